@@ -29,8 +29,11 @@
 
 #ifndef _GZIP_ENCODING_H_
 #define _GZIP_ENCODING_H_
+#include <algorithm>
+#include <string>
+#include <zlib.h>
+#include "misc_log_ex.h"
 #include "net/http_client_base.h"
-#include "zlib/zlib.h"
 //#include "http.h"
 
 
@@ -38,6 +41,27 @@ namespace epee
 {
 namespace net_utils
 {
+	/*! \brief
+	*	Compresses a whole buffer as a gzip stream, for a "Content-Encoding: gzip" body
+	*/
+	inline
+	bool gzip_pack(const std::string& in, std::string& out, int level = Z_BEST_SPEED)
+	{
+		z_stream zstream;
+		memset(&zstream, 0, sizeof(zstream));
+		if (deflateInit2(&zstream, level, Z_DEFLATED, 0x1F, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return false;
+		out.resize(deflateBound(&zstream, (uLong)in.size()));
+		zstream.next_in = (Bytef*)in.data();
+		zstream.avail_in = (uInt)in.size();
+		zstream.next_out = (Bytef*)&out[0];
+		zstream.avail_out = (uInt)out.size();
+		const int ret = deflate(&zstream, Z_FINISH);
+		deflateEnd(&zstream);
+		CHECK_AND_ASSERT_MES(ret == Z_STREAM_END, false, "gzip_pack: failed to deflate, err = " << ret);
+		out.resize(out.size() - zstream.avail_out);
+		return true;
+	}
 
 
 
@@ -96,7 +120,8 @@ namespace net_utils
 
 			std::string decode_summary_buff;
 
-			size_t	ungzip_size = m_pre_decode.size() * 0x30;
+			// the loop below carries on when the output fills up, no need for huge buffers on big pieces
+			size_t	ungzip_size = std::min<size_t>(m_pre_decode.size() * 0x30, 1024 * 1024);
 			std::string current_decode_buff(ungzip_size, 'X');
 
 			//Here the cycle is introduced where we unpack the buffer, the cycle is required
@@ -181,7 +206,7 @@ namespace net_utils
 		*
 		*/
 		inline 
-		virtual void stop(std::string& OUT collect_remains)
+		virtual void stop(std::string& collect_remains)
 		{
 		}
 	protected:
@@ -68,4 +68,15 @@ namespace epee
     //! Write `src` bytes as hex to `out`. `out` must be twice the length
     static void buffer_unchecked(char* out, const span<const std::uint8_t> src) noexcept;
   };
+
+  struct from_hex
+  {
+    /*! Write the bytes of hex string `src` to `out`, which must be half its
+        length. Upper and lower case digits are accepted, nothing else.
+        \return False if the lengths do not match or `src` is not all hex. */
+    static bool buffer(span<std::uint8_t> out, const span<const char> src) noexcept;
+
+    //! \return The value of hex digit `c`, or -1 if it is not one.
+    static int nibble(char c) noexcept;
+  };
 }
@@ -36,14 +36,23 @@
 #define MAX_LOG_FILE_SIZE 104850000 // 100 MB - 7600 bytes
 #define MAX_LOG_FILES 50
 
-#define MCFATAL(cat,x) CLOG(FATAL,cat) << x
-#define MCERROR(cat,x) CLOG(ERROR,cat) << x
-#define MCWARNING(cat,x) CLOG(WARNING,cat) << x
-#define MCINFO(cat,x) CLOG(INFO,cat) << x
-#define MCDEBUG(cat,x) CLOG(DEBUG,cat) << x
-#define MCTRACE(cat,x) CLOG(TRACE,cat) << x
-#define MCLOG(level,cat,x) ELPP_WRITE_LOG(el::base::Writer, level, el::base::DispatchAction::NormalLog, cat) << x
-#define MCLOG_FILE(level,cat,x) ELPP_WRITE_LOG(el::base::Writer, level, el::base::DispatchAction::FileOnlyLog, cat) << x
+#define MLOG_ASYNC_QUEUE_SIZE 16384 // lines
+
+// the level is checked before anything is built, so disabled log lines
+// do not evaluate their arguments
+#define MCLOG_TYPE(level,cat,type,x) do { \
+    if (mlog_allowed(level, cat)) \
+      ELPP_WRITE_LOG(el::base::Writer, level, type, cat) << x; \
+  } while (0)
+
+#define MCFATAL(cat,x) MCLOG_TYPE(el::Level::Fatal,cat,el::base::DispatchAction::NormalLog,x)
+#define MCERROR(cat,x) MCLOG_TYPE(el::Level::Error,cat,el::base::DispatchAction::NormalLog,x)
+#define MCWARNING(cat,x) MCLOG_TYPE(el::Level::Warning,cat,el::base::DispatchAction::NormalLog,x)
+#define MCINFO(cat,x) MCLOG_TYPE(el::Level::Info,cat,el::base::DispatchAction::NormalLog,x)
+#define MCDEBUG(cat,x) MCLOG_TYPE(el::Level::Debug,cat,el::base::DispatchAction::NormalLog,x)
+#define MCTRACE(cat,x) MCLOG_TYPE(el::Level::Trace,cat,el::base::DispatchAction::NormalLog,x)
+#define MCLOG(level,cat,x) MCLOG_TYPE(level,cat,el::base::DispatchAction::NormalLog,x)
+#define MCLOG_FILE(level,cat,x) MCLOG_TYPE(level,cat,el::base::DispatchAction::FileOnlyLog,x)
 
 #define MCLOG_COLOR(level,cat,color,x) MCLOG(level,cat,"\033[1;" color "m" << x << "\033[0m")
 #define MCLOG_RED(level,cat,x) MCLOG_COLOR(level,cat,"31",x)
@@ -111,6 +120,9 @@ void mlog_set_categories(const char *categories);
 std::string mlog_get_categories();
 void mlog_set_log_level(int level);
 void mlog_set_log(const char *log);
+bool mlog_allowed(el::Level level, const char *category);
+bool mlog_set_async(bool async, std::size_t queue_size = MLOG_ASYNC_QUEUE_SIZE);
+bool mlog_is_async();
 
 namespace epee
 {
@@ -28,8 +28,11 @@
 
 #pragma once 
 
-#include <map>
-#include <boost/thread/mutex.hpp>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stddef.h>
 
 namespace epee
 {
@@ -47,11 +50,11 @@ namespace epee
     static void unlock(void *ptr, size_t len);
 
   private:
-    static size_t page_size;
-    static size_t num_locked_objects;
+    struct shard;
 
-    static boost::mutex &mutex();
-    static std::map<size_t, unsigned int> &map();
+    static std::atomic<size_t> num_locked_objects;
+
+    static shard &get_shard(size_t page);
     static void lock_page(size_t page);
     static void unlock_page(size_t page);
 
@@ -59,6 +62,62 @@ namespace epee
     size_t len;
   };
 
+  /// A few slabs locked once when first used, carved into power of two blocks
+  ///
+  /// Secrets allocated here need no mlock call or page refcounting of their
+  /// own, and each block size has its own free list lock. Blocks are wiped
+  /// when freed.
+  class mlocked_arena
+  {
+  public:
+    /// returns NULL if the size is too large or the arena is exhausted
+    static void *allocate(size_t size);
+    /// returns false if ptr was not allocated by the arena
+    static bool deallocate(void *ptr, size_t size);
+    static bool contains(const void *ptr, size_t len);
+
+    static size_t get_size();
+    static size_t get_num_allocated_blocks();
+
+    static const size_t max_block_size = 4096;
+  };
+
+  /// Allocates from the locked arena, or falls back to mlocking heap memory
+  template<typename T>
+  struct mlocked_allocator
+  {
+    typedef T value_type;
+
+    mlocked_allocator() noexcept {}
+    template<typename U> mlocked_allocator(const mlocked_allocator<U>&) noexcept {}
+
+    T *allocate(size_t n)
+    {
+      if (n > ((size_t)-1) / sizeof(T))
+        throw std::bad_alloc();
+      const size_t bytes = n * sizeof(T);
+      void *ptr = mlocked_arena::allocate(bytes);
+      if (ptr)
+        return (T*)ptr;
+      T *t = std::allocator<T>().allocate(n);
+      mlocker::lock(t, bytes);
+      return t;
+    }
+
+    void deallocate(T *t, size_t n)
+    {
+      if (mlocked_arena::deallocate(t, n * sizeof(T)))
+        return;
+      mlocker::unlock(t, n * sizeof(T));
+      std::allocator<T>().deallocate(t, n);
+    }
+  };
+
+  template<typename T, typename U>
+  bool operator==(const mlocked_allocator<T>&, const mlocked_allocator<U>&) noexcept { return true; }
+  template<typename T, typename U>
+  bool operator!=(const mlocked_allocator<T>&, const mlocked_allocator<U>&) noexcept { return false; }
+
   /// Locks memory while in scope
   ///
   /// Primarily useful for making sure that private keys don't get swapped out
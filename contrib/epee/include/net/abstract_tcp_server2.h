@@ -56,6 +56,7 @@
 #include "syncobj.h"
 #include "connection_basic.hpp"
 #include "network_throttle-detail.hpp"
+#include "timer_wheel.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net"
@@ -118,7 +119,8 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb); ///< (see do_send from i_service_endpoint)
-    virtual bool do_send_chunk(const void* ptr, size_t cb); ///< will send (or queue) a part of data
+    virtual bool do_send(const std::shared_ptr<const std::string>& buff); ///< queues slices of buff without copying it (see i_service_endpoint)
+    virtual bool do_send_chunk(const std::shared_ptr<const std::string>& buff, size_t offset, size_t cb); ///< will send (or queue) a part of buff
     virtual bool send_done();
     virtual bool close();
     virtual bool call_run_once_service_io();
@@ -168,7 +170,8 @@ namespace net_utils
     boost::mutex m_throttle_speed_in_mutex;
     boost::mutex m_throttle_speed_out_mutex;
 
-    boost::asio::deadline_timer m_timer;
+    timer_wheel& m_wheel;
+    timer_wheel::timer_id m_timer_id; //!< idle timeout, RPC connections only
     bool m_local;
     bool m_ready_to_close;
     std::string m_host;
@@ -214,6 +217,14 @@ namespace net_utils
 
     void set_threads_prefix(const std::string& prefix_name);
 
+    /// Splits the worker threads over this many io_services, each connection
+    /// staying on the one it was created on, so threads serving different
+    /// connections do not contend on a single io_service. The acceptor and
+    /// idle handlers get an io_service of their own. Only servers owning
+    /// their io_service can be sharded; 0 or 1 keeps a single shared one.
+    /// Must be called before run_server.
+    void set_io_shards(size_t shards);
+
     bool deinit_server(){return true;}
 
     size_t get_threads_count(){return m_threads_count;}
@@ -296,8 +307,12 @@ namespace net_utils
     typename t_protocol_handler::config_type m_config;
 
   private:
-    /// Run the server's io_service loop.
-    bool worker_thread();
+    /// Run the given io_service's loop.
+    bool worker_thread(boost::asio::io_service* io_service);
+    /// io_service for a new connection, avoiding the caller's own shard if
+    /// it is going to block waiting on the connection
+    boost::asio::io_service& get_connection_io_service(bool avoid_current);
+    static boost::asio::io_service*& current_io_service();
     /// Handle completion of an asynchronous accept operation.
     void handle_accept(const boost::system::error_code& e);
 
@@ -307,6 +322,12 @@ namespace net_utils
     std::unique_ptr<boost::asio::io_service> m_io_service_local_instance;
     boost::asio::io_service& io_service_;    
 
+    /// connection io_services when sharded, io_service_ then only runs the acceptor and idle handlers
+    size_t m_io_shards_count;
+    std::vector<std::unique_ptr<boost::asio::io_service>> m_io_shards;
+    std::vector<std::unique_ptr<boost::asio::io_service::work>> m_io_shards_work;
+    std::atomic<size_t> m_next_io_shard;
+
     /// Acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor acceptor_;
 
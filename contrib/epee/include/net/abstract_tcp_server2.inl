@@ -85,7 +85,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		m_connection_type( connection_type ),
 		m_throttle_speed_in("speed_in", "throttle_speed_in"),
 		m_throttle_speed_out("speed_out", "throttle_speed_out"),
-		m_timer(io_service),
+		m_wheel(timer_wheel::get(io_service)),
+		m_timer_id(0),
 		m_local(false),
 		m_ready_to_close(false)
   {
@@ -297,29 +298,14 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			context.m_current_speed_down = m_throttle_speed_in.get_current_speed();
 		}
     
-    {
-			CRITICAL_REGION_LOCAL(	epee::net_utils::network_throttle_manager::network_throttle_manager::m_lock_get_global_throttle_in );
-			epee::net_utils::network_throttle_manager::network_throttle_manager::get_global_throttle_in().handle_trafic_exact(bytes_transferred);
-		}
-
-		double delay=0; // will be calculated - how much we should sleep to obey speed limit etc
-
-
 		if (speed_limit_is_enabled()) {
-			do // keep sleeping if we should sleep
-			{
-				{ //_scope_dbg1("CRITICAL_REGION_LOCAL");
-					CRITICAL_REGION_LOCAL(	epee::net_utils::network_throttle_manager::m_lock_get_global_throttle_in );
-					delay = epee::net_utils::network_throttle_manager::get_global_throttle_in().get_sleep_time_after_tick( bytes_transferred );
-				}
-				
-				delay *= 0.5;
-				if (delay > 0) {
-					long int ms = (long int)(delay * 100);
-					reset_timer(boost::posix_time::milliseconds(ms + 1), true);
-					boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
-				}
-			} while(delay > 0);
+			// the data is already here, so pay for it by delaying the next read
+			const double delay = epee::net_utils::network_throttle_manager::get_global_throttle_in().reserve(bytes_transferred);
+			if (delay > 0) {
+				long int ms = (long int)(delay * 1000);
+				reset_timer(boost::posix_time::milliseconds(ms + 1), true);
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(ms));
+			}
 		} // any form of sleeping
 		
       //_info("[sock " << socket_.native_handle() << "] RECV " << bytes_transferred);
@@ -403,12 +389,22 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb) {
     TRY_ENTRY();
+    // copy the caller's data once; the chunks below are then slices of this buffer
+    return do_send(std::make_shared<const std::string>((const char*)ptr, cb));
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+  }
+  //---------------------------------------------------------------------------------
+    template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send(const std::shared_ptr<const std::string>& buff) {
+    TRY_ENTRY();
 
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
     auto self = safe_shared_from_this();
     if (!self) return false;
     if (m_was_shutdown) return false;
-		// TODO avoid copy
+    CHECK_AND_ASSERT_MES(buff, false, "Null send buffer");
+    const char* ptr = buff->data();
+    const size_t cb = buff->size();
 
 		const double factor = 32; // TODO config
 		typedef long long signed int t_safe; // my t_size to avoid any overunderflow in arithmetic
@@ -446,14 +442,9 @@ PRAGMA_WARNING_DISABLE_VS(4355)
                     CHECK_AND_ASSERT_MES(len>0, false, "len not strictly positive"); // (redundant)
                     CHECK_AND_ASSERT_MES(len_unsigned < std::numeric_limits<size_t>::max(), false, "Invalid len_unsigned");   // yeap we want strong < then max size, to be sure
 					
-					void *chunk_start = ((char*)ptr) + pos;
-					MDEBUG("chunk_start="<<chunk_start<<" ptr="<<ptr<<" pos="<<pos);
-					CHECK_AND_ASSERT_MES(chunk_start >= ptr, false, "Pointer wraparound"); // not wrapped around address?
-					//std::memcpy( (void*)buf, chunk_start, len);
-
 					MDEBUG("part of " << lenall << ": pos="<<pos << " len="<<len);
 
-					bool ok = do_send_chunk(chunk_start, len); // <====== ***
+					bool ok = do_send_chunk(buff, pos, len); // <====== ***
 
 					all_ok = all_ok && ok;
 					if (!all_ok) {
@@ -476,7 +467,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			} // LOCK: chunking
 		} // a big block (to be chunked) - all chunks
 		else { // small block
-			return do_send_chunk(ptr,cb); // just send as 1 big chunk
+			return do_send_chunk(buff, 0, cb); // just send as 1 big chunk
 		}
 
     CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
@@ -484,7 +475,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool connection<t_protocol_handler>::do_send_chunk(const void* ptr, size_t cb)
+  bool connection<t_protocol_handler>::do_send_chunk(const std::shared_ptr<const std::string>& buff, size_t offset, size_t cb)
   {
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -535,8 +526,9 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         }
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    CHECK_AND_ASSERT_MES(offset <= buff->size() && cb <= buff->size() - offset, false, "Send chunk out of buffer bounds");
+    m_send_que.push_back(send_que_entry{buff, offset, cb});
+    on_send_que_push(m_send_que.back());
     
     if(m_send_que.size() > 1)
     { // active operation should be in progress, nothing to do, just wait last operation callback
@@ -558,7 +550,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
         auto size_now = m_send_que.front().size();
         MDEBUG("do_send_chunk() NOW SENSD: packet="<<size_now<<" B");
         if (speed_limit_is_enabled())
-			do_send_handler_write( ptr , size_now ); // (((H)))
+			do_send_handler_write( m_send_que.front().data() , size_now ); // (((H)))
 
         CHECK_AND_ASSERT_MES( size_now == m_send_que.front().size(), false, "Unexpected queue size");
         reset_timer(get_default_timeout(), false);
@@ -597,7 +589,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   boost::posix_time::milliseconds connection<t_protocol_handler>::get_timeout_from_bytes_read(size_t bytes)
   {
     boost::posix_time::milliseconds ms = (boost::posix_time::milliseconds)(unsigned)(bytes * TIMEOUT_EXTRA_MS_PER_BYTE);
-    ms += m_timer.expires_from_now();
+    ms += boost::posix_time::milliseconds(m_wheel.remaining(m_timer_id).count());
     if (ms > get_default_timeout())
       ms = get_default_timeout();
     return ms;
@@ -633,13 +625,19 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return;
     }
     if (add)
-      ms += m_timer.expires_from_now();
-    m_timer.expires_from_now(ms);
-    m_timer.async_wait([=](const boost::system::error_code& ec)
+      ms += boost::posix_time::milliseconds(m_wheel.remaining(m_timer_id).count());
+    const std::chrono::milliseconds timeout(ms.total_milliseconds());
+    if (m_wheel.reset(m_timer_id, timeout))
+      return;
+    // the wheel may call back after the connection is gone, so it is
+    // only weakly held
+    boost::weak_ptr<connection<t_protocol_handler>> weak_self = self;
+    m_timer_id = m_wheel.add(timeout, [weak_self]()
     {
-      if(ec == boost::asio::error::operation_aborted)
+      auto self = weak_self.lock();
+      if (!self)
         return;
-      MDEBUG(context << "connection timeout, closing");
+      MDEBUG(self->context << "connection timeout, closing");
       self->close();
     });
   }
@@ -652,7 +650,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return true;
     m_was_shutdown = true;
     // Initiate graceful connection closure.
-    m_timer.cancel();
+    m_wheel.cancel(m_timer_id);
     boost::system::error_code ignored_ec;
     socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored_ec);
     if (!m_host.empty())
@@ -673,7 +671,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     if(!self)
       return false;
     //_info("[sock " << socket_.native_handle() << "] Que Shutdown called.");
-    m_timer.cancel();
+    m_wheel.cancel(m_timer_id);
     size_t send_que_size = 0;
     CRITICAL_REGION_BEGIN(m_send_que_lock);
     send_que_size = m_send_que.size();
@@ -730,6 +728,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return;
     }
 
+    on_send_que_pop(m_send_que.front());
     m_send_que.pop_front();
     if(m_send_que.empty())
     {
@@ -784,6 +783,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server( t_connection_type connection_type ) :
     m_io_service_local_instance(new boost::asio::io_service()),
     io_service_(*m_io_service_local_instance.get()),
+    m_io_shards_count(0),
+    m_next_io_shard(0),
     acceptor_(io_service_),
     m_stop_signal_sent(false), m_port(0), 
 	m_sock_count(0), m_sock_number(0), m_threads_count(0), 
@@ -798,6 +799,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   template<class t_protocol_handler>
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service, t_connection_type connection_type) :
     io_service_(extarnal_io_service),
+    m_io_shards_count(0),
+    m_next_io_shard(0),
     acceptor_(io_service_),
     m_stop_signal_sent(false), m_port(0), 
 		m_sock_count(0), m_sock_number(0), m_threads_count(0), 
@@ -842,7 +845,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
     m_port = binded_endpoint.port();
     MDEBUG("start accept");
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+    new_connection_.reset(new connection<t_protocol_handler>(get_connection_io_service(false), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
     acceptor_.async_accept(new_connection_->socket(),
       boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
       boost::asio::placeholders::error));
@@ -877,19 +880,20 @@ DISABLE_GCC_WARNING(maybe-uninitialized)
 POP_WARNINGS
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool boosted_tcp_server<t_protocol_handler>::worker_thread()
+  bool boosted_tcp_server<t_protocol_handler>::worker_thread(boost::asio::io_service* io_service)
   {
     TRY_ENTRY();
     uint32_t local_thr_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index); 
     std::string thread_name = std::string("[") + m_thread_name_prefix;
     thread_name += boost::to_string(local_thr_index) + "]";
     MLOG_SET_THREAD_NAME(thread_name);
+    current_io_service() = io_service;
     //   _fact("Thread name: " << m_thread_name_prefix);
     while(!m_stop_signal_sent)
     {
       try
       {
-        io_service_.run();
+        io_service->run();
       }
       catch(const std::exception& ex)
       {
@@ -916,6 +920,35 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::set_io_shards(size_t shards)
+  {
+    if (shards > 1 && !m_io_service_local_instance)
+    {
+      MWARNING("Can not shard a server running on an external io_service");
+      return;
+    }
+    m_io_shards_count = shards;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service*& boosted_tcp_server<t_protocol_handler>::current_io_service()
+  {
+    static thread_local boost::asio::io_service* io_service = NULL;
+    return io_service;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::get_connection_io_service(bool avoid_current)
+  {
+    if (m_io_shards.empty())
+      return io_service_;
+    size_t shard = m_next_io_shard++ % m_io_shards.size();
+    if (avoid_current && m_io_shards.size() > 1 && m_io_shards[shard].get() == current_io_service())
+      shard = (shard + 1) % m_io_shards.size();
+    return *m_io_shards[shard];
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void boosted_tcp_server<t_protocol_handler>::set_connection_filter(i_connection_filter* pfilter)
   {
     m_pfilter = pfilter;
@@ -933,10 +966,24 @@ POP_WARNINGS
 
       // Create a pool of threads to run all of the io_services.
       CRITICAL_REGION_BEGIN(m_threads_lock);
-      for (std::size_t i = 0; i < threads_count; ++i)
+      if (m_io_shards_count > 1 && m_io_shards.empty())
+      {
+        for (size_t i = 0; i < m_io_shards_count; ++i)
+        {
+          m_io_shards.emplace_back(new boost::asio::io_service());
+          // keeps run() from returning while a shard has no connections
+          m_io_shards_work.emplace_back(new boost::asio::io_service::work(*m_io_shards.back()));
+        }
+      }
+      // when sharded, the acceptor and idle handlers keep their share of the threads,
+      // and each connection shard gets at least one
+      const size_t control_threads = m_io_shards.empty() ? threads_count : std::max<size_t>(1, threads_count / (m_io_shards.size() + 1));
+      const size_t shard_threads = m_io_shards.empty() ? 0 : std::max(m_io_shards.size(), threads_count - control_threads);
+      for (std::size_t i = 0; i < control_threads + shard_threads; ++i)
       {
+        boost::asio::io_service* io_service = i < control_threads ? &io_service_ : m_io_shards[(i - control_threads) % m_io_shards.size()].get();
         boost::shared_ptr<boost::thread> thread(new boost::thread(
-          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this)));
+          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, io_service)));
           _note("Run server thread name: " << m_thread_name_prefix);
         m_threads.push_back(thread);
       }
@@ -1022,6 +1069,9 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_service_.stop();
+    m_io_shards_work.clear();
+    for (auto &io_service: m_io_shards)
+      io_service->stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
@@ -1044,7 +1094,7 @@ POP_WARNINGS
 			new_connection_->setRpcStation(); // hopefully this is not needed actually
 		}
 		connection_ptr conn(std::move(new_connection_));
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+      new_connection_.reset(new connection<t_protocol_handler>(get_connection_io_service(false), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
       acceptor_.async_accept(new_connection_->socket(),
         boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
         boost::asio::placeholders::error));
@@ -1069,7 +1119,7 @@ POP_WARNINGS
     // error path, if e or exception
     _erro("Some problems at accept: " << e.message() << ", connections_count = " << m_sock_count);
     misc_utils::sleep_no_w(100);
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+    new_connection_.reset(new connection<t_protocol_handler>(get_connection_io_service(false), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
     acceptor_.async_accept(new_connection_->socket(),
       boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
       boost::asio::placeholders::error));
@@ -1080,7 +1130,8 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
+    // we block below until the connect completes, so it must not land on our own shard
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(get_connection_io_service(true), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1197,7 +1248,7 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, const t_callback &cb, const std::string& bind_ip)
   {
     TRY_ENTRY();    
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(get_connection_io_service(false), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1233,7 +1284,7 @@ POP_WARNINGS
       }
     }
     
-    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(sock_.get_io_service()));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
@@ -82,6 +82,18 @@ class connection_basic_pimpl; // PIMPL for this class
   
   std::string to_string(t_connection_type type);
 
+  /// A slice of an immutable, reference counted send buffer. The same buffer
+  /// may sit in the send queues of many connections at once.
+  struct send_que_entry
+  {
+    std::shared_ptr<const std::string> buffer;
+    size_t offset;
+    size_t length;
+
+    const char* data() const { return buffer->data() + offset; }
+    size_t size() const { return length; }
+  };
+
 class connection_basic { // not-templated base class for rapid developmet of some code parts
 	public:
 		std::unique_ptr< connection_basic_pimpl > mI; // my Implementation
@@ -90,7 +102,7 @@ class connection_basic { // not-templated base class for rapid developmet of som
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    std::list<send_que_entry> m_send_que;
     volatile bool m_is_multithreaded;
     /// Strand to ensure the connection's handlers are not called concurrently.
     boost::asio::io_service::strand strand_;
@@ -128,6 +140,16 @@ class connection_basic { // not-templated base class for rapid developmet of som
 		static double get_sleep_time(size_t cb);
 		
 		static void set_save_graph(bool save_graph);
+
+		// entries and bytes waiting in the send queues of all connections; a
+		// buffer queued on several connections counts once per connection
+		static void get_send_que_totals(uint64_t &count, uint64_t &bytes);
+		void on_send_que_push(const send_que_entry &entry);
+		void on_send_que_pop(const send_que_entry &entry);
+
+	private:
+		static std::atomic<uint64_t> s_send_que_count;
+		static std::atomic<uint64_t> s_send_que_bytes;
 };
 
 } // nameserver
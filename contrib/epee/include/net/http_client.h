@@ -375,6 +375,9 @@ namespace net_utils
 				req_buff.append(method.data(), method.size()).append(" ").append(uri.data(), uri.size()).append(" HTTP/1.1\r\n");
 				add_field(req_buff, "Host", m_host_buff);
 				add_field(req_buff, "Content-Length", std::to_string(body.size()));
+#ifdef HTTP_ENABLE_GZIP
+				add_field(req_buff, "Accept-Encoding", "gzip");
+#endif
 
 				//handle "additional_params"
 				for(const auto& field : additional_params)
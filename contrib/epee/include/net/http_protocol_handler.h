@@ -125,6 +125,7 @@ namespace net_utils
 			bool slash_to_back_slash(std::string& str);
 			std::string get_file_mime_tipe(const std::string& path);
 			std::string get_response_header(const http_response_info& response);
+			bool accepts_gzip(const http_header_info& header_info);
 
 			//major function 
 			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
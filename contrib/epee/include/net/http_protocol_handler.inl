@@ -25,14 +25,17 @@
 // 
 
 
-#include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
+#include <ctype.h>
+#include <limits>
 #include "http_protocol_handler.h"
-#include "reg_exp_definer.h"
 #include "string_tools.h"
 #include "file_io_utils.h"
 #include "net_parse_helpers.h"
 #include "time_helper.h"
+#ifdef HTTP_ENABLE_GZIP
+#include "gzip_encoding.h"
+#endif
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
@@ -40,6 +43,7 @@
 #define HTTP_MAX_URI_LEN		 9000 
 #define HTTP_MAX_HEADER_LEN		 100000
 #define HTTP_MAX_STARTING_NEWLINES       8
+#define HTTP_GZIP_MIN_BODY_SIZE          1024
 
 namespace epee
 {
@@ -56,55 +60,86 @@ namespace net_utils
 			std::string m_body;
 		};
 
-		inline
-			bool match_boundary(const std::string& content_type, std::string& boundary)
+		//The request line, headers and their values are scanned in place: nothing
+		//is allocated until a value is stored in the request info.
+		inline bool token_equals_no_case(const char *ptr, size_t len, const char *literal)
 		{
-			STATIC_REGEXP_EXPR_1(rexp_match_boundary, "boundary=(.*?)(($)|([;\\s,]))", boost::regex::icase | boost::regex::normal);
-			//											        1
-			boost::smatch result;	
-			if(boost::regex_search(content_type, result, rexp_match_boundary, boost::match_default) && result[0].matched)
+			for(size_t i = 0; i < len; ++i, ++literal)
 			{
-				boundary = result[1];
-				return true;
+				if(!*literal || tolower((unsigned char)ptr[i]) != tolower((unsigned char)*literal))
+					return false;
 			}
+			return !*literal;
+		}
 
-			return false;
+		inline bool is_token_char(char c)
+		{
+			return isalnum((unsigned char)c) || c == '_' || c == '-';
 		}
 
-		inline 
-			bool parse_header(std::string::const_iterator it_begin, std::string::const_iterator it_end, multipart_entry& entry)
+		//calls f(name, name_len, value, value_len) for every "name: value" line in
+		//[ptr, end); other lines (blank, folded or malformed ones) are skipped
+		template<typename F>
+		inline void for_each_header_field(const char *ptr, const char *end, F f)
 		{
-			STATIC_REGEXP_EXPR_1(rexp_mach_field, 
-				"\n?((Content-Disposition)|(Content-Type)"
-				//  12                     3 
-				"|([\\w-]+?)) ?: ?((.*?)(\r?\n))[^\t ]",	
-				//4               56    7 
-				boost::regex::icase | boost::regex::normal);
-
-			boost::smatch		result;
-			std::string::const_iterator it_current_bound = it_begin;
-			std::string::const_iterator it_end_bound = it_end;
-
-			//lookup all fields and fill well-known fields
-			while( boost::regex_search( it_current_bound, it_end_bound, result, rexp_mach_field, boost::match_default) && result[0].matched) 
+			while(ptr < end)
 			{
-				const size_t field_val = 6;
-				const size_t field_etc_name = 4;
-
-				int i = 2; //start position = 2
-				if(result[i++].matched)//"Content-Disposition"
-					entry.m_content_disposition = result[field_val];
-				else if(result[i++].matched)//"Content-Type"
-					entry.m_content_type = result[field_val];
-				else if(result[i++].matched)//e.t.c (HAVE TO BE MATCHED!)
-					entry.m_etc_header_fields.push_back(std::pair<std::string, std::string>(result[field_etc_name], result[field_val]));
-				else
+				const char *line_end = (const char*)memchr(ptr, '\n', end - ptr);
+				if(!line_end)
+					line_end = end;
+				const char *key_pos = ptr;
+				while(ptr < line_end && is_token_char(*ptr))
+					++ptr;
+				const char *key_end = ptr;
+				// optional space (not in RFC, but in previous code)
+				if(ptr < line_end && *ptr == ' ')
+					++ptr;
+				if(key_end != key_pos && ptr < line_end && *ptr == ':')
 				{
-					LOG_ERROR("simple_http_connection_handler::parse_header() not matched last entry in:"<<std::string(it_current_bound, it_end));
+					++ptr;
+					while(ptr < line_end && (*ptr == ' ' || *ptr == '\t'))
+						++ptr;
+					const char *value_end = line_end;
+					while(value_end > ptr && isspace((unsigned char)value_end[-1]))
+						--value_end;
+					f(key_pos, key_end - key_pos, ptr, value_end - ptr);
 				}
+				ptr = line_end + 1;
+			}
+		}
 
-				it_current_bound = result[(int)result.size()-1].first;
+		inline
+			bool match_boundary(const std::string& content_type, std::string& boundary)
+		{
+			static const char name[] = "boundary=";
+			static const size_t name_len = sizeof(name) - 1;
+			for(size_t pos = 0; pos + name_len <= content_type.size(); ++pos)
+			{
+				if(token_equals_no_case(content_type.data() + pos, name_len, name))
+				{
+					const size_t start = pos + name_len;
+					size_t stop = start;
+					while(stop < content_type.size() && content_type[stop] != ';' && content_type[stop] != ',' && !isspace((unsigned char)content_type[stop]))
+						++stop;
+					boundary.assign(content_type, start, stop - start);
+					return true;
+				}
 			}
+			return false;
+		}
+
+		inline 
+			bool parse_header(std::string::const_iterator it_begin, std::string::const_iterator it_end, multipart_entry& entry)
+		{
+			const char *begin = &*it_begin;
+			for_each_header_field(begin, begin + (it_end - it_begin), [&entry](const char *key, size_t key_len, const char *value, size_t value_len) {
+				if(token_equals_no_case(key, key_len, "Content-Disposition"))
+					entry.m_content_disposition.assign(value, value_len);
+				else if(token_equals_no_case(key, key_len, "Content-Type"))
+					entry.m_content_type.assign(value, value_len);
+				else
+					entry.m_etc_header_fields.emplace_back(std::string(key, key_len), std::string(value, value_len));
+			});
 			return  true;
 		}
 
@@ -326,69 +361,93 @@ namespace net_utils
 		return true;
 	}
 	//--------------------------------------------------------------------------------------------
-	inline bool analize_http_method(const boost::smatch& result, http::http_method& method, int& http_ver_major, int& http_ver_minor)
+	inline bool analize_http_method(const char *ptr, size_t len, http::http_method& method)
 	{
-		CHECK_AND_ASSERT_MES(result[0].matched, false, "simple_http_connection_handler::analize_http_method() assert failed...");
-		if (!boost::conversion::try_lexical_convert<int>(result[11], http_ver_major))
-			return false;
-		if (!boost::conversion::try_lexical_convert<int>(result[12], http_ver_minor))
-			return false;
-
-		if(result[3].matched)
+		if(token_equals_no_case(ptr, len, "OPTIONS"))
 			method = http::http_method_options;
-		else if(result[4].matched)
+		else if(token_equals_no_case(ptr, len, "GET"))
 			method = http::http_method_get;
-		else if(result[5].matched)
+		else if(token_equals_no_case(ptr, len, "HEAD"))
 			method = http::http_method_head;
-		else if(result[6].matched)
+		else if(token_equals_no_case(ptr, len, "POST"))
 			method = http::http_method_post;
-		else if(result[7].matched)
+		else if(token_equals_no_case(ptr, len, "PUT"))
 			method = http::http_method_put;
-		else 
+		else if(token_equals_no_case(ptr, len, "DELETE") || token_equals_no_case(ptr, len, "TRACE"))
 			method = http::http_method_etc;
-
+		else
+			return false;
 		return true;
 	}
 
+	inline const char *parse_http_version_number(const char *ptr, const char *end, int& number)
+	{
+		if(ptr == end || !isdigit((unsigned char)*ptr))
+			return NULL;
+		number = 0;
+		for(; ptr < end && isdigit((unsigned char)*ptr); ++ptr)
+		{
+			if(number > (std::numeric_limits<int>::max() - 9) / 10)
+				return NULL;
+			number = number * 10 + (*ptr - '0');
+		}
+		return ptr;
+	}
+
   //--------------------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_invoke_query_line()
 	{ 
-		STATIC_REGEXP_EXPR_1(rexp_match_command_line, "^(((OPTIONS)|(GET)|(HEAD)|(POST)|(PUT)|(DELETE)|(TRACE)) (\\S+) HTTP/(\\d+)\\.(\\d+))\r?\n", boost::regex::icase | boost::regex::normal);
-		//											    123         4     5      6      7     8        9        10          11     12    
-		//size_t match_len = 0;
-		boost::smatch result;	
-		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
+		//First request line, look like this: "POST /json_rpc HTTP/1.1"
+		const char *const begin = m_cache.data();
+		const char *const end = begin + m_cache.size();
+		const char *ptr = begin;
+
+		const char *method_pos = ptr;
+		while(ptr < end && isalpha((unsigned char)*ptr))
+			++ptr;
+		const char *method_end = ptr;
+		bool ok = analize_http_method(method_pos, method_end - method_pos, m_query_info.m_http_method) && ptr < end && *ptr++ == ' ';
+
+		const char *uri_pos = ptr;
+		while(ok && ptr < end && !isspace((unsigned char)*ptr))
+			++ptr;
+		const char *uri_end = ptr;
+		ok = ok && uri_end != uri_pos && ptr < end && *ptr++ == ' ';
+
+		ok = ok && end - ptr >= 5 && token_equals_no_case(ptr, 5, "HTTP/");
+		if(ok)
+			ptr = parse_http_version_number(ptr + 5, end, m_query_info.m_http_ver_hi);
+		ok = ok && ptr && ptr < end && *ptr++ == '.';
+		if(ok)
+			ptr = parse_http_version_number(ptr, end, m_query_info.m_http_ver_lo);
+		ok = ok && ptr;
+		if(ok && ptr < end && *ptr == '\r')
+			++ptr;
+		ok = ok && ptr < end && *ptr++ == '\n';
+
+		if(!ok)
 		{
-			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi))
-			{
-				m_state = http_state_error;
-				MERROR("Failed to analyze method");
-				return false;
-			}
-			m_query_info.m_URI = result[10];
-			if (!parse_uri(m_query_info.m_URI, m_query_info.m_uri_content))
-			{
-				m_state = http_state_error;
-				MERROR("Failed to parse URI: m_query_info.m_URI");
-				return false;
-			}
-			m_query_info.m_http_method_str = result[2];
-			m_query_info.m_full_request_str = result[0];
-
-			m_cache.erase(m_cache.begin(),  to_nonsonst_iterator(m_cache, result[0].second));
-
-			m_state = http_state_retriving_header;
+			m_state = http_state_error;
+			LOG_ERROR_CC(m_conn_context, "simple_http_connection_handler<t_connection_context>::handle_invoke_query_line(): Failed to match first line: " << m_cache);
+			return false;
+		}
 
-			return true;
-		}else
+		m_query_info.m_URI.assign(uri_pos, uri_end - uri_pos);
+		if (!parse_uri(m_query_info.m_URI, m_query_info.m_uri_content))
 		{
 			m_state = http_state_error;
-			LOG_ERROR_CC(m_conn_context, "simple_http_connection_handler<t_connection_context>::handle_invoke_query_line(): Failed to match first line: " << m_cache);
+			MERROR("Failed to parse URI: m_query_info.m_URI");
 			return false;
 		}
+		m_query_info.m_http_method_str.assign(method_pos, method_end - method_pos);
+		m_query_info.m_full_request_str.assign(begin, ptr - begin);
 
-		return false;
+		m_cache.erase(0, ptr - begin);
+
+		m_state = http_state_retriving_header;
+
+		return true;
 	}
 	//--------------------------------------------------------------------------------------------
   template<class t_connection_context>
@@ -501,69 +560,54 @@ namespace net_utils
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::parse_cached_header(http_header_info& body_info, const std::string& m_cache_to_process, size_t pos)
 	{ 
-		STATIC_REGEXP_EXPR_1(rexp_mach_field, 
-			"\n?((Connection)|(Referer)|(Content-Length)|(Content-Type)|(Transfer-Encoding)|(Content-Encoding)|(Host)|(Cookie)|(User-Agent)|(Origin)"
-			//  12            3         4                5              6                   7                  8      9        10           11
-			"|([\\w-]+?)) ?: ?((.*?)(\r?\n))[^\t ]",	
-			//11             1213   14 
-			boost::regex::icase | boost::regex::normal);
-
-		boost::smatch		result;
-		std::string::const_iterator it_current_bound = m_cache_to_process.begin();
-		std::string::const_iterator it_end_bound = m_cache_to_process.begin()+pos;
-
 		body_info.clear();
 
 		//lookup all fields and fill well-known fields
-		while( boost::regex_search( it_current_bound, it_end_bound, result, rexp_mach_field, boost::match_default) && result[0].matched) 
-		{
-			const size_t field_val = 14;
-			const size_t field_etc_name = 12;
-
-			int i = 2; //start position = 2
-			if(result[i++].matched)//"Connection"
-				body_info.m_connection = result[field_val];
-			else if(result[i++].matched)//"Referer"
-				body_info.m_referer = result[field_val];
-			else if(result[i++].matched)//"Content-Length"
-				body_info.m_content_length = result[field_val];
-			else if(result[i++].matched)//"Content-Type"
-				body_info.m_content_type = result[field_val];
-			else if(result[i++].matched)//"Transfer-Encoding"
-				body_info.m_transfer_encoding = result[field_val];
-			else if(result[i++].matched)//"Content-Encoding"
-				body_info.m_content_encoding = result[field_val];
-			else if(result[i++].matched)//"Host"
-				body_info.m_host = result[field_val];
-			else if(result[i++].matched)//"Cookie"
-				body_info.m_cookie = result[field_val];
-			else if(result[i++].matched)//"User-Agent"
-				body_info.m_user_agent = result[field_val];
-			else if(result[i++].matched)//"Origin"
-				body_info.m_origin = result[field_val];
-			else if(result[i++].matched)//e.t.c (HAVE TO BE MATCHED!)
-				body_info.m_etc_fields.push_back(std::pair<std::string, std::string>(result[field_etc_name], result[field_val]));
+		const char *begin = m_cache_to_process.data();
+		for_each_header_field(begin, begin + std::min(pos, m_cache_to_process.size()), [&body_info](const char *key, size_t key_len, const char *value, size_t value_len) {
+			if(token_equals_no_case(key, key_len, "Connection"))
+				body_info.m_connection.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Referer"))
+				body_info.m_referer.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Content-Length"))
+				body_info.m_content_length.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Content-Type"))
+				body_info.m_content_type.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Transfer-Encoding"))
+				body_info.m_transfer_encoding.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Content-Encoding"))
+				body_info.m_content_encoding.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Host"))
+				body_info.m_host.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Cookie"))
+				body_info.m_cookie.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "User-Agent"))
+				body_info.m_user_agent.assign(value, value_len);
+			else if(token_equals_no_case(key, key_len, "Origin"))
+				body_info.m_origin.assign(value, value_len);
 			else
-			{
-				LOG_ERROR_CC(m_conn_context, "simple_http_connection_handler<t_connection_context>::parse_cached_header() not matched last entry in:" << m_cache_to_process);
-			}
-
-			it_current_bound = result[(int)result.size()-1]. first;
-		}
+				body_info.m_etc_fields.emplace_back(std::string(key, key_len), std::string(value, value_len));
+		});
 		return  true;
 	}
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::get_len_from_content_lenght(const std::string& str, size_t& OUT len)
 	{
-		STATIC_REGEXP_EXPR_1(rexp_mach_field, "\\d+", boost::regex::normal);
-		std::string res;
-		boost::smatch result;
-		if(!(boost::regex_search( str, result, rexp_mach_field, boost::match_default) && result[0].matched))
+		//the first run of digits
+		const char *ptr = str.c_str();
+		while(*ptr && !isdigit((unsigned char)*ptr))
+			++ptr;
+		if(!*ptr)
 			return false;
-
-		try { len = boost::lexical_cast<size_t>(result[0]); }
-		catch(...) { return false; }
+		len = 0;
+		for(; isdigit((unsigned char)*ptr); ++ptr)
+		{
+			const size_t digit = *ptr - '0';
+			if(len > (std::numeric_limits<size_t>::max() - digit) / 10)
+				return false;
+			len = len * 10 + digit;
+		}
 		return true;
 	}
 	//-----------------------------------------------------------------------------------
@@ -584,18 +628,91 @@ namespace net_utils
 			response.m_response_comment = "OK";
 		}
 
+#ifdef HTTP_ENABLE_GZIP
+		if(query_info.m_http_method != http::http_method_head && response.m_body.size() >= HTTP_GZIP_MIN_BODY_SIZE && accepts_gzip(query_info.m_header_info))
+		{
+			std::string packed;
+			if(gzip_pack(response.m_body, packed) && packed.size() < response.m_body.size())
+			{
+				MDEBUG("gzipped response of " << response.m_body.size() << " bytes to " << packed.size());
+				response.m_body.swap(packed);
+				response.m_additional_fields.push_back(std::make_pair("Content-Encoding", " gzip"));
+			}
+		}
+		if(response.m_body.size() >= HTTP_GZIP_MIN_BODY_SIZE)
+			response.m_additional_fields.push_back(std::make_pair("Vary", " Accept-Encoding"));
+#endif
+
 		std::string response_data = get_response_header(response);
 		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
 
     LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
 		
 		m_psnd_hndlr->do_send((void*)response_data.data(), response_data.size());
+		//hand the body over rather than have the connection copy it, large responses would otherwise sit in memory twice
 		if ((response.m_body.size() && (query_info.m_http_method != http::http_method_head)) || (query_info.m_http_method == http::http_method_options))
-			m_psnd_hndlr->do_send((void*)response.m_body.data(), response.m_body.size());
+			m_psnd_hndlr->do_send(std::make_shared<const std::string>(std::move(response.m_body)));
 		m_psnd_hndlr->send_done();
 		return res;
 	}
 	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::accepts_gzip(const http_header_info& header_info)
+	{
+		for(const auto& field: header_info.m_etc_fields)
+		{
+			if(string_tools::compare_no_case(field.first, "Accept-Encoding"))
+				continue;
+			//a "gzip" coding in the list, unless its weight is "q=0"
+			const char *ptr = field.second.c_str();
+			while(*ptr)
+			{
+				while(*ptr == ' ' || *ptr == ',')
+					++ptr;
+				const char *coding = ptr;
+				while(*ptr && *ptr != ',' && *ptr != ';' && *ptr != ' ')
+					++ptr;
+				const bool is_gzip = token_equals_no_case(coding, ptr - coding, "gzip");
+				while(*ptr == ' ')
+					++ptr;
+				bool rejected = false;
+				if(*ptr == ';')
+				{
+					const char *param = ptr + 1;
+					while(*param == ' ')
+						++param;
+					if(tolower((unsigned char)*param) == 'q')
+					{
+						++param;
+						while(*param == ' ')
+							++param;
+						if(*param == '=')
+						{
+							++param;
+							while(*param == ' ')
+								++param;
+							if(*param == '0')
+							{
+								++param;
+								if(*param == '.')
+									while(*++param == '0');
+								while(*param == ' ')
+									++param;
+								rejected = !*param || *param == ',';
+							}
+						}
+					}
+				}
+				if(is_gzip && !rejected)
+					return true;
+				while(*ptr && *ptr != ',')
+					++ptr;
+			}
+			return false;
+		}
+		return false;
+	}
+	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_request(const http::http_request_info& query_info, http_response_info& response)
 	{
@@ -26,6 +26,8 @@
 
 
 #pragma once 
+#include <string>
+#include <vector>
 #include "http_base.h"
 #include "jsonrpc_structs.h"
 #include "storages/portable_storage.h"
@@ -34,6 +36,139 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "net.http"
 
+#ifndef JSON_RPC_MAX_BATCH_SIZE
+#define JSON_RPC_MAX_BATCH_SIZE 1000
+#endif
+
+namespace epee
+{
+  namespace json_rpc
+  {
+    // true if the body is a JSON-RPC 2.0 batch, ie a top level array
+    inline bool is_batch(const std::string& body)
+    {
+      for (char c: body)
+      {
+        if (c == '[')
+          return true;
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+          return false;
+      }
+      return false;
+    }
+
+    // splits a batch into the text of its top level elements, without parsing them
+    inline bool split_batch(const std::string& body, std::vector<std::string>& items)
+    {
+      items.clear();
+      size_t depth = 0, start = 0;
+      bool in_string = false, escaped = false, closed = false;
+      for (size_t i = 0; i < body.size(); ++i)
+      {
+        const char c = body[i];
+        if (in_string)
+        {
+          if (escaped)
+            escaped = false;
+          else if (c == '\\')
+            escaped = true;
+          else if (c == '"')
+            in_string = false;
+          continue;
+        }
+        if (closed)
+        {
+          if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+            return false;
+          continue;
+        }
+        switch (c)
+        {
+          case '"':
+            in_string = true;
+            break;
+          case '[':
+          case '{':
+            if (depth++ == 0)
+            {
+              if (c != '[')
+                return false;
+              start = i + 1;
+            }
+            break;
+          case ']':
+          case '}':
+            if (depth == 0)
+              return false;
+            if (--depth == 0)
+            {
+              if (c != ']')
+                return false;
+              closed = true;
+              if (!items.empty() || body.find_first_not_of(" \t\r\n", start) != i)
+                items.push_back(body.substr(start, i - start));
+            }
+            break;
+          case ',':
+            if (depth == 1)
+            {
+              items.push_back(body.substr(start, i - start));
+              start = i + 1;
+            }
+            break;
+          default:
+            break;
+        }
+      }
+      return closed;
+    }
+
+    // runs each element of a batch through handler as if it were a request of its own,
+    // and joins the replies into a single array
+    template<typename t_handler>
+    bool handle_batch(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, t_handler handler)
+    {
+      std::vector<std::string> items;
+      if (!split_batch(query_info.m_body, items) || items.empty() || items.size() > JSON_RPC_MAX_BATCH_SIZE)
+      {
+        epee::json_rpc::error_response rsp = AUTO_VAL_INIT(rsp);
+        rsp.jsonrpc = "2.0";
+        rsp.error.code = -32600;
+        rsp.error.message = items.size() > JSON_RPC_MAX_BATCH_SIZE ? "Batch too large" : "Invalid Request";
+        epee::serialization::store_t_to_json(rsp, response_info.m_body);
+        return true;
+      }
+
+      epee::net_utils::http::http_request_info item_query = query_info;
+      item_query.m_body.clear();
+      response_info.m_body = "[";
+      for (size_t i = 0; i < items.size(); ++i)
+      {
+        item_query.m_body = std::move(items[i]);
+        epee::net_utils::http::http_response_info item_response = AUTO_VAL_INIT(item_response);
+        item_response.m_response_code = 200;
+        // batches do not nest
+        if (is_batch(item_query.m_body) || !handler(item_query, item_response) || item_response.m_response_code != 200 || item_response.m_body.empty())
+        {
+          epee::json_rpc::error_response rsp = AUTO_VAL_INIT(rsp);
+          rsp.jsonrpc = "2.0";
+          rsp.error.code = -32600;
+          rsp.error.message = "Invalid Request";
+          item_response.m_body.clear();
+          epee::serialization::store_t_to_json(rsp, item_response.m_body);
+        }
+        if (i)
+          response_info.m_body += ',';
+        response_info.m_body += item_response.m_body;
+      }
+      response_info.m_body += ']';
+      response_info.m_mime_tipe = "application/json";
+      response_info.m_header_info.m_content_type = " application/json";
+      return true;
+    }
+  }
+}
+
 
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
               epee::net_utils::http::http_response_info& response, \
@@ -117,6 +252,9 @@
 
 #define BEGIN_JSON_RPC_MAP(uri)    else if(query_info.m_URI == uri) \
     { \
+    if(epee::json_rpc::is_batch(query_info.m_body)) \
+      return epee::json_rpc::handle_batch(query_info, response_info, [&](const epee::net_utils::http::http_request_info& item_query, epee::net_utils::http::http_response_info& item_response) { \
+        return handle_http_request_map(item_query, item_response, m_conn_context); }); \
     uint64_t ticks = epee::misc_utils::get_tick_count(); \
     epee::serialization::portable_storage ps; \
     if(!ps.load_from_json(query_info.m_body)) \
@@ -29,6 +29,8 @@
 #ifndef _LEVIN_BASE_H_
 #define _LEVIN_BASE_H_
 
+#include <atomic>
+#include <vector>
 #include "net_utils_base.h"
 
 #define LEVIN_SIGNATURE  0x0101010101012101LL  //Bender's nightmare
@@ -76,6 +78,122 @@ namespace levin
 
 #define LEVIN_PROTOCOL_VER_0         0
 #define LEVIN_PROTOCOL_VER_1         1
+
+#define LEVIN_COMMAND_STATS_SLOTS    64
+#define LEVIN_CONNECTION_COMMAND_STATS_SLOTS 32
+
+  // packet and byte counts per command, headers included, with the time
+  // spent handling the requests and notifications received and the time
+  // our own invokes took to be answered. There is one table of these for
+  // the process and one per connection. A command takes a free slot the
+  // first time it is seen, commands arriving once the table is full are
+  // not counted.
+  struct command_stats
+  {
+    std::atomic<uint32_t> command;  // 0 for a free slot
+    std::atomic<uint64_t> packets_in;
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> packets_out;
+    std::atomic<uint64_t> bytes_out;
+    std::atomic<uint64_t> handled;
+    std::atomic<uint64_t> handler_ns;
+    std::atomic<uint64_t> invokes;
+    std::atomic<uint64_t> invoke_ns;
+    std::atomic<uint64_t> invoke_timeouts;
+  };
+
+  // a copy of a command_stats slot
+  struct command_stats_snapshot
+  {
+    uint32_t command;
+    uint64_t packets_in;
+    uint64_t bytes_in;
+    uint64_t packets_out;
+    uint64_t bytes_out;
+    uint64_t handled;
+    uint64_t handler_ns;
+    uint64_t invokes;
+    uint64_t invoke_ns;
+    uint64_t invoke_timeouts;
+  };
+
+  inline
+  command_stats *get_command_stats()
+  {
+    static command_stats stats[LEVIN_COMMAND_STATS_SLOTS];
+    return stats;
+  }
+
+  inline
+  command_stats *find_command_stats(command_stats *stats, size_t slots, uint32_t command)
+  {
+    if (command == 0)
+      return NULL;
+    for (size_t i = 0; i < slots; ++i)
+    {
+      uint32_t slot_command = stats[i].command.load(std::memory_order_acquire);
+      if (slot_command == 0)
+      {
+        stats[i].command.compare_exchange_strong(slot_command, command, std::memory_order_acq_rel);
+        if (slot_command != 0 && slot_command != command)
+          continue;
+      }
+      else if (slot_command != command)
+        continue;
+      return &stats[i];
+    }
+    return NULL;
+  }
+
+  inline
+  void add_command_stats(command_stats &stats, uint64_t bytes, bool out)
+  {
+    (out ? stats.packets_out : stats.packets_in).fetch_add(1, std::memory_order_relaxed);
+    (out ? stats.bytes_out : stats.bytes_in).fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  inline
+  void add_handler_stats(command_stats &stats, uint64_t ns)
+  {
+    stats.handled.fetch_add(1, std::memory_order_relaxed);
+    stats.handler_ns.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  inline
+  void add_invoke_stats(command_stats &stats, uint64_t ns, bool timed_out)
+  {
+    if (timed_out)
+    {
+      stats.invoke_timeouts.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    stats.invokes.fetch_add(1, std::memory_order_relaxed);
+    stats.invoke_ns.fetch_add(ns, std::memory_order_relaxed);
+  }
+
+  inline
+  std::vector<command_stats_snapshot> snapshot_command_stats(const command_stats *stats, size_t slots)
+  {
+    std::vector<command_stats_snapshot> snapshot;
+    for (size_t i = 0; i < slots; ++i)
+    {
+      command_stats_snapshot s;
+      s.command = stats[i].command.load(std::memory_order_acquire);
+      if (s.command == 0)
+        break;
+      s.packets_in = stats[i].packets_in.load(std::memory_order_relaxed);
+      s.bytes_in = stats[i].bytes_in.load(std::memory_order_relaxed);
+      s.packets_out = stats[i].packets_out.load(std::memory_order_relaxed);
+      s.bytes_out = stats[i].bytes_out.load(std::memory_order_relaxed);
+      s.handled = stats[i].handled.load(std::memory_order_relaxed);
+      s.handler_ns = stats[i].handler_ns.load(std::memory_order_relaxed);
+      s.invokes = stats[i].invokes.load(std::memory_order_relaxed);
+      s.invoke_ns = stats[i].invoke_ns.load(std::memory_order_relaxed);
+      s.invoke_timeouts = stats[i].invoke_timeouts.load(std::memory_order_relaxed);
+      snapshot.push_back(s);
+    }
+    return snapshot;
+  }
  
   template<class t_connection_context = net_utils::connection_context_base>
   struct levin_commands_handler
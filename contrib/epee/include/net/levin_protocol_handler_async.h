@@ -25,15 +25,16 @@
 // 
 
 #pragma once
-#include <boost/asio/deadline_timer.hpp>
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/interprocess/detail/atomic.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
 
 #include <atomic>
+#include <memory>
 
 #include "levin_base.h"
+#include "timer_wheel.h"
 #include "misc_language.h"
 #include "syncobj.h"
 #include "misc_os_dependent.h"
@@ -89,6 +90,8 @@ public:
   int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t &cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int send_notify(const std::shared_ptr<const std::string>& message, boost::uuids::uuid connection_id);
+  static std::shared_ptr<const std::string> make_notify_buffer(int command, const std::string& in_buff);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -96,6 +99,9 @@ public:
   bool foreach_connection(const callback_t &cb);
   template<class callback_t>
   bool for_connection(const boost::uuids::uuid &connection_id, const callback_t &cb);
+  // cb(t_connection_context&, const std::vector<command_stats_snapshot>&)
+  template<class callback_t>
+  bool foreach_connection_command_stats(const callback_t &cb);
   size_t get_connections_count();
   void set_handler(levin_commands_handler<t_connection_context>* handler, void (*destroy)(levin_commands_handler<t_connection_context>*) = NULL);
 
@@ -142,12 +148,45 @@ public:
   config_type& m_config;
   t_connection_context& m_connection_context;
 
+  // a partial packet head, only while one is split across reads
   std::string m_cache_in_buffer;
+  // the current packet's body, received in place and handed over whole
+  std::string m_body_buffer;
+  // bytes received so far, for the sync invoke to see progress
+  std::atomic<uint64_t> m_bytes_received;
   stream_state m_state;
 
   int32_t m_oponent_protocol_ver;
   bool m_connection_initialized;
 
+  // this connection's share of get_command_stats()
+  command_stats m_command_stats[LEVIN_CONNECTION_COMMAND_STATS_SLOTS];
+
+  template<class F>
+  void update_command_stats(uint32_t command, const F &f)
+  {
+    command_stats *stats = find_command_stats(get_command_stats(), LEVIN_COMMAND_STATS_SLOTS, command);
+    if (stats)
+      f(*stats);
+    stats = find_command_stats(m_command_stats, LEVIN_CONNECTION_COMMAND_STATS_SLOTS, command);
+    if (stats)
+      f(*stats);
+  }
+  void add_command_stats(uint32_t command, uint64_t bytes, bool out)
+  {
+    update_command_stats(command, [bytes, out](command_stats &s) { levin::add_command_stats(s, bytes, out); });
+  }
+  void add_handler_stats(uint32_t command, std::chrono::steady_clock::time_point start)
+  {
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    update_command_stats(command, [ns](command_stats &s) { levin::add_handler_stats(s, ns); });
+  }
+  void add_invoke_stats(uint32_t command, std::chrono::steady_clock::time_point start, bool timed_out)
+  {
+    const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    update_command_stats(command, [ns, timed_out](command_stats &s) { levin::add_invoke_stats(s, ns, timed_out); });
+  }
+
   struct invoke_response_handler_base
   {
     virtual bool handle(int res, const std::string& buff, connection_context& context)=0;
@@ -160,40 +199,44 @@ public:
   struct anvoke_handler: invoke_response_handler_base
   {
     anvoke_handler(const callback_t& cb, uint64_t timeout,  async_protocol_handler& con, int command)
-      :m_cb(cb), m_timeout(timeout), m_con(con), m_timer(con.m_pservice_endpoint->get_io_service()), m_timer_started(false),
-      m_cancel_timer_called(false), m_timer_cancelled(false), m_command(command)
+      :m_cb(cb), m_con(con), m_wheel(net_utils::timer_wheel::get(con.m_pservice_endpoint->get_io_service())), m_timer_id(0), m_timer_started(false),
+      m_cancel_timer_called(false), m_timer_cancelled(false), m_timeout(timeout), m_command(command), m_start(std::chrono::steady_clock::now())
     {
       if(m_con.start_outer_call())
       {
         MDEBUG(con.get_context_ref() << "anvoke_handler, timeout: " << timeout);
-        m_timer.expires_from_now(boost::posix_time::milliseconds(timeout));
-        m_timer.async_wait([&con, command, cb, timeout](const boost::system::error_code& ec)
+        const std::chrono::steady_clock::time_point start = m_start;
+        m_timer_id = m_wheel.add(std::chrono::milliseconds(timeout), [&con, command, cb, timeout, start]()
         {
-          if(ec == boost::asio::error::operation_aborted)
-            return;
           MINFO(con.get_context_ref() << "Timeout on invoke operation happened, command: " << command << " timeout: " << timeout);
+          con.add_invoke_stats(command, start, true);
           std::string fake;
           cb(LEVIN_ERROR_CONNECTION_TIMEDOUT, fake, con.get_context_ref());
           con.close();
           con.finish_outer_call();
         });
-        m_timer_started = true;
+        m_timer_started = m_timer_id != 0;
+        if (!m_timer_started)
+          m_con.finish_outer_call();
       }
     }
     virtual ~anvoke_handler()
     {}
     callback_t m_cb;
     async_protocol_handler& m_con;
-    boost::asio::deadline_timer m_timer;
+    net_utils::timer_wheel& m_wheel;
+    net_utils::timer_wheel::timer_id m_timer_id;
     bool m_timer_started;
     bool m_cancel_timer_called;
     bool m_timer_cancelled;
     uint64_t m_timeout;
     int m_command;
+    std::chrono::steady_clock::time_point m_start;
     virtual bool handle(int res, const std::string& buff, typename async_protocol_handler::connection_context& context)
     {
       if(!cancel_timer())
         return false;
+      m_con.add_invoke_stats(m_command, m_start, false);
       m_cb(res, buff, context);
       m_con.finish_outer_call();
       return true;
@@ -216,32 +259,14 @@ public:
       if(!m_cancel_timer_called)
       {
         m_cancel_timer_called = true;
-        boost::system::error_code ignored_ec;
-        m_timer_cancelled = 1 == m_timer.cancel(ignored_ec);
+        m_timer_cancelled = m_timer_started && m_wheel.cancel(m_timer_id);
       }
       return m_timer_cancelled;
     }
     virtual void reset_timer()
     {
-      boost::system::error_code ignored_ec;
-      if (!m_cancel_timer_called && m_timer.cancel(ignored_ec) > 0)
-      {
-        callback_t& cb = m_cb;
-        uint64_t timeout = m_timeout;
-        async_protocol_handler& con = m_con;
-        int command = m_command;
-        m_timer.expires_from_now(boost::posix_time::milliseconds(m_timeout));
-        m_timer.async_wait([&con, cb, command, timeout](const boost::system::error_code& ec)
-        {
-          if(ec == boost::asio::error::operation_aborted)
-            return;
-          MINFO(con.get_context_ref() << "Timeout on invoke operation happened, command: " << command << " timeout: " << timeout);
-          std::string fake;
-          cb(LEVIN_ERROR_CONNECTION_TIMEDOUT, fake, con.get_context_ref());
-          con.close();
-          con.finish_outer_call();
-        });
-      }
+      if (!m_cancel_timer_called && m_timer_started)
+        m_wheel.reset(m_timer_id, std::chrono::milliseconds(m_timeout));
     }
   };
   critical_section m_invoke_response_handlers_lock;
@@ -264,7 +289,9 @@ public:
             m_pservice_endpoint(psnd_hndlr), 
             m_config(config), 
             m_connection_context(conn_context), 
-            m_state(stream_state_head)
+            m_bytes_received(0),
+            m_state(stream_state_head),
+            m_command_stats()
   {
     m_close_called = 0;
     m_deletion_initiated = false;
@@ -371,15 +398,22 @@ public:
       return false;
     }
 
-    if(m_cache_in_buffer.size() +  cb > m_config.m_max_packet_size)
+    if(m_cache_in_buffer.size() + m_body_buffer.size() + cb > m_config.m_max_packet_size)
     {
       MWARNING(m_connection_context << "Maximum packet size exceed!, m_max_packet_size = " << m_config.m_max_packet_size
-                          << ", packet received " << m_cache_in_buffer.size() +  cb 
+                          << ", packet received " << m_cache_in_buffer.size() + m_body_buffer.size() + cb
                           << ", connection will be closed.");
       return false;
     }
 
-    m_cache_in_buffer.append((const char*)ptr, cb);
+    m_bytes_received += cb;
+
+    // packets are parsed straight out of the read buffer: heads are only
+    // copied aside when split across reads, and bodies go to their own
+    // buffer, which is given to the handler rather than copied out of a
+    // shared one and erased from its front
+    const char *data = (const char*)ptr;
+    size_t left = cb;
 
     bool is_continue = true;
     while(is_continue)
@@ -387,7 +421,19 @@ public:
       switch(m_state)
       {
       case stream_state_body:
-        if(m_cache_in_buffer.size() < m_current_head.m_cb)
+        {
+          const size_t wanted = std::min<size_t>(m_current_head.m_cb - m_body_buffer.size(), left);
+          if (m_body_buffer.size() + wanted > m_body_buffer.capacity())
+          {
+            // grow geometrically, but never past the body size
+            const size_t capacity = std::max<size_t>(m_body_buffer.size() + wanted, m_body_buffer.capacity() * 2);
+            m_body_buffer.reserve(std::min<size_t>(capacity, m_current_head.m_cb));
+          }
+          m_body_buffer.append(data, wanted);
+          data += wanted;
+          left -= wanted;
+        }
+        if(m_body_buffer.size() < m_current_head.m_cb)
         {
           is_continue = false;
           if(cb >= MIN_BYTES_WANTED)
@@ -405,15 +451,10 @@ public:
         }
         {
           std::string buff_to_invoke;
-          if(m_cache_in_buffer.size()  == m_current_head.m_cb)
-            buff_to_invoke.swap(m_cache_in_buffer);
-          else
-          {
-            buff_to_invoke.assign(m_cache_in_buffer, 0, (std::string::size_type)m_current_head.m_cb);
-            m_cache_in_buffer.erase(0, (std::string::size_type)m_current_head.m_cb);
-          }
+          buff_to_invoke.swap(m_body_buffer);
 
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
+          add_command_stats(m_current_head.m_command, sizeof(bucket_head2) + buff_to_invoke.size(), false);
 
           MDEBUG(m_connection_context << "LEVIN_PACKET_RECIEVED. [len=" << m_current_head.m_cb
             << ", flags" << m_current_head.m_flags 
@@ -457,6 +498,7 @@ public:
             }
           }else
           {
+            const std::chrono::steady_clock::time_point handler_start = std::chrono::steady_clock::now();
             if(m_current_head.m_have_to_return_data)
             {
               std::string return_buff;
@@ -465,6 +507,7 @@ public:
                                                                   buff_to_invoke, 
                                                                   return_buff, 
                                                                   m_connection_context);
+              add_handler_stats(m_current_head.m_command, handler_start);
               m_current_head.m_cb = return_buff.size();
               m_current_head.m_have_to_return_data = false;
               m_current_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
@@ -475,6 +518,7 @@ public:
               if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
                 return false;
               CRITICAL_REGION_END();
+              add_command_stats(m_current_head.m_command, send_buff.size(), true);
               MDEBUG(m_connection_context << "LEVIN_PACKET_SENT. [len=" << m_current_head.m_cb
                 << ", flags" << m_current_head.m_flags 
                 << ", r?=" << m_current_head.m_have_to_return_data 
@@ -482,25 +526,47 @@ public:
                 << ", ver=" << m_current_head.m_protocol_version);
             }
             else
+            {
               m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context);
+              add_handler_stats(m_current_head.m_command, handler_start);
+            }
           }
         }
         m_state = stream_state_head;
         break;
       case stream_state_head:
         {
-          if(m_cache_in_buffer.size() < sizeof(bucket_head2))
+          if (!left)
           {
-            if(m_cache_in_buffer.size() >= sizeof(uint64_t) && *((uint64_t*)m_cache_in_buffer.data()) != LEVIN_SIGNATURE)
-            {
-              MWARNING(m_connection_context << "Signature mismatch, connection will be closed");
-              return false;
-            }
             is_continue = false;
             break;
           }
+          const bucket_head2* phead;
+          if (m_cache_in_buffer.empty() && left >= sizeof(bucket_head2))
+          {
+            phead = (const bucket_head2*)data;
+            data += sizeof(bucket_head2);
+            left -= sizeof(bucket_head2);
+          }
+          else
+          {
+            const size_t wanted = std::min<size_t>(sizeof(bucket_head2) - m_cache_in_buffer.size(), left);
+            m_cache_in_buffer.append(data, wanted);
+            data += wanted;
+            left -= wanted;
+            if(m_cache_in_buffer.size() < sizeof(bucket_head2))
+            {
+              if(m_cache_in_buffer.size() >= sizeof(uint64_t) && *((uint64_t*)m_cache_in_buffer.data()) != LEVIN_SIGNATURE)
+              {
+                MWARNING(m_connection_context << "Signature mismatch, connection will be closed");
+                return false;
+              }
+              is_continue = false;
+              break;
+            }
+            phead = (const bucket_head2*)m_cache_in_buffer.data();
+          }
 
-          bucket_head2* phead = (bucket_head2*)m_cache_in_buffer.data();
           if(LEVIN_SIGNATURE != phead->m_signature)
           {
             LOG_ERROR_CC(m_connection_context, "Signature mismatch, connection will be closed");
@@ -508,7 +574,7 @@ public:
           }
           m_current_head = *phead;
 
-          m_cache_in_buffer.erase(0, sizeof(bucket_head2));
+          m_cache_in_buffer.clear();
           m_state = stream_state_body;
           m_oponent_protocol_ver = m_current_head.m_protocol_version;
           if(m_current_head.m_cb > m_config.m_max_packet_size)
@@ -590,6 +656,7 @@ public:
         err_code = LEVIN_ERROR_CONNECTION;
         break;
       }
+      add_command_stats(command, sizeof(head) + in_buff.size(), true);
 
       if(!add_invoke_response_handler(cb, timeout, *this, command))
       {
@@ -646,6 +713,7 @@ public:
       return LEVIN_ERROR_CONNECTION;
     }
     CRITICAL_REGION_END();
+    add_command_stats(command, sizeof(head) + in_buff.size(), true);
 
     MDEBUG(m_connection_context << "LEVIN_PACKET_SENT. [len=" << head.m_cb
                             << ", f=" << head.m_flags 
@@ -653,19 +721,21 @@ public:
                             << ", cmd = " << head.m_command 
                             << ", ver=" << head.m_protocol_version);
 
+    const std::chrono::steady_clock::time_point invoke_start = std::chrono::steady_clock::now();
     uint64_t ticks_start = misc_utils::get_tick_count();
-    size_t prev_size = 0;
+    uint64_t prev_size = m_bytes_received;
 
     while(!boost::interprocess::ipcdetail::atomic_read32(&m_invoke_buf_ready) && !m_deletion_initiated && !m_protocol_released)
     {
-      if(m_cache_in_buffer.size() - prev_size >= MIN_BYTES_WANTED)
+      if(m_bytes_received - prev_size >= MIN_BYTES_WANTED)
       {
-        prev_size = m_cache_in_buffer.size();
+        prev_size = m_bytes_received;
         ticks_start = misc_utils::get_tick_count();
       }
       if(misc_utils::get_tick_count() - ticks_start > m_config.m_invoke_timeout)
       {
         MWARNING(m_connection_context << "invoke timeout (" << m_config.m_invoke_timeout << "), closing connection ");
+        add_invoke_stats(command, invoke_start, true);
         close();
         return LEVIN_ERROR_CONNECTION_TIMEDOUT;
       }
@@ -680,11 +750,19 @@ public:
     buff_out.swap(m_local_inv_buff);
     m_local_inv_buff.clear();
     CRITICAL_REGION_END();
+    add_invoke_stats(command, invoke_start, false);
 
     return m_invoke_result_code;
   }
 
   int notify(int command, const std::string& in_buff)
+  {
+    return send_notify(async_protocol_handler_config<t_connection_context>::make_notify_buffer(command, in_buff));
+  }
+  //------------------------------------------------------------------------------------------
+  // message is a complete levin packet (see make_notify_buffer); it is queued as is, so one
+  // buffer can be handed to any number of connections without being copied per connection
+  int send_notify(const std::shared_ptr<const std::string>& message)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -697,27 +775,18 @@ public:
     if(m_deletion_initiated)
       return LEVIN_ERROR_CONNECTION_DESTROYED;
 
-    bucket_head2 head = {0};
-    head.m_signature = LEVIN_SIGNATURE;
-    head.m_have_to_return_data = false;
-    head.m_cb = in_buff.size();
+    CHECK_AND_ASSERT_MES(message && message->size() >= sizeof(bucket_head2), -1, "Invalid levin notify buffer");
+    bucket_head2 head;
+    memcpy(&head, message->data(), sizeof(head));
 
-    head.m_command = command;
-    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
-    head.m_flags = LEVIN_PACKET_REQUEST;
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
-      return -1;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!m_pservice_endpoint->do_send(message))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
     }
     CRITICAL_REGION_END();
+    add_command_stats(head.m_command, message->size(), true);
     LOG_DEBUG_CC(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb <<
       ", f=" << head.m_flags << 
       ", r?=" << head.m_have_to_return_data <<
@@ -730,6 +799,8 @@ public:
   boost::uuids::uuid get_connection_id() {return m_connection_context.m_connection_id;}
   //------------------------------------------------------------------------------------------
   t_connection_context& get_context_ref() {return m_connection_context;}
+  //------------------------------------------------------------------------------------------
+  std::vector<command_stats_snapshot> get_command_stats_snapshot() const {return snapshot_command_stats(m_command_stats, LEVIN_CONNECTION_COMMAND_STATS_SLOTS);}
 };
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
@@ -846,6 +917,19 @@ bool async_protocol_handler_config<t_connection_context>::foreach_connection(con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context> template<class callback_t>
+bool async_protocol_handler_config<t_connection_context>::foreach_connection_command_stats(const callback_t &cb)
+{
+  CRITICAL_REGION_LOCAL(m_connects_lock);
+  for(auto& c: m_connects)
+  {
+    async_protocol_handler<t_connection_context>* aph = c.second;
+    if(!cb(aph->get_context_ref(), aph->get_command_stats_snapshot()))
+      return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context> template<class callback_t>
 bool async_protocol_handler_config<t_connection_context>::for_connection(const boost::uuids::uuid &connection_id, const callback_t &cb)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
@@ -882,6 +966,33 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::send_notify(const std::shared_ptr<const std::string>& message, boost::uuids::uuid connection_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->send_notify(message) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
+std::shared_ptr<const std::string> async_protocol_handler_config<t_connection_context>::make_notify_buffer(int command, const std::string& in_buff)
+{
+  bucket_head2 head = {0};
+  head.m_signature = LEVIN_SIGNATURE;
+  head.m_have_to_return_data = false;
+  head.m_cb = in_buff.size();
+
+  head.m_command = command;
+  head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+  head.m_flags = LEVIN_PACKET_REQUEST;
+
+  std::string message;
+  message.reserve(sizeof(head) + in_buff.size());
+  message.append((const char*)&head, sizeof(head));
+  message.append(in_buff);
+  return std::make_shared<const std::string>(std::move(message));
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
@@ -31,6 +31,8 @@
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_service.hpp>
+#include <memory>
+#include <string>
 #include <typeinfo>
 #include <type_traits>
 #include "serialization/keyvalue_serialization.h"
@@ -280,6 +282,8 @@ namespace net_utils
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    //send an immutable buffer which may be shared with other connections; endpoints that can queue it without copying override this
+    virtual bool do_send(const std::shared_ptr<const std::string>& buff) { return buff && do_send(buff->data(), buff->size()); }
     virtual bool close()=0;
     virtual bool send_done()=0;
     virtual bool call_run_once_service_io()=0;
@@ -101,6 +101,34 @@ class network_throttle : public i_network_throttle {
         virtual void logger_handle_net(const std::string &filename, double time, size_t size);
 };
 
+/***
+ * Token bucket used for the global speed limits. The bucket is kept as the
+ * time at which it will be full again, moved forward with a CAS for every
+ * packet, so accounting takes no lock. Each caller reserves its bytes and is
+ * told how long to wait before using them; reservations are served in the
+ * order they are made, and since a connection only waits for one packet at
+ * a time, busy peers take turns instead of starving the others.
+*/
+class network_token_bucket {
+	public:
+		network_token_bucket(const std::string &name, network_time_seconds burst = 1.0);
+
+		void set_target_speed( network_speed_kbps target ); ///< 0 for no limit
+		network_speed_kbps get_target_speed() const;
+
+		network_time_seconds reserve(size_t packet_size); ///< takes packet_size bytes, returns how long to wait before they may be used
+		network_time_seconds get_sleep_time(size_t packet_size) const; ///< ditto, without taking the bytes
+
+	private:
+		static int64_t get_time_ns();
+		int64_t get_cost_ns(size_t packet_size, uint64_t speed) const;
+
+		const std::string m_name;
+		const int64_t m_burst_ns; ///< how much unused allowance can be saved up, in time at the target speed
+		std::atomic<uint64_t> m_target_speed; ///< bytes per second, 0 for no limit
+		std::atomic<int64_t> m_full_time_ns; ///< when the bucket will be full again if nothing else is taken
+};
+
 /***
  * The complete set of traffic throttle for one typical connection
 */
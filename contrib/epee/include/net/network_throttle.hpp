@@ -86,6 +86,7 @@ typedef double network_time_seconds;
 typedef double network_MB;
 
 class i_network_throttle;
+class network_token_bucket;
 
 /***
 @brief All information about given throttle - speed calculations
@@ -108,20 +109,10 @@ class network_throttle_manager {
 	// [[note1]] see also http://www.nuonsoft.com/blog/2012/10/21/implementing-a-thread-safe-singleton-with-c11/
 	// [[note2]] _inreq is the requested in traffic - we anticipate we will get in-bound traffic soon as result of what we do (e.g. that we sent network downloads requests)
 	
-	//protected:
-	public: // XXX
-
-    static boost::mutex m_lock_get_global_throttle_in;
-    static boost::mutex m_lock_get_global_throttle_inreq;
-    static boost::mutex m_lock_get_global_throttle_out;
-
-		friend class connection_basic; // FRIEND - to directly access global throttle-s. !! REMEMBER TO USE LOCKS!
-		friend class connection_basic_pimpl; // ditto
-
 	public:
-		static i_network_throttle & get_global_throttle_in(); ///< singleton ; for friend class ; caller MUST use proper locks! like m_lock_get_global_throttle_in
-		static i_network_throttle & get_global_throttle_inreq(); ///< ditto ; use lock ... use m_lock_get_global_throttle_inreq obviously
-		static i_network_throttle & get_global_throttle_out(); ///< ditto ; use lock ... use m_lock_get_global_throttle_out obviously
+		static network_token_bucket & get_global_throttle_in(); ///< singleton ; lock free, no locking needed by the caller
+		static network_token_bucket & get_global_throttle_inreq(); ///< ditto
+		static network_token_bucket & get_global_throttle_out(); ///< ditto
 };
 
 
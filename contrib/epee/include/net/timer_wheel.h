@@ -0,0 +1,277 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+#pragma once
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/thread/mutex.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace epee
+{
+namespace net_utils
+{
+  /************************************************************************/
+  /* Hierarchical timer wheel, one per io_service, for the many timeouts  */
+  /* connections keep: a single asio timer ticks while any are pending,   */
+  /* and adding, moving or cancelling one is a few list operations.       */
+  /************************************************************************/
+  class timer_wheel: public boost::asio::detail::service_base<timer_wheel>
+  {
+  public:
+    typedef uint64_t timer_id;
+    typedef std::function<void()> callback_t;
+
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS = 1 << SLOT_BITS;
+    static const unsigned LEVELS = 4; // 64^4 ticks, over 9 days at 50ms
+    static const unsigned TICK_MS = 50;
+
+    explicit timer_wheel(boost::asio::io_service& io_service):
+      boost::asio::detail::service_base<timer_wheel>(io_service),
+      m_timer(io_service), m_start(std::chrono::steady_clock::now()),
+      m_current(0), m_next_id(1), m_armed(false), m_shutdown(false),
+      m_slots(LEVELS * SLOTS)
+    {}
+
+    //! get the wheel of an io_service
+    static timer_wheel& get(boost::asio::io_service& io_service)
+    {
+      return boost::asio::use_service<timer_wheel>(io_service);
+    }
+
+    /**
+     * @brief calls cb on the io_service once timeout has passed,
+     *        rounded up to the next tick
+     *
+     * @return an id for cancel, reset and remaining, never 0
+     */
+    timer_id add(std::chrono::milliseconds timeout, callback_t cb)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (m_shutdown)
+        return 0;
+      if (!m_armed)
+      {
+        // nothing is pending, so the wheel can jump to the present
+        m_current = now_tick();
+        arm();
+      }
+      const timer_id id = m_next_id++;
+      entry &e = m_entries[id];
+      e.cb = std::move(cb);
+      e.deadline = deadline_for(timeout);
+      insert(id, e);
+      return id;
+    }
+
+    /**
+     * @brief stops a timer from firing
+     *
+     * @return true if it was pending, false if it already fired (or is
+     *         firing) or was cancelled
+     */
+    bool cancel(timer_id id)
+    {
+      callback_t cb;
+      {
+        boost::unique_lock<boost::mutex> lock(m_lock);
+        const auto i = m_entries.find(id);
+        if (i == m_entries.end())
+          return false;
+        m_slots[i->second.slot].erase(i->second.pos);
+        cb = std::move(i->second.cb);
+        m_entries.erase(i);
+      }
+      // the callback may hold the last reference to its owner, which may
+      // cancel more timers when going away
+      return true;
+    }
+
+    /**
+     * @brief moves a pending timer to fire timeout from now
+     *
+     * @return true if it was pending, false if it had already fired (or is
+     *         firing) or was cancelled
+     */
+    bool reset(timer_id id, std::chrono::milliseconds timeout)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_entries.find(id);
+      if (i == m_entries.end())
+        return false;
+      m_slots[i->second.slot].erase(i->second.pos);
+      i->second.deadline = deadline_for(timeout);
+      insert(id, i->second);
+      return true;
+    }
+
+    //! time left before a pending timer fires, 0 if it is not pending
+    std::chrono::milliseconds remaining(timer_id id)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_entries.find(id);
+      if (i == m_entries.end())
+        return std::chrono::milliseconds(0);
+      const uint64_t now = now_tick();
+      return std::chrono::milliseconds(i->second.deadline > now ? (i->second.deadline - now) * TICK_MS : 0);
+    }
+
+    size_t size()
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_entries.size();
+    }
+
+  private:
+    struct entry
+    {
+      callback_t cb;
+      uint64_t deadline;
+      size_t slot;
+      std::list<timer_id>::iterator pos;
+    };
+
+    virtual void shutdown_service()
+    {
+      std::unordered_map<timer_id, entry> entries;
+      {
+        boost::unique_lock<boost::mutex> lock(m_lock);
+        m_shutdown = true;
+        boost::system::error_code ignored_ec;
+        m_timer.cancel(ignored_ec);
+        for (auto &slot: m_slots)
+          slot.clear();
+        entries.swap(m_entries);
+      }
+    }
+
+    uint64_t now_tick() const
+    {
+      return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count() / TICK_MS;
+    }
+
+    uint64_t deadline_for(std::chrono::milliseconds timeout) const
+    {
+      // count from the present even if the wheel lags behind, and never
+      // fire before the timeout has passed
+      const uint64_t ticks = (std::max<int64_t>(timeout.count(), 0) + TICK_MS - 1) / TICK_MS;
+      return std::max(m_current, now_tick()) + std::max<uint64_t>(ticks, 1);
+    }
+
+    void insert(timer_id id, entry &e)
+    {
+      // the lowest level whose span covers the deadline, and its slot
+      // there; entries cascade down as the wheel turns
+      const uint64_t delta = e.deadline > m_current ? e.deadline - m_current : 0;
+      unsigned level = 0;
+      while (level + 1 < LEVELS && delta >= (uint64_t(1) << (SLOT_BITS * (level + 1))))
+        ++level;
+      uint64_t deadline = e.deadline;
+      if (level == LEVELS - 1 && delta >= (uint64_t(1) << (SLOT_BITS * LEVELS)))
+        deadline = m_current + (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1; // comes back around and is placed again
+      e.slot = level * SLOTS + ((deadline >> (SLOT_BITS * level)) & (SLOTS - 1));
+      m_slots[e.slot].push_back(id);
+      e.pos = std::prev(m_slots[e.slot].end());
+    }
+
+    void arm()
+    {
+      m_armed = true;
+      m_timer.expires_at(m_start + std::chrono::milliseconds((m_current + 1) * TICK_MS));
+      m_timer.async_wait([this](const boost::system::error_code& ec) {
+        if (ec != boost::asio::error::operation_aborted)
+          on_tick();
+      });
+    }
+
+    void on_tick()
+    {
+      std::vector<callback_t> due;
+      {
+        boost::unique_lock<boost::mutex> lock(m_lock);
+        if (m_shutdown)
+          return;
+        const uint64_t now = now_tick();
+        while (m_current < now && !m_entries.empty())
+        {
+          ++m_current;
+          for (unsigned level = 1; level < LEVELS; ++level)
+          {
+            if (m_current & ((uint64_t(1) << (SLOT_BITS * level)) - 1))
+              break;
+            cascade(level * SLOTS + ((m_current >> (SLOT_BITS * level)) & (SLOTS - 1)));
+          }
+          std::list<timer_id> &slot = m_slots[m_current & (SLOTS - 1)];
+          for (auto i = slot.begin(); i != slot.end(); )
+          {
+            const auto e = m_entries.find(*i);
+            if (e->second.deadline > m_current)
+            {
+              ++i;
+              continue;
+            }
+            due.push_back(std::move(e->second.cb));
+            m_entries.erase(e);
+            i = slot.erase(i);
+          }
+        }
+        if (m_entries.empty())
+          m_armed = false;
+        else
+          arm();
+      }
+      for (auto &cb: due)
+        cb();
+    }
+
+    void cascade(size_t slot_index)
+    {
+      std::list<timer_id> slot;
+      slot.swap(m_slots[slot_index]);
+      for (timer_id id: slot)
+        insert(id, m_entries[id]);
+    }
+
+    boost::mutex m_lock;
+    boost::asio::steady_timer m_timer;
+    const std::chrono::steady_clock::time_point m_start;
+    uint64_t m_current;
+    timer_id m_next_id;
+    bool m_armed;
+    bool m_shutdown;
+    std::vector<std::list<timer_id>> m_slots; // LEVELS levels of SLOTS slots
+    std::unordered_map<timer_id, entry> m_entries;
+  };
+}
+}
@@ -29,6 +29,7 @@
 #pragma once 
 
 #include <algorithm>
+#include <cstring>
 
 namespace epee 
 {
@@ -38,8 +39,8 @@ namespace misc_utils
   {
     inline std::string transform_to_escape_sequence(const std::string& src)
     {
-      static const char escaped[] = "\b\f\n\r\t\v\"\\/";
-      if (std::find_first_of(src.begin(), src.end(), escaped, escaped + sizeof(escaped)) == src.end())
+      static const char escaped[] = "\"\\/";
+      if (std::find_if(src.begin(), src.end(), [](char c) { return (unsigned char)c < 0x20 || strchr(escaped, c); }) == src.end())
         return src;
 
       std::string res;
@@ -58,8 +59,6 @@ namespace misc_utils
           res+="\\r"; break;
         case '\t':  //Tab
           res+="\\t"; break;
-        case '\v':  //Vertical tab
-          res+="\\v"; break;
         //case '\'':  //Apostrophe or single quote
         //  res+="\\'"; break;
         case '"':  //Double quote
@@ -69,7 +68,16 @@ namespace misc_utils
         case '/':  //Backslash caracter
           res+="\\/"; break;
         default:
-          res.push_back(*it);
+          // other control characters have no short escape in JSON
+          if ((unsigned char)*it < 0x20)
+          {
+            static const char hex[] = "0123456789abcdef";
+            res += "\\u00";
+            res.push_back(hex[(unsigned char)*it >> 4]);
+            res.push_back(hex[*it & 0xf]);
+          }
+          else
+            res.push_back(*it);
         }
       }
       return res;
@@ -28,6 +28,8 @@
 
 #pragma once 
 
+#include <ostream>
+#include <streambuf>
 #include "misc_language.h"
 #include "portable_storage_base.h"
 #include "portable_storage_to_bin.h"
@@ -40,6 +42,28 @@ namespace epee
 {
   namespace serialization
   {
+    //lets the stream based writers append straight to the target string,
+    //instead of building a stringstream and copying it out with str()
+    class string_append_buf: public std::streambuf
+    {
+    public:
+      explicit string_append_buf(std::string& buff): m_buff(buff) {}
+    protected:
+      int_type overflow(int_type c) override
+      {
+        if(!traits_type::eq_int_type(c, traits_type::eof()))
+          m_buff.push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+      }
+      std::streamsize xsputn(const char* s, std::streamsize n) override
+      {
+        m_buff.append(s, n);
+        return n;
+      }
+    private:
+      std::string& m_buff;
+    };
+
     /************************************************************************/
     /*                                                                      */
     /************************************************************************/
@@ -109,9 +133,10 @@ namespace epee
     bool portable_storage::dump_as_json(std::string& buff, size_t indent, bool insert_newlines)
     {
       TRY_ENTRY();
-      std::stringstream ss;
+      buff.clear();
+      string_append_buf sb(buff);
+      std::ostream ss(&sb);
       epee::serialization::dump_as_json(ss, m_root, indent, insert_newlines);
-      buff = ss.str();
       return true;
       CATCH_ENTRY("portable_storage::dump_as_json", false)
     }
@@ -133,14 +158,15 @@ namespace epee
     bool portable_storage::store_to_binary(binarybuffer& target)
     {
       TRY_ENTRY();
-      std::stringstream ss;
+      target.clear();
+      string_append_buf sb(target);
+      std::ostream ss(&sb);
       storage_block_header sbh = AUTO_VAL_INIT(sbh);
       sbh.m_signature_a = PORTABLE_STORAGE_SIGNATUREA;
       sbh.m_signature_b = PORTABLE_STORAGE_SIGNATUREB;
       sbh.m_ver = PORTABLE_STORAGE_FORMAT_VER;
       ss.write((const char*)&sbh, sizeof(storage_block_header));
       pack_entry_to_buff(ss, m_root);
-      target = ss.str();
       return true;
       CATCH_ENTRY("portable_storage::store_to_binary", false)
     }
@@ -25,359 +25,231 @@
 // 
 
 #pragma once
+#include <cerrno>
+#include <cstdlib>
+#include <vector>
 #include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string/predicate.hpp>
-#include "parserse_base_utils.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+#include "misc_log_ex.h"
 #include "file_io_utils.h"
 
 #define EPEE_JSON_RECURSION_LIMIT_INTERNAL 100
 
 namespace epee
 {
-  using namespace misc_utils::parse;
   namespace serialization
   {
     namespace json
     {
-#define CHECK_ISSPACE()  if(!isspace(*it)){ ASSERT_MES_AND_THROW("Wrong JSON character at: " << std::string(it, buf_end));}
-
-      /*inline void parse_error()
-      {
-        ASSERT_MES_AND_THROW("json parse error");
-      }*/
+      // Fills a storage straight from the events of a rapidjson SAX reader, so
+      // the text is walked once and no intermediate document is built.
+      // The storage keeps the rules of the format: the top level is a section,
+      // arrays hold values of a single kind, arrays of arrays are not supported,
+      // null members are skipped, and integers keep their signedness (negative
+      // integers are int64, others uint64, and integers in arrays are int64).
       template<class t_storage>
-      inline void run_handler(typename t_storage::hsection current_section, std::string::const_iterator& sec_buf_begin, std::string::const_iterator buf_end, t_storage& stg, unsigned int recursion)
+      class storage_reader_handler: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, storage_reader_handler<t_storage> >
       {
-        CHECK_AND_ASSERT_THROW_MES(recursion < EPEE_JSON_RECURSION_LIMIT_INTERNAL, "Wrong JSON data: recursion limitation (" << EPEE_JSON_RECURSION_LIMIT_INTERNAL << ") exceeded");
+      public:
+        explicit storage_reader_handler(t_storage& stg): m_stg(stg) {}
 
-        std::string::const_iterator sub_element_start;
-        std::string name;        
-        typename t_storage::harray h_array = nullptr;
-        enum match_state
+        bool Null()
         {
-          match_state_lookup_for_section_start, 
-          match_state_lookup_for_name, 
-          match_state_waiting_separator, 
-          match_state_wonder_after_separator, 
-          match_state_wonder_after_value, 
-          match_state_wonder_array, 
-          match_state_array_after_value,
-          match_state_array_waiting_value, 
-          match_state_error
-        };
+          if (!check_value())
+            return false;
+          if (!m_frames.back().is_array)
+            return true;
+          return fail("null array elements are not supported");
+        }
 
-        enum array_mode
+        bool Bool(bool b)
         {
-          array_mode_undifined = 0,
-          array_mode_sections, 
-          array_mode_string, 
-          array_mode_numbers,
-          array_mode_booleans
-        };
+          return check_value() && store(b, array_mode_booleans);
+        }
+
+        bool RawNumber(const char* str, rapidjson::SizeType length, bool copy)
+        {
+          if (!check_value())
+            return false;
+          const frame& top = m_frames.back();
+          bool is_float = false;
+          for (rapidjson::SizeType i = 0; i < length; ++i)
+            if (str[i] == '.' || str[i] == 'e' || str[i] == 'E')
+              is_float = true;
+          if (is_float)
+          {
+            double val;
+            if (!boost::conversion::try_lexical_convert(str, length, val))
+              return fail("invalid number");
+            return store(val, array_mode_numbers);
+          }
+          // the text is a valid JSON integer, only its range needs checking
+          char* end = nullptr;
+          errno = 0;
+          if (str[0] == '-' || top.is_array)
+          {
+            const long long val = std::strtoll(str, &end, 10);
+            if (errno == ERANGE)
+              return fail("integer out of range");
+            return store(int64_t(val), array_mode_numbers);
+          }
+          const unsigned long long val = std::strtoull(str, &end, 10);
+          if (errno == ERANGE)
+            return fail("integer out of range");
+          return store(uint64_t(val), array_mode_numbers);
+        }
 
-        match_state state = match_state_lookup_for_section_start;
-        array_mode array_md = array_mode_undifined;
-        std::string::const_iterator it = sec_buf_begin;
-        for(;it != buf_end;it++)
+        bool String(const char* str, rapidjson::SizeType length, bool copy)
         {
-          switch (state)
+          return check_value() && store(std::string(str, length), array_mode_string);
+        }
+
+        bool StartObject()
+        {
+          if (m_frames.size() >= EPEE_JSON_RECURSION_LIMIT_INTERNAL)
+            return fail("recursion limitation exceeded");
+          typename t_storage::hsection section = nullptr;
+          if (!m_frames.empty())
           {
-          case match_state_lookup_for_section_start:
-            if(*it == '{')
-              state = match_state_lookup_for_name;
-            else CHECK_ISSPACE();
-            break;
-          case match_state_lookup_for_name:
-            switch(*it)
+            frame& top = m_frames.back();
+            if (top.is_array)
             {
-            case '"':
-              match_string2(it, buf_end, name);
-              state = match_state_waiting_separator;
-              break;
-            case '}':
-              //this is it! section ends here.
-              //seems that it is empty section
-              sec_buf_begin = it;
-              return;
-            default:
-              CHECK_ISSPACE();
-            }
-            break;
-          case match_state_waiting_separator:
-            if(*it == ':')
-              state = match_state_wonder_after_separator;
-            else CHECK_ISSPACE();
-            break;
-          case match_state_wonder_after_separator:
-            if(*it == '"')
-            {//just a named string value started
-              std::string val;
-              match_string2(it, buf_end, val);
-              //insert text value 
-              stg.set_value(name, val, current_section);              
-              state = match_state_wonder_after_value;
-            }else if (isdigit(*it) || *it == '-')
-            {//just a named number value started
-              std::string val;
-              bool is_v_float = false;bool is_signed = false;
-              match_number2(it, buf_end, val, is_v_float, is_signed);
-              if(!is_v_float)
+              if (top.mode == array_mode_undefined)
               {
-                if(is_signed)
-                {
-                  int64_t nval = boost::lexical_cast<int64_t>(val);
-                  stg.set_value(name, nval, current_section);              
-                }else
-                {
-                  uint64_t nval = boost::lexical_cast<uint64_t >(val);
-                  stg.set_value(name, nval, current_section);              
-                }
-              }else
-              {
-                double nval = boost::lexical_cast<double>(val);
-                stg.set_value(name, nval, current_section);              
+                top.array = m_stg.insert_first_section(top.name, section, top.section);
+                top.mode = array_mode_sections;
               }
-              state = match_state_wonder_after_value;
-            }else if(isalpha(*it) )
-            {// could be null, true or false
-              std::string word;
-              match_word2(it, buf_end, word);
-              if(boost::iequals(word, "null"))
-              {
-                state = match_state_wonder_after_value;
-                //just skip this, 
-              }else if(boost::iequals(word, "true"))
-              {
-                stg.set_value(name, true, current_section);              
-                state = match_state_wonder_after_value;
-              }else if(boost::iequals(word, "false"))
-              {
-                stg.set_value(name, false, current_section);              
-                state = match_state_wonder_after_value;
-              }else ASSERT_MES_AND_THROW("Unknown value keyword " << word);
-            }else if(*it == '{')
-            {
-              //sub section here
-              typename t_storage::hsection new_sec = stg.open_section(name, current_section, true);
-              CHECK_AND_ASSERT_THROW_MES(new_sec, "Failed to insert new section in json: " << std::string(it, buf_end));
-              run_handler(new_sec, it, buf_end, stg, recursion + 1);
-              state = match_state_wonder_after_value;
-            }else if(*it == '[')
-            {//array of something
-              state = match_state_wonder_array;
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_wonder_after_value:
-            if(*it == ',')
-              state = match_state_lookup_for_name;
-            else if(*it == '}')
-            {
-              //this is it! section ends here.
-              sec_buf_begin = it;
-              return;
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_wonder_array:
-            if(*it == '[')
-            {
-              ASSERT_MES_AND_THROW("array of array not suppoerted yet :( sorry"); 
-              //mean array of array
+              else if (top.mode != array_mode_sections || !m_stg.insert_next_section(top.array, section))
+                return fail("mixed types in array");
+              if (!top.array)
+                return fail("failed to insert array of sections");
             }
-            if(*it == '{')
-            {
-              //mean array of sections
-              typename t_storage::hsection new_sec = nullptr;
-              h_array = stg.insert_first_section(name, new_sec, current_section);
-              CHECK_AND_ASSERT_THROW_MES(h_array&&new_sec, "failed to create new section");
-              run_handler(new_sec, it, buf_end, stg, recursion + 1);
-              state = match_state_array_after_value;
-              array_md = array_mode_sections;
-            }else if(*it == '"')
-            {
-              //mean array of strings
-              std::string val;
-              match_string2(it, buf_end, val);
-              h_array = stg.insert_first_value(name, val, current_section);
-              CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values entry");
-              state = match_state_array_after_value;
-              array_md = array_mode_string;
-            }else if (isdigit(*it) || *it == '-')
-            {//array of numbers value started
-              std::string val;
-              bool is_v_float = false;bool is_signed_val = false;
-              match_number2(it, buf_end, val, is_v_float, is_signed_val);
-              if(!is_v_float)
-              {
-                int64_t nval = boost::lexical_cast<int64_t>(val);//bool res = string_tools::string_to_num_fast(val, nval);
-                h_array = stg.insert_first_value(name, nval, current_section);
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-              }else
-              {
-                double nval = boost::lexical_cast<double>(val);//bool res = string_tools::string_to_num_fast(val, nval);
-                h_array = stg.insert_first_value(name, nval, current_section);
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-              }
-
-              state = match_state_array_after_value;
-              array_md = array_mode_numbers;
-            }else if(*it == ']')//empty array
+            else
             {
-              array_md = array_mode_undifined;
-              state = match_state_wonder_after_value;
-            }else if(isalpha(*it) )
-            {// array of booleans
-              std::string word;
-              match_word2(it, buf_end, word);
-              if(boost::iequals(word, "true"))
-              {
-                h_array = stg.insert_first_value(name, true, current_section);              
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-                state = match_state_array_after_value;
-                array_md = array_mode_booleans;
-              }else if(boost::iequals(word, "false"))
-              {
-                h_array = stg.insert_first_value(name, false, current_section);              
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-                state = match_state_array_after_value;
-                array_md = array_mode_booleans;
-
-              }else ASSERT_MES_AND_THROW("Unknown value keyword " << word)
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_array_after_value:
-            if(*it == ',')
-              state = match_state_array_waiting_value;
-            else if(*it == ']')
-            {
-              h_array = nullptr;
-              array_md = array_mode_undifined;
-              state = match_state_wonder_after_value;
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_array_waiting_value:
-            switch(array_md)
-            {
-            case array_mode_sections:
-              if(*it == '{')
-              {
-                typename t_storage::hsection new_sec = NULL;
-                bool res = stg.insert_next_section(h_array, new_sec);
-                CHECK_AND_ASSERT_THROW_MES(res&&new_sec, "failed to insert next section");
-                run_handler(new_sec, it, buf_end, stg, recursion + 1);
-                state = match_state_array_after_value;
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_string:
-              if(*it == '"')
-              {
-                std::string val;
-                match_string2(it, buf_end, val);
-                bool res = stg.insert_next_value(h_array, val);
-                CHECK_AND_ASSERT_THROW_MES(res, "failed to insert values");
-                state = match_state_array_after_value;
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_numbers:
-              if (isdigit(*it) || *it == '-')
-              {//array of numbers value started
-                std::string val;
-                bool is_v_float = false;bool is_signed_val = false;
-                match_number2(it, buf_end, val, is_v_float, is_signed_val);
-                bool insert_res = false;
-                if(!is_v_float)
-                {
-                  int64_t nval = boost::lexical_cast<int64_t>(val);  //bool res = string_tools::string_to_num_fast(val, nval);
-                  insert_res = stg.insert_next_value(h_array, nval);
-                  
-                }else
-                {
-                  //TODO: optimize here if need
-                  double nval = boost::lexical_cast<double>(val); //string_tools::string_to_num_fast(val, nval);
-                  insert_res = stg.insert_next_value(h_array, nval);              
-                }
-                CHECK_AND_ASSERT_THROW_MES(insert_res, "Failed to insert next value");
-                state = match_state_array_after_value;
-                array_md = array_mode_numbers;
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_booleans:
-              if(isalpha(*it) )
-              {// array of booleans
-                std::string word;
-                match_word2(it, buf_end, word);
-                if(boost::iequals(word, "true"))
-                {
-                  bool r = stg.insert_next_value(h_array, true);              
-                  CHECK_AND_ASSERT_THROW_MES(r, " failed to insert values section entry");
-                  state = match_state_array_after_value;
-                }else if(boost::iequals(word, "false"))
-                {
-                  bool r = stg.insert_next_value(h_array, false);
-                  CHECK_AND_ASSERT_THROW_MES(r, " failed to insert values section entry");
-                  state = match_state_array_after_value;
-                }
-                else ASSERT_MES_AND_THROW("Unknown value keyword " << word);
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_undifined:
-            default:
-              ASSERT_MES_AND_THROW("Bad array state");
+              section = m_stg.open_section(top.name, top.section, true);
             }
-            break;
-          case match_state_error:
-          default:
-            ASSERT_MES_AND_THROW("WRONG JSON STATE");
+            if (!section)
+              return fail("failed to insert section");
           }
+          m_frames.push_back(frame(section, false));
+          return true;
         }
-      }
-/*
-{
-    "firstName": "John",
-    "lastName": "Smith",
-    "age": 25,
-    "address": {
-        "streetAddress": "21 2nd Street",
-        "city": "New York",
-        "state": "NY",
-        "postalCode": -10021, 
-        "have_boobs": true, 
-        "have_balls": false 
-    },
-    "phoneNumber": [
+
+        bool Key(const char* str, rapidjson::SizeType length, bool copy)
         {
-            "type": "home",
-            "number": "212 555-1234"
-        },
+          m_frames.back().name.assign(str, length);
+          return true;
+        }
+
+        bool EndObject(rapidjson::SizeType member_count)
         {
-            "type": "fax",
-            "number": "646 555-4567"
+          m_frames.pop_back();
+          return true;
         }
-    ], 
-    "phoneNumbers": [
-    "812 123-1234",
-    "916 123-4567"
-    ]
-}
-*/
-      template<class t_storage>
-      inline bool load_from_json(const std::string& buff_json, t_storage& stg)
-      {
-        std::string::const_iterator sec_buf_begin  = buff_json.begin();
-        try
+
+        bool StartArray()
+        {
+          if (m_frames.empty())
+            return fail("top level must be a section");
+          if (m_frames.back().is_array)
+            return fail("arrays of arrays are not supported");
+          frame array(m_frames.back().section, true);
+          array.name = m_frames.back().name;
+          m_frames.push_back(std::move(array));
+          return true;
+        }
+
+        bool EndArray(rapidjson::SizeType element_count)
         {
-          run_handler(nullptr, sec_buf_begin, buff_json.end(), stg, 0);
+          m_frames.pop_back();
           return true;
         }
-        catch(const std::exception& ex)
+
+        const std::string& error() const { return m_error; }
+
+      private:
+        enum array_mode
+        {
+          array_mode_undefined = 0,
+          array_mode_sections,
+          array_mode_string,
+          array_mode_numbers,
+          array_mode_booleans
+        };
+
+        struct frame
         {
-          MERROR("Failed to parse json, what: " << ex.what());
+          frame(typename t_storage::hsection section, bool is_array): section(section), array(nullptr), is_array(is_array), mode(array_mode_undefined) {}
+          typename t_storage::hsection section;
+          typename t_storage::harray array;
+          std::string name;
+          bool is_array;
+          array_mode mode;
+        };
+
+        bool fail(const char* error)
+        {
+          m_error = error;
           return false;
         }
-        catch(...)
+
+        bool check_value()
+        {
+          if (m_frames.empty())
+            return fail("top level must be a section");
+          return true;
+        }
+
+        template<class t_value>
+        bool store(const t_value& val, array_mode mode)
+        {
+          frame& top = m_frames.back();
+          if (!top.is_array)
+          {
+            if (!m_stg.set_value(top.name, val, top.section))
+              return fail("failed to set value");
+            return true;
+          }
+          if (top.mode == array_mode_undefined)
+          {
+            top.array = m_stg.insert_first_value(top.name, val, top.section);
+            top.mode = mode;
+            if (!top.array)
+              return fail("failed to insert array");
+            return true;
+          }
+          if (top.mode != mode || !m_stg.insert_next_value(top.array, val))
+            return fail("mixed types in array");
+          return true;
+        }
+
+        t_storage& m_stg;
+        std::vector<frame> m_frames;
+        std::string m_error;
+      };
+
+      template<class t_storage>
+      inline bool load_from_json(const std::string& buff_json, t_storage& stg)
+      {
+        // a blank body stands for an empty section, as calls without parameters are often sent that way
+        if (buff_json.find_first_not_of(" \t\r\n") == std::string::npos)
+          return true;
+        storage_reader_handler<t_storage> handler(stg);
+        rapidjson::Reader reader;
+        rapidjson::MemoryStream stream(buff_json.data(), buff_json.size());
+        // numbers come as text so that 64 bit integers keep every digit
+        const rapidjson::ParseResult res = reader.Parse<rapidjson::kParseStopWhenDoneFlag | rapidjson::kParseNumbersAsStringsFlag>(stream, handler);
+        if (res.IsError())
         {
-          MERROR("Failed to parse json");
+          if (!handler.error().empty())
+            MERROR("Failed to parse json at offset " << res.Offset() << ": " << handler.error());
+          else
+            MERROR("Failed to parse json at offset " << res.Offset() << ": " << rapidjson::GetParseError_En(res.Code()));
           return false;
         }
+        return true;
       }
     }
   }
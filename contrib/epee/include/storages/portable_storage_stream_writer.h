@@ -0,0 +1,291 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "misc_language.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /* Writes the portable_storage binary format straight from the          */
+    /* KV_SERIALIZE store() calls, without building a section tree first.  */
+    /* Entries come out in declaration order rather than sorted by name,   */
+    /* which the binary loader does not care about. Store-only: any         */
+    /* attempt to read through it fails.                                    */
+    /************************************************************************/
+    class portable_storage_stream_writer
+    {
+    public:
+      //a section or an array currently being written
+      struct frame
+      {
+        size_t count_fixup;   // index into m_count_fixups of this container's element counter
+        uint8_t array_type;   // element type for arrays, 0 for sections
+      };
+      typedef frame* hsection;
+      typedef frame* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_stream_writer(size_t reserve_size = 0);
+
+      hsection   open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool       set_value(const std::string& value_name, const t_value& v, hsection hparent_section);
+      bool       set_value(const std::string& value_name, const storage_entry& v, hsection hparent_section);
+
+      template<class t_value>
+      harray     insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section);
+      template<class t_value>
+      bool       insert_next_value(harray hval_array, const t_value& v);
+      harray     insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section);
+      bool       insert_next_section(harray hsec_array, hsection& hinserted_childsection);
+
+      //load side of the storage interface, never succeeds
+      template<class t_value>
+      bool       get_value(const std::string& value_name, t_value& val, hsection hparent_section) { return false; }
+      template<class t_value>
+      harray     get_first_value(const std::string& value_name, t_value& target, hsection hparent_section) { return nullptr; }
+      template<class t_value>
+      bool       get_next_value(harray hval_array, t_value& target) { return false; }
+      harray     get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section) { return nullptr; }
+      bool       get_next_section(harray hsec_array, hsection& h_child_section) { return false; }
+
+      //closes everything still open; the writer can not be used afterwards
+      bool       store_to_binary(binarybuffer& target);
+
+    private:
+      struct buffer_stream
+      {
+        std::string& m_buff;
+        buffer_stream(std::string& buff): m_buff(buff) {}
+        void write(const char* data, size_t size) { m_buff.append(data, size); }
+      };
+
+      //element counters are written as a fixed 4 byte varint placeholder and shrunk to their
+      //minimal encoding by store_to_binary, so the output matches what pack_varint would give
+      struct count_fixup
+      {
+        size_t offset;
+        size_t count;
+      };
+
+      template<class t_value> struct type_code;
+
+      bool        close_above(frame* f);
+      void        push_frame(uint8_t array_type);
+      bool        begin_entry(const std::string& name, uint8_t type, hsection hparent_section);
+      template<class t_value>
+      void        write_raw(const t_value& v) { m_buff.append((const char*)&v, sizeof(v)); }
+      void        write_raw(const std::string& v) { buffer_stream strm(m_buff); put_string(strm, v); }
+
+      std::string m_buff;
+      std::deque<frame> m_frames; // deque keeps handles stable while frames are pushed and popped
+      std::vector<count_fixup> m_count_fixups;
+      bool m_finished;
+    };
+
+    template<> struct portable_storage_stream_writer::type_code<uint64_t> { enum { value = SERIALIZE_TYPE_UINT64 }; };
+    template<> struct portable_storage_stream_writer::type_code<uint32_t> { enum { value = SERIALIZE_TYPE_UINT32 }; };
+    template<> struct portable_storage_stream_writer::type_code<uint16_t> { enum { value = SERIALIZE_TYPE_UINT16 }; };
+    template<> struct portable_storage_stream_writer::type_code<uint8_t>  { enum { value = SERIALIZE_TYPE_UINT8 }; };
+    template<> struct portable_storage_stream_writer::type_code<int64_t>  { enum { value = SERIALIZE_TYPE_INT64 }; };
+    template<> struct portable_storage_stream_writer::type_code<int32_t>  { enum { value = SERIALIZE_TYPE_INT32 }; };
+    template<> struct portable_storage_stream_writer::type_code<int16_t>  { enum { value = SERIALIZE_TYPE_INT16 }; };
+    template<> struct portable_storage_stream_writer::type_code<int8_t>   { enum { value = SERIALIZE_TYPE_INT8 }; };
+    template<> struct portable_storage_stream_writer::type_code<double>   { enum { value = SERIALIZE_TYPE_DUOBLE }; };
+    template<> struct portable_storage_stream_writer::type_code<bool>     { enum { value = SERIALIZE_TYPE_BOOL }; };
+    template<> struct portable_storage_stream_writer::type_code<std::string> { enum { value = SERIALIZE_TYPE_STRING }; };
+
+    inline
+    portable_storage_stream_writer::portable_storage_stream_writer(size_t reserve_size): m_finished(false)
+    {
+      m_buff.reserve(reserve_size);
+      const uint32_t signature_a = PORTABLE_STORAGE_SIGNATUREA;
+      const uint32_t signature_b = PORTABLE_STORAGE_SIGNATUREB;
+      const uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+      write_raw(signature_a);
+      write_raw(signature_b);
+      write_raw(ver);
+      push_frame(0); // root section
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_stream_writer::push_frame(uint8_t array_type)
+    {
+      m_frames.push_back(frame{m_count_fixups.size(), array_type});
+      m_count_fixups.push_back(count_fixup{m_buff.size(), 0});
+      const uint32_t placeholder = PORTABLE_RAW_SIZE_MARK_DWORD;
+      write_raw(placeholder);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_stream_writer::close_above(frame* f)
+    {
+      CHECK_AND_ASSERT_MES(!m_finished, false, "portable_storage_stream_writer used after store_to_binary");
+      if(!f)
+        f = &m_frames.front();
+      //store() calls are strictly nested, so touching a container means everything opened after it is complete
+      while(m_frames.size() > 1 && &m_frames.back() != f)
+        m_frames.pop_back();
+      CHECK_AND_ASSERT_MES(&m_frames.back() == f, false, "portable_storage_stream_writer: write to a container that is already closed");
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_stream_writer::begin_entry(const std::string& name, uint8_t type, hsection hparent_section)
+    {
+      if(!close_above(hparent_section))
+        return false;
+      CHECK_AND_ASSERT_MES(!m_frames.back().array_type, false, "portable_storage_stream_writer: named entry " << name << " written into an array");
+      CHECK_AND_ASSERT_THROW_MES(name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << name.size() << ", val: " << name);
+      ++m_count_fixups[m_frames.back().count_fixup].count;
+      const uint8_t len = static_cast<uint8_t>(name.size());
+      write_raw(len);
+      m_buff.append(name.data(), name.size());
+      write_raw(type);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_stream_writer::hsection portable_storage_stream_writer::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      if(!create_if_notexist)
+        return nullptr;
+      if(!begin_entry(section_name, SERIALIZE_TYPE_OBJECT, hparent_section))
+        return nullptr;
+      push_frame(0);
+      return &m_frames.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_stream_writer::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      if(!begin_entry(value_name, type_code<t_value>::value, hparent_section))
+        return false;
+      write_raw(v);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_stream_writer::set_value(const std::string& value_name, const storage_entry& v, hsection hparent_section)
+    {
+      if(!close_above(hparent_section))
+        return false;
+      CHECK_AND_ASSERT_MES(!m_frames.back().array_type, false, "portable_storage_stream_writer: named entry " << value_name << " written into an array");
+      CHECK_AND_ASSERT_THROW_MES(value_name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << value_name.size() << ", val: " << value_name);
+      ++m_count_fixups[m_frames.back().count_fixup].count;
+      const uint8_t len = static_cast<uint8_t>(value_name.size());
+      write_raw(len);
+      m_buff.append(value_name.data(), value_name.size());
+      //pack_entry_to_buff writes the type byte itself
+      buffer_stream strm(m_buff);
+      return pack_entry_to_buff(strm, v);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_storage_stream_writer::harray portable_storage_stream_writer::insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+    {
+      const uint8_t type = type_code<t_value>::value;
+      if(!begin_entry(value_name, type | SERIALIZE_FLAG_ARRAY, hparent_section))
+        return nullptr;
+      push_frame(type);
+      ++m_count_fixups[m_frames.back().count_fixup].count;
+      write_raw(v);
+      return &m_frames.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_stream_writer::insert_next_value(harray hval_array, const t_value& v)
+    {
+      CHECK_AND_ASSERT_MES(hval_array, false, "portable_storage_stream_writer: null array handle");
+      if(!close_above(hval_array))
+        return false;
+      CHECK_AND_ASSERT_MES(hval_array->array_type == type_code<t_value>::value, false, "portable_storage_stream_writer: array element type mismatch");
+      ++m_count_fixups[hval_array->count_fixup].count;
+      write_raw(v);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_stream_writer::harray portable_storage_stream_writer::insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      hinserted_childsection = nullptr;
+      if(!begin_entry(section_name, SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY, hparent_section))
+        return nullptr;
+      push_frame(SERIALIZE_TYPE_OBJECT);
+      harray hsec_array = &m_frames.back();
+      if(!insert_next_section(hsec_array, hinserted_childsection))
+        return nullptr;
+      return hsec_array;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_stream_writer::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      hinserted_childsection = nullptr;
+      CHECK_AND_ASSERT_MES(hsec_array, false, "portable_storage_stream_writer: null array handle");
+      if(!close_above(hsec_array))
+        return false;
+      CHECK_AND_ASSERT_MES(hsec_array->array_type == SERIALIZE_TYPE_OBJECT, false, "portable_storage_stream_writer: array element type mismatch");
+      ++m_count_fixups[hsec_array->count_fixup].count;
+      push_frame(0);
+      hinserted_childsection = &m_frames.back();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_stream_writer::store_to_binary(binarybuffer& target)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT_MES(!m_finished, false, "portable_storage_stream_writer::store_to_binary called twice");
+      m_finished = true;
+      m_frames.clear();
+
+      //fixups were recorded in creation order, which is also buffer order
+      target.clear();
+      target.reserve(m_buff.size());
+      buffer_stream strm(target);
+      size_t pos = 0;
+      for(const count_fixup& cf: m_count_fixups)
+      {
+        target.append(m_buff.data() + pos, cf.offset - pos);
+        pack_varint(strm, cf.count);
+        pos = cf.offset + sizeof(uint32_t);
+      }
+      target.append(m_buff.data() + pos, m_buff.size() - pos);
+      return true;
+      CATCH_ENTRY("portable_storage_stream_writer::store_to_binary", false)
+    }
+  }
+}
@@ -30,6 +30,7 @@
 
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_stream_writer.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -107,9 +108,9 @@ namespace epee
     template<class t_struct>
     bool store_t_to_binary(t_struct& str_in, std::string& binary_buff, size_t indent = 0)
     {
-      portable_storage ps;
-      str_in.store(ps);
-      return ps.store_to_binary(binary_buff);
+      portable_storage_stream_writer writer;
+      str_in.store(writer);
+      return writer.store_to_binary(binary_buff);
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
@@ -100,31 +100,28 @@ namespace string_tools
   template<class CharT>
   bool parse_hexstr_to_binbuff(const std::basic_string<CharT>& s, std::basic_string<CharT>& res, bool allow_partial_byte = false)
   {
+    static_assert(sizeof(CharT) == 1, "expected a narrow string");
     res.clear();
     if (!allow_partial_byte && (s.size() & 1))
       return false;
-    try
+    res.resize((s.size() + 1) / 2);
+    const size_t whole = s.size() / 2;
+    if (!from_hex::buffer({reinterpret_cast<std::uint8_t*>(&res[0]), whole}, {reinterpret_cast<const char*>(s.data()), whole * 2}))
+    {
+      res.clear();
+      return false;
+    }
+    if (s.size() & 1)
     {
-      long v = 0;
-      for(size_t i = 0; i < (s.size() + 1) / 2; i++)
+      const int v = from_hex::nibble(static_cast<char>(s.back()));
+      if (v < 0)
       {
-        CharT byte_str[3];
-        size_t copied = s.copy(byte_str, 2, 2 * i);
-        byte_str[copied] = CharT(0);
-        CharT* endptr;
-        v = strtoul(byte_str, &endptr, 16);
-        if (v < 0 || 0xFF < v || endptr != byte_str + copied)
-        {
-          return false;
-        }
-        res.push_back(static_cast<unsigned char>(v));
+        res.clear();
+        return false;
       }
-
-      return true;
-    }catch(...)
-    {
-      return false;
+      res.back() = static_cast<CharT>(v);
     }
+    return true;
   }
   //----------------------------------------------------------------------------
   template<class t_pod_type>
@@ -340,17 +337,12 @@ POP_WARNINGS
   bool hex_to_pod(const std::string& hex_str, t_pod_type& s)
   {
     static_assert(std::is_pod<t_pod_type>::value, "expected pod type");
-    std::string hex_str_tr = trim(hex_str);
-    if(sizeof(s)*2 != hex_str.size())
-      return false;
-    std::string bin_buff;
-    if(!parse_hexstr_to_binbuff(hex_str_tr, bin_buff))
-      return false;
-    if(bin_buff.size()!=sizeof(s))
-      return false;
-
-    s = *(t_pod_type*)bin_buff.data();
-    return true;
+    t_pod_type tmp;
+    const bool r = from_hex::buffer(as_mut_byte_span(tmp), to_span(hex_str));
+    if (r)
+      s = tmp;
+    memwipe(&tmp, sizeof(tmp));
+    return r;
   }
   //----------------------------------------------------------------------------
   template<class t_pod_type>
@@ -34,6 +34,7 @@
 #include <string>
 #include "memwipe.h"
 #include "fnv1.h"
+#include "mlocker.h"
 
 namespace epee
 {
@@ -80,7 +81,7 @@ namespace epee
     void grow(size_t sz, size_t reserved = 0);
 
   private:
-    std::vector<char> buffer;
+    std::vector<char, mlocked_allocator<char>> buffer;
   };
 
   template<typename T> inline bool wipeable_string::hex_to_pod(T &pod) const
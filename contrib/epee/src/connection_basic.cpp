@@ -143,6 +143,8 @@ connection_basic_pimpl::connection_basic_pimpl(const std::string &name) : m_thro
 
 // static variables:
 int connection_basic_pimpl::m_default_tos;
+std::atomic<uint64_t> connection_basic::s_send_que_count(0);
+std::atomic<uint64_t> connection_basic::s_send_que_bytes(0);
 
 // methods:
 connection_basic::connection_basic(boost::asio::io_service& io_service, std::atomic<long> &ref_sock_count, std::atomic<long> &sock_number)
@@ -167,47 +169,44 @@ connection_basic::connection_basic(boost::asio::io_service& io_service, std::ato
 connection_basic::~connection_basic() noexcept(false) {
 	std::string remote_addr_str = "?";
 	m_ref_sock_count--;
+	for (const send_que_entry &entry: m_send_que)
+		on_send_que_pop(entry);
 	try { boost::system::error_code e; remote_addr_str = socket_.remote_endpoint(e).address().to_string(); } catch(...){} ;
 	_note("Destructing connection p2p#"<<mI->m_peer_number << " to " << remote_addr_str);
 }
 
+void connection_basic::get_send_que_totals(uint64_t &count, uint64_t &bytes) {
+	count = s_send_que_count.load(std::memory_order_relaxed);
+	bytes = s_send_que_bytes.load(std::memory_order_relaxed);
+}
+
+void connection_basic::on_send_que_push(const send_que_entry &entry) {
+	s_send_que_count.fetch_add(1, std::memory_order_relaxed);
+	s_send_que_bytes.fetch_add(entry.size(), std::memory_order_relaxed);
+}
+
+void connection_basic::on_send_que_pop(const send_que_entry &entry) {
+	s_send_que_count.fetch_sub(1, std::memory_order_relaxed);
+	s_send_que_bytes.fetch_sub(entry.size(), std::memory_order_relaxed);
+}
+
 void connection_basic::set_rate_up_limit(uint64_t limit) {
-	{
-		CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
-		network_throttle_manager::get_global_throttle_out().set_target_speed(limit);
-	}
+	network_throttle_manager::get_global_throttle_out().set_target_speed(limit);
 	save_limit_to_file(limit);
 }
 
 void connection_basic::set_rate_down_limit(uint64_t limit) {
-	{
-	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_in );
-		network_throttle_manager::get_global_throttle_in().set_target_speed(limit);
-	}
-
-	{
-	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_inreq );
-		network_throttle_manager::get_global_throttle_inreq().set_target_speed(limit);
-	}
+	network_throttle_manager::get_global_throttle_in().set_target_speed(limit);
+	network_throttle_manager::get_global_throttle_inreq().set_target_speed(limit);
     save_limit_to_file(limit);
 }
 
 uint64_t connection_basic::get_rate_up_limit() {
-    uint64_t limit;
-    {
-         CRITICAL_REGION_LOCAL( network_throttle_manager::m_lock_get_global_throttle_out );
-         limit = network_throttle_manager::get_global_throttle_out().get_target_speed();
-	}
-    return limit;
+    return network_throttle_manager::get_global_throttle_out().get_target_speed();
 }
 
 uint64_t connection_basic::get_rate_down_limit() {
-    uint64_t limit;
-    {
-         CRITICAL_REGION_LOCAL( network_throttle_manager::m_lock_get_global_throttle_in );
-         limit = network_throttle_manager::get_global_throttle_in().get_target_speed();
-	}
-    return limit;
+    return network_throttle_manager::get_global_throttle_in().get_target_speed();
 }
 
 void connection_basic::save_limit_to_file(int limit) {
@@ -222,33 +221,18 @@ int connection_basic::get_tos_flag() {
 }
 
 void connection_basic::sleep_before_packet(size_t packet_size, int phase,  int q_len) {
-	double delay=0; // will be calculated
-	do
-	{ // rate limiting
-		if (m_was_shutdown) { 
-			_dbg2("m_was_shutdown - so abort sleep");
-			return;
-		}
-
-		{ 
-			CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
-			delay = network_throttle_manager::get_global_throttle_out().get_sleep_time_after_tick( packet_size );
-		}
-
-		delay *= 0.50;
-		if (delay > 0) {
-            long int ms = (long int)(delay * 1000);
-			MTRACE("Sleeping in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<packet_size); // debug sleep
-			boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
-		}
-	} while(delay > 0);
-
-// XXX LATER XXX
-	{
-	  CRITICAL_REGION_LOCAL(	network_throttle_manager::m_lock_get_global_throttle_out );
-		network_throttle_manager::get_global_throttle_out().handle_trafic_exact( packet_size ); // increase counter - global
+	if (m_was_shutdown) { 
+		_dbg2("m_was_shutdown - so abort sleep");
+		return;
 	}
 
+	// rate limiting
+	const double delay = network_throttle_manager::get_global_throttle_out().reserve( packet_size );
+	if (delay > 0) {
+		long int ms = (long int)(delay * 1000);
+		MTRACE("Sleeping in " << __FUNCTION__ << " for " << ms << " ms before packet_size="<<packet_size); // debug sleep
+		boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
+	}
 }
 
 void connection_basic::do_send_handler_write(const void* ptr , size_t cb ) {
@@ -268,9 +252,7 @@ void connection_basic::logger_handle_net_write(size_t size) {
 }
 
 double connection_basic::get_sleep_time(size_t cb) {
-	CRITICAL_REGION_LOCAL(epee::net_utils::network_throttle_manager::network_throttle_manager::m_lock_get_global_throttle_out);
-    auto t = network_throttle_manager::get_global_throttle_out().get_sleep_time(cb);
-    return t;
+    return network_throttle_manager::get_global_throttle_out().get_sleep_time(cb);
 }
 
 void connection_basic::set_save_graph(bool save_graph) {
@@ -28,11 +28,15 @@
 
 #include "hex.h"
 
-#include <iterator>
+#include <algorithm>
 #include <limits>
 #include <ostream>
 #include <stdexcept>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace epee
 {
   namespace
@@ -50,6 +54,55 @@ namespace epee
         ++out;
       }
     }
+
+#if defined(__SSE2__)
+    // nibbles to '0'-'9' and 'a'-'f', 16 at a time
+    inline __m128i nibbles_to_hex(const __m128i n)
+    {
+      const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(n, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+      return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), letters);
+    }
+
+    // 16 source bytes to 32 hex chars
+    inline void write_hex_16(char* out, const std::uint8_t* src)
+    {
+      const __m128i mask = _mm_set1_epi8(0x0F);
+      const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      const __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), mask);
+      const __m128i lo = _mm_and_si128(in, mask);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), nibbles_to_hex(_mm_unpacklo_epi8(hi, lo)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), nibbles_to_hex(_mm_unpackhi_epi8(hi, lo)));
+    }
+
+    /* 16 hex chars to their nibble values, as 8 little endian 16 bit lanes
+       of high nibble then low nibble. Signed compares are fine here: bytes
+       with the top bit set wrap well outside both accepted ranges. */
+    inline bool hex_to_nibbles(const char* src, __m128i& out)
+    {
+      const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      const __m128i digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+      const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digit, _mm_set1_epi8(-1)), _mm_cmplt_epi8(digit, _mm_set1_epi8(10)));
+      const __m128i letter = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+      const __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(letter, _mm_set1_epi8(-1)), _mm_cmplt_epi8(letter, _mm_set1_epi8(6)));
+      if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF)
+        return false;
+      out = _mm_or_si128(_mm_and_si128(digit, is_digit), _mm_and_si128(_mm_add_epi8(letter, _mm_set1_epi8(10)), is_letter));
+      return true;
+    }
+
+    // 32 hex chars to 16 bytes
+    inline bool read_hex_32(std::uint8_t* out, const char* src)
+    {
+      __m128i a, b;
+      if (!hex_to_nibbles(src, a) || !hex_to_nibbles(src + 16, b))
+        return false;
+      const __m128i mask = _mm_set1_epi16(0x00F0);
+      a = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(a, 4), mask), _mm_srli_epi16(a, 8));
+      b = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(b, 4), mask), _mm_srli_epi16(b, 8));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(a, b));
+      return true;
+    }
+#endif
   }
 
   template<typename T>
@@ -69,7 +122,16 @@ namespace epee
 
   void to_hex::buffer(std::ostream& out, const span<const std::uint8_t> src)
   {
-    write_hex(std::ostreambuf_iterator<char>{out}, src);
+    char chunk[512];
+    const std::uint8_t* p = src.data();
+    for (std::size_t left = src.size(); left > 0; )
+    {
+      const std::size_t n = std::min(left, sizeof(chunk) / 2);
+      buffer_unchecked(chunk, {p, n});
+      out.write(chunk, n * 2);
+      p += n;
+      left -= n;
+    }
   }
 
   void to_hex::formatted(std::ostream& out, const span<const std::uint8_t> src)
@@ -81,6 +143,49 @@ namespace epee
 
   void to_hex::buffer_unchecked(char* out, const span<const std::uint8_t> src) noexcept
   {
-    return write_hex(out, src);
+    const std::uint8_t* p = src.data();
+    std::size_t left = src.size();
+#if defined(__SSE2__)
+    for (; left >= 16; left -= 16, p += 16, out += 32)
+      write_hex_16(out, p);
+#endif
+    return write_hex(out, {p, left});
+  }
+
+  bool from_hex::buffer(span<std::uint8_t> out, const span<const char> src) noexcept
+  {
+    if (src.size() / 2 != out.size() || src.size() % 2)
+      return false;
+
+    std::uint8_t* dst = out.data();
+    const char* p = src.data();
+    std::size_t left = out.size();
+#if defined(__SSE2__)
+    for (; left >= 16; left -= 16, p += 32, dst += 16)
+    {
+      if (!read_hex_32(dst, p))
+        return false;
+    }
+#endif
+    for (; left > 0; --left, p += 2, ++dst)
+    {
+      const int hi = nibble(p[0]);
+      const int lo = nibble(p[1]);
+      if (hi < 0 || lo < 0)
+        return false;
+      *dst = (hi << 4) | lo;
+    }
+    return true;
+  }
+
+  int from_hex::nibble(const char c) noexcept
+  {
+    if (c >= '0' && c <= '9')
+      return c - '0';
+    if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+    return -1;
   }
 }
@@ -34,8 +34,13 @@
 #if defined HAVE_MLOCK
 #include <sys/mman.h>
 #endif
+#include <string.h>
+#include <unordered_map>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
 #include "misc_log_ex.h"
 #include "syncobj.h"
+#include "memwipe.h"
 #include "mlocker.h"
 
 static size_t query_page_size()
@@ -77,28 +82,97 @@ static void do_unlock(void *ptr, size_t len)
 #endif
 }
 
-namespace epee
+namespace
 {
-  size_t mlocker::page_size = 0;
-  size_t mlocker::num_locked_objects = 0;
+  // page refcounts are spread over shards so unrelated objects rarely share a lock
+  static const size_t NUM_SHARDS = 64;
+  // number of pages locked for the arena
+  static const size_t ARENA_PAGES = 16;
+  static const size_t MIN_BLOCK_SHIFT = 4;
+  static const size_t NUM_BLOCK_CLASSES = 9; // 16 to 4096 bytes
+
+  size_t page_size()
+  {
+    static const size_t size = query_page_size();
+    return size;
+  }
+
+  struct arena_state
+  {
+    struct free_block { free_block *next; };
+    struct block_class
+    {
+      boost::mutex mutex;
+      free_block *free_list = NULL;
+    };
+
+    char *base = NULL;
+    size_t size = 0;
+    std::atomic<size_t> next_page{0};
+    std::atomic<size_t> num_allocated{0};
+    block_class classes[NUM_BLOCK_CLASSES];
+  };
+
+  // published once the arena memory is locked, and never freed
+  std::atomic<arena_state*> arena{NULL};
+
+  arena_state *get_arena()
+  {
+    arena_state *state = arena.load(std::memory_order_acquire);
+    if (state)
+      return state;
+    static boost::mutex init_mutex;
+    boost::lock_guard<boost::mutex> lock(init_mutex);
+    state = arena.load(std::memory_order_relaxed);
+    if (state)
+      return state;
+    const size_t ps = page_size();
+    if (ps < epee::mlocked_arena::max_block_size)
+      return NULL;
+    state = new arena_state();
+    char *raw = new (std::nothrow) char[(ARENA_PAGES + 1) * ps];
+    if (!raw)
+    {
+      delete state;
+      return NULL;
+    }
+    state->base = (char*)((((uintptr_t)raw) + ps - 1) / ps * ps);
+    state->size = ARENA_PAGES * ps;
+    memset(state->base, 0, state->size);
+    do_lock(state->base, state->size);
+    arena.store(state, std::memory_order_release);
+    return state;
+  }
 
-  boost::mutex &mlocker::mutex()
+  size_t block_class_index(size_t size)
   {
-    static boost::mutex vmutex;
-    return vmutex;
+    size_t idx = 0;
+    while (((size_t)1 << (idx + MIN_BLOCK_SHIFT)) < size)
+      ++idx;
+    return idx;
   }
-  std::map<size_t, unsigned int> &mlocker::map()
+}
+
+namespace epee
+{
+  struct mlocker::shard
   {
-    static std::map<size_t, unsigned int> vmap;
-    return vmap;
+    boost::mutex mutex;
+    std::unordered_map<size_t, unsigned int> pages;
+  };
+
+  std::atomic<size_t> mlocker::num_locked_objects{0};
+
+  mlocker::shard &mlocker::get_shard(size_t page)
+  {
+    // leaked so mlocked objects with static storage can still unlock on exit
+    static shard *shards = new shard[NUM_SHARDS];
+    return shards[page % NUM_SHARDS];
   }
 
   size_t mlocker::get_page_size()
   {
-    CRITICAL_REGION_LOCAL(mutex());
-    if (page_size == 0)
-      page_size = query_page_size();
-    return page_size;
+    return page_size();
   }
 
   mlocker::mlocker(void *ptr, size_t len): ptr(ptr), len(len)
@@ -117,12 +191,13 @@ namespace epee
     if (page_size == 0)
       return;
 
-    CRITICAL_REGION_LOCAL(mutex());
+    ++num_locked_objects;
+    if (mlocked_arena::contains(ptr, len))
+      return;
     const size_t first = ((uintptr_t)ptr) / page_size;
     const size_t last = (((uintptr_t)ptr) + len - 1) / page_size;
     for (size_t page = first; page <= last; ++page)
       lock_page(page);
-    ++num_locked_objects;
   }
 
   void mlocker::unlock(void *ptr, size_t len)
@@ -130,32 +205,41 @@ namespace epee
     size_t page_size = get_page_size();
     if (page_size == 0)
       return;
-    CRITICAL_REGION_LOCAL(mutex());
+
+    --num_locked_objects;
+    if (mlocked_arena::contains(ptr, len))
+      return;
     const size_t first = ((uintptr_t)ptr) / page_size;
     const size_t last = (((uintptr_t)ptr) + len - 1) / page_size;
     for (size_t page = first; page <= last; ++page)
       unlock_page(page);
-    --num_locked_objects;
   }
 
   size_t mlocker::get_num_locked_pages()
   {
-    CRITICAL_REGION_LOCAL(mutex());
-    return map().size();
+    size_t pages = 0;
+    for (size_t i = 0; i < NUM_SHARDS; ++i)
+    {
+      shard &s = get_shard(i);
+      CRITICAL_REGION_LOCAL(s.mutex);
+      pages += s.pages.size();
+    }
+    return pages;
   }
 
   size_t mlocker::get_num_locked_objects()
   {
-    CRITICAL_REGION_LOCAL(mutex());
     return num_locked_objects;
   }
 
   void mlocker::lock_page(size_t page)
   {
-    std::pair<std::map<size_t, unsigned int>::iterator, bool> p = map().insert(std::make_pair(page, 1));
+    shard &s = get_shard(page);
+    CRITICAL_REGION_LOCAL(s.mutex);
+    std::pair<std::unordered_map<size_t, unsigned int>::iterator, bool> p = s.pages.insert(std::make_pair(page, 1));
     if (p.second)
     {
-      do_lock((void*)(page * page_size), page_size);
+      do_lock((void*)(page * page_size()), page_size());
     }
     else
     {
@@ -165,18 +249,91 @@ namespace epee
 
   void mlocker::unlock_page(size_t page)
   {
-    std::map<size_t, unsigned int>::iterator i = map().find(page);
-    if (i == map().end())
+    shard &s = get_shard(page);
+    CRITICAL_REGION_LOCAL(s.mutex);
+    std::unordered_map<size_t, unsigned int>::iterator i = s.pages.find(page);
+    if (i == s.pages.end())
     {
-      MERROR("Attempt to unlock unlocked page at " << (void*)(page * page_size));
+      MERROR("Attempt to unlock unlocked page at " << (void*)(page * page_size()));
     }
     else
     {
       if (!--i->second)
       {
-        map().erase(i);
-        do_unlock((void*)(page * page_size), page_size);
+        s.pages.erase(i);
+        do_unlock((void*)(page * page_size()), page_size());
+      }
+    }
+  }
+
+  void *mlocked_arena::allocate(size_t size)
+  {
+    if (size == 0 || size > max_block_size)
+      return NULL;
+    arena_state *state = get_arena();
+    if (!state)
+      return NULL;
+
+    const size_t idx = block_class_index(size);
+    const size_t block_size = (size_t)1 << (idx + MIN_BLOCK_SHIFT);
+    arena_state::block_class &bc = state->classes[idx];
+    CRITICAL_REGION_LOCAL(bc.mutex);
+    if (!bc.free_list)
+    {
+      // carve a fresh page into blocks of this size
+      const size_t ps = page_size();
+      const size_t page = state->next_page++;
+      if (page >= state->size / ps)
+        return NULL;
+      char *p = state->base + page * ps;
+      for (size_t offset = ps; offset >= block_size; offset -= block_size)
+      {
+        arena_state::free_block *b = (arena_state::free_block*)(p + offset - block_size);
+        b->next = bc.free_list;
+        bc.free_list = b;
       }
     }
+    arena_state::free_block *b = bc.free_list;
+    bc.free_list = b->next;
+    memwipe(b, sizeof(*b));
+    ++state->num_allocated;
+    return b;
+  }
+
+  bool mlocked_arena::deallocate(void *ptr, size_t size)
+  {
+    if (!contains(ptr, size))
+      return false;
+    arena_state *state = arena.load(std::memory_order_acquire);
+    const size_t idx = block_class_index(size);
+    memwipe(ptr, (size_t)1 << (idx + MIN_BLOCK_SHIFT));
+    arena_state::block_class &bc = state->classes[idx];
+    CRITICAL_REGION_LOCAL(bc.mutex);
+    arena_state::free_block *b = (arena_state::free_block*)ptr;
+    b->next = bc.free_list;
+    bc.free_list = b;
+    --state->num_allocated;
+    return true;
+  }
+
+  bool mlocked_arena::contains(const void *ptr, size_t len)
+  {
+    const arena_state *state = arena.load(std::memory_order_acquire);
+    if (!state)
+      return false;
+    const uintptr_t p = (uintptr_t)ptr, base = (uintptr_t)state->base;
+    return p >= base && p - base < state->size && len <= state->size - (p - base);
+  }
+
+  size_t mlocked_arena::get_size()
+  {
+    const arena_state *state = arena.load(std::memory_order_acquire);
+    return state ? state->size : 0;
+  }
+
+  size_t mlocked_arena::get_num_allocated_blocks()
+  {
+    const arena_state *state = arena.load(std::memory_order_acquire);
+    return state ? state->num_allocated.load() : 0;
   }
 }
@@ -37,8 +37,15 @@
 
 #include <time.h>
 #include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include "string_tools.h"
 #include "misc_log_ex.h"
 
@@ -51,6 +58,13 @@
 
 using namespace epee;
 
+// bumped when the categories change, to invalidate the mlog_allowed caches
+static std::atomic<unsigned int> categories_generation(1);
+
+static std::string log_filename_base;
+static std::size_t log_max_file_size = MAX_LOG_FILE_SIZE;
+static std::size_t log_max_files = MAX_LOG_FILES;
+
 static std::string generate_log_filename(const char *base)
 {
   std::string filename(base);
@@ -124,6 +138,69 @@ static const char *get_default_categories(int level)
   return categories;
 }
 
+// moves the full log file aside, and removes the oldest ones beyond max_log_files
+static void rotate_log_files(const std::string &filename_base, std::size_t max_log_files, const char *name, const std::function<void(const std::string&)> &error)
+{
+  std::string rname = generate_log_filename(filename_base.c_str());
+  int ret = rename(name, rname.c_str());
+  if (ret < 0)
+  {
+    // can't log a failure, but don't do the file removal below
+    return;
+  }
+  if (max_log_files != 0)
+  {
+    std::vector<boost::filesystem::path> found_files;
+    const boost::filesystem::directory_iterator end_itr;
+    const boost::filesystem::path filename_base_path(filename_base);
+    const boost::filesystem::path parent_path = filename_base_path.has_parent_path() ? filename_base_path.parent_path() : ".";
+    for (boost::filesystem::directory_iterator iter(parent_path); iter != end_itr; ++iter)
+    {
+      const std::string filename = iter->path().string();
+      if (filename.size() >= filename_base.size() && std::memcmp(filename.data(), filename_base.data(), filename_base.size()) == 0)
+      {
+        found_files.push_back(iter->path());
+      }
+    }
+    if (found_files.size() >= max_log_files)
+    {
+      std::sort(found_files.begin(), found_files.end(), [&error](const boost::filesystem::path &a, const boost::filesystem::path &b) {
+        boost::system::error_code ec;
+        std::time_t ta = boost::filesystem::last_write_time(boost::filesystem::path(a), ec);
+        if (ec)
+        {
+          error("Failed to get timestamp from " + a.string() + ": " + ec.message());
+          ta = std::time(nullptr);
+        }
+        std::time_t tb = boost::filesystem::last_write_time(boost::filesystem::path(b), ec);
+        if (ec)
+        {
+          error("Failed to get timestamp from " + b.string() + ": " + ec.message());
+          tb = std::time(nullptr);
+        }
+        static_assert(std::is_integral<time_t>(), "bad time_t");
+        return ta < tb;
+      });
+      for (size_t i = 0; i <= found_files.size() - max_log_files; ++i)
+      {
+        try
+        {
+          boost::system::error_code ec;
+          boost::filesystem::remove(found_files[i], ec);
+          if (ec)
+          {
+            error("Failed to remove " + found_files[i].string() + ": " + ec.message());
+          }
+        }
+        catch (const std::exception &e)
+        {
+          error("Failed to remove " + found_files[i].string() + ": " + e.what());
+        }
+      }
+    }
+  }
+}
+
 #ifdef WIN32
 bool EnableVTMode()
 {
@@ -151,6 +228,12 @@ bool EnableVTMode()
 
 void mlog_configure(const std::string &filename_base, bool console, const std::size_t max_log_file_size, const std::size_t max_log_files)
 {
+  const bool async = mlog_is_async() || getenv("MONERO_LOG_ASYNC");
+  mlog_set_async(false);
+  log_filename_base = filename_base;
+  log_max_file_size = max_log_file_size;
+  log_max_files = max_log_files;
+
   el::Configurations c;
   c.setGlobally(el::ConfigurationType::Filename, filename_base);
   c.setGlobally(el::ConfigurationType::ToFile, "true");
@@ -168,64 +251,7 @@ void mlog_configure(const std::string &filename_base, bool console, const std::s
   el::Loggers::addFlag(el::LoggingFlag::ColoredTerminalOutput);
   el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
   el::Helpers::installPreRollOutCallback([filename_base, max_log_files](const char *name, size_t){
-    std::string rname = generate_log_filename(filename_base.c_str());
-    int ret = rename(name, rname.c_str());
-    if (ret < 0)
-    {
-      // can't log a failure, but don't do the file removal below
-      return;
-    }
-    if (max_log_files != 0)
-    {
-      std::vector<boost::filesystem::path> found_files;
-      const boost::filesystem::directory_iterator end_itr;
-      const boost::filesystem::path filename_base_path(filename_base);
-      const boost::filesystem::path parent_path = filename_base_path.has_parent_path() ? filename_base_path.parent_path() : ".";
-      for (boost::filesystem::directory_iterator iter(parent_path); iter != end_itr; ++iter)
-      {
-        const std::string filename = iter->path().string();
-        if (filename.size() >= filename_base.size() && std::memcmp(filename.data(), filename_base.data(), filename_base.size()) == 0)
-        {
-          found_files.push_back(iter->path());
-        }
-      }
-      if (found_files.size() >= max_log_files)
-      {
-        std::sort(found_files.begin(), found_files.end(), [](const boost::filesystem::path &a, const boost::filesystem::path &b) {
-          boost::system::error_code ec;
-          std::time_t ta = boost::filesystem::last_write_time(boost::filesystem::path(a), ec);
-          if (ec)
-          {
-            MERROR("Failed to get timestamp from " << a << ": " << ec);
-            ta = std::time(nullptr);
-          }
-          std::time_t tb = boost::filesystem::last_write_time(boost::filesystem::path(b), ec);
-          if (ec)
-          {
-            MERROR("Failed to get timestamp from " << b << ": " << ec);
-            tb = std::time(nullptr);
-          }
-          static_assert(std::is_integral<time_t>(), "bad time_t");
-          return ta < tb;
-        });
-        for (size_t i = 0; i <= found_files.size() - max_log_files; ++i)
-        {
-          try
-          {
-            boost::system::error_code ec;
-            boost::filesystem::remove(found_files[i], ec);
-            if (ec)
-            {
-              MERROR("Failed to remove " << found_files[i] << ": " << ec);
-            }
-          }
-          catch (const std::exception &e)
-          {
-            MERROR("Failed to remove " << found_files[i] << ": " << e.what());
-          }
-        }
-      }
-    }
+    rotate_log_files(filename_base, max_log_files, name, [](const std::string &e) { MERROR(e); });
   });
   mlog_set_common_prefix();
   const char *monero_log = getenv("MONERO_LOGS");
@@ -237,6 +263,8 @@ void mlog_configure(const std::string &filename_base, bool console, const std::s
 #ifdef WIN32
   EnableVTMode();
 #endif
+  if (async && !mlog_set_async(true))
+    MERROR("Failed to start asynchronous logging");
 }
 
 void mlog_set_categories(const char *categories)
@@ -274,6 +302,7 @@ void mlog_set_categories(const char *categories)
     }
   }
   el::Loggers::setCategories(new_categories.c_str(), true);
+  categories_generation.fetch_add(1, std::memory_order_release);
   MLOG_LOG("New log categories: " << el::Loggers::getCategories());
 }
 
@@ -321,6 +350,325 @@ void mlog_set_log(const char *log)
   }
 }
 
+bool mlog_allowed(el::Level level, const char *category)
+{
+  // until mlog_configure, loggers are enabled by their own configuration,
+  // and verbose levels are left to the logger
+  if (!el::Loggers::hasFlag(el::LoggingFlag::HierarchicalLogging) || level == el::Level::Verbose || !category)
+    return true;
+
+  // categories are mostly literals, so the pointer finds the entry, and
+  // the name confirms it
+  struct entry
+  {
+    std::string category;
+    unsigned int generation;
+    unsigned int levels;
+  };
+  static thread_local std::unordered_map<const char*, entry> cache;
+  const unsigned int generation = categories_generation.load(std::memory_order_acquire);
+  entry &e = cache[category];
+  if (e.generation != generation || e.category != category)
+  {
+    e.category = category;
+    e.generation = generation;
+    e.levels = 0;
+    for (el::Level l: {el::Level::Fatal, el::Level::Error, el::Level::Warning, el::Level::Info, el::Level::Debug, el::Level::Trace})
+      if (ELPP->vRegistry()->allowed(l, category))
+        e.levels |= static_cast<unsigned int>(l);
+  }
+  return e.levels & static_cast<unsigned int>(level);
+}
+
+namespace
+{
+  /**
+   * Writes log lines from a background thread, so the threads logging only
+   * format their line and queue it.
+   *
+   * Log lines are dispatched under the easylogging lock, so the queue is a
+   * ring with a single producer at a time and the writer thread as its only
+   * consumer, and needs no lock of its own. The writer does the file writes,
+   * size based rolling and console output the easylogging default dispatch
+   * callback would do. When the ring is full, debug, trace and info lines
+   * are dropped and counted, while warnings and errors wait for room.
+   *
+   * The writer never logs through easylogging, as a producer may be waiting
+   * on it with the easylogging lock held. Lines still queued are lost if the
+   * process crashes.
+   */
+  class async_log_writer
+  {
+  public:
+    async_log_writer(size_t queue_size, const std::string &filename, size_t max_log_file_size, size_t max_log_files):
+      m_filename(filename), m_max_log_file_size(max_log_file_size), m_max_log_files(max_log_files),
+      m_head(0), m_tail(0), m_dropped(0), m_waiting(false), m_stop(false), m_stopped(false), m_file_size(0)
+    {
+      size_t size = 1;
+      while (size < queue_size)
+        size <<= 1;
+      m_lines.resize(size);
+    }
+
+    bool start()
+    {
+      if (!m_filename.empty() && !open_file(false))
+        return false;
+      m_thread = boost::thread([this]() { run(); });
+      return true;
+    }
+
+    // drains the queue, after which lines are written as they come
+    void stop()
+    {
+      if (m_stopped)
+        return;
+      {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_stop = true;
+      }
+      m_cond.notify_one();
+      m_thread.join();
+      m_stopped = true;
+    }
+
+    void close()
+    {
+      stop();
+      m_file.close();
+    }
+
+    // called with the easylogging lock held
+    void push(std::string &&line, el::Level level, bool to_file, el::LogBuilder *console)
+    {
+      if (m_stopped)
+      {
+        write(line, level, to_file, console);
+        flush();
+        return;
+      }
+      const bool important = level == el::Level::Fatal || level == el::Level::Error || level == el::Level::Warning;
+      while (m_tail.load(std::memory_order_relaxed) - m_head.load(std::memory_order_acquire) == m_lines.size())
+      {
+        if (!important || boost::this_thread::get_id() == m_thread.get_id())
+        {
+          m_dropped.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        wake();
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+      }
+      const uint64_t tail = m_tail.load(std::memory_order_relaxed);
+      line_t &l = m_lines[tail & (m_lines.size() - 1)];
+      l.line = std::move(line);
+      l.level = level;
+      l.to_file = to_file;
+      l.console = console;
+      m_tail.store(tail + 1, std::memory_order_seq_cst);
+      if (important || m_waiting.load(std::memory_order_seq_cst))
+        wake();
+    }
+
+  private:
+    struct line_t
+    {
+      std::string line;
+      el::Level level;
+      bool to_file;
+      el::LogBuilder *console;
+    };
+
+    void wake()
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      m_cond.notify_one();
+    }
+
+    bool open_file(bool truncate)
+    {
+      m_file.open(m_filename, std::ios::out | std::ios::binary | (truncate ? std::ios::trunc : std::ios::app));
+      if (!m_file.is_open())
+        return false;
+      boost::system::error_code ec;
+      m_file_size = truncate ? 0 : boost::filesystem::file_size(m_filename, ec);
+      if (ec)
+        m_file_size = 0;
+      return true;
+    }
+
+    void write(std::string &line, el::Level level, bool to_file, el::LogBuilder *console)
+    {
+      if (to_file && m_file.is_open())
+      {
+        if (m_max_log_file_size != 0 && m_file_size >= m_max_log_file_size)
+        {
+          m_file.close();
+          std::vector<std::string> errors;
+          rotate_log_files(m_filename, m_max_log_files, m_filename.c_str(), [&errors](const std::string &e) { errors.push_back(e); });
+          open_file(true);
+          for (const std::string &e: errors)
+            m_file << e << std::endl;
+        }
+        m_file.write(line.data(), line.size());
+        m_file_size += line.size();
+      }
+      if (console)
+      {
+        console->convertToColoredOutput(&line, level);
+        std::cout << line;
+      }
+    }
+
+    void flush()
+    {
+      if (m_file.is_open())
+        m_file.flush();
+      std::cout.flush();
+    }
+
+    void run()
+    {
+      while (true)
+      {
+        const uint64_t tail = m_tail.load(std::memory_order_acquire);
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        if (head != tail)
+        {
+          for (; head != tail; ++head)
+          {
+            line_t &l = m_lines[head & (m_lines.size() - 1)];
+            write(l.line, l.level, l.to_file, l.console);
+            std::string().swap(l.line);
+            m_head.store(head + 1, std::memory_order_release);
+          }
+          const uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+          if (dropped)
+          {
+            std::string line = "Log queue full, " + std::to_string(dropped) + " log lines were dropped\n";
+            write(line, el::Level::Warning, true, NULL);
+          }
+          flush();
+          continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        if (m_stop)
+          break;
+        m_waiting.store(true, std::memory_order_seq_cst);
+        if (m_tail.load(std::memory_order_seq_cst) == head)
+          m_cond.wait_for(lock, boost::chrono::milliseconds(100));
+        m_waiting.store(false, std::memory_order_relaxed);
+      }
+    }
+
+    const std::string m_filename;
+    const size_t m_max_log_file_size;
+    const size_t m_max_log_files;
+    std::vector<line_t> m_lines;
+    std::atomic<uint64_t> m_head;
+    std::atomic<uint64_t> m_tail;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_waiting;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    bool m_stop;
+    bool m_stopped;
+    boost::thread m_thread;
+    std::ofstream m_file;
+    size_t m_file_size;
+  };
+
+  // the file stream easylogging shares between loggers, closed while async
+  // so the writer can move the file aside
+  el::base::type::fstream_t *default_log_file_stream()
+  {
+    if (log_filename_base.empty())
+      return NULL;
+    return el::Loggers::getLogger(el::base::consts::kDefaultLoggerId)->typedConfigurations()->fileStream(el::Level::Global);
+  }
+
+  // left alive at exit, so lines logged from static destructors still make it
+  async_log_writer *async_writer = NULL;
+
+  class async_log_dispatch_callback: public el::LogDispatchCallback
+  {
+  protected:
+    void handle(const el::LogDispatchData *data)
+    {
+      const el::base::DispatchAction action = data->dispatchAction();
+      if (action != el::base::DispatchAction::NormalLog && action != el::base::DispatchAction::FileOnlyLog)
+        return;
+      const el::LogMessage *msg = data->logMessage();
+      el::Logger *logger = msg->logger();
+      el::base::TypedConfigurations *tc = logger->typedConfigurations();
+      const bool to_file = tc->toFile(msg->level());
+      const bool to_console = action != el::base::DispatchAction::FileOnlyLog && tc->toStandardOutput(msg->level());
+      if (!to_file && !to_console)
+        return;
+      async_writer->push(logger->logBuilder()->build(msg, true), msg->level(), to_file,
+          to_console && el::Loggers::hasFlag(el::LoggingFlag::ColoredTerminalOutput) ? logger->logBuilder() : NULL);
+    }
+  };
+}
+
+bool mlog_set_async(bool async, std::size_t queue_size)
+{
+  static bool atexit_registered = false;
+  el::base::threading::ScopedLock lock(ELPP->lock());
+  if (async == (async_writer != NULL))
+    return true;
+
+  if (async)
+  {
+    if (queue_size == 0)
+      return false;
+    el::Loggers::flushAll();
+    el::base::type::fstream_t *fs = default_log_file_stream();
+    if (fs)
+      fs->close();
+    std::unique_ptr<async_log_writer> writer(new async_log_writer(queue_size, log_filename_base, log_max_file_size, log_max_files));
+    if (!writer->start())
+    {
+      if (fs)
+        fs->open(log_filename_base, std::fstream::out | std::fstream::app);
+      return false;
+    }
+    async_writer = writer.release();
+    el::Helpers::installLogDispatchCallback<async_log_dispatch_callback>("AsyncLogDispatchCallback");
+    el::Helpers::uninstallLogDispatchCallback<el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback");
+    // the writer rolls the file itself
+    el::Loggers::removeFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+    if (!atexit_registered)
+    {
+      atexit_registered = true;
+      std::atexit([]() {
+        el::base::threading::ScopedLock lock(ELPP->lock());
+        if (async_writer)
+          async_writer->stop();
+      });
+    }
+  }
+  else
+  {
+    el::Helpers::installLogDispatchCallback<el::base::DefaultLogDispatchCallback>("DefaultLogDispatchCallback");
+    el::Helpers::uninstallLogDispatchCallback<async_log_dispatch_callback>("AsyncLogDispatchCallback");
+    el::Loggers::addFlag(el::LoggingFlag::StrictLogFileSizeCheck);
+    async_writer->close();
+    delete async_writer;
+    async_writer = NULL;
+    el::base::type::fstream_t *fs = default_log_file_stream();
+    if (fs)
+      fs->open(log_filename_base, std::fstream::out | std::fstream::app);
+  }
+  return true;
+}
+
+bool mlog_is_async()
+{
+  el::base::threading::ScopedLock lock(ELPP->lock());
+  return async_writer != NULL;
+}
+
 namespace epee
 {
 
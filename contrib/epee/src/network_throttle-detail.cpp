@@ -66,6 +66,7 @@
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <chrono>
 
 
 
@@ -367,6 +368,63 @@ double network_throttle::get_current_speed() const {
 	return bytes_transferred / ((m_history.size() - 1) * m_slot_size);
 }
 
+// ================================================================================================
+// network_token_bucket
+// ================================================================================================
+
+network_token_bucket::network_token_bucket(const std::string &name, network_time_seconds burst)
+	: m_name(name), m_burst_ns((int64_t)(burst * 1e9)), m_target_speed(16 * 1024), m_full_time_ns(0)
+{
+}
+
+void network_token_bucket::set_target_speed( network_speed_kbps target )
+{
+	m_target_speed = target > 0 ? (uint64_t)(target * 1024) : 0;
+	MINFO("Setting LIMIT: " << target << " kbps for " << m_name);
+}
+
+network_speed_kbps network_token_bucket::get_target_speed() const
+{
+	return m_target_speed / 1024.0;
+}
+
+int64_t network_token_bucket::get_time_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t network_token_bucket::get_cost_ns(size_t packet_size, uint64_t speed) const
+{
+	return (int64_t)(packet_size * 1e9 / speed);
+}
+
+network_time_seconds network_token_bucket::reserve(size_t packet_size)
+{
+	const uint64_t speed = m_target_speed.load(std::memory_order_relaxed);
+	if (speed == 0)
+		return 0;
+	const int64_t now = get_time_ns();
+	const int64_t cost = get_cost_ns(packet_size, speed);
+	int64_t full_time = m_full_time_ns.load(std::memory_order_relaxed);
+	int64_t new_full_time;
+	do
+	{
+		// a bucket that filled up in the past only holds m_burst_ns worth
+		new_full_time = std::max(full_time, now) + cost;
+	} while (!m_full_time_ns.compare_exchange_weak(full_time, new_full_time, std::memory_order_relaxed));
+	return std::max<int64_t>(0, new_full_time - now - m_burst_ns) / 1e9;
+}
+
+network_time_seconds network_token_bucket::get_sleep_time(size_t packet_size) const
+{
+	const uint64_t speed = m_target_speed.load(std::memory_order_relaxed);
+	if (speed == 0)
+		return 0;
+	const int64_t now = get_time_ns();
+	const int64_t full_time = std::max(m_full_time_ns.load(std::memory_order_relaxed), now) + get_cost_ns(packet_size, speed);
+	return std::max<int64_t>(0, full_time - now - m_burst_ns) / 1e9;
+}
+
 } // namespace
 } // namespace
 
@@ -727,9 +727,7 @@ blobdata BlockchainBDB::output_to_blob(const tx_out& output) const
 tx_out BlockchainBDB::output_from_blob(const blobdata& blob) const
 {
     LOG_PRINT_L3("BlockchainBDB::" << __func__);
-    std::stringstream ss;
-    ss << blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(blob)};
     tx_out o;
 
     if (!(::serialization::serialize(ba, o)))
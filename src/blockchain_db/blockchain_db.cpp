@@ -36,12 +36,14 @@
 #include "ringct/rctOps.h"
 
 #include "lmdb/db_lmdb.h"
+#include "memory/db_memory.h"
 #ifdef BERKELEY_DB
 #include "berkeleydb/db_bdb.h"
 #endif
 
 static const char *db_types[] = {
   "lmdb",
+  "memory",
 #ifdef BERKELEY_DB
   "berkeley",
 #endif
@@ -101,6 +103,8 @@ BlockchainDB *new_db(const std::string& db_type)
 {
   if (db_type == "lmdb")
     return new BlockchainLMDB();
+  if (db_type == "memory")
+    return new BlockchainMemory();
 #if defined(BERKELEY_DB)
   if (db_type == "berkeley")
     return new BlockchainBDB();
@@ -122,7 +126,21 @@ void BlockchainDB::pop_block()
   pop_block(blk, txs);
 }
 
-void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash* tx_hash_ptr, const crypto::hash* tx_prunable_hash_ptr)
+void BlockchainDB::add_spent_keys(const std::vector<crypto::key_image>& k_images)
+{
+  for (const crypto::key_image &k_image: k_images)
+    add_spent_key(k_image);
+}
+
+void BlockchainDB::has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const
+{
+  spent.clear();
+  spent.reserve(imgs.size());
+  for (const crypto::key_image &img: imgs)
+    spent.push_back(has_key_image(img));
+}
+
+void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash* tx_hash_ptr, const crypto::hash* tx_prunable_hash_ptr, std::vector<crypto::key_image>* key_images)
 {
   bool miner_tx = false;
   crypto::hash tx_hash, tx_prunable_hash;
@@ -144,11 +162,15 @@ void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transacti
       tx_prunable_hash = *tx_prunable_hash_ptr;
   }
 
+  const size_t key_images_start = key_images ? key_images->size() : 0;
   for (const txin_v& tx_input : tx.vin)
   {
     if (tx_input.type() == typeid(txin_to_key))
     {
-      add_spent_key(boost::get<txin_to_key>(tx_input).k_image);
+      if (key_images)
+        key_images->push_back(boost::get<txin_to_key>(tx_input).k_image);
+      else
+        add_spent_key(boost::get<txin_to_key>(tx_input).k_image);
     }
     else if (tx_input.type() == typeid(txin_gen))
     {
@@ -158,6 +180,11 @@ void BlockchainDB::add_transaction(const crypto::hash& blk_hash, const transacti
     else
     {
       LOG_PRINT_L1("Unsupported input type, removing key images and aborting transaction addition");
+      if (key_images)
+      {
+        key_images->resize(key_images_start);
+        return;
+      }
       for (const txin_v& tx_input : tx.vin)
       {
         if (tx_input.type() == typeid(txin_to_key))
@@ -220,8 +247,11 @@ uint64_t BlockchainDB::add_block( const block& blk
 
   time1 = epee::misc_utils::get_tick_count();
 
+  // the block's key images are stored together once all are known, so the
+  // subclass can order the writes
+  std::vector<crypto::key_image> key_images;
   uint64_t num_rct_outs = 0;
-  add_transaction(blk_hash, blk.miner_tx);
+  add_transaction(blk_hash, blk.miner_tx, NULL, NULL, &key_images);
   if (blk.miner_tx.version == 2)
     num_rct_outs += blk.miner_tx.vout.size();
   int tx_i = 0;
@@ -229,7 +259,7 @@ uint64_t BlockchainDB::add_block( const block& blk
   for (const transaction& tx : txs)
   {
     tx_hash = blk.tx_hashes[tx_i];
-    add_transaction(blk_hash, tx, &tx_hash);
+    add_transaction(blk_hash, tx, &tx_hash, NULL, &key_images);
     for (const auto &vout: tx.vout)
     {
       if (vout.amount == 0)
@@ -237,15 +267,22 @@ uint64_t BlockchainDB::add_block( const block& blk
     }
     ++tx_i;
   }
+  add_spent_keys(key_images);
   TIME_MEASURE_FINISH(time1);
   time_add_transaction += time1;
 
   // call out to subclass implementation to add the block & metadata
   time1 = epee::misc_utils::get_tick_count();
-  add_block(blk, block_weight, cumulative_difficulty, coins_generated, num_rct_outs, blk_hash);
+  uint64_t fees = 0;
+  for (const transaction& tx : txs)
+    fees += get_tx_fee(tx);
+  const uint64_t emission = get_outs_money_amount(blk.miner_tx) - fees;
+  add_block(blk, block_weight, cumulative_difficulty, coins_generated, num_rct_outs, emission, fees, blk_hash);
   TIME_MEASURE_FINISH(time1);
   time_add_block1 += time1;
 
+  add_block_filter(prev_height, make_block_filter_blob(blk, txs));
+
   m_hardfork->add(blk, prev_height);
 
   block_txn_stop();
@@ -268,7 +305,11 @@ void BlockchainDB::pop_block(block& blk, std::vector<transaction>& txs)
 
   for (const auto& h : boost::adaptors::reverse(blk.tx_hashes))
   {
-    txs.push_back(get_tx(h));
+    // a pruned db may only have the pruned tx left
+    transaction tx;
+    if (!get_tx(h, tx) && !get_pruned_tx(h, tx))
+      throw TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str());
+    txs.push_back(std::move(tx));
     remove_transaction(h);
   }
   remove_transaction(get_transaction_hash(blk.miner_tx));
@@ -281,7 +322,10 @@ bool BlockchainDB::is_open() const
 
 void BlockchainDB::remove_transaction(const crypto::hash& tx_hash)
 {
-  transaction tx = get_tx(tx_hash);
+  // the inputs and outputs are all we need, and they survive pruning
+  transaction tx;
+  if (!get_pruned_tx(tx_hash, tx))
+    throw TX_DNE(std::string("tx with hash ").append(epee::string_tools::pod_to_hex(tx_hash)).append(" not found in db").c_str());
 
   for (const txin_v& tx_input : tx.vin)
   {
@@ -297,8 +341,17 @@ void BlockchainDB::remove_transaction(const crypto::hash& tx_hash)
 
 block BlockchainDB::get_block_from_height(const uint64_t& height) const
 {
-  blobdata bd = get_block_blob_from_height(height);
   block b;
+  db_rtxn_guard rtxn_guard(this);
+  epee::span<const uint8_t> view;
+  if (get_block_blob_view(height, view))
+  {
+    if (!parse_and_validate_block_from_blob(view, b))
+      throw DB_ERROR("Failed to parse block from blob retrieved from the db");
+    return b;
+  }
+
+  blobdata bd = get_block_blob_from_height(height);
   if (!parse_and_validate_block_from_blob(bd, b))
     throw DB_ERROR("Failed to parse block from blob retrieved from the db");
 
@@ -326,6 +379,65 @@ bool BlockchainDB::get_tx(const crypto::hash& h, cryptonote::transaction &tx) co
   return true;
 }
 
+bool BlockchainDB::get_pruned_tx(const crypto::hash& h, cryptonote::transaction &tx) const
+{
+  blobdata bd;
+  if (!get_pruned_tx_blob(h, bd))
+    return false;
+  if (!parse_and_validate_tx_base_from_blob(bd, tx))
+    throw DB_ERROR("Failed to parse transaction base from blob retrieved from the db");
+
+  return true;
+}
+
+size_t BlockchainDB::get_tx_blobs(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &bds, std::vector<bool> &found, bool pruned) const
+{
+  bds.clear();
+  bds.resize(hashes.size());
+  found.assign(hashes.size(), false);
+  size_t n_found = 0;
+  for (size_t i = 0; i < hashes.size(); ++i)
+  {
+    found[i] = pruned ? get_pruned_tx_blob(hashes[i], bds[i]) : get_tx_blob(hashes[i], bds[i]);
+    if (found[i])
+      ++n_found;
+  }
+  return n_found;
+}
+
+bool BlockchainDB::get_block_tx_blobs(uint64_t height, std::vector<cryptonote::blobdata> &bds, bool pruned) const
+{
+  block b;
+  if (!parse_and_validate_block_from_blob(get_block_blob_from_height(height), b))
+    throw DB_ERROR("Failed to parse block from blob retrieved from the db");
+  std::vector<bool> found;
+  return get_tx_blobs(b.tx_hashes, bds, found, pruned) == b.tx_hashes.size();
+}
+
+void BlockchainDB::get_blocks_amount_output_indices(uint64_t start_height, size_t count, std::vector<std::vector<std::vector<uint64_t>>> &indices) const
+{
+  indices.clear();
+  indices.reserve(count);
+  for (uint64_t height = start_height; height < start_height + count; ++height)
+  {
+    block b;
+    if (!parse_and_validate_block_from_blob(get_block_blob_from_height(height), b))
+      throw DB_ERROR("Failed to parse block from blob retrieved from the db");
+    indices.push_back(std::vector<std::vector<uint64_t>>());
+    indices.back().reserve(1 + b.tx_hashes.size());
+    uint64_t tx_id;
+    if (!tx_exists(get_transaction_hash(b.miner_tx), tx_id))
+      throw TX_DNE("Miner tx of a block in the db not found");
+    indices.back().push_back(get_tx_amount_output_indices(tx_id));
+    for (const crypto::hash &h: b.tx_hashes)
+    {
+      if (!tx_exists(h, tx_id))
+        throw TX_DNE("Tx of a block in the db not found");
+      indices.back().push_back(get_tx_amount_output_indices(tx_id));
+    }
+  }
+}
+
 transaction BlockchainDB::get_tx(const crypto::hash& h) const
 {
   transaction tx;
@@ -334,6 +446,35 @@ transaction BlockchainDB::get_tx(const crypto::hash& h) const
   return tx;
 }
 
+std::vector<uint64_t> BlockchainDB::get_block_cumulative_rct_outputs_range(uint64_t from_height, uint64_t to_height) const
+{
+  std::vector<uint64_t> heights;
+  if (to_height < from_height)
+    return heights;
+  heights.reserve(to_height + 1 - from_height);
+  for (uint64_t h = from_height; h <= to_height; ++h)
+    heights.push_back(h);
+  return get_block_cumulative_rct_outputs(heights);
+}
+
+void BlockchainDB::get_block_header_entries(uint64_t h1, uint64_t h2, std::vector<block_header_entry_t> &entries) const
+{
+  entries.clear();
+  if (h2 < h1)
+    return;
+  entries.reserve(h2 + 1 - h1);
+  for (uint64_t h = h1; h <= h2; ++h)
+  {
+    entries.push_back(block_header_entry_t());
+    block_header_entry_t &e = entries.back();
+    e.blk = get_block_from_height(h);
+    e.hash = get_block_hash_from_height(h);
+    e.weight = get_block_weight(h);
+    e.cumulative_difficulty = get_block_cumulative_difficulty(h);
+    e.difficulty = get_block_difficulty(h);
+  }
+}
+
 void BlockchainDB::reset_stats()
 {
   num_calls = 0;
@@ -37,6 +37,7 @@
 #include <boost/program_options.hpp>
 #include "common/command_line.h"
 #include "crypto/hash.h"
+#include "span.h"
 #include "cryptonote_basic/blobdatatype.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/difficulty.h"
@@ -131,6 +132,17 @@ struct tx_data_t
 };
 #pragma pack(pop)
 
+#pragma pack(push, 1)
+/**
+ * @brief where an output is indexed, as found from its public key
+ */
+struct output_location_t
+{
+  uint64_t amount;        //!< the amount the output is indexed under, 0 for RCT outputs
+  uint64_t amount_index;  //!< the output's index among outputs of that amount
+};
+#pragma pack(pop)
+
 /**
  * @brief a struct containing txpool per transaction metadata
  */
@@ -149,9 +161,53 @@ struct txpool_tx_meta_t
   uint8_t relayed;
   uint8_t do_not_relay;
   uint8_t double_spend_seen: 1;
-  uint8_t bf_padding: 7;
+  uint8_t prunable_hash_valid: 1;
+  uint8_t bf_padding: 6;
+
+  crypto::hash prunable_hash; // saves rehashing the tx when it is mined
+  uint8_t padding[44]; // till 192 bytes
+};
+
+/**
+ * @brief a struct containing the chain data of a block in an alternative chain
+ *
+ * The parent id and timestamp are kept alongside so alternative chains can
+ * be walked, checked and pruned without parsing the block blobs.
+ */
+struct alt_block_data_t
+{
+  crypto::hash prev_id;
+  uint64_t timestamp;
+  uint64_t height;
+  uint64_t cumulative_weight;
+  uint64_t cumulative_difficulty;
+  uint64_t already_generated_coins;
+};
 
-  uint8_t padding[76]; // till 192 bytes
+/**
+ * @brief a block with the metadata needed to describe its header
+ */
+struct block_header_entry_t
+{
+  cryptonote::block blk;
+  crypto::hash hash;
+  uint64_t weight;
+  difficulty_type cumulative_difficulty;
+  difficulty_type difficulty;
+};
+
+/**
+ * @brief usage statistics for an in-memory spent key image filter
+ */
+struct key_image_filter_stats
+{
+  bool enabled;
+  uint64_t memory_size;         //!< bytes used by the filter
+  uint64_t entries;             //!< key images inserted
+  double estimated_fp_rate;     //!< expected false positive rate at the current fill
+  uint64_t lookups;             //!< has_key_image calls
+  uint64_t filtered;            //!< lookups answered by the filter alone
+  uint64_t false_positives;     //!< lookups the filter let through which were not spent
 };
 
 #define DBF_SAFE       1
@@ -159,6 +215,8 @@ struct txpool_tx_meta_t
 #define DBF_FASTEST    4
 #define DBF_RDONLY     8
 #define DBF_SALVAGE 0x10
+#define DBF_TXPOOL_MEMORY 0x20
+#define DBF_EXPLORER_INDEX 0x40
 
 /***********************************
  * Exception Definitions
@@ -362,6 +420,8 @@ private:
    * @param block_weight the weight of the block (transactions and all)
    * @param cumulative_difficulty the accumulated difficulty after this block
    * @param coins_generated the number of coins generated total after this block
+   * @param emission the block's coinbase amount less its fees
+   * @param fees the fees paid by the block's transactions
    * @param blk_hash the hash of the block
    */
   virtual void add_block( const block& blk
@@ -369,6 +429,8 @@ private:
                 , const difficulty_type& cumulative_difficulty
                 , const uint64_t& coins_generated
                 , uint64_t num_rct_outs
+                , uint64_t emission
+                , uint64_t fees
                 , const crypto::hash& blk_hash
                 ) = 0;
 
@@ -384,6 +446,21 @@ private:
    */
   virtual void remove_block() = 0;
 
+  /**
+   * @brief store the compact filter of a block
+   *
+   * The subclass implementing this will store the filter (see
+   * cryptonote::block_filter) of the block just added at the given height.
+   * It is removed again along with the block, by remove_block().
+   *
+   * If any of this cannot be done, the subclass should throw the corresponding
+   * subclass of DB_EXCEPTION
+   *
+   * @param height the height of the block
+   * @param filter the serialized filter
+   */
+  virtual void add_block_filter(uint64_t height, const cryptonote::blobdata& filter) = 0;
+
   /**
    * @brief store the transaction and its metadata
    *
@@ -479,6 +556,17 @@ private:
    */
   virtual void add_spent_key(const crypto::key_image& k_image) = 0;
 
+  /**
+   * @brief store a block's spent keys at once
+   *
+   * The key images come in no particular order. A subclass may override this
+   * to write them in its own key order rather than one at a time; by default
+   * each is passed to add_spent_key.
+   *
+   * @param k_images the spent key images to store
+   */
+  virtual void add_spent_keys(const std::vector<crypto::key_image>& k_images);
+
   /**
    * @brief remove a spent key
    *
@@ -531,8 +619,9 @@ protected:
    * @param tx the transaction to add
    * @param tx_hash_ptr the hash of the transaction, if already calculated
    * @param tx_prunable_hash_ptr the hash of the prunable part of the transaction, if already calculated
+   * @param key_images if not NULL, the transaction's key images are appended here for the caller to store, rather than stored one by one
    */
-  void add_transaction(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash* tx_hash_ptr = NULL, const crypto::hash* tx_prunable_hash_ptr = NULL);
+  void add_transaction(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash* tx_hash_ptr = NULL, const crypto::hash* tx_prunable_hash_ptr = NULL, std::vector<crypto::key_image>* key_images = NULL);
 
   mutable uint64_t time_tx_exists = 0;  //!< a performance metric
   uint64_t time_commit1 = 0;  //!< a performance metric
@@ -774,6 +863,23 @@ public:
   virtual void block_txn_stop() = 0;
   virtual void block_txn_abort() = 0;
 
+  /**
+   * @brief starts a read txn for the calling thread, unless one is active
+   *
+   * While the txn is active, reads by this thread reuse it, and its
+   * cursors, instead of starting and resetting a txn each. They all see
+   * the same state of the db. Use db_rtxn_guard rather than calling this
+   * directly.
+   *
+   * @return true if a txn was started, and block_rtxn_stop needs calling
+   */
+  virtual bool block_rtxn_start() const { return false; }
+
+  /**
+   * @brief ends the read txn started by block_rtxn_start
+   */
+  virtual void block_rtxn_stop() const {}
+
   virtual void set_hard_fork(HardFork* hf);
 
   // adds a block with the given metadata to the top of the blockchain, returns the new height
@@ -881,6 +987,96 @@ public:
    */
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const = 0;
 
+  /**
+   * @brief fetch a view of a block blob by height, without copying it
+   *
+   * The view points into storage owned by the db, and is only valid while
+   * the read txn it was fetched under is active, so the caller must hold a
+   * db_rtxn_guard (or a batch) for as long as it uses the view.
+   *
+   * If the block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param height the height to look for
+   * @param blob return-by-reference the view of the block blob
+   *
+   * @return true if a view was returned, false if the db does not support
+   *         views, in which case get_block_blob_from_height should be used
+   */
+  virtual bool get_block_blob_view(uint64_t height, epee::span<const uint8_t>& blob) const { return false; }
+
+  /**
+   * @brief fetch the compact filter of a block by height
+   *
+   * Blocks added before the db stored filters have none.
+   *
+   * @param height the height to look for
+   * @param filter return-by-reference the serialized filter
+   *
+   * @return true if a filter was found, false otherwise
+   */
+  virtual bool get_block_filter(uint64_t height, cryptonote::blobdata& filter) const = 0;
+
+  /**
+   * @brief fetch a cached proof of work hash
+   *
+   * The cache is keyed by block id, so it may hold hashes of alternative
+   * blocks, and of blocks popped off the main chain, as well as main chain
+   * blocks validated since the cache was added.
+   *
+   * @param blk_hash the block id
+   * @param pow_hash return-by-reference the block's PoW hash
+   *
+   * @return true if a PoW hash was found, false otherwise
+   */
+  virtual bool get_pow_hash(const crypto::hash& blk_hash, crypto::hash& pow_hash) const = 0;
+
+  /**
+   * @brief cache the proof of work hash of a block
+   *
+   * As with the txpool functions, the caller is responsible for having a
+   * write transaction (ie, a batch) open.
+   *
+   * If any of this cannot be done, the subclass should throw the corresponding
+   * subclass of DB_EXCEPTION
+   *
+   * @param blk_hash the block id
+   * @param pow_hash the block's PoW hash
+   */
+  virtual void add_pow_hash(const crypto::hash& blk_hash, const crypto::hash& pow_hash) = 0;
+
+  /**
+   * @brief check whether the explorer indexes are kept
+   *
+   * They are built the first time the db is opened with DBF_EXPLORER_INDEX,
+   * and kept up to date from then on.
+   *
+   * @return true if get_key_image_spender and get_output_locations can be used
+   */
+  virtual bool has_explorer_index() const = 0;
+
+  /**
+   * @brief fetch the transaction which spent a key image
+   *
+   * @param k_image the key image to look for
+   * @param tx_hash return-by-reference the hash of the spending transaction
+   *
+   * @return true if the key image is spent in the chain, false otherwise
+   */
+  virtual bool get_key_image_spender(const crypto::key_image& k_image, crypto::hash& tx_hash) const = 0;
+
+  /**
+   * @brief fetch where the outputs with a given public key are
+   *
+   * Output keys are expected to be unique, but nothing in the chain
+   * enforces it, so there may be more than one.
+   *
+   * @param key the output public key to look for
+   * @param locations return-by-reference the (amount, amount index) of each match
+   *
+   * @return true if at least one output was found, false otherwise
+   */
+  virtual bool get_output_locations(const crypto::public_key& key, std::vector<output_location_t>& locations) const = 0;
+
   /**
    * @brief fetch a block by height
    *
@@ -921,6 +1117,21 @@ public:
    */
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const = 0;
 
+  /**
+   * @brief fetch the cumulative number of rct outputs for a range of blocks
+   *
+   * The default implementation calls get_block_cumulative_rct_outputs with
+   * every height of the range. Subclasses may serve it from memory.
+   *
+   * If a block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param from_height the first height requested
+   * @param to_height the last height requested (inclusive)
+   *
+   * @return the cumulative number of rct outputs for each block of the range
+   */
+  virtual std::vector<uint64_t> get_block_cumulative_rct_outputs_range(uint64_t from_height, uint64_t to_height) const;
+
   /**
    * @brief fetch the top block's timestamp
    *
@@ -986,6 +1197,21 @@ public:
    */
   virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const = 0;
 
+  /**
+   * @brief fetch the emission and fees summed over the chain up to a block
+   *
+   * Emission here is the coinbase amount less the fees, for each block, as
+   * reported by get_coinbase_tx_sum, so the sums over any range of blocks
+   * are the difference of two lookups.
+   *
+   * If the block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param height the height requested
+   * @param emission return-by-reference the emission from the genesis block to this one included
+   * @param fees return-by-reference the fees from the genesis block to this one included
+   */
+  virtual void get_block_cumulative_emission_and_fees(const uint64_t& height, uint64_t &emission, uint64_t &fees) const = 0;
+
   /**
    * @brief fetch a block's hash
    *
@@ -1017,6 +1243,20 @@ public:
    */
   virtual std::vector<block> get_blocks_range(const uint64_t& h1, const uint64_t& h2) const = 0;
 
+  /**
+   * @brief fetch a range of blocks along with their metadata
+   *
+   * The default implementation calls the single block getters for each
+   * height. Subclasses may read the whole range in one pass instead.
+   *
+   * If a block in the range does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param h1 the start height
+   * @param h2 the end height (inclusive)
+   * @param entries return-by-reference the blocks and their metadata
+   */
+  virtual void get_block_header_entries(uint64_t h1, uint64_t h2, std::vector<block_header_entry_t> &entries) const;
+
   /**
    * @brief fetch a list of block hashes
    *
@@ -1138,6 +1378,20 @@ public:
    */
   virtual bool get_tx(const crypto::hash& h, transaction &tx) const;
 
+  /**
+   * @brief fetches the pruned transaction with the given hash
+   *
+   * The pruned transaction is available even when its prunable data was
+   * dropped by pruning the db.
+   *
+   * If the transaction does not exist, the subclass should return false.
+   *
+   * @param h the hash to look for
+   *
+   * @return true iff the transaction was found
+   */
+  virtual bool get_pruned_tx(const crypto::hash& h, transaction &tx) const;
+
   /**
    * @brief fetches the transaction blob with the given hash
    *
@@ -1166,6 +1420,39 @@ public:
    */
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const = 0;
 
+  /**
+   * @brief fetches the blobs of several transactions
+   *
+   * Subclasses may do the lookups in their own key order, for locality,
+   * but results are returned in the order of the given hashes. The base
+   * implementation looks them up one at a time.
+   *
+   * @param hashes the hashes to look for
+   * @param bds return-by-reference the blobs, empty for txes not found
+   * @param found return-by-reference whether each tx was found
+   * @param pruned whether to fetch pruned blobs
+   *
+   * @return the number of transactions found
+   */
+  virtual size_t get_tx_blobs(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &bds, std::vector<bool> &found, bool pruned = false) const;
+
+  /**
+   * @brief fetches the blobs of a block's transactions, miner tx excluded
+   *
+   * Subclasses which store a block's transactions together may read them
+   * as one range, without looking each up by hash. The base implementation
+   * parses the block and calls get_tx_blobs.
+   *
+   * If the block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param height the height of the block
+   * @param bds return-by-reference the blobs, in block order
+   * @param pruned whether to fetch pruned blobs
+   *
+   * @return false if any of the transactions was not found
+   */
+  virtual bool get_block_tx_blobs(uint64_t height, std::vector<cryptonote::blobdata> &bds, bool pruned = false) const;
+
   /**
    * @brief fetches the prunable transaction hash
    *
@@ -1336,6 +1623,22 @@ public:
    */
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const = 0;
 
+  /**
+   * @brief gets output indices (amount-specific) for all txs of a range of blocks
+   *
+   * Tx IDs are allocated in block order, so subclasses which store the
+   * indices by tx ID may read them as one range, without looking each tx
+   * up by hash. The base implementation parses each block and calls
+   * get_tx_amount_output_indices for its miner tx and txs.
+   *
+   * If a block does not exist, the subclass should throw BLOCK_DNE.
+   *
+   * @param start_height the height of the first block
+   * @param count the number of blocks
+   * @param indices return-by-reference the indices, per block, per tx, miner tx first
+   */
+  virtual void get_blocks_amount_output_indices(uint64_t start_height, size_t count, std::vector<std::vector<std::vector<uint64_t>>> &indices) const;
+
   /**
    * @brief check if a key image is stored as spent
    *
@@ -1345,6 +1648,16 @@ public:
    */
   virtual bool has_key_image(const crypto::key_image& img) const = 0;
 
+  /**
+   * @brief check if key images are stored as spent
+   *
+   * The default implementation calls has_key_image for each.
+   *
+   * @param imgs the key images to check for
+   * @param spent return-by-reference whether each key image is present
+   */
+  virtual void has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const;
+
   /**
    * @brief add a txpool transaction
    *
@@ -1421,6 +1734,77 @@ public:
    */
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false, bool include_unrelayed_txes = true) const = 0;
 
+  /**
+   * @brief write the txpool to the db, when it is kept in memory only
+   *
+   * When opened with DBF_TXPOOL_MEMORY, the txpool functions above work on
+   * memory only, and the txpool as stored in the db is what it was when
+   * last snapshotted. As with the other txpool functions, the caller is
+   * responsible for having a write transaction (ie, a batch) open.
+   *
+   * @return false if the txpool is not kept in memory
+   */
+  virtual bool snapshot_txpool() { return false; }
+
+  /**
+   * @brief add a block to the alternative block storage
+   *
+   * As with the txpool functions, the caller is responsible for having a
+   * write transaction (ie, a batch) open.
+   *
+   * @param blkid the block id
+   * @param data the block's chain data
+   * @param blob the block blob
+   */
+  virtual void add_alt_block(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata &blob) = 0;
+
+  /**
+   * @brief get a block from the alternative block storage
+   *
+   * @param blkid the block id
+   * @param data return-by-pointer the block's chain data, if not NULL
+   * @param blob return-by-pointer the block blob, if not NULL
+   *
+   * @return true if the block was found, false otherwise
+   */
+  virtual bool get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob) const = 0;
+
+  /**
+   * @brief remove a block from the alternative block storage
+   *
+   * Removing a block which is not stored is not an error.
+   *
+   * @param blkid the block id
+   */
+  virtual void remove_alt_block(const crypto::hash &blkid) = 0;
+
+  /**
+   * @brief get the number of blocks in the alternative block storage
+   */
+  virtual uint64_t get_alt_block_count() = 0;
+
+  /**
+   * @brief remove all blocks from the alternative block storage
+   */
+  virtual void drop_alt_blocks() = 0;
+
+  /**
+   * @brief runs a function over all alternative blocks
+   *
+   * The subclass should run the passed function for each alternative block
+   * it has stored, passing the block id, chain data and (if include_blob is
+   * set) blob as its parameters.
+   *
+   * If any call to the function returns false, the subclass should return
+   * false.  Otherwise, the subclass returns true.
+   *
+   * @param std::function fn the function to run
+   * @param include_blob whether to pass the block blobs
+   *
+   * @return false if the function returns false for any block, otherwise true
+   */
+  virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata *blob)> f, bool include_blob = false) const = 0;
+
   /**
    * @brief runs a function over all key images stored
    *
@@ -1456,6 +1840,18 @@ public:
    */
   virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const = 0;
 
+  /**
+   * @brief hints that a range of blocks and their txs is about to be read
+   *
+   * Purely advisory: a memory mapped implementation may start reading the
+   * range in ahead of the caller, so a sequential read of a cold range is
+   * not paid for one page fault at a time.
+   *
+   * @param start_height the first block to be read
+   * @param count the number of blocks to be read
+   */
+  virtual void prefetch_blocks(uint64_t start_height, uint64_t count) const { }
+
   /**
    * @brief runs a function over all transactions stored
    *
@@ -1556,6 +1952,83 @@ public:
    */
   virtual uint64_t get_database_size() const = 0;
 
+  /**
+   * @brief get the pruning seed of the db
+   *
+   * @return the seed of the stripe the db keeps prunable data for, or 0 if
+   *         it keeps all prunable data
+   */
+  virtual uint32_t get_blockchain_pruning_seed() const = 0;
+
+  /**
+   * @brief prune the db
+   *
+   * Drops the prunable tx data of the blocks outside the stripe of the
+   * given seed, except for the most recent CRYPTONOTE_PRUNING_TIP_BLOCKS,
+   * and records the seed so later blocks get pruned by update_pruning.
+   * The subclass may compact the db afterwards, so no other thread may be
+   * using it.
+   *
+   * @param pruning_seed the seed to prune to, or 0 to pick a random stripe
+   *
+   * @return true on success, false if the db is already pruned to another seed
+   */
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0) = 0;
+
+  /**
+   * @brief prune the blocks which have left the tip since the db was last pruned
+   *
+   * Does nothing if the db is not pruned.
+   *
+   * @return true on success
+   */
+  virtual bool update_pruning() = 0;
+
+  /**
+   * @brief get the statistics of the spent key image filter
+   *
+   * @param stats return-by-reference the statistics
+   *
+   * @return false if the implementation has no such filter
+   */
+  virtual bool get_key_image_filter_stats(key_image_filter_stats &stats) const { return false; }
+
+  /**
+   * @brief get the size of the memory map and how much of it is in use
+   *
+   * @param map_size return-by-reference the size of the map in bytes
+   * @param used return-by-reference the bytes in use
+   *
+   * @return false if the implementation is not memory mapped
+   */
+  virtual bool get_map_usage(uint64_t &map_size, uint64_t &used) const { return false; }
+
+  /**
+   * @brief get how often the memory map was resized, and for how long txns were held back
+   *
+   * @param resizes return-by-reference the number of resizes
+   * @param blocked_ns return-by-reference the nanoseconds new txns waited on resizes
+   *
+   * @return false if the implementation is not memory mapped
+   */
+  virtual bool get_resize_stats(uint64_t &resizes, uint64_t &blocked_ns) const { return false; }
+
+  /**
+   * @brief write a compacted copy of the db while it stays in use
+   *
+   * The copy is a consistent snapshot of the db as it was when the copy
+   * started, without the free pages the db has accumulated. Blocks may be
+   * added meanwhile, though the subclass may hold back growing the db
+   * until the copy is done.
+   *
+   * @param folder the directory to write the copy to, which must not hold a db yet
+   * @param max_bytes_per_second the rate to write the copy at, 0 for as fast as possible
+   * @param progress called with the bytes written so far, returns false to cancel the copy
+   *
+   * @return false if the implementation cannot make such copies, or the copy was cancelled
+   */
+  virtual bool backup(const std::string &folder, uint64_t max_bytes_per_second, const std::function<bool(uint64_t)> &progress = NULL) { return false; }
+
   // TODO: this should perhaps be (or call) a series of functions which
   // progressively update through version updates
   /**
@@ -1578,6 +2051,28 @@ public:
 
 };  // class BlockchainDB
 
+/**
+ * @brief keeps one db read txn active for the calling thread while in scope
+ *
+ * Guards nest: only the outermost one starts and ends the txn. The txn is
+ * per thread, so the guard must be destroyed on the thread that made it.
+ * As the db can only be resized when no txn is active, hold it only where
+ * a resize cannot be waited on, i.e. under the blockchain lock.
+ */
+class db_rtxn_guard
+{
+public:
+  db_rtxn_guard(const BlockchainDB *db): m_db(db), m_active(db->block_rtxn_start()) {}
+  ~db_rtxn_guard() { if (m_active) m_db->block_rtxn_stop(); }
+
+private:
+  db_rtxn_guard(const db_rtxn_guard&);
+  db_rtxn_guard &operator=(const db_rtxn_guard&);
+
+  const BlockchainDB *m_db;
+  bool m_active;
+};
+
 BlockchainDB *new_db(const std::string& db_type);
 
 }  // namespace cryptonote
@@ -0,0 +1,128 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cmath>
+#include <cstring>
+#include "misc_log_ex.h"
+#include "key_image_filter.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db"
+
+namespace cryptonote
+{
+
+constexpr size_t key_image_filter::BLOCK_WORDS;
+constexpr size_t key_image_filter::BITS_PER_ENTRY;
+constexpr size_t key_image_filter::NUM_PROBES;
+constexpr uint64_t key_image_filter::MIN_HEADROOM;
+
+key_image_filter::key_image_filter():
+  m_num_blocks(0), m_capacity(0), m_entries(0), m_enabled(false)
+{
+}
+
+void key_image_filter::reset(uint64_t expected_entries)
+{
+  m_enabled = false;
+
+  // leave room for the key images added while the daemon runs
+  m_capacity = expected_entries + std::max<uint64_t>(expected_entries / 2, MIN_HEADROOM);
+  const size_t bits_per_block = BLOCK_WORDS * 64;
+  m_num_blocks = (m_capacity * BITS_PER_ENTRY + bits_per_block - 1) / bits_per_block;
+  m_bits.reset(new std::atomic<uint64_t>[m_num_blocks * BLOCK_WORDS]);
+  for (size_t i = 0; i < m_num_blocks * BLOCK_WORDS; ++i)
+    m_bits[i].store(0, std::memory_order_relaxed);
+  m_entries = 0;
+
+  m_enabled = true;
+}
+
+void key_image_filter::clear()
+{
+  m_enabled = false;
+  m_bits.reset();
+  m_num_blocks = 0;
+  m_capacity = 0;
+  m_entries = 0;
+}
+
+size_t key_image_filter::block_index(const crypto::key_image &ki) const
+{
+  uint64_t h;
+  memcpy(&h, &ki, sizeof(h));
+  return h % m_num_blocks;
+}
+
+void key_image_filter::insert(const crypto::key_image &ki)
+{
+  if (!m_enabled)
+    return;
+
+  if (++m_entries > m_capacity)
+  {
+    MWARNING("Key image filter is full, disabling it until restart");
+    m_enabled = false;
+    return;
+  }
+
+  std::atomic<uint64_t> *block = &m_bits[block_index(ki) * BLOCK_WORDS];
+  const unsigned char *bytes = (const unsigned char*)&ki + sizeof(uint64_t);
+  for (size_t i = 0; i < NUM_PROBES; ++i)
+  {
+    const unsigned bit = (bytes[2 * i] | (bytes[2 * i + 1] << 8)) & (BLOCK_WORDS * 64 - 1);
+    block[bit / 64].fetch_or(1ull << (bit % 64));
+  }
+}
+
+bool key_image_filter::may_contain(const crypto::key_image &ki) const
+{
+  if (!m_enabled)
+    return true;
+
+  const std::atomic<uint64_t> *block = &m_bits[block_index(ki) * BLOCK_WORDS];
+  const unsigned char *bytes = (const unsigned char*)&ki + sizeof(uint64_t);
+  for (size_t i = 0; i < NUM_PROBES; ++i)
+  {
+    const unsigned bit = (bytes[2 * i] | (bytes[2 * i + 1] << 8)) & (BLOCK_WORDS * 64 - 1);
+    if (!(block[bit / 64].load() & (1ull << (bit % 64))))
+      return false;
+  }
+  return true;
+}
+
+double key_image_filter::estimated_false_positive_rate() const
+{
+  if (!m_enabled)
+    return 1.0;
+  const double bits = m_num_blocks * BLOCK_WORDS * 64;
+  return std::pow(1.0 - std::exp(-(double)NUM_PROBES * m_entries / bits), NUM_PROBES);
+}
+
+}
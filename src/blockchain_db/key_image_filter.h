@@ -0,0 +1,113 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include "crypto/crypto.h"
+
+namespace cryptonote
+{
+
+/**
+ * @brief in-memory filter over the spent key image set
+ *
+ * A blocked Bloom filter: each key image sets a few bits within one
+ * 512 bit block, so a lookup touches a single cache line. Key images are
+ * already uniformly distributed, so their bytes are used directly as the
+ * hash functions.
+ *
+ * There are no false negatives, so a negative answer means the key image
+ * is not in the set. Entries cannot be removed; a key image which goes
+ * back to unspent on a pop only costs an extra false positive. If more
+ * entries are inserted than the filter was sized for, it disables itself
+ * and may_contain always returns true until the next reset.
+ *
+ * insert and may_contain can be called concurrently.
+ */
+class key_image_filter
+{
+public:
+  key_image_filter();
+
+  /**
+   * @brief clears the filter and sizes it for a number of entries
+   *
+   * @param expected_entries the number of key images it will hold
+   */
+  void reset(uint64_t expected_entries);
+
+  /**
+   * @brief frees the filter, which then answers true to every lookup
+   */
+  void clear();
+
+  /**
+   * @brief adds a key image to the filter
+   *
+   * @param ki the key image
+   */
+  void insert(const crypto::key_image &ki);
+
+  /**
+   * @brief checks a key image against the filter
+   *
+   * @param ki the key image
+   *
+   * @return false if the key image was never inserted, true if it may have been
+   */
+  bool may_contain(const crypto::key_image &ki) const;
+
+  bool enabled() const { return m_enabled; }
+  uint64_t entries() const { return m_entries; }
+  uint64_t memory_size() const { return m_num_blocks * BLOCK_WORDS * sizeof(uint64_t); }
+
+  /**
+   * @brief the false positive rate expected at the current fill level
+   */
+  double estimated_false_positive_rate() const;
+
+private:
+  static constexpr size_t BLOCK_WORDS = 8;
+  static constexpr size_t BITS_PER_ENTRY = 10;
+  static constexpr size_t NUM_PROBES = 7;
+  static constexpr uint64_t MIN_HEADROOM = 1 << 20;
+
+  size_t block_index(const crypto::key_image &ki) const;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> m_bits;
+  size_t m_num_blocks;
+  uint64_t m_capacity;
+  std::atomic<uint64_t> m_entries;
+  std::atomic<bool> m_enabled;
+};
+
+}
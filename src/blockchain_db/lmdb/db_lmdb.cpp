@@ -34,13 +34,26 @@
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
 #include <random>
+#include <numeric>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#endif
 
 #include "string_tools.h"
 #include "file_io_utils.h"
 #include "common/util.h"
+#include "common/pruning.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "crypto/crypto.h"
 #include "profile_tools.h"
+#include "misc_language.h"
 #include "ringct/rctOps.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -55,7 +68,7 @@ using epee::string_tools::pod_to_hex;
 using namespace crypto;
 
 // Increase when the DB structure changes
-#define VERSION 3
+#define VERSION 6
 
 namespace
 {
@@ -163,7 +176,7 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  * -----            ---          ----
  * blocks           block ID     block blob
  * block_heights    block hash   block height
- * block_info       block ID     {block metadata}
+ * block_info       block ID     {block metadata, first txn ID}
  *
  * txs_pruned       txn ID       pruned txn blob
  * txs_prunable     txn ID       prunable txn blob
@@ -173,23 +186,39 @@ int compare_string(const MDB_val *a, const MDB_val *b)
  *
  * output_txs       output ID    {txn hash, local index}
  * output_amounts   amount       [{amount output index, metadata}...]
+ * rct_outputs      rct output index {output ID, metadata}
  *
  * spent_keys       input hash   -
  *
+ * spent_key_txs    input hash   spending txn hash
+ * output_keys      output key   [{amount, amount output index}...]
+ *
  * txpool_meta      txn hash     txn metadata
  * txpool_blob      txn hash     txn blob
  *
+ * alt_blocks       block hash   {chain data, block blob}
+ *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
  * key is used when accessing the table; the Key listed above will be
  * attached as a prefix on the Data to serve as the DUPSORT key.
  * (DUPFIXED saves 8 bytes per record.)
  *
+ * Txn IDs are handed out in block order, so a block's txns are the IDs from
+ * its first txn ID (that of its miner txn) up to the next block's.
+ *
  * The output_amounts table doesn't use a dummy key, but uses DUPSORT.
+ * It holds pre-RCT outputs only: RCT outputs all have amount 0, and are
+ * kept in rct_outputs so they are found with a single key lookup.
+ *
+ * spent_key_txs and output_keys are the optional explorer indexes, which
+ * only exist once the db was opened with DBF_EXPLORER_INDEX.
  */
 const char* const LMDB_BLOCKS = "blocks";
 const char* const LMDB_BLOCK_HEIGHTS = "block_heights";
 const char* const LMDB_BLOCK_INFO = "block_info";
+const char* const LMDB_BLOCK_FILTERS = "block_filters";
+const char* const LMDB_POW_HASHES = "pow_hashes";
 
 const char* const LMDB_TXS = "txs";
 const char* const LMDB_TXS_PRUNED = "txs_pruned";
@@ -200,11 +229,16 @@ const char* const LMDB_TX_OUTPUTS = "tx_outputs";
 
 const char* const LMDB_OUTPUT_TXS = "output_txs";
 const char* const LMDB_OUTPUT_AMOUNTS = "output_amounts";
+const char* const LMDB_RCT_OUTPUTS = "rct_outputs";
 const char* const LMDB_SPENT_KEYS = "spent_keys";
+const char* const LMDB_SPENT_KEY_TXS = "spent_key_txs";
+const char* const LMDB_OUTPUT_KEYS = "output_keys";
 
 const char* const LMDB_TXPOOL_META = "txpool_meta";
 const char* const LMDB_TXPOOL_BLOB = "txpool_blob";
 
+const char* const LMDB_ALT_BLOCKS = "alt_blocks";
+
 const char* const LMDB_HF_STARTING_HEIGHTS = "hf_starting_heights";
 const char* const LMDB_HF_VERSIONS = "hf_versions";
 
@@ -225,6 +259,83 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+// map resizes, ours or another process's, and how long new txns were held back for them
+std::atomic<uint64_t> resize_count(0);
+std::atomic<uint64_t> resize_blocked_ns(0);
+
+uint64_t resize_elapsed_ns(const std::chrono::steady_clock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// The env is opened with MDB_NORDAHEAD, which keeps the kernel from reading
+// around random lookups but leaves a long walk over a cold map faulting one
+// page at a time. Tables keyed by increasing integers are written mostly in
+// key order, so pages a scan is about to reach tend to sit just after the
+// ones it is on: ask for those ahead of time. MADV_WILLNEED only queues the
+// reads, the scan does not wait on them.
+constexpr size_t SCAN_READAHEAD_WINDOW = 4 << 20;
+constexpr size_t PREFETCH_MAX_SPAN = 64 << 20;
+
+void advise_willneed(MDB_env *env, const void *lo, const void *hi)
+{
+#ifndef _WIN32
+  MDB_envinfo mei;
+  if (mdb_env_info(env, &mei))
+    return;
+  const uintptr_t map_begin = (uintptr_t)mei.me_mapaddr, map_end = map_begin + mei.me_mapsize;
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = (uintptr_t)lo & ~(page_size - 1), end = (uintptr_t)hi;
+  // records in a write txn may live in dirty pages outside the map
+  if (begin < map_begin || begin >= map_end || end <= begin)
+    return;
+  end = std::min(end, map_end);
+  madvise((void*)begin, end - begin, MADV_WILLNEED);
+#endif
+}
+
+// Called with each record a cursor walks through, keeps a window of the map
+// ahead of it read in.
+class mdb_readahead
+{
+public:
+  mdb_readahead(MDB_env *env, size_t window = SCAN_READAHEAD_WINDOW): m_env(env), m_window(window), m_begin(NULL), m_end(NULL) {}
+
+  void operator()(const MDB_val &v)
+  {
+    const char *p = (const char*)v.mv_data;
+    if (p >= m_begin && p + m_window / 2 < m_end)
+      return;
+    m_begin = p;
+    m_end = p + m_window;
+    advise_willneed(m_env, m_begin, m_end);
+  }
+
+private:
+  MDB_env *m_env;
+  const size_t m_window;
+  const char *m_begin;
+  const char *m_end;
+};
+
+// Reads the records for keys lo and hi (or the last record, if hi is past the
+// end) of an integer keyed table, and advises the span between them.
+bool advise_key_range(MDB_env *env, MDB_cursor *cur, uint64_t lo, uint64_t hi, MDB_val &lo_v, MDB_val &hi_v)
+{
+  MDB_val k = {sizeof(lo), (void*)&lo};
+  if (mdb_cursor_get(cur, &k, &lo_v, MDB_SET))
+    return false;
+  k = {sizeof(hi), (void*)&hi};
+  int ret = mdb_cursor_get(cur, &k, &hi_v, MDB_SET);
+  if (ret == MDB_NOTFOUND)
+    ret = mdb_cursor_get(cur, &k, &hi_v, MDB_LAST);
+  if (ret)
+    return false;
+  const char *begin = (const char*)lo_v.mv_data, *end = (const char*)hi_v.mv_data + hi_v.mv_size;
+  if (end > begin)
+    advise_willneed(env, begin, std::min(end, begin + PREFETCH_MAX_SPAN));
+  return true;
+}
 
 }  // anonymous namespace
 
@@ -252,7 +363,28 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
 namespace cryptonote
 {
 
-typedef struct mdb_block_info_old
+typedef struct mdb_block_info_1
+{
+  uint64_t bi_height;
+  uint64_t bi_timestamp;
+  uint64_t bi_coins;
+  uint64_t bi_weight; // a size_t really but we need 32-bit compat
+  difficulty_type bi_diff;
+  crypto::hash bi_hash;
+} mdb_block_info_1;
+
+typedef struct mdb_block_info_2
+{
+  uint64_t bi_height;
+  uint64_t bi_timestamp;
+  uint64_t bi_coins;
+  uint64_t bi_weight; // a size_t really but we need 32-bit compat
+  difficulty_type bi_diff;
+  crypto::hash bi_hash;
+  uint64_t bi_cum_rct;
+} mdb_block_info_2;
+
+typedef struct mdb_block_info_3
 {
   uint64_t bi_height;
   uint64_t bi_timestamp;
@@ -260,9 +392,11 @@ typedef struct mdb_block_info_old
   uint64_t bi_weight; // a size_t really but we need 32-bit compat
   difficulty_type bi_diff;
   crypto::hash bi_hash;
-} mdb_block_info_old;
+  uint64_t bi_cum_rct;
+  uint64_t bi_first_tx_id;
+} mdb_block_info_3;
 
-typedef struct mdb_block_info
+typedef struct mdb_block_info_4
 {
   uint64_t bi_height;
   uint64_t bi_timestamp;
@@ -271,7 +405,12 @@ typedef struct mdb_block_info
   difficulty_type bi_diff;
   crypto::hash bi_hash;
   uint64_t bi_cum_rct;
-} mdb_block_info;
+  uint64_t bi_first_tx_id;
+  uint64_t bi_cum_emission; // coinbase less fees, as get_coinbase_tx_sum counts it
+  uint64_t bi_cum_fees;
+} mdb_block_info_4;
+
+typedef mdb_block_info_4 mdb_block_info;
 
 typedef struct blk_height {
     crypto::hash bh_hash;
@@ -295,6 +434,11 @@ typedef struct outkey {
     output_data_t data;
 } outkey;
 
+typedef struct rct_outval {
+    uint64_t output_id;
+    output_data_t data;
+} rct_outval;
+
 typedef struct outtx {
     uint64_t output_id;
     crypto::hash tx_hash;
@@ -412,6 +556,7 @@ void mdb_txn_safe::allow_new_txns()
 
 void lmdb_resized(MDB_env *env)
 {
+  const auto start = std::chrono::steady_clock::now();
   mdb_txn_safe::prevent_new_txns();
 
   MGINFO("LMDB map resize detected.");
@@ -433,6 +578,8 @@ void lmdb_resized(MDB_env *env)
   MGINFO("LMDB Mapsize increased." << "  Old: " << old / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
 
   mdb_txn_safe::allow_new_txns();
+  ++resize_count;
+  resize_blocked_ns += resize_elapsed_ns(start);
 }
 
 inline int lmdb_txn_begin(MDB_env *env, MDB_txn *parent, unsigned int flags, MDB_txn **txn)
@@ -498,6 +645,7 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
 
   new_mapsize += (new_mapsize % mst.ms_psize);
 
+  const auto start = std::chrono::steady_clock::now();
   mdb_txn_safe::prevent_new_txns();
 
   if (m_write_txn != nullptr)
@@ -521,6 +669,10 @@ void BlockchainLMDB::do_resize(uint64_t increase_size)
   MGINFO("LMDB Mapsize increased." << "  Old: " << mei.me_mapsize / (1024 * 1024) << "MiB" << ", New: " << new_mapsize / (1024 * 1024) << "MiB");
 
   mdb_txn_safe::allow_new_txns();
+  ++resize_count;
+  const uint64_t blocked_ns = resize_elapsed_ns(start);
+  resize_blocked_ns += blocked_ns;
+  MDEBUG("New transactions were held back for " << blocked_ns / 1000000 << " ms by the resize");
 }
 
 // threshold_size is used for batch transactions
@@ -679,7 +831,7 @@ estim:
 }
 
 void BlockchainLMDB::add_block(const block& blk, size_t block_weight, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
-    uint64_t num_rct_outs, const crypto::hash& blk_hash)
+    uint64_t num_rct_outs, uint64_t emission, uint64_t fees, const crypto::hash& blk_hash)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
@@ -728,14 +880,21 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, const diff
   bi.bi_diff = cumulative_difficulty;
   bi.bi_hash = blk_hash;
   bi.bi_cum_rct = num_rct_outs;
-  if (blk.major_version >= 4)
+  // the block's txns were just added, miner txn first
+  bi.bi_first_tx_id = get_tx_count() - blk.tx_hashes.size() - 1;
+  bi.bi_cum_emission = emission;
+  bi.bi_cum_fees = fees;
+  if (m_height > 0)
   {
     uint64_t last_height = m_height-1;
     MDB_val_set(h, last_height);
     if ((result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &h, MDB_GET_BOTH)))
         throw1(BLOCK_DNE(lmdb_error("Failed to get block info: ", result).c_str()));
     const mdb_block_info *bi_prev = (const mdb_block_info*)h.mv_data;
-    bi.bi_cum_rct += bi_prev->bi_cum_rct;
+    if (blk.major_version >= 4)
+      bi.bi_cum_rct += bi_prev->bi_cum_rct;
+    bi.bi_cum_emission += bi_prev->bi_cum_emission;
+    bi.bi_cum_fees += bi_prev->bi_cum_fees;
   }
 
   MDB_val_set(val, bi);
@@ -743,6 +902,13 @@ void BlockchainLMDB::add_block(const block& blk, size_t block_weight, const diff
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block info to db transaction: ", result).c_str()));
 
+  if (!m_cum_rct_pending_active)
+  {
+    m_cum_rct_pending_active = true;
+    m_cum_rct_pending_height = m_height;
+  }
+  m_cum_rct_pending.push_back(bi.bi_cum_rct);
+
   result = mdb_cursor_put(m_cur_block_heights, (MDB_val *)&zerokval, &val_h, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add block height by hash to db transaction: ", result).c_str()));
@@ -788,6 +954,40 @@ void BlockchainLMDB::remove_block()
 
   if ((result = mdb_cursor_del(m_cur_block_info, 0)))
       throw1(DB_ERROR(lmdb_error("Failed to add removal of block info to db transaction: ", result).c_str()));
+
+  if (m_cum_rct_pending_active && !m_cum_rct_pending.empty())
+    m_cum_rct_pending.pop_back();
+  else
+  {
+    m_cum_rct_pending_active = true;
+    m_cum_rct_pending_height = m_height - 1;
+  }
+
+  // blocks added by older versions have no filter
+  CURSOR(block_filters)
+  MDB_val_copy<uint64_t> fk(m_height - 1);
+  MDB_val fv;
+  if ((result = mdb_cursor_get(m_cur_block_filters, &fk, &fv, MDB_SET)) == 0)
+  {
+    if ((result = mdb_cursor_del(m_cur_block_filters, 0)))
+      throw1(DB_ERROR(lmdb_error("Failed to add removal of block filter to db transaction: ", result).c_str()));
+  }
+  else if (result != MDB_NOTFOUND)
+    throw1(DB_ERROR(lmdb_error("Failed to locate block filter for removal: ", result).c_str()));
+}
+
+void BlockchainLMDB::add_block_filter(uint64_t height, const cryptonote::blobdata& filter)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(block_filters)
+  MDB_val_copy<uint64_t> key(height);
+  MDB_val_copy<blobdata> blob(filter);
+  int result = mdb_cursor_put(m_cur_block_filters, &key, &blob, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to add block filter to db transaction: ", result).c_str()));
 }
 
 uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash)
@@ -858,6 +1058,9 @@ uint64_t BlockchainLMDB::add_transaction_data(const crypto::hash& blk_hash, cons
       throw0(DB_ERROR(lmdb_error("Failed to add prunable tx prunable hash to db transaction: ", result).c_str()));
   }
 
+  if (m_has_explorer_index)
+    add_spent_key_txs(tx_hash, tx);
+
   return tx_id;
 }
 
@@ -890,11 +1093,16 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
   if (result)
       throw1(DB_ERROR(lmdb_error("Failed to add removal of pruned tx to db transaction: ", result).c_str()));
 
-  if ((result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET)))
+  // the prunable data is gone already if the db was pruned
+  result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, NULL, MDB_SET);
+  if (result && result != MDB_NOTFOUND)
       throw1(DB_ERROR(lmdb_error("Failed to locate prunable tx for removal: ", result).c_str()));
-  result = mdb_cursor_del(m_cur_txs_prunable, 0);
-  if (result)
-      throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
+  if (!result)
+  {
+    result = mdb_cursor_del(m_cur_txs_prunable, 0);
+    if (result)
+        throw1(DB_ERROR(lmdb_error("Failed to add removal of prunable tx to db transaction: ", result).c_str()));
+  }
 
   if (tx.version > 1)
   {
@@ -907,6 +1115,9 @@ void BlockchainLMDB::remove_transaction_data(const crypto::hash& tx_hash, const
 
   remove_tx_outputs(tip->data.tx_id, tx);
 
+  if (m_has_explorer_index)
+    remove_spent_key_txs(tx);
+
   result = mdb_cursor_get(m_cur_tx_outputs, &val_tx_id, NULL, MDB_SET);
   if (result == MDB_NOTFOUND)
     LOG_PRINT_L1("tx has no outputs to remove: " << tx_hash);
@@ -940,6 +1151,7 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
 
   CURSOR(output_txs)
   CURSOR(output_amounts)
+  CURSOR(rct_outputs)
 
   if (tx_output.target.type() != typeid(txout_to_key))
     throw0(DB_ERROR("Wrong output type: expected txout_to_key"));
@@ -953,6 +1165,31 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   if (result)
     throw0(DB_ERROR(lmdb_error("Failed to add output tx hash to db transaction: ", result).c_str()));
 
+  if (tx_output.amount == 0)
+  {
+    uint64_t amount_index = 0;
+    MDB_val k, v;
+    result = mdb_cursor_get(m_cur_rct_outputs, &k, &v, MDB_LAST);
+    if (!result)
+      amount_index = *(const uint64_t*)k.mv_data + 1;
+    else if (result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to get last rct output in db transaction: ", result).c_str()));
+
+    rct_outval rv;
+    rv.output_id = m_num_outputs;
+    rv.data.pubkey = boost::get < txout_to_key > (tx_output.target).key;
+    rv.data.unlock_time = unlock_time;
+    rv.data.height = m_height;
+    rv.data.commitment = *commitment;
+    MDB_val_set(krv, amount_index);
+    MDB_val_set(vrv, rv);
+    if ((result = mdb_cursor_put(m_cur_rct_outputs, &krv, &vrv, MDB_APPEND)))
+      throw0(DB_ERROR(lmdb_error("Failed to add rct output to db transaction: ", result).c_str()));
+    if (m_has_explorer_index)
+      add_output_key(rv.data.pubkey, 0, amount_index);
+    return amount_index;
+  }
+
   outkey ok;
   MDB_val data;
   MDB_val_copy<uint64_t> val_amount(tx_output.amount);
@@ -973,19 +1210,13 @@ uint64_t BlockchainLMDB::add_output(const crypto::hash& tx_hash,
   ok.data.pubkey = boost::get < txout_to_key > (tx_output.target).key;
   ok.data.unlock_time = unlock_time;
   ok.data.height = m_height;
-  if (tx_output.amount == 0)
-  {
-    ok.data.commitment = *commitment;
-    data.mv_size = sizeof(ok);
-  }
-  else
-  {
-    data.mv_size = sizeof(pre_rct_outkey);
-  }
+  data.mv_size = sizeof(pre_rct_outkey);
   data.mv_data = &ok;
 
   if ((result = mdb_cursor_put(m_cur_output_amounts, &val_amount, &data, MDB_APPENDDUP)))
       throw0(DB_ERROR(lmdb_error("Failed to add output pubkey to db transaction: ", result).c_str()));
+  if (m_has_explorer_index)
+    add_output_key(ok.data.pubkey, tx_output.amount, ok.amount_index);
 
   return ok.amount_index;
 }
@@ -1041,19 +1272,34 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
   check_open();
   mdb_txn_cursors *m_cursors = &m_wcursors;
   CURSOR(output_amounts);
+  CURSOR(rct_outputs);
   CURSOR(output_txs);
 
+  MDB_cursor *cur = amount == 0 ? m_cur_rct_outputs : m_cur_output_amounts;
   MDB_val_set(k, amount);
   MDB_val_set(v, out_index);
-
-  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+  int result;
+  if (amount == 0)
+  {
+    k = v;
+    result = mdb_cursor_get(cur, &k, &v, MDB_SET);
+  }
+  else
+  {
+    result = mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH);
+  }
   if (result == MDB_NOTFOUND)
     throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
   else if (result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to get an output", result).c_str()));
 
-  const pre_rct_outkey *ok = (const pre_rct_outkey *)v.mv_data;
-  MDB_val_set(otxk, ok->output_id);
+  const uint64_t output_id = amount == 0 ? ((const rct_outval *)v.mv_data)->output_id : ((const pre_rct_outkey *)v.mv_data)->output_id;
+  if (m_has_explorer_index)
+  {
+    const crypto::public_key pubkey = amount == 0 ? ((const rct_outval *)v.mv_data)->data.pubkey : ((const pre_rct_outkey *)v.mv_data)->data.pubkey;
+    remove_output_key(pubkey, amount, out_index);
+  }
+  MDB_val_set(otxk, output_id);
   result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &otxk, MDB_GET_BOTH);
   if (result == MDB_NOTFOUND)
   {
@@ -1068,11 +1314,87 @@ void BlockchainLMDB::remove_output(const uint64_t amount, const uint64_t& out_in
     throw0(DB_ERROR(lmdb_error(std::string("Error deleting output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
 
   // now delete the amount
-  result = mdb_cursor_del(m_cur_output_amounts, 0);
+  result = mdb_cursor_del(cur, 0);
   if (result)
     throw0(DB_ERROR(lmdb_error(std::string("Error deleting amount for output index ").append(boost::lexical_cast<std::string>(out_index).append(": ")).c_str(), result).c_str()));
 }
 
+void BlockchainLMDB::add_spent_key_txs(const crypto::hash& tx_hash, const transaction& tx)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(spent_key_txs)
+
+  for (const txin_v& tx_input: tx.vin)
+  {
+    if (tx_input.type() != typeid(txin_to_key))
+      continue;
+    const crypto::key_image &k_image = boost::get<txin_to_key>(tx_input).k_image;
+    MDB_val k = {sizeof(k_image), (void *)&k_image};
+    MDB_val v = {sizeof(tx_hash), (void *)&tx_hash};
+    if (auto result = mdb_cursor_put(m_cur_spent_key_txs, &k, &v, MDB_NOOVERWRITE))
+      throw1(DB_ERROR(lmdb_error("Error adding key image spender to db transaction: ", result).c_str()));
+  }
+}
+
+void BlockchainLMDB::remove_spent_key_txs(const transaction& tx)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(spent_key_txs)
+
+  for (const txin_v& tx_input: tx.vin)
+  {
+    if (tx_input.type() != typeid(txin_to_key))
+      continue;
+    const crypto::key_image &k_image = boost::get<txin_to_key>(tx_input).k_image;
+    MDB_val k = {sizeof(k_image), (void *)&k_image};
+    MDB_val v;
+    auto result = mdb_cursor_get(m_cur_spent_key_txs, &k, &v, MDB_SET);
+    if (result == MDB_NOTFOUND)
+      continue;
+    if (result)
+      throw1(DB_ERROR(lmdb_error("Error finding key image spender to remove: ", result).c_str()));
+    if ((result = mdb_cursor_del(m_cur_spent_key_txs, 0)))
+      throw1(DB_ERROR(lmdb_error("Error adding removal of key image spender to db transaction: ", result).c_str()));
+  }
+}
+
+void BlockchainLMDB::add_output_key(const crypto::public_key& key, uint64_t amount, uint64_t amount_index)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(output_keys)
+
+  const output_location_t location = {amount, amount_index};
+  MDB_val k = {sizeof(key), (void *)&key};
+  MDB_val v = {sizeof(location), (void *)&location};
+  if (auto result = mdb_cursor_put(m_cur_output_keys, &k, &v, MDB_NODUPDATA))
+    throw1(DB_ERROR(lmdb_error("Error adding output key location to db transaction: ", result).c_str()));
+}
+
+void BlockchainLMDB::remove_output_key(const crypto::public_key& key, uint64_t amount, uint64_t amount_index)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(output_keys)
+
+  const output_location_t location = {amount, amount_index};
+  MDB_val k = {sizeof(key), (void *)&key};
+  MDB_val v = {sizeof(location), (void *)&location};
+  auto result = mdb_cursor_get(m_cur_output_keys, &k, &v, MDB_GET_BOTH);
+  if (result == MDB_NOTFOUND)
+    return;
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error finding output key location to remove: ", result).c_str()));
+  if ((result = mdb_cursor_del(m_cur_output_keys, 0)))
+    throw1(DB_ERROR(lmdb_error("Error adding removal of output key location to db transaction: ", result).c_str()));
+}
+
 void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1088,6 +1410,42 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+
+  // added before the txn commits, and kept if it aborts, which only
+  // leaves a false positive behind
+  m_key_image_filter.insert(k_image);
+}
+
+void BlockchainLMDB::add_spent_keys(const std::vector<crypto::key_image>& k_images)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(spent_keys)
+
+  // key images land all over the table: putting them in its own order walks
+  // the tree once, left to right, rather than hopping between leaves
+  std::vector<const crypto::key_image*> sorted;
+  sorted.reserve(k_images.size());
+  for (const crypto::key_image &k_image: k_images)
+    sorted.push_back(&k_image);
+  std::sort(sorted.begin(), sorted.end(), [](const crypto::key_image *a, const crypto::key_image *b) {
+    const MDB_val va = {sizeof(*a), (void*)a}, vb = {sizeof(*b), (void*)b};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  for (const crypto::key_image *k_image: sorted)
+  {
+    MDB_val k = {sizeof(*k_image), (void *)k_image};
+    if (auto result = mdb_cursor_put(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_NODUPDATA)) {
+      if (result == MDB_KEYEXIST)
+        throw1(KEY_IMAGE_EXISTS("Attempting to add spent key image that's already in the db"));
+      else
+        throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
+    }
+    m_key_image_filter.insert(*k_image);
+  }
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -1122,9 +1480,7 @@ blobdata BlockchainLMDB::output_to_blob(const tx_out& output) const
 tx_out BlockchainLMDB::output_from_blob(const blobdata& blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  std::stringstream ss;
-  ss << blob;
-  binary_archive<false> ba(ss);
+  binary_archive<false> ba{epee::strspan<std::uint8_t>(blob)};
   tx_out o;
 
   if (!(::serialization::serialize(ba, o)))
@@ -1167,6 +1523,19 @@ BlockchainLMDB::BlockchainLMDB(bool batch_transactions): BlockchainDB()
   m_batch_active = false;
   m_cum_size = 0;
   m_cum_count = 0;
+  m_has_block_filters = false;
+  m_has_pow_hashes = false;
+  m_has_alt_blocks = false;
+  m_has_explorer_index = false;
+  m_db_flags = 0;
+  m_key_image_lookups = 0;
+  m_key_image_filtered = 0;
+  m_key_image_false_positives = 0;
+  m_cum_rct_txnid = 0;
+  m_cum_rct_pending_active = false;
+  m_cum_rct_pending_height = 0;
+  m_txpool_in_memory = false;
+  m_txpool_memory_dirty = false;
 
   // reset may also need changing when initialize things here
 
@@ -1213,6 +1582,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   }
 
   m_folder = filename;
+  m_db_flags = db_flags;
+  reset_cum_rct();
 
 #ifdef __OpenBSD__
   if ((mdb_flags & MDB_WRITEMAP) == 0) {
@@ -1223,7 +1594,7 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   // set up lmdb environment
   if ((result = mdb_env_create(&m_env)))
     throw0(DB_ERROR(lmdb_error("Failed to create lmdb environment: ", result).c_str()));
-  if ((result = mdb_env_set_maxdbs(m_env, 20)))
+  if ((result = mdb_env_set_maxdbs(m_env, 24)))
     throw0(DB_ERROR(lmdb_error("Failed to set max number of dbs: ", result).c_str()));
 
   int threads = tools::get_max_concurrency();
@@ -1258,6 +1629,24 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
     LOG_PRINT_L1("LMDB memory map size: " << cur_mapsize);
   }
 
+  // Map a large address range now, while no txn can be active: the file only
+  // grows as pages get written, so the map need not be resized later, which
+  // holds back every new txn until the running ones are done. Settle for a
+  // smaller range if the address space is limited (ulimit -v).
+  if (!(mdb_flags & MDB_RDONLY))
+  {
+    for (uint64_t reserve = RESERVED_MAPSIZE; reserve > cur_mapsize && reserve >= mapsize; reserve /= 2)
+    {
+      if (!mdb_env_set_mapsize(m_env, reserve))
+      {
+        mdb_env_info(m_env, &mei);
+        cur_mapsize = (double)mei.me_mapsize;
+        MGINFO("LMDB memory map reserved: " << cur_mapsize / (1024 * 1024) << " MiB");
+        break;
+      }
+    }
+  }
+
   if (need_resize())
   {
     LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
@@ -1280,6 +1669,22 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   lmdb_db_open(txn, LMDB_BLOCK_INFO, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for m_block_info");
   lmdb_db_open(txn, LMDB_BLOCK_HEIGHTS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for m_block_heights");
 
+  // added without a db version bump: blocks added by older versions have no
+  // filter, and a read-only db written only by older versions has no table
+  m_has_block_filters = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_BLOCK_FILTERS, MDB_INTEGERKEY | MDB_CREATE, m_block_filters, "Failed to open db handle for m_block_filters");
+  else if (mdb_dbi_open(txn, LMDB_BLOCK_FILTERS, MDB_INTEGERKEY, &m_block_filters))
+    m_has_block_filters = false;
+
+  // same for the PoW hash cache, which is keyed by block id and so also
+  // holds alt blocks; entries are never removed, they stay valid forever
+  m_has_pow_hashes = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_POW_HASHES, MDB_CREATE, m_pow_hashes, "Failed to open db handle for m_pow_hashes");
+  else if (mdb_dbi_open(txn, LMDB_POW_HASHES, 0, &m_pow_hashes))
+    m_has_pow_hashes = false;
+
   lmdb_db_open(txn, LMDB_TXS, MDB_INTEGERKEY | MDB_CREATE, m_txs, "Failed to open db handle for m_txs");
   lmdb_db_open(txn, LMDB_TXS_PRUNED, MDB_INTEGERKEY | MDB_CREATE, m_txs_pruned, "Failed to open db handle for m_txs_pruned");
   lmdb_db_open(txn, LMDB_TXS_PRUNABLE, MDB_INTEGERKEY | MDB_CREATE, m_txs_prunable, "Failed to open db handle for m_txs_prunable");
@@ -1289,12 +1694,35 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   lmdb_db_open(txn, LMDB_OUTPUT_TXS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_output_txs, "Failed to open db handle for m_output_txs");
   lmdb_db_open(txn, LMDB_OUTPUT_AMOUNTS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_CREATE, m_output_amounts, "Failed to open db handle for m_output_amounts");
+  lmdb_db_open(txn, LMDB_RCT_OUTPUTS, MDB_INTEGERKEY | MDB_CREATE, m_rct_outputs, "Failed to open db handle for m_rct_outputs");
 
   lmdb_db_open(txn, LMDB_SPENT_KEYS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_spent_keys, "Failed to open db handle for m_spent_keys");
 
+  // the explorer indexes are opt in: created when first asked for, and kept
+  // up to date whenever they exist. Blocks already in the db are indexed by
+  // build_explorer_index once the db is open
+  bool new_explorer_index = false;
+  m_has_explorer_index = !mdb_dbi_open(txn, LMDB_SPENT_KEY_TXS, 0, &m_spent_key_txs)
+      && !mdb_dbi_open(txn, LMDB_OUTPUT_KEYS, MDB_DUPSORT | MDB_DUPFIXED, &m_output_keys);
+  if (!m_has_explorer_index && (db_flags & DBF_EXPLORER_INDEX) && !(mdb_flags & MDB_RDONLY))
+  {
+    lmdb_db_open(txn, LMDB_SPENT_KEY_TXS, MDB_CREATE, m_spent_key_txs, "Failed to open db handle for m_spent_key_txs");
+    lmdb_db_open(txn, LMDB_OUTPUT_KEYS, MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_output_keys, "Failed to open db handle for m_output_keys");
+    m_has_explorer_index = true;
+    new_explorer_index = true;
+  }
+
   lmdb_db_open(txn, LMDB_TXPOOL_META, MDB_CREATE, m_txpool_meta, "Failed to open db handle for m_txpool_meta");
   lmdb_db_open(txn, LMDB_TXPOOL_BLOB, MDB_CREATE, m_txpool_blob, "Failed to open db handle for m_txpool_blob");
 
+  // alt blocks were kept in memory by older versions, so there may be no
+  // table in a read-only db
+  m_has_alt_blocks = true;
+  if (!(mdb_flags & MDB_RDONLY))
+    lmdb_db_open(txn, LMDB_ALT_BLOCKS, MDB_CREATE, m_alt_blocks, "Failed to open db handle for m_alt_blocks");
+  else if (mdb_dbi_open(txn, LMDB_ALT_BLOCKS, 0, &m_alt_blocks))
+    m_has_alt_blocks = false;
+
   // this subdb is dropped on sight, so it may not be present when we open the DB.
   // Since we use MDB_CREATE, we'll get an exception if we open read-only and it does not exist.
   // So we don't open for read-only, and also not drop below. It is not used elsewhere.
@@ -1314,6 +1742,15 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   mdb_set_compare(txn, m_txpool_meta, compare_hash32);
   mdb_set_compare(txn, m_txpool_blob, compare_hash32);
+  if (m_has_explorer_index)
+  {
+    mdb_set_compare(txn, m_spent_key_txs, compare_hash32);
+    mdb_set_compare(txn, m_output_keys, compare_hash32);
+  }
+  if (m_has_pow_hashes)
+    mdb_set_compare(txn, m_pow_hashes, compare_hash32);
+  if (m_has_alt_blocks)
+    mdb_set_compare(txn, m_alt_blocks, compare_hash32);
   mdb_set_compare(txn, m_properties, compare_string);
 
   if (!(mdb_flags & MDB_RDONLY))
@@ -1330,6 +1767,15 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   LOG_PRINT_L2("Setting m_height to: " << db_stats.ms_entries);
   uint64_t m_height = db_stats.ms_entries;
 
+  // progress marker for build_explorer_index, removed when it is done
+  if (new_explorer_index && m_height > 0)
+  {
+    MDB_val_copy<const char*> k("explorer_index_height");
+    MDB_val_copy<uint64_t> v(0);
+    if (auto put_result = mdb_put(txn, m_properties, &k, &v, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to write explorer index height: ", put_result).c_str()));
+  }
+
   bool compatible = true;
 
   MDB_val_copy<const char*> k("version");
@@ -1349,9 +1795,23 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
       // Note that there was a schema change within version 0 as well.
       // See commit e5d2680094ee15889934fe28901e4e133cda56f2 2015/07/10
       // We don't handle the old format previous to that commit.
+      if (mdb_flags & MDB_RDONLY)
+      {
+        txn.abort();
+        mdb_env_close(m_env);
+        m_open = false;
+        MFATAL("Existing lmdb database needs migrating from version " << db_version << " to " << VERSION << ", which cannot be done read only.");
+        MFATAL("Please open it read/write first, or wait for the daemon owning it to do so.");
+        return;
+      }
       txn.commit();
       m_open = true;
       migrate(db_version);
+      init_key_image_filter();
+      if (m_has_explorer_index)
+        build_explorer_index();
+      if (db_flags & DBF_TXPOOL_MEMORY)
+        load_txpool_memory();
       return;
     }
 #endif
@@ -1398,9 +1858,45 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+  // another process may add key images we would not see in the filter, so
+  // a read only db leaves it disabled and looks every key image up
+  if (!(mdb_flags & MDB_RDONLY))
+    init_key_image_filter();
+  else
+    m_key_image_filter.clear();
+  if (m_has_explorer_index && !(mdb_flags & MDB_RDONLY))
+    build_explorer_index();
+  // a read only db has no pool of its own to keep, it sees the snapshots
+  if ((db_flags & DBF_TXPOOL_MEMORY) && !(mdb_flags & MDB_RDONLY))
+    load_txpool_memory();
   // from here, init should be finished
 }
 
+bool BlockchainLMDB::txid_less::operator()(const crypto::hash &a, const crypto::hash &b) const
+{
+  const MDB_val va = {sizeof(a), (void*)&a}, vb = {sizeof(b), (void*)&b};
+  return compare_hash32(&va, &vb) < 0;
+}
+
+void BlockchainLMDB::load_txpool_memory()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  std::map<crypto::hash, txpool_memory_entry, txid_less> txes;
+  m_txpool_in_memory = false;
+  for_all_txpool_txes([&txes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+    txpool_memory_entry &e = txes[txid];
+    e.meta = meta;
+    e.blob = *bd;
+    return true;
+  }, true);
+
+  boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+  m_txpool_memory = std::move(txes);
+  m_txpool_memory_dirty = false;
+  m_txpool_in_memory = true;
+  MINFO("Keeping the txpool in memory, " << m_txpool_memory.size() << " txes loaded from the last snapshot");
+}
+
 void BlockchainLMDB::close()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -1409,12 +1905,21 @@ void BlockchainLMDB::close()
     LOG_PRINT_L3("close() first calling batch_abort() due to active batch transaction");
     batch_abort();
   }
+  if (m_txpool_in_memory)
+  {
+    try { snapshot_txpool(); }
+    catch (const std::exception &e) { MERROR("Failed to snapshot the txpool: " << e.what()); }
+    m_txpool_in_memory = false;
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    m_txpool_memory.clear();
+  }
   this->sync();
   m_tinfo.reset();
 
   // FIXME: not yet thread safe!!!  Use with care.
   mdb_env_close(m_env);
   m_open = false;
+  reset_cum_rct();
 }
 
 void BlockchainLMDB::sync()
@@ -1454,6 +1959,12 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_info: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_block_heights, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_block_heights: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_block_filters, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_block_filters: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_pow_hashes, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_pow_hashes: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_alt_blocks, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_alt_blocks: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_pruned, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_txs_pruned: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_txs_prunable, 0))
@@ -1468,8 +1979,17 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_output_txs: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_output_amounts, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_output_amounts: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_rct_outputs, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_rct_outputs: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_spent_keys, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_spent_keys: ", result).c_str()));
+  if (m_has_explorer_index)
+  {
+    if (auto result = mdb_drop(txn, m_spent_key_txs, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to drop m_spent_key_txs: ", result).c_str()));
+    if (auto result = mdb_drop(txn, m_output_keys, 0))
+      throw0(DB_ERROR(lmdb_error("Failed to drop m_output_keys: ", result).c_str()));
+  }
   (void)mdb_drop(txn, m_hf_starting_heights, 0); // this one is dropped in new code
   if (auto result = mdb_drop(txn, m_hf_versions, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_hf_versions: ", result).c_str()));
@@ -1482,9 +2002,14 @@ void BlockchainLMDB::reset()
   if (auto result = mdb_put(txn, m_properties, &k, &v, 0))
     throw0(DB_ERROR(lmdb_error("Failed to write version to database: ", result).c_str()));
 
-  txn.commit();
+  // all blocks are gone
+  m_cum_rct_pending_active = true;
+  m_cum_rct_pending_height = 0;
+  m_cum_rct_pending.clear();
+  commit_block_changes(txn);
   m_cum_size = 0;
   m_cum_count = 0;
+  m_key_image_filter.reset(0);
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -1596,6 +2121,21 @@ void BlockchainLMDB::add_txpool_tx(const transaction &tx, const txpool_tx_meta_t
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+
+  if (m_txpool_in_memory)
+  {
+    const crypto::hash txid = get_transaction_hash(tx);
+    cryptonote::blobdata blob = tx_to_blob(tx);
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    auto ins = m_txpool_memory.emplace(txid, txpool_memory_entry());
+    if (!ins.second)
+      throw1(DB_ERROR("Attempting to add txpool tx metadata that's already in the db"));
+    ins.first->second.meta = meta;
+    ins.first->second.blob = std::move(blob);
+    m_txpool_memory_dirty = true;
+    return;
+  }
+
   mdb_txn_cursors *m_cursors = &m_wcursors;
 
   CURSOR(txpool_meta)
@@ -1624,6 +2164,18 @@ void BlockchainLMDB::update_txpool_tx(const crypto::hash &txid, const txpool_tx_
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+
+  if (m_txpool_in_memory)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    auto it = m_txpool_memory.find(txid);
+    if (it == m_txpool_memory.end())
+      throw1(DB_ERROR("Error finding txpool tx meta to update"));
+    it->second.meta = meta;
+    m_txpool_memory_dirty = true;
+    return;
+  }
+
   mdb_txn_cursors *m_cursors = &m_wcursors;
 
   CURSOR(txpool_meta)
@@ -1654,6 +2206,17 @@ uint64_t BlockchainLMDB::get_txpool_tx_count(bool include_unrelayed_txes) const
   int result;
   uint64_t num_entries = 0;
 
+  if (m_txpool_in_memory)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    if (include_unrelayed_txes)
+      return m_txpool_memory.size();
+    for (const auto &e: m_txpool_memory)
+      if (!e.second.meta.do_not_relay)
+        ++num_entries;
+    return num_entries;
+  }
+
   TXN_PREFIX_RDONLY();
 
   if (include_unrelayed_txes)
@@ -1696,6 +2259,12 @@ bool BlockchainLMDB::txpool_has_tx(const crypto::hash& txid) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (m_txpool_in_memory)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    return m_txpool_memory.find(txid) != m_txpool_memory.end();
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(txpool_meta)
 
@@ -1711,6 +2280,15 @@ void BlockchainLMDB::remove_txpool_tx(const crypto::hash& txid)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+
+  if (m_txpool_in_memory)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    if (m_txpool_memory.erase(txid))
+      m_txpool_memory_dirty = true;
+    return;
+  }
+
   mdb_txn_cursors *m_cursors = &m_wcursors;
 
   CURSOR(txpool_meta)
@@ -1742,6 +2320,16 @@ bool BlockchainLMDB::get_txpool_tx_meta(const crypto::hash& txid, txpool_tx_meta
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (m_txpool_in_memory)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    auto it = m_txpool_memory.find(txid);
+    if (it == m_txpool_memory.end())
+      return false;
+    meta = it->second.meta;
+    return true;
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(txpool_meta)
 
@@ -1763,6 +2351,16 @@ bool BlockchainLMDB::get_txpool_tx_blob(const crypto::hash& txid, cryptonote::bl
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (m_txpool_in_memory)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    auto it = m_txpool_memory.find(txid);
+    if (it == m_txpool_memory.end())
+      return false;
+    bd = it->second.blob;
+    return true;
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(txpool_blob)
 
@@ -1792,6 +2390,29 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&,
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (m_txpool_in_memory)
+  {
+    // f may call back into the txpool functions, so it runs on a copy
+    std::vector<std::pair<crypto::hash, txpool_memory_entry>> txes;
+    {
+      boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+      txes.reserve(m_txpool_memory.size());
+      for (const auto &e: m_txpool_memory)
+      {
+        if (!include_unrelayed_txes && e.second.meta.do_not_relay)
+          continue;
+        txes.push_back(std::make_pair(e.first, txpool_memory_entry()));
+        txes.back().second.meta = e.second.meta;
+        if (include_blob)
+          txes.back().second.blob = e.second.blob;
+      }
+    }
+    for (const auto &e: txes)
+      if (!f(e.first, e.second.meta, include_blob ? &e.second.blob : NULL))
+        return false;
+    return true;
+  }
+
   TXN_PREFIX_RDONLY();
   RCURSOR(txpool_meta);
   RCURSOR(txpool_blob);
@@ -1839,2215 +2460,4039 @@ bool BlockchainLMDB::for_all_txpool_txes(std::function<bool(const crypto::hash&,
   return ret;
 }
 
-bool BlockchainLMDB::block_exists(const crypto::hash& h, uint64_t *height) const
+bool BlockchainLMDB::snapshot_txpool()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(block_heights);
+  if (!m_txpool_in_memory)
+    return false;
 
-  bool ret = false;
-  MDB_val_set(key, h);
-  auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
+  std::vector<std::pair<crypto::hash, txpool_memory_entry>> txes;
   {
-    LOG_PRINT_L3("Block with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    if (!m_txpool_memory_dirty)
+      return true;
+    txes.assign(m_txpool_memory.begin(), m_txpool_memory.end());
+    m_txpool_memory_dirty = false;
   }
-  else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch block index from hash", get_result).c_str()));
-  else
+
+  try
   {
-    if (height)
+    TXN_BLOCK_PREFIX(0);
+
+    int result = mdb_drop(*txn_ptr, m_txpool_meta, 0);
+    if (result)
+      throw1(DB_ERROR(lmdb_error("Error dropping txpool tx metadata: ", result).c_str()));
+    result = mdb_drop(*txn_ptr, m_txpool_blob, 0);
+    if (result)
+      throw1(DB_ERROR(lmdb_error("Error dropping txpool tx blobs: ", result).c_str()));
+
+    // in txid order, as the tables are sorted
+    for (const auto &e: txes)
     {
-      const blk_height *bhp = (const blk_height *)key.mv_data;
-      *height = bhp->bh_height;
+      MDB_val k = {sizeof(e.first), (void *)&e.first};
+      MDB_val v = {sizeof(e.second.meta), (void *)&e.second.meta};
+      if ((result = mdb_put(*txn_ptr, m_txpool_meta, &k, &v, MDB_APPEND)))
+        throw1(DB_ERROR(lmdb_error("Error adding txpool tx metadata to db transaction: ", result).c_str()));
+      MDB_val b = {e.second.blob.size(), (void *)e.second.blob.data()};
+      if ((result = mdb_put(*txn_ptr, m_txpool_blob, &k, &b, MDB_APPEND)))
+        throw1(DB_ERROR(lmdb_error("Error adding txpool tx blob to db transaction: ", result).c_str()));
     }
-    ret = true;
+
+    TXN_BLOCK_POSTFIX_SUCCESS();
+  }
+  catch (...)
+  {
+    boost::unique_lock<boost::mutex> lock(m_txpool_memory_lock);
+    m_txpool_memory_dirty = true;
+    throw;
   }
 
-  TXN_POSTFIX_RDONLY();
-  return ret;
+  MDEBUG("Snapshotted " << txes.size() << " txpool txes");
+  return true;
 }
 
-cryptonote::blobdata BlockchainLMDB::get_block_blob(const crypto::hash& h) const
+void BlockchainLMDB::add_alt_block(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata &blob)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
 
-  return get_block_blob_from_height(get_block_height(h));
+  CURSOR(alt_blocks)
+
+  MDB_val k = {sizeof(blkid), (void *)&blkid};
+  const size_t val_size = sizeof(alt_block_data_t) + blob.size();
+  MDB_val v = {val_size, NULL};
+  // reserve the space and write it in place rather than staging a copy
+  int result = mdb_cursor_put(m_cur_alt_blocks, &k, &v, MDB_NOOVERWRITE | MDB_RESERVE);
+  if (result == MDB_KEYEXIST)
+    throw1(DB_ERROR("Attempting to add alternate block that's already in the db"));
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error adding alternate block to db transaction: ", result).c_str()));
+  memcpy(v.mv_data, &data, sizeof(data));
+  memcpy((char*)v.mv_data + sizeof(data), blob.data(), blob.size());
 }
 
-uint64_t BlockchainLMDB::get_block_height(const crypto::hash& h) const
+bool BlockchainLMDB::get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  if (!m_has_alt_blocks)
+    return false;
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_heights);
+  RCURSOR(alt_blocks);
 
-  MDB_val_set(key, h);
-  auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
-    throw1(BLOCK_DNE("Attempted to retrieve non-existent block height"));
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a block height from the db"));
+  MDB_val k = {sizeof(blkid), (void *)&blkid};
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_alt_blocks, &k, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve alternate block " + epee::string_tools::pod_to_hex(blkid) + " from the db: ", result).c_str()));
+  if (v.mv_size < sizeof(alt_block_data_t))
+    throw0(DB_ERROR("Record size is less than expected"));
+
+  if (data)
+    memcpy(data, v.mv_data, sizeof(alt_block_data_t));
+  if (blob)
+    blob->assign((const char*)v.mv_data + sizeof(alt_block_data_t), v.mv_size - sizeof(alt_block_data_t));
 
-  blk_height *bhp = (blk_height *)key.mv_data;
-  uint64_t ret = bhp->bh_height;
   TXN_POSTFIX_RDONLY();
-  return ret;
+  return true;
 }
 
-block_header BlockchainLMDB::get_block_header(const crypto::hash& h) const
+void BlockchainLMDB::remove_alt_block(const crypto::hash &blkid)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
 
-  // block_header object is automatically cast from block object
-  return get_block(h);
+  CURSOR(alt_blocks)
+
+  MDB_val k = {sizeof(blkid), (void *)&blkid};
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_alt_blocks, &k, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error locating alternate block " + epee::string_tools::pod_to_hex(blkid) + " in the db: ", result).c_str()));
+  result = mdb_cursor_del(m_cur_alt_blocks, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error deleting alternate block " + epee::string_tools::pod_to_hex(blkid) + " from the db: ", result).c_str()));
 }
 
-cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t& height) const
+uint64_t BlockchainLMDB::get_alt_block_count()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  if (!m_has_alt_blocks)
+    return 0;
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(blocks);
-
-  MDB_val_copy<uint64_t> key(height);
-  MDB_val result;
-  auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
-  if (get_result == MDB_NOTFOUND)
-  {
-    throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
-  blobdata bd;
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+  MDB_stat db_stats;
+  int result = mdb_stat(m_txn, m_alt_blocks, &db_stats);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to query m_alt_blocks: ", result).c_str()));
 
   TXN_POSTFIX_RDONLY();
-
-  return bd;
+  return db_stats.ms_entries;
 }
 
-uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
+void BlockchainLMDB::drop_alt_blocks()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
+  TXN_BLOCK_PREFIX(0);
 
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
-  {
-    throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
-  }
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a timestamp from the db"));
+  auto result = mdb_drop(*txn_ptr, m_alt_blocks, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error dropping alternative blocks: ", result).c_str()));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  uint64_t ret = bi->bi_timestamp;
-  TXN_POSTFIX_RDONLY();
-  return ret;
+  TXN_BLOCK_POSTFIX_SUCCESS();
 }
 
-std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const
+bool BlockchainLMDB::for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata *blob)> f, bool include_blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  std::vector<uint64_t> res;
-  int result;
-
-  if (heights.empty())
-    return {};
-  res.reserve(heights.size());
+  if (!m_has_alt_blocks)
+    return true;
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
-
-  MDB_stat db_stats;
-  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
-    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
-  for (size_t i = 0; i < heights.size(); ++i)
-    if (heights[i] >= db_stats.ms_entries)
-      throw0(BLOCK_DNE(std::string("Attempt to get rct distribution from height " + std::to_string(heights[i]) + " failed -- block size not in db").c_str()));
+  RCURSOR(alt_blocks);
 
+  MDB_val k;
   MDB_val v;
+  bool ret = true;
 
-  uint64_t prev_height = heights[0];
-  for (uint64_t height: heights)
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
   {
-    if (height == prev_height + 1)
+    int result = mdb_cursor_get(m_cur_alt_blocks, &k, &v, op);
+    op = MDB_NEXT;
+    if (result == MDB_NOTFOUND)
+      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate alternate blocks: ", result).c_str()));
+    const crypto::hash &blkid = *(const crypto::hash*)k.mv_data;
+    if (v.mv_size < sizeof(alt_block_data_t))
+      throw0(DB_ERROR("alt_blocks record is too small"));
+    // the value may not be aligned, so copy the chain data out
+    alt_block_data_t data;
+    memcpy(&data, v.mv_data, sizeof(data));
+    const cryptonote::blobdata *passed_bd = NULL;
+    cryptonote::blobdata bd;
+    if (include_blob)
     {
-      MDB_val k2;
-      result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT);
+      bd.assign((const char*)v.mv_data + sizeof(alt_block_data_t), v.mv_size - sizeof(alt_block_data_t));
+      passed_bd = &bd;
     }
-    else
+
+    if (!f(blkid, data, passed_bd))
     {
-      v.mv_size = sizeof(uint64_t);
-      v.mv_data = (void*)&height;
-      result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+      ret = false;
+      break;
     }
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve rct distribution from the db: ", result).c_str()));
-    const mdb_block_info *bi = (const mdb_block_info *)v.mv_data;
-    res.push_back(bi->bi_cum_rct);
-    prev_height = height;
   }
 
   TXN_POSTFIX_RDONLY();
-  return res;
-}
-
-uint64_t BlockchainLMDB::get_top_block_timestamp() const
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-  uint64_t m_height = height();
-
-  // if no blocks, return 0
-  if (m_height == 0)
-  {
-    return 0;
-  }
 
-  return get_block_timestamp(m_height - 1);
+  return ret;
 }
 
-size_t BlockchainLMDB::get_block_weight(const uint64_t& height) const
+bool BlockchainLMDB::block_exists(const crypto::hash& h, uint64_t *height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
+  RCURSOR(block_heights);
 
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  bool ret = false;
+  MDB_val_set(key, h);
+  auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
-    throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
+    LOG_PRINT_L3("Block with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
   }
   else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a block size from the db"));
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch block index from hash", get_result).c_str()));
+  else
+  {
+    if (height)
+    {
+      const blk_height *bhp = (const blk_height *)key.mv_data;
+      *height = bhp->bh_height;
+    }
+    ret = true;
+  }
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  size_t ret = bi->bi_weight;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
-difficulty_type BlockchainLMDB::get_block_cumulative_difficulty(const uint64_t& height) const
+cryptonote::blobdata BlockchainLMDB::get_block_blob(const crypto::hash& h) const
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__ << "  height: " << height);
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  return get_block_blob_from_height(get_block_height(h));
+}
+
+uint64_t BlockchainLMDB::get_block_height(const crypto::hash& h) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
+  RCURSOR(block_heights);
 
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  MDB_val_set(key, h);
+  auto get_result = mdb_cursor_get(m_cur_block_heights, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
-  {
-    throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
-  }
+    throw1(BLOCK_DNE("Attempted to retrieve non-existent block height"));
   else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a cumulative difficulty from the db"));
+    throw0(DB_ERROR("Error attempting to retrieve a block height from the db"));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  difficulty_type ret = bi->bi_diff;
+  blk_height *bhp = (blk_height *)key.mv_data;
+  uint64_t ret = bhp->bh_height;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
-difficulty_type BlockchainLMDB::get_block_difficulty(const uint64_t& height) const
+block_header BlockchainLMDB::get_block_header(const crypto::hash& h) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  difficulty_type diff1 = 0;
-  difficulty_type diff2 = 0;
-
-  diff1 = get_block_cumulative_difficulty(height);
-  if (height != 0)
-  {
-    diff2 = get_block_cumulative_difficulty(height - 1);
-  }
-
-  return diff1 - diff2;
+  // block_header object is automatically cast from block object
+  return get_block(h);
 }
 
-uint64_t BlockchainLMDB::get_block_already_generated_coins(const uint64_t& height) const
+bool BlockchainLMDB::get_block_filter(uint64_t height, cryptonote::blobdata& filter) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  if (!m_has_block_filters)
+    return false;
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
+  RCURSOR(block_filters);
 
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  MDB_val_copy<uint64_t> key(height);
+  MDB_val result;
+  auto get_result = mdb_cursor_get(m_cur_block_filters, &key, &result, MDB_SET);
   if (get_result == MDB_NOTFOUND)
-  {
-    throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
-  }
+    return false;
   else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve a total generated coins from the db"));
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block filter from the db: ", get_result).c_str()));
+
+  filter.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  uint64_t ret = bi->bi_coins;
   TXN_POSTFIX_RDONLY();
-  return ret;
+
+  return true;
 }
 
-crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t& height) const
+bool BlockchainLMDB::get_pow_hash(const crypto::hash& blk_hash, crypto::hash& pow_hash) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  if (!m_has_pow_hashes)
+    return false;
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(block_info);
+  RCURSOR(pow_hashes);
 
-  MDB_val_set(result, height);
-  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  MDB_val k = {sizeof(blk_hash), (void *)&blk_hash};
+  MDB_val v;
+  auto get_result = mdb_cursor_get(m_cur_pow_hashes, &k, &v, MDB_SET);
   if (get_result == MDB_NOTFOUND)
-  {
-    throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
-  }
+    return false;
   else if (get_result)
-    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block hash from the db: ", get_result).c_str()));
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a PoW hash from the db: ", get_result).c_str()));
+  if (v.mv_size != sizeof(pow_hash))
+    throw0(DB_ERROR("PoW hash in the db has an unexpected size"));
+
+  memcpy(&pow_hash, v.mv_data, sizeof(pow_hash));
 
-  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
-  crypto::hash ret = bi->bi_hash;
   TXN_POSTFIX_RDONLY();
-  return ret;
+
+  return true;
 }
 
-std::vector<block> BlockchainLMDB::get_blocks_range(const uint64_t& h1, const uint64_t& h2) const
+bool BlockchainLMDB::has_explorer_index() const
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-  std::vector<block> v;
-
-  for (uint64_t height = h1; height <= h2; ++height)
-  {
-    v.push_back(get_block_from_height(height));
-  }
-
-  return v;
+  return m_has_explorer_index;
 }
 
-std::vector<crypto::hash> BlockchainLMDB::get_hashes_range(const uint64_t& h1, const uint64_t& h2) const
+bool BlockchainLMDB::get_key_image_spender(const crypto::key_image& k_image, crypto::hash& tx_hash) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  std::vector<crypto::hash> v;
+  if (!m_has_explorer_index)
+    return false;
 
-  for (uint64_t height = h1; height <= h2; ++height)
-  {
-    v.push_back(get_block_hash_from_height(height));
-  }
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_key_txs);
 
-  return v;
+  MDB_val k = {sizeof(k_image), (void *)&k_image};
+  MDB_val v;
+  auto get_result = mdb_cursor_get(m_cur_spent_key_txs, &k, &v, MDB_SET);
+  if (get_result == MDB_NOTFOUND)
+    return false;
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a key image spender from the db: ", get_result).c_str()));
+  if (v.mv_size != sizeof(tx_hash))
+    throw0(DB_ERROR("Key image spender in the db has an unexpected size"));
+
+  memcpy(&tx_hash, v.mv_data, sizeof(tx_hash));
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
 }
 
-crypto::hash BlockchainLMDB::top_block_hash() const
+bool BlockchainLMDB::get_output_locations(const crypto::public_key& key, std::vector<output_location_t>& locations) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  uint64_t m_height = height();
-  if (m_height != 0)
+  locations.clear();
+  if (!m_has_explorer_index)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_keys);
+
+  MDB_val k = {sizeof(key), (void *)&key};
+  MDB_val v;
+  auto get_result = mdb_cursor_get(m_cur_output_keys, &k, &v, MDB_SET);
+  while (get_result == 0)
   {
-    return get_block_hash_from_height(m_height - 1);
+    if (v.mv_size != sizeof(output_location_t))
+      throw0(DB_ERROR("Output key location in the db has an unexpected size"));
+    output_location_t location;
+    memcpy(&location, v.mv_data, sizeof(location));
+    locations.push_back(location);
+    get_result = mdb_cursor_get(m_cur_output_keys, &k, &v, MDB_NEXT_DUP);
   }
+  if (get_result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve output key locations from the db: ", get_result).c_str()));
 
-  return null_hash;
+  TXN_POSTFIX_RDONLY();
+
+  return !locations.empty();
 }
 
-block BlockchainLMDB::get_top_block() const
+void BlockchainLMDB::build_explorer_index()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-  uint64_t m_height = height();
 
-  if (m_height != 0)
+  uint64_t start_height;
   {
-    return get_block_from_height(m_height - 1);
+    TXN_PREFIX_RDONLY();
+    MDB_val_copy<const char*> k("explorer_index_height");
+    MDB_val v;
+    auto get_result = mdb_get(m_txn, m_properties, &k, &v);
+    if (get_result == MDB_NOTFOUND)
+      return;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Failed to read explorer index height: ", get_result).c_str()));
+    start_height = *(const uint64_t*)v.mv_data;
+    TXN_POSTFIX_RDONLY();
   }
 
-  block b;
-  return b;
-}
+  const uint64_t end_height = height();
+  MGINFO("Adding blocks " << start_height << " to " << end_height << " to the explorer indexes, this may take a while");
 
-uint64_t BlockchainLMDB::height() const
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-  TXN_PREFIX_RDONLY();
-  int result;
+  // each chunk is committed together with the progress marker, so an
+  // interrupted run carries on from where it stopped, with no duplicates
+  const bool batch_transactions = m_batch_transactions;
+  m_batch_transactions = true;
+  auto restore = epee::misc_utils::create_scope_leave_handler([&](){ m_batch_transactions = batch_transactions; });
+  static const uint64_t chunk_blocks = 1000;
+  for (uint64_t h = start_height; h < end_height; )
+  {
+    const uint64_t chunk_end = std::min(end_height, h + chunk_blocks);
+    batch_start(chunk_end - h);
+    try
+    {
+      for (; h < chunk_end; ++h)
+      {
+        const block b = get_block_from_height(h);
+        std::vector<std::pair<crypto::hash, transaction>> txs;
+        txs.reserve(b.tx_hashes.size() + 1);
+        txs.push_back({get_transaction_hash(b.miner_tx), b.miner_tx});
+        for (const crypto::hash &tx_hash: b.tx_hashes)
+        {
+          txs.push_back({tx_hash, transaction()});
+          if (!get_pruned_tx(tx_hash, txs.back().second))
+            throw0(DB_ERROR("Failed to get a transaction to add to the explorer indexes"));
+        }
+        for (const auto &e: txs)
+        {
+          const transaction &tx = e.second;
+          uint64_t tx_id;
+          if (!tx_exists(e.first, tx_id))
+            throw0(DB_ERROR("Failed to get a transaction id to add to the explorer indexes"));
+          add_spent_key_txs(e.first, tx);
+          const std::vector<uint64_t> amount_output_indices = get_tx_amount_output_indices(tx_id);
+          if (amount_output_indices.size() != tx.vout.size())
+            throw0(DB_ERROR("Unexpected number of output indices while adding to the explorer indexes"));
+          const bool is_pseudo_rct = tx.version >= 2 && tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
+          for (size_t i = 0; i < tx.vout.size(); ++i)
+          {
+            if (tx.vout[i].target.type() != typeid(txout_to_key))
+              continue;
+            const uint64_t amount = is_pseudo_rct ? 0 : tx.vout[i].amount;
+            add_output_key(boost::get<txout_to_key>(tx.vout[i].target).key, amount, amount_output_indices[i]);
+          }
+        }
+      }
 
-  // get current height
-  MDB_stat db_stats;
-  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
-    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
-  return db_stats.ms_entries;
+      MDB_val_copy<const char*> k("explorer_index_height");
+      int result;
+      if (h < end_height)
+      {
+        MDB_val_copy<uint64_t> v(h);
+        result = mdb_put(*m_write_txn, m_properties, &k, &v, 0);
+      }
+      else
+      {
+        result = mdb_del(*m_write_txn, m_properties, &k, NULL);
+      }
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to update explorer index height: ", result).c_str()));
+    }
+    catch (...)
+    {
+      batch_abort();
+      throw;
+    }
+    batch_stop();
+    MINFO("Explorer indexes built up to height " << h << " / " << end_height);
+  }
+  MGINFO("Explorer indexes are up to date");
 }
 
-uint64_t BlockchainLMDB::num_outputs() const
+void BlockchainLMDB::add_pow_hash(const crypto::hash& blk_hash, const crypto::hash& pow_hash)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  TXN_PREFIX_RDONLY();
-  int result;
+  mdb_txn_cursors *m_cursors = &m_wcursors;
 
-  // get current height
-  MDB_stat db_stats;
-  if ((result = mdb_stat(m_txn, m_output_txs, &db_stats)))
-    throw0(DB_ERROR(lmdb_error("Failed to query m_output_txs: ", result).c_str()));
-  return db_stats.ms_entries;
+  CURSOR(pow_hashes)
+
+  MDB_val k = {sizeof(blk_hash), (void *)&blk_hash};
+  MDB_val v = {sizeof(pow_hash), (void *)&pow_hash};
+  // a block's PoW hash never changes, so an existing entry is left alone
+  int result = mdb_cursor_put(m_cur_pow_hashes, &k, &v, MDB_NOOVERWRITE);
+  if (result && result != MDB_KEYEXIST)
+    throw0(DB_ERROR(lmdb_error("Failed to add PoW hash to db transaction: ", result).c_str()));
 }
 
-bool BlockchainLMDB::tx_exists(const crypto::hash& h) const
+cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
-
-  MDB_val_set(key, h);
-  bool tx_found = false;
+  RCURSOR(blocks);
 
-  TIME_MEASURE_START(time1);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
-  if (get_result == 0)
-    tx_found = true;
-  else if (get_result != MDB_NOTFOUND)
-    throw0(DB_ERROR(lmdb_error(std::string("DB error attempting to fetch transaction index from hash ") + epee::string_tools::pod_to_hex(h) + ": ", get_result).c_str()));
+  MDB_val_copy<uint64_t> key(height);
+  MDB_val result;
+  auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
+  if (get_result == MDB_NOTFOUND)
+  {
+    throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+  }
+  else if (get_result)
+    throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
-  TIME_MEASURE_FINISH(time1);
-  time_tx_exists += time1;
+  blobdata bd;
+  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
 
   TXN_POSTFIX_RDONLY();
 
-  if (! tx_found)
-  {
-    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
-    return false;
-  }
-
-  return true;
+  return bd;
 }
 
-bool BlockchainLMDB::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
+bool BlockchainLMDB::get_block_blob_view(uint64_t height, epee::span<const uint8_t>& blob) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
-
-  MDB_val_set(v, h);
-
-  TIME_MEASURE_START(time1);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-  TIME_MEASURE_FINISH(time1);
-  time_tx_exists += time1;
-  if (!get_result) {
-    txindex *tip = (txindex *)v.mv_data;
-    tx_id = tip->data.tx_id;
-  }
-
-  TXN_POSTFIX_RDONLY();
+  // the view would not outlive a txn we start here
+  if (my_rtxn)
+    throw0(DB_ERROR("A block blob view needs a read txn held by the caller"));
+  RCURSOR(blocks);
 
-  bool ret = false;
+  MDB_val_copy<uint64_t> key(height);
+  MDB_val result;
+  auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
   if (get_result == MDB_NOTFOUND)
   {
-    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
   }
   else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch transaction from hash", get_result).c_str()));
-  else
-    ret = true;
+    throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
 
-  return ret;
+  blob = epee::span<const uint8_t>(reinterpret_cast<const uint8_t*>(result.mv_data), result.mv_size);
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
 }
 
-uint64_t BlockchainLMDB::get_tx_unlock_time(const crypto::hash& h) const
+uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
+  RCURSOR(block_info);
 
-  MDB_val_set(v, h);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
-    throw1(TX_DNE(lmdb_error(std::string("tx data with hash ") + epee::string_tools::pod_to_hex(h) + " not found in db: ", get_result).c_str()));
+  {
+    throw0(BLOCK_DNE(std::string("Attempt to get timestamp from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- timestamp not in db").c_str()));
+  }
   else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx data from hash: ", get_result).c_str()));
+    throw0(DB_ERROR("Error attempting to retrieve a timestamp from the db"));
 
-  txindex *tip = (txindex *)v.mv_data;
-  uint64_t ret = tip->data.unlock_time;
+  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
+  uint64_t ret = bi->bi_timestamp;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
-bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  std::vector<uint64_t> res;
+  int result;
+
+  if (heights.empty())
+    return {};
+  res.reserve(heights.size());
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
-  RCURSOR(txs_pruned);
-  RCURSOR(txs_prunable);
+  RCURSOR(block_info);
 
-  MDB_val_set(v, h);
-  MDB_val result0, result1;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-  if (get_result == 0)
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  for (size_t i = 0; i < heights.size(); ++i)
+    if (heights[i] >= db_stats.ms_entries)
+      throw0(BLOCK_DNE(std::string("Attempt to get rct distribution from height " + std::to_string(heights[i]) + " failed -- block size not in db").c_str()));
+
+  MDB_val v;
+
+  uint64_t prev_height = heights[0];
+  for (uint64_t height: heights)
   {
-    txindex *tip = (txindex *)v.mv_data;
-    MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
-    if (get_result == 0)
+    if (height == prev_height + 1)
     {
-      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+      MDB_val k2;
+      result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT);
+    }
+    else
+    {
+      v.mv_size = sizeof(uint64_t);
+      v.mv_data = (void*)&height;
+      result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
     }
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve rct distribution from the db: ", result).c_str()));
+    const mdb_block_info *bi = (const mdb_block_info *)v.mv_data;
+    res.push_back(bi->bi_cum_rct);
+    prev_height = height;
   }
-  if (get_result == MDB_NOTFOUND)
-    return false;
-  else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
-
-  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
-  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
 
   TXN_POSTFIX_RDONLY();
-
-  return true;
+  return res;
 }
 
-bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
+std::vector<uint64_t> BlockchainLMDB::get_block_cumulative_rct_outputs_range(uint64_t from_height, uint64_t to_height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  int result;
+
+  if (to_height < from_height)
+    return {};
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
-  RCURSOR(txs_pruned);
+  RCURSOR(block_info);
 
-  MDB_val_set(v, h);
-  MDB_val result;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-  if (get_result == 0)
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  if (to_height >= db_stats.ms_entries)
+    throw0(BLOCK_DNE(std::string("Attempt to get rct distribution from height " + std::to_string(to_height) + " failed -- block size not in db").c_str()));
+
+  // the writer sees its own uncommitted blocks, which the cache does not have,
+  // and a read only db may have blocks popped by another process
+  const bool use_cache = !(m_write_txn && m_writer == boost::this_thread::get_id()) && !(m_db_flags & DBF_RDONLY);
+  std::vector<uint64_t> res;
+  uint64_t cached = 0;
+  if (use_cache)
   {
-    txindex *tip = (txindex *)v.mv_data;
-    MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result, MDB_SET);
+    boost::lock_guard<boost::mutex> lock(m_cum_rct_lock);
+    if (m_cum_rct.size() > to_height)
+      return std::vector<uint64_t>(m_cum_rct.begin() + from_height, m_cum_rct.begin() + to_height + 1);
+    cached = m_cum_rct.size();
+    if (cached > from_height)
+      res.assign(m_cum_rct.begin() + from_height, m_cum_rct.end());
   }
-  if (get_result == MDB_NOTFOUND)
-    return false;
-  else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
-
-  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
 
-  TXN_POSTFIX_RDONLY();
-
-  return true;
-}
-
-bool BlockchainLMDB::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-
-  TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
-  RCURSOR(txs_prunable_hash);
-
-  MDB_val_set(v, tx_hash);
-  MDB_val result, val_tx_prunable_hash;
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-  if (get_result == 0)
+  // read up to the top when filling the cache, so the next request is a copy
+  const uint64_t start = use_cache ? cached : from_height;
+  const uint64_t end = use_cache ? db_stats.ms_entries : to_height + 1;
+  std::vector<uint64_t> tail;
+  tail.reserve(end - start);
+  MDB_val v;
+  uint64_t height = start;
+  v.mv_size = sizeof(uint64_t);
+  v.mv_data = (void*)&height;
+  result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  for (height = start; height < end; ++height)
   {
-    txindex *tip = (txindex *)v.mv_data;
-    MDB_val_set(val_tx_id, tip->data.tx_id);
-    get_result = mdb_cursor_get(m_cur_txs_prunable_hash, &val_tx_id, &result, MDB_SET);
+    if (height > start)
+    {
+      MDB_val k2;
+      result = mdb_cursor_get(m_cur_block_info, &k2, &v, MDB_NEXT);
+    }
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve rct distribution from the db: ", result).c_str()));
+    tail.push_back(((const mdb_block_info *)v.mv_data)->bi_cum_rct);
   }
-  if (get_result == MDB_NOTFOUND)
-    return false;
-  else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx prunable hash from tx hash", get_result).c_str()));
 
-  prunable_hash = *(const crypto::hash*)result.mv_data;
+  if (use_cache)
+  {
+    // only a snapshot including every change applied to the cache may extend it
+    boost::lock_guard<boost::mutex> lock(m_cum_rct_lock);
+    if (mdb_txn_id(m_txn) >= m_cum_rct_txnid && m_cum_rct.size() == cached)
+      m_cum_rct.insert(m_cum_rct.end(), tail.begin(), tail.end());
+  }
 
   TXN_POSTFIX_RDONLY();
 
-  return true;
+  if (from_height >= start)
+    return std::vector<uint64_t>(tail.begin() + (from_height - start), tail.begin() + (to_height + 1 - start));
+  res.insert(res.end(), tail.begin(), tail.begin() + (to_height + 1 - start));
+  return res;
 }
 
-uint64_t BlockchainLMDB::get_tx_count() const
+void BlockchainLMDB::commit_block_changes(mdb_txn_safe &txn)
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  check_open();
-
-  TXN_PREFIX_RDONLY();
-  int result;
-
-  MDB_stat db_stats;
-  if ((result = mdb_stat(m_txn, m_txs_pruned, &db_stats)))
-    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+  boost::lock_guard<boost::mutex> lock(m_cum_rct_lock);
+  const uint64_t txnid = mdb_txn_id(txn.m_txn);
+  try
+  {
+    txn.commit();
+  }
+  catch (...)
+  {
+    m_cum_rct_pending_active = false;
+    m_cum_rct_pending.clear();
+    throw;
+  }
+  m_cum_rct_txnid = txnid;
+  if (m_cum_rct_pending_active)
+  {
+    // a cache ending below the changes is still a valid prefix
+    if (m_cum_rct.size() >= m_cum_rct_pending_height)
+    {
+      m_cum_rct.resize(m_cum_rct_pending_height);
+      m_cum_rct.insert(m_cum_rct.end(), m_cum_rct_pending.begin(), m_cum_rct_pending.end());
+    }
+    m_cum_rct_pending_active = false;
+    m_cum_rct_pending.clear();
+  }
+}
 
-  TXN_POSTFIX_RDONLY();
+void BlockchainLMDB::abort_block_changes()
+{
+  m_cum_rct_pending_active = false;
+  m_cum_rct_pending.clear();
+}
 
-  return db_stats.ms_entries;
+void BlockchainLMDB::reset_cum_rct()
+{
+  boost::lock_guard<boost::mutex> lock(m_cum_rct_lock);
+  m_cum_rct.clear();
+  m_cum_rct_txnid = 0;
+  m_cum_rct_pending_active = false;
+  m_cum_rct_pending.clear();
 }
 
-std::vector<transaction> BlockchainLMDB::get_tx_list(const std::vector<crypto::hash>& hlist) const
+uint64_t BlockchainLMDB::get_top_block_timestamp() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  std::vector<transaction> v;
+  uint64_t m_height = height();
 
-  for (auto& h : hlist)
+  // if no blocks, return 0
+  if (m_height == 0)
   {
-    v.push_back(get_tx(h));
+    return 0;
   }
 
-  return v;
+  return get_block_timestamp(m_height - 1);
 }
 
-uint64_t BlockchainLMDB::get_tx_block_height(const crypto::hash& h) const
+size_t BlockchainLMDB::get_block_weight(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_indices);
+  RCURSOR(block_info);
 
-  MDB_val_set(v, h);
-  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
   {
-    throw1(TX_DNE(std::string("tx_data_t with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
+    throw0(BLOCK_DNE(std::string("Attempt to get block size from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
   }
   else if (get_result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx height from hash", get_result).c_str()));
+    throw0(DB_ERROR("Error attempting to retrieve a block size from the db"));
 
-  txindex *tip = (txindex *)v.mv_data;
-  uint64_t ret = tip->data.block_id;
+  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
+  size_t ret = bi->bi_weight;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
-uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
+difficulty_type BlockchainLMDB::get_block_cumulative_difficulty(const uint64_t& height) const
 {
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__ << "  height: " << height);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
+  RCURSOR(block_info);
 
-  MDB_val_copy<uint64_t> k(amount);
-  MDB_val v;
-  mdb_size_t num_elems = 0;
-  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
-  if (result == MDB_SUCCESS)
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
   {
-    mdb_cursor_count(m_cur_output_amounts, &num_elems);
+    throw0(BLOCK_DNE(std::string("Attempt to get cumulative difficulty from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- difficulty not in db").c_str()));
   }
-  else if (result != MDB_NOTFOUND)
-    throw0(DB_ERROR("DB error attempting to get number of outputs of an amount"));
+  else if (get_result)
+    throw0(DB_ERROR("Error attempting to retrieve a cumulative difficulty from the db"));
 
+  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
+  difficulty_type ret = bi->bi_diff;
   TXN_POSTFIX_RDONLY();
-
-  return num_elems;
+  return ret;
 }
 
-output_data_t BlockchainLMDB::get_output_key(const uint64_t& amount, const uint64_t& index)
+difficulty_type BlockchainLMDB::get_block_difficulty(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
-
-  MDB_val_set(k, amount);
-  MDB_val_set(v, index);
-  auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
-  if (get_result == MDB_NOTFOUND)
-    throw1(OUTPUT_DNE("Attempting to get output pubkey by index, but key does not exist"));
-  else if (get_result)
-    throw0(DB_ERROR("Error attempting to retrieve an output pubkey from the db"));
+  difficulty_type diff1 = 0;
+  difficulty_type diff2 = 0;
 
-  output_data_t ret;
-  if (amount == 0)
-  {
-    const outkey *okp = (const outkey *)v.mv_data;
-    ret = okp->data;
-  }
-  else
+  diff1 = get_block_cumulative_difficulty(height);
+  if (height != 0)
   {
-    const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
-    memcpy(&ret, &okp->data, sizeof(pre_rct_output_data_t));;
-    ret.commitment = rct::zeroCommit(amount);
+    diff2 = get_block_cumulative_difficulty(height - 1);
   }
-  TXN_POSTFIX_RDONLY();
-  return ret;
+
+  return diff1 - diff2;
 }
 
-tx_out_index BlockchainLMDB::get_output_tx_and_index_from_global(const uint64_t& output_id) const
+uint64_t BlockchainLMDB::get_block_already_generated_coins(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(output_txs);
-
-  MDB_val_set(v, output_id);
+  RCURSOR(block_info);
 
-  auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
   if (get_result == MDB_NOTFOUND)
-    throw1(OUTPUT_DNE("output with given index not in db"));
+  {
+    throw0(BLOCK_DNE(std::string("Attempt to get generated coins from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block size not in db").c_str()));
+  }
   else if (get_result)
-    throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
-
-  outtx *ot = (outtx *)v.mv_data;
-  tx_out_index ret = tx_out_index(ot->tx_hash, ot->local_index);
+    throw0(DB_ERROR("Error attempting to retrieve a total generated coins from the db"));
 
+  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
+  uint64_t ret = bi->bi_coins;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
-tx_out_index BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  std::vector < uint64_t > offsets;
-  std::vector<tx_out_index> indices;
-  offsets.push_back(index);
-  get_output_tx_and_index(amount, offsets, indices);
-  if (!indices.size())
-    throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
-
-  return indices[0];
-}
-
-std::vector<uint64_t> BlockchainLMDB::get_tx_amount_output_indices(const uint64_t tx_id) const
+void BlockchainLMDB::get_block_cumulative_emission_and_fees(const uint64_t& height, uint64_t &emission, uint64_t &fees) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(tx_outputs);
-
-  int result = 0;
-  MDB_val_set(k_tx_id, tx_id);
-  MDB_val v;
-  std::vector<uint64_t> amount_output_indices;
-
-  result = mdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, MDB_SET);
-  if (result == MDB_NOTFOUND)
-    LOG_PRINT_L0("WARNING: Unexpected: tx has no amount indices stored in "
-        "tx_outputs, but it should have an empty entry even if it's a tx without "
-        "outputs");
-  else if (result)
-    throw0(DB_ERROR(lmdb_error("DB error attempting to get data for tx_outputs[tx_index]", result).c_str()));
-
-  const uint64_t* indices = (const uint64_t*)v.mv_data;
-  int num_outputs = v.mv_size / sizeof(uint64_t);
+  RCURSOR(block_info);
 
-  amount_output_indices.reserve(num_outputs);
-  for (int i = 0; i < num_outputs; ++i)
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
   {
-    // LOG_PRINT_L0("amount output index[" << 2*i << "]" << ": " << paired_indices[2*i] << "  global output index: " << paired_indices[2*i+1]);
-    amount_output_indices.push_back(indices[i]);
+    throw0(BLOCK_DNE(std::string("Attempt to get cumulative emission from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block info not in db").c_str()));
   }
-  indices = nullptr;
+  else if (get_result)
+    throw0(DB_ERROR("Error attempting to retrieve a cumulative emission from the db"));
 
+  const mdb_block_info *bi = (const mdb_block_info *)result.mv_data;
+  emission = bi->bi_cum_emission;
+  fees = bi->bi_cum_fees;
   TXN_POSTFIX_RDONLY();
-  return amount_output_indices;
 }
 
-
-bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
+crypto::hash BlockchainLMDB::get_block_hash_from_height(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  bool ret;
-
   TXN_PREFIX_RDONLY();
-  RCURSOR(spent_keys);
+  RCURSOR(block_info);
 
-  MDB_val k = {sizeof(img), (void *)&img};
-  ret = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
+  {
+    throw0(BLOCK_DNE(std::string("Attempt to get hash from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- hash not in db").c_str()));
+  }
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block hash from the db: ", get_result).c_str()));
 
+  mdb_block_info *bi = (mdb_block_info *)result.mv_data;
+  crypto::hash ret = bi->bi_hash;
   TXN_POSTFIX_RDONLY();
   return ret;
 }
 
-bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
+std::vector<block> BlockchainLMDB::get_blocks_range(const uint64_t& h1, const uint64_t& h2) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  std::vector<block> v;
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(spent_keys);
-
-  MDB_val k, v;
-  bool fret = true;
-
-  k = zerokval;
-  MDB_cursor_op op = MDB_FIRST;
-  while (1)
+  for (uint64_t height = h1; height <= h2; ++height)
   {
-    int ret = mdb_cursor_get(m_cur_spent_keys, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret < 0)
-      throw0(DB_ERROR("Failed to enumerate key images"));
-    const crypto::key_image k_image = *(const crypto::key_image*)v.mv_data;
-    if (!f(k_image)) {
-      fret = false;
-      break;
-    }
+    v.push_back(get_block_from_height(height));
   }
 
-  TXN_POSTFIX_RDONLY();
-
-  return fret;
+  return v;
 }
 
-bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
+void BlockchainLMDB::get_block_header_entries(uint64_t h1, uint64_t h2, std::vector<block_header_entry_t> &entries) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  int result;
+
+  entries.clear();
+  if (h2 < h1)
+    return;
 
   TXN_PREFIX_RDONLY();
+  RCURSOR(block_info);
   RCURSOR(blocks);
 
-  MDB_val k;
-  MDB_val v;
-  bool fret = true;
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  if (h2 >= db_stats.ms_entries)
+    throw0(BLOCK_DNE(std::string("Attempt to get block headers up to height " + std::to_string(h2) + " failed -- block not in db").c_str()));
 
-  MDB_cursor_op op;
+  // walk block info from the block before the range, for the first difficulty
+  uint64_t height = h1 ? h1 - 1 : 0;
+  MDB_val v = {sizeof(height), (void*)&height};
+  result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", result).c_str()));
+  difficulty_type prev_cumulative_difficulty = h1 ? ((const mdb_block_info *)v.mv_data)->bi_diff : 0;
   if (h1)
   {
-    k = MDB_val{sizeof(h1), (void*)&h1};
-    op = MDB_SET;
-  } else
-  {
-    op = MDB_FIRST;
+    MDB_val k;
+    result = mdb_cursor_get(m_cur_block_info, &k, &v, MDB_NEXT);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", result).c_str()));
   }
-  while (1)
+
+  MDB_val_set(kb, h1);
+  MDB_val vb;
+  result = mdb_cursor_get(m_cur_blocks, &kb, &vb, MDB_SET);
+
+  entries.reserve(h2 + 1 - h1);
+  for (height = h1; height <= h2; ++height)
   {
-    int ret = mdb_cursor_get(m_cur_blocks, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR("Failed to enumerate blocks"));
-    uint64_t height = *(const uint64_t*)k.mv_data;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    block b;
-    if (!parse_and_validate_block_from_blob(bd, b))
-      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
-    crypto::hash hash;
-    if (!get_block_hash(b, hash))
-        throw0(DB_ERROR("Failed to get block hash from blob retrieved from the db"));
-    if (!f(height, hash, b)) {
-      fret = false;
-      break;
+    if (height > h1)
+    {
+      MDB_val k;
+      result = mdb_cursor_get(m_cur_block_info, &k, &v, MDB_NEXT);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", result).c_str()));
+      result = mdb_cursor_get(m_cur_blocks, &kb, &vb, MDB_NEXT);
     }
-    if (height >= h2)
-      break;
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a block from the db: ", result).c_str()));
+
+    const mdb_block_info *bi = (const mdb_block_info *)v.mv_data;
+    entries.push_back(block_header_entry_t());
+    block_header_entry_t &e = entries.back();
+    if (!parse_and_validate_block_from_blob(epee::span<const uint8_t>((const uint8_t*)vb.mv_data, vb.mv_size), e.blk))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    e.hash = bi->bi_hash;
+    e.weight = bi->bi_weight;
+    e.cumulative_difficulty = bi->bi_diff;
+    e.difficulty = bi->bi_diff - prev_cumulative_difficulty;
+    prev_cumulative_difficulty = bi->bi_diff;
   }
 
   TXN_POSTFIX_RDONLY();
-
-  return fret;
 }
 
-bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)> f, bool pruned) const
+std::vector<crypto::hash> BlockchainLMDB::get_hashes_range(const uint64_t& h1, const uint64_t& h2) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  std::vector<crypto::hash> v;
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(txs_pruned);
-  RCURSOR(txs_prunable);
-  RCURSOR(tx_indices);
-
-  MDB_val k;
-  MDB_val v;
-  bool fret = true;
-
-  MDB_cursor_op op = MDB_FIRST;
-  while (1)
+  for (uint64_t height = h1; height <= h2; ++height)
   {
-    int ret = mdb_cursor_get(m_cur_tx_indices, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
-
-    txindex *ti = (txindex *)v.mv_data;
-    const crypto::hash hash = ti->key;
-    k.mv_data = (void *)&ti->data.tx_id;
-    k.mv_size = sizeof(ti->data.tx_id);
-
-    ret = mdb_cursor_get(m_cur_txs_pruned, &k, &v, MDB_SET);
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
-    transaction tx;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    if (pruned)
-    {
-      if (!parse_and_validate_tx_base_from_blob(bd, tx))
-        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-    }
-    else
-    {
-      ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
-      if (ret)
-        throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
-      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-      if (!parse_and_validate_tx_from_blob(bd, tx))
-        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-    }
-    if (!f(hash, tx)) {
-      fret = false;
-      break;
-    }
+    v.push_back(get_block_hash_from_height(height));
   }
 
-  TXN_POSTFIX_RDONLY();
-
-  return fret;
+  return v;
 }
 
-bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const
+crypto::hash BlockchainLMDB::top_block_hash() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
+  uint64_t m_height = height();
+  if (m_height != 0)
+  {
+    return get_block_hash_from_height(m_height - 1);
+  }
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
+  return null_hash;
+}
 
-  MDB_val k;
-  MDB_val v;
-  bool fret = true;
+block BlockchainLMDB::get_top_block() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  uint64_t m_height = height();
 
-  MDB_cursor_op op = MDB_FIRST;
-  while (1)
+  if (m_height != 0)
   {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
-    op = MDB_NEXT;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR("Failed to enumerate outputs"));
-    uint64_t amount = *(const uint64_t*)k.mv_data;
-    outkey *ok = (outkey *)v.mv_data;
-    tx_out_index toi = get_output_tx_and_index_from_global(ok->output_id);
-    if (!f(amount, toi.first, ok->data.height, toi.second)) {
-      fret = false;
-      break;
-    }
+    return get_block_from_height(m_height - 1);
   }
 
-  TXN_POSTFIX_RDONLY();
-
-  return fret;
+  block b;
+  return b;
 }
 
-bool BlockchainLMDB::for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const
+uint64_t BlockchainLMDB::height() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-
   TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
-
-  MDB_val_set(k, amount);
-  MDB_val v;
-  bool fret = true;
+  int result;
 
-  MDB_cursor_op op = MDB_SET;
-  while (1)
-  {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
-    op = MDB_NEXT_DUP;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR("Failed to enumerate outputs"));
-    uint64_t out_amount = *(const uint64_t*)k.mv_data;
-    if (amount != out_amount)
-    {
-      MERROR("Amount is not the expected amount");
-      fret = false;
-      break;
-    }
-    const outkey *ok = (const outkey *)v.mv_data;
-    if (!f(ok->data.height)) {
-      fret = false;
-      break;
-    }
-  }
+  // get current height
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_blocks, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+  return db_stats.ms_entries;
+}
 
-  TXN_POSTFIX_RDONLY();
+uint64_t BlockchainLMDB::num_outputs() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  TXN_PREFIX_RDONLY();
+  int result;
 
-  return fret;
+  // get current height
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_output_txs, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_output_txs: ", result).c_str()));
+  return db_stats.ms_entries;
 }
 
-// batch_num_blocks: (optional) Used to check if resize needed before batch transaction starts.
-bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes)
+bool BlockchainLMDB::tx_exists(const crypto::hash& h) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (m_batch_active)
-    return false;
-  if (m_write_batch_txn != nullptr)
-    return false;
-  if (m_write_txn)
-    throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
   check_open();
 
-  m_writer = boost::this_thread::get_id();
-  check_and_resize_for_batch(batch_num_blocks, batch_bytes);
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
 
-  m_write_batch_txn = new mdb_txn_safe();
+  MDB_val_set(key, h);
+  bool tx_found = false;
 
-  // NOTE: need to make sure it's destroyed properly when done
-  if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_batch_txn))
-  {
-    delete m_write_batch_txn;
-    m_write_batch_txn = nullptr;
-    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
-  }
-  // indicates this transaction is for batch transactions, but not whether it's
-  // active
-  m_write_batch_txn->m_batch_txn = true;
-  m_write_txn = m_write_batch_txn;
+  TIME_MEASURE_START(time1);
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &key, MDB_GET_BOTH);
+  if (get_result == 0)
+    tx_found = true;
+  else if (get_result != MDB_NOTFOUND)
+    throw0(DB_ERROR(lmdb_error(std::string("DB error attempting to fetch transaction index from hash ") + epee::string_tools::pod_to_hex(h) + ": ", get_result).c_str()));
 
-  m_batch_active = true;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
-  if (m_tinfo.get())
+  TIME_MEASURE_FINISH(time1);
+  time_tx_exists += time1;
+
+  TXN_POSTFIX_RDONLY();
+
+  if (! tx_found)
   {
-    if (m_tinfo->m_ti_rflags.m_rf_txn)
-      mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
+    return false;
   }
 
-  LOG_PRINT_L3("batch transaction: begin");
   return true;
 }
 
-void BlockchainLMDB::batch_commit()
+bool BlockchainLMDB::tx_exists(const crypto::hash& h, uint64_t& tx_id) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (! m_batch_active)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_write_batch_txn == nullptr)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_writer != boost::this_thread::get_id())
-    throw1(DB_ERROR("batch transaction owned by other thread"));
-
   check_open();
 
-  LOG_PRINT_L3("batch transaction: committing...");
-  TIME_MEASURE_START(time1);
-  m_write_txn->commit();
-  TIME_MEASURE_FINISH(time1);
-  time_commit1 += time1;
-  LOG_PRINT_L3("batch transaction: committed");
-
-  m_write_txn = nullptr;
-  delete m_write_batch_txn;
-  m_write_batch_txn = nullptr;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
-}
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
 
-void BlockchainLMDB::cleanup_batch()
-{
-  // for destruction of batch transaction
-  m_write_txn = nullptr;
-  delete m_write_batch_txn;
-  m_write_batch_txn = nullptr;
-  m_batch_active = false;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
-}
+  MDB_val_set(v, h);
 
-void BlockchainLMDB::batch_stop()
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (! m_batch_active)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_write_batch_txn == nullptr)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_writer != boost::this_thread::get_id())
-    throw1(DB_ERROR("batch transaction owned by other thread"));
-  check_open();
-  LOG_PRINT_L3("batch transaction: committing...");
   TIME_MEASURE_START(time1);
-  try
-  {
-    m_write_txn->commit();
-    TIME_MEASURE_FINISH(time1);
-    time_commit1 += time1;
-    cleanup_batch();
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  TIME_MEASURE_FINISH(time1);
+  time_tx_exists += time1;
+  if (!get_result) {
+    txindex *tip = (txindex *)v.mv_data;
+    tx_id = tip->data.tx_id;
   }
-  catch (const std::exception &e)
+
+  TXN_POSTFIX_RDONLY();
+
+  bool ret = false;
+  if (get_result == MDB_NOTFOUND)
   {
-    cleanup_batch();
-    throw;
+    LOG_PRINT_L1("transaction with hash " << epee::string_tools::pod_to_hex(h) << " not found in db");
   }
-  LOG_PRINT_L3("batch transaction: end");
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch transaction from hash", get_result).c_str()));
+  else
+    ret = true;
+
+  return ret;
 }
 
-void BlockchainLMDB::batch_abort()
+uint64_t BlockchainLMDB::get_tx_unlock_time(const crypto::hash& h) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (! m_batch_transactions)
-    throw0(DB_ERROR("batch transactions not enabled"));
-  if (! m_batch_active)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_write_batch_txn == nullptr)
-    throw1(DB_ERROR("batch transaction not in progress"));
-  if (m_writer != boost::this_thread::get_id())
-    throw1(DB_ERROR("batch transaction owned by other thread"));
   check_open();
-  // for destruction of batch transaction
-  m_write_txn = nullptr;
-  // explicitly call in case mdb_env_close() (BlockchainLMDB::close()) called before BlockchainLMDB destructor called.
-  m_write_batch_txn->abort();
-  delete m_write_batch_txn;
-  m_write_batch_txn = nullptr;
-  m_batch_active = false;
-  memset(&m_wcursors, 0, sizeof(m_wcursors));
-  LOG_PRINT_L3("batch transaction: aborted");
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+
+  MDB_val_set(v, h);
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
+    throw1(TX_DNE(lmdb_error(std::string("tx data with hash ") + epee::string_tools::pod_to_hex(h) + " not found in db: ", get_result).c_str()));
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx data from hash: ", get_result).c_str()));
+
+  txindex *tip = (txindex *)v.mv_data;
+  uint64_t ret = tip->data.unlock_time;
+  TXN_POSTFIX_RDONLY();
+  return ret;
 }
 
-void BlockchainLMDB::set_batch_transactions(bool batch_transactions)
+bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if ((batch_transactions) && (m_batch_transactions))
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
+
+  MDB_val_set(v, h);
+  MDB_val result0, result1;
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == 0)
   {
-    MINFO("batch transaction mode already enabled, but asked to enable batch mode");
+    txindex *tip = (txindex *)v.mv_data;
+    MDB_val_set(val_tx_id, tip->data.tx_id);
+    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
+    if (get_result == 0)
+    {
+      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+    }
   }
-  m_batch_transactions = batch_transactions;
-  MINFO("batch transactions " << (m_batch_transactions ? "enabled" : "disabled"));
+  if (get_result == MDB_NOTFOUND)
+    return false;
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+
+  bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
+  bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
 }
 
-// return true if we started the txn, false if already started
-bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const
+bool BlockchainLMDB::get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd) const
 {
-  bool ret = false;
-  mdb_threadinfo *tinfo;
-  if (m_write_txn && m_writer == boost::this_thread::get_id()) {
-    *mtxn = m_write_txn->m_txn;
-    *mcur = (mdb_txn_cursors *)&m_wcursors;
-    return ret;
-  }
-  /* Check for existing info and force reset if env doesn't match -
-   * only happens if env was opened/closed multiple times in same process
-   */
-  if (!(tinfo = m_tinfo.get()) || mdb_txn_env(tinfo->m_ti_rtxn) != m_env)
-  {
-    tinfo = new mdb_threadinfo;
-    m_tinfo.reset(tinfo);
-    memset(&tinfo->m_ti_rcursors, 0, sizeof(tinfo->m_ti_rcursors));
-    memset(&tinfo->m_ti_rflags, 0, sizeof(tinfo->m_ti_rflags));
-    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, &tinfo->m_ti_rtxn))
-      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
-    ret = true;
-  } else if (!tinfo->m_ti_rflags.m_rf_txn)
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs_pruned);
+
+  MDB_val_set(v, h);
+  MDB_val result;
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == 0)
   {
-    if (auto mdb_res = lmdb_txn_renew(tinfo->m_ti_rtxn))
-      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to renew a read transaction for the db: ", mdb_res).c_str()));
-    ret = true;
+    txindex *tip = (txindex *)v.mv_data;
+    MDB_val_set(val_tx_id, tip->data.tx_id);
+    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result, MDB_SET);
   }
-  if (ret)
-    tinfo->m_ti_rflags.m_rf_txn = true;
-  *mtxn = tinfo->m_ti_rtxn;
-  *mcur = &tinfo->m_ti_rcursors;
+  if (get_result == MDB_NOTFOUND)
+    return false;
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
-  if (ret)
-    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  return ret;
+  bd.assign(reinterpret_cast<char*>(result.mv_data), result.mv_size);
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
 }
 
-void BlockchainLMDB::block_rtxn_stop() const
+size_t BlockchainLMDB::get_tx_blobs(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &bds, std::vector<bool> &found, bool pruned) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  mdb_txn_reset(m_tinfo->m_ti_rtxn);
-  memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-}
+  check_open();
 
-void BlockchainLMDB::block_txn_start(bool readonly)
-{
-  if (readonly)
+  bds.clear();
+  bds.resize(hashes.size());
+  found.assign(hashes.size(), false);
+
+  // look the hashes up in index order, so consecutive lookups share pages
+  std::vector<size_t> order(hashes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&hashes](size_t a, size_t b) {
+    MDB_val va = {sizeof(crypto::hash), (void*)&hashes[a]}, vb = {sizeof(crypto::hash), (void*)&hashes[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
+
+  std::vector<std::pair<uint64_t, size_t>> tx_ids;
+  tx_ids.reserve(hashes.size());
+  for (size_t i: order)
   {
-    MDB_txn *mtxn;
-	mdb_txn_cursors *mcur;
-	block_rtxn_start(&mtxn, &mcur);
-    return;
+    MDB_val_set(v, hashes[i]);
+    auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+    const txindex *tip = (const txindex *)v.mv_data;
+    tx_ids.push_back(std::make_pair(tip->data.tx_id, i));
   }
 
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  // Distinguish the exceptions here from exceptions that would be thrown while
-  // using the txn and committing it.
-  //
-  // If an exception is thrown in this setup, we don't want the caller to catch
-  // it and proceed as if there were an existing write txn, such as trying to
-  // call block_txn_abort(). It also indicates a serious issue which will
-  // probably be thrown up another layer.
-  if (! m_batch_active && m_write_txn)
-    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when write txn already exists in ")+__FUNCTION__).c_str()));
-  if (! m_batch_active)
-  {
-    m_writer = boost::this_thread::get_id();
-    m_write_txn = new mdb_txn_safe();
-    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_txn))
-    {
-      delete m_write_txn;
-      m_write_txn = nullptr;
-      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
-    }
-    memset(&m_wcursors, 0, sizeof(m_wcursors));
-    if (m_tinfo.get())
+  // then read the blobs in tx id order, stepping forward instead of seeking
+  // when ids are consecutive, as for the txes of a block
+  std::sort(tx_ids.begin(), tx_ids.end());
+  auto seek = [](MDB_cursor *cur, uint64_t tx_id, bool next, MDB_val &data) -> int {
+    if (next)
     {
-      if (m_tinfo->m_ti_rflags.m_rf_txn)
-        mdb_txn_reset(m_tinfo->m_ti_rtxn);
-      memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+      MDB_val k;
+      int result = mdb_cursor_get(cur, &k, &data, MDB_NEXT);
+      if (result == 0 && *(const uint64_t*)k.mv_data == tx_id)
+        return 0;
+      if (result && result != MDB_NOTFOUND)
+        return result;
     }
-  } else if (m_writer != boost::this_thread::get_id())
-    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when batch txn already exists in ")+__FUNCTION__).c_str()));
+    MDB_val_set(k, tx_id);
+    return mdb_cursor_get(cur, &k, &data, MDB_SET);
+  };
+  size_t n_found = 0;
+  bool have_prev = false;
+  uint64_t prev_tx_id = 0;
+  for (const auto &e: tx_ids)
+  {
+    const bool next = have_prev && e.first == prev_tx_id + 1;
+    have_prev = false;
+    MDB_val result0, result1;
+    auto get_result = seek(m_cur_txs_pruned, e.first, next, result0);
+    if (get_result == 0 && !pruned)
+      get_result = seek(m_cur_txs_prunable, e.first, next, result1);
+    if (get_result == MDB_NOTFOUND)
+      continue;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+
+    cryptonote::blobdata &bd = bds[e.second];
+    bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
+    if (!pruned)
+      bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
+    found[e.second] = true;
+    ++n_found;
+    have_prev = true;
+    prev_tx_id = e.first;
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return n_found;
 }
 
-void BlockchainLMDB::block_txn_stop()
+bool BlockchainLMDB::get_block_tx_blobs(uint64_t height, std::vector<cryptonote::blobdata> &bds, bool pruned) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (m_write_txn && m_writer == boost::this_thread::get_id())
-  {
-    if (! m_batch_active)
-	{
-      TIME_MEASURE_START(time1);
-      m_write_txn->commit();
-      TIME_MEASURE_FINISH(time1);
-      time_commit1 += time1;
+  check_open();
 
-      delete m_write_txn;
-      m_write_txn = nullptr;
-      memset(&m_wcursors, 0, sizeof(m_wcursors));
-	}
-  }
-  else if (m_tinfo->m_ti_rtxn)
-  {
-    mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-  }
-}
+  TXN_PREFIX_RDONLY();
+  RCURSOR(block_info);
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
 
-void BlockchainLMDB::block_txn_abort()
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  bds.clear();
+
+  // the block's txns run from after its miner txn to the next block's
+  MDB_val_set(result, height);
+  auto get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
+    throw0(BLOCK_DNE(std::string("Attempt to get txes of block at height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", get_result).c_str()));
+  const uint64_t first_tx_id = ((const mdb_block_info *)result.mv_data)->bi_first_tx_id + 1;
+  uint64_t end_tx_id;
+  MDB_val k_next;
+  get_result = mdb_cursor_get(m_cur_block_info, &k_next, &result, MDB_NEXT_DUP);
+  if (get_result == 0)
+    end_tx_id = ((const mdb_block_info *)result.mv_data)->bi_first_tx_id;
+  else if (get_result == MDB_NOTFOUND)
+    end_tx_id = get_tx_count();
+  else
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", get_result).c_str()));
+  if (end_tx_id < first_tx_id)
+    throw0(DB_ERROR("Block info has txn IDs out of order"));
+
+  bds.reserve(end_tx_id - first_tx_id);
+  for (uint64_t tx_id = first_tx_id; tx_id < end_tx_id; ++tx_id)
   {
-    if (! m_batch_active)
+    const MDB_cursor_op op = tx_id == first_tx_id ? MDB_SET : MDB_NEXT;
+    MDB_val_set(k, tx_id);
+    MDB_val result0, result1;
+    get_result = mdb_cursor_get(m_cur_txs_pruned, &k, &result0, op);
+    if (get_result == 0 && *(const uint64_t*)k.mv_data != tx_id)
+      get_result = MDB_NOTFOUND;
+    if (get_result == 0 && !pruned)
     {
-      delete m_write_txn;
-      m_write_txn = nullptr;
-      memset(&m_wcursors, 0, sizeof(m_wcursors));
+      k = MDB_val{sizeof(tx_id), (void*)&tx_id};
+      get_result = mdb_cursor_get(m_cur_txs_prunable, &k, &result1, op);
+      if (get_result == 0 && *(const uint64_t*)k.mv_data != tx_id)
+        get_result = MDB_NOTFOUND;
     }
+    if (get_result == MDB_NOTFOUND)
+      return false;
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from id", get_result).c_str()));
+
+    bds.push_back(cryptonote::blobdata(reinterpret_cast<char*>(result0.mv_data), result0.mv_size));
+    if (!pruned)
+      bds.back().append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
   }
-  else if (m_tinfo->m_ti_rtxn)
-  {
-    mdb_txn_reset(m_tinfo->m_ti_rtxn);
-    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
-  }
-  else
-  {
-    // This would probably mean an earlier exception was caught, but then we
-    // proceeded further than we should have.
-    throw0(DB_ERROR((std::string("BlockchainLMDB::") + __func__ +
-                     std::string(": block-level DB transaction abort called when write txn doesn't exist")
-                    ).c_str()));
-  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
 }
 
-uint64_t BlockchainLMDB::add_block(const block& blk, size_t block_weight, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
-    const std::vector<transaction>& txs)
+bool BlockchainLMDB::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  uint64_t m_height = height();
 
-  if (m_height % 1000 == 0)
-  {
-    // for batch mode, DB resize check is done at start of batch transaction
-    if (! m_batch_active && need_resize())
-    {
-      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
-      do_resize();
-    }
-  }
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs_prunable_hash);
 
-  try
-  {
-    BlockchainDB::add_block(blk, block_weight, cumulative_difficulty, coins_generated, txs);
-  }
-  catch (const DB_ERROR_TXN_START& e)
-  {
-    throw;
-  }
-  catch (...)
+  MDB_val_set(v, tx_hash);
+  MDB_val result, val_tx_prunable_hash;
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == 0)
   {
-    block_txn_abort();
-    throw;
+    txindex *tip = (txindex *)v.mv_data;
+    MDB_val_set(val_tx_id, tip->data.tx_id);
+    get_result = mdb_cursor_get(m_cur_txs_prunable_hash, &val_tx_id, &result, MDB_SET);
   }
+  if (get_result == MDB_NOTFOUND)
+    return false;
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx prunable hash from tx hash", get_result).c_str()));
 
-  return ++m_height;
+  prunable_hash = *(const crypto::hash*)result.mv_data;
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
 }
 
-void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
+uint64_t BlockchainLMDB::get_tx_count() const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  block_txn_start(false);
+  TXN_PREFIX_RDONLY();
+  int result;
 
-  try
-  {
-    BlockchainDB::pop_block(blk, txs);
-	block_txn_stop();
-  }
-  catch (...)
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_txs_pruned, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+
+  TXN_POSTFIX_RDONLY();
+
+  return db_stats.ms_entries;
+}
+
+std::vector<transaction> BlockchainLMDB::get_tx_list(const std::vector<crypto::hash>& hlist) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  std::vector<transaction> v;
+
+  for (auto& h : hlist)
   {
-	block_txn_abort();
-    throw;
+    v.push_back(get_tx(h));
   }
+
+  return v;
 }
 
-void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
-    std::vector<tx_out_index> &tx_out_indices) const
+uint64_t BlockchainLMDB::get_tx_block_height(const crypto::hash& h) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  tx_out_indices.clear();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(output_txs);
+  RCURSOR(tx_indices);
 
-  for (const uint64_t &output_id : global_indices)
+  MDB_val_set(v, h);
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
   {
-    MDB_val_set(v, output_id);
-
-    auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
-      throw1(OUTPUT_DNE("output with given index not in db"));
-    else if (get_result)
-      throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
-
-    outtx *ot = (outtx *)v.mv_data;
-    auto result = tx_out_index(ot->tx_hash, ot->local_index);
-    tx_out_indices.push_back(result);
+    throw1(TX_DNE(std::string("tx_data_t with hash ").append(epee::string_tools::pod_to_hex(h)).append(" not found in db").c_str()));
   }
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx height from hash", get_result).c_str()));
 
+  txindex *tip = (txindex *)v.mv_data;
+  uint64_t ret = tip->data.block_id;
   TXN_POSTFIX_RDONLY();
+  return ret;
 }
 
-void BlockchainLMDB::get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial)
+uint64_t BlockchainLMDB::get_num_outputs(const uint64_t& amount) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  TIME_MEASURE_START(db3);
   check_open();
-  outputs.clear();
 
   TXN_PREFIX_RDONLY();
-
   RCURSOR(output_amounts);
 
-  MDB_val_set(k, amount);
-  for (const uint64_t &index : offsets)
+  if (amount == 0)
   {
-    MDB_val_set(v, index);
-
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
-    {
-      if (allow_partial)
-      {
-        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
-        break;
-      }
-      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(index) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
-    }
-    else if (get_result)
-      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
+    MDB_stat db_stats;
+    if (auto result = mdb_stat(m_txn, m_rct_outputs, &db_stats))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_rct_outputs: ", result).c_str()));
+    TXN_POSTFIX_RDONLY();
+    return db_stats.ms_entries;
+  }
 
-    output_data_t data;
-    if (amount == 0)
-    {
-      const outkey *okp = (const outkey *)v.mv_data;
-      data = okp->data;
-    }
-    else
-    {
-      const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
-      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
-      data.commitment = rct::zeroCommit(amount);
-    }
-    outputs.push_back(data);
+  MDB_val_copy<uint64_t> k(amount);
+  MDB_val v;
+  mdb_size_t num_elems = 0;
+  auto result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+  if (result == MDB_SUCCESS)
+  {
+    mdb_cursor_count(m_cur_output_amounts, &num_elems);
   }
+  else if (result != MDB_NOTFOUND)
+    throw0(DB_ERROR("DB error attempting to get number of outputs of an amount"));
 
   TXN_POSTFIX_RDONLY();
 
-  TIME_MEASURE_FINISH(db3);
-  LOG_PRINT_L3("db3: " << db3);
+  return num_elems;
 }
 
-void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const
+output_data_t BlockchainLMDB::get_output_key(const uint64_t& amount, const uint64_t& index)
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
-  indices.clear();
 
-  std::vector <uint64_t> tx_indices;
   TXN_PREFIX_RDONLY();
-
   RCURSOR(output_amounts);
+  RCURSOR(rct_outputs);
 
   MDB_val_set(k, amount);
-  for (const uint64_t &index : offsets)
+  MDB_val_set(v, index);
+  int get_result;
+  if (amount == 0)
   {
-    MDB_val_set(v, index);
-
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
-      throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
-    else if (get_result)
-      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output from the db", get_result).c_str()));
-
-    const outkey *okp = (const outkey *)v.mv_data;
-    tx_indices.push_back(okp->output_id);
+    k = v;
+    get_result = mdb_cursor_get(m_cur_rct_outputs, &k, &v, MDB_SET);
+  }
+  else
+  {
+    get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
   }
+  if (get_result == MDB_NOTFOUND)
+    throw1(OUTPUT_DNE("Attempting to get output pubkey by index, but key does not exist"));
+  else if (get_result)
+    throw0(DB_ERROR("Error attempting to retrieve an output pubkey from the db"));
 
-  TIME_MEASURE_START(db3);
-  if(tx_indices.size() > 0)
+  output_data_t ret;
+  if (amount == 0)
   {
-    get_output_tx_and_index_from_global(tx_indices, indices);
+    const rct_outval *rvp = (const rct_outval *)v.mv_data;
+    ret = rvp->data;
   }
-  TIME_MEASURE_FINISH(db3);
-  LOG_PRINT_L3("db3: " << db3);
+  else
+  {
+    const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
+    memcpy(&ret, &okp->data, sizeof(pre_rct_output_data_t));;
+    ret.commitment = rct::zeroCommit(amount);
+  }
+  TXN_POSTFIX_RDONLY();
+  return ret;
 }
 
-std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const
+tx_out_index BlockchainLMDB::get_output_tx_and_index_from_global(const uint64_t& output_id) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
+  RCURSOR(output_txs);
 
-  std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> histogram;
-  MDB_val k;
-  MDB_val v;
+  MDB_val_set(v, output_id);
 
-  if (amounts.empty())
-  {
-    MDB_cursor_op op = MDB_FIRST;
-    while (1)
-    {
-      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
-      op = MDB_NEXT_NODUP;
-      if (ret == MDB_NOTFOUND)
-        break;
-      if (ret)
-        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
-      mdb_size_t num_elems = 0;
-      mdb_cursor_count(m_cur_output_amounts, &num_elems);
-      uint64_t amount = *(const uint64_t*)k.mv_data;
-      if (num_elems >= min_count)
-        histogram[amount] = std::make_tuple(num_elems, 0, 0);
-    }
+  auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == MDB_NOTFOUND)
+    throw1(OUTPUT_DNE("output with given index not in db"));
+  else if (get_result)
+    throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
+
+  outtx *ot = (outtx *)v.mv_data;
+  tx_out_index ret = tx_out_index(ot->tx_hash, ot->local_index);
+
+  TXN_POSTFIX_RDONLY();
+  return ret;
+}
+
+tx_out_index BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  std::vector < uint64_t > offsets;
+  std::vector<tx_out_index> indices;
+  offsets.push_back(index);
+  get_output_tx_and_index(amount, offsets, indices);
+  if (!indices.size())
+    throw1(OUTPUT_DNE("Attempting to get an output index by amount and amount index, but amount not found"));
+
+  return indices[0];
+}
+
+std::vector<uint64_t> BlockchainLMDB::get_tx_amount_output_indices(const uint64_t tx_id) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_outputs);
+
+  int result = 0;
+  MDB_val_set(k_tx_id, tx_id);
+  MDB_val v;
+  std::vector<uint64_t> amount_output_indices;
+
+  result = mdb_cursor_get(m_cur_tx_outputs, &k_tx_id, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    LOG_PRINT_L0("WARNING: Unexpected: tx has no amount indices stored in "
+        "tx_outputs, but it should have an empty entry even if it's a tx without "
+        "outputs");
+  else if (result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to get data for tx_outputs[tx_index]", result).c_str()));
+
+  const uint64_t* indices = (const uint64_t*)v.mv_data;
+  int num_outputs = v.mv_size / sizeof(uint64_t);
+
+  amount_output_indices.reserve(num_outputs);
+  for (int i = 0; i < num_outputs; ++i)
+  {
+    // LOG_PRINT_L0("amount output index[" << 2*i << "]" << ": " << paired_indices[2*i] << "  global output index: " << paired_indices[2*i+1]);
+    amount_output_indices.push_back(indices[i]);
   }
-  else
+  indices = nullptr;
+
+  TXN_POSTFIX_RDONLY();
+  return amount_output_indices;
+}
+
+void BlockchainLMDB::get_blocks_amount_output_indices(uint64_t start_height, size_t count, std::vector<std::vector<std::vector<uint64_t>>> &indices) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  indices.clear();
+  if (count == 0)
+    return;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(block_info);
+  RCURSOR(tx_outputs);
+
+  // each block's txns run from its miner txn to the next block's
+  std::vector<uint64_t> first_tx_ids;
+  first_tx_ids.reserve(count + 1);
+  MDB_val_set(result, start_height);
+  int get_result = mdb_cursor_get(m_cur_block_info, (MDB_val *)&zerokval, &result, MDB_GET_BOTH);
+  for (size_t i = 0; i <= count; ++i)
   {
-    for (const auto &amount: amounts)
+    if (i > 0)
     {
-      MDB_val_copy<uint64_t> k(amount);
-      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
-      if (ret == MDB_NOTFOUND)
-      {
-        if (0 >= min_count)
-          histogram[amount] = std::make_tuple(0, 0, 0);
-      }
-      else if (ret == MDB_SUCCESS)
-      {
-        mdb_size_t num_elems = 0;
-        mdb_cursor_count(m_cur_output_amounts, &num_elems);
-        if (num_elems >= min_count)
-          histogram[amount] = std::make_tuple(num_elems, 0, 0);
-      }
-      else
-      {
-        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
-      }
+      MDB_val k;
+      get_result = mdb_cursor_get(m_cur_block_info, &k, &result, MDB_NEXT_DUP);
+    }
+    if (get_result == MDB_NOTFOUND)
+    {
+      if (i < count)
+        throw0(BLOCK_DNE(std::string("Attempt to get output indices of block at height ").append(boost::lexical_cast<std::string>(start_height + i)).append(" failed -- block not in db").c_str()));
+      first_tx_ids.push_back(get_tx_count());
+      break;
     }
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve block info from the db: ", get_result).c_str()));
+    first_tx_ids.push_back(((const mdb_block_info *)result.mv_data)->bi_first_tx_id);
+    if (first_tx_ids.size() > 1 && first_tx_ids.back() <= first_tx_ids[first_tx_ids.size() - 2])
+      throw0(DB_ERROR("Block info has txn IDs out of order"));
   }
 
-  if (unlocked || recent_cutoff > 0) {
-    const uint64_t blockchain_height = height();
-    for (std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>::iterator i = histogram.begin(); i != histogram.end(); ++i) {
-      uint64_t amount = i->first;
-      uint64_t num_elems = std::get<0>(i->second);
-      while (num_elems > 0) {
-        const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
-        const uint64_t height = get_tx_block_height(toi.first);
-        if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
-          break;
-        --num_elems;
-      }
-      // modifying second does not invalidate the iterator
-      std::get<1>(i->second) = num_elems;
-
-      if (recent_cutoff > 0)
-      {
-        uint64_t recent = 0;
-        while (num_elems > 0) {
-          const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
-          const uint64_t height = get_tx_block_height(toi.first);
-          const uint64_t ts = get_block_timestamp(height);
-          if (ts < recent_cutoff)
-            break;
-          --num_elems;
-          ++recent;
-        }
-        // modifying second does not invalidate the iterator
-        std::get<2>(i->second) = recent;
-      }
+  indices.resize(count);
+  uint64_t tx_id = first_tx_ids[0];
+  for (size_t i = 0; i < count; ++i)
+  {
+    indices[i].reserve(first_tx_ids[i + 1] - first_tx_ids[i]);
+    for (; tx_id < first_tx_ids[i + 1]; ++tx_id)
+    {
+      MDB_val_set(k, tx_id);
+      MDB_val v;
+      get_result = mdb_cursor_get(m_cur_tx_outputs, &k, &v, tx_id == first_tx_ids[0] ? MDB_SET : MDB_NEXT);
+      if (get_result == 0 && *(const uint64_t*)k.mv_data != tx_id)
+        get_result = MDB_NOTFOUND;
+      if (get_result == MDB_NOTFOUND)
+        throw0(TX_DNE(std::string("Output indices of tx ").append(boost::lexical_cast<std::string>(tx_id)).append(" not found in tx_outputs").c_str()));
+      else if (get_result)
+        throw0(DB_ERROR(lmdb_error("DB error attempting to get data for tx_outputs[tx_index]", get_result).c_str()));
+      const uint64_t *data = (const uint64_t*)v.mv_data;
+      indices[i].push_back(std::vector<uint64_t>(data, data + v.mv_size / sizeof(uint64_t)));
     }
   }
 
   TXN_POSTFIX_RDONLY();
-
-  return histogram;
 }
 
-bool BlockchainLMDB::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+
+bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_PREFIX_RDONLY();
-  RCURSOR(output_amounts);
+  bool ret;
 
-  distribution.clear();
-  const uint64_t db_height = height();
-  if (from_height >= db_height)
+  ++m_key_image_lookups;
+  if (!m_key_image_filter.may_contain(img))
+  {
+    ++m_key_image_filtered;
     return false;
-  distribution.resize(db_height - from_height, 0);
+  }
 
-  bool fret = true;
-  MDB_val_set(k, amount);
-  MDB_val v;
-  MDB_cursor_op op = MDB_SET;
-  base = 0;
-  while (1)
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
+
+  MDB_val k = {sizeof(img), (void *)&img};
+  ret = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
+
+  TXN_POSTFIX_RDONLY();
+  if (!ret)
+    ++m_key_image_false_positives;
+  return ret;
+}
+
+void BlockchainLMDB::has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  spent.assign(imgs.size(), false);
+
+  std::vector<size_t> lookups;
+  lookups.reserve(imgs.size());
+  for (size_t i = 0; i < imgs.size(); ++i)
   {
-    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
-    op = MDB_NEXT_DUP;
-    if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
-      throw0(DB_ERROR("Failed to enumerate outputs"));
-    const outkey *ok = (const outkey *)v.mv_data;
-    const uint64_t height = ok->data.height;
-    if (height >= from_height)
-      distribution[height - from_height]++;
+    ++m_key_image_lookups;
+    if (m_key_image_filter.may_contain(imgs[i]))
+      lookups.push_back(i);
     else
-      base++;
-    if (to_height > 0 && height > to_height)
-      break;
+      ++m_key_image_filtered;
   }
+  if (lookups.empty())
+    return;
 
-  distribution[0] += base;
-  for (size_t n = 1; n < distribution.size(); ++n)
-    distribution[n] += distribution[n - 1];
-  base = 0;
+  // in table order, so consecutive lookups share most of their path down
+  // the tree, and repeated key images end up next to each other
+  std::sort(lookups.begin(), lookups.end(), [&imgs](size_t a, size_t b) {
+    const MDB_val va = {sizeof(imgs[a]), (void*)&imgs[a]}, vb = {sizeof(imgs[b]), (void*)&imgs[b]};
+    return compare_hash32(&va, &vb) < 0;
+  });
 
-  TXN_POSTFIX_RDONLY();
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
 
-  return true;
-}
+  const crypto::key_image *prev = NULL;
+  for (size_t i: lookups)
+  {
+    const crypto::key_image &img = imgs[i];
+    if (prev && *prev == img)
+    {
+      spent[i] = spent[prev - imgs.data()];
+      continue;
+    }
+    MDB_val k = {sizeof(img), (void *)&img};
+    int result = mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH);
+    if (result && result != MDB_NOTFOUND)
+      throw0(DB_ERROR(lmdb_error("Failed to check key images: ", result).c_str()));
+    spent[i] = result == 0;
+    if (!spent[i])
+      ++m_key_image_false_positives;
+    prev = &img;
+  }
 
-void BlockchainLMDB::check_hard_fork_info()
-{
+  TXN_POSTFIX_RDONLY();
 }
 
-void BlockchainLMDB::drop_hard_fork_info()
+bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_PREFIX(0);
+  TXN_PREFIX_RDONLY();
+  RCURSOR(spent_keys);
 
-  auto result = mdb_drop(*txn_ptr, m_hf_starting_heights, 1);
-  if (result)
-    throw1(DB_ERROR(lmdb_error("Error dropping hard fork starting heights db: ", result).c_str()));
-  result = mdb_drop(*txn_ptr, m_hf_versions, 1);
-  if (result)
-    throw1(DB_ERROR(lmdb_error("Error dropping hard fork versions db: ", result).c_str()));
+  MDB_val k, v;
+  bool fret = true;
 
-  TXN_POSTFIX_SUCCESS();
+  k = zerokval;
+  mdb_readahead readahead(m_env);
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_spent_keys, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret < 0)
+      throw0(DB_ERROR("Failed to enumerate key images"));
+    readahead(v);
+    const crypto::key_image k_image = *(const crypto::key_image*)v.mv_data;
+    if (!f(k_image)) {
+      fret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return fret;
 }
 
-void BlockchainLMDB::set_hard_fork_version(uint64_t height, uint8_t version)
+void BlockchainLMDB::init_key_image_filter()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
-  TXN_BLOCK_PREFIX(0);
-
-  MDB_val_copy<uint64_t> val_key(height);
-  MDB_val_copy<uint8_t> val_value(version);
-  int result;
-  result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
-  if (result == MDB_KEYEXIST)
-    result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
-  if (result)
-    throw1(DB_ERROR(lmdb_error("Error adding hard fork version to db transaction: ", result).c_str()));
+  TIME_MEASURE_START(t);
+  MDB_stat db_stats;
+  {
+    TXN_PREFIX_RDONLY();
+    if (auto result = mdb_stat(m_txn, m_spent_keys, &db_stats))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+    TXN_POSTFIX_RDONLY();
+  }
 
-  TXN_BLOCK_POSTFIX_SUCCESS();
+  m_key_image_filter.reset(db_stats.ms_entries);
+  for_all_key_images([this](const crypto::key_image &k_image) {
+    m_key_image_filter.insert(k_image);
+    return true;
+  });
+  TIME_MEASURE_FINISH(t);
+  MINFO("Loaded " << m_key_image_filter.entries() << " key images into a " << m_key_image_filter.memory_size() / 1024 << " kB filter in " << t << " ms");
 }
 
-uint8_t BlockchainLMDB::get_hard_fork_version(uint64_t height) const
+bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
   TXN_PREFIX_RDONLY();
-  RCURSOR(hf_versions);
-
-  MDB_val_copy<uint64_t> val_key(height);
-  MDB_val val_ret;
-  auto result = mdb_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
-  if (result == MDB_NOTFOUND || result)
-    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a hard fork version at height " + boost::lexical_cast<std::string>(height) + " from the db: ", result).c_str()));
+  RCURSOR(blocks);
+
+  MDB_val k;
+  MDB_val v;
+  bool fret = true;
+
+  mdb_readahead readahead(m_env);
+  MDB_cursor_op op;
+  if (h1)
+  {
+    k = MDB_val{sizeof(h1), (void*)&h1};
+    op = MDB_SET;
+  } else
+  {
+    op = MDB_FIRST;
+  }
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_blocks, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR("Failed to enumerate blocks"));
+    readahead(v);
+    uint64_t height = *(const uint64_t*)k.mv_data;
+    blobdata bd;
+    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    block b;
+    if (!parse_and_validate_block_from_blob(bd, b))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    crypto::hash hash;
+    if (!get_block_hash(b, hash))
+        throw0(DB_ERROR("Failed to get block hash from blob retrieved from the db"));
+    if (!f(height, hash, b)) {
+      fret = false;
+      break;
+    }
+    if (height >= h2)
+      break;
+  }
 
-  uint8_t ret = *(const uint8_t*)val_ret.mv_data;
   TXN_POSTFIX_RDONLY();
-  return ret;
+
+  return fret;
+}
+
+void BlockchainLMDB::prefetch_blocks(uint64_t start_height, uint64_t count) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(blocks);
+  RCURSOR(tx_indices);
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
+
+  const uint64_t db_height = height();
+  if (count == 0 || start_height >= db_height)
+    return;
+  const uint64_t end_height = count < db_height - start_height ? start_height + count : db_height;
+
+  MDB_val first_block, end_block;
+  if (!advise_key_range(m_env, m_cur_blocks, start_height, end_height, first_block, end_block))
+    return;
+
+  // tx ids follow block order, each block's starting with its miner tx
+  auto miner_tx_id = [&](const MDB_val &bv, uint64_t &tx_id) {
+    block b;
+    if (!parse_and_validate_block_from_blob(blobdata((const char*)bv.mv_data, bv.mv_size), b))
+      return false;
+    crypto::hash h = get_transaction_hash(b.miner_tx);
+    MDB_val_set(v, h);
+    if (mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH))
+      return false;
+    tx_id = ((const txindex *)v.mv_data)->data.tx_id;
+    return true;
+  };
+  uint64_t first_tx_id, end_tx_id = std::numeric_limits<uint64_t>::max();
+  if (!miner_tx_id(first_block, first_tx_id))
+    return;
+  if (end_height < db_height && !miner_tx_id(end_block, end_tx_id))
+    return;
+
+  MDB_val lo, hi;
+  advise_key_range(m_env, m_cur_txs_pruned, first_tx_id, end_tx_id, lo, hi);
+  advise_key_range(m_env, m_cur_txs_prunable, first_tx_id, end_tx_id, lo, hi);
+
+  TXN_POSTFIX_RDONLY();
+}
+
+bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)> f, bool pruned) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
+  RCURSOR(tx_indices);
+
+  MDB_val k;
+  MDB_val v;
+  bool fret = true;
+
+  // only the index walk is sequential, txs are reached in hash order
+  mdb_readahead readahead(m_env);
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_tx_indices, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
+    readahead(v);
+
+    txindex *ti = (txindex *)v.mv_data;
+    const crypto::hash hash = ti->key;
+    k.mv_data = (void *)&ti->data.tx_id;
+    k.mv_size = sizeof(ti->data.tx_id);
+
+    ret = mdb_cursor_get(m_cur_txs_pruned, &k, &v, MDB_SET);
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate transactions: ", ret).c_str()));
+    transaction tx;
+    blobdata bd;
+    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+    if (!pruned)
+    {
+      ret = mdb_cursor_get(m_cur_txs_prunable, &k, &v, MDB_SET);
+      if (ret && ret != MDB_NOTFOUND)
+        throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data the db: ", ret).c_str()));
+    }
+    if (pruned || ret == MDB_NOTFOUND)
+    {
+      if (!parse_and_validate_tx_base_from_blob(bd, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    }
+    else
+    {
+      bd.append(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      if (!parse_and_validate_tx_from_blob(bd, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+    }
+    if (!f(hash, tx)) {
+      fret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return fret;
+}
+
+bool BlockchainLMDB::for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+  RCURSOR(rct_outputs);
+
+  MDB_val k;
+  MDB_val v;
+  bool fret = true;
+
+  // amount 0 first, as it sorts first
+  mdb_readahead rct_readahead(m_env), readahead(m_env);
+  MDB_cursor_op op = MDB_FIRST;
+  while (1)
+  {
+    int ret = mdb_cursor_get(m_cur_rct_outputs, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR("Failed to enumerate outputs"));
+    rct_readahead(v);
+    const rct_outval *rv = (const rct_outval *)v.mv_data;
+    tx_out_index toi = get_output_tx_and_index_from_global(rv->output_id);
+    if (!f(0, toi.first, rv->data.height, toi.second)) {
+      fret = false;
+      break;
+    }
+  }
+
+  op = MDB_FIRST;
+  while (fret)
+  {
+    int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR("Failed to enumerate outputs"));
+    readahead(v);
+    uint64_t amount = *(const uint64_t*)k.mv_data;
+    outkey *ok = (outkey *)v.mv_data;
+    tx_out_index toi = get_output_tx_and_index_from_global(ok->output_id);
+    if (!f(amount, toi.first, ok->data.height, toi.second)) {
+      fret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return fret;
+}
+
+bool BlockchainLMDB::for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+  RCURSOR(rct_outputs);
+
+  MDB_val_set(k, amount);
+  MDB_val v;
+  bool fret = true;
+
+  MDB_cursor *cur = amount == 0 ? m_cur_rct_outputs : m_cur_output_amounts;
+  MDB_cursor_op op = amount == 0 ? MDB_FIRST : MDB_SET;
+  mdb_readahead readahead(m_env);
+  while (1)
+  {
+    int ret = mdb_cursor_get(cur, &k, &v, op);
+    op = amount == 0 ? MDB_NEXT : MDB_NEXT_DUP;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR("Failed to enumerate outputs"));
+    readahead(v);
+    if (amount != 0 && amount != *(const uint64_t*)k.mv_data)
+    {
+      MERROR("Amount is not the expected amount");
+      fret = false;
+      break;
+    }
+    const uint64_t height = amount == 0 ? ((const rct_outval *)v.mv_data)->data.height : ((const outkey *)v.mv_data)->data.height;
+    if (!f(height)) {
+      fret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return fret;
+}
+
+// batch_num_blocks: (optional) Used to check if resize needed before batch transaction starts.
+bool BlockchainLMDB::batch_start(uint64_t batch_num_blocks, uint64_t batch_bytes)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (m_batch_active)
+    return false;
+  if (m_write_batch_txn != nullptr)
+    return false;
+  if (m_write_txn)
+    throw0(DB_ERROR("batch transaction attempted, but m_write_txn already in use"));
+  check_open();
+
+  m_writer = boost::this_thread::get_id();
+  check_and_resize_for_batch(batch_num_blocks, batch_bytes);
+
+  m_write_batch_txn = new mdb_txn_safe();
+
+  // NOTE: need to make sure it's destroyed properly when done
+  if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_batch_txn))
+  {
+    delete m_write_batch_txn;
+    m_write_batch_txn = nullptr;
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
+  }
+  // indicates this transaction is for batch transactions, but not whether it's
+  // active
+  m_write_batch_txn->m_batch_txn = true;
+  m_write_txn = m_write_batch_txn;
+
+  m_batch_active = true;
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+  if (m_tinfo.get())
+  {
+    if (m_tinfo->m_ti_rflags.m_rf_txn)
+      mdb_txn_reset(m_tinfo->m_ti_rtxn);
+    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+  }
+
+  LOG_PRINT_L3("batch transaction: begin");
+  return true;
 }
 
-bool BlockchainLMDB::is_read_only() const
-{
-  unsigned int flags;
-  auto result = mdb_env_get_flags(m_env, &flags);
-  if (result)
-    throw0(DB_ERROR(lmdb_error("Error getting database environment info: ", result).c_str()));
+void BlockchainLMDB::batch_commit()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_write_batch_txn == nullptr)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+
+  check_open();
+
+  LOG_PRINT_L3("batch transaction: committing...");
+  TIME_MEASURE_START(time1);
+  commit_block_changes(*m_write_txn);
+  TIME_MEASURE_FINISH(time1);
+  time_commit1 += time1;
+  LOG_PRINT_L3("batch transaction: committed");
+
+  m_write_txn = nullptr;
+  delete m_write_batch_txn;
+  m_write_batch_txn = nullptr;
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+}
+
+void BlockchainLMDB::cleanup_batch()
+{
+  abort_block_changes();
+  // for destruction of batch transaction
+  m_write_txn = nullptr;
+  delete m_write_batch_txn;
+  m_write_batch_txn = nullptr;
+  m_batch_active = false;
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+}
+
+void BlockchainLMDB::batch_stop()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_write_batch_txn == nullptr)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+  check_open();
+  LOG_PRINT_L3("batch transaction: committing...");
+  TIME_MEASURE_START(time1);
+  try
+  {
+    commit_block_changes(*m_write_txn);
+    TIME_MEASURE_FINISH(time1);
+    time_commit1 += time1;
+    cleanup_batch();
+  }
+  catch (const std::exception &e)
+  {
+    cleanup_batch();
+    throw;
+  }
+  LOG_PRINT_L3("batch transaction: end");
+}
+
+void BlockchainLMDB::batch_abort()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (! m_batch_transactions)
+    throw0(DB_ERROR("batch transactions not enabled"));
+  if (! m_batch_active)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_write_batch_txn == nullptr)
+    throw1(DB_ERROR("batch transaction not in progress"));
+  if (m_writer != boost::this_thread::get_id())
+    throw1(DB_ERROR("batch transaction owned by other thread"));
+  check_open();
+  // for destruction of batch transaction
+  m_write_txn = nullptr;
+  // explicitly call in case mdb_env_close() (BlockchainLMDB::close()) called before BlockchainLMDB destructor called.
+  m_write_batch_txn->abort();
+  delete m_write_batch_txn;
+  m_write_batch_txn = nullptr;
+  m_batch_active = false;
+  memset(&m_wcursors, 0, sizeof(m_wcursors));
+  abort_block_changes();
+  LOG_PRINT_L3("batch transaction: aborted");
+}
+
+void BlockchainLMDB::set_batch_transactions(bool batch_transactions)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if ((batch_transactions) && (m_batch_transactions))
+  {
+    MINFO("batch transaction mode already enabled, but asked to enable batch mode");
+  }
+  m_batch_transactions = batch_transactions;
+  MINFO("batch transactions " << (m_batch_transactions ? "enabled" : "disabled"));
+}
+
+// return true if we started the txn, false if already started
+bool BlockchainLMDB::block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const
+{
+  bool ret = false;
+  mdb_threadinfo *tinfo;
+  if (m_write_txn && m_writer == boost::this_thread::get_id()) {
+    *mtxn = m_write_txn->m_txn;
+    *mcur = (mdb_txn_cursors *)&m_wcursors;
+    return ret;
+  }
+  /* Check for existing info and force reset if env doesn't match -
+   * only happens if env was opened/closed multiple times in same process
+   */
+  if (!(tinfo = m_tinfo.get()) || mdb_txn_env(tinfo->m_ti_rtxn) != m_env)
+  {
+    tinfo = new mdb_threadinfo;
+    m_tinfo.reset(tinfo);
+    memset(&tinfo->m_ti_rcursors, 0, sizeof(tinfo->m_ti_rcursors));
+    memset(&tinfo->m_ti_rflags, 0, sizeof(tinfo->m_ti_rflags));
+    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, MDB_RDONLY, &tinfo->m_ti_rtxn))
+      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a read transaction for the db: ", mdb_res).c_str()));
+    ret = true;
+  } else if (!tinfo->m_ti_rflags.m_rf_txn)
+  {
+    if (auto mdb_res = lmdb_txn_renew(tinfo->m_ti_rtxn))
+      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to renew a read transaction for the db: ", mdb_res).c_str()));
+    ret = true;
+  }
+  if (ret)
+    tinfo->m_ti_rflags.m_rf_txn = true;
+  *mtxn = tinfo->m_ti_rtxn;
+  *mcur = &tinfo->m_ti_rcursors;
+
+  if (ret)
+    LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  return ret;
+}
+
+bool BlockchainLMDB::block_rtxn_start() const
+{
+  MDB_txn *mtxn;
+  mdb_txn_cursors *mcur;
+  return block_rtxn_start(&mtxn, &mcur);
+}
+
+void BlockchainLMDB::block_rtxn_stop() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  mdb_txn_reset(m_tinfo->m_ti_rtxn);
+  memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+}
+
+void BlockchainLMDB::block_txn_start(bool readonly)
+{
+  if (readonly)
+  {
+    MDB_txn *mtxn;
+	mdb_txn_cursors *mcur;
+	block_rtxn_start(&mtxn, &mcur);
+    return;
+  }
+
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  // Distinguish the exceptions here from exceptions that would be thrown while
+  // using the txn and committing it.
+  //
+  // If an exception is thrown in this setup, we don't want the caller to catch
+  // it and proceed as if there were an existing write txn, such as trying to
+  // call block_txn_abort(). It also indicates a serious issue which will
+  // probably be thrown up another layer.
+  if (! m_batch_active && m_write_txn)
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when write txn already exists in ")+__FUNCTION__).c_str()));
+  if (! m_batch_active)
+  {
+    m_writer = boost::this_thread::get_id();
+    m_write_txn = new mdb_txn_safe();
+    if (auto mdb_res = lmdb_txn_begin(m_env, NULL, 0, *m_write_txn))
+    {
+      delete m_write_txn;
+      m_write_txn = nullptr;
+      throw0(DB_ERROR_TXN_START(lmdb_error("Failed to create a transaction for the db: ", mdb_res).c_str()));
+    }
+    memset(&m_wcursors, 0, sizeof(m_wcursors));
+    if (m_tinfo.get())
+    {
+      if (m_tinfo->m_ti_rflags.m_rf_txn)
+        mdb_txn_reset(m_tinfo->m_ti_rtxn);
+      memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+    }
+  } else if (m_writer != boost::this_thread::get_id())
+    throw0(DB_ERROR_TXN_START((std::string("Attempted to start new write txn when batch txn already exists in ")+__FUNCTION__).c_str()));
+}
+
+void BlockchainLMDB::block_txn_stop()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  {
+    if (! m_batch_active)
+	{
+      TIME_MEASURE_START(time1);
+      commit_block_changes(*m_write_txn);
+      TIME_MEASURE_FINISH(time1);
+      time_commit1 += time1;
+
+      delete m_write_txn;
+      m_write_txn = nullptr;
+      memset(&m_wcursors, 0, sizeof(m_wcursors));
+	}
+  }
+  else if (m_tinfo->m_ti_rtxn)
+  {
+    mdb_txn_reset(m_tinfo->m_ti_rtxn);
+    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+  }
+}
+
+void BlockchainLMDB::block_txn_abort()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (m_write_txn && m_writer == boost::this_thread::get_id())
+  {
+    if (! m_batch_active)
+    {
+      delete m_write_txn;
+      m_write_txn = nullptr;
+      memset(&m_wcursors, 0, sizeof(m_wcursors));
+      abort_block_changes();
+    }
+  }
+  else if (m_tinfo->m_ti_rtxn)
+  {
+    mdb_txn_reset(m_tinfo->m_ti_rtxn);
+    memset(&m_tinfo->m_ti_rflags, 0, sizeof(m_tinfo->m_ti_rflags));
+  }
+  else
+  {
+    // This would probably mean an earlier exception was caught, but then we
+    // proceeded further than we should have.
+    throw0(DB_ERROR((std::string("BlockchainLMDB::") + __func__ +
+                     std::string(": block-level DB transaction abort called when write txn doesn't exist")
+                    ).c_str()));
+  }
+}
+
+uint64_t BlockchainLMDB::add_block(const block& blk, size_t block_weight, const difficulty_type& cumulative_difficulty, const uint64_t& coins_generated,
+    const std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  uint64_t m_height = height();
+
+  if (m_height % 1000 == 0)
+  {
+    // for batch mode, DB resize check is done at start of batch transaction
+    if (! m_batch_active && need_resize())
+    {
+      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+      do_resize();
+    }
+  }
+
+  try
+  {
+    BlockchainDB::add_block(blk, block_weight, cumulative_difficulty, coins_generated, txs);
+  }
+  catch (const DB_ERROR_TXN_START& e)
+  {
+    throw;
+  }
+  catch (...)
+  {
+    block_txn_abort();
+    throw;
+  }
+
+  return ++m_height;
+}
+
+void BlockchainLMDB::pop_block(block& blk, std::vector<transaction>& txs)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  block_txn_start(false);
+
+  try
+  {
+    BlockchainDB::pop_block(blk, txs);
+	block_txn_stop();
+  }
+  catch (...)
+  {
+	block_txn_abort();
+    throw;
+  }
+}
+
+void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint64_t> &global_indices,
+    std::vector<tx_out_index> &tx_out_indices) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  tx_out_indices.clear();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_txs);
+
+  for (const uint64_t &output_id : global_indices)
+  {
+    MDB_val_set(v, output_id);
+
+    auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+    if (get_result == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE("output with given index not in db"));
+    else if (get_result)
+      throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
+
+    outtx *ot = (outtx *)v.mv_data;
+    auto result = tx_out_index(ot->tx_hash, ot->local_index);
+    tx_out_indices.push_back(result);
+  }
+
+  TXN_POSTFIX_RDONLY();
+}
+
+void BlockchainLMDB::get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  TIME_MEASURE_START(db3);
+  check_open();
+  outputs.clear();
+
+  TXN_PREFIX_RDONLY();
+
+  RCURSOR(output_amounts);
+  RCURSOR(rct_outputs);
+
+  MDB_val_set(k, amount);
+  for (const uint64_t &index : offsets)
+  {
+    MDB_val_set(v, index);
+
+    int get_result;
+    if (amount == 0)
+    {
+      MDB_val_set(rk, index);
+      get_result = mdb_cursor_get(m_cur_rct_outputs, &rk, &v, MDB_SET);
+    }
+    else
+    {
+      get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    }
+    if (get_result == MDB_NOTFOUND)
+    {
+      if (allow_partial)
+      {
+        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
+        break;
+      }
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(index) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
+    }
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
+
+    output_data_t data;
+    if (amount == 0)
+    {
+      const rct_outval *rvp = (const rct_outval *)v.mv_data;
+      data = rvp->data;
+    }
+    else
+    {
+      const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
+      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
+      data.commitment = rct::zeroCommit(amount);
+    }
+    outputs.push_back(data);
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  TIME_MEASURE_FINISH(db3);
+  LOG_PRINT_L3("db3: " << db3);
+}
+
+void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  indices.clear();
+
+  std::vector <uint64_t> tx_indices;
+  TXN_PREFIX_RDONLY();
+
+  RCURSOR(output_amounts);
+  RCURSOR(rct_outputs);
+
+  MDB_val_set(k, amount);
+  for (const uint64_t &index : offsets)
+  {
+    MDB_val_set(v, index);
+
+    int get_result;
+    if (amount == 0)
+    {
+      MDB_val_set(rk, index);
+      get_result = mdb_cursor_get(m_cur_rct_outputs, &rk, &v, MDB_SET);
+    }
+    else
+    {
+      get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
+    }
+    if (get_result == MDB_NOTFOUND)
+      throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
+    else if (get_result)
+      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output from the db", get_result).c_str()));
+
+    if (amount == 0)
+      tx_indices.push_back(((const rct_outval *)v.mv_data)->output_id);
+    else
+      tx_indices.push_back(((const outkey *)v.mv_data)->output_id);
+  }
+
+  TIME_MEASURE_START(db3);
+  if(tx_indices.size() > 0)
+  {
+    get_output_tx_and_index_from_global(tx_indices, indices);
+  }
+  TIME_MEASURE_FINISH(db3);
+  LOG_PRINT_L3("db3: " << db3);
+}
+
+std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> BlockchainLMDB::get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+
+  std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> histogram;
+  MDB_val k;
+  MDB_val v;
+
+  MDB_stat rct_stats;
+  if (auto result = mdb_stat(m_txn, m_rct_outputs, &rct_stats))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_rct_outputs: ", result).c_str()));
+
+  if (amounts.empty())
+  {
+    if (rct_stats.ms_entries > 0 && rct_stats.ms_entries >= min_count)
+      histogram[0] = std::make_tuple(rct_stats.ms_entries, 0, 0);
+    MDB_cursor_op op = MDB_FIRST;
+    while (1)
+    {
+      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, op);
+      op = MDB_NEXT_NODUP;
+      if (ret == MDB_NOTFOUND)
+        break;
+      if (ret)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
+      mdb_size_t num_elems = 0;
+      mdb_cursor_count(m_cur_output_amounts, &num_elems);
+      uint64_t amount = *(const uint64_t*)k.mv_data;
+      if (num_elems >= min_count)
+        histogram[amount] = std::make_tuple(num_elems, 0, 0);
+    }
+  }
+  else
+  {
+    for (const auto &amount: amounts)
+    {
+      if (amount == 0)
+      {
+        if (rct_stats.ms_entries >= min_count)
+          histogram[0] = std::make_tuple(rct_stats.ms_entries, 0, 0);
+        continue;
+      }
+      MDB_val_copy<uint64_t> k(amount);
+      int ret = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_SET);
+      if (ret == MDB_NOTFOUND)
+      {
+        if (0 >= min_count)
+          histogram[amount] = std::make_tuple(0, 0, 0);
+      }
+      else if (ret == MDB_SUCCESS)
+      {
+        mdb_size_t num_elems = 0;
+        mdb_cursor_count(m_cur_output_amounts, &num_elems);
+        if (num_elems >= min_count)
+          histogram[amount] = std::make_tuple(num_elems, 0, 0);
+      }
+      else
+      {
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate outputs: ", ret).c_str()));
+      }
+    }
+  }
+
+  if (unlocked || recent_cutoff > 0) {
+    const uint64_t blockchain_height = height();
+    for (std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>::iterator i = histogram.begin(); i != histogram.end(); ++i) {
+      uint64_t amount = i->first;
+      uint64_t num_elems = std::get<0>(i->second);
+      while (num_elems > 0) {
+        const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
+        const uint64_t height = get_tx_block_height(toi.first);
+        if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= blockchain_height)
+          break;
+        --num_elems;
+      }
+      // modifying second does not invalidate the iterator
+      std::get<1>(i->second) = num_elems;
+
+      if (recent_cutoff > 0)
+      {
+        uint64_t recent = 0;
+        while (num_elems > 0) {
+          const tx_out_index toi = get_output_tx_and_index(amount, num_elems - 1);
+          const uint64_t height = get_tx_block_height(toi.first);
+          const uint64_t ts = get_block_timestamp(height);
+          if (ts < recent_cutoff)
+            break;
+          --num_elems;
+          ++recent;
+        }
+        // modifying second does not invalidate the iterator
+        std::get<2>(i->second) = recent;
+      }
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return histogram;
+}
+
+bool BlockchainLMDB::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(output_amounts);
+  RCURSOR(rct_outputs);
+
+  distribution.clear();
+  const uint64_t db_height = height();
+  if (from_height >= db_height)
+    return false;
+  distribution.resize(db_height - from_height, 0);
+
+  bool fret = true;
+  MDB_val_set(k, amount);
+  MDB_val v;
+  MDB_cursor *cur = amount == 0 ? m_cur_rct_outputs : m_cur_output_amounts;
+  MDB_cursor_op op = amount == 0 ? MDB_FIRST : MDB_SET;
+  mdb_readahead readahead(m_env);
+  base = 0;
+  while (1)
+  {
+    int ret = mdb_cursor_get(cur, &k, &v, op);
+    op = amount == 0 ? MDB_NEXT : MDB_NEXT_DUP;
+    if (ret == MDB_NOTFOUND)
+      break;
+    if (ret)
+      throw0(DB_ERROR("Failed to enumerate outputs"));
+    readahead(v);
+    const uint64_t height = amount == 0 ? ((const rct_outval *)v.mv_data)->data.height : ((const outkey *)v.mv_data)->data.height;
+    if (height >= from_height)
+      distribution[height - from_height]++;
+    else
+      base++;
+    if (to_height > 0 && height > to_height)
+      break;
+  }
+
+  distribution[0] += base;
+  for (size_t n = 1; n < distribution.size(); ++n)
+    distribution[n] += distribution[n - 1];
+  base = 0;
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
+void BlockchainLMDB::check_hard_fork_info()
+{
+}
+
+void BlockchainLMDB::drop_hard_fork_info()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX(0);
+
+  auto result = mdb_drop(*txn_ptr, m_hf_starting_heights, 1);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error dropping hard fork starting heights db: ", result).c_str()));
+  result = mdb_drop(*txn_ptr, m_hf_versions, 1);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error dropping hard fork versions db: ", result).c_str()));
+
+  TXN_POSTFIX_SUCCESS();
+}
+
+void BlockchainLMDB::set_hard_fork_version(uint64_t height, uint8_t version)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_BLOCK_PREFIX(0);
+
+  MDB_val_copy<uint64_t> val_key(height);
+  MDB_val_copy<uint8_t> val_value(version);
+  int result;
+  result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, MDB_APPEND);
+  if (result == MDB_KEYEXIST)
+    result = mdb_put(*txn_ptr, m_hf_versions, &val_key, &val_value, 0);
+  if (result)
+    throw1(DB_ERROR(lmdb_error("Error adding hard fork version to db transaction: ", result).c_str()));
+
+  TXN_BLOCK_POSTFIX_SUCCESS();
+}
+
+uint8_t BlockchainLMDB::get_hard_fork_version(uint64_t height) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(hf_versions);
+
+  MDB_val_copy<uint64_t> val_key(height);
+  MDB_val val_ret;
+  auto result = mdb_cursor_get(m_cur_hf_versions, &val_key, &val_ret, MDB_SET);
+  if (result == MDB_NOTFOUND || result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve a hard fork version at height " + boost::lexical_cast<std::string>(height) + " from the db: ", result).c_str()));
+
+  uint8_t ret = *(const uint8_t*)val_ret.mv_data;
+  TXN_POSTFIX_RDONLY();
+  return ret;
+}
+
+bool BlockchainLMDB::is_read_only() const
+{
+  unsigned int flags;
+  auto result = mdb_env_get_flags(m_env, &flags);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error getting database environment info: ", result).c_str()));
+
+  if (flags & MDB_RDONLY)
+    return true;
+
+  return false;
+}
+
+uint64_t BlockchainLMDB::get_database_size() const
+{
+  uint64_t size = 0;
+  boost::filesystem::path datafile(m_folder);
+  datafile /= CRYPTONOTE_BLOCKCHAINDATA_FILENAME;
+  if (!epee::file_io_utils::get_file_size(datafile.string(), size))
+    size = 0;
+  return size;
+}
+
+uint32_t BlockchainLMDB::get_blockchain_pruning_seed() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  MDB_val_copy<const char*> k("pruning_seed");
+  MDB_val v;
+  int result = mdb_get(m_txn, m_properties, &k, &v);
+  if (result == MDB_NOTFOUND)
+    return 0;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to retrieve pruning seed: ", result).c_str()));
+  if (v.mv_size != sizeof(uint32_t))
+    throw0(DB_ERROR("Failed to retrieve pruning seed: unexpected value size"));
+  uint32_t pruning_seed;
+  memcpy(&pruning_seed, v.mv_data, sizeof(pruning_seed));
+  TXN_POSTFIX_RDONLY();
+  return pruning_seed;
+}
+
+bool BlockchainLMDB::prune_blockchain(uint32_t pruning_seed)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (is_read_only())
+  {
+    MERROR("Cannot prune a read only database");
+    return false;
+  }
+
+  const uint32_t current_seed = get_blockchain_pruning_seed();
+  if (pruning_seed == 0)
+    pruning_seed = current_seed ? current_seed : tools::make_pruning_seed(tools::get_random_stripe(), CRYPTONOTE_PRUNING_LOG_STRIPES);
+  if (current_seed && current_seed != pruning_seed)
+  {
+    MERROR("The blockchain is already pruned with seed " << current_seed << ", not " << pruning_seed);
+    return false;
+  }
+  const uint32_t log_stripes = tools::get_pruning_log_stripes(pruning_seed);
+  if (log_stripes != CRYPTONOTE_PRUNING_LOG_STRIPES || tools::get_pruning_stripe(pruning_seed) > (1u << log_stripes))
+  {
+    MERROR("Invalid pruning seed " << pruning_seed);
+    return false;
+  }
+
+  MGINFO("Pruning the blockchain, keeping stripe " << tools::get_pruning_stripe(pruning_seed) << " of " << (1u << log_stripes));
+  if (prune_worker(pruning_seed) > 0)
+    compact();
+  return true;
+}
+
+bool BlockchainLMDB::update_pruning()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  const uint32_t pruning_seed = get_blockchain_pruning_seed();
+  if (pruning_seed == 0)
+    return true;
+  prune_worker(pruning_seed);
+  return true;
+}
+
+uint64_t BlockchainLMDB::prune_worker(uint32_t pruning_seed)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  if (m_write_txn)
+    throw0(DB_ERROR("Cannot prune the blockchain while a write txn is active"));
+
+  // everything below the tip which is not in our stripe goes, in txns of
+  // a bounded number of blocks, recording how far we got in each
+  const uint64_t blockchain_height = height();
+  const uint64_t end_height = blockchain_height > CRYPTONOTE_PRUNING_TIP_BLOCKS ? blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS : 0;
+  MDB_val_copy<const char*> k_seed("pruning_seed");
+  MDB_val_copy<const char*> k_height("pruned_height");
+  uint64_t pruned_height = 0, n_blocks = 0, n_txes = 0;
+  int result;
+
+  while (1)
+  {
+    if (need_resize())
+    {
+      LOG_PRINT_L0("LMDB memory map needs to be resized, doing that now.");
+      do_resize();
+    }
+
+    mdb_txn_safe txn;
+    if ((result = lmdb_txn_begin(m_env, NULL, 0, txn)))
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    MDB_val v;
+    if (n_blocks == 0)
+    {
+      result = mdb_get(txn, m_properties, &k_height, &v);
+      if (result == 0 && v.mv_size == sizeof(pruned_height))
+        memcpy(&pruned_height, v.mv_data, sizeof(pruned_height));
+      else if (result && result != MDB_NOTFOUND)
+        throw0(DB_ERROR(lmdb_error("Failed to retrieve pruned height: ", result).c_str()));
+      MDB_val_copy<uint32_t> v_seed(pruning_seed);
+      if ((result = mdb_put(txn, m_properties, &k_seed, &v_seed, 0)))
+        throw0(DB_ERROR(lmdb_error("Failed to save pruning seed: ", result).c_str()));
+    }
+
+    MDB_cursor *c_blocks, *c_tx_indices, *c_txs_prunable;
+    if ((result = mdb_cursor_open(txn, m_blocks, &c_blocks)))
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for blocks: ", result).c_str()));
+    if ((result = mdb_cursor_open(txn, m_tx_indices, &c_tx_indices)))
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+    if ((result = mdb_cursor_open(txn, m_txs_prunable, &c_txs_prunable)))
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+
+    size_t n_blocks_txn = 0;
+    while (pruned_height < end_height && n_blocks_txn < 1000)
+    {
+      pruned_height = tools::get_next_pruned_block_height(pruned_height, blockchain_height, pruning_seed);
+      if (pruned_height >= end_height)
+        break;
+
+      MDB_val_copy<uint64_t> k_block(pruned_height);
+      if ((result = mdb_cursor_get(c_blocks, &k_block, &v, MDB_SET)))
+        throw0(DB_ERROR(lmdb_error("Failed to get block to prune: ", result).c_str()));
+      block b;
+      if (!parse_and_validate_block_from_blob(epee::span<const uint8_t>(reinterpret_cast<const uint8_t*>(v.mv_data), v.mv_size), b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+      std::vector<crypto::hash> tx_hashes;
+      tx_hashes.reserve(b.tx_hashes.size() + 1);
+      tx_hashes.push_back(get_transaction_hash(b.miner_tx));
+      tx_hashes.insert(tx_hashes.end(), b.tx_hashes.begin(), b.tx_hashes.end());
+      for (const crypto::hash &tx_hash: tx_hashes)
+      {
+        MDB_val_set(v_index, tx_hash);
+        if ((result = mdb_cursor_get(c_tx_indices, (MDB_val *)&zerokval, &v_index, MDB_GET_BOTH)))
+          throw0(DB_ERROR(lmdb_error("Failed to get tx to prune: ", result).c_str()));
+        const txindex *tip = (const txindex *)v_index.mv_data;
+        MDB_val_set(k_tx_id, tip->data.tx_id);
+        result = mdb_cursor_get(c_txs_prunable, &k_tx_id, NULL, MDB_SET);
+        if (result == MDB_NOTFOUND)
+          continue;
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get prunable tx data: ", result).c_str()));
+        if ((result = mdb_cursor_del(c_txs_prunable, 0)))
+          throw0(DB_ERROR(lmdb_error("Failed to delete prunable tx data: ", result).c_str()));
+        ++n_txes;
+      }
+      ++pruned_height;
+      ++n_blocks;
+      ++n_blocks_txn;
+    }
+
+    const bool done = pruned_height >= end_height || n_blocks_txn == 0;
+    if (done)
+      pruned_height = std::max(pruned_height, end_height);
+    MDB_val_copy<uint64_t> v_height(pruned_height);
+    if ((result = mdb_put(txn, m_properties, &k_height, &v_height, 0)))
+      throw0(DB_ERROR(lmdb_error("Failed to save pruned height: ", result).c_str()));
+    txn.commit();
+
+    if (done)
+      break;
+    if (n_blocks % 10000 == 0)
+      MGINFO("Pruned " << n_blocks << " blocks, up to height " << pruned_height << "/" << end_height);
+  }
+
+  if (n_blocks > 0)
+    MINFO("Pruned " << n_txes << " txes in " << n_blocks << " blocks");
+  return n_txes;
+}
+
+void BlockchainLMDB::compact()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+
+  // LMDB only reuses the pages pruning frees, so copy the db without them
+  // and swap the copy in
+  const boost::filesystem::path folder(m_folder);
+  const boost::filesystem::path compact_folder = folder / "compact";
+  boost::system::error_code ec;
+  boost::filesystem::remove_all(compact_folder, ec);
+  if (!boost::filesystem::create_directories(compact_folder, ec))
+    throw0(DB_ERROR(std::string("Failed to create directory ").append(compact_folder.string()).c_str()));
+
+  MGINFO("Compacting the blockchain, this may take a while");
+  if (auto result = mdb_env_copy2(m_env, compact_folder.string().c_str(), MDB_CP_COMPACT))
+    throw0(DB_ERROR(lmdb_error("Failed to compact the db: ", result).c_str()));
+
+  const int db_flags = m_db_flags;
+  close();
+  boost::filesystem::rename(compact_folder / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, folder / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, ec);
+  if (ec)
+    throw0(DB_ERROR(std::string("Failed to replace the db with its compacted copy: ").append(ec.message()).c_str()));
+  boost::filesystem::remove_all(compact_folder, ec);
+  open(folder.string(), db_flags);
+  MGINFO("Blockchain compacted to " << (get_database_size() >> 20) << " MB");
+}
+
+bool BlockchainLMDB::get_resize_stats(uint64_t &resizes, uint64_t &blocked_ns) const
+{
+  resizes = resize_count;
+  blocked_ns = resize_blocked_ns;
+  return true;
+}
+
+bool BlockchainLMDB::backup(const std::string &folder, uint64_t max_bytes_per_second, const std::function<bool(uint64_t)> &progress)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  const boost::filesystem::path dir(folder);
+  boost::system::error_code ec;
+  if (boost::filesystem::exists(dir / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, ec))
+    throw0(DB_ERROR(std::string("There is a db in ").append(folder).append(" already").c_str()));
+  boost::filesystem::create_directories(dir, ec);
+  if (ec)
+    throw0(DB_ERROR(std::string("Failed to create directory ").append(folder).append(": ").append(ec.message()).c_str()));
+
+  // the copy reads straight from the map for as long as it runs, so a
+  // resize has to wait for it, and all new txns with it: make room for
+  // the blocks expected meanwhile up front, unless a write is under way,
+  // whose batch will have checked for room itself
+#if defined(ENABLE_AUTO_RESIZE)
+  static const uint64_t backup_headroom = 2ull << 30;
+  if (!is_read_only() && !m_batch_active && m_write_txn == nullptr && need_resize(backup_headroom))
+    do_resize(backup_headroom);
+#endif
+
+  MGINFO("Copying the blockchain to " << folder);
+#ifdef _WIN32
+  if (max_bytes_per_second > 0 || progress)
+    MWARNING("Copies of the db cannot be throttled or followed on this platform");
+  mdb_txn_safe copy_guard;
+  if (auto result = mdb_env_copy2(m_env, folder.c_str(), MDB_CP_COMPACT))
+    throw0(DB_ERROR(lmdb_error("Failed to copy the db: ", result).c_str()));
+  return true;
+#else
+  // LMDB writes the copy into a pipe, and we pass it on to the file at the
+  // requested rate: a full pipe blocks LMDB, so the copy reads the db no
+  // faster than that either
+  const boost::filesystem::path partial = dir / (std::string(CRYPTONOTE_BLOCKCHAINDATA_FILENAME) + ".partial");
+  const int out = ::open(partial.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0)
+    throw0(DB_ERROR(std::string("Failed to create ").append(partial.string()).append(": ").append(strerror(errno)).c_str()));
+  int fds[2];
+  if (pipe(fds))
+  {
+    ::close(out);
+    throw0(DB_ERROR(std::string("Failed to create a pipe to copy the db: ").append(strerror(errno)).c_str()));
+  }
+
+  int copy_result = 0;
+  int write_error = 0;
+  bool cancelled = false;
+  uint64_t written = 0;
+  {
+    mdb_txn_safe copy_guard;
+    std::thread copier([&]() {
+      // stopping early closes the pipe, which LMDB must see as a failed
+      // write rather than a signal
+      sigset_t set;
+      sigemptyset(&set);
+      sigaddset(&set, SIGPIPE);
+      pthread_sigmask(SIG_BLOCK, &set, NULL);
+      copy_result = mdb_env_copyfd2(m_env, fds[1], MDB_CP_COMPACT);
+      ::close(fds[1]);
+    });
+
+    std::vector<char> buffer(1 << 16);
+    const auto start = std::chrono::steady_clock::now();
+    while (true)
+    {
+      const ssize_t n = ::read(fds[0], buffer.data(), buffer.size());
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      for (ssize_t done = 0; done < n; )
+      {
+        const ssize_t w = ::write(out, buffer.data() + done, n - done);
+        if (w < 0 && errno == EINTR)
+          continue;
+        if (w <= 0)
+        {
+          write_error = w < 0 ? errno : EIO;
+          break;
+        }
+        done += w;
+      }
+      if (write_error)
+        break;
+      written += n;
+      if (progress && !progress(written))
+      {
+        cancelled = true;
+        break;
+      }
+      if (max_bytes_per_second > 0)
+        std::this_thread::sleep_until(start + std::chrono::microseconds(written * 1000000 / max_bytes_per_second));
+    }
+    ::close(fds[0]);
+    copier.join();
+  }
+
+  if (!write_error && !cancelled && !copy_result && fsync(out))
+    write_error = errno;
+  ::close(out);
+  if (write_error || cancelled || copy_result)
+  {
+    boost::filesystem::remove(partial, ec);
+    if (cancelled)
+    {
+      MGINFO("Copy of the blockchain cancelled");
+      return false;
+    }
+    if (write_error)
+      throw0(DB_ERROR(std::string("Failed to write the copy of the db: ").append(strerror(write_error)).c_str()));
+    throw0(DB_ERROR(lmdb_error("Failed to copy the db: ", copy_result).c_str()));
+  }
+  boost::filesystem::rename(partial, dir / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, ec);
+  if (ec)
+    throw0(DB_ERROR(std::string("Failed to rename the copy of the db: ").append(ec.message()).c_str()));
+  MGINFO("Copied the blockchain to " << folder << ", " << (written >> 20) << " MB");
+  return true;
+#endif
+}
+
+bool BlockchainLMDB::get_map_usage(uint64_t &map_size, uint64_t &used) const
+{
+  MDB_envinfo mei;
+  MDB_stat mst;
+  if (mdb_env_info(m_env, &mei) || mdb_env_stat(m_env, &mst))
+    return false;
+  map_size = mei.me_mapsize;
+  used = mst.ms_psize * mei.me_last_pgno;
+  return true;
+}
+
+bool BlockchainLMDB::get_key_image_filter_stats(key_image_filter_stats &stats) const
+{
+  stats.enabled = m_key_image_filter.enabled();
+  stats.memory_size = m_key_image_filter.memory_size();
+  stats.entries = m_key_image_filter.entries();
+  stats.estimated_fp_rate = m_key_image_filter.estimated_false_positive_rate();
+  stats.lookups = m_key_image_lookups;
+  stats.filtered = m_key_image_filtered;
+  stats.false_positives = m_key_image_false_positives;
+  return true;
+}
+
+void BlockchainLMDB::fixup()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  // Always call parent as well
+  BlockchainDB::fixup();
+}
+
+#define RENAME_DB(name) do { \
+    char n2[] = name; \
+    MDB_dbi tdbi; \
+    n2[sizeof(n2)-2]--; \
+    /* play some games to put (name) on a writable page */ \
+    result = mdb_dbi_open(txn, n2, MDB_CREATE, &tdbi); \
+    if (result) \
+      throw0(DB_ERROR(lmdb_error("Failed to create " + std::string(n2) + ": ", result).c_str())); \
+    result = mdb_drop(txn, tdbi, 1); \
+    if (result) \
+      throw0(DB_ERROR(lmdb_error("Failed to delete " + std::string(n2) + ": ", result).c_str())); \
+    k.mv_data = (void *)name; \
+    k.mv_size = sizeof(name)-1; \
+    result = mdb_cursor_open(txn, 1, &c_cur); \
+    if (result) \
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for " name ": ", result).c_str())); \
+    result = mdb_cursor_get(c_cur, &k, NULL, MDB_SET_KEY); \
+    if (result) \
+      throw0(DB_ERROR(lmdb_error("Failed to get DB record for " name ": ", result).c_str())); \
+    ptr = (char *)k.mv_data; \
+    ptr[sizeof(name)-2]++; } while(0)
+
+#define LOGIF(y)    if (ELPP->vRegistry()->allowed(y, "global"))
+
+void BlockchainLMDB::migrate_0_1()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  uint64_t i, z, m_height;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+  char *ptr;
+
+  MGINFO_YELLOW("Migrating blockchain from DB version 0 to 1 - this may take a while:");
+  MINFO("updating blocks, hf_versions, outputs, txs, and spent_keys tables...");
+
+  do {
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    m_height = db_stats.ms_entries;
+    MINFO("Total number of blocks: " << m_height);
+    MINFO("block migration will update block_heights, block_info, and hf_versions...");
+
+    MINFO("migrating block_heights:");
+    MDB_dbi o_heights;
+
+    unsigned int flags;
+    result = mdb_dbi_flags(txn, m_block_heights, &flags);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to retrieve block_heights flags: ", result).c_str()));
+    /* if the flags are what we expect, this table has already been migrated */
+    if ((flags & (MDB_INTEGERKEY|MDB_DUPSORT|MDB_DUPFIXED)) == (MDB_INTEGERKEY|MDB_DUPSORT|MDB_DUPFIXED)) {
+      txn.abort();
+      LOG_PRINT_L1("  block_heights already migrated");
+      break;
+    }
+
+    /* the block_heights table name is the same but the old version and new version
+     * have incompatible DB flags. Create a new table with the right flags. We want
+     * the name to be similar to the old name so that it will occupy the same location
+     * in the DB.
+     */
+    o_heights = m_block_heights;
+    lmdb_db_open(txn, "block_heightr", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for block_heightr");
+    mdb_set_dupsort(txn, m_block_heights, compare_hash32);
+
+    MDB_cursor *c_old, *c_cur;
+    blk_height bh;
+    MDB_val_set(nv, bh);
+
+    /* old table was k(hash), v(height).
+     * new table is DUPFIXED, k(zeroval), v{hash, height}.
+     */
+    i = 0;
+    z = m_height;
+    while(1) {
+      if (!(i % 2000)) {
+        if (i) {
+          LOGIF(el::Level::Info) {
+            std::cout << i << " / " << z << "  \r" << std::flush;
+          }
+          txn.commit();
+          result = mdb_txn_begin(m_env, NULL, 0, txn);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+        }
+        result = mdb_cursor_open(txn, m_block_heights, &c_cur);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_heightr: ", result).c_str()));
+        result = mdb_cursor_open(txn, o_heights, &c_old);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_heights: ", result).c_str()));
+        if (!i) {
+          MDB_stat ms;
+          result = mdb_stat(txn, m_block_heights, &ms);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to query block_heights table: ", result).c_str()));
+          i = ms.ms_entries;
+        }
+      }
+      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
+      if (result == MDB_NOTFOUND) {
+        txn.commit();
+        break;
+      }
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_heights: ", result).c_str()));
+      bh.bh_hash = *(crypto::hash *)k.mv_data;
+      bh.bh_height = *(uint64_t *)v.mv_data;
+      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_heightr: ", result).c_str()));
+      /* we delete the old records immediately, so the overall DB and mapsize should not grow.
+       * This is a little slower than just letting mdb_drop() delete it all at the end, but
+       * it saves a significant amount of disk space.
+       */
+      result = mdb_cursor_del(c_old, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_heights: ", result).c_str()));
+      i++;
+    }
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    /* Delete the old table */
+    result = mdb_drop(txn, o_heights, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete old block_heights table: ", result).c_str()));
+
+    RENAME_DB("block_heightr");
+
+    /* close and reopen to get old dbi slot back */
+    mdb_dbi_close(m_env, m_block_heights);
+    lmdb_db_open(txn, "block_heights", MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for block_heights");
+    mdb_set_dupsort(txn, m_block_heights, compare_hash32);
+    txn.commit();
+
+  } while(0);
+
+  /* old tables are k(height), v(value).
+   * new table is DUPFIXED, k(zeroval), v{height, values...}.
+   */
+  do {
+    LOG_PRINT_L1("migrating block info:");
+
+    MDB_dbi coins;
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    result = mdb_dbi_open(txn, "block_coins", 0, &coins);
+    if (result == MDB_NOTFOUND) {
+      txn.abort();
+      LOG_PRINT_L1("  block_info already migrated");
+      break;
+    }
+    MDB_dbi diffs, hashes, sizes, timestamps;
+    mdb_block_info_1 bi;
+    MDB_val_set(nv, bi);
+
+    lmdb_db_open(txn, "block_diffs", 0, diffs, "Failed to open db handle for block_diffs");
+    lmdb_db_open(txn, "block_hashes", 0, hashes, "Failed to open db handle for block_hashes");
+    lmdb_db_open(txn, "block_sizes", 0, sizes, "Failed to open db handle for block_sizes");
+    lmdb_db_open(txn, "block_timestamps", 0, timestamps, "Failed to open db handle for block_timestamps");
+    MDB_cursor *c_cur, *c_coins, *c_diffs, *c_hashes, *c_sizes, *c_timestamps;
+    i = 0;
+    z = m_height;
+    while(1) {
+      MDB_val k, v;
+      if (!(i % 2000)) {
+        if (i) {
+          LOGIF(el::Level::Info) {
+            std::cout << i << " / " << z << "  \r" << std::flush;
+          }
+          txn.commit();
+          result = mdb_txn_begin(m_env, NULL, 0, txn);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+        }
+        result = mdb_cursor_open(txn, m_block_info, &c_cur);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_info: ", result).c_str()));
+        result = mdb_cursor_open(txn, coins, &c_coins);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_coins: ", result).c_str()));
+        result = mdb_cursor_open(txn, diffs, &c_diffs);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_diffs: ", result).c_str()));
+        result = mdb_cursor_open(txn, hashes, &c_hashes);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_hashes: ", result).c_str()));
+        result = mdb_cursor_open(txn, sizes, &c_sizes);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_coins: ", result).c_str()));
+        result = mdb_cursor_open(txn, timestamps, &c_timestamps);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_timestamps: ", result).c_str()));
+        if (!i) {
+          MDB_stat ms;
+          result = mdb_stat(txn, m_block_info, &ms);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to query block_info table: ", result).c_str()));
+          i = ms.ms_entries;
+        }
+      }
+      result = mdb_cursor_get(c_coins, &k, &v, MDB_NEXT);
+      if (result == MDB_NOTFOUND) {
+        break;
+      } else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_coins: ", result).c_str()));
+      bi.bi_height = *(uint64_t *)k.mv_data;
+      bi.bi_coins = *(uint64_t *)v.mv_data;
+      result = mdb_cursor_get(c_diffs, &k, &v, MDB_NEXT);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_diffs: ", result).c_str()));
+      bi.bi_diff = *(uint64_t *)v.mv_data;
+      result = mdb_cursor_get(c_hashes, &k, &v, MDB_NEXT);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_hashes: ", result).c_str()));
+      bi.bi_hash = *(crypto::hash *)v.mv_data;
+      result = mdb_cursor_get(c_sizes, &k, &v, MDB_NEXT);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_sizes: ", result).c_str()));
+      if (v.mv_size == sizeof(uint32_t))
+        bi.bi_weight = *(uint32_t *)v.mv_data;
+      else
+        bi.bi_weight = *(uint64_t *)v.mv_data;  // this is a 32/64 compat bug in version 0
+      result = mdb_cursor_get(c_timestamps, &k, &v, MDB_NEXT);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_timestamps: ", result).c_str()));
+      bi.bi_timestamp = *(uint64_t *)v.mv_data;
+      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_info: ", result).c_str()));
+      result = mdb_cursor_del(c_coins, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_coins: ", result).c_str()));
+      result = mdb_cursor_del(c_diffs, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_diffs: ", result).c_str()));
+      result = mdb_cursor_del(c_hashes, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_hashes: ", result).c_str()));
+      result = mdb_cursor_del(c_sizes, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_sizes: ", result).c_str()));
+      result = mdb_cursor_del(c_timestamps, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_timestamps: ", result).c_str()));
+      i++;
+    }
+    mdb_cursor_close(c_timestamps);
+    mdb_cursor_close(c_sizes);
+    mdb_cursor_close(c_hashes);
+    mdb_cursor_close(c_diffs);
+    mdb_cursor_close(c_coins);
+    result = mdb_drop(txn, timestamps, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete block_timestamps from the db: ", result).c_str()));
+    result = mdb_drop(txn, sizes, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete block_sizes from the db: ", result).c_str()));
+    result = mdb_drop(txn, hashes, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete block_hashes from the db: ", result).c_str()));
+    result = mdb_drop(txn, diffs, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete block_diffs from the db: ", result).c_str()));
+    result = mdb_drop(txn, coins, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete block_coins from the db: ", result).c_str()));
+    txn.commit();
+  } while(0);
+
+  do {
+    LOG_PRINT_L1("migrating hf_versions:");
+    MDB_dbi o_hfv;
+
+    unsigned int flags;
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    result = mdb_dbi_flags(txn, m_hf_versions, &flags);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to retrieve hf_versions flags: ", result).c_str()));
+    /* if the flags are what we expect, this table has already been migrated */
+    if (flags & MDB_INTEGERKEY) {
+      txn.abort();
+      LOG_PRINT_L1("  hf_versions already migrated");
+      break;
+    }
+
+    /* the hf_versions table name is the same but the old version and new version
+     * have incompatible DB flags. Create a new table with the right flags.
+     */
+    o_hfv = m_hf_versions;
+    lmdb_db_open(txn, "hf_versionr", MDB_INTEGERKEY | MDB_CREATE, m_hf_versions, "Failed to open db handle for hf_versionr");
+
+    MDB_cursor *c_old, *c_cur;
+    i = 0;
+    z = m_height;
+
+    while(1) {
+      if (!(i % 2000)) {
+        if (i) {
+          LOGIF(el::Level::Info) {
+            std::cout << i << " / " << z << "  \r" << std::flush;
+          }
+          txn.commit();
+          result = mdb_txn_begin(m_env, NULL, 0, txn);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+        }
+        result = mdb_cursor_open(txn, m_hf_versions, &c_cur);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for spent_keyr: ", result).c_str()));
+        result = mdb_cursor_open(txn, o_hfv, &c_old);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for spent_keys: ", result).c_str()));
+        if (!i) {
+          MDB_stat ms;
+          result = mdb_stat(txn, m_hf_versions, &ms);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to query hf_versions table: ", result).c_str()));
+          i = ms.ms_entries;
+        }
+      }
+      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
+      if (result == MDB_NOTFOUND) {
+        txn.commit();
+        break;
+      }
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from hf_versions: ", result).c_str()));
+      result = mdb_cursor_put(c_cur, &k, &v, MDB_APPEND);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into hf_versionr: ", result).c_str()));
+      result = mdb_cursor_del(c_old, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from hf_versions: ", result).c_str()));
+      i++;
+    }
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    /* Delete the old table */
+    result = mdb_drop(txn, o_hfv, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete old hf_versions table: ", result).c_str()));
+    RENAME_DB("hf_versionr");
+    mdb_dbi_close(m_env, m_hf_versions);
+    lmdb_db_open(txn, "hf_versions", MDB_INTEGERKEY, m_hf_versions, "Failed to open db handle for hf_versions");
 
-  if (flags & MDB_RDONLY)
-    return true;
+    txn.commit();
+  } while(0);
 
-  return false;
-}
+  do {
+    LOG_PRINT_L1("deleting old indices:");
 
-uint64_t BlockchainLMDB::get_database_size() const
-{
-  uint64_t size = 0;
-  boost::filesystem::path datafile(m_folder);
-  datafile /= CRYPTONOTE_BLOCKCHAINDATA_FILENAME;
-  if (!epee::file_io_utils::get_file_size(datafile.string(), size))
-    size = 0;
-  return size;
-}
+    /* Delete all other tables, we're just going to recreate them */
+    MDB_dbi dbi;
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
 
-void BlockchainLMDB::fixup()
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  // Always call parent as well
-  BlockchainDB::fixup();
-}
+    result = mdb_dbi_open(txn, "tx_unlocks", 0, &dbi);
+    if (result == MDB_NOTFOUND) {
+        txn.abort();
+        LOG_PRINT_L1("  old indices already deleted");
+        break;
+    }
+    txn.abort();
 
-#define RENAME_DB(name) do { \
-    char n2[] = name; \
-    MDB_dbi tdbi; \
-    n2[sizeof(n2)-2]--; \
-    /* play some games to put (name) on a writable page */ \
-    result = mdb_dbi_open(txn, n2, MDB_CREATE, &tdbi); \
-    if (result) \
-      throw0(DB_ERROR(lmdb_error("Failed to create " + std::string(n2) + ": ", result).c_str())); \
-    result = mdb_drop(txn, tdbi, 1); \
-    if (result) \
-      throw0(DB_ERROR(lmdb_error("Failed to delete " + std::string(n2) + ": ", result).c_str())); \
-    k.mv_data = (void *)name; \
-    k.mv_size = sizeof(name)-1; \
-    result = mdb_cursor_open(txn, 1, &c_cur); \
-    if (result) \
-      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for " name ": ", result).c_str())); \
-    result = mdb_cursor_get(c_cur, &k, NULL, MDB_SET_KEY); \
+#define DELETE_DB(x) do {   \
+    LOG_PRINT_L1("  " x ":"); \
+    result = mdb_txn_begin(m_env, NULL, 0, txn); \
     if (result) \
-      throw0(DB_ERROR(lmdb_error("Failed to get DB record for " name ": ", result).c_str())); \
-    ptr = (char *)k.mv_data; \
-    ptr[sizeof(name)-2]++; } while(0)
-
-#define LOGIF(y)    if (ELPP->vRegistry()->allowed(y, "global"))
-
-void BlockchainLMDB::migrate_0_1()
-{
-  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  uint64_t i, z, m_height;
-  int result;
-  mdb_txn_safe txn(false);
-  MDB_val k, v;
-  char *ptr;
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str())); \
+    result = mdb_dbi_open(txn, x, 0, &dbi); \
+    if (!result) { \
+      result = mdb_drop(txn, dbi, 1); \
+      if (result) \
+        throw0(DB_ERROR(lmdb_error("Failed to delete " x ": ", result).c_str())); \
+    txn.commit(); \
+    } } while(0)
 
-  MGINFO_YELLOW("Migrating blockchain from DB version 0 to 1 - this may take a while:");
-  MINFO("updating blocks, hf_versions, outputs, txs, and spent_keys tables...");
+    DELETE_DB("tx_heights");
+    DELETE_DB("output_txs");
+    DELETE_DB("output_indices");
+    DELETE_DB("output_keys");
+    DELETE_DB("spent_keys");
+    DELETE_DB("output_amounts");
+    DELETE_DB("tx_outputs");
+    DELETE_DB("tx_unlocks");
 
-  do {
+    /* reopen new DBs with correct flags */
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    lmdb_db_open(txn, LMDB_OUTPUT_TXS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_output_txs, "Failed to open db handle for m_output_txs");
+    mdb_set_dupsort(txn, m_output_txs, compare_uint64);
+    lmdb_db_open(txn, LMDB_TX_OUTPUTS, MDB_INTEGERKEY | MDB_CREATE, m_tx_outputs, "Failed to open db handle for m_tx_outputs");
+    lmdb_db_open(txn, LMDB_SPENT_KEYS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_spent_keys, "Failed to open db handle for m_spent_keys");
+    mdb_set_dupsort(txn, m_spent_keys, compare_hash32);
+    lmdb_db_open(txn, LMDB_OUTPUT_AMOUNTS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_CREATE, m_output_amounts, "Failed to open db handle for m_output_amounts");
+    mdb_set_dupsort(txn, m_output_amounts, compare_uint64);
+    txn.commit();
+  } while(0);
 
-    MDB_stat db_stats;
-    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
-      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
-    m_height = db_stats.ms_entries;
-    MINFO("Total number of blocks: " << m_height);
-    MINFO("block migration will update block_heights, block_info, and hf_versions...");
-
-    MINFO("migrating block_heights:");
-    MDB_dbi o_heights;
+  do {
+    LOG_PRINT_L1("migrating txs and outputs:");
 
     unsigned int flags;
-    result = mdb_dbi_flags(txn, m_block_heights, &flags);
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to retrieve block_heights flags: ", result).c_str()));
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    result = mdb_dbi_flags(txn, m_txs, &flags);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to retrieve txs flags: ", result).c_str()));
     /* if the flags are what we expect, this table has already been migrated */
-    if ((flags & (MDB_INTEGERKEY|MDB_DUPSORT|MDB_DUPFIXED)) == (MDB_INTEGERKEY|MDB_DUPSORT|MDB_DUPFIXED)) {
+    if (flags & MDB_INTEGERKEY) {
       txn.abort();
-      LOG_PRINT_L1("  block_heights already migrated");
+      LOG_PRINT_L1("  txs already migrated");
       break;
     }
 
-    /* the block_heights table name is the same but the old version and new version
-     * have incompatible DB flags. Create a new table with the right flags. We want
-     * the name to be similar to the old name so that it will occupy the same location
-     * in the DB.
-     */
-    o_heights = m_block_heights;
-    lmdb_db_open(txn, "block_heightr", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for block_heightr");
-    mdb_set_dupsort(txn, m_block_heights, compare_hash32);
+    MDB_dbi o_txs;
+    blobdata bd;
+    block b;
+    MDB_val hk;
 
-    MDB_cursor *c_old, *c_cur;
-    blk_height bh;
-    MDB_val_set(nv, bh);
+    o_txs = m_txs;
+    mdb_set_compare(txn, o_txs, compare_hash32);
+    lmdb_db_open(txn, "txr", MDB_INTEGERKEY | MDB_CREATE, m_txs, "Failed to open db handle for txr");
 
-    /* old table was k(hash), v(height).
-     * new table is DUPFIXED, k(zeroval), v{hash, height}.
-     */
+    txn.commit();
+
+    MDB_cursor *c_blocks, *c_txs, *c_props, *c_cur;
     i = 0;
     z = m_height;
+
+    hk.mv_size = sizeof(crypto::hash);
+    set_batch_transactions(true);
+    batch_start(1000);
+    txn.m_txn = m_write_txn->m_txn;
+    m_height = 0;
+
     while(1) {
-      if (!(i % 2000)) {
+      if (!(i % 1000)) {
         if (i) {
           LOGIF(el::Level::Info) {
             std::cout << i << " / " << z << "  \r" << std::flush;
           }
+          MDB_val_set(pk, "txblk");
+          MDB_val_set(pv, m_height);
+          result = mdb_cursor_put(c_props, &pk, &pv, 0);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to update txblk property: ", result).c_str()));
           txn.commit();
           result = mdb_txn_begin(m_env, NULL, 0, txn);
           if (result)
             throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+          m_write_txn->m_txn = txn.m_txn;
+          m_write_batch_txn->m_txn = txn.m_txn;
+          memset(&m_wcursors, 0, sizeof(m_wcursors));
         }
-        result = mdb_cursor_open(txn, m_block_heights, &c_cur);
+        result = mdb_cursor_open(txn, m_blocks, &c_blocks);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_heightr: ", result).c_str()));
-        result = mdb_cursor_open(txn, o_heights, &c_old);
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for blocks: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_properties, &c_props);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_heights: ", result).c_str()));
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for properties: ", result).c_str()));
+        result = mdb_cursor_open(txn, o_txs, &c_txs);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs: ", result).c_str()));
         if (!i) {
           MDB_stat ms;
-          result = mdb_stat(txn, m_block_heights, &ms);
+          result = mdb_stat(txn, m_txs, &ms);
           if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to query block_heights table: ", result).c_str()));
+            throw0(DB_ERROR(lmdb_error("Failed to query txs table: ", result).c_str()));
           i = ms.ms_entries;
+          if (i) {
+            MDB_val_set(pk, "txblk");
+            result = mdb_cursor_get(c_props, &pk, &k, MDB_SET);
+            if (result)
+              throw0(DB_ERROR(lmdb_error("Failed to get a record from properties: ", result).c_str()));
+            m_height = *(uint64_t *)k.mv_data;
+          }
+        }
+        if (i) {
+          result = mdb_cursor_get(c_blocks, &k, &v, MDB_SET);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to get a record from blocks: ", result).c_str()));
         }
       }
-      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
+      result = mdb_cursor_get(c_blocks, &k, &v, MDB_NEXT);
       if (result == MDB_NOTFOUND) {
-        txn.commit();
+        MDB_val_set(pk, "txblk");
+        result = mdb_cursor_get(c_props, &pk, &v, MDB_SET);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get a record from props: ", result).c_str()));
+        result = mdb_cursor_del(c_props, 0);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to delete a record from props: ", result).c_str()));
+        batch_stop();
         break;
+      } else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from blocks: ", result).c_str()));
+
+      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      if (!parse_and_validate_block_from_blob(bd, b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+
+      add_transaction(null_hash, b.miner_tx);
+      for (unsigned int j = 0; j<b.tx_hashes.size(); j++) {
+        transaction tx;
+        hk.mv_data = &b.tx_hashes[j];
+        result = mdb_cursor_get(c_txs, &hk, &v, MDB_SET);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get record from txs: ", result).c_str()));
+        bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+        if (!parse_and_validate_tx_from_blob(bd, tx))
+          throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+        add_transaction(null_hash, tx, &b.tx_hashes[j]);
+        result = mdb_cursor_del(c_txs, 0);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get record from txs: ", result).c_str()));
       }
-      else if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_heights: ", result).c_str()));
-      bh.bh_hash = *(crypto::hash *)k.mv_data;
-      bh.bh_height = *(uint64_t *)v.mv_data;
-      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_heightr: ", result).c_str()));
-      /* we delete the old records immediately, so the overall DB and mapsize should not grow.
-       * This is a little slower than just letting mdb_drop() delete it all at the end, but
-       * it saves a significant amount of disk space.
-       */
-      result = mdb_cursor_del(c_old, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_heights: ", result).c_str()));
       i++;
+      m_height = i;
     }
-
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    /* Delete the old table */
-    result = mdb_drop(txn, o_heights, 1);
+    result = mdb_drop(txn, o_txs, 1);
     if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete old block_heights table: ", result).c_str()));
+      throw0(DB_ERROR(lmdb_error("Failed to delete txs from the db: ", result).c_str()));
 
-    RENAME_DB("block_heightr");
+    RENAME_DB("txr");
 
-    /* close and reopen to get old dbi slot back */
-    mdb_dbi_close(m_env, m_block_heights);
-    lmdb_db_open(txn, "block_heights", MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED, m_block_heights, "Failed to open db handle for block_heights");
-    mdb_set_dupsort(txn, m_block_heights, compare_hash32);
-    txn.commit();
+    mdb_dbi_close(m_env, m_txs);
+
+    lmdb_db_open(txn, "txs", MDB_INTEGERKEY, m_txs, "Failed to open db handle for txs");
 
+    txn.commit();
   } while(0);
 
-  /* old tables are k(height), v(value).
-   * new table is DUPFIXED, k(zeroval), v{height, values...}.
-   */
-  do {
-    LOG_PRINT_L1("migrating block info:");
+  uint32_t version = 1;
+  v.mv_data = (void *)&version;
+  v.mv_size = sizeof(version);
+  MDB_val_copy<const char *> vk("version");
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  result = mdb_put(txn, m_properties, &vk, &v, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  txn.commit();
+}
 
-    MDB_dbi coins;
+void BlockchainLMDB::migrate_1_2()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  uint64_t i, z;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+  char *ptr;
+
+  MGINFO_YELLOW("Migrating blockchain from DB version 1 to 2 - this may take a while:");
+  MINFO("updating txs_pruned and txs_prunable tables...");
+
+  do {
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    result = mdb_dbi_open(txn, "block_coins", 0, &coins);
-    if (result == MDB_NOTFOUND) {
-      txn.abort();
-      LOG_PRINT_L1("  block_info already migrated");
+
+    MDB_stat db_stats_txs;
+    MDB_stat db_stats_txs_pruned;
+    MDB_stat db_stats_txs_prunable;
+    MDB_stat db_stats_txs_prunable_hash;
+    if ((result = mdb_stat(txn, m_txs, &db_stats_txs)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_txs: ", result).c_str()));
+    if ((result = mdb_stat(txn, m_txs_pruned, &db_stats_txs_pruned)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
+    if ((result = mdb_stat(txn, m_txs_prunable, &db_stats_txs_prunable)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable: ", result).c_str()));
+    if ((result = mdb_stat(txn, m_txs_prunable_hash, &db_stats_txs_prunable_hash)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable_hash: ", result).c_str()));
+    if (db_stats_txs_pruned.ms_entries != db_stats_txs_prunable.ms_entries)
+      throw0(DB_ERROR("Mismatched sizes for txs_pruned and txs_prunable"));
+    if (db_stats_txs_pruned.ms_entries == db_stats_txs.ms_entries)
+    {
+      txn.commit();
+      MINFO("txs already migrated");
       break;
     }
-    MDB_dbi diffs, hashes, sizes, timestamps;
-    mdb_block_info_old bi;
-    MDB_val_set(nv, bi);
 
-    lmdb_db_open(txn, "block_diffs", 0, diffs, "Failed to open db handle for block_diffs");
-    lmdb_db_open(txn, "block_hashes", 0, hashes, "Failed to open db handle for block_hashes");
-    lmdb_db_open(txn, "block_sizes", 0, sizes, "Failed to open db handle for block_sizes");
-    lmdb_db_open(txn, "block_timestamps", 0, timestamps, "Failed to open db handle for block_timestamps");
-    MDB_cursor *c_cur, *c_coins, *c_diffs, *c_hashes, *c_sizes, *c_timestamps;
+    MINFO("updating txs tables:");
+
+    MDB_cursor *c_old, *c_cur0, *c_cur1, *c_cur2;
     i = 0;
-    z = m_height;
+
     while(1) {
-      MDB_val k, v;
-      if (!(i % 2000)) {
+      if (!(i % 1000)) {
         if (i) {
+          result = mdb_stat(txn, m_txs, &db_stats_txs);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to query m_txs: ", result).c_str()));
           LOGIF(el::Level::Info) {
-            std::cout << i << " / " << z << "  \r" << std::flush;
+            std::cout << i << " / " << (i + db_stats_txs.ms_entries) << "  \r" << std::flush;
           }
           txn.commit();
           result = mdb_txn_begin(m_env, NULL, 0, txn);
           if (result)
             throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
         }
-        result = mdb_cursor_open(txn, m_block_info, &c_cur);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_info: ", result).c_str()));
-        result = mdb_cursor_open(txn, coins, &c_coins);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_coins: ", result).c_str()));
-        result = mdb_cursor_open(txn, diffs, &c_diffs);
+        result = mdb_cursor_open(txn, m_txs_pruned, &c_cur0);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_diffs: ", result).c_str()));
-        result = mdb_cursor_open(txn, hashes, &c_hashes);
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs_prunable, &c_cur1);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_hashes: ", result).c_str()));
-        result = mdb_cursor_open(txn, sizes, &c_sizes);
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs_prunable_hash, &c_cur2);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_coins: ", result).c_str()));
-        result = mdb_cursor_open(txn, timestamps, &c_timestamps);
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_hash: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs, &c_old);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_timestamps: ", result).c_str()));
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs: ", result).c_str()));
         if (!i) {
-          MDB_stat ms;
-          result = mdb_stat(txn, m_block_info, &ms);
-          if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to query block_info table: ", result).c_str()));
-          i = ms.ms_entries;
+          i = db_stats_txs_pruned.ms_entries;
         }
       }
-      result = mdb_cursor_get(c_coins, &k, &v, MDB_NEXT);
+      MDB_val_set(k, i);
+      result = mdb_cursor_get(c_old, &k, &v, MDB_SET);
       if (result == MDB_NOTFOUND) {
+        txn.commit();
         break;
-      } else if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_coins: ", result).c_str()));
-      bi.bi_height = *(uint64_t *)k.mv_data;
-      bi.bi_coins = *(uint64_t *)v.mv_data;
-      result = mdb_cursor_get(c_diffs, &k, &v, MDB_NEXT);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_diffs: ", result).c_str()));
-      bi.bi_diff = *(uint64_t *)v.mv_data;
-      result = mdb_cursor_get(c_hashes, &k, &v, MDB_NEXT);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_hashes: ", result).c_str()));
-      bi.bi_hash = *(crypto::hash *)v.mv_data;
-      result = mdb_cursor_get(c_sizes, &k, &v, MDB_NEXT);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_sizes: ", result).c_str()));
-      if (v.mv_size == sizeof(uint32_t))
-        bi.bi_weight = *(uint32_t *)v.mv_data;
-      else
-        bi.bi_weight = *(uint64_t *)v.mv_data;  // this is a 32/64 compat bug in version 0
-      result = mdb_cursor_get(c_timestamps, &k, &v, MDB_NEXT);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_timestamps: ", result).c_str()));
-      bi.bi_timestamp = *(uint64_t *)v.mv_data;
-      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_info: ", result).c_str()));
-      result = mdb_cursor_del(c_coins, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_coins: ", result).c_str()));
-      result = mdb_cursor_del(c_diffs, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_diffs: ", result).c_str()));
-      result = mdb_cursor_del(c_hashes, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_hashes: ", result).c_str()));
-      result = mdb_cursor_del(c_sizes, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_sizes: ", result).c_str()));
-      result = mdb_cursor_del(c_timestamps, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_timestamps: ", result).c_str()));
-      i++;
-    }
-    mdb_cursor_close(c_timestamps);
-    mdb_cursor_close(c_sizes);
-    mdb_cursor_close(c_hashes);
-    mdb_cursor_close(c_diffs);
-    mdb_cursor_close(c_coins);
-    result = mdb_drop(txn, timestamps, 1);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete block_timestamps from the db: ", result).c_str()));
-    result = mdb_drop(txn, sizes, 1);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete block_sizes from the db: ", result).c_str()));
-    result = mdb_drop(txn, hashes, 1);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete block_hashes from the db: ", result).c_str()));
-    result = mdb_drop(txn, diffs, 1);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete block_diffs from the db: ", result).c_str()));
-    result = mdb_drop(txn, coins, 1);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete block_coins from the db: ", result).c_str()));
-    txn.commit();
-  } while(0);
+      }
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from txs: ", result).c_str()));
 
-  do {
-    LOG_PRINT_L1("migrating hf_versions:");
-    MDB_dbi o_hfv;
+      cryptonote::blobdata bd;
+      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
+      transaction tx;
+      if (!parse_and_validate_tx_from_blob(bd, tx))
+        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+      std::stringstream ss;
+      binary_archive<true> ba(ss);
+      bool r = tx.serialize_base(ba);
+      if (!r)
+        throw0(DB_ERROR("Failed to serialize pruned tx"));
+      std::string pruned = ss.str();
 
-    unsigned int flags;
-    result = mdb_txn_begin(m_env, NULL, 0, txn);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    result = mdb_dbi_flags(txn, m_hf_versions, &flags);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to retrieve hf_versions flags: ", result).c_str()));
-    /* if the flags are what we expect, this table has already been migrated */
-    if (flags & MDB_INTEGERKEY) {
-      txn.abort();
-      LOG_PRINT_L1("  hf_versions already migrated");
-      break;
-    }
+      if (pruned.size() > bd.size())
+        throw0(DB_ERROR("Pruned tx is larger than raw tx"));
+      if (memcmp(pruned.data(), bd.data(), pruned.size()))
+        throw0(DB_ERROR("Pruned tx is not a prefix of the raw tx"));
 
-    /* the hf_versions table name is the same but the old version and new version
-     * have incompatible DB flags. Create a new table with the right flags.
-     */
-    o_hfv = m_hf_versions;
-    lmdb_db_open(txn, "hf_versionr", MDB_INTEGERKEY | MDB_CREATE, m_hf_versions, "Failed to open db handle for hf_versionr");
+      MDB_val nv;
+      nv.mv_data = (void*)pruned.data();
+      nv.mv_size = pruned.size();
+      result = mdb_cursor_put(c_cur0, (MDB_val *)&k, &nv, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_pruned: ", result).c_str()));
 
-    MDB_cursor *c_old, *c_cur;
-    i = 0;
-    z = m_height;
+      nv.mv_data = (void*)(bd.data() + pruned.size());
+      nv.mv_size = bd.size() - pruned.size();
+      result = mdb_cursor_put(c_cur1, (MDB_val *)&k, &nv, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable: ", result).c_str()));
 
-    while(1) {
-      if (!(i % 2000)) {
-        if (i) {
-          LOGIF(el::Level::Info) {
-            std::cout << i << " / " << z << "  \r" << std::flush;
-          }
-          txn.commit();
-          result = mdb_txn_begin(m_env, NULL, 0, txn);
-          if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-        }
-        result = mdb_cursor_open(txn, m_hf_versions, &c_cur);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for spent_keyr: ", result).c_str()));
-        result = mdb_cursor_open(txn, o_hfv, &c_old);
+      if (tx.version > 1)
+      {
+        crypto::hash prunable_hash = get_transaction_prunable_hash(tx);
+        MDB_val_set(val_prunable_hash, prunable_hash);
+        result = mdb_cursor_put(c_cur2, (MDB_val *)&k, &val_prunable_hash, 0);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for spent_keys: ", result).c_str()));
-        if (!i) {
-          MDB_stat ms;
-          result = mdb_stat(txn, m_hf_versions, &ms);
-          if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to query hf_versions table: ", result).c_str()));
-          i = ms.ms_entries;
-        }
-      }
-      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
-      if (result == MDB_NOTFOUND) {
-        txn.commit();
-        break;
+          throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable_hash: ", result).c_str()));
       }
-      else if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from hf_versions: ", result).c_str()));
-      result = mdb_cursor_put(c_cur, &k, &v, MDB_APPEND);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to put a record into hf_versionr: ", result).c_str()));
+
       result = mdb_cursor_del(c_old, 0);
       if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from hf_versions: ", result).c_str()));
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from txs: ", result).c_str()));
+
       i++;
     }
-
-    result = mdb_txn_begin(m_env, NULL, 0, txn);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    /* Delete the old table */
-    result = mdb_drop(txn, o_hfv, 1);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete old hf_versions table: ", result).c_str()));
-    RENAME_DB("hf_versionr");
-    mdb_dbi_close(m_env, m_hf_versions);
-    lmdb_db_open(txn, "hf_versions", MDB_INTEGERKEY, m_hf_versions, "Failed to open db handle for hf_versions");
-
-    txn.commit();
   } while(0);
 
-  do {
-    LOG_PRINT_L1("deleting old indices:");
-
-    /* Delete all other tables, we're just going to recreate them */
-    MDB_dbi dbi;
-    result = mdb_txn_begin(m_env, NULL, 0, txn);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  uint32_t version = 2;
+  v.mv_data = (void *)&version;
+  v.mv_size = sizeof(version);
+  MDB_val_copy<const char *> vk("version");
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  result = mdb_put(txn, m_properties, &vk, &v, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  txn.commit();
+}
 
-    result = mdb_dbi_open(txn, "tx_unlocks", 0, &dbi);
-    if (result == MDB_NOTFOUND) {
-        txn.abort();
-        LOG_PRINT_L1("  old indices already deleted");
-        break;
-    }
-    txn.abort();
+void BlockchainLMDB::migrate_2_3()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  uint64_t i;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+  char *ptr;
 
-#define DELETE_DB(x) do {   \
-    LOG_PRINT_L1("  " x ":"); \
-    result = mdb_txn_begin(m_env, NULL, 0, txn); \
-    if (result) \
-      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str())); \
-    result = mdb_dbi_open(txn, x, 0, &dbi); \
-    if (!result) { \
-      result = mdb_drop(txn, dbi, 1); \
-      if (result) \
-        throw0(DB_ERROR(lmdb_error("Failed to delete " x ": ", result).c_str())); \
-    txn.commit(); \
-    } } while(0)
+  MGINFO_YELLOW("Migrating blockchain from DB version 2 to 3 - this may take a while:");
 
-    DELETE_DB("tx_heights");
-    DELETE_DB("output_txs");
-    DELETE_DB("output_indices");
-    DELETE_DB("output_keys");
-    DELETE_DB("spent_keys");
-    DELETE_DB("output_amounts");
-    DELETE_DB("tx_outputs");
-    DELETE_DB("tx_unlocks");
+  do {
+    LOG_PRINT_L1("migrating block info:");
 
-    /* reopen new DBs with correct flags */
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    lmdb_db_open(txn, LMDB_OUTPUT_TXS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_output_txs, "Failed to open db handle for m_output_txs");
-    mdb_set_dupsort(txn, m_output_txs, compare_uint64);
-    lmdb_db_open(txn, LMDB_TX_OUTPUTS, MDB_INTEGERKEY | MDB_CREATE, m_tx_outputs, "Failed to open db handle for m_tx_outputs");
-    lmdb_db_open(txn, LMDB_SPENT_KEYS, MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_spent_keys, "Failed to open db handle for m_spent_keys");
-    mdb_set_dupsort(txn, m_spent_keys, compare_hash32);
-    lmdb_db_open(txn, LMDB_OUTPUT_AMOUNTS, MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED | MDB_CREATE, m_output_amounts, "Failed to open db handle for m_output_amounts");
-    mdb_set_dupsort(txn, m_output_amounts, compare_uint64);
-    txn.commit();
-  } while(0);
 
-  do {
-    LOG_PRINT_L1("migrating txs and outputs:");
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const uint64_t blockchain_height = db_stats.ms_entries;
 
-    unsigned int flags;
-    result = mdb_txn_begin(m_env, NULL, 0, txn);
-    if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    result = mdb_dbi_flags(txn, m_txs, &flags);
+    MDEBUG("enumerating rct outputs...");
+    std::vector<uint64_t> distribution(blockchain_height, 0);
+    // rct outputs are still under amount 0 in output_amounts at this version
+    MDB_cursor *c_amounts;
+    result = mdb_cursor_open(txn, m_output_amounts, &c_amounts);
     if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to retrieve txs flags: ", result).c_str()));
-    /* if the flags are what we expect, this table has already been migrated */
-    if (flags & MDB_INTEGERKEY) {
-      txn.abort();
-      LOG_PRINT_L1("  txs already migrated");
-      break;
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for output_amounts: ", result).c_str()));
+    uint64_t rct_amount = 0;
+    MDB_cursor_op op = MDB_SET;
+    while (1)
+    {
+      k.mv_size = sizeof(rct_amount);
+      k.mv_data = &rct_amount;
+      result = mdb_cursor_get(c_amounts, &k, &v, op);
+      op = MDB_NEXT_DUP;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to build rct output distribution: ", result).c_str()));
+      const uint64_t height = ((const outkey *)v.mv_data)->data.height;
+      if (height >= blockchain_height)
+        throw0(DB_ERROR("Output found claiming height >= blockchain height"));
+      distribution[height]++;
     }
+    mdb_cursor_close(c_amounts);
+    for (size_t i = 1; i < distribution.size(); ++i)
+      distribution[i] += distribution[i - 1];
 
-    MDB_dbi o_txs;
-    blobdata bd;
-    block b;
-    MDB_val hk;
-
-    o_txs = m_txs;
-    mdb_set_compare(txn, o_txs, compare_hash32);
-    lmdb_db_open(txn, "txr", MDB_INTEGERKEY | MDB_CREATE, m_txs, "Failed to open db handle for txr");
-
-    txn.commit();
+    /* the block_info table name is the same but the old version and new version
+     * have incompatible data. Create a new table. We want the name to be similar
+     * to the old name so that it will occupy the same location in the DB.
+     */
+    MDB_dbi o_block_info = m_block_info;
+    lmdb_db_open(txn, "block_infn", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for block_infn");
+    mdb_set_dupsort(txn, m_block_info, compare_uint64);
 
-    MDB_cursor *c_blocks, *c_txs, *c_props, *c_cur;
+    MDB_cursor *c_old, *c_cur;
     i = 0;
-    z = m_height;
-
-    hk.mv_size = sizeof(crypto::hash);
-    set_batch_transactions(true);
-    batch_start(1000);
-    txn.m_txn = m_write_txn->m_txn;
-    m_height = 0;
-
     while(1) {
       if (!(i % 1000)) {
         if (i) {
           LOGIF(el::Level::Info) {
-            std::cout << i << " / " << z << "  \r" << std::flush;
+            std::cout << i << " / " << blockchain_height << "  \r" << std::flush;
           }
-          MDB_val_set(pk, "txblk");
-          MDB_val_set(pv, m_height);
-          result = mdb_cursor_put(c_props, &pk, &pv, 0);
-          if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to update txblk property: ", result).c_str()));
           txn.commit();
           result = mdb_txn_begin(m_env, NULL, 0, txn);
           if (result)
             throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-          m_write_txn->m_txn = txn.m_txn;
-          m_write_batch_txn->m_txn = txn.m_txn;
-          memset(&m_wcursors, 0, sizeof(m_wcursors));
         }
-        result = mdb_cursor_open(txn, m_blocks, &c_blocks);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for blocks: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_properties, &c_props);
+        result = mdb_cursor_open(txn, m_block_info, &c_cur);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for properties: ", result).c_str()));
-        result = mdb_cursor_open(txn, o_txs, &c_txs);
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_infn: ", result).c_str()));
+        result = mdb_cursor_open(txn, o_block_info, &c_old);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs: ", result).c_str()));
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_info: ", result).c_str()));
         if (!i) {
-          MDB_stat ms;
-          result = mdb_stat(txn, m_txs, &ms);
-          if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to query txs table: ", result).c_str()));
-          i = ms.ms_entries;
-          if (i) {
-            MDB_val_set(pk, "txblk");
-            result = mdb_cursor_get(c_props, &pk, &k, MDB_SET);
-            if (result)
-              throw0(DB_ERROR(lmdb_error("Failed to get a record from properties: ", result).c_str()));
-            m_height = *(uint64_t *)k.mv_data;
-          }
-        }
-        if (i) {
-          result = mdb_cursor_get(c_blocks, &k, &v, MDB_SET);
+          MDB_stat db_stat;
+          result = mdb_stat(txn, m_block_info, &db_stats);
           if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to get a record from blocks: ", result).c_str()));
+            throw0(DB_ERROR(lmdb_error("Failed to query m_block_info: ", result).c_str()));
+          i = db_stats.ms_entries;
         }
       }
-      result = mdb_cursor_get(c_blocks, &k, &v, MDB_NEXT);
+      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
       if (result == MDB_NOTFOUND) {
-        MDB_val_set(pk, "txblk");
-        result = mdb_cursor_get(c_props, &pk, &v, MDB_SET);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to get a record from props: ", result).c_str()));
-        result = mdb_cursor_del(c_props, 0);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to delete a record from props: ", result).c_str()));
-        batch_stop();
+        txn.commit();
         break;
-      } else if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from blocks: ", result).c_str()));
-
-      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-      if (!parse_and_validate_block_from_blob(bd, b))
-        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
-
-      add_transaction(null_hash, b.miner_tx);
-      for (unsigned int j = 0; j<b.tx_hashes.size(); j++) {
-        transaction tx;
-        hk.mv_data = &b.tx_hashes[j];
-        result = mdb_cursor_get(c_txs, &hk, &v, MDB_SET);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to get record from txs: ", result).c_str()));
-        bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-        if (!parse_and_validate_tx_from_blob(bd, tx))
-          throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-        add_transaction(null_hash, tx, &b.tx_hashes[j]);
-        result = mdb_cursor_del(c_txs, 0);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to get record from txs: ", result).c_str()));
       }
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_info: ", result).c_str()));
+      const mdb_block_info_1 *bi_old = (const mdb_block_info_1*)v.mv_data;
+      mdb_block_info_2 bi;
+      bi.bi_height = bi_old->bi_height;
+      bi.bi_timestamp = bi_old->bi_timestamp;
+      bi.bi_coins = bi_old->bi_coins;
+      bi.bi_weight = bi_old->bi_weight;
+      bi.bi_diff = bi_old->bi_diff;
+      bi.bi_hash = bi_old->bi_hash;
+      if (bi_old->bi_height >= distribution.size())
+        throw0(DB_ERROR("Bad height in block_info record"));
+      bi.bi_cum_rct = distribution[bi_old->bi_height];
+      MDB_val_set(nv, bi);
+      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_infn: ", result).c_str()));
+      /* we delete the old records immediately, so the overall DB and mapsize should not grow.
+       * This is a little slower than just letting mdb_drop() delete it all at the end, but
+       * it saves a significant amount of disk space.
+       */
+      result = mdb_cursor_del(c_old, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_info: ", result).c_str()));
       i++;
-      m_height = i;
     }
+
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
-    result = mdb_drop(txn, o_txs, 1);
+    /* Delete the old table */
+    result = mdb_drop(txn, o_block_info, 1);
     if (result)
-      throw0(DB_ERROR(lmdb_error("Failed to delete txs from the db: ", result).c_str()));
+      throw0(DB_ERROR(lmdb_error("Failed to delete old block_info table: ", result).c_str()));
 
-    RENAME_DB("txr");
+    RENAME_DB("block_infn");
 
-    mdb_dbi_close(m_env, m_txs);
+    lmdb_db_open(txn, "block_info", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for block_infn");
+    mdb_set_dupsort(txn, m_block_info, compare_uint64);
 
-    lmdb_db_open(txn, "txs", MDB_INTEGERKEY, m_txs, "Failed to open db handle for txs");
+    txn.commit();
+  } while(0);
+
+  uint32_t version = 3;
+  v.mv_data = (void *)&version;
+  v.mv_size = sizeof(version);
+  MDB_val_copy<const char *> vk("version");
+  result = mdb_txn_begin(m_env, NULL, 0, txn);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+  result = mdb_put(txn, m_properties, &vk, &v, 0);
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Failed to update version for the db: ", result).c_str()));
+  txn.commit();
+}
+
+void BlockchainLMDB::migrate_3_4()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  uint64_t i;
+  int result;
+  mdb_txn_safe txn(false);
+  MDB_val k, v;
+
+  MGINFO_YELLOW("Migrating blockchain from DB version 3 to 4 - this may take a while:");
+
+  do {
+    LOG_PRINT_L1("moving rct outputs to rct_outputs:");
 
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_output_txs, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_output_txs: ", result).c_str()));
+    const uint64_t total_outputs = db_stats.ms_entries;
     txn.commit();
+
+    /* Outputs are moved in order and deleted from output_amounts as we go, so
+     * an interrupted migration picks up where it stopped, and the DB does not
+     * grow much beyond its current size.
+     */
+    MDB_cursor *c_old, *c_new;
+    uint64_t rct_amount = 0;
+    i = 0;
+    while(1) {
+      if (!(i % 1000)) {
+        if (i) {
+          LOGIF(el::Level::Info) {
+            std::cout << i << " / " << total_outputs << "  \r" << std::flush;
+          }
+          txn.commit();
+        }
+        result = mdb_txn_begin(m_env, NULL, 0, txn);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_output_amounts, &c_old);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for output_amounts: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_rct_outputs, &c_new);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for rct_outputs: ", result).c_str()));
+      }
+      k.mv_size = sizeof(rct_amount);
+      k.mv_data = &rct_amount;
+      result = mdb_cursor_get(c_old, &k, &v, MDB_SET);
+      if (result == MDB_NOTFOUND) {
+        txn.commit();
+        break;
+      }
+      else if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from output_amounts: ", result).c_str()));
+      const outkey *ok = (const outkey *)v.mv_data;
+      const uint64_t amount_index = ok->amount_index;
+      rct_outval rv;
+      rv.output_id = ok->output_id;
+      rv.data = ok->data;
+      MDB_val_set(nk, amount_index);
+      MDB_val_set(nv, rv);
+      result = mdb_cursor_put(c_new, &nk, &nv, MDB_APPEND);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into rct_outputs: ", result).c_str()));
+      result = mdb_cursor_del(c_old, 0);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from output_amounts: ", result).c_str()));
+      i++;
+    }
   } while(0);
 
-  uint32_t version = 1;
+  uint32_t version = 4;
   v.mv_data = (void *)&version;
   v.mv_size = sizeof(version);
   MDB_val_copy<const char *> vk("version");
@@ -4060,136 +6505,130 @@ void BlockchainLMDB::migrate_0_1()
   txn.commit();
 }
 
-void BlockchainLMDB::migrate_1_2()
+void BlockchainLMDB::migrate_4_5()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
-  uint64_t i, z;
+  uint64_t i;
   int result;
   mdb_txn_safe txn(false);
   MDB_val k, v;
   char *ptr;
 
-  MGINFO_YELLOW("Migrating blockchain from DB version 1 to 2 - this may take a while:");
-  MINFO("updating txs_pruned and txs_prunable tables...");
+  MGINFO_YELLOW("Migrating blockchain from DB version 4 to 5 - this may take a while:");
 
   do {
+    LOG_PRINT_L1("adding first txn IDs to block info:");
+
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
       throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
 
-    MDB_stat db_stats_txs;
-    MDB_stat db_stats_txs_pruned;
-    MDB_stat db_stats_txs_prunable;
-    MDB_stat db_stats_txs_prunable_hash;
-    if ((result = mdb_stat(txn, m_txs, &db_stats_txs)))
-      throw0(DB_ERROR(lmdb_error("Failed to query m_txs: ", result).c_str()));
-    if ((result = mdb_stat(txn, m_txs_pruned, &db_stats_txs_pruned)))
-      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_pruned: ", result).c_str()));
-    if ((result = mdb_stat(txn, m_txs_prunable, &db_stats_txs_prunable)))
-      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable: ", result).c_str()));
-    if ((result = mdb_stat(txn, m_txs_prunable_hash, &db_stats_txs_prunable_hash)))
-      throw0(DB_ERROR(lmdb_error("Failed to query m_txs_prunable_hash: ", result).c_str()));
-    if (db_stats_txs_pruned.ms_entries != db_stats_txs_prunable.ms_entries)
-      throw0(DB_ERROR("Mismatched sizes for txs_pruned and txs_prunable"));
-    if (db_stats_txs_pruned.ms_entries == db_stats_txs.ms_entries)
+    MDB_stat db_stats;
+    if ((result = mdb_stat(txn, m_blocks, &db_stats)))
+      throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
+    const uint64_t blockchain_height = db_stats.ms_entries;
+
+    MDEBUG("enumerating txn indices...");
+    std::vector<uint64_t> first_tx_id(blockchain_height, std::numeric_limits<uint64_t>::max());
+    MDB_cursor *c_indices;
+    result = mdb_cursor_open(txn, m_tx_indices, &c_indices);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to open a cursor for tx_indices: ", result).c_str()));
+    MDB_cursor_op op = MDB_FIRST;
+    while (1)
     {
-      txn.commit();
-      MINFO("txs already migrated");
-      break;
+      result = mdb_cursor_get(c_indices, &k, &v, op);
+      op = MDB_NEXT;
+      if (result == MDB_NOTFOUND)
+        break;
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to enumerate txn indices: ", result).c_str()));
+      const txindex *ti = (const txindex *)v.mv_data;
+      if (ti->data.block_id >= blockchain_height)
+        throw0(DB_ERROR("Txn found claiming height >= blockchain height"));
+      first_tx_id[ti->data.block_id] = std::min(first_tx_id[ti->data.block_id], ti->data.tx_id);
     }
+    mdb_cursor_close(c_indices);
 
-    MINFO("updating txs tables:");
+    /* As in migrate_2_3, the new records do not fit the old table: write
+     * them to a new one, deleting the old records as we go.
+     */
+    MDB_dbi o_block_info = m_block_info;
+    lmdb_db_open(txn, "block_infn", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for block_infn");
+    mdb_set_dupsort(txn, m_block_info, compare_uint64);
 
-    MDB_cursor *c_old, *c_cur0, *c_cur1, *c_cur2;
+    MDB_cursor *c_old, *c_cur;
     i = 0;
-
     while(1) {
       if (!(i % 1000)) {
         if (i) {
-          result = mdb_stat(txn, m_txs, &db_stats_txs);
-          if (result)
-            throw0(DB_ERROR(lmdb_error("Failed to query m_txs: ", result).c_str()));
           LOGIF(el::Level::Info) {
-            std::cout << i << " / " << (i + db_stats_txs.ms_entries) << "  \r" << std::flush;
+            std::cout << i << " / " << blockchain_height << "  \r" << std::flush;
           }
           txn.commit();
           result = mdb_txn_begin(m_env, NULL, 0, txn);
           if (result)
             throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
         }
-        result = mdb_cursor_open(txn, m_txs_pruned, &c_cur0);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs_prunable, &c_cur1);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs_prunable_hash, &c_cur2);
+        result = mdb_cursor_open(txn, m_block_info, &c_cur);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_prunable_hash: ", result).c_str()));
-        result = mdb_cursor_open(txn, m_txs, &c_old);
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_infn: ", result).c_str()));
+        result = mdb_cursor_open(txn, o_block_info, &c_old);
         if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs: ", result).c_str()));
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_info: ", result).c_str()));
         if (!i) {
-          i = db_stats_txs_pruned.ms_entries;
+          result = mdb_stat(txn, m_block_info, &db_stats);
+          if (result)
+            throw0(DB_ERROR(lmdb_error("Failed to query m_block_info: ", result).c_str()));
+          i = db_stats.ms_entries;
         }
       }
-      MDB_val_set(k, i);
-      result = mdb_cursor_get(c_old, &k, &v, MDB_SET);
+      result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
       if (result == MDB_NOTFOUND) {
         txn.commit();
         break;
       }
       else if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to get a record from txs: ", result).c_str()));
-
-      cryptonote::blobdata bd;
-      bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-      transaction tx;
-      if (!parse_and_validate_tx_from_blob(bd, tx))
-        throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
-      std::stringstream ss;
-      binary_archive<true> ba(ss);
-      bool r = tx.serialize_base(ba);
-      if (!r)
-        throw0(DB_ERROR("Failed to serialize pruned tx"));
-      std::string pruned = ss.str();
-
-      if (pruned.size() > bd.size())
-        throw0(DB_ERROR("Pruned tx is larger than raw tx"));
-      if (memcmp(pruned.data(), bd.data(), pruned.size()))
-        throw0(DB_ERROR("Pruned tx is not a prefix of the raw tx"));
-
-      MDB_val nv;
-      nv.mv_data = (void*)pruned.data();
-      nv.mv_size = pruned.size();
-      result = mdb_cursor_put(c_cur0, (MDB_val *)&k, &nv, 0);
-      if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_pruned: ", result).c_str()));
-
-      nv.mv_data = (void*)(bd.data() + pruned.size());
-      nv.mv_size = bd.size() - pruned.size();
-      result = mdb_cursor_put(c_cur1, (MDB_val *)&k, &nv, 0);
+        throw0(DB_ERROR(lmdb_error("Failed to get a record from block_info: ", result).c_str()));
+      const mdb_block_info_2 *bi_old = (const mdb_block_info_2*)v.mv_data;
+      mdb_block_info_3 bi;
+      bi.bi_height = bi_old->bi_height;
+      bi.bi_timestamp = bi_old->bi_timestamp;
+      bi.bi_coins = bi_old->bi_coins;
+      bi.bi_weight = bi_old->bi_weight;
+      bi.bi_diff = bi_old->bi_diff;
+      bi.bi_hash = bi_old->bi_hash;
+      bi.bi_cum_rct = bi_old->bi_cum_rct;
+      if (bi_old->bi_height >= first_tx_id.size() || first_tx_id[bi_old->bi_height] == std::numeric_limits<uint64_t>::max())
+        throw0(DB_ERROR("Bad height in block_info record"));
+      bi.bi_first_tx_id = first_tx_id[bi_old->bi_height];
+      MDB_val_set(nv, bi);
+      result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
       if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable: ", result).c_str()));
-
-      if (tx.version > 1)
-      {
-        crypto::hash prunable_hash = get_transaction_prunable_hash(tx);
-        MDB_val_set(val_prunable_hash, prunable_hash);
-        result = mdb_cursor_put(c_cur2, (MDB_val *)&k, &val_prunable_hash, 0);
-        if (result)
-          throw0(DB_ERROR(lmdb_error("Failed to put a record into txs_prunable_hash: ", result).c_str()));
-      }
-
+        throw0(DB_ERROR(lmdb_error("Failed to put a record into block_infn: ", result).c_str()));
       result = mdb_cursor_del(c_old, 0);
       if (result)
-        throw0(DB_ERROR(lmdb_error("Failed to delete a record from txs: ", result).c_str()));
-
+        throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_info: ", result).c_str()));
       i++;
     }
+
+    result = mdb_txn_begin(m_env, NULL, 0, txn);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to create a transaction for the db: ", result).c_str()));
+    /* Delete the old table */
+    result = mdb_drop(txn, o_block_info, 1);
+    if (result)
+      throw0(DB_ERROR(lmdb_error("Failed to delete old block_info table: ", result).c_str()));
+
+    RENAME_DB("block_infn");
+
+    lmdb_db_open(txn, "block_info", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for block_infn");
+    mdb_set_dupsort(txn, m_block_info, compare_uint64);
+
+    txn.commit();
   } while(0);
 
-  uint32_t version = 2;
+  uint32_t version = 5;
   v.mv_data = (void *)&version;
   v.mv_size = sizeof(version);
   MDB_val_copy<const char *> vk("version");
@@ -4202,7 +6641,7 @@ void BlockchainLMDB::migrate_1_2()
   txn.commit();
 }
 
-void BlockchainLMDB::migrate_2_3()
+void BlockchainLMDB::migrate_5_6()
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   uint64_t i;
@@ -4211,10 +6650,10 @@ void BlockchainLMDB::migrate_2_3()
   MDB_val k, v;
   char *ptr;
 
-  MGINFO_YELLOW("Migrating blockchain from DB version 2 to 3 - this may take a while:");
+  MGINFO_YELLOW("Migrating blockchain from DB version 5 to 6 - this may take a while:");
 
   do {
-    LOG_PRINT_L1("migrating block info:");
+    LOG_PRINT_L1("adding cumulative emission and fees to block info:");
 
     result = mdb_txn_begin(m_env, NULL, 0, txn);
     if (result)
@@ -4225,31 +6664,15 @@ void BlockchainLMDB::migrate_2_3()
       throw0(DB_ERROR(lmdb_error("Failed to query m_blocks: ", result).c_str()));
     const uint64_t blockchain_height = db_stats.ms_entries;
 
-    MDEBUG("enumerating rct outputs...");
-    std::vector<uint64_t> distribution(blockchain_height, 0);
-    bool r = for_all_outputs(0, [&](uint64_t height) {
-      if (height >= blockchain_height)
-      {
-        MERROR("Output found claiming height >= blockchain height");
-        return false;
-      }
-      distribution[height]++;
-      return true;
-    });
-    if (!r)
-      throw0(DB_ERROR("Failed to build rct output distribution"));
-    for (size_t i = 1; i < distribution.size(); ++i)
-      distribution[i] += distribution[i - 1];
-
-    /* the block_info table name is the same but the old version and new version
-     * have incompatible data. Create a new table. We want the name to be similar
-     * to the old name so that it will occupy the same location in the DB.
+    /* As in migrate_2_3, the new records do not fit the old table: write
+     * them to a new one, deleting the old records as we go.
      */
     MDB_dbi o_block_info = m_block_info;
     lmdb_db_open(txn, "block_infn", MDB_INTEGERKEY | MDB_CREATE | MDB_DUPSORT | MDB_DUPFIXED, m_block_info, "Failed to open db handle for block_infn");
     mdb_set_dupsort(txn, m_block_info, compare_uint64);
 
-    MDB_cursor *c_old, *c_cur;
+    MDB_cursor *c_old, *c_cur, *c_blocks, *c_txs;
+    uint64_t cum_emission = 0, cum_fees = 0;
     i = 0;
     while(1) {
       if (!(i % 1000)) {
@@ -4268,12 +6691,25 @@ void BlockchainLMDB::migrate_2_3()
         result = mdb_cursor_open(txn, o_block_info, &c_old);
         if (result)
           throw0(DB_ERROR(lmdb_error("Failed to open a cursor for block_info: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_blocks, &c_blocks);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for blocks: ", result).c_str()));
+        result = mdb_cursor_open(txn, m_txs_pruned, &c_txs);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to open a cursor for txs_pruned: ", result).c_str()));
         if (!i) {
-          MDB_stat db_stat;
           result = mdb_stat(txn, m_block_info, &db_stats);
           if (result)
             throw0(DB_ERROR(lmdb_error("Failed to query m_block_info: ", result).c_str()));
           i = db_stats.ms_entries;
+          if (i) {
+            /* resuming an interrupted migration: carry on from the last record written */
+            result = mdb_cursor_get(c_cur, &k, &v, MDB_LAST);
+            if (result)
+              throw0(DB_ERROR(lmdb_error("Failed to get the last record from block_infn: ", result).c_str()));
+            cum_emission = ((const mdb_block_info_4*)v.mv_data)->bi_cum_emission;
+            cum_fees = ((const mdb_block_info_4*)v.mv_data)->bi_cum_fees;
+          }
         }
       }
       result = mdb_cursor_get(c_old, &k, &v, MDB_NEXT);
@@ -4283,25 +6719,52 @@ void BlockchainLMDB::migrate_2_3()
       }
       else if (result)
         throw0(DB_ERROR(lmdb_error("Failed to get a record from block_info: ", result).c_str()));
-      const mdb_block_info_old *bi_old = (const mdb_block_info_old*)v.mv_data;
-      mdb_block_info bi;
+      const mdb_block_info_3 *bi_old = (const mdb_block_info_3*)v.mv_data;
+      mdb_block_info_4 bi;
       bi.bi_height = bi_old->bi_height;
       bi.bi_timestamp = bi_old->bi_timestamp;
       bi.bi_coins = bi_old->bi_coins;
       bi.bi_weight = bi_old->bi_weight;
       bi.bi_diff = bi_old->bi_diff;
       bi.bi_hash = bi_old->bi_hash;
-      if (bi_old->bi_height >= distribution.size())
-        throw0(DB_ERROR("Bad height in block_info record"));
-      bi.bi_cum_rct = distribution[bi_old->bi_height];
+      bi.bi_cum_rct = bi_old->bi_cum_rct;
+      bi.bi_first_tx_id = bi_old->bi_first_tx_id;
+
+      /* the block gives the number of txes, which follow the miner tx in id order */
+      MDB_val_set(kb, bi.bi_height);
+      MDB_val vb;
+      result = mdb_cursor_get(c_blocks, &kb, &vb, MDB_SET);
+      if (result)
+        throw0(DB_ERROR(lmdb_error("Failed to get block: ", result).c_str()));
+      block b;
+      if (!parse_and_validate_block_from_blob(blobdata((const char*)vb.mv_data, vb.mv_size), b))
+        throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+      uint64_t coinbase = 0, fees = 0;
+      for (uint64_t n = 0; n <= b.tx_hashes.size(); ++n)
+      {
+        uint64_t tx_id = bi.bi_first_tx_id + n;
+        MDB_val_set(kt, tx_id);
+        MDB_val vt;
+        result = mdb_cursor_get(c_txs, &kt, &vt, MDB_SET);
+        if (result)
+          throw0(DB_ERROR(lmdb_error("Failed to get tx: ", result).c_str()));
+        transaction tx;
+        if (!parse_and_validate_tx_base_from_blob(blobdata((const char*)vt.mv_data, vt.mv_size), tx))
+          throw0(DB_ERROR("Failed to parse tx from blob retrieved from the db"));
+        if (n == 0)
+          coinbase = get_outs_money_amount(tx);
+        else
+          fees += get_tx_fee(tx);
+      }
+      cum_emission += coinbase - fees;
+      cum_fees += fees;
+      bi.bi_cum_emission = cum_emission;
+      bi.bi_cum_fees = cum_fees;
+
       MDB_val_set(nv, bi);
       result = mdb_cursor_put(c_cur, (MDB_val *)&zerokval, &nv, MDB_APPENDDUP);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to put a record into block_infn: ", result).c_str()));
-      /* we delete the old records immediately, so the overall DB and mapsize should not grow.
-       * This is a little slower than just letting mdb_drop() delete it all at the end, but
-       * it saves a significant amount of disk space.
-       */
       result = mdb_cursor_del(c_old, 0);
       if (result)
         throw0(DB_ERROR(lmdb_error("Failed to delete a record from block_info: ", result).c_str()));
@@ -4324,7 +6787,7 @@ void BlockchainLMDB::migrate_2_3()
     txn.commit();
   } while(0);
 
-  uint32_t version = 3;
+  uint32_t version = 6;
   v.mv_data = (void *)&version;
   v.mv_size = sizeof(version);
   MDB_val_copy<const char *> vk("version");
@@ -4346,6 +6809,12 @@ void BlockchainLMDB::migrate(const uint32_t oldversion)
     migrate_1_2(); /* FALLTHRU */
   case 2:
     migrate_2_3(); /* FALLTHRU */
+  case 3:
+    migrate_3_4(); /* FALLTHRU */
+  case 4:
+    migrate_4_5(); /* FALLTHRU */
+  case 5:
+    migrate_5_6(); /* FALLTHRU */
   default:
     ;
   }
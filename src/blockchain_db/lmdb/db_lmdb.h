@@ -28,10 +28,13 @@
 #pragma once
 
 #include <atomic>
+#include <map>
 
 #include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/key_image_filter.h"
 #include "cryptonote_basic/blobdatatype.h" // for type blobdata
 #include "ringct/rctTypes.h"
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/tss.hpp>
 
 #include <lmdb.h>
@@ -46,9 +49,13 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_blocks;
   MDB_cursor *m_txc_block_heights;
   MDB_cursor *m_txc_block_info;
+  MDB_cursor *m_txc_block_filters;
+  MDB_cursor *m_txc_pow_hashes;
+  MDB_cursor *m_txc_alt_blocks;
 
   MDB_cursor *m_txc_output_txs;
   MDB_cursor *m_txc_output_amounts;
+  MDB_cursor *m_txc_rct_outputs;
 
   MDB_cursor *m_txc_txs;
   MDB_cursor *m_txc_txs_pruned;
@@ -58,6 +65,8 @@ typedef struct mdb_txn_cursors
   MDB_cursor *m_txc_tx_outputs;
 
   MDB_cursor *m_txc_spent_keys;
+  MDB_cursor *m_txc_spent_key_txs;
+  MDB_cursor *m_txc_output_keys;
 
   MDB_cursor *m_txc_txpool_meta;
   MDB_cursor *m_txc_txpool_blob;
@@ -68,8 +77,12 @@ typedef struct mdb_txn_cursors
 #define m_cur_blocks	m_cursors->m_txc_blocks
 #define m_cur_block_heights	m_cursors->m_txc_block_heights
 #define m_cur_block_info	m_cursors->m_txc_block_info
+#define m_cur_block_filters	m_cursors->m_txc_block_filters
+#define m_cur_pow_hashes	m_cursors->m_txc_pow_hashes
+#define m_cur_alt_blocks	m_cursors->m_txc_alt_blocks
 #define m_cur_output_txs	m_cursors->m_txc_output_txs
 #define m_cur_output_amounts	m_cursors->m_txc_output_amounts
+#define m_cur_rct_outputs	m_cursors->m_txc_rct_outputs
 #define m_cur_txs	m_cursors->m_txc_txs
 #define m_cur_txs_pruned	m_cursors->m_txc_txs_pruned
 #define m_cur_txs_prunable	m_cursors->m_txc_txs_prunable
@@ -77,6 +90,8 @@ typedef struct mdb_txn_cursors
 #define m_cur_tx_indices	m_cursors->m_txc_tx_indices
 #define m_cur_tx_outputs	m_cursors->m_txc_tx_outputs
 #define m_cur_spent_keys	m_cursors->m_txc_spent_keys
+#define m_cur_spent_key_txs	m_cursors->m_txc_spent_key_txs
+#define m_cur_output_keys	m_cursors->m_txc_output_keys
 #define m_cur_txpool_meta	m_cursors->m_txc_txpool_meta
 #define m_cur_txpool_blob	m_cursors->m_txc_txpool_blob
 #define m_cur_hf_versions	m_cursors->m_txc_hf_versions
@@ -87,8 +102,12 @@ typedef struct mdb_rflags
   bool m_rf_blocks;
   bool m_rf_block_heights;
   bool m_rf_block_info;
+  bool m_rf_block_filters;
+  bool m_rf_pow_hashes;
+  bool m_rf_alt_blocks;
   bool m_rf_output_txs;
   bool m_rf_output_amounts;
+  bool m_rf_rct_outputs;
   bool m_rf_txs;
   bool m_rf_txs_pruned;
   bool m_rf_txs_prunable;
@@ -96,6 +115,8 @@ typedef struct mdb_rflags
   bool m_rf_tx_indices;
   bool m_rf_tx_outputs;
   bool m_rf_spent_keys;
+  bool m_rf_spent_key_txs;
+  bool m_rf_output_keys;
   bool m_rf_txpool_meta;
   bool m_rf_txpool_blob;
   bool m_rf_hf_versions;
@@ -200,7 +221,28 @@ public:
 
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const;
 
+  virtual bool get_block_blob_view(uint64_t height, epee::span<const uint8_t>& blob) const;
+
+  virtual bool get_block_filter(uint64_t height, cryptonote::blobdata& filter) const;
+
+  virtual bool get_pow_hash(const crypto::hash& blk_hash, crypto::hash& pow_hash) const;
+
+  virtual void add_pow_hash(const crypto::hash& blk_hash, const crypto::hash& pow_hash);
+
+  virtual bool has_explorer_index() const;
+
+  virtual bool get_key_image_spender(const crypto::key_image& k_image, crypto::hash& tx_hash) const;
+
+  virtual bool get_output_locations(const crypto::public_key& key, std::vector<output_location_t>& locations) const;
+
+  virtual uint32_t get_blockchain_pruning_seed() const;
+  virtual bool prune_blockchain(uint32_t pruning_seed = 0);
+  virtual bool update_pruning();
+
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
+  virtual std::vector<uint64_t> get_block_cumulative_rct_outputs_range(uint64_t from_height, uint64_t to_height) const;
+
+  virtual void get_block_header_entries(uint64_t h1, uint64_t h2, std::vector<block_header_entry_t> &entries) const;
 
   virtual uint64_t get_block_timestamp(const uint64_t& height) const;
 
@@ -214,6 +256,8 @@ public:
 
   virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const;
 
+  virtual void get_block_cumulative_emission_and_fees(const uint64_t& height, uint64_t &emission, uint64_t &fees) const;
+
   virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const;
 
   virtual std::vector<block> get_blocks_range(const uint64_t& h1, const uint64_t& h2) const;
@@ -233,6 +277,9 @@ public:
 
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+  virtual bool get_block_tx_blobs(uint64_t height, std::vector<cryptonote::blobdata> &bds, bool pruned) const;
+
+  virtual size_t get_tx_blobs(const std::vector<crypto::hash> &hashes, std::vector<cryptonote::blobdata> &bds, std::vector<bool> &found, bool pruned = false) const;
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const;
 
   virtual uint64_t get_tx_count() const;
@@ -254,9 +301,12 @@ public:
   virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const;
 
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const;
+  virtual void get_blocks_amount_output_indices(uint64_t start_height, size_t count, std::vector<std::vector<std::vector<uint64_t>>> &indices) const;
 
   virtual bool has_key_image(const crypto::key_image& img) const;
 
+  virtual void has_key_images(const std::vector<crypto::key_image>& imgs, std::vector<bool>& spent) const;
+
   virtual void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t& meta);
   virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta);
   virtual uint64_t get_txpool_tx_count(bool include_unrelayed_txes = true) const;
@@ -266,9 +316,18 @@ public:
   virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const;
   virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const;
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob = false, bool include_unrelayed_txes = true) const;
+  virtual bool snapshot_txpool();
+
+  virtual void add_alt_block(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata &blob);
+  virtual bool get_alt_block(const crypto::hash &blkid, alt_block_data_t *data, cryptonote::blobdata *blob) const;
+  virtual void remove_alt_block(const crypto::hash &blkid);
+  virtual uint64_t get_alt_block_count();
+  virtual void drop_alt_blocks();
+  virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata *blob)> f, bool include_blob = false) const;
 
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
   virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
+  virtual void prefetch_blocks(uint64_t start_height, uint64_t count) const;
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>, bool pruned) const;
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const;
   virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const;
@@ -290,6 +349,7 @@ public:
   virtual void block_txn_stop();
   virtual void block_txn_abort();
   virtual bool block_rtxn_start(MDB_txn **mtxn, mdb_txn_cursors **mcur) const;
+  virtual bool block_rtxn_start() const;
   virtual void block_rtxn_stop() const;
 
   virtual void pop_block(block& blk, std::vector<transaction>& txs);
@@ -322,11 +382,15 @@ private:
                 , const difficulty_type& cumulative_difficulty
                 , const uint64_t& coins_generated
                 , uint64_t num_rct_outs
+                , uint64_t emission
+                , uint64_t fees
                 , const crypto::hash& block_hash
                 );
 
   virtual void remove_block();
 
+  virtual void add_block_filter(uint64_t height, const cryptonote::blobdata& filter);
+
   virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash);
 
   virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx);
@@ -346,8 +410,16 @@ private:
 
   void remove_output(const uint64_t amount, const uint64_t& out_index);
 
+  // explorer index upkeep, only called when m_has_explorer_index
+  void add_spent_key_txs(const crypto::hash& tx_hash, const transaction& tx);
+  void remove_spent_key_txs(const transaction& tx);
+  void add_output_key(const crypto::public_key& key, uint64_t amount, uint64_t amount_index);
+  void remove_output_key(const crypto::public_key& key, uint64_t amount, uint64_t amount_index);
+
   virtual void add_spent_key(const crypto::key_image& k_image);
 
+  virtual void add_spent_keys(const std::vector<crypto::key_image>& k_images);
+
   virtual void remove_spent_key(const crypto::key_image& k_image);
 
   uint64_t num_outputs() const;
@@ -382,6 +454,11 @@ private:
 
   virtual uint64_t get_database_size() const;
 
+  virtual bool get_key_image_filter_stats(key_image_filter_stats &stats) const;
+  virtual bool get_map_usage(uint64_t &map_size, uint64_t &used) const;
+  virtual bool get_resize_stats(uint64_t &resizes, uint64_t &blocked_ns) const;
+  virtual bool backup(const std::string &folder, uint64_t max_bytes_per_second, const std::function<bool(uint64_t)> &progress = NULL);
+
   // fix up anything that may be wrong due to past bugs
   virtual void fixup();
 
@@ -397,14 +474,53 @@ private:
   // migrate from DB version 2 to 3
   void migrate_2_3();
 
+  // migrate from DB version 3 to 4
+  void migrate_3_4();
+
+  // migrate from DB version 4 to 5
+  void migrate_4_5();
+
+  // migrate from DB version 5 to 6
+  void migrate_5_6();
+
   void cleanup_batch();
 
+  // fill m_key_image_filter from m_spent_keys
+  void init_key_image_filter();
+
+  // index the blocks added before the explorer indexes were, from where
+  // an earlier, interrupted run left off
+  void build_explorer_index();
+
+  // drop the prunable data of the blocks left to prune, returns how many txes lost theirs
+  uint64_t prune_worker(uint32_t pruning_seed);
+
+  // replace the db with a copy without free pages, reopening it
+  void compact();
+
+  // commit a write txn holding block changes, and apply them to m_cum_rct
+  void commit_block_changes(mdb_txn_safe &txn);
+
+  // drop the m_cum_rct changes of an aborted write txn
+  void abort_block_changes();
+
+  void reset_cum_rct();
+
+  // load the txpool tables into m_txpool_memory
+  void load_txpool_memory();
+
 private:
   MDB_env* m_env;
 
   MDB_dbi m_blocks;
   MDB_dbi m_block_heights;
   MDB_dbi m_block_info;
+  MDB_dbi m_block_filters;
+  bool m_has_block_filters;
+  MDB_dbi m_pow_hashes;
+  bool m_has_pow_hashes;
+  MDB_dbi m_alt_blocks;
+  bool m_has_alt_blocks;
 
   MDB_dbi m_txs;
   MDB_dbi m_txs_pruned;
@@ -415,12 +531,34 @@ private:
 
   MDB_dbi m_output_txs;
   MDB_dbi m_output_amounts;
+  MDB_dbi m_rct_outputs;
 
   MDB_dbi m_spent_keys;
 
+  // explorer indexes, see has_explorer_index
+  MDB_dbi m_spent_key_txs;
+  MDB_dbi m_output_keys;
+  bool m_has_explorer_index;
+
   MDB_dbi m_txpool_meta;
   MDB_dbi m_txpool_blob;
 
+  // the txpool when opened with DBF_TXPOOL_MEMORY, the tables then only
+  // hold the last snapshot. Ordered by txid, as the tables are.
+  struct txpool_memory_entry
+  {
+    txpool_tx_meta_t meta;
+    cryptonote::blobdata blob;
+  };
+  struct txid_less
+  {
+    bool operator()(const crypto::hash &a, const crypto::hash &b) const;
+  };
+  bool m_txpool_in_memory;
+  mutable boost::mutex m_txpool_memory_lock;
+  std::map<crypto::hash, txpool_memory_entry, txid_less> m_txpool_memory;
+  bool m_txpool_memory_dirty; // changed since the last snapshot
+
   MDB_dbi m_hf_starting_heights;
   MDB_dbi m_hf_versions;
 
@@ -429,6 +567,7 @@ private:
   mutable uint64_t m_cum_size;	// used in batch size estimation
   mutable unsigned int m_cum_count;
   std::string m_folder;
+  int m_db_flags; // as last opened with, to reopen after compacting
   mdb_txn_safe* m_write_txn; // may point to either a short-lived txn or a batch txn
   mdb_txn_safe* m_write_batch_txn; // persist batch txn outside of BlockchainLMDB
   boost::thread::id m_writer;
@@ -439,6 +578,23 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  key_image_filter m_key_image_filter;
+  mutable std::atomic<uint64_t> m_key_image_lookups;
+  mutable std::atomic<uint64_t> m_key_image_filtered;
+  mutable std::atomic<uint64_t> m_key_image_false_positives;
+
+  // cumulative rct output counts of the first blocks, as committed, so
+  // range requests are a copy rather than a block_info walk. Filled by
+  // readers and kept up to date by commits, which hold the lock while
+  // committing so a reader can tell its snapshot predates the cache.
+  mutable boost::mutex m_cum_rct_lock;
+  mutable std::vector<uint64_t> m_cum_rct;
+  uint64_t m_cum_rct_txnid; // id of the last write txn applied to m_cum_rct
+  // changes made by the write txn in progress, from m_cum_rct_pending_height on
+  bool m_cum_rct_pending_active;
+  uint64_t m_cum_rct_pending_height;
+  std::vector<uint64_t> m_cum_rct_pending;
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
@@ -450,6 +606,14 @@ private:
 #endif
 #endif
 
+  // Map size reserved at open. Only where the address space is plentiful and
+  // the file stays sparse: Windows extends the file to the full map size.
+#if defined(_WIN32) || !(defined(__x86_64__) || defined(__aarch64__) || defined(__powerpc64__))
+  constexpr static uint64_t RESERVED_MAPSIZE = 0;
+#else
+  constexpr static uint64_t RESERVED_MAPSIZE = 1LL << 40;
+#endif
+
   constexpr static float RESIZE_PERCENT = 0.9f;
 };
 
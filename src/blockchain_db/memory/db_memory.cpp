@@ -0,0 +1,131 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+
+#include "db_memory.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db.memory"
+
+namespace
+{
+  boost::filesystem::path get_memory_root()
+  {
+#if !defined(_WIN32) && !defined(__APPLE__)
+    boost::system::error_code ec;
+    if (boost::filesystem::is_directory("/dev/shm", ec))
+      return "/dev/shm";
+#endif
+    return boost::filesystem::temp_directory_path();
+  }
+}
+
+namespace cryptonote
+{
+
+BlockchainMemory::BlockchainMemory(bool batch_transactions): BlockchainLMDB(batch_transactions)
+{
+}
+
+BlockchainMemory::~BlockchainMemory()
+{
+  // the base class would only close its own part
+  if (m_open)
+  {
+    try { close(); }
+    catch (...) { /* ignore */ }
+  }
+}
+
+void BlockchainMemory::open(const std::string& filename, const int db_flags)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  if (m_open)
+    throw DB_OPEN_FAILURE("Attempted to open db, but it's already open");
+  if (db_flags & DBF_RDONLY)
+    throw DB_OPEN_FAILURE("An in-memory db cannot be opened read only");
+
+  boost::system::error_code ec;
+  if (!filename.empty())
+    boost::filesystem::create_directories(filename, ec);
+
+  const boost::filesystem::path folder = get_memory_root() / boost::filesystem::unique_path("etnc-memory-db-%%%%-%%%%-%%%%-%%%%");
+  m_memory_folder = folder.string();
+  MINFO("Keeping the blockchain in memory, in " << m_memory_folder);
+
+  // nothing outlives the process, so there is nothing to sync
+  try
+  {
+    BlockchainLMDB::open(m_memory_folder, (db_flags & ~(DBF_SAFE | DBF_FAST | DBF_SALVAGE)) | DBF_FASTEST);
+  }
+  catch (...)
+  {
+    boost::filesystem::remove_all(m_memory_folder, ec);
+    m_memory_folder.clear();
+    throw;
+  }
+}
+
+void BlockchainMemory::close()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  BlockchainLMDB::close();
+
+  boost::system::error_code ec;
+  if (!m_memory_folder.empty())
+    boost::filesystem::remove_all(m_memory_folder, ec);
+  m_memory_folder.clear();
+}
+
+void BlockchainMemory::sync()
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+}
+
+void BlockchainMemory::safesyncmode(const bool onoff)
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+}
+
+bool BlockchainMemory::remove_data_file(const std::string& folder) const
+{
+  // each open starts empty
+  return true;
+}
+
+std::string BlockchainMemory::get_db_name() const
+{
+  LOG_PRINT_L3("BlockchainMemory::" << __func__);
+
+  return std::string("memory");
+}
+
+}  // namespace cryptonote
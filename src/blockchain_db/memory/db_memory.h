@@ -0,0 +1,74 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "blockchain_db/lmdb/db_lmdb.h"
+
+namespace cryptonote
+{
+
+/**
+ * A blockchain db which lives in memory only, for throwaway chains:
+ * regtest and fake chain nodes, and test suites.
+ *
+ * It is the LMDB db, opened with syncing off on a private, empty
+ * directory of a RAM backed filesystem (/dev/shm where there is one, the
+ * temporary directory otherwise), and deleted when closed. So it has all
+ * of the interface, batches and txpool tables included, and behaves as
+ * the LMDB db does, without ever writing to a disk.
+ *
+ * The folder it is opened on is created, for the files kept beside the
+ * db, but the db itself always starts empty. Read only opens are refused,
+ * as there would be nothing to read.
+ */
+class BlockchainMemory : public BlockchainLMDB
+{
+public:
+  BlockchainMemory(bool batch_transactions=true);
+  ~BlockchainMemory();
+
+  virtual void open(const std::string& filename, const int db_flags=0);
+
+  virtual void close();
+
+  virtual void sync();
+
+  virtual void safesyncmode(const bool onoff);
+
+  virtual bool remove_data_file(const std::string& folder) const;
+
+  virtual std::string get_db_name() const;
+
+private:
+  std::string m_memory_folder;
+};
+
+}  // namespace cryptonote
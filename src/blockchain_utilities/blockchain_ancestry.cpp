@@ -27,16 +27,13 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <atomic>
 #include <unordered_map>
-#include <unordered_set>
-#include <boost/range/adaptor/transformed.hpp>
+#include <lmdb.h>
 #include <boost/algorithm/string.hpp>
-#include <boost/archive/portable_binary_iarchive.hpp>
-#include <boost/archive/portable_binary_oarchive.hpp>
-#include "common/unordered_containers_boost_serialization.h"
 #include "common/command_line.h"
-#include "common/varint.h"
-#include "cryptonote_basic/cryptonote_boost_serialization.h"
+#include "common/threadpool.h"
+#include "common/util.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_core/blockchain.h"
@@ -52,6 +49,10 @@ using namespace epee;
 using namespace cryptonote;
 
 static bool stop_requested = false;
+static uint64_t blocks_per_sync = 100;
+static MDB_dbi dbi_ancestry;
+static MDB_dbi dbi_properties;
+static MDB_env *env = NULL;
 
 struct ancestor
 {
@@ -59,14 +60,8 @@ struct ancestor
   uint64_t offset;
 
   bool operator==(const ancestor &other) const { return amount == other.amount && offset == other.offset; }
-
-  template <typename t_archive> void serialize(t_archive &a, const unsigned int ver)
-  {
-    a & amount;
-    a & offset;
-  }
+  bool operator<(const ancestor &other) const { return amount < other.amount || (amount == other.amount && offset < other.offset); }
 };
-BOOST_CLASS_VERSION(ancestor, 0)
 
 namespace std
 {
@@ -79,10 +74,13 @@ namespace std
   };
 }
 
+// sorted, without duplicates, stored as is in the cache
+typedef std::vector<ancestor> ancestry_t;
+
+// only what the traversal needs: the absolute ring offsets
 struct tx_data_t
 {
   std::vector<std::pair<uint64_t, std::vector<uint64_t>>> vin;
-  std::vector<crypto::public_key> vout;
   bool coinbase;
 
   tx_data_t(): coinbase(false) {}
@@ -106,69 +104,172 @@ struct tx_data_t
         }
       }
     }
-    vout.reserve(tx.vout.size());
-    for (size_t out = 0; out < tx.vout.size(); ++out)
+  }
+};
+
+static int resize_env(const char *db_path)
+{
+  MDB_envinfo mei;
+  MDB_stat mst;
+  int ret;
+
+  size_t needed = 1000ul * 1024 * 1024; // at least 1000 MB
+
+  ret = mdb_env_info(env, &mei);
+  if (ret)
+    return ret;
+  ret = mdb_env_stat(env, &mst);
+  if (ret)
+    return ret;
+  uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+  uint64_t mapsize = mei.me_mapsize;
+  if (size_used + needed > mei.me_mapsize)
+  {
+    try
     {
-      if (tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
+      boost::filesystem::path path(db_path);
+      boost::filesystem::space_info si = boost::filesystem::space(path);
+      if(si.available < needed)
       {
-        const auto &txout = boost::get<cryptonote::txout_to_key>(tx.vout[out].target);
-        vout.push_back(txout.key);
-      }
-      else
-      {
-        LOG_PRINT_L0("Bad vout type in txid " << get_transaction_hash(tx));
-        throw std::runtime_error("Bad vout type");
+        MERROR("!! WARNING: Insufficient free space to extend database !!: " << (si.available >> 20L) << " MB available");
+        return ENOSPC;
       }
     }
+    catch(...)
+    {
+      // print something but proceed.
+      MWARNING("Unable to query free disk space.");
+    }
+
+    mapsize += needed;
   }
+  return mdb_env_set_mapsize(env, mapsize);
+}
+
+static void init(const std::string &cache_dir)
+{
+  MDB_txn *txn;
+  bool tx_active = false;
+  int dbr;
 
-  template <typename t_archive> void serialize(t_archive &a, const unsigned int ver)
+  MINFO("Opening ancestry cache in " << cache_dir);
+
+  tools::create_directories_if_necessary(cache_dir);
+
+  dbr = mdb_env_create(&env);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_env_set_maxdbs(env, 2);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
+  // read txns are started by the thread pool workers
+  dbr = mdb_env_open(env, cache_dir.c_str(), MDB_NOTLS | MDB_NOSYNC, 0664);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open ancestry database file '"
+      + cache_dir + "': " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_begin(env, NULL, 0, &txn);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  dbr = mdb_dbi_open(txn, "ancestry", MDB_CREATE, &dbi_ancestry);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_dbi_open(txn, "properties", MDB_CREATE, &dbi_properties);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_commit(txn);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to commit txn creating/opening database: " + std::string(mdb_strerror(dbr)));
+  tx_active = false;
+}
+
+static void close()
+{
+  if (env)
   {
-    a & coinbase;
-    a & vin;
-    a & vout;
+    mdb_env_sync(env, 1);
+    mdb_dbi_close(env, dbi_ancestry);
+    mdb_dbi_close(env, dbi_properties);
+    mdb_env_close(env);
+    env = NULL;
   }
-};
+}
+
+static bool get_stored_ancestry(MDB_txn *txn, const crypto::hash &txid, ancestry_t &ancestry)
+{
+  MDB_val k = {sizeof(txid), (void*)&txid}, v;
+  int dbr = mdb_get(txn, dbi_ancestry, &k, &v);
+  if (dbr == MDB_NOTFOUND)
+    return false;
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to read ancestry: " + std::string(mdb_strerror(dbr)));
+  CHECK_AND_ASSERT_THROW_MES(v.mv_size % sizeof(ancestor) == 0, "Bad ancestry record size");
+  ancestry.resize(v.mv_size / sizeof(ancestor));
+  if (!ancestry.empty())
+    memcpy(ancestry.data(), v.mv_data, v.mv_size);
+  return true;
+}
+
+static void store_ancestry(MDB_txn *txn, const crypto::hash &txid, const ancestry_t &ancestry)
+{
+  MDB_val k = {sizeof(txid), (void*)&txid};
+  MDB_val v = {ancestry.size() * sizeof(ancestor), (void*)ancestry.data()};
+  int dbr = mdb_put(txn, dbi_ancestry, &k, &v, 0);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to write ancestry: " + std::string(mdb_strerror(dbr)));
+}
 
-struct ancestry_state_t
+static uint64_t get_stored_height()
 {
+  MDB_txn *txn;
+  int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){mdb_txn_abort(txn);});
+  static const char key[] = "height";
+  MDB_val k = {sizeof(key), (void*)key}, v;
+  dbr = mdb_get(txn, dbi_properties, &k, &v);
+  if (dbr == MDB_NOTFOUND)
+    return 0;
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to read height: " + std::string(mdb_strerror(dbr)));
+  CHECK_AND_ASSERT_THROW_MES(v.mv_size == sizeof(uint64_t), "Bad height record size");
   uint64_t height;
-  std::unordered_map<crypto::hash, std::unordered_set<ancestor>> ancestry;
-  std::unordered_map<ancestor, crypto::hash> output_cache;
-  std::unordered_map<crypto::hash, ::tx_data_t> tx_cache;
-  std::vector<cryptonote::block> block_cache;
+  memcpy(&height, v.mv_data, sizeof(height));
+  return height;
+}
 
-  template <typename t_archive> void serialize(t_archive &a, const unsigned int ver)
-  {
-    a & height;
-    a & ancestry;
-    a & output_cache;
-    if (ver < 1)
-    {
-      std::unordered_map<crypto::hash, cryptonote::transaction> old_tx_cache;
-      a & old_tx_cache;
-      for (const auto i: old_tx_cache)
-        tx_cache.insert(std::make_pair(i.first, ::tx_data_t(i.second)));
-    }
-    else
-    {
-      a & tx_cache;
-    }
-    if (ver < 2)
-    {
-      std::unordered_map<uint64_t, cryptonote::block> old_block_cache;
-      a & old_block_cache;
-      block_cache.resize(old_block_cache.size());
-      for (const auto i: old_block_cache)
-        block_cache[i.first] = i.second;
-    }
-    else
-    {
-      a & block_cache;
-    }
-  }
-};
-BOOST_CLASS_VERSION(ancestry_state_t, 2)
+// writes the ancestry computed since the last flush, and the height it covers, in one txn
+static void flush_ancestry(const char *cache_dir, std::unordered_map<crypto::hash, ancestry_t> &pending, uint64_t height)
+{
+  int dbr = resize_env(cache_dir);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to resize LMDB database: " + std::string(mdb_strerror(dbr)));
+
+  MDB_txn *txn;
+  bool tx_active = false;
+  dbr = mdb_txn_begin(env, NULL, 0, &txn);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  for (const auto &e: pending)
+    store_ancestry(txn, e.first, e.second);
+
+  static const char key[] = "height";
+  MDB_val k = {sizeof(key), (void*)key};
+  MDB_val v = {sizeof(height), (void*)&height};
+  dbr = mdb_put(txn, dbi_properties, &k, &v, 0);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to write height: " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_commit(txn);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to commit ancestry txn: " + std::string(mdb_strerror(dbr)));
+  tx_active = false;
+  pending.clear();
+}
+
+static void merge_ancestry(ancestry_t &ancestry, const ancestry_t &other)
+{
+  if (other.empty())
+    return;
+  ancestry_t merged;
+  merged.reserve(ancestry.size() + other.size());
+  std::set_union(ancestry.begin(), ancestry.end(), other.begin(), other.end(), std::back_inserter(merged));
+  ancestry.swap(merged);
+}
 
 static void add_ancestor(std::unordered_map<ancestor, unsigned int> &ancestry, uint64_t amount, uint64_t offset)
 {
@@ -192,32 +293,129 @@ static size_t get_deduplicated_ancestry(const std::unordered_map<ancestor, unsig
   return ancestry.size();
 }
 
-static void add_ancestry(std::unordered_map<crypto::hash, std::unordered_set<ancestor>> &ancestry, const crypto::hash &txid, const std::unordered_set<ancestor> &ancestors)
+static bool get_tx_data(const BlockchainDB *db, const crypto::hash &txid, ::tx_data_t &tx_data)
 {
-  std::pair<std::unordered_map<crypto::hash, std::unordered_set<ancestor>>::iterator, bool> p = ancestry.insert(std::make_pair(txid, ancestors));
-  if (!p.second)
+  cryptonote::blobdata bd;
+  if (!db->get_pruned_tx_blob(txid, bd))
+  {
+    LOG_PRINT_L0("Failed to get txid " << txid << " from db");
+    return false;
+  }
+  cryptonote::transaction tx;
+  if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+  {
+    LOG_PRINT_L0("Bad tx: " << txid);
+    return false;
+  }
+  tx_data = ::tx_data_t(tx);
+  return true;
+}
+
+// the txids which created the given ring members, from the output index rather than
+// by scanning the txes of the block they are in
+static bool get_ring_origins(const BlockchainDB *db, uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<crypto::hash> &origins)
+{
+  std::vector<tx_out_index> indices;
+  db->get_output_tx_and_index(amount, offsets, indices);
+  if (indices.size() != offsets.size())
   {
-    for (const auto &e: ancestors)
-      p.first->second.insert(e);
+    LOG_PRINT_L0("Output originating transaction not found");
+    return false;
   }
+  origins.clear();
+  origins.reserve(indices.size());
+  for (const tx_out_index &i: indices)
+    origins.push_back(i.first);
+  return true;
 }
 
-static void add_ancestry(std::unordered_map<crypto::hash, std::unordered_set<ancestor>> &ancestry, const crypto::hash &txid, const ancestor &new_ancestor)
+// forward method: a tx's ancestry is its ring members plus the ancestry of the txes
+// which created them, all of which are in earlier blocks, so either in pending or stored
+static bool compute_ancestry(const BlockchainDB *db, const std::unordered_map<crypto::hash, ancestry_t> &pending, const crypto::hash &txid, ancestry_t &ancestry)
 {
-  std::pair<std::unordered_map<crypto::hash, std::unordered_set<ancestor>>::iterator, bool> p = ancestry.insert(std::make_pair(txid, std::unordered_set<ancestor>()));
-  p.first->second.insert(new_ancestor);
+  ancestry.clear();
+  ::tx_data_t tx_data;
+  if (!get_tx_data(db, txid, tx_data))
+    return false;
+  if (tx_data.coinbase)
+    return true;
+
+  MDB_txn *txn;
+  int dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+  CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){mdb_txn_abort(txn);});
+
+  std::vector<crypto::hash> origins;
+  ancestry_t members, origin_ancestry;
+  for (const auto &ring: tx_data.vin)
+  {
+    const uint64_t amount = ring.first;
+    members.clear();
+    for (uint64_t offset: ring.second)
+      members.push_back(ancestor{amount, offset});
+    std::sort(members.begin(), members.end());
+    members.erase(std::unique(members.begin(), members.end()), members.end());
+    merge_ancestry(ancestry, members);
+
+    if (!get_ring_origins(db, amount, ring.second, origins))
+      return false;
+    std::sort(origins.begin(), origins.end(), [](const crypto::hash &a, const crypto::hash &b) { return memcmp(&a, &b, sizeof(a)) < 0; });
+    origins.erase(std::unique(origins.begin(), origins.end()), origins.end());
+    for (const crypto::hash &origin: origins)
+    {
+      const auto i = pending.find(origin);
+      if (i != pending.end())
+        merge_ancestry(ancestry, i->second);
+      else if (get_stored_ancestry(txn, origin, origin_ancestry))
+        merge_ancestry(ancestry, origin_ancestry);
+    }
+  }
+  return true;
 }
 
-static std::unordered_set<ancestor> get_ancestry(const std::unordered_map<crypto::hash, std::unordered_set<ancestor>> &ancestry, const crypto::hash &txid)
+// backward method, counting each time an ancestor is reached
+static bool get_ancestry_counts(const BlockchainDB *db, const crypto::hash &start_txid, std::unordered_map<ancestor, unsigned int> &ancestry)
 {
-  std::unordered_map<crypto::hash, std::unordered_set<ancestor>>::const_iterator i = ancestry.find(txid);
-  if (i == ancestry.end())
+  // a tx is typically reached many times, parse it once
+  std::unordered_map<crypto::hash, ::tx_data_t> tx_cache;
+  std::vector<crypto::hash> origins;
+
+  std::list<crypto::hash> txids;
+  txids.push_back(start_txid);
+  while (!txids.empty())
   {
-    //MERROR("txid ancestry not found: " << txid);
-    //throw std::runtime_error("txid ancestry not found");
-    return std::unordered_set<ancestor>();
+    if (stop_requested)
+      return false;
+    const crypto::hash txid = txids.front();
+    txids.pop_front();
+
+    auto it = tx_cache.find(txid);
+    if (it == tx_cache.end())
+    {
+      ::tx_data_t tx_data;
+      if (!get_tx_data(db, txid, tx_data))
+        return false;
+      it = tx_cache.insert(std::make_pair(txid, std::move(tx_data))).first;
+    }
+    const ::tx_data_t &tx_data = it->second;
+    if (tx_data.coinbase)
+      continue;
+
+    for (const auto &ring: tx_data.vin)
+    {
+      const uint64_t amount = ring.first;
+      for (uint64_t offset: ring.second)
+        add_ancestor(ancestry, amount, offset);
+      if (!get_ring_origins(db, amount, ring.second, origins))
+        return false;
+      for (const crypto::hash &origin: origins)
+      {
+        txids.push_back(origin);
+        MDEBUG("adding txid: " << origin);
+      }
+    }
   }
-  return i->second;
+  return true;
 }
 
 int main(int argc, char* argv[])
@@ -246,11 +444,8 @@ int main(int argc, char* argv[])
   const command_line::arg_descriptor<std::string> arg_txid  = {"txid", "Get ancestry for this txid", ""};
   const command_line::arg_descriptor<uint64_t> arg_height  = {"height", "Get ancestry for all txes at this height", 0};
   const command_line::arg_descriptor<bool> arg_all  = {"all", "Include the whole chain", false};
-  const command_line::arg_descriptor<bool> arg_cache_outputs  = {"cache-outputs", "Cache outputs (memory hungry)", false};
-  const command_line::arg_descriptor<bool> arg_cache_txes  = {"cache-txes", "Cache txes (memory hungry)", false};
-  const command_line::arg_descriptor<bool> arg_cache_blocks  = {"cache-blocks", "Cache blocks (memory hungry)", false};
   const command_line::arg_descriptor<bool> arg_include_coinbase  = {"include-coinbase", "Including coinbase tx", false};
-  const command_line::arg_descriptor<bool> arg_show_cache_stats  = {"show-cache-stats", "Show cache statistics", false};
+  const command_line::arg_descriptor<uint64_t> arg_blocks_per_sync  = {"blocks-per-sync", "Blocks of ancestry to compute between cache commits", blocks_per_sync};
 
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
@@ -260,11 +455,8 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_txid);
   command_line::add_arg(desc_cmd_sett, arg_height);
   command_line::add_arg(desc_cmd_sett, arg_all);
-  command_line::add_arg(desc_cmd_sett, arg_cache_outputs);
-  command_line::add_arg(desc_cmd_sett, arg_cache_txes);
-  command_line::add_arg(desc_cmd_sett, arg_cache_blocks);
   command_line::add_arg(desc_cmd_sett, arg_include_coinbase);
-  command_line::add_arg(desc_cmd_sett, arg_show_cache_stats);
+  command_line::add_arg(desc_cmd_sett, arg_blocks_per_sync);
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
   po::options_description desc_options("Allowed options");
@@ -303,11 +495,8 @@ int main(int argc, char* argv[])
   std::string opt_txid_string = command_line::get_arg(vm, arg_txid);
   uint64_t opt_height = command_line::get_arg(vm, arg_height);
   bool opt_all = command_line::get_arg(vm, arg_all);
-  bool opt_cache_outputs = command_line::get_arg(vm, arg_cache_outputs);
-  bool opt_cache_txes = command_line::get_arg(vm, arg_cache_txes);
-  bool opt_cache_blocks = command_line::get_arg(vm, arg_cache_blocks);
   bool opt_include_coinbase = command_line::get_arg(vm, arg_include_coinbase);
-  bool opt_show_cache_stats = command_line::get_arg(vm, arg_show_cache_stats);
+  blocks_per_sync = std::max<uint64_t>(command_line::get_arg(vm, arg_blocks_per_sync), 1);
 
   if ((!opt_txid_string.empty()) + !!opt_height + !!opt_all > 1)
   {
@@ -372,246 +561,80 @@ int main(int argc, char* argv[])
   LOG_PRINT_L0("Source blockchain storage initialized OK");
 
   std::vector<crypto::hash> start_txids;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
 
   // forward method
   if (opt_all)
   {
-    uint64_t cached_txes = 0, cached_blocks = 0, cached_outputs = 0, total_txes = 0, total_blocks = 0, total_outputs = 0;
-    ancestry_state_t state;
-
-    const std::string state_file_path = (boost::filesystem::path(opt_data_dir) / "ancestry-state.bin").string();
-    LOG_PRINT_L0("Loading state data from " << state_file_path);
-    std::ifstream state_data_in;
-    state_data_in.open(state_file_path, std::ios_base::binary | std::ios_base::in);
-    if (!state_data_in.fail())
-    {
-      try
-      {
-        boost::archive::portable_binary_iarchive a(state_data_in);
-        a >> state;
-      }
-      catch (const std::exception &e)
-      {
-        MERROR("Failed to load state data from " << state_file_path << ", restarting from scratch");
-        state = ancestry_state_t();
-      }
-      state_data_in.close();
-    }
+    const std::string cache_dir = (boost::filesystem::path(opt_data_dir) / "ancestry-cache").string();
+    init(cache_dir);
+    epee::misc_utils::auto_scope_leave_caller env_dtor = epee::misc_utils::create_scope_leave_handler([](){close();});
 
     tools::signal_handler::install([](int type) {
       stop_requested = true;
     });
 
-    MINFO("Starting from height " << state.height);
+    // ancestry computed since the last commit, visible to the workers
+    std::unordered_map<crypto::hash, ancestry_t> pending;
+    const uint64_t start_height = get_stored_height();
+    MINFO("Starting from height " << start_height);
     const uint64_t db_height = db->height();
-    state.block_cache.reserve(db_height);
-    for (uint64_t h = state.height; h < db_height; ++h)
+    uint64_t h;
+    for (h = start_height; h < db_height && !stop_requested; ++h)
     {
       size_t block_ancestry_size = 0;
       const crypto::hash block_hash = db->get_block_hash_from_height(h);
       const cryptonote::blobdata bd = db->get_block_blob(block_hash);
-      ++total_blocks;
       cryptonote::block b;
       if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
       {
         LOG_PRINT_L0("Bad block from db");
         return 1;
       }
-      if (opt_cache_blocks)
-      {
-        state.block_cache.resize(h + 1);
-        state.block_cache[h] = b;
-      }
       std::vector<crypto::hash> txids;
       txids.reserve(1 + b.tx_hashes.size());
       if (opt_include_coinbase)
         txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
       for (const auto &h: b.tx_hashes)
         txids.push_back(h);
-      for (const crypto::hash &txid: txids)
-      {
-        printf("%lu/%lu               \r", (unsigned long)h, (unsigned long)db_height);
-        fflush(stdout);
-        ::tx_data_t tx_data;
-        std::unordered_map<crypto::hash, ::tx_data_t>::const_iterator i = state.tx_cache.find(txid);
-        ++total_txes;
-        if (i != state.tx_cache.end())
-        {
-          ++cached_txes;
-          tx_data = i->second;
-        }
-        else
-        {
-          cryptonote::blobdata bd;
-          if (!db->get_pruned_tx_blob(txid, bd))
-          {
-            LOG_PRINT_L0("Failed to get txid " << txid << " from db");
-            return 1;
-          }
-          cryptonote::transaction tx;
-          if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
-          {
-            LOG_PRINT_L0("Bad tx: " << txid);
-            return 1;
-          }
-          tx_data = ::tx_data_t(tx);
-          if (opt_cache_txes)
-            state.tx_cache.insert(std::make_pair(txid, tx_data));
-        }
-        if (tx_data.coinbase)
-        {
-          add_ancestry(state.ancestry, txid, std::unordered_set<ancestor>());
-        }
-        else
-        {
-          for (size_t ring = 0; ring < tx_data.vin.size(); ++ring)
-          {
-            if (1)
-            {
-              const uint64_t amount = tx_data.vin[ring].first;
-              const std::vector<uint64_t> &absolute_offsets = tx_data.vin[ring].second;
-              for (uint64_t offset: absolute_offsets)
-              {
-                const output_data_t od = db->get_output_key(amount, offset);
-                add_ancestry(state.ancestry, txid, ancestor{amount, offset});
-                cryptonote::block b;
-                ++total_blocks;
-                if (state.block_cache.size() > od.height && !state.block_cache[od.height].miner_tx.vin.empty())
-                {
-                  ++cached_blocks;
-                  b = state.block_cache[od.height];
-                }
-                else
-                {
-                  const crypto::hash block_hash = db->get_block_hash_from_height(od.height);
-                  cryptonote::blobdata bd = db->get_block_blob(block_hash);
-                  if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
-                  {
-                    LOG_PRINT_L0("Bad block from db");
-                    return 1;
-                  }
-                  if (opt_cache_blocks)
-                  {
-                    state.block_cache.resize(od.height + 1);
-                    state.block_cache[od.height] = b;
-                  }
-                }
-                // find the tx which created this output
-                bool found = false;
-                std::unordered_map<ancestor, crypto::hash>::const_iterator i = state.output_cache.find({amount, offset});
-                ++total_outputs;
-                if (i != state.output_cache.end())
-                {
-                  ++cached_outputs;
-                  add_ancestry(state.ancestry, txid, get_ancestry(state.ancestry, i->second));
-                  found = true;
-                }
-                else for (size_t out = 0; out < b.miner_tx.vout.size(); ++out)
-                {
-                  if (b.miner_tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                  {
-                    const auto &txout = boost::get<cryptonote::txout_to_key>(b.miner_tx.vout[out].target);
-                    if (txout.key == od.pubkey)
-                    {
-                      found = true;
-                      add_ancestry(state.ancestry, txid, get_ancestry(state.ancestry, cryptonote::get_transaction_hash(b.miner_tx)));
-                      if (opt_cache_outputs)
-                        state.output_cache.insert(std::make_pair(ancestor{amount, offset}, cryptonote::get_transaction_hash(b.miner_tx)));
-                      break;
-                    }
-                  }
-                  else
-                  {
-                    LOG_PRINT_L0("Bad vout type in txid " << cryptonote::get_transaction_hash(b.miner_tx));
-                    return 1;
-                  }
-                }
-                for (const crypto::hash &block_txid: b.tx_hashes)
-                {
-                  if (found)
-                    break;
-                  ::tx_data_t tx_data2;
-                  std::unordered_map<crypto::hash, ::tx_data_t>::const_iterator i = state.tx_cache.find(block_txid);
-                  ++total_txes;
-                  if (i != state.tx_cache.end())
-                  {
-                    ++cached_txes;
-                    tx_data2 = i->second;
-                  }
-                  else
-                  {
-                    cryptonote::blobdata bd;
-                    if (!db->get_pruned_tx_blob(block_txid, bd))
-                    {
-                      LOG_PRINT_L0("Failed to get txid " << block_txid << " from db");
-                      return 1;
-                    }
-                    cryptonote::transaction tx;
-                    if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
-                    {
-                      LOG_PRINT_L0("Bad tx: " << block_txid);
-                      return 1;
-                    }
-                    tx_data2 = ::tx_data_t(tx);
-                    if (opt_cache_txes)
-                      state.tx_cache.insert(std::make_pair(block_txid, tx_data2));
-                  }
-                  for (size_t out = 0; out < tx_data2.vout.size(); ++out)
-                  {
-                    if (tx_data2.vout[out] == od.pubkey)
-                    {
-                      found = true;
-                      add_ancestry(state.ancestry, txid, get_ancestry(state.ancestry, block_txid));
-                      if (opt_cache_outputs)
-                        state.output_cache.insert(std::make_pair(ancestor{amount, offset}, block_txid));
-                      break;
-                    }
-                  }
-                }
-                if (!found)
-                {
-                  LOG_PRINT_L0("Output originating transaction not found");
-                  return 1;
-                }
-              }
-            }
-          }
-        }
-        const size_t ancestry_size = get_ancestry(state.ancestry, txid).size();
-        block_ancestry_size += ancestry_size;
-        MINFO(txid << ": " << ancestry_size);
-      }
-      if (!txids.empty())
-      {
-        std::string stats_msg;
-        if (opt_show_cache_stats)
-          stats_msg = std::string(", cache: txes ") + std::to_string(cached_txes*100./total_txes)
-              + ", blocks " + std::to_string(cached_blocks*100./total_blocks) + ", outputs "
-              + std::to_string(cached_outputs*100./total_outputs);
-        MINFO("Height " << h << ": " << (block_ancestry_size / txids.size()) << " average over " << txids.size() << stats_msg);
-      }
-      state.height = h;
-      if (stop_requested)
-        break;
-    }
 
-    LOG_PRINT_L0("Saving state data to " << state_file_path);
-    std::ofstream state_data_out;
-    state_data_out.open(state_file_path, std::ios_base::binary | std::ios_base::out | std::ios::trunc);
-    if (!state_data_out.fail())
-    {
-      try
+      printf("%lu/%lu               \r", (unsigned long)h, (unsigned long)db_height);
+      fflush(stdout);
+
+      // txes in a block cannot spend each other's outputs, so they are independent
+      std::vector<ancestry_t> ancestries(txids.size());
+      std::unique_ptr<std::atomic<bool>[]> ok(new std::atomic<bool>[txids.size()]);
+      tools::threadpool::waiter waiter;
+      for (size_t n = 0; n < txids.size(); ++n)
       {
-        boost::archive::portable_binary_oarchive a(state_data_out);
-        a << state;
+        ok[n] = false;
+        tpool.submit(&waiter, [&, n](){
+          try { ok[n] = compute_ancestry(db, pending, txids[n], ancestries[n]); }
+          catch (const std::exception &e) { MERROR("Failed to get ancestry for " << txids[n] << ": " << e.what()); }
+        });
       }
-      catch (const std::exception &e)
+      waiter.wait(&tpool);
+
+      for (size_t n = 0; n < txids.size(); ++n)
       {
-        MERROR("Failed to save state data to " << state_file_path);
+        if (!ok[n])
+          return 1;
+        const size_t ancestry_size = ancestries[n].size();
+        block_ancestry_size += ancestry_size;
+        MINFO(txids[n] << ": " << ancestry_size);
+        if (!ancestries[n].empty())
+          pending[txids[n]] = std::move(ancestries[n]);
       }
-      state_data_out.close();
+      if (!txids.empty())
+        MINFO("Height " << h << ": " << (block_ancestry_size / txids.size()) << " average over " << txids.size());
+
+      if ((h + 1 - start_height) % blocks_per_sync == 0)
+        flush_ancestry(cache_dir.c_str(), pending, h + 1);
     }
 
+    LOG_PRINT_L0("Saving ancestry up to height " << h << " to " << cache_dir);
+    flush_ancestry(cache_dir.c_str(), pending, h);
+
     goto done;
   }
 
@@ -639,130 +662,33 @@ int main(int argc, char* argv[])
     return 1;
   }
 
-  for (const crypto::hash &start_txid: start_txids)
   {
-    LOG_PRINT_L0("Checking ancestry for txid " << start_txid);
-
-    std::unordered_map<ancestor, unsigned int> ancestry;
-
-    std::list<crypto::hash> txids;
-    txids.push_back(start_txid);
-    while (!txids.empty())
+    // the start txes are independent, walk them in parallel and report in order
+    std::vector<std::unordered_map<ancestor, unsigned int>> ancestries(start_txids.size());
+    std::unique_ptr<std::atomic<bool>[]> ok(new std::atomic<bool>[start_txids.size()]);
+    tools::threadpool::waiter waiter;
+    for (size_t n = 0; n < start_txids.size(); ++n)
     {
-      const crypto::hash txid = txids.front();
-      txids.pop_front();
+      ok[n] = false;
+      tpool.submit(&waiter, [&, n](){
+        try { ok[n] = get_ancestry_counts(db, start_txids[n], ancestries[n]); }
+        catch (const std::exception &e) { MERROR("Failed to get ancestry for " << start_txids[n] << ": " << e.what()); }
+      });
+    }
+    waiter.wait(&tpool);
 
-      cryptonote::blobdata bd;
-      if (!db->get_pruned_tx_blob(txid, bd))
-      {
-        LOG_PRINT_L0("Failed to get txid " << txid << " from db");
-        return 1;
-      }
-      cryptonote::transaction tx;
-      if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
-      {
-        LOG_PRINT_L0("Bad tx: " << txid);
+    for (size_t n = 0; n < start_txids.size(); ++n)
+    {
+      LOG_PRINT_L0("Checking ancestry for txid " << start_txids[n]);
+      if (!ok[n])
         return 1;
-      }
-      const bool coinbase = tx.vin.size() == 1 && tx.vin[0].type() == typeid(cryptonote::txin_gen);
-      if (coinbase)
-        continue;
-
-      for (size_t ring = 0; ring < tx.vin.size(); ++ring)
+      const std::unordered_map<ancestor, unsigned int> &ancestry = ancestries[n];
+      MINFO("Ancestry for " << start_txids[n] << ": " << get_deduplicated_ancestry(ancestry) << " / " << get_full_ancestry(ancestry));
+      for (const auto &i: ancestry)
       {
-        if (tx.vin[ring].type() == typeid(cryptonote::txin_to_key))
-        {
-          const cryptonote::txin_to_key &txin = boost::get<cryptonote::txin_to_key>(tx.vin[ring]);
-          const uint64_t amount = txin.amount;
-          auto absolute_offsets = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-          for (uint64_t offset: absolute_offsets)
-          {
-            add_ancestor(ancestry, amount, offset);
-            const output_data_t od = db->get_output_key(amount, offset);
-            const crypto::hash block_hash = db->get_block_hash_from_height(od.height);
-            bd = db->get_block_blob(block_hash);
-            cryptonote::block b;
-            if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
-            {
-              LOG_PRINT_L0("Bad block from db");
-              return 1;
-            }
-            // find the tx which created this output
-            bool found = false;
-            for (size_t out = 0; out < b.miner_tx.vout.size(); ++out)
-            {
-              if (b.miner_tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-              {
-                const auto &txout = boost::get<cryptonote::txout_to_key>(b.miner_tx.vout[out].target);
-                if (txout.key == od.pubkey)
-                {
-                  found = true;
-                  txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
-                  MDEBUG("adding txid: " << cryptonote::get_transaction_hash(b.miner_tx));
-                  break;
-                }
-              }
-              else
-              {
-                LOG_PRINT_L0("Bad vout type in txid " << cryptonote::get_transaction_hash(b.miner_tx));
-                return 1;
-              }
-            }
-            for (const crypto::hash &block_txid: b.tx_hashes)
-            {
-              if (found)
-                break;
-              if (!db->get_pruned_tx_blob(block_txid, bd))
-              {
-                LOG_PRINT_L0("Failed to get txid " << block_txid << " from db");
-                return 1;
-              }
-              cryptonote::transaction tx2;
-              if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx2))
-              {
-                LOG_PRINT_L0("Bad tx: " << block_txid);
-                return 1;
-              }
-              for (size_t out = 0; out < tx2.vout.size(); ++out)
-              {
-                if (tx2.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                {
-                  const auto &txout = boost::get<cryptonote::txout_to_key>(tx2.vout[out].target);
-                  if (txout.key == od.pubkey)
-                  {
-                    found = true;
-                    txids.push_back(block_txid);
-                    MDEBUG("adding txid: " << block_txid);
-                    break;
-                  }
-                }
-                else
-                {
-                  LOG_PRINT_L0("Bad vout type in txid " << block_txid);
-                  return 1;
-                }
-              }
-            }
-            if (!found)
-            {
-              LOG_PRINT_L0("Output originating transaction not found");
-              return 1;
-            }
-          }
-        }
-        else
-        {
-          LOG_PRINT_L0("Bad vin type in txid " << txid);
-          return 1;
-        }
+        MINFO(cryptonote::print_money(i.first.amount) << "/" << i.first.offset << ": " << i.second);
       }
     }
-
-    MINFO("Ancestry for " << start_txid << ": " << get_deduplicated_ancestry(ancestry) << " / " << get_full_ancestry(ancestry));
-    for (const auto &i: ancestry)
-    {
-      MINFO(cryptonote::print_money(i.first.amount) << "/" << i.first.offset << ": " << i.second);
-    }
   }
 
 done:
@@ -42,6 +42,7 @@
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/db_types.h"
 #include "wallet/ringdb.h"
+#include "common/threadpool.h"
 #include "version.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -71,6 +72,7 @@ struct output_data
   output_data(): amount(0), offset(0) {}
   output_data(uint64_t a, uint64_t i): amount(a), offset(i) {}
   bool operator==(const output_data &other) const { return other.amount == amount && other.offset == offset; }
+  bool operator<(const output_data &other) const { return amount < other.amount || (amount == other.amount && offset < other.offset); }
 };
 
 //
@@ -329,7 +331,9 @@ static std::vector<uint64_t> decompress_ring(const std::string &s)
   return ring;
 }
 
-static bool for_all_transactions(const std::string &filename, uint64_t &start_idx, uint64_t &n_txes, const std::function<bool(const cryptonote::transaction_prefix&)> &f)
+// calls f with batches of up to batch_size transactions, parsed in parallel;
+// start_idx is the index of the last transaction in the batch
+static bool for_all_transactions(const std::string &filename, uint64_t &start_idx, uint64_t &n_txes, size_t batch_size, const std::function<bool(const std::vector<cryptonote::transaction_prefix>&)> &f)
 {
   MDB_env *env;
   MDB_dbi dbi;
@@ -367,35 +371,55 @@ static bool for_all_transactions(const std::string &filename, uint64_t &start_id
 
   bool fret = true;
 
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  batch_size = std::max<size_t>(batch_size, 1);
+  std::vector<blobdata> blobs;
+  blobs.reserve(batch_size);
+  uint64_t last_idx = start_idx;
+
   k.mv_size = sizeof(uint64_t);
   k.mv_data = &start_idx;
   MDB_cursor_op op = MDB_SET;
-  while (1)
+  bool done = false;
+  while (!done)
   {
     int ret = mdb_cursor_get(cur, &k, &v, op);
     op = MDB_NEXT;
     if (ret == MDB_NOTFOUND)
-      break;
-    if (ret)
+      done = true;
+    else if (ret)
       throw std::runtime_error("Failed to enumerate transactions: " + std::string(mdb_strerror(ret)));
+    else
+    {
+      if (k.mv_size != sizeof(uint64_t))
+        throw std::runtime_error("Bad key size");
+      const uint64_t idx = *(uint64_t*)k.mv_data;
+      if (idx < start_idx)
+        continue;
+      blobs.push_back(blobdata(reinterpret_cast<char*>(v.mv_data), v.mv_size));
+      last_idx = idx;
+    }
 
-    if (k.mv_size != sizeof(uint64_t))
-      throw std::runtime_error("Bad key size");
-    const uint64_t idx = *(uint64_t*)k.mv_data;
-    if (idx < start_idx)
+    if (blobs.empty() || (!done && blobs.size() < batch_size))
       continue;
 
-    cryptonote::transaction_prefix tx;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
-    std::stringstream ss;
-    ss << bd;
-    binary_archive<false> ba(ss);
-    bool r = do_serialize(ba, tx);
-    CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
-
-    start_idx = *(uint64_t*)k.mv_data;
-    if (!f(tx)) {
+    std::vector<cryptonote::transaction_prefix> txs(blobs.size());
+    std::unique_ptr<char[]> parsed(new char[blobs.size()]);
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {
+      tpool.submit(&waiter, [&, i](){
+        binary_archive<false> ba{epee::strspan<std::uint8_t>(blobs[i])};
+        parsed[i] = do_serialize(ba, txs[i]);
+      }, true);
+    }
+    waiter.wait(&tpool);
+    for (size_t i = 0; i < blobs.size(); ++i)
+      CHECK_AND_ASSERT_MES(parsed[i], false, "Failed to parse transaction from blob");
+    blobs.clear();
+
+    start_idx = last_idx;
+    if (!f(txs)) {
       fret = false;
       break;
     }
@@ -692,9 +716,9 @@ static uint64_t get_ring_subset_instances(MDB_txn *txn, uint64_t amount, const s
   return instances + extra;
 }
 
-static uint64_t inc_ring_instances(MDB_txn *txn, uint64_t amount, const std::vector<uint64_t> &ring)
+// adds instances uses of the ring with the given key, returns the new count
+static uint64_t inc_ring_instances(MDB_txn *txn, const std::string &sring, uint64_t instances)
 {
-  const std::string sring = keep_under_511(compress_ring(amount, ring));
   MDB_val k, v;
   k.mv_data = (void*)sring.data();
   k.mv_size = sring.size();
@@ -704,9 +728,9 @@ static uint64_t inc_ring_instances(MDB_txn *txn, uint64_t amount, const std::vec
 
   uint64_t count;
   if (dbr == MDB_NOTFOUND)
-    count = 1;
+    count = instances;
   else
-    count = 1 + *(const uint64_t*)v.mv_data;
+    count = instances + *(const uint64_t*)v.mv_data;
 
   v.mv_data = &count;
   v.mv_size = sizeof(count);
@@ -734,7 +758,8 @@ static std::vector<crypto::key_image> get_key_images(MDB_txn *txn, const output_
   return key_images;
 }
 
-static void add_key_image(MDB_txn *txn, const output_data &od, const crypto::key_image &ki)
+// appends key images, a concatenation of 32 byte key images, to an output
+static void add_key_images(MDB_txn *txn, const output_data &od, const std::string &key_images)
 {
   MDB_val k, v;
   k.mv_data = (void*)&od;
@@ -747,7 +772,7 @@ static void add_key_image(MDB_txn *txn, const output_data &od, const crypto::key
     CHECK_AND_ASSERT_THROW_MES(v.mv_size % 32 == 0, "Unexpected record size");
     data = std::string((const char*)v.mv_data, v.mv_size);
   }
-  data += std::string((const char*)&ki, sizeof(ki));
+  data += key_images;
 
   v.mv_data = (void*)data.data();
   v.mv_size = data.size();
@@ -789,6 +814,103 @@ static void inc_stat(MDB_txn *txn, const char *key)
   set_stat(txn, key, data);
 }
 
+// A batch of transactions is first reduced in memory, split by tx range
+// across threads, then merged and written to the db in key order. Ring
+// instance counts only ever go up by one, so a ring reaching N uses is
+// found the same way whether the uses are counted one by one or in bulk.
+
+struct ring_data
+{
+  uint64_t amount;
+  std::vector<uint64_t> ring; // canonical, relative offsets
+  uint64_t instances; // uses within the batch
+};
+
+struct ring_use
+{
+  crypto::key_image k_image;
+  uint64_t amount;
+  std::vector<uint64_t> ring; // canonical on the first input, as in the tx on forks
+};
+
+struct batch_data
+{
+  std::map<std::string, ring_data> rings; // keyed as in ring_instances
+  std::map<output_data, std::string> key_images; // key images to append to outputs
+  std::vector<ring_use> relative_rings;
+  std::vector<output_data> ring_size_1;
+
+  void merge(batch_data &other)
+  {
+    for (auto &e: other.rings)
+    {
+      auto i = rings.find(e.first);
+      if (i == rings.end())
+        rings.insert(std::move(e));
+      else
+        i->second.instances += e.second.instances;
+    }
+    for (const auto &e: other.key_images)
+      key_images[e.first] += e.second;
+    relative_rings.insert(relative_rings.end(), std::make_move_iterator(other.relative_rings.begin()), std::make_move_iterator(other.relative_rings.end()));
+    ring_size_1.insert(ring_size_1.end(), other.ring_size_1.begin(), other.ring_size_1.end());
+  }
+};
+
+static void reduce_transactions(const std::vector<cryptonote::transaction_prefix> &txs, size_t begin, size_t end, bool primary, bool rct_only, batch_data &data)
+{
+  for (size_t t = begin; t < end; ++t)
+  {
+    for (const auto &in: txs[t].vin)
+    {
+      if (in.type() != typeid(txin_to_key))
+        continue;
+      const auto &txin = boost::get<txin_to_key>(in);
+      if (rct_only && txin.amount != 0)
+        continue;
+
+      std::vector<uint64_t> new_ring = canonicalize(txin.key_offsets);
+      const std::string key = keep_under_511(compress_ring(txin.amount, new_ring));
+      auto i = data.rings.find(key);
+      if (i == data.rings.end())
+        i = data.rings.insert(std::make_pair(key, ring_data{txin.amount, new_ring, 0})).first;
+      ++i->second.instances;
+
+      if (primary)
+      {
+        const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
+        for (uint64_t out: absolute)
+          data.key_images[output_data(txin.amount, out)] += std::string((const char*)&txin.k_image, sizeof(txin.k_image));
+        if (new_ring.size() == 1)
+          data.ring_size_1.push_back(output_data(txin.amount, absolute[0]));
+        data.relative_rings.push_back({txin.k_image, txin.amount, std::move(new_ring)});
+      }
+      else
+      {
+        data.relative_rings.push_back({txin.k_image, txin.amount, txin.key_offsets});
+      }
+    }
+  }
+}
+
+static batch_data reduce_transactions(const std::vector<cryptonote::transaction_prefix> &txs, bool primary, bool rct_only)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const size_t n_slices = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), txs.size()));
+  std::vector<batch_data> slices(n_slices);
+  tools::threadpool::waiter waiter;
+  for (size_t i = 0; i < n_slices; ++i)
+  {
+    const size_t begin = txs.size() * i / n_slices, end = txs.size() * (i + 1) / n_slices;
+    tpool.submit(&waiter, [&, i, begin, end](){ reduce_transactions(txs, begin, end, primary, rct_only, slices[i]); }, true);
+  }
+  waiter.wait(&tpool);
+
+  for (size_t i = 1; i < n_slices; ++i)
+    slices[0].merge(slices[i]);
+  return std::move(slices[0]);
+}
+
 static void open_db(const std::string &filename, MDB_env **env, MDB_txn **txn, MDB_cursor **cur, MDB_dbi *dbi)
 {
   tools::create_directories_if_necessary(filename);
@@ -1187,142 +1309,144 @@ int main(int argc, char* argv[])
     MDB_cursor *cur;
     dbr = mdb_cursor_open(txn, dbi_spent, &cur);
     CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB cursor: " + std::string(mdb_strerror(dbr)));
-    size_t records = 0;
     const std::string filename = inputs[n];
     std::vector<std::pair<uint64_t, uint64_t>> blackballs;
     uint64_t n_txes;
-    for_all_transactions(filename, start_idx, n_txes, [&](const cryptonote::transaction_prefix &tx)->bool
+    const auto mark_spent = [&](const output_data &od, const char *stat)
+    {
+      blackballs.push_back(std::make_pair(od.amount, od.offset));
+      if (add_spent_output(cur, od))
+        inc_stat(txn, stat);
+    };
+    for_all_transactions(filename, start_idx, n_txes, records_per_sync, [&](const std::vector<cryptonote::transaction_prefix> &txs)->bool
     {
       std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-      for (const auto &in: tx.vin)
-      {
-        if (in.type() != typeid(txin_to_key))
-          continue;
-        const auto &txin = boost::get<txin_to_key>(in);
-        if (opt_rct_only && txin.amount != 0)
-          continue;
+      batch_data data = reduce_transactions(txs, n == 0, opt_rct_only);
 
-        const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-        if (n == 0)
-          for (uint64_t out: absolute)
-            add_key_image(txn, output_data(txin.amount, out), txin.k_image);
+      if (n == 0)
+      {
+        for (const auto &e: data.key_images)
+          add_key_images(txn, e.first, e.second);
 
-        std::vector<uint64_t> relative_ring;
-        std::vector<uint64_t> new_ring = canonicalize(txin.key_offsets);
-        const uint32_t ring_size = txin.key_offsets.size();
-        const uint64_t instances = inc_ring_instances(txn, txin.amount, new_ring);
-        if (n == 0 && ring_size == 1)
+        for (const output_data &od: data.ring_size_1)
         {
-          const std::pair<uint64_t, uint64_t> output = std::make_pair(txin.amount, absolute[0]);
           if (opt_verbose)
           {
-            MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in a 1-ring");
+            MINFO("Marking output " << od.amount << "/" << od.offset << " as spent, due to being used in a 1-ring");
             std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
           }
-          blackballs.push_back(output);
-          if (add_spent_output(cur, output_data(txin.amount, absolute[0])))
-            inc_stat(txn, txin.amount ? "pre-rct-ring-size-1" : "rct-ring-size-1");
+          mark_spent(od, od.amount ? "pre-rct-ring-size-1" : "rct-ring-size-1");
         }
-        else if (n == 0 && instances == new_ring.size())
+      }
+
+      std::vector<const ring_data*> subset_candidates;
+      for (const auto &e: data.rings)
+      {
+        const ring_data &rd = e.second;
+        const uint64_t instances = inc_ring_instances(txn, e.first, rd.instances);
+        if (n > 0 || rd.ring.size() == 1)
+          continue;
+        const uint64_t ring_size = rd.ring.size();
+        if (instances - rd.instances < ring_size && instances >= ring_size)
         {
-          for (size_t o = 0; o < new_ring.size(); ++o)
+          const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(rd.ring);
+          for (uint64_t out: absolute)
           {
-            const std::pair<uint64_t, uint64_t> output = std::make_pair(txin.amount, absolute[o]);
             if (opt_verbose)
             {
-              MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in " << new_ring.size() << " identical " << new_ring.size() << "-rings");
+              MINFO("Marking output " << rd.amount << "/" << out << " as spent, due to being used in " << ring_size << " identical " << ring_size << "-rings");
               std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
             }
-            blackballs.push_back(output);
-            if (add_spent_output(cur, output_data(txin.amount, absolute[o])))
-              inc_stat(txn, txin.amount ? "pre-rct-duplicate-rings" : "rct-duplicate-rings");
+            mark_spent(output_data(rd.amount, out), rd.amount ? "pre-rct-duplicate-rings" : "rct-duplicate-rings");
           }
         }
-        else if (n == 0 && opt_check_subsets && get_ring_subset_instances(txn, txin.amount, new_ring) >= new_ring.size())
+        else if (instances < ring_size && opt_check_subsets)
+          subset_candidates.push_back(&rd);
+      }
+
+      // subsets are checked once the whole batch is counted
+      for (const ring_data *rd: subset_candidates)
+      {
+        if (get_ring_subset_instances(txn, rd->amount, rd->ring) < rd->ring.size())
+          continue;
+        const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(rd->ring);
+        for (uint64_t out: absolute)
         {
-          for (size_t o = 0; o < new_ring.size(); ++o)
+          if (opt_verbose)
           {
-            const std::pair<uint64_t, uint64_t> output = std::make_pair(txin.amount, absolute[o]);
-            if (opt_verbose)
-            {
-              MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in " << new_ring.size() << " subsets of " << new_ring.size() << "-rings");
-              std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-            }
-            blackballs.push_back(output);
-            if (add_spent_output(cur, output_data(txin.amount, absolute[o])))
-              inc_stat(txn, txin.amount ? "pre-rct-subset-rings" : "rct-subset-rings");
+            MINFO("Marking output " << rd->amount << "/" << out << " as spent, due to being used in " << rd->ring.size() << " subsets of " << rd->ring.size() << "-rings");
+            std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
           }
+          mark_spent(output_data(rd->amount, out), rd->amount ? "pre-rct-subset-rings" : "rct-subset-rings");
+        }
+      }
+
+      std::sort(data.relative_rings.begin(), data.relative_rings.end(), [](const ring_use &a, const ring_use &b) {
+        return memcmp(&a.k_image, &b.k_image, sizeof(a.k_image)) < 0;
+      });
+      for (const ring_use &e: data.relative_rings)
+      {
+        const crypto::key_image &ki = e.k_image;
+        const uint64_t amount = e.amount;
+        const std::vector<uint64_t> &key_offsets = e.ring;
+        std::vector<uint64_t> relative_ring;
+        if (n == 0)
+        {
+          set_relative_ring(txn, ki, key_offsets);
+          continue;
+        }
+        if (!get_relative_ring(txn, ki, relative_ring))
+          continue;
+        MDEBUG("Key image " << ki << " already seen: rings " <<
+            boost::join(relative_ring | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " ") <<
+            ", " << boost::join(key_offsets | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " "));
+        if (relative_ring == key_offsets)
+          continue;
+        MDEBUG("Rings are different");
+        const std::vector<uint64_t> r0 = cryptonote::relative_output_offsets_to_absolute(relative_ring);
+        const std::vector<uint64_t> r1 = cryptonote::relative_output_offsets_to_absolute(key_offsets);
+        std::vector<uint64_t> common;
+        for (uint64_t out: r0)
+        {
+          if (std::find(r1.begin(), r1.end(), out) != r1.end())
+            common.push_back(out);
         }
-        else if (n > 0 && get_relative_ring(txn, txin.k_image, relative_ring))
+        if (common.empty())
         {
-          MDEBUG("Key image " << txin.k_image << " already seen: rings " <<
-              boost::join(relative_ring | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " ") <<
-              ", " << boost::join(txin.key_offsets | boost::adaptors::transformed([](uint64_t out){return std::to_string(out);}), " "));
+          MERROR("Rings for the same key image are disjoint");
           std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-          if (relative_ring != txin.key_offsets)
+        }
+        else if (common.size() == 1)
+        {
+          if (opt_verbose)
           {
-            MDEBUG("Rings are different");
+            MINFO("Marking output " << amount << "/" << common[0] << " as spent, due to being used in rings with a single common element");
             std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-            const std::vector<uint64_t> r0 = cryptonote::relative_output_offsets_to_absolute(relative_ring);
-            const std::vector<uint64_t> r1 = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-            std::vector<uint64_t> common;
-            for (uint64_t out: r0)
-            {
-              if (std::find(r1.begin(), r1.end(), out) != r1.end())
-                common.push_back(out);
-            }
-            if (common.empty())
-            {
-              MERROR("Rings for the same key image are disjoint");
-              std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-            }
-            else if (common.size() == 1)
-            {
-              const std::pair<uint64_t, uint64_t> output = std::make_pair(txin.amount, common[0]);
-              if (opt_verbose)
-              {
-                MINFO("Marking output " << output.first << "/" << output.second << " as spent, due to being used in rings with a single common element");
-                std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-              }
-              blackballs.push_back(output);
-              if (add_spent_output(cur, output_data(txin.amount, common[0])))
-                inc_stat(txn, txin.amount ? "pre-rct-key-image-attack" : "rct-key-image-attack");
-            }
-            else
-            {
-              MDEBUG("The intersection has more than one element, it's still ok");
-              std::cout << "\r" << start_idx << "/" << n_txes << "         \r" << std::flush;
-              for (const auto &out: r0)
-                if (std::find(common.begin(), common.end(), out) != common.end())
-                  new_ring.push_back(out);
-              new_ring = cryptonote::absolute_output_offsets_to_relative(new_ring);
-            }
           }
+          mark_spent(output_data(amount, common[0]), amount ? "pre-rct-key-image-attack" : "rct-key-image-attack");
+        }
+        else
+        {
+          MDEBUG("The intersection has more than one element, it's still ok");
         }
-        if (n == 0)
-          set_relative_ring(txn, txin.k_image, new_ring);
       }
+
       set_processed_txidx(txn, canonical, start_idx+1);
 
-      ++records;
-      if (records >= records_per_sync)
+      if (!blackballs.empty())
       {
-        if (!blackballs.empty())
-        {
-          ringdb.blackball(blackballs);
-          blackballs.clear();
-        }
-        mdb_cursor_close(cur);
-        dbr = mdb_txn_commit(txn);
-        CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to commit txn creating/opening database: " + std::string(mdb_strerror(dbr)));
-        int dbr = resize_env(cache_dir.c_str());
-        CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to resize LMDB database: " + std::string(mdb_strerror(dbr)));
-        dbr = mdb_txn_begin(env, NULL, 0, &txn);
-        CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
-        dbr = mdb_cursor_open(txn, dbi_spent, &cur);
-        CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB cursor: " + std::string(mdb_strerror(dbr)));
-        records = 0;
+        ringdb.blackball(blackballs);
+        blackballs.clear();
       }
+      mdb_cursor_close(cur);
+      dbr = mdb_txn_commit(txn);
+      CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to commit txn creating/opening database: " + std::string(mdb_strerror(dbr)));
+      int dbr = resize_env(cache_dir.c_str());
+      CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to resize LMDB database: " + std::string(mdb_strerror(dbr)));
+      dbr = mdb_txn_begin(env, NULL, 0, &txn);
+      CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+      dbr = mdb_cursor_open(txn, dbi_spent, &cur);
+      CHECK_AND_ASSERT_THROW_MES(!dbr, "Failed to open LMDB cursor: " + std::string(mdb_strerror(dbr)));
 
       if (stop_requested)
       {
@@ -0,0 +1,557 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include "common/command_line.h"
+#include "common/int-util.h"
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/blockchain.h"
+#include "blockchain_db/blockchain_db.h"
+#include "blockchain_db/db_types.h"
+#include "file_io_utils.h"
+#include "version.h"
+
+#ifdef COLUMNS_ENABLE_ZLIB
+#include <zlib.h>
+#endif
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace epee;
+using namespace cryptonote;
+
+// Writes the chain as column files an analytics engine can scan without
+// decoding blocks: the range is cut into partitions of blocks, each one
+// exported by a worker thread into its own directory, with one file per
+// column holding the values of all rows back to back. u64 columns are
+// little endian 8 byte values, hash and key columns 32 bytes per value.
+// A list column holds the values of all rows in a row, the matching count
+// column tells how many belong to each.
+
+namespace
+{
+  enum column_id
+  {
+    block_height, block_hash, block_prev_hash, block_timestamp, block_major_version, block_minor_version,
+    block_nonce, block_weight, block_difficulty, block_reward, block_num_txes,
+    tx_height, tx_hash, tx_version, tx_unlock_time, tx_coinbase, tx_fee, tx_num_inputs, tx_num_outputs,
+    input_tx_hash, input_index, input_amount, input_key_image, input_ring_size, input_key_offsets,
+    output_tx_hash, output_index, output_amount, output_global_index, output_key, output_height,
+    num_columns
+  };
+
+  struct column
+  {
+    const char *table;
+    const char *name;
+    const char *type;
+  };
+
+  const column columns[num_columns] = {
+    { "blocks", "height", "u64" },
+    { "blocks", "hash", "hash" },
+    { "blocks", "prev_hash", "hash" },
+    { "blocks", "timestamp", "u64" },
+    { "blocks", "major_version", "u64" },
+    { "blocks", "minor_version", "u64" },
+    { "blocks", "nonce", "u64" },
+    { "blocks", "weight", "u64" },
+    { "blocks", "difficulty", "u64" },
+    { "blocks", "reward", "u64" },
+    { "blocks", "num_txes", "u64" },
+    { "txs", "height", "u64" },
+    { "txs", "hash", "hash" },
+    { "txs", "version", "u64" },
+    { "txs", "unlock_time", "u64" },
+    { "txs", "coinbase", "u64" },
+    { "txs", "fee", "u64" },
+    { "txs", "num_inputs", "u64" },
+    { "txs", "num_outputs", "u64" },
+    { "inputs", "tx_hash", "hash" },
+    { "inputs", "index", "u64" },
+    { "inputs", "amount", "u64" },
+    { "inputs", "key_image", "hash" },
+    { "inputs", "ring_size", "u64" },
+    { "inputs", "key_offsets", "list<u64> (absolute, counted by ring_size)" },
+    { "outputs", "tx_hash", "hash" },
+    { "outputs", "index", "u64" },
+    { "outputs", "amount", "u64" },
+    { "outputs", "global_index", "u64" },
+    { "outputs", "key", "hash" },
+    { "outputs", "height", "u64" },
+  };
+
+#ifdef COLUMNS_ENABLE_ZLIB
+  const char *column_extension = ".gz";
+#else
+  const char *column_extension = ".bin";
+#endif
+
+  // confirmed blocks are the only ones exported, a reorg above them would
+  // leave stale rows in partitions already written
+  const uint64_t default_confirmations = CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
+
+  struct partition
+  {
+    std::string data[num_columns];
+
+    void put(column_id c, uint64_t v)
+    {
+      v = SWAP64LE(v);
+      data[c].append((const char*)&v, sizeof(v));
+    }
+    template<typename T>
+    void put_pod(column_id c, const T &v)
+    {
+      static_assert(sizeof(T) == 32, "hash columns hold 32 byte values");
+      data[c].append((const char*)&v, sizeof(v));
+    }
+  };
+
+  bool write_column(const boost::filesystem::path &path, const std::string &raw)
+  {
+#ifdef COLUMNS_ENABLE_ZLIB
+    // gzip framing, so any tool can read a column with zcat
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    std::string stored(deflateBound(&zs, raw.size()), 0);
+    zs.next_in = (Bytef*)raw.data();
+    zs.avail_in = raw.size();
+    zs.next_out = (Bytef*)&stored[0];
+    zs.avail_out = stored.size();
+    const int result = deflate(&zs, Z_FINISH);
+    stored.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (result != Z_STREAM_END)
+      return false;
+    return epee::file_io_utils::save_string_to_file(path.string(), stored);
+#else
+    return epee::file_io_utils::save_string_to_file(path.string(), raw);
+#endif
+  }
+
+  std::string partition_name(uint64_t first, uint64_t last)
+  {
+    return (boost::format("%010u-%010u") % first % last).str();
+  }
+
+  bool add_tx(const BlockchainDB &db, uint64_t height, const crypto::hash &txid, const transaction &tx, partition &p)
+  {
+    const bool coinbase = tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
+    uint64_t fee = 0;
+    if (!coinbase && !get_tx_fee(tx, fee))
+      fee = 0;
+
+    p.put(tx_height, height);
+    p.put_pod(tx_hash, txid);
+    p.put(tx_version, tx.version);
+    p.put(tx_unlock_time, tx.unlock_time);
+    p.put(tx_coinbase, coinbase);
+    p.put(tx_fee, fee);
+    p.put(tx_num_inputs, tx.vin.size());
+    p.put(tx_num_outputs, tx.vout.size());
+
+    for (size_t n = 0; n < tx.vin.size(); ++n)
+    {
+      if (tx.vin[n].type() != typeid(txin_to_key))
+        continue;
+      const txin_to_key &in = boost::get<txin_to_key>(tx.vin[n]);
+      p.put_pod(input_tx_hash, txid);
+      p.put(input_index, n);
+      p.put(input_amount, in.amount);
+      p.put_pod(input_key_image, in.k_image);
+      p.put(input_ring_size, in.key_offsets.size());
+      for (uint64_t offset: relative_output_offsets_to_absolute(in.key_offsets))
+        p.put(input_key_offsets, offset);
+    }
+
+    uint64_t tx_id;
+    if (!db.tx_exists(txid, tx_id))
+    {
+      MERROR("Transaction " << txid << " not found");
+      return false;
+    }
+    const std::vector<uint64_t> indices = db.get_tx_amount_output_indices(tx_id);
+    if (indices.size() != tx.vout.size())
+    {
+      MERROR("Transaction " << txid << " has " << tx.vout.size() << " outputs, but " << indices.size() << " indices");
+      return false;
+    }
+    // coinbase outputs of rct txes are indexed as amount 0
+    const bool is_pseudo_rct = tx.version >= 2 && coinbase;
+    for (size_t n = 0; n < tx.vout.size(); ++n)
+    {
+      if (tx.vout[n].target.type() != typeid(txout_to_key))
+        continue;
+      p.put_pod(output_tx_hash, txid);
+      p.put(output_index, n);
+      p.put(output_amount, is_pseudo_rct ? 0 : tx.vout[n].amount);
+      p.put(output_global_index, indices[n]);
+      p.put_pod(output_key, boost::get<txout_to_key>(tx.vout[n].target).key);
+      p.put(output_height, height);
+    }
+    return true;
+  }
+
+  bool export_partition(const BlockchainDB &db, uint64_t first, uint64_t last, const boost::filesystem::path &output_dir)
+  {
+    partition p;
+    bool ok = true;
+    db.prefetch_blocks(first, last - first + 1);
+    db.for_blocks_range(first, last, [&](uint64_t height, const crypto::hash &hash, const block &b) {
+      uint64_t reward = 0;
+      for (const auto &out: b.miner_tx.vout)
+        reward += out.amount;
+
+      p.put(block_height, height);
+      p.put_pod(block_hash, hash);
+      p.put_pod(block_prev_hash, b.prev_id);
+      p.put(block_timestamp, b.timestamp);
+      p.put(block_major_version, b.major_version);
+      p.put(block_minor_version, b.minor_version);
+      p.put(block_nonce, b.nonce);
+      p.put(block_weight, db.get_block_weight(height));
+      p.put(block_difficulty, db.get_block_difficulty(height));
+      p.put(block_reward, reward);
+      p.put(block_num_txes, b.tx_hashes.size() + 1);
+
+      if (!add_tx(db, height, get_transaction_hash(b.miner_tx), b.miner_tx, p))
+        return ok = false;
+      for (const crypto::hash &txid: b.tx_hashes)
+      {
+        transaction tx;
+        if (!db.get_pruned_tx(txid, tx))
+        {
+          MERROR("Transaction " << txid << " not found");
+          return ok = false;
+        }
+        if (!add_tx(db, height, txid, tx, p))
+          return ok = false;
+      }
+      return true;
+    });
+    if (!ok)
+      return false;
+
+    // written aside and renamed once complete, so a partition directory
+    // is never seen half written
+    const std::string name = partition_name(first, last);
+    const boost::filesystem::path partial = output_dir / (name + ".partial");
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(partial, ec);
+    if (!boost::filesystem::create_directory(partial, ec))
+    {
+      MERROR("Failed to create " << partial.string() << ": " << ec.message());
+      return false;
+    }
+    for (size_t c = 0; c < num_columns; ++c)
+    {
+      const boost::filesystem::path path = partial / (std::string(columns[c].table) + "." + columns[c].name + column_extension);
+      if (!write_column(path, p.data[c]))
+      {
+        MERROR("Failed to write " << path.string());
+        return false;
+      }
+    }
+    boost::filesystem::remove_all(output_dir / name, ec);
+    boost::filesystem::rename(partial, output_dir / name, ec);
+    if (ec)
+    {
+      MERROR("Failed to rename " << partial.string() << ": " << ec.message());
+      return false;
+    }
+    return true;
+  }
+
+  bool write_schema(const boost::filesystem::path &output_dir)
+  {
+    std::string schema;
+    for (const column &c: columns)
+      schema += std::string(c.table) + "." + c.name + "\t" + c.type + "\n";
+    return epee::file_io_utils::save_string_to_file((output_dir / "schema.txt").string(), schema);
+  }
+
+  // "<next height> <hash of the block before it>", so a later run can tell
+  // whether the chain it exported from is still there
+  bool load_state(const boost::filesystem::path &output_dir, uint64_t &next_height, crypto::hash &last_hash)
+  {
+    std::string state;
+    if (!epee::file_io_utils::load_file_to_string((output_dir / "state").string(), state))
+      return false;
+    std::istringstream iss(state);
+    std::string hash_str;
+    if (!(iss >> next_height >> hash_str) || !epee::string_tools::hex_to_pod(hash_str, last_hash))
+      throw std::runtime_error("Invalid state file in " + output_dir.string());
+    return true;
+  }
+
+  bool save_state(const boost::filesystem::path &output_dir, uint64_t next_height, const crypto::hash &last_hash)
+  {
+    const std::string state = std::to_string(next_height) + " " + epee::string_tools::pod_to_hex(last_hash) + "\n";
+    const boost::filesystem::path tmp = output_dir / "state.tmp";
+    if (!epee::file_io_utils::save_string_to_file(tmp.string(), state))
+      return false;
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, output_dir / "state", ec);
+    return !ec;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  std::string default_db_type = "lmdb";
+
+  std::string available_dbs = cryptonote::blockchain_db_types(", ");
+  available_dbs = "available: " + available_dbs;
+
+  uint32_t log_level = 0;
+
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_output_dir = {"output-dir", "Specify output directory", "", true};
+  const command_line::arg_descriptor<std::string> arg_log_level  = {"log-level",  "0-4 or categories", ""};
+  const command_line::arg_descriptor<std::string> arg_database = {
+    "database", available_dbs.c_str(), default_db_type
+  };
+  const command_line::arg_descriptor<uint64_t> arg_block_start = {"block-start", "Start at block number, instead of where the last export stopped", 0};
+  const command_line::arg_descriptor<uint64_t> arg_block_stop = {"block-stop", "Stop at block number", 0};
+  const command_line::arg_descriptor<uint64_t> arg_confirmations = {"confirmations", "Only export blocks with at least this many blocks on top", default_confirmations};
+  const command_line::arg_descriptor<uint64_t> arg_partition_size = {"partition-size", "Number of blocks per partition", 10000};
+  const command_line::arg_descriptor<unsigned> arg_threads = {"threads", "Number of partitions exported at once, 0 for one per CPU", 0};
+
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
+  command_line::add_arg(desc_cmd_sett, arg_output_dir);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
+  command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_database);
+  command_line::add_arg(desc_cmd_sett, arg_block_start);
+  command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_confirmations);
+  command_line::add_arg(desc_cmd_sett, arg_partition_size);
+  command_line::add_arg(desc_cmd_sett, arg_threads);
+
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (! r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Electroneum Classic '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("etnc-blockchain-export-columns.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log(std::string(std::to_string(log_level) + ",bcutil:INFO").c_str());
+
+  LOG_PRINT_L0("Starting...");
+
+  bool opt_testnet = command_line::get_arg(vm, cryptonote::arg_testnet_on);
+  bool opt_stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
+  if (opt_testnet && opt_stagenet)
+  {
+    std::cerr << "Can't specify more than one of --testnet and --stagenet" << std::endl;
+    return 1;
+  }
+  const uint64_t partition_size = command_line::get_arg(vm, arg_partition_size);
+  if (partition_size == 0)
+  {
+    std::cerr << "Partition size must be at least 1" << std::endl;
+    return 1;
+  }
+
+  std::string m_config_folder = command_line::get_arg(vm, cryptonote::arg_data_dir);
+
+  std::string db_type = command_line::get_arg(vm, arg_database);
+  if (!cryptonote::blockchain_valid_db_type(db_type))
+  {
+    std::cerr << "Invalid database type: " << db_type << std::endl;
+    return 1;
+  }
+
+  boost::filesystem::path output_dir;
+  if (command_line::has_arg(vm, arg_output_dir))
+    output_dir = boost::filesystem::path(command_line::get_arg(vm, arg_output_dir));
+  else
+    output_dir = boost::filesystem::path(m_config_folder) / "export" / "columns";
+  boost::system::error_code ec;
+  boost::filesystem::create_directories(output_dir, ec);
+  if (ec)
+  {
+    std::cerr << "Failed to create " << output_dir.string() << ": " << ec.message() << std::endl;
+    return 1;
+  }
+  LOG_PRINT_L0("Export output directory: " << output_dir.string());
+
+  LOG_PRINT_L0("Initializing source blockchain (BlockchainDB)");
+  std::unique_ptr<Blockchain> core_storage;
+  tx_memory_pool m_mempool(*core_storage);
+  core_storage.reset(new Blockchain(m_mempool));
+  BlockchainDB* db = new_db(db_type);
+  if (db == NULL)
+  {
+    LOG_ERROR("Attempted to use non-existent database type: " << db_type);
+    throw std::runtime_error("Attempting to use non-existent database type");
+  }
+  LOG_PRINT_L0("database: " << db_type);
+
+  boost::filesystem::path folder(m_config_folder);
+  folder /= db->get_db_name();
+  const std::string filename = folder.string();
+
+  LOG_PRINT_L0("Loading blockchain from folder " << filename << " ...");
+  try
+  {
+    db->open(filename, DBF_RDONLY);
+  }
+  catch (const std::exception& e)
+  {
+    LOG_PRINT_L0("Error opening database: " << e.what());
+    return 1;
+  }
+  r = core_storage->init(db, opt_testnet ? cryptonote::TESTNET : opt_stagenet ? cryptonote::STAGENET : cryptonote::MAINNET);
+  CHECK_AND_ASSERT_MES(r, 1, "Failed to initialize source blockchain storage");
+  LOG_PRINT_L0("Source blockchain storage initialized OK");
+
+  uint64_t start_height = 0;
+  crypto::hash last_hash;
+  if (!command_line::is_arg_defaulted(vm, arg_block_start))
+  {
+    start_height = command_line::get_arg(vm, arg_block_start);
+  }
+  else if (load_state(output_dir, start_height, last_hash) && start_height > 0)
+  {
+    if (start_height > db->height() || db->get_block_hash_from_height(start_height - 1) != last_hash)
+    {
+      LOG_ERROR("Block " << (start_height - 1) << " is not the one last exported, the chain reorganized below it; "
+          "export again with --block-start below the reorganization");
+      return 1;
+    }
+  }
+
+  const uint64_t confirmations = command_line::get_arg(vm, arg_confirmations);
+  const uint64_t db_height = db->height();
+  uint64_t stop_height = db_height > confirmations ? db_height - confirmations : 0;
+  if (!command_line::is_arg_defaulted(vm, arg_block_stop))
+    stop_height = std::min(stop_height, command_line::get_arg(vm, arg_block_stop) + 1);
+  if (start_height >= stop_height)
+  {
+    LOG_PRINT_L0("Nothing to export, next height is " << start_height << ", confirmed height " << stop_height);
+    return 0;
+  }
+
+  if (!write_schema(output_dir))
+  {
+    LOG_ERROR("Failed to write the schema to " << output_dir.string());
+    return 1;
+  }
+
+  unsigned threads = command_line::get_arg(vm, arg_threads);
+  tools::threadpool::configure(tools::threadpool::block, threads);
+  tools::threadpool &tpool = tools::threadpool::getInstance(tools::threadpool::block);
+  threads = tpool.get_max_concurrency();
+
+  LOG_PRINT_L0("Exporting blocks " << start_height << " to " << (stop_height - 1) << " with " << threads << " threads");
+
+  // partitions are exported a wave at a time, and the state moved past a
+  // wave once all of it is on disk, so an interrupted export resumes from
+  // the last complete wave
+  for (uint64_t height = start_height; height < stop_height; )
+  {
+    tools::threadpool::waiter waiter;
+    std::atomic<bool> failed(false);
+    uint64_t wave_end = height;
+    for (unsigned n = 0; n < threads && wave_end < stop_height; ++n)
+    {
+      const uint64_t first = wave_end;
+      const uint64_t last = std::min(stop_height, first + partition_size) - 1;
+      tpool.submit(&waiter, [&, first, last]() {
+        try
+        {
+          if (!export_partition(*db, first, last, output_dir))
+            failed = true;
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to export blocks " << first << " to " << last << ": " << e.what());
+          failed = true;
+        }
+      });
+      wave_end = last + 1;
+    }
+    waiter.wait(&tpool);
+    if (failed)
+    {
+      LOG_ERROR("Export failed, blocks from " << height << " on will be exported again on the next run");
+      return 1;
+    }
+    if (!save_state(output_dir, wave_end, db->get_block_hash_from_height(wave_end - 1)))
+    {
+      LOG_ERROR("Failed to save the export state to " << output_dir.string());
+      return 1;
+    }
+    height = wave_end;
+    LOG_PRINT_L0("Exported up to block " << (height - 1) << " / " << (stop_height - 1));
+  }
+
+  LOG_PRINT_L0("Blockchain columns exported OK");
+  return 0;
+
+  CATCH_ENTRY("Export error", 1);
+}
@@ -27,15 +27,20 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <atomic>
+#include <unordered_set>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string.hpp>
 #include "common/command_line.h"
+#include "common/threadpool.h"
+#include "common/util.h"
 #include "common/varint.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_core/blockchain.h"
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/db_types.h"
+#include "file_io_utils.h"
 #include "version.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -45,6 +50,216 @@ namespace po = boost::program_options;
 using namespace epee;
 using namespace cryptonote;
 
+static std::atomic<bool> stop_requested(false);
+
+// the min depth of the txes of a block
+struct block_depths_t
+{
+  uint64_t height;
+  std::vector<std::pair<crypto::hash, uint64_t>> depths;
+};
+
+// depths of the blocks from from_height to below next_height, saved between runs
+struct depth_state_t
+{
+  uint64_t from_height;
+  uint64_t next_height;
+  bool include_coinbase;
+  std::vector<block_depths_t> blocks;
+};
+
+namespace
+{
+  // the amount and absolute offsets of each ring of a tx
+  bool get_tx_rings(const BlockchainDB *db, const crypto::hash &txid, bool &coinbase, std::vector<std::pair<uint64_t, std::vector<uint64_t>>> &rings)
+  {
+    cryptonote::blobdata bd;
+    if (!db->get_pruned_tx_blob(txid, bd))
+    {
+      LOG_PRINT_L0("Failed to get txid " << txid << " from db");
+      return false;
+    }
+    cryptonote::transaction tx;
+    if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+    {
+      LOG_PRINT_L0("Bad tx: " << txid);
+      return false;
+    }
+    coinbase = false;
+    rings.clear();
+    for (size_t ring = 0; ring < tx.vin.size(); ++ring)
+    {
+      if (tx.vin[ring].type() == typeid(cryptonote::txin_gen))
+      {
+        MDEBUG(txid << " is a coinbase transaction");
+        coinbase = true;
+        return true;
+      }
+      if (tx.vin[ring].type() != typeid(cryptonote::txin_to_key))
+      {
+        LOG_PRINT_L0("Bad vin type in txid " << txid);
+        return false;
+      }
+      const cryptonote::txin_to_key &txin = boost::get<cryptonote::txin_to_key>(tx.vin[ring]);
+      rings.push_back(std::make_pair(txin.amount, cryptonote::relative_output_offsets_to_absolute(txin.key_offsets)));
+    }
+    return true;
+  }
+
+  // the txids which created the given ring members, from the output index rather than
+  // by scanning the txes of the block they are in
+  bool get_ring_origins(const BlockchainDB *db, uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<crypto::hash> &origins)
+  {
+    std::vector<tx_out_index> indices;
+    db->get_output_tx_and_index(amount, offsets, indices);
+    if (indices.size() != offsets.size())
+    {
+      LOG_PRINT_L0("Output originating transaction not found");
+      return false;
+    }
+    origins.clear();
+    origins.reserve(indices.size());
+    for (const tx_out_index &i: indices)
+      origins.push_back(i.first);
+    return true;
+  }
+
+  // the fewest steps from a tx back to a coinbase tx, going from each ring
+  // member to the tx which created it. The walk goes a depth at a time, and
+  // looks at each tx once, at the lowest depth it is reached at. The depths
+  // of txes walked before are in known, and bound the walk.
+  bool get_min_depth(const BlockchainDB *db, const crypto::hash &start_txid, std::unordered_map<crypto::hash, uint64_t> &known, uint64_t &min_depth)
+  {
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    std::unordered_set<crypto::hash> seen;
+    std::vector<crypto::hash> txids(1, start_txid), new_txids, origins;
+    std::vector<std::pair<uint64_t, std::vector<uint64_t>>> rings;
+    seen.insert(start_txid);
+    for (uint64_t depth = 0; !txids.empty() && depth < best; ++depth)
+    {
+      if (stop_requested)
+        return false;
+      MDEBUG("Considering " << txids.size() << " transaction(s) at depth " << depth);
+      new_txids.clear();
+      for (const crypto::hash &txid: txids)
+      {
+        const auto k = known.find(txid);
+        if (k != known.end())
+        {
+          best = std::min(best, depth + k->second);
+          continue;
+        }
+        bool coinbase;
+        if (!get_tx_rings(db, txid, coinbase, rings))
+          return false;
+        if (coinbase)
+        {
+          best = depth;
+          break;
+        }
+        for (const auto &ring: rings)
+        {
+          if (!get_ring_origins(db, ring.first, ring.second, origins))
+            return false;
+          for (const crypto::hash &origin: origins)
+          {
+            if (seen.insert(origin).second)
+              new_txids.push_back(origin);
+          }
+        }
+      }
+      std::swap(txids, new_txids);
+    }
+    if (best == std::numeric_limits<uint64_t>::max())
+    {
+      LOG_PRINT_L0("No coinbase transaction reached from " << start_txid);
+      return false;
+    }
+    known[start_txid] = best;
+    min_depth = best;
+    return true;
+  }
+
+  bool get_block_txids(const BlockchainDB *db, uint64_t height, bool include_coinbase, std::vector<crypto::hash> &txids)
+  {
+    const crypto::hash block_hash = db->get_block_hash_from_height(height);
+    const cryptonote::blobdata bd = db->get_block_blob(block_hash);
+    cryptonote::block b;
+    if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
+    {
+      LOG_PRINT_L0("Bad block from db");
+      return false;
+    }
+    txids = b.tx_hashes;
+    if (include_coinbase)
+      txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
+    return true;
+  }
+
+  // blocks in a range share ancestors, so the depths found for a block's
+  // txes are kept for the blocks after it
+  bool get_range_depths(const BlockchainDB *db, uint64_t start, uint64_t end, bool include_coinbase, std::vector<block_depths_t> &blocks)
+  {
+    std::unordered_map<crypto::hash, uint64_t> known;
+    std::vector<crypto::hash> txids;
+    for (uint64_t h = start; h < end; ++h)
+    {
+      if (!get_block_txids(db, h, include_coinbase, txids))
+        return false;
+      block_depths_t block_depths;
+      block_depths.height = h;
+      for (const crypto::hash &txid: txids)
+      {
+        uint64_t depth;
+        if (!get_min_depth(db, txid, known, depth))
+          return false;
+        block_depths.depths.push_back(std::make_pair(txid, depth));
+      }
+      blocks.push_back(std::move(block_depths));
+    }
+    return true;
+  }
+
+  // "<from height> <next height> <include coinbase>", then a line per tx
+  // "<height> <txid> <depth>"
+  bool load_state(const std::string &path, depth_state_t &state)
+  {
+    std::string contents;
+    if (!epee::file_io_utils::load_file_to_string(path, contents))
+      return false;
+    std::istringstream iss(contents);
+    if (!(iss >> state.from_height >> state.next_height >> state.include_coinbase))
+      throw std::runtime_error("Invalid state file " + path);
+    state.blocks.clear();
+    uint64_t height, depth;
+    std::string txid_str;
+    while (iss >> height >> txid_str >> depth)
+    {
+      crypto::hash txid;
+      if (!epee::string_tools::hex_to_pod(txid_str, txid))
+        throw std::runtime_error("Invalid state file " + path);
+      if (state.blocks.empty() || state.blocks.back().height != height)
+        state.blocks.push_back({height, {}});
+      state.blocks.back().depths.push_back(std::make_pair(txid, depth));
+    }
+    return true;
+  }
+
+  bool save_state(const std::string &path, const depth_state_t &state)
+  {
+    std::string contents = std::to_string(state.from_height) + " " + std::to_string(state.next_height) + " " + (state.include_coinbase ? "1" : "0") + "\n";
+    for (const block_depths_t &b: state.blocks)
+      for (const auto &d: b.depths)
+        contents += std::to_string(b.height) + " " + epee::string_tools::pod_to_hex(d.first) + " " + std::to_string(d.second) + "\n";
+    const std::string tmp = path + ".tmp";
+    if (!epee::file_io_utils::save_string_to_file(tmp, contents))
+      return false;
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, path, ec);
+    return !ec;
+  }
+}
+
 int main(int argc, char* argv[])
 {
   TRY_ENTRY();
@@ -70,7 +285,11 @@ int main(int argc, char* argv[])
   };
   const command_line::arg_descriptor<std::string> arg_txid  = {"txid", "Get min depth for this txid", ""};
   const command_line::arg_descriptor<uint64_t> arg_height  = {"height", "Get min depth for all txes at this height", 0};
+  const command_line::arg_descriptor<uint64_t> arg_to_height  = {"to-height", "Get min depth for all txes from --height up to this height", 0};
   const command_line::arg_descriptor<bool> arg_include_coinbase  = {"include-coinbase", "Include coinbase in the average", false};
+  const command_line::arg_descriptor<std::string> arg_state_file = {"state-file", "Save depths to this file as blocks are done, and carry on from it on the next run", ""};
+  const command_line::arg_descriptor<uint64_t> arg_blocks_per_task = {"blocks-per-task", "Number of blocks a thread walks at a time", 100};
+  const command_line::arg_descriptor<unsigned> arg_threads = {"threads", "Number of threads, 0 for one per CPU", 0};
 
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
@@ -79,7 +298,11 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_txid);
   command_line::add_arg(desc_cmd_sett, arg_height);
+  command_line::add_arg(desc_cmd_sett, arg_to_height);
   command_line::add_arg(desc_cmd_sett, arg_include_coinbase);
+  command_line::add_arg(desc_cmd_sett, arg_state_file);
+  command_line::add_arg(desc_cmd_sett, arg_blocks_per_task);
+  command_line::add_arg(desc_cmd_sett, arg_threads);
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
   po::options_description desc_options("Allowed options");
@@ -117,13 +340,26 @@ int main(int argc, char* argv[])
   network_type net_type = opt_testnet ? TESTNET : opt_stagenet ? STAGENET : MAINNET;
   std::string opt_txid_string = command_line::get_arg(vm, arg_txid);
   uint64_t opt_height = command_line::get_arg(vm, arg_height);
+  uint64_t opt_to_height = command_line::is_arg_defaulted(vm, arg_to_height) ? opt_height : command_line::get_arg(vm, arg_to_height);
   bool opt_include_coinbase = command_line::get_arg(vm, arg_include_coinbase);
+  const std::string opt_state_file = command_line::get_arg(vm, arg_state_file);
+  const uint64_t blocks_per_task = command_line::get_arg(vm, arg_blocks_per_task);
 
-  if (!opt_txid_string.empty() && opt_height)
+  if (!opt_txid_string.empty() && (opt_height || opt_to_height))
   {
     std::cerr << "txid and height cannot be given at the same time" << std::endl;
     return 1;
   }
+  if (opt_to_height < opt_height)
+  {
+    std::cerr << "to-height cannot be below height" << std::endl;
+    return 1;
+  }
+  if (blocks_per_task == 0)
+  {
+    std::cerr << "Blocks per task must be at least 1" << std::endl;
+    return 1;
+  }
   crypto::hash opt_txid = crypto::null_hash;
   if (!opt_txid_string.empty())
   {
@@ -181,169 +417,113 @@ int main(int argc, char* argv[])
   CHECK_AND_ASSERT_MES(r, 1, "Failed to initialize source blockchain storage");
   LOG_PRINT_L0("Source blockchain storage initialized OK");
 
-  std::vector<crypto::hash> start_txids;
+  std::vector<uint64_t> depths;
   if (!opt_txid_string.empty())
   {
-    start_txids.push_back(opt_txid);
+    LOG_PRINT_L0("Checking depth for txid " << opt_txid);
+    std::unordered_map<crypto::hash, uint64_t> known;
+    uint64_t depth;
+    if (!get_min_depth(db, opt_txid, known, depth))
+      return 1;
+    LOG_PRINT_L0("Min depth for txid " << opt_txid << ": " << depth);
+    depths.push_back(depth);
   }
   else
   {
-    const crypto::hash block_hash = db->get_block_hash_from_height(opt_height);
-    const cryptonote::blobdata bd = db->get_block_blob(block_hash);
-    cryptonote::block b;
-    if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
+    depth_state_t state;
+    state.from_height = opt_height;
+    state.next_height = opt_height;
+    state.include_coinbase = opt_include_coinbase;
+    if (!opt_state_file.empty() && load_state(opt_state_file, state))
     {
-      LOG_PRINT_L0("Bad block from db");
-      return 1;
+      if (state.from_height != opt_height || state.include_coinbase != opt_include_coinbase)
+      {
+        LOG_ERROR("The state in " << opt_state_file << " was saved from height " << state.from_height << (state.include_coinbase ? " with" : " without")
+            << " --include-coinbase, remove it to start over");
+        return 1;
+      }
+      LOG_PRINT_L0("Carrying on from block " << state.next_height);
     }
-    for (const crypto::hash &txid: b.tx_hashes)
-      start_txids.push_back(txid);
-    if (opt_include_coinbase)
-      start_txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
-  }
+    const uint64_t stop_height = std::min(opt_to_height + 1, db->height());
 
-  if (start_txids.empty())
-  {
-    LOG_PRINT_L0("No transaction(s) to check");
-    return 1;
-  }
+    tools::signal_handler::install([](int type) {
+      stop_requested = true;
+    });
 
-  std::vector<uint64_t> depths;
-  for (const crypto::hash &start_txid: start_txids)
-  {
-    uint64_t depth = 0;
-    bool coinbase = false;
+    unsigned threads = command_line::get_arg(vm, arg_threads);
+    tools::threadpool::configure(tools::threadpool::block, threads);
+    tools::threadpool &tpool = tools::threadpool::getInstance(tools::threadpool::block);
+    threads = tpool.get_max_concurrency();
 
-    LOG_PRINT_L0("Checking depth for txid " << start_txid);
-    std::vector<crypto::hash> txids(1, start_txid);
-    while (!coinbase)
+    // ranges are walked a wave at a time, and the state saved once a wave
+    // is done, so an interrupted run resumes from the last complete wave
+    while (state.next_height < stop_height && !stop_requested)
     {
-      LOG_PRINT_L0("Considering "<< txids.size() << " transaction(s) at depth " << depth);
-      std::vector<crypto::hash> new_txids;
-      for (const crypto::hash &txid: txids)
+      tools::threadpool::waiter waiter;
+      std::atomic<bool> failed(false);
+      std::vector<std::vector<block_depths_t>> task_blocks(threads);
+      uint64_t wave_end = state.next_height;
+      for (unsigned n = 0; n < threads && wave_end < stop_height; ++n)
       {
-        cryptonote::blobdata bd;
-        if (!db->get_pruned_tx_blob(txid, bd))
-        {
-          LOG_PRINT_L0("Failed to get txid " << txid << " from db");
-          return 1;
-        }
-        cryptonote::transaction tx;
-        if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
-        {
-          LOG_PRINT_L0("Bad tx: " << txid);
-          return 1;
-        }
-        for (size_t ring = 0; ring < tx.vin.size(); ++ring)
-        {
-          if (tx.vin[ring].type() == typeid(cryptonote::txin_gen))
+        const uint64_t start = wave_end;
+        const uint64_t end = std::min(stop_height, start + blocks_per_task);
+        tpool.submit(&waiter, [&, n, start, end]() {
+          try
           {
-            MDEBUG(txid << " is a coinbase transaction");
-            coinbase = true;
-            goto done;
+            if (!get_range_depths(db, start, end, opt_include_coinbase, task_blocks[n]))
+              failed = true;
           }
-          if (tx.vin[ring].type() == typeid(cryptonote::txin_to_key))
+          catch (const std::exception &e)
           {
-            const cryptonote::txin_to_key &txin = boost::get<cryptonote::txin_to_key>(tx.vin[ring]);
-            const uint64_t amount = txin.amount;
-            auto absolute_offsets = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-            for (uint64_t offset: absolute_offsets)
-            {
-              const output_data_t od = db->get_output_key(amount, offset);
-              const crypto::hash block_hash = db->get_block_hash_from_height(od.height);
-              bd = db->get_block_blob(block_hash);
-              cryptonote::block b;
-              if (!cryptonote::parse_and_validate_block_from_blob(bd, b))
-              {
-                LOG_PRINT_L0("Bad block from db");
-                return 1;
-              }
-              // find the tx which created this output
-              bool found = false;
-              for (size_t out = 0; out < b.miner_tx.vout.size(); ++out)
-              {
-                if (b.miner_tx.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                {
-                  const auto &txout = boost::get<cryptonote::txout_to_key>(b.miner_tx.vout[out].target);
-                  if (txout.key == od.pubkey)
-                  {
-                    found = true;
-                    new_txids.push_back(cryptonote::get_transaction_hash(b.miner_tx));
-                    MDEBUG("adding txid: " << cryptonote::get_transaction_hash(b.miner_tx));
-                    break;
-                  }
-                }
-                else
-                {
-                  LOG_PRINT_L0("Bad vout type in txid " << cryptonote::get_transaction_hash(b.miner_tx));
-                  return 1;
-                }
-              }
-              for (const crypto::hash &block_txid: b.tx_hashes)
-              {
-                if (found)
-                  break;
-                if (!db->get_pruned_tx_blob(block_txid, bd))
-                {
-                  LOG_PRINT_L0("Failed to get txid " << block_txid << " from db");
-                  return 1;
-                }
-                cryptonote::transaction tx2;
-                if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx2))
-                {
-                  LOG_PRINT_L0("Bad tx: " << block_txid);
-                  return 1;
-                }
-                for (size_t out = 0; out < tx2.vout.size(); ++out)
-                {
-                  if (tx2.vout[out].target.type() == typeid(cryptonote::txout_to_key))
-                  {
-                    const auto &txout = boost::get<cryptonote::txout_to_key>(tx2.vout[out].target);
-                    if (txout.key == od.pubkey)
-                    {
-                      found = true;
-                      new_txids.push_back(block_txid);
-                      MDEBUG("adding txid: " << block_txid);
-                      break;
-                    }
-                  }
-                  else
-                  {
-                    LOG_PRINT_L0("Bad vout type in txid " << block_txid);
-                    return 1;
-                  }
-                }
-              }
-              if (!found)
-              {
-                LOG_PRINT_L0("Output originating transaction not found");
-                return 1;
-              }
-            }
-          }
-          else
-          {
-            LOG_PRINT_L0("Bad vin type in txid " << txid);
-            return 1;
+            MERROR("Failed to get depths for blocks " << start << " to " << (end - 1) << ": " << e.what());
+            failed = true;
           }
+        });
+        wave_end = end;
+      }
+      waiter.wait(&tpool);
+      if (failed)
+      {
+        if (stop_requested)
+          break;
+        return 1;
+      }
+
+      for (std::vector<block_depths_t> &blocks: task_blocks)
+      {
+        for (block_depths_t &b: blocks)
+        {
+          for (const auto &d: b.depths)
+            LOG_PRINT_L0("Min depth for txid " << d.first << ": " << d.second);
+          state.blocks.push_back(std::move(b));
         }
       }
-      if (!coinbase)
+      state.next_height = wave_end;
+      if (!opt_state_file.empty() && !save_state(opt_state_file, state))
       {
-        std::swap(txids, new_txids);
-        ++depth;
+        LOG_ERROR("Failed to save the state to " << opt_state_file);
+        return 1;
       }
     }
-done:
-    LOG_PRINT_L0("Min depth for txid " << start_txid << ": " << depth);
-    depths.push_back(depth);
+    if (stop_requested)
+      LOG_PRINT_L0("Stopped at block " << state.next_height);
+
+    for (const block_depths_t &b: state.blocks)
+      for (const auto &d: b.depths)
+        depths.push_back(d.second);
+  }
+
+  if (depths.empty())
+  {
+    LOG_PRINT_L0("No transaction(s) to check");
+    return 1;
   }
 
   uint64_t cumulative_depth = 0;
   for (uint64_t depth: depths)
     cumulative_depth += depth;
-  LOG_PRINT_L0("Average min depth for " << start_txids.size() << " transaction(s): " << cumulative_depth/(float)depths.size());
-  LOG_PRINT_L0("Median min depth for " << start_txids.size() << " transaction(s): " << epee::misc_utils::median(depths));
+  LOG_PRINT_L0("Average min depth for " << depths.size() << " transaction(s): " << cumulative_depth/(float)depths.size());
+  LOG_PRINT_L0("Median min depth for " << depths.size() << " transaction(s): " << epee::misc_utils::median(depths));
 
   core_storage->deinit();
   return 0;
@@ -56,6 +56,7 @@ int main(int argc, char* argv[])
   uint32_t log_level = 0;
   uint64_t block_stop = 0;
   bool blocks_dat = false;
+  bool indexed = false;
 
   tools::on_startup();
 
@@ -70,6 +71,8 @@ int main(int argc, char* argv[])
     "database", available_dbs.c_str(), default_db_type
   };
   const command_line::arg_descriptor<bool> arg_blocks_dat = {"blocksdat", "Output in blocks.dat format", blocks_dat};
+  const command_line::arg_descriptor<bool> arg_indexed = {"indexed", "Output in the indexed, seekable bootstrap format", indexed};
+  const command_line::arg_descriptor<bool> arg_no_compress = {"no-compress", "Do not compress chunks in the indexed format", false};
 
 
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_data_dir);
@@ -80,6 +83,8 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_block_stop);
   command_line::add_arg(desc_cmd_sett, arg_blocks_dat);
+  command_line::add_arg(desc_cmd_sett, arg_indexed);
+  command_line::add_arg(desc_cmd_sett, arg_no_compress);
 
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
@@ -120,6 +125,12 @@ int main(int argc, char* argv[])
     return 1;
   }
   bool opt_blocks_dat = command_line::get_arg(vm, arg_blocks_dat);
+  bool opt_indexed = command_line::get_arg(vm, arg_indexed);
+  if (opt_blocks_dat && opt_indexed)
+  {
+    std::cerr << "Can't specify more than one of --blocksdat and --indexed" << std::endl;
+    return 1;
+  }
 
   std::string m_config_folder;
 
@@ -187,6 +198,11 @@ int main(int argc, char* argv[])
     BlocksdatFile blocksdat;
     r = blocksdat.store_blockchain_raw(core_storage, NULL, output_file_path, block_stop);
   }
+  else if (opt_indexed)
+  {
+    BootstrapFile bootstrap;
+    r = bootstrap.store_blockchain_indexed(core_storage, NULL, output_file_path, block_stop, !command_line::get_arg(vm, arg_no_compress));
+  }
   else
   {
     BootstrapFile bootstrap;
@@ -34,8 +34,10 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/thread.hpp>
 #include <unistd.h>
 #include "misc_log_ex.h"
+#include "misc_language.h"
 #include "bootstrap_file.h"
 #include "bootstrap_serialization.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
@@ -44,6 +46,7 @@
 #include "include_base_utils.h"
 #include "blockchain_db/db_types.h"
 #include "cryptonote_core/cryptonote_core.h"
+#include "common/threadpool.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
@@ -70,6 +73,14 @@ uint64_t db_batch_size = 100;
 // frequently saved
 uint64_t db_batch_size_verify = 5000;
 
+// a verified batch is handed to flush_thread, so reading and deserializing
+// the next batch from the file overlaps with verifying this one
+boost::thread flush_thread;
+std::vector<cryptonote::block_complete_entry> flush_blocks;
+std::vector<crypto::hash> flush_hashes;
+int flush_result = 0;
+uint64_t flush_height = 0; // chain height once the batch in flight is added
+
 std::string refresh_string = "\r                                    \r";
 }
 
@@ -166,46 +177,34 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
   return num_blocks;
 }
 
-int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, bool force)
+// hashes are those of the blocks, computed when they were read from the file
+int flush(cryptonote::core &core, const std::vector<block_complete_entry> &blocks, const std::vector<crypto::hash> &hashes)
 {
-  if (blocks.empty())
-    return 0;
-  if (!force && blocks.size() < db_batch_size)
-    return 0;
-
-  // wait till we can verify a full HOH without extra, for speed
-  uint64_t new_height = core.get_blockchain_storage().get_db().height() + blocks.size();
-  if (!force && new_height % HASH_OF_HASHES_STEP)
-    return 0;
+  core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes);
 
-  std::vector<crypto::hash> hashes;
-  for (const auto &b: blocks)
+  // parses blocks and checks PoW on the thread pool
+  std::vector<block> pblocks;
+  core.prepare_handle_incoming_blocks(blocks, pblocks);
+  if (!pblocks.empty() && pblocks.size() != blocks.size())
   {
-    cryptonote::block block;
-    if (!parse_and_validate_block_from_blob(b.block, block))
-    {
-      MERROR("Failed to parse block: "
-          << epee::string_tools::pod_to_hex(get_blob_hash(b.block)));
-      core.cleanup_handle_incoming_blocks();
-      return 1;
-    }
-    hashes.push_back(cryptonote::get_block_hash(block));
+    MERROR("Internal error: blocks were not parsed as expected");
+    core.cleanup_handle_incoming_blocks();
+    return 1;
   }
-  core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes);
 
-  core.prepare_handle_incoming_blocks(blocks);
-
-  for(const block_complete_entry& block_entry: blocks)
+  for (size_t i = 0; i < blocks.size(); ++i)
   {
-    // process transactions
-    for(auto& tx_blob: block_entry.txs)
+    const block_complete_entry& block_entry = blocks[i];
+
+    // process transactions, parsed on the thread pool
+    std::vector<tx_verification_context> tvc(block_entry.txs.size());
+    core.handle_incoming_txs(block_entry.txs, tvc, true, true, false);
+    for (size_t j = 0; j < tvc.size(); ++j)
     {
-      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      core.handle_incoming_tx(tx_blob, tvc, true, true, false);
-      if(tvc.m_verifivation_failed)
+      if(tvc[j].m_verifivation_failed)
       {
         MERROR("transaction verification failed, tx_id = "
-            << epee::string_tools::pod_to_hex(get_blob_hash(tx_blob)));
+            << epee::string_tools::pod_to_hex(get_blob_hash(block_entry.txs[j])));
         core.cleanup_handle_incoming_blocks();
         return 1;
       }
@@ -215,7 +214,7 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
 
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
 
-    core.handle_incoming_block(block_entry.block, bvc, false); // <--- process block
+    core.handle_incoming_block(block_entry.block, pblocks.empty() ? NULL : &pblocks[i], bvc, false); // <--- process block
 
     if(bvc.m_verifivation_failed)
     {
@@ -235,12 +234,202 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
   if (!core.cleanup_handle_incoming_blocks())
     return 1;
 
-  blocks.clear();
   return 0;
 }
 
+int wait_flush()
+{
+  if (flush_thread.joinable())
+    flush_thread.join();
+  return flush_result;
+}
+
+int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, std::vector<crypto::hash> &hashes, bool force)
+{
+  if (blocks.empty())
+    return force ? wait_flush() : 0;
+  if (!force && blocks.size() < db_batch_size)
+    return 0;
+
+  // wait till we can verify a full HOH without extra, for speed
+  uint64_t new_height = flush_height + blocks.size();
+  if (!force && new_height % HASH_OF_HASHES_STEP)
+    return 0;
+
+  // only one batch in flight, so memory stays bounded to two batches
+  int ret = wait_flush();
+  if (ret)
+    return ret;
+
+  flush_blocks.clear();
+  flush_hashes.clear();
+  flush_blocks.swap(blocks);
+  flush_hashes.swap(hashes);
+  flush_height = new_height;
+  boost::thread::attributes attrs;
+  attrs.set_stack_size(THREAD_STACK_SIZE);
+  flush_thread = boost::thread(attrs, [&core]() { flush_result = flush(core, flush_blocks, flush_hashes); });
+
+  if (force)
+    return wait_flush();
+  return 0;
+}
+
+// queues a block for verified import, or adds it straight to the db
+int import_block_package(cryptonote::core &core, const bootstrap::block_package &bp, std::vector<block_complete_entry> &blocks, std::vector<crypto::hash> &block_hashes)
+{
+  if (opt_verify)
+  {
+    cryptonote::blobdata block;
+    cryptonote::block_to_blob(bp.block, block);
+    std::vector<cryptonote::blobdata> txs;
+    for (const auto &tx: bp.txs)
+    {
+      txs.push_back(cryptonote::blobdata());
+      cryptonote::tx_to_blob(tx, txs.back());
+    }
+    blocks.push_back({block, txs});
+    block_hashes.push_back(cryptonote::get_block_hash(bp.block));
+    return check_flush(core, blocks, block_hashes, false);
+  }
+
+  // add_block() adds the coinbase tx itself, so bp.txs are only the
+  // regular transactions
+  try
+  {
+    core.get_blockchain_storage().get_db().add_block(bp.block, bp.block_weight, bp.cumulative_difficulty, bp.coins_generated, bp.txs);
+  }
+  catch (const std::exception& e)
+  {
+    std::cout << refresh_string;
+    MFATAL("Error adding block to blockchain: " << e.what());
+    return 2;
+  }
+  return 0;
+}
+
+int import_from_indexed_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop)
+{
+  core.get_blockchain_storage().get_db().reset_stats();
+
+  BootstrapFile bootstrap;
+  if (!bootstrap.open_indexed(import_file_path))
+    return 2;
+  const std::vector<bootstrap::chunk_index_entry> &index = bootstrap.get_index();
+
+  uint64_t start_height = 1;
+  if (opt_resume)
+    start_height = core.get_blockchain_storage().get_current_blockchain_height();
+  const uint64_t total_source_blocks = bootstrap.indexed_block_count();
+  MINFO("bootstrap file last block number: " << total_source_blocks-1 << " (zero-based height)  total blocks: " << total_source_blocks);
+  if (total_source_blocks-1 <= start_height)
+    return false;
+  if (!block_stop || block_stop > total_source_blocks - 1)
+    block_stop = total_source_blocks - 1;
+  MINFO("start block: " << start_height << "  stop block: " << block_stop);
+
+  bool use_batch = opt_batch && !opt_verify;
+  // DB batches are sized from the decoded chunk sizes in the index
+  auto batch_bytes = [&index](size_t chunk) {
+    uint64_t bytes = 0;
+    for (uint64_t blocks = 0; chunk < index.size() && blocks < db_batch_size; ++chunk)
+    {
+      bytes += index[chunk].raw_size;
+      blocks += index[chunk].num_blocks;
+    }
+    return bytes;
+  };
+
+  std::vector<block_complete_entry> blocks;
+  std::vector<crypto::hash> block_hashes;
+  flush_height = core.get_blockchain_storage().get_db().height();
+  flush_result = 0;
+  epee::misc_utils::auto_scope_leave_caller flush_guard = epee::misc_utils::create_scope_leave_handler([](){ wait_flush(); });
+
+  // seek straight to the chunk holding start_height, then decode as many
+  // chunks at a time as there are threads
+  size_t chunk = bootstrap.find_indexed_chunk(start_height);
+  const size_t chunks_per_read = std::max<size_t>(1, tools::threadpool::getInstance().get_max_concurrency());
+  if (use_batch)
+    core.get_blockchain_storage().get_db().batch_start(db_batch_size, batch_bytes(chunk));
+
+  uint64_t h = start_height;
+  uint64_t num_imported = 0;
+  int quit = 0;
+  std::vector<bootstrap::block_package> bps;
+  while (!quit && chunk < index.size())
+  {
+    if (!bootstrap.read_indexed_chunks(chunk, chunks_per_read, bps))
+    {
+      quit = 2;
+      break;
+    }
+    chunk += chunks_per_read;
+
+    for (const bootstrap::block_package &bp: bps)
+    {
+      const uint64_t height = boost::get<txin_gen>(bp.block.miner_tx.vin.front()).height;
+      if (height < h)
+        continue;
+      if (height > block_stop)
+      {
+        MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
+        quit = 1;
+        break;
+      }
+      if (height != h)
+      {
+        MFATAL("Unexpected block height in bootstrap file: " << height << ", expected " << h);
+        quit = 2;
+        break;
+      }
+
+      if (import_block_package(core, bp, blocks, block_hashes))
+      {
+        quit = 2; // make sure we don't commit partial block data
+        break;
+      }
+      ++h;
+      ++num_imported;
+
+      if (h % 10 == 0)
+        std::cout << refresh_string << "block " << h-1 << " / " << block_stop << std::flush;
+
+      if (use_batch && (h-1) % db_batch_size == 0)
+      {
+        std::cout << refresh_string;
+        std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
+        core.get_blockchain_storage().get_db().batch_stop();
+        core.get_blockchain_storage().get_db().batch_start(db_batch_size, batch_bytes(bootstrap.find_indexed_chunk(h)));
+        std::cout << ENDL;
+        core.get_blockchain_storage().get_db().show_stats();
+      }
+    }
+  }
+  std::cout << refresh_string;
+
+  if (opt_verify && quit < 2)
+  {
+    int ret = check_flush(core, blocks, block_hashes, true);
+    if (ret)
+      return ret;
+  }
+
+  if (use_batch && quit < 2)
+    core.get_blockchain_storage().get_db().batch_stop();
+
+  core.get_blockchain_storage().get_db().show_stats();
+  MINFO("Number of blocks imported: " << num_imported);
+  MINFO("Finished at block: " << h-1 << "  total blocks: " << h);
+  std::cout << ENDL;
+  return quit > 1 ? 2 : 0;
+}
+
 int import_from_file(cryptonote::core& core, const std::string& import_file_path, uint64_t block_stop=0)
 {
+  if (BootstrapFile::is_indexed_file(import_file_path))
+    return import_from_indexed_file(core, import_file_path, block_stop);
+
   // Reset stats, in case we're using newly created db, accumulating stats
   // from addition of genesis block.
   // This aligns internal db counts with importer counts.
@@ -315,6 +504,11 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   std::cout << ENDL;
 
   std::vector<block_complete_entry> blocks;
+  std::vector<crypto::hash> block_hashes;
+  flush_height = core.get_blockchain_storage().get_db().height();
+  flush_result = 0;
+  // never leave with a batch still being verified
+  epee::misc_utils::auto_scope_leave_caller flush_guard = epee::misc_utils::create_scope_leave_handler([](){ wait_flush(); });
 
   // Skip to start_height before we start adding.
   {
@@ -435,84 +629,26 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
             << std::flush;
         }
 
-        if (opt_verify)
+        if (import_block_package(core, bp, blocks, block_hashes))
         {
-          cryptonote::blobdata block;
-          cryptonote::block_to_blob(bp.block, block);
-          std::vector<cryptonote::blobdata> txs;
-          for (const auto &tx: bp.txs)
-          {
-            txs.push_back(cryptonote::blobdata());
-            cryptonote::tx_to_blob(tx, txs.back());
-          }
-          blocks.push_back({block, txs});
-          int ret = check_flush(core, blocks, false);
-          if (ret)
-          {
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
+          quit = 2; // make sure we don't commit partial block data
+          break;
         }
-        else
+
+        if (use_batch && (h-1) % db_batch_size == 0)
         {
-          std::vector<transaction> txs;
-          std::vector<transaction> archived_txs;
-
-          archived_txs = bp.txs;
-
-          // tx number 1: coinbase tx
-          // tx number 2 onwards: archived_txs
-          for (const transaction &tx : archived_txs)
-          {
-            // add blocks with verification.
-            // for Blockchain and blockchain_storage add_new_block().
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(tx);
-          }
-
-          size_t block_weight;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
-
-          block_weight = bp.block_weight;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
-
-          try
-          {
-            core.get_blockchain_storage().get_db().add_block(b, block_weight, cumulative_difficulty, coins_generated, txs);
-          }
-          catch (const std::exception& e)
-          {
-            std::cout << refresh_string;
-            MFATAL("Error adding block to blockchain: " << e.what());
-            quit = 2; // make sure we don't commit partial block data
-            break;
-          }
-
-          if (use_batch)
-          {
-            if ((h-1) % db_batch_size == 0)
-            {
-              uint64_t bytes, h2;
-              bool q2;
-              std::cout << refresh_string;
-              // zero-based height
-              std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
-              core.get_blockchain_storage().get_db().batch_stop();
-              pos = import_file.tellg();
-              bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-              import_file.seekg(pos);
-              core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
-              std::cout << ENDL;
-              core.get_blockchain_storage().get_db().show_stats();
-            }
-          }
+          uint64_t bytes, h2;
+          bool q2;
+          std::cout << refresh_string;
+          // zero-based height
+          std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
+          core.get_blockchain_storage().get_db().batch_stop();
+          pos = import_file.tellg();
+          bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
+          import_file.seekg(pos);
+          core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
+          std::cout << ENDL;
+          core.get_blockchain_storage().get_db().show_stats();
         }
         ++num_imported;
       }
@@ -530,7 +666,7 @@ quitting:
 
   if (opt_verify)
   {
-    int ret = check_flush(core, blocks, true);
+    int ret = check_flush(core, blocks, block_hashes, true);
     if (ret)
       return ret;
   }
@@ -0,0 +1,316 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Replays a range of an indexed bootstrap file through the same core calls
+// the sync code makes, into a scratch database, and reports the throughput
+// and where the time went.
+
+#include <boost/filesystem.hpp>
+#include "misc_log_ex.h"
+#include "misc_language.h"
+#include "profile_tools.h"
+#include "bootstrap_file.h"
+#include "bootstrap_serialization.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "include_base_utils.h"
+#include "blockchain_db/db_types.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "common/threadpool.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
+
+namespace po = boost::program_options;
+using namespace cryptonote;
+using namespace epee;
+
+namespace
+{
+  // time spent outside Blockchain::handle_block_to_main_chain
+  struct pipeline_times
+  {
+    uint64_t read_ms = 0;
+    uint64_t prepare_ms = 0;
+    uint64_t txs_ms = 0;
+    uint64_t blocks_ms = 0;
+    uint64_t cleanup_ms = 0;
+  };
+
+  bool replay(cryptonote::core &core, const std::vector<block_complete_entry> &blocks, const std::vector<crypto::hash> &hashes, pipeline_times &times)
+  {
+    TIME_MEASURE_START(prepare);
+    core.prevalidate_block_hashes(core.get_current_blockchain_height(), hashes);
+    std::vector<block> pblocks;
+    core.prepare_handle_incoming_blocks(blocks, pblocks);
+    TIME_MEASURE_FINISH(prepare);
+    times.prepare_ms += prepare;
+    if (!pblocks.empty() && pblocks.size() != blocks.size())
+    {
+      MERROR("Internal error: blocks were not parsed as expected");
+      core.cleanup_handle_incoming_blocks();
+      return false;
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+      const block_complete_entry &block_entry = blocks[i];
+
+      TIME_MEASURE_START(txs);
+      std::vector<tx_verification_context> tvc(block_entry.txs.size());
+      core.handle_incoming_txs(block_entry.txs, tvc, true, true, false);
+      TIME_MEASURE_FINISH(txs);
+      times.txs_ms += txs;
+      for (size_t j = 0; j < tvc.size(); ++j)
+      {
+        if (tvc[j].m_verifivation_failed)
+        {
+          MERROR("transaction verification failed, tx_id = " << get_blob_hash(block_entry.txs[j]));
+          core.cleanup_handle_incoming_blocks();
+          return false;
+        }
+      }
+
+      TIME_MEASURE_START(blk);
+      block_verification_context bvc = boost::value_initialized<block_verification_context>();
+      core.handle_incoming_block(block_entry.block, pblocks.empty() ? NULL : &pblocks[i], bvc, false);
+      TIME_MEASURE_FINISH(blk);
+      times.blocks_ms += blk;
+      if (bvc.m_verifivation_failed || !bvc.m_added_to_main_chain)
+      {
+        MERROR("Block was not added to the main chain, id = " << get_blob_hash(block_entry.block));
+        core.cleanup_handle_incoming_blocks();
+        return false;
+      }
+    }
+
+    TIME_MEASURE_START(cleanup);
+    const bool r = core.cleanup_handle_incoming_blocks();
+    TIME_MEASURE_FINISH(cleanup);
+    times.cleanup_ms += cleanup;
+    return r;
+  }
+
+  double per_second(uint64_t count, uint64_t ms)
+  {
+    return ms ? count * 1000.0 / ms : 0.0;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+  tools::on_startup();
+
+  po::options_description desc_cmd_only("Command line options");
+  po::options_description desc_cmd_sett("Command line options and settings options");
+  const command_line::arg_descriptor<std::string> arg_input_file = {"input-file", "Indexed bootstrap file to replay (see etnc-blockchain-export --indexed)", "", true};
+  const command_line::arg_descriptor<std::string> arg_log_level = {"log-level", "0-4 or categories", ""};
+  const command_line::arg_descriptor<std::string> arg_seed_db = {"seed-db", "Directory holding a data.mdb to start from, instead of the genesis block", ""};
+  const command_line::arg_descriptor<std::string> arg_scratch_dir = {"scratch-dir", "Directory for the scratch database, created if needed (default: a new temporary directory)", ""};
+  const command_line::arg_descriptor<bool> arg_keep_scratch = {"keep-scratch", "Do not remove the scratch database when done", false};
+  const command_line::arg_descriptor<uint64_t> arg_block_stop = {"block-stop", "Stop at this block height", 0};
+  const command_line::arg_descriptor<uint64_t> arg_batch_size = {"batch-size", "Blocks handed to the core at a time", BLOCKS_SYNCHRONIZING_DEFAULT_COUNT};
+
+  command_line::add_arg(desc_cmd_sett, arg_input_file);
+  command_line::add_arg(desc_cmd_sett, arg_log_level);
+  command_line::add_arg(desc_cmd_sett, arg_seed_db);
+  command_line::add_arg(desc_cmd_sett, arg_scratch_dir);
+  command_line::add_arg(desc_cmd_sett, arg_keep_scratch);
+  command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_batch_size);
+  command_line::add_arg(desc_cmd_only, command_line::arg_help);
+
+  po::options_description desc_options("Allowed options");
+  desc_options.add(desc_cmd_only).add(desc_cmd_sett);
+  cryptonote::core::init_options(desc_options);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc_options, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc_options), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << "Electroneum Classic '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << ENDL << ENDL;
+    std::cout << desc_options << std::endl;
+    return 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("etnc-blockchain-sync-bench.log"), true);
+  if (!command_line::is_arg_defaulted(vm, arg_log_level))
+    mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+  else
+    mlog_set_log("0,bcutil:INFO");
+
+  const std::string input_file = command_line::get_arg(vm, arg_input_file);
+  const uint64_t batch_size = command_line::get_arg(vm, arg_batch_size);
+  uint64_t block_stop = command_line::get_arg(vm, arg_block_stop);
+  if (!batch_size)
+  {
+    std::cerr << "Error: batch-size must be > 0" << ENDL;
+    return 1;
+  }
+  if (!BootstrapFile::is_indexed_file(input_file))
+  {
+    std::cerr << "Error: " << input_file << " is not an indexed bootstrap file" << ENDL;
+    return 1;
+  }
+
+  // the core opens its db under data-dir, so that is pointed at the scratch
+  // directory, seeded with a copy of an existing db if asked
+  boost::filesystem::path scratch_dir;
+  if (command_line::is_arg_defaulted(vm, arg_scratch_dir))
+    scratch_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("etnc-sync-bench-%%%%-%%%%");
+  else
+    scratch_dir = command_line::get_arg(vm, arg_scratch_dir);
+  const bool keep_scratch = command_line::get_arg(vm, arg_keep_scratch);
+  epee::misc_utils::auto_scope_leave_caller scratch_remover = epee::misc_utils::create_scope_leave_handler([&](){
+    if (keep_scratch)
+      return;
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(scratch_dir, ec);
+  });
+  try
+  {
+    boost::filesystem::create_directories(scratch_dir / "lmdb");
+    if (!command_line::is_arg_defaulted(vm, arg_seed_db))
+    {
+      const boost::filesystem::path seed = boost::filesystem::path(command_line::get_arg(vm, arg_seed_db)) / "data.mdb";
+      MINFO("Copying " << seed.string() << " to the scratch directory");
+      boost::filesystem::copy_file(seed, scratch_dir / "lmdb" / "data.mdb", boost::filesystem::copy_option::overwrite_if_exists);
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "Error preparing the scratch directory: " << e.what() << ENDL;
+    return 1;
+  }
+  vm.erase(cryptonote::arg_data_dir.name);
+  vm.insert(std::make_pair(cryptonote::arg_data_dir.name, po::variable_value(scratch_dir.string(), false)));
+  MINFO("scratch directory: " << scratch_dir.string());
+
+  cryptonote::cryptonote_protocol_stub pr;
+  cryptonote::core core(&pr);
+  core.disable_dns_checkpoints(true);
+  if (!core.init(vm, NULL))
+  {
+    std::cerr << "Failed to initialize core" << ENDL;
+    return 1;
+  }
+  epee::misc_utils::auto_scope_leave_caller core_deinit = epee::misc_utils::create_scope_leave_handler([&](){ core.deinit(); });
+  core.get_blockchain_storage().get_db().set_batch_transactions(true);
+
+  BootstrapFile bootstrap;
+  if (!bootstrap.open_indexed(input_file))
+    return 1;
+  const uint64_t start_height = core.get_current_blockchain_height();
+  const uint64_t total_source_blocks = bootstrap.indexed_block_count();
+  if (!block_stop || block_stop > total_source_blocks - 1)
+    block_stop = total_source_blocks - 1;
+  if (start_height > block_stop)
+  {
+    std::cerr << "Nothing to replay: the database is at height " << start_height << ", the range ends at " << block_stop << ENDL;
+    return 1;
+  }
+  MINFO("replaying blocks " << start_height << " to " << block_stop);
+
+  core.get_blockchain_storage().reset_block_processing_stats();
+  pipeline_times times;
+  const std::vector<bootstrap::chunk_index_entry> &index = bootstrap.get_index();
+  const size_t chunks_per_read = std::max<size_t>(1, tools::threadpool::getInstance().get_max_concurrency());
+  size_t chunk = bootstrap.find_indexed_chunk(start_height);
+  uint64_t h = start_height;
+  std::vector<block_complete_entry> blocks;
+  std::vector<crypto::hash> hashes;
+  std::vector<bootstrap::block_package> bps;
+
+  TIME_MEASURE_START(total);
+  while (h <= block_stop && chunk < index.size())
+  {
+    TIME_MEASURE_START(read);
+    if (!bootstrap.read_indexed_chunks(chunk, chunks_per_read, bps))
+      return 1;
+    chunk += chunks_per_read;
+    blocks.clear();
+    hashes.clear();
+    for (const bootstrap::block_package &bp: bps)
+    {
+      const uint64_t height = boost::get<txin_gen>(bp.block.miner_tx.vin.front()).height;
+      if (height < h || height > block_stop)
+        continue;
+      blobdata block_blob;
+      block_to_blob(bp.block, block_blob);
+      std::vector<blobdata> txs;
+      for (const auto &tx: bp.txs)
+        txs.push_back(tx_to_blob(tx));
+      blocks.push_back({block_blob, txs});
+      hashes.push_back(get_block_hash(bp.block));
+    }
+    TIME_MEASURE_FINISH(read);
+    times.read_ms += read;
+
+    for (size_t i = 0; i < blocks.size(); i += batch_size)
+    {
+      const size_t end = std::min<size_t>(blocks.size(), i + batch_size);
+      const std::vector<block_complete_entry> batch(blocks.begin() + i, blocks.begin() + end);
+      const std::vector<crypto::hash> batch_hashes(hashes.begin() + i, hashes.begin() + end);
+      if (!replay(core, batch, batch_hashes, times))
+        return 1;
+      h += batch.size();
+    }
+    std::cout << "\rblock " << h - 1 << " / " << block_stop << std::flush;
+  }
+  TIME_MEASURE_FINISH(total);
+  std::cout << ENDL;
+
+  // reading the file is not part of syncing
+  const uint64_t sync_ms = total - times.read_ms;
+  const Blockchain::block_processing_stats stats = core.get_blockchain_storage().get_block_processing_stats();
+  MGINFO("Replayed " << stats.blocks << " blocks, " << stats.txes << " txes in " << sync_ms << " ms ("
+      << times.read_ms << " ms more reading the file)");
+  MGINFO("  " << per_second(stats.blocks, sync_ms) << " blocks/s, " << per_second(stats.txes, sync_ms) << " txes/s");
+  MGINFO("  prepare_handle_incoming_blocks: " << times.prepare_ms << " ms");
+  MGINFO("  handle_incoming_txs:            " << times.txs_ms << " ms");
+  MGINFO("  handle_incoming_block:          " << times.blocks_ms << " ms");
+  MGINFO("    PoW:                          " << stats.pow_ms << " ms");
+  MGINFO("    tx input/signature checks:    " << stats.tx_checks_ms << " ms");
+  MGINFO("    db writes:                    " << stats.db_ms << " ms");
+  MGINFO("  cleanup_handle_incoming_blocks: " << times.cleanup_ms << " ms");
+
+  return 0;
+
+  CATCH_ENTRY("Sync benchmark error", 1);
+}
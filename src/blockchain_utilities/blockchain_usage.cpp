@@ -27,9 +27,14 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <atomic>
+#include <fstream>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/algorithm/string.hpp>
 #include "common/command_line.h"
+#include "common/int-util.h"
+#include "common/threadpool.h"
+#include "common/util.h"
 #include "common/varint.h"
 #include "cryptonote_core/tx_pool.h"
 #include "cryptonote_core/cryptonote_core.h"
@@ -45,38 +50,181 @@ namespace po = boost::program_options;
 using namespace epee;
 using namespace cryptonote;
 
-struct output_data
+static std::atomic<bool> stop_requested(false);
+
+struct output_id
 {
   uint64_t amount;
   uint64_t index;
-  mutable bool coinbase;
-  mutable uint64_t height;
-  output_data(uint64_t a, uint64_t i, bool cb, uint64_t h): amount(a), index(i), coinbase(cb), height(h) {}
-  bool operator==(const output_data &other) const { return other.amount == amount && other.index == index; }
-  void info(bool c, uint64_t h) const { coinbase = c; height =h; }
+  bool operator==(const output_id &other) const { return other.amount == amount && other.index == index; }
 };
 namespace std
 {
-  template<> struct hash<output_data>
+  template<> struct hash<output_id>
   {
-    size_t operator()(const output_data &od) const
+    size_t operator()(const output_id &od) const
     {
-      const uint64_t data[2] = {od.amount, od.index};
-      crypto::hash h;
-      crypto::cn_fast_hash(data, 2 * sizeof(uint64_t), h);
-      return reinterpret_cast<const std::size_t &>(h);
+      return od.amount ^ od.index; // amounts other than 0 have few outputs
     }
   };
 }
 
-struct reference
+// what a range of blocks adds up to: the outputs it creates, and the ring
+// references it makes to outputs, which may be in any earlier block
+struct usage_t
+{
+  std::unordered_map<uint64_t, uint64_t> outputs;         // per amount
+  std::unordered_map<output_id, uint64_t> references;
+
+  void merge(const usage_t &other)
+  {
+    for (const auto &e: other.outputs)
+      outputs[e.first] += e.second;
+    for (const auto &e: other.references)
+      references[e.first] += e.second;
+  }
+};
+
+// usage of all blocks below next_height, saved between runs
+struct usage_state_t
 {
-  uint64_t height;
-  uint64_t ring_size;
-  uint64_t position;
-  reference(uint64_t h, uint64_t rs, uint64_t p): height(h), ring_size(rs), position(p) {}
+  uint64_t next_height;
+  crypto::hash last_hash;
+  bool rct_only;
+  usage_t usage;
 };
 
+namespace
+{
+  const uint64_t state_version = 1;
+
+  void write_u64(std::ofstream &f, uint64_t v)
+  {
+    v = SWAP64LE(v);
+    f.write((const char*)&v, sizeof(v));
+  }
+
+  uint64_t read_u64(std::ifstream &f)
+  {
+    uint64_t v;
+    if (!f.read((char*)&v, sizeof(v)))
+      throw std::runtime_error("Truncated state file");
+    return SWAP64LE(v);
+  }
+
+  bool load_state(const std::string &path, usage_state_t &state)
+  {
+    std::ifstream f(path, std::ios::binary);
+    if (!f)
+      return false;
+    if (read_u64(f) != state_version)
+      throw std::runtime_error("Unsupported state file version in " + path);
+    state.next_height = read_u64(f);
+    if (!f.read((char*)&state.last_hash, sizeof(state.last_hash)))
+      throw std::runtime_error("Truncated state file");
+    state.rct_only = read_u64(f);
+    state.usage = usage_t();
+    for (uint64_t n = read_u64(f); n > 0; --n)
+    {
+      const uint64_t amount = read_u64(f);
+      state.usage.outputs[amount] = read_u64(f);
+    }
+    const uint64_t nrefs = read_u64(f);
+    state.usage.references.reserve(nrefs);
+    for (uint64_t n = nrefs; n > 0; --n)
+    {
+      output_id id;
+      id.amount = read_u64(f);
+      id.index = read_u64(f);
+      state.usage.references[id] = read_u64(f);
+    }
+    return true;
+  }
+
+  // written aside and renamed over, so an interrupted save leaves the last one
+  bool save_state(const std::string &path, const usage_state_t &state)
+  {
+    const std::string tmp = path + ".tmp";
+    {
+      std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+      if (!f)
+        return false;
+      write_u64(f, state_version);
+      write_u64(f, state.next_height);
+      f.write((const char*)&state.last_hash, sizeof(state.last_hash));
+      write_u64(f, state.rct_only);
+      write_u64(f, state.usage.outputs.size());
+      for (const auto &e: state.usage.outputs)
+      {
+        write_u64(f, e.first);
+        write_u64(f, e.second);
+      }
+      write_u64(f, state.usage.references.size());
+      for (const auto &e: state.usage.references)
+      {
+        write_u64(f, e.first.amount);
+        write_u64(f, e.first.index);
+        write_u64(f, e.second);
+      }
+      f.flush();
+      if (!f)
+        return false;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp, path, ec);
+    return !ec;
+  }
+
+  void add_tx(const transaction &tx, bool miner_tx, bool rct_only, usage_t &usage)
+  {
+    // rct coinbase outputs are stored under amount 0
+    const bool rct_coinbase = miner_tx && tx.version >= 2;
+    for (const auto &out: tx.vout)
+    {
+      const uint64_t amount = rct_coinbase ? 0 : out.amount;
+      if (rct_only && amount)
+        continue;
+      ++usage.outputs[amount];
+    }
+
+    for (const auto &in: tx.vin)
+    {
+      if (in.type() != typeid(txin_to_key))
+        continue;
+      const auto &txin = boost::get<txin_to_key>(in);
+      if (rct_only && txin.amount != 0)
+        continue;
+      const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
+      for (uint64_t offset: absolute)
+        ++usage.references[output_id{txin.amount, offset}];
+    }
+  }
+
+  // the txes of each block are read in one batch, pruned, as only their
+  // prefixes are needed
+  bool scan_blocks(const BlockchainDB &db, uint64_t start, uint64_t end, bool rct_only, usage_t &usage)
+  {
+    std::vector<cryptonote::blobdata> bds;
+    for (uint64_t h = start; h < end; ++h)
+    {
+      if (stop_requested)
+        return false;
+      const block b = db.get_block_from_height(h);
+      add_tx(b.miner_tx, true, rct_only, usage);
+      if (!db.get_block_tx_blobs(h, bds, true))
+        throw std::runtime_error("Failed to get the txes of block " + std::to_string(h));
+      for (const cryptonote::blobdata &bd: bds)
+      {
+        transaction tx;
+        if (!cryptonote::parse_and_validate_tx_base_from_blob(bd, tx))
+          throw std::runtime_error("Bad tx in block " + std::to_string(h));
+        add_tx(tx, false, rct_only, usage);
+      }
+    }
+    return true;
+  }
+}
+
 int main(int argc, char* argv[])
 {
   TRY_ENTRY();
@@ -102,6 +250,11 @@ int main(int argc, char* argv[])
   };
   const command_line::arg_descriptor<bool> arg_rct_only  = {"rct-only", "Only work on ringCT outputs", false};
   const command_line::arg_descriptor<std::string> arg_input = {"input", ""};
+  const command_line::arg_descriptor<std::string> arg_state_file = {"state-file", "Save usage to this file as blocks are done, and carry on from it on the next run", ""};
+  const command_line::arg_descriptor<uint64_t> arg_block_stop = {"block-stop", "Stop at block number", 0};
+  const command_line::arg_descriptor<uint64_t> arg_confirmations = {"confirmations", "Only count blocks with at least this many blocks on top", 0};
+  const command_line::arg_descriptor<uint64_t> arg_blocks_per_task = {"blocks-per-task", "Number of blocks a thread scans at a time", 10000};
+  const command_line::arg_descriptor<unsigned> arg_threads = {"threads", "Number of threads, 0 for one per CPU", 0};
 
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_testnet_on);
   command_line::add_arg(desc_cmd_sett, cryptonote::arg_stagenet_on);
@@ -109,6 +262,11 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_rct_only);
   command_line::add_arg(desc_cmd_sett, arg_input);
+  command_line::add_arg(desc_cmd_sett, arg_state_file);
+  command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_confirmations);
+  command_line::add_arg(desc_cmd_sett, arg_blocks_per_task);
+  command_line::add_arg(desc_cmd_sett, arg_threads);
   command_line::add_arg(desc_cmd_only, command_line::arg_help);
 
   po::options_description desc_options("Allowed options");
@@ -147,6 +305,13 @@ int main(int argc, char* argv[])
   bool opt_stagenet = command_line::get_arg(vm, cryptonote::arg_stagenet_on);
   network_type net_type = opt_testnet ? TESTNET : opt_stagenet ? STAGENET : MAINNET;
   bool opt_rct_only = command_line::get_arg(vm, arg_rct_only);
+  const std::string opt_state_file = command_line::get_arg(vm, arg_state_file);
+  const uint64_t blocks_per_task = command_line::get_arg(vm, arg_blocks_per_task);
+  if (blocks_per_task == 0)
+  {
+    std::cerr << "Blocks per task must be at least 1" << std::endl;
+    return 1;
+  }
 
   std::string db_type = command_line::get_arg(vm, arg_database);
   if (!cryptonote::blockchain_valid_db_type(db_type))
@@ -196,54 +361,110 @@ int main(int argc, char* argv[])
   CHECK_AND_ASSERT_MES(r, 1, "Failed to initialize source blockchain storage");
   LOG_PRINT_L0("Source blockchain storage initialized OK");
 
-  LOG_PRINT_L0("Building usage patterns...");
+  usage_state_t state;
+  state.next_height = 0;
+  state.last_hash = crypto::null_hash;
+  state.rct_only = opt_rct_only;
+  if (!opt_state_file.empty() && load_state(opt_state_file, state) && state.next_height > 0)
+  {
+    if (state.rct_only != opt_rct_only)
+    {
+      LOG_ERROR("The state in " << opt_state_file << " was saved " << (state.rct_only ? "with" : "without") << " --rct-only");
+      return 1;
+    }
+    if (state.next_height > db->height() || db->get_block_hash_from_height(state.next_height - 1) != state.last_hash)
+    {
+      LOG_ERROR("Block " << (state.next_height - 1) << " is not the one last counted, the chain reorganized below it; "
+          "remove " << opt_state_file << " to start over");
+      return 1;
+    }
+    LOG_PRINT_L0("Carrying on from block " << state.next_height);
+  }
 
-  size_t done = 0;
-  std::unordered_map<output_data, std::list<reference>> outputs;
-  std::unordered_map<uint64_t,uint64_t> indices;
+  const uint64_t confirmations = command_line::get_arg(vm, arg_confirmations);
+  const uint64_t db_height = db->height();
+  uint64_t stop_height = db_height > confirmations ? db_height - confirmations : 0;
+  if (!command_line::is_arg_defaulted(vm, arg_block_stop))
+    stop_height = std::min(stop_height, command_line::get_arg(vm, arg_block_stop) + 1);
 
-  LOG_PRINT_L0("Reading blockchain from " << input);
-  core_storage->for_all_transactions([&](const crypto::hash &hash, const cryptonote::transaction &tx)->bool
-  {
-    const bool coinbase = tx.vin.size() == 1 && tx.vin[0].type() == typeid(txin_gen);
-    const uint64_t height = core_storage->get_db().get_tx_block_height(hash);
+  tools::signal_handler::install([](int type) {
+    stop_requested = true;
+  });
 
-    // create new outputs
-    for (const auto &out: tx.vout)
+  unsigned threads = command_line::get_arg(vm, arg_threads);
+  tools::threadpool::configure(tools::threadpool::block, threads);
+  tools::threadpool &tpool = tools::threadpool::getInstance(tools::threadpool::block);
+  threads = tpool.get_max_concurrency();
+
+  LOG_PRINT_L0("Building usage patterns with " << threads << " threads...");
+
+  // ranges are scanned a wave at a time, each into its own usage, which are
+  // then merged, and the state saved, so an interrupted run resumes from
+  // the last complete wave
+  while (state.next_height < stop_height && !stop_requested)
+  {
+    tools::threadpool::waiter waiter;
+    std::atomic<bool> failed(false);
+    std::vector<usage_t> task_usage(threads);
+    uint64_t wave_end = state.next_height;
+    for (unsigned n = 0; n < threads && wave_end < stop_height; ++n)
     {
-      if (opt_rct_only && out.amount)
-        continue;
-      uint64_t index = indices[out.amount]++;
-      output_data od(out.amount, indices[out.amount], coinbase, height);
-      auto itb = outputs.emplace(od, std::list<reference>());
-      itb.first->first.info(coinbase, height);
+      const uint64_t start = wave_end;
+      const uint64_t end = std::min(stop_height, start + blocks_per_task);
+      tpool.submit(&waiter, [&, n, start, end]() {
+        try
+        {
+          if (!scan_blocks(*db, start, end, opt_rct_only, task_usage[n]))
+            failed = true;
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to scan blocks " << start << " to " << (end - 1) << ": " << e.what());
+          failed = true;
+        }
+      });
+      wave_end = end;
     }
-
-    for (const auto &in: tx.vin)
+    waiter.wait(&tpool);
+    if (failed)
     {
-      if (in.type() != typeid(txin_to_key))
-        continue;
-      const auto &txin = boost::get<txin_to_key>(in);
-      if (opt_rct_only && txin.amount != 0)
-        continue;
-
-      const std::vector<uint64_t> absolute = cryptonote::relative_output_offsets_to_absolute(txin.key_offsets);
-      for (size_t n = 0; n < txin.key_offsets.size(); ++n)
-      {
-        output_data od(txin.amount, absolute[n], coinbase, height);
-        outputs[od].push_back(reference(height, txin.key_offsets.size(), n));
-      }
+      if (stop_requested)
+        break;
+      return 1;
     }
-    return true;
-  }, true);
 
-  std::unordered_map<uint64_t, uint64_t> counts;
-  size_t total = 0;
-  for (const auto &out: outputs)
+    for (usage_t &u: task_usage)
+    {
+      state.usage.merge(u);
+      u = usage_t();
+    }
+    state.next_height = wave_end;
+    state.last_hash = db->get_block_hash_from_height(wave_end - 1);
+    if (!opt_state_file.empty() && !save_state(opt_state_file, state))
+    {
+      LOG_ERROR("Failed to save the state to " << opt_state_file);
+      return 1;
+    }
+    LOG_PRINT_L0("Counted up to block " << (state.next_height - 1) << " / " << (stop_height - 1));
+  }
+  if (stop_requested)
+    LOG_PRINT_L0("Stopped, usage below is up to block " << state.next_height);
+
+  // outputs never referenced are not in the references, but are counted
+  // in the outputs of their amount
+  std::map<uint64_t, uint64_t> counts;
+  uint64_t total = 0;
+  for (const auto &e: state.usage.outputs)
+    total += e.second;
+  uint64_t referenced = 0;
+  for (const auto &e: state.usage.references)
   {
-    counts[out.second.size()]++;
-    total++;
+    counts[e.second]++;
+    referenced++;
   }
+  if (total > referenced)
+    counts[0] = total - referenced;
+  total = std::max(total, referenced);
   if (total > 0)
   {
     for (const auto &c: counts)
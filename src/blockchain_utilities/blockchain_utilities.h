@@ -37,5 +37,6 @@
 #define BUFFER_SIZE 1000000
 #define CHUNK_SIZE_WARNING_THRESHOLD 500000
 #define NUM_BLOCKS_PER_CHUNK 1
+#define NUM_BLOCKS_PER_INDEXED_CHUNK 100
 #define BLOCKCHAIN_RAW "blockchain.raw"
 
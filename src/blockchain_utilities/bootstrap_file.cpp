@@ -32,6 +32,11 @@
 #include "serialization/json_utils.h" // dump_json()
 
 #include "bootstrap_file.h"
+#include "common/threadpool.h"
+
+#ifdef BOOTSTRAP_ENABLE_ZLIB
+#include <zlib.h>
+#endif
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "bcutil"
@@ -46,14 +51,82 @@ namespace
   // This number was picked by taking the leading 4 bytes from this output:
   // echo Monero bootstrap file | sha1sum
   const uint32_t blockchain_raw_magic = 0x28721586;
+  // differs from the above, so importers without index support reject it
+  const uint32_t blockchain_indexed_magic = 0x5ba1d0e3;
   const uint32_t header_size = 1024;
 
+  // decoded chunks larger than this are taken as corrupt
+  const uint32_t max_indexed_chunk_size = 256 * 1024 * 1024;
+
   std::string refresh_string = "\r                                    \r";
+
+  template<typename T>
+  size_t serialized_size()
+  {
+    return t_serializable_object_to_blob(T()).size();
+  }
+
+  void encode_chunk(const bootstrap::block_chunk& chunk, bool compress, bootstrap::chunk_header& header, std::string& stored)
+  {
+    std::string raw = t_serializable_object_to_blob(chunk);
+    header.raw_size = raw.size();
+    header.compression = bootstrap::chunk_compression_none;
+#ifdef BOOTSTRAP_ENABLE_ZLIB
+    if (compress)
+    {
+      uLongf len = compressBound(raw.size());
+      stored.resize(len);
+      if (compress2((Bytef*)&stored[0], &len, (const Bytef*)raw.data(), raw.size(), Z_DEFAULT_COMPRESSION) == Z_OK && len < raw.size())
+      {
+        stored.resize(len);
+        header.compression = bootstrap::chunk_compression_zlib;
+      }
+    }
+#endif
+    if (header.compression == bootstrap::chunk_compression_none)
+      stored = std::move(raw);
+    header.stored_size = stored.size();
+    header.checksum = crypto::cn_fast_hash(stored.data(), stored.size());
+  }
+
+  bool decode_chunk(const bootstrap::chunk_header& header, const std::string& stored, bootstrap::block_chunk& chunk)
+  {
+    if (crypto::cn_fast_hash(stored.data(), stored.size()) != header.checksum)
+    {
+      MERROR("Chunk checksum mismatch");
+      return false;
+    }
+    if (header.compression == bootstrap::chunk_compression_none)
+      return ::serialization::parse_binary(stored, chunk);
+    if (header.compression != bootstrap::chunk_compression_zlib)
+    {
+      MERROR("Unknown chunk compression: " << (unsigned)header.compression);
+      return false;
+    }
+#ifdef BOOTSTRAP_ENABLE_ZLIB
+    if (header.raw_size > max_indexed_chunk_size)
+    {
+      MERROR("Chunk too large: " << header.raw_size);
+      return false;
+    }
+    std::string raw(header.raw_size, 0);
+    uLongf len = raw.size();
+    if (uncompress((Bytef*)&raw[0], &len, (const Bytef*)stored.data(), stored.size()) != Z_OK || len != raw.size())
+    {
+      MERROR("Failed to decompress chunk");
+      return false;
+    }
+    return ::serialization::parse_binary(raw, chunk);
+#else
+    MERROR("Chunk is compressed, but this build has no zlib support");
+    return false;
+#endif
+  }
 }
 
 
 
-bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
+bool BootstrapFile::open_writer(const boost::filesystem::path& file_path, uint32_t file_magic, uint8_t major_version)
 {
   const boost::filesystem::path dir_path = file_path.parent_path();
   if (!dir_path.empty())
@@ -107,15 +180,16 @@ bool BootstrapFile::open_writer(const boost::filesystem::path& file_path)
     return false;
 
   if (do_initialize_file)
-    initialize_file();
+    initialize_file(file_magic, major_version);
 
   return true;
 }
 
 
-bool BootstrapFile::initialize_file()
+bool BootstrapFile::initialize_file(uint32_t file_magic, uint8_t major_version)
 {
-  const uint32_t file_magic = blockchain_raw_magic;
+  if (!file_magic)
+    file_magic = blockchain_raw_magic;
 
   std::string blob;
   if (! ::serialization::dump_binary(file_magic, blob))
@@ -125,8 +199,8 @@ bool BootstrapFile::initialize_file()
   *m_raw_data_file << blob;
 
   bootstrap::file_info bfi;
-  bfi.major_version = 0;
-  bfi.minor_version = 1;
+  bfi.major_version = major_version;
+  bfi.minor_version = major_version ? 0 : 1;
   bfi.header_size = header_size;
 
   bootstrap::blocks_info bbi;
@@ -208,9 +282,8 @@ void BootstrapFile::flush_chunk()
   MDEBUG("flushed chunk:  chunk_size: " << chunk_size);
 }
 
-void BootstrapFile::write_block(block& block)
+void BootstrapFile::make_block_package(block& block, bootstrap::block_package& bp)
 {
-  bootstrap::block_package bp;
   bp.block = block;
 
   std::vector<transaction> txs;
@@ -245,11 +318,54 @@ void BootstrapFile::write_block(block& block)
     bp.cumulative_difficulty = cumulative_difficulty;
     bp.coins_generated = coins_generated;
   }
+}
+
+void BootstrapFile::write_block(block& block)
+{
+  bootstrap::block_package bp;
+  make_block_package(block, bp);
 
   blobdata bd = t_serializable_object_to_blob(bp);
   m_output_stream->write((const char*)bd.data(), bd.size());
 }
 
+void BootstrapFile::write_indexed_chunks(std::vector<bootstrap::block_chunk>& chunks, bool compress)
+{
+  std::vector<bootstrap::chunk_header> headers(chunks.size());
+  std::vector<std::string> stored(chunks.size());
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  for (size_t i = 0; i < chunks.size(); ++i)
+    tpool.submit(&waiter, [&, i](){ encode_chunk(chunks[i], compress, headers[i], stored[i]); }, true);
+  waiter.wait(&tpool);
+
+  for (size_t i = 0; i < chunks.size(); ++i)
+  {
+    const bootstrap::block_chunk& chunk = chunks[i];
+    if (chunk.blocks.empty())
+      continue;
+    bootstrap::chunk_index_entry entry;
+    entry.block_first = boost::get<txin_gen>(chunk.blocks.front().block.miner_tx.vin.front()).height;
+    entry.num_blocks = chunk.blocks.size();
+    entry.offset = m_raw_data_file->tellp();
+    entry.raw_size = headers[i].raw_size;
+
+    *m_raw_data_file << t_serializable_object_to_blob(headers[i]);
+    m_raw_data_file->write(stored[i].data(), stored[i].size());
+    if (m_raw_data_file->fail())
+    {
+      MFATAL("Error writing chunk at height " << entry.block_first);
+      throw std::runtime_error("Error writing chunk");
+    }
+
+    if (m_max_chunk < headers[i].stored_size)
+      m_max_chunk = headers[i].stored_size;
+    m_index.chunks.push_back(entry);
+  }
+  chunks.clear();
+}
+
 bool BootstrapFile::close()
 {
   if (m_raw_data_file->fail())
@@ -269,6 +385,7 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
   m_blockchain_storage = _blockchain_storage;
   m_tx_pool = _tx_pool;
   uint64_t progress_interval = 100;
+  const uint64_t prefetch_interval = 1000;
   MINFO("Storing blocks raw data...");
   if (!BootstrapFile::open_writer(output_file))
   {
@@ -295,6 +412,8 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
   }
   for (m_cur_height = block_start; m_cur_height <= block_stop; ++m_cur_height)
   {
+    if ((m_cur_height - block_start) % prefetch_interval == 0)
+      m_blockchain_storage->get_db().prefetch_blocks(m_cur_height, prefetch_interval);
     // this method's height refers to 0-based height (genesis block = height 0)
     crypto::hash hash = m_blockchain_storage->get_block_id_by_height(m_cur_height);
     m_blockchain_storage->get_block_by_hash(hash, b);
@@ -324,6 +443,211 @@ bool BootstrapFile::store_blockchain_raw(Blockchain* _blockchain_storage, tx_mem
   return BootstrapFile::close();
 }
 
+bool BootstrapFile::store_blockchain_indexed(Blockchain* _blockchain_storage, tx_memory_pool* _tx_pool, boost::filesystem::path& output_file, uint64_t requested_block_stop, bool compress)
+{
+  uint64_t num_blocks_written = 0;
+  m_max_chunk = 0;
+  m_blockchain_storage = _blockchain_storage;
+  m_tx_pool = _tx_pool;
+  m_index.chunks.clear();
+  uint64_t progress_interval = 100;
+#ifndef BOOTSTRAP_ENABLE_ZLIB
+  if (compress)
+  {
+    MWARNING("Built without zlib support, chunks will not be compressed");
+    compress = false;
+  }
+#endif
+  if (boost::filesystem::exists(output_file))
+  {
+    MFATAL("Indexed export does not append to existing files, remove " << output_file << " first");
+    return false;
+  }
+  MINFO("Storing blocks in indexed format...");
+  if (!BootstrapFile::open_writer(output_file, blockchain_indexed_magic, 1))
+  {
+    MFATAL("failed to open raw file for write");
+    return false;
+  }
+  block b;
+
+  uint64_t block_stop = 0;
+  MINFO("source blockchain height: " <<  m_blockchain_storage->get_current_blockchain_height()-1);
+  if ((requested_block_stop > 0) && (requested_block_stop < m_blockchain_storage->get_current_blockchain_height()))
+  {
+    MINFO("Using requested block height: " << requested_block_stop);
+    block_stop = requested_block_stop;
+  }
+  else
+  {
+    block_stop = m_blockchain_storage->get_current_blockchain_height() - 1;
+    MINFO("Using block height of source blockchain: " << block_stop);
+  }
+
+  // gather one chunk per thread, then serialize, compress and checksum
+  // them in parallel before writing them out in order
+  const size_t chunks_per_write = std::max<size_t>(1, tools::threadpool::getInstance().get_max_concurrency());
+  std::vector<bootstrap::block_chunk> chunks;
+  for (m_cur_height = 0; m_cur_height <= block_stop; ++m_cur_height)
+  {
+    if (chunks.empty() || chunks.back().blocks.size() >= NUM_BLOCKS_PER_INDEXED_CHUNK)
+    {
+      if (chunks.size() >= chunks_per_write)
+        write_indexed_chunks(chunks, compress);
+      chunks.emplace_back();
+      chunks.back().blocks.reserve(NUM_BLOCKS_PER_INDEXED_CHUNK);
+    }
+    crypto::hash hash = m_blockchain_storage->get_block_id_by_height(m_cur_height);
+    m_blockchain_storage->get_block_by_hash(hash, b);
+    chunks.back().blocks.emplace_back();
+    make_block_package(b, chunks.back().blocks.back());
+    ++num_blocks_written;
+    if (m_cur_height % progress_interval == 0) {
+      std::cout << refresh_string;
+      std::cout << "block " << m_cur_height << "/" << block_stop << std::flush;
+    }
+  }
+  write_indexed_chunks(chunks, compress);
+
+  bootstrap::index_trailer trailer;
+  trailer.index_offset = m_raw_data_file->tellp();
+  const blobdata index_blob = t_serializable_object_to_blob(m_index);
+  trailer.index_size = index_blob.size();
+  trailer.magic = blockchain_indexed_magic;
+  *m_raw_data_file << index_blob;
+  *m_raw_data_file << t_serializable_object_to_blob(trailer);
+
+  std::cout << refresh_string;
+  std::cout << "block " << m_cur_height-1 << "/" << block_stop << ENDL;
+
+  MINFO("Number of blocks exported: " << num_blocks_written << " in " << m_index.chunks.size() << " chunks");
+  if (num_blocks_written > 0)
+    MINFO("Largest chunk: " << m_max_chunk << " bytes");
+
+  return BootstrapFile::close();
+}
+
+bool BootstrapFile::is_indexed_file(const std::string& import_file_path)
+{
+  std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+  uint32_t file_magic;
+  char buf1[sizeof(file_magic)];
+  import_file.read(buf1, sizeof(file_magic));
+  if (!import_file)
+    return false;
+  return ::serialization::parse_binary(std::string(buf1, sizeof(file_magic)), file_magic) && file_magic == blockchain_indexed_magic;
+}
+
+bool BootstrapFile::open_indexed(const std::string& import_file_path)
+{
+  m_indexed_file_path = import_file_path;
+  m_index.chunks.clear();
+
+  std::ifstream import_file(import_file_path, std::ios_base::binary | std::ifstream::in);
+  if (import_file.fail())
+  {
+    MFATAL("import_file.open() fail");
+    return false;
+  }
+  import_file.seekg(0, std::ios_base::end);
+  const uint64_t file_size = import_file.tellg();
+  const size_t trailer_size = serialized_size<bootstrap::index_trailer>();
+  if (file_size < sizeof(uint32_t) + header_size + trailer_size)
+  {
+    MFATAL("Indexed bootstrap file is too short");
+    return false;
+  }
+
+  std::string blob(trailer_size, 0);
+  import_file.seekg(file_size - trailer_size);
+  import_file.read(&blob[0], blob.size());
+  bootstrap::index_trailer trailer;
+  if (!import_file || !::serialization::parse_binary(blob, trailer) || trailer.magic != blockchain_indexed_magic
+      || trailer.index_offset + trailer.index_size + trailer_size != file_size)
+  {
+    MFATAL("Indexed bootstrap file has no valid index, it may be truncated");
+    return false;
+  }
+
+  blob.resize(trailer.index_size);
+  import_file.seekg(trailer.index_offset);
+  import_file.read(&blob[0], blob.size());
+  if (!import_file || !::serialization::parse_binary(blob, m_index))
+  {
+    MFATAL("Failed to read indexed bootstrap file index");
+    return false;
+  }
+  MINFO("Indexed bootstrap file: " << m_index.chunks.size() << " chunks, " << indexed_block_count() << " blocks");
+  return true;
+}
+
+uint64_t BootstrapFile::indexed_block_count() const
+{
+  if (m_index.chunks.empty())
+    return 0;
+  return m_index.chunks.back().block_first + m_index.chunks.back().num_blocks;
+}
+
+size_t BootstrapFile::find_indexed_chunk(uint64_t height) const
+{
+  const auto it = std::upper_bound(m_index.chunks.begin(), m_index.chunks.end(), height,
+      [](uint64_t h, const bootstrap::chunk_index_entry& e){ return h < e.block_first; });
+  return it == m_index.chunks.begin() ? 0 : std::distance(m_index.chunks.begin(), it) - 1;
+}
+
+bool BootstrapFile::read_indexed_chunks(size_t first_chunk, size_t count, std::vector<bootstrap::block_package>& blocks)
+{
+  blocks.clear();
+  if (first_chunk >= m_index.chunks.size())
+    return true;
+  count = std::min(count, m_index.chunks.size() - first_chunk);
+
+  std::ifstream import_file(m_indexed_file_path, std::ios_base::binary | std::ifstream::in);
+  const size_t chunk_header_size = serialized_size<bootstrap::chunk_header>();
+  std::vector<bootstrap::chunk_header> headers(count);
+  std::vector<std::string> stored(count);
+  std::string blob(chunk_header_size, 0);
+  for (size_t i = 0; i < count; ++i)
+  {
+    const bootstrap::chunk_index_entry& entry = m_index.chunks[first_chunk + i];
+    import_file.seekg(entry.offset);
+    import_file.read(&blob[0], blob.size());
+    if (!import_file || !::serialization::parse_binary(blob, headers[i]) || headers[i].stored_size > max_indexed_chunk_size)
+    {
+      MERROR("Failed to read chunk header at height " << entry.block_first);
+      return false;
+    }
+    stored[i].resize(headers[i].stored_size);
+    import_file.read(&stored[i][0], stored[i].size());
+    if (!import_file)
+    {
+      MERROR("Failed to read chunk at height " << entry.block_first);
+      return false;
+    }
+  }
+
+  std::vector<bootstrap::block_chunk> chunks(count);
+  std::unique_ptr<bool[]> ok(new bool[count]);
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  for (size_t i = 0; i < count; ++i)
+    tpool.submit(&waiter, [&, i](){ ok[i] = decode_chunk(headers[i], stored[i], chunks[i]); }, true);
+  waiter.wait(&tpool);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    const bootstrap::chunk_index_entry& entry = m_index.chunks[first_chunk + i];
+    if (!ok[i] || chunks[i].blocks.size() != entry.num_blocks)
+    {
+      MERROR("Bad chunk at height " << entry.block_first);
+      return false;
+    }
+    for (auto& bp: chunks[i].blocks)
+      blocks.push_back(std::move(bp));
+  }
+  return true;
+}
+
 uint64_t BootstrapFile::seek_to_first_chunk(std::ifstream& import_file)
 {
   uint32_t file_magic;
@@ -49,6 +49,7 @@
 #include "version.h"
 
 #include "blockchain_utilities.h"
+#include "bootstrap_serialization.h"
 
 
 using namespace cryptonote;
@@ -66,6 +67,18 @@ public:
   bool store_blockchain_raw(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
       boost::filesystem::path& output_file, uint64_t use_block_height=0);
 
+  // indexed format: multi-block chunks, optionally compressed, with a
+  // height index at the end of the file
+  bool store_blockchain_indexed(cryptonote::Blockchain* cs, cryptonote::tx_memory_pool* txp,
+      boost::filesystem::path& output_file, uint64_t use_block_height=0, bool compress=true);
+  static bool is_indexed_file(const std::string& import_file_path);
+  bool open_indexed(const std::string& import_file_path);
+  const std::vector<bootstrap::chunk_index_entry>& get_index() const { return m_index.chunks; }
+  uint64_t indexed_block_count() const;
+  size_t find_indexed_chunk(uint64_t height) const;
+  // reads count chunks from first_chunk on, then checks and decodes them in parallel
+  bool read_indexed_chunks(size_t first_chunk, size_t count, std::vector<bootstrap::block_package>& blocks);
+
 protected:
 
   Blockchain* m_blockchain_storage;
@@ -77,15 +90,20 @@ protected:
   boost::iostreams::stream<boost::iostreams::back_insert_device<buffer_type>>* m_output_stream;
 
   // open export file for write
-  bool open_writer(const boost::filesystem::path& file_path);
-  bool initialize_file();
+  bool open_writer(const boost::filesystem::path& file_path, uint32_t file_magic = 0, uint8_t major_version = 0);
+  bool initialize_file(uint32_t file_magic = 0, uint8_t major_version = 0);
   bool close();
+  void make_block_package(block& block, bootstrap::block_package& bp);
   void write_block(block& block);
   void flush_chunk();
+  void write_indexed_chunks(std::vector<bootstrap::block_chunk>& chunks, bool compress);
 
 private:
 
   uint64_t m_height;
   uint64_t m_cur_height; // tracks current height during export
   uint32_t m_max_chunk;
+
+  std::string m_indexed_file_path;
+  bootstrap::chunk_index m_index;
 };
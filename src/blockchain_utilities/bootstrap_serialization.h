@@ -84,6 +84,79 @@ namespace cryptonote
       END_SERIALIZE()
     };
 
+    // Indexed bootstrap files hold several blocks per chunk. Each chunk is
+    // a fixed size chunk_header followed by the stored (possibly
+    // compressed) bytes of a serialized block_chunk. After the last chunk
+    // comes a serialized chunk_index, then a fixed size index_trailer, so a
+    // reader can find any height without scanning the file.
+
+    enum chunk_compression : uint8_t
+    {
+      chunk_compression_none = 0,
+      chunk_compression_zlib = 1,
+    };
+
+    struct chunk_header
+    {
+      uint32_t stored_size; // bytes following this header
+      uint32_t raw_size;    // bytes once decompressed
+      uint8_t compression;
+      crypto::hash checksum; // cn_fast_hash of the stored bytes
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(stored_size)
+        FIELD(raw_size)
+        FIELD(compression)
+        FIELD(checksum)
+      END_SERIALIZE()
+    };
+
+    struct block_chunk
+    {
+      std::vector<block_package> blocks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(blocks)
+      END_SERIALIZE()
+    };
+
+    struct chunk_index_entry
+    {
+      uint64_t block_first; // zero-based height of the chunk's first block
+      uint64_t num_blocks;
+      uint64_t offset;      // file position of the chunk_header
+      uint64_t raw_size;
+
+      BEGIN_SERIALIZE_OBJECT()
+        VARINT_FIELD(block_first)
+        VARINT_FIELD(num_blocks)
+        VARINT_FIELD(offset)
+        VARINT_FIELD(raw_size)
+      END_SERIALIZE()
+    };
+
+    struct chunk_index
+    {
+      std::vector<chunk_index_entry> chunks;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(chunks)
+      END_SERIALIZE()
+    };
+
+    struct index_trailer
+    {
+      uint64_t index_offset;
+      uint32_t index_size;
+      uint32_t magic;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(index_offset)
+        FIELD(index_size)
+        FIELD(magic)
+      END_SERIALIZE()
+    };
+
   }
 
 }
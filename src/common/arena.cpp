@@ -0,0 +1,108 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstdlib>
+#include "arena.h"
+
+namespace tools
+{
+
+arena::arena(size_t block_size, size_t max_retained):
+  m_block_size(block_size),
+  m_max_retained(max_retained),
+  m_blocks(NULL),
+  m_ptr(NULL),
+  m_end(NULL),
+  m_reserved(0)
+{
+}
+
+arena::~arena()
+{
+  while (m_blocks)
+  {
+    block *next = m_blocks->next;
+    free(m_blocks);
+    m_blocks = next;
+  }
+}
+
+void arena::add_block(size_t min_size)
+{
+  // grow geometrically, so a large batch needs few blocks
+  size_t size = std::max(m_block_size, m_reserved / 2);
+  if (size < min_size + sizeof(block))
+    size = min_size + sizeof(block);
+  block *b = (block*)malloc(size);
+  if (!b)
+    throw std::bad_alloc();
+  b->next = m_blocks;
+  b->size = size;
+  m_blocks = b;
+  m_ptr = (char*)(b + 1);
+  m_end = (char*)b + size;
+  m_reserved += size;
+}
+
+void *arena::allocate(size_t size, size_t alignment)
+{
+  uintptr_t p = ((uintptr_t)m_ptr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  if (!m_ptr || p > (uintptr_t)m_end || size > (size_t)(m_end - (char*)p))
+  {
+    add_block(size + alignment);
+    p = ((uintptr_t)m_ptr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+  }
+  m_ptr = (char*)p + size;
+  return (void*)p;
+}
+
+void arena::release()
+{
+  if (!m_blocks)
+    return;
+  // several blocks are merged into one of their total size for next time
+  const size_t total = m_reserved;
+  if (m_blocks->next || total > m_max_retained)
+  {
+    while (m_blocks)
+    {
+      block *next = m_blocks->next;
+      free(m_blocks);
+      m_blocks = next;
+    }
+    m_ptr = m_end = NULL;
+    m_reserved = 0;
+    if (total <= m_max_retained)
+      add_block(total - sizeof(block));
+    return;
+  }
+  m_ptr = (char*)(m_blocks + 1);
+}
+
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <utility>
+
+namespace tools
+{
+//! Monotonic memory for short lived containers: allocations bump a pointer
+//! in large blocks, freeing is a no-op, and release() drops everything at
+//! once. Not thread safe, the owner serializes use.
+class arena
+{
+public:
+  //! blocks are at least block_size bytes, and up to max_retained bytes are
+  //! kept over a release() so the next round of similar size allocates nothing
+  arena(size_t block_size = 65536, size_t max_retained = 16 * 1024 * 1024);
+  ~arena();
+
+  void *allocate(size_t size, size_t alignment);
+  void release();
+
+  //! bytes obtained from the system, used or not
+  size_t reserved() const { return m_reserved; }
+
+private:
+  arena(const arena&) = delete;
+  arena &operator=(const arena&) = delete;
+
+  struct block
+  {
+    block *next;
+    size_t size;
+  };
+  void add_block(size_t min_size);
+
+  const size_t m_block_size;
+  const size_t m_max_retained;
+  block *m_blocks;
+  char *m_ptr;
+  char *m_end;
+  size_t m_reserved;
+};
+
+//! standard allocator on top of an arena, for the containers using it
+template<typename T>
+class arena_allocator
+{
+public:
+  typedef T value_type;
+  typedef T *pointer;
+  typedef const T *const_pointer;
+  typedef T &reference;
+  typedef const T &const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+  template<typename U> struct rebind { typedef arena_allocator<U> other; };
+
+  explicit arena_allocator(arena &a): m_arena(&a) {}
+  template<typename U> arena_allocator(const arena_allocator<U> &other): m_arena(other.m_arena) {}
+
+  T *allocate(size_t n, const void *hint = NULL)
+  {
+    if (n > max_size())
+      throw std::bad_alloc();
+    return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+  size_t max_size() const { return std::numeric_limits<size_t>::max() / sizeof(T); }
+
+  template<typename U, typename... Args> void construct(U *p, Args&&... args) { ::new((void*)p) U(std::forward<Args>(args)...); }
+  template<typename U> void destroy(U *p) { p->~U(); }
+
+  template<typename U> bool operator==(const arena_allocator<U> &other) const { return m_arena == other.m_arena; }
+  template<typename U> bool operator!=(const arena_allocator<U> &other) const { return m_arena != other.m_arena; }
+
+private:
+  template<typename U> friend class arena_allocator;
+  arena *m_arena;
+};
+}
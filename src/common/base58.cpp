@@ -57,25 +57,21 @@ namespace tools
       {
         reverse_alphabet()
         {
-          m_data.resize(alphabet[alphabet_size - 1] - alphabet[0] + 1, -1);
-
+          for (size_t i = 0; i < sizeof(m_data); ++i)
+            m_data[i] = -1;
           for (size_t i = 0; i < alphabet_size; ++i)
-          {
-            size_t idx = static_cast<size_t>(alphabet[i] - alphabet[0]);
-            m_data[idx] = static_cast<int8_t>(i);
-          }
+            m_data[static_cast<uint8_t>(alphabet[i])] = static_cast<int8_t>(i);
         }
 
         int operator()(char letter) const
         {
-          size_t idx = static_cast<size_t>(letter - alphabet[0]);
-          return idx < m_data.size() ? m_data[idx] : -1;
+          return m_data[static_cast<uint8_t>(letter)];
         }
 
         static reverse_alphabet instance;
 
       private:
-        std::vector<int8_t> m_data;
+        int8_t m_data[256];
       };
 
       reverse_alphabet reverse_alphabet::instance;
@@ -134,6 +130,55 @@ namespace tools
         memcpy(data, reinterpret_cast<uint8_t*>(&num_be) + sizeof(uint64_t) - size, size);
       }
 
+      // 58^5 fits 32 bits, so a full block's 11 digits are 1 + 5 + 5 digits
+      // of three 32 bit numbers, and 58^10 < 2^64 < 58^11
+      const uint32_t alphabet_size_pow5 = 58 * 58 * 58 * 58 * 58;
+
+      void encode_5_digits(uint32_t num, char* res)
+      {
+        res[4] = alphabet[num % alphabet_size]; num /= alphabet_size;
+        res[3] = alphabet[num % alphabet_size]; num /= alphabet_size;
+        res[2] = alphabet[num % alphabet_size]; num /= alphabet_size;
+        res[1] = alphabet[num % alphabet_size]; num /= alphabet_size;
+        res[0] = alphabet[num];
+      }
+
+      void encode_full_block(const char* block, char* res)
+      {
+        uint64_t num;
+        memcpy(&num, block, sizeof(num));
+        num = SWAP64BE(num);
+        const uint64_t hi = num / alphabet_size_pow5;
+        encode_5_digits(static_cast<uint32_t>(num % alphabet_size_pow5), res + 6);
+        encode_5_digits(static_cast<uint32_t>(hi % alphabet_size_pow5), res + 1);
+        res[0] = alphabet[hi / alphabet_size_pow5];
+      }
+
+      bool decode_full_block(const char* block, char* res)
+      {
+        // the first ten digits can't overflow, only the last one is checked
+        uint64_t res_num = 0;
+        for (size_t i = 0; i < full_encoded_block_size - 1; ++i)
+        {
+          int digit = reverse_alphabet::instance(block[i]);
+          if (digit < 0)
+            return false; // Invalid symbol
+          res_num = res_num * alphabet_size + digit;
+        }
+        int digit = reverse_alphabet::instance(block[full_encoded_block_size - 1]);
+        if (digit < 0)
+          return false; // Invalid symbol
+        uint64_t product_hi;
+        uint64_t product = mul128(res_num, alphabet_size, &product_hi);
+        res_num = product + digit;
+        if (0 != product_hi || res_num < product)
+          return false; // Overflow
+
+        res_num = SWAP64BE(res_num);
+        memcpy(res, &res_num, sizeof(res_num));
+        return true;
+      }
+
       void encode_block(const char* block, size_t size, char* res)
       {
         assert(1 <= size && size <= full_block_size);
@@ -195,7 +240,7 @@ namespace tools
       std::string res(res_size, alphabet[0]);
       for (size_t i = 0; i < full_block_count; ++i)
       {
-        encode_block(data.data() + i * full_block_size, full_block_size, &res[i * full_encoded_block_size]);
+        encode_full_block(data.data() + i * full_block_size, &res[i * full_encoded_block_size]);
       }
 
       if (0 < last_block_size)
@@ -224,7 +269,7 @@ namespace tools
       data.resize(data_size, 0);
       for (size_t i = 0; i < full_block_count; ++i)
       {
-        if (!decode_block(enc.data() + i * full_encoded_block_size, full_encoded_block_size, &data[i * full_block_size]))
+        if (!decode_full_block(enc.data() + i * full_encoded_block_size, &data[i * full_block_size]))
           return false;
       }
 
@@ -0,0 +1,89 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <utility>
+
+namespace tools
+{
+//! A blocking FIFO holding at most a given number of items, for
+//! passing work between the stages of a pipeline
+template<typename T>
+class bounded_queue
+{
+public:
+  bounded_queue(size_t max_size): max_size(std::max<size_t>(max_size, 1)), closed(false) {}
+
+  // Waits for room, returns false if the queue was closed meanwhile
+  bool push(T &&t)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (queue.size() >= max_size && !closed)
+      changed.wait(lock);
+    if (closed)
+      return false;
+    queue.push_back(std::move(t));
+    changed.notify_all();
+    return true;
+  }
+
+  // Waits for an item, returns false once the queue is closed and empty
+  bool pop(T &t)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (queue.empty() && !closed)
+      changed.wait(lock);
+    if (queue.empty())
+      return false;
+    t = std::move(queue.front());
+    queue.pop_front();
+    changed.notify_all();
+    return true;
+  }
+
+  // Wakes up everyone waiting, further pushes fail
+  void close()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    closed = true;
+    changed.notify_all();
+  }
+
+private:
+  boost::mutex mutex;
+  boost::condition_variable changed;
+  std::deque<T> queue;
+  const size_t max_size;
+  bool closed;
+};
+}
@@ -33,7 +33,8 @@
 
 #include <stdlib.h>
 #include "include_base_utils.h"
-#include <random>
+#include "misc_language.h"
+#include "cryptonote_config.h"
 #include <boost/filesystem/fstream.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
@@ -56,6 +57,9 @@ static const char *DEFAULT_DNS_PUBLIC_ADDR[] =
 
 static boost::mutex instance_lock;
 
+// how often outstanding asynchronous queries are checked for answers
+static const uint64_t DNS_ASYNC_POLL_INTERVAL_MS = 10;
+
 namespace
 {
 
@@ -200,8 +204,43 @@ typedef class scoped_ptr<ub_result,ub_resolve_free> ub_result_ptr;
 struct DNSResolverData
 {
   ub_ctx* m_ub_context;
+  // serializes ub_process and ub_cancel between concurrent multi-name lookups
+  boost::mutex m_async_lock;
 };
 
+namespace
+{
+  struct async_query
+  {
+    std::string (*reader)(const char *, size_t);
+    int async_id;
+    bool sent;
+    bool done;
+    bool dnssec_available;
+    bool dnssec_valid;
+    std::vector<std::string> records;
+  };
+
+  // called from ub_process, with m_async_lock held by whichever lookup is processing
+  void async_query_callback(void *data, int err, ub_result *result)
+  {
+    ub_result_ptr result_ptr(result);
+    async_query &query = *static_cast<async_query*>(data);
+    query.done = true;
+    if (err || !result)
+      return;
+    query.dnssec_available = (result->secure || (!result->secure && result->bogus));
+    query.dnssec_valid = result->secure && !result->bogus;
+    if (result->havedata)
+    {
+      for (size_t i=0; result->data[i] != NULL; i++)
+      {
+        query.records.push_back((*query.reader)(result->data[i], result->len[i]));
+      }
+    }
+  }
+}
+
 // work around for bug https://www.nlnetlabs.nl/bugs-script/show_bug.cgi?id=515 needed for it to compile on e.g. Debian 7
 class string_copy {
 public:
@@ -247,6 +286,10 @@ DNSResolver::DNSResolver() : m_data(new DNSResolverData())
     ub_ctx_hosts(m_data->m_ub_context, NULL);
   }
 
+  // run async queries on a thread rather than in a forked process
+  if (ub_ctx_async(m_data->m_ub_context, 1))
+    MERROR("Failed to set up threaded asynchronous DNS resolution");
+
   const char * const *ds = ::get_builtin_ds();
   while (*ds)
   {
@@ -298,6 +341,87 @@ std::vector<std::string> DNSResolver::get_record(const std::string& url, int rec
   return addresses;
 }
 
+size_t DNSResolver::get_records(const std::vector<std::string>& urls, int record_type, std::string (*reader)(const char *,size_t), const record_handler& handler, uint64_t timeout_ms)
+{
+  const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(timeout_ms);
+
+  // the resolver keeps pointers into this until each query is answered or cancelled
+  std::vector<async_query> queries(urls.size());
+  std::vector<bool> reported(urls.size(), false);
+
+  auto cancel_outstanding = epee::misc_utils::create_scope_leave_handler([&](){
+    boost::lock_guard<boost::mutex> lock(m_data->m_async_lock);
+    for (const async_query &query: queries)
+      if (!query.done)
+        ub_cancel(m_data->m_ub_context, query.async_id);
+  });
+
+  {
+    boost::lock_guard<boost::mutex> lock(m_data->m_async_lock);
+    for (size_t n = 0; n < urls.size(); ++n)
+    {
+      async_query &query = queries[n];
+      query.reader = reader;
+      query.async_id = 0;
+      query.sent = false;
+      query.done = true;
+      query.dnssec_available = false;
+      query.dnssec_valid = false;
+      if (!check_address_syntax(urls[n].c_str()))
+        continue;
+      if (ub_resolve_async(m_data->m_ub_context, string_copy(urls[n].c_str()), record_type, DNS_CLASS_IN, &query, async_query_callback, &query.async_id))
+      {
+        MWARNING("Failed to start DNS query for " << urls[n]);
+        continue;
+      }
+      query.sent = true;
+      query.done = false;
+    }
+  }
+
+  size_t answered = 0, finished = 0;
+  while (finished < urls.size())
+  {
+    std::vector<size_t> newly_done;
+    {
+      boost::lock_guard<boost::mutex> lock(m_data->m_async_lock);
+      if (ub_poll(m_data->m_ub_context))
+        ub_process(m_data->m_ub_context);
+      for (size_t n = 0; n < queries.size(); ++n)
+      {
+        if (queries[n].done && !reported[n])
+        {
+          reported[n] = true;
+          newly_done.push_back(n);
+        }
+      }
+    }
+
+    // report outside the lock, queries no longer touched by the resolver
+    bool keep_going = true;
+    for (size_t n: newly_done)
+    {
+      ++finished;
+      if (queries[n].sent)
+        ++answered;
+      if (keep_going && handler && !handler(n, queries[n].records, queries[n].dnssec_available, queries[n].dnssec_valid))
+        keep_going = false;
+    }
+    if (!keep_going || finished == urls.size())
+      break;
+
+    const boost::chrono::steady_clock::time_point now = boost::chrono::steady_clock::now();
+    if (now >= deadline)
+    {
+      MDEBUG("DNS lookup timed out with " << (urls.size() - finished) << "/" << urls.size() << " queries outstanding");
+      break;
+    }
+    boost::this_thread::sleep_for(std::min<boost::chrono::steady_clock::duration>(deadline - now, boost::chrono::milliseconds(DNS_ASYNC_POLL_INTERVAL_MS)));
+  }
+
+  return answered;
+}
+
 std::vector<std::string> DNSResolver::get_ipv4(const std::string& url, bool& dnssec_available, bool& dnssec_valid)
 {
   return get_record(url, DNS_TYPE_A, ipv4_to_string, dnssec_available, dnssec_valid);
@@ -313,6 +437,16 @@ std::vector<std::string> DNSResolver::get_txt_record(const std::string& url, boo
   return get_record(url, DNS_TYPE_TXT, txt_to_string, dnssec_available, dnssec_valid);
 }
 
+size_t DNSResolver::get_ipv4(const std::vector<std::string>& urls, const record_handler& handler, uint64_t timeout_ms)
+{
+  return get_records(urls, DNS_TYPE_A, ipv4_to_string, handler, timeout_ms);
+}
+
+size_t DNSResolver::get_txt_record(const std::vector<std::string>& urls, const record_handler& handler, uint64_t timeout_ms)
+{
+  return get_records(urls, DNS_TYPE_TXT, txt_to_string, handler, timeout_ms);
+}
+
 std::string DNSResolver::get_dns_format_from_oa_address(const std::string& oa_addr)
 {
   std::string addr(oa_addr);
@@ -466,44 +600,42 @@ bool load_txt_records_from_dns(std::vector<std::string> &good_records, const std
   std::vector<std::vector<std::string> > records;
   records.resize(dns_urls.size());
 
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<int> dis(0, dns_urls.size() - 1);
-  size_t first_index = dis(gen);
-
-  // send all requests in parallel
-  std::vector<boost::thread> threads(dns_urls.size());
-  std::deque<bool> avail(dns_urls.size(), false), valid(dns_urls.size(), false);
-  for (size_t n = 0; n < dns_urls.size(); ++n)
-  {
-    threads[n] = boost::thread([n, dns_urls, &records, &avail, &valid](){
-      records[n] = tools::DNSResolver::instance().get_txt_record(dns_urls[n], avail[n], valid[n]); 
-    });
-  }
-  for (size_t n = 0; n < dns_urls.size(); ++n)
-    threads[n].join();
-
-  size_t cur_index = first_index;
-  do
+  // send all requests in parallel, and stop waiting as soon as two
+  // validated answers agree
+  int good_records_index = -1;
+  tools::DNSResolver::instance().get_txt_record(dns_urls, [&](size_t n, const std::vector<std::string> &answer, bool avail, bool valid)
   {
-    const std::string &url = dns_urls[cur_index];
-    if (!avail[cur_index])
+    const std::string &url = dns_urls[n];
+    if (!avail)
     {
-      records[cur_index].clear();
       LOG_PRINT_L2("DNSSEC not available for checkpoint update at URL: " << url << ", skipping.");
+      return true;
     }
-    if (!valid[cur_index])
+    if (!valid)
     {
-      records[cur_index].clear();
       LOG_PRINT_L2("DNSSEC validation failed for checkpoint update at URL: " << url << ", skipping.");
+      return true;
     }
+    if (answer.empty())
+      return true;
 
-    cur_index++;
-    if (cur_index == dns_urls.size())
+    records[n] = answer;
+    for (size_t i = 0; i < records.size(); ++i)
     {
-      cur_index = 0;
+      if (i != n && records[i].size() != 0 && dns_records_match(records[i], records[n]))
+      {
+        good_records_index = i;
+        return false;
+      }
     }
-  } while (cur_index != first_index);
+    return true;
+  }, CRYPTONOTE_DNS_TIMEOUT_MS);
+
+  if (good_records_index >= 0)
+  {
+    good_records = records[good_records_index];
+    return true;
+  }
 
   size_t num_valid_records = 0;
 
@@ -521,30 +653,8 @@ bool load_txt_records_from_dns(std::vector<std::string> &good_records, const std
     return false;
   }
 
-  int good_records_index = -1;
-  for (size_t i = 0; i < records.size() - 1; ++i)
-  {
-    if (records[i].size() == 0) continue;
-
-    for (size_t j = i + 1; j < records.size(); ++j)
-    {
-      if (dns_records_match(records[i], records[j]))
-      {
-        good_records_index = i;
-        break;
-      }
-    }
-    if (good_records_index >= 0) break;
-  }
-
-  if (good_records_index < 0)
-  {
-    LOG_PRINT_L0("WARNING: no two ETNCPulse DNS checkpoint records matched");
-    return false;
-  }
-
-  good_records = records[good_records_index];
-  return true;
+  LOG_PRINT_L0("WARNING: no two ETNCPulse DNS checkpoint records matched");
+  return false;
 }
 
 std::vector<std::string> parse_dns_public(const char *s)
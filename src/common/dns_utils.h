@@ -52,6 +52,17 @@ struct DNSResolverData;
  */
 class DNSResolver
 {
+public:
+
+  /**
+   * @brief receives the answer to one query of a multi-name lookup
+   *
+   * Called from the thread which issued the lookup, as each answer arrives.
+   * The first argument is the index of the answered name in the query list.
+   * Return false to cancel the queries still outstanding.
+   */
+  typedef std::function<bool(size_t, const std::vector<std::string>&, bool, bool)> record_handler;
+
 private:
 
   /**
@@ -105,6 +116,28 @@ public:
   // TODO: modify this to accommodate DNSSEC
    std::vector<std::string> get_txt_record(const std::string& url, bool& dnssec_available, bool& dnssec_valid);
 
+  /**
+   * @brief resolves ipv4 addresses for several URLs concurrently
+   *
+   * All queries are sent at once through the asynchronous resolver, and
+   * handler is called for each answer as it arrives.  Queries which have
+   * not been answered within timeout_ms are cancelled.
+   *
+   * @param urls the URLs to query for
+   * @param handler called once per answered URL
+   * @param timeout_ms deadline for the whole lookup
+   *
+   * @return the number of URLs which were answered
+   */
+  size_t get_ipv4(const std::vector<std::string>& urls, const record_handler& handler, uint64_t timeout_ms);
+
+  /**
+   * @brief gets TXT records for several URLs concurrently
+   *
+   * @see get_ipv4(const std::vector<std::string>&, const record_handler&, uint64_t)
+   */
+  size_t get_txt_record(const std::vector<std::string>& urls, const record_handler& handler, uint64_t timeout_ms);
+
   /**
    * @brief Gets a DNS address from OpenAlias format
    *
@@ -146,6 +179,13 @@ private:
   // TODO: modify this to accommodate DNSSEC
   std::vector<std::string> get_record(const std::string& url, int record_type, std::string (*reader)(const char *,size_t), bool& dnssec_available, bool& dnssec_valid);
 
+  /**
+   * @brief asynchronously queries records of a given type for several URLs
+   *
+   * @return the number of URLs which were answered before the deadline
+   */
+  size_t get_records(const std::vector<std::string>& urls, int record_type, std::string (*reader)(const char *,size_t), const record_handler& handler, uint64_t timeout_ms);
+
   /**
    * @brief Checks a string to see if it looks like a URL
    *
@@ -0,0 +1,207 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace tools
+{
+//! Open addressing hash map with linear probing, keys and values stored
+//! inline in one array. Meant for keys which hash well on their own (key
+//! images, tx hashes), so a lookup usually touches a single cache line.
+//! Erasing shifts the following entries back rather than leaving
+//! tombstones, which invalidates iterators and references.
+template<typename K, typename V, typename Hash = std::hash<K>>
+class flat_hash_map
+{
+public:
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<K, V> value_type;
+
+private:
+  struct slot
+  {
+    value_type kv;
+    bool used;
+    slot(): used(false) {}
+  };
+
+  template<typename Map, typename Value>
+  class iterator_base
+  {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Value value_type;
+    typedef ptrdiff_t difference_type;
+    typedef Value *pointer;
+    typedef Value &reference;
+
+    iterator_base(): m(NULL), i(0) {}
+    iterator_base(Map *m, size_t i): m(m), i(i) { skip(); }
+    template<typename M, typename W> iterator_base(const iterator_base<M, W> &other): m(other.m), i(other.i) {}
+    Value &operator*() const { return m->m_slots[i].kv; }
+    Value *operator->() const { return &m->m_slots[i].kv; }
+    iterator_base &operator++() { ++i; skip(); return *this; }
+    iterator_base operator++(int) { iterator_base r = *this; ++*this; return r; }
+    bool operator==(const iterator_base &other) const { return i == other.i; }
+    bool operator!=(const iterator_base &other) const { return i != other.i; }
+  private:
+    void skip() { while (i < m->m_slots.size() && !m->m_slots[i].used) ++i; }
+    template<typename M, typename W> friend class iterator_base;
+    friend class flat_hash_map;
+    Map *m;
+    size_t i;
+  };
+
+public:
+  typedef iterator_base<flat_hash_map, value_type> iterator;
+  typedef iterator_base<const flat_hash_map, const value_type> const_iterator;
+
+  flat_hash_map(): m_size(0) {}
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  //! number of slots, for memory accounting
+  size_t capacity() const { return m_slots.size(); }
+  static constexpr size_t slot_size() { return sizeof(slot); }
+
+  iterator begin() { return iterator(this, 0); }
+  iterator end() { return iterator(this, m_slots.size()); }
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, m_slots.size()); }
+
+  void clear() { std::vector<slot>().swap(m_slots); m_size = 0; }
+  void swap(flat_hash_map &other) { m_slots.swap(other.m_slots); std::swap(m_size, other.m_size); }
+
+  void reserve(size_t n)
+  {
+    size_t slots = 16;
+    while (slots * 3 < n * 4)
+      slots *= 2;
+    if (slots > m_slots.size())
+      rehash(slots);
+  }
+
+  iterator find(const K &key) { return iterator(this, lookup(key)); }
+  const_iterator find(const K &key) const { return const_iterator(this, lookup(key)); }
+  size_t count(const K &key) const { return lookup(key) == m_slots.size() ? 0 : 1; }
+
+  std::pair<iterator, bool> emplace(const K &key, V value)
+  {
+    size_t i = lookup(key);
+    if (i != m_slots.size())
+      return std::make_pair(iterator(this, i), false);
+    if ((m_size + 1) * 4 > m_slots.size() * 3)
+      reserve(m_size + 1);
+    i = probe(key);
+    m_slots[i].kv.first = key;
+    m_slots[i].kv.second = std::move(value);
+    m_slots[i].used = true;
+    ++m_size;
+    return std::make_pair(iterator(this, i), true);
+  }
+
+  V &operator[](const K &key) { return emplace(key, V()).first->second; }
+
+  size_t erase(const K &key)
+  {
+    const size_t i = lookup(key);
+    if (i == m_slots.size())
+      return 0;
+    erase_slot(i);
+    return 1;
+  }
+  void erase(const_iterator it) { erase_slot(it.i); }
+
+private:
+  size_t bucket(const K &key) const { return Hash()(key) & (m_slots.size() - 1); }
+
+  // index of the key's slot, or of the first free slot where it would go
+  size_t probe(const K &key) const
+  {
+    const size_t mask = m_slots.size() - 1;
+    size_t i = bucket(key);
+    while (m_slots[i].used && !(m_slots[i].kv.first == key))
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  size_t lookup(const K &key) const
+  {
+    if (m_size == 0)
+      return m_slots.size();
+    const size_t i = probe(key);
+    return m_slots[i].used ? i : m_slots.size();
+  }
+
+  void erase_slot(size_t i)
+  {
+    const size_t mask = m_slots.size() - 1;
+    size_t j = i;
+    while (true)
+    {
+      j = (j + 1) & mask;
+      if (!m_slots[j].used)
+        break;
+      // an entry may move back into the hole only if its home bucket is not
+      // cyclically within (i, j]
+      const size_t home = bucket(m_slots[j].kv.first);
+      if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        continue;
+      m_slots[i].kv = std::move(m_slots[j].kv);
+      i = j;
+    }
+    m_slots[i].kv = value_type();
+    m_slots[i].used = false;
+    --m_size;
+  }
+
+  void rehash(size_t slots)
+  {
+    std::vector<slot> old(slots);
+    old.swap(m_slots);
+    for (slot &s: old)
+    {
+      if (!s.used)
+        continue;
+      const size_t i = probe(s.kv.first);
+      m_slots[i].kv = std::move(s.kv);
+      m_slots[i].used = true;
+    }
+  }
+
+  std::vector<slot> m_slots;
+  size_t m_size;
+};
+}
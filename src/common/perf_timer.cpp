@@ -26,7 +26,13 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <map>
+#include <unordered_map>
 #include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/tss.hpp>
 #include "misc_os_dependent.h"
 #include "perf_timer.h"
 
@@ -133,6 +139,8 @@ PerformanceTimer::~PerformanceTimer()
 LoggingPerformanceTimer::~LoggingPerformanceTimer()
 {
   pause();
+  if (performance_stats_enabled.load(std::memory_order_relaxed))
+    add_performance_stat(name, ticks_to_ns(ticks));
   performance_timers->pop_back();
   char s[12];
   snprintf(s, sizeof(s), "%8llu  ", (unsigned long long)(ticks_to_ns(ticks) / (1000000000 / unit)));
@@ -162,3 +170,190 @@ void PerformanceTimer::resume()
 }
 
 }
+
+namespace
+{
+  // buckets of a quarter of a power of two each, from 256 ns to about 18 minutes
+  static const unsigned PERF_HISTOGRAM_MIN_LOG = 8;
+  static const unsigned PERF_HISTOGRAM_MAX_LOG = 40;
+  static const size_t PERF_HISTOGRAM_BUCKETS = (PERF_HISTOGRAM_MAX_LOG - PERF_HISTOGRAM_MIN_LOG) * 4 + 2;
+
+  size_t get_bucket(uint64_t ns)
+  {
+    if (ns < (1ull << PERF_HISTOGRAM_MIN_LOG))
+      return 0;
+    unsigned log = PERF_HISTOGRAM_MIN_LOG;
+    while (log < 63 && (ns >> (log + 1)))
+      ++log;
+    const size_t bucket = (log - PERF_HISTOGRAM_MIN_LOG) * 4 + ((ns >> (log - 2)) & 3) + 1;
+    return std::min(bucket, PERF_HISTOGRAM_BUCKETS - 1);
+  }
+
+  uint64_t get_bucket_upper_bound(size_t bucket)
+  {
+    if (bucket == 0)
+      return 1ull << PERF_HISTOGRAM_MIN_LOG;
+    const unsigned log = (bucket - 1) / 4 + PERF_HISTOGRAM_MIN_LOG;
+    return (5ull + (bucket - 1) % 4) << (log - 2);
+  }
+
+  struct perf_histogram
+  {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> buckets[PERF_HISTOGRAM_BUCKETS];
+
+    perf_histogram(): count(0), total_ns(0), max_ns(0) { for (auto &b: buckets) b = 0; }
+
+    // only called by the thread owning the histogram, readers may reset it
+    void add(uint64_t ns)
+    {
+      count.fetch_add(1, std::memory_order_relaxed);
+      total_ns.fetch_add(ns, std::memory_order_relaxed);
+      if (ns > max_ns.load(std::memory_order_relaxed))
+        max_ns.store(ns, std::memory_order_relaxed);
+      buckets[get_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    }
+  };
+
+  struct perf_thread_stats
+  {
+    // taken by the owning thread only to add a name, and by readers
+    boost::mutex lock;
+    std::unordered_map<std::string, std::unique_ptr<perf_histogram>> histograms;
+  };
+
+  boost::mutex perf_stats_lock;
+  std::vector<perf_thread_stats*> perf_stats_threads;
+  // what threads which exited had recorded
+  perf_thread_stats perf_stats_retired;
+
+  void merge_histogram(perf_histogram &dst, const perf_histogram &src)
+  {
+    dst.count += src.count.load(std::memory_order_relaxed);
+    dst.total_ns += src.total_ns.load(std::memory_order_relaxed);
+    dst.max_ns = std::max(dst.max_ns.load(), src.max_ns.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+      dst.buckets[i] += src.buckets[i].load(std::memory_order_relaxed);
+  }
+
+  void reset_histogram(perf_histogram &h)
+  {
+    h.count.store(0, std::memory_order_relaxed);
+    h.total_ns.store(0, std::memory_order_relaxed);
+    h.max_ns.store(0, std::memory_order_relaxed);
+    for (auto &b: h.buckets)
+      b.store(0, std::memory_order_relaxed);
+  }
+
+  void merge_thread_stats(std::map<std::string, std::unique_ptr<perf_histogram>> &dst, perf_thread_stats &src, bool reset)
+  {
+    boost::lock_guard<boost::mutex> lock(src.lock);
+    for (const auto &e: src.histograms)
+    {
+      std::unique_ptr<perf_histogram> &h = dst[e.first];
+      if (!h)
+        h.reset(new perf_histogram());
+      merge_histogram(*h, *e.second);
+      if (reset)
+        reset_histogram(*e.second);
+    }
+  }
+
+  void retire_thread_stats(perf_thread_stats *stats)
+  {
+    boost::lock_guard<boost::mutex> lock(perf_stats_lock);
+    perf_stats_threads.erase(std::remove(perf_stats_threads.begin(), perf_stats_threads.end(), stats), perf_stats_threads.end());
+    {
+      boost::lock_guard<boost::mutex> retired_lock(perf_stats_retired.lock);
+      for (const auto &e: stats->histograms)
+      {
+        std::unique_ptr<perf_histogram> &h = perf_stats_retired.histograms[e.first];
+        if (!h)
+          h.reset(new perf_histogram());
+        merge_histogram(*h, *e.second);
+      }
+    }
+    delete stats;
+  }
+
+  boost::thread_specific_ptr<perf_thread_stats> perf_stats_this_thread(retire_thread_stats);
+}
+
+namespace tools
+{
+
+std::atomic<bool> performance_stats_enabled(false);
+
+void set_performance_stats_enabled(bool enabled)
+{
+  performance_stats_enabled = enabled;
+}
+
+void add_performance_stat(const std::string &name, uint64_t ns)
+{
+  perf_thread_stats *stats = perf_stats_this_thread.get();
+  if (!stats)
+  {
+    stats = new perf_thread_stats();
+    perf_stats_this_thread.reset(stats);
+    boost::lock_guard<boost::mutex> lock(perf_stats_lock);
+    perf_stats_threads.push_back(stats);
+  }
+
+  // lookups by the owning thread do not race with readers, only insertions do
+  auto i = stats->histograms.find(name);
+  if (i == stats->histograms.end())
+  {
+    boost::lock_guard<boost::mutex> lock(stats->lock);
+    i = stats->histograms.emplace(name, std::unique_ptr<perf_histogram>(new perf_histogram())).first;
+  }
+  i->second->add(ns);
+}
+
+std::vector<performance_stats_entry> get_performance_stats(bool reset)
+{
+  std::map<std::string, std::unique_ptr<perf_histogram>> merged;
+  {
+    boost::lock_guard<boost::mutex> lock(perf_stats_lock);
+    for (perf_thread_stats *stats: perf_stats_threads)
+      merge_thread_stats(merged, *stats, reset);
+    merge_thread_stats(merged, perf_stats_retired, reset);
+  }
+
+  std::vector<performance_stats_entry> entries;
+  entries.reserve(merged.size());
+  for (const auto &e: merged)
+  {
+    const perf_histogram &h = *e.second;
+    performance_stats_entry entry;
+    entry.name = e.first;
+    entry.count = h.count;
+    entry.total_ns = h.total_ns;
+    entry.max_ns = h.max_ns;
+    entry.p50_ns = entry.p99_ns = 0;
+    if (entry.count == 0)
+      continue;
+    const uint64_t p50_rank = (entry.count + 1) / 2, p99_rank = entry.count - entry.count / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+    {
+      const uint64_t n = h.buckets[i];
+      if (n == 0)
+        continue;
+      seen += n;
+      if (entry.p50_ns == 0 && seen >= p50_rank)
+        entry.p50_ns = std::min(get_bucket_upper_bound(i), entry.max_ns);
+      if (seen >= p99_rank)
+      {
+        entry.p99_ns = std::min(get_bucket_upper_bound(i), entry.max_ns);
+        break;
+      }
+    }
+    entries.push_back(std::move(entry));
+  }
+  return entries;
+}
+
+}
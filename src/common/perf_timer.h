@@ -28,7 +28,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
+#include <vector>
 #include <stdio.h>
 #include <memory>
 #include "misc_log_ex.h"
@@ -78,6 +80,24 @@ private:
 
 void set_performance_timer_log_level(el::Level level);
 
+// Timings aggregated over all threads, per timer name. Each thread records
+// into its own histograms, so recording takes no lock once a name was seen.
+struct performance_stats_entry
+{
+  std::string name;
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t p50_ns;  // quantiles are histogram bucket bounds, within 25%
+  uint64_t p99_ns;
+};
+
+extern std::atomic<bool> performance_stats_enabled;
+
+void set_performance_stats_enabled(bool enabled);
+void add_performance_stat(const std::string &name, uint64_t ns);
+std::vector<performance_stats_entry> get_performance_stats(bool reset = false);
+
 #define PERF_TIMER_UNIT(name, unit) tools::LoggingPerformanceTimer pt_##name(#name, unit, tools::performance_timer_log_level)
 #define PERF_TIMER_UNIT_L(name, unit, l) tools::LoggingPerformanceTimer pt_##name(#name, unit, l)
 #define PERF_TIMER(name) PERF_TIMER_UNIT(name, 1000)
@@ -0,0 +1,146 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <map>
+#include <string>
+
+namespace tools
+{
+//! Bounds how many requests of some expensive kinds run at the same time.
+//! Each kind has its own limit, and all of them together share a total
+//! limit. Kinds that were never given a limit are not counted and are
+//! always admitted, so cheap requests never wait behind expensive ones.
+class request_limiter
+{
+public:
+  //! Holds one admission for its lifetime, if it got one
+  class slot
+  {
+  public:
+    slot(request_limiter &limiter, const std::string &kind): limiter(limiter), kind(kind), acquired(limiter.try_acquire(kind)) {}
+    ~slot() { if (acquired) limiter.release(kind); }
+    slot(const slot&) = delete;
+    slot &operator=(const slot&) = delete;
+    explicit operator bool() const { return acquired; }
+
+  private:
+    request_limiter &limiter;
+    const std::string kind;
+    const bool acquired;
+  };
+
+  request_limiter(): total_limit(0), total_running(0) {}
+
+  // 0 means no total limit
+  void set_total_limit(unsigned limit)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    total_limit = limit;
+  }
+
+  // 0 means only the total limit applies to this kind
+  void set_limit(const std::string &kind, unsigned limit)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    kinds[kind].limit = limit;
+  }
+
+  // Names may share a kind, eg aliases of the same RPC call
+  void add_alias(const std::string &alias, const std::string &kind)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    aliases[alias] = kind;
+  }
+
+  bool try_acquire(const std::string &name)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    kind_state *k = find(name);
+    if (!k)
+      return true;
+    if (total_limit > 0 && total_running >= total_limit)
+      return false;
+    if (k->limit > 0 && k->running >= k->limit)
+      return false;
+    ++k->running;
+    ++total_running;
+    return true;
+  }
+
+  void release(const std::string &name)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    kind_state *k = find(name);
+    if (!k || k->running == 0)
+      return;
+    --k->running;
+    --total_running;
+  }
+
+  unsigned running(const std::string &name) const
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    const kind_state *k = find(name);
+    return k ? k->running : 0;
+  }
+
+  unsigned running() const
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return total_running;
+  }
+
+private:
+  struct kind_state
+  {
+    kind_state(): limit(0), running(0) {}
+    unsigned limit;
+    unsigned running;
+  };
+
+  const kind_state *find(const std::string &name) const
+  {
+    const auto a = aliases.find(name);
+    const auto i = kinds.find(a == aliases.end() ? name : a->second);
+    return i == kinds.end() ? NULL : &i->second;
+  }
+
+  kind_state *find(const std::string &name)
+  {
+    return const_cast<kind_state*>(static_cast<const request_limiter*>(this)->find(name));
+  }
+
+  mutable boost::mutex mutex;
+  unsigned total_limit;
+  unsigned total_running;
+  std::map<std::string, kind_state> kinds;
+  std::map<std::string, std::string> aliases;
+};
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <vector>
+
+namespace tools
+{
+//! Median of a window of values kept in the order they were added. Values
+//! come and go at either end: new blocks at the back, the oldest dropped at
+//! the front, popped blocks taken off the back again. A sorted copy is kept
+//! alongside, so the median is read in constant time. The windows this is
+//! used for are ~100 values, where the memmove on insert/erase into the
+//! sorted copy beats heaps or trees, and allocates nothing once grown.
+//! Same result as epee::misc_utils::median of the values.
+template<typename T>
+class rolling_median
+{
+public:
+  void clear()
+  {
+    values.clear();
+    sorted.clear();
+  }
+
+  void push_back(T v)
+  {
+    values.push_back(v);
+    insert_sorted(v);
+  }
+
+  void push_front(T v)
+  {
+    values.push_front(v);
+    insert_sorted(v);
+  }
+
+  void pop_back()
+  {
+    assert(!values.empty());
+    erase_sorted(values.back());
+    values.pop_back();
+  }
+
+  void pop_front()
+  {
+    assert(!values.empty());
+    erase_sorted(values.front());
+    values.pop_front();
+  }
+
+  size_t size() const { return values.size(); }
+  bool empty() const { return values.empty(); }
+
+  //! the values, oldest first
+  const std::deque<T> &get_values() const { return values; }
+
+  T median() const
+  {
+    if (sorted.empty())
+      return T();
+    const size_t n = sorted.size() / 2;
+    if (sorted.size() % 2)
+      return sorted[n];
+    return (sorted[n - 1] + sorted[n]) / 2;
+  }
+
+private:
+  void insert_sorted(T v)
+  {
+    sorted.insert(std::upper_bound(sorted.begin(), sorted.end(), v), v);
+  }
+
+  void erase_sorted(T v)
+  {
+    const auto it = std::lower_bound(sorted.begin(), sorted.end(), v);
+    assert(it != sorted.end() && *it == v);
+    sorted.erase(it);
+  }
+
+  std::deque<T> values;
+  std::vector<T> sorted;
+};
+}
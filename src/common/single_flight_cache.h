@@ -0,0 +1,128 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <chrono>
+#include <functional>
+#include <list>
+#include <memory>
+#include <set>
+#include <string>
+
+namespace tools
+{
+//! A small cache shared by several consumers computing the same values.
+//! The first consumer to ask for a missing key computes it, the others
+//! asking meanwhile wait for its result. Entries expire after a given
+//! time, and the oldest ones are dropped past a given number.
+template<typename T>
+class single_flight_cache
+{
+public:
+  typedef std::shared_ptr<const T> value_ptr;
+
+  single_flight_cache(size_t max_entries, std::chrono::milliseconds ttl): max_entries(max_entries), ttl(ttl) {}
+
+  // Returns the cached value for key, or the one f returns. A null value
+  // from f is returned but not cached, and exceptions are passed on.
+  value_ptr get(const std::string &key, const std::function<value_ptr()> &f)
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true)
+    {
+      expire(std::chrono::steady_clock::now());
+      for (const entry &e: entries)
+        if (e.key == key)
+          return e.value;
+      if (pending.find(key) == pending.end())
+        break;
+      changed.wait(lock);
+    }
+
+    pending.insert(key);
+    lock.unlock();
+    value_ptr value;
+    try
+    {
+      value = f();
+    }
+    catch (...)
+    {
+      lock.lock();
+      pending.erase(key);
+      changed.notify_all();
+      throw;
+    }
+    lock.lock();
+    pending.erase(key);
+    if (value && max_entries > 0)
+    {
+      entries.push_back({key, value, std::chrono::steady_clock::now() + ttl});
+      while (entries.size() > max_entries)
+        entries.pop_front();
+    }
+    changed.notify_all();
+    return value;
+  }
+
+  void clear()
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    entries.clear();
+  }
+
+  size_t size() const
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return entries.size();
+  }
+
+private:
+  struct entry
+  {
+    std::string key;
+    value_ptr value;
+    std::chrono::steady_clock::time_point expiry;
+  };
+
+  void expire(std::chrono::steady_clock::time_point now)
+  {
+    while (!entries.empty() && entries.front().expiry <= now)
+      entries.pop_front();
+  }
+
+  const size_t max_entries;
+  const std::chrono::milliseconds ttl;
+  mutable boost::mutex mutex;
+  boost::condition_variable changed;
+  std::list<entry> entries; // oldest first
+  std::set<std::string> pending;
+};
+}
@@ -28,28 +28,228 @@
 #include "misc_log_ex.h"
 #include "common/threadpool.h"
 
+#include <algorithm>
 #include <cassert>
 #include <limits>
 #include <stdexcept>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "cryptonote_config.h"
 #include "common/util.h"
 
 static __thread int depth = 0;
 static __thread bool is_leaf = false;
+// set on pool worker threads, so they push to and pop from their own queue first
+static __thread const tools::threadpool *current_pool = NULL;
+static __thread unsigned int current_queue = 0;
+// set by threadpool::scoped_purpose, -1 if none
+static __thread int current_purpose = -1;
+
+namespace
+{
+  boost::mutex config_lock;
+  unsigned int configured_threads[tools::threadpool::num_purposes] = {};
+  std::vector<unsigned int> configured_cpus[tools::threadpool::num_purposes];
+
+  // how much lower than the block pool the other pools run, as niceness
+  const int purpose_niceness[tools::threadpool::num_purposes] = {0, 5, 10};
+
+  unsigned int get_pool_threads(tools::threadpool::purpose p)
+  {
+    boost::lock_guard<boost::mutex> lock(config_lock);
+    if (configured_threads[p])
+      return configured_threads[p];
+    // the lower classes get fewer threads, they'd otherwise crowd out
+    // block verification whenever both run at once
+    const unsigned int max = tools::get_max_concurrency();
+    switch (p)
+    {
+      case tools::threadpool::relay: return std::max(1u, max / 2);
+      case tools::threadpool::background: return std::max(1u, max / 4);
+      default: return max;
+    }
+  }
+
+  std::vector<unsigned int> get_pool_cpus(tools::threadpool::purpose p)
+  {
+    boost::lock_guard<boost::mutex> lock(config_lock);
+    return configured_cpus[p];
+  }
+
+  void setup_worker_thread(const std::vector<unsigned int> &cpus, int niceness)
+  {
+#ifdef __linux__
+    if (!cpus.empty())
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (unsigned int cpu: cpus)
+        if (cpu < CPU_SETSIZE)
+          CPU_SET(cpu, &set);
+      if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        MWARNING("Failed to set threadpool worker CPU affinity");
+    }
+    // niceness is per thread on Linux
+    if (niceness && setpriority(PRIO_PROCESS, syscall(SYS_gettid), niceness) != 0)
+      MWARNING("Failed to lower threadpool worker priority");
+#endif
+  }
+}
 
 namespace tools
 {
-threadpool::threadpool(unsigned int max_threads) : running(true), active(0) {
+threadpool::threadpool(unsigned int max_threads, const std::vector<unsigned int> &cpus, int niceness) : next_queue(0), pending(0), sleeping(0), active(0), running(true) {
   boost::thread::attributes attrs;
   attrs.set_stack_size(THREAD_STACK_SIZE);
   max = max_threads ? max_threads : tools::get_max_concurrency();
-  size_t i = max ? max - 1 : 0;
-  while(i--) {
-    threads.push_back(boost::thread(attrs, boost::bind(&threadpool::run, this, false)));
+  const size_t n_threads = max ? max - 1 : 0;
+  for (size_t i = 0; i <= n_threads; ++i)
+    queues.emplace_back(new worker_queue());
+  for (size_t i = 0; i < n_threads; ++i) {
+    threads.push_back(boost::thread(attrs, [this, i, cpus, niceness]() {
+      setup_worker_thread(cpus, niceness);
+      run(i, false);
+    }));
+  }
+}
+
+threadpool& threadpool::getInstance() {
+  if (current_pool)
+    return *const_cast<threadpool*>(current_pool);
+  return getInstance(current_purpose >= 0 ? purpose(current_purpose) : block);
+}
+
+threadpool& threadpool::getInstance(purpose p) {
+  switch (p)
+  {
+    case relay: {
+      static threadpool instance(get_pool_threads(relay), get_pool_cpus(relay), purpose_niceness[relay]);
+      return instance;
+    }
+    case background: {
+      static threadpool instance(get_pool_threads(background), get_pool_cpus(background), purpose_niceness[background]);
+      return instance;
+    }
+    default: {
+      static threadpool instance(get_pool_threads(block), get_pool_cpus(block), purpose_niceness[block]);
+      return instance;
+    }
   }
 }
 
+void threadpool::configure(purpose p, unsigned int max_threads, const std::vector<unsigned int> &cpus) {
+  CHECK_AND_ASSERT_THROW_MES(p < num_purposes, "Invalid threadpool purpose");
+  boost::lock_guard<boost::mutex> lock(config_lock);
+  configured_threads[p] = max_threads;
+  configured_cpus[p] = cpus;
+}
+
+bool threadpool::configure_from_args(const std::vector<std::string> &sizes, const std::vector<std::string> &cpus) {
+  unsigned int threads[num_purposes] = {};
+  std::vector<unsigned int> cpu_lists[num_purposes];
+  bool has_cpus[num_purposes] = {};
+
+  // splits "<purpose>:<value>"
+  auto split = [](const std::string &s, purpose &p, std::string &value) {
+    const size_t colon = s.find(':');
+    if (colon == std::string::npos)
+      return false;
+    const std::string name = s.substr(0, colon);
+    for (int i = 0; i < num_purposes; ++i)
+    {
+      if (name == get_purpose_name(purpose(i)))
+      {
+        p = purpose(i);
+        value = s.substr(colon + 1);
+        return !value.empty();
+      }
+    }
+    return false;
+  };
+  auto parse_unsigned = [](const std::string &s, unsigned int &n) {
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos || s.size() > 9)
+      return false;
+    n = std::stoul(s);
+    return true;
+  };
+
+  for (const std::string &s: sizes)
+  {
+    purpose p;
+    std::string value;
+    if (!split(s, p, value) || !parse_unsigned(value, threads[p]))
+    {
+      MERROR("Invalid threadpool size: " << s);
+      return false;
+    }
+  }
+  for (const std::string &s: cpus)
+  {
+    purpose p;
+    std::string value;
+    if (!split(s, p, value))
+    {
+      MERROR("Invalid threadpool CPU list: " << s);
+      return false;
+    }
+    size_t start = 0;
+    while (start <= value.size())
+    {
+      size_t end = value.find(',', start);
+      if (end == std::string::npos)
+        end = value.size();
+      const std::string range = value.substr(start, end - start);
+      const size_t dash = range.find('-');
+      unsigned int first, last;
+      if (dash == std::string::npos ? !parse_unsigned(range, first) : !parse_unsigned(range.substr(0, dash), first) || !parse_unsigned(range.substr(dash + 1), last))
+      {
+        MERROR("Invalid threadpool CPU list: " << s);
+        return false;
+      }
+      if (dash == std::string::npos)
+        last = first;
+      if (last < first || last >= 1024)
+      {
+        MERROR("Invalid threadpool CPU range: " << range);
+        return false;
+      }
+      for (unsigned int cpu = first; cpu <= last; ++cpu)
+        cpu_lists[p].push_back(cpu);
+      has_cpus[p] = true;
+      start = end + 1;
+    }
+  }
+
+  for (int i = 0; i < num_purposes; ++i)
+    if (threads[i] || has_cpus[i])
+      configure(purpose(i), threads[i], cpu_lists[i]);
+  return true;
+}
+
+const char *threadpool::get_purpose_name(purpose p) {
+  switch (p)
+  {
+    case block: return "block";
+    case relay: return "relay";
+    case background: return "background";
+    default: return "unknown";
+  }
+}
+
+threadpool::scoped_purpose::scoped_purpose(purpose p): previous(current_purpose) {
+  current_purpose = p;
+}
+
+threadpool::scoped_purpose::~scoped_purpose() {
+  current_purpose = previous;
+}
+
 threadpool::~threadpool() {
   try
   {
@@ -70,13 +270,55 @@ threadpool::~threadpool() {
   }
 }
 
+unsigned int threadpool::pick_queue() {
+  if (current_pool == this)
+    return current_queue;
+  return next_queue++ % queues.size();
+}
+
+void threadpool::push(unsigned int idx, entry e) {
+  worker_queue &q = *queues[idx];
+  const boost::unique_lock<boost::mutex> lock(q.mutex);
+  if (e.leaf)
+    q.queue.push_front(std::move(e));
+  else
+    q.queue.push_back(std::move(e));
+  ++pending;
+}
+
+bool threadpool::pop(unsigned int first, entry &e) {
+  // own queue first, then steal from the others
+  const unsigned int n = queues.size();
+  for (unsigned int k = 0; k < n && pending > 0; ++k) {
+    worker_queue &q = *queues[(first + k) % n];
+    const boost::unique_lock<boost::mutex> lock(q.mutex);
+    if (q.queue.empty())
+      continue;
+    e = std::move(q.queue.front());
+    q.queue.pop_front();
+    --pending;
+    return true;
+  }
+  return false;
+}
+
+void threadpool::wake(unsigned int count) {
+  // pending was bumped before this check, and sleepers bump sleeping
+  // (under the mutex) before checking pending, so no wakeup is lost
+  if (sleeping == 0)
+    return;
+  const boost::unique_lock<boost::mutex> lock(mutex);
+  if (count > 1)
+    has_work.notify_all();
+  else
+    has_work.notify_one();
+}
+
 void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf) {
   CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
-  boost::unique_lock<boost::mutex> lock(mutex);
-  if (!leaf && ((active == max && !queue.empty()) || depth > 0)) {
+  if (!leaf && ((active == max && pending > 0) || depth > 0)) {
     // if all available threads are already running
     // and there's work waiting, just run in current thread
-    lock.unlock();
     ++depth;
     is_leaf = leaf;
     f();
@@ -85,18 +327,57 @@ void threadpool::submit(waiter *obj, std::function<void()> f, bool leaf) {
   } else {
     if (obj)
       obj->inc();
-    if (leaf)
-      queue.push_front({obj, f, leaf});
-    else
-      queue.push_back({obj, f, leaf});
-    has_work.notify_one();
+    push(pick_queue(), {obj, std::move(f), leaf});
+    wake(1);
   }
 }
 
+void threadpool::submit_bulk(waiter *obj, std::vector<std::function<void()>> fs, bool leaf) {
+  CHECK_AND_ASSERT_THROW_MES(!is_leaf, "A leaf routine is using a thread pool");
+  if (fs.empty())
+    return;
+  if (!leaf && ((active == max && pending > 0) || depth > 0)) {
+    ++depth;
+    for (auto &f: fs)
+      f();
+    --depth;
+    return;
+  }
+
+  if (obj)
+    obj->inc(fs.size());
+  // spread contiguous chunks over the queues, so each lock is taken once
+  const size_t n_queues = queues.size();
+  const size_t chunk = (fs.size() + n_queues - 1) / n_queues;
+  unsigned int idx = pick_queue();
+  size_t n = 0;
+  while (n < fs.size()) {
+    worker_queue &q = *queues[idx];
+    const size_t end = std::min(n + chunk, fs.size());
+    {
+      const boost::unique_lock<boost::mutex> lock(q.mutex);
+      for (size_t i = n; i < end; ++i) {
+        if (leaf)
+          q.queue.push_front({obj, std::move(fs[i]), leaf});
+        else
+          q.queue.push_back({obj, std::move(fs[i]), leaf});
+      }
+      pending += end - n;
+    }
+    n = end;
+    idx = (idx + 1) % n_queues;
+  }
+  wake(fs.size());
+}
+
 unsigned int threadpool::get_max_concurrency() const {
   return max;
 }
 
+unsigned int threadpool::get_pending() const {
+  return pending.load(std::memory_order_relaxed);
+}
+
 threadpool::waiter::~waiter()
 {
   try
@@ -118,50 +399,60 @@ threadpool::waiter::~waiter()
 
 void threadpool::waiter::wait(threadpool *tpool) {
   if (tpool)
-    tpool->run(true);
+    tpool->run(current_pool == tpool ? current_queue : tpool->queues.size() - 1, true);
   boost::unique_lock<boost::mutex> lock(mt);
   while(num)
     cv.wait(lock);
 }
 
-void threadpool::waiter::inc() {
-  const boost::unique_lock<boost::mutex> lock(mt);
-  num++;
+void threadpool::waiter::inc(int count) {
+  num += count;
 }
 
 void threadpool::waiter::dec() {
+  // only the last task takes the mutex, so the waiter can't
+  // wake up and go away between the decrement and the notify
+  int n = num;
+  while (n > 1) {
+    if (num.compare_exchange_weak(n, n - 1))
+      return;
+  }
   const boost::unique_lock<boost::mutex> lock(mt);
-  num--;
-  if (!num)
+  if (--num == 0)
     cv.notify_all();
 }
 
-void threadpool::run(bool flush) {
-  boost::unique_lock<boost::mutex> lock(mutex);
+void threadpool::run_entry(entry &e) {
+  ++active;
+  ++depth;
+  is_leaf = e.leaf;
+  e.f();
+  --depth;
+  is_leaf = false;
+
+  if (e.wo)
+    e.wo->dec();
+  --active;
+}
+
+void threadpool::run(unsigned int idx, bool flush) {
+  if (!flush) {
+    current_pool = this;
+    current_queue = idx;
+  }
   while (running) {
     entry e;
-    while(queue.empty() && running)
-    {
-      if (flush)
-        return;
-      has_work.wait(lock);
+    if (pop(idx, e)) {
+      run_entry(e);
+      continue;
     }
-    if (!running) break;
-
-    active++;
-    e = queue.front();
-    queue.pop_front();
-    lock.unlock();
-    ++depth;
-    is_leaf = e.leaf;
-    e.f();
-    --depth;
-    is_leaf = false;
-
-    if (e.wo)
-      e.wo->dec();
-    lock.lock();
-    active--;
+    if (flush)
+      return;
+    boost::unique_lock<boost::mutex> lock(mutex);
+    ++sleeping;
+    while (pending == 0 && running)
+      has_work.wait(lock);
+    --sleeping;
   }
 }
 }
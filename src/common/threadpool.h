@@ -30,34 +30,74 @@
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
+#include <atomic>
 #include <cstddef>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 #include <stdexcept>
 
 namespace tools
 {
-//! A global thread pool
+//! Global thread pools, one per class of work
 class threadpool
 {
 public:
-  static threadpool& getInstance() {
-    static threadpool instance;
-    return instance;
-  }
+  // Work classes, most urgent first. Each has its own pool, so a new
+  // block is verified with all of its threads even while the relay
+  // pool is busy with a flood of transactions.
+  enum purpose {
+    block = 0,   //!< block verification, and anything not classified
+    relay,       //!< transactions received for the pool
+    background,  //!< wallet scanning and other work nobody waits on
+    num_purposes
+  };
+
+  // The pool tasks submitted from this thread should go to: the pool of
+  // the calling worker thread, else the one picked by a scoped_purpose,
+  // else the block pool.
+  static threadpool& getInstance();
+
+  static threadpool& getInstance(purpose p);
+
+  // Sets the number of threads (0 for the default) and the CPUs they may
+  // run on (empty for any) of a pool. Only has effect before the pool is
+  // first used.
+  static void configure(purpose p, unsigned int max_threads, const std::vector<unsigned int> &cpus = {});
+
+  // Configures the pools from "<purpose>:<threads>" and
+  // "<purpose>:<cpu>[-<cpu>][,...]" strings, as given on the command line.
+  // Returns false if any is malformed, in which case nothing is changed.
+  static bool configure_from_args(const std::vector<std::string> &sizes, const std::vector<std::string> &cpus);
+
+  static const char *get_purpose_name(purpose p);
+
+  // Routes getInstance() on this thread to the pool of a purpose, for
+  // as long as it lives
+  class scoped_purpose {
+    int previous;
+    public:
+    scoped_purpose(purpose p);
+    ~scoped_purpose();
+  };
+
   static threadpool *getNewForUnitTests(unsigned max_threads = 0) {
     return new threadpool(max_threads);
   }
 
   // The waiter lets the caller know when all of its
-  // tasks are completed.
+  // tasks are completed. The counter is atomic, the
+  // mutex is only taken when the last task completes
+  // and when waiting.
   class waiter {
     boost::mutex mt;
     boost::condition_variable cv;
-    int num;
+    std::atomic<int> num;
     public:
-    void inc();
+    void inc(int count = 1);
     void dec();
     void wait(threadpool *tpool);  //! Wait for a set of tasks to finish.
     waiter() : num(0){}
@@ -69,25 +109,47 @@ public:
   // task to finish.
   void submit(waiter *waiter, std::function<void()> f, bool leaf = false);
 
+  // Submit a batch of tasks at once, spreading them over
+  // the worker queues. Same semantics as calling submit
+  // for each of them, but cheaper.
+  void submit_bulk(waiter *waiter, std::vector<std::function<void()>> fs, bool leaf = false);
+
   unsigned int get_max_concurrency() const;
 
+  // number of tasks queued and not yet picked up by a worker
+  unsigned int get_pending() const;
+
   ~threadpool();
 
   private:
-    threadpool(unsigned int max_threads = 0);
+    threadpool(unsigned int max_threads = 0, const std::vector<unsigned int> &cpus = {}, int niceness = 0);
     typedef struct entry {
       waiter *wo;
       std::function<void()> f;
       bool leaf;
     } entry;
-    std::deque<entry> queue;
+    // one queue per worker, the last one is not owned by
+    // any worker and is only drained by stealing
+    struct worker_queue {
+      boost::mutex mutex;
+      std::deque<entry> queue;
+    };
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::atomic<unsigned int> next_queue;
+    std::atomic<unsigned int> pending;
+    std::atomic<unsigned int> sleeping;
     boost::condition_variable has_work;
     boost::mutex mutex;
     std::vector<boost::thread> threads;
-    unsigned int active;
+    std::atomic<unsigned int> active;
     unsigned int max;
-    bool running;
-    void run(bool flush = false);
+    std::atomic<bool> running;
+    unsigned int pick_queue();
+    void push(unsigned int idx, entry e);
+    bool pop(unsigned int first, entry &e);
+    void wake(unsigned int count);
+    void run_entry(entry &e);
+    void run(unsigned int idx, bool flush = false);
 };
 
 }
@@ -0,0 +1,436 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+// Copyright (c) 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crypto-ops.h"
+
+/* Batched variable base scalar multiplication.
+ *
+ * The AVX2 backend keeps four field elements side by side, one per 64 bit
+ * lane, and runs the ref10 formulas on all four at once. Limb bounds are the
+ * same as in ref10, so products fit the signed 32x32->64 multiply and the
+ * carry chains are the ref10 ones. */
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define GE_BATCH_HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define GE_BATCH_HAVE_AVX2 0
+#endif
+
+static void ge_scalarmult_batch_ref10(ge_p2 *r, const unsigned char *a, const ge_p3 *A, size_t n) {
+  size_t i;
+  for (i = 0; i < n; i++) {
+    ge_scalarmult(&r[i], a + 32 * i, &A[i]);
+  }
+}
+
+#if GE_BATCH_HAVE_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+
+typedef struct { __m256i v[10]; } fe4;
+
+typedef struct { fe4 X, Y, Z; } ge4_p2;
+typedef struct { fe4 X, Y, Z, T; } ge4_p3;
+typedef struct { fe4 X, Y, Z, T; } ge4_p1p1;
+typedef struct { fe4 YplusX, YminusX, Z, T2d; } ge4_cached;
+
+static AVX2 void fe4_load(fe4 *h, const fe f0, const fe f1, const fe f2, const fe f3) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    h->v[i] = _mm256_set_epi64x(f3[i], f2[i], f1[i], f0[i]);
+  }
+}
+
+static AVX2 void fe4_store(fe f0, fe f1, fe f2, fe f3, const fe4 *h) {
+  int64_t l[4] __attribute__((aligned(32)));
+  int i;
+  for (i = 0; i < 10; i++) {
+    _mm256_store_si256((__m256i *) l, h->v[i]);
+    f0[i] = (int32_t) l[0];
+    f1[i] = (int32_t) l[1];
+    f2[i] = (int32_t) l[2];
+    f3[i] = (int32_t) l[3];
+  }
+}
+
+static AVX2 void fe4_broadcast(fe4 *h, const fe f) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    h->v[i] = _mm256_set1_epi64x(f[i]);
+  }
+}
+
+static AVX2 void fe4_0(fe4 *h) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    h->v[i] = _mm256_setzero_si256();
+  }
+}
+
+static AVX2 void fe4_1(fe4 *h) {
+  fe4_0(h);
+  h->v[0] = _mm256_set1_epi64x(1);
+}
+
+static AVX2 void fe4_add(fe4 *h, const fe4 *f, const fe4 *g) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    h->v[i] = _mm256_add_epi64(f->v[i], g->v[i]);
+  }
+}
+
+static AVX2 void fe4_sub(fe4 *h, const fe4 *f, const fe4 *g) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    h->v[i] = _mm256_sub_epi64(f->v[i], g->v[i]);
+  }
+}
+
+static AVX2 void fe4_neg(fe4 *h, const fe4 *f) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    h->v[i] = _mm256_sub_epi64(_mm256_setzero_si256(), f->v[i]);
+  }
+}
+
+/* Replace (f) with (g) in the lanes where mask is all ones */
+static AVX2 void fe4_cmov(fe4 *f, const fe4 *g, __m256i mask) {
+  int i;
+  for (i = 0; i < 10; i++) {
+    f->v[i] = _mm256_blendv_epi8(f->v[i], g->v[i], mask);
+  }
+}
+
+/* Arithmetic right shift of 64 bit lanes with rounding, for |x| < 2^62:
+ * bias the value positive, shift logically and remove the bias again. */
+#define FE4_CARRY(t, i, j, bits) do { \
+    __m256i c = _mm256_srli_epi64(t[i] + _mm256_set1_epi64x((INT64_C(1) << ((bits) - 1)) + (INT64_C(1) << 62)), (bits)) - \
+      _mm256_set1_epi64x(INT64_C(1) << (62 - (bits))); \
+    t[j] += c; \
+    t[i] -= _mm256_slli_epi64(c, (bits)); \
+  } while (0)
+
+#define M(a, b) _mm256_mul_epi32((a), (b))
+
+static AVX2 inline __m256i mul19(__m256i x) {
+  return x + _mm256_slli_epi64(x, 1) + _mm256_slli_epi64(x, 4);
+}
+
+static AVX2 inline void fe4_carry(fe4 *h, __m256i *t) {
+  int i;
+  FE4_CARRY(t, 0, 1, 26);
+  FE4_CARRY(t, 4, 5, 26);
+  FE4_CARRY(t, 1, 2, 25);
+  FE4_CARRY(t, 5, 6, 25);
+  FE4_CARRY(t, 2, 3, 26);
+  FE4_CARRY(t, 6, 7, 26);
+  FE4_CARRY(t, 3, 4, 25);
+  FE4_CARRY(t, 7, 8, 25);
+  FE4_CARRY(t, 4, 5, 26);
+  FE4_CARRY(t, 8, 9, 26);
+  {
+    __m256i c = _mm256_srli_epi64(t[9] + _mm256_set1_epi64x((INT64_C(1) << 24) + (INT64_C(1) << 62)), 25) -
+      _mm256_set1_epi64x(INT64_C(1) << 37);
+    t[0] += mul19(c);
+    t[9] -= _mm256_slli_epi64(c, 25);
+  }
+  FE4_CARRY(t, 0, 1, 26);
+  for (i = 0; i < 10; i++) {
+    h->v[i] = t[i];
+  }
+}
+
+/* Same terms and bounds as fe_mul */
+static AVX2 void fe4_mul(fe4 *h, const fe4 *f, const fe4 *g) {
+  __m256i f0 = f->v[0], f1 = f->v[1], f2 = f->v[2], f3 = f->v[3], f4 = f->v[4];
+  __m256i f5 = f->v[5], f6 = f->v[6], f7 = f->v[7], f8 = f->v[8], f9 = f->v[9];
+  __m256i g0 = g->v[0], g1 = g->v[1], g2 = g->v[2], g3 = g->v[3], g4 = g->v[4];
+  __m256i g5 = g->v[5], g6 = g->v[6], g7 = g->v[7], g8 = g->v[8], g9 = g->v[9];
+  __m256i f1_2 = f1 + f1, f3_2 = f3 + f3, f5_2 = f5 + f5, f7_2 = f7 + f7, f9_2 = f9 + f9;
+  __m256i g1_19 = mul19(g1), g2_19 = mul19(g2), g3_19 = mul19(g3);
+  __m256i g4_19 = mul19(g4), g5_19 = mul19(g5), g6_19 = mul19(g6);
+  __m256i g7_19 = mul19(g7), g8_19 = mul19(g8), g9_19 = mul19(g9);
+  __m256i t[10];
+  t[0] = M(f0, g0) + M(f1_2, g9_19) + M(f2, g8_19) + M(f3_2, g7_19) + M(f4, g6_19) +
+         M(f5_2, g5_19) + M(f6, g4_19) + M(f7_2, g3_19) + M(f8, g2_19) + M(f9_2, g1_19);
+  t[1] = M(f0, g1) + M(f1, g0) + M(f2, g9_19) + M(f3, g8_19) + M(f4, g7_19) +
+         M(f5, g6_19) + M(f6, g5_19) + M(f7, g4_19) + M(f8, g3_19) + M(f9, g2_19);
+  t[2] = M(f0, g2) + M(f1_2, g1) + M(f2, g0) + M(f3_2, g9_19) + M(f4, g8_19) +
+         M(f5_2, g7_19) + M(f6, g6_19) + M(f7_2, g5_19) + M(f8, g4_19) + M(f9_2, g3_19);
+  t[3] = M(f0, g3) + M(f1, g2) + M(f2, g1) + M(f3, g0) + M(f4, g9_19) +
+         M(f5, g8_19) + M(f6, g7_19) + M(f7, g6_19) + M(f8, g5_19) + M(f9, g4_19);
+  t[4] = M(f0, g4) + M(f1_2, g3) + M(f2, g2) + M(f3_2, g1) + M(f4, g0) +
+         M(f5_2, g9_19) + M(f6, g8_19) + M(f7_2, g7_19) + M(f8, g6_19) + M(f9_2, g5_19);
+  t[5] = M(f0, g5) + M(f1, g4) + M(f2, g3) + M(f3, g2) + M(f4, g1) +
+         M(f5, g0) + M(f6, g9_19) + M(f7, g8_19) + M(f8, g7_19) + M(f9, g6_19);
+  t[6] = M(f0, g6) + M(f1_2, g5) + M(f2, g4) + M(f3_2, g3) + M(f4, g2) +
+         M(f5_2, g1) + M(f6, g0) + M(f7_2, g9_19) + M(f8, g8_19) + M(f9_2, g7_19);
+  t[7] = M(f0, g7) + M(f1, g6) + M(f2, g5) + M(f3, g4) + M(f4, g3) +
+         M(f5, g2) + M(f6, g1) + M(f7, g0) + M(f8, g9_19) + M(f9, g8_19);
+  t[8] = M(f0, g8) + M(f1_2, g7) + M(f2, g6) + M(f3_2, g5) + M(f4, g4) +
+         M(f5_2, g3) + M(f6, g2) + M(f7_2, g1) + M(f8, g0) + M(f9_2, g9_19);
+  t[9] = M(f0, g9) + M(f1, g8) + M(f2, g7) + M(f3, g6) + M(f4, g5) +
+         M(f5, g4) + M(f6, g3) + M(f7, g2) + M(f8, g1) + M(f9, g0);
+  fe4_carry(h, t);
+}
+
+/* Same terms and bounds as fe_sq, doubled before carrying for fe_sq2 */
+static AVX2 void fe4_sq_gen(fe4 *h, const fe4 *f, int dbl) {
+  __m256i f0 = f->v[0], f1 = f->v[1], f2 = f->v[2], f3 = f->v[3], f4 = f->v[4];
+  __m256i f5 = f->v[5], f6 = f->v[6], f7 = f->v[7], f8 = f->v[8], f9 = f->v[9];
+  __m256i f0_2 = f0 + f0, f1_2 = f1 + f1, f2_2 = f2 + f2, f3_2 = f3 + f3;
+  __m256i f4_2 = f4 + f4, f5_2 = f5 + f5, f6_2 = f6 + f6, f7_2 = f7 + f7;
+  __m256i f5_38 = mul19(f5_2), f6_19 = mul19(f6), f7_38 = mul19(f7_2);
+  __m256i f8_19 = mul19(f8), f9_38 = mul19(f9 + f9);
+  __m256i t[10];
+  int i;
+  t[0] = M(f0, f0) + M(f1_2, f9_38) + M(f2_2, f8_19) + M(f3_2, f7_38) + M(f4_2, f6_19) + M(f5, f5_38);
+  t[1] = M(f0_2, f1) + M(f2, f9_38) + M(f3_2, f8_19) + M(f4, f7_38) + M(f5_2, f6_19);
+  t[2] = M(f0_2, f2) + M(f1_2, f1) + M(f3_2, f9_38) + M(f4_2, f8_19) + M(f5_2, f7_38) + M(f6, f6_19);
+  t[3] = M(f0_2, f3) + M(f1_2, f2) + M(f4, f9_38) + M(f5_2, f8_19) + M(f6, f7_38);
+  t[4] = M(f0_2, f4) + M(f1_2, f3_2) + M(f2, f2) + M(f5_2, f9_38) + M(f6_2, f8_19) + M(f7, f7_38);
+  t[5] = M(f0_2, f5) + M(f1_2, f4) + M(f2_2, f3) + M(f6, f9_38) + M(f7_2, f8_19);
+  t[6] = M(f0_2, f6) + M(f1_2, f5_2) + M(f2_2, f4) + M(f3_2, f3) + M(f7_2, f9_38) + M(f8, f8_19);
+  t[7] = M(f0_2, f7) + M(f1_2, f6) + M(f2_2, f5) + M(f3_2, f4) + M(f8, f9_38);
+  t[8] = M(f0_2, f8) + M(f1_2, f7_2) + M(f2_2, f6) + M(f3_2, f5_2) + M(f4, f4) + M(f9, f9_38);
+  t[9] = M(f0_2, f9) + M(f1_2, f8) + M(f2_2, f7) + M(f3_2, f6) + M(f4_2, f5);
+  if (dbl) {
+    for (i = 0; i < 10; i++) {
+      t[i] += t[i];
+    }
+  }
+  fe4_carry(h, t);
+}
+
+static AVX2 void fe4_sq(fe4 *h, const fe4 *f) {
+  fe4_sq_gen(h, f, 0);
+}
+
+static AVX2 void fe4_sq2(fe4 *h, const fe4 *f) {
+  fe4_sq_gen(h, f, 1);
+}
+
+static AVX2 void ge4_p2_0(ge4_p2 *h) {
+  fe4_0(&h->X);
+  fe4_1(&h->Y);
+  fe4_1(&h->Z);
+}
+
+static AVX2 void ge4_cached_0(ge4_cached *h) {
+  fe4_1(&h->YplusX);
+  fe4_1(&h->YminusX);
+  fe4_1(&h->Z);
+  fe4_0(&h->T2d);
+}
+
+static AVX2 void ge4_cached_cmov(ge4_cached *t, const ge4_cached *u, __m256i mask) {
+  fe4_cmov(&t->YplusX, &u->YplusX, mask);
+  fe4_cmov(&t->YminusX, &u->YminusX, mask);
+  fe4_cmov(&t->Z, &u->Z, mask);
+  fe4_cmov(&t->T2d, &u->T2d, mask);
+}
+
+static AVX2 void ge4_add(ge4_p1p1 *r, const ge4_p3 *p, const ge4_cached *q) {
+  fe4 t0;
+  fe4_add(&r->X, &p->Y, &p->X);
+  fe4_sub(&r->Y, &p->Y, &p->X);
+  fe4_mul(&r->Z, &r->X, &q->YplusX);
+  fe4_mul(&r->Y, &r->Y, &q->YminusX);
+  fe4_mul(&r->T, &q->T2d, &p->T);
+  fe4_mul(&r->X, &p->Z, &q->Z);
+  fe4_add(&t0, &r->X, &r->X);
+  fe4_sub(&r->X, &r->Z, &r->Y);
+  fe4_add(&r->Y, &r->Z, &r->Y);
+  fe4_add(&r->Z, &t0, &r->T);
+  fe4_sub(&r->T, &t0, &r->T);
+}
+
+static AVX2 void ge4_p1p1_to_p2(ge4_p2 *r, const ge4_p1p1 *p) {
+  fe4_mul(&r->X, &p->X, &p->T);
+  fe4_mul(&r->Y, &p->Y, &p->Z);
+  fe4_mul(&r->Z, &p->Z, &p->T);
+}
+
+static AVX2 void ge4_p1p1_to_p3(ge4_p3 *r, const ge4_p1p1 *p) {
+  fe4_mul(&r->X, &p->X, &p->T);
+  fe4_mul(&r->Y, &p->Y, &p->Z);
+  fe4_mul(&r->Z, &p->Z, &p->T);
+  fe4_mul(&r->T, &p->X, &p->Y);
+}
+
+static AVX2 void ge4_p2_dbl(ge4_p1p1 *r, const ge4_p2 *p) {
+  fe4 t0;
+  fe4_sq(&r->X, &p->X);
+  fe4_sq(&r->Z, &p->Y);
+  fe4_sq2(&r->T, &p->Z);
+  fe4_add(&r->Y, &p->X, &p->Y);
+  fe4_sq(&t0, &r->Y);
+  fe4_add(&r->Y, &r->Z, &r->X);
+  fe4_sub(&r->Z, &r->Z, &r->X);
+  fe4_sub(&r->X, &t0, &r->Y);
+  fe4_sub(&r->T, &r->T, &r->Z);
+}
+
+static AVX2 void ge4_p3_to_cached(ge4_cached *r, const ge4_p3 *p, const fe4 *d2) {
+  fe4_add(&r->YplusX, &p->Y, &p->X);
+  fe4_sub(&r->YminusX, &p->Y, &p->X);
+  r->Z = p->Z;
+  fe4_mul(&r->T2d, &p->T, d2);
+}
+
+/* Constant time, same signed radix 16 window as ge_scalarmult */
+static AVX2 void ge_scalarmult_x4_avx2(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
+  signed char e[4][64];
+  int carry, carry2, i, k;
+  fe4 d2;
+  ge4_p3 A4, u;
+  ge4_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge4_p1p1 t;
+  ge4_p2 r4;
+
+  for (k = 0; k < 4; k++) {
+    const unsigned char *s = a + 32 * k;
+    carry = 0; /* 0..1 */
+    for (i = 0; i < 31; i++) {
+      carry += s[i]; /* 0..256 */
+      carry2 = (carry + 8) >> 4; /* 0..16 */
+      e[k][2 * i] = carry - (carry2 << 4); /* -8..7 */
+      carry = (carry2 + 8) >> 4; /* 0..1 */
+      e[k][2 * i + 1] = carry2 - (carry << 4); /* -8..7 */
+    }
+    carry += s[31]; /* 0..128 */
+    carry2 = (carry + 8) >> 4; /* 0..8 */
+    e[k][62] = carry - (carry2 << 4); /* -8..7 */
+    e[k][63] = carry2; /* 0..8 */
+  }
+
+  fe4_broadcast(&d2, fe_d2);
+  fe4_load(&A4.X, A[0].X, A[1].X, A[2].X, A[3].X);
+  fe4_load(&A4.Y, A[0].Y, A[1].Y, A[2].Y, A[3].Y);
+  fe4_load(&A4.Z, A[0].Z, A[1].Z, A[2].Z, A[3].Z);
+  fe4_load(&A4.T, A[0].T, A[1].T, A[2].T, A[3].T);
+
+  ge4_p3_to_cached(&Ai[0], &A4, &d2);
+  for (i = 0; i < 7; i++) {
+    ge4_add(&t, &A4, &Ai[i]);
+    ge4_p1p1_to_p3(&u, &t);
+    ge4_p3_to_cached(&Ai[i + 1], &u, &d2);
+  }
+
+  ge4_p2_0(&r4);
+  for (i = 63; i >= 0; i--) {
+    int64_t babs[4], bneg[4];
+    __m256i vabs, vneg;
+    ge4_cached cur, minuscur;
+    int j;
+    for (k = 0; k < 4; k++) {
+      signed char b = e[k][i];
+      int64_t bnegative = (int64_t) ((unsigned char) b >> 7);
+      babs[k] = b - (((-bnegative) & b) << 1);
+      bneg[k] = -bnegative;
+    }
+    vabs = _mm256_set_epi64x(babs[3], babs[2], babs[1], babs[0]);
+    vneg = _mm256_set_epi64x(bneg[3], bneg[2], bneg[1], bneg[0]);
+
+    ge4_p2_dbl(&t, &r4);
+    ge4_p1p1_to_p2(&r4, &t);
+    ge4_p2_dbl(&t, &r4);
+    ge4_p1p1_to_p2(&r4, &t);
+    ge4_p2_dbl(&t, &r4);
+    ge4_p1p1_to_p2(&r4, &t);
+    ge4_p2_dbl(&t, &r4);
+    ge4_p1p1_to_p3(&u, &t);
+    ge4_cached_0(&cur);
+    for (j = 0; j < 8; j++) {
+      ge4_cached_cmov(&cur, &Ai[j], _mm256_cmpeq_epi64(vabs, _mm256_set1_epi64x(j + 1)));
+    }
+    minuscur.YplusX = cur.YminusX;
+    minuscur.YminusX = cur.YplusX;
+    minuscur.Z = cur.Z;
+    fe4_neg(&minuscur.T2d, &cur.T2d);
+    ge4_cached_cmov(&cur, &minuscur, vneg);
+    ge4_add(&t, &u, &cur);
+    ge4_p1p1_to_p2(&r4, &t);
+  }
+
+  fe4_store(r[0].X, r[1].X, r[2].X, r[3].X, &r4.X);
+  fe4_store(r[0].Y, r[1].Y, r[2].Y, r[3].Y, &r4.Y);
+  fe4_store(r[0].Z, r[1].Z, r[2].Z, r[3].Z, &r4.Z);
+}
+
+static int ge_batch_avx2_supported(void) {
+  static volatile int supported = -1;
+  if (supported < 0) {
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return supported;
+}
+
+static void ge_scalarmult_batch_avx2(ge_p2 *r, const unsigned char *a, const ge_p3 *A, size_t n) {
+  size_t i;
+  for (i = 0; i + 4 <= n; i += 4) {
+    ge_scalarmult_x4_avx2(r + i, a + 32 * i, A + i);
+  }
+  ge_scalarmult_batch_ref10(r + i, a + 32 * i, A + i, n - i);
+}
+
+#endif
+
+int ge_batch_backend_supported(int backend) {
+  switch (backend) {
+  case GE_BATCH_BACKEND_REF10:
+    return 1;
+#if GE_BATCH_HAVE_AVX2
+  case GE_BATCH_BACKEND_AVX2:
+    return ge_batch_avx2_supported();
+#endif
+  default:
+    return 0;
+  }
+}
+
+void ge_scalarmult_batch_backend(int backend, ge_p2 *r, const unsigned char *a, const ge_p3 *A, size_t n) {
+#if GE_BATCH_HAVE_AVX2
+  if (backend == GE_BATCH_BACKEND_AVX2 && ge_batch_avx2_supported()) {
+    ge_scalarmult_batch_avx2(r, a, A, n);
+    return;
+  }
+#endif
+  ge_scalarmult_batch_ref10(r, a, A, n);
+}
+
+/* Assumes that a[32 * i + 31] <= 127 for all i */
+void ge_scalarmult_batch(ge_p2 *r, const unsigned char *a, const ge_p3 *A, size_t n) {
+  ge_scalarmult_batch_backend(n >= 4 ? GE_BATCH_BACKEND_AVX2 : GE_BATCH_BACKEND_REF10, r, a, A, n);
+}
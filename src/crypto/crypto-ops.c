@@ -1558,20 +1558,20 @@ static void ge_precomp_cmov(ge_precomp *t, const ge_precomp *u, unsigned char b)
   fe_cmov(t->xy2d, u->xy2d, b);
 }
 
-static void select(ge_precomp *t, int pos, signed char b) {
+static void select(ge_precomp *t, const ge_precomp row[8], signed char b) {
   ge_precomp minust;
   unsigned char bnegative = negative(b);
   unsigned char babs = b - (((-bnegative) & b) << 1);
 
   ge_precomp_0(t);
-  ge_precomp_cmov(t, &ge_base[pos][0], equal(babs, 1));
-  ge_precomp_cmov(t, &ge_base[pos][1], equal(babs, 2));
-  ge_precomp_cmov(t, &ge_base[pos][2], equal(babs, 3));
-  ge_precomp_cmov(t, &ge_base[pos][3], equal(babs, 4));
-  ge_precomp_cmov(t, &ge_base[pos][4], equal(babs, 5));
-  ge_precomp_cmov(t, &ge_base[pos][5], equal(babs, 6));
-  ge_precomp_cmov(t, &ge_base[pos][6], equal(babs, 7));
-  ge_precomp_cmov(t, &ge_base[pos][7], equal(babs, 8));
+  ge_precomp_cmov(t, &row[0], equal(babs, 1));
+  ge_precomp_cmov(t, &row[1], equal(babs, 2));
+  ge_precomp_cmov(t, &row[2], equal(babs, 3));
+  ge_precomp_cmov(t, &row[3], equal(babs, 4));
+  ge_precomp_cmov(t, &row[4], equal(babs, 5));
+  ge_precomp_cmov(t, &row[5], equal(babs, 6));
+  ge_precomp_cmov(t, &row[6], equal(babs, 7));
+  ge_precomp_cmov(t, &row[7], equal(babs, 8));
   fe_copy(minust.yplusx, t->yminusx);
   fe_copy(minust.yminusx, t->yplusx);
   fe_neg(minust.xy2d, t->xy2d);
@@ -1588,6 +1588,52 @@ Preconditions:
 */
 
 void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
+  ge_scalarmult_base_table(h, a, ge_base);
+}
+
+/*
+table[i][j] = (j+1) * 256^i * P, the layout of ge_base, for any fixed point P
+*/
+
+void ge_base_table_init(ge_precomp table[32][8], const ge_p3 *P) {
+  ge_p3 base = *P, cur;
+  ge_cached base_cached;
+  ge_p1p1 r;
+  fe recip, x, y;
+  int i, j, k;
+
+  for (i = 0; i < 32; ++i) {
+    ge_p3_to_cached(&base_cached, &base);
+    cur = base;
+    for (j = 0; j < 8; ++j) {
+      if (j > 0) {
+        ge_add(&r, &cur, &base_cached);
+        ge_p1p1_to_p3(&cur, &r);
+      }
+      fe_invert(recip, cur.Z);
+      fe_mul(x, cur.X, recip);
+      fe_mul(y, cur.Y, recip);
+      fe_add(table[i][j].yplusx, y, x);
+      fe_sub(table[i][j].yminusx, y, x);
+      fe_mul(table[i][j].xy2d, x, y);
+      fe_mul(table[i][j].xy2d, table[i][j].xy2d, fe_d2);
+    }
+    for (k = 0; k < 8; ++k) {
+      ge_p3_dbl(&r, &base);
+      ge_p1p1_to_p3(&base, &r);
+    }
+  }
+}
+
+/*
+h = a * P, where table was filled by ge_base_table_init for P
+Runs in constant time, as ge_scalarmult_base.
+
+Preconditions:
+  a[31] <= 127
+*/
+
+void ge_scalarmult_base_table(ge_p3 *h, const unsigned char *a, const ge_precomp table[32][8]) {
   signed char e[64];
   signed char carry;
   ge_p1p1 r;
@@ -1614,7 +1660,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
 
   ge_p3_0(h);
   for (i = 1; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 
@@ -1624,7 +1670,7 @@ void ge_scalarmult_base(ge_p3 *h, const unsigned char *a) {
   ge_p2_dbl(&r, &s); ge_p1p1_to_p3(h, &r);
 
   for (i = 0; i < 64; i += 2) {
-    select(&t, i / 2, e[i]);
+    select(&t, table[i / 2], e[i]);
     ge_madd(&r, h, &t); ge_p1p1_to_p3(h, &r);
   }
 }
@@ -3743,3 +3789,11 @@ int ge_p3_is_point_at_infinity(const ge_p3 *p) {
   }
   return 1;
 }
+
+/* Unlike ge_p3_is_point_at_infinity, compares field elements rather than
+ * limbs, so it holds for any representation of the identity */
+int ge_p3_is_identity_vartime(const ge_p3 *p) {
+  fe t;
+  fe_sub(t, p->Y, p->Z);
+  return !fe_isnonzero(p->X) && !fe_isnonzero(t);
+}
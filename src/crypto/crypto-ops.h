@@ -31,6 +31,8 @@
 
 #pragma once
 
+#include <stddef.h>
+
 /* From fe.h */
 
 typedef int32_t fe[10];
@@ -117,6 +119,8 @@ void ge_p3_tobytes(unsigned char *, const ge_p3 *);
 
 extern const ge_precomp ge_base[32][8];
 void ge_scalarmult_base(ge_p3 *, const unsigned char *);
+void ge_base_table_init(ge_precomp [32][8], const ge_p3 *);
+void ge_scalarmult_base_table(ge_p3 *, const unsigned char *, const ge_precomp [32][8]);
 
 /* From ge_tobytes.c */
 
@@ -134,6 +138,13 @@ void ge_double_scalarmult_precomp_vartime(ge_p2 *, const unsigned char *, const
 void ge_double_scalarmult_precomp_vartime2(ge_p2 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
 void ge_double_scalarmult_precomp_vartime2_p3(ge_p3 *, const unsigned char *, const ge_dsmp, const unsigned char *, const ge_dsmp);
 void ge_mul8(ge_p1p1 *, const ge_p2 *);
+
+/* Batched ge_scalarmult over n points, a holds n consecutive 32 byte scalars */
+#define GE_BATCH_BACKEND_REF10 0
+#define GE_BATCH_BACKEND_AVX2 1
+void ge_scalarmult_batch(ge_p2 *, const unsigned char *, const ge_p3 *, size_t);
+void ge_scalarmult_batch_backend(int, ge_p2 *, const unsigned char *, const ge_p3 *, size_t);
+int ge_batch_backend_supported(int);
 extern const fe fe_ma2;
 extern const fe fe_ma;
 extern const fe fe_fffb1;
@@ -162,3 +173,4 @@ void fe_tobytes(unsigned char *, const fe);
 void fe_invert(fe out, const fe z);
 
 int ge_p3_is_point_at_infinity(const ge_p3 *p);
+int ge_p3_is_identity_vartime(const ge_p3 *p);
@@ -30,14 +30,13 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #include <unistd.h>
+#include <algorithm>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/lock_guard.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include "common/varint.h"
@@ -92,9 +91,7 @@ namespace crypto {
 
   void generate_random_bytes_thread_safe(size_t N, uint8_t *bytes)
   {
-    static boost::mutex random_lock;
-    boost::lock_guard<boost::mutex> lock(random_lock);
-    generate_random_bytes_not_thread_safe(N, bytes);
+    generate_random_bytes_thread_local(N, bytes);
   }
 
   static inline bool less32(const unsigned char *k0, const unsigned char *k1)
@@ -187,6 +184,44 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations_batch(const public_key *keys, size_t count, const secret_key &sec,
+    key_derivation *derivations, bool *valid) {
+    static const size_t chunk_size = 64;
+    ge_p3 points[chunk_size];
+    ge_p2 products[chunk_size];
+    unsigned char scalars[chunk_size * 32];
+    bool all_valid = true;
+    assert(sc_check(&sec) == 0);
+    for (size_t i = 0; i < chunk_size; ++i) {
+      memcpy(scalars + 32 * i, &unwrap(sec), 32);
+    }
+    for (size_t start = 0; start < count; start += chunk_size) {
+      const size_t n = std::min(chunk_size, count - start);
+      bool ok[chunk_size];
+      for (size_t i = 0; i < n; ++i) {
+        ok[i] = ge_frombytes_vartime(&points[i], &keys[start + i]) == 0;
+        if (!ok[i]) {
+          points[i] = ge_p3_identity;
+          all_valid = false;
+        }
+      }
+      ge_scalarmult_batch(products, scalars, points, n);
+      for (size_t i = 0; i < n; ++i) {
+        ge_p1p1 point3;
+        ge_p2 point2;
+        if (valid)
+          valid[start + i] = ok[i];
+        if (!ok[i]) {
+          continue;
+        }
+        ge_mul8(&point3, &products[i]);
+        ge_p1p1_to_p2(&point2, &point3);
+        ge_tobytes(&derivations[start + i], &point2);
+      }
+    }
+    return all_valid;
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -219,6 +254,48 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::derive_public_keys_batch(const key_derivation *derivations, const size_t *output_indices, size_t count,
+    const public_key &base, public_key *derived_keys) {
+    ge_p3 point1;
+    ge_cached base_cached;
+    if (ge_frombytes_vartime(&point1, &base) != 0) {
+      return false;
+    }
+    ge_p3_to_cached(&base_cached, &point1);
+    // the derivation_to_scalar hashes go through cn_fast_hash_multi a chunk at a time
+    static const size_t chunk_size = 64;
+    struct {
+      key_derivation derivation;
+      char output_index[(sizeof(size_t) * 8 + 6) / 7];
+    } bufs[chunk_size];
+    const void *data[chunk_size];
+    size_t lengths[chunk_size];
+    ec_scalar scalars[chunk_size];
+    for (size_t start = 0; start < count; start += chunk_size) {
+      const size_t n = std::min(chunk_size, count - start);
+      for (size_t i = 0; i < n; ++i) {
+        char *end = bufs[i].output_index;
+        bufs[i].derivation = derivations[start + i];
+        tools::write_varint(end, output_indices[start + i]);
+        assert(end <= bufs[i].output_index + sizeof bufs[i].output_index);
+        data[i] = &bufs[i];
+        lengths[i] = end - reinterpret_cast<char *>(&bufs[i]);
+      }
+      cn_fast_hash_multi(data, lengths, n, reinterpret_cast<hash *>(scalars));
+      for (size_t i = 0; i < n; ++i) {
+        ge_p3 point2;
+        ge_p1p1 point4;
+        ge_p2 point5;
+        sc_reduce32(&scalars[i]);
+        ge_scalarmult_base(&point2, &scalars[i]);
+        ge_add(&point4, &point2, &base_cached);
+        ge_p1p1_to_p2(&point5, &point4);
+        ge_tobytes(&derived_keys[start + i], &point5);
+      }
+    }
+    return true;
+  }
+
   void crypto_ops::derive_secret_key(const key_derivation &derivation, size_t output_index,
     const secret_key &base, secret_key &derived_key) {
     ec_scalar scalar;
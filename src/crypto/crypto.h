@@ -121,10 +121,14 @@ namespace crypto {
     friend bool secret_key_to_public_key(const secret_key &, public_key &);
     static bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
     friend bool generate_key_derivation(const public_key &, const secret_key &, key_derivation &);
+    static bool generate_key_derivations_batch(const public_key *, std::size_t, const secret_key &, key_derivation *, bool *);
+    friend bool generate_key_derivations_batch(const public_key *, std::size_t, const secret_key &, key_derivation *, bool *);
     static void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     friend void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res);
     static bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
     friend bool derive_public_key(const key_derivation &, std::size_t, const public_key &, public_key &);
+    static bool derive_public_keys_batch(const key_derivation *, const std::size_t *, std::size_t, const public_key &, public_key *);
+    friend bool derive_public_keys_batch(const key_derivation *, const std::size_t *, std::size_t, const public_key &, public_key *);
     static void derive_secret_key(const key_derivation &, std::size_t, const secret_key &, secret_key &);
     friend void derive_secret_key(const key_derivation &, std::size_t, const secret_key &, secret_key &);
     static bool derive_subaddress_public_key(const public_key &, const key_derivation &, std::size_t, public_key &);
@@ -197,6 +201,20 @@ namespace crypto {
     const public_key &base, public_key &derived_key) {
     return crypto_ops::derive_public_key(derivation, output_index, base, derived_key);
   }
+
+  /* Batched forms of the above, for scanning many tx keys or outputs at once.
+   * generate_key_derivations_batch derives count tx keys against the same secret key,
+   * setting valid[i] (if given) per key, and returns false if any key was invalid.
+   * derive_public_keys_batch derives count output keys from the same base.
+   */
+  inline bool generate_key_derivations_batch(const public_key *keys, std::size_t count, const secret_key &sec,
+    key_derivation *derivations, bool *valid = NULL) {
+    return crypto_ops::generate_key_derivations_batch(keys, count, sec, derivations, valid);
+  }
+  inline bool derive_public_keys_batch(const key_derivation *derivations, const std::size_t *output_indices, std::size_t count,
+    const public_key &base, public_key *derived_keys) {
+    return crypto_ops::derive_public_keys_batch(derivations, output_indices, count, base, derived_keys);
+  }
   inline void derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     return crypto_ops::derivation_to_scalar(derivation, output_index, res);
   }
@@ -76,11 +76,39 @@ void hash_process(union hash_state *state, const uint8_t *buf, size_t count);
 
 enum {
   HASH_SIZE = 32,
-  HASH_DATA_AREA = 136
+  HASH_DATA_AREA = 136,
+  CN_SLOW_HASH_MAX_WAYS = 4 // most hashes cn_slow_hash_multi interleaves per call
 };
 
 void cn_fast_hash(const void *data, size_t length, char *hash);
+void cn_fast_hash_multi(const void *const *data, const size_t *length, size_t n, char *hash);
 void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int prehashed);
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t n, char *hash, int variant);
+
+/* How slow hash scratchpads are backed, best last */
+enum {
+  SLOW_HASH_PAGES_NONE = 0,
+  SLOW_HASH_PAGES_SMALL = 1,
+  SLOW_HASH_PAGES_TRANSPARENT = 2, /* transparent huge pages requested */
+  SLOW_HASH_PAGES_HUGE = 3
+};
+
+struct slow_hash_state_info {
+  int pages;     /* SLOW_HASH_PAGES_* */
+  int numa_node; /* node the scratchpad is bound to, -1 if none */
+};
+
+/* scratchpads currently allocated across all threads */
+struct slow_hash_allocation_stats {
+  uint64_t small_pages;
+  uint64_t transparent_huge_pages;
+  uint64_t huge_pages;
+  uint64_t numa_bound;
+};
+
+size_t slow_hash_allocate_state_multi(size_t ways);
+void slow_hash_get_state_info(struct slow_hash_state_info *info);
+void slow_hash_get_allocation_stats(struct slow_hash_allocation_stats *stats);
 
 void hash_extra_blake(const void *data, size_t length, char *hash);
 void hash_extra_groestl(const void *data, size_t length, char *hash);
@@ -88,3 +116,6 @@ void hash_extra_jh(const void *data, size_t length, char *hash);
 void hash_extra_skein(const void *data, size_t length, char *hash);
 
 void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash);
+size_t tree_depth(size_t count);
+void tree_branch(const char (*hashes)[HASH_SIZE], size_t count, char (*branch)[HASH_SIZE]);
+void tree_hash_from_branch(const char (*branch)[HASH_SIZE], size_t depth, const char *leaf, char *root_hash);
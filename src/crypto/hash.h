@@ -72,6 +72,10 @@ namespace crypto {
     return h;
   }
 
+  inline void cn_fast_hash_multi(const void *const *data, const std::size_t *length, std::size_t n, hash *hashes) {
+    cn_fast_hash_multi(data, length, n, reinterpret_cast<char *>(hashes));
+  }
+
   inline void cn_slow_hash(const void *data, std::size_t length, hash &hash, int variant = 0) {
     cn_slow_hash(data, length, reinterpret_cast<char *>(&hash), variant, 0/*prehashed*/);
   }
@@ -80,10 +84,31 @@ namespace crypto {
     cn_slow_hash(data, length, reinterpret_cast<char *>(&hash), variant, 1/*prehashed*/);
   }
 
+  inline void cn_slow_hash_multi(const void *const *data, const std::size_t *length, std::size_t n, hash *hashes, int variant = 0) {
+    cn_slow_hash_multi(data, length, n, reinterpret_cast<char *>(hashes), variant);
+  }
+
+  inline const char *slow_hash_pages_name(int pages) {
+    switch (pages) {
+      case SLOW_HASH_PAGES_HUGE: return "huge pages";
+      case SLOW_HASH_PAGES_TRANSPARENT: return "transparent huge pages";
+      case SLOW_HASH_PAGES_SMALL: return "small pages";
+      default: return "not allocated";
+    }
+  }
+
   inline void tree_hash(const hash *hashes, std::size_t count, hash &root_hash) {
     tree_hash(reinterpret_cast<const char (*)[HASH_SIZE]>(hashes), count, reinterpret_cast<char *>(&root_hash));
   }
 
+  inline void tree_branch(const hash *hashes, std::size_t count, hash *branch) {
+    tree_branch(reinterpret_cast<const char (*)[HASH_SIZE]>(hashes), count, reinterpret_cast<char (*)[HASH_SIZE]>(branch));
+  }
+
+  inline void tree_hash_from_branch(const hash *branch, std::size_t depth, const hash &leaf, hash &root_hash) {
+    tree_hash_from_branch(reinterpret_cast<const char (*)[HASH_SIZE]>(branch), depth, reinterpret_cast<const char *>(&leaf), reinterpret_cast<char *>(&root_hash));
+  }
+
   inline std::ostream &operator <<(std::ostream &o, const crypto::hash &v) {
     epee::to_hex::formatted(o, epee::as_byte_span(v)); return o;
   }
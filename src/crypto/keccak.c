@@ -138,6 +138,199 @@ void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md)
     keccak(in, inlen, md, sizeof(state_t));
 }
 
+// Multi-buffer keccak.
+//
+// The AVX2 backend keeps four independent states side by side, one per 64
+// bit lane, and runs the permutation on all four at once. Inputs are taken
+// four at a time when their lengths span the same number of rate blocks,
+// which is the common case for batches of tree hash nodes or derivations.
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define KECCAK_HAVE_AVX2 1
+#include <immintrin.h>
+#else
+#define KECCAK_HAVE_AVX2 0
+#endif
+
+static void keccak_multi_portable(const uint8_t *const *in, const size_t *inlen, size_t n, uint8_t *md, int mdlen)
+{
+    size_t i;
+    for (i = 0; i < n; i++)
+        keccak(in[i], inlen[i], md + i * mdlen, mdlen);
+}
+
+#if KECCAK_HAVE_AVX2
+
+#define AVX2 __attribute__((target("avx2")))
+#define ROL64X4(x, y) _mm256_or_si256(_mm256_slli_epi64((x), (y)), _mm256_srli_epi64((x), 64 - (y)))
+
+static AVX2 void keccakf_x4_avx2(__m256i st[25], int rounds)
+{
+    int i, j, round;
+    __m256i t, bc[5], b[25];
+
+    for (round = 0; round < rounds; round++) {
+
+        // Theta
+        for (i = 0; i < 5; i++)
+            bc[i] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(st[i], st[i + 5]),
+                _mm256_xor_si256(st[i + 10], st[i + 15])), st[i + 20]);
+
+        for (i = 0; i < 5; i++) {
+            t = _mm256_xor_si256(bc[(i + 4) % 5], ROL64X4(bc[(i + 1) % 5], 1));
+            for (j = 0; j < 25; j += 5)
+                st[j + i] = _mm256_xor_si256(st[j + i], t);
+        }
+
+        // Rho Pi, keccakf_piln and keccakf_rotc spelled out so the
+        // rotation counts are immediates
+        b[0] = st[0];
+        b[10] = ROL64X4(st[1], 1);
+        b[7] = ROL64X4(st[10], 3);
+        b[11] = ROL64X4(st[7], 6);
+        b[17] = ROL64X4(st[11], 10);
+        b[18] = ROL64X4(st[17], 15);
+        b[3] = ROL64X4(st[18], 21);
+        b[5] = ROL64X4(st[3], 28);
+        b[16] = ROL64X4(st[5], 36);
+        b[8] = ROL64X4(st[16], 45);
+        b[21] = ROL64X4(st[8], 55);
+        b[24] = ROL64X4(st[21], 2);
+        b[4] = ROL64X4(st[24], 14);
+        b[15] = ROL64X4(st[4], 27);
+        b[23] = ROL64X4(st[15], 41);
+        b[19] = ROL64X4(st[23], 56);
+        b[13] = ROL64X4(st[19], 8);
+        b[12] = ROL64X4(st[13], 25);
+        b[2] = ROL64X4(st[12], 43);
+        b[20] = ROL64X4(st[2], 62);
+        b[14] = ROL64X4(st[20], 18);
+        b[22] = ROL64X4(st[14], 39);
+        b[9] = ROL64X4(st[22], 61);
+        b[6] = ROL64X4(st[9], 20);
+        b[1] = ROL64X4(st[6], 44);
+
+        //  Chi
+        for (j = 0; j < 25; j += 5) {
+            for (i = 0; i < 5; i++)
+                st[j + i] = _mm256_xor_si256(b[j + i], _mm256_andnot_si256(b[j + (i + 1) % 5], b[j + (i + 2) % 5]));
+        }
+
+        //  Iota
+        st[0] = _mm256_xor_si256(st[0], _mm256_set1_epi64x(keccakf_rndc[round]));
+    }
+}
+
+static AVX2 __m256i load64x4(const uint8_t *p0, const uint8_t *p1, const uint8_t *p2, const uint8_t *p3)
+{
+    uint64_t w0, w1, w2, w3;
+    memcpy(&w0, p0, 8);
+    memcpy(&w1, p1, 8);
+    memcpy(&w2, p2, 8);
+    memcpy(&w3, p3, 8);
+    return _mm256_set_epi64x(w3, w2, w1, w0);
+}
+
+// four inputs whose lengths are the same number of whole rate blocks plus
+// a partial one, rsiz no larger than the padding buffer
+static AVX2 void keccak_x4_avx2(const uint8_t *const *in, const size_t *inlen, uint8_t *md, int mdlen, size_t rsiz)
+{
+    __m256i st[25];
+    uint8_t temp[4][144];
+    uint64_t lanes[4] __attribute__((aligned(32)));
+    const size_t rsizw = rsiz / 8;
+    const size_t absorbed = inlen[0] / rsiz * rsiz;
+    size_t i, k, off;
+
+    for (i = 0; i < 25; i++)
+        st[i] = _mm256_setzero_si256();
+
+    for (off = 0; off < absorbed; off += rsiz) {
+        for (i = 0; i < rsizw; i++)
+            st[i] = _mm256_xor_si256(st[i], load64x4(in[0] + off + 8 * i, in[1] + off + 8 * i, in[2] + off + 8 * i, in[3] + off + 8 * i));
+        keccakf_x4_avx2(st, KECCAK_ROUNDS);
+    }
+
+    // last block and padding
+    for (k = 0; k < 4; k++) {
+        const size_t rest = inlen[k] - absorbed;
+        memcpy(temp[k], in[k] + absorbed, rest);
+        temp[k][rest] = 1;
+        memset(temp[k] + rest + 1, 0, rsiz - rest - 1);
+        temp[k][rsiz - 1] |= 0x80;
+    }
+
+    for (i = 0; i < rsizw; i++)
+        st[i] = _mm256_xor_si256(st[i], load64x4(temp[0] + 8 * i, temp[1] + 8 * i, temp[2] + 8 * i, temp[3] + 8 * i));
+
+    keccakf_x4_avx2(st, KECCAK_ROUNDS);
+
+    for (i = 0; i < (size_t)mdlen / 8; i++) {
+        _mm256_store_si256((__m256i *) lanes, st[i]);
+        for (k = 0; k < 4; k++)
+            memcpy(md + k * mdlen + 8 * i, &lanes[k], 8);
+    }
+}
+
+static int keccak_avx2_supported(void)
+{
+    static volatile int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported;
+}
+
+static void keccak_multi_avx2(const uint8_t *const *in, const size_t *inlen, size_t n, uint8_t *md, int mdlen)
+{
+    // the digest sizes in use, both with the 136 byte rate
+    const size_t rsiz = HASH_DATA_AREA;
+    size_t i = 0;
+    if (mdlen == HASH_SIZE || (size_t)mdlen == sizeof(state_t)) {
+        for (; i + 4 <= n; i += 4) {
+            const size_t blocks = inlen[i] / rsiz;
+            if (inlen[i + 1] / rsiz == blocks && inlen[i + 2] / rsiz == blocks && inlen[i + 3] / rsiz == blocks)
+                keccak_x4_avx2(in + i, inlen + i, md + i * mdlen, mdlen, rsiz);
+            else
+                keccak_multi_portable(in + i, inlen + i, 4, md + i * mdlen, mdlen);
+        }
+    }
+    keccak_multi_portable(in + i, inlen + i, n - i, md + i * mdlen, mdlen);
+}
+
+#endif
+
+int keccak_backend_supported(int backend)
+{
+    switch (backend) {
+    case KECCAK_BACKEND_PORTABLE:
+        return 1;
+#if KECCAK_HAVE_AVX2
+    case KECCAK_BACKEND_AVX2:
+        return keccak_avx2_supported();
+#endif
+    default:
+        return 0;
+    }
+}
+
+void keccak_multi_backend(int backend, const uint8_t *const *in, const size_t *inlen, size_t n, uint8_t *md, int mdlen)
+{
+#if KECCAK_HAVE_AVX2
+    if (backend == KECCAK_BACKEND_AVX2 && keccak_avx2_supported()) {
+        keccak_multi_avx2(in, inlen, n, md, mdlen);
+        return;
+    }
+#endif
+    keccak_multi_portable(in, inlen, n, md, mdlen);
+}
+
+void keccak_multi(const uint8_t *const *in, const size_t *inlen, size_t n, uint8_t *md, int mdlen)
+{
+    keccak_multi_backend(n >= 4 ? KECCAK_BACKEND_AVX2 : KECCAK_BACKEND_PORTABLE, in, inlen, n, md, mdlen);
+}
+
 #define KECCAK_FINALIZED 0x80000000
 #define KECCAK_BLOCKLEN 136
 #define KECCAK_WORDS 17
@@ -34,6 +34,14 @@ void keccakf(uint64_t st[25], int norounds);
 
 void keccak1600(const uint8_t *in, size_t inlen, uint8_t *md);
 
+// compute keccak hashes of n inputs into n consecutive digests of mdlen
+// bytes, several at a time where the CPU has wide enough vectors
+#define KECCAK_BACKEND_PORTABLE 0
+#define KECCAK_BACKEND_AVX2 1
+void keccak_multi(const uint8_t *const *in, const size_t *inlen, size_t n, uint8_t *md, int mdlen);
+void keccak_multi_backend(int backend, const uint8_t *const *in, const size_t *inlen, size_t n, uint8_t *md, int mdlen);
+int keccak_backend_supported(int backend);
+
 void keccak_init(KECCAK_CTX * ctx);
 void keccak_update(KECCAK_CTX * ctx, const uint8_t *in, size_t inlen);
 void keccak_finish(KECCAK_CTX * ctx, uint8_t *md);
@@ -33,6 +33,7 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "chacha.h"
 #include "hash-ops.h"
 #include "initializer.h"
 #include "random.h"
@@ -66,6 +67,7 @@ static void generate_system_random_bytes(size_t n, void *result) {
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <pthread.h>
 #include <unistd.h>
 
 static void generate_system_random_bytes(size_t n, void *result) {
@@ -98,6 +100,16 @@ static void generate_system_random_bytes(size_t n, void *result) {
 
 static union hash_state state;
 
+/* Bumped in the child after a fork, so per-thread generators inherited from
+ * the parent reseed instead of repeating its output. */
+static volatile unsigned fork_generation = 1;
+
+#if !defined(_WIN32)
+static void random_fork_child(void) {
+  ++fork_generation;
+}
+#endif
+
 #if !defined(NDEBUG)
 static volatile int curstate; /* To catch thread safety problems. */
 #endif
@@ -113,6 +125,9 @@ FINALIZER(deinit_random) {
 INITIALIZER(init_random) {
   generate_system_random_bytes(32, &state);
   REGISTER_FINALIZER(deinit_random);
+#if !defined(_WIN32)
+  pthread_atfork(NULL, NULL, random_fork_child);
+#endif
 #if !defined(NDEBUG)
   assert(curstate == 0);
   curstate = 1;
@@ -147,3 +162,65 @@ void generate_random_bytes_not_thread_safe(size_t n, void *result) {
     }
   }
 }
+
+/* Per-thread generator: ChaCha20 keystream, with the key replaced by the
+ * first 32 bytes of each block so past output can't be recovered from the
+ * state. The key is seeded from the OS, then mixed with fresh OS bytes every
+ * RANDOM_RESEED_BYTES of output and in the child after a fork. */
+#define RANDOM_BLOCK_SIZE 512
+#define RANDOM_RESEED_BYTES (1024 * 1024)
+
+struct thread_random_state {
+  uint8_t key[CHACHA_KEY_SIZE];
+  uint8_t block[RANDOM_BLOCK_SIZE];
+  size_t available; /* unread bytes at the end of block */
+  size_t since_reseed;
+  unsigned generation; /* fork_generation when last seeded, 0 if never */
+};
+
+static __thread struct thread_random_state thread_state;
+
+static void refill_thread_random(struct thread_random_state *s) {
+  static const uint8_t zero[RANDOM_BLOCK_SIZE];
+  static const uint8_t iv[CHACHA_IV_SIZE];
+  size_t i;
+  if (s->generation != fork_generation || s->since_reseed >= RANDOM_RESEED_BYTES) {
+    uint8_t seed[CHACHA_KEY_SIZE];
+    generate_system_random_bytes(sizeof(seed), seed);
+    for (i = 0; i < sizeof(seed); ++i) {
+      s->key[i] ^= seed[i];
+    }
+    memset(seed, 0, sizeof(seed));
+    s->generation = fork_generation;
+    s->since_reseed = 0;
+  }
+  /* each key is used for one block only, so the iv can stay constant */
+  chacha20(zero, RANDOM_BLOCK_SIZE, s->key, iv, (char *) s->block);
+  memcpy(s->key, s->block, CHACHA_KEY_SIZE);
+  memset(s->block, 0, CHACHA_KEY_SIZE);
+  s->available = RANDOM_BLOCK_SIZE - CHACHA_KEY_SIZE;
+  s->since_reseed += RANDOM_BLOCK_SIZE;
+}
+
+void generate_random_bytes_thread_local(size_t n, void *result) {
+  struct thread_random_state *s = &thread_state;
+  if (s->generation != fork_generation) {
+    /* output buffered before a fork must not be handed out twice */
+    memset(s->block, 0, sizeof(s->block));
+    s->available = 0;
+  }
+  while (n > 0) {
+    size_t chunk;
+    uint8_t *src;
+    if (s->available == 0) {
+      refill_thread_random(s);
+    }
+    chunk = n < s->available ? n : s->available;
+    src = s->block + RANDOM_BLOCK_SIZE - s->available;
+    memcpy(result, src, chunk);
+    memset(src, 0, chunk);
+    result = padd(result, chunk);
+    n -= chunk;
+    s->available -= chunk;
+  }
+}
@@ -34,3 +34,7 @@
 #include <stddef.h>
 
 void generate_random_bytes_not_thread_safe(size_t n, void *result);
+
+/* Safe to call from any thread without locking: each thread has its own
+ * ChaCha20 state, seeded from the OS and reseeded after a fork. */
+void generate_random_bytes_thread_local(size_t n, void *result);
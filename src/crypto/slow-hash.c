@@ -240,6 +240,15 @@ extern int aesb_pseudo_round(const uint8_t *in, uint8_t *out, const uint8_t *exp
 #else
 #include <wmmintrin.h>
 #include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+#endif
 #define STATIC static
 #define INLINE inline
 #if !defined(RDATA_ALIGN16)
@@ -327,8 +336,43 @@ union cn_slow_hash_state
 };
 #pragma pack(pop)
 
+struct scratchpad_alloc
+{
+    int mapped; // from the OS rather than malloc
+    int pages; // SLOW_HASH_PAGES_*
+    int numa_node; // -1 if not bound to a node
+};
+
 THREADV uint8_t *hp_state = NULL;
-THREADV int hp_allocated = 0;
+THREADV struct scratchpad_alloc hp_info;
+// scratchpads for the extra ways of cn_slow_hash_multi, hp_state is the first
+THREADV uint8_t *hp_state_ways[CN_SLOW_HASH_MAX_WAYS - 1] = { NULL };
+THREADV struct scratchpad_alloc hp_ways_info[CN_SLOW_HASH_MAX_WAYS - 1];
+
+// scratchpads currently allocated by all threads, by SLOW_HASH_PAGES_* type
+static volatile int64_t scratchpad_counts[SLOW_HASH_PAGES_HUGE + 1];
+static volatile int64_t scratchpad_numa_bound;
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#define ATOMIC_ADD64(p, v) InterlockedExchangeAdd64((volatile LONG64 *)(p), (v))
+#else
+#define ATOMIC_ADD64(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#endif
+
+STATIC INLINE void slow_hash_stats_add(const struct scratchpad_alloc *info, int64_t delta)
+{
+    ATOMIC_ADD64(&scratchpad_counts[info->pages], delta);
+    if(info->numa_node >= 0)
+        ATOMIC_ADD64(&scratchpad_numa_bound, delta);
+}
+
+void slow_hash_get_allocation_stats(struct slow_hash_allocation_stats *stats)
+{
+    stats->small_pages = ATOMIC_ADD64(&scratchpad_counts[SLOW_HASH_PAGES_SMALL], 0);
+    stats->transparent_huge_pages = ATOMIC_ADD64(&scratchpad_counts[SLOW_HASH_PAGES_TRANSPARENT], 0);
+    stats->huge_pages = ATOMIC_ADD64(&scratchpad_counts[SLOW_HASH_PAGES_HUGE], 0);
+    stats->numa_bound = ATOMIC_ADD64(&scratchpad_numa_bound, 0);
+}
 
 #if defined(_MSC_VER)
 #define cpuid(info,x)    __cpuidex(info,x,0)
@@ -599,6 +643,113 @@ BOOL SetLockPagesPrivilege(HANDLE hProcess, BOOL bEnable)
 }
 #endif
 
+/**
+ * @brief allocate a 2MB scratch buffer using OS support for huge pages, if available
+ *
+ * Tries a reserved 2MB huge page first, then (on Linux) a 2MB aligned mapping
+ * with transparent huge pages requested, then malloc. On Linux the buffer is
+ * bound to the NUMA node of the calling thread, and every page is touched so
+ * it is committed here on that node rather than during the first hash.
+ *
+ * @param info set to how the buffer was allocated
+ * @return the buffer, or NULL if allocation failed
+ */
+
+static uint8_t *allocate_scratchpad(struct scratchpad_alloc *info)
+{
+    uint8_t *state = NULL;
+    size_t i;
+
+    info->mapped = 0;
+    info->pages = SLOW_HASH_PAGES_SMALL;
+    info->numa_node = -1;
+
+#if defined(_MSC_VER) || defined(__MINGW32__)
+    SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
+    state = (uint8_t *) VirtualAlloc(NULL, MEMORY, MEM_LARGE_PAGES |
+                                     MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if(state != NULL)
+        info->pages = SLOW_HASH_PAGES_HUGE;
+#else
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
+  defined(__DragonFly__) || defined(__NetBSD__)
+    state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANON, 0, 0);
+#else
+    state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
+    if(state != MAP_FAILED)
+        info->pages = SLOW_HASH_PAGES_HUGE;
+#if defined(__linux__)
+    else
+    {
+        // no reserved huge pages, map twice the size to cut a 2MB aligned
+        // range out of, so the kernel can back it with a transparent huge page
+        uint8_t *base = mmap(0, 2 * MEMORY, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+        if(base != MAP_FAILED)
+        {
+            const size_t head = (MEMORY - ((uintptr_t) base & (MEMORY - 1))) & (MEMORY - 1);
+            if(head)
+                munmap(base, head);
+            munmap(base + head + MEMORY, MEMORY - head);
+            state = base + head;
+            if(madvise(state, MEMORY, MADV_HUGEPAGE) == 0)
+                info->pages = SLOW_HASH_PAGES_TRANSPARENT;
+        }
+    }
+#endif
+#endif
+    if(state == MAP_FAILED)
+        state = NULL;
+#endif
+    info->mapped = 1;
+    if(state == NULL)
+    {
+        info->mapped = 0;
+        info->pages = SLOW_HASH_PAGES_SMALL;
+        state = (uint8_t *) malloc(MEMORY);
+        if(state == NULL)
+            return NULL;
+    }
+
+#if defined(__linux__) && defined(SYS_getcpu) && defined(SYS_mbind)
+    if(info->mapped)
+    {
+        // prefer the node this thread runs on, pages still come from
+        // elsewhere if that node has no memory left
+        unsigned cpu, node;
+        if(syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < 64)
+        {
+            const unsigned long nodemask = 1ul << node;
+            if(syscall(SYS_mbind, state, MEMORY, MPOL_PREFERRED, &nodemask, 64, 0) == 0)
+                info->numa_node = node;
+        }
+    }
+#endif
+
+    for(i = 0; i < MEMORY; i += 4096)
+        state[i] = 0;
+
+    slow_hash_stats_add(info, 1);
+    return state;
+}
+
+static void free_scratchpad(uint8_t *state, const struct scratchpad_alloc *info)
+{
+    slow_hash_stats_add(info, -1);
+    if(!info->mapped)
+        free(state);
+    else
+    {
+#if defined(_MSC_VER) || defined(__MINGW32__)
+        VirtualFree(state, 0, MEM_RELEASE);
+#else
+        munmap(state, MEMORY);
+#endif
+    }
+}
+
 /**
  * @brief allocate the 2MB scratch buffer using OS support for huge pages, if available
  *
@@ -616,52 +767,63 @@ void slow_hash_allocate_state(void)
     if(hp_state != NULL)
         return;
 
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
-    hp_state = (uint8_t *) VirtualAlloc(hp_state, MEMORY, MEM_LARGE_PAGES |
-                                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
-#else
-#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
-  defined(__DragonFly__) || defined(__NetBSD__)
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANON, 0, 0);
-#else
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
-#endif
-    if(hp_state == MAP_FAILED)
-        hp_state = NULL;
-#endif
-    hp_allocated = 1;
+    hp_state = allocate_scratchpad(&hp_info);
+}
+
+/**
+ * @brief allocate up front the scratchpads cn_slow_hash_multi needs for ways hashes
+ *
+ * @return the number of ways that have a scratchpad
+ */
+
+size_t slow_hash_allocate_state_multi(size_t ways)
+{
+    size_t w;
+
+    slow_hash_allocate_state();
     if(hp_state == NULL)
+        return 0;
+    for(w = 1; w < ways && w < CN_SLOW_HASH_MAX_WAYS; w++)
     {
-        hp_allocated = 0;
-        hp_state = (uint8_t *) malloc(MEMORY);
+        if(hp_state_ways[w - 1] == NULL)
+            hp_state_ways[w - 1] = allocate_scratchpad(&hp_ways_info[w - 1]);
+        if(hp_state_ways[w - 1] == NULL)
+            break;
     }
+    return w;
 }
 
 /**
- *@brief frees the state allocated by slow_hash_allocate_state
+ *@brief frees the state allocated by slow_hash_allocate_state, and any cn_slow_hash_multi scratchpads
  */
 
 void slow_hash_free_state(void)
 {
-    if(hp_state == NULL)
-        return;
+    size_t i;
 
-    if(!hp_allocated)
-        free(hp_state);
-    else
+    for(i = 0; i < CN_SLOW_HASH_MAX_WAYS - 1; i++)
     {
-#if defined(_MSC_VER) || defined(__MINGW32__)
-        VirtualFree(hp_state, 0, MEM_RELEASE);
-#else
-        munmap(hp_state, MEMORY);
-#endif
+        if(hp_state_ways[i] == NULL)
+            continue;
+        free_scratchpad(hp_state_ways[i], &hp_ways_info[i]);
+        hp_state_ways[i] = NULL;
     }
 
+    if(hp_state == NULL)
+        return;
+
+    free_scratchpad(hp_state, &hp_info);
     hp_state = NULL;
-    hp_allocated = 0;
+}
+
+/**
+ * @brief reports how the calling thread's scratchpad was allocated
+ */
+
+void slow_hash_get_state_info(struct slow_hash_state_info *info)
+{
+    info->pages = hp_state ? hp_info.pages : SLOW_HASH_PAGES_NONE;
+    info->numa_node = hp_state ? hp_info.numa_node : -1;
 }
 
 /**
@@ -830,6 +992,169 @@ void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int
     extra_hashes[state.hs.b[0] & 3](&state, 200, hash);
 }
 
+
+/*
+ * State of one of the independent hashes computed by cn_slow_hash_multi.
+ * _b and _b1 hold what cn_slow_hash keeps in registers across iterations.
+ */
+struct cn_slow_hash_way
+{
+    union cn_slow_hash_state state;
+    uint8_t *hp_state;
+    RDATA_ALIGN16 uint64_t a[2];
+    RDATA_ALIGN16 uint64_t b[4];
+    RDATA_ALIGN16 uint64_t c[2];
+    __m128i _b, _b1;
+    uint64_t tweak1_2;
+    uint64_t division_result;
+    uint64_t sqrt_result;
+};
+
+/* CryptoNight steps 1 and 2 for one way, with hardware AES */
+STATIC INLINE void cn_slow_hash_way_init(struct cn_slow_hash_way *way, const void *data, size_t length, int variant)
+{
+    RDATA_ALIGN16 uint8_t expandedKey[240];
+    uint8_t text[INIT_SIZE_BYTE];
+    uint64_t *b = way->b;
+    union cn_slow_hash_state state;
+    size_t i;
+
+    hash_process(&state.hs, data, length);
+    memcpy(text, state.init, INIT_SIZE_BYTE);
+
+    VARIANT1_INIT64();
+    VARIANT2_INIT64();
+    way->tweak1_2 = tweak1_2;
+    way->division_result = division_result;
+    way->sqrt_result = sqrt_result;
+
+    aes_expand_key(state.hs.b, expandedKey);
+    for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+    {
+        aes_pseudo_round(text, text, expandedKey, INIT_SIZE_BLK);
+        memcpy(&way->hp_state[i * INIT_SIZE_BYTE], text, INIT_SIZE_BYTE);
+    }
+
+    U64(way->a)[0] = U64(&state.k[0])[0] ^ U64(&state.k[32])[0];
+    U64(way->a)[1] = U64(&state.k[0])[1] ^ U64(&state.k[32])[1];
+    U64(b)[0] = U64(&state.k[16])[0] ^ U64(&state.k[48])[0];
+    U64(b)[1] = U64(&state.k[16])[1] ^ U64(&state.k[48])[1];
+    way->_b = _mm_load_si128(R128(b));
+    way->_b1 = _mm_load_si128(R128(b) + 1);
+
+    memcpy(&way->state, &state, sizeof(state));
+}
+
+/* one iteration of CryptoNight step 3 for one way, with hardware AES */
+STATIC INLINE void cn_slow_hash_way_round(struct cn_slow_hash_way *way, int variant)
+{
+    uint8_t *hp_state = way->hp_state;
+    uint64_t *a = way->a;
+    uint64_t *b = way->b;
+    uint64_t *c = way->c;
+    const uint64_t tweak1_2 = way->tweak1_2;
+    uint64_t division_result = way->division_result;
+    uint64_t sqrt_result = way->sqrt_result;
+    __m128i _a, _b = way->_b, _b1 = way->_b1, _c;
+    uint64_t hi, lo;
+    size_t j;
+    uint64_t *p = NULL;
+
+    pre_aes();
+    _c = _mm_aesenc_si128(_c, _a);
+    post_aes();
+
+    way->_b = _b;
+    way->_b1 = _b1;
+    way->division_result = division_result;
+    way->sqrt_result = sqrt_result;
+}
+
+/* CryptoNight steps 4 and 5 for one way, with hardware AES */
+STATIC INLINE void cn_slow_hash_way_finish(struct cn_slow_hash_way *way, char *hash)
+{
+    RDATA_ALIGN16 uint8_t expandedKey[240];
+    uint8_t text[INIT_SIZE_BYTE];
+    size_t i;
+
+    static void (*const extra_hashes[4])(const void *, size_t, char *) =
+    {
+        hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
+    };
+
+    memcpy(text, way->state.init, INIT_SIZE_BYTE);
+    aes_expand_key(&way->state.hs.b[32], expandedKey);
+    for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+        aes_pseudo_round_xor(text, text, expandedKey, &way->hp_state[i * INIT_SIZE_BYTE], INIT_SIZE_BLK);
+
+    memcpy(way->state.init, text, INIT_SIZE_BYTE);
+    hash_permutation(&way->state.hs);
+    extra_hashes[way->state.hs.b[0] & 3](&way->state, 200, hash);
+}
+
+/*
+ * Step 3 for all ways, one iteration of each in turn. The ways do not
+ * depend on each other, so the CPU overlaps their scratchpad accesses
+ * instead of stalling on each one. Called with a constant number of ways
+ * so the inner loop gets unrolled.
+ */
+STATIC INLINE void cn_slow_hash_ways_mix(struct cn_slow_hash_way *ways, size_t n, int variant)
+{
+    size_t i, w;
+
+    for(i = 0; i < ITER / 2; i++)
+        for(w = 0; w < n; w++)
+            cn_slow_hash_way_round(&ways[w], variant);
+}
+
+/**
+ * @brief computes several CryptoNight hashes at once, interleaving their scratchpads
+ *
+ * Gives the same hashes as n calls to cn_slow_hash, using one 2MB scratchpad
+ * per hash. The main loop of a single hash is bound by the latency of its
+ * random scratchpad accesses, so running two to four independent hashes on
+ * one thread gets more hashes per second out of a core, as long as the
+ * scratchpads fit in its share of the cache. Without hardware AES the
+ * hashes are computed one after the other.
+ *
+ * @param data the data to hash, one pointer per hash
+ * @param length the length in bytes of each data
+ * @param n the number of hashes, at most CN_SLOW_HASH_MAX_WAYS
+ * @param hash a buffer for n consecutive 256 bit hashes
+ * @param variant the CryptoNight variant, the same for all hashes
+ */
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t n, char *hash, int variant)
+{
+    struct cn_slow_hash_way ways[CN_SLOW_HASH_MAX_WAYS];
+    size_t w;
+    int useAes = !force_software_aes() && check_aes_hw();
+
+    assert(n <= CN_SLOW_HASH_MAX_WAYS);
+
+    if(n < 2 || !useAes || slow_hash_allocate_state_multi(n) < n)
+    {
+        for(w = 0; w < n; w++)
+            cn_slow_hash(data[w], length[w], hash + w * HASH_SIZE, variant, 0);
+        return;
+    }
+
+    for(w = 0; w < n; w++)
+    {
+        ways[w].hp_state = w ? hp_state_ways[w - 1] : hp_state;
+        cn_slow_hash_way_init(&ways[w], data[w], length[w], variant);
+    }
+
+    switch(n)
+    {
+        case 2: cn_slow_hash_ways_mix(ways, 2, variant); break;
+        case 3: cn_slow_hash_ways_mix(ways, 3, variant); break;
+        default: cn_slow_hash_ways_mix(ways, 4, variant); break;
+    }
+
+    for(w = 0; w < n; w++)
+        cn_slow_hash_way_finish(&ways[w], hash + w * HASH_SIZE);
+}
+
 #elif !defined NO_AES && (defined(__arm__) || defined(__aarch64__))
 void slow_hash_allocate_state(void)
 {
@@ -843,6 +1168,32 @@ void slow_hash_free_state(void)
   return;
 }
 
+size_t slow_hash_allocate_state_multi(size_t ways)
+{
+  // As above
+  return ways < CN_SLOW_HASH_MAX_WAYS ? ways : CN_SLOW_HASH_MAX_WAYS;
+}
+
+void slow_hash_get_state_info(struct slow_hash_state_info *info)
+{
+  // The scratchpad is allocated per hash here
+  info->pages = SLOW_HASH_PAGES_NONE;
+  info->numa_node = -1;
+}
+
+void slow_hash_get_allocation_stats(struct slow_hash_allocation_stats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t n, char *hash, int variant)
+{
+  // No interleaved implementation here, hash one after the other
+  size_t i;
+  for (i = 0; i < n; ++i)
+    cn_slow_hash(data[i], length[i], hash + i * HASH_SIZE, variant, 0);
+}
+
 #if defined(__GNUC__)
 #define RDATA_ALIGN16 __attribute__ ((aligned(16)))
 #define STATIC static
@@ -1405,6 +1756,32 @@ void slow_hash_free_state(void)
   return;
 }
 
+size_t slow_hash_allocate_state_multi(size_t ways)
+{
+  // As above
+  return ways < CN_SLOW_HASH_MAX_WAYS ? ways : CN_SLOW_HASH_MAX_WAYS;
+}
+
+void slow_hash_get_state_info(struct slow_hash_state_info *info)
+{
+  // The scratchpad is allocated per hash here
+  info->pages = SLOW_HASH_PAGES_NONE;
+  info->numa_node = -1;
+}
+
+void slow_hash_get_allocation_stats(struct slow_hash_allocation_stats *stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+void cn_slow_hash_multi(const void *const *data, const size_t *length, size_t n, char *hash, int variant)
+{
+  // No interleaved implementation here, hash one after the other
+  size_t i;
+  for (i = 0; i < n; ++i)
+    cn_slow_hash(data[i], length[i], hash + i * HASH_SIZE, variant, 0);
+}
+
 static void (*const extra_hashes[4])(const void *, size_t, char *) = {
   hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
 };
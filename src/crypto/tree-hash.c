@@ -68,6 +68,26 @@ size_t tree_hash_cnt(size_t count) {
 	return pow >> 1;
 }
 
+/***
+* Hash pairs of nodes into the level above, several pairs per call to
+* cn_fast_hash_multi. out may alias in as long as it does not run ahead of
+* it, each pair is read before the nodes after it are written.
+*/
+static void tree_hash_pairs(const char (*in)[HASH_SIZE], size_t pairs, char (*out)[HASH_SIZE]) {
+  enum { CHUNK = 16 };
+  const void *data[CHUNK];
+  size_t length[CHUNK];
+  size_t i, j;
+  for (i = 0; i < pairs; i += CHUNK) {
+    const size_t n = pairs - i < CHUNK ? pairs - i : CHUNK;
+    for (j = 0; j < n; ++j) {
+      data[j] = in[2 * (i + j)];
+      length[j] = 2 * HASH_SIZE;
+    }
+    cn_fast_hash_multi(data, length, n, out[i]);
+  }
+}
+
 void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
 // The blockchain block at height 202612 https://moneroblocks.info/block/202612
 // contained 514 transactions, that triggered bad calculation of variable "cnt" in the original version of this function
@@ -88,8 +108,6 @@ void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
   } else if (count == 2) {
     cn_fast_hash(hashes, 2 * HASH_SIZE, root_hash);
   } else {
-    size_t i, j;
-
     size_t cnt = tree_hash_cnt( count );
 
     char (*ints)[HASH_SIZE];
@@ -98,18 +116,86 @@ void tree_hash(const char (*hashes)[HASH_SIZE], size_t count, char *root_hash) {
 
     memcpy(ints, hashes, (2 * cnt - count) * HASH_SIZE);
 
-    for (i = 2 * cnt - count, j = 2 * cnt - count; j < cnt; i += 2, ++j) {
-      cn_fast_hash(hashes[i], 64, ints[j]);
-    }
-    assert(i == count);
+    tree_hash_pairs(hashes + (2 * cnt - count), count - cnt, ints + (2 * cnt - count));
 
     while (cnt > 2) {
       cnt >>= 1;
-      for (i = 0, j = 0; j < cnt; i += 2, ++j) {
-        cn_fast_hash(ints[i], 64, ints[j]);
-      }
+      tree_hash_pairs(ints, cnt, ints);
     }
 
     cn_fast_hash(ints[0], 64, root_hash);
   }
 }
+
+/***
+* Number of siblings on the path from the first leaf (the miner tx) to the root
+*/
+size_t tree_depth(size_t count) {
+  size_t depth = 0;
+  assert(count > 0);
+  if (count == 1)
+    return 0;
+  if (count == 2)
+    return 1;
+  size_t cnt = tree_hash_cnt( count );
+  if (2 * cnt == count)
+    ++depth; // the first leaf is hashed with the second one instead of being copied
+  for (; cnt > 1; cnt >>= 1)
+    ++depth;
+  return depth;
+}
+
+/***
+* Fill branch with the tree_depth(count) siblings of the first leaf, bottom up.
+* The first leaf itself is not read, so a template can compute the branch once
+* and rebuild the root with tree_hash_from_branch whenever the miner tx changes.
+*/
+void tree_branch(const char (*hashes)[HASH_SIZE], size_t count, char (*branch)[HASH_SIZE]) {
+  assert(count > 0);
+  if (count == 1) {
+    return;
+  } else if (count == 2) {
+    memcpy(branch[0], hashes[1], HASH_SIZE);
+  } else {
+    size_t depth = 0;
+
+    size_t cnt = tree_hash_cnt( count );
+
+    char (*ints)[HASH_SIZE];
+    size_t ints_size = cnt * HASH_SIZE;
+    ints = alloca(ints_size); 	memset( ints , 0 , ints_size);
+
+    if (2 * cnt == count) {
+      memcpy(branch[depth++], hashes[1], HASH_SIZE);
+    } else {
+      memcpy(ints + 1, hashes + 1, (2 * cnt - count - 1) * HASH_SIZE);
+    }
+
+    if (2 * cnt == count) {
+      tree_hash_pairs(hashes + 2, cnt - 1, ints + 1);
+    } else {
+      tree_hash_pairs(hashes + (2 * cnt - count), count - cnt, ints + (2 * cnt - count));
+    }
+
+    // ints[0] depends on the first leaf, its value is never used
+    while (cnt > 2) {
+      memcpy(branch[depth++], ints[1], HASH_SIZE);
+      cnt >>= 1;
+      tree_hash_pairs(ints + 2, cnt - 1, ints + 1);
+    }
+
+    memcpy(branch[depth++], ints[1], HASH_SIZE);
+    assert(depth == tree_depth(count));
+  }
+}
+
+void tree_hash_from_branch(const char (*branch)[HASH_SIZE], size_t depth, const char *leaf, char *root_hash) {
+  char buffer[2 * HASH_SIZE];
+  size_t i;
+  memcpy(root_hash, leaf, HASH_SIZE);
+  for (i = 0; i < depth; ++i) {
+    memcpy(buffer, root_hash, HASH_SIZE);
+    memcpy(buffer + HASH_SIZE, branch[i], HASH_SIZE);
+    cn_fast_hash(buffer, 2 * HASH_SIZE, root_hash);
+  }
+}
@@ -37,6 +37,7 @@
 #include <cstring>  // memcmp
 #include <sstream>
 #include <atomic>
+#include <memory>
 #include "serialization/variant.h"
 #include "serialization/vector.h"
 #include "serialization/binary_archive.h"
@@ -185,7 +186,22 @@ namespace cryptonote
   private:
     // hash cash
     mutable std::atomic<bool> hash_valid;
+    mutable std::atomic<bool> prunable_hash_valid;
     mutable std::atomic<bool> blob_size_valid;
+    mutable std::atomic<bool> weight_valid;
+
+  public:
+    // extra as last parsed, kept with the bytes it was parsed from so
+    // any change to extra is noticed without hooking every writer
+    struct parsed_extra_t
+    {
+      std::vector<uint8_t> extra;
+      std::vector<tx_extra_field> fields;
+      bool ok;
+    };
+
+  private:
+    mutable std::shared_ptr<const parsed_extra_t> parsed_extra;
 
   public:
     std::vector<std::vector<crypto::signature> > signatures; //count signatures  always the same as inputs count
@@ -193,24 +209,40 @@ namespace cryptonote
 
     // hash cash
     mutable crypto::hash hash;
+    mutable crypto::hash prunable_hash;
     mutable size_t blob_size;
+    mutable uint64_t weight;
 
     transaction();
-    transaction(const transaction &t): transaction_prefix(t), hash_valid(false), blob_size_valid(false), signatures(t.signatures), rct_signatures(t.rct_signatures) { if (t.is_hash_valid()) { hash = t.hash; set_hash_valid(true); } if (t.is_blob_size_valid()) { blob_size = t.blob_size; set_blob_size_valid(true); } }
-    transaction &operator=(const transaction &t) { transaction_prefix::operator=(t); set_hash_valid(false); set_blob_size_valid(false); signatures = t.signatures; rct_signatures = t.rct_signatures; if (t.is_hash_valid()) { hash = t.hash; set_hash_valid(true); } if (t.is_blob_size_valid()) { blob_size = t.blob_size; set_blob_size_valid(true); } return *this; }
+    transaction(const transaction &t): transaction_prefix(t), hash_valid(false), prunable_hash_valid(false), blob_size_valid(false), weight_valid(false), signatures(t.signatures), rct_signatures(t.rct_signatures) { copy_cached_data(t); }
+    transaction(transaction &&t): transaction_prefix(std::move(t)), hash_valid(false), prunable_hash_valid(false), blob_size_valid(false), weight_valid(false), signatures(std::move(t.signatures)), rct_signatures(std::move(t.rct_signatures)) { copy_cached_data(t); t.invalidate_hashes(); }
+    transaction &operator=(const transaction &t) { if (&t == this) return *this; transaction_prefix::operator=(t); signatures = t.signatures; rct_signatures = t.rct_signatures; copy_cached_data(t); return *this; }
+    transaction &operator=(transaction &&t) { if (&t == this) return *this; transaction_prefix::operator=(std::move(t)); signatures = std::move(t.signatures); rct_signatures = std::move(t.rct_signatures); copy_cached_data(t); t.invalidate_hashes(); return *this; }
     virtual ~transaction();
     void set_null();
     void invalidate_hashes();
     bool is_hash_valid() const { return hash_valid.load(std::memory_order_acquire); }
     void set_hash_valid(bool v) const { hash_valid.store(v,std::memory_order_release); }
+    bool is_prunable_hash_valid() const { return prunable_hash_valid.load(std::memory_order_acquire); }
+    void set_prunable_hash_valid(bool v) const { prunable_hash_valid.store(v,std::memory_order_release); }
     bool is_blob_size_valid() const { return blob_size_valid.load(std::memory_order_acquire); }
     void set_blob_size_valid(bool v) const { blob_size_valid.store(v,std::memory_order_release); }
+    bool is_weight_valid() const { return weight_valid.load(std::memory_order_acquire); }
+    void set_weight_valid(bool v) const { weight_valid.store(v,std::memory_order_release); }
+    void set_hash(const crypto::hash &h) const { hash = h; set_hash_valid(true); }
+    void set_prunable_hash(const crypto::hash &h) const { prunable_hash = h; set_prunable_hash_valid(true); }
+    void set_blob_size(size_t sz) const { blob_size = sz; set_blob_size_valid(true); }
+    void set_weight(uint64_t w) const { weight = w; set_weight_valid(true); }
+    std::shared_ptr<const parsed_extra_t> get_parsed_extra() const { return std::atomic_load(&parsed_extra); }
+    void set_parsed_extra(std::shared_ptr<const parsed_extra_t> p) const { std::atomic_store(&parsed_extra, std::move(p)); }
 
     BEGIN_SERIALIZE_OBJECT()
       if (!typename Archive<W>::is_saving())
       {
         set_hash_valid(false);
+        set_prunable_hash_valid(false);
         set_blob_size_valid(false);
+        set_weight_valid(false);
       }
 
       FIELDS(*static_cast<transaction_prefix *>(this))
@@ -253,7 +285,7 @@ namespace cryptonote
         {
           ar.begin_object();
           bool r = rct_signatures.serialize_rctsig_base(ar, vin.size(), vout.size());
-          if (!r || !ar.stream().good()) return false;
+          if (!r || !ar.good()) return false;
           ar.end_object();
           if (rct_signatures.type != rct::RCTTypeNull)
           {
@@ -261,7 +293,7 @@ namespace cryptonote
             ar.begin_object();
             r = rct_signatures.p.serialize_rctsig_prunable(ar, rct_signatures.type, vin.size(), vout.size(),
                 vin.size() > 0 && vin[0].type() == typeid(txin_to_key) ? boost::get<txin_to_key>(vin[0]).key_offsets.size() - 1 : 0);
-            if (!r || !ar.stream().good()) return false;
+            if (!r || !ar.good()) return false;
             ar.end_object();
           }
         }
@@ -283,7 +315,7 @@ namespace cryptonote
         {
           ar.begin_object();
           bool r = rct_signatures.serialize_rctsig_base(ar, vin.size(), vout.size());
-          if (!r || !ar.stream().good()) return false;
+          if (!r || !ar.good()) return false;
           ar.end_object();
         }
       }
@@ -292,6 +324,23 @@ namespace cryptonote
 
   private:
     static size_t get_signature_size(const txin_v& tx_in);
+
+    void copy_cached_data(const transaction &t)
+    {
+      set_hash_valid(false);
+      set_prunable_hash_valid(false);
+      set_blob_size_valid(false);
+      set_weight_valid(false);
+      if (t.is_hash_valid())
+        set_hash(t.hash);
+      if (t.is_prunable_hash_valid())
+        set_prunable_hash(t.prunable_hash);
+      if (t.is_blob_size_valid())
+        set_blob_size(t.blob_size);
+      if (t.is_weight_valid())
+        set_weight(t.weight);
+      set_parsed_extra(t.get_parsed_extra());
+    }
   };
 
 
@@ -318,14 +367,19 @@ namespace cryptonote
     signatures.clear();
     rct_signatures.type = rct::RCTTypeNull;
     set_hash_valid(false);
+    set_prunable_hash_valid(false);
     set_blob_size_valid(false);
+    set_weight_valid(false);
+    set_parsed_extra(nullptr);
   }
 
   inline
   void transaction::invalidate_hashes()
   {
     set_hash_valid(false);
+    set_prunable_hash_valid(false);
     set_blob_size_valid(false);
+    set_weight_valid(false);
   }
 
   inline
@@ -374,6 +428,8 @@ namespace cryptonote
     block(): block_header(), hash_valid(false) {}
     block(const block &b): block_header(b), hash_valid(false), miner_tx(b.miner_tx), tx_hashes(b.tx_hashes) { if (b.is_hash_valid()) { hash = b.hash; set_hash_valid(true); } }
     block &operator=(const block &b) { block_header::operator=(b); hash_valid = false; miner_tx = b.miner_tx; tx_hashes = b.tx_hashes; if (b.is_hash_valid()) { hash = b.hash; set_hash_valid(true); } return *this; }
+    block(block &&b): block_header(std::move(b)), hash_valid(false), miner_tx(std::move(b.miner_tx)), tx_hashes(std::move(b.tx_hashes)) { if (b.is_hash_valid()) { hash = b.hash; set_hash_valid(true); } b.invalidate_hashes(); }
+    block &operator=(block &&b) { if (&b == this) return *this; block_header::operator=(std::move(b)); hash_valid = false; miner_tx = std::move(b.miner_tx); tx_hashes = std::move(b.tx_hashes); if (b.is_hash_valid()) { hash = b.hash; set_hash_valid(true); } b.invalidate_hashes(); return *this; }
     void invalidate_hashes() { set_hash_valid(false); }
     bool is_hash_valid() const { return hash_valid.load(std::memory_order_acquire); }
     void set_hash_valid(bool v) const { hash_valid.store(v,std::memory_order_release); }
@@ -395,6 +451,40 @@ namespace cryptonote
   };
 
 
+  /************************************************************************/
+  /* Compact per block index, for wallets scanning through a remote node  */
+  /************************************************************************/
+  struct tx_filter_entry
+  {
+    crypto::hash tx_hash;
+    crypto::public_key tx_pub_key; // null_pkey if the tx has none
+    std::vector<crypto::public_key> additional_tx_pub_keys;
+    std::vector<crypto::public_key> output_keys; // null_pkey for outputs not to a key
+    std::vector<crypto::key_image> key_images;
+
+    BEGIN_SERIALIZE()
+      FIELD(tx_hash)
+      FIELD(tx_pub_key)
+      FIELD(additional_tx_pub_keys)
+      FIELD(output_keys)
+      FIELD(key_images)
+    END_SERIALIZE()
+  };
+
+  struct block_filter
+  {
+    uint8_t version;
+    crypto::hash block_hash;
+    std::vector<tx_filter_entry> txs; // miner tx first, then in block order
+
+    BEGIN_SERIALIZE()
+      VARINT_FIELD(version)
+      FIELD(block_hash)
+      FIELD(txs)
+    END_SERIALIZE()
+  };
+
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
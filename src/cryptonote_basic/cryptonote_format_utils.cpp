@@ -33,6 +33,8 @@
 using namespace epee;
 
 #include <atomic>
+#include <unordered_set>
+#include <boost/thread/mutex.hpp>
 #include <boost/algorithm/string.hpp>
 #include "wipeable_string.h"
 #include "string_tools.h"
@@ -81,6 +83,28 @@ static std::atomic<uint64_t> tx_hashes_calculated_count(0);
 static std::atomic<uint64_t> tx_hashes_cached_count(0);
 static std::atomic<uint64_t> block_hashes_calculated_count(0);
 static std::atomic<uint64_t> block_hashes_cached_count(0);
+static std::atomic<uint64_t> tx_prunable_hashes_calculated_count(0);
+static std::atomic<uint64_t> tx_prunable_hashes_cached_count(0);
+
+// audit mode: remember what was hashed, and count the hashes computed again
+// for the same data because the cached value had been lost on the way
+#define TX_HASH_AUDIT_MAX_ENTRIES (1 << 18)
+static std::atomic<bool> tx_hash_audit_enabled(false);
+static boost::mutex tx_hash_audit_lock;
+static std::unordered_set<crypto::hash> tx_hash_audit_seen[2];
+static std::atomic<uint64_t> tx_hash_audit_redundant[2];
+
+static void audit_tx_hash(size_t kind, const crypto::hash &h)
+{
+  if (!tx_hash_audit_enabled.load(std::memory_order_relaxed))
+    return;
+  boost::unique_lock<boost::mutex> lock(tx_hash_audit_lock);
+  std::unordered_set<crypto::hash> &seen = tx_hash_audit_seen[kind];
+  if (!seen.insert(h).second)
+    ++tx_hash_audit_redundant[kind];
+  else if (seen.size() > TX_HASH_AUDIT_MAX_ENTRIES)
+    seen.clear();
+}
 
 #define CHECK_AND_ASSERT_THROW_MES_L1(expr, message) {if(!(expr)) {MWARNING(message); throw std::runtime_error(message);}}
 
@@ -179,21 +203,18 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     CHECK_AND_ASSERT_MES(expand_transaction_1(tx, false), false, "Failed to expand transaction data");
     tx.invalidate_hashes();
+    tx.set_blob_size(tx_blob.size());
     return true;
   }
   //---------------------------------------------------------------
   bool parse_and_validate_tx_base_from_blob(const blobdata& tx_blob, transaction& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = tx.serialize_base(ba);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     CHECK_AND_ASSERT_MES(expand_transaction_1(tx, true), false, "Failed to expand transaction data");
@@ -202,9 +223,7 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_tx_prefix_from_blob(const blobdata& tx_blob, transaction_prefix& tx)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = ::serialization::serialize_noeof(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction prefix from blob");
     return true;
@@ -212,13 +231,12 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_tx_from_blob(const blobdata& tx_blob, transaction& tx, crypto::hash& tx_hash, crypto::hash& tx_prefix_hash)
   {
-    std::stringstream ss;
-    ss << tx_blob;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(tx_blob)};
     bool r = ::serialization::serialize(ba, tx);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse transaction from blob");
     CHECK_AND_ASSERT_MES(expand_transaction_1(tx, false), false, "Failed to expand transaction data");
     tx.invalidate_hashes();
+    tx.set_blob_size(tx_blob.size());
     //TODO: validate tx
 
     get_transaction_hash(tx, tx_hash);
@@ -357,7 +375,7 @@ namespace cryptonote
     return string_tools::get_xtype_from_string(amount, str_amount);
   }
   //---------------------------------------------------------------
-  uint64_t get_transaction_weight(const transaction &tx, size_t blob_size)
+  static uint64_t calculate_transaction_weight(const transaction &tx, size_t blob_size)
   {
     if (tx.version < 2)
       return blob_size;
@@ -379,13 +397,31 @@ namespace cryptonote
     return blob_size + bp_clawback;
   }
   //---------------------------------------------------------------
+  uint64_t get_transaction_weight(const transaction &tx, size_t blob_size)
+  {
+    // only the blob size the tx was parsed from or serialized to is cached,
+    // callers may pass the size of some other encoding
+    const bool cacheable = tx.is_blob_size_valid() && tx.blob_size == blob_size;
+    if (cacheable && tx.is_weight_valid())
+      return tx.weight;
+    const uint64_t weight = calculate_transaction_weight(tx, blob_size);
+    if (cacheable)
+      tx.set_weight(weight);
+    return weight;
+  }
+  //---------------------------------------------------------------
   uint64_t get_transaction_weight(const transaction &tx)
   {
-    std::ostringstream s;
-    binary_archive<true> a(s);
-    ::serialization::serialize(a, const_cast<transaction&>(tx));
-    const cryptonote::blobdata blob = s.str();
-    return get_transaction_weight(tx, blob.size());
+    if (tx.is_weight_valid())
+      return tx.weight;
+    return get_transaction_weight(tx, get_transaction_blob_size(tx));
+  }
+  //---------------------------------------------------------------
+  size_t get_transaction_blob_size(const transaction &tx)
+  {
+    if (!tx.is_blob_size_valid())
+      tx.set_blob_size(get_object_blobsize(tx));
+    return tx.blob_size;
   }
   //---------------------------------------------------------------
   bool get_tx_fee(const transaction& tx, uint64_t & fee)
@@ -418,6 +454,53 @@ namespace cryptonote
     return r;
   }
   //---------------------------------------------------------------
+  // The layouts wallets write: a tx pubkey, a nonce and additional pubkeys,
+  // with lengths small enough for a one byte varint. Returns false for
+  // anything else, malformed or not, which then gets the full parse.
+  static bool parse_tx_extra_fast(const std::vector<uint8_t>& tx_extra, std::vector<tx_extra_field>& tx_extra_fields)
+  {
+    const uint8_t *p = tx_extra.data(), *end = p + tx_extra.size();
+    while (p < end)
+    {
+      const uint8_t tag = *p++;
+      if (tag == TX_EXTRA_TAG_PUBKEY)
+      {
+        if ((size_t)(end - p) < sizeof(crypto::public_key))
+          return false;
+        tx_extra_pub_key pub_key;
+        memcpy(&pub_key.pub_key, p, sizeof(crypto::public_key));
+        p += sizeof(crypto::public_key);
+        tx_extra_fields.push_back(pub_key);
+      }
+      else if (tag == TX_EXTRA_NONCE)
+      {
+        if (p == end || *p >= 0x80 || (size_t)(end - p - 1) < *p)
+          return false;
+        const size_t size = *p++;
+        tx_extra_nonce nonce;
+        nonce.nonce.assign(reinterpret_cast<const char*>(p), size);
+        p += size;
+        tx_extra_fields.push_back(std::move(nonce));
+      }
+      else if (tag == TX_EXTRA_TAG_ADDITIONAL_PUBKEYS)
+      {
+        if (p == end || *p >= 0x80 || (size_t)(end - p - 1) / sizeof(crypto::public_key) < *p)
+          return false;
+        const size_t count = *p++;
+        tx_extra_additional_pub_keys additional_pub_keys;
+        additional_pub_keys.data.resize(count);
+        memcpy(additional_pub_keys.data.data(), p, count * sizeof(crypto::public_key));
+        p += count * sizeof(crypto::public_key);
+        tx_extra_fields.push_back(std::move(additional_pub_keys));
+      }
+      else
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+  //---------------------------------------------------------------
   bool parse_tx_extra(const std::vector<uint8_t>& tx_extra, std::vector<tx_extra_field>& tx_extra_fields)
   {
     tx_extra_fields.clear();
@@ -425,9 +508,11 @@ namespace cryptonote
     if(tx_extra.empty())
       return true;
 
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
-    binary_archive<false> ar(iss);
+    if (parse_tx_extra_fast(tx_extra, tx_extra_fields))
+      return true;
+    tx_extra_fields.clear();
+
+    binary_archive<false> ar{epee::to_span(tx_extra)};
 
     bool eof = false;
     while (!eof)
@@ -437,15 +522,32 @@ namespace cryptonote
       CHECK_AND_NO_ASSERT_MES_L1(r, false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
       tx_extra_fields.push_back(field);
 
-      std::ios_base::iostate state = iss.rdstate();
-      eof = (EOF == iss.peek());
-      iss.clear(state);
+      eof = ar.remaining_bytes() == 0;
     }
     CHECK_AND_NO_ASSERT_MES_L1(::serialization::check_stream_state(ar), false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
 
     return true;
   }
   //---------------------------------------------------------------
+  static std::shared_ptr<const transaction::parsed_extra_t> get_parsed_extra(const transaction& tx)
+  {
+    std::shared_ptr<const transaction::parsed_extra_t> parsed = tx.get_parsed_extra();
+    if (parsed && parsed->extra == tx.extra)
+      return parsed;
+    std::shared_ptr<transaction::parsed_extra_t> fresh = std::make_shared<transaction::parsed_extra_t>();
+    fresh->extra = tx.extra;
+    fresh->ok = parse_tx_extra(tx.extra, fresh->fields);
+    tx.set_parsed_extra(fresh);
+    return fresh;
+  }
+  //---------------------------------------------------------------
+  bool parse_tx_extra(const transaction& tx, std::vector<tx_extra_field>& tx_extra_fields)
+  {
+    const std::shared_ptr<const transaction::parsed_extra_t> parsed = get_parsed_extra(tx);
+    tx_extra_fields = parsed->fields;
+    return parsed->ok;
+  }
+  //---------------------------------------------------------------
   crypto::public_key get_tx_pub_key_from_extra(const std::vector<uint8_t>& tx_extra, size_t pk_index)
   {
     std::vector<tx_extra_field> tx_extra_fields;
@@ -465,7 +567,11 @@ namespace cryptonote
   //---------------------------------------------------------------
   crypto::public_key get_tx_pub_key_from_extra(const transaction& tx, size_t pk_index)
   {
-    return get_tx_pub_key_from_extra(tx.extra, pk_index);
+    tx_extra_pub_key pub_key_field;
+    if(!find_tx_extra_field_by_type(get_parsed_extra(tx)->fields, pub_key_field, pk_index))
+      return null_pkey;
+
+    return pub_key_field.pub_key;
   }
   //---------------------------------------------------------------
   bool add_tx_pub_key_to_extra(transaction& tx, const crypto::public_key& tx_pub_key)
@@ -503,6 +609,14 @@ namespace cryptonote
     return get_additional_tx_pub_keys_from_extra(tx.extra);
   }
   //---------------------------------------------------------------
+  std::vector<crypto::public_key> get_additional_tx_pub_keys_from_extra(const transaction& tx)
+  {
+    tx_extra_additional_pub_keys additional_pub_keys;
+    if(!find_tx_extra_field_by_type(get_parsed_extra(tx)->fields, additional_pub_keys))
+      return {};
+    return additional_pub_keys.data;
+  }
+  //---------------------------------------------------------------
   bool add_additional_tx_pub_keys_to_extra(std::vector<uint8_t>& tx_extra, const std::vector<crypto::public_key>& additional_pub_keys)
   {
     // convert to variant
@@ -540,9 +654,7 @@ namespace cryptonote
   {
     if (tx_extra.empty())
       return true;
-    std::string extra_str(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size());
-    std::istringstream iss(extra_str);
-    binary_archive<false> ar(iss);
+    binary_archive<false> ar{epee::to_span(tx_extra)};
     std::ostringstream oss;
     binary_archive<true> newar(oss);
 
@@ -555,9 +667,7 @@ namespace cryptonote
       if (field.type() != type)
         ::do_serialize(newar, field);
 
-      std::ios_base::iostate state = iss.rdstate();
-      eof = (EOF == iss.peek());
-      iss.clear(state);
+      eof = ar.remaining_bytes() == 0;
     }
     CHECK_AND_NO_ASSERT_MES_L1(::serialization::check_stream_state(ar), false, "failed to deserialize extra field. extra = " << string_tools::buff_to_hex_nodelimer(std::string(reinterpret_cast<const char*>(tx_extra.data()), tx_extra.size())));
     tx_extra.clear();
@@ -857,8 +967,16 @@ namespace cryptonote
   //---------------------------------------------------------------
   crypto::hash get_transaction_prunable_hash(const transaction& t)
   {
+    if (t.is_prunable_hash_valid())
+    {
+      ++tx_prunable_hashes_cached_count;
+      return t.prunable_hash;
+    }
+    ++tx_prunable_hashes_calculated_count;
     crypto::hash res;
     CHECK_AND_ASSERT_THROW_MES(calculate_transaction_prunable_hash(t, res), "Failed to calculate tx prunable hash");
+    audit_tx_hash(1, res);
+    t.set_prunable_hash(res);
     return res;
   }
   //---------------------------------------------------------------
@@ -927,9 +1045,17 @@ namespace cryptonote
     {
       hashes[2] = crypto::null_hash;
     }
+    else if (t.is_prunable_hash_valid())
+    {
+      ++tx_prunable_hashes_cached_count;
+      hashes[2] = t.prunable_hash;
+    }
     else
     {
+      ++tx_prunable_hashes_calculated_count;
       CHECK_AND_ASSERT_MES(calculate_transaction_prunable_hash(t, hashes[2]), false, "Failed to get tx prunable hash");
+      audit_tx_hash(1, hashes[2]);
+      t.set_prunable_hash(hashes[2]);
     }
 
     // the tx hash is the hash of the 3 hashes
@@ -937,7 +1063,7 @@ namespace cryptonote
 
     // we still need the size
     if (blob_size)
-      *blob_size = get_object_blobsize(t);
+      *blob_size = get_transaction_blob_size(t);
 
     return true;
   }
@@ -952,12 +1078,7 @@ namespace cryptonote
       res = t.hash;
       if (blob_size)
       {
-        if (!t.is_blob_size_valid())
-        {
-          t.blob_size = get_object_blobsize(t);
-          t.set_blob_size_valid(true);
-        }
-        *blob_size = t.blob_size;
+        *blob_size = get_transaction_blob_size(t);
       }
       ++tx_hashes_cached_count;
       return true;
@@ -966,13 +1087,10 @@ namespace cryptonote
     bool ret = calculate_transaction_hash(t, res, blob_size);
     if (!ret)
       return false;
-    t.hash = res;
-    t.set_hash_valid(true);
+    audit_tx_hash(0, res);
+    t.set_hash(res);
     if (blob_size)
-    {
-      t.blob_size = *blob_size;
-      t.set_blob_size_valid(true);
-    }
+      t.set_blob_size(*blob_size);
     return true;
   }
   //---------------------------------------------------------------
@@ -981,15 +1099,24 @@ namespace cryptonote
     return get_transaction_hash(t, res, &blob_size);
   }
   //---------------------------------------------------------------
-  blobdata get_block_hashing_blob(const block& b)
+  static blobdata get_block_hashing_blob(const block& b, const crypto::hash& tree_root_hash)
   {
     blobdata blob = t_serializable_object_to_blob(static_cast<block_header>(b));
-    crypto::hash tree_root_hash = get_tx_tree_hash(b);
     blob.append(reinterpret_cast<const char*>(&tree_root_hash), sizeof(tree_root_hash));
     blob.append(tools::get_varint_data(b.tx_hashes.size()+1));
     return blob;
   }
   //---------------------------------------------------------------
+  blobdata get_block_hashing_blob(const block& b)
+  {
+    return get_block_hashing_blob(b, get_tx_tree_hash(b));
+  }
+  //---------------------------------------------------------------
+  blobdata get_block_hashing_blob(const block& b, const std::vector<crypto::hash>& tx_tree_branch)
+  {
+    return get_block_hashing_blob(b, get_tx_tree_hash(get_transaction_hash(b.miner_tx), tx_tree_branch));
+  }
+  //---------------------------------------------------------------
   bool calculate_block_hash(const block& b, crypto::hash& res)
   {
     bool hash_result = get_object_hash(get_block_hashing_blob(b), res);
@@ -1023,20 +1150,95 @@ namespace cryptonote
     return p;
   }
   //---------------------------------------------------------------
-  bool get_block_longhash(const block& b, crypto::hash& res, uint64_t height)
+  static void fill_tx_filter_entry(const transaction& tx, const crypto::hash& tx_hash, tx_filter_entry& entry)
+  {
+    entry.tx_hash = tx_hash;
+    entry.tx_pub_key = get_tx_pub_key_from_extra(tx);
+    entry.additional_tx_pub_keys = get_additional_tx_pub_keys_from_extra(tx);
+    entry.output_keys.clear();
+    entry.output_keys.reserve(tx.vout.size());
+    for (const auto &o: tx.vout)
+      entry.output_keys.push_back(o.target.type() == typeid(txout_to_key) ? boost::get<txout_to_key>(o.target).key : null_pkey);
+    entry.key_images.clear();
+    for (const auto &in: tx.vin)
+      if (in.type() == typeid(txin_to_key))
+        entry.key_images.push_back(boost::get<txin_to_key>(in).k_image);
+  }
+  //---------------------------------------------------------------
+  bool make_block_filter(const block& b, const std::vector<transaction>& txs, block_filter& filter)
+  {
+    CHECK_AND_ASSERT_MES(txs.size() == b.tx_hashes.size(), false, "Block has " << b.tx_hashes.size() << " txes, got " << txs.size());
+    filter.version = 1;
+    filter.block_hash = get_block_hash(b);
+    filter.txs.resize(txs.size() + 1);
+    fill_tx_filter_entry(b.miner_tx, get_transaction_hash(b.miner_tx), filter.txs[0]);
+    for (size_t i = 0; i < txs.size(); ++i)
+      fill_tx_filter_entry(txs[i], b.tx_hashes[i], filter.txs[i + 1]);
+    return true;
+  }
+  //---------------------------------------------------------------
+  blobdata make_block_filter_blob(const block& b, const std::vector<transaction>& txs)
+  {
+    block_filter filter;
+    if (!make_block_filter(b, txs, filter))
+      return blobdata();
+    return t_serializable_object_to_blob(filter);
+  }
+  //---------------------------------------------------------------
+  static int get_block_longhash_variant(const block_header& b)
   {
-    blobdata bd = get_block_hashing_blob(b);
     int cn_variant = 0;
     if (b.major_version >= 9) {
       cn_variant = 2;
     } else if (b.major_version >= 6) {
       cn_variant = 1;
     }
-
-    crypto::cn_slow_hash(bd.data(), bd.size(), res, cn_variant);
+    return cn_variant;
+  }
+  //---------------------------------------------------------------
+  bool get_block_longhash(const block& b, crypto::hash& res, uint64_t height)
+  {
+    blobdata bd = get_block_hashing_blob(b);
+    crypto::cn_slow_hash(bd.data(), bd.size(), res, get_block_longhash_variant(b));
+    return true;
+  }
+  //---------------------------------------------------------------
+  void get_block_longhash_from_hashing_blob(const blobdata& hashing_blob, const block_header& header, crypto::hash& res)
+  {
+    crypto::cn_slow_hash(hashing_blob.data(), hashing_blob.size(), res, get_block_longhash_variant(header));
+  }
+  //---------------------------------------------------------------
+  bool parse_block_header_from_hashing_blob(const blobdata& hashing_blob, block_header& header)
+  {
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(hashing_blob)};
+    bool r = ::serialization::serialize_noeof(ba, header);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from hashing blob");
     return true;
   }
   //---------------------------------------------------------------
+  void get_block_longhashes(const std::vector<const block*>& blocks, std::vector<crypto::hash>& res, size_t ways, const std::vector<crypto::hash>* tx_tree_branch)
+  {
+    ways = std::max<size_t>(1, std::min<size_t>(ways, crypto::CN_SLOW_HASH_MAX_WAYS));
+    res.resize(blocks.size());
+    std::vector<blobdata> bd(ways);
+    const void *data[crypto::CN_SLOW_HASH_MAX_WAYS];
+    size_t length[crypto::CN_SLOW_HASH_MAX_WAYS];
+    for (size_t i = 0; i < blocks.size(); )
+    {
+      // all blocks hashed together must use the same variant
+      const int cn_variant = get_block_longhash_variant(*blocks[i]);
+      size_t n = 0;
+      for (; n < ways && i + n < blocks.size() && get_block_longhash_variant(*blocks[i + n]) == cn_variant; ++n)
+      {
+        bd[n] = tx_tree_branch ? get_block_hashing_blob(*blocks[i + n], *tx_tree_branch) : get_block_hashing_blob(*blocks[i + n]);
+        data[n] = bd[n].data();
+        length[n] = bd[n].size();
+      }
+      crypto::cn_slow_hash_multi(data, length, n, &res[i], cn_variant);
+      i += n;
+    }
+  }
+  //---------------------------------------------------------------
   std::vector<uint64_t> relative_output_offsets_to_absolute(const std::vector<uint64_t>& off)
   {
     std::vector<uint64_t> res = off;
@@ -1066,9 +1268,12 @@ namespace cryptonote
   //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b)
   {
-    std::stringstream ss;
-    ss << b_blob;
-    binary_archive<false> ba(ss);
+    return parse_and_validate_block_from_blob(epee::span<const uint8_t>(reinterpret_cast<const uint8_t*>(b_blob.data()), b_blob.size()), b);
+  }
+  //---------------------------------------------------------------
+  bool parse_and_validate_block_from_blob(const epee::span<const uint8_t>& b_blob, block& b)
+  {
+    binary_archive<false> ba{b_blob};
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
     b.invalidate_hashes();
@@ -1120,6 +1325,24 @@ namespace cryptonote
     return get_tx_tree_hash(txs_ids);
   }
   //---------------------------------------------------------------
+  void get_tx_tree_branch(const block& b, std::vector<crypto::hash>& branch)
+  {
+    // the miner tx leaf is not part of its own branch, leave it null
+    std::vector<crypto::hash> txs_ids;
+    txs_ids.reserve(b.tx_hashes.size() + 1);
+    txs_ids.push_back(null_hash);
+    txs_ids.insert(txs_ids.end(), b.tx_hashes.begin(), b.tx_hashes.end());
+    branch.resize(tree_depth(txs_ids.size()));
+    tree_branch(txs_ids.data(), txs_ids.size(), branch.data());
+  }
+  //---------------------------------------------------------------
+  crypto::hash get_tx_tree_hash(const crypto::hash& miner_tx_hash, const std::vector<crypto::hash>& branch)
+  {
+    crypto::hash h = null_hash;
+    tree_hash_from_branch(branch.data(), branch.size(), miner_tx_hash, h);
+    return h;
+  }
+  //---------------------------------------------------------------
   bool is_valid_decomposed_amount(uint64_t amount)
   {
     const uint64_t *begin = valid_decomposed_outputs;
@@ -1135,6 +1358,30 @@ namespace cryptonote
     block_hashes_cached = block_hashes_cached_count;
   }
   //---------------------------------------------------------------
+  void get_prunable_hash_stats(uint64_t &prunable_hashes_calculated, uint64_t &prunable_hashes_cached)
+  {
+    prunable_hashes_calculated = tx_prunable_hashes_calculated_count;
+    prunable_hashes_cached = tx_prunable_hashes_cached_count;
+  }
+  //---------------------------------------------------------------
+  void set_tx_hash_audit(bool enabled)
+  {
+    boost::unique_lock<boost::mutex> lock(tx_hash_audit_lock);
+    tx_hash_audit_enabled = enabled;
+    if (!enabled)
+    {
+      for (auto &seen: tx_hash_audit_seen)
+        seen.clear();
+    }
+  }
+  //---------------------------------------------------------------
+  bool get_tx_hash_audit_stats(uint64_t &tx_hashes_redundant, uint64_t &prunable_hashes_redundant)
+  {
+    tx_hashes_redundant = tx_hash_audit_redundant[0];
+    prunable_hashes_redundant = tx_hash_audit_redundant[1];
+    return tx_hash_audit_enabled;
+  }
+  //---------------------------------------------------------------
   crypto::secret_key encrypt_key(crypto::secret_key key, const epee::wipeable_string &passphrase)
   {
     crypto::hash hash;
@@ -35,6 +35,7 @@
 #include "account.h"
 #include "subaddress_index.h"
 #include "include_base_utils.h"
+#include "span.h"
 #include "crypto/crypto.h"
 #include "crypto/hash.h"
 #include <unordered_map>
@@ -66,6 +67,7 @@ namespace cryptonote
   }
 
   bool parse_tx_extra(const std::vector<uint8_t>& tx_extra, std::vector<tx_extra_field>& tx_extra_fields);
+  bool parse_tx_extra(const transaction& tx, std::vector<tx_extra_field>& tx_extra_fields);
   crypto::public_key get_tx_pub_key_from_extra(const std::vector<uint8_t>& tx_extra, size_t pk_index = 0);
   crypto::public_key get_tx_pub_key_from_extra(const transaction_prefix& tx, size_t pk_index = 0);
   crypto::public_key get_tx_pub_key_from_extra(const transaction& tx, size_t pk_index = 0);
@@ -74,6 +76,7 @@ namespace cryptonote
   bool add_tx_pub_key_to_extra(std::vector<uint8_t>& tx_extra, const crypto::public_key& tx_pub_key);
   std::vector<crypto::public_key> get_additional_tx_pub_keys_from_extra(const std::vector<uint8_t>& tx_extra);
   std::vector<crypto::public_key> get_additional_tx_pub_keys_from_extra(const transaction_prefix& tx);
+  std::vector<crypto::public_key> get_additional_tx_pub_keys_from_extra(const transaction& tx);
   bool add_additional_tx_pub_keys_to_extra(std::vector<uint8_t>& tx_extra, const std::vector<crypto::public_key>& additional_pub_keys);
   bool add_extra_nonce_to_tx_extra(std::vector<uint8_t>& tx_extra, const blobdata& extra_nonce);
   bool remove_field_from_tx_extra(std::vector<uint8_t>& tx_extra, const std::type_info &type);
@@ -108,12 +111,24 @@ namespace cryptonote
   crypto::hash get_pruned_transaction_hash(const transaction& t, const crypto::hash &pruned_data_hash);
 
   blobdata get_block_hashing_blob(const block& b);
+  // same blob, with the tx tree root rebuilt from a branch made by get_tx_tree_branch
+  blobdata get_block_hashing_blob(const block& b, const std::vector<crypto::hash>& tx_tree_branch);
   bool calculate_block_hash(const block& b, crypto::hash& res);
   bool get_block_hash(const block& b, crypto::hash& res);
   crypto::hash get_block_hash(const block& b);
   bool get_block_longhash(const block& b, crypto::hash& res, uint64_t height);
   crypto::hash get_block_longhash(const block& b, uint64_t height);
+  // the same hash, from a blob made by get_block_hashing_blob and the header it starts with
+  void get_block_longhash_from_hashing_blob(const blobdata& hashing_blob, const block_header& header, crypto::hash& res);
+  bool parse_block_header_from_hashing_blob(const blobdata& hashing_blob, block_header& header);
+  // hashes the blocks in groups of up to ways, interleaving their scratchpads on this thread
+  // if tx_tree_branch is given, all blocks must have the same tx_hashes it was made from
+  void get_block_longhashes(const std::vector<const block*>& blocks, std::vector<crypto::hash>& res, size_t ways = 2, const std::vector<crypto::hash>* tx_tree_branch = NULL);
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b);
+  // parses straight from the given bytes, eg a view into the db map, without copying them
+  bool parse_and_validate_block_from_blob(const epee::span<const uint8_t>& b_blob, block& b);
+  bool make_block_filter(const block& b, const std::vector<transaction>& txs, block_filter& filter);
+  blobdata make_block_filter_blob(const block& b, const std::vector<transaction>& txs);
   bool get_inputs_money_amount(const transaction& tx, uint64_t& money);
   uint64_t get_outs_money_amount(const transaction& tx);
   bool check_inputs_types_supported(const transaction& tx);
@@ -121,6 +136,7 @@ namespace cryptonote
   bool parse_amount(uint64_t& amount, const std::string& str_amount);
   uint64_t get_transaction_weight(const transaction &tx);
   uint64_t get_transaction_weight(const transaction &tx, size_t blob_size);
+  size_t get_transaction_blob_size(const transaction &tx);
 
   bool check_money_overflow(const transaction& tx);
   bool check_outs_overflow(const transaction& tx);
@@ -177,11 +193,12 @@ namespace cryptonote
   template <typename T>
   std::string obj_to_json_str(T& obj)
   {
-    std::stringstream ss;
+    std::string s;
+    json_string_ostream ss(s);
     json_archive<true> ar(ss, true);
     bool r = ::serialization::serialize(ar, obj);
     CHECK_AND_ASSERT_MES(r, "", "obj_to_json_str failed: serialization::serialize returned false");
-    return ss.str();
+    return s;
   }
   //---------------------------------------------------------------
   // 62387455827 -> 455827 + 7000000 + 80000000 + 300000000 + 2000000000 + 60000000000, where 455827 <= dust_threshold
@@ -233,8 +250,14 @@ namespace cryptonote
   void get_tx_tree_hash(const std::vector<crypto::hash>& tx_hashes, crypto::hash& h);
   crypto::hash get_tx_tree_hash(const std::vector<crypto::hash>& tx_hashes);
   crypto::hash get_tx_tree_hash(const block& b);
+  // siblings of the miner tx leaf, so the root can be rebuilt in log(n) hashes when only the miner tx changes
+  void get_tx_tree_branch(const block& b, std::vector<crypto::hash>& branch);
+  crypto::hash get_tx_tree_hash(const crypto::hash& miner_tx_hash, const std::vector<crypto::hash>& branch);
   bool is_valid_decomposed_amount(uint64_t amount);
   void get_hash_stats(uint64_t &tx_hashes_calculated, uint64_t &tx_hashes_cached, uint64_t &block_hashes_calculated, uint64_t & block_hashes_cached);
+  void get_prunable_hash_stats(uint64_t &prunable_hashes_calculated, uint64_t &prunable_hashes_cached);
+  void set_tx_hash_audit(bool enabled);
+  bool get_tx_hash_audit_stats(uint64_t &tx_hashes_redundant, uint64_t &prunable_hashes_redundant);
 
   crypto::secret_key encrypt_key(crypto::secret_key key, const epee::wipeable_string &passphrase);
   crypto::secret_key decrypt_key(crypto::secret_key key, const epee::wipeable_string &passphrase);
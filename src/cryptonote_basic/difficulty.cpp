@@ -121,26 +121,23 @@ namespace cryptonote {
     return !carry;
   }
 
-  difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds, uint8_t version) {
+  difficulty_type next_difficulty(const std::uint64_t *timestamps_in, const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds, uint8_t version) {
 
     size_t difficultyWindow = version >= 6 ? DIFFICULTY_WINDOW_V6_OLD : DIFFICULTY_WINDOW;
 
-    if(timestamps.size() > difficultyWindow)
-    {
-      timestamps.resize(difficultyWindow);
-      cumulative_difficulties.resize(difficultyWindow);
-    }
-
+    if(length > difficultyWindow)
+      length = difficultyWindow;
 
-    size_t length = timestamps.size();
-    assert(length == cumulative_difficulties.size());
     if (length <= 1) {
       return 1;
     }
     static_assert(DIFFICULTY_WINDOW >= 2, "Window is too small");
     static_assert(DIFFICULTY_WINDOW_V6_OLD >= 2, "Window is too small");
     assert(length <= difficultyWindow);
-    sort(timestamps.begin(), timestamps.end());
+    // sorted copy on the stack, the input is left alone
+    uint64_t timestamps[DIFFICULTY_WINDOW > DIFFICULTY_WINDOW_V6_OLD ? DIFFICULTY_WINDOW : DIFFICULTY_WINDOW_V6_OLD];
+    std::copy(timestamps_in, timestamps_in + length, timestamps);
+    std::sort(timestamps, timestamps + length);
     size_t cut_begin, cut_end;
     static_assert(2 * DIFFICULTY_CUT <= DIFFICULTY_WINDOW - 2, "Cut length is too large");
     static_assert(2 * DIFFICULTY_CUT <= DIFFICULTY_WINDOW_V6_OLD - 2, "Cut length is too large");
@@ -168,7 +165,7 @@ namespace cryptonote {
     return (low + time_span - 1) / time_span;
   }
 
-  difficulty_type next_difficulty_v2(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
+  difficulty_type next_difficulty_v2(const std::uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds) {
 
     // LWMA difficulty algorithm
     // Copyright (c) 2017-2018 Zawy
@@ -184,12 +181,7 @@ namespace cryptonote {
     const int64_t T = static_cast<int64_t>(target_seconds);
     size_t N = DIFFICULTY_WINDOW_V6;
 
-    if (timestamps.size() > N) {
-      timestamps.resize(N + 1);
-      cumulative_difficulties.resize(N + 1);
-    }
-    size_t n = timestamps.size();
-    assert(n == cumulative_difficulties.size());
+    size_t n = length > N ? N + 1 : length;
     assert(n <= DIFFICULTY_WINDOW_V6);
     // If new coin, just "give away" first 5 blocks at low difficulty
     if ( n < 6 ) { return  1; }
@@ -234,8 +226,8 @@ namespace cryptonote {
 // and most recent element (Nth one) is most recently solved block.
 
 // difficulty_type should be uint64_t
-difficulty_type next_difficulty_v3(std::vector<uint64_t> timestamps, 
-    std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
+difficulty_type next_difficulty_v3(const uint64_t *timestamps,
+    const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds) {
  
     int64_t  T = DIFFICULTY_TARGET;
     int64_t  N = DIFFICULTY_WINDOW_V6 -1; // N=45, 60, and 90 for T=600, 120, 60.
@@ -276,21 +268,20 @@ difficulty_type next_difficulty_v3(std::vector<uint64_t> timestamps,
 // See commented version for required config file changes. Fix your FTL and MTP.
 
 // difficulty_type should be uint64_t
-difficulty_type next_difficulty_v9(std::vector<uint64_t> timestamps, 
-    std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds) {
+difficulty_type next_difficulty_v9(const uint64_t *timestamps,
+    const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds) {
     
     uint64_t  T = DIFFICULTY_TARGET;
     uint64_t  N = DIFFICULTY_WINDOW_V9; // N=45, 60, and 90 for T=600, 120, 60.
     uint64_t  L(0), ST, sum_3_ST(0), next_D, prev_D, this_timestamp, previous_timestamp;
         
-     assert(timestamps.size() == cumulative_difficulties.size() && 
-                     timestamps.size() <= N+1 );
+     assert(length <= N+1);
 
     // If it's a new coin, do startup code. 
     // Increase difficulty_guess if it needs to be much higher, but guess lower than lowest guess.
     uint64_t difficulty_guess = 100; 
-    if (timestamps.size() <= 10 ) {   return difficulty_guess;   }
-    if ( timestamps.size() < N +1 ) { N = timestamps.size()-1;  }
+    if (length <= 10 ) {   return difficulty_guess;   }
+    if ( length < N +1 ) { N = length-1;  }
     
     // If hashrate/difficulty ratio after a fork is < 1/3 prior ratio, hardcode D for N+1 blocks after fork. 
     // difficulty_guess = 100; //  Dev may change.  Guess low.
@@ -316,4 +307,73 @@ difficulty_type next_difficulty_v9(std::vector<uint64_t> timestamps,
 
     return next_D;
   }
+
+  difficulty_type next_difficulty(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds, uint8_t version) {
+    assert(timestamps.size() == cumulative_difficulties.size());
+    return next_difficulty(timestamps.data(), cumulative_difficulties.data(), timestamps.size(), target_seconds, version);
+  }
+
+  difficulty_type next_difficulty_v2(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds) {
+    assert(timestamps.size() == cumulative_difficulties.size());
+    return next_difficulty_v2(timestamps.data(), cumulative_difficulties.data(), timestamps.size(), target_seconds);
+  }
+
+  difficulty_type next_difficulty_v3(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds) {
+    assert(timestamps.size() == cumulative_difficulties.size());
+    return next_difficulty_v3(timestamps.data(), cumulative_difficulties.data(), timestamps.size(), target_seconds);
+  }
+
+  difficulty_type next_difficulty_v9(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds) {
+    assert(timestamps.size() == cumulative_difficulties.size());
+    return next_difficulty_v9(timestamps.data(), cumulative_difficulties.data(), timestamps.size(), target_seconds);
+  }
+
+  void difficulty_window::clear() {
+    m_timestamps.clear();
+    m_cumulative_difficulties.clear();
+    m_begin = 0;
+  }
+
+  void difficulty_window::reserve(size_t count) {
+    m_timestamps.reserve(2 * count);
+    m_cumulative_difficulties.reserve(2 * count);
+  }
+
+  void difficulty_window::push_back(std::uint64_t timestamp, difficulty_type cumulative_difficulty) {
+    // once the dropped front is as large as the live part, slide the live
+    // part down; this keeps the storage within twice the window size
+    if (m_begin > 0 && m_begin >= size()) {
+      m_timestamps.erase(m_timestamps.begin(), m_timestamps.begin() + m_begin);
+      m_cumulative_difficulties.erase(m_cumulative_difficulties.begin(), m_cumulative_difficulties.begin() + m_begin);
+      m_begin = 0;
+    }
+    m_timestamps.push_back(timestamp);
+    m_cumulative_difficulties.push_back(cumulative_difficulty);
+  }
+
+  void difficulty_window::push_front(std::uint64_t timestamp, difficulty_type cumulative_difficulty) {
+    if (m_begin > 0) {
+      --m_begin;
+      m_timestamps[m_begin] = timestamp;
+      m_cumulative_difficulties[m_begin] = cumulative_difficulty;
+    } else {
+      m_timestamps.insert(m_timestamps.begin(), timestamp);
+      m_cumulative_difficulties.insert(m_cumulative_difficulties.begin(), cumulative_difficulty);
+    }
+  }
+
+  void difficulty_window::pop_back() {
+    assert(!empty());
+    m_timestamps.pop_back();
+    m_cumulative_difficulties.pop_back();
+    if (empty())
+      clear();
+  }
+
+  void difficulty_window::pop_front() {
+    assert(!empty());
+    ++m_begin;
+    if (empty())
+      clear();
+  }
 }
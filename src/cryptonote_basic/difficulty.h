@@ -53,8 +53,50 @@ namespace cryptonote
      * @return true if valid, else false
      */
     bool check_hash(const crypto::hash &hash, difficulty_type difficulty);
-    difficulty_type next_difficulty(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds, uint8_t version = 1);
-    difficulty_type next_difficulty_v2(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
-    difficulty_type next_difficulty_v3(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
-    difficulty_type next_difficulty_v9(std::vector<std::uint64_t> timestamps, std::vector<difficulty_type> cumulative_difficulties, size_t target_seconds);
+
+    /*
+     * The pointer versions read the oldest-first timestamps and cumulative
+     * difficulties in place and do not allocate; the vector versions forward
+     * to them.
+     */
+    difficulty_type next_difficulty(const std::uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds, uint8_t version = 1);
+    difficulty_type next_difficulty_v2(const std::uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds);
+    difficulty_type next_difficulty_v3(const std::uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds);
+    difficulty_type next_difficulty_v9(const std::uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length, size_t target_seconds);
+
+    difficulty_type next_difficulty(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds, uint8_t version = 1);
+    difficulty_type next_difficulty_v2(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds);
+    difficulty_type next_difficulty_v3(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds);
+    difficulty_type next_difficulty_v9(const std::vector<std::uint64_t> &timestamps, const std::vector<difficulty_type> &cumulative_difficulties, size_t target_seconds);
+
+    /**
+     * @brief sliding window of block timestamps and cumulative difficulties
+     *
+     * Entries are kept oldest first and contiguous, so the pointer versions of
+     * the next_difficulty functions can read them in place. Adding at the back
+     * and dropping at the front are amortized constant time, and the storage
+     * is reused once it has grown to the window size.
+     */
+    class difficulty_window
+    {
+    public:
+      difficulty_window(): m_begin(0) {}
+
+      void clear();
+      void reserve(size_t count);
+      void push_back(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+      void push_front(std::uint64_t timestamp, difficulty_type cumulative_difficulty);
+      void pop_back();
+      void pop_front();
+
+      size_t size() const { return m_timestamps.size() - m_begin; }
+      bool empty() const { return size() == 0; }
+      const std::uint64_t *timestamps() const { return m_timestamps.data() + m_begin; }
+      const difficulty_type *cumulative_difficulties() const { return m_cumulative_difficulties.data() + m_begin; }
+
+    private:
+      std::vector<std::uint64_t> m_timestamps;
+      std::vector<difficulty_type> m_cumulative_difficulties;
+      size_t m_begin;
+    };
 }
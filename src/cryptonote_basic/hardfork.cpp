@@ -31,6 +31,7 @@
 #include <cstdio>
 
 #include "cryptonote_basic/cryptonote_basic.h"
+#include "common/varint.h"
 #include "blockchain_db/blockchain_db.h"
 #include "hardfork.h"
 
@@ -55,6 +56,28 @@ static uint8_t get_block_version(const cryptonote::block &b)
   return b.major_version;
 }
 
+// The major and minor versions are the first two fields of a block blob,
+// so when the db can hand out a view of the blob, the version and vote
+// are read from it without parsing the whole block. The caller must hold
+// a db txn for the view to be valid.
+static void get_block_version_and_vote(const cryptonote::BlockchainDB &db, uint64_t height, uint8_t &version, uint8_t &vote)
+{
+  epee::span<const uint8_t> view;
+  if (db.get_block_blob_view(height, view))
+  {
+    const uint8_t *p = view.data(), *end = view.data() + view.size();
+    uint8_t minor_version;
+    if (tools::read_varint(p, end, version) > 0 && tools::read_varint(p, end, minor_version) > 0)
+    {
+      vote = minor_version == 0 ? 1 : minor_version;
+      return;
+    }
+  }
+  const cryptonote::block b = db.get_block_from_height(height);
+  version = get_block_version(b);
+  vote = get_block_vote(b);
+}
+
 HardFork::HardFork(cryptonote::BlockchainDB &db, uint8_t original_version, uint64_t original_version_till_height, time_t forked_time, time_t update_time, uint64_t window_size, uint8_t default_threshold_percent):
   db(db),
   original_version(original_version),
@@ -235,8 +258,9 @@ bool HardFork::reorganize_from_block_height(uint64_t height)
     --current_fork_index;
   }
   for (uint64_t h = rescan_height; h <= height; ++h) {
-    cryptonote::block b = db.get_block_from_height(h);
-    const uint8_t v = get_effective_version(get_block_vote(b));
+    uint8_t block_version, vote;
+    get_block_version_and_vote(db, h, block_version, vote);
+    const uint8_t v = get_effective_version(vote);
     last_versions[v]++;
     versions.push_back(v);
   }
@@ -248,7 +272,9 @@ bool HardFork::reorganize_from_block_height(uint64_t height)
 
   const uint64_t bc_height = db.height();
   for (uint64_t h = height + 1; h < bc_height; ++h) {
-    add(db.get_block_from_height(h), h);
+    uint8_t block_version, vote;
+    get_block_version_and_vote(db, h, block_version, vote);
+    add(block_version, vote, h);
   }
 
   if (stop_batch)
@@ -278,8 +304,9 @@ bool HardFork::rescan_from_block_height(uint64_t height)
   for (size_t n = 0; n < 256; ++n)
     last_versions[n] = 0;
   for (uint64_t h = height; h < db.height(); ++h) {
-    cryptonote::block b = db.get_block_from_height(h);
-    const uint8_t v = get_effective_version(get_block_vote(b));
+    uint8_t block_version, vote;
+    get_block_version_and_vote(db, h, block_version, vote);
+    const uint8_t v = get_effective_version(vote);
     last_versions[v]++;
     versions.push_back(v);
   }
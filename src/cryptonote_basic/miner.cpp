@@ -78,7 +78,6 @@ using namespace epee;
 #include "miner.h"
 
 
-extern "C" void slow_hash_allocate_state();
 extern "C" void slow_hash_free_state();
 namespace cryptonote
 {
@@ -97,15 +96,11 @@ namespace cryptonote
 
 
   miner::miner(i_miner_handler* phandler):m_stop(1),
-    m_template(boost::value_initialized<block>()),
     m_template_no(0),
-    m_diffic(0),
     m_thread_index(0),
     m_phandler(phandler),
-    m_height(0),
     m_pausers_count(0),
     m_threads_total(0),
-    m_starter_nonce(0),
     m_last_hr_merge_time(0),
     m_hashes(0),
     m_do_print_hashrate(false),
@@ -128,15 +123,24 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------------
   bool miner::set_block_template(const block& bl, const difficulty_type& di, uint64_t height)
   {
-    CRITICAL_REGION_LOCAL(m_template_lock);
-    m_template = bl;
-    m_diffic = di;
-    m_height = height;
+    std::shared_ptr<job> j = std::make_shared<job>();
+    j->b = bl;
+    get_tx_tree_branch(j->b, j->tx_tree_branch);
+    j->difficulty = di;
+    j->height = height;
+    j->starter_nonce = crypto::rand<uint32_t>();
+    // workers pick the new job up at their next batch, without taking any lock
+    std::atomic_store(&m_job, std::shared_ptr<const job>(std::move(j)));
     ++m_template_no;
-    m_starter_nonce = crypto::rand<uint32_t>();
     return true;
   }
   //-----------------------------------------------------------------------------------------------------
+  crypto::hash miner::get_template_prev_id() const
+  {
+    const std::shared_ptr<const job> j = std::atomic_load(&m_job);
+    return j ? j->b.prev_id : crypto::null_hash;
+  }
+  //-----------------------------------------------------------------------------------------------------
   bool miner::on_block_chain_update()
   {
     if(!is_mining())
@@ -297,7 +301,6 @@ namespace cryptonote
   {
     m_mine_address = adr;
     m_threads_total = static_cast<uint32_t>(threads_count);
-    m_starter_nonce = crypto::rand<uint32_t>();
     CRITICAL_REGION_LOCAL(m_threads_lock);
     if(is_mining())
     {
@@ -440,12 +443,23 @@ namespace cryptonote
     uint32_t th_local_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
     MLOG_SET_THREAD_NAME(std::string("[miner ") + std::to_string(th_local_index) + "]");
     MGINFO("Miner thread was started ["<< th_local_index << "]");
-    uint32_t nonce = m_starter_nonce + th_local_index;
-    uint64_t height = 0;
-    difficulty_type local_diff = 0;
     uint32_t local_template_ver = 0;
-    block b;
-    slow_hash_allocate_state();
+    std::shared_ptr<const job> j;
+    // each thread walks its own slice of the nonce space, starting from the job's random start
+    uint32_t range_start = 0;
+    uint64_t range_size = 1, range_offset = 0;
+    // nonces hashed together with interleaved scratchpads
+    const size_t ways = 2;
+    std::vector<block> bs(ways);
+    std::vector<const block*> pbs;
+    for (const block &bn: bs)
+      pbs.push_back(&bn);
+    std::vector<crypto::hash> hs;
+    crypto::slow_hash_allocate_state_multi(ways);
+    crypto::slow_hash_state_info state_info;
+    crypto::slow_hash_get_state_info(&state_info);
+    MGINFO("Miner thread [" << th_local_index << "] scratchpads use " << crypto::slow_hash_pages_name(state_info.pages)
+        << (state_info.numa_node >= 0 ? ", NUMA node " + std::to_string(state_info.numa_node) : std::string()));
     while(!m_stop)
     {
       if(m_pausers_count)//anti split workaround
@@ -469,31 +483,39 @@ namespace cryptonote
 
       if(local_template_ver != m_template_no)
       {
-        CRITICAL_REGION_BEGIN(m_template_lock);
-        b = m_template;
-        local_diff = m_diffic;
-        height = m_height;
-        CRITICAL_REGION_END();
         local_template_ver = m_template_no;
-        nonce = m_starter_nonce + th_local_index;
+        j = std::atomic_load(&m_job);
+        if (j)
+        {
+          const uint32_t threads_total = std::max<uint32_t>((uint32_t)m_threads_total, 1);
+          range_size = (((uint64_t)1) << 32) / threads_total;
+          range_start = j->starter_nonce + (uint32_t)(range_size * (th_local_index % threads_total));
+          range_offset = 0;
+          for (block &bn: bs)
+            bn = j->b;
+        }
       }
 
-      if(!local_template_ver)//no any set_block_template call
+      if(!j)//no any set_block_template call
       {
         LOG_PRINT_L2("Block template not set yet");
         epee::misc_utils::sleep_no_w(1000);
         continue;
       }
 
-      b.nonce = nonce;
-      crypto::hash h;
-      get_block_longhash(b, h, height);
+      for (size_t n = 0; n < ways; ++n)
+        bs[n].nonce = range_start + (uint32_t)((range_offset + n) % range_size);
+      get_block_longhashes(pbs, hs, ways, &j->tx_tree_branch);
 
-      if(check_hash(h, local_diff))
+      for (size_t n = 0; n < ways; ++n)
       {
+        if(!check_hash(hs[n], j->difficulty))
+          continue;
         //we lucky!
+        block b = j->b;
+        b.nonce = bs[n].nonce;
         ++m_config.current_extra_message_index;
-        MGINFO_GREEN("Found block " << get_block_hash(b) << " at height " << height << " for difficulty: " << local_diff);
+        MGINFO_GREEN("Found block " << get_block_hash(b) << " at height " << j->height << " for difficulty: " << j->difficulty);
         if(!m_phandler->handle_block_found(b))
         {
           --m_config.current_extra_message_index;
@@ -503,9 +525,11 @@ namespace cryptonote
           if (!m_config_folder_path.empty())
             epee::serialization::store_t_to_json_file(m_config, m_config_folder_path + "/" + MINER_CONFIG_FILE_NAME);
         }
+        // the other nonces are for the same height, and will be stale
+        break;
       }
-      nonce+=m_threads_total;
-      ++m_hashes;
+      range_offset += ways;
+      m_hashes += ways;
     }
     slow_hash_free_state();
     MGINFO("Miner thread stopped ["<< th_local_index << "]");
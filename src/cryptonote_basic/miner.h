@@ -34,6 +34,7 @@
 #include <boost/program_options.hpp>
 #include <boost/logic/tribool_fwd.hpp>
 #include <atomic>
+#include <memory>
 #include "cryptonote_basic.h"
 #include "difficulty.h"
 #include "math_helper.h"
@@ -69,6 +70,8 @@ namespace cryptonote
     static void init_options(boost::program_options::options_description& desc);
     bool set_block_template(const block& bl, const difficulty_type& diffic, uint64_t height);
     bool on_block_chain_update();
+    //! prev_id of the template being mined, null if none
+    crypto::hash get_template_prev_id() const;
     bool start(const account_public_address& adr, size_t threads_count, const boost::thread::attributes& attrs, bool do_background = false, bool ignore_battery = false);
     uint64_t get_speed() const;
     uint32_t get_threads_count() const;
@@ -120,13 +123,19 @@ namespace cryptonote
     };
 
 
+    // everything a worker needs for one template, never modified once published
+    struct job
+    {
+      block b;
+      std::vector<crypto::hash> tx_tree_branch;
+      difficulty_type difficulty;
+      uint64_t height;
+      uint32_t starter_nonce;
+    };
+
     volatile uint32_t m_stop;
-    epee::critical_section m_template_lock;
-    block m_template;
+    std::shared_ptr<const job> m_job;  //!< swapped with std::atomic_store, read with std::atomic_load
     std::atomic<uint32_t> m_template_no;
-    std::atomic<uint32_t> m_starter_nonce;
-    difficulty_type m_diffic;
-    uint64_t m_height;
     volatile uint32_t m_thread_index; 
     volatile uint32_t m_threads_total;
     std::atomic<int32_t> m_pausers_count;
@@ -53,6 +53,8 @@
 #define CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE             10
 
 #define BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW               11
+#define BLOCKCHAIN_ALT_BLOCKS_MAX_DEPTH                 720 // alt chains whose top is deeper than this are pruned
+#define BLOCKCHAIN_ALT_BLOCKS_PRUNE_INTERVAL            60
 
 // MONEY_SUPPLY - total number coins to be generated
 #define MONEY_SUPPLY                                    ((uint64_t)2100000000000)
@@ -109,11 +111,21 @@
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4       100    //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              20     //by default, blocks count in blocks downloading
+#define BLOCKS_SYNCHRONIZING_MAX_COUNT                  100    //by default, most blocks count in blocks downloading, as adapted to db commit times
+#define DB_SYNC_ADAPTIVE_MAX_BLOCKS                     100    //by default, most blocks between db syncs, as adapted to db sync times
+#define BLOCKS_HEADERS_SYNCHRONIZING_MAX_COUNT          256    //block headers sent ahead of the blocks in a chain entry
+#define BLOCK_QUEUE_DEFAULT_MAX_SIZE                    (100*1024*1024) // bytes of downloaded blocks waiting to be added
+
+#define CRYPTONOTE_PRUNING_STRIPE_SIZE                  4096   // the size of a pruning stripe, in blocks
+#define CRYPTONOTE_PRUNING_LOG_STRIPES                  3      // the higher, the more space saved
+#define CRYPTONOTE_PRUNING_TIP_BLOCKS                   11000  // the smaller, the more space saved, about a week
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    (86400*3) //seconds, three days
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
+#define COMMAND_RPC_GET_BLOCK_FILTERS_MAX_COUNT         1000
+#define COMMAND_RPC_EXPLORER_INDEX_MAX_COUNT            1000
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -135,7 +147,16 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_TX_INVENTORY                   0x02
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_TX_INVENTORY)
+
+#define P2P_TX_ANNOUNCE_DELAY_MS                        2000         // mean delay between tx announcements to a peer
+#define P2P_TX_KNOWN_PER_PEER                           16384        // txids remembered per peer
+#define P2P_TX_REQUEST_TIMEOUT                          30           // seconds before a tx may be asked from another peer
+#define P2P_MAX_TX_HASHES_PER_NOTIFY                    1000
+
+#define P2P_REQUEST_THREADS                             2            // threads serving block and chain requests from peers
+#define P2P_MAX_PENDING_REQUESTS                        64           // past that, requests are served on the io thread
 
 #define ALLOW_DEBUG_COMMANDS
 
@@ -158,8 +179,16 @@
 #define PER_KB_FEE_QUANTIZATION_DECIMALS        8
 
 #define HASH_OF_HASHES_STEP                     256
+#define BOOTSTRAP_SNAPSHOT_MAX_UNANCHORED_BLOCKS 20000 // blocks above the compiled hashes a bootstrap snapshot may have, dropped and synced again
 
 #define DEFAULT_TXPOOL_MAX_WEIGHT               648000000ull // 3 days at 300000, in bytes
+#define DEFAULT_TXPOOL_PARSED_TX_CACHE_SIZE     2048 // parsed txes kept in memory
+#define OUTPUT_KEY_CACHE_SIZE                   131072 // ring member outputs kept in memory, total over all shards
+#define VERIFIED_TX_CACHE_SIZE                  16384 // txes whose pool signature checks are reused for blocks
+#define DEFAULT_TXPOOL_INPUT_CACHE_SIZE         16384 // pool tx input check results kept in memory
+#define DEFAULT_MAX_INVALID_BLOCKS              4096 // invalid blocks remembered, oldest forgotten first
+#define DEFAULT_BLOCK_ENTRY_CACHE_SIZE          (64 * 1024 * 1024) // bytes of serialized block entries kept for serving syncing peers
+#define DEFAULT_LIGHT_WALLET_MAX_ACCOUNTS       10000 // view keys the built in light wallet server scans for
 
 #define BULLETPROOF_MAX_OUTPUTS                 16
 
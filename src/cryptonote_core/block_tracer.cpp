@@ -0,0 +1,192 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+
+#include "block_tracer.h"
+#include "string_tools.h"
+
+namespace
+{
+  // the trace of the block handled on this thread, if any
+  thread_local cryptonote::block_trace *current_trace = NULL;
+
+  void write_event(std::ostringstream &ss, bool &first, const std::string &name, uint64_t ts, uint64_t dur, int tid, const std::string &args)
+  {
+    ss << (first ? "\n" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+       << ",\"ts\":" << ts << ",\"dur\":" << dur << ",\"args\":{" << args << "}}";
+    first = false;
+  }
+}
+
+namespace cryptonote
+{
+
+block_tracer::block_tracer():
+  m_max_blocks(0), m_max_txs(DEFAULT_MAX_TXS)
+{
+}
+
+void block_tracer::set_max_blocks(size_t max_blocks)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_max_blocks = max_blocks;
+  while (m_traces.size() > max_blocks)
+    m_traces.pop_front();
+}
+
+void block_tracer::set_max_txs(size_t max_txs)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_max_txs = max_txs;
+}
+
+void block_tracer::add(block_trace &&trace)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  const size_t max_blocks = m_max_blocks;
+  if (max_blocks == 0)
+    return;
+  const size_t ntxs = std::min(m_max_txs, trace.txs.size());
+  std::partial_sort(trace.txs.begin(), trace.txs.begin() + ntxs, trace.txs.end(), [](const block_trace::tx &a, const block_trace::tx &b) {
+    return a.duration_us > b.duration_us;
+  });
+  trace.txs.resize(ntxs);
+  m_traces.push_back(std::move(trace));
+  while (m_traces.size() > max_blocks)
+    m_traces.pop_front();
+}
+
+std::vector<block_trace> block_tracer::get_traces() const
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  return std::vector<block_trace>(m_traces.begin(), m_traces.end());
+}
+
+std::string block_tracer::to_chrome_trace(const std::vector<block_trace> &traces)
+{
+  // blocks and their phases on one row, the txs they time on another
+  std::ostringstream ss;
+  bool first = true;
+  ss << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (const block_trace &b: traces)
+  {
+    const std::string block_args = "\"height\":" + std::to_string(b.height) + ",\"id\":\"" + epee::string_tools::pod_to_hex(b.id) + "\",\"added\":" + (b.added ? "true" : "false");
+    write_event(ss, first, "block " + std::to_string(b.height), b.timestamp_us, b.duration_us, 1, block_args);
+    for (const block_trace::phase &p: b.phases)
+      write_event(ss, first, p.name, b.timestamp_us + p.start_us, p.duration_us, 1, "\"height\":" + std::to_string(b.height));
+    for (const block_trace::tx &tx: b.txs)
+    {
+      const std::string tx_args = "\"height\":" + std::to_string(b.height) + ",\"pool_us\":" + std::to_string(tx.pool_us) + ",\"ring_members_us\":" + std::to_string(tx.ring_members_us);
+      write_event(ss, first, "tx " + epee::string_tools::pod_to_hex(tx.id), b.timestamp_us + tx.start_us, tx.duration_us, 2, tx_args);
+    }
+  }
+  ss << "\n]}\n";
+  return ss.str();
+}
+
+block_trace_scope::block_trace_scope(block_tracer &tracer, uint64_t height, const crypto::hash &id):
+  m_tracer(tracer), m_enabled(tracer.enabled() && !current_trace), m_start_us(0), m_lap_us(0)
+{
+  m_trace.height = height;
+  m_trace.id = id;
+  m_trace.timestamp_us = 0;
+  m_trace.duration_us = 0;
+  m_trace.added = false;
+  if (!m_enabled)
+    return;
+  m_trace.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  m_start_us = m_lap_us = clock_us();
+  current_trace = &m_trace;
+}
+
+block_trace_scope::~block_trace_scope()
+{
+  if (!m_enabled)
+    return;
+  current_trace = NULL;
+  m_trace.duration_us = clock_us() - m_start_us;
+  try
+  {
+    m_tracer.add(std::move(m_trace));
+  }
+  catch (...) {}
+}
+
+void block_trace_scope::lap(const char *phase)
+{
+  if (!m_enabled)
+    return;
+  const uint64_t now = clock_us();
+  m_trace.phases.push_back({phase, m_lap_us - m_start_us, now - m_lap_us});
+  m_lap_us = now;
+}
+
+void block_trace_scope::begin_tx(const crypto::hash &id)
+{
+  if (!m_enabled)
+    return;
+  m_trace.txs.push_back({id, clock_us() - m_start_us, 0, 0, 0});
+}
+
+void block_trace_scope::tx_taken_from_pool()
+{
+  if (!m_enabled || m_trace.txs.empty())
+    return;
+  block_trace::tx &tx = m_trace.txs.back();
+  tx.pool_us = clock_us() - m_start_us - tx.start_us;
+}
+
+void block_trace_scope::end_tx()
+{
+  if (!m_enabled || m_trace.txs.empty())
+    return;
+  block_trace::tx &tx = m_trace.txs.back();
+  tx.duration_us = clock_us() - m_start_us - tx.start_us;
+}
+
+uint64_t block_trace_scope::now_us()
+{
+  return current_trace ? clock_us() : 0;
+}
+
+void block_trace_scope::add_ring_members_time(uint64_t start_us)
+{
+  if (!current_trace || current_trace->txs.empty() || start_us == 0)
+    return;
+  current_trace->txs.back().ring_members_us += clock_us() - start_us;
+}
+
+uint64_t block_trace_scope::clock_us()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
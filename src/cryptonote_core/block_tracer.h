@@ -0,0 +1,150 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+/**
+ * The time a block spent in each phase of being added to the main chain,
+ * and the time its slowest txs took.
+ *
+ * Phases follow each other, and are timed from the start of the block.
+ * Signatures are checked for the whole block at once, after the txs, so
+ * the time of a tx covers taking it from the pool, looking up its ring
+ * members and its other input checks.
+ */
+struct block_trace
+{
+  struct phase
+  {
+    std::string name;
+    uint64_t start_us;
+    uint64_t duration_us;
+  };
+
+  struct tx
+  {
+    crypto::hash id;
+    uint64_t start_us;
+    uint64_t duration_us;
+    uint64_t pool_us;           //!< taking it from the pool
+    uint64_t ring_members_us;   //!< looking up its ring members
+  };
+
+  uint64_t height;
+  crypto::hash id;
+  uint64_t timestamp_us;        //!< wall clock time the block started, since the epoch
+  uint64_t duration_us;
+  bool added;
+  std::vector<phase> phases;
+  std::vector<tx> txs;          //!< slowest first
+};
+
+/**
+ * Keeps the traces of the last blocks handled, for the
+ * get_block_processing_trace RPC. Tracing is off until a number of blocks
+ * to keep is set.
+ */
+class block_tracer
+{
+  public:
+
+    static constexpr size_t DEFAULT_MAX_TXS = 10;
+
+    block_tracer();
+
+    //! 0 turns tracing off, and drops the traces kept
+    void set_max_blocks(size_t max_blocks);
+    size_t get_max_blocks() const { return m_max_blocks.load(std::memory_order_relaxed); }
+    void set_max_txs(size_t max_txs);
+    bool enabled() const { return get_max_blocks() != 0; }
+
+    //! keeps the trace, with its slowest txs only
+    void add(block_trace &&trace);
+
+    //! the traces kept, oldest first
+    std::vector<block_trace> get_traces() const;
+
+    //! the traces in the Chrome trace event format, for chrome://tracing and similar viewers
+    static std::string to_chrome_trace(const std::vector<block_trace> &traces);
+
+  private:
+    mutable boost::mutex m_lock;
+    std::deque<block_trace> m_traces;
+    std::atomic<size_t> m_max_blocks;
+    size_t m_max_txs;
+};
+
+/**
+ * Traces the block handled on this thread while it lives, if the tracer
+ * is enabled, and hands the trace to the tracer when it goes away.
+ *
+ * lap() closes the phase running since the last lap. Code deeper down,
+ * which doesn't know about the block, adds to the tx being traced with
+ * the static functions, which do nothing when no block is traced on this
+ * thread.
+ */
+class block_trace_scope
+{
+  public:
+
+    block_trace_scope(block_tracer &tracer, uint64_t height, const crypto::hash &id);
+    ~block_trace_scope();
+
+    void lap(const char *phase);
+    void begin_tx(const crypto::hash &id);
+    void tx_taken_from_pool();
+    void end_tx();
+    void set_added() { m_trace.added = true; }
+
+    //! a time to pass to add_ring_members_time, 0 if no block is traced on this thread
+    static uint64_t now_us();
+    static void add_ring_members_time(uint64_t start_us);
+
+  private:
+    static uint64_t clock_us();
+
+    block_tracer &m_tracer;
+    bool m_enabled;
+    block_trace m_trace;
+    uint64_t m_start_us;
+    uint64_t m_lap_us;
+};
+
+}
@@ -31,8 +31,8 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <mutex>
 #include <boost/filesystem.hpp>
-#include <boost/range/adaptor/reversed.hpp>
 
 #include "include_base_utils.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
@@ -51,6 +51,8 @@
 #include "warnings.h"
 #include "crypto/hash.h"
 #include "cryptonote_core.h"
+#include "cryptonote_protocol/get_objects_serialization.h"
+#include "light_wallet_scanner.h"
 #include "ringct/rctSigs.h"
 #include "common/perf_timer.h"
 #include "common/notify.h"
@@ -75,7 +77,6 @@ using namespace crypto;
 
 using namespace cryptonote;
 using epee::string_tools::pod_to_hex;
-extern "C" void slow_hash_allocate_state();
 extern "C" void slow_hash_free_state();
 
 DISABLE_VS_WARNINGS(4267)
@@ -133,11 +134,19 @@ static const struct {
 
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
-  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
-  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_show_time_stats(false), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
+  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_block_weights_height(0), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
+  m_max_invalid_blocks(DEFAULT_MAX_INVALID_BLOCKS),
+  m_block_entry_cache_bytes(0), m_block_entry_cache_max_bytes(DEFAULT_BLOCK_ENTRY_CACHE_SIZE),
+  m_scan_table(make_validation_container<scan_table_t>()),
+  m_check_txin_table(make_validation_container<check_txin_table_t>()),
+  m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false), m_fast_sync(true), m_fast_sync_state_checks(false), m_show_time_stats(false), m_pow_hash_cache(true), m_sync_counter(0), m_bytes_to_sync(0), m_batch_blocks(0), m_batch_bytes(0), m_block_processing_stats(), m_cancel(false),
+  m_output_histogram_cache_top(crypto::null_hash),
   m_difficulty_for_next_block_top_hash(crypto::null_hash),
   m_difficulty_for_next_block(1),
-  m_btc_valid(false)
+  m_refresh_height(0),
+  m_refresh_top_id(crypto::null_hash),
+  m_btc_valid(false),
+  m_switching_chain(false)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -162,6 +171,13 @@ bool Blockchain::have_tx_keyimg_as_spent(const crypto::key_image &key_im) const
   return  m_db->has_key_image(key_im);
 }
 //------------------------------------------------------------------
+void Blockchain::have_key_images_as_spent(const std::vector<crypto::key_image> &key_im, std::vector<bool> &spent) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  // same as have_tx_keyimg_as_spent, this does not take m_blockchain_lock
+  m_db->has_key_images(key_im, spent);
+}
+//------------------------------------------------------------------
 // This function makes sure that each "input" in an input (mixins) exists
 // and collects the public key for each from the transaction it was included in
 // via the visitor passed to it.
@@ -191,7 +207,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
     auto its = it->second.find(tx_in_to_key.k_image);
     if (its != it->second.end())
     {
-      outputs = its->second;
+      outputs.assign(its->second.begin(), its->second.end());
       found = true;
     }
   }
@@ -200,7 +216,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   {
     try
     {
-      m_db->get_output_key(tx_in_to_key.amount, absolute_offsets, outputs, true);
+      get_output_keys_cached(tx_in_to_key.amount, absolute_offsets, outputs);
       if (absolute_offsets.size() != outputs.size())
       {
         MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
@@ -226,7 +242,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
         add_offsets.push_back(absolute_offsets[i]);
       try
       {
-        m_db->get_output_key(tx_in_to_key.amount, add_offsets, add_outputs, true);
+        get_output_keys_cached(tx_in_to_key.amount, add_offsets, add_outputs);
         if (add_offsets.size() != add_outputs.size())
         {
           MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
@@ -374,6 +390,11 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   //       taking testnet into account
   if(!m_db->height())
   {
+    if (m_db->is_read_only())
+    {
+      LOG_ERROR("The read only blockchain is empty, it has to be synced by a read/write daemon first");
+      return false;
+    }
     MINFO("Blockchain not loaded, generating genesis block.");
     block bl = boost::value_initialized<block>();
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
@@ -459,11 +480,14 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   if (num_popped_blocks > 0)
   {
     m_timestamps_and_difficulties_height = 0;
+    m_block_weights_height = 0;
     m_hardfork->reorganize_from_chain_height(get_current_blockchain_height());
     m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
   }
 
   update_next_cumulative_weight_limit();
+  m_refresh_height = m_db->height();
+  m_refresh_top_id = m_db->top_block_hash();
   return true;
 }
 //------------------------------------------------------------------
@@ -484,6 +508,7 @@ bool Blockchain::store_blockchain()
   CRITICAL_REGION_LOCAL(m_db->m_synchronization_lock);
 
   TIME_MEASURE_START(save);
+  TIME_MEASURE_NS_START(save_ns);
   // TODO: make sure sync(if this throws that it is not simply ignored higher
   // up the call stack
   try
@@ -502,6 +527,8 @@ bool Blockchain::store_blockchain()
   }
 
   TIME_MEASURE_FINISH(save);
+  TIME_MEASURE_NS_FINISH(save_ns);
+  m_db_sync_tuner.on_sync(save_ns / 1000, epee::misc_utils::get_ns_count() / 1000);
   if(m_show_time_stats)
     MINFO("Blockchain stored OK, took: " << save << " ms");
   return true;
@@ -513,6 +540,8 @@ bool Blockchain::deinit()
 
   MTRACE("Stopping blockchain read/write activity");
 
+  wait_for_longhash_prefetch();
+
  // stop async service
   m_async_work_idle.reset();
   m_async_pool.join_all();
@@ -547,70 +576,124 @@ bool Blockchain::deinit()
   return true;
 }
 //------------------------------------------------------------------
-// This function tells BlockchainDB to remove the top block from the
-// blockchain and then returns all transactions (except the miner tx, of course)
-// from it to the tx_pool
-block Blockchain::pop_block_from_blockchain()
+bool Blockchain::refresh_from_db()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  CRITICAL_REGION_LOCAL(m_tx_pool);
+  CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+
+  uint64_t height;
+  crypto::hash top_id;
+  bool extended = false;
+  {
+    db_rtxn_guard rtxn_guard(m_db);
+    height = m_db->height();
+    top_id = m_db->top_block_hash();
+    if (top_id == m_refresh_top_id)
+      return false;
+    // the last top still in place means blocks were only added on top of it
+    if (m_refresh_height > 0 && m_refresh_height <= height)
+      extended = m_db->get_block_hash_from_height(m_refresh_height - 1) == m_refresh_top_id;
+  }
+
+  if (extended)
+    MDEBUG("Blockchain grew from height " << m_refresh_height << " to " << height);
+  else
+    MINFO("Blockchain reorganized from height " << m_refresh_height << " to " << height << ", top block " << top_id);
 
+  // we cannot tell where a reorg forked, so it drops all cached outputs
+  invalidate_output_key_cache(extended ? m_refresh_height : 0);
   m_timestamps_and_difficulties_height = 0;
+  m_block_weights_height = 0;
+  m_hardfork->init();
+  update_next_cumulative_weight_limit();
+  invalidate_block_template_cache();
+  if (extended)
+    m_tx_pool.on_blockchain_inc(height, top_id);
+  else
+    m_tx_pool.on_blockchain_dec(height - 1, top_id);
+
+  m_refresh_height = height;
+  m_refresh_top_id = top_id;
+  return true;
+}
+//------------------------------------------------------------------
+// This function tells BlockchainDB to remove the top block from the
+// blockchain and then hands all transactions (except the miner tx, of course)
+// from it back to the caller, to be returned to the tx_pool
+block Blockchain::pop_block_from_blockchain(std::vector<transaction>& popped_txs)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
   block popped_block;
-  std::vector<transaction> popped_txs;
+  std::vector<transaction> txs;
 
   try
   {
-    m_db->pop_block(popped_block, popped_txs);
+    m_db->pop_block(popped_block, txs);
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
   catch (const std::exception& e)
   {
+    m_timestamps_and_difficulties_height = 0;
+    m_block_weights_height = 0;
     LOG_ERROR("Error popping block from blockchain: " << e.what());
     throw;
   }
   catch (...)
   {
+    m_timestamps_and_difficulties_height = 0;
+    m_block_weights_height = 0;
     LOG_ERROR("Error popping block from blockchain, throwing!");
     throw;
   }
 
-  // return transactions from popped block to the tx_pool
-  for (transaction& tx : popped_txs)
+  // step the difficulty window back by one block: drop the popped block and
+  // read back the one which slides in at the front
+  if (m_timestamps_and_difficulties_height == m_db->height() + 1 && !m_difficulty_window.empty())
   {
-    if (!is_coinbase(tx))
-    {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+    const uint64_t first = m_timestamps_and_difficulties_height - m_difficulty_window.size();
+    m_difficulty_window.pop_back();
+    if (first > 1)
+      m_difficulty_window.push_front(m_db->get_block_timestamp(first - 1), m_db->get_block_cumulative_difficulty(first - 1));
+    m_timestamps_and_difficulties_height = m_db->height();
+  }
+  else
+    m_timestamps_and_difficulties_height = 0;
 
-      // FIXME: HardFork
-      // Besides the below, popping a block should also remove the last entry
-      // in hf_versions.
-      //
-      // FIXME: HardFork
-      // This is not quite correct, as we really want to add the txes
-      // to the pool based on the version determined after all blocks
-      // are popped.
-      uint8_t version = get_current_hard_fork_version();
-
-      // We assume that if they were in a block, the transactions are already
-      // known to the network as a whole. However, if we had mined that block,
-      // that might not be always true. Unlikely though, and always relaying
-      // these again might cause a spike of traffic as many nodes re-relay
-      // all the transactions in a popped block when a reorg happens.
-      bool r = m_tx_pool.add_tx(tx, tvc, true, true, false, version);
-      if (!r)
-      {
-        LOG_ERROR("Error returning transaction to tx_pool");
-      }
-    }
+  // same for the block weights window
+  if (m_block_weights_height == m_db->height() + 1 && !m_block_weights.empty())
+  {
+    const uint64_t first = m_block_weights_height - m_block_weights.size();
+    m_block_weights.pop_back();
+    if (first > 0)
+      m_block_weights.push_front(m_db->get_block_weight(first - 1));
+    m_block_weights_height = m_db->height();
+  }
+  else
+    m_block_weights_height = 0;
+
+  // the popped block's outputs are gone, and their indices will be reused
+  invalidate_output_key_cache(m_db->height());
+  if (m_light_wallet_scanner)
+    m_light_wallet_scanner->on_blocks_popped(m_db->height());
+
+  // the caller returns these to the tx_pool once all blocks are popped, so
+  // they are added at the version determined after that
+  //
+  // FIXME: HardFork
+  // Popping a block should also remove the last entry in hf_versions.
+  for (transaction& tx : txs)
+  {
+    if (!is_coinbase(tx))
+      popped_txs.push_back(std::move(tx));
   }
 
   m_blocks_longhash_table.clear();
-  m_scan_table.clear();
   m_blocks_txs_check.clear();
-  m_check_txin_table.clear();
+  reset_validation_tables();
 
   update_next_cumulative_weight_limit();
   m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
@@ -624,9 +707,12 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_timestamps_and_difficulties_height = 0;
-  m_alternative_chains.clear();
+  m_block_weights_height = 0;
   invalidate_block_template_cache();
   m_db->reset();
+  invalidate_output_key_cache(0);
+  m_verified_txes.clear();
+  m_verified_txes_order.clear();
   m_hardfork->init();
 
   block_verification_context bvc = boost::value_initialized<block_verification_context>();
@@ -676,7 +762,7 @@ bool Blockchain::get_short_chain_history(std::list<crypto::hash>& ids) const
   if(!sz)
     return true;
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(m_db);
   bool genesis_included = false;
   uint64_t current_back_offset = 1;
   while(current_back_offset < sz)
@@ -703,7 +789,6 @@ bool Blockchain::get_short_chain_history(std::list<crypto::hash>& ids) const
   {
     ids.push_back(m_db->get_block_hash_from_height(0));
   }
-  m_db->block_txn_stop();
 
   return true;
 }
@@ -751,10 +836,14 @@ bool Blockchain::get_block_by_hash(const crypto::hash &h, block &blk, bool *orph
   // try to find block in alternative chain
   catch (const BLOCK_DNE& e)
   {
-    blocks_ext_by_hash::const_iterator it_alt = m_alternative_chains.find(h);
-    if (m_alternative_chains.end() != it_alt)
+    cryptonote::blobdata blob;
+    if (m_db->get_alt_block(h, NULL, &blob))
     {
-      blk = it_alt->second.bl;
+      if (!parse_and_validate_block_from_blob(blob, blk))
+      {
+        MERROR("Found alternative block " << h << " in the db, but failed to parse it");
+        return false;
+      }
       if (orphan)
         *orphan = true;
       return true;
@@ -789,12 +878,7 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
 
   uint8_t version = get_current_hard_fork_version();
   auto height = m_db->height();
-  uint32_t difficultyBlocksCount = DIFFICULTY_BLOCKS_COUNT;
-  if (version >= 9) {
-    difficultyBlocksCount = DIFFICULTY_BLOCKS_COUNT_V9;
-  } else if (height >= 2) {
-    difficultyBlocksCount = DIFFICULTY_BLOCKS_COUNT_V6;
-  }
+  const size_t difficultyBlocksCount = get_difficulty_blocks_count(version, height);
 
   crypto::hash top_hash = get_tail_id();
   {
@@ -808,63 +892,33 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   }
 
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  std::vector<uint64_t> timestamps;
-  std::vector<difficulty_type> difficulties;
-  // ND: Speedup
-  // 1. Keep a list of the last 735 (or less) blocks that is used to compute difficulty,
-  //    then when the next block difficulty is queried, push the latest height data and
-  //    pop the oldest one from the list. This only requires 1x read per height instead
-  //    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && m_timestamps.size() >= difficultyBlocksCount)
+  // The last DIFFICULTY_BLOCKS_COUNT (or less) blocks are kept in a sliding
+  // window: a new block is pushed at the back and the oldest dropped at the
+  // front, and pop_block_from_blockchain steps it back, so there is a single
+  // db read per block instead of reading the whole window again.
+  size_t offset = height - std::min < size_t > (height, static_cast<size_t>(difficultyBlocksCount));
+  if (offset == 0)
+    ++offset;
+  const size_t expected = height > offset ? height - offset : 0;
+
+  if (m_timestamps_and_difficulties_height != 0 && height == m_timestamps_and_difficulties_height + 1)
   {
     uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > difficultyBlocksCount)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > difficultyBlocksCount)
-      m_difficulties.erase(m_difficulties.begin());
-
+    m_difficulty_window.push_back(m_db->get_block_timestamp(index), m_db->get_block_cumulative_difficulty(index));
     m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
   }
-  else
+  if (m_timestamps_and_difficulties_height != height || m_difficulty_window.size() < expected)
   {
-    size_t offset = height - std::min < size_t > (height, static_cast<size_t>(difficultyBlocksCount));
-    if (offset == 0)
-      ++offset;
-
-    timestamps.clear();
-    difficulties.clear();
-    if (height > offset)
-    {
-      timestamps.reserve(height - offset);
-      difficulties.reserve(height - offset);
-    }
+    m_difficulty_window.clear();
+    m_difficulty_window.reserve(difficultyBlocksCount);
     for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
-
+      m_difficulty_window.push_back(m_db->get_block_timestamp(offset), m_db->get_block_cumulative_difficulty(offset));
     m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
   }
-  size_t target = get_difficulty_target();
-  difficulty_type diff = -1;
+  while (m_difficulty_window.size() > expected)
+    m_difficulty_window.pop_front();
 
-  if (height < 2) {
-    diff = next_difficulty(timestamps, difficulties, target, version);
-  } else if (height < HARDFORK_EMERGENCY_V6_HEIGHT) {
-    diff = next_difficulty_v2(timestamps, difficulties, target);
-  } else if (version < 8) {
-    diff = next_difficulty_v3(timestamps, difficulties, target);
-  } else {
-    diff = next_difficulty_v9(timestamps, difficulties, target);
-  }
+  const difficulty_type diff = get_next_difficulty(version, height, m_difficulty_window.timestamps(), m_difficulty_window.cumulative_difficulties(), m_difficulty_window.size());
 
   CRITICAL_REGION_LOCAL1(m_difficulty_lock);
   m_difficulty_for_next_block_top_hash = top_hash;
@@ -872,6 +926,27 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   return diff;
 }
 
+//------------------------------------------------------------------
+size_t Blockchain::get_difficulty_blocks_count(uint8_t version, uint64_t height)
+{
+  if (version >= 9)
+    return DIFFICULTY_BLOCKS_COUNT_V9;
+  if (height >= 2)
+    return DIFFICULTY_BLOCKS_COUNT_V6;
+  return DIFFICULTY_BLOCKS_COUNT;
+}
+//------------------------------------------------------------------
+difficulty_type Blockchain::get_next_difficulty(uint8_t version, uint64_t height, const uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length) const
+{
+  const size_t target = get_difficulty_target();
+  if (height < 2)
+    return next_difficulty(timestamps, cumulative_difficulties, length, target, version);
+  if (height < HARDFORK_EMERGENCY_V6_HEIGHT)
+    return next_difficulty_v2(timestamps, cumulative_difficulties, length, target);
+  if (version < 8)
+    return next_difficulty_v3(timestamps, cumulative_difficulties, length, target);
+  return next_difficulty_v9(timestamps, cumulative_difficulties, length, target);
+}
 //------------------------------------------------------------------
 // This function removes blocks from the blockchain until it gets to the
 // position where the blockchain switch started and then re-adds the blocks
@@ -887,13 +962,13 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
+  std::vector<transaction> popped_txs;
   while (m_db->height() != rollback_height)
   {
-    pop_block_from_blockchain();
+    pop_block_from_blockchain(popped_txs);
   }
+  m_tx_pool.add_popped_txs(popped_txs, get_current_hard_fork_version());
 
   // make sure the hard fork object updates its current version
   m_hardfork->reorganize_from_chain_height(rollback_height);
@@ -918,42 +993,58 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
 //------------------------------------------------------------------
 // This function attempts to switch to an alternate chain, returning
 // boolean based on success therein.
-bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain, bool discard_disconnected_chain)
+bool Blockchain::switch_to_alternative_blockchain(const std::list<alt_chain_entry>& alt_chain, bool discard_disconnected_chain)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
   // verify that main chain has front of alt chain's parent block
-  if (!m_db->block_exists(alt_chain.front()->second.bl.prev_id))
+  if (!m_db->block_exists(alt_chain.front().data.prev_id))
   {
     LOG_ERROR("Attempting to move to an alternate chain, but it doesn't appear to connect to the main chain!");
     return false;
   }
 
+  // hold back block callbacks until we know which branch wins
+  m_switching_chain = true;
+  epee::misc_utils::auto_scope_leave_caller switching_chain_guard = epee::misc_utils::create_scope_leave_handler([this](){ m_switching_chain = false; });
+  const uint64_t old_height = m_db->height();
+
+  // disconnect and connect (or roll back) in a single db transaction,
+  // joining the sync batch if there is one
+  bool stop_batch = m_db->batch_start(old_height - alt_chain.front().data.height + alt_chain.size());
+  epee::misc_utils::auto_scope_leave_caller batch_guard = epee::misc_utils::create_scope_leave_handler([this, &stop_batch](){
+    try { if (stop_batch) m_db->batch_stop(); }
+    catch (const std::exception &e) { MERROR("Failed to commit chain switch: " << e.what()); }
+  });
+
   // pop blocks from the blockchain until the top block is the parent
   // of the front block of the alt chain.
   std::list<block> disconnected_chain;
-  while (m_db->top_block_hash() != alt_chain.front()->second.bl.prev_id)
+  std::vector<transaction> popped_txs;
+  while (m_db->top_block_hash() != alt_chain.front().data.prev_id)
   {
-    block b = pop_block_from_blockchain();
+    block b = pop_block_from_blockchain(popped_txs);
     disconnected_chain.push_front(b);
   }
 
+  // the alt chain may mine some of them again, so they go back to the pool
+  // before connecting it, all at once and without checking their inputs
+  m_tx_pool.add_popped_txs(popped_txs, get_current_hard_fork_version());
+
   auto split_height = m_db->height();
 
-  //connecting new alternative chain
+  //connecting new alternative chain, reading each block from the db in turn
   for(auto alt_ch_iter = alt_chain.begin(); alt_ch_iter != alt_chain.end(); alt_ch_iter++)
   {
-    auto ch_ent = *alt_ch_iter;
+    block_extended_info bei;
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
 
     // add block to main chain
-    bool r = handle_block_to_main_chain(ch_ent->second.bl, bvc);
+    bool r = get_alt_block(alt_ch_iter->id, bei) && handle_block_to_main_chain(bei.bl, alt_ch_iter->id, bvc);
 
     // if adding block to main chain failed, rollback to previous state and
     // return false
@@ -969,15 +1060,16 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
       // FIXME: Why do we keep invalid blocks around?  Possibly in case we hear
       // about them again so we can immediately dismiss them, but needs some
       // looking into.
-      add_block_as_invalid(ch_ent->second, get_block_hash(ch_ent->second.bl));
-      MERROR("The block was inserted as invalid while connecting new alternative chain, block_id: " << get_block_hash(ch_ent->second.bl));
-      m_alternative_chains.erase(*alt_ch_iter++);
-
-      for(auto alt_ch_to_orph_iter = alt_ch_iter; alt_ch_to_orph_iter != alt_chain.end(); )
+      MERROR("The block was inserted as invalid while connecting new alternative chain, block_id: " << alt_ch_iter->id);
+      std::vector<crypto::hash> invalid_ids;
+      for(auto alt_ch_to_orph_iter = alt_ch_iter; alt_ch_to_orph_iter != alt_chain.end(); ++alt_ch_to_orph_iter)
       {
-        add_block_as_invalid((*alt_ch_to_orph_iter)->second, (*alt_ch_to_orph_iter)->first);
-        m_alternative_chains.erase(*alt_ch_to_orph_iter++);
+        block_extended_info orph_bei;
+        if (get_alt_block(alt_ch_to_orph_iter->id, orph_bei))
+          add_block_as_invalid(orph_bei, alt_ch_to_orph_iter->id);
+        invalid_ids.push_back(alt_ch_to_orph_iter->id);
       }
+      remove_alt_blocks(invalid_ids);
       return false;
     }
   }
@@ -999,21 +1091,65 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     }
   }
 
-  //removing alt_chain entries from alternative chains container
-  for (auto ch_ent: alt_chain)
+  // commit before reporting the switch, so it is visible to other threads
+  if (stop_batch)
+  {
+    stop_batch = false;
+    m_db->batch_stop();
+  }
+
+  // report the switch; the new blocks are read back from the main chain
+  // rather than kept around while connecting them
+  if (m_reorg_callback)
+    m_reorg_callback(split_height, old_height, m_db->height());
+  if (m_block_added_callback)
   {
-    m_alternative_chains.erase(ch_ent);
+    for (uint64_t height = split_height; height < m_db->height(); ++height)
+      m_block_added_callback(height, m_db->get_block_from_height(height));
   }
 
+  //removing alt_chain entries from alternative block storage
+  std::vector<crypto::hash> connected_ids;
+  connected_ids.reserve(alt_chain.size());
+  for (const auto &ch_ent: alt_chain)
+    connected_ids.push_back(ch_ent.id);
+  remove_alt_blocks(connected_ids);
+
   m_hardfork->reorganize_from_chain_height(split_height);
 
+  precheck_popped_txs(std::move(popped_txs));
+
   MGINFO_GREEN("REORGANIZE SUCCESS! on height: " << split_height << ", new blockchain size: " << m_db->height());
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::precheck_popped_txs(std::vector<transaction> &&txs)
+{
+  if (txs.empty())
+    return;
+
+  // those not mined again stay in the pool with unchecked inputs; checking
+  // them in parallel, off the reorg path, fills the pool's input cache
+  // before they are next considered for a block
+  std::shared_ptr<std::vector<transaction>> pending = std::make_shared<std::vector<transaction>>(std::move(txs));
+  const uint8_t version = get_current_hard_fork_version();
+  m_async_service.post([this, pending, version]() {
+    std::vector<std::tuple<transaction*, crypto::hash, size_t>> checks;
+    for (transaction &tx: *pending)
+    {
+      crypto::hash txid;
+      size_t blob_size = 0;
+      if (!get_transaction_hash(tx, txid, blob_size) || !m_tx_pool.have_tx(txid))
+        continue;
+      checks.emplace_back(&tx, txid, get_transaction_weight(tx, blob_size));
+    }
+    m_tx_pool.precheck_tx_inputs(checks, version);
+  });
+}
+//------------------------------------------------------------------
 // This function calculates the difficulty target for the block being added to
 // an alternate chain.
-difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator>& alt_chain, block_extended_info& bei) const
+difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std::list<alt_chain_entry>& alt_chain, block_extended_info& bei) const
 {  
   if (m_fixed_difficulty)
   {
@@ -1021,8 +1157,6 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
   }
 
   LOG_PRINT_L3("Blockchain::" << __func__);
-  std::vector<uint64_t> timestamps;
-  std::vector<difficulty_type> cumulative_difficulties;
 
   uint8_t version = get_current_hard_fork_version();
   uint32_t difficultyBlocksCount = DIFFICULTY_BLOCKS_COUNT;
@@ -1034,6 +1168,9 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     difficultyBlocksCount = DIFFICULTY_BLOCKS_COUNT_V6;
   }
 
+  difficulty_window window;
+  window.reserve(difficultyBlocksCount);
+
   // if the alt chain isn't long enough to calculate the difficulty target
   // based on its blocks alone, need to get more blocks from the main chain
   if(alt_chain.size()< difficultyBlocksCount)
@@ -1041,7 +1178,7 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
     // Figure out start and stop offsets for main chain blocks
-    size_t main_chain_stop_offset = alt_chain.size() ? alt_chain.front()->second.height : bei.height;
+    size_t main_chain_stop_offset = alt_chain.size() ? alt_chain.front().data.height : bei.height;
     size_t main_chain_count = difficultyBlocksCount - std::min(static_cast<size_t>(difficultyBlocksCount), alt_chain.size());
     main_chain_count = std::min(main_chain_count, main_chain_stop_offset);
     size_t main_chain_start_offset = main_chain_stop_offset - main_chain_count;
@@ -1049,54 +1186,59 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     if(!main_chain_start_offset)
       ++main_chain_start_offset; //skip genesis block
 
-    // get difficulties and timestamps from relevant main chain blocks
-    for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+    // get difficulties and timestamps from relevant main chain blocks; alt
+    // chains usually fork off near the top, within the main chain difficulty
+    // window, so those can be copied from there instead of read from the db
+    const uint64_t window_end = m_timestamps_and_difficulties_height;
+    const uint64_t window_begin = window_end - m_difficulty_window.size();
+    if (window_end != 0 && window_end == m_db->height() && main_chain_start_offset >= window_begin && main_chain_stop_offset <= window_end)
     {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+      {
+        const size_t idx = main_chain_start_offset - window_begin;
+        window.push_back(m_difficulty_window.timestamps()[idx], m_difficulty_window.cumulative_difficulties()[idx]);
+      }
+    }
+    else
+    {
+      for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+        window.push_back(m_db->get_block_timestamp(main_chain_start_offset), m_db->get_block_cumulative_difficulty(main_chain_start_offset));
     }
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
-    CHECK_AND_ASSERT_MES((alt_chain.size() + timestamps.size()) <= difficultyBlocksCount, false, "Internal error, alt_chain.size()[" << alt_chain.size() << "] + vtimestampsec.size()[" << timestamps.size() << "] NOT <= DIFFICULTY_WINDOW[]" << DIFFICULTY_BLOCKS_COUNT);
+    CHECK_AND_ASSERT_MES((alt_chain.size() + window.size()) <= difficultyBlocksCount, false, "Internal error, alt_chain.size()[" << alt_chain.size() << "] + vtimestampsec.size()[" << window.size() << "] NOT <= DIFFICULTY_WINDOW[]" << DIFFICULTY_BLOCKS_COUNT);
 
-    for (auto it : alt_chain)
-    {
-      timestamps.push_back(it->second.bl.timestamp);
-      cumulative_difficulties.push_back(it->second.cumulative_difficulty);
-    }
+    for (const auto &it : alt_chain)
+      window.push_back(it.data.timestamp, it.data.cumulative_difficulty);
   }
   // if the alt chain is long enough for the difficulty calc, grab difficulties
   // and timestamps from it alone
   else
   {
-    timestamps.resize(static_cast<size_t>(difficultyBlocksCount));
-    cumulative_difficulties.resize(static_cast<size_t>(difficultyBlocksCount));
-    size_t count = 0;
-    size_t max_i = timestamps.size()-1;
     // get difficulties and timestamps from most recent blocks in alt chain
-    for(auto it: boost::adaptors::reverse(alt_chain))
-    {
-      timestamps[max_i - count] = it->second.bl.timestamp;
-      cumulative_difficulties[max_i - count] = it->second.cumulative_difficulty;
-      count++;
-      if(count >= difficultyBlocksCount)
-        break;
-    }
+    auto it = alt_chain.end();
+    std::advance(it, -static_cast<std::ptrdiff_t>(difficultyBlocksCount));
+    for (; it != alt_chain.end(); ++it)
+      window.push_back(it->data.timestamp, it->data.cumulative_difficulty);
   }
 
   // FIXME: This will fail if fork activation heights are subject to voting
   size_t target = get_ideal_hard_fork_version(bei.height) < 2 ? DIFFICULTY_TARGET : DIFFICULTY_TARGET;
 
+  const uint64_t *timestamps = window.timestamps();
+  const difficulty_type *cumulative_difficulties = window.cumulative_difficulties();
+  const size_t length = window.size();
+
   if (height < 2) {
-    return next_difficulty(timestamps, cumulative_difficulties, target, version);
+    return next_difficulty(timestamps, cumulative_difficulties, length, target, version);
   } else if (height < HARDFORK_EMERGENCY_V6_HEIGHT) {
-    return next_difficulty_v2(timestamps, cumulative_difficulties, target);
+    return next_difficulty_v2(timestamps, cumulative_difficulties, length, target);
   } else if (version < 9) {
-    return next_difficulty_v3(timestamps, cumulative_difficulties, target);
+    return next_difficulty_v3(timestamps, cumulative_difficulties, length, target);
   } else {
-    return next_difficulty_v9(timestamps, cumulative_difficulties, target);
+    return next_difficulty_v9(timestamps, cumulative_difficulties, length, target);
   }
-  return next_difficulty_v9(timestamps, cumulative_difficulties, target);
+  return next_difficulty_v9(timestamps, cumulative_difficulties, length, target);
 }
 //------------------------------------------------------------------
 // This function does a sanity check on basic things that all miner
@@ -1149,9 +1291,7 @@ bool Blockchain::validate_miner_transaction(const block& b, size_t cumulative_bl
     }
   }
 
-  std::vector<size_t> last_blocks_weights;
-  get_last_n_blocks_weights(last_blocks_weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-  if (!get_block_reward(epee::misc_utils::median(last_blocks_weights), cumulative_block_weight, already_generated_coins, base_reward, version))
+  if (!get_block_reward(sync_block_weights().median(), cumulative_block_weight, already_generated_coins, base_reward, version))
   {
     MERROR_VER("block weight " << cumulative_block_weight << " is bigger than allowed for this blockchain");
     return false;
@@ -1183,26 +1323,29 @@ bool Blockchain::validate_miner_transaction(const block& b, size_t cumulative_bl
   return true;
 }
 //------------------------------------------------------------------
-// get the block weights of the last <count> blocks, and return by reference <sz>.
-void Blockchain::get_last_n_blocks_weights(std::vector<size_t>& weights, size_t count) const
+const tools::rolling_median<uint64_t> &Blockchain::sync_block_weights() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  auto h = m_db->height();
+  const uint64_t h = m_db->height();
+  const uint64_t count = std::min<uint64_t>(h, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
 
-  // this function is meaningless for an empty blockchain...granted it should never be empty
-  if(h == 0)
-    return;
-
-  m_db->block_txn_start(true);
-  // add weight of last <count> blocks to vector <weights> (or less, if blockchain size < count)
-  size_t start_offset = h - std::min<size_t>(h, count);
-  weights.reserve(weights.size() + h - start_offset);
-  for(size_t i = start_offset; i < h; i++)
+  if (m_block_weights_height != 0 && h == m_block_weights_height + 1)
   {
-    weights.push_back(m_db->get_block_weight(i));
+    m_block_weights.push_back(m_db->get_block_weight(h - 1));
+    m_block_weights_height = h;
   }
-  m_db->block_txn_stop();
+  if (m_block_weights_height != h || m_block_weights.size() < count)
+  {
+    db_rtxn_guard rtxn_guard(m_db);
+    m_block_weights.clear();
+    for (uint64_t i = h - count; i < h; ++i)
+      m_block_weights.push_back(m_db->get_block_weight(i));
+    m_block_weights_height = h;
+  }
+  while (m_block_weights.size() > count)
+    m_block_weights.pop_front();
+  return m_block_weights;
 }
 //------------------------------------------------------------------
 uint64_t Blockchain::get_current_cumulative_block_weight_limit() const
@@ -1250,6 +1393,20 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
       expected_reward = m_btc_expected_reward;
       return true;
     }
+    if (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address)) && m_btc_pool_cookie == m_tx_pool.cookie()) {
+      // only the extra nonce differs: the miner tx keeps its key and weight, so
+      // its outputs and the reward stay valid
+      block nb = m_btc;
+      if (replace_miner_tx_extra_nonce(nb.miner_tx, ex_nonce)) {
+        MDEBUG("Using cached template with a new extra nonce");
+        nb.timestamp = time(NULL);
+        b = nb;
+        diffic = m_btc_difficulty;
+        expected_reward = m_btc_expected_reward;
+        cache_block_template(b, miner_address, ex_nonce, diffic, expected_reward, m_btc_pool_cookie);
+        return true;
+      }
+    }
     MDEBUG("Not using cached template: address " << (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address))) << ", nonce " << (m_btc_nonce == ex_nonce) << ", cookie " << (m_btc_pool_cookie == m_tx_pool.cookie()));
     invalidate_block_template_cache();
   }
@@ -1336,63 +1493,38 @@ bool Blockchain::create_block_template(block& b, const account_public_address& m
 #endif
 
   /*
-   two-phase miner transaction generation: we don't know exact block weight until we prepare block, but we don't know reward until we know
-   block weight, so first miner transaction generated with fake amount of money, and with phase we know think we know expected block weight
+   the miner tx weight feeds into the reward through the block weight, and the reward feeds back into the
+   miner tx weight through its output amounts. The reward can only shrink as the block grows, so the miner
+   tx paying the reward of the transactions alone is an upper bound: its weight is computed without building
+   it, the block is sized on it, and the miner tx built for that block is padded to land exactly on it
    */
-  //make blocks coin-base tx looks close to real coinbase tx to get truthful blob weight
   uint8_t hf_version = m_hardfork->get_current_version();
   size_t max_outs = hf_version >= 4 ? 1 : 11;
-  bool r = construct_miner_tx(height, median_weight, already_generated_coins, txs_weight, fee, miner_address, b.miner_tx, ex_nonce, max_outs, hf_version);
-  CHECK_AND_ASSERT_MES(r, false, "Failed to construct miner tx, first chance");
-  size_t cumulative_weight = txs_weight + get_transaction_weight(b.miner_tx);
-#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
-  MDEBUG("Creating block template: miner tx weight " << get_transaction_weight(b.miner_tx) <<
-      ", cumulative weight " << cumulative_weight);
-#endif
+  uint64_t base_reward;
+  if (!get_block_reward(median_weight, txs_weight, already_generated_coins, base_reward, hf_version))
+  {
+    MERROR("Block is too big");
+    return false;
+  }
+  size_t coinbase_weight;
+  bool r = get_miner_tx_weight(height, base_reward + fee, ex_nonce, max_outs, hf_version, coinbase_weight);
+  CHECK_AND_ASSERT_MES(r, false, "Failed to compute miner tx weight");
   for (size_t try_count = 0; try_count != 10; ++try_count)
   {
-    r = construct_miner_tx(height, median_weight, already_generated_coins, cumulative_weight, fee, miner_address, b.miner_tx, ex_nonce, max_outs, hf_version);
-
-    CHECK_AND_ASSERT_MES(r, false, "Failed to construct miner tx, second chance");
-    size_t coinbase_weight = get_transaction_weight(b.miner_tx);
-    if (coinbase_weight > cumulative_weight - txs_weight)
+    r = construct_miner_tx(height, median_weight, already_generated_coins, txs_weight + coinbase_weight, fee, miner_address, b.miner_tx, ex_nonce, max_outs, hf_version);
+    CHECK_AND_ASSERT_MES(r, false, "Failed to construct miner tx");
+    if (!pad_miner_tx_to_weight(b.miner_tx, coinbase_weight))
     {
-      cumulative_weight = txs_weight + coinbase_weight;
-#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
-      MDEBUG("Creating block template: miner tx weight " << coinbase_weight <<
-          ", cumulative weight " << cumulative_weight << " is greater than before");
-#endif
+      // before v4 a smaller reward may decompose into more outputs, and the varint extra length
+      // makes one weight unreachable by padding; either way, aim a little higher
+      coinbase_weight = std::max<size_t>(get_transaction_weight(b.miner_tx), coinbase_weight + 1);
+      MDEBUG("Miner tx does not fit its estimated weight, retrying with " << coinbase_weight << ", try_count=" << try_count);
       continue;
     }
-
-    if (coinbase_weight < cumulative_weight - txs_weight)
-    {
-      size_t delta = cumulative_weight - txs_weight - coinbase_weight;
-#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
-      MDEBUG("Creating block template: miner tx weight " << coinbase_weight <<
-          ", cumulative weight " << txs_weight + coinbase_weight <<
-          " is less than before, adding " << delta << " zero bytes");
-#endif
-      b.miner_tx.extra.insert(b.miner_tx.extra.end(), delta, 0);
-      //here  could be 1 byte difference, because of extra field counter is varint, and it can become from 1-byte len to 2-bytes len.
-      if (cumulative_weight != txs_weight + get_transaction_weight(b.miner_tx))
-      {
-        CHECK_AND_ASSERT_MES(cumulative_weight + 1 == txs_weight + get_transaction_weight(b.miner_tx), false, "unexpected case: cumulative_weight=" << cumulative_weight << " + 1 is not equal txs_cumulative_weight=" << txs_weight << " + get_transaction_weight(b.miner_tx)=" << get_transaction_weight(b.miner_tx));
-        b.miner_tx.extra.resize(b.miner_tx.extra.size() - 1);
-        if (cumulative_weight != txs_weight + get_transaction_weight(b.miner_tx))
-        {
-          //fuck, not lucky, -1 makes varint-counter size smaller, in that case we continue to grow with cumulative_weight
-          MDEBUG("Miner tx creation has no luck with delta_extra size = " << delta << " and " << delta - 1);
-          cumulative_weight += delta - 1;
-          continue;
-        }
-        MDEBUG("Setting extra for block: " << b.miner_tx.extra.size() << ", try_count=" << try_count);
-      }
-    }
-    CHECK_AND_ASSERT_MES(cumulative_weight == txs_weight + get_transaction_weight(b.miner_tx), false, "unexpected case: cumulative_weight=" << cumulative_weight << " is not equal txs_cumulative_weight=" << txs_weight << " + get_transaction_weight(b.miner_tx)=" << get_transaction_weight(b.miner_tx));
+    CHECK_AND_ASSERT_MES(get_transaction_weight(b.miner_tx) == coinbase_weight, false, "unexpected case: miner tx weight " << get_transaction_weight(b.miner_tx) << " is not the expected " << coinbase_weight);
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
     MDEBUG("Creating block template: miner tx weight " << coinbase_weight <<
-        ", cumulative weight " << cumulative_weight << " is now good");
+        ", cumulative weight " << txs_weight + coinbase_weight << " is now good");
 #endif
 
     cache_block_template(b, miner_address, ex_nonce, diffic, expected_reward, pool_cookie);
@@ -1434,7 +1566,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -1462,22 +1593,28 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
   }
 
   //block is not related with head of main chain
-  //first of all - look in alternative chains container
-  auto it_prev = m_alternative_chains.find(b.prev_id);
+  //first of all - look in alternative block storage
+  alt_block_data_t prev_data;
+  const bool parent_in_alt = m_db->get_alt_block(b.prev_id, &prev_data, NULL);
   bool parent_in_main = m_db->block_exists(b.prev_id);
-  if(it_prev != m_alternative_chains.end() || parent_in_main)
+  if(parent_in_alt || parent_in_main)
   {
     //we have new block in alternative chain
 
-    //build alternative subchain, front -> mainchain, back -> alternative head
-    blocks_ext_by_hash::iterator alt_it = it_prev; //m_alternative_chains.find()
-    std::list<blocks_ext_by_hash::iterator> alt_chain;
+    //build alternative subchain, front -> mainchain, back -> alternative head;
+    //only the chain data is read, the blocks stay in the db
+    std::list<alt_chain_entry> alt_chain;
     std::vector<uint64_t> timestamps;
-    while(alt_it != m_alternative_chains.end())
+    if (parent_in_alt)
     {
-      alt_chain.push_front(alt_it);
-      timestamps.push_back(alt_it->second.bl.timestamp);
-      alt_it = m_alternative_chains.find(alt_it->second.bl.prev_id);
+      db_rtxn_guard rtxn_guard(m_db);
+      alt_chain_entry entry = {b.prev_id, prev_data};
+      do
+      {
+        alt_chain.push_front(entry);
+        timestamps.push_back(entry.data.timestamp);
+        entry.id = entry.data.prev_id;
+      } while (m_db->get_alt_block(entry.id, &entry.data, NULL));
     }
 
     // if block to be added connects to known blocks that aren't part of the
@@ -1485,20 +1622,20 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     if(alt_chain.size())
     {
       // make sure alt chain doesn't somehow start past the end of the main chain
-      CHECK_AND_ASSERT_MES(m_db->height() > alt_chain.front()->second.height, false, "main blockchain wrong height");
+      CHECK_AND_ASSERT_MES(m_db->height() > alt_chain.front().data.height, false, "main blockchain wrong height");
 
       // make sure that the blockchain contains the block that should connect
       // this alternate chain with it.
-      if (!m_db->block_exists(alt_chain.front()->second.bl.prev_id))
+      if (!m_db->block_exists(alt_chain.front().data.prev_id))
       {
         MERROR("alternate chain does not appear to connect to main chain...");
         return false;
       }
 
       // make sure block connects correctly to the main chain
-      auto h = m_db->get_block_hash_from_height(alt_chain.front()->second.height - 1);
-      CHECK_AND_ASSERT_MES(h == alt_chain.front()->second.bl.prev_id, false, "alternative chain has wrong connection to main chain");
-      complete_timestamps_vector(m_db->get_block_height(alt_chain.front()->second.bl.prev_id), timestamps);
+      auto h = m_db->get_block_hash_from_height(alt_chain.front().data.height - 1);
+      CHECK_AND_ASSERT_MES(h == alt_chain.front().data.prev_id, false, "alternative chain has wrong connection to main chain");
+      complete_timestamps_vector(m_db->get_block_height(alt_chain.front().data.prev_id), timestamps);
     }
     // if block not associated with known alternate chain
     else
@@ -1522,7 +1659,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     // FIXME: consider moving away from block_extended_info at some point
     block_extended_info bei = boost::value_initialized<block_extended_info>();
     bei.bl = b;
-    bei.height = alt_chain.size() ? it_prev->second.height + 1 : m_db->get_block_height(b.prev_id) + 1;
+    bei.height = alt_chain.size() ? prev_data.height + 1 : m_db->get_block_height(b.prev_id) + 1;
 
     bool is_a_checkpoint;
     if(!m_checkpoints.check_block(bei.height, id, is_a_checkpoint))
@@ -1536,13 +1673,17 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     difficulty_type current_diff = get_next_difficulty_for_alternative_chain(alt_chain, bei);
     CHECK_AND_ASSERT_MES(current_diff, false, "!!!!!!! DIFFICULTY OVERHEAD !!!!!!!");
     crypto::hash proof_of_work = null_hash;
-    get_block_longhash(bei.bl, proof_of_work, bei.height);
+    const bool pow_cached = get_cached_pow_hash(id, proof_of_work);
+    if (!pow_cached)
+      get_block_longhash(bei.bl, proof_of_work, bei.height);
     if(!check_hash(proof_of_work, current_diff))
     {
       MERROR_VER("Block with id: " << id << std::endl << " for alternative chain, does not have enough proof of work: " << proof_of_work << std::endl << " expected difficulty: " << current_diff);
       bvc.m_verifivation_failed = true;
       return false;
     }
+    if (!pow_cached)
+      cache_pow_hash(id, proof_of_work);
 
     if(!prevalidate_miner_transaction(b, bei.height))
     {
@@ -1557,7 +1698,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     difficulty_type main_chain_cumulative_difficulty = m_db->get_block_cumulative_difficulty(m_db->height() - 1);
     if (alt_chain.size())
     {
-      bei.cumulative_difficulty = it_prev->second.cumulative_difficulty;
+      bei.cumulative_difficulty = prev_data.cumulative_difficulty;
     }
     else
     {
@@ -1568,15 +1709,23 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 
     // add block to alternate blocks storage,
     // as well as the current "alt chain" container
-    auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
-    CHECK_AND_ASSERT_MES(i_res.second, false, "insertion of new alternative block returned as it already exist");
-    alt_chain.push_back(i_res.first);
+    alt_chain_entry entry = boost::value_initialized<alt_chain_entry>();
+    entry.id = id;
+    entry.data.prev_id = b.prev_id;
+    entry.data.timestamp = b.timestamp;
+    entry.data.height = bei.height;
+    entry.data.cumulative_weight = bei.block_cumulative_weight;
+    entry.data.cumulative_difficulty = bei.cumulative_difficulty;
+    entry.data.already_generated_coins = bei.already_generated_coins;
+    if (!add_alt_block(entry, b))
+      return false;
+    alt_chain.push_back(entry);
 
     // FIXME: is it even possible for a checkpoint to show up not on the main chain?
     if(is_a_checkpoint)
     {
       //do reorganize!
-      MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << ", checkpoint is found in alternative chain on height " << bei.height);
+      MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front().data.height << " of " << m_db->height() - 1 << ", checkpoint is found in alternative chain on height " << bei.height);
 
       bool r = switch_to_alternative_blockchain(alt_chain, true);
 
@@ -1588,7 +1737,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     else if(main_chain_cumulative_difficulty < bei.cumulative_difficulty) //check if difficulty bigger then in main chain
     {
       //do reorganize!
-      MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_db->height() - 1 << " with cum_difficulty " << m_db->get_block_cumulative_difficulty(m_db->height() - 1) << std::endl << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << bei.cumulative_difficulty);
+      MGINFO_GREEN("###### REORGANIZE on height: " << alt_chain.front().data.height << " of " << m_db->height() - 1 << " with cum_difficulty " << m_db->get_block_cumulative_difficulty(m_db->height() - 1) << std::endl << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << bei.cumulative_difficulty);
 
       bool r = switch_to_alternative_blockchain(alt_chain, false);
       if (r)
@@ -1608,7 +1757,7 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     //block orphaned
     bvc.m_marked_as_orphaned = true;
     MERROR_VER("Block recognized as orphaned and rejected, id = " << id << ", height " << block_height
-        << ", parent in alt " << (it_prev != m_alternative_chains.end()) << ", parent in main " << parent_in_main
+        << ", parent in alt " << parent_in_alt << ", parent in main " << parent_in_main
         << " (parent " << b.prev_id << ", current top " << get_tail_id() << ", chain height " << get_current_blockchain_height() << ")");
   }
 
@@ -1619,6 +1768,7 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
   if(start_offset >= m_db->height())
     return false;
 
@@ -1627,10 +1777,10 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
     return false;
   }
 
+  std::vector<crypto::hash> missed_ids;
   for(const auto& blk : blocks)
   {
-    std::vector<crypto::hash> missed_ids;
-    get_transactions_blobs(blk.second.tx_hashes, txs, missed_ids);
+    get_block_transactions_blobs(blk.second, txs, missed_ids);
     CHECK_AND_ASSERT_MES(!missed_ids.size(), false, "has missed transactions in own block in main blockchain");
   }
 
@@ -1641,14 +1791,16 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
   const uint64_t height = m_db->height();
   if(start_offset >= height)
     return false;
 
-  blocks.reserve(blocks.size() + height - start_offset);
-  for(size_t i = start_offset; i < start_offset + count && i < height;i++)
+  const uint64_t end_offset = std::min<uint64_t>(start_offset + count, height);
+  blocks.reserve(blocks.size() + end_offset - start_offset);
+  for(uint64_t i = start_offset; i < end_offset; i++)
   {
-    blocks.push_back(std::make_pair(m_db->get_block_blob_from_height(i), block()));
+    blocks.emplace_back(m_db->get_block_blob_from_height(i), block());
     if (!parse_and_validate_block_from_blob(blocks.back().first, blocks.back().second))
     {
       LOG_ERROR("Invalid block");
@@ -1658,70 +1810,165 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
   return true;
 }
 //------------------------------------------------------------------
-//TODO: This function *looks* like it won't need to be rewritten
-//      to use BlockchainDB, as it calls other functions that were,
-//      but it warrants some looking into later.
-//
+bool Blockchain::get_block_filters(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& filters) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
+  const uint64_t height = m_db->height();
+  if (start_height >= height)
+    return false;
+
+  const uint64_t end_height = std::min<uint64_t>(start_height + count, height);
+  filters.reserve(filters.size() + end_height - start_height);
+  for (uint64_t h = start_height; h < end_height; ++h)
+  {
+    filters.push_back(cryptonote::blobdata());
+    if (m_db->get_block_filter(h, filters.back()))
+      continue;
+
+    // blocks added before filters were stored, build it from the tx prefixes
+    block b;
+    epee::span<const uint8_t> view;
+    const bool parsed = m_db->get_block_blob_view(h, view) ? parse_and_validate_block_from_blob(view, b) :
+        parse_and_validate_block_from_blob(m_db->get_block_blob_from_height(h), b);
+    if (!parsed)
+    {
+      LOG_ERROR("Invalid block at height " << h);
+      return false;
+    }
+    std::vector<transaction> txs(b.tx_hashes.size());
+    for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+    {
+      cryptonote::blobdata tx_blob;
+      if (!m_db->get_pruned_tx_blob(b.tx_hashes[i], tx_blob) || !parse_and_validate_tx_base_from_blob(tx_blob, txs[i]))
+      {
+        LOG_ERROR("Failed to get tx " << b.tx_hashes[i] << " of block at height " << h);
+        return false;
+      }
+    }
+    filters.back() = make_block_filter_blob(b, txs);
+  }
+  return true;
+}
+//------------------------------------------------------------------
 //FIXME: This function appears to want to return false if any transactions
 //       that belong with blocks are missing, but not if blocks themselves
 //       are missing.
-bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)
+bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, std::string& rsp_blob)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_db->block_txn_start(true);
-  rsp.current_blockchain_height = get_current_blockchain_height();
-  std::vector<std::pair<cryptonote::blobdata,block>> blocks;
-  get_blocks(arg.blocks, blocks, rsp.missed_ids);
-
-  for (auto& bl: blocks)
+  std::vector<std::shared_ptr<const std::string>> entries;
+  entries.reserve(arg.blocks.size());
   {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    db_rtxn_guard rtxn_guard(m_db);
+    rsp.current_blockchain_height = get_current_blockchain_height();
+
     std::vector<crypto::hash> missed_tx_ids;
-    std::vector<cryptonote::blobdata> txs;
+    for (const auto &id: arg.blocks)
+    {
+      // only blocks on the main chain are served, so a cached entry for a
+      // block which has since been popped is not handed out
+      uint64_t height;
+      if (!m_db->block_exists(id, &height))
+      {
+        rsp.missed_ids.push_back(id);
+        continue;
+      }
 
-    rsp.blocks.push_back(block_complete_entry());
-    block_complete_entry& e = rsp.blocks.back();
+      std::shared_ptr<const std::string> entry = get_cached_block_entry(id);
+      if (!entry)
+      {
+        block_complete_entry e;
+        block bl;
+        e.block = m_db->get_block_blob_from_height(height);
+        if (!parse_and_validate_block_from_blob(e.block, bl))
+        {
+          LOG_ERROR("Invalid block: " << id);
+          rsp.missed_ids.push_back(id);
+          continue;
+        }
 
-    // FIXME: s/rsp.missed_ids/missed_tx_id/ ?  Seems like rsp.missed_ids
-    //        is for missed blocks, not missed transactions as well.
-    get_transactions_blobs(bl.second.tx_hashes, e.txs, missed_tx_ids);
+        // FIXME: s/rsp.missed_ids/missed_tx_id/ ?  Seems like rsp.missed_ids
+        //        is for missed blocks, not missed transactions as well.
+        get_block_transactions_blobs(bl, e.txs, missed_tx_ids);
 
-    if (missed_tx_ids.size() != 0)
-    {
-      LOG_ERROR("Error retrieving blocks, missed " << missed_tx_ids.size()
-          << " transactions for block with hash: " << get_block_hash(bl.second)
-          << std::endl
-      );
+        if (missed_tx_ids.size() != 0)
+        {
+          LOG_ERROR("Error retrieving blocks, missed " << missed_tx_ids.size()
+              << " transactions for block with hash: " << id
+              << std::endl
+          );
+
+          // append missed transaction hashes to response missed_ids field,
+          // as done below if any standalone transactions were requested
+          // and missed.
+          rsp.missed_ids.insert(rsp.missed_ids.end(), missed_tx_ids.begin(), missed_tx_ids.end());
+          return false;
+        }
 
-      // append missed transaction hashes to response missed_ids field,
-      // as done below if any standalone transactions were requested
-      // and missed.
-      rsp.missed_ids.insert(rsp.missed_ids.end(), missed_tx_ids.begin(), missed_tx_ids.end());
-      m_db->block_txn_stop();
-      return false;
+        entry = std::make_shared<const std::string>(get_objects_serialization::serialize_block_entry(e));
+        add_cached_block_entry(id, entry);
+      }
+      entries.push_back(std::move(entry));
     }
-
-    //pack block
-    e.block = std::move(bl.first);
+    //get and pack other transactions, if needed
+    get_transactions_blobs(arg.txs, rsp.txs, rsp.missed_ids);
   }
-  //get and pack other transactions, if needed
-  std::vector<cryptonote::blobdata> txs;
-  get_transactions_blobs(arg.txs, rsp.txs, rsp.missed_ids);
 
-  m_db->block_txn_stop();
+  // the entries are immutable, so the response is put together without
+  // holding up the blockchain
+  CHECK_AND_ASSERT_MES(get_objects_serialization::serialize_response(rsp, entries, rsp_blob), false,
+      "Failed to serialize NOTIFY_RESPONSE_GET_OBJECTS");
   return true;
 }
 //------------------------------------------------------------------
+std::shared_ptr<const std::string> Blockchain::get_cached_block_entry(const crypto::hash &id)
+{
+  boost::unique_lock<boost::mutex> lock(m_block_entry_cache_lock);
+  const auto i = m_block_entry_index.find(id);
+  if (i == m_block_entry_index.end())
+    return nullptr;
+  m_block_entries.splice(m_block_entries.begin(), m_block_entries, i->second);
+  return i->second->second;
+}
+//------------------------------------------------------------------
+void Blockchain::add_cached_block_entry(const crypto::hash &id, const std::shared_ptr<const std::string> &entry)
+{
+  boost::unique_lock<boost::mutex> lock(m_block_entry_cache_lock);
+  if (entry->size() > m_block_entry_cache_max_bytes || m_block_entry_index.find(id) != m_block_entry_index.end())
+    return;
+  m_block_entries.emplace_front(id, entry);
+  m_block_entry_index[id] = m_block_entries.begin();
+  m_block_entry_cache_bytes += entry->size();
+  while (m_block_entry_cache_bytes > m_block_entry_cache_max_bytes)
+  {
+    m_block_entry_cache_bytes -= m_block_entries.back().second->size();
+    m_block_entry_index.erase(m_block_entries.back().first);
+    m_block_entries.pop_back();
+  }
+}
+//------------------------------------------------------------------
 bool Blockchain::get_alternative_blocks(std::vector<block>& blocks) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  blocks.reserve(m_alternative_chains.size());
-  for (const auto& alt_bl: m_alternative_chains)
-  {
-    blocks.push_back(alt_bl.second.bl);
-  }
+  blocks.reserve(m_db->get_alt_block_count());
+  m_db->for_all_alt_blocks([&blocks](const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata *blob) {
+    if (!blob)
+    {
+      MERROR("No blob, but blobs were requested");
+      return false;
+    }
+    cryptonote::block bl;
+    if (cryptonote::parse_and_validate_block_from_blob(*blob, bl))
+      blocks.push_back(std::move(bl));
+    else
+      MERROR("Failed to parse block from blob");
+    return true;
+  }, true);
   return true;
 }
 //------------------------------------------------------------------
@@ -1729,69 +1976,200 @@ size_t Blockchain::get_alternative_blocks_count() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  return m_alternative_chains.size();
+  return m_db->get_alt_block_count();
 }
 //------------------------------------------------------------------
-// This function adds the output specified by <amount, i> to the result_outs container
-// unlocked and other such checks should be done by here.
-uint64_t Blockchain::get_num_mature_outputs(uint64_t amount) const
+bool Blockchain::get_alt_block(const crypto::hash& id, block_extended_info& bei) const
 {
-  uint64_t num_outs = m_db->get_num_outputs(amount);
-  // ensure we don't include outputs that aren't yet eligible to be used
-  // outpouts are sorted by height
-  while (num_outs > 0)
+  alt_block_data_t data;
+  cryptonote::blobdata blob;
+  if (!m_db->get_alt_block(id, &data, &blob))
+    return false;
+  if (!parse_and_validate_block_from_blob(blob, bei.bl))
   {
-    const tx_out_index toi = m_db->get_output_tx_and_index(amount, num_outs - 1);
-    const uint64_t height = m_db->get_tx_block_height(toi.first);
-    if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= m_db->height())
-      break;
-    --num_outs;
+    MERROR("Failed to parse alternative block " << id << " from the db");
+    return false;
   }
-
-  return num_outs;
-}
-
-crypto::public_key Blockchain::get_output_key(uint64_t amount, uint64_t global_index) const
-{
-  output_data_t data = m_db->get_output_key(amount, global_index);
-  return data.pubkey;
+  bei.height = data.height;
+  bei.block_cumulative_weight = data.cumulative_weight;
+  bei.cumulative_difficulty = data.cumulative_difficulty;
+  bei.already_generated_coins = data.already_generated_coins;
+  return true;
 }
-
 //------------------------------------------------------------------
-bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
+bool Blockchain::add_alt_block(const alt_chain_entry& entry, const block& b)
 {
-  LOG_PRINT_L3("Blockchain::" << __func__);
-  CRITICAL_REGION_LOCAL(m_blockchain_lock);
-
-  res.outs.clear();
-  res.outs.reserve(req.outputs.size());
   try
   {
-    for (const auto &i: req.outputs)
+    // joins the sync batch if there is one
+    const bool stop_batch = m_db->batch_start();
+    try
     {
-      // get tx_hash, tx_out_index from DB
-      const output_data_t od = m_db->get_output_key(i.amount, i.index);
-      tx_out_index toi = m_db->get_output_tx_and_index(i.amount, i.index);
-      bool unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
-
-      res.outs.push_back({od.pubkey, od.commitment, unlocked, od.height, toi.first});
+      m_db->add_alt_block(entry.id, entry.data, block_to_blob(b));
+    }
+    catch (...)
+    {
+      if (stop_batch)
+        m_db->batch_stop();
+      throw;
     }
+    if (stop_batch)
+      m_db->batch_stop();
   }
   catch (const std::exception &e)
   {
+    MERROR("Failed to store alternative block " << entry.id << ": " << e.what());
     return false;
   }
   return true;
 }
 //------------------------------------------------------------------
-void Blockchain::get_output_key_mask_unlocked(const uint64_t& amount, const uint64_t& index, crypto::public_key& key, rct::key& mask, bool& unlocked) const
+void Blockchain::remove_alt_blocks(const std::vector<crypto::hash>& ids)
 {
-  const auto o_data = m_db->get_output_key(amount, index);
-  key = o_data.pubkey;
-  mask = o_data.commitment;
-  tx_out_index toi = m_db->get_output_tx_and_index(amount, index);
-  unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
-}
+  if (ids.empty())
+    return;
+  try
+  {
+    const bool stop_batch = m_db->batch_start();
+    try
+    {
+      for (const crypto::hash &id: ids)
+        m_db->remove_alt_block(id);
+    }
+    catch (...)
+    {
+      if (stop_batch)
+        m_db->batch_stop();
+      throw;
+    }
+    if (stop_batch)
+      m_db->batch_stop();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to remove alternative blocks: " << e.what());
+  }
+}
+//------------------------------------------------------------------
+void Blockchain::prune_alt_blocks()
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  const uint64_t height = m_db->height();
+  if (height <= BLOCKCHAIN_ALT_BLOCKS_MAX_DEPTH)
+    return;
+  const uint64_t cutoff = height - BLOCKCHAIN_ALT_BLOCKS_MAX_DEPTH;
+
+  std::unordered_map<crypto::hash, crypto::hash> parents;
+  std::vector<crypto::hash> recent;
+  m_db->for_all_alt_blocks([&parents, &recent, cutoff](const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata *blob) {
+    parents[blkid] = data.prev_id;
+    if (data.height >= cutoff)
+      recent.push_back(blkid);
+    return true;
+  }, false);
+  if (recent.size() == parents.size())
+    return;
+
+  // a recent block keeps the part of its chain below the cutoff too, so
+  // chains are only ever pruned whole
+  std::unordered_set<crypto::hash> keep;
+  for (const crypto::hash &id: recent)
+  {
+    auto it = parents.find(id);
+    while (it != parents.end() && keep.insert(it->first).second)
+      it = parents.find(it->second);
+  }
+
+  std::vector<crypto::hash> stale;
+  for (const auto &e: parents)
+    if (keep.find(e.first) == keep.end())
+      stale.push_back(e.first);
+  if (stale.empty())
+    return;
+  MINFO("Pruning " << stale.size() << " alternative blocks more than " << BLOCKCHAIN_ALT_BLOCKS_MAX_DEPTH << " blocks deep");
+  remove_alt_blocks(stale);
+}
+//------------------------------------------------------------------
+// This function adds the output specified by <amount, i> to the result_outs container
+// unlocked and other such checks should be done by here.
+uint64_t Blockchain::get_num_mature_outputs(uint64_t amount) const
+{
+  uint64_t num_outs = m_db->get_num_outputs(amount);
+  // ensure we don't include outputs that aren't yet eligible to be used
+  // outpouts are sorted by height
+  while (num_outs > 0)
+  {
+    const tx_out_index toi = m_db->get_output_tx_and_index(amount, num_outs - 1);
+    const uint64_t height = m_db->get_tx_block_height(toi.first);
+    if (height + CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE <= m_db->height())
+      break;
+    --num_outs;
+  }
+
+  return num_outs;
+}
+
+crypto::public_key Blockchain::get_output_key(uint64_t amount, uint64_t global_index) const
+{
+  output_data_t data = m_db->get_output_key(amount, global_index);
+  return data.pubkey;
+}
+
+//------------------------------------------------------------------
+bool Blockchain::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
+
+  res.outs.clear();
+  res.outs.resize(req.outputs.size());
+  try
+  {
+    // look outputs up per amount, in index order, with the batched calls:
+    // ring members of one tx are mostly rct outputs, so this is usually
+    // a couple of sorted walks rather than one seek per output
+    std::map<uint64_t, std::vector<std::pair<uint64_t, size_t>>> by_amount;
+    for (size_t n = 0; n < req.outputs.size(); ++n)
+      by_amount[req.outputs[n].amount].push_back(std::make_pair(req.outputs[n].index, n));
+    std::vector<uint64_t> offsets;
+    std::vector<output_data_t> data;
+    std::vector<tx_out_index> indices;
+    for (auto &e: by_amount)
+    {
+      std::sort(e.second.begin(), e.second.end());
+      offsets.clear();
+      for (const auto &o: e.second)
+        offsets.push_back(o.first);
+      m_db->get_output_key(e.first, offsets, data);
+      m_db->get_output_tx_and_index(e.first, offsets, indices);
+      CHECK_AND_ASSERT_MES(data.size() == offsets.size() && indices.size() == offsets.size(), false, "Unexpected number of outputs returned");
+      for (size_t n = 0; n < offsets.size(); ++n)
+      {
+        const output_data_t &od = data[n];
+        const tx_out_index &toi = indices[n];
+        bool unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
+        res.outs[e.second[n].second] = {od.pubkey, od.commitment, unlocked, od.height, toi.first};
+      }
+    }
+  }
+  catch (const std::exception &e)
+  {
+    return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------
+void Blockchain::get_output_key_mask_unlocked(const uint64_t& amount, const uint64_t& index, crypto::public_key& key, rct::key& mask, bool& unlocked) const
+{
+  const auto o_data = m_db->get_output_key(amount, index);
+  key = o_data.pubkey;
+  mask = o_data.commitment;
+  tx_out_index toi = m_db->get_output_tx_and_index(amount, index);
+  unlocked = is_tx_spendtime_unlocked(m_db->get_tx_unlock_time(toi.first));
+}
 //------------------------------------------------------------------
 bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, uint64_t &start_height, std::vector<uint64_t> &distribution, uint64_t &base) const
 {
@@ -1827,11 +2205,7 @@ bool Blockchain::get_output_distribution(uint64_t amount, uint64_t from_height,
     return false;
   if (amount == 0)
   {
-    std::vector<uint64_t> heights;
-    heights.reserve(to_height + 1 - start_height);
-    for (uint64_t h = start_height; h <= to_height; ++h)
-      heights.push_back(h);
-    distribution = m_db->get_block_cumulative_rct_outputs(heights);
+    distribution = m_db->get_block_cumulative_rct_outputs_range(start_height, to_height);
     base = 0;
     return true;
   }
@@ -1857,36 +2231,35 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  m_db->block_txn_start(true);
-  // make sure that the last block in the request's block list matches
-  // the genesis block
-  auto gen_hash = m_db->get_block_hash_from_height(0);
-  if(qblock_ids.back() != gen_hash)
-  {
-    MCERROR("net.p2p", "Client sent wrong NOTIFY_REQUEST_CHAIN: genesis block mismatch: " << std::endl << "id: " << qblock_ids.back() << ", " << std::endl << "expected: " << gen_hash << "," << std::endl << " dropping connection");
-	m_db->block_txn_abort();
-    return false;
-  }
-
-  // Find the first block the foreign chain has that we also have.
-  // Assume qblock_ids is in reverse-chronological order.
   auto bl_it = qblock_ids.begin();
   uint64_t split_height = 0;
-  for(; bl_it != qblock_ids.end(); bl_it++)
   {
-    try
+    db_rtxn_guard rtxn_guard(m_db);
+    // make sure that the last block in the request's block list matches
+    // the genesis block
+    auto gen_hash = m_db->get_block_hash_from_height(0);
+    if(qblock_ids.back() != gen_hash)
     {
-      if (m_db->block_exists(*bl_it, &split_height))
-        break;
+      MCERROR("net.p2p", "Client sent wrong NOTIFY_REQUEST_CHAIN: genesis block mismatch: " << std::endl << "id: " << qblock_ids.back() << ", " << std::endl << "expected: " << gen_hash << "," << std::endl << " dropping connection");
+      return false;
     }
-    catch (const std::exception& e)
+
+    // Find the first block the foreign chain has that we also have.
+    // Assume qblock_ids is in reverse-chronological order.
+    for(; bl_it != qblock_ids.end(); bl_it++)
     {
-      MWARNING("Non-critical error trying to find block by hash in BlockchainDB, hash: " << *bl_it);
-	  m_db->block_txn_abort();
-      return false;
+      try
+      {
+        if (m_db->block_exists(*bl_it, &split_height))
+          break;
+      }
+      catch (const std::exception& e)
+      {
+        MWARNING("Non-critical error trying to find block by hash in BlockchainDB, hash: " << *bl_it);
+        return false;
+      }
     }
   }
-  m_db->block_txn_stop();
 
   // this should be impossible, as we checked that we share the genesis block,
   // but just in case...
@@ -1921,6 +2294,9 @@ uint64_t Blockchain::block_difficulty(uint64_t i) const
 //------------------------------------------------------------------
 template<typename T> void reserve_container(std::vector<T> &v, size_t N) { v.reserve(N); }
 template<typename T> void reserve_container(std::list<T> &v, size_t N) { }
+// the DB takes a vector of hashes, only copy the ids when they come in another container
+const std::vector<crypto::hash> &hash_vector(const std::vector<crypto::hash> &ids, std::vector<crypto::hash> &storage) { return ids; }
+template<typename T> const std::vector<crypto::hash> &hash_vector(const T &ids, std::vector<crypto::hash> &storage) { storage.assign(ids.begin(), ids.end()); return storage; }
 //------------------------------------------------------------------
 //TODO: return type should be void, throw on exception
 //       alternatively, return true only if no blocks missed
@@ -1929,6 +2305,7 @@ bool Blockchain::get_blocks(const t_ids_container& block_ids, t_blocks_container
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
 
   reserve_container(blocks, block_ids.size());
   for (const auto& block_hash : block_ids)
@@ -1938,7 +2315,7 @@ bool Blockchain::get_blocks(const t_ids_container& block_ids, t_blocks_container
       uint64_t height = 0;
       if (m_db->block_exists(block_hash, &height))
       {
-        blocks.push_back(std::make_pair(m_db->get_block_blob_from_height(height), block()));
+        blocks.emplace_back(m_db->get_block_blob_from_height(height), block());
         if (!parse_and_validate_block_from_blob(blocks.back().first, blocks.back().second))
         {
           LOG_ERROR("Invalid block: " << block_hash);
@@ -1964,26 +2341,52 @@ bool Blockchain::get_transactions_blobs(const t_ids_container& txs_ids, t_tx_con
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
 
   reserve_container(txs, txs_ids.size());
-  for (const auto& tx_hash : txs_ids)
+  std::vector<crypto::hash> hashes_storage;
+  const std::vector<crypto::hash> &hashes = hash_vector(txs_ids, hashes_storage);
+  std::vector<cryptonote::blobdata> blobs;
+  std::vector<bool> found;
+  try
   {
-    try
-    {
-      cryptonote::blobdata tx;
-      if (pruned && m_db->get_pruned_tx_blob(tx_hash, tx))
-        txs.push_back(std::move(tx));
-      else if (!pruned && m_db->get_tx_blob(tx_hash, tx))
-        txs.push_back(std::move(tx));
-      else
-        missed_txs.push_back(tx_hash);
-    }
-    catch (const std::exception& e)
+    m_db->get_tx_blobs(hashes, blobs, found, pruned);
+  }
+  catch (const std::exception& e)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < hashes.size(); ++i)
+  {
+    if (found[i])
+      txs.push_back(std::move(blobs[i]));
+    else
+      missed_txs.push_back(hashes[i]);
+  }
+  return true;
+}
+//------------------------------------------------------------------
+void Blockchain::get_block_transactions_blobs(const block& b, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs, bool pruned) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  std::vector<cryptonote::blobdata> blobs;
+  try
+  {
+    if (m_db->get_block_tx_blobs(get_block_height(b), blobs, pruned) && blobs.size() == b.tx_hashes.size())
     {
-      return false;
+      txs.reserve(txs.size() + blobs.size());
+      for (auto &blob: blobs)
+        txs.push_back(std::move(blob));
+      return;
     }
   }
-  return true;
+  catch (const std::exception &e)
+  {
+    MDEBUG("Failed to get txes of block " << get_block_hash(b) << " by range: " << e.what());
+  }
+  get_transactions_blobs(b.tx_hashes, txs, missed_txs, pruned);
 }
 //------------------------------------------------------------------
 template<class t_ids_container, class t_tx_container, class t_missed_container>
@@ -1991,29 +2394,34 @@ bool Blockchain::get_transactions(const t_ids_container& txs_ids, t_tx_container
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
 
   reserve_container(txs, txs_ids.size());
-  for (const auto& tx_hash : txs_ids)
+  std::vector<crypto::hash> hashes_storage;
+  const std::vector<crypto::hash> &hashes = hash_vector(txs_ids, hashes_storage);
+  std::vector<cryptonote::blobdata> blobs;
+  std::vector<bool> found;
+  try
   {
-    try
+    m_db->get_tx_blobs(hashes, blobs, found);
+  }
+  catch (const std::exception& e)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < hashes.size(); ++i)
+  {
+    if (found[i])
     {
-      cryptonote::blobdata tx;
-      if (m_db->get_tx_blob(tx_hash, tx))
+      txs.push_back(transaction());
+      if (!parse_and_validate_tx_from_blob(blobs[i], txs.back()))
       {
-        txs.push_back(transaction());
-        if (!parse_and_validate_tx_from_blob(tx, txs.back()))
-        {
-          LOG_ERROR("Invalid transaction");
-          return false;
-        }
+        LOG_ERROR("Invalid transaction");
+        return false;
       }
-      else
-        missed_txs.push_back(tx_hash);
-    }
-    catch (const std::exception& e)
-    {
-      return false;
     }
+    else
+      missed_txs.push_back(hashes[i]);
   }
   return true;
 }
@@ -2032,7 +2440,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     return false;
   }
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(m_db);
   current_height = get_current_blockchain_height();
   size_t count = 0;
   hashes.reserve(std::max((size_t)(current_height - start_height), (size_t)BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT));
@@ -2041,11 +2449,10 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
     hashes.push_back(m_db->get_block_hash_from_height(i));
   }
 
-  m_db->block_txn_stop();
   return true;
 }
 
-bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
+bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, size_t max_headers) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -2054,6 +2461,24 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
   if (result)
     resp.cumulative_difficulty = m_db->get_block_cumulative_difficulty(resp.total_height - 1);
 
+  if (result && max_headers)
+  {
+    // taken under the same lock as the ids, so they match even if the chain changes right after
+    const size_t count = std::min(max_headers, resp.m_block_ids.size());
+    resp.m_block_headers.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(m_db->get_block_blob_from_height(resp.start_height + i), b))
+      {
+        MERROR("Failed to parse block at height " << resp.start_height + i);
+        resp.m_block_headers.clear();
+        break;
+      }
+      resp.m_block_headers.push_back(get_block_hashing_blob(b));
+    }
+  }
+
   return result;
 }
 //------------------------------------------------------------------
@@ -2061,7 +2486,7 @@ bool Blockchain::find_blockchain_supplement(const std::list<crypto::hash>& qbloc
 // find split point between ours and foreign blockchain (or start at
 // blockchain height <req_start_block>), and return up to max_count FULL
 // blocks by reference.
-bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const
+bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -2084,10 +2509,13 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
     }
   }
 
-  m_db->block_txn_start(true);
+  db_rtxn_guard rtxn_guard(m_db);
   total_height = get_current_blockchain_height();
   size_t count = 0, size = 0;
   blocks.reserve(std::min(std::min(max_count, (size_t)10000), (size_t)(total_height - start_height)));
+  m_db->prefetch_blocks(start_height, max_count);
+  std::vector<crypto::hash> mis;
+  std::vector<cryptonote::blobdata> txs;
   for(uint64_t i = start_height; i < total_height && count < max_count && (size < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE || count < 3); i++, count++)
   {
     blocks.resize(blocks.size()+1);
@@ -2095,9 +2523,9 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
     block b;
     CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blocks.back().first.first, b), false, "internal error, invalid block");
     blocks.back().first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
-    std::vector<crypto::hash> mis;
-    std::vector<cryptonote::blobdata> txs;
-    get_transactions_blobs(b.tx_hashes, txs, mis, pruned);
+    mis.clear();
+    txs.clear();
+    get_block_transactions_blobs(b, txs, mis, pruned);
     CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, transaction from block not found");
     size += blocks.back().first.first.size();
     for (const auto &t: txs)
@@ -2110,7 +2538,15 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
       blocks.back().second.push_back(std::make_pair(b.tx_hashes[i], std::move(txs[i])));
     }
   }
-  m_db->block_txn_stop();
+
+  // in the same txn, so they match the blocks
+  if (output_indices)
+  {
+    m_db->get_blocks_amount_output_indices(start_height, blocks.size(), *output_indices);
+    CHECK_AND_ASSERT_MES(output_indices->size() == blocks.size(), false, "mismatched sizes of blocks and output indices");
+    for (size_t i = 0; i < blocks.size(); ++i)
+      CHECK_AND_ASSERT_MES((*output_indices)[i].size() == 1 + blocks[i].second.size(), false, "mismatched sizes of block txes and output indices");
+  }
   return true;
 }
 //------------------------------------------------------------------
@@ -2128,10 +2564,47 @@ bool Blockchain::add_block_as_invalid(const block_extended_info& bei, const cryp
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   auto i_res = m_invalid_blocks.insert(std::map<crypto::hash, block_extended_info>::value_type(h, bei));
   CHECK_AND_ASSERT_MES(i_res.second, false, "at insertion invalid by tx returned status existed");
+  m_invalid_blocks_order.push_back(h);
+  while (m_invalid_blocks_order.size() > m_max_invalid_blocks)
+  {
+    m_invalid_blocks.erase(m_invalid_blocks_order.front());
+    m_invalid_blocks_order.pop_front();
+  }
   MINFO("BLOCK ADDED AS INVALID: " << h << std::endl << ", prev_id=" << bei.bl.prev_id << ", m_invalid_blocks count=" << m_invalid_blocks.size());
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::reset_validation_tables()
+{
+  // the tables must let go of their nodes before the memory goes away
+  m_scan_table = make_validation_container<scan_table_t>();
+  m_check_txin_table = make_validation_container<check_txin_table_t>();
+  m_validation_arena.release();
+}
+//------------------------------------------------------------------
+void Blockchain::set_max_invalid_blocks(size_t max_blocks)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  m_max_invalid_blocks = max_blocks;
+  while (m_invalid_blocks_order.size() > m_max_invalid_blocks)
+  {
+    m_invalid_blocks.erase(m_invalid_blocks_order.front());
+    m_invalid_blocks_order.pop_front();
+  }
+}
+//------------------------------------------------------------------
+void Blockchain::set_block_entry_cache_size(size_t bytes)
+{
+  boost::unique_lock<boost::mutex> lock(m_block_entry_cache_lock);
+  m_block_entry_cache_max_bytes = bytes;
+  while (m_block_entry_cache_bytes > m_block_entry_cache_max_bytes)
+  {
+    m_block_entry_cache_bytes -= m_block_entries.back().second->size();
+    m_block_entry_index.erase(m_block_entries.back().first);
+    m_block_entries.pop_back();
+  }
+}
+//------------------------------------------------------------------
 bool Blockchain::have_block(const crypto::hash& id) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2143,9 +2616,9 @@ bool Blockchain::have_block(const crypto::hash& id) const
     return true;
   }
 
-  if(m_alternative_chains.count(id))
+  if(m_db->get_alt_block(id, NULL, NULL))
   {
-    LOG_PRINT_L2("block " << id << " found in m_alternative_chains");
+    LOG_PRINT_L2("block " << id << " found in alternative chains");
     return true;
   }
 
@@ -2311,16 +2784,91 @@ bool Blockchain::check_tx_inputs(transaction& tx, uint64_t& max_used_block_heigh
   if(m_show_time_stats)
   {
     size_t ring_size = !tx.vin.empty() && tx.vin[0].type() == typeid(txin_to_key) ? boost::get<txin_to_key>(tx.vin[0]).key_offsets.size() : 0;
-    MINFO("HASH: " <<  get_transaction_hash(tx) << " I/M/O: " << tx.vin.size() << "/" << ring_size << "/" << tx.vout.size() << " H: " << max_used_block_height << " ms: " << a + m_fake_scan_time << " B: " << get_object_blobsize(tx) << " W: " << get_transaction_weight(tx));
+    MINFO("HASH: " <<  get_transaction_hash(tx) << " I/M/O: " << tx.vin.size() << "/" << ring_size << "/" << tx.vout.size() << " H: " << max_used_block_height << " ms: " << a + m_fake_scan_time << " B: " << get_transaction_blob_size(tx) << " W: " << get_transaction_weight(tx));
   }
   if (!res)
     return false;
 
   CHECK_AND_ASSERT_MES(max_used_block_height < m_db->height(), false,  "internal error: max used block index=" << max_used_block_height << " is not less then blockchain size = " << m_db->height());
   max_used_block_id = m_db->get_block_hash_from_height(max_used_block_height);
+  add_verified_tx(get_transaction_hash(tx), max_used_block_height, max_used_block_id);
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::add_verified_tx(const crypto::hash &txid, uint64_t max_used_block_height, const crypto::hash &max_used_block_id)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const auto i = m_verified_txes.find(txid);
+  if (i != m_verified_txes.end())
+  {
+    i->second = std::make_pair(max_used_block_height, max_used_block_id);
+    return;
+  }
+  m_verified_txes.emplace(txid, std::make_pair(max_used_block_height, max_used_block_id));
+  m_verified_txes_order.push_back(txid);
+  while (m_verified_txes_order.size() > VERIFIED_TX_CACHE_SIZE)
+  {
+    m_verified_txes.erase(m_verified_txes_order.front());
+    m_verified_txes_order.pop_front();
+  }
+}
+//------------------------------------------------------------------
+bool Blockchain::is_tx_verified(const crypto::hash &txid) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const auto i = m_verified_txes.find(txid);
+  if (i == m_verified_txes.end())
+    return false;
+  const uint64_t height = i->second.first;
+  return height < m_db->height() && m_db->get_block_hash_from_height(height) == i->second.second;
+}
+//------------------------------------------------------------------
+void Blockchain::check_tx_inputs_batch(std::vector<tx_input_check> &txes)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  PERF_TIMER(check_tx_inputs_batch);
+  std::vector<signature_job> jobs;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    for (size_t i = 0; i < txes.size(); ++i)
+    {
+      tx_input_check &check = txes[i];
+      check.max_used_block_height = 0;
+      check.max_used_block_id = crypto::null_hash;
+      check.result = check_tx_inputs(*check.tx, check.tvc, &check.max_used_block_height, &jobs, i);
+      if (check.result && check.max_used_block_height >= m_db->height())
+      {
+        MERROR("internal error: max used block index=" << check.max_used_block_height << " is not less then blockchain size = " << m_db->height());
+        check.result = false;
+      }
+      if (!check.result)
+      {
+        // a failing tx may have queued some of its checks already
+        while (!jobs.empty() && jobs.back().tx_index == i)
+          jobs.pop_back();
+        continue;
+      }
+      check.max_used_block_id = m_db->get_block_hash_from_height(check.max_used_block_height);
+    }
+  }
+
+  std::vector<uint64_t> results;
+  run_signature_jobs(jobs, results);
+  for (size_t i = 0; i < jobs.size(); ++i)
+  {
+    tx_input_check &check = txes[jobs[i].tx_index];
+    if (!results[i] && check.result)
+    {
+      MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(*jobs[i].tx) << " input " << jobs[i].input_index);
+      check.result = false;
+    }
+  }
+
+  for (const tx_input_check &check : txes)
+    if (check.result)
+      add_verified_tx(get_transaction_hash(*check.tx), check.max_used_block_height, check.max_used_block_id);
+}
+//------------------------------------------------------------------
 bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context &tvc)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2398,13 +2946,16 @@ bool Blockchain::check_tx_outputs(const transaction& tx, tx_verification_context
 bool Blockchain::have_tx_keyimges_as_spent(const transaction &tx) const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(tx.vin.size());
   for (const txin_v& in: tx.vin)
   {
     CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, in_to_key, true);
-    if(have_tx_keyimg_as_spent(in_to_key.k_image))
-      return true;
+    key_images.push_back(in_to_key.k_image);
   }
-  return false;
+  std::vector<bool> spent;
+  have_key_images_as_spent(key_images, spent);
+  return std::find(spent.begin(), spent.end(), true) != spent.end();
 }
 bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys)
 {
@@ -2482,7 +3033,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, std::vector<signature_job> *deferred, size_t tx_index, bool trusted_signatures)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -2589,10 +3140,15 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       }
     }
   }
+  // signatures already checked in the pool against the same ring members, or
+  // vouched for by the embedded block hashes, need not be checked again,
+  // everything else still is
+  const bool signatures_verified = trusted_signatures || is_tx_verified(get_transaction_hash(tx));
+
   auto it = m_check_txin_table.find(tx_prefix_hash);
   if(it == m_check_txin_table.end())
   {
-    m_check_txin_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, bool>());
+    m_check_txin_table.emplace(tx_prefix_hash, make_validation_container<check_txin_inputs_t>());
     it = m_check_txin_table.find(tx_prefix_hash);
     assert(it != m_check_txin_table.end());
   }
@@ -2647,6 +3203,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     // make sure that output being spent matches up correctly with the
     // signature spending it.
+    const uint64_t ring_members_start = block_trace_scope::now_us();
     if (!check_tx_input(tx.version, in_to_key, tx_prefix_hash, tx.version == 1 ? tx.signatures[sig_index] : std::vector<crypto::signature>(), tx.rct_signatures, pubkeys[sig_index], pmax_used_block_height))
     {
       it->second[in_to_key.k_image] = false;
@@ -2658,10 +3215,26 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
       return false;
     }
+    block_trace_scope::add_ring_members_time(ring_members_start);
 
     if (tx.version == 1)
     {
-      if (threads > 1)
+      if (signatures_verified)
+      {
+        results[sig_index] = 1;
+        it->second[in_to_key.k_image] = true;
+      }
+      else if (deferred)
+      {
+        deferred->push_back(signature_job());
+        signature_job &job = deferred->back();
+        job.tx_index = tx_index;
+        job.tx = &tx;
+        job.input_index = sig_index;
+        job.tx_prefix_hash = tx_prefix_hash;
+        job.pubkeys = std::move(pubkeys[sig_index]);
+      }
+      else if (threads > 1)
       {
         // ND: Speedup
         // 1. Thread ring signature verification if possible.
@@ -2688,12 +3261,12 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
 
     sig_index++;
   }
-  if (tx.version == 1 && threads > 1)
+  if (tx.version == 1 && threads > 1 && !deferred)
     waiter.wait(&tpool);
 
   if (tx.version == 1)
   {
-    if (threads > 1)
+    if (threads > 1 && !deferred)
     {
       // save results to table, passed or otherwise
       bool failed = false;
@@ -2782,7 +3355,40 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRctNonSemanticsSimple(rv))
+      if (signatures_verified)
+      {
+        MDEBUG("Ring signatures of tx " << get_transaction_hash(tx) << " were checked already");
+      }
+      else if (deferred)
+      {
+        const rct::keyV &pseudoOuts = rct::is_rct_bulletproof(rv.type) ? rv.p.pseudoOuts : rv.pseudoOuts;
+        if (pseudoOuts.size() != rv.mixRing.size())
+        {
+          MERROR_VER("Failed to check ringct signatures: mismatched pseudoOuts/mixRing sizes");
+          return false;
+        }
+        rct::key message;
+        try
+        {
+          message = rct::get_pre_mlsag_hash(rv, hw::get_device("default"));
+        }
+        catch (const std::exception &e)
+        {
+          MERROR_VER("Failed to check ringct signatures: " << e.what());
+          return false;
+        }
+        for (size_t n = 0; n < rv.mixRing.size(); ++n)
+        {
+          deferred->push_back(signature_job());
+          signature_job &job = deferred->back();
+          job.tx_index = tx_index;
+          job.tx = &tx;
+          job.input_index = n;
+          job.tx_prefix_hash = tx_prefix_hash;
+          job.message = message;
+        }
+      }
+      else if (!rct::verRctNonSemanticsSimple(rv))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -2841,7 +3447,7 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRct(rv, false))
+      if (!signatures_verified && !rct::verRct(rv, false))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -2887,27 +3493,96 @@ void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const
 }
 
 //------------------------------------------------------------------
-uint64_t Blockchain::get_fee_quantization_mask()
+void Blockchain::check_signature_job(const signature_job &job, uint64_t &result)
 {
-  static uint64_t mask = 0;
-  if (mask == 0)
+  const transaction &tx = *job.tx;
+  if (tx.version == 1)
   {
-    mask = 1;
-    for (size_t n = PER_KB_FEE_QUANTIZATION_DECIMALS; n < CRYPTONOTE_DISPLAY_DECIMAL_POINT; ++n)
-      mask *= 10;
+    const txin_to_key& in_to_key = boost::get<txin_to_key>(tx.vin[job.input_index]);
+    check_ring_signature(job.tx_prefix_hash, in_to_key.k_image, job.pubkeys, tx.signatures[job.input_index], result);
+    return;
   }
-  return mask;
+
+  const rct::rctSig &rv = tx.rct_signatures;
+  const rct::keyV &pseudoOuts = rct::is_rct_bulletproof(rv.type) ? rv.p.pseudoOuts : rv.pseudoOuts;
+  result = rct::verRctMGSimple(job.message, rv.p.MGs[job.input_index], rv.mixRing[job.input_index], pseudoOuts[job.input_index]) ? 1 : 0;
 }
 
 //------------------------------------------------------------------
-uint64_t Blockchain::get_dynamic_base_fee(uint64_t block_reward, size_t median_block_weight, uint8_t version)
+void Blockchain::run_signature_jobs(const std::vector<signature_job> &jobs, std::vector<uint64_t> &results)
 {
-  const uint64_t min_block_weight = get_min_block_weight(version);
-  if (median_block_weight < min_block_weight)
-    median_block_weight = min_block_weight;
-  uint64_t hi, lo;
+  results.assign(jobs.size(), 0);
 
-  if (version >= HF_VERSION_PER_BYTE_FEE)
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  if (tpool.get_max_concurrency() > 1 && jobs.size() > 1)
+  {
+    tools::threadpool::waiter waiter;
+    std::vector<std::function<void()>> checks;
+    checks.reserve(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i)
+      checks.push_back(boost::bind(&Blockchain::check_signature_job, this, std::cref(jobs[i]), std::ref(results[i])));
+    tpool.submit_bulk(&waiter, std::move(checks), true);
+    waiter.wait(&tpool);
+  }
+  else
+  {
+    for (size_t i = 0; i < jobs.size(); ++i)
+      check_signature_job(jobs[i], results[i]);
+  }
+}
+
+//------------------------------------------------------------------
+bool Blockchain::check_signature_jobs(const std::vector<signature_job> &jobs, size_t &failed_tx_index)
+{
+  PERF_TIMER(check_signature_jobs);
+  std::vector<uint64_t> results;
+  run_signature_jobs(jobs, results);
+
+  // jobs are queued in tx order, so the first failure is the lowest tx index
+  bool failed = false;
+  for (size_t i = 0; i < jobs.size(); ++i)
+  {
+    const signature_job &job = jobs[i];
+    if (job.tx->version == 1)
+    {
+      const txin_to_key& in_to_key = boost::get<txin_to_key>(job.tx->vin[job.input_index]);
+      auto it = m_check_txin_table.find(job.tx_prefix_hash);
+      if (it == m_check_txin_table.end())
+        it = m_check_txin_table.emplace(job.tx_prefix_hash, make_validation_container<check_txin_inputs_t>()).first;
+      it->second[in_to_key.k_image] = results[i];
+    }
+    if (!failed && !results[i])
+    {
+      MERROR_VER("Failed to check ring signature for tx " << get_transaction_hash(*job.tx) << " input " << job.input_index);
+      failed_tx_index = job.tx_index;
+      failed = true;
+    }
+  }
+  return !failed;
+}
+
+//------------------------------------------------------------------
+uint64_t Blockchain::get_fee_quantization_mask()
+{
+  static uint64_t mask = 0;
+  if (mask == 0)
+  {
+    mask = 1;
+    for (size_t n = PER_KB_FEE_QUANTIZATION_DECIMALS; n < CRYPTONOTE_DISPLAY_DECIMAL_POINT; ++n)
+      mask *= 10;
+  }
+  return mask;
+}
+
+//------------------------------------------------------------------
+uint64_t Blockchain::get_dynamic_base_fee(uint64_t block_reward, size_t median_block_weight, uint8_t version)
+{
+  const uint64_t min_block_weight = get_min_block_weight(version);
+  if (median_block_weight < min_block_weight)
+    median_block_weight = min_block_weight;
+  uint64_t hi, lo;
+
+  if (version >= HF_VERSION_PER_BYTE_FEE)
   {
     lo = mul128(block_reward, DYNAMIC_FEE_REFERENCE_TRANSACTION_WEIGHT, &hi);
     div128_32(hi, lo, min_block_weight, &hi, &lo);
@@ -3005,13 +3680,26 @@ uint64_t Blockchain::get_dynamic_base_fee_estimate(uint64_t grace_blocks) const
     grace_blocks = CRYPTONOTE_REWARD_BLOCKS_WINDOW - 1;
 
   const uint64_t min_block_weight = get_min_block_weight(version);
-  std::vector<size_t> weights;
-  get_last_n_blocks_weights(weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW - grace_blocks);
-  weights.reserve(grace_blocks);
-  for (size_t i = 0; i < grace_blocks; ++i)
-    weights.push_back(min_block_weight);
-
-  uint64_t median = epee::misc_utils::median(weights);
+  uint64_t median;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    const tools::rolling_median<uint64_t> &block_weights = sync_block_weights();
+    if (grace_blocks == 0)
+    {
+      median = block_weights.median();
+    }
+    else
+    {
+      // the most recent blocks, padded with minimum weight ones
+      const std::deque<uint64_t> &recent = block_weights.get_values();
+      const size_t n = std::min<size_t>(recent.size(), CRYPTONOTE_REWARD_BLOCKS_WINDOW - grace_blocks);
+      std::vector<uint64_t> weights(recent.end() - n, recent.end());
+      weights.reserve(n + grace_blocks);
+      for (size_t i = 0; i < grace_blocks; ++i)
+        weights.push_back(min_block_weight);
+      median = epee::misc_utils::median(weights);
+    }
+  }
   if(median <= min_block_weight)
     median = min_block_weight;
 
@@ -3223,6 +3911,7 @@ bool Blockchain::handle_block_to_main_chain(const block& bl, const crypto::hash&
 
   TIME_MEASURE_START(block_processing_time);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  block_trace_scope trace(m_block_tracer, m_db->height(), id);
   TIME_MEASURE_START(t1);
 
   static bool seen_future_version = false;
@@ -3258,6 +3947,7 @@ leave:
   }
 
   TIME_MEASURE_FINISH(t1);
+  trace.lap("version");
   TIME_MEASURE_START(t2);
 
   // make sure block timestamp is not less than the median timestamp
@@ -3270,6 +3960,7 @@ leave:
   }
 
   TIME_MEASURE_FINISH(t2);
+  trace.lap("timestamp");
   //check proof of work
   TIME_MEASURE_START(target_calculating_time);
 
@@ -3282,6 +3973,7 @@ leave:
   CHECK_AND_ASSERT_MES(current_diffic, false, "!!!!!!!!! difficulty overhead !!!!!!!!!");
 
   TIME_MEASURE_FINISH(target_calculating_time);
+  trace.lap("difficulty");
 
   TIME_MEASURE_START(longhash_calculating_time);
 
@@ -3297,6 +3989,7 @@ leave:
   // be a parameter?
   // validate proof_of_work versus difficulty target
   bool precomputed = false;
+  bool pow_cached = false;
   bool fast_check = false;
 #if defined(PER_BLOCK_CHECKPOINT)
   if (m_db->height() < m_blocks_hash_check.size())
@@ -3327,6 +4020,8 @@ leave:
       precomputed = true;
       proof_of_work = it->second;
     }
+    else if (get_cached_pow_hash(id, proof_of_work))
+      pow_cached = true;
     else
       proof_of_work = get_block_longhash(bl, m_db->height());
 
@@ -3354,6 +4049,7 @@ leave:
   TIME_MEASURE_FINISH(longhash_calculating_time);
   if (precomputed)
     longhash_calculating_time += m_fake_pow_calc_time;
+  trace.lap(fast_check ? "pow (embedded hash)" : precomputed ? "pow (precomputed)" : pow_cached ? "pow (cached)" : "pow");
 
   TIME_MEASURE_START(t3);
 
@@ -3370,6 +4066,8 @@ leave:
 
   std::vector<transaction> txs;
   key_images_container keys;
+  // signature checks for the whole block, these point into txs
+  std::vector<signature_job> signature_jobs;
 
   uint64_t fee_summary = 0;
   uint64_t t_checktx = 0;
@@ -3391,6 +4089,7 @@ leave:
     size_t tx_weight = 0;
     uint64_t fee = 0;
     bool relayed = false, do_not_relay = false, double_spend_seen = false;
+    trace.begin_tx(tx_id);
     TIME_MEASURE_START(aa);
 
 // XXX old code does not check whether tx exists
@@ -3417,6 +4116,7 @@ leave:
 
     TIME_MEASURE_FINISH(bb);
     t_pool += bb;
+    trace.tx_taken_from_pool();
     // add the transaction to the temp list of transactions, so we can either
     // store the list of transactions all at once or return the ones we've
     // taken from the tx_pool back to it if the block fails verification.
@@ -3441,15 +4141,13 @@ leave:
     TIME_MEASURE_START(cc);
 
 #if defined(PER_BLOCK_CHECKPOINT)
-    if (!fast_check)
-#endif
+    if (fast_check)
     {
-      // validate that transaction inputs and the keys spending them are correct.
-      tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
+      // ND: if fast_check is enabled for blocks, there is no need to check
+      // the transaction inputs, but do some sanity checks anyway.
+      if (tx_index >= m_blocks_txs_check.size() || memcmp(&m_blocks_txs_check[tx_index++], &tx_id, sizeof(tx_id)) != 0)
       {
-        MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
-
+        MERROR_VER("Block with id: " << id << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
         //TODO: why is this done?  make sure that keeping invalid blocks makes sense.
         add_block_as_invalid(bl, id);
         MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
@@ -3458,14 +4156,17 @@ leave:
         goto leave;
       }
     }
-#if defined(PER_BLOCK_CHECKPOINT)
-    else
+    if (!fast_check || m_fast_sync_state_checks)
+#endif
     {
-      // ND: if fast_check is enabled for blocks, there is no need to check
-      // the transaction inputs, but do some sanity checks anyway.
-      if (tx_index >= m_blocks_txs_check.size() || memcmp(&m_blocks_txs_check[tx_index++], &tx_id, sizeof(tx_id)) != 0)
+      // validate that transaction inputs and the keys spending them are correct.
+      // txs was reserved upfront, so the jobs' pointers into it stay valid.
+      // Below the embedded hashes only the signatures are taken on trust.
+      tx_verification_context tvc;
+      if(!check_tx_inputs(txs.back(), tvc, NULL, &signature_jobs, txs.size() - 1, fast_check))
       {
-        MERROR_VER("Block with id: " << id << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
+        MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
+
         //TODO: why is this done?  make sure that keeping invalid blocks makes sense.
         add_block_as_invalid(bl, id);
         MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
@@ -3474,14 +4175,34 @@ leave:
         goto leave;
       }
     }
-#endif
     TIME_MEASURE_FINISH(cc);
     t_checktx += cc;
+    trace.end_tx();
     fee_summary += fee;
     cumulative_block_weight += tx_weight;
   }
 
   m_blocks_txs_check.clear();
+  trace.lap("txs");
+
+  if (!signature_jobs.empty())
+  {
+    TIME_MEASURE_START(cc);
+    size_t failed_tx_index = 0;
+    if (!check_signature_jobs(signature_jobs, failed_tx_index))
+    {
+      MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << bl.tx_hashes[failed_tx_index] << ") with wrong inputs.");
+
+      add_block_as_invalid(bl, id);
+      MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+      bvc.m_verifivation_failed = true;
+      return_tx_to_pool(txs);
+      goto leave;
+    }
+    TIME_MEASURE_FINISH(cc);
+    t_checktx += cc;
+    trace.lap("signatures");
+  }
 
   TIME_MEASURE_START(vmt);
   uint64_t base_reward = 0;
@@ -3495,6 +4216,7 @@ leave:
   }
 
   TIME_MEASURE_FINISH(vmt);
+  trace.lap("miner tx");
   size_t block_weight;
   difficulty_type cumulative_difficulty;
 
@@ -3544,11 +4266,22 @@ leave:
   }
 
   TIME_MEASURE_FINISH(addblock);
+  trace.lap("db");
+  trace.set_added();
+
+  if (!fast_check && !pow_cached)
+    cache_pow_hash(id, proof_of_work);
 
   // do this after updating the hard fork state since the weight limit may change due to fork
   update_next_cumulative_weight_limit();
 
   MINFO("+++++ BLOCK SUCCESSFULLY ADDED" << std::endl << "id:\t" << id << std::endl << "PoW:\t" << proof_of_work << std::endl << "HEIGHT " << new_height-1 << ", difficulty:\t" << current_diffic << std::endl << "block reward: " << print_money(fee_summary + base_reward) << "(" << print_money(base_reward) << " + " << print_money(fee_summary) << "), coinbase_weight: " << coinbase_weight << ", cumulative weight: " << cumulative_block_weight << ", " << block_processing_time << "(" << target_calculating_time << "/" << longhash_calculating_time << ")ms");
+  m_block_processing_stats.blocks++;
+  m_block_processing_stats.txes += txs.size();
+  m_block_processing_stats.pow_ms += longhash_calculating_time;
+  m_block_processing_stats.tx_checks_ms += t_checktx;
+  m_block_processing_stats.db_ms += addblock;
+  m_block_processing_stats.total_ms += block_processing_time + addblock;
   if(m_show_time_stats)
   {
     MINFO("Height: " << new_height << " coinbase weight: " << coinbase_weight << " cumm: "
@@ -3561,8 +4294,14 @@ leave:
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
 
+  for (const crypto::hash &tx_id : bl.tx_hashes)
+    m_verified_txes.erase(tx_id);
+
   // appears to be a NOP *and* is called elsewhere.  wat?
   m_tx_pool.on_blockchain_inc(new_height, id);
+
+  if (m_light_wallet_scanner)
+    m_light_wallet_scanner->on_block_added(new_height - 1, bl, txs);
   get_difficulty_for_next_block(); // just to cache it
   invalidate_block_template_cache();
 
@@ -3570,6 +4309,10 @@ leave:
   if (block_notify)
     block_notify->notify(epee::string_tools::pod_to_hex(id).c_str());
 
+  if (m_block_added_callback && !m_switching_chain)
+    m_block_added_callback(new_height - 1, bl);
+  trace.lap("bookkeeping");
+
   return true;
 }
 //------------------------------------------------------------------
@@ -3578,10 +4321,7 @@ bool Blockchain::update_next_cumulative_weight_limit()
   uint64_t full_reward_zone = get_min_block_weight(get_current_hard_fork_version());
 
   LOG_PRINT_L3("Blockchain::" << __func__);
-  std::vector<size_t> weights;
-  get_last_n_blocks_weights(weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-
-  uint64_t median = epee::misc_utils::median(weights);
+  uint64_t median = sync_block_weights().median();
   m_current_block_cumul_weight_median = median;
   if(median <= full_reward_zone)
     median = full_reward_zone;
@@ -3621,7 +4361,10 @@ bool Blockchain::add_new_block(const block& bl_, block_verification_context& bvc
   }
 
   m_db->block_txn_stop();
-  return handle_block_to_main_chain(bl, id, bvc);
+  const bool r = handle_block_to_main_chain(bl, id, bvc);
+  if (r && bvc.m_added_to_main_chain && m_db->height() % BLOCKCHAIN_ALT_BLOCKS_PRUNE_INTERVAL == 0)
+    prune_alt_blocks();
+  return r;
 }
 //------------------------------------------------------------------
 //TODO: Refactor, consider returning a failure height and letting
@@ -3703,24 +4446,183 @@ void Blockchain::set_enforce_dns_checkpoints(bool enforce_checkpoints)
   m_enforce_dns_checkpoints = enforce_checkpoints;
 }
 
+//------------------------------------------------------------------
+bool Blockchain::update_blockchain_pruning()
+{
+  CRITICAL_REGION_LOCAL(m_tx_pool);
+  CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+
+  try
+  {
+    return m_db->update_pruning();
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to update blockchain pruning: " << e.what());
+    return false;
+  }
+}
+//------------------------------------------------------------------
+bool Blockchain::get_cached_pow_hash(const crypto::hash &id, crypto::hash &pow) const
+{
+  if (!m_pow_hash_cache)
+    return false;
+  try
+  {
+    return m_db->get_pow_hash(id, pow);
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to look up cached PoW hash for " << id << ": " << e.what());
+    return false;
+  }
+}
+//------------------------------------------------------------------
+void Blockchain::cache_pow_hash(const crypto::hash &id, const crypto::hash &pow)
+{
+  if (!m_pow_hash_cache)
+    return;
+  try
+  {
+    // joins the sync batch if there is one
+    const bool stop_batch = m_db->batch_start();
+    try
+    {
+      m_db->add_pow_hash(id, pow);
+    }
+    catch (...)
+    {
+      if (stop_batch)
+        m_db->batch_stop();
+      throw;
+    }
+    if (stop_batch)
+      m_db->batch_stop();
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to cache PoW hash for " << id << ": " << e.what());
+  }
+}
 //------------------------------------------------------------------
 void Blockchain::block_longhash_worker(uint64_t height, const std::vector<block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const
 {
   TIME_MEASURE_START(t);
-  slow_hash_allocate_state();
 
-  for (const auto & block : blocks)
+  // hash a couple of blocks at a time with interleaved scratchpads
+  const size_t ways = 2;
+  crypto::slow_hash_allocate_state_multi(ways);
+  static std::once_flag state_logged;
+  std::call_once(state_logged, []() {
+    crypto::slow_hash_state_info state_info;
+    crypto::slow_hash_get_state_info(&state_info);
+    MINFO("PoW verification scratchpads use " << crypto::slow_hash_pages_name(state_info.pages)
+        << (state_info.numa_node >= 0 ? ", NUMA node " + std::to_string(state_info.numa_node) : std::string()));
+  });
+  std::vector<const block*> group;
+  std::vector<crypto::hash> pow;
+  for (size_t i = 0; i < blocks.size(); i += ways)
   {
     if (m_cancel)
        break;
-    crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(block, height++);
-    map.emplace(id, pow);
+    group.clear();
+    for (size_t n = i; n < std::min(i + ways, blocks.size()); ++n)
+      group.push_back(&blocks[n]);
+    get_block_longhashes(group, pow, ways);
+    for (size_t n = 0; n < group.size(); ++n)
+      map.emplace(get_block_hash(*group[n]), pow[n]);
   }
 
   slow_hash_free_state();
   TIME_MEASURE_FINISH(t);
 }
+//------------------------------------------------------------------
+void Blockchain::longhash_prefetch_worker(const std::vector<blobdata> &blobs, uint64_t start_height)
+{
+  TIME_MEASURE_START(t);
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  uint64_t threads = std::min<uint64_t>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads);
+  threads = std::max<uint64_t>(std::min<uint64_t>(threads, blobs.size()), 1);
+  const size_t per_thread = (blobs.size() + threads - 1) / threads;
+
+  // contiguous chunks, so each worker's height stays in step with its blocks
+  std::vector<std::vector<block>> blocks(threads);
+  std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
+  for (size_t n = 0; n < blobs.size(); ++n)
+  {
+    block b;
+    if (!parse_and_validate_block_from_blob(blobs[n], b))
+      break;
+    blocks[n / per_thread].push_back(std::move(b));
+  }
+
+  tools::threadpool::waiter waiter;
+  std::vector<std::function<void()>> jobs;
+  jobs.reserve(threads);
+  for (uint64_t i = 0; i < threads; i++)
+  {
+    if (blocks[i].empty())
+      break;
+    jobs.push_back(boost::bind(&Blockchain::block_longhash_worker, this, start_height + i * per_thread, std::cref(blocks[i]), std::ref(maps[i])));
+  }
+  tpool.submit_bulk(&waiter, std::move(jobs), true);
+  waiter.wait(&tpool);
+
+  if (m_cancel)
+    return;
+
+  size_t count = 0;
+  boost::unique_lock<boost::mutex> lock(m_prefetched_longhashes_lock);
+  for (uint64_t i = 0; i < threads; i++)
+  {
+    for (size_t j = 0; j < blocks[i].size(); ++j)
+    {
+      const crypto::hash id = get_block_hash(blocks[i][j]);
+      const auto pow = maps[i].find(id);
+      if (pow == maps[i].end())
+        continue;
+      m_prefetched_longhashes.emplace(id, std::make_pair(start_height + i * per_thread + j, pow->second));
+      ++count;
+    }
+  }
+  TIME_MEASURE_FINISH(t);
+  MDEBUG("Prefetched " << count << " block hashes from height " << start_height << " in " << t << " ms");
+}
+//------------------------------------------------------------------
+void Blockchain::wait_for_longhash_prefetch()
+{
+  boost::unique_lock<boost::mutex> lock(m_longhash_prefetch_thread_lock);
+  if (m_longhash_prefetch_thread.joinable())
+    m_longhash_prefetch_thread.join();
+}
+//------------------------------------------------------------------
+void Blockchain::prefetch_block_longhashes(const std::vector<block_complete_entry> &blocks_entry, uint64_t start_height)
+{
+  MTRACE("Blockchain::" << __func__);
+  if (blocks_entry.size() <= 1 || m_max_prepare_blocks_threads <= 1 || tools::threadpool::getInstance().get_max_concurrency() <= 1)
+    return;
+
+  {
+    // blocks below the hash of hashes checkpoints are not PoW checked at all
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    if (start_height + blocks_entry.size() < m_blocks_hash_check.size())
+      return;
+  }
+
+  std::vector<blobdata> blobs;
+  blobs.reserve(blocks_entry.size());
+  for (const auto &entry : blocks_entry)
+    blobs.push_back(entry.block);
+
+  boost::unique_lock<boost::mutex> lock(m_longhash_prefetch_thread_lock);
+  if (m_longhash_prefetch_thread.joinable())
+    m_longhash_prefetch_thread.join();
+  {
+    boost::unique_lock<boost::mutex> hashes_lock(m_prefetched_longhashes_lock);
+    m_prefetched_longhashes.clear();
+  }
+  m_longhash_prefetch_thread = boost::thread([this, blobs, start_height]() { longhash_prefetch_worker(blobs, start_height); });
+}
 
 //------------------------------------------------------------------
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
@@ -3733,14 +4635,20 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 
   try
   {
+    TIME_MEASURE_NS_START(commit_time);
     m_db->batch_stop();
+    TIME_MEASURE_NS_FINISH(commit_time);
     success = true;
+    m_db_sync_tuner.on_commit(m_batch_blocks, m_batch_bytes, commit_time / 1000);
   }
   catch (const std::exception &e)
   {
     MERROR("Exception in cleanup_handle_incoming_blocks: " << e.what());
   }
+  m_batch_blocks = 0;
+  m_batch_bytes = 0;
 
+  const uint64_t sync_threshold = m_db_sync_on_blocks ? get_db_sync_blocks() : m_db_sync_threshold;
   if (success && m_sync_counter > 0)
   {
     if (force_sync)
@@ -3749,7 +4657,7 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
         store_blockchain();
       m_sync_counter = 0;
     }
-    else if (m_db_sync_threshold && ((m_db_sync_on_blocks && m_sync_counter >= m_db_sync_threshold) || (!m_db_sync_on_blocks && m_bytes_to_sync >= m_db_sync_threshold)))
+    else if (sync_threshold && ((m_db_sync_on_blocks && m_sync_counter >= sync_threshold) || (!m_db_sync_on_blocks && m_bytes_to_sync >= sync_threshold)))
     {
       MDEBUG("Sync threshold met, syncing");
       if(m_db_sync_mode == db_async)
@@ -3771,9 +4679,8 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 
   TIME_MEASURE_FINISH(t1);
   m_blocks_longhash_table.clear();
-  m_scan_table.clear();
   m_blocks_txs_check.clear();
-  m_check_txin_table.clear();
+  reset_validation_tables();
 
   // when we're well clear of the precomputed hashes, free the memory
   if (!m_blocks_hash_check.empty() && m_db->height() > m_blocks_hash_check.size() + 4096)
@@ -3789,13 +4696,85 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   return success;
 }
 
+//------------------------------------------------------------------
+void Blockchain::get_output_keys_cached(uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs) const
+{
+  outputs.resize(offsets.size());
+
+  std::vector<size_t> missing;
+  std::vector<uint64_t> missing_offsets;
+  for (size_t n = 0; n < offsets.size(); ++n)
+  {
+    const output_key_cache_shard::key_type key(amount, offsets[n]);
+    output_key_cache_shard &shard = m_output_key_cache[output_key_cache_shard::key_hash()(key) % OUTPUT_KEY_CACHE_SHARDS];
+    boost::unique_lock<boost::mutex> lock(shard.lock);
+    const auto i = shard.index.find(key);
+    if (i != shard.index.end())
+    {
+      shard.entries.splice(shard.entries.begin(), shard.entries, i->second);
+      outputs[n] = i->second->second;
+    }
+    else
+    {
+      missing.push_back(n);
+      missing_offsets.push_back(offsets[n]);
+    }
+  }
+  if (missing.empty())
+    return;
+
+  std::vector<output_data_t> missing_outputs;
+  m_db->get_output_key(amount, missing_offsets, missing_outputs, true);
+
+  const size_t max_shard_entries = OUTPUT_KEY_CACHE_SIZE / OUTPUT_KEY_CACHE_SHARDS;
+  for (size_t n = 0; n < missing_outputs.size(); ++n)
+  {
+    outputs[missing[n]] = missing_outputs[n];
+
+    const output_key_cache_shard::key_type key(amount, missing_offsets[n]);
+    output_key_cache_shard &shard = m_output_key_cache[output_key_cache_shard::key_hash()(key) % OUTPUT_KEY_CACHE_SHARDS];
+    boost::unique_lock<boost::mutex> lock(shard.lock);
+    if (shard.index.find(key) != shard.index.end())
+      continue;
+    shard.entries.push_front(std::make_pair(key, missing_outputs[n]));
+    shard.index[key] = shard.entries.begin();
+    while (shard.entries.size() > max_shard_entries)
+    {
+      shard.index.erase(shard.entries.back().first);
+      shard.entries.pop_back();
+    }
+  }
+
+  // partial result, stop at the first output that was not found
+  if (missing_outputs.size() < missing.size())
+    outputs.resize(missing[missing_outputs.size()]);
+}
+//------------------------------------------------------------------
+void Blockchain::invalidate_output_key_cache(uint64_t height)
+{
+  for (size_t s = 0; s < OUTPUT_KEY_CACHE_SHARDS; ++s)
+  {
+    output_key_cache_shard &shard = m_output_key_cache[s];
+    boost::unique_lock<boost::mutex> lock(shard.lock);
+    for (auto i = shard.entries.begin(); i != shard.entries.end(); )
+    {
+      if (i->second.height >= height)
+      {
+        shard.index.erase(i->first);
+        i = shard.entries.erase(i);
+      }
+      else
+        ++i;
+    }
+  }
+}
 //------------------------------------------------------------------
 //FIXME: unused parameter txs
 void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash, cryptonote::transaction> &txs) const
 {
   try
   {
-    m_db->get_output_key(amount, offsets, outputs, true);
+    get_output_keys_cached(amount, offsets, outputs);
   }
   catch (const std::exception& e)
   {
@@ -3902,6 +4881,144 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   CHECK_AND_ASSERT_MES(usable < std::numeric_limits<uint64_t>::max() / 2, 0, "usable is negative");
   return usable;
 }
+//------------------------------------------------------------------
+bool Blockchain::verify_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers)
+{
+  MTRACE("Blockchain::" << __func__);
+  if (headers.empty())
+    return true;
+  if (headers.size() > hashes.size())
+  {
+    MERROR_VER("Got " << headers.size() << " block headers for " << hashes.size() << " block ids");
+    return false;
+  }
+
+  std::vector<block_header> parsed(headers.size());
+  for (size_t i = 0; i < headers.size(); ++i)
+  {
+    crypto::hash id;
+    if (!get_object_hash(headers[i], id) || id != hashes[i] || !parse_block_header_from_hashing_blob(headers[i], parsed[i]))
+    {
+      MERROR_VER("Block header at height " << height + i << " does not match block id " << hashes[i]);
+      return false;
+    }
+    if (i > 0 && parsed[i].prev_id != hashes[i - 1])
+    {
+      MERROR_VER("Block header at height " << height + i << " does not link to the previous one");
+      return false;
+    }
+  }
+
+  // difficulties of the headers past the point where they leave our main chain,
+  // worked out the way get_difficulty_for_next_block would once the blocks are added
+  std::vector<difficulty_type> difficulties(headers.size(), 0);
+  std::vector<bool> check_pow(headers.size(), false);
+  size_t split = 0;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    const uint64_t db_height = m_db->height();
+    while (split < headers.size() && height + split < db_height && m_db->get_block_hash_from_height(height + split) == hashes[split])
+      ++split;
+    if (split == headers.size())
+      return true;
+    if (split == 0)
+    {
+      // our chain changed since we asked, there is nothing to check against
+      MDEBUG("Block headers at height " << height << " do not start on our chain, not checking them");
+      return true;
+    }
+
+    const uint64_t split_height = height + split;
+    const uint64_t max_count = std::max<uint64_t>(std::max<uint64_t>(DIFFICULTY_BLOCKS_COUNT, DIFFICULTY_BLOCKS_COUNT_V6), DIFFICULTY_BLOCKS_COUNT_V9);
+    const uint64_t base = std::max<uint64_t>(1, split_height - std::min(split_height, max_count));
+    std::vector<uint64_t> timestamps;
+    std::vector<difficulty_type> cumulative_difficulties;
+    timestamps.reserve(split_height - base + headers.size());
+    cumulative_difficulties.reserve(split_height - base + headers.size());
+    for (uint64_t h = base; h < split_height; ++h)
+    {
+      timestamps.push_back(m_db->get_block_timestamp(h));
+      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(h));
+    }
+    difficulty_type cumulative_difficulty = m_db->get_block_cumulative_difficulty(split_height - 1);
+
+    for (size_t i = split; i < headers.size(); ++i)
+    {
+      const uint64_t h = height + i;
+      const uint8_t version = parsed[i].major_version;
+      uint64_t offset = h - std::min<uint64_t>(h, get_difficulty_blocks_count(version, h));
+      if (offset == 0)
+        ++offset;
+      const size_t length = h > offset ? h - offset : 0;
+      if (m_fixed_difficulty)
+        difficulties[i] = h ? m_fixed_difficulty : 1;
+      else
+        difficulties[i] = get_next_difficulty(version, h, timestamps.data() + (offset - base), cumulative_difficulties.data() + (offset - base), length);
+      cumulative_difficulty += difficulties[i];
+      timestamps.push_back(parsed[i].timestamp);
+      cumulative_difficulties.push_back(cumulative_difficulty);
+#if defined(PER_BLOCK_CHECKPOINT)
+      // blocks covered by the hash of hashes checkpoints are not PoW checked
+      check_pow[i] = h >= m_blocks_hash_check.size() || m_blocks_hash_check[h] == crypto::null_hash;
+#else
+      check_pow[i] = true;
+#endif
+    }
+  }
+
+  // reuse what another peer's copy of these headers made us compute
+  std::vector<crypto::hash> pow(headers.size());
+  std::vector<size_t> todo;
+  {
+    boost::unique_lock<boost::mutex> lock(m_prefetched_longhashes_lock);
+    for (size_t i = split; i < headers.size(); ++i)
+    {
+      if (!check_pow[i])
+        continue;
+      const auto it = m_header_longhashes.find(hashes[i]);
+      if (it != m_header_longhashes.end() && it->second.first == height + i)
+        pow[i] = it->second.second;
+      else
+        todo.push_back(i);
+    }
+  }
+
+  TIME_MEASURE_START(t);
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  for (size_t i: todo)
+    tpool.submit(&waiter, [&headers, &parsed, &pow, i]() { get_block_longhash_from_hashing_blob(headers[i], parsed[i], pow[i]); }, true);
+  waiter.wait(&tpool);
+  TIME_MEASURE_FINISH(t);
+
+  for (size_t i = split; i < headers.size(); ++i)
+  {
+    if (check_pow[i] && !check_hash(pow[i], difficulties[i]))
+    {
+      MERROR_VER("Block header for " << hashes[i] << " at height " << height + i << " does not have enough proof of work: " << pow[i] << ", expected difficulty " << difficulties[i]);
+      return false;
+    }
+  }
+  MDEBUG("Checked " << headers.size() - split << " block headers from height " << height + split << ", " << todo.size() << " hashed in " << t << " ms");
+
+  boost::unique_lock<boost::mutex> lock(m_prefetched_longhashes_lock);
+  if (m_header_longhashes.size() > 16 * BLOCKS_HEADERS_SYNCHRONIZING_MAX_COUNT)
+    m_header_longhashes.clear();
+  for (size_t i: todo)
+    m_header_longhashes[hashes[i]] = std::make_pair(height + i, pow[i]);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::take_header_longhash(const crypto::hash &id, uint64_t height, crypto::hash &pow)
+{
+  boost::unique_lock<boost::mutex> lock(m_prefetched_longhashes_lock);
+  const auto it = m_header_longhashes.find(id);
+  if (it == m_header_longhashes.end() || it->second.first != height)
+    return false;
+  pow = it->second.second;
+  m_header_longhashes.erase(it);
+  return true;
+}
 
 //------------------------------------------------------------------
 // ND: Speedups:
@@ -3911,12 +5028,43 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
 //    and is threaded if possible. The table (m_scan_table) will be used later when querying output
 //    keys.
 bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry)
+{
+  std::vector<block> parsed_blocks;
+  return prepare_handle_incoming_blocks(blocks_entry, parsed_blocks);
+}
+//------------------------------------------------------------------
+bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks_entry, std::vector<block> &parsed_blocks)
 {
   MTRACE("Blockchain::" << __func__);
   TIME_MEASURE_START(prepare);
   bool stop_batch;
   uint64_t bytes = 0;
   size_t total_txs = 0;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+
+  // parse and hash every block of the span in parallel, before any lock is
+  // taken; the results feed the PoW stage below and are handed back so the
+  // caller does not parse them again when adding them one at a time
+  std::vector<block> parsed(blocks_entry.size());
+  std::vector<char> parsed_ok(blocks_entry.size(), 0);
+  {
+    tools::threadpool::waiter waiter;
+    std::vector<std::function<void()>> jobs;
+    jobs.reserve(blocks_entry.size());
+    for (size_t i = 0; i < blocks_entry.size(); ++i)
+    {
+      jobs.push_back([&, i]() {
+        parsed_ok[i] = parse_and_validate_block_from_blob(blocks_entry[i].block, parsed[i]);
+        if (parsed_ok[i])
+          get_block_hash(parsed[i]); // fills the block's hash cache
+      });
+    }
+    tpool.submit_bulk(&waiter, std::move(jobs), true);
+    waiter.wait(&tpool);
+  }
+  parsed_blocks.clear();
+  if (std::find(parsed_ok.begin(), parsed_ok.end(), 0) == parsed_ok.end())
+    parsed_blocks = parsed;
 
   // Order of locking must be:
   //  m_incoming_tx_lock (optional)
@@ -3955,12 +5103,13 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     m_tx_pool.lock();
     m_blockchain_lock.lock();
   }
+  m_batch_blocks = blocks_entry.size();
+  m_batch_bytes = bytes;
 
   if ((m_db->height() + blocks_entry.size()) < m_blocks_hash_check.size())
     return true;
 
   bool blocks_exist = false;
-  tools::threadpool& tpool = tools::threadpool::getInstance();
   uint64_t threads = tpool.get_max_concurrency();
 
   if (blocks_entry.size() > 1 && threads > 1 && m_max_prepare_blocks_threads > 1)
@@ -3970,6 +5119,16 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       threads = m_max_prepare_blocks_threads;
 
     uint64_t height = m_db->height();
+
+    // pick up hashes computed ahead of time for this span, if any
+    std::unordered_map<crypto::hash, std::pair<uint64_t, crypto::hash>> prefetched;
+    wait_for_longhash_prefetch();
+    {
+      boost::unique_lock<boost::mutex> lock(m_prefetched_longhashes_lock);
+      prefetched.swap(m_prefetched_longhashes);
+    }
+    std::unordered_map<crypto::hash, crypto::hash> prefetched_pow;
+
     int batches = blocks_entry.size() / threads;
     int extra = blocks_entry.size() % threads;
     MDEBUG("block_batches: " << batches);
@@ -3982,13 +5141,13 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
       blocks[i].reserve(batches + 1);
       for (int j = 0; j < batches; j++)
       {
-        block block;
-
-        if (!parse_and_validate_block_from_blob(it->block, block))
+        const size_t idx = std::distance(blocks_entry.begin(), it);
+        if (!parsed_ok[idx])
         {
           std::advance(it, 1);
           continue;
         }
+        block block = parsed[idx];
 
         // check first block and skip all blocks if its not chained properly
         if (i == 0 && j == 0)
@@ -4000,47 +5159,72 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
             return true;
           }
         }
-        if (have_block(get_block_hash(block)))
+        const crypto::hash id = get_block_hash(block);
+        if (have_block(id))
         {
           blocks_exist = true;
           break;
         }
 
-        blocks[i].push_back(std::move(block));
+        const auto pf = prefetched.find(id);
+        crypto::hash cached_pow;
+        if (pf != prefetched.end() && pf->second.first == height + std::distance(blocks_entry.begin(), it))
+          prefetched_pow.emplace(id, pf->second.second);
+        else if (take_header_longhash(id, height + std::distance(blocks_entry.begin(), it), cached_pow))
+          prefetched_pow.emplace(id, cached_pow);
+        else if (get_cached_pow_hash(id, cached_pow))
+          prefetched_pow.emplace(id, cached_pow);
+        else
+          blocks[i].push_back(std::move(block));
         std::advance(it, 1);
       }
     }
 
     for (int i = 0; i < extra && !blocks_exist; i++)
     {
-      block block;
-
-      if (!parse_and_validate_block_from_blob(it->block, block))
+      const size_t idx = std::distance(blocks_entry.begin(), it);
+      if (!parsed_ok[idx])
       {
         std::advance(it, 1);
         continue;
       }
+      block block = parsed[idx];
 
-      if (have_block(get_block_hash(block)))
+      const crypto::hash id = get_block_hash(block);
+      if (have_block(id))
       {
         blocks_exist = true;
         break;
       }
 
-      blocks[i].push_back(std::move(block));
+      const auto pf = prefetched.find(id);
+      crypto::hash cached_pow;
+      if (pf != prefetched.end() && pf->second.first == height + std::distance(blocks_entry.begin(), it))
+        prefetched_pow.emplace(id, pf->second.second);
+      else if (take_header_longhash(id, height + std::distance(blocks_entry.begin(), it), cached_pow))
+        prefetched_pow.emplace(id, cached_pow);
+      else if (get_cached_pow_hash(id, cached_pow))
+        prefetched_pow.emplace(id, cached_pow);
+      else
+        blocks[i].push_back(std::move(block));
       std::advance(it, 1);
     }
 
     if (!blocks_exist)
     {
-      m_blocks_longhash_table.clear();
+      m_blocks_longhash_table = std::move(prefetched_pow);
+      if (!m_blocks_longhash_table.empty())
+        MDEBUG("Using " << m_blocks_longhash_table.size() << " prefetched or cached block hashes");
       uint64_t thread_height = height;
       tools::threadpool::waiter waiter;
+      std::vector<std::function<void()>> jobs;
+      jobs.reserve(threads);
       for (uint64_t i = 0; i < threads; i++)
       {
-        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, thread_height, std::cref(blocks[i]), std::ref(maps[i])), true);
+        jobs.push_back(boost::bind(&Blockchain::block_longhash_worker, this, thread_height, std::cref(blocks[i]), std::ref(maps[i])));
         thread_height += blocks[i].size();
       }
+      tpool.submit_bulk(&waiter, std::move(jobs), true);
 
       waiter.wait(&tpool);
 
@@ -4066,8 +5250,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   m_fake_scan_time = 0;
   m_fake_pow_calc_time = 0;
 
-  m_scan_table.clear();
-  m_check_txin_table.clear();
+  reset_validation_tables();
 
   TIME_MEASURE_FINISH(prepare);
   m_fake_pow_calc_time = prepare / blocks_entry.size();
@@ -4092,6 +5275,31 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
             return false; \
         } while(0); \
 
+  // parse the span's txes and hash their prefixes in parallel, the loop
+  // below then only has to build the tables
+  std::vector<char> tx_parsed(total_txs, 0);
+  {
+    std::vector<const blobdata*> tx_blobs;
+    tx_blobs.reserve(total_txs);
+    for (const auto &entry : blocks_entry)
+      for (const auto &tx_blob : entry.txs)
+        tx_blobs.push_back(&tx_blob);
+
+    tools::threadpool::waiter waiter;
+    std::vector<std::function<void()>> jobs;
+    jobs.reserve(tx_blobs.size());
+    for (size_t i = 0; i < tx_blobs.size(); ++i)
+    {
+      jobs.push_back([&, i]() {
+        tx_parsed[i] = parse_and_validate_tx_base_from_blob(*tx_blobs[i], txes[i].first);
+        if (tx_parsed[i])
+          cryptonote::get_transaction_prefix_hash(txes[i].first, txes[i].second);
+      });
+    }
+    tpool.submit_bulk(&waiter, std::move(jobs), true);
+    waiter.wait(&tpool);
+  }
+
   // generate sorted tables for all amounts and absolute offsets
   size_t tx_index = 0;
   for (const auto &entry : blocks_entry)
@@ -4099,23 +5307,21 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     if (m_cancel)
       return false;
 
-    for (const auto &tx_blob : entry.txs)
+    for (size_t n = 0; n < entry.txs.size(); ++n)
     {
       if (tx_index >= txes.size())
         SCAN_TABLE_QUIT("tx_index is out of sync");
+      if (!tx_parsed[tx_index])
+        SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
       transaction &tx = txes[tx_index].first;
       crypto::hash &tx_prefix_hash = txes[tx_index].second;
       ++tx_index;
 
-      if (!parse_and_validate_tx_base_from_blob(tx_blob, tx))
-        SCAN_TABLE_QUIT("Could not parse tx from incoming blocks.");
-      cryptonote::get_transaction_prefix_hash(tx, tx_prefix_hash);
-
       auto its = m_scan_table.find(tx_prefix_hash);
       if (its != m_scan_table.end())
         SCAN_TABLE_QUIT("Duplicate tx found from incoming blocks.");
 
-      m_scan_table.emplace(tx_prefix_hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>());
+      m_scan_table.emplace(tx_prefix_hash, make_validation_container<scan_inputs_t>());
       its = m_scan_table.find(tx_prefix_hash);
       assert(its != m_scan_table.end());
 
@@ -4219,7 +5425,8 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
         const txin_to_key &in_to_key = boost::get < txin_to_key > (txin);
         auto needed_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
 
-        std::vector<output_data_t> outputs;
+        scan_outputs_t outputs{scan_outputs_t::allocator_type(m_validation_arena)};
+        outputs.reserve(needed_offsets.size());
         for (const uint64_t & offset_needed : needed_offsets)
         {
           size_t pos = 0;
@@ -4242,7 +5449,7 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
             break;
         }
 
-        its->second.emplace(in_to_key.k_image, outputs);
+        its->second.emplace(in_to_key.k_image, std::move(outputs));
       }
     }
   }
@@ -4312,6 +5519,36 @@ void Blockchain::set_user_options(uint64_t maxthreads, bool sync_on_blocks, uint
   m_max_prepare_blocks_threads = maxthreads;
 }
 
+void Blockchain::set_db_sync_tuning(uint64_t max_sync_blocks, uint64_t min_batch_blocks, uint64_t max_batch_blocks, bool rotating_drive)
+{
+  m_db_sync_tuner.set_rotating_drive(rotating_drive);
+  if (m_db_default_sync && m_db_sync_on_blocks && max_sync_blocks > m_db_sync_threshold)
+    m_db_sync_tuner.set_sync_bounds(m_db_sync_threshold, max_sync_blocks);
+  else
+    m_db_sync_tuner.set_sync_bounds(0, 0);
+  m_db_sync_tuner.set_batch_bounds(min_batch_blocks, max_batch_blocks);
+}
+
+uint64_t Blockchain::get_db_sync_blocks() const
+{
+  if (!m_db_sync_on_blocks)
+    return 0;
+  const uint64_t adapted = m_db_sync_tuner.get_sync_blocks();
+  return adapted ? adapted : m_db_sync_threshold;
+}
+
+Blockchain::block_processing_stats Blockchain::get_block_processing_stats() const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_block_processing_stats;
+}
+
+void Blockchain::reset_block_processing_stats()
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  m_block_processing_stats = block_processing_stats();
+}
+
 void Blockchain::safesyncmode(const bool onoff)
 {
   /* all of this is no-op'd if the user set a specific
@@ -4374,37 +5611,93 @@ uint64_t Blockchain::get_difficulty_target() const
 
 std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> Blockchain:: get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const
 {
-  return m_db->get_output_histogram(amounts, unlocked, recent_cutoff, min_count);
+  // wallets building pre-rct sweeps ask for the same histograms over and over,
+  // the results only change with the top block
+  const crypto::hash top_hash = m_db->top_block_hash();
+  std::vector<uint64_t> missing;
+  std::map<uint64_t, output_histogram_entry> histogram;
+  {
+    boost::unique_lock<boost::mutex> lock(m_output_histogram_cache_lock);
+    if (top_hash != m_output_histogram_cache_top || m_output_histogram_cache.size() > OUTPUT_HISTOGRAM_CACHE_MAX_ENTRIES || m_output_histogram_all_cache.size() > OUTPUT_HISTOGRAM_CACHE_MAX_FULL)
+    {
+      m_output_histogram_cache.clear();
+      m_output_histogram_all_cache.clear();
+      m_output_histogram_cache_top = top_hash;
+    }
+    if (amounts.empty())
+    {
+      const auto i = m_output_histogram_all_cache.find(std::make_tuple(unlocked, recent_cutoff, min_count));
+      if (i != m_output_histogram_all_cache.end())
+        return i->second;
+    }
+    else
+    {
+      for (uint64_t amount: amounts)
+      {
+        const auto i = m_output_histogram_cache.find(std::make_tuple(amount, unlocked, recent_cutoff));
+        if (i == m_output_histogram_cache.end())
+          missing.push_back(amount);
+        else if (std::get<0>(i->second) >= min_count)
+          histogram[amount] = i->second;
+      }
+      if (missing.empty())
+        return histogram;
+    }
+  }
+
+  // uncached amounts are looked up without min_count, so all of them can be cached
+  std::map<uint64_t, output_histogram_entry> looked_up = m_db->get_output_histogram(missing, unlocked, recent_cutoff, amounts.empty() ? min_count : 0);
+
+  boost::unique_lock<boost::mutex> lock(m_output_histogram_cache_lock);
+  // the chain may have moved while looking up
+  const bool cache = m_output_histogram_cache_top == top_hash && m_db->top_block_hash() == top_hash;
+  if (amounts.empty())
+  {
+    if (cache)
+      m_output_histogram_all_cache[std::make_tuple(unlocked, recent_cutoff, min_count)] = looked_up;
+    return looked_up;
+  }
+  for (const auto &e: looked_up)
+  {
+    if (cache)
+      m_output_histogram_cache[std::make_tuple(e.first, unlocked, recent_cutoff)] = e.second;
+    if (std::get<0>(e.second) >= min_count)
+      histogram[e.first] = e.second;
+  }
+  return histogram;
 }
 
 std::list<std::pair<Blockchain::block_extended_info,std::vector<crypto::hash>>> Blockchain::get_alternative_chains() const
 {
   std::list<std::pair<Blockchain::block_extended_info,std::vector<crypto::hash>>> chains;
 
-  for (const auto &i: m_alternative_chains)
+  // gather the chain data only, and parse just the blocks at the chain tops
+  std::unordered_map<crypto::hash, alt_block_data_t> alt_blocks;
+  std::unordered_set<crypto::hash> parents;
+  m_db->for_all_alt_blocks([&alt_blocks, &parents](const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata *blob) {
+    alt_blocks[blkid] = data;
+    parents.insert(data.prev_id);
+    return true;
+  }, false);
+
+  for (const auto &i: alt_blocks)
   {
     const crypto::hash &top = i.first;
-    bool found = false;
-    for (const auto &j: m_alternative_chains)
-    {
-      if (j.second.bl.prev_id == top)
-      {
-        found = true;
-        break;
-      }
-    }
-    if (!found)
+    if (parents.find(top) == parents.end())
     {
+      block_extended_info bei;
+      if (!get_alt_block(top, bei))
+        continue;
       std::vector<crypto::hash> chain;
-      auto h = i.second.bl.prev_id;
+      auto h = i.second.prev_id;
       chain.push_back(top);
-      blocks_ext_by_hash::const_iterator prev;
-      while ((prev = m_alternative_chains.find(h)) != m_alternative_chains.end())
+      std::unordered_map<crypto::hash, alt_block_data_t>::const_iterator prev;
+      while ((prev = alt_blocks.find(h)) != alt_blocks.end())
       {
         chain.push_back(h);
-        h = prev->second.bl.prev_id;
+        h = prev->second.prev_id;
       }
-      chains.push_back(std::make_pair(i.second, chain));
+      chains.push_back(std::make_pair(std::move(bei), chain));
     }
   }
   return chains;
@@ -4417,82 +5710,106 @@ void Blockchain::cancel()
 
 #if defined(PER_BLOCK_CHECKPOINT)
 static const char expected_block_hashes_hash[] = "954cb2bbfa2fe6f74b2cdd22a1a4c767aea249ad47ad4f7c9445f0f03260f511";
-void Blockchain::load_compiled_in_block_hashes()
+#endif
+bool Blockchain::get_compiled_in_block_hashes(network_type nettype, std::vector<crypto::hash> &hashes)
 {
-  const bool testnet = m_nettype == TESTNET;
-  const bool stagenet = m_nettype == STAGENET;
-  if (m_fast_sync && get_blocks_dat_start(testnet, stagenet) != nullptr && get_blocks_dat_size(testnet, stagenet) > 0)
+  hashes.clear();
+#if defined(PER_BLOCK_CHECKPOINT)
+  const bool testnet = nettype == TESTNET;
+  const bool stagenet = nettype == STAGENET;
+  if (get_blocks_dat_start(testnet, stagenet) == nullptr || get_blocks_dat_size(testnet, stagenet) == 0)
+    return true;
+
+  MINFO("Loading precomputed blocks (" << get_blocks_dat_size(testnet, stagenet) << " bytes)");
+
+  if (nettype == MAINNET)
   {
-    MINFO("Loading precomputed blocks (" << get_blocks_dat_size(testnet, stagenet) << " bytes)");
+    // first check hash
+    crypto::hash hash;
+    if (!tools::sha256sum(get_blocks_dat_start(testnet, stagenet), get_blocks_dat_size(testnet, stagenet), hash))
+    {
+      MERROR("Failed to hash precomputed blocks data");
+      return false;
+    }
+    MINFO("precomputed blocks hash: " << hash << ", expected " << expected_block_hashes_hash);
+    cryptonote::blobdata expected_hash_data;
+    if (!epee::string_tools::parse_hexstr_to_binbuff(std::string(expected_block_hashes_hash), expected_hash_data) || expected_hash_data.size() != sizeof(crypto::hash))
+    {
+      MERROR("Failed to parse expected block hashes hash");
+      return false;
+    }
+    const crypto::hash expected_hash = *reinterpret_cast<const crypto::hash*>(expected_hash_data.data());
+    if (hash != expected_hash)
+    {
+      MERROR("Block hash data does not match expected hash");
+      return false;
+    }
+  }
 
-    if (m_nettype == MAINNET)
+  if (get_blocks_dat_size(testnet, stagenet) > 4)
+  {
+    const unsigned char *p = get_blocks_dat_start(testnet, stagenet);
+    const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
+    if (nblocks > (std::numeric_limits<uint32_t>::max() - 4) / sizeof(crypto::hash))
+    {
+      MERROR("Block hash data is too large");
+      return false;
+    }
+    const size_t size_needed = 4 + nblocks * sizeof(crypto::hash);
+    if (get_blocks_dat_size(testnet, stagenet) < size_needed)
+    {
+      MERROR("Block hash data is truncated");
+      return false;
+    }
+    p += sizeof(uint32_t);
+    hashes.reserve(nblocks);
+    for (uint32_t i = 0; i < nblocks; i++)
     {
-      // first check hash
       crypto::hash hash;
-      if (!tools::sha256sum(get_blocks_dat_start(testnet, stagenet), get_blocks_dat_size(testnet, stagenet), hash))
-      {
-        MERROR("Failed to hash precomputed blocks data");
-        return;
-      }
-      MINFO("precomputed blocks hash: " << hash << ", expected " << expected_block_hashes_hash);
-      cryptonote::blobdata expected_hash_data;
-      if (!epee::string_tools::parse_hexstr_to_binbuff(std::string(expected_block_hashes_hash), expected_hash_data) || expected_hash_data.size() != sizeof(crypto::hash))
-      {
-        MERROR("Failed to parse expected block hashes hash");
-        return;
-      }
-      const crypto::hash expected_hash = *reinterpret_cast<const crypto::hash*>(expected_hash_data.data());
-      if (hash != expected_hash)
-      {
-        MERROR("Block hash data does not match expected hash");
-        return;
-      }
+      memcpy(hash.data, p, sizeof(hash.data));
+      p += sizeof(hash.data);
+      hashes.push_back(hash);
     }
+  }
+#endif
+  return true;
+}
+
+#if defined(PER_BLOCK_CHECKPOINT)
+void Blockchain::load_compiled_in_block_hashes()
+{
+  if (!m_fast_sync)
+    return;
+
+  std::vector<crypto::hash> hashes;
+  if (!get_compiled_in_block_hashes(m_nettype, hashes))
+    return;
+
+  const size_t nblocks = hashes.size();
+  if(nblocks > 0 && nblocks > (m_db->height() + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP)
+  {
+    m_blocks_hash_of_hashes = std::move(hashes);
+    m_blocks_hash_check.resize(m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP, crypto::null_hash);
+    MINFO(nblocks << " block hashes loaded");
+
+    // FIXME: clear tx_pool because the process might have been
+    // terminated and caused it to store txs kept by blocks.
+    // The core will not call check_tx_inputs(..) for these
+    // transactions in this case. Consequently, the sanity check
+    // for tx hashes will fail in handle_block_to_main_chain(..)
+    CRITICAL_REGION_LOCAL(m_tx_pool);
 
-    if (get_blocks_dat_size(testnet, stagenet) > 4)
+    std::vector<transaction> txs;
+    m_tx_pool.get_transactions(txs);
+
+    size_t tx_weight;
+    uint64_t fee;
+    bool relayed, do_not_relay, double_spend_seen;
+    transaction pool_tx;
+    for(const transaction &tx : txs)
     {
-      const unsigned char *p = get_blocks_dat_start(testnet, stagenet);
-      const uint32_t nblocks = *p | ((*(p+1))<<8) | ((*(p+2))<<16) | ((*(p+3))<<24);
-      if (nblocks > (std::numeric_limits<uint32_t>::max() - 4) / sizeof(hash))
-      {
-        MERROR("Block hash data is too large");
-        return;
-      }
-      const size_t size_needed = 4 + nblocks * sizeof(crypto::hash);
-      if(nblocks > 0 && nblocks > (m_db->height() + HASH_OF_HASHES_STEP - 1) / HASH_OF_HASHES_STEP && get_blocks_dat_size(testnet, stagenet) >= size_needed)
-      {
-        p += sizeof(uint32_t);
-        m_blocks_hash_of_hashes.reserve(nblocks);
-        for (uint32_t i = 0; i < nblocks; i++)
-        {
-          crypto::hash hash;
-          memcpy(hash.data, p, sizeof(hash.data));
-          p += sizeof(hash.data);
-          m_blocks_hash_of_hashes.push_back(hash);
-        }
-        m_blocks_hash_check.resize(m_blocks_hash_of_hashes.size() * HASH_OF_HASHES_STEP, crypto::null_hash);
-        MINFO(nblocks << " block hashes loaded");
-
-        // FIXME: clear tx_pool because the process might have been
-        // terminated and caused it to store txs kept by blocks.
-        // The core will not call check_tx_inputs(..) for these
-        // transactions in this case. Consequently, the sanity check
-        // for tx hashes will fail in handle_block_to_main_chain(..)
-        CRITICAL_REGION_LOCAL(m_tx_pool);
-
-        std::vector<transaction> txs;
-        m_tx_pool.get_transactions(txs);
-
-        size_t tx_weight;
-        uint64_t fee;
-        bool relayed, do_not_relay, double_spend_seen;
-        transaction pool_tx;
-        for(const transaction &tx : txs)
-        {
-          crypto::hash tx_hash = get_transaction_hash(tx);
-          m_tx_pool.take_tx(tx_hash, pool_tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen);
-        }
-      }
+      crypto::hash tx_hash = get_transaction_hash(tx);
+      m_tx_pool.take_tx(tx_hash, pool_tx, tx_weight, fee, relayed, do_not_relay, double_spend_seen);
     }
   }
 }
@@ -4560,6 +5877,85 @@ void Blockchain::cache_block_template(const block &b, const cryptonote::account_
   m_btc_valid = true;
 }
 
+void Blockchain::get_memory_usage(std::vector<tools::memory_usage> &usage) const
+{
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+    uint64_t bytes = tools::node_container_bytes<blocks_ext_by_hash::value_type>(m_invalid_blocks.size());
+    for (const auto &e: m_invalid_blocks)
+      bytes += e.second.bl.tx_hashes.size() * sizeof(crypto::hash) + e.second.bl.miner_tx.vout.size() * sizeof(tx_out) + e.second.bl.miner_tx.extra.size();
+    bytes += m_invalid_blocks_order.size() * sizeof(crypto::hash);
+    usage.push_back({"blockchain.invalid_blocks", m_invalid_blocks.size(), bytes, m_max_invalid_blocks, 0});
+
+    uint64_t count = 0;
+    bytes = tools::node_container_bytes<decltype(m_scan_table)::value_type>(m_scan_table.size());
+    for (const auto &e: m_scan_table)
+    {
+      count += e.second.size();
+      bytes += tools::node_container_bytes<scan_inputs_t::value_type>(e.second.size());
+      for (const auto &ki: e.second)
+        bytes += ki.second.capacity() * sizeof(output_data_t);
+    }
+    usage.push_back({"blockchain.scan_table", count, bytes, 0, 0});
+
+    count = 0;
+    bytes = tools::node_container_bytes<decltype(m_check_txin_table)::value_type>(m_check_txin_table.size());
+    for (const auto &e: m_check_txin_table)
+    {
+      count += e.second.size();
+      bytes += tools::node_container_bytes<std::pair<const crypto::key_image, bool>>(e.second.size());
+    }
+    usage.push_back({"blockchain.check_txin_table", count, bytes, 0, 0});
+    usage.push_back({"blockchain.validation_arena", 0, m_validation_arena.reserved(), 0, 0});
+
+    count = m_blocks_longhash_table.size();
+    bytes = tools::node_container_bytes<decltype(m_blocks_longhash_table)::value_type>(m_blocks_longhash_table.size());
+    {
+      boost::unique_lock<boost::mutex> lock(m_prefetched_longhashes_lock);
+      count += m_prefetched_longhashes.size() + m_header_longhashes.size();
+      bytes += tools::node_container_bytes<decltype(m_prefetched_longhashes)::value_type>(m_prefetched_longhashes.size() + m_header_longhashes.size());
+    }
+    usage.push_back({"blockchain.longhashes", count, bytes, 0, 0});
+
+    bytes = tools::node_container_bytes<decltype(m_verified_txes)::value_type>(m_verified_txes.size()) + m_verified_txes_order.size() * sizeof(crypto::hash);
+    usage.push_back({"blockchain.verified_txes", m_verified_txes.size(), bytes, VERIFIED_TX_CACHE_SIZE, 0});
+
+    count = m_blocks_hash_of_hashes.size() + m_blocks_hash_check.size() + m_blocks_txs_check.size();
+    usage.push_back({"blockchain.fast_sync_hashes", count, count * sizeof(crypto::hash), 0, 0});
+  }
+
+  {
+    boost::unique_lock<boost::mutex> lock(m_block_entry_cache_lock);
+    const size_t entries = m_block_entries.size();
+    usage.push_back({"blockchain.block_entry_cache", entries,
+        m_block_entry_cache_bytes + tools::node_container_bytes<block_entry_list::value_type>(entries) + tools::node_container_bytes<decltype(m_block_entry_index)::value_type>(entries),
+        0, m_block_entry_cache_max_bytes});
+  }
+
+  uint64_t count = 0;
+  for (size_t s = 0; s < OUTPUT_KEY_CACHE_SHARDS; ++s)
+  {
+    output_key_cache_shard &shard = m_output_key_cache[s];
+    boost::unique_lock<boost::mutex> lock(shard.lock);
+    count += shard.entries.size();
+  }
+  usage.push_back({"blockchain.output_key_cache", count,
+      tools::node_container_bytes<output_key_cache_shard::entry_list::value_type>(count) + tools::node_container_bytes<std::pair<const output_key_cache_shard::key_type, output_key_cache_shard::entry_list::iterator>>(count),
+      OUTPUT_KEY_CACHE_SIZE, 0});
+
+  boost::unique_lock<boost::mutex> lock(m_output_histogram_cache_lock);
+  count = m_output_histogram_cache.size();
+  uint64_t bytes = tools::node_container_bytes<decltype(m_output_histogram_cache)::value_type>(m_output_histogram_cache.size());
+  for (const auto &e: m_output_histogram_all_cache)
+  {
+    count += e.second.size();
+    bytes += tools::node_container_bytes<std::pair<const uint64_t, output_histogram_entry>>(e.second.size());
+  }
+  bytes += tools::node_container_bytes<decltype(m_output_histogram_all_cache)::value_type>(m_output_histogram_all_cache.size());
+  usage.push_back({"blockchain.output_histogram_cache", count, bytes, 0, 0});
+}
+
 namespace cryptonote {
 template bool Blockchain::get_transactions(const std::vector<crypto::hash>&, std::vector<transaction>&, std::vector<crypto::hash>&) const;
 template bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>&, std::vector<cryptonote::blobdata>&, std::vector<crypto::hash>&, bool) const;
@@ -39,6 +39,9 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <atomic>
+#include <functional>
+#include <list>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -46,6 +49,9 @@
 #include "string_tools.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/util.h"
+#include "common/rolling_median.h"
+#include "common/memory_usage.h"
+#include "common/arena.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
@@ -55,12 +61,15 @@
 #include "checkpoints/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "db_sync_tuner.h"
+#include "block_tracer.h"
 
 namespace tools { class Notify; }
 
 namespace cryptonote
 {
   class tx_memory_pool;
+  class light_wallet_scanner;
   struct test_options;
 
   /** Declares ways in which the BlockchainDB backend should be told to sync
@@ -103,6 +112,15 @@ namespace cryptonote
       uint64_t already_generated_coins; //!< the total coins minted after that block
     };
 
+    /**
+     * @brief an alternative block's id and chain data, as stored in the db
+     */
+    struct alt_chain_entry
+    {
+      crypto::hash id; //!< the block id
+      alt_block_data_t data; //!< the block's parent, timestamp, height and cumulative values
+    };
+
     /**
      * @brief Blockchain constructor
      *
@@ -144,6 +162,16 @@ namespace cryptonote
      */
     bool deinit();
 
+    /**
+     * @brief picks up the blocks another process added to or popped from a read only db
+     *
+     * The state derived from the db (hard fork votes, difficulty and weight
+     * windows, cached outputs) is refreshed when its top block changed.
+     *
+     * @return true if the top block changed since the last call
+     */
+    bool refresh_from_db();
+
     /**
      * @brief assign a set of blockchain checkpoint hashes
      *
@@ -174,6 +202,20 @@ namespace cryptonote
      */
     bool get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata,block>>& blocks) const;
 
+    /**
+     * @brief get the compact filters of a range of blocks
+     *
+     * Each filter is a serialized cryptonote::block_filter, listing the keys
+     * a wallet needs to find out whether a block has anything for it.
+     *
+     * @param start_height the height on the blockchain to start at
+     * @param count the number of filters to get, if there are as many blocks after start_height
+     * @param filters return-by-reference container to put the filters in
+     *
+     * @return false if start_height >= blockchain height or a block could not be read, else true
+     */
+    bool get_block_filters(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& filters) const;
+
     /**
      * @brief compiles a list of all blocks stored as alternative chains
      *
@@ -219,6 +261,32 @@ namespace cryptonote
      */
     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
 
+    /**
+     * @brief performs some preprocessing on a group of incoming blocks to speed up verification
+     *
+     * The blocks are parsed and hashed in parallel before the locks are taken.
+     *
+     * @param blocks a list of incoming blocks
+     * @param parsed_blocks return-by-reference the parsed blocks, in order, or
+     * empty if any of them failed to parse
+     *
+     * @return false on erroneous blocks, else true
+     */
+    bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks, std::vector<block> &parsed_blocks);
+
+    /**
+     * @brief starts computing the PoW hashes of a queued span in the background
+     *
+     * The hashes are picked up by the next prepare_handle_incoming_blocks
+     * call if the span turns out to sit at the expected height, so
+     * hashing span N+1 overlaps with verifying and committing span N.
+     * Any previous prefetch is waited for first.
+     *
+     * @param blocks the blocks of the span
+     * @param start_height the height the first block is expected at
+     */
+    void prefetch_block_longhashes(const std::vector<block_complete_entry> &blocks, uint64_t start_height);
+
     /**
      * @brief incoming blocks post-processing, cleanup, and disk sync
      *
@@ -260,6 +328,14 @@ namespace cryptonote
      */
     bool have_tx_keyimg_as_spent(const crypto::key_image &key_im) const;
 
+    /**
+     * @brief check if key images are already spent on the blockchain
+     *
+     * @param key_im the key images to search for
+     * @param spent return-by-reference whether each key image is already spent
+     */
+    void have_key_images_as_spent(const std::vector<crypto::key_image> &key_im, std::vector<bool> &spent) const;
+
     /**
      * @brief get the current height of the blockchain
      *
@@ -290,6 +366,24 @@ namespace cryptonote
      */
     difficulty_type get_difficulty_for_next_block();
 
+    /**
+     * @brief checks the block headers a peer sent along with a chain entry
+     *
+     * headers[i] is the hashing blob of the block at height + i, which must
+     * hash to hashes[i] and link to the previous header. Blocks not in our
+     * main chain must have enough proof of work for the difficulty the
+     * headers before them give, so a chain that is not worth downloading is
+     * caught before any block is. The proof of work hashes are kept for when
+     * the blocks themselves arrive.
+     *
+     * @param height the height of the first header
+     * @param hashes the block ids of the chain entry
+     * @param headers the block hashing blobs, at most as many as hashes
+     *
+     * @return false if a header is invalid or lacks proof of work
+     */
+    bool verify_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers);
+
     /**
      * @brief adds a block to the blockchain
      *
@@ -388,10 +482,11 @@ namespace cryptonote
      *
      * @param qblock_ids the foreign chain's "short history" (see get_short_chain_history)
      * @param resp return-by-reference the split height and subsequent blocks' hashes
+     * @param max_headers how many of those blocks' hashing blobs to add as headers
      *
      * @return true if a block found in common, else false
      */
-    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, size_t max_headers = 0) const;
 
     /**
      * @brief find the most recent common point between ours and a foreign chain
@@ -421,10 +516,11 @@ namespace cryptonote
      * @param start_height return-by-reference the height of the first block returned
      * @param pruned whether to return full or pruned tx blobs
      * @param max_count the max number of blocks to get
+     * @param output_indices if not NULL, return-by-reference the output indices of the blocks' txs, per block, miner tx first
      *
      * @return true if a block found in common or req_start_block specified, else false
      */
-    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const;
+    bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices = NULL) const;
 
     /**
      * @brief retrieves a set of blocks and their transactions, and possibly other transactions
@@ -433,12 +529,16 @@ namespace cryptonote
      * transaction hashes.  for each block hash, the block is fetched along with all of that
      * block's transactions.  Any transactions requested separately are fetched afterwards.
      *
+     * Serialized block entries are cached, so peers syncing the same span
+     * of the chain do not each cost a database read and a serialization.
+     *
      * @param arg the request
-     * @param rsp return-by-reference the response to fill in
+     * @param rsp return-by-reference the response, except for its blocks
+     * @param rsp_blob return-by-reference the serialized response, blocks included
      *
      * @return true unless any blocks or transactions are missing
      */
-    bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp);
+    bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, std::string& rsp_blob);
 
     /**
      * @brief get number of outputs of an amount past the minimum spendable age
@@ -538,6 +638,30 @@ namespace cryptonote
      */
     bool check_tx_inputs(transaction& tx, uint64_t& pmax_used_block_height, crypto::hash& max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false);
 
+    /**
+     * @brief the input check of one transaction in a batch, see check_tx_inputs_batch
+     */
+    struct tx_input_check
+    {
+      transaction *tx; //!< the transaction to validate, expanded like in check_tx_inputs
+      bool result; //!< return-by-reference whether all inputs are valid
+      tx_verification_context tvc; //!< return-by-reference information about tx verification
+      uint64_t max_used_block_height; //!< return-by-reference block height of most recent input
+      crypto::hash max_used_block_id; //!< return-by-reference block hash of most recent input
+    };
+
+    /**
+     * @brief validates the inputs of a batch of relayed transactions
+     *
+     * Same checks as check_tx_inputs for each transaction, but only the ring
+     * lookups are done under the blockchain lock. The ring signature and
+     * MLSAG checks of the whole batch then run in one parallel pass, after
+     * the lock is released.
+     *
+     * @param txes the transactions to validate, and where to store the results
+     */
+    void check_tx_inputs_batch(std::vector<tx_input_check> &txes);
+
     /**
      * @brief get fee quantization mask
      *
@@ -661,6 +785,19 @@ namespace cryptonote
     template<class t_ids_container, class t_tx_container, class t_missed_container>
     bool get_transactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) const;
 
+    /**
+     * @brief gets the transaction blobs of a block in the main chain
+     *
+     * Reads them as one range where the db allows it, else looks each
+     * one up by hash.
+     *
+     * @param b the block
+     * @param txs return-by-reference the blobs are appended here, in block order
+     * @param missed_txs return-by-reference the hashes of transactions not found
+     * @param pruned whether to return full or pruned blobs
+     */
+    void get_block_transactions_blobs(const block& b, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs, bool pruned = false) const;
+
     //debug functions
 
     /**
@@ -708,6 +845,35 @@ namespace cryptonote
     void set_user_options(uint64_t maxthreads, bool sync_on_blocks, uint64_t sync_threshold,
         blockchain_db_sync_mode sync_mode, bool fast_sync);
 
+    /**
+     * @brief adapts db batch sizes and the sync interval to measured commit and sync times
+     *
+     * The sync interval is only adapted if the sync mode was left to its
+     * default and syncs are counted in blocks, from the sync threshold up.
+     * Call after set_user_options.
+     *
+     * @param max_sync_blocks the most blocks between syncs, 0 to keep the sync threshold
+     * @param min_batch_blocks the fewest blocks per batch
+     * @param max_batch_blocks the most blocks per batch, 0 to not adapt batch sizes
+     * @param rotating_drive whether the db is on a rotating drive
+     */
+    void set_db_sync_tuning(uint64_t max_sync_blocks, uint64_t min_batch_blocks, uint64_t max_batch_blocks, bool rotating_drive);
+
+    /**
+     * @brief gets the adapted blocks per batch, 0 if not adapted
+     */
+    uint64_t get_db_batch_blocks() const { return m_db_sync_tuner.get_batch_blocks(); }
+
+    /**
+     * @brief gets the number of blocks between db syncs, adapted or not, 0 if syncs are not counted in blocks
+     */
+    uint64_t get_db_sync_blocks() const;
+
+    /**
+     * @brief gets the adapted db sync settings and measured commit and sync times
+     */
+    db_sync_tuner::state get_db_sync_state() const { return m_db_sync_tuner.get_state(); }
+
     /**
      * @brief sets a block notify object to call for every new block
      *
@@ -715,6 +881,30 @@ namespace cryptonote
      */
     void set_block_notify(const std::shared_ptr<tools::Notify> &notify) { m_block_notify = notify; }
 
+    /**
+     * @brief sets callbacks to call when the main chain changes
+     *
+     * The block callback gets the height and block of every block added to
+     * the main chain. The reorg callback gets the split height and the chain
+     * height before and after a switch to an alternative chain; the blocks of
+     * the new branch are reported to the block callback after it.
+     *
+     * Both run with the blockchain lock held, so they must not block or call
+     * back into the blockchain. Set them before the daemon starts syncing.
+     *
+     * @param block_added the callback to call for every new main chain block
+     * @param reorg the callback to call after every reorganization
+     */
+    void set_chain_callbacks(const std::function<void(uint64_t, const block&)> &block_added, const std::function<void(uint64_t, uint64_t, uint64_t)> &reorg) { m_block_added_callback = block_added; m_reorg_callback = reorg; }
+
+    /**
+     * @brief sets the light wallet scanner to run on every block added to, or popped from, the main chain
+     *
+     * Unlike the chain callbacks, it also sees the blocks connected while
+     * switching to an alternative chain, as they are connected.
+     */
+    void set_light_wallet_scanner(const std::shared_ptr<light_wallet_scanner> &scanner) { m_light_wallet_scanner = scanner; }
+
     /**
      * @brief Put DB in safe sync mode
      */
@@ -727,6 +917,97 @@ namespace cryptonote
      */
     void set_show_time_stats(bool stats) { m_show_time_stats = stats; }
 
+    /**
+     * @brief time spent adding blocks to the main chain, by phase
+     *
+     * PoW time includes the per block share of PoW computed ahead of time
+     * by prepare_handle_incoming_blocks.
+     */
+    struct block_processing_stats
+    {
+      uint64_t blocks;
+      uint64_t txes;
+      uint64_t pow_ms;
+      uint64_t tx_checks_ms;
+      uint64_t db_ms;
+      uint64_t total_ms;
+    };
+
+    /**
+     * @brief gets the block processing times accumulated since the last reset
+     *
+     * @return the accumulated stats
+     */
+    block_processing_stats get_block_processing_stats() const;
+
+    /**
+     * @brief resets the accumulated block processing times
+     */
+    void reset_block_processing_stats();
+
+    /**
+     * @brief gets the tracer timing each phase of the last blocks added
+     *
+     * @return the tracer, off until told how many blocks to keep
+     */
+    block_tracer &get_block_tracer() { return m_block_tracer; }
+
+    /**
+     * @brief set whether or not block PoW hashes are cached in the db
+     *
+     * @param enabled the new cache setting
+     */
+    void set_pow_hash_cache(bool enabled) { m_pow_hash_cache = enabled; }
+
+    /**
+     * @brief set whether blocks covered by the embedded hashes still get their inputs checked
+     *
+     * When set, fast sync only skips the signatures of those blocks: key images,
+     * ring members and the other input rules are checked against the chain as usual.
+     *
+     * @param enabled the new setting
+     */
+    void set_fast_sync_state_checks(bool enabled) { m_fast_sync_state_checks = enabled; }
+
+    /**
+     * @brief set how many invalid blocks are remembered
+     *
+     * Past that, the oldest are forgotten, and would be verified again if
+     * they are seen again.
+     *
+     * @param max_blocks the new limit
+     */
+    void set_max_invalid_blocks(size_t max_blocks);
+
+    /**
+     * @brief set how many bytes of serialized block entries are cached for
+     *        serving NOTIFY_REQUEST_GET_OBJECTS
+     *
+     * @param bytes the new limit, 0 to disable the cache
+     */
+    void set_block_entry_cache_size(size_t bytes);
+
+    /**
+     * @brief appends the approximate memory use of the in-memory caches and tables
+     *
+     * @param usage return-by-reference the list to append to
+     */
+    void get_memory_usage(std::vector<tools::memory_usage> &usage) const;
+
+    /**
+     * @brief get the pruning seed of the blockchain
+     *
+     * @return the seed of the stripe of prunable data kept, or 0 if all is kept
+     */
+    uint32_t get_blockchain_pruning_seed() const { return m_db->get_blockchain_pruning_seed(); }
+
+    /**
+     * @brief prune the prunable data of the blocks which left the tip, if pruning
+     *
+     * @return true on success
+     */
+    bool update_blockchain_pruning();
+
     /**
      * @brief gets the hardfork voting state object
      *
@@ -741,6 +1022,20 @@ namespace cryptonote
      */
     static const std::vector<HardFork::Params>& get_hard_fork_heights(network_type nettype);
 
+    /**
+     * @brief gets the block hashes compiled into the binary for a network
+     *
+     * Each entry is the hash of HASH_OF_HASHES_STEP consecutive block
+     * hashes, from the genesis block on. The mainnet set is checked
+     * against its expected hash first.
+     *
+     * @param nettype the network
+     * @param hashes return-by-reference the hashes, empty if none are compiled in
+     *
+     * @return false if the compiled-in data is corrupt, true otherwise
+     */
+    static bool get_compiled_in_block_hashes(network_type nettype, std::vector<crypto::hash> &hashes);
+
     /**
      * @brief gets the current hardfork version in use/voted for
      *
@@ -911,6 +1206,27 @@ namespace cryptonote
         std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash,
         cryptonote::transaction> &txs) const;
 
+    /**
+     * @brief looks up a block's PoW hash in the db cache
+     *
+     * @param id the block id
+     * @param pow return-by-reference the block's PoW hash
+     *
+     * @return true if the hash was cached, false otherwise
+     */
+    bool get_cached_pow_hash(const crypto::hash &id, crypto::hash &pow) const;
+
+    /**
+     * @brief stores a validated block's PoW hash in the db cache
+     *
+     * Failing to store is not an error, the hash is just computed again
+     * next time it is needed.
+     *
+     * @param id the block id
+     * @param pow the block's PoW hash
+     */
+    void cache_pow_hash(const crypto::hash &id, const crypto::hash &pow);
+
     /**
      * @brief computes the "short" and "long" hashes for a set of blocks
      *
@@ -921,6 +1237,83 @@ namespace cryptonote
     void block_longhash_worker(uint64_t height, const std::vector<block> &blocks,
         std::unordered_map<crypto::hash, crypto::hash> &map) const;
 
+    /**
+     * @brief parses and hashes a span for prefetch_block_longhashes
+     *
+     * @param blobs the block blobs of the span
+     * @param start_height the height of the first block
+     */
+    void longhash_prefetch_worker(const std::vector<blobdata> &blobs, uint64_t start_height);
+
+    /**
+     * @brief waits for a running longhash prefetch, if any, to finish
+     */
+    void wait_for_longhash_prefetch();
+
+    /**
+     * @brief takes the PoW hash found by verify_block_headers for a block, if any
+     *
+     * @return true if the block was verified at that height
+     */
+    bool take_header_longhash(const crypto::hash &id, uint64_t height, crypto::hash &pow);
+
+    /**
+     * @brief the number of blocks before a block its difficulty is computed from
+     */
+    static size_t get_difficulty_blocks_count(uint8_t version, uint64_t height);
+
+    /**
+     * @brief the difficulty for a main chain block at the given height
+     *
+     * @param version the hard fork version of the block
+     * @param height the height of the block
+     * @param timestamps the timestamps of the blocks before it
+     * @param cumulative_difficulties their cumulative difficulties
+     * @param length the number of blocks in the window
+     */
+    difficulty_type get_next_difficulty(uint8_t version, uint64_t height, const uint64_t *timestamps, const difficulty_type *cumulative_difficulties, size_t length) const;
+
+    /**
+     * @brief gets output data for ring members, going through the output cache
+     *
+     * Same semantics as BlockchainDB::get_output_key with allow_partial set:
+     * the results stop at the first output which does not exist.
+     *
+     * @param amount the amount of the outputs
+     * @param offsets the global indices of the outputs
+     * @param outputs return-by-reference the output data
+     */
+    void get_output_keys_cached(uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs) const;
+
+    /**
+     * @brief drops cached output data for outputs at or above a height
+     *
+     * @param height the height of the first popped block
+     */
+    void invalidate_output_key_cache(uint64_t height);
+
+    /**
+     * @brief records that a transaction's signatures were checked
+     *
+     * @param txid the transaction's hash
+     * @param max_used_block_height the height of the newest block referenced by its rings
+     * @param max_used_block_id the hash of that block
+     */
+    void add_verified_tx(const crypto::hash &txid, uint64_t max_used_block_height, const crypto::hash &max_used_block_id);
+
+    /**
+     * @brief checks whether a transaction's signatures can be trusted from an earlier check
+     *
+     * This is the case if they were checked while the block holding
+     * its newest ring member was the same as now, since its rings then
+     * resolve to the same outputs.
+     *
+     * @param txid the transaction's hash
+     *
+     * @return true if the signature checks can be skipped
+     */
+    bool is_tx_verified(const crypto::hash &txid) const;
+
     /**
      * @brief returns a set of known alternate chains
      *
@@ -970,6 +1363,47 @@ namespace cryptonote
 
     typedef std::map<uint64_t, std::vector<std::pair<crypto::hash, size_t>>> outputs_container; //crypto::hash - tx hash, size_t - index of out in transaction
 
+    /**
+     * @brief a ring signature or MLSAG check deferred by check_tx_inputs
+     *
+     * When validating a block, the signature checks of all its transactions
+     * are gathered and run in one parallel pass instead of one pass per
+     * transaction. The transaction pointed to must outlive the job.
+     */
+    struct signature_job
+    {
+      size_t tx_index; //!< index of the owning transaction in the block
+      const transaction *tx;
+      size_t input_index;
+      crypto::hash tx_prefix_hash;
+      rct::key message; //!< pre-MLSAG hash, RingCT only
+      std::vector<rct::ctkey> pubkeys; //!< ring members, v1 only
+    };
+
+    /**
+     * @brief one shard of the ring member output cache
+     *
+     * An LRU of output data keyed by (amount, global index), filled from
+     * ring member lookups in pool and block validation alike.
+     */
+    struct output_key_cache_shard
+    {
+      typedef std::pair<uint64_t, uint64_t> key_type;
+      struct key_hash
+      {
+        size_t operator()(const key_type &k) const { return std::hash<uint64_t>()(k.first * 0x9e3779b97f4a7c15ull ^ k.second); }
+      };
+      typedef std::list<std::pair<key_type, output_data_t>> entry_list;
+
+      boost::mutex lock;
+      entry_list entries;
+      std::unordered_map<key_type, entry_list::iterator, key_hash> index;
+    };
+
+    static const size_t OUTPUT_KEY_CACHE_SHARDS = 16;
+    static const size_t OUTPUT_HISTOGRAM_CACHE_MAX_ENTRIES = 65536;
+    static const size_t OUTPUT_HISTOGRAM_CACHE_MAX_FULL = 16;
+
 
     BlockchainDB* m_db;
 
@@ -982,10 +1416,50 @@ namespace cryptonote
     size_t m_current_block_cumul_weight_limit;
     size_t m_current_block_cumul_weight_median;
 
+    // per-batch validation tables live in m_validation_arena and are freed
+    // all at once by reset_validation_tables, guarded by m_blockchain_lock
+    typedef std::vector<output_data_t, tools::arena_allocator<output_data_t>> scan_outputs_t;
+    typedef std::unordered_map<crypto::key_image, scan_outputs_t, std::hash<crypto::key_image>, std::equal_to<crypto::key_image>,
+        tools::arena_allocator<std::pair<const crypto::key_image, scan_outputs_t>>> scan_inputs_t;
+    typedef std::unordered_map<crypto::hash, scan_inputs_t, std::hash<crypto::hash>, std::equal_to<crypto::hash>,
+        tools::arena_allocator<std::pair<const crypto::hash, scan_inputs_t>>> scan_table_t;
+    typedef std::unordered_map<crypto::key_image, bool, std::hash<crypto::key_image>, std::equal_to<crypto::key_image>,
+        tools::arena_allocator<std::pair<const crypto::key_image, bool>>> check_txin_inputs_t;
+    typedef std::unordered_map<crypto::hash, check_txin_inputs_t, std::hash<crypto::hash>, std::equal_to<crypto::hash>,
+        tools::arena_allocator<std::pair<const crypto::hash, check_txin_inputs_t>>> check_txin_table_t;
+
+    template<typename T> T make_validation_container()
+    {
+      return T(0, typename T::hasher(), typename T::key_equal(), typename T::allocator_type(m_validation_arena));
+    }
+
     // metadata containers
-    std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
+    tools::arena m_validation_arena;
+    scan_table_t m_scan_table;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
-    std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
+    // PoW hashes computed ahead of the sync loop, block id -> (height, hash)
+    std::unordered_map<crypto::hash, std::pair<uint64_t, crypto::hash>> m_prefetched_longhashes;
+    mutable boost::mutex m_prefetched_longhashes_lock;
+    boost::thread m_longhash_prefetch_thread;
+    boost::mutex m_longhash_prefetch_thread_lock;
+    // PoW hashes of headers checked by verify_block_headers, block id -> (height, hash)
+    std::unordered_map<crypto::hash, std::pair<uint64_t, crypto::hash>> m_header_longhashes;
+    check_txin_table_t m_check_txin_table;
+
+    // ring member output data, shared by pool and block validation
+    mutable output_key_cache_shard m_output_key_cache[OUTPUT_KEY_CACHE_SHARDS];
+
+    // get_output_histogram results, valid while the top block is m_output_histogram_cache_top
+    typedef std::tuple<uint64_t, uint64_t, uint64_t> output_histogram_entry;
+    mutable boost::mutex m_output_histogram_cache_lock;
+    mutable crypto::hash m_output_histogram_cache_top;
+    mutable std::map<std::tuple<uint64_t, bool, uint64_t>, output_histogram_entry> m_output_histogram_cache; // (amount, unlocked, recent_cutoff)
+    mutable std::map<std::tuple<bool, uint64_t, uint64_t>, std::map<uint64_t, output_histogram_entry>> m_output_histogram_all_cache; // all amounts, (unlocked, recent_cutoff, min_count)
+
+    // txes whose signatures passed in the pool, txid -> height and id of the
+    // block holding their newest ring member, oldest first in the deque
+    std::unordered_map<crypto::hash, std::pair<uint64_t, crypto::hash>> m_verified_txes;
+    std::deque<crypto::hash> m_verified_txes_order;
 
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<crypto::hash> m_blocks_hash_of_hashes;
@@ -994,19 +1468,30 @@ namespace cryptonote
 
     blockchain_db_sync_mode m_db_sync_mode;
     bool m_fast_sync;
+    bool m_fast_sync_state_checks;
     bool m_show_time_stats;
+    bool m_pow_hash_cache;
     bool m_db_default_sync;
     bool m_db_sync_on_blocks;
     uint64_t m_db_sync_threshold;
     uint64_t m_max_prepare_blocks_threads;
     uint64_t m_fake_pow_calc_time;
     uint64_t m_fake_scan_time;
+    block_processing_stats m_block_processing_stats;
+    block_tracer m_block_tracer;
     uint64_t m_sync_counter;
     uint64_t m_bytes_to_sync;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
+    db_sync_tuner m_db_sync_tuner;
+    uint64_t m_batch_blocks; // blocks and bytes in the incoming blocks batch, for m_db_sync_tuner
+    uint64_t m_batch_bytes;
+    difficulty_window m_difficulty_window;
     uint64_t m_timestamps_and_difficulties_height;
 
+    // the weights of the last CRYPTONOTE_REWARD_BLOCKS_WINDOW blocks below
+    // m_block_weights_height (0 if unknown), guarded by m_blockchain_lock
+    mutable tools::rolling_median<uint64_t> m_block_weights;
+    mutable uint64_t m_block_weights_height;
+
     epee::critical_section m_difficulty_lock;
     crypto::hash m_difficulty_for_next_block_top_hash;
     difficulty_type m_difficulty_for_next_block;
@@ -1015,12 +1500,18 @@ namespace cryptonote
     boost::thread_group m_async_pool;
     std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
 
-    // all alternative chains
-    blocks_ext_by_hash m_alternative_chains; // crypto::hash -> block_extended_info
-
     // some invalid blocks
     blocks_ext_by_hash m_invalid_blocks;     // crypto::hash -> block_extended_info
+    std::deque<crypto::hash> m_invalid_blocks_order; // oldest first
+    size_t m_max_invalid_blocks;
 
+    // serialized block entries recently served to peers, most recent first
+    typedef std::list<std::pair<crypto::hash, std::shared_ptr<const std::string>>> block_entry_list;
+    mutable boost::mutex m_block_entry_cache_lock;
+    block_entry_list m_block_entries;
+    std::unordered_map<crypto::hash, block_entry_list::iterator> m_block_entry_index;
+    size_t m_block_entry_cache_bytes;
+    size_t m_block_entry_cache_max_bytes;
 
     checkpoints m_checkpoints;
     bool m_enforce_dns_checkpoints;
@@ -1031,6 +1522,10 @@ namespace cryptonote
     bool m_offline;
     difficulty_type m_fixed_difficulty;
 
+    // the top of the db as last seen by refresh_from_db
+    uint64_t m_refresh_height;
+    crypto::hash m_refresh_top_id;
+
     std::atomic<bool> m_cancel;
 
     // block template cache
@@ -1043,6 +1538,10 @@ namespace cryptonote
     bool m_btc_valid;
 
     std::shared_ptr<tools::Notify> m_block_notify;
+    std::function<void(uint64_t, const block&)> m_block_added_callback;
+    std::function<void(uint64_t, uint64_t, uint64_t)> m_reorg_callback;
+    std::shared_ptr<light_wallet_scanner> m_light_wallet_scanner;
+    bool m_switching_chain;
 
     /**
      * @brief collects the keys for all outputs being "spent" as an input
@@ -1099,16 +1598,51 @@ namespace cryptonote
      * If pmax_related_block_height is not NULL, its value is set to the height
      * of the most recent block which contains an output used in any input set
      *
-     * Currently this function calls ring signature validation for each
-     * transaction.
+     * If deferred is NULL, ring signatures are validated before returning.
+     * Otherwise, the ring signature and simple RingCT MLSAG checks are
+     * appended to deferred, for a later call to check_signature_jobs.
      *
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param deferred if not NULL, where to queue the signature checks
+     * @param tx_index the index of tx in its block, recorded in deferred jobs
+     * @param trusted_signatures skip the ring signature and RCT checks, the block is covered by the embedded hashes
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, std::vector<signature_job> *deferred = NULL, size_t tx_index = 0, bool trusted_signatures = false);
+
+    /**
+     * @brief runs signature checks queued by check_tx_inputs in parallel
+     *
+     * Ring signature results are recorded in the txin check table, as when
+     * checked directly.
+     *
+     * @param jobs the signature checks to run
+     * @param failed_tx_index return-by-reference the lowest tx_index of a failed job
+     *
+     * @return false if any signature is invalid, otherwise true
+     */
+    bool check_signature_jobs(const std::vector<signature_job> &jobs, size_t &failed_tx_index);
+
+    /**
+     * @brief runs a single queued signature check
+     *
+     * @param job the signature check
+     * @param result 1 if the signature is valid, otherwise 0
+     */
+    void check_signature_job(const signature_job &job, uint64_t &result);
+
+    /**
+     * @brief runs signature checks queued by check_tx_inputs in parallel, without recording them
+     *
+     * Does not need the blockchain lock.
+     *
+     * @param jobs the signature checks to run
+     * @param results return-by-reference 1 for each valid signature, otherwise 0
+     */
+    void run_signature_jobs(const std::vector<signature_job> &jobs, std::vector<uint64_t> &results);
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1122,14 +1656,26 @@ namespace cryptonote
      *
      * @return false if the reorganization fails, otherwise true
      */
-    bool switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain, bool discard_disconnected_chain);
+    bool switch_to_alternative_blockchain(const std::list<alt_chain_entry>& alt_chain, bool discard_disconnected_chain);
 
     /**
      * @brief removes the most recent block from the blockchain
      *
+     * @param popped_txs return-by-reference the block's transactions, but
+     *        the miner tx, appended for the caller to return to the pool
+     *
      * @return the block removed
      */
-    block pop_block_from_blockchain();
+    block pop_block_from_blockchain(std::vector<transaction>& popped_txs);
+
+    /**
+     * @brief checks the inputs of transactions returned to the pool by a reorg
+     *
+     * The checks run in the background, and only fill the pool's input cache.
+     *
+     * @param txs the transactions popped off the main chain
+     */
+    void precheck_popped_txs(std::vector<transaction> &&txs);
 
     /**
      * @brief validate and add a new block to the end of the blockchain
@@ -1183,7 +1729,46 @@ namespace cryptonote
      *
      * @return the difficulty requirement
      */
-    difficulty_type get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator>& alt_chain, block_extended_info& bei) const;
+    difficulty_type get_next_difficulty_for_alternative_chain(const std::list<alt_chain_entry>& alt_chain, block_extended_info& bei) const;
+
+    /**
+     * @brief loads an alternative block from the db
+     *
+     * @param id the block id
+     * @param bei return-by-reference the block and its chain data
+     *
+     * @return false if the block is not stored or cannot be parsed, otherwise true
+     */
+    bool get_alt_block(const crypto::hash& id, block_extended_info& bei) const;
+
+    /**
+     * @brief stores an alternative block in the db
+     *
+     * Joins the current batch if there is one.
+     *
+     * @param entry the block id and chain data
+     * @param b the block
+     *
+     * @return false if the block could not be stored, otherwise true
+     */
+    bool add_alt_block(const alt_chain_entry& entry, const block& b);
+
+    /**
+     * @brief removes alternative blocks from the db
+     *
+     * Joins the current batch if there is one.
+     *
+     * @param ids the ids of the blocks to remove
+     */
+    void remove_alt_blocks(const std::vector<crypto::hash>& ids);
+
+    /**
+     * @brief removes alternative chains which have fallen too far behind
+     *
+     * An alternative block is kept while it, or any block built on it, is
+     * within BLOCKCHAIN_ALT_BLOCKS_MAX_DEPTH of the main chain top.
+     */
+    void prune_alt_blocks();
 
     /**
      * @brief sanity checks a miner transaction before validating an entire block
@@ -1231,14 +1816,15 @@ namespace cryptonote
     bool rollback_blockchain_switching(std::list<block>& original_chain, uint64_t rollback_height);
 
     /**
-     * @brief gets recent block weights for median calculation
+     * @brief brings the rolling window of recent block weights up to the top
      *
-     * get the block weights of the last <count> blocks, and return by reference <sz>.
+     * The window holds the weights of the last CRYPTONOTE_REWARD_BLOCKS_WINDOW
+     * blocks. Normally only the block added since the last call is read from
+     * the db; the window is reloaded if it lost track of the chain.
      *
-     * @param sz return-by-reference the list of weights
-     * @param count the number of blocks to get weights for
+     * @return the window, valid while m_blockchain_lock is held
      */
-    void get_last_n_blocks_weights(std::vector<size_t>& weights, size_t count) const;
+    const tools::rolling_median<uint64_t> &sync_block_weights() const;
 
     /**
      * @brief checks if a transaction is unlocked (its outputs spendable)
@@ -1278,6 +1864,13 @@ namespace cryptonote
      */
     bool add_block_as_invalid(const block_extended_info& bei, const crypto::hash& h);
 
+    /**
+     * @brief empties the scan and check_txin tables and frees their arena
+     *
+     * The caller must hold m_blockchain_lock.
+     */
+    void reset_validation_tables();
+
     /**
      * @brief checks a block's timestamp
      *
@@ -1382,6 +1975,24 @@ namespace cryptonote
      */
     bool expand_transaction_2(transaction &tx, const crypto::hash &tx_prefix_hash, const std::vector<std::vector<rct::ctkey>> &pubkeys);
 
+    /**
+     * @brief looks up a serialized block entry in the block entry cache
+     *
+     * @param id the block hash
+     *
+     * @return the serialized entry, or NULL if not cached
+     */
+    std::shared_ptr<const std::string> get_cached_block_entry(const crypto::hash &id);
+
+    /**
+     * @brief adds a serialized block entry to the block entry cache,
+     *        evicting the least recently used entries past the size limit
+     *
+     * @param id the block hash
+     * @param entry the serialized entry
+     */
+    void add_cached_block_entry(const crypto::hash &id, const std::shared_ptr<const std::string> &entry);
+
     /**
      * @brief invalidates any cached block template
      */
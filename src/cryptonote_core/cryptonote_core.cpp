@@ -47,7 +47,10 @@ using namespace epee;
 #include "crypto/crypto.h"
 #include "cryptonote_config.h"
 #include "cryptonote_tx_utils.h"
+#include "light_wallet_scanner.h"
+#include "snapshot_verifier.h"
 #include "misc_language.h"
+#include "profile_tools.h"
 #include "file_io_utils.h"
 #include <csignal>
 #include "checkpoints/checkpoints.h"
@@ -105,6 +108,10 @@ namespace cryptonote
     "offline"
   , "Do not listen for peers, nor connect to any"
   };
+  const command_line::arg_descriptor<bool> arg_rpc_only_readonly_db = {
+    "rpc-only-readonly-db"
+  , "Open the blockchain of a daemon running on the same data dir read only, and only serve RPC from it (implies --offline)"
+  };
   const command_line::arg_descriptor<bool> arg_disable_dns_checkpoints = {
     "disable-dns-checkpoints"
   , "Do not retrieve checkpoints from DNS"
@@ -134,6 +141,11 @@ namespace cryptonote
   , "Sync up most of the way by using embedded, known block hashes."
   , 1
   };
+  static const command_line::arg_descriptor<bool> arg_fast_block_sync_state_checks = {
+    "fast-block-sync-state-checks"
+  , "When syncing with embedded block hashes, skip only the signature checks and still check key images and ring members"
+  , false
+  };
   static const command_line::arg_descriptor<uint64_t> arg_prep_blocks_threads = {
     "prep-blocks-threads"
   , "Max number of threads to use when preparing block hashes in groups."
@@ -144,11 +156,26 @@ namespace cryptonote
   , "Show time-stats when processing blocks/txs and disk synchronization."
   , 0
   };
+  static const command_line::arg_descriptor<size_t> arg_block_trace  = {
+    "block-trace"
+  , "Keep the per phase timings of this many of the last blocks added, for the get_block_processing_trace RPC (0 to disable)."
+  , 0
+  };
   static const command_line::arg_descriptor<size_t> arg_block_sync_size  = {
     "block-sync-size"
   , "How many blocks to sync at once during chain synchronization (0 = adaptive)."
   , 0
   };
+  static const command_line::arg_descriptor<size_t> arg_block_sync_size_max  = {
+    "block-sync-size-max"
+  , "Most blocks to sync at once when --block-sync-size is adaptive, which adapts it to db commit times (0 = no adaptation)."
+  , BLOCKS_SYNCHRONIZING_MAX_COUNT
+  };
+  static const command_line::arg_descriptor<uint64_t> arg_db_sync_max_blocks  = {
+    "db-sync-max-blocks"
+  , "Most blocks between db syncs when --db-sync-mode is left to its default, which adapts the interval to db sync times (0 = no adaptation)."
+  , DB_SYNC_ADAPTIVE_MAX_BLOCKS
+  };
   static const command_line::arg_descriptor<std::string> arg_check_updates = {
     "check-updates"
   , "Check for new versions of etnc: [disabled|notify|download|update]"
@@ -169,6 +196,71 @@ namespace cryptonote
   , "Set maximum txpool weight in bytes."
   , DEFAULT_TXPOOL_MAX_WEIGHT
   };
+  static const command_line::arg_descriptor<size_t> arg_txpool_parsed_tx_cache_size  = {
+    "txpool-parsed-tx-cache-size"
+  , "Set how many parsed txpool transactions are kept in memory, 0 to disable."
+  , DEFAULT_TXPOOL_PARSED_TX_CACHE_SIZE
+  };
+  static const command_line::arg_descriptor<size_t> arg_txpool_input_cache_size  = {
+    "txpool-input-cache-size"
+  , "Set how many txpool input check results are kept in memory, 0 to disable."
+  , DEFAULT_TXPOOL_INPUT_CACHE_SIZE
+  };
+  static const command_line::arg_descriptor<bool> arg_txpool_in_memory  = {
+    "txpool-in-memory"
+  , "Keep the txpool in memory only, writing it to the database at exit and every --txpool-snapshot-interval."
+  , false
+  };
+  static const command_line::arg_descriptor<bool> arg_explorer_index  = {
+    "explorer-index"
+  , "Keep key image to spending tx and output key to output indexes for explorers, built from the existing chain on first use."
+  , false
+  };
+  static const command_line::arg_descriptor<std::string> arg_bootstrap_snapshot  = {
+    "bootstrap-snapshot"
+  , "Start from the blockchain db in this directory, when there is none yet, once it is verified against the compiled-in block hashes."
+  , ""
+  };
+  static const command_line::arg_descriptor<uint64_t> arg_txpool_snapshot_interval  = {
+    "txpool-snapshot-interval"
+  , "Seconds between writes of a --txpool-in-memory txpool to the database, 0 to only write it at exit."
+  , 0
+  };
+  static const command_line::arg_descriptor<size_t> arg_max_invalid_blocks  = {
+    "max-invalid-blocks"
+  , "Set how many invalid blocks are remembered, the oldest are forgotten past that."
+  , DEFAULT_MAX_INVALID_BLOCKS
+  };
+  static const command_line::arg_descriptor<size_t> arg_block_entry_cache_size  = {
+    "block-entry-cache-size"
+  , "Set how many bytes of serialized blocks are kept in memory for serving syncing peers, 0 to disable."
+  , DEFAULT_BLOCK_ENTRY_CACHE_SIZE
+  };
+  static const command_line::arg_descriptor<bool> arg_light_wallet_server  = {
+    "light-wallet-server"
+  , "Scan the chain for light wallets registering their view key, and serve them over RPC"
+  , false
+  };
+  static const command_line::arg_descriptor<size_t> arg_light_wallet_max_accounts  = {
+    "light-wallet-max-accounts"
+  , "Set how many light wallet accounts can be registered"
+  , DEFAULT_LIGHT_WALLET_MAX_ACCOUNTS
+  };
+  static const command_line::arg_descriptor<bool> arg_tx_hash_audit  = {
+    "tx-hash-audit"
+  , "Count transaction hashes computed more than once for the same data"
+  , false
+  };
+  static const command_line::arg_descriptor<bool> arg_no_pow_hash_cache  = {
+    "no-pow-hash-cache"
+  , "Do not cache block PoW hashes in the database"
+  , false
+  };
+  static const command_line::arg_descriptor<bool> arg_prune_blockchain  = {
+    "prune-blockchain"
+  , "Prune blockchain, keeping the prunable data of only 1/8 of older blocks"
+  , false
+  };
   static const command_line::arg_descriptor<std::string> arg_block_notify = {
     "block-notify"
   , "Run a program for each new block, '%s' will be replaced by the block hash"
@@ -179,6 +271,9 @@ namespace cryptonote
   core::core(i_cryptonote_protocol* pprotocol):
               m_mempool(m_blockchain_storage),
               m_blockchain_storage(m_mempool),
+              m_backup_in_progress(false),
+              m_backup_cancel(false),
+              m_backup_bytes(0),
               m_miner(this),
               m_miner_address(boost::value_initialized<account_public_address>()),
               m_starter_message_showed(false),
@@ -189,7 +284,9 @@ namespace cryptonote
               m_disable_dns_checkpoints(false),
               m_update_download(0),
               m_nettype(UNDEFINED),
-              m_update_available(false)
+              m_update_available(false),
+              m_offline(false),
+              m_read_only(false)
   {
     m_checkpoints_updating.clear();
     set_cryptonote_protocol(pprotocol);
@@ -217,14 +314,14 @@ namespace cryptonote
     m_blockchain_storage.set_enforce_dns_checkpoints(enforce_dns);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::update_checkpoints()
+  bool core::update_checkpoints(bool check_dns)
   {
     if (m_nettype != MAINNET || m_disable_dns_checkpoints) return true;
 
     if (m_checkpoints_updating.test_and_set()) return true;
 
     bool res = true;
-    if (time(NULL) - m_last_dns_checkpoints_update >= 3600)
+    if (check_dns && time(NULL) - m_last_dns_checkpoints_update >= 3600)
     {
       res = m_blockchain_storage.update_checkpoints(m_checkpoints_path, true);
       m_last_dns_checkpoints_update = time(NULL);
@@ -274,15 +371,33 @@ namespace cryptonote
     command_line::add_arg(desc, arg_dns_checkpoints);
     command_line::add_arg(desc, arg_prep_blocks_threads);
     command_line::add_arg(desc, arg_fast_block_sync);
+    command_line::add_arg(desc, arg_fast_block_sync_state_checks);
     command_line::add_arg(desc, arg_show_time_stats);
+    command_line::add_arg(desc, arg_block_trace);
     command_line::add_arg(desc, arg_block_sync_size);
+    command_line::add_arg(desc, arg_block_sync_size_max);
+    command_line::add_arg(desc, arg_db_sync_max_blocks);
     command_line::add_arg(desc, arg_check_updates);
     command_line::add_arg(desc, arg_fluffy_blocks);
     command_line::add_arg(desc, arg_no_fluffy_blocks);
     command_line::add_arg(desc, arg_test_dbg_lock_sleep);
     command_line::add_arg(desc, arg_offline);
+    command_line::add_arg(desc, arg_rpc_only_readonly_db);
     command_line::add_arg(desc, arg_disable_dns_checkpoints);
     command_line::add_arg(desc, arg_max_txpool_weight);
+    command_line::add_arg(desc, arg_txpool_parsed_tx_cache_size);
+    command_line::add_arg(desc, arg_txpool_input_cache_size);
+    command_line::add_arg(desc, arg_txpool_in_memory);
+    command_line::add_arg(desc, arg_txpool_snapshot_interval);
+    command_line::add_arg(desc, arg_explorer_index);
+    command_line::add_arg(desc, arg_bootstrap_snapshot);
+    command_line::add_arg(desc, arg_max_invalid_blocks);
+    command_line::add_arg(desc, arg_block_entry_cache_size);
+    command_line::add_arg(desc, arg_light_wallet_server);
+    command_line::add_arg(desc, arg_light_wallet_max_accounts);
+    command_line::add_arg(desc, arg_tx_hash_audit);
+    command_line::add_arg(desc, arg_no_pow_hash_cache);
+    command_line::add_arg(desc, arg_prune_blockchain);
     command_line::add_arg(desc, arg_block_notify);
 
     miner::init_options(desc);
@@ -321,7 +436,8 @@ namespace cryptonote
     set_enforce_dns_checkpoints(command_line::get_arg(vm, arg_dns_checkpoints));
     test_drop_download_height(command_line::get_arg(vm, arg_test_drop_download_height));
     m_fluffy_blocks_enabled = !get_arg(vm, arg_no_fluffy_blocks);
-    m_offline = get_arg(vm, arg_offline);
+    m_read_only = get_arg(vm, arg_rpc_only_readonly_db);
+    m_offline = get_arg(vm, arg_offline) || m_read_only;
     m_disable_dns_checkpoints = get_arg(vm, arg_disable_dns_checkpoints);
     if (!command_line::is_arg_defaulted(vm, arg_fluffy_blocks))
       MWARNING(arg_fluffy_blocks.name << " is obsolete, it is now default");
@@ -354,13 +470,19 @@ namespace cryptonote
     return m_blockchain_storage.get_blocks(start_offset, count, blocks);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_block_filters(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& filters) const
+  {
+    return m_blockchain_storage.get_block_filters(start_height, count, filters);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const
   {
     std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> bs;
     if (!m_blockchain_storage.get_blocks(start_offset, count, bs))
       return false;
-    for (const auto &b: bs)
-      blocks.push_back(b.second);
+    blocks.reserve(blocks.size() + bs.size());
+    for (auto &b: bs)
+      blocks.push_back(std::move(b.second));
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -412,6 +534,11 @@ namespace cryptonote
     uint64_t blocks_threads = command_line::get_arg(vm, arg_prep_blocks_threads);
     std::string check_updates_string = command_line::get_arg(vm, arg_check_updates);
     size_t max_txpool_weight = command_line::get_arg(vm, arg_max_txpool_weight);
+    size_t txpool_parsed_tx_cache_size = command_line::get_arg(vm, arg_txpool_parsed_tx_cache_size);
+    size_t txpool_input_cache_size = command_line::get_arg(vm, arg_txpool_input_cache_size);
+    size_t max_invalid_blocks = command_line::get_arg(vm, arg_max_invalid_blocks);
+    size_t block_entry_cache_size = command_line::get_arg(vm, arg_block_entry_cache_size);
+    set_tx_hash_audit(command_line::get_arg(vm, arg_tx_hash_audit));
 
     boost::filesystem::path folder(m_config_folder);
     if (m_nettype == FAKECHAIN)
@@ -437,6 +564,7 @@ namespace cryptonote
     // folder might not be a directory, etc, etc
     catch (...) { }
 
+    TIME_MEASURE_START(t_db);
     std::unique_ptr<BlockchainDB> db(new_db(db_type));
     if (db == NULL)
     {
@@ -448,6 +576,19 @@ namespace cryptonote
     MGINFO("Loading blockchain from folder " << folder.string() << " ...");
 
     const std::string filename = folder.string();
+
+    const std::string bootstrap_snapshot = command_line::get_arg(vm, arg_bootstrap_snapshot);
+    if (!bootstrap_snapshot.empty())
+    {
+      if (m_nettype == FAKECHAIN || m_read_only)
+      {
+        MERROR("A bootstrap snapshot cannot be used with a fake chain or a read only db");
+        return false;
+      }
+      if (!install_blockchain_snapshot(db_type, bootstrap_snapshot, filename))
+        return false;
+    }
+
     // default to fast:async:1 if overridden
     blockchain_db_sync_mode sync_mode = db_defaultsync;
     bool sync_on_blocks = true;
@@ -455,6 +596,11 @@ namespace cryptonote
 
     if (m_nettype == FAKECHAIN)
     {
+      if (m_read_only)
+      {
+        MERROR("A fake chain is reset on start, it cannot be read only");
+        return false;
+      }
       // reset the db by removing the database file before opening it
       if (!db->remove_data_file(filename))
       {
@@ -539,19 +685,39 @@ namespace cryptonote
 
       if (db_salvage)
         db_flags |= DBF_SALVAGE;
+      if (m_read_only)
+        db_flags |= DBF_RDONLY;
+      else if (command_line::get_arg(vm, arg_txpool_in_memory))
+        db_flags |= DBF_TXPOOL_MEMORY;
+      if (!m_read_only && command_line::get_arg(vm, arg_explorer_index))
+        db_flags |= DBF_EXPLORER_INDEX;
 
       db->open(filename, db_flags);
       if(!db->m_open)
         return false;
+
+      // before anything else uses the db, as pruning may reopen it
+      if (command_line::get_arg(vm, arg_prune_blockchain) && (m_read_only || !db->prune_blockchain()))
+      {
+        LOG_ERROR("Failed to prune blockchain");
+        return false;
+      }
     }
     catch (const DB_ERROR& e)
     {
       LOG_ERROR("Error opening database: " << e.what());
       return false;
     }
+    TIME_MEASURE_FINISH(t_db);
 
     m_blockchain_storage.set_user_options(blocks_threads,
         sync_on_blocks, sync_threshold, sync_mode, fast_sync);
+    {
+      const boost::optional<bool> is_hdd = tools::is_hdd(filename.c_str());
+      const size_t max_batch_blocks = command_line::get_arg(vm, arg_block_sync_size) ? 0 : command_line::get_arg(vm, arg_block_sync_size_max);
+      m_blockchain_storage.set_db_sync_tuning(command_line::get_arg(vm, arg_db_sync_max_blocks),
+          BLOCKS_SYNCHRONIZING_DEFAULT_COUNT, max_batch_blocks, is_hdd && *is_hdd);
+    }
 
     try
     {
@@ -568,26 +734,59 @@ namespace cryptonote
       regtest_hard_forks
     };
     const difficulty_type fixed_difficulty = command_line::get_arg(vm, arg_fixed_difficulty);
+    TIME_MEASURE_START(t_blockchain);
     r = m_blockchain_storage.init(db.release(), m_nettype, m_offline, regtest ? &regtest_test_options : test_options, fixed_difficulty);
-
+    TIME_MEASURE_FINISH(t_blockchain);
+    m_blockchain_storage.set_max_invalid_blocks(max_invalid_blocks);
+    m_blockchain_storage.set_block_entry_cache_size(block_entry_cache_size);
+
+    TIME_MEASURE_START(t_pool);
+    m_mempool.set_parsed_tx_cache_size(txpool_parsed_tx_cache_size);
+    m_mempool.set_input_cache_size(txpool_input_cache_size);
+    m_mempool.set_db_snapshot_interval(command_line::get_arg(vm, arg_txpool_snapshot_interval));
+    // the pool of a read only daemon is a view of the one owning the db
+    if (!m_read_only)
+      m_mempool.set_index_checkpoint_file((folder / "txpool_index.bin").string());
     r = m_mempool.init(max_txpool_weight);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize memory pool");
 
     // now that we have a valid m_blockchain_storage, we can clean out any
     // transactions in the pool that do not conform to the current fork
-    m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
+    if (!m_read_only)
+      m_mempool.validate(m_blockchain_storage.get_current_hard_fork_version());
+    TIME_MEASURE_FINISH(t_pool);
 
     bool show_time_stats = command_line::get_arg(vm, arg_show_time_stats) != 0;
     m_blockchain_storage.set_show_time_stats(show_time_stats);
+    m_blockchain_storage.get_block_tracer().set_max_blocks(command_line::get_arg(vm, arg_block_trace));
+    m_blockchain_storage.set_pow_hash_cache(!command_line::get_arg(vm, arg_no_pow_hash_cache));
+    m_blockchain_storage.set_fast_sync_state_checks(command_line::get_arg(vm, arg_fast_block_sync_state_checks));
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize blockchain storage");
 
+    // the scanner follows the chain from the blockchain's own thread, which
+    // a read only daemon does not have
+    if (command_line::get_arg(vm, arg_light_wallet_server) && !m_read_only)
+    {
+      m_light_wallet_scanner.reset(new light_wallet_scanner(m_blockchain_storage.get_db(), command_line::get_arg(vm, arg_light_wallet_max_accounts)));
+      m_light_wallet_accounts_file = (folder / "light_wallet_accounts.bin").string();
+      boost::system::error_code ec;
+      if (boost::filesystem::exists(m_light_wallet_accounts_file, ec) && !m_light_wallet_scanner->load(m_light_wallet_accounts_file))
+        MWARNING("Failed to load light wallet accounts from " << m_light_wallet_accounts_file);
+      m_blockchain_storage.set_light_wallet_scanner(m_light_wallet_scanner);
+    }
+
     block_sync_size = command_line::get_arg(vm, arg_block_sync_size);
 
     MGINFO("Loading checkpoints");
 
-    // load json & DNS checkpoints, and verify them
-    // with respect to what blocks we already have
-    CHECK_AND_ASSERT_MES(update_checkpoints(), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
+    // load json checkpoints, and verify them with respect to what blocks we
+    // already have, which may pop blocks and so is left to the daemon owning
+    // a read only db. DNS checkpoints are slow to resolve, so they are first
+    // fetched from on_idle rather than holding up startup
+    TIME_MEASURE_START(t_checkpoints);
+    if (!m_read_only)
+      CHECK_AND_ASSERT_MES(update_checkpoints(false), false, "One or more checkpoints loaded from json conflicted with existing checkpoints.");
+    TIME_MEASURE_FINISH(t_checkpoints);
 
    // DNS versions checking
     if (check_updates_string == "disabled")
@@ -603,8 +802,14 @@ namespace cryptonote
       return false;
     }
 
+    TIME_MEASURE_START(t_miner);
     r = m_miner.init(vm, m_nettype);
     CHECK_AND_ASSERT_MES(r, false, "Failed to initialize miner instance");
+    TIME_MEASURE_FINISH(t_miner);
+
+    MGINFO("Core initialized in " << (t_db + t_blockchain + t_pool + t_checkpoints + t_miner) << " ms (db " << t_db
+        << " ms, blockchain " << t_blockchain << " ms, pool " << t_pool << " ms, checkpoints " << t_checkpoints
+        << " ms, miner " << t_miner << " ms)");
 
     return load_state_data();
   }
@@ -623,11 +828,63 @@ namespace cryptonote
     bool core::deinit()
   {
     m_miner.stop();
+    m_backup_cancel = true;
+    if (m_backup_thread.joinable())
+      m_backup_thread.join();
     m_mempool.deinit();
+    if (m_light_wallet_scanner)
+    {
+      m_blockchain_storage.set_light_wallet_scanner(nullptr);
+      if (!m_light_wallet_scanner->store(m_light_wallet_accounts_file))
+        MWARNING("Failed to save light wallet accounts to " << m_light_wallet_accounts_file);
+    }
     m_blockchain_storage.deinit();
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::start_blockchain_backup(const std::string &folder, uint64_t max_bytes_per_second)
+  {
+    if (m_backup_in_progress.exchange(true))
+      return false;
+    if (m_backup_thread.joinable())
+      m_backup_thread.join();
+    m_backup_bytes = 0;
+    {
+      boost::lock_guard<boost::mutex> lock(m_backup_lock);
+      m_backup_error.clear();
+    }
+    m_backup_thread = boost::thread([this, folder, max_bytes_per_second]() {
+      std::string error;
+      try
+      {
+        const bool r = m_blockchain_storage.get_db().backup(folder, max_bytes_per_second, [this](uint64_t bytes) {
+          m_backup_bytes = bytes;
+          return !m_backup_cancel;
+        });
+        if (!r)
+          error = m_backup_cancel ? "Cancelled" : "Not supported by this database";
+      }
+      catch (const std::exception &e)
+      {
+        error = e.what();
+      }
+      if (!error.empty())
+        MERROR("Failed to copy the blockchain to " << folder << ": " << error);
+      boost::lock_guard<boost::mutex> lock(m_backup_lock);
+      m_backup_error = error;
+      m_backup_in_progress = false;
+    });
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  void core::get_blockchain_backup_status(bool &in_progress, uint64_t &bytes_written, std::string &error) const
+  {
+    boost::lock_guard<boost::mutex> lock(m_backup_lock);
+    in_progress = m_backup_in_progress;
+    bytes_written = m_backup_bytes;
+    error = m_backup_error;
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::test_drop_download()
   {
     m_test_drop_download = false;
@@ -769,14 +1026,7 @@ namespace cryptonote
           tx_info[n].result = false;
           break;
         case rct::RCTTypeSimple:
-          if (!rct::verRctSemanticsSimple(rv))
-          {
-            MERROR_VER("rct signature semantics check failed");
-            set_semantics_failed(tx_info[n].tx_hash);
-            tx_info[n].tvc.m_verifivation_failed = true;
-            tx_info[n].result = false;
-            break;
-          }
+          rvv.push_back(&rv); // delayed batch verification
           break;
         case rct::RCTTypeFull:
           if (!rct::verRct(rv, true))
@@ -816,7 +1066,8 @@ namespace cryptonote
       {
         if (!tx_info[n].result)
           continue;
-        if (tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproof)
+        const uint8_t type = tx_info[n].tx->rct_signatures.type;
+        if (type != rct::RCTTypeBulletproof && type != rct::RCTTypeSimple)
           continue;
         if (assumed_bad || !rct::verRctSemanticsSimple(tx_info[n].tx->rct_signatures))
         {
@@ -839,6 +1090,11 @@ namespace cryptonote
     std::vector<result> results(tx_blobs.size());
 
     tvc.resize(tx_blobs.size());
+    // txes for the pool are checked on their own threads, so a flood of
+    // them does not hold up verifying the next block
+    std::unique_ptr<tools::threadpool::scoped_purpose> purpose;
+    if (!keeped_by_block)
+      purpose.reset(new tools::threadpool::scoped_purpose(tools::threadpool::relay));
     tools::threadpool& tpool = tools::threadpool::getInstance();
     tools::threadpool::waiter waiter;
     std::vector<blobdata>::const_iterator it = tx_blobs.begin();
@@ -898,6 +1154,20 @@ namespace cryptonote
     if (!tx_info.empty())
       handle_incoming_tx_accumulated_batch(tx_info, keeped_by_block);
 
+    // check the inputs of the txes which passed so far in one parallel pass,
+    // so the serial add_tx calls below mostly find their result cached
+    if (!keeped_by_block)
+    {
+      std::vector<std::tuple<transaction*, crypto::hash, size_t>> precheck;
+      it = tx_blobs.begin();
+      for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
+        if (results[i].res && !already_have[i] && !tvc[i].m_verifivation_failed)
+          precheck.push_back(std::make_tuple(&results[i].tx, results[i].hash, get_transaction_weight(results[i].tx, it->size())));
+      }
+      if (precheck.size() > 1)
+        m_mempool.precheck_tx_inputs(precheck, m_blockchain_storage.get_current_hard_fork_version());
+    }
+
     bool ok = true;
     it = tx_blobs.begin();
     for (size_t i = 0; i < tx_blobs.size(); i++, ++it) {
@@ -1028,11 +1298,7 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
-    spent.clear();
-    for(auto& ki: key_im)
-    {
-      spent.push_back(m_blockchain_storage.have_tx_keyimg_as_spent(ki));
-    }
+    m_blockchain_storage.have_key_images_as_spent(key_im, spent);
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -1041,41 +1307,39 @@ namespace cryptonote
     static const uint64_t quick_height = m_nettype == TESTNET ? 801219 : m_nettype == MAINNET ? 1220516 : 0;
     if (block_sync_size > 0)
       return block_sync_size;
+    const size_t adapted = m_blockchain_storage.get_db_batch_blocks();
     if (height >= quick_height)
-      return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
-    return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4;
+      return adapted ? adapted : BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
+    return std::max<size_t>(adapted, BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
+  bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent, bool include_sensitive_data) const
   {
     spent.clear();
 
-    return m_mempool.check_for_key_images(key_im, spent);
+    return m_mempool.check_for_key_images(key_im, spent, include_sensitive_data);
   }
   //-----------------------------------------------------------------------------------------------
   std::pair<uint64_t, uint64_t> core::get_coinbase_tx_sum(const uint64_t start_offset, const size_t count)
   {
     uint64_t emission_amount = 0;
     uint64_t total_fee_amount = 0;
-    if (count)
+    CRITICAL_REGION_LOCAL(m_blockchain_storage);
+    const uint64_t height = m_blockchain_storage.get_current_blockchain_height();
+    if (count && start_offset < height)
     {
-      const uint64_t end = start_offset + count - 1;
-      m_blockchain_storage.for_blocks_range(start_offset, end,
-        [this, &emission_amount, &total_fee_amount](uint64_t, const crypto::hash& hash, const block& b){
-      std::vector<transaction> txs;
-      std::vector<crypto::hash> missed_txs;
-      uint64_t coinbase_amount = get_outs_money_amount(b.miner_tx);
-      this->get_transactions(b.tx_hashes, txs, missed_txs);      
-      uint64_t tx_fee_amount = 0;
-      for(const auto& tx: txs)
+      // the db keeps running totals, so any range is the difference of two of them
+      const uint64_t end = count < height - start_offset ? start_offset + count - 1 : height - 1;
+      const BlockchainDB &db = m_blockchain_storage.get_db();
+      db_rtxn_guard rtxn_guard(&db);
+      db.get_block_cumulative_emission_and_fees(end, emission_amount, total_fee_amount);
+      if (start_offset > 0)
       {
-        tx_fee_amount += get_tx_fee(tx);
+        uint64_t prev_emission, prev_fees;
+        db.get_block_cumulative_emission_and_fees(start_offset - 1, prev_emission, prev_fees);
+        emission_amount -= prev_emission;
+        total_fee_amount -= prev_fees;
       }
-      
-      emission_amount += coinbase_amount - tx_fee_amount;
-      total_fee_amount += tx_fee_amount;
-      return true;
-      });
     }
 
     return std::pair<uint64_t, uint64_t>(emission_amount, total_fee_amount);
@@ -1195,14 +1459,14 @@ namespace cryptonote
     return m_blockchain_storage.create_block_template(b, adr, diffic, height, expected_reward, ex_nonce);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const
+  bool core::find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, size_t max_headers) const
   {
-    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp);
+    return m_blockchain_storage.find_blockchain_supplement(qblock_ids, resp, max_headers);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const
+  bool core::find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices) const
   {
-    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, pruned, get_miner_tx_hash, max_count);
+    return m_blockchain_storage.find_blockchain_supplement(req_start_block, qblock_ids, blocks, total_height, start_height, pruned, get_miner_tx_hash, max_count, output_indices);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_outs(const COMMAND_RPC_GET_OUTPUTS_BIN::request& req, COMMAND_RPC_GET_OUTPUTS_BIN::response& res) const
@@ -1309,11 +1573,22 @@ namespace cryptonote
 
   //-----------------------------------------------------------------------------------------------
   bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks)
+  {
+    std::vector<block> parsed_blocks;
+    return prepare_handle_incoming_blocks(blocks, parsed_blocks);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks, std::vector<block> &parsed_blocks)
   {
     m_incoming_tx_lock.lock();
-    m_blockchain_storage.prepare_handle_incoming_blocks(blocks);
+    m_blockchain_storage.prepare_handle_incoming_blocks(blocks, parsed_blocks);
     return true;
   }
+  //-----------------------------------------------------------------------------------------------
+  void core::prefetch_block_longhashes(const std::vector<block_complete_entry> &blocks, uint64_t start_height)
+  {
+    m_blockchain_storage.prefetch_block_longhashes(blocks, start_height);
+  }
 
   //-----------------------------------------------------------------------------------------------
   bool core::cleanup_handle_incoming_blocks(bool force_sync)
@@ -1324,17 +1599,27 @@ namespace cryptonote
     }
     catch (...) {}
     m_incoming_tx_lock.unlock();
+    // blocks added while syncing don't refresh the template one by one, so the miner
+    // would keep working on a stale parent until its next periodic refresh
+    if (m_miner.is_mining() && m_miner.get_template_prev_id() != m_blockchain_storage.get_tail_id())
+      update_miner_block_template();
     return success;
   }
 
   //-----------------------------------------------------------------------------------------------
   bool core::handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate)
+  {
+    return handle_incoming_block(block_blob, NULL, bvc, update_miner_blocktemplate);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::handle_incoming_block(const blobdata& block_blob, const block *b, block_verification_context& bvc, bool update_miner_blocktemplate)
   {
     TRY_ENTRY();
 
-    // load json & DNS checkpoints every 10min/hour respectively,
-    // and verify them with respect to what blocks we already have
-    CHECK_AND_ASSERT_MES(update_checkpoints(), false, "One or more checkpoints loaded from json or dns conflicted with existing checkpoints.");
+    // load json checkpoints every 10min, and verify them with respect to
+    // what blocks we already have; DNS ones are left to on_idle so a slow
+    // resolver does not stall block handling
+    CHECK_AND_ASSERT_MES(update_checkpoints(false), false, "One or more checkpoints loaded from json conflicted with existing checkpoints.");
 
     bvc = boost::value_initialized<block_verification_context>();
     if(block_blob.size() > get_max_block_size())
@@ -1344,14 +1629,18 @@ namespace cryptonote
       return false;
     }
 
-    block b = AUTO_VAL_INIT(b);
-    if(!parse_and_validate_block_from_blob(block_blob, b))
+    block lb;
+    if (!b)
     {
-      LOG_PRINT_L1("Failed to parse and validate new block");
-      bvc.m_verifivation_failed = true;
-      return false;
+      if(!parse_and_validate_block_from_blob(block_blob, lb))
+      {
+        LOG_PRINT_L1("Failed to parse and validate new block");
+        bvc.m_verifivation_failed = true;
+        return false;
+      }
+      b = &lb;
     }
-    add_new_block(b, bvc);
+    add_new_block(*b, bvc);
     if(update_miner_blocktemplate && bvc.m_added_to_main_chain)
        update_miner_block_template();
     return true;
@@ -1413,6 +1702,11 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_pool_transaction_changes(uint64_t instance, uint64_t cookie, uint64_t &current_instance, uint64_t &current_cookie, std::vector<crypto::hash> &added, std::vector<crypto::hash> &removed, bool include_sensitive_data) const
+  {
+    return m_mempool.get_transaction_changes(instance, cookie, current_instance, current_cookie, added, removed, include_sensitive_data);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_pool_transaction_stats(struct txpool_stats& stats, bool include_sensitive_data) const
   {
     m_mempool.get_transaction_stats(stats, include_sensitive_data);
@@ -1444,9 +1738,9 @@ namespace cryptonote
     return m_blockchain_storage.get_short_chain_history(ids);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context)
+  bool core::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, std::string& rsp_blob, cryptonote_connection_context& context)
   {
-    return m_blockchain_storage.handle_get_objects(arg, rsp);
+    return m_blockchain_storage.handle_get_objects(arg, rsp, rsp_blob);
   }
   //-----------------------------------------------------------------------------------------------
   crypto::hash core::get_block_id_by_height(uint64_t height) const
@@ -1475,7 +1769,9 @@ namespace cryptonote
     if(!m_starter_message_showed)
     {
       std::string main_message;
-      if (m_offline)
+      if (m_read_only)
+        main_message = "The daemon is serving RPC from a read only blockchain, kept up to date by the daemon owning it.";
+      else if (m_offline)
         main_message = "The daemon is running offline and will not attempt to sync to the ETNC network.";
       else
         main_message = "The daemon will start synchronizing with the network. This may take a long time to complete.";
@@ -1491,15 +1787,42 @@ namespace cryptonote
       m_starter_message_showed = true;
     }
 
+    if (m_read_only)
+    {
+      m_read_only_refresh_interval.do_call(boost::bind(&core::refresh_read_only_state, this));
+      return true;
+    }
+
+    // DNS checkpoints are fetched hourly, and the first time here, off the
+    // startup path
+    update_checkpoints();
     m_fork_moaner.do_call(boost::bind(&core::check_fork_time, this));
     m_txpool_auto_relayer.do_call(boost::bind(&core::relay_txpool_transactions, this));
     m_check_updates_interval.do_call(boost::bind(&core::check_updates, this));
     m_check_disk_space_interval.do_call(boost::bind(&core::check_disk_space, this));
+    m_blockchain_pruning_interval.do_call(boost::bind(&core::update_blockchain_pruning, this));
+    if (m_light_wallet_scanner)
+      m_light_wallet_catch_up_interval.do_call([this](){ m_light_wallet_scanner->catch_up(); return true; });
     m_miner.on_idle();
     m_mempool.on_idle();
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::refresh_read_only_state()
+  {
+    try
+    {
+      m_blockchain_storage.refresh_from_db();
+      // the pool changes without the chain changing, so it is reloaded every time
+      m_mempool.reload();
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to refresh from the read only blockchain: " << e.what());
+    }
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::check_fork_time()
   {
     HardFork::State state = m_blockchain_storage.get_hard_fork_state();
@@ -1683,6 +2006,111 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::install_blockchain_snapshot(const std::string &db_type, const std::string &snapshot_folder, const std::string &folder)
+  {
+    boost::system::error_code ec;
+    if (boost::filesystem::exists(boost::filesystem::path(folder) / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, ec))
+    {
+      MGINFO("There is a blockchain in " << folder << " already, ignoring the bootstrap snapshot");
+      return true;
+    }
+
+    std::vector<crypto::hash> block_hashes;
+    if (!Blockchain::get_compiled_in_block_hashes(m_nettype, block_hashes))
+    {
+      MERROR("Failed to load the compiled-in block hashes");
+      return false;
+    }
+    cryptonote::checkpoints checkpoints;
+    if (!checkpoints.init_default_checkpoints(m_nettype))
+    {
+      MERROR("Failed to initialize checkpoints");
+      return false;
+    }
+
+    // the copy is made and trimmed next to the db folder, and only moved
+    // in place once done
+    const std::string staging = folder + ".bootstrap";
+    uint64_t anchored_height;
+    try
+    {
+      std::unique_ptr<BlockchainDB> snapshot(new_db(db_type));
+      if (snapshot == NULL)
+      {
+        MERROR("Attempted to use non-existent database type");
+        return false;
+      }
+      MGINFO("Verifying the blockchain snapshot in " << snapshot_folder << " ...");
+      TIME_MEASURE_START(t_verify);
+      snapshot->open(snapshot_folder, DBF_RDONLY);
+      snapshot_verifier verifier(*snapshot, block_hashes, checkpoints.get_points());
+      if (!verifier.verify())
+      {
+        MERROR("The blockchain snapshot failed verification: " << verifier.get_error());
+        return false;
+      }
+      TIME_MEASURE_FINISH(t_verify);
+      anchored_height = verifier.get_anchored_height();
+      const uint64_t height = snapshot->height();
+      if (height - anchored_height > BOOTSTRAP_SNAPSHOT_MAX_UNANCHORED_BLOCKS)
+      {
+        MERROR("The blockchain snapshot has " << (height - anchored_height) << " blocks above the compiled-in block hashes, at most "
+            << BOOTSTRAP_SNAPSHOT_MAX_UNANCHORED_BLOCKS << " can be synced again");
+        return false;
+      }
+      MGINFO("Blockchain snapshot verified in " << t_verify << " ms, " << anchored_height << " of its " << height << " blocks are anchored");
+
+      boost::filesystem::remove_all(staging, ec);
+      if (!snapshot->backup(staging, 0))
+      {
+        MERROR("A " << db_type << " db cannot be copied");
+        return false;
+      }
+      snapshot->close();
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to verify the blockchain snapshot: " << e.what());
+      return false;
+    }
+
+    try
+    {
+      std::unique_ptr<BlockchainDB> db(new_db(db_type));
+      db->open(staging, 0);
+      if (db->height() > anchored_height)
+        MGINFO("Popping the " << (db->height() - anchored_height) << " blocks above the compiled-in block hashes, to sync them again");
+      while (db->height() > anchored_height)
+      {
+        block popped_block;
+        std::vector<transaction> popped_txs;
+        db->pop_block(popped_block, popped_txs);
+      }
+      db->close();
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to trim the copy of the blockchain snapshot: " << e.what());
+      return false;
+    }
+
+    boost::filesystem::create_directories(folder, ec);
+    boost::filesystem::rename(boost::filesystem::path(staging) / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, boost::filesystem::path(folder) / CRYPTONOTE_BLOCKCHAINDATA_FILENAME, ec);
+    if (ec)
+    {
+      MERROR("Failed to move the blockchain snapshot into " << folder << ": " << ec.message());
+      return false;
+    }
+    boost::filesystem::remove_all(staging, ec);
+    MGINFO("Blockchain snapshot installed in " << folder);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::update_blockchain_pruning()
+  {
+    return m_blockchain_storage.update_blockchain_pruning();
+  }
+  //-----------------------------------------------------------------------------------------------
   void core::set_target_blockchain_height(uint64_t target_blockchain_height)
   {
     m_target_blockchain_height = target_blockchain_height;
@@ -1698,6 +2126,11 @@ namespace cryptonote
     return get_blockchain_storage().prevalidate_block_hashes(height, hashes);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::verify_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers)
+  {
+    return get_blockchain_storage().verify_block_headers(height, hashes, headers);
+  }
+  //-----------------------------------------------------------------------------------------------
   uint64_t core::get_free_space() const
   {
     boost::filesystem::path path(m_config_folder);
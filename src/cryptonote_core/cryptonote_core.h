@@ -43,6 +43,7 @@
 #include "common/command_line.h"
 #include "tx_pool.h"
 #include "blockchain.h"
+#include "light_wallet_scanner.h"
 #include "cryptonote_basic/miner.h"
 #include "cryptonote_basic/connection_context.h"
 #include "cryptonote_basic/cryptonote_stat_info.h"
@@ -64,6 +65,7 @@ namespace cryptonote
   extern const command_line::arg_descriptor<bool, false> arg_regtest_on;
   extern const command_line::arg_descriptor<difficulty_type> arg_fixed_difficulty;
   extern const command_line::arg_descriptor<bool> arg_offline;
+  extern const command_line::arg_descriptor<bool> arg_rpc_only_readonly_db;
 
   /************************************************************************/
   /*                                                                      */
@@ -95,7 +97,7 @@ namespace cryptonote
      * @note see Blockchain::handle_get_objects()
      * @param context connection context associated with the request
      */
-     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context);
+     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, std::string& rsp_blob, cryptonote_connection_context& context);
 
      /**
       * @brief calls various idle routines
@@ -154,6 +156,19 @@ namespace cryptonote
       */
      bool handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate = true);
 
+     /**
+      * @brief handles an incoming block which may already have been parsed
+      *
+      * @param block_blob the block to be added
+      * @param b the parsed block, or NULL to parse it from block_blob
+      * @param bvc return-by-reference metadata context about the block's validity
+      * @param update_miner_blocktemplate whether or not to update the miner's block template
+      *
+      * @return false if loading new checkpoints fails, or the block is not
+      * added, otherwise true
+      */
+     bool handle_incoming_block(const blobdata& block_blob, const block *b, block_verification_context& bvc, bool update_miner_blocktemplate = true);
+
      /**
       * @copydoc Blockchain::prepare_handle_incoming_blocks
       *
@@ -161,6 +176,20 @@ namespace cryptonote
       */
      bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry>  &blocks);
 
+     /**
+      * @copydoc Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete_entry>&, std::vector<block>&)
+      *
+      * @note see Blockchain::prepare_handle_incoming_blocks
+      */
+     bool prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks, std::vector<block> &parsed_blocks);
+
+     /**
+      * @copydoc Blockchain::prefetch_block_longhashes
+      *
+      * @note see Blockchain::prefetch_block_longhashes
+      */
+     void prefetch_block_longhashes(const std::vector<block_complete_entry> &blocks, uint64_t start_height);
+
      /**
       * @copydoc Blockchain::cleanup_handle_incoming_blocks
       *
@@ -324,6 +353,13 @@ namespace cryptonote
       */
      bool get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata,block>>& blocks) const;
 
+     /**
+      * @copydoc Blockchain::get_block_filters
+      *
+      * @note see Blockchain::get_block_filters
+      */
+     bool get_block_filters(uint64_t start_height, size_t count, std::vector<cryptonote::blobdata>& filters) const;
+
      /**
       * @copydoc Blockchain::get_blocks(uint64_t, size_t, std::vector<std::pair<cryptonote::blobdata,block>>&) const
       *
@@ -449,6 +485,13 @@ namespace cryptonote
       */
      bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const;
 
+     /**
+      * @copydoc tx_memory_pool::get_transaction_changes
+      *
+      * @note see tx_memory_pool::get_transaction_changes
+      */
+     bool get_pool_transaction_changes(uint64_t instance, uint64_t cookie, uint64_t &current_instance, uint64_t &current_cookie, std::vector<crypto::hash> &added, std::vector<crypto::hash> &removed, bool include_unrelayed_txes = true) const;
+
      /**
       * @copydoc tx_memory_pool::get_transactions
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -508,18 +551,18 @@ namespace cryptonote
      bool get_short_chain_history(std::list<crypto::hash>& ids) const;
 
      /**
-      * @copydoc Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&) const
+      * @copydoc Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&, size_t) const
       *
-      * @note see Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&) const
+      * @note see Blockchain::find_blockchain_supplement(const std::list<crypto::hash>&, NOTIFY_RESPONSE_CHAIN_ENTRY::request&, size_t) const
       */
-     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const;
+     bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, size_t max_headers = 0) const;
 
      /**
       * @copydoc Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<cryptonote::blobdata, std::vector<cryptonote::blobdata> > >&, uint64_t&, uint64_t&, size_t) const
       *
       * @note see Blockchain::find_blockchain_supplement(const uint64_t, const std::list<crypto::hash>&, std::vector<std::pair<cryptonote::blobdata, std::vector<transaction> > >&, uint64_t&, uint64_t&, size_t) const
       */
-     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count) const;
+     bool find_blockchain_supplement(const uint64_t req_start_block, const std::list<crypto::hash>& qblock_ids, std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > >& blocks, uint64_t& total_height, uint64_t& start_height, bool pruned, bool get_miner_tx_hash, size_t max_count, std::vector<std::vector<std::vector<uint64_t>>> *output_indices = NULL) const;
 
      /**
       * @brief gets some stats about the daemon
@@ -593,6 +636,39 @@ namespace cryptonote
       */
      const Blockchain& get_blockchain_storage()const{return m_blockchain_storage;}
 
+     /**
+      * @brief gets the tx_memory_pool instance
+      *
+      * @return a reference to the tx_memory_pool instance
+      */
+     tx_memory_pool& get_pool(){return m_mempool;}
+
+     /**
+      * @brief gets the light wallet scanner
+      *
+      * @return the scanner, or NULL if the light wallet server is not enabled
+      */
+     light_wallet_scanner* get_light_wallet_scanner(){return m_light_wallet_scanner.get();}
+
+     /**
+      * @brief starts writing a compacted copy of the blockchain db in the background
+      *
+      * @param folder the directory to write the copy to
+      * @param max_bytes_per_second the rate to write the copy at, 0 for as fast as possible
+      *
+      * @return false if a copy is being written already
+      */
+     bool start_blockchain_backup(const std::string &folder, uint64_t max_bytes_per_second);
+
+     /**
+      * @brief gets the state of the last copy started by start_blockchain_backup
+      *
+      * @param in_progress return-by-reference whether the copy is still being written
+      * @param bytes_written return-by-reference the bytes of it written so far
+      * @param error return-by-reference why the copy failed, empty if it did not
+      */
+     void get_blockchain_backup_status(bool &in_progress, uint64_t &bytes_written, std::string &error) const;
+
      /**
       * @copydoc tx_memory_pool::print_pool
       *
@@ -670,9 +746,11 @@ namespace cryptonote
       * its checkpoints if it is time.  If updating checkpoints fails,
       * the daemon is told to shut down.
       *
+      * @param check_dns whether DNS checkpoints may be fetched, if they are due
+      *
       * @note see Blockchain::update_checkpoints()
       */
-     bool update_checkpoints();
+     bool update_checkpoints(bool check_dns = true);
 
      /**
       * @brief tells the daemon to wind down operations and stop running
@@ -713,10 +791,11 @@ namespace cryptonote
       *
       * @param key_im list of key images to check
       * @param spent return-by-reference result for each image checked
+      * @param include_sensitive_data whether to count key images only spent by txes not meant to be relayed
       *
       * @return true
       */
-     bool are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const;
+     bool are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent, bool include_sensitive_data = true) const;
 
      /**
       * @brief get the number of blocks to sync in one go
@@ -728,7 +807,10 @@ namespace cryptonote
      /**
       * @brief get the sum of coinbase tx amounts between blocks
       *
-      * @return the number of blocks to sync in one go
+      * @param start_offset the height of the first block
+      * @param count the number of blocks, clamped to the top of the chain
+      *
+      * @return the emission (coinbase less fees) and the fees over those blocks
       */
      std::pair<uint64_t, uint64_t> get_coinbase_tx_sum(const uint64_t start_offset, const size_t count);
      
@@ -763,6 +845,13 @@ namespace cryptonote
       */
      uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes);
 
+     /**
+      * @copydoc Blockchain::verify_block_headers
+      *
+      * @note see Blockchain::verify_block_headers
+      */
+     bool verify_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<blobdata> &headers);
+
      /**
       * @brief get free disk space on the blockchain partition
       *
@@ -770,6 +859,13 @@ namespace cryptonote
       */
      uint64_t get_free_space() const;
 
+     /**
+      * @brief get the pruning seed of the blockchain
+      *
+      * @return the seed of the stripe of prunable data kept, or 0 if all is kept
+      */
+     uint32_t get_blockchain_pruning_seed() const { return m_blockchain_storage.get_blockchain_pruning_seed(); }
+
      /**
       * @brief get whether the core is running offline
       *
@@ -777,6 +873,16 @@ namespace cryptonote
       */
      bool offline() const { return m_offline; }
 
+     /**
+      * @brief get whether the core serves a blockchain owned by another daemon
+      *
+      * A read only core does not add blocks or transactions, it follows the
+      * changes made by the daemon owning the db.
+      *
+      * @return whether the core is read only
+      */
+     bool read_only() const { return m_read_only; }
+
    private:
 
      /**
@@ -925,6 +1031,13 @@ namespace cryptonote
       */
      bool check_fork_time();
 
+     /**
+      * @brief follows the changes made to a read only blockchain and pool
+      *
+      * @return true
+      */
+     bool refresh_read_only_state();
+
      /**
       * @brief attempts to relay any transactions in the mempool which need it
       *
@@ -946,6 +1059,29 @@ namespace cryptonote
       */
      bool check_disk_space();
 
+     /**
+      * @brief installs a verified copy of a blockchain db, if there is no db yet
+      *
+      * The snapshot is verified by snapshot_verifier, copied next to the
+      * db folder, and the blocks above the anchored height are popped from
+      * the copy, to be synced again. Only then is it moved in place, so an
+      * interrupted install leaves no db behind.
+      *
+      * @param db_type the db type
+      * @param snapshot_folder the folder holding the snapshot
+      * @param folder the db folder
+      *
+      * @return false if the snapshot could not be verified or installed, true otherwise
+      */
+     bool install_blockchain_snapshot(const std::string &db_type, const std::string &snapshot_folder, const std::string &folder);
+
+     /**
+      * @brief prunes the blocks which left the tip, if the blockchain is pruned
+      *
+      * @return true on success, false otherwise
+      */
+     bool update_blockchain_pruning();
+
      bool m_test_drop_download = true; //!< whether or not to drop incoming blocks (for testing)
 
      uint64_t m_test_drop_download_height = 0; //!< height under which to drop incoming blocks, if doing so
@@ -953,6 +1089,16 @@ namespace cryptonote
      tx_memory_pool m_mempool; //!< transaction pool instance
      Blockchain m_blockchain_storage; //!< Blockchain instance
 
+     std::shared_ptr<light_wallet_scanner> m_light_wallet_scanner; //!< light wallet scanner, if enabled
+     std::string m_light_wallet_accounts_file; //!< where the light wallet registrations are saved
+
+     boost::thread m_backup_thread; //!< writes the copy started by start_blockchain_backup
+     std::atomic<bool> m_backup_in_progress; //!< is a copy being written?
+     std::atomic<bool> m_backup_cancel; //!< set at exit, to stop the copy being written
+     std::atomic<uint64_t> m_backup_bytes; //!< bytes of the copy written so far
+     std::string m_backup_error; //!< why the last copy failed, if it did
+     mutable boost::mutex m_backup_lock; //!< guards m_backup_error
+
      i_cryptonote_protocol* m_pprotocol; //!< cryptonote protocol instance
 
      epee::critical_section m_incoming_tx_lock; //!< incoming transaction lock
@@ -970,6 +1116,9 @@ namespace cryptonote
      epee::math_helper::once_a_time_seconds<60*2, false> m_txpool_auto_relayer; //!< interval for checking re-relaying txpool transactions
      epee::math_helper::once_a_time_seconds<60*60*12, true> m_check_updates_interval; //!< interval for checking for new versions
      epee::math_helper::once_a_time_seconds<60*10, true> m_check_disk_space_interval; //!< interval for checking for disk space
+     epee::math_helper::once_a_time_seconds<60*5, true> m_blockchain_pruning_interval; //!< interval for pruning blocks which left the tip
+     epee::math_helper::once_a_time_seconds<10, true> m_read_only_refresh_interval; //!< interval for following a read only blockchain
+     epee::math_helper::once_a_time_seconds<1, true> m_light_wallet_catch_up_interval; //!< interval for scanning past blocks for light wallets behind the chain
 
      std::atomic<bool> m_starter_message_showed; //!< has the "daemon will sync now" message been shown?
 
@@ -1006,6 +1155,7 @@ namespace cryptonote
 
      bool m_fluffy_blocks_enabled;
      bool m_offline;
+     bool m_read_only;
    };
 }
 
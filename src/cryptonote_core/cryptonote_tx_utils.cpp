@@ -75,33 +75,8 @@ namespace cryptonote
     LOG_PRINT_L2("destinations include " << num_stdaddresses << " standard addresses and " << num_subaddresses << " subaddresses");
   }
   //---------------------------------------------------------------
-  bool construct_miner_tx(size_t height, size_t median_weight, uint64_t already_generated_coins, size_t current_block_weight, uint64_t fee, const account_public_address &miner_address, transaction& tx, const blobdata& extra_nonce, size_t max_outs, uint8_t hard_fork_version) {
-    tx.vin.clear();
-    tx.vout.clear();
-    tx.extra.clear();
-
-    keypair txkey = keypair::generate(hw::get_device("default"));
-    add_tx_pub_key_to_extra(tx, txkey.pub);
-    if(!extra_nonce.empty())
-      if(!add_extra_nonce_to_tx_extra(tx.extra, extra_nonce))
-        return false;
-
-    txin_gen in;
-    in.height = height;
-
-    uint64_t block_reward;
-    if(!get_block_reward(median_weight, current_block_weight, already_generated_coins, block_reward, hard_fork_version))
-    {
-      LOG_PRINT_L0("Block is too big");
-      return false;
-    }
-
-#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
-    LOG_PRINT_L1("Creating block template: reward " << block_reward <<
-      ", fee " << fee);
-#endif
-    block_reward += fee;
-
+  static bool get_miner_tx_amounts(size_t height, uint64_t block_reward, size_t max_outs, uint8_t hard_fork_version, std::vector<uint64_t> &out_amounts)
+  {
     // from hard fork 2, we cut out the low significant digits. This makes the tx smaller, and
     // keeps the paid amount almost the same. The unpaid remainder gets pushed back to the
     // emission schedule
@@ -112,7 +87,7 @@ namespace cryptonote
       block_reward = block_reward - block_reward % ::config::BASE_REWARD_CLAMP_THRESHOLD;
     }
 
-    std::vector<uint64_t> out_amounts;
+    out_amounts.clear();
     decompose_amount_into_digits(block_reward, hard_fork_version >= 2 ? 0 : ::config::DEFAULT_DUST_THRESHOLD,
       [&out_amounts](uint64_t a_chunk) { out_amounts.push_back(a_chunk); },
       [&out_amounts](uint64_t a_dust) { out_amounts.push_back(a_dust); });
@@ -135,6 +110,42 @@ namespace cryptonote
     {
       CHECK_AND_ASSERT_MES(max_outs >= out_amounts.size(), false, "max_out exceeded");
     }
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool construct_miner_tx(size_t height, size_t median_weight, uint64_t already_generated_coins, size_t current_block_weight, uint64_t fee, const account_public_address &miner_address, transaction& tx, const blobdata& extra_nonce, size_t max_outs, uint8_t hard_fork_version) {
+    tx.vin.clear();
+    tx.vout.clear();
+    tx.extra.clear();
+
+    keypair txkey = keypair::generate(hw::get_device("default"));
+    add_tx_pub_key_to_extra(tx, txkey.pub);
+    if(!extra_nonce.empty())
+      if(!add_extra_nonce_to_tx_extra(tx.extra, extra_nonce))
+        return false;
+
+    txin_gen in;
+    in.height = height;
+
+    uint64_t block_reward;
+    if(!get_block_reward(median_weight, current_block_weight, already_generated_coins, block_reward, hard_fork_version))
+    {
+      LOG_PRINT_L0("Block is too big");
+      return false;
+    }
+
+#if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
+    LOG_PRINT_L1("Creating block template: reward " << block_reward <<
+      ", fee " << fee);
+#endif
+    block_reward += fee;
+
+    std::vector<uint64_t> out_amounts;
+    if (!get_miner_tx_amounts(height, block_reward, max_outs, hard_fork_version, out_amounts))
+      return false;
+    block_reward = 0;
+    for (uint64_t amount: out_amounts)
+      block_reward += amount;
 
     uint64_t summary_amounts = 0;
     for (size_t no = 0; no < out_amounts.size(); no++)
@@ -174,6 +185,87 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------
+  static size_t varint_size(uint64_t v)
+  {
+    size_t n = 1;
+    while (v >= 0x80)
+    {
+      v >>= 7;
+      ++n;
+    }
+    return n;
+  }
+  //---------------------------------------------------------------
+  bool get_miner_tx_weight(size_t height, uint64_t reward, const blobdata& extra_nonce, size_t max_outs, uint8_t hard_fork_version, size_t &weight)
+  {
+    std::vector<uint64_t> out_amounts;
+    if (!get_miner_tx_amounts(height, reward, max_outs, hard_fork_version, out_amounts))
+      return false;
+    CHECK_AND_ASSERT_MES(extra_nonce.size() <= TX_EXTRA_NONCE_MAX_COUNT, false, "extra nonce could be 255 bytes max");
+
+    // mirrors the serialization of the transaction construct_miner_tx builds:
+    // version, unlock time, one txin_gen, txout_to_key outputs, extra holding the
+    // tx pub key and the nonce, and for v2 the RCTTypeNull byte
+    const size_t extra_size = 1 + sizeof(crypto::public_key) + (extra_nonce.empty() ? 0 : 2 + extra_nonce.size());
+    weight = varint_size(hard_fork_version >= 4 ? 2 : 1);
+    weight += varint_size(height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW);
+    weight += varint_size(1) + 1 + varint_size(height);
+    weight += varint_size(out_amounts.size());
+    for (uint64_t amount: out_amounts)
+      weight += varint_size(amount) + 1 + sizeof(crypto::public_key);
+    weight += varint_size(extra_size) + extra_size;
+    if (hard_fork_version >= 4)
+      weight += 1;
+    return true;
+  }
+  //---------------------------------------------------------------
+  bool pad_miner_tx_to_weight(transaction& tx, size_t weight)
+  {
+    const size_t current_weight = get_transaction_weight(tx);
+    if (current_weight > weight)
+      return false;
+    const size_t delta = weight - current_weight;
+    const size_t extra_size = tx.extra.size();
+    const size_t extra_size_bytes = varint_size(extra_size);
+
+    // the extra length is a varint, so padding may also lengthen its prefix.
+    // Growing the prefix by one byte skips exactly one weight, which no
+    // padding can then reach
+    for (size_t prefix_growth = 0; prefix_growth <= delta && prefix_growth < 10; ++prefix_growth)
+    {
+      const size_t padding = delta - prefix_growth;
+      if (varint_size(extra_size + padding) - extra_size_bytes != prefix_growth)
+        continue;
+      if (padding > 0)
+      {
+        tx.extra.insert(tx.extra.end(), padding, 0);
+        tx.invalidate_hashes();
+      }
+      return true;
+    }
+    return false;
+  }
+  //---------------------------------------------------------------
+  bool replace_miner_tx_extra_nonce(transaction& tx, const blobdata& extra_nonce)
+  {
+    const crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
+    if (tx_pub_key == null_pkey)
+      return false;
+
+    std::vector<uint8_t> extra;
+    if (!add_tx_pub_key_to_extra(extra, tx_pub_key))
+      return false;
+    if (!extra_nonce.empty() && !add_extra_nonce_to_tx_extra(extra, extra_nonce))
+      return false;
+    // keeping the extra length keeps the weight, and so the reward, unchanged
+    if (extra.size() > tx.extra.size())
+      return false;
+    extra.resize(tx.extra.size(), 0);
+    tx.extra = std::move(extra);
+    tx.invalidate_hashes();
+    return true;
+  }
+  //---------------------------------------------------------------
   crypto::public_key get_destination_view_key_pub(const std::vector<tx_destination_entry> &destinations, const boost::optional<cryptonote::account_public_address>& change_addr)
   {
     account_public_address addr = {null_pkey, null_pkey};
@@ -39,6 +39,12 @@ namespace cryptonote
 {
   //---------------------------------------------------------------
   bool construct_miner_tx(size_t height, size_t median_weight, uint64_t already_generated_coins, size_t current_block_weight, uint64_t fee, const account_public_address &miner_address, transaction& tx, const blobdata& extra_nonce = blobdata(), size_t max_outs = 999, uint8_t hard_fork_version = 1);
+  // weight of the miner tx construct_miner_tx would build paying reward (fees included)
+  bool get_miner_tx_weight(size_t height, uint64_t reward, const blobdata& extra_nonce, size_t max_outs, uint8_t hard_fork_version, size_t &weight);
+  // zero pads the extra of a miner tx so its weight becomes exactly weight, fails if that weight can't be reached
+  bool pad_miner_tx_to_weight(transaction& tx, size_t weight);
+  // swaps the extra nonce of a miner tx without changing its weight, fails if the new nonce does not fit
+  bool replace_miner_tx_extra_nonce(transaction& tx, const blobdata& extra_nonce);
 
   struct tx_source_entry
   {
@@ -0,0 +1,137 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+
+#include "db_sync_tuner.h"
+
+namespace
+{
+  // weight of a new measurement in the moving averages
+  constexpr double EWMA_ALPHA = 0.25;
+
+  double ewma(double avg, double value)
+  {
+    return avg == 0.0 ? value : avg + EWMA_ALPHA * (value - avg);
+  }
+
+  // move towards target, by at most a factor of two, within bounds
+  uint64_t step_towards(uint64_t current, uint64_t target, uint64_t min, uint64_t max)
+  {
+    target = std::min(target, current * 2);
+    target = std::max(target, current / 2);
+    return std::max(min, std::min(max, target));
+  }
+}
+
+namespace cryptonote
+{
+
+db_sync_tuner::db_sync_tuner():
+  m_min_batch_blocks(0), m_max_batch_blocks(0), m_batch_blocks(0),
+  m_min_sync_blocks(0), m_max_sync_blocks(0), m_sync_blocks(0),
+  m_rotating_drive(false), m_us_per_byte(0.0), m_bytes_per_block(0.0), m_commit_us(0.0), m_sync_us(0.0), m_last_sync_us(0)
+{
+}
+
+void db_sync_tuner::set_batch_bounds(uint64_t min_blocks, uint64_t max_blocks)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_min_batch_blocks = std::max<uint64_t>(1, std::min(min_blocks, max_blocks));
+  m_max_batch_blocks = max_blocks;
+  m_batch_blocks = max_blocks ? m_min_batch_blocks : 0;
+}
+
+void db_sync_tuner::set_sync_bounds(uint64_t min_blocks, uint64_t max_blocks)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_min_sync_blocks = std::max<uint64_t>(1, std::min(min_blocks, max_blocks));
+  m_max_sync_blocks = max_blocks;
+  m_sync_blocks = max_blocks ? m_min_sync_blocks : 0;
+  if (m_sync_blocks && m_rotating_drive)
+    m_sync_blocks = std::min(m_max_sync_blocks, m_min_sync_blocks * 8);
+}
+
+void db_sync_tuner::set_rotating_drive(bool hdd)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_rotating_drive = hdd;
+  // syncs are seeks, start with them spaced out
+  if (m_sync_blocks && hdd)
+    m_sync_blocks = std::min(m_max_sync_blocks, m_min_sync_blocks * 8);
+}
+
+void db_sync_tuner::on_commit(uint64_t blocks, uint64_t bytes, uint64_t us)
+{
+  if (blocks == 0 || bytes == 0)
+    return;
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_us_per_byte = ewma(m_us_per_byte, us / (double)bytes);
+  m_bytes_per_block = ewma(m_bytes_per_block, bytes / (double)blocks);
+  m_commit_us = ewma(m_commit_us, us);
+  if (!m_max_batch_blocks)
+    return;
+  const double us_per_block = m_us_per_byte * m_bytes_per_block;
+  const uint64_t target = us_per_block > 0.0 ? (uint64_t)std::min<double>(target_commit_us() / us_per_block, m_max_batch_blocks) : m_max_batch_blocks;
+  m_batch_blocks = step_towards(m_batch_blocks, target, m_min_batch_blocks, m_max_batch_blocks);
+}
+
+void db_sync_tuner::on_sync(uint64_t us, uint64_t now_us)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_sync_us = ewma(m_sync_us, us);
+  const uint64_t since_last = m_last_sync_us && now_us > m_last_sync_us ? now_us - m_last_sync_us : 0;
+  m_last_sync_us = now_us;
+  if (!m_max_sync_blocks || since_last == 0)
+    return;
+  const double share = us / (double)since_last;
+  if (share > MAX_SYNC_SHARE)
+    m_sync_blocks = step_towards(m_sync_blocks, m_sync_blocks * 2, m_min_sync_blocks, m_max_sync_blocks);
+  else if (share < MIN_SYNC_SHARE)
+    m_sync_blocks = step_towards(m_sync_blocks, m_sync_blocks / 2, m_min_sync_blocks, m_max_sync_blocks);
+}
+
+uint64_t db_sync_tuner::get_batch_blocks() const
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  return m_batch_blocks;
+}
+
+uint64_t db_sync_tuner::get_sync_blocks() const
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  return m_sync_blocks;
+}
+
+db_sync_tuner::state db_sync_tuner::get_state() const
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  return {m_batch_blocks, m_sync_blocks, (uint64_t)m_commit_us, (uint64_t)m_sync_us, m_rotating_drive};
+}
+
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+
+namespace cryptonote
+{
+
+/**
+ * Picks how many blocks go in a db batch during sync, and how many blocks
+ * may be added between two syncs of the db to disk, from how long commits
+ * and syncs are measured to take.
+ *
+ * Batches are sized so that a commit takes about a target time, from the
+ * commit time per byte and the bytes per block seen so far: bigger batches
+ * amortize the commit, but hold the locks and the dirty pages for longer.
+ *
+ * Syncs are spaced so that they take a bounded share of the time: more
+ * blocks between syncs when syncing takes a large share, as on rotating
+ * drives, and fewer when syncing is cheap, to keep the window of blocks
+ * lost on a crash small.
+ *
+ * Both values stay within the bounds they are given, and each adjustment
+ * at most doubles or halves them. A max of 0 leaves a value unadapted.
+ */
+class db_sync_tuner
+{
+  public:
+
+    static constexpr uint64_t TARGET_COMMIT_US = 1000000;
+    static constexpr uint64_t TARGET_COMMIT_US_HDD = 3000000;
+    static constexpr double MAX_SYNC_SHARE = 0.10;
+    static constexpr double MIN_SYNC_SHARE = 0.02;
+
+    struct state
+    {
+      uint64_t batch_blocks;    //!< blocks per batch, 0 if not adapted
+      uint64_t sync_blocks;     //!< blocks between syncs, 0 if not adapted
+      uint64_t avg_commit_us;   //!< recent commit time
+      uint64_t avg_sync_us;     //!< recent sync time
+      bool rotating_drive;
+    };
+
+    db_sync_tuner();
+
+    void set_batch_bounds(uint64_t min_blocks, uint64_t max_blocks);
+    void set_sync_bounds(uint64_t min_blocks, uint64_t max_blocks);
+    void set_rotating_drive(bool hdd);
+
+    /**
+     * @brief records a batch commit
+     *
+     * @param blocks the number of blocks in the batch
+     * @param bytes the size of these blocks and their txes
+     * @param us how long the commit took
+     */
+    void on_commit(uint64_t blocks, uint64_t bytes, uint64_t us);
+
+    /**
+     * @brief records a sync of the db to disk
+     *
+     * @param us how long the sync took
+     * @param now_us a monotonic time after the sync, to measure the time since the last one
+     */
+    void on_sync(uint64_t us, uint64_t now_us);
+
+    uint64_t get_batch_blocks() const;
+    uint64_t get_sync_blocks() const;
+    state get_state() const;
+
+  private:
+    uint64_t target_commit_us() const { return m_rotating_drive ? TARGET_COMMIT_US_HDD : TARGET_COMMIT_US; }
+
+    mutable boost::mutex m_lock;
+    uint64_t m_min_batch_blocks;
+    uint64_t m_max_batch_blocks;
+    uint64_t m_batch_blocks;
+    uint64_t m_min_sync_blocks;
+    uint64_t m_max_sync_blocks;
+    uint64_t m_sync_blocks;
+    bool m_rotating_drive;
+    double m_us_per_byte;       // moving averages, 0 until measured
+    double m_bytes_per_block;
+    double m_commit_us;
+    double m_sync_us;
+    uint64_t m_last_sync_us;
+};
+
+}
@@ -0,0 +1,498 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <boost/serialization/vector.hpp>
+#include <limits>
+
+#include "light_wallet_scanner.h"
+#include "blockchain_db/blockchain_db.h"
+#include "common/boost_serialization_helper.h"
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_boost_serialization.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "device/device.hpp"
+#include "ringct/rctSigs.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "light_wallet"
+
+namespace
+{
+  // the registrations, saved on exit; what was found is rebuilt from the
+  // chain by catch_up
+  struct account_record
+  {
+    crypto::public_key spend_public_key;
+    crypto::public_key view_public_key;
+    crypto::secret_key view_secret_key;
+    uint64_t start_height;
+
+    template<class Archive>
+    void serialize(Archive &a, const unsigned int ver)
+    {
+      a & spend_public_key;
+      a & view_public_key;
+      a & view_secret_key;
+      a & start_height;
+    }
+  };
+
+  struct accounts_file
+  {
+    std::vector<account_record> accounts;
+
+    template<class Archive>
+    void serialize(Archive &a, const unsigned int ver)
+    {
+      a & accounts;
+    }
+  };
+
+  uint64_t decode_amount(const cryptonote::transaction &tx, const crypto::key_derivation &derivation, size_t i)
+  {
+    crypto::secret_key scalar;
+    crypto::derivation_to_scalar(derivation, i, scalar);
+    rct::key mask;
+    hw::device &hwdev = hw::get_device("default");
+    switch (tx.rct_signatures.type)
+    {
+    case rct::RCTTypeSimple:
+    case rct::RCTTypeBulletproof:
+      return rct::decodeRctSimple(tx.rct_signatures, rct::sk2rct(scalar), i, mask, hwdev);
+    case rct::RCTTypeFull:
+      return rct::decodeRct(tx.rct_signatures, rct::sk2rct(scalar), i, mask, hwdev);
+    default:
+      throw std::runtime_error("Unsupported rct type");
+    }
+  }
+
+  crypto::hash get_payment_id(const cryptonote::transaction &tx, const crypto::public_key &tx_pub_key, const crypto::secret_key &view_secret_key)
+  {
+    crypto::hash payment_id = crypto::null_hash;
+    std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+    cryptonote::parse_tx_extra(tx.extra, tx_extra_fields);
+    cryptonote::tx_extra_nonce extra_nonce;
+    if (!cryptonote::find_tx_extra_field_by_type(tx_extra_fields, extra_nonce))
+      return payment_id;
+    crypto::hash8 payment_id8;
+    if (cryptonote::get_encrypted_payment_id_from_tx_extra_nonce(extra_nonce.nonce, payment_id8))
+    {
+      // short ids are reported in the first 8 bytes, as the wallet does
+      if (hw::get_device("default").decrypt_payment_id(payment_id8, tx_pub_key, view_secret_key))
+        memcpy(payment_id.data, payment_id8.data, sizeof(payment_id8));
+    }
+    else
+    {
+      cryptonote::get_payment_id_from_tx_extra_nonce(extra_nonce.nonce, payment_id);
+    }
+    return payment_id;
+  }
+}
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------------------------
+  light_wallet_scanner::light_wallet_scanner(BlockchainDB &db, size_t max_accounts):
+    m_db(db),
+    m_max_accounts(max_accounts),
+    m_generation(0)
+  {
+  }
+  //---------------------------------------------------------------------------------
+  light_wallet_scanner::account *light_wallet_scanner::find_account(const account_public_address &address, const crypto::secret_key &view_secret_key) const
+  {
+    crypto::public_key view_public_key;
+    if (!crypto::secret_key_to_public_key(view_secret_key, view_public_key) || view_public_key != address.m_view_public_key)
+      return NULL;
+    const auto i = m_accounts_by_view_key.find(view_public_key);
+    if (i == m_accounts_by_view_key.end())
+      return NULL;
+    account *acc = m_accounts[i->second].get();
+    return acc->address.m_spend_public_key == address.m_spend_public_key ? acc : NULL;
+  }
+  //---------------------------------------------------------------------------------
+  light_wallet_scanner::login_result light_wallet_scanner::login(const account_public_address &address, const crypto::secret_key &view_secret_key, bool create)
+  {
+    crypto::public_key view_public_key;
+    if (!crypto::secret_key_to_public_key(view_secret_key, view_public_key) || view_public_key != address.m_view_public_key)
+      return login_wrong_key;
+
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+    const auto i = m_accounts_by_view_key.find(view_public_key);
+    if (i != m_accounts_by_view_key.end())
+      return m_accounts[i->second]->address.m_spend_public_key == address.m_spend_public_key ? login_existing : login_wrong_key;
+    if (!create)
+      return login_not_found;
+    if (m_accounts.size() >= m_max_accounts)
+      return login_too_many_accounts;
+
+    std::unique_ptr<account> acc(new account());
+    acc->address = address;
+    acc->view_secret_key = view_secret_key;
+    acc->state.start_height = acc->state.scanned_height = m_db.height();
+    m_accounts_by_view_key.emplace(view_public_key, m_accounts.size());
+    m_accounts.push_back(std::move(acc));
+    MDEBUG("Registered light wallet account, " << m_accounts.size() << " accounts");
+    return login_created;
+  }
+  //---------------------------------------------------------------------------------
+  bool light_wallet_scanner::import_from_genesis(const account_public_address &address, const crypto::secret_key &view_secret_key)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+    account *acc = find_account(address, view_secret_key);
+    if (!acc)
+      return false;
+    if (acc->state.start_height == 0)
+      return true;
+    forget_from(*acc, m_accounts_by_view_key[address.m_view_public_key], 0);
+    acc->state.start_height = acc->state.scanned_height = 0;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool light_wallet_scanner::get_account(const account_public_address &address, const crypto::secret_key &view_secret_key, account_state &state) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_lock);
+    const account *acc = find_account(address, view_secret_key);
+    if (!acc)
+      return false;
+    state = acc->state;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void light_wallet_scanner::scan_account_outputs(const account &acc, size_t account_index, const std::vector<const transaction*> &txs, const std::vector<crypto::public_key> &tx_pub_keys, std::vector<found_output> &found)
+  {
+    for (size_t t = 0; t < txs.size(); ++t)
+    {
+      if (tx_pub_keys[t] == crypto::null_pkey)
+        continue;
+      crypto::key_derivation derivation;
+      if (!crypto::generate_key_derivation(tx_pub_keys[t], acc.view_secret_key, derivation))
+        continue;
+      const transaction &tx = *txs[t];
+      for (size_t i = 0; i < tx.vout.size(); ++i)
+      {
+        if (tx.vout[i].target.type() != typeid(txout_to_key))
+          continue;
+        crypto::public_key key;
+        if (!crypto::derive_public_key(derivation, i, acc.address.m_spend_public_key, key) || key != boost::get<txout_to_key>(tx.vout[i].target).key)
+          continue;
+        uint64_t amount = tx.vout[i].amount;
+        if (tx.version >= 2 && tx.rct_signatures.type != rct::RCTTypeNull)
+        {
+          try { amount = decode_amount(tx, derivation, i); }
+          catch (const std::exception &e) { MWARNING("Failed to decode the amount of output " << i << " of a tx for a light wallet: " << e.what()); continue; }
+        }
+        found.push_back({account_index, t, i, amount});
+      }
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void light_wallet_scanner::scan_block(uint64_t height, const block &b, const std::vector<transaction> &txs, const std::vector<size_t> &accounts)
+  {
+    // per tx data is gathered once for all accounts
+    std::vector<const transaction*> all_txs;
+    std::vector<crypto::hash> tx_hashes;
+    std::vector<crypto::public_key> tx_pub_keys;
+    all_txs.reserve(txs.size() + 1);
+    tx_hashes.reserve(txs.size() + 1);
+    all_txs.push_back(&b.miner_tx);
+    tx_hashes.push_back(get_transaction_hash(b.miner_tx));
+    for (size_t t = 0; t < txs.size(); ++t)
+    {
+      all_txs.push_back(&txs[t]);
+      tx_hashes.push_back(b.tx_hashes[t]);
+    }
+    tx_pub_keys.reserve(all_txs.size());
+    for (const transaction *tx: all_txs)
+      tx_pub_keys.push_back(get_tx_pub_key_from_extra(*tx));
+
+    // the derivations are the bulk of the work, and are spread over the
+    // background threadpool in runs of accounts
+    tools::threadpool &tpool = tools::threadpool::getInstance(tools::threadpool::background);
+    const size_t per_task = std::max<size_t>(LIGHT_WALLET_MIN_ACCOUNTS_PER_TASK, (accounts.size() + tpool.get_max_concurrency() - 1) / std::max(1u, tpool.get_max_concurrency()));
+    const size_t tasks = (accounts.size() + per_task - 1) / per_task;
+    std::vector<std::vector<found_output>> found(tasks);
+    if (tasks == 1)
+    {
+      for (size_t a: accounts)
+        scan_account_outputs(*m_accounts[a], a, all_txs, tx_pub_keys, found[0]);
+    }
+    else
+    {
+      tools::threadpool::waiter waiter;
+      for (size_t task = 0; task < tasks; ++task)
+      {
+        const size_t begin = task * per_task, end = std::min(accounts.size(), begin + per_task);
+        tpool.submit(&waiter, [this, &accounts, &all_txs, &tx_pub_keys, &found, task, begin, end]() {
+          for (size_t a = begin; a < end; ++a)
+            scan_account_outputs(*m_accounts[accounts[a]], accounts[a], all_txs, tx_pub_keys, found[task]);
+        }, true);
+      }
+      waiter.wait(&tpool);
+    }
+
+    // global indices are only looked up for the txs which pay an account
+    std::vector<std::vector<uint64_t>> global_indices(all_txs.size());
+    for (const std::vector<found_output> &task_found: found)
+    {
+      for (const found_output &f: task_found)
+      {
+        const transaction &tx = *all_txs[f.tx];
+        if (global_indices[f.tx].empty())
+        {
+          uint64_t tx_id;
+          if (!m_db.tx_exists(tx_hashes[f.tx], tx_id))
+          {
+            MERROR("Tx " << tx_hashes[f.tx] << " paying a light wallet not found in the db");
+            continue;
+          }
+          global_indices[f.tx] = m_db.get_tx_amount_output_indices(tx_id);
+        }
+        if (f.out_index >= global_indices[f.tx].size())
+          continue;
+
+        account &acc = *m_accounts[f.account];
+        received_output out;
+        out.tx_hash = tx_hashes[f.tx];
+        out.tx_prefix_hash = get_transaction_prefix_hash(tx);
+        out.tx_pub_key = tx_pub_keys[f.tx];
+        out.key = boost::get<txout_to_key>(tx.vout[f.out_index].target).key;
+        out.amount = f.amount;
+        out.out_index = f.out_index;
+        out.global_index = global_indices[f.tx][f.out_index];
+        out.height = height;
+        out.timestamp = b.timestamp;
+        out.unlock_time = tx.unlock_time;
+        out.payment_id = get_payment_id(tx, out.tx_pub_key, acc.view_secret_key);
+        out.coinbase = f.tx == 0;
+        out.rct = tx.version >= 2 && tx.rct_signatures.type != rct::RCTTypeNull;
+        if (out.rct)
+        {
+          out.commitment = tx.rct_signatures.outPk[f.out_index].mask;
+          out.encrypted_mask = tx.rct_signatures.ecdhInfo[f.out_index].mask;
+          out.encrypted_amount = tx.rct_signatures.ecdhInfo[f.out_index].amount;
+        }
+        acc.state.outputs.push_back(out);
+        m_owned_outputs.emplace(output_id{tx.vout[f.out_index].amount, out.global_index}, std::make_pair(f.account, acc.state.outputs.size() - 1));
+      }
+    }
+
+    // rings are matched against the outputs of all accounts at once
+    if (!m_owned_outputs.empty())
+    {
+      std::vector<bool> scanning(m_accounts.size(), false);
+      for (size_t a: accounts)
+        scanning[a] = true;
+      for (size_t t = 1; t < all_txs.size(); ++t)
+      {
+        const transaction &tx = *all_txs[t];
+        for (const txin_v &in: tx.vin)
+        {
+          if (in.type() != typeid(txin_to_key))
+            continue;
+          const txin_to_key &in_to_key = boost::get<txin_to_key>(in);
+          const std::vector<uint64_t> offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
+          for (uint64_t offset: offsets)
+          {
+            const auto range = m_owned_outputs.equal_range(output_id{in_to_key.amount, offset});
+            for (auto i = range.first; i != range.second; ++i)
+            {
+              if (!scanning[i->second.first])
+                continue;
+              const uint32_t mixin = offsets.empty() ? 0 : offsets.size() - 1;
+              m_accounts[i->second.first]->state.spends.push_back({tx_hashes[t], in_to_key.k_image, i->second.second, mixin, height, b.timestamp, tx.unlock_time});
+            }
+          }
+        }
+      }
+    }
+
+    for (size_t a: accounts)
+      m_accounts[a]->state.scanned_height = height + 1;
+  }
+  //---------------------------------------------------------------------------------
+  void light_wallet_scanner::on_block_added(uint64_t height, const block &b, const std::vector<transaction> &txs)
+  {
+    try
+    {
+      boost::unique_lock<boost::shared_mutex> lock(m_lock);
+      std::vector<size_t> accounts;
+      for (size_t a = 0; a < m_accounts.size(); ++a)
+        if (m_accounts[a]->state.scanned_height == height)
+          accounts.push_back(a);
+      if (!accounts.empty())
+        scan_block(height, b, txs, accounts);
+    }
+    catch (const std::exception &e)
+    {
+      // the accounts stay at this height, and catch_up retries it
+      MERROR("Failed to scan block " << height << " for light wallets: " << e.what());
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void light_wallet_scanner::forget_from(account &acc, size_t account_index, uint64_t height)
+  {
+    // both are in height order, and spends only point to older outputs
+    while (!acc.state.spends.empty() && acc.state.spends.back().height >= height)
+      acc.state.spends.pop_back();
+    while (!acc.state.outputs.empty() && acc.state.outputs.back().height >= height)
+    {
+      const received_output &out = acc.state.outputs.back();
+      const auto range = m_owned_outputs.equal_range(output_id{out.rct ? 0 : out.amount, out.global_index});
+      for (auto i = range.first; i != range.second; ++i)
+      {
+        if (i->second.first == account_index && i->second.second == acc.state.outputs.size() - 1)
+        {
+          m_owned_outputs.erase(i);
+          break;
+        }
+      }
+      acc.state.outputs.pop_back();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void light_wallet_scanner::on_blocks_popped(uint64_t height)
+  {
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+    ++m_generation;
+    for (size_t a = 0; a < m_accounts.size(); ++a)
+    {
+      account_state &state = m_accounts[a]->state;
+      if (state.scanned_height <= height)
+        continue;
+      forget_from(*m_accounts[a], a, height);
+      state.scanned_height = height;
+      state.start_height = std::min(state.start_height, height);
+    }
+  }
+  //---------------------------------------------------------------------------------
+  size_t light_wallet_scanner::catch_up(size_t max_blocks)
+  {
+    size_t scanned = 0;
+    try
+    {
+      while (scanned < max_blocks)
+      {
+        uint64_t height = std::numeric_limits<uint64_t>::max(), generation;
+        {
+          boost::shared_lock<boost::shared_mutex> lock(m_lock);
+          for (const auto &acc: m_accounts)
+            height = std::min(height, acc->state.scanned_height);
+          generation = m_generation;
+        }
+        if (height >= m_db.height())
+          break;
+
+        // read outside the lock, which the Blockchain takes for each new block
+        const block b = m_db.get_block_from_height(height);
+        std::vector<transaction> txs;
+        txs.reserve(b.tx_hashes.size());
+        for (const crypto::hash &tx_hash: b.tx_hashes)
+          txs.push_back(m_db.get_tx(tx_hash));
+
+        boost::unique_lock<boost::shared_mutex> lock(m_lock);
+        if (generation != m_generation)
+          break;
+        std::vector<size_t> accounts;
+        for (size_t a = 0; a < m_accounts.size(); ++a)
+          if (m_accounts[a]->state.scanned_height == height)
+            accounts.push_back(a);
+        if (!accounts.empty())
+          scan_block(height, b, txs, accounts);
+        ++scanned;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to catch up light wallets: " << e.what());
+    }
+    return scanned;
+  }
+  //---------------------------------------------------------------------------------
+  bool light_wallet_scanner::load(const std::string &filename)
+  {
+    accounts_file file;
+    if (!tools::unserialize_obj_from_file(file, filename))
+      return false;
+
+    boost::unique_lock<boost::shared_mutex> lock(m_lock);
+    const uint64_t height = m_db.height();
+    for (const account_record &record: file.accounts)
+    {
+      if (m_accounts.size() >= m_max_accounts)
+        break;
+      if (m_accounts_by_view_key.find(record.view_public_key) != m_accounts_by_view_key.end())
+        continue;
+      std::unique_ptr<account> acc(new account());
+      acc->address.m_spend_public_key = record.spend_public_key;
+      acc->address.m_view_public_key = record.view_public_key;
+      acc->view_secret_key = record.view_secret_key;
+      acc->state.start_height = acc->state.scanned_height = std::min(record.start_height, height);
+      m_accounts_by_view_key.emplace(record.view_public_key, m_accounts.size());
+      m_accounts.push_back(std::move(acc));
+    }
+    MINFO("Loaded " << m_accounts.size() << " light wallet accounts, rescanning them from the chain");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool light_wallet_scanner::store(const std::string &filename) const
+  {
+    accounts_file file;
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_lock);
+      file.accounts.reserve(m_accounts.size());
+      for (const auto &acc: m_accounts)
+        file.accounts.push_back({acc->address.m_spend_public_key, acc->address.m_view_public_key, acc->view_secret_key, acc->state.start_height});
+    }
+    return tools::serialize_obj_to_file(file, filename);
+  }
+  //---------------------------------------------------------------------------------
+  size_t light_wallet_scanner::get_num_accounts() const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_lock);
+    return m_accounts.size();
+  }
+  //---------------------------------------------------------------------------------
+  void light_wallet_scanner::get_memory_usage(std::vector<tools::memory_usage> &usage) const
+  {
+    boost::shared_lock<boost::shared_mutex> lock(m_lock);
+    uint64_t outputs = 0, spends = 0, bytes = 0;
+    for (const auto &acc: m_accounts)
+    {
+      outputs += acc->state.outputs.size();
+      spends += acc->state.spends.size();
+      bytes += sizeof(account) + acc->state.outputs.capacity() * sizeof(received_output) + acc->state.spends.capacity() * sizeof(possible_spend);
+    }
+    bytes += tools::node_container_bytes<decltype(m_accounts_by_view_key)::value_type>(m_accounts_by_view_key.size());
+    bytes += tools::node_container_bytes<decltype(m_owned_outputs)::value_type>(m_owned_outputs.size());
+    usage.push_back({"light_wallet.accounts", m_accounts.size(), bytes, m_max_accounts, 0});
+    usage.push_back({"light_wallet.outputs", outputs, 0, 0, 0});
+    usage.push_back({"light_wallet.spends", spends, 0, 0, 0});
+  }
+}
@@ -0,0 +1,220 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/shared_mutex.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "common/memory_usage.h"
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+#include "ringct/rctTypes.h"
+
+namespace cryptonote
+{
+
+class BlockchainDB;
+
+/**
+ * Scans the chain on behalf of light wallets, which hand their view key to
+ * the daemon instead of fetching and scanning every block themselves.
+ *
+ * Each new block is scanned once for all registered accounts: the block's
+ * tx public keys and output keys are gathered once, and the accounts are
+ * split across the threadpool, each deriving its keys for every tx of the
+ * block in one go. Inputs are matched against the outputs of all accounts
+ * through a single index of owned global output indices, so a ring is
+ * looked up once however many accounts there are.
+ *
+ * Accounts which start below the top of the chain (new registrations and
+ * import requests) are caught up from the db by catch_up, in bounded
+ * batches, and join the per-block scan once they reach the top.
+ *
+ * Without the spend key, spends can't be told from decoys: every ring
+ * referencing one of an account's outputs is reported as a possible spend,
+ * and the wallet checks the key images against its own.
+ */
+class light_wallet_scanner
+{
+  public:
+
+    static constexpr size_t LIGHT_WALLET_CATCH_UP_BLOCKS = 100;
+    static constexpr size_t LIGHT_WALLET_MIN_ACCOUNTS_PER_TASK = 8;
+
+    struct received_output
+    {
+      crypto::hash tx_hash;
+      crypto::hash tx_prefix_hash;
+      crypto::public_key tx_pub_key;
+      crypto::public_key key;
+      uint64_t amount;
+      uint64_t out_index;     //!< index in the tx's outputs
+      uint64_t global_index;  //!< amount specific index
+      uint64_t height;
+      uint64_t timestamp;
+      uint64_t unlock_time;
+      crypto::hash payment_id;
+      bool coinbase;
+      bool rct;
+      rct::key commitment;
+      rct::key encrypted_mask;
+      rct::key encrypted_amount;
+    };
+
+    struct possible_spend
+    {
+      crypto::hash tx_hash;
+      crypto::key_image key_image;
+      size_t output;          //!< index of the referenced output in the account's outputs
+      uint32_t mixin;
+      uint64_t height;
+      uint64_t timestamp;
+      uint64_t unlock_time;
+    };
+
+    struct account_state
+    {
+      uint64_t start_height;
+      uint64_t scanned_height;  //!< blocks below this height have been scanned
+      std::vector<received_output> outputs;
+      std::vector<possible_spend> spends;
+    };
+
+    enum login_result
+    {
+      login_existing,
+      login_created,
+      login_not_found,
+      login_wrong_key,
+      login_too_many_accounts,
+    };
+
+    light_wallet_scanner(BlockchainDB &db, size_t max_accounts);
+
+    /**
+     * @brief checks the view key of an account, registering it if needed
+     *
+     * A new account starts scanning at the current top of the chain, an
+     * import request moves its start back to the genesis block.
+     */
+    login_result login(const account_public_address &address, const crypto::secret_key &view_secret_key, bool create);
+
+    /**
+     * @brief rescans an account from the genesis block
+     *
+     * @return false if the account is not registered with that view key
+     */
+    bool import_from_genesis(const account_public_address &address, const crypto::secret_key &view_secret_key);
+
+    /**
+     * @brief gets a copy of what was found for an account so far
+     *
+     * @return false if the account is not registered with that view key
+     */
+    bool get_account(const account_public_address &address, const crypto::secret_key &view_secret_key, account_state &state) const;
+
+    /**
+     * @brief scans a block just added to the main chain
+     *
+     * Called by the Blockchain with its lock taken, for the accounts which
+     * are caught up to that block.
+     */
+    void on_block_added(uint64_t height, const block &b, const std::vector<transaction> &txs);
+
+    /**
+     * @brief forgets what was found in blocks popped from the main chain
+     *
+     * @param height the new height of the chain
+     */
+    void on_blocks_popped(uint64_t height);
+
+    /**
+     * @brief scans up to max_blocks blocks from the db for accounts behind the chain
+     *
+     * @return the number of blocks scanned
+     */
+    size_t catch_up(size_t max_blocks = LIGHT_WALLET_CATCH_UP_BLOCKS);
+
+    bool load(const std::string &filename);
+    bool store(const std::string &filename) const;
+
+    size_t get_num_accounts() const;
+    void get_memory_usage(std::vector<tools::memory_usage> &usage) const;
+
+  private:
+    struct account
+    {
+      account_public_address address;
+      crypto::secret_key view_secret_key;
+      account_state state;
+    };
+
+    struct output_id
+    {
+      uint64_t amount;
+      uint64_t index;
+      bool operator==(const output_id &other) const { return amount == other.amount && index == other.index; }
+    };
+
+    struct output_id_hash
+    {
+      size_t operator()(const output_id &id) const { return std::hash<uint64_t>()(id.amount * 0x9e3779b97f4a7c15ull ^ id.index); }
+    };
+
+    // an output found for an account while scanning a block, before its
+    // global index is looked up
+    struct found_output
+    {
+      size_t account;
+      size_t tx;
+      size_t out_index;
+      uint64_t amount;
+      crypto::key_derivation derivation;
+    };
+
+    account *find_account(const account_public_address &address, const crypto::secret_key &view_secret_key) const;
+    void scan_block(uint64_t height, const block &b, const std::vector<transaction> &txs, const std::vector<size_t> &accounts);
+    static void scan_account_outputs(const account &acc, size_t account_index, const std::vector<const transaction*> &txs, const std::vector<crypto::public_key> &tx_pub_keys, std::vector<found_output> &found);
+    void forget_from(account &acc, size_t account_index, uint64_t height);
+
+    BlockchainDB &m_db;
+    const size_t m_max_accounts;
+
+    mutable boost::shared_mutex m_lock;
+    std::vector<std::unique_ptr<account>> m_accounts;
+    std::unordered_map<crypto::public_key, size_t> m_accounts_by_view_key;  //!< by view public key
+    std::unordered_multimap<output_id, std::pair<size_t, size_t>, output_id_hash> m_owned_outputs;  //!< account and output index, for matching rings
+    uint64_t m_generation;  //!< bumped when blocks are popped, so catch_up drops blocks it read before that
+};
+
+}  // namespace cryptonote
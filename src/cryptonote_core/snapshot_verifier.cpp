@@ -0,0 +1,267 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+
+#include "snapshot_verifier.h"
+#include "blockchain_db/blockchain_db.h"
+#include "common/threadpool.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "ringct/rctOps.h"
+#include "string_tools.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "snapshot"
+
+namespace cryptonote
+{
+
+snapshot_verifier::snapshot_verifier(BlockchainDB &db, const std::vector<crypto::hash> &block_hashes, const std::map<uint64_t, crypto::hash> &checkpoints):
+  m_db(db),
+  m_block_hashes(block_hashes),
+  m_checkpoints(checkpoints),
+  m_anchored_height(0)
+{
+}
+
+void snapshot_verifier::fail(const std::string &error)
+{
+  boost::unique_lock<boost::mutex> lock(m_error_lock);
+  if (m_error.empty())
+    m_error = error;
+}
+
+bool snapshot_verifier::failed()
+{
+  boost::unique_lock<boost::mutex> lock(m_error_lock);
+  return !m_error.empty();
+}
+
+bool snapshot_verifier::verify()
+{
+  m_error.clear();
+  const uint64_t height = m_db.height();
+  if (height == 0)
+  {
+    m_error = "The db has no blocks";
+    return false;
+  }
+
+  // a run of compiled hashes anchors the blocks up to its end, and a
+  // checkpoint the blocks up to itself, as every block commits to the one
+  // before it
+  m_anchored_height = std::min<uint64_t>(m_block_hashes.size(), height / HASH_OF_HASHES_STEP) * HASH_OF_HASHES_STEP;
+  for (const auto &point: m_checkpoints)
+    if (point.first < height)
+      m_anchored_height = std::max(m_anchored_height, point.first + 1);
+  if (m_anchored_height == 0)
+  {
+    m_error = "No compiled block hashes or checkpoints cover the db";
+    return false;
+  }
+  MGINFO("Verifying " << height << " blocks, anchored up to " << m_anchored_height);
+
+  tools::threadpool &tpool = tools::threadpool::getInstance(tools::threadpool::block);
+  tools::threadpool::waiter waiter;
+  const uint64_t ntasks = (height + BLOCKS_PER_TASK - 1) / BLOCKS_PER_TASK;
+  std::vector<counts> task_counts(ntasks);
+  for (uint64_t n = 0; n < ntasks; ++n)
+  {
+    const uint64_t start = n * BLOCKS_PER_TASK;
+    const uint64_t end = std::min(height, start + BLOCKS_PER_TASK);
+    tpool.submit(&waiter, [this, &task_counts, n, start, end]() {
+      try
+      {
+        verify_blocks(start, end, task_counts[n]);
+      }
+      catch (const std::exception &e)
+      {
+        fail(std::string("Failed to verify blocks ") + std::to_string(start) + " to " + std::to_string(end - 1) + ": " + e.what());
+      }
+    });
+  }
+
+  // meanwhile, count what the tables hold
+  counts db_counts;
+  db_counts.key_images = 0;
+  try
+  {
+    m_db.for_all_key_images([&db_counts](const crypto::key_image&) {
+      ++db_counts.key_images;
+      return true;
+    });
+    m_db.for_all_outputs([&db_counts](uint64_t amount, const crypto::hash&, uint64_t, size_t) {
+      ++db_counts.outputs[amount];
+      return true;
+    });
+  }
+  catch (const std::exception &e)
+  {
+    fail(std::string("Failed to enumerate the db: ") + e.what());
+  }
+
+  waiter.wait(&tpool);
+  if (failed())
+    return false;
+
+  counts tx_counts;
+  tx_counts.key_images = 0;
+  for (const counts &c: task_counts)
+  {
+    tx_counts.key_images += c.key_images;
+    for (const auto &e: c.outputs)
+      tx_counts.outputs[e.first] += e.second;
+  }
+
+  if (tx_counts.key_images != db_counts.key_images)
+  {
+    m_error = "The db has " + std::to_string(db_counts.key_images) + " spent key images, but its txes spend " + std::to_string(tx_counts.key_images);
+    return false;
+  }
+  if (tx_counts.outputs != db_counts.outputs)
+  {
+    m_error = "The db has outputs its txes do not have";
+    return false;
+  }
+
+  MGINFO("Verified " << height << " blocks, " << tx_counts.key_images << " key images and the outputs of " << tx_counts.outputs.size() << " amounts");
+  return true;
+}
+
+void snapshot_verifier::verify_blocks(uint64_t start, uint64_t end, counts &c)
+{
+  c.key_images = 0;
+
+  std::vector<crypto::hash> block_hashes;
+  block_hashes.reserve(end - start);
+  crypto::hash prev_hash = start == 0 ? crypto::null_hash : m_db.get_block_hash_from_height(start - 1);
+  for (uint64_t h = start; h < end && !failed(); ++h)
+  {
+    const block b = m_db.get_block_from_height(h);
+    const crypto::hash block_hash = get_block_hash(b);
+    if (block_hash != m_db.get_block_hash_from_height(h))
+      throw std::runtime_error("block " + std::to_string(h) + " does not hash to its stored hash");
+    if (b.prev_id != prev_hash)
+      throw std::runtime_error("block " + std::to_string(h) + " does not link to the block before it");
+    const auto point = m_checkpoints.find(h);
+    if (point != m_checkpoints.end() && point->second != block_hash)
+      throw std::runtime_error("block " + std::to_string(h) + " does not match its checkpoint");
+    block_hashes.push_back(block_hash);
+    prev_hash = block_hash;
+
+    // the txes as they are stored must be those the block commits to
+    std::vector<transaction> txs;
+    std::vector<crypto::hash> tx_hashes;
+    txs.reserve(b.tx_hashes.size() + 1);
+    tx_hashes.reserve(b.tx_hashes.size() + 1);
+    txs.push_back(b.miner_tx);
+    tx_hashes.push_back(get_transaction_hash(b.miner_tx));
+    for (const crypto::hash &tx_hash: b.tx_hashes)
+    {
+      transaction tx;
+      if (!m_db.get_pruned_tx(tx_hash, tx))
+        throw std::runtime_error("tx " + epee::string_tools::pod_to_hex(tx_hash) + " is missing");
+      if (tx.version == 1)
+      {
+        // v1 txes hash their signatures whole, so they can't be pruned
+        if (!m_db.get_tx(tx_hash, tx) || get_transaction_hash(tx) != tx_hash)
+          throw std::runtime_error("tx " + epee::string_tools::pod_to_hex(tx_hash) + " does not match its hash");
+      }
+      else
+      {
+        crypto::hash prunable_hash;
+        if (!m_db.get_prunable_tx_hash(tx_hash, prunable_hash) || get_pruned_transaction_hash(tx, prunable_hash) != tx_hash)
+          throw std::runtime_error("tx " + epee::string_tools::pod_to_hex(tx_hash) + " does not match its hash");
+      }
+      txs.push_back(std::move(tx));
+      tx_hashes.push_back(tx_hash);
+    }
+
+    for (size_t t = 0; t < txs.size(); ++t)
+    {
+      const transaction &tx = txs[t];
+      const crypto::hash &tx_hash = tx_hashes[t];
+      const bool miner_tx = t == 0;
+
+      for (const txin_v &in: tx.vin)
+      {
+        if (in.type() != typeid(txin_to_key))
+          continue;
+        if (!m_db.has_key_image(boost::get<txin_to_key>(in).k_image))
+          throw std::runtime_error("a key image spent by tx " + epee::string_tools::pod_to_hex(tx_hash) + " is not marked spent");
+        ++c.key_images;
+      }
+
+      // outputs are stored as add_transaction stores them
+      uint64_t tx_id;
+      if (!m_db.tx_exists(tx_hash, tx_id))
+        throw std::runtime_error("tx " + epee::string_tools::pod_to_hex(tx_hash) + " is missing");
+      const std::vector<uint64_t> indices = m_db.get_tx_amount_output_indices(tx_id);
+      if (indices.size() != tx.vout.size())
+        throw std::runtime_error("tx " + epee::string_tools::pod_to_hex(tx_hash) + " has the wrong number of output indices");
+      for (size_t i = 0; i < tx.vout.size(); ++i)
+      {
+        const tx_out &out = tx.vout[i];
+        if (out.target.type() != typeid(txout_to_key))
+          throw std::runtime_error("tx " + epee::string_tools::pod_to_hex(tx_hash) + " has an unsupported output");
+        uint64_t amount = out.amount;
+        rct::key commitment;
+        if (miner_tx && tx.version == 2)
+        {
+          commitment = rct::zeroCommit(out.amount);
+          amount = 0;
+        }
+        else if (tx.version > 1)
+          commitment = tx.rct_signatures.outPk[i].mask;
+        else
+          commitment = rct::zeroCommit(out.amount);
+
+        const output_data_t data = m_db.get_output_key(amount, indices[i]);
+        if (data.pubkey != boost::get<txout_to_key>(out.target).key || data.unlock_time != tx.unlock_time
+            || data.height != h || !(data.commitment == commitment))
+          throw std::runtime_error("output " + std::to_string(i) + " of tx " + epee::string_tools::pod_to_hex(tx_hash) + " does not match the output table");
+        // each output table entry belongs to a single tx output
+        const tx_out_index toi = m_db.get_output_tx_and_index(amount, indices[i]);
+        if (toi.first != tx_hash || toi.second != i)
+          throw std::runtime_error("output " + std::to_string(i) + " of tx " + epee::string_tools::pod_to_hex(tx_hash) + " is not the owner of its index");
+        ++c.outputs[amount];
+      }
+    }
+  }
+
+  // runs start on a hash of hashes boundary
+  for (uint64_t n = start / HASH_OF_HASHES_STEP; n < m_block_hashes.size() && (n + 1) * HASH_OF_HASHES_STEP <= start + block_hashes.size(); ++n)
+  {
+    crypto::hash hash;
+    crypto::cn_fast_hash(block_hashes.data() + n * HASH_OF_HASHES_STEP - start, HASH_OF_HASHES_STEP * sizeof(crypto::hash), hash);
+    if (hash != m_block_hashes[n])
+      throw std::runtime_error("blocks " + std::to_string(n * HASH_OF_HASHES_STEP) + " to " + std::to_string((n + 1) * HASH_OF_HASHES_STEP - 1) + " do not match the compiled block hashes");
+  }
+}
+
+}
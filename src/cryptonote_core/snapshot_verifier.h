@@ -0,0 +1,111 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "cryptonote_config.h"
+
+namespace cryptonote
+{
+
+class BlockchainDB;
+
+/**
+ * Checks a blockchain db from an untrusted source, such as a snapshot
+ * copied from another node, before the daemon adopts it.
+ *
+ * Every block is read back and rehashed, and must link to the one before
+ * it, and every tx is rehashed and must match the hash its block commits
+ * to. The chain is then anchored: its block hashes are checked against
+ * the hashes compiled into the binary (src/blocks/checkpoints.dat) and
+ * against the hard-coded checkpoints. Blocks above the highest anchor are
+ * only checked to link, and are left to the caller to drop.
+ *
+ * The state the daemon relies on when verifying new txs is then checked
+ * against those txs. Each key image a tx spends must be in the spent key
+ * table, and each output must be at the global index its tx lists, with
+ * the key, commitment, unlock time and height of the tx output, and must
+ * point back to its tx. The tables are enumerated (for_all_key_images,
+ * for_all_outputs) and must hold exactly as many entries per amount as
+ * the txs have, so nothing can have been added to them either.
+ *
+ * The blocks are split in runs verified on the threadpool, while the
+ * tables are enumerated on the calling thread.
+ */
+class snapshot_verifier
+{
+  public:
+
+    static constexpr uint64_t BLOCKS_PER_TASK = 4 * HASH_OF_HASHES_STEP;
+
+    /**
+     * @param db the db to verify, opened read only
+     * @param block_hashes the hashes of HASH_OF_HASHES_STEP block hashes compiled into the binary
+     * @param checkpoints the hard-coded checkpoints
+     */
+    snapshot_verifier(BlockchainDB &db, const std::vector<crypto::hash> &block_hashes, const std::map<uint64_t, crypto::hash> &checkpoints);
+
+    /**
+     * @brief verifies the db
+     *
+     * @return true if the db is consistent and anchored, false otherwise, see get_error()
+     */
+    bool verify();
+
+    //! the number of blocks from the genesis block on which are anchored
+    uint64_t get_anchored_height() const { return m_anchored_height; }
+
+    const std::string &get_error() const { return m_error; }
+
+  private:
+    struct counts
+    {
+      uint64_t key_images;
+      std::map<uint64_t, uint64_t> outputs;   // per amount
+    };
+
+    void verify_blocks(uint64_t start, uint64_t end, counts &c);
+    void fail(const std::string &error);
+    bool failed();
+
+    BlockchainDB &m_db;
+    const std::vector<crypto::hash> &m_block_hashes;
+    const std::map<uint64_t, crypto::hash> &m_checkpoints;
+    uint64_t m_anchored_height;
+    boost::mutex m_error_lock;
+    std::string m_error;
+};
+
+}
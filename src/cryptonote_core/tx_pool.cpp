@@ -65,7 +65,9 @@ namespace cryptonote
     //      will work correctly.
     time_t const MIN_RELAY_TIME = (60 * 5); // only start re-relaying transactions after that many seconds
     time_t const MAX_RELAY_TIME = (60 * 60 * 4); // at most that many seconds between resends
+    time_t const RELAY_SCHEDULE_BUCKET = 60; // granularity of the relay schedule, in seconds
     float const ACCEPT_THRESHOLD = 1.0f;
+    size_t const MAX_POOL_CHANGES = 65536; // txes entering/leaving the pool remembered for get_transaction_changes
 
     // a kind of increasing backoff within min/max bounds
     uint64_t get_relay_delay(time_t now, time_t received)
@@ -90,6 +92,35 @@ namespace cryptonote
         return get_min_block_weight(version) - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
     }
 
+    uint64_t new_pool_instance()
+    {
+      uint64_t instance;
+      do instance = crypto::rand<uint64_t>(); while (instance == 0);
+      return instance;
+    }
+
+    // rough heap footprint of a parsed tx
+    uint64_t parsed_tx_bytes(const transaction &tx)
+    {
+      uint64_t bytes = sizeof(transaction) + tx.extra.size() + tx.vout.size() * sizeof(tx_out);
+      for (const txin_v &in: tx.vin)
+      {
+        bytes += sizeof(txin_v);
+        if (in.type() == typeid(txin_to_key))
+          bytes += boost::get<txin_to_key>(in).key_offsets.size() * sizeof(uint64_t);
+      }
+      for (const auto &sigs: tx.signatures)
+        bytes += sigs.size() * sizeof(crypto::signature);
+      return bytes;
+    }
+
+    // carried in the pool metadata so mining the tx needs no rehash
+    void set_meta_prunable_hash(txpool_tx_meta_t &meta, const transaction &tx)
+    {
+      meta.prunable_hash_valid = tx.version >= 2;
+      meta.prunable_hash = tx.version >= 2 ? get_transaction_prunable_hash(tx) : crypto::null_hash;
+    }
+
     // This class is meant to create a batch when none currently exists.
     // If a batch exists, it can't be from another thread, since we can
     // only be called with the txpool lock taken, and it is held during
@@ -104,20 +135,46 @@ namespace cryptonote
       Blockchain &m_blockchain;
       bool m_batch;
     };
+
+    // the pool's key image index as saved by deinit, for the pool it was built from
+    struct index_checkpoint
+    {
+      crypto::hash pool_digest;
+      std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash>> key_images;
+
+      template<class Archive>
+      void serialize(Archive &a, const unsigned int ver)
+      {
+        a & pool_digest;
+        a & key_images;
+      }
+    };
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0), m_pool_changes_start(0), m_pool_instance(new_pool_instance()), m_input_cache_generation(0), m_input_cache_max(DEFAULT_TXPOOL_INPUT_CACHE_SIZE), m_input_cache_hits(0), m_input_cache_misses(0), m_parsed_tx_cache_max(DEFAULT_TXPOOL_PARSED_TX_CACHE_SIZE), m_parsed_tx_cache_hits(0), m_parsed_tx_cache_misses(0), m_pruned_txes(0), m_pruned_bytes(0), m_db_snapshot_interval(0), m_last_db_snapshot(time(NULL))
   {
-
+    m_block_template_cache.valid = false;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::add_tx(transaction &tx, /*const crypto::hash& tx_prefix_hash,*/ const crypto::hash &id, size_t tx_weight, tx_verification_context& tvc, bool kept_by_block, bool relayed, bool do_not_relay, uint8_t version)
   {
+    PERF_TIMER(add_tx);
+
+    // checking inputs is by far the slowest part of accepting a relayed tx, so
+    // it is done before taking the pool lock, and its cached result picked up
+    // below (unless a block came in meanwhile)
+    if (!kept_by_block && passes_cheap_checks(tx, id, tx_weight, version))
+    {
+      uint64_t max_used_block_height = 0;
+      crypto::hash max_used_block_id = null_hash;
+      tx_verification_context pre_tvc = AUTO_VAL_INIT(pre_tvc);
+      check_tx_inputs([&tx]()->cryptonote::transaction&{ return tx; }, id, max_used_block_height, max_used_block_id, pre_tvc, false);
+    }
+
     // this should already be called with that lock, but let's make it explicit for clarity
     CRITICAL_REGION_LOCAL(m_transactions_lock);
 
-    PERF_TIMER(add_tx);
     if (tx.version == 0)
     {
       // v0 never accepted
@@ -245,6 +302,7 @@ namespace cryptonote
         meta.do_not_relay = do_not_relay;
         meta.double_spend_seen = have_tx_keyimges_as_spent(tx);
         meta.bf_padding = 0;
+        set_meta_prunable_hash(meta, tx);
         memset(meta.padding, 0, sizeof(meta.padding));
         try
         {
@@ -254,6 +312,7 @@ namespace cryptonote
           if (!insert_key_images(tx, id, kept_by_block))
             return false;
           m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+          add_tx_stats(id, meta);
         }
         catch (const std::exception &e)
         {
@@ -285,6 +344,7 @@ namespace cryptonote
       meta.do_not_relay = do_not_relay;
       meta.double_spend_seen = false;
       meta.bf_padding = 0;
+      set_meta_prunable_hash(meta, tx);
       memset(meta.padding, 0, sizeof(meta.padding));
 
       try
@@ -297,6 +357,7 @@ namespace cryptonote
         if (!insert_key_images(tx, txid, kept_by_block))
           return false;
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+        add_tx_stats(id, meta);
       }
       catch (const std::exception &e)
       {
@@ -312,10 +373,14 @@ namespace cryptonote
     tvc.m_verifivation_failed = false;
     m_txpool_weight += tx_weight;
 
+    add_pool_change(id, true, do_not_relay);
     ++m_cookie;
 
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)tx_weight));
 
+    if (m_tx_added_callback)
+      m_tx_added_callback(id, tx_weight, fee);
+
     prune(m_txpool_max_weight);
 
     return true;
@@ -330,18 +395,223 @@ namespace cryptonote
     return add_tx(tx, h, get_transaction_weight(tx, blob_size), tvc, keeped_by_block, relayed, do_not_relay, version);
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_popped_txs(std::vector<transaction> &txs, uint8_t version)
+  {
+    PERF_TIMER(add_popped_txs);
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    LockedTXN lock(m_blockchain);
+
+    const time_t receive_time = time(nullptr);
+    for (transaction &tx: txs)
+    {
+      crypto::hash id = null_hash;
+      size_t blob_size = 0;
+      if (!get_transaction_hash(tx, id, blob_size) || blob_size == 0)
+      {
+        MERROR("Failed to hash transaction returned from a popped block");
+        continue;
+      }
+      const size_t tx_weight = get_transaction_weight(tx, blob_size);
+
+      // the same checks add_tx does for a tx kept by block, short of the
+      // inputs check: that one is left until the tx is next considered for
+      // a block, or done ahead of it by precheck_tx_inputs
+      if (tx.version == 0 || !check_inputs_types_supported(tx))
+        continue;
+      uint64_t fee;
+      if (tx.version == 1)
+      {
+        uint64_t inputs_amount = 0;
+        const uint64_t outputs_amount = get_outs_money_amount(tx);
+        if (!get_inputs_money_amount(tx, inputs_amount) || inputs_amount <= outputs_amount)
+          continue;
+        fee = inputs_amount - outputs_amount;
+      }
+      else
+      {
+        fee = tx.rct_signatures.txnFee;
+      }
+      if (version >= HF_VERSION_PER_BYTE_FEE && tx_weight > get_transaction_weight_limit(version))
+        continue;
+      tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if (!m_blockchain.check_tx_outputs(tx, tvc))
+        continue;
+      if (m_blockchain.get_db().txpool_has_tx(id))
+        continue;
+
+      // We assume that if they were in a block, the transactions are already
+      // known to the network as a whole, so they are marked as relayed
+      txpool_tx_meta_t meta;
+      meta.weight = tx_weight;
+      meta.fee = fee;
+      meta.max_used_block_id = null_hash;
+      meta.max_used_block_height = 0;
+      meta.last_failed_height = 0;
+      meta.last_failed_id = null_hash;
+      meta.kept_by_block = true;
+      meta.receive_time = receive_time;
+      meta.last_relayed_time = receive_time;
+      meta.relayed = true;
+      meta.do_not_relay = false;
+      meta.double_spend_seen = have_tx_keyimges_as_spent(tx);
+      meta.bf_padding = 0;
+      set_meta_prunable_hash(meta, tx);
+      memset(meta.padding, 0, sizeof(meta.padding));
+      try
+      {
+        m_blockchain.add_txpool_tx(tx, meta);
+        if (!insert_key_images(tx, id, true))
+          continue;
+        m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+        add_tx_stats(id, meta);
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to return transaction " << id << " to the pool: " << e.what());
+        continue;
+      }
+      m_txpool_weight += tx_weight;
+      add_pool_change(id, true, false);
+      ++m_cookie;
+      MINFO("Transaction returned to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)tx_weight));
+      if (m_tx_added_callback)
+        m_tx_added_callback(id, tx_weight, fee);
+    }
+
+    prune(m_txpool_max_weight);
+  }
+  //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_txpool_weight() const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     return m_txpool_weight;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_input_cache_stats(uint64_t &hits, uint64_t &misses) const
+  {
+    hits = m_input_cache_hits.load(std::memory_order_relaxed);
+    misses = m_input_cache_misses.load(std::memory_order_relaxed);
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::set_txpool_max_weight(size_t bytes)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_txpool_max_weight = bytes;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_parsed_tx_cache_size(size_t entries)
+  {
+    boost::unique_lock<boost::mutex> lock(m_parsed_tx_cache_lock);
+    m_parsed_tx_cache_max = entries;
+    while (m_parsed_txes.size() > m_parsed_tx_cache_max)
+    {
+      m_parsed_tx_index.erase(m_parsed_txes.back().first);
+      m_parsed_txes.pop_back();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::set_input_cache_size(size_t entries)
+  {
+    boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
+    m_input_cache_max = entries;
+    while (m_input_cache.size() > m_input_cache_max)
+      m_input_cache.erase(m_input_cache.begin());
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_memory_usage(std::vector<tools::memory_usage> &usage) const
+  {
+    {
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      {
+        boost::shared_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+        uint64_t bytes = m_spent_key_images.capacity() * key_images_container::slot_size();
+        for (const auto &e: m_spent_key_images)
+          bytes += e.second.capacity() * sizeof(crypto::hash);
+        usage.push_back({"txpool.spent_key_images", m_spent_key_images.size(), bytes, 0, 0});
+        bytes = m_tx_key_images.capacity() * decltype(m_tx_key_images)::slot_size();
+        for (const auto &e: m_tx_key_images)
+          bytes += e.second.key_images.capacity() * sizeof(crypto::key_image);
+        usage.push_back({"txpool.tx_key_images", m_tx_key_images.size(), bytes, 0, 0});
+      }
+      {
+        boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
+        usage.push_back({"txpool.tx_stats", m_tx_stats.size(),
+            m_tx_stats.capacity() * sizeof(tx_stats_entry) + m_tx_stats_index.capacity() * decltype(m_tx_stats_index)::slot_size(), 0, 0});
+        uint64_t bytes = m_relay_due.capacity() * decltype(m_relay_due)::slot_size() +
+            tools::node_container_bytes<decltype(m_relay_schedule)::value_type>(m_relay_schedule.size());
+        for (const auto &e: m_relay_schedule)
+          bytes += e.second.capacity() * sizeof(crypto::hash);
+        usage.push_back({"txpool.relay_schedule", m_relay_due.size(), bytes, 0, 0});
+      }
+      usage.push_back({"txpool.sorted_txes", m_txs_by_fee_and_receive_time.size(),
+          tools::node_container_bytes<sorted_tx_container::value_type>(m_txs_by_fee_and_receive_time.size()), 0, 0});
+      usage.push_back({"txpool.pool_changes", m_pool_changes.size(), m_pool_changes.size() * sizeof(pool_change), MAX_POOL_CHANGES, 0});
+      usage.push_back({"txpool.timed_out_txes", m_timed_out_transactions.size(),
+          tools::node_container_bytes<crypto::hash>(m_timed_out_transactions.size()), 0, 0});
+    }
+    {
+      boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
+      usage.push_back({"txpool.input_cache", m_input_cache.size(),
+          tools::node_container_bytes<decltype(m_input_cache)::value_type>(m_input_cache.size()), m_input_cache_max, 0});
+    }
+    boost::unique_lock<boost::mutex> lock(m_parsed_tx_cache_lock);
+    uint64_t bytes = tools::node_container_bytes<std::pair<const crypto::hash, parsed_tx_list::iterator>>(m_parsed_txes.size());
+    for (const auto &e: m_parsed_txes)
+      bytes += 3 * sizeof(void*) + sizeof(crypto::hash) + parsed_tx_bytes(e.second);
+    usage.push_back({"txpool.parsed_txes", m_parsed_txes.size(), bytes, m_parsed_tx_cache_max, 0});
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_parsed_tx(const crypto::hash &txid, transaction &tx, const cryptonote::blobdata *txblob) const
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(m_parsed_tx_cache_lock);
+      const auto i = m_parsed_tx_index.find(txid);
+      if (i != m_parsed_tx_index.end())
+      {
+        m_parsed_txes.splice(m_parsed_txes.begin(), m_parsed_txes, i->second);
+        tx = i->second->second;
+        ++m_parsed_tx_cache_hits;
+        return true;
+      }
+    }
+    ++m_parsed_tx_cache_misses;
+
+    cryptonote::blobdata bd;
+    if (!txblob)
+    {
+      if (!m_blockchain.get_txpool_tx_blob(txid, bd))
+        return false;
+      txblob = &bd;
+    }
+    if (!parse_and_validate_tx_from_blob(*txblob, tx))
+      return false;
+    // the pool is keyed by txid, so copies handed out later come with the hash
+    tx.set_hash(txid);
+
+    boost::unique_lock<boost::mutex> lock(m_parsed_tx_cache_lock);
+    if (m_parsed_tx_cache_max == 0 || m_parsed_tx_index.find(txid) != m_parsed_tx_index.end())
+      return true;
+    m_parsed_txes.push_front(std::make_pair(txid, tx));
+    m_parsed_tx_index[txid] = m_parsed_txes.begin();
+    while (m_parsed_txes.size() > m_parsed_tx_cache_max)
+    {
+      m_parsed_tx_index.erase(m_parsed_txes.back().first);
+      m_parsed_txes.pop_back();
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_parsed_tx(const crypto::hash &txid) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_parsed_tx_cache_lock);
+    const auto i = m_parsed_tx_index.find(txid);
+    if (i == m_parsed_tx_index.end())
+      return;
+    m_parsed_txes.erase(i->second);
+    m_parsed_tx_index.erase(i);
+  }
+  //---------------------------------------------------------------------------------
   void tx_memory_pool::prune(size_t bytes)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -360,31 +630,37 @@ namespace cryptonote
       try
       {
         const crypto::hash &txid = it->second;
-        txpool_tx_meta_t meta;
-        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+        const auto ki = m_tx_key_images.find(txid);
+        if (ki == m_tx_key_images.end())
         {
-          MERROR("Failed to find tx in txpool");
+          MERROR("Failed to find key images of tx in txpool");
           return;
         }
         // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
-        if (meta.kept_by_block)
+        if (ki->second.kept_by_block)
         {
           --it;
           continue;
         }
-        cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
-        cryptonote::transaction_prefix tx;
-        if (!parse_and_validate_tx_prefix_from_blob(txblob, tx))
+        txpool_tx_meta_t meta;
+        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
         {
-          MERROR("Failed to parse tx from txpool");
+          MERROR("Failed to find tx in txpool");
           return;
         }
         // remove first, in case this throws, so key images aren't removed
-        MINFO("Pruning tx " << txid << " from txpool: weight: " << it->first.second << ", fee/byte: " << it->first.first);
+        MINFO("Pruning tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
         m_blockchain.remove_txpool_tx(txid);
-        m_txpool_weight -= it->first.second;
-        remove_transaction_keyimages(tx, txid);
-        MINFO("Pruned tx " << txid << " from txpool: weight: " << it->first.second << ", fee/byte: " << it->first.first);
+        remove_parsed_tx(txid);
+        m_txpool_weight -= meta.weight;
+        remove_transaction_keyimages(txid);
+        add_pool_change(txid, false, meta.do_not_relay);
+        ++m_pruned_txes;
+        m_pruned_bytes += meta.weight;
+        MINFO("Pruned tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
+        if (m_tx_removed_callback)
+          m_tx_removed_callback(txid);
+        remove_tx_stats(txid);
         m_txs_by_fee_and_receive_time.erase(it--);
         changed = true;
       }
@@ -402,20 +678,47 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::insert_key_images(const transaction_prefix &tx, const crypto::hash &id, bool kept_by_block)
   {
+    boost::unique_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+    tx_key_images &tx_images = m_tx_key_images[id];
+    tx_images.key_images.clear();
+    tx_images.key_images.reserve(tx.vin.size());
+    tx_images.kept_by_block = kept_by_block;
     for(const auto& in: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, txin, false);
-      std::unordered_set<crypto::hash>& kei_image_set = m_spent_key_images[txin.k_image];
+      std::vector<crypto::hash>& kei_image_set = m_spent_key_images[txin.k_image];
       CHECK_AND_ASSERT_MES(kept_by_block || kei_image_set.size() == 0, false, "internal error: kept_by_block=" << kept_by_block
                                           << ",  kei_image_set.size()=" << kei_image_set.size() << ENDL << "txin.k_image=" << txin.k_image << ENDL
                                           << "tx_id=" << id );
-      auto ins_res = kei_image_set.insert(id);
-      CHECK_AND_ASSERT_MES(ins_res.second, false, "internal error: try to insert duplicate iterator in key_image set");
+      CHECK_AND_ASSERT_MES(std::find(kei_image_set.begin(), kei_image_set.end(), id) == kei_image_set.end(), false, "internal error: try to insert duplicate iterator in key_image set");
+      kei_image_set.push_back(id);
+      tx_images.key_images.push_back(txin.k_image);
     }
     ++m_cookie;
     return true;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::remove_key_image(const crypto::key_image &k_image, const crypto::hash &actual_hash)
+  {
+    auto it = m_spent_key_images.find(k_image);
+    CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << k_image << ENDL
+                                  << "transaction id = " << actual_hash);
+    std::vector<crypto::hash>& key_image_set =  it->second;
+    CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << k_image << ENDL
+      << "transaction id = " << actual_hash);
+
+    auto it_in_set = std::find(key_image_set.begin(), key_image_set.end(), actual_hash);
+    CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << k_image << ENDL
+      << "transaction id = " << actual_hash);
+    key_image_set.erase(it_in_set);
+    if(!key_image_set.size())
+    {
+      //it is now empty hash container for this key_image
+      m_spent_key_images.erase(it);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   //FIXME: Can return early before removal of all of the key images.
   //       At the least, need to make sure that a false return here
   //       is treated properly.  Should probably not return early, however.
@@ -423,27 +726,32 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::unique_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+    m_tx_key_images.erase(actual_hash);
     // ND: Speedup
     for(const txin_v& vi: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(vi, const txin_to_key, txin, false);
-      auto it = m_spent_key_images.find(txin.k_image);
-      CHECK_AND_ASSERT_MES(it != m_spent_key_images.end(), false, "failed to find transaction input in key images. img=" << txin.k_image << ENDL
-                                    << "transaction id = " << actual_hash);
-      std::unordered_set<crypto::hash>& key_image_set =  it->second;
-      CHECK_AND_ASSERT_MES(key_image_set.size(), false, "empty key_image set, img=" << txin.k_image << ENDL
-        << "transaction id = " << actual_hash);
-
-      auto it_in_set = key_image_set.find(actual_hash);
-      CHECK_AND_ASSERT_MES(it_in_set != key_image_set.end(), false, "transaction id not found in key_image set, img=" << txin.k_image << ENDL
-        << "transaction id = " << actual_hash);
-      key_image_set.erase(it_in_set);
-      if(!key_image_set.size())
-      {
-        //it is now empty hash container for this key_image
-        m_spent_key_images.erase(it);
-      }
-
+      if (!remove_key_image(txin.k_image, actual_hash))
+        return false;
+    }
+    ++m_cookie;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::remove_transaction_keyimages(const crypto::hash &actual_hash)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::unique_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+    auto it = m_tx_key_images.find(actual_hash);
+    CHECK_AND_ASSERT_MES(it != m_tx_key_images.end(), false, "key images not found for transaction id = " << actual_hash);
+    const std::vector<crypto::key_image> key_images = std::move(it->second.key_images);
+    m_tx_key_images.erase(it);
+    for (const crypto::key_image &k_image: key_images)
+    {
+      if (!remove_key_image(k_image, actual_hash))
+        return false;
     }
     ++m_cookie;
     return true;
@@ -454,25 +762,26 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    auto sorted_it = find_tx_in_sorted_container(id);
-    if (sorted_it == m_txs_by_fee_and_receive_time.end())
-      return false;
-
+    sorted_tx_container::iterator sorted_it;
     try
     {
       LockedTXN lock(m_blockchain);
       txpool_tx_meta_t meta;
       if (!m_blockchain.get_txpool_tx_meta(id, meta))
+        return false;
+      sorted_it = find_tx_in_sorted_container(id, meta);
+      if (sorted_it == m_txs_by_fee_and_receive_time.end())
       {
-        MERROR("Failed to find tx in txpool");
+        MERROR("Failed to find tx in the sorted txs container");
         return false;
       }
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(id);
-      if (!parse_and_validate_tx_from_blob(txblob, tx))
+      if (!get_parsed_tx(id, tx))
       {
         MERROR("Failed to parse tx from txpool");
         return false;
       }
+      if (meta.prunable_hash_valid)
+        tx.set_prunable_hash(meta.prunable_hash);
       tx_weight = meta.weight;
       fee = meta.fee;
       relayed = meta.relayed;
@@ -481,8 +790,10 @@ namespace cryptonote
 
       // remove first, in case this throws, so key images aren't removed
       m_blockchain.remove_txpool_tx(id);
+      remove_parsed_tx(id);
       m_txpool_weight -= tx_weight;
       remove_transaction_keyimages(tx, id);
+      add_pool_change(id, false, meta.do_not_relay);
     }
     catch (const std::exception &e)
     {
@@ -491,13 +802,37 @@ namespace cryptonote
     }
 
     m_txs_by_fee_and_receive_time.erase(sorted_it);
+    remove_tx_stats(id);
     ++m_cookie;
+    if (m_tx_removed_callback)
+      m_tx_removed_callback(id);
     return true;
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::on_idle()
   {
     m_remove_stuck_tx_interval.do_call([this](){return remove_stuck_transactions();});
+    if (m_db_snapshot_interval && time(NULL) - m_last_db_snapshot >= (time_t)m_db_snapshot_interval)
+    {
+      snapshot_to_db();
+      m_last_db_snapshot = time(NULL);
+    }
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::snapshot_to_db()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    try
+    {
+      LockedTXN lock(m_blockchain);
+      return m_blockchain.get_db().snapshot_txpool();
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to write the txpool to the db: " << e.what());
+      return false;
+    }
   }
   //---------------------------------------------------------------------------------
   sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
@@ -509,6 +844,15 @@ namespace cryptonote
     );
   }
   //---------------------------------------------------------------------------------
+  sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id, const txpool_tx_meta_t& meta) const
+  {
+    // the same key the tx was inserted with
+    const auto it = m_txs_by_fee_and_receive_time.find(tx_by_fee_and_receive_time_entry(std::pair<double, std::time_t>(meta.fee / (double)meta.weight, meta.receive_time), id));
+    if (it != m_txs_by_fee_and_receive_time.end())
+      return it;
+    return find_tx_in_sorted_container(id);
+  }
+  //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::remove_stuck_transactions()
   {
@@ -522,7 +866,7 @@ namespace cryptonote
          (tx_age > CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME && meta.kept_by_block) )
       {
         LOG_PRINT_L1("Tx " << txid << " removed from tx pool due to outdated, age: " << tx_age );
-        auto sorted_it = find_tx_in_sorted_container(txid);
+        auto sorted_it = find_tx_in_sorted_container(txid, meta);
         if (sorted_it == m_txs_by_fee_and_receive_time.end())
         {
           LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
@@ -531,6 +875,7 @@ namespace cryptonote
         {
           m_txs_by_fee_and_receive_time.erase(sorted_it);
         }
+        remove_tx_stats(txid);
         m_timed_out_transactions.insert(txid);
         remove.push_back(std::make_pair(txid, meta.weight));
       }
@@ -554,10 +899,16 @@ namespace cryptonote
           }
           else
           {
+            txpool_tx_meta_t meta;
+            const bool do_not_relay = m_blockchain.get_txpool_tx_meta(txid, meta) && meta.do_not_relay;
             // remove first, so we only remove key images if the tx removal succeeds
             m_blockchain.remove_txpool_tx(txid);
+            remove_parsed_tx(txid);
             m_txpool_weight -= entry.second;
             remove_transaction_keyimages(tx, txid);
+            add_pool_change(txid, false, do_not_relay);
+            if (m_tx_removed_callback)
+              m_tx_removed_callback(txid);
           }
         }
         catch (const std::exception &e)
@@ -576,32 +927,53 @@ namespace cryptonote
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    const uint64_t now = time(NULL);
-    txs.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([this, now, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *){
-      // 0 fee transactions are never relayed
-      if(meta.fee > 0 && !meta.do_not_relay && now - meta.last_relayed_time > get_relay_delay(now, meta.receive_time))
+    const time_t now = time(NULL);
+    std::vector<crypto::hash> due;
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
+      while (!m_relay_schedule.empty() && m_relay_schedule.begin()->first <= now)
       {
-        // if the tx is older than half the max lifetime, we don't re-relay it, to avoid a problem
-        // mentioned by smooth where nodes would flush txes at slightly different times, causing
-        // flushed txes to be re-added when received from a node which was just about to flush it
-        uint64_t max_age = meta.kept_by_block ? CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME : CRYPTONOTE_MEMPOOL_TX_LIVETIME;
-        if (now - meta.receive_time <= max_age / 2)
+        const time_t bucket = m_relay_schedule.begin()->first;
+        const std::vector<crypto::hash> txids = std::move(m_relay_schedule.begin()->second);
+        m_relay_schedule.erase(m_relay_schedule.begin());
+        for (const crypto::hash &txid: txids)
         {
-          try
-          {
-            cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
-            txs.push_back(std::make_pair(txid, bd));
-          }
-          catch (const std::exception &e)
+          auto i = m_relay_due.find(txid);
+          if (i == m_relay_due.end() || i->second.bucket != bucket)
+            continue;
+          relay_schedule_entry &e = i->second;
+          // if the tx is older than half the max lifetime, we don't re-relay it, to avoid a problem
+          // mentioned by smooth where nodes would flush txes at slightly different times, causing
+          // flushed txes to be re-added when received from a node which was just about to flush it
+          const time_t max_age = e.kept_by_block ? CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME : CRYPTONOTE_MEMPOOL_TX_LIVETIME;
+          if (now - e.receive_time > max_age / 2)
           {
-            MERROR("Failed to get transaction blob from db");
-            // ignore error
+            m_relay_due.erase(txid);
+            continue;
           }
+          const time_t delay = get_relay_delay(std::max(now, e.receive_time), e.receive_time);
+          if (now - e.last_relayed_time > delay)
+            due.push_back(txid);
+          // the delay only grows, so it cannot be due before this; set_relayed moves it on once relayed
+          schedule_relay(txid, e, std::max<time_t>(now + 1, e.last_relayed_time + delay + 1));
         }
       }
-      return true;
-    }, false);
+    }
+
+    txs.reserve(due.size());
+    for (const crypto::hash &txid: due)
+    {
+      try
+      {
+        cryptonote::blobdata bd = m_blockchain.get_txpool_tx_blob(txid);
+        txs.push_back(std::make_pair(txid, bd));
+      }
+      catch (const std::exception &e)
+      {
+        MERROR("Failed to get transaction blob from db");
+        // ignore error
+      }
+    }
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -621,6 +993,7 @@ namespace cryptonote
           meta.relayed = true;
           meta.last_relayed_time = now;
           m_blockchain.update_txpool_tx(it->first, meta);
+          add_tx_stats(it->first, meta);
         }
       }
       catch (const std::exception &e)
@@ -633,9 +1006,10 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count(bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    if (include_unrelayed_txes)
+      return snapshot->txes.size();
+    return std::count_if(snapshot->txes.begin(), snapshot->txes.end(), [](const pool_snapshot::entry &e) { return !e.do_not_relay; });
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_unrelayed_txes) const
@@ -643,9 +1017,9 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
     txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    m_blockchain.for_all_txpool_txes([this, &txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      if (!get_parsed_tx(txid, tx, bd))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -657,60 +1031,197 @@ namespace cryptonote
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes) const
+  {
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    txs.reserve(snapshot->txes.size());
+    for (const pool_snapshot::entry &e: snapshot->txes)
+      if (include_unrelayed_txes || !e.do_not_relay)
+        txs.push_back(e.txid);
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::add_pool_change(const crypto::hash &txid, bool added, bool do_not_relay)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      txs.push_back(txid);
-      return true;
-    }, false, include_unrelayed_txes);
+    m_pool_changes.push_back({m_cookie, txid, added, do_not_relay});
+    while (m_pool_changes.size() > MAX_POOL_CHANGES)
+    {
+      // other changes may share this cookie, so only vouch for the next one
+      m_pool_changes_start = m_pool_changes.front().cookie + 1;
+      m_pool_changes.pop_front();
+    }
   }
   //------------------------------------------------------------------
-  void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
+  bool tx_memory_pool::get_transaction_changes(uint64_t instance, uint64_t cookie, uint64_t &current_instance, uint64_t &current_cookie, std::vector<crypto::hash> &added, std::vector<crypto::hash> &removed, bool include_unrelayed_txes) const
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    current_instance = m_pool_instance;
+    current_cookie = m_cookie;
+    added.clear();
+    removed.clear();
+    if (instance != m_pool_instance || cookie < m_pool_changes_start || cookie > current_cookie)
+    {
+      get_transaction_hashes(added, include_unrelayed_txes);
+      return false;
+    }
+
+    // the first and last change seen for each tx decide whether it's new, gone, or both
+    std::unordered_map<crypto::hash, std::pair<bool, bool>> changes;
+    std::vector<crypto::hash> order;
+    auto it = std::lower_bound(m_pool_changes.begin(), m_pool_changes.end(), cookie,
+        [](const pool_change &c, uint64_t cookie) { return c.cookie < cookie; });
+    for (; it != m_pool_changes.end(); ++it)
+    {
+      if (!include_unrelayed_txes && it->do_not_relay)
+        continue;
+      auto i = changes.find(it->txid);
+      if (i == changes.end())
+      {
+        changes.emplace(it->txid, std::make_pair(it->added, it->added));
+        order.push_back(it->txid);
+      }
+      else
+        i->second.second = it->added;
+    }
+    for (const crypto::hash &txid: order)
+    {
+      const std::pair<bool, bool> &c = changes[txid];
+      if (c.second)
+        added.push_back(txid);
+      else if (!c.first)
+        removed.push_back(txid);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
+  {
+    boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
     const uint64_t now = time(NULL);
-    backlog.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      backlog.push_back({meta.weight, meta.fee, meta.receive_time - now});
-      return true;
-    }, false, include_unrelayed_txes);
+    backlog.reserve(m_tx_stats.size());
+    for (const tx_stats_entry &e: m_tx_stats)
+      if (include_unrelayed_txes || !e.do_not_relay)
+        backlog.push_back({e.weight, e.fee, e.receive_time - now});
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::add_tx_stats(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+  {
+    boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
+    const tx_stats_entry e{txid, meta.weight, meta.fee, (time_t)meta.receive_time, (bool)meta.relayed, (bool)meta.do_not_relay, meta.last_failed_height != 0, (bool)meta.double_spend_seen};
+    auto i = m_tx_stats_index.find(txid);
+    if (i == m_tx_stats_index.end())
+    {
+      m_tx_stats_index.emplace(txid, m_tx_stats.size());
+      m_tx_stats.push_back(e);
+    }
+    else
+    {
+      update_tx_stats_totals(m_tx_stats[i->second], -1);
+      m_tx_stats[i->second] = e;
+    }
+    update_tx_stats_totals(e, 1);
+
+    // 0 fee transactions are never relayed
+    if (meta.fee > 0 && !meta.do_not_relay)
+    {
+      relay_schedule_entry &r = m_relay_due[txid];
+      r.last_relayed_time = meta.last_relayed_time;
+      r.receive_time = meta.receive_time;
+      r.kept_by_block = meta.kept_by_block;
+      // it cannot be relayed before it was received, and the delay only grows from there
+      const time_t since = std::max(r.last_relayed_time, r.receive_time);
+      schedule_relay(txid, r, r.last_relayed_time + get_relay_delay(since, r.receive_time) + 1);
+    }
+    else
+    {
+      m_relay_due.erase(txid);
+    }
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_stats(const crypto::hash &txid)
+  {
+    boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
+    m_relay_due.erase(txid);
+    auto i = m_tx_stats_index.find(txid);
+    if (i == m_tx_stats_index.end())
+      return;
+    const size_t idx = i->second;
+    m_tx_stats_index.erase(i);
+    update_tx_stats_totals(m_tx_stats[idx], -1);
+    // move the last one into the hole
+    if (idx + 1 != m_tx_stats.size())
+    {
+      m_tx_stats[idx] = m_tx_stats.back();
+      m_tx_stats_index[m_tx_stats[idx].txid] = idx;
+    }
+    m_tx_stats.pop_back();
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::schedule_relay(const crypto::hash &txid, relay_schedule_entry &e, time_t due) const
+  {
+    const time_t bucket = (due + RELAY_SCHEDULE_BUCKET - 1) / RELAY_SCHEDULE_BUCKET * RELAY_SCHEDULE_BUCKET;
+    if (e.bucket == bucket)
+      return;
+    e.bucket = bucket;
+    m_relay_schedule[bucket].push_back(txid);
+  }
+  //------------------------------------------------------------------
+  void tx_memory_pool::update_tx_stats_totals(const tx_stats_entry &e, int sign)
+  {
+    for (int relayable = 0; relayable < 2; ++relayable)
+    {
+      if (relayable && e.do_not_relay)
+        continue;
+      tx_stats_totals &t = m_tx_stats_totals[relayable];
+      t.txs += sign;
+      t.bytes += sign * (int64_t)e.weight;
+      t.fees += sign * (int64_t)e.fee;
+      t.not_relayed += sign * !e.relayed;
+      t.failing += sign * e.failing;
+      t.double_spends += sign * e.double_spend_seen;
+    }
   }
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
     const uint64_t now = time(NULL);
     std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    stats.parsed_cache_hits = m_parsed_tx_cache_hits;
+    stats.parsed_cache_misses = m_parsed_tx_cache_misses;
+    stats.input_cache_hits = m_input_cache_hits;
+    stats.input_cache_misses = m_input_cache_misses;
+    stats.num_pruned = m_pruned_txes;
+    stats.bytes_pruned = m_pruned_bytes;
     std::vector<uint32_t> weights;
-    weights.reserve(stats.txs_total);
-    m_blockchain.for_all_txpool_txes([&stats, &weights, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
-      weights.push_back(meta.weight);
-      stats.bytes_total += meta.weight;
-      if (!stats.bytes_min || meta.weight < stats.bytes_min)
-        stats.bytes_min = meta.weight;
-      if (meta.weight > stats.bytes_max)
-        stats.bytes_max = meta.weight;
-      if (!meta.relayed)
-        stats.num_not_relayed++;
-      stats.fee_total += meta.fee;
-      if (!stats.oldest || meta.receive_time < stats.oldest)
-        stats.oldest = meta.receive_time;
-      if (meta.receive_time < now - 600)
-        stats.num_10m++;
-      if (meta.last_failed_height)
-        stats.num_failing++;
-      uint64_t age = now - meta.receive_time + (now == meta.receive_time);
-      agebytes[age].txs++;
-      agebytes[age].bytes += meta.weight;
-      if (meta.double_spend_seen)
-        ++stats.num_double_spends;
-      return true;
-      }, false, include_unrelayed_txes);
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
+      const tx_stats_totals &totals = m_tx_stats_totals[include_unrelayed_txes ? 0 : 1];
+      stats.txs_total = totals.txs;
+      stats.bytes_total = totals.bytes;
+      stats.fee_total = totals.fees;
+      stats.num_not_relayed = totals.not_relayed;
+      stats.num_failing = totals.failing;
+      stats.num_double_spends = totals.double_spends;
+
+      // the rest depends on the time or the whole distribution
+      weights.reserve(stats.txs_total);
+      for (const tx_stats_entry &e: m_tx_stats)
+      {
+        if (!include_unrelayed_txes && e.do_not_relay)
+          continue;
+        weights.push_back(e.weight);
+        if (!stats.bytes_min || e.weight < stats.bytes_min)
+          stats.bytes_min = e.weight;
+        if (e.weight > stats.bytes_max)
+          stats.bytes_max = e.weight;
+        if (!stats.oldest || (uint64_t)e.receive_time < stats.oldest)
+          stats.oldest = e.receive_time;
+        if ((uint64_t)e.receive_time < now - 600)
+          stats.num_10m++;
+        uint64_t age = now - e.receive_time + (now == (uint64_t)e.receive_time);
+        agebytes[age].txs++;
+        agebytes[age].bytes += e.weight;
+      }
+    }
     stats.bytes_med = epee::misc_utils::median(weights);
     if (stats.txs_total > 1)
     {
@@ -763,12 +1274,12 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL1(m_blockchain);
     tx_infos.reserve(m_blockchain.get_txpool_tx_count());
     key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    m_blockchain.for_all_txpool_txes([this, &tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       tx_info txi;
       txi.id_hash = epee::string_tools::pod_to_hex(txid);
       txi.tx_blob = *bd;
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      if (!get_parsed_tx(txid, tx, bd))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -797,7 +1308,7 @@ namespace cryptonote
     txpool_tx_meta_t meta;
     for (const key_images_container::value_type& kee : m_spent_key_images) {
       const crypto::key_image& k_image = kee.first;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
+      const std::vector<crypto::hash>& kei_image_set = kee.second;
       spent_key_image_info ki;
       ki.id_hash = epee::string_tools::pod_to_hex(k_image);
       for (const crypto::hash& tx_id_hash : kei_image_set)
@@ -836,11 +1347,11 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL1(m_blockchain);
     tx_infos.reserve(m_blockchain.get_txpool_tx_count());
     key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    m_blockchain.for_all_txpool_txes([this, &tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       cryptonote::rpc::tx_in_pool txi;
       txi.tx_hash = txid;
       transaction tx;
-      if (!parse_and_validate_tx_from_blob(*bd, tx))
+      if (!get_parsed_tx(txid, tx, bd))
       {
         MERROR("Failed to parse tx from txpool");
         // continue
@@ -866,7 +1377,7 @@ namespace cryptonote
 
     for (const key_images_container::value_type& kee : m_spent_key_images) {
       std::vector<crypto::hash> tx_hashes;
-      const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
+      const std::vector<crypto::hash>& kei_image_set = kee.second;
       for (const crypto::hash& tx_id_hash : kei_image_set)
       {
         tx_hashes.push_back(tx_id_hash);
@@ -878,16 +1389,42 @@ namespace cryptonote
     return true;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const
+  bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> &spent, bool include_sensitive_data) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-
     spent.clear();
+    spent.reserve(key_images.size());
 
+    if (include_sensitive_data)
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+      for (const auto& image : key_images)
+      {
+        spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      }
+      return true;
+    }
+
+    // only the txes spending a key image need their metadata checked
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::shared_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
     for (const auto& image : key_images)
     {
-      spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      bool relayable = false;
+      const auto it = m_spent_key_images.find(image);
+      if (it != m_spent_key_images.end())
+      {
+        for (const crypto::hash &txid: it->second)
+        {
+          txpool_tx_meta_t meta;
+          if (m_blockchain.get_txpool_tx_meta(txid, meta) && !meta.do_not_relay)
+          {
+            relayable = true;
+            break;
+          }
+        }
+      }
+      spent.push_back(relayable);
     }
 
     return true;
@@ -910,14 +1447,18 @@ namespace cryptonote
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
     m_input_cache.clear();
+    ++m_input_cache_generation;
     return true;
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
     m_input_cache.clear();
+    ++m_input_cache_generation;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -930,12 +1471,11 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimges_as_spent(const transaction& tx) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    boost::shared_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
     for(const auto& in: tx.vin)
     {
       CHECKED_GET_SPECIFIC_VARIANT(in, const txin_to_key, tokey_in, true);//should never fail
-      if(have_tx_keyimg_as_spent(tokey_in.k_image))
+      if(m_spent_key_images.end() != m_spent_key_images.find(tokey_in.k_image))
          return true;
     }
     return false;
@@ -943,7 +1483,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::have_tx_keyimg_as_spent(const crypto::key_image& key_im) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    boost::shared_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
     return m_spent_key_images.end() != m_spent_key_images.find(key_im);
   }
   //---------------------------------------------------------------------------------
@@ -959,42 +1499,160 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block) const
   {
+    uint64_t generation = 0;
     if (!kept_by_block)
     {
+      boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
       const std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>>::const_iterator i = m_input_cache.find(txid);
       if (i != m_input_cache.end())
       {
+        m_input_cache_hits.fetch_add(1, std::memory_order_relaxed);
         max_used_block_height = std::get<2>(i->second);
         max_used_block_id = std::get<3>(i->second);
         tvc = std::get<1>(i->second);
         return std::get<0>(i->second);
       }
+      generation = m_input_cache_generation;
+      m_input_cache_misses.fetch_add(1, std::memory_order_relaxed);
     }
     bool ret = m_blockchain.check_tx_inputs(get_tx(), max_used_block_height, max_used_block_id, tvc, kept_by_block);
     if (!kept_by_block)
-      m_input_cache.insert(std::make_pair(txid, std::make_tuple(ret, tvc, max_used_block_height, max_used_block_id)));
+    {
+      boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
+      // the result is stale if the chain changed while checking
+      if (generation == m_input_cache_generation && m_input_cache_max > 0)
+      {
+        m_input_cache.insert(std::make_pair(txid, std::make_tuple(ret, tvc, max_used_block_height, max_used_block_id)));
+        while (m_input_cache.size() > m_input_cache_max)
+          m_input_cache.erase(m_input_cache.begin());
+      }
+    }
     return ret;
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::passes_cheap_checks(const transaction &tx, const crypto::hash &id, size_t tx_weight, uint8_t version) const
+  {
+    if (tx.version == 0 || !check_inputs_types_supported(tx) || tx_weight > get_transaction_weight_limit(version))
+      return false;
+
+    uint64_t fee;
+    if (tx.version == 1)
+    {
+      uint64_t inputs_amount = 0;
+      const uint64_t outputs_amount = get_outs_money_amount(tx);
+      if (!get_inputs_money_amount(tx, inputs_amount) || inputs_amount <= outputs_amount)
+        return false;
+      fee = inputs_amount - outputs_amount;
+    }
+    else
+    {
+      fee = tx.rct_signatures.txnFee;
+    }
+    {
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      if (m_timed_out_transactions.find(id) != m_timed_out_transactions.end())
+        return false;
+    }
+    return m_blockchain.check_fee(tx_weight, fee);
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::precheck_tx_inputs(const std::vector<std::tuple<transaction*, crypto::hash, size_t>> &txes, uint8_t version)
+  {
+    std::vector<Blockchain::tx_input_check> checks;
+    std::vector<crypto::hash> txids;
+    for (const auto &e: txes)
+    {
+      if (!passes_cheap_checks(*std::get<0>(e), std::get<1>(e), std::get<2>(e), version))
+        continue;
+      Blockchain::tx_input_check check = AUTO_VAL_INIT(check);
+      check.tx = std::get<0>(e);
+      checks.push_back(check);
+      txids.push_back(std::get<1>(e));
+    }
+    uint64_t generation;
+    {
+      boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
+      size_t n = 0;
+      for (size_t i = 0; i < checks.size(); ++i)
+      {
+        if (m_input_cache.find(txids[i]) != m_input_cache.end())
+          continue;
+        checks[n] = checks[i];
+        txids[n] = txids[i];
+        ++n;
+      }
+      checks.resize(n);
+      txids.resize(n);
+      generation = m_input_cache_generation;
+    }
+    if (checks.empty())
+      return;
+
+    m_blockchain.check_tx_inputs_batch(checks);
+
+    boost::unique_lock<boost::mutex> lock(m_input_cache_lock);
+    // the results are stale if the chain changed while checking
+    if (generation != m_input_cache_generation || m_input_cache_max == 0)
+      return;
+    for (size_t i = 0; i < checks.size(); ++i)
+    {
+      const Blockchain::tx_input_check &check = checks[i];
+      m_input_cache.insert(std::make_pair(txids[i], std::make_tuple(check.result, check.tvc, check.max_used_block_height, check.max_used_block_id)));
+    }
+    while (m_input_cache.size() > m_input_cache_max)
+      m_input_cache.erase(m_input_cache.begin());
+  }
+  //---------------------------------------------------------------------------------
+  std::shared_ptr<const tx_memory_pool::pool_snapshot> tx_memory_pool::get_snapshot() const
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(m_snapshot_lock);
+      if (m_snapshot && m_snapshot->cookie == m_cookie)
+        return m_snapshot;
+    }
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    {
+      // another reader may have rebuilt it while we were waiting for the lock
+      boost::unique_lock<boost::mutex> lock(m_snapshot_lock);
+      if (m_snapshot && m_snapshot->cookie == m_cookie)
+        return m_snapshot;
+    }
+    std::shared_ptr<pool_snapshot> snapshot = std::make_shared<pool_snapshot>();
+    snapshot->cookie = m_cookie;
+    snapshot->txes.reserve(m_blockchain.get_txpool_tx_count(true));
+    m_blockchain.for_all_txpool_txes([&snapshot](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+      snapshot->txes.push_back({txid, meta.weight, meta.fee, (time_t)meta.receive_time, (bool)meta.do_not_relay});
+      return true;
+    }, false, true);
+
+    boost::unique_lock<boost::mutex> lock(m_snapshot_lock);
+    m_snapshot = snapshot;
+    return snapshot;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx) const
   {
     struct transction_parser
     {
-      transction_parser(const cryptonote::blobdata &txblob, transaction &tx): txblob(txblob), tx(tx), parsed(false) {}
+      transction_parser(const tx_memory_pool &pool, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx): pool(pool), txid(txid), txblob(txblob), tx(tx), parsed(false) {}
       cryptonote::transaction &operator()()
       {
         if (!parsed)
         {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!pool.get_parsed_tx(txid, tx, &txblob))
             throw std::runtime_error("failed to parse transaction blob");
           parsed = true;
         }
         return tx;
       }
+      const tx_memory_pool &pool;
+      const crypto::hash &txid;
       const cryptonote::blobdata &txblob;
       transaction &tx;
       bool parsed;
-    } lazy_tx(txblob, tx);
+    } lazy_tx(*this, txid, txblob, tx);
 
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
@@ -1092,6 +1750,7 @@ namespace cryptonote
             try
             {
               m_blockchain.update_txpool_tx(txid, meta);
+              add_tx_stats(txid, meta);
             }
             catch (const std::exception &e)
             {
@@ -1111,11 +1770,11 @@ namespace cryptonote
     std::stringstream ss;
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
-    m_blockchain.for_all_txpool_txes([&ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
+    m_blockchain.for_all_txpool_txes([this, &ss, short_format](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *txblob) {
       ss << "id: " << txid << std::endl;
       if (!short_format) {
         cryptonote::transaction tx;
-        if (!parse_and_validate_tx_from_blob(*txblob, tx))
+        if (!get_parsed_tx(txid, tx, txblob))
         {
           MERROR("Failed to parse tx from txpool");
           return true; // continue
@@ -1143,6 +1802,29 @@ namespace cryptonote
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
+    // whether a pool tx is ready to go, and its key images, only depend on
+    // the chain, so are kept until the top block changes. If the pool did
+    // not change either, the last template is returned as is.
+    block_template_cache &cache = m_block_template_cache;
+    const crypto::hash top_block_id = m_blockchain.get_tail_id();
+    if (cache.top_block_id != top_block_id)
+    {
+      cache.top_block_id = top_block_id;
+      cache.candidates.clear();
+      cache.valid = false;
+    }
+    if (cache.valid && cache.cookie == m_cookie && cache.median_weight == median_weight && cache.already_generated_coins == already_generated_coins && cache.version == version)
+    {
+      bl.tx_hashes.insert(bl.tx_hashes.end(), cache.tx_hashes.begin(), cache.tx_hashes.end());
+      total_weight = cache.total_weight;
+      fee = cache.fee;
+      expected_reward = cache.expected_reward;
+      LOG_PRINT_L2("Block template reused with " << cache.tx_hashes.size() << " txes, weight " << total_weight
+          << ", coinbase " << print_money(expected_reward) << " (including " << print_money(fee) << " in fees)");
+      return true;
+    }
+    cache.valid = false;
+
     uint64_t best_coinbase = 0, coinbase = 0;
     total_weight = 0;
     fee = 0;
@@ -1155,6 +1837,7 @@ namespace cryptonote
     size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
     size_t max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
     std::unordered_set<crypto::key_image> k_images;
+    std::vector<crypto::hash> tx_hashes;
 
     LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
 
@@ -1163,16 +1846,22 @@ namespace cryptonote
     auto sorted_it = m_txs_by_fee_and_receive_time.begin();
     for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
+      auto ci = cache.candidates.find(sorted_it->second);
+      if (ci == cache.candidates.end())
       {
-        MERROR("  failed to find tx meta");
-        continue;
+        txpool_tx_meta_t meta;
+        if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
+        {
+          MERROR("  failed to find tx meta");
+          continue;
+        }
+        ci = cache.candidates.insert(std::make_pair(sorted_it->second, block_template_candidate{meta.weight, meta.fee, false, false, {}})).first;
       }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
+      block_template_candidate &candidate = ci->second;
+      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << candidate.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
 
       // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
+      if (max_total_weight < total_weight + candidate.weight)
       {
         LOG_PRINT_L2("  would exceed maximum block weight");
         continue;
@@ -1184,12 +1873,12 @@ namespace cryptonote
         // If we're getting lower coinbase tx,
         // stop including more tx
         uint64_t block_reward;
-        if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version))
+        if(!get_block_reward(median_weight, total_weight + candidate.weight, already_generated_coins, block_reward, version))
         {
           LOG_PRINT_L2("  would exceed maximum block weight");
           continue;
         }
-        coinbase = block_reward + fee + meta.fee;
+        coinbase = block_reward + fee + candidate.fee;
         if (coinbase < template_accept_threshold(best_coinbase))
         {
           LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
@@ -1207,58 +1896,88 @@ namespace cryptonote
         }
       }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
-
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
-      try
-      {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
-      }
-      catch (const std::exception &e)
-      {
-        MERROR("Failed to check transaction readiness: " << e.what());
-        // continue, not fatal
-      }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
+      if (!candidate.checked)
       {
+        txpool_tx_meta_t meta;
+        if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
+        {
+          MERROR("  failed to find tx meta");
+          cache.candidates.erase(ci);
+          continue;
+        }
+        cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
+        cryptonote::transaction tx;
+
+        // Skip transactions that are not ready to be
+        // included into the blockchain or that are
+        // missing key images
+        const cryptonote::txpool_tx_meta_t original_meta = meta;
+        bool ready = false;
         try
-	{
-	  m_blockchain.update_txpool_tx(sorted_it->second, meta);
-	}
+        {
+          ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
+        }
         catch (const std::exception &e)
-	{
-	  MERROR("Failed to update tx meta: " << e.what());
-	  // continue, not fatal
-	}
+        {
+          MERROR("Failed to check transaction readiness: " << e.what());
+          // continue, not fatal
+        }
+        if (memcmp(&original_meta, &meta, sizeof(meta)))
+        {
+          try
+          {
+            m_blockchain.update_txpool_tx(sorted_it->second, meta);
+            add_tx_stats(sorted_it->second, meta);
+          }
+          catch (const std::exception &e)
+          {
+            MERROR("Failed to update tx meta: " << e.what());
+            // continue, not fatal
+          }
+        }
+        candidate.checked = true;
+        candidate.ready = ready;
+        if (ready)
+        {
+          for (const txin_v &in: tx.vin)
+            if (in.type() == typeid(txin_to_key))
+              candidate.key_images.push_back(boost::get<txin_to_key>(in).k_image);
+        }
       }
-      if (!ready)
+      if (!candidate.ready)
       {
         LOG_PRINT_L2("  not ready to go");
         continue;
       }
-      if (have_key_images(k_images, tx))
+      if (std::any_of(candidate.key_images.begin(), candidate.key_images.end(), [&k_images](const crypto::key_image &ki) { return k_images.count(ki) != 0; }))
       {
         LOG_PRINT_L2("  key images already seen");
         continue;
       }
 
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
+      tx_hashes.push_back(sorted_it->second);
+      total_weight += candidate.weight;
+      fee += candidate.fee;
       best_coinbase = coinbase;
-      append_key_images(k_images, tx);
+      k_images.insert(candidate.key_images.begin(), candidate.key_images.end());
       LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
     }
 
     expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
+    bl.tx_hashes.insert(bl.tx_hashes.end(), tx_hashes.begin(), tx_hashes.end());
+    LOG_PRINT_L2("Block template filled with " << tx_hashes.size() << " txes, weight "
         << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
         << " (including " << print_money(fee) << " in fees)");
+
+    cache.cookie = m_cookie;
+    cache.median_weight = median_weight;
+    cache.already_generated_coins = already_generated_coins;
+    cache.version = version;
+    cache.tx_hashes = std::move(tx_hashes);
+    cache.total_weight = total_weight;
+    cache.fee = fee;
+    cache.expected_reward = expected_reward;
+    cache.valid = true;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -1293,16 +2012,21 @@ namespace cryptonote
         {
           cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(txid);
           cryptonote::transaction tx;
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!get_parsed_tx(txid, tx, &txblob))
           {
             MERROR("Failed to parse tx from txpool");
             continue;
           }
+          txpool_tx_meta_t meta;
+          const bool have_meta = m_blockchain.get_txpool_tx_meta(txid, meta);
+          const bool do_not_relay = have_meta && meta.do_not_relay;
           // remove tx from db first
           m_blockchain.remove_txpool_tx(txid);
+          remove_parsed_tx(txid);
           m_txpool_weight -= get_transaction_weight(tx, txblob.size());
           remove_transaction_keyimages(tx, txid);
-          auto sorted_it = find_tx_in_sorted_container(txid);
+          add_pool_change(txid, false, do_not_relay);
+          auto sorted_it = have_meta ? find_tx_in_sorted_container(txid, meta) : find_tx_in_sorted_container(txid);
           if (sorted_it == m_txs_by_fee_and_receive_time.end())
           {
             LOG_PRINT_L1("Removing tx " << txid << " from tx pool, but it was not found in the sorted txs container!");
@@ -1311,6 +2035,9 @@ namespace cryptonote
           {
             m_txs_by_fee_and_receive_time.erase(sorted_it);
           }
+          remove_tx_stats(txid);
+          if (m_tx_removed_callback)
+            m_tx_removed_callback(txid);
           ++n_removed;
         }
         catch (const std::exception &e)
@@ -1332,13 +2059,40 @@ namespace cryptonote
 
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
-    m_spent_key_images.clear();
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_stats_lock);
+      m_tx_stats.clear();
+      m_tx_stats_index.clear();
+      m_tx_stats_totals[0] = m_tx_stats_totals[1] = tx_stats_totals();
+      m_relay_schedule.clear();
+      m_relay_due.clear();
+    }
+    {
+      boost::unique_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+      m_spent_key_images.clear();
+      m_tx_key_images.clear();
+    }
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
 
+    const bool index_loaded = load_index_checkpoint();
+    if (index_loaded)
+    {
+      // the key images are known already, the rest is in the metadata
+      bool r = m_blockchain.for_all_txpool_txes([this](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+        m_tx_key_images[txid].kept_by_block = meta.kept_by_block;
+        m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
+        add_tx_stats(txid, meta);
+        m_txpool_weight += meta.weight;
+        return true;
+      }, false);
+      if (!r)
+        return false;
+    }
+
     // first add the not kept by block, then the kept by block,
     // to avoid rejection due to key image collision
-    for (int pass = 0; pass < 2; ++pass)
+    for (int pass = 0; pass < 2 && !index_loaded; ++pass)
     {
       const bool kept = pass == 1;
       bool r = m_blockchain.for_all_txpool_txes([this, &remove, kept](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
@@ -1357,13 +2111,15 @@ namespace cryptonote
           return false;
         }
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
+        add_tx_stats(txid, meta);
         m_txpool_weight += meta.weight;
         return true;
       }, true);
       if (!r)
         return false;
     }
-    if (!remove.empty())
+    // a read only pool is left to the daemon owning the db to clean up
+    if (!remove.empty() && !m_blockchain.get_db().is_read_only())
     {
       LockedTXN lock(m_blockchain);
       for (const auto &txid: remove)
@@ -1371,6 +2127,7 @@ namespace cryptonote
         try
         {
           m_blockchain.remove_txpool_tx(txid);
+          remove_parsed_tx(txid);
         }
         catch (const std::exception &e)
         {
@@ -1381,14 +2138,103 @@ namespace cryptonote
     }
 
     m_cookie = 0;
+    m_pool_changes.clear();
+    m_pool_changes_start = 0;
+    m_pool_instance = new_pool_instance();
+    {
+      boost::unique_lock<boost::mutex> lock(m_snapshot_lock);
+      m_snapshot.reset();
+    }
+    m_block_template_cache.valid = false;
+    m_block_template_cache.candidates.clear();
+    {
+      boost::unique_lock<boost::mutex> lock(m_parsed_tx_cache_lock);
+      m_parsed_txes.clear();
+      m_parsed_tx_index.clear();
+    }
 
     // Ignore deserialization error
     return true;
   }
 
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_pool_digest(crypto::hash &digest) const
+  {
+    std::string data;
+    bool r = m_blockchain.for_all_txpool_txes([&data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+      data.append((const char*)&txid, sizeof(txid));
+      data.append((const char*)&meta, sizeof(meta));
+      return true;
+    }, false);
+    if (!r)
+      return false;
+    digest = crypto::cn_fast_hash(data.data(), data.size());
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::load_index_checkpoint()
+  {
+    if (m_index_checkpoint_file.empty())
+      return false;
+    boost::system::error_code ec;
+    if (!boost::filesystem::exists(m_index_checkpoint_file, ec) || ec)
+      return false;
+
+    index_checkpoint checkpoint;
+    const bool loaded = tools::unserialize_obj_from_file(checkpoint, m_index_checkpoint_file);
+    // only good for the first init after the deinit that saved it
+    boost::filesystem::remove(m_index_checkpoint_file, ec);
+    if (!loaded)
+    {
+      MWARNING("Failed to load " << m_index_checkpoint_file << ", rebuilding the pool key image index");
+      return false;
+    }
+    crypto::hash digest;
+    if (!get_pool_digest(digest) || digest != checkpoint.pool_digest)
+    {
+      MINFO("The pool changed since its key image index was saved, rebuilding it");
+      return false;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+    key_images_container key_images;
+    key_images.reserve(checkpoint.key_images.size());
+    for (const auto &e: checkpoint.key_images)
+    {
+      key_images[e.first].assign(e.second.begin(), e.second.end());
+      for (const crypto::hash &txid: e.second)
+        m_tx_key_images[txid].key_images.push_back(e.first);
+    }
+    m_spent_key_images.swap(key_images);
+    MINFO("Loaded the pool key image index, " << m_spent_key_images.size() << " key images");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::reload()
+  {
+    return init(m_txpool_max_weight);
+  }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::deinit()
   {
+    if (m_index_checkpoint_file.empty())
+      return true;
+
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    CRITICAL_REGION_LOCAL1(m_blockchain);
+    index_checkpoint checkpoint;
+    if (!get_pool_digest(checkpoint.pool_digest))
+    {
+      MWARNING("Failed to hash the pool, not saving its key image index");
+      return true;
+    }
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_spent_key_images_lock);
+      for (const auto &e: m_spent_key_images)
+        checkpoint.key_images[e.first].insert(e.second.begin(), e.second.end());
+    }
+    if (!tools::serialize_obj_to_file(checkpoint, m_index_checkpoint_file))
+      MWARNING("Failed to save the pool key image index to " << m_index_checkpoint_file);
     return true;
   }
 }
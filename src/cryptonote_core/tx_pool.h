@@ -32,11 +32,19 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <list>
+#include <map>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
+#include <deque>
+#include <tuple>
+#include <memory>
+#include <functional>
 #include <boost/serialization/version.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/utility.hpp>
 
 #include "string_tools.h"
@@ -46,6 +54,8 @@
 #include "cryptonote_basic/verification_context.h"
 #include "blockchain_db/blockchain_db.h"
 #include "crypto/hash.h"
+#include "common/memory_usage.h"
+#include "common/flat_hash_map.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
 
@@ -62,15 +72,15 @@ namespace cryptonote
   class txCompare
   {
   public:
-    bool operator()(const tx_by_fee_and_receive_time_entry& a, const tx_by_fee_and_receive_time_entry& b)
+    bool operator()(const tx_by_fee_and_receive_time_entry& a, const tx_by_fee_and_receive_time_entry& b) const
     {
       // sort by greatest first, not least
       if (a.first.first > b.first.first) return true;
       else if (a.first.first < b.first.first) return false;
       else if (a.first.second < b.first.second) return true;
       else if (a.first.second > b.first.second) return false;
-      else if (a.second != b.second) return true;
-      else return false;
+      // ties are ordered by txid, so a tx can be found by its key
+      else return memcmp(a.second.data, b.second.data, sizeof(a.second.data)) < 0;
     }
   };
 
@@ -205,6 +215,13 @@ namespace cryptonote
      */
     bool init(size_t max_txpool_weight = 0);
 
+    /**
+     * @brief reloads the pool from the db, which another process may have changed
+     *
+     * @return true on success, false otherwise
+     */
+    bool reload();
+
     /**
      * @brief attempts to save the transaction pool state to disk
      *
@@ -297,10 +314,11 @@ namespace cryptonote
      *
      * @param key_images [in] vector of key images to check
      * @param spent [out] vector of bool to return
+     * @param include_sensitive_data [in] whether to count key images only spent by txes not meant to be relayed
      *
      * @return true
      */
-    bool check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const;
+    bool check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> &spent, bool include_sensitive_data = true) const;
 
     /**
      * @brief get a specific transaction from the pool
@@ -370,6 +388,25 @@ namespace cryptonote
       */
     uint64_t cookie() const { return m_cookie; }
 
+    /**
+     * @brief get the txids which entered or left the pool since a cookie
+     *
+     * A txid which entered and left again is in neither list. Some changes
+     * made at the given cookie may be reported again, so callers must
+     * tolerate adding a txid they have or removing one they don't.
+     *
+     * @param instance the pool instance the cookie was obtained from
+     * @param cookie the cookie from which to report changes
+     * @param current_instance return-by-reference this pool's instance
+     * @param current_cookie return-by-reference the cookie the changes bring the caller to
+     * @param added return-by-reference txids added, or every txid in the pool if false is returned
+     * @param removed return-by-reference txids removed
+     * @param include_unrelayed_txes include unrelayed txes in the result
+     *
+     * @return true if the changes were known, false if the full list was returned instead
+     */
+    bool get_transaction_changes(uint64_t instance, uint64_t cookie, uint64_t &current_instance, uint64_t &current_cookie, std::vector<crypto::hash> &added, std::vector<crypto::hash> &removed, bool include_unrelayed_txes) const;
+
     /**
      * @brief get the cumulative txpool weight in bytes
      *
@@ -384,6 +421,99 @@ namespace cryptonote
      */
     void set_txpool_max_weight(size_t bytes);
 
+    /**
+     * @brief get how often input checks were answered from the input cache
+     *
+     * @param hits return-by-reference lookups answered by the cache
+     * @param misses return-by-reference lookups which had to check the inputs
+     */
+    void get_input_cache_stats(uint64_t &hits, uint64_t &misses) const;
+
+    /**
+     * @brief sets how many parsed transactions are kept in memory
+     *
+     * @param entries the max number of parsed txes kept, 0 to disable the cache
+     */
+    void set_parsed_tx_cache_size(size_t entries);
+
+    /**
+     * @brief sets how many input check results are kept in memory
+     *
+     * @param entries the max number of results kept, 0 to disable the cache
+     */
+    void set_input_cache_size(size_t entries);
+
+    /**
+     * @brief appends the approximate memory use of the pool's in-memory indexes and caches
+     *
+     * @param usage return-by-reference the list to append to
+     */
+    void get_memory_usage(std::vector<tools::memory_usage> &usage) const;
+
+    /**
+     * @brief sets where the key image index is saved at deinit and reloaded at init
+     *
+     * At init, the saved index is only used if the pool in the database is
+     * still the one it was saved for, which saves parsing every pool tx.
+     *
+     * @param path the file to use, empty to always rebuild the index
+     */
+    void set_index_checkpoint_file(const std::string &path) { m_index_checkpoint_file = path; }
+
+    /**
+     * @brief sets how often a pool kept in memory only is written to the db
+     *
+     * The pool is also written when the db is closed. Does nothing unless
+     * the db was opened with DBF_TXPOOL_MEMORY.
+     *
+     * @param seconds the interval between snapshots, 0 to only write at deinit
+     */
+    void set_db_snapshot_interval(uint64_t seconds) { m_db_snapshot_interval = seconds; }
+
+    /**
+     * @brief writes a pool kept in memory only to the db
+     *
+     * @return false if the pool is not kept in memory, or on error
+     */
+    bool snapshot_to_db();
+
+    /**
+     * @brief sets callbacks to call when a transaction enters or leaves the pool
+     *
+     * The added callback gets the txid, weight and fee of each new pool tx;
+     * the removed callback gets the txid of each tx taken out for a block,
+     * pruned, timed out or dropped as invalid. Both run with the pool lock
+     * held, so they must not block or call back into the pool.
+     *
+     * @param added the callback to call when a tx is added
+     * @param removed the callback to call when a tx is removed
+     */
+    void set_tx_callbacks(const std::function<void(const crypto::hash&, uint64_t, uint64_t)> &added, const std::function<void(const crypto::hash&)> &removed) { m_tx_added_callback = added; m_tx_removed_callback = removed; }
+
+    /**
+     * @brief returns the transactions of blocks popped during a reorg to the pool
+     *
+     * Unlike add_tx, the inputs are not checked: the transactions were valid
+     * when mined, and are checked again once considered for a new block, so
+     * a reorg need not wait for their signatures.
+     *
+     * @param txs the transactions, without the miner transactions
+     * @param version the hard fork version once the reorg is done
+     */
+    void add_popped_txs(std::vector<transaction> &txs, uint8_t version);
+
+    /**
+     * @brief checks the inputs of a batch of relayed transactions ahead of add_tx
+     *
+     * The signature checks of the whole batch run in parallel, without the
+     * pool lock. The results go into the input cache, so the add_tx calls
+     * that follow only need to look them up.
+     *
+     * @param txes the transactions, with their hashes and weights
+     * @param version the current hard fork version
+     */
+    void precheck_tx_inputs(const std::vector<std::tuple<transaction*, crypto::hash, size_t>> &txes, uint8_t version);
+
 #define CURRENT_MEMPOOL_ARCHIVE_VER    11
 #define CURRENT_MEMPOOL_TX_DETAILS_ARCHIVE_VER    13
 
@@ -485,6 +615,57 @@ namespace cryptonote
      */
     bool remove_transaction_keyimages(const transaction_prefix& tx, const crypto::hash &txid);
 
+    /**
+     * @brief forget a transaction's spent key images, without the transaction
+     *
+     * Uses the key images recorded when the transaction was added, so the
+     * transaction need not be read and parsed again.
+     *
+     * @param txid the transaction's hash
+     *
+     * @return false if any key images to be removed cannot be found, otherwise true
+     */
+    bool remove_transaction_keyimages(const crypto::hash &txid);
+
+    /**
+     * @brief forget one of a transaction's spent key images
+     *
+     * The caller holds m_spent_key_images_lock.
+     *
+     * @return false if the key image, or the tx for it, cannot be found
+     */
+    bool remove_key_image(const crypto::key_image &k_image, const crypto::hash &txid);
+
+    /**
+     * @brief records a tx's metadata for get_transaction_stats and get_transaction_backlog
+     *
+     * Called when a tx enters the pool or its metadata changes.
+     */
+    void add_tx_stats(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief forgets a tx's metadata recorded by add_tx_stats
+     */
+    void remove_tx_stats(const crypto::hash &txid);
+
+    //! what the relay schedule needs of a relayable tx
+    struct relay_schedule_entry
+    {
+      time_t bucket;  //!< the m_relay_schedule bucket the tx is in
+      time_t last_relayed_time;
+      time_t receive_time;
+      bool kept_by_block;
+    };
+
+    /**
+     * @brief (re)files a tx in the relay schedule bucket for its due time, m_tx_stats_lock held
+     *
+     * @param txid the tx
+     * @param e its relay schedule entry, bucket is updated
+     * @param due the earliest time the tx may be due for relay
+     */
+    void schedule_relay(const crypto::hash &txid, relay_schedule_entry &e, time_t due) const;
+
     /**
      * @brief check if any of a transaction's spent key images are present in a given set
      *
@@ -529,6 +710,74 @@ namespace cryptonote
      */
     void prune(size_t bytes = 0);
 
+    //! what read-only queries about pool membership need, built once per pool change
+    struct pool_snapshot
+    {
+      struct entry
+      {
+        crypto::hash txid;
+        uint64_t weight;
+        uint64_t fee;
+        time_t receive_time;
+        bool do_not_relay;
+      };
+      uint64_t cookie;
+      std::vector<entry> txes;
+    };
+
+    /**
+     * @brief get a snapshot of the pool, rebuilding it if the pool changed
+     *
+     * Readers that get a current snapshot do not take the pool lock.
+     *
+     * @return the snapshot
+     */
+    std::shared_ptr<const pool_snapshot> get_snapshot() const;
+
+    /**
+     * @brief get a pool transaction, parsing it only if it is not cached
+     *
+     * @param txid the transaction's hash
+     * @param tx return-by-reference the transaction
+     * @param txblob the transaction's blob if the caller has it, or NULL to read it from the db
+     *
+     * @return true on success, false if the tx could not be read or parsed
+     */
+    bool get_parsed_tx(const crypto::hash &txid, transaction &tx, const cryptonote::blobdata *txblob = NULL) const;
+
+    /**
+     * @brief drop a transaction from the parsed tx cache
+     *
+     * @param txid the transaction's hash
+     */
+    void remove_parsed_tx(const crypto::hash &txid) const;
+
+    //! what fill_block_template learnt about a pool tx, valid until the top block changes
+    struct block_template_candidate
+    {
+      uint64_t weight;
+      uint64_t fee;
+      bool checked;  //!< whether ready and key_images are set yet
+      bool ready;
+      std::vector<crypto::key_image> key_images;
+    };
+
+    //! the last block template, and the per tx data used to build it
+    struct block_template_cache
+    {
+      crypto::hash top_block_id;
+      uint64_t cookie;
+      size_t median_weight;
+      uint64_t already_generated_coins;
+      uint8_t version;
+      bool valid;  //!< whether the fields below match the fields above
+      std::vector<crypto::hash> tx_hashes;
+      size_t total_weight;
+      uint64_t fee;
+      uint64_t expected_reward;
+      std::unordered_map<crypto::hash, block_template_candidate> candidates;
+    };
+
     //TODO: confirm the below comments and investigate whether or not this
     //      is the desired behavior
     //! map key images to transactions which spent them
@@ -538,7 +787,9 @@ namespace cryptonote
      *  transaction on the assumption that the original will not be in a
      *  block again.
      */
-    typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
+    //! a key image is nearly always spent by a single pool tx, so its txes are
+    //! kept in a plain vector next to it rather than in a set of their own
+    typedef tools::flat_hash_map<crypto::key_image, std::vector<crypto::hash>> key_images_container;
 
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
 public:
@@ -551,9 +802,64 @@ private:
     //! container for spent key images from the transactions in the pool
     key_images_container m_spent_key_images;  
 
+    //! lets key image lookups run without the pool lock, changes take both
+    mutable boost::shared_mutex m_spent_key_images_lock;
+
+    //! the key images each pool tx spends, so removing it needs no parsing
+    struct tx_key_images
+    {
+      std::vector<crypto::key_image> key_images;
+      bool kept_by_block;
+    };
+    tools::flat_hash_map<crypto::hash, tx_key_images> m_tx_key_images;  //!< changes take m_spent_key_images_lock too
+
+    std::atomic<uint64_t> m_pruned_txes;  //!< txes evicted by prune since startup
+    std::atomic<uint64_t> m_pruned_bytes;  //!< their total weight
+
+    //! what the stats and backlog queries need of each tx, kept up to date
+    //! as txes come, go and change, so those need neither the db nor the pool lock
+    struct tx_stats_entry
+    {
+      crypto::hash txid;
+      uint64_t weight;
+      uint64_t fee;
+      time_t receive_time;
+      bool relayed;
+      bool do_not_relay;
+      bool failing;
+      bool double_spend_seen;
+    };
+    struct tx_stats_totals
+    {
+      uint64_t txs = 0;
+      uint64_t bytes = 0;
+      uint64_t fees = 0;
+      uint64_t not_relayed = 0;
+      uint64_t failing = 0;
+      uint64_t double_spends = 0;
+    };
+    mutable boost::mutex m_tx_stats_lock;  //!< lock for the m_tx_stats* members only
+    std::vector<tx_stats_entry> m_tx_stats;
+    tools::flat_hash_map<crypto::hash, size_t> m_tx_stats_index;  //!< txid -> index in m_tx_stats
+    tx_stats_totals m_tx_stats_totals[2];  //!< over all txes, and over relayable ones
+
+    //! adds (sign 1) or removes (sign -1) an entry from the running totals, m_tx_stats_lock held
+    void update_tx_stats_totals(const tx_stats_entry &e, int sign);
+
+    //! relayable txes by due time bucket, so a relay tick only looks at the
+    //! txes that are due. A tx is only in the bucket its m_relay_due entry
+    //! names, copies left in other buckets are skipped. Both take m_tx_stats_lock.
+    mutable std::map<time_t, std::vector<crypto::hash>> m_relay_schedule;
+    mutable tools::flat_hash_map<crypto::hash, relay_schedule_entry> m_relay_due;
+
+    mutable boost::mutex m_snapshot_lock;  //!< lock for m_snapshot only
+    mutable std::shared_ptr<const pool_snapshot> m_snapshot;  //!< last snapshot built, if any
+
     //TODO: this time should be a named constant somewhere, not hard-coded
     //! interval on which to check for stale/"stuck" transactions
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
+    uint64_t m_db_snapshot_interval; //!< seconds between snapshots of a pool kept in memory, 0 for none
+    time_t m_last_db_snapshot;
 
     //TODO: look into doing this better
     //!< container for transactions organized by fee per size and receive time
@@ -561,6 +867,40 @@ private:
 
     std::atomic<uint64_t> m_cookie; //!< incremented at each change
 
+    /**
+     * @brief records a tx entering or leaving the pool for get_transaction_changes
+     *
+     * @param txid the tx
+     * @param added true if it entered the pool, false if it left
+     * @param do_not_relay whether the tx is not to be relayed
+     */
+    void add_pool_change(const crypto::hash &txid, bool added, bool do_not_relay);
+
+    //! a tx entering or leaving the pool
+    struct pool_change
+    {
+      uint64_t cookie; //!< m_cookie when the change was made
+      crypto::hash txid;
+      bool added;
+      bool do_not_relay;
+    };
+    std::deque<pool_change> m_pool_changes; //!< most recent changes, oldest first
+    uint64_t m_pool_changes_start; //!< m_pool_changes has every change made at or after this cookie
+    uint64_t m_pool_instance; //!< random, so cookies from before a restart are not mistaken for current ones
+
+    block_template_cache m_block_template_cache; //!< reused by fill_block_template while the pool and top block are unchanged
+
+    //! parsed txes, most recently used first, so most pool operations do not deserialize again
+    typedef std::list<std::pair<crypto::hash, transaction>> parsed_tx_list;
+    mutable boost::mutex m_parsed_tx_cache_lock;  //!< lock for the parsed tx cache only
+    size_t m_parsed_tx_cache_max;  //!< max number of entries in m_parsed_txes
+    mutable parsed_tx_list m_parsed_txes;
+    mutable std::unordered_map<crypto::hash, parsed_tx_list::iterator> m_parsed_tx_index;
+    mutable std::atomic<uint64_t> m_parsed_tx_cache_hits;
+    mutable std::atomic<uint64_t> m_parsed_tx_cache_misses;
+
+    std::string m_index_checkpoint_file; //!< where m_spent_key_images is saved at deinit, if set
+
     /**
      * @brief get an iterator to a transaction in the sorted container
      *
@@ -570,6 +910,44 @@ private:
      */
     sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id) const;
 
+    /**
+     * @brief get an iterator to a transaction in the sorted container
+     *
+     * Looks the transaction up by the key it was sorted by, rather than
+     * walking the whole container.
+     *
+     * @param id the hash of the transaction to look for
+     * @param meta the transaction's pool metadata
+     *
+     * @return an iterator, possibly to the end of the container if not found
+     */
+    sorted_tx_container::iterator find_tx_in_sorted_container(const crypto::hash& id, const txpool_tx_meta_t& meta) const;
+
+    /**
+     * @brief hashes the ids and metadata of all txes in the pool database
+     *
+     * @param digest return-by-reference the digest
+     *
+     * @return true on success
+     */
+    bool get_pool_digest(crypto::hash &digest) const;
+
+    /**
+     * @brief rebuilds m_spent_key_images from the index saved at the last deinit
+     *
+     * @return true if the saved index matched the pool and was used
+     */
+    bool load_index_checkpoint();
+
+    /**
+     * @brief whether a tx passes the checks add_tx does before checking inputs
+     *
+     * Used to avoid checking the inputs of txes add_tx would reject anyway.
+     *
+     * @return true if the tx is worth checking the inputs of
+     */
+    bool passes_cheap_checks(const transaction &tx, const crypto::hash &id, size_t tx_weight, uint8_t version) const;
+
     //! cache/call Blockchain::check_tx_inputs results
     bool check_tx_inputs(const std::function<cryptonote::transaction&(void)> &get_tx, const crypto::hash &txid, uint64_t &max_used_block_height, crypto::hash &max_used_block_id, tx_verification_context &tvc, bool kept_by_block = false) const;
 
@@ -584,7 +962,15 @@ private:
     size_t m_txpool_max_weight;
     size_t m_txpool_weight;
 
+    std::function<void(const crypto::hash&, uint64_t, uint64_t)> m_tx_added_callback;
+    std::function<void(const crypto::hash&)> m_tx_removed_callback;
+
     mutable std::unordered_map<crypto::hash, std::tuple<bool, tx_verification_context, uint64_t, crypto::hash>> m_input_cache;
+    size_t m_input_cache_max;  //!< max number of entries in m_input_cache, arbitrary ones are dropped past that
+    mutable boost::mutex m_input_cache_lock;  //!< input checks can run without the pool lock
+    uint64_t m_input_cache_generation;  //!< incremented when the chain changes, to drop results computed before
+    mutable std::atomic<uint64_t> m_input_cache_hits;
+    mutable std::atomic<uint64_t> m_input_cache_misses;
   };
 }
 
@@ -55,7 +55,23 @@ void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_comp
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
-  blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
+  const size_t nblocks = bcel.size();
+  if (blocks.insert(span(height, std::move(bcel), connection_id, rate, size)).second)
+    data_size += size;
+  // same pseudo average as get_speed: the latest measurement weighs most
+  if (rate > 0)
+  {
+    std::unordered_map<boost::uuids::uuid, float, boost::hash<boost::uuids::uuid>>::iterator i = peer_rates.find(connection_id);
+    if (i == peer_rates.end())
+      peer_rates.insert(std::make_pair(connection_id, rate));
+    else
+      i->second = (i->second + rate) / 2;
+  }
+  if (nblocks > 0)
+  {
+    const float block_size = size / (float)nblocks;
+    average_block_size = average_block_size > 0 ? (average_block_size + block_size) / 2 : block_size;
+  }
   if (has_hashes)
   {
     for (const crypto::hash &h: hashes)
@@ -90,6 +106,7 @@ void block_queue::erase_block(block_map::iterator j)
   CHECK_AND_ASSERT_THROW_MES(j != blocks.end(), "Invalid iterator");
   for (const crypto::hash &h: j->hashes)
     requested_hashes.erase(h);
+  data_size -= j->size;
   blocks.erase(j);
 }
 
@@ -107,6 +124,13 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
       erase_block(j);
     }
   }
+  for (auto r = peer_rates.begin(); r != peer_rates.end(); )
+  {
+    if (live_connections.find(r->first) == live_connections.end())
+      r = peer_rates.erase(r);
+    else
+      ++r;
+  }
 }
 
 bool block_queue::remove_span(uint64_t start_block_height, std::vector<crypto::hash> *hashes)
@@ -271,7 +295,8 @@ void block_queue::set_span_hashes(uint64_t start_height, const boost::uuids::uui
       s.hashes = std::move(hashes);
       for (const crypto::hash &h: s.hashes)
         requested_hashes.insert(h);
-      blocks.insert(s);
+      if (blocks.insert(s).second)
+        data_size += s.size;
       return;
     }
   }
@@ -298,6 +323,20 @@ bool block_queue::get_next_span(uint64_t &height, std::vector<cryptonote::block_
   return false;
 }
 
+bool block_queue::get_filled_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  for (const span &s: blocks)
+  {
+    if (s.start_block_height == height && !s.blocks.empty() && !is_blockchain_placeholder(s))
+    {
+      bcel = s.blocks;
+      return true;
+    }
+  }
+  return false;
+}
+
 bool block_queue::has_next_span(const boost::uuids::uuid &connection_id, bool &filled) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
@@ -317,10 +356,7 @@ bool block_queue::has_next_span(const boost::uuids::uuid &connection_id, bool &f
 size_t block_queue::get_data_size() const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
-  size_t size = 0;
-  for (const auto &span: blocks)
-    size += span.size;
-  return size;
+  return data_size;
 }
 
 size_t block_queue::get_num_filled_spans_prefix() const
@@ -416,6 +452,43 @@ float block_queue::get_speed(const boost::uuids::uuid &connection_id) const
   return speed;
 }
 
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t min_blocks, uint64_t max_blocks, float target_seconds) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_rates.find(connection_id);
+  if (i == peer_rates.end() || average_block_size <= 0)
+    return max_blocks; // not measured yet, use the full span
+  // as many blocks as this peer is expected to send within the target time
+  const float nblocks = i->second * target_seconds / average_block_size;
+  if (nblocks <= min_blocks)
+    return min_blocks;
+  if (nblocks >= max_blocks)
+    return max_blocks;
+  return nblocks;
+}
+
+uint64_t block_queue::get_expected_download_time(const boost::uuids::uuid &connection_id, uint64_t nblocks) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_rates.find(connection_id);
+  if (i == peer_rates.end() || i->second <= 0 || average_block_size <= 0)
+    return 0;
+  return nblocks * average_block_size * 1e6 / i->second;
+}
+
+size_t block_queue::get_inflight_size() const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  uint64_t nblocks = 0;
+  block_map::const_iterator i = blocks.begin();
+  if (i != blocks.end() && is_blockchain_placeholder(*i))
+    ++i;
+  for (; i != blocks.end(); ++i)
+    if (i->blocks.empty())
+      nblocks += i->nblocks;
+  return nblocks * average_block_size;
+}
+
 bool block_queue::foreach(std::function<bool(const span&)> f, bool include_blockchain_placeholder) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
@@ -34,6 +34,8 @@
 #include <vector>
 #include <set>
 #include <unordered_set>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <boost/uuid/uuid.hpp>
 
@@ -83,6 +85,7 @@ namespace cryptonote
     std::pair<uint64_t, uint64_t> get_next_span_if_scheduled(std::vector<crypto::hash> &hashes, boost::uuids::uuid &connection_id, boost::posix_time::ptime &time) const;
     void set_span_hashes(uint64_t start_height, const boost::uuids::uuid &connection_id, std::vector<crypto::hash> hashes);
     bool get_next_span(uint64_t &height, std::vector<cryptonote::block_complete_entry> &bcel, boost::uuids::uuid &connection_id, bool filled = true) const;
+    bool get_filled_span(uint64_t height, std::vector<cryptonote::block_complete_entry> &bcel) const;
     bool has_next_span(const boost::uuids::uuid &connection_id, bool &filled) const;
     size_t get_data_size() const;
     size_t get_num_filled_spans_prefix() const;
@@ -92,6 +95,9 @@ namespace cryptonote
     float get_speed(const boost::uuids::uuid &connection_id) const;
     bool foreach(std::function<bool(const span&)> f, bool include_blockchain_placeholder = false) const;
     bool requested(const crypto::hash &hash) const;
+    uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t min_blocks, uint64_t max_blocks, float target_seconds) const;
+    uint64_t get_expected_download_time(const boost::uuids::uuid &connection_id, uint64_t nblocks) const;
+    size_t get_inflight_size() const;
 
   private:
     void erase_block(block_map::iterator j);
@@ -101,5 +107,11 @@ namespace cryptonote
     block_map blocks;
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
+    // bytes of block and tx blobs in the filled spans, kept as spans come and go
+    size_t data_size = 0;
+    // download rate in bytes/sec per peer, and average block size, both kept
+    // past the lifetime of the spans they were measured on
+    std::unordered_map<boost::uuids::uuid, float, boost::hash<boost::uuids::uuid>> peer_rates;
+    float average_block_size = 0.0f;
   };
 }
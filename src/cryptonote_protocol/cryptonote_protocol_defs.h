@@ -104,6 +104,60 @@ namespace cryptonote
     END_KV_SERIALIZE_MAP()
   };
 
+  /************************************************************************/
+  /* Levin traffic and timings for a command, serializable to json        */
+  /************************************************************************/
+  struct levin_command_stats
+  {
+    uint32_t command;
+    std::string name;
+
+    uint64_t packets_in;
+    uint64_t bytes_in;
+    uint64_t packets_out;
+    uint64_t bytes_out;
+
+    // requests and notifications received, and the time spent handling them
+    uint64_t handled;
+    uint64_t handler_time_us;
+
+    // requests sent and answered, and the time until the answer came
+    uint64_t invokes;
+    uint64_t invoke_time_us;
+    uint64_t invoke_timeouts;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(command)
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(packets_in)
+      KV_SERIALIZE(bytes_in)
+      KV_SERIALIZE(packets_out)
+      KV_SERIALIZE(bytes_out)
+      KV_SERIALIZE(handled)
+      KV_SERIALIZE(handler_time_us)
+      KV_SERIALIZE(invokes)
+      KV_SERIALIZE(invoke_time_us)
+      KV_SERIALIZE(invoke_timeouts)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct connection_levin_stats
+  {
+    std::string connection_id;
+    std::string address;
+    std::string peer_id;
+    bool incoming;
+    std::vector<levin_command_stats> commands;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(connection_id)
+      KV_SERIALIZE(address)
+      KV_SERIALIZE(peer_id)
+      KV_SERIALIZE(incoming)
+      KV_SERIALIZE(commands)
+    END_KV_SERIALIZE_MAP()
+  };
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -199,12 +253,14 @@ namespace cryptonote
     uint64_t cumulative_difficulty;
     crypto::hash  top_id;
     uint8_t top_version;
+    uint32_t pruning_seed;
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(current_height)
       KV_SERIALIZE(cumulative_difficulty)
       KV_SERIALIZE_VAL_POD_AS_BLOB(top_id)
       KV_SERIALIZE_OPT(top_version, (uint8_t)0)
+      KV_SERIALIZE_OPT(pruning_seed, (uint32_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -215,9 +271,11 @@ namespace cryptonote
     struct request
     {
       std::list<crypto::hash> block_ids; /*IDs of the first 10 blocks are sequential, next goes with pow(2,n) offset, like 2, 4, 8, 16, 32, 64 and so on, and the last one is always genesis block */
+      bool headers; // ask for the block headers along with the ids
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
+        KV_SERIALIZE_OPT(headers, false)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -232,12 +290,14 @@ namespace cryptonote
       uint64_t total_height;
       uint64_t cumulative_difficulty;
       std::vector<crypto::hash> m_block_ids;
+      std::vector<blobdata> m_block_headers; // hashing blobs of the first m_block_ids, if asked for
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(start_height)
         KV_SERIALIZE(total_height)
         KV_SERIALIZE(cumulative_difficulty)
         KV_SERIALIZE_CONTAINER_POD_AS_BLOB(m_block_ids)
+        KV_SERIALIZE(m_block_headers)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -281,5 +341,39 @@ namespace cryptonote
       END_KV_SERIALIZE_MAP()
     };
   }; 
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_TRANSACTION_HASHES
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TRANSACTIONS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
     
 }
@@ -36,7 +36,14 @@
 #pragma once
 
 #include <boost/program_options/variables_map.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+#include <functional>
+#include <memory>
 #include <string>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -46,7 +53,11 @@
 #include "block_queue.h"
 #include "cryptonote_basic/connection_context.h"
 #include "cryptonote_basic/cryptonote_stat_info.h"
+#include "common/memory_usage.h"
+#include "common/command_line.h"
 #include <boost/circular_buffer.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/functional/hash.hpp>
 
 PUSH_WARNINGS
 DISABLE_VS_WARNINGS(4355)
@@ -55,6 +66,7 @@ DISABLE_VS_WARNINGS(4355)
 
 namespace cryptonote
 {
+  extern const command_line::arg_descriptor<size_t> arg_block_download_max_size;
 
 	class cryptonote_protocol_handler_base_pimpl;
 	class cryptonote_protocol_handler_base {
@@ -81,6 +93,7 @@ namespace cryptonote
     typedef CORE_SYNC_DATA payload_type;
 
     t_cryptonote_protocol_handler(t_core& rcore, nodetool::i_p2p_endpoint<connection_context>* p_net_layout, bool offline = false);
+    ~t_cryptonote_protocol_handler();
 
     BEGIN_INVOKE_MAP2(cryptonote_protocol_handler)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_BLOCK, &cryptonote_protocol_handler::handle_notify_new_block)
@@ -91,9 +104,12 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTION_HASHES, &cryptonote_protocol_handler::handle_notify_new_transaction_hashes)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TRANSACTIONS, &cryptonote_protocol_handler::handle_request_transactions)
     END_INVOKE_MAP2()
 
     bool on_idle();
+    static void init_options(boost::program_options::options_description& desc);
     bool init(const boost::program_options::variables_map& vm);
     bool deinit();
     void set_p2p_endpoint(nodetool::i_p2p_endpoint<connection_context>* p2p);
@@ -107,19 +123,30 @@ namespace cryptonote
     bool is_synchronized(){return m_synchronized;}
     void log_connections();
     std::list<connection_info> get_connections();
+    std::list<connection_levin_stats> get_connection_levin_stats();
+    static std::vector<levin_command_stats> get_levin_command_stats();
+    static const char *get_levin_command_name(uint32_t command);
     const block_queue &get_block_queue() const { return m_block_queue; }
+    void get_block_queue_watermarks(size_t &high, size_t &low, bool &paused) const;
+    void get_memory_usage(std::vector<tools::memory_usage> &usage) const;
     void stop();
     void on_connection_close(cryptonote_connection_context &context);
   private:
+    static std::vector<levin_command_stats> to_levin_command_stats(const std::vector<epee::levin::command_stats_snapshot> &snapshot);
+
     //----------------- commands handlers ----------------------------------------------
     int handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
     int handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context);
+    void serve_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context);
     int handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request& arg, cryptonote_connection_context& context);
     int handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context);
+    void serve_chain(NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context);
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context);
+    int handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -130,9 +157,15 @@ namespace cryptonote
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
     bool should_download_next_span(cryptonote_connection_context& context) const;
+    bool has_unpruned_span(const cryptonote_connection_context& context, const std::pair<uint64_t, uint64_t> &span) const;
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     bool kick_idle_peers();
     int try_add_next_blocks(cryptonote_connection_context &context);
+    void flush_tx_announcements();
+    void notify_block_queue_changed();
+    template<class t_request>
+    bool post_request(t_request& arg, cryptonote_connection_context& context, void (t_cryptonote_protocol_handler::*serve)(t_request&, cryptonote_connection_context&));
+    void stop_request_threads();
 
     t_core& m_core;
 
@@ -145,6 +178,49 @@ namespace cryptonote
     block_queue m_block_queue;
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
 
+    // wakes connections waiting in standby for room in the block queue
+    boost::mutex m_block_queue_wait_lock;
+    boost::condition_variable m_block_queue_changed;
+    uint64_t m_block_queue_events;
+
+    // block requests pause when the queued and requested bytes reach the high
+    // watermark, and resume once back under the low one
+    size_t m_block_queue_high_watermark;
+    size_t m_block_queue_low_watermark;
+    std::atomic<bool> m_block_queue_paused;
+
+    // requests which read and serialize a lot are served here, so the
+    // network io threads stay free for other connections
+    boost::asio::io_service m_request_service;
+    boost::thread_group m_request_threads;
+    std::unique_ptr<boost::asio::io_service::work> m_request_work;
+    boost::mutex m_request_lock;
+    std::atomic<unsigned> m_pending_requests;
+
+    // txids announced to and by peers which take NOTIFY_NEW_TRANSACTION_HASHES
+    struct peer_tx_inventory
+    {
+      std::unordered_set<crypto::hash> known; //!< txes the peer has or was told about
+      std::deque<crypto::hash> known_order;
+      std::vector<crypto::hash> pending; //!< txids for the next announcement
+      boost::posix_time::ptime next_announce;
+
+      void add_known(const crypto::hash &txid)
+      {
+        if (!known.insert(txid).second)
+          return;
+        known_order.push_back(txid);
+        while (known_order.size() > P2P_TX_KNOWN_PER_PEER)
+        {
+          known.erase(known_order.front());
+          known_order.pop_front();
+        }
+      }
+    };
+    boost::mutex m_tx_inventory_lock;
+    std::unordered_map<boost::uuids::uuid, peer_tx_inventory, boost::hash<boost::uuids::uuid>> m_tx_inventory;
+    std::unordered_map<crypto::hash, boost::posix_time::ptime> m_requested_txes; //!< asked for, not yet timed out
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
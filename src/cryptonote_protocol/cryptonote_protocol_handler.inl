@@ -41,6 +41,7 @@
 #include <ctime>
 
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "common/pruning.h"
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 
@@ -49,9 +50,12 @@
 
 #define MLOG_P2P_MESSAGE(x) MCINFO("net.p2p.msg", context << x)
 
-#define BLOCK_QUEUE_NBLOCKS_THRESHOLD 10 // chunks of N blocks
-#define BLOCK_QUEUE_SIZE_THRESHOLD (100*1024*1024) // MB
+#define BLOCK_QUEUE_LOW_WATERMARK_PERCENT 75 // of the high watermark, so requests do not flap on and off around it
 #define REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD (5 * 1000000) // microseconds
+#define REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD_MIN (1 * 1000000) // microseconds
+#define REQUEST_NEXT_SCHEDULED_SPAN_STALL_FACTOR 3 // times the expected download time
+#define BLOCK_QUEUE_SPAN_TARGET_TIME 3.0f // seconds
+#define BLOCK_QUEUE_STANDBY_RECHECK_TIME 5000 // milliseconds, standby connections are woken earlier when the queue changes
 #define IDLE_PEER_KICK_TIME (600 * 1000000) // microseconds
 #define PASSIVE_PEER_KICK_TIME (60 * 1000000) // microseconds
 
@@ -66,7 +70,12 @@ namespace cryptonote
                                                                                                               m_p2p(p_net_layout),
                                                                                                               m_syncronized_connections_count(0),
                                                                                                               m_synchronized(offline),
-                                                                                                              m_stopping(false)
+                                                                                                              m_stopping(false),
+                                                                                                              m_block_queue_events(0),
+                                                                                                              m_block_queue_high_watermark(BLOCK_QUEUE_DEFAULT_MAX_SIZE),
+                                                                                                              m_block_queue_low_watermark(BLOCK_QUEUE_DEFAULT_MAX_SIZE / 100 * BLOCK_QUEUE_LOW_WATERMARK_PERCENT),
+                                                                                                              m_block_queue_paused(false),
+                                                                                                              m_pending_requests(0)
 
   {
     if(!m_p2p)
@@ -74,14 +83,41 @@ namespace cryptonote
   }
   //-----------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  t_cryptonote_protocol_handler<t_core>::~t_cryptonote_protocol_handler()
+  {
+    m_stopping = true;
+    stop_request_threads();
+  }
+  //-----------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::init_options(boost::program_options::options_description& desc)
+  {
+    command_line::add_arg(desc, arg_block_download_max_size);
+  }
+  //-----------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::init(const boost::program_options::variables_map& vm)
   {
+    if (command_line::has_arg(vm, arg_block_download_max_size))
+    {
+      m_block_queue_high_watermark = command_line::get_arg(vm, arg_block_download_max_size);
+      m_block_queue_low_watermark = m_block_queue_high_watermark / 100 * BLOCK_QUEUE_LOW_WATERMARK_PERCENT;
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_request_lock);
+    if (!m_request_work)
+    {
+      m_request_work.reset(new boost::asio::io_service::work(m_request_service));
+      for (unsigned n = 0; n < P2P_REQUEST_THREADS; ++n)
+        m_request_threads.create_thread(boost::bind(&boost::asio::io_service::run, &m_request_service));
+    }
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::deinit()
   {
+    stop_request_threads();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -105,6 +141,7 @@ namespace cryptonote
     {
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
+      r.headers = true;
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
       post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
     }
@@ -258,6 +295,105 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  const char *t_cryptonote_protocol_handler<t_core>::get_levin_command_name(uint32_t command)
+  {
+    switch (command)
+    {
+      case P2P_COMMANDS_POOL_BASE + 1: return "handshake";
+      case P2P_COMMANDS_POOL_BASE + 2: return "timed_sync";
+      case P2P_COMMANDS_POOL_BASE + 3: return "ping";
+      case P2P_COMMANDS_POOL_BASE + 4: return "request_stat_info";
+      case P2P_COMMANDS_POOL_BASE + 5: return "request_network_state";
+      case P2P_COMMANDS_POOL_BASE + 6: return "request_peer_id";
+      case P2P_COMMANDS_POOL_BASE + 7: return "request_support_flags";
+      case NOTIFY_NEW_BLOCK::ID: return "new_block";
+      case NOTIFY_NEW_TRANSACTIONS::ID: return "new_transactions";
+      case NOTIFY_REQUEST_GET_OBJECTS::ID: return "request_get_objects";
+      case NOTIFY_RESPONSE_GET_OBJECTS::ID: return "response_get_objects";
+      case NOTIFY_REQUEST_CHAIN::ID: return "request_chain";
+      case NOTIFY_RESPONSE_CHAIN_ENTRY::ID: return "response_chain_entry";
+      case NOTIFY_NEW_FLUFFY_BLOCK::ID: return "new_fluffy_block";
+      case NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID: return "request_fluffy_missing_tx";
+      case NOTIFY_NEW_TRANSACTION_HASHES::ID: return "new_transaction_hashes";
+      case NOTIFY_REQUEST_TRANSACTIONS::ID: return "request_transactions";
+      default: return "unknown";
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  std::vector<levin_command_stats> t_cryptonote_protocol_handler<t_core>::to_levin_command_stats(const std::vector<epee::levin::command_stats_snapshot> &snapshot)
+  {
+    std::vector<levin_command_stats> stats;
+    stats.reserve(snapshot.size());
+    for (const auto &s: snapshot)
+    {
+      levin_command_stats cs;
+      cs.command = s.command;
+      cs.name = get_levin_command_name(s.command);
+      cs.packets_in = s.packets_in;
+      cs.bytes_in = s.bytes_in;
+      cs.packets_out = s.packets_out;
+      cs.bytes_out = s.bytes_out;
+      cs.handled = s.handled;
+      cs.handler_time_us = s.handler_ns / 1000;
+      cs.invokes = s.invokes;
+      cs.invoke_time_us = s.invoke_ns / 1000;
+      cs.invoke_timeouts = s.invoke_timeouts;
+      stats.push_back(cs);
+    }
+    return stats;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  std::vector<levin_command_stats> t_cryptonote_protocol_handler<t_core>::get_levin_command_stats()
+  {
+    return to_levin_command_stats(epee::levin::snapshot_command_stats(epee::levin::get_command_stats(), LEVIN_COMMAND_STATS_SLOTS));
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  std::list<connection_levin_stats> t_cryptonote_protocol_handler<t_core>::get_connection_levin_stats()
+  {
+    std::list<connection_levin_stats> connections;
+
+    m_p2p->for_each_connection_command_stats([&](const connection_context& cntxt, nodetool::peerid_type peer_id, const std::vector<epee::levin::command_stats_snapshot>& stats)
+    {
+      connection_levin_stats cnx;
+      cnx.connection_id = epee::string_tools::pod_to_hex(cntxt.m_connection_id);
+      cnx.address = cntxt.m_remote_address.str();
+      std::stringstream peer_id_str;
+      peer_id_str << std::hex << std::setw(16) << peer_id;
+      peer_id_str >> cnx.peer_id;
+      cnx.incoming = cntxt.m_is_income;
+      cnx.commands = to_levin_command_stats(stats);
+      connections.push_back(std::move(cnx));
+      return true;
+    });
+
+    return connections;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::get_memory_usage(std::vector<tools::memory_usage> &usage) const
+  {
+    // downloaded blocks waiting to be added, the high watermark stops further requests rather than evicting
+    uint64_t nblocks = 0, bytes = 0;
+    m_block_queue.foreach([&](const block_queue::span &span) {
+      nblocks += span.blocks.size();
+      bytes += span.size + span.hashes.size() * sizeof(crypto::hash);
+      return true;
+    });
+    usage.push_back({"protocol.block_queue", nblocks, bytes, 0, m_block_queue_high_watermark});
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::get_block_queue_watermarks(size_t &high, size_t &low, bool &paused) const
+  {
+    high = m_block_queue_high_watermark;
+    low = m_block_queue_low_watermark;
+    paused = m_block_queue_paused;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::process_payload_sync_data(const CORE_SYNC_DATA& hshd, cryptonote_connection_context& context, bool is_inital)
   {
     if(context.m_state == cryptonote_connection_context::state_before_handshake && !is_inital)
@@ -281,6 +417,7 @@ namespace cryptonote
     }
 
     context.m_remote_blockchain_height = hshd.current_height;
+    context.m_pruning_seed = hshd.pruning_seed;
 
     uint64_t target = m_core.get_target_blockchain_height();
     if (target == 0)
@@ -328,6 +465,7 @@ namespace cryptonote
     hshd.top_version = m_core.get_ideal_hard_fork_version(hshd.current_height);
     hshd.cumulative_difficulty = m_core.get_block_cumulative_difficulty(hshd.current_height);
     hshd.current_height +=1;
+    hshd.pruning_seed = m_core.get_blockchain_pruning_seed();
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -355,10 +493,11 @@ namespace cryptonote
     std::vector<block_complete_entry> blocks;
     blocks.push_back(arg.b);
     m_core.prepare_handle_incoming_blocks(blocks);
-    for(auto tx_blob_it = arg.b.txs.begin(); tx_blob_it!=arg.b.txs.end();tx_blob_it++)
+    // all of the block's txes in one call, so their range proofs are batch verified
+    std::vector<cryptonote::tx_verification_context> tvcv;
+    m_core.handle_incoming_txs(arg.b.txs, tvcv, true, true, false);
+    for(const cryptonote::tx_verification_context &tvc: tvcv)
     {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx(*tx_blob_it, tvc, true, true, false);
       if(tvc.m_verifivation_failed)
       {
         LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
@@ -393,6 +532,7 @@ namespace cryptonote
       context.m_state = cryptonote_connection_context::state_synchronizing;
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
+      r.headers = true;
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
       post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
     }
@@ -660,6 +800,7 @@ namespace cryptonote
           context.m_state = cryptonote_connection_context::state_synchronizing;
           NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
           m_core.get_short_chain_history(r.block_ids);
+          r.headers = true;
           LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
           post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
         }            
@@ -775,19 +916,26 @@ namespace cryptonote
       return 1;
     }
 
+    // the whole relay batch in one call, so their range proofs are batch verified
+    std::vector<cryptonote::tx_verification_context> tvcv;
+    m_core.handle_incoming_txs(arg.txs, tvcv, false, true, false);
+    if (tvcv.size() != arg.txs.size())
+    {
+      LOG_ERROR_CCONTEXT("Internal error: tvc.size() != arg.txs.size()");
+      return 1;
+    }
+
     std::vector<cryptonote::blobdata> newtxs;
     newtxs.reserve(arg.txs.size());
     for (size_t i = 0; i < arg.txs.size(); ++i)
     {
-      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-      m_core.handle_incoming_tx(arg.txs[i], tvc, false, true, false);
-      if(tvc.m_verifivation_failed)
+      if(tvcv[i].m_verifivation_failed)
       {
         LOG_PRINT_CCONTEXT_L1("Tx verification failed, dropping connection");
         drop_connection(context, false, false);
         return 1;
       }
-      if(tvc.m_should_be_relayed)
+      if(tvcv[i].m_should_be_relayed)
         newtxs.push_back(std::move(arg.txs[i]));
     }
     arg.txs = std::move(newtxs);
@@ -802,22 +950,99 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTION_HASHES (" << arg.tx_hashes.size() << " txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new tx hashes while syncing, ignored");
+      return 1;
+    }
+    if (arg.tx_hashes.size() > P2P_MAX_TX_HASHES_PER_NOTIFY)
+    {
+      LOG_ERROR_CCONTEXT("Too many tx hashes announced (" << arg.tx_hashes.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    std::vector<crypto::hash> unknown;
+    unknown.reserve(arg.tx_hashes.size());
+    for (const crypto::hash &tx_hash : arg.tx_hashes)
+      if (!m_core.pool_has_tx(tx_hash))
+        unknown.push_back(tx_hash);
+
+    NOTIFY_REQUEST_TRANSACTIONS::request req;
+    {
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+      boost::unique_lock<boost::mutex> lock(m_tx_inventory_lock);
+      peer_tx_inventory &inv = m_tx_inventory[context.m_connection_id];
+      for (const crypto::hash &tx_hash : arg.tx_hashes)
+        inv.add_known(tx_hash);
+      // ask only one peer at a time for each tx
+      for (const crypto::hash &tx_hash : unknown)
+        if (m_requested_txes.emplace(tx_hash, now).second)
+          req.tx_hashes.push_back(tx_hash);
+    }
+
+    if (!req.tx_hashes.empty())
+    {
+      MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_TRANSACTIONS: " << req.tx_hashes.size() << " txes");
+      post_notify<NOTIFY_REQUEST_TRANSACTIONS>(req, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TRANSACTIONS (" << arg.tx_hashes.size() << " txes)");
+    if (arg.tx_hashes.size() > P2P_MAX_TX_HASHES_PER_NOTIFY)
+    {
+      LOG_ERROR_CCONTEXT("Too many txes requested (" << arg.tx_hashes.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    NOTIFY_NEW_TRANSACTIONS::request resp;
+    for (const crypto::hash &tx_hash : arg.tx_hashes)
+    {
+      cryptonote::blobdata tx_blob;
+      if (m_core.get_pool_transaction(tx_hash, tx_blob))
+        resp.txs.push_back(std::move(tx_blob));
+    }
+    if (!resp.txs.empty())
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(resp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
+    if (!post_request(arg, context, &t_cryptonote_protocol_handler<t_core>::serve_get_objects))
+      serve_get_objects(arg, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::serve_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
+  {
     NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
-    if(!m_core.handle_get_objects(arg, rsp, context))
+    std::string blob;
+    if(!m_core.handle_get_objects(arg, rsp, blob, context))
     {
       LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_GET_OBJECTS, dropping connection");
       drop_connection(context, false, false);
-      return 1;
+      return;
     }
-    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_GET_OBJECTS: blocks.size()=" << rsp.blocks.size() << ", txs.size()=" << rsp.txs.size()
-                            << ", rsp.m_current_blockchain_height=" << rsp.current_blockchain_height << ", missed_ids.size()=" << rsp.missed_ids.size());
-    post_notify<NOTIFY_RESPONSE_GET_OBJECTS>(rsp, context);
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_GET_OBJECTS: " << arg.blocks.size() << " blocks requested, txs.size()=" << rsp.txs.size()
+                            << ", rsp.m_current_blockchain_height=" << rsp.current_blockchain_height << ", missed_ids.size()=" << rsp.missed_ids.size() << ", " << blob.size() << " bytes");
+    LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] post " << typeid(NOTIFY_RESPONSE_GET_OBJECTS).name() << " -->");
+    m_p2p->invoke_notify_to_peer(NOTIFY_RESPONSE_GET_OBJECTS::ID, blob, context);
     //handler_response_blocks_now(sizeof(rsp)); // XXX
     //handler_response_blocks_now(200);
-    return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
 
@@ -959,6 +1184,7 @@ namespace cryptonote
       const float rate = size * 1e6 / (dt.total_microseconds() + 1);
       MDEBUG(context << " adding span: " << arg.blocks.size() << " at height " << start_height << ", " << dt.total_microseconds()/1e6 << " seconds, " << (rate/1e3) << " kB/s, size now " << (m_block_queue.get_data_size() + blocks_size) / 1048576.f << " MB");
       m_block_queue.add_blocks(start_height, arg.blocks, context.m_connection_id, rate, blocks_size);
+      m_p2p->add_peer_sync_rate(context, rate);
 
       context.m_last_known_hash = last_block_hash;
 
@@ -1050,10 +1276,24 @@ skip:
           const boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
           context.m_last_request_time = start;
 
-          m_core.prepare_handle_incoming_blocks(blocks);
+          std::vector<block> pblocks;
+          m_core.prepare_handle_incoming_blocks(blocks, pblocks);
+          if (!pblocks.empty() && pblocks.size() != blocks.size())
+          {
+            m_core.cleanup_handle_incoming_blocks();
+            LOG_ERROR_CCONTEXT("Internal error: blocks.size() != pblocks.size()");
+            return 1;
+          }
+
+          // hash the next span while this one gets verified and committed
+          {
+            std::vector<cryptonote::block_complete_entry> next_blocks;
+            if (m_block_queue.get_filled_span(start_height + blocks.size(), next_blocks))
+              m_core.prefetch_block_longhashes(next_blocks, start_height + blocks.size());
+          }
 
           uint64_t block_process_time_full = 0, transactions_process_time_full = 0;
-          size_t num_txs = 0;
+          size_t num_txs = 0, blockidx = 0;
           for(const block_complete_entry& block_entry: blocks)
           {
             if (m_stopping)
@@ -1103,7 +1343,7 @@ skip:
             TIME_MEASURE_START(block_process_time);
             block_verification_context bvc = boost::value_initialized<block_verification_context>();
 
-            m_core.handle_incoming_block(block_entry.block, bvc, false); // <--- process block
+            m_core.handle_incoming_block(block_entry.block, pblocks.empty() ? NULL : &pblocks[blockidx], bvc, false); // <--- process block
 
             if(bvc.m_verifivation_failed)
             {
@@ -1146,6 +1386,7 @@ skip:
 
             TIME_MEASURE_FINISH(block_process_time);
             block_process_time_full += block_process_time;
+            ++blockidx;
 
           } // each download block
 
@@ -1158,6 +1399,7 @@ skip:
           }
 
           m_block_queue.remove_spans(span_connection_id, start_height);
+          notify_block_queue_changed();
 
           if (m_core.get_current_blockchain_height() > previous_height)
           {
@@ -1209,6 +1451,7 @@ skip:
   bool t_cryptonote_protocol_handler<t_core>::on_idle()
   {
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
+    flush_tx_announcements();
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -1247,16 +1490,23 @@ skip:
   int t_cryptonote_protocol_handler<t_core>::handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_CHAIN (" << arg.block_ids.size() << " blocks");
+    if (!post_request(arg, context, &t_cryptonote_protocol_handler<t_core>::serve_chain))
+      serve_chain(arg, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::serve_chain(NOTIFY_REQUEST_CHAIN::request& arg, cryptonote_connection_context& context)
+  {
     NOTIFY_RESPONSE_CHAIN_ENTRY::request r;
-    if(!m_core.find_blockchain_supplement(arg.block_ids, r))
+    if(!m_core.find_blockchain_supplement(arg.block_ids, r, arg.headers ? BLOCKS_HEADERS_SYNCHRONIZING_MAX_COUNT : 0))
     {
       LOG_ERROR_CCONTEXT("Failed to handle NOTIFY_REQUEST_CHAIN.");
       drop_connection(context, false, false);
-      return 1;
+      return;
     }
-    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_CHAIN_ENTRY: m_start_height=" << r.start_height << ", m_total_height=" << r.total_height << ", m_block_ids.size()=" << r.m_block_ids.size());
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_CHAIN_ENTRY: m_start_height=" << r.start_height << ", m_total_height=" << r.total_height << ", m_block_ids.size()=" << r.m_block_ids.size() << ", m_block_headers.size()=" << r.m_block_headers.size());
     post_notify<NOTIFY_RESPONSE_CHAIN_ENTRY>(r, context);
-    return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
@@ -1313,16 +1563,31 @@ skip:
       MDEBUG(context << " we should download it as we're the fastest peer");
       return true;
     }
+    // a span is stalled once it took a few times longer than that peer's
+    // measured throughput says it should, or the fixed threshold if unmeasured
+    uint64_t stall_threshold = REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD;
+    const uint64_t expected_time = m_block_queue.get_expected_download_time(span_connection_id, span.second);
+    if (expected_time > 0)
+      stall_threshold = std::max<uint64_t>(REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD_MIN, std::min<uint64_t>(stall_threshold, expected_time * REQUEST_NEXT_SCHEDULED_SPAN_STALL_FACTOR));
     const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
-    if ((now - request_time).total_microseconds() > REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD)
+    if ((now - request_time).total_microseconds() > (int64_t)stall_threshold)
     {
-      MDEBUG(context << " we should download it as this span was requested long ago");
+      MDEBUG(context << " we should download it as this span was requested long ago (expected " << expected_time / 1e6 << " seconds)");
       return true;
     }
     return false;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::has_unpruned_span(const cryptonote_connection_context& context, const std::pair<uint64_t, uint64_t> &span) const
+  {
+    // a pruned peer only has the prunable data of its stripe, and of its tip
+    if (context.m_pruning_seed == 0 || span.second == 0)
+      return true;
+    return tools::get_next_pruned_block_height(span.first, context.m_remote_blockchain_height, context.m_pruning_seed) >= span.first + span.second;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span)
   {
     // flush stale spans
@@ -1340,9 +1605,20 @@ skip:
       bool first = true;
       while (1)
       {
+        uint64_t block_queue_events;
+        {
+          const boost::unique_lock<boost::mutex> lock(m_block_queue_wait_lock);
+          block_queue_events = m_block_queue_events;
+        }
         size_t nblocks = m_block_queue.get_num_filled_spans();
-        size_t size = m_block_queue.get_data_size();
-        if (nblocks < BLOCK_QUEUE_NBLOCKS_THRESHOLD || size < BLOCK_QUEUE_SIZE_THRESHOLD)
+        // count what is already on its way too, so a burst of requests does not overshoot
+        size_t size = m_block_queue.get_data_size() + m_block_queue.get_inflight_size();
+        // shared by all connections: once paused at the high watermark, nobody
+        // requests more until the queue drained below the low one
+        const bool paused = size >= (m_block_queue_paused ? m_block_queue_low_watermark : m_block_queue_high_watermark);
+        if (paused != m_block_queue_paused.exchange(paused))
+          MDEBUG("Block queue at " << size << " bytes, " << (paused ? "pausing" : "resuming") << " block requests");
+        if (!paused)
         {
           if (!first)
           {
@@ -1384,12 +1660,15 @@ skip:
           return true;
         }
 
-        for (size_t n = 0; n < 50; ++n)
+        // spans added to the chain, peers going away and new chain entries all wake us up,
+        // the timeout only covers whatever else might change the conditions above
         {
-          if (m_stopping)
-            return true;
-          boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+          boost::unique_lock<boost::mutex> lock(m_block_queue_wait_lock);
+          m_block_queue_changed.wait_for(lock, boost::chrono::milliseconds(BLOCK_QUEUE_STANDBY_RECHECK_TIME),
+              [&]() { return m_stopping || m_block_queue_events != block_queue_events; });
         }
+        if (m_stopping)
+          return true;
       }
       context.m_state = cryptonote_connection_context::state_synchronizing;
     }
@@ -1406,6 +1685,8 @@ skip:
       {
         MDEBUG(context << " checking for gap");
         span = m_block_queue.get_start_gap_span();
+        if (!has_unpruned_span(context, span))
+          span = std::make_pair(0, 0);
         if (span.second > 0)
         {
           const uint64_t first_block_height_known = context.m_last_response_height - context.m_needed_objects.size() + 1;
@@ -1433,6 +1714,8 @@ skip:
           boost::uuids::uuid span_connection_id;
           boost::posix_time::ptime time;
           span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+          if (!has_unpruned_span(context, span))
+            span = std::make_pair(0, 0);
           if (span.second > 0)
           {
             is_next = true;
@@ -1468,8 +1751,21 @@ skip:
           context.m_needed_objects = std::vector<crypto::hash>(context.m_needed_objects.begin() + skip, context.m_needed_objects.end());
 
         const uint64_t first_block_height = context.m_last_response_height - context.m_needed_objects.size() + 1;
-        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, count_limit, context.m_connection_id, context.m_needed_objects);
-        MDEBUG(context << " span from " << first_block_height << ": " << span.first << "/" << span.second);
+        // size the span after this peer's throughput, so slow peers hold fewer blocks up
+        uint64_t span_size = m_block_queue.get_span_size(context.m_connection_id, std::max<uint64_t>(1, count_limit / 4), count_limit * 2, BLOCK_QUEUE_SPAN_TARGET_TIME);
+        // and not past the end of the peer's stripe
+        const uint64_t next_pruned_height = tools::get_next_pruned_block_height(first_block_height, context.m_remote_blockchain_height, context.m_pruning_seed);
+        if (next_pruned_height > first_block_height)
+          span_size = std::min(span_size, next_pruned_height - first_block_height);
+        span = m_block_queue.reserve_span(first_block_height, context.m_last_response_height, span_size, context.m_connection_id, context.m_needed_objects);
+        MDEBUG(context << " span from " << first_block_height << " (size " << span_size << "): " << span.first << "/" << span.second);
+        if (!has_unpruned_span(context, span))
+        {
+          // leave it to a peer keeping this stripe, this one gets kicked if it stays useless
+          MDEBUG(context << " peer is pruned with seed " << context.m_pruning_seed << " and lacks the prunable data of this span");
+          m_block_queue.remove_spans(context.m_connection_id, span.first);
+          return true;
+        }
       }
       if (span.second == 0 && !force_next_span)
       {
@@ -1478,6 +1774,8 @@ skip:
         boost::uuids::uuid span_connection_id;
         boost::posix_time::ptime time;
         span = m_block_queue.get_next_span_if_scheduled(hashes, span_connection_id, time);
+        if (!has_unpruned_span(context, span))
+          span = std::make_pair(0, 0);
         if (span.second > 0)
         {
           is_next = true;
@@ -1539,6 +1837,7 @@ skip:
 
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
       m_core.get_short_chain_history(r.block_ids);
+      r.headers = true;
       CHECK_AND_ASSERT_MES(!r.block_ids.empty(), false, "Short chain history is empty");
 
       if (!start_from_current_chain)
@@ -1653,6 +1952,14 @@ skip:
       return 1;
     }
 
+    // peers that send headers let us reject a bad chain before downloading any of it
+    if (!m_core.verify_block_headers(arg.start_height, arg.m_block_ids, arg.m_block_headers))
+    {
+      LOG_ERROR_CCONTEXT("Sent invalid block headers, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+
     uint64_t added = 0;
     for(auto& bl_id: arg.m_block_ids)
     {
@@ -1661,6 +1968,7 @@ skip:
         break;
     }
     context.m_last_response_height -= arg.m_block_ids.size() - n_use_blocks;
+    notify_block_queue_changed();
 
     if (!request_missing_objects(context, false))
     {
@@ -1725,9 +2033,103 @@ skip:
   bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
   {
     // no check for success, so tell core they're relayed unconditionally
+    std::vector<crypto::hash> tx_hashes;
+    tx_hashes.reserve(arg.txs.size());
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
+    {
       m_core.on_transaction_relayed(*tx_blob_it);
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+      transaction tx;
+      crypto::hash tx_hash, tx_prefix_hash;
+      if (parse_and_validate_tx_from_blob(*tx_blob_it, tx, tx_hash, tx_prefix_hash))
+        tx_hashes.push_back(tx_hash);
+    }
+
+    // peers taking announcements get the txids on their next trickle, the
+    // others get the blobs now
+    std::list<boost::uuids::uuid> fullConnections;
+    std::vector<boost::uuids::uuid> inventoryConnections;
+    const bool all_parsed = tx_hashes.size() == arg.txs.size();
+    m_p2p->for_each_connection([&](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (!peer_id)
+        return true;
+      if (all_parsed && (support_flags & P2P_SUPPORT_FLAG_TX_INVENTORY))
+        inventoryConnections.push_back(context.m_connection_id);
+      else if (context.m_connection_id != exclude_context.m_connection_id)
+        fullConnections.push_back(context.m_connection_id);
+      return true;
+    });
+
+    if (!inventoryConnections.empty())
+    {
+      const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+      boost::unique_lock<boost::mutex> lock(m_tx_inventory_lock);
+      for (const boost::uuids::uuid &connection_id : inventoryConnections)
+      {
+        peer_tx_inventory &inv = m_tx_inventory[connection_id];
+        for (const crypto::hash &tx_hash : tx_hashes)
+        {
+          if (connection_id == exclude_context.m_connection_id)
+          {
+            // it sent them to us
+            inv.add_known(tx_hash);
+            continue;
+          }
+          if (inv.known.find(tx_hash) != inv.known.end())
+            continue;
+          inv.add_known(tx_hash);
+          if (inv.pending.empty())
+            inv.next_announce = now + boost::posix_time::milliseconds(crypto::rand<uint32_t>() % (2 * P2P_TX_ANNOUNCE_DELAY_MS));
+          inv.pending.push_back(tx_hash);
+        }
+      }
+    }
+
+    if (!fullConnections.empty())
+    {
+      std::string fullBlob;
+      epee::serialization::store_t_to_binary(arg, fullBlob);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, fullBlob, fullConnections);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::flush_tx_announcements()
+  {
+    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    std::vector<std::pair<boost::uuids::uuid, NOTIFY_NEW_TRANSACTION_HASHES::request>> announcements;
+    {
+      boost::unique_lock<boost::mutex> lock(m_tx_inventory_lock);
+      for (auto &e : m_tx_inventory)
+      {
+        peer_tx_inventory &inv = e.second;
+        if (inv.pending.empty() || inv.next_announce > now)
+          continue;
+        announcements.push_back(std::make_pair(e.first, NOTIFY_NEW_TRANSACTION_HASHES::request()));
+        const size_t n = std::min<size_t>(inv.pending.size(), P2P_MAX_TX_HASHES_PER_NOTIFY);
+        std::vector<crypto::hash> &tx_hashes = announcements.back().second.tx_hashes;
+        tx_hashes.assign(inv.pending.begin(), inv.pending.begin() + n);
+        inv.pending.erase(inv.pending.begin(), inv.pending.begin() + n);
+        if (!inv.pending.empty())
+          inv.next_announce = now + boost::posix_time::milliseconds(crypto::rand<uint32_t>() % (2 * P2P_TX_ANNOUNCE_DELAY_MS));
+      }
+
+      for (auto i = m_requested_txes.begin(); i != m_requested_txes.end(); )
+      {
+        if (now - i->second > boost::posix_time::seconds(P2P_TX_REQUEST_TIMEOUT))
+          i = m_requested_txes.erase(i);
+        else
+          ++i;
+      }
+    }
+
+    for (const auto &a : announcements)
+    {
+      std::string blob;
+      epee::serialization::store_t_to_binary(a.second, blob);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTION_HASHES::ID, blob, std::list<boost::uuids::uuid>(1, a.first));
+    }
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
@@ -1761,6 +2163,10 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+    notify_block_queue_changed();
+
+    boost::unique_lock<boost::mutex> lock(m_tx_inventory_lock);
+    m_tx_inventory.erase(context.m_connection_id);
   }
 
   //------------------------------------------------------------------------------------------------------------------------
@@ -1768,7 +2174,61 @@ skip:
   void t_cryptonote_protocol_handler<t_core>::stop()
   {
     m_stopping = true;
+    notify_block_queue_changed();
+    stop_request_threads();
     m_core.stop();
   }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  template<class t_request>
+  bool t_cryptonote_protocol_handler<t_core>::post_request(t_request& arg, cryptonote_connection_context& context, void (t_cryptonote_protocol_handler::*serve)(t_request&, cryptonote_connection_context&))
+  {
+    // when the pool is not running or is backed up, the caller serves the
+    // request itself, which throttles that connection's reads
+    boost::unique_lock<boost::mutex> lock(m_request_lock);
+    if (!m_request_work || m_pending_requests >= P2P_MAX_PENDING_REQUESTS)
+      return false;
+    ++m_pending_requests;
+
+    // the connection context is copied: the worker only needs its id to
+    // reply or drop it, and the connection may be gone by the time it runs
+    auto request = std::make_shared<std::pair<t_request, cryptonote_connection_context>>(std::move(arg), context);
+    m_request_service.post([this, request, serve]() {
+      if (!m_stopping)
+      {
+        try
+        {
+          (this->*serve)(request->first, request->second);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Exception serving a request from " << request->second << ": " << e.what());
+        }
+      }
+      --m_pending_requests;
+    });
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::stop_request_threads()
+  {
+    std::unique_ptr<boost::asio::io_service::work> work;
+    {
+      boost::unique_lock<boost::mutex> lock(m_request_lock);
+      work = std::move(m_request_work);
+    }
+    // queued requests run through, but are not served once stopping
+    work.reset();
+    m_request_threads.join_all();
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::notify_block_queue_changed()
+  {
+    const boost::unique_lock<boost::mutex> lock(m_block_queue_wait_lock);
+    ++m_block_queue_events;
+    m_block_queue_changed.notify_all();
+  }
 } // namespace
 
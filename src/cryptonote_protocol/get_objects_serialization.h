@@ -0,0 +1,141 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace cryptonote
+{
+  namespace get_objects_serialization
+  {
+    //! signature a, signature b, format version
+    static const size_t PORTABLE_STORAGE_HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+
+    struct string_writer
+    {
+      std::string &s;
+      void write(const char *p, size_t n) { s.append(p, n); }
+    };
+
+    inline bool read_varint(const std::string &blob, size_t &pos, uint64_t &value)
+    {
+      if (pos >= blob.size())
+        return false;
+      const size_t size = size_t(1) << (blob[pos] & PORTABLE_RAW_SIZE_MARK_MASK);
+      if (blob.size() - pos < size)
+        return false;
+      value = 0;
+      memcpy(&value, blob.data() + pos, size);
+      value >>= 2;
+      pos += size;
+      return true;
+    }
+
+    /**
+     * @brief serializes a block entry the way it appears in the blocks array
+     *        of a NOTIFY_RESPONSE_GET_OBJECTS, so responses can be stitched
+     *        together from entries serialized earlier
+     */
+    inline std::string serialize_block_entry(const block_complete_entry &e)
+    {
+      std::string blob;
+      epee::serialization::store_t_to_binary(e, blob);
+      return blob.substr(PORTABLE_STORAGE_HEADER_SIZE);
+    }
+
+    /**
+     * @brief serializes a NOTIFY_RESPONSE_GET_OBJECTS whose blocks are given
+     *        as serialized entries, the same bytes store_t_to_binary would give
+     *
+     * @param rsp the response, with no blocks
+     * @param blocks the blocks, from serialize_block_entry
+     * @param blob return-by-reference the serialized response
+     *
+     * @return false if the response could not be serialized
+     */
+    inline bool serialize_response(const NOTIFY_RESPONSE_GET_OBJECTS::request &rsp, const std::vector<std::shared_ptr<const std::string>> &blocks, std::string &blob)
+    {
+      CHECK_AND_ASSERT_MES(rsp.blocks.empty(), false, "Blocks must be passed serialized");
+      std::string rest;
+      if (!epee::serialization::store_t_to_binary(rsp, rest))
+        return false;
+      if (blocks.empty())
+      {
+        blob = std::move(rest);
+        return true;
+      }
+
+      // the root section starts with its entry count, which gains the blocks
+      // entry, then has its entries in KV_SERIALIZE order, where blocks comes
+      // right after txs
+      size_t pos = PORTABLE_STORAGE_HEADER_SIZE;
+      uint64_t count;
+      CHECK_AND_ASSERT_MES(read_varint(rest, pos, count), false, "Bad serialized response");
+      const size_t entries_start = pos;
+      if (!rsp.txs.empty())
+      {
+        static const std::string txs_name = "\x03txs";
+        CHECK_AND_ASSERT_MES(rest.compare(pos, txs_name.size(), txs_name) == 0, false, "Unexpected first entry in serialized response");
+        pos += txs_name.size() + 1;
+        uint64_t txs;
+        CHECK_AND_ASSERT_MES(read_varint(rest, pos, txs), false, "Bad serialized response");
+        for (uint64_t i = 0; i < txs; ++i)
+        {
+          uint64_t len;
+          CHECK_AND_ASSERT_MES(read_varint(rest, pos, len) && rest.size() - pos >= len, false, "Bad serialized response");
+          pos += len;
+        }
+      }
+
+      size_t size = rest.size() + 16;
+      for (const auto &e: blocks)
+        size += e->size();
+      blob.clear();
+      blob.reserve(size);
+      blob.append(rest.data(), PORTABLE_STORAGE_HEADER_SIZE);
+      string_writer w{blob};
+      epee::serialization::pack_varint(w, count + 1);
+      blob.append(rest.data() + entries_start, pos - entries_start);
+      static const char name[] = "blocks";
+      const uint8_t name_size = sizeof(name) - 1;
+      blob.push_back(name_size);
+      blob.append(name, name_size);
+      blob.push_back((char)(SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY));
+      epee::serialization::pack_varint(w, blocks.size());
+      for (const auto &e: blocks)
+        blob.append(*e);
+      blob.append(rest.data() + pos, rest.size() - pos);
+      return true;
+    }
+  }
+}
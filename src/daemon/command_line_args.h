@@ -83,6 +83,11 @@ namespace daemon_args
   , ""
   , ""
   };
+  const command_line::arg_descriptor<bool> arg_log_async = {
+    "log-async"
+  , "Write logs from a background thread, dropping debug lines if it falls behind"
+  , false
+  };
   const command_line::arg_descriptor<std::vector<std::string>> arg_command = {
     "daemon_command"
   , "Hidden"
@@ -96,6 +101,14 @@ namespace daemon_args
   , "Max number of threads to use for a parallel job"
   , 0
   };
+  const command_line::arg_descriptor<std::vector<std::string>> arg_threadpool_size = {
+    "threadpool-size"
+  , "Threads for a class of work (block, relay or background), as <class>:<threads>"
+  };
+  const command_line::arg_descriptor<std::vector<std::string>> arg_threadpool_cpus = {
+    "threadpool-cpus"
+  , "CPUs a class of work (block, relay or background) may run on, as <class>:<cpu>[-<cpu>][,...]"
+  };
 
   const command_line::arg_descriptor<std::string> arg_zmq_rpc_bind_ip   = {
     "zmq-rpc-bind-ip"
@@ -117,6 +130,18 @@ namespace daemon_args
     }
   };
 
+  const command_line::arg_descriptor<unsigned> arg_zmq_rpc_threads = {
+    "zmq-rpc-threads"
+  , "Number of threads serving ZMQ RPC requests"
+  , 2
+  };
+
+  const command_line::arg_descriptor<std::string> arg_zmq_pub = {
+    "zmq-pub"
+  , "Address for ZMQ block and tx pool notifications, e.g. tcp://127.0.0.1:18084 (disabled if empty)"
+  , ""
+  };
+
 }  // namespace daemon_args
 
 #endif // DAEMON_COMMAND_LINE_ARGS_H
@@ -675,6 +675,30 @@ bool t_command_parser_executor::sync_info(const std::vector<std::string>& args)
   return m_executor.sync_info();
 }
 
+bool t_command_parser_executor::print_memory_usage(const std::vector<std::string>& args)
+{
+  if (args.size() != 0) return false;
+
+  return m_executor.print_memory_usage();
+}
+
+bool t_command_parser_executor::backup_blockchain(const std::vector<std::string>& args)
+{
+  if (args.size() > 2) return false;
+
+  std::string folder;
+  uint64_t max_mb_per_second = 0;
+  if (args.size() > 0)
+    folder = args[0];
+  if (args.size() > 1 && !epee::string_tools::get_xtype_from_string(max_mb_per_second, args[1]))
+  {
+    std::cout << "wrong max MB per second parameter" << std::endl;
+    return false;
+  }
+
+  return m_executor.backup_blockchain(folder, max_mb_per_second << 20);
+}
+
 bool t_command_parser_executor::version(const std::vector<std::string>& args)
 {
   std::cout << "Monero '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")" << std::endl;
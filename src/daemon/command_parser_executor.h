@@ -140,6 +140,10 @@ public:
 
   bool sync_info(const std::vector<std::string>& args);
 
+  bool print_memory_usage(const std::vector<std::string>& args);
+
+  bool backup_blockchain(const std::vector<std::string>& args);
+
   bool version(const std::vector<std::string>& args);
 };
 
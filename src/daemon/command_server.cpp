@@ -226,14 +226,14 @@ t_command_server::t_command_server(
     m_command_lookup.set_handler(
       "ban"
     , std::bind(&t_command_parser_executor::ban, &m_parser, p::_1)
-    , "ban <IP> [<seconds>]"
-    , "Ban a given <IP> for a given amount of <seconds>."
+    , "ban <IP>|<IP>/<prefix> [<seconds>]"
+    , "Ban a given <IP> or subnet for a given amount of <seconds>."
     );
     m_command_lookup.set_handler(
       "unban"
     , std::bind(&t_command_parser_executor::unban, &m_parser, p::_1)
-    , "unban <IP>"
-    , "Unban a given <IP>."
+    , "unban <IP>|<IP>/<prefix>"
+    , "Unban a given <IP> or subnet."
     );
     m_command_lookup.set_handler(
       "flush_txpool"
@@ -282,6 +282,17 @@ t_command_server::t_command_server(
     , std::bind(&t_command_parser_executor::sync_info, &m_parser, p::_1)
     , "Print information about the blockchain sync state."
     );
+    m_command_lookup.set_handler(
+      "memory_usage"
+    , std::bind(&t_command_parser_executor::print_memory_usage, &m_parser, p::_1)
+    , "Print the approximate memory use of the daemon's in-memory caches and queues."
+    );
+    m_command_lookup.set_handler(
+      "backup_blockchain"
+    , std::bind(&t_command_parser_executor::backup_blockchain, &m_parser, p::_1)
+    , "backup_blockchain [<folder> [<max_mb_per_second>]]"
+    , "Start writing a compacted copy of the blockchain to <folder> while the daemon runs, at most <max_mb_per_second> MB per second if given. Without arguments, print how the last copy is going."
+    );
     m_command_lookup.set_handler(
       "version"
     , std::bind(&t_command_parser_executor::version, &m_parser, p::_1)
@@ -36,6 +36,7 @@
 #include "daemon/daemon.h"
 #include "rpc/daemon_handler.h"
 #include "rpc/zmq_server.h"
+#include "rpc/zmq_pub.h"
 
 #include "common/password.h"
 #include "common/util.h"
@@ -69,7 +70,7 @@ public:
       boost::program_options::variables_map const & vm
     )
     : core{vm}
-    , protocol{vm, core, command_line::get_arg(vm, cryptonote::arg_offline)}
+    , protocol{vm, core, command_line::get_arg(vm, cryptonote::arg_offline) || command_line::get_arg(vm, cryptonote::arg_rpc_only_readonly_db)}
     , p2p{vm, protocol}
   {
     // Handle circular dependencies
@@ -95,6 +96,7 @@ public:
 void t_daemon::init_options(boost::program_options::options_description & option_spec)
 {
   t_core::init_options(option_spec);
+  t_protocol::init_options(option_spec);
   t_p2p::init_options(option_spec);
   t_rpc::init_options(option_spec);
 }
@@ -106,6 +108,8 @@ t_daemon::t_daemon(
 {
   zmq_rpc_bind_port = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_bind_port);
   zmq_rpc_bind_address = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_bind_ip);
+  zmq_rpc_threads = command_line::get_arg(vm, daemon_args::arg_zmq_rpc_threads);
+  zmq_pub_address = command_line::get_arg(vm, daemon_args::arg_zmq_pub);
 }
 
 t_daemon::~t_daemon() = default;
@@ -156,6 +160,21 @@ bool t_daemon::run(bool interactive)
     if (!mp_internals->core.run())
       return false;
 
+    // hook up before anything can add blocks or txes
+    std::shared_ptr<cryptonote::rpc::ZmqPublisher> zmq_pub;
+    if (!zmq_pub_address.empty())
+    {
+      zmq_pub = std::make_shared<cryptonote::rpc::ZmqPublisher>();
+      if (!zmq_pub->bind(zmq_pub_address))
+      {
+        LOG_ERROR(std::string("Failed to bind ZMQ publisher to ") + zmq_pub_address);
+        return false;
+      }
+      zmq_pub->run();
+      cryptonote::rpc::ZmqPublisher::attach(zmq_pub, mp_internals->core.get());
+      MINFO(std::string("ZMQ publisher started at ") + zmq_pub_address + ".");
+    }
+
     for(auto& rpc: mp_internals->rpcs)
       rpc->run();
 
@@ -168,7 +187,7 @@ bool t_daemon::run(bool interactive)
     }
 
     cryptonote::rpc::DaemonHandler rpc_daemon_handler(mp_internals->core.get(), mp_internals->p2p.get());
-    cryptonote::rpc::ZmqServer zmq_server(rpc_daemon_handler);
+    cryptonote::rpc::ZmqServer zmq_server(rpc_daemon_handler, zmq_rpc_threads);
 
     if (!zmq_server.addTCPSocket(zmq_rpc_bind_address, zmq_rpc_bind_port))
     {
@@ -200,6 +219,11 @@ bool t_daemon::run(bool interactive)
     for(auto& rpc : mp_internals->rpcs)
       rpc->stop();
     mp_internals->core.get().get_miner().stop();
+    if (zmq_pub)
+    {
+      cryptonote::rpc::ZmqPublisher::detach(mp_internals->core.get());
+      zmq_pub->stop();
+    }
     MGINFO("Node stopped.");
     return true;
   }
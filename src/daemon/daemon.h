@@ -46,6 +46,8 @@ private:
   std::unique_ptr<t_internals> mp_internals;
   std::string zmq_rpc_bind_address;
   std::string zmq_rpc_bind_port;
+  unsigned int zmq_rpc_threads;
+  std::string zmq_pub_address;
 public:
   t_daemon(
       boost::program_options::variables_map const & vm
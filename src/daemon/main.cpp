@@ -33,6 +33,7 @@
 #include "common/scoped_message_writer.h"
 #include "common/password.h"
 #include "common/util.h"
+#include "common/threadpool.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_basic/miner.h"
 #include "daemon/command_server.h"
@@ -86,9 +87,14 @@ int main(int argc, char const * argv[])
       command_line::add_arg(core_settings, daemon_args::arg_log_level);
       command_line::add_arg(core_settings, daemon_args::arg_max_log_file_size);
       command_line::add_arg(core_settings, daemon_args::arg_max_log_files);
+      command_line::add_arg(core_settings, daemon_args::arg_log_async);
       command_line::add_arg(core_settings, daemon_args::arg_max_concurrency);
+      command_line::add_arg(core_settings, daemon_args::arg_threadpool_size);
+      command_line::add_arg(core_settings, daemon_args::arg_threadpool_cpus);
       command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_bind_ip);
       command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_bind_port);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_rpc_threads);
+      command_line::add_arg(core_settings, daemon_args::arg_zmq_pub);
 
       daemonizer::init_options(hidden_options, visible_options);
       daemonize::t_executor::init_options(core_settings);
@@ -213,6 +219,8 @@ int main(int argc, char const * argv[])
     {
       mlog_set_log(command_line::get_arg(vm, daemon_args::arg_log_level).c_str());
     }
+    if (command_line::get_arg(vm, daemon_args::arg_log_async) && !mlog_set_async(true))
+      MERROR("Failed to start asynchronous logging");
 
     // after logs initialized
     tools::create_directories_if_necessary(data_dir.string());
@@ -283,6 +291,11 @@ int main(int argc, char const * argv[])
 
     if (!command_line::is_arg_defaulted(vm, daemon_args::arg_max_concurrency))
       tools::set_max_concurrency(command_line::get_arg(vm, daemon_args::arg_max_concurrency));
+    if (!tools::threadpool::configure_from_args(command_line::get_arg(vm, daemon_args::arg_threadpool_size), command_line::get_arg(vm, daemon_args::arg_threadpool_cpus)))
+    {
+      std::cerr << "Invalid threadpool configuration" << std::endl;
+      return 1;
+    }
 
     // logging is now set up
     MGINFO("Electroneum Classic '" << MONERO_RELEASE_NAME << "' (v" << MONERO_VERSION_FULL << ")");
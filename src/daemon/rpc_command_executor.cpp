@@ -36,6 +36,7 @@
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "cryptonote_basic/hardfork.h"
+#include "p2p/net_ban_list.h"
 #include <boost/format.hpp>
 #include <ctime>
 #include <string>
@@ -337,6 +338,18 @@ static std::string get_mining_speed(uint64_t hr)
   return (boost::format("%.0f H/s") % hr).str();
 }
 
+static std::string get_scratchpad_info(const cryptonote::COMMAND_RPC_MINING_STATUS::response &mres)
+{
+  const uint64_t large = mres.hugepage_scratchpads + mres.transparent_hugepage_scratchpads;
+  const uint64_t total = large + mres.small_page_scratchpads;
+  if (total == 0)
+    return "";
+  std::string s = (boost::format(" (%llu/%llu scratchpads on huge pages") % (unsigned long long)large % (unsigned long long)total).str();
+  if (mres.numa_bound_scratchpads)
+    s += (boost::format(", %llu NUMA bound") % (unsigned long long)mres.numa_bound_scratchpads).str();
+  return s + ")";
+}
+
 static std::string get_fork_extra_info(uint64_t t, uint64_t now, uint64_t block_time)
 {
   uint64_t blocks_per_day = 86400 / block_time;
@@ -450,7 +463,7 @@ bool t_rpc_command_executor::show_status() {
     % get_sync_percentage(ires)
     % (ires.testnet ? "testnet" : ires.stagenet ? "stagenet" : "mainnet")
     % bootstrap_msg
-    % (!has_mining_info ? "mining info unavailable" : mining_busy ? "syncing" : mres.active ? ( ( mres.is_background_mining_enabled ? "smart " : "" ) + std::string("mining at ") + get_mining_speed(mres.speed) ) : "not mining")
+    % (!has_mining_info ? "mining info unavailable" : mining_busy ? "syncing" : mres.active ? ( ( mres.is_background_mining_enabled ? "smart " : "" ) + std::string("mining at ") + get_mining_speed(mres.speed) + get_scratchpad_info(mres) ) : "not mining")
     % get_mining_speed(ires.difficulty / ires.target)
     % (unsigned)hfres.version
     % get_fork_extra_info(hfres.earliest_height, net_height, ires.target)
@@ -1024,7 +1037,9 @@ bool t_rpc_command_executor::print_transaction_pool_stats() {
 
   tools::msg_writer() << n_transactions << " tx(es), " << res.pool_stats.bytes_total << " bytes total (min " << res.pool_stats.bytes_min << ", max " << res.pool_stats.bytes_max << ", avg " << avg_bytes << ", median " << res.pool_stats.bytes_med << ")" << std::endl
       << "fees " << cryptonote::print_money(res.pool_stats.fee_total) << " (avg " << cryptonote::print_money(n_transactions ? res.pool_stats.fee_total / n_transactions : 0) << " per tx" << ", " << cryptonote::print_money(res.pool_stats.bytes_total ? res.pool_stats.fee_total / res.pool_stats.bytes_total : 0) << " per byte)" << std::endl
-      << res.pool_stats.num_double_spends << " double spends, " << res.pool_stats.num_not_relayed << " not relayed, " << res.pool_stats.num_failing << " failing, " << res.pool_stats.num_10m << " older than 10 minutes (oldest " << (res.pool_stats.oldest == 0 ? "-" : get_human_time_ago(res.pool_stats.oldest, now)) << "), " << backlog_message;
+      << res.pool_stats.num_double_spends << " double spends, " << res.pool_stats.num_not_relayed << " not relayed, " << res.pool_stats.num_failing << " failing, " << res.pool_stats.num_10m << " older than 10 minutes (oldest " << (res.pool_stats.oldest == 0 ? "-" : get_human_time_ago(res.pool_stats.oldest, now)) << "), " << backlog_message << std::endl
+      << "parsed tx cache: " << res.pool_stats.parsed_cache_hits << " hits, " << res.pool_stats.parsed_cache_misses << " misses" << std::endl
+      << "evicted when full: " << res.pool_stats.num_pruned << " tx(es), " << res.pool_stats.bytes_pruned << " bytes";
 
   if (n_transactions > 1 && res.pool_stats.histo.size())
   {
@@ -1462,7 +1477,7 @@ bool t_rpc_command_executor::print_bans()
 
     for (auto i = res.bans.begin(); i != res.bans.end(); ++i)
     {
-        tools::msg_writer() << epee::string_tools::get_ip_string_from_int32(i->ip) << " banned for " << i->seconds << " seconds";
+        tools::msg_writer() << (i->host.empty() ? epee::string_tools::get_ip_string_from_int32(i->ip) : i->host) << " banned for " << i->seconds << " seconds";
     }
 
     return true;
@@ -1477,7 +1492,19 @@ bool t_rpc_command_executor::ban(const std::string &ip, time_t seconds)
     epee::json_rpc::error error_resp;
 
     cryptonote::COMMAND_RPC_SETBANS::ban ban;
-    if (!epee::string_tools::get_ip_int32_from_string(ban.ip, ip))
+    if (ip.find('/') != std::string::npos)
+    {
+        uint32_t subnet_ip;
+        uint8_t subnet_bits;
+        if (!nodetool::ban_list::parse_subnet(ip, subnet_ip, subnet_bits))
+        {
+            tools::fail_msg_writer() << "Invalid subnet";
+            return true;
+        }
+        ban.host = ip;
+        ban.ip = 0;
+    }
+    else if (!epee::string_tools::get_ip_int32_from_string(ban.ip, ip))
     {
         tools::fail_msg_writer() << "Invalid IP";
         return true;
@@ -1513,7 +1540,19 @@ bool t_rpc_command_executor::unban(const std::string &ip)
     epee::json_rpc::error error_resp;
 
     cryptonote::COMMAND_RPC_SETBANS::ban ban;
-    if (!epee::string_tools::get_ip_int32_from_string(ban.ip, ip))
+    if (ip.find('/') != std::string::npos)
+    {
+        uint32_t subnet_ip;
+        uint8_t subnet_bits;
+        if (!nodetool::ban_list::parse_subnet(ip, subnet_ip, subnet_bits))
+        {
+            tools::fail_msg_writer() << "Invalid subnet";
+            return true;
+        }
+        ban.host = ip;
+        ban.ip = 0;
+    }
+    else if (!epee::string_tools::get_ip_int32_from_string(ban.ip, ip))
     {
         tools::fail_msg_writer() << "Invalid IP";
         return true;
@@ -1940,6 +1979,12 @@ bool t_rpc_command_executor::sync_info()
     for (const auto &s: res.spans)
       total_size += s.size;
     tools::success_msg_writer() << std::to_string(res.spans.size()) << " spans, " << total_size/1e6 << " MB";
+    tools::success_msg_writer() << "Block queue: " << res.queued_bytes/1e6 << " MB queued, " << res.inflight_bytes/1e6 << " MB requested, requests pause at "
+        << res.queue_high_watermark/1e6 << " MB and resume under " << res.queue_low_watermark/1e6 << " MB" << (res.queue_paused ? " (paused)" : "");
+    tools::success_msg_writer() << "DB: " << res.db_batch_blocks << " blocks per batch" << (res.db_adaptive_batch ? " (adaptive)" : "")
+        << (res.db_sync_blocks ? ", sync every " + std::to_string(res.db_sync_blocks) + " blocks" : std::string(", sync by size")) << (res.db_adaptive_sync ? " (adaptive)" : "")
+        << ", commits take " << res.db_commit_time_us / 1000 << " ms, syncs " << res.db_sync_time_us / 1000 << " ms"
+        << (res.db_rotating_drive ? ", rotating drive" : "");
     for (const auto &s: res.spans)
     {
       std::string address = epee::string_tools::pad_string(s.remote_address, 24);
@@ -1956,4 +2001,81 @@ bool t_rpc_command_executor::sync_info()
     return true;
 }
 
+bool t_rpc_command_executor::print_memory_usage()
+{
+  cryptonote::COMMAND_RPC_GET_MEMORY_USAGE::request req;
+  cryptonote::COMMAND_RPC_GET_MEMORY_USAGE::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "get_memory_usage", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_get_memory_usage(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << make_error(fail_message, error_resp.message.empty() ? res.status : error_resp.message);
+      return true;
+    }
+  }
+
+  tools::msg_writer() << std::setw(36) << std::left << "Structure"
+      << std::setw(12) << "Count"
+      << std::setw(12) << "Max count"
+      << std::setw(12) << "kB"
+      << "Max kB";
+  for (const auto &e: res.entries)
+  {
+    tools::msg_writer() << std::setw(36) << std::left << e.name
+        << std::setw(12) << e.count
+        << std::setw(12) << (e.max_count ? std::to_string(e.max_count) : "-")
+        << std::setw(12) << (e.bytes + 1023) / 1024
+        << (e.max_bytes ? std::to_string((e.max_bytes + 1023) / 1024) : "-");
+  }
+  tools::success_msg_writer() << "Total: " << (res.total_bytes + 1023) / 1024 << " kB (approximate)";
+  return true;
+}
+
+bool t_rpc_command_executor::backup_blockchain(const std::string &folder, uint64_t max_bytes_per_second)
+{
+  cryptonote::COMMAND_RPC_BACKUP_BLOCKCHAIN::request req;
+  cryptonote::COMMAND_RPC_BACKUP_BLOCKCHAIN::response res;
+  std::string fail_message = "Unsuccessful";
+  epee::json_rpc::error error_resp;
+
+  req.folder = folder;
+  req.max_bytes_per_second = max_bytes_per_second;
+
+  if (m_is_rpc)
+  {
+    if (!m_rpc_client->json_rpc_request(req, res, "backup_blockchain", fail_message.c_str()))
+    {
+      return true;
+    }
+  }
+  else
+  {
+    if (!m_rpc_server->on_backup_blockchain(req, res, error_resp) || res.status != CORE_RPC_STATUS_OK)
+    {
+      tools::fail_msg_writer() << make_error(fail_message, error_resp.message.empty() ? res.status : error_resp.message);
+      return true;
+    }
+  }
+
+  if (res.in_progress)
+    tools::success_msg_writer() << "Copying the blockchain, " << (res.bytes_written >> 20) << " MB written so far";
+  else if (!res.error.empty())
+    tools::fail_msg_writer() << "The last copy of the blockchain failed: " << res.error;
+  else if (res.bytes_written > 0)
+    tools::success_msg_writer() << "The last copy of the blockchain is done, " << (res.bytes_written >> 20) << " MB";
+  else
+    tools::msg_writer() << "No copy of the blockchain was started";
+  return true;
+}
+
 }// namespace daemonize
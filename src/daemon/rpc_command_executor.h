@@ -153,6 +153,10 @@ public:
   bool relay_tx(const std::string &txid);
 
   bool sync_info();
+
+  bool print_memory_usage();
+
+  bool backup_blockchain(const std::string &folder, uint64_t max_bytes_per_second);
 };
 
 } // namespace daemonize
@@ -160,6 +160,21 @@ namespace hw {
         virtual bool  secret_key_to_public_key(const crypto::secret_key &sec, crypto::public_key &pub) = 0;
         virtual bool  generate_key_image(const crypto::public_key &pub, const crypto::secret_key &sec, crypto::key_image &image) = 0;
 
+        // generate_key_derivation for many tx keys against the same secret, valid[i]
+        // (if given) set per key; devices override it to save work or round trips
+        virtual bool  generate_key_derivations(const crypto::public_key *pubs, std::size_t count, const crypto::secret_key &sec, crypto::key_derivation *derivations, bool *valid)
+        {
+            bool all_valid = true;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                const bool r = generate_key_derivation(pubs[i], sec, derivations[i]);
+                if (valid)
+                    valid[i] = r;
+                all_valid = all_valid && r;
+            }
+            return all_valid;
+        }
+
         // alternative prototypes available in libringct
         rct::key scalarmultKey(const rct::key &P, const rct::key &a)
         {
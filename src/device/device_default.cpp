@@ -241,6 +241,10 @@ namespace hw {
             return crypto::generate_key_derivation(key1, key2, derivation);
         }
 
+        bool device_default::generate_key_derivations(const crypto::public_key *pubs, std::size_t count, const crypto::secret_key &sec, crypto::key_derivation *derivations, bool *valid) {
+            return crypto::generate_key_derivations_batch(pubs, count, sec, derivations, valid);
+        }
+
         bool device_default::derivation_to_scalar(const crypto::key_derivation &derivation, const size_t output_index, crypto::ec_scalar &res){
             crypto::derivation_to_scalar(derivation,output_index, res);
             return true;
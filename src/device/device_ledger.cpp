@@ -563,7 +563,10 @@ namespace hw {
     }
 
     std::vector<crypto::public_key>  device_ledger::get_subaddress_spend_public_keys(const cryptonote::account_keys &keys, uint32_t account, uint32_t begin, uint32_t end) {
+     //hold the device for the whole range so no other command interleaves
+     boost::lock_guard<boost::recursive_mutex> device_lock(device_locker);
      std::vector<crypto::public_key> pkeys;
+     pkeys.reserve(end > begin ? end - begin : 0);
      cryptonote::subaddress_index index = {account, begin};
      crypto::public_key D;
      for (uint32_t idx = begin; idx < end; ++idx) {
@@ -864,6 +867,23 @@ namespace hw {
       return r;
     }
 
+    bool device_ledger::generate_key_derivations(const crypto::public_key *pubs, std::size_t count, const crypto::secret_key &sec, crypto::key_derivation *derivations, bool *valid) {
+      //hold the device for the whole batch so no other command interleaves
+      boost::lock_guard<boost::recursive_mutex> device_lock(device_locker);
+
+      #ifndef DEBUG_HWDEVICE
+      if ((this->mode == TRANSACTION_PARSE)  && has_view_key) {
+        //same as generate_key_derivation, without any exchange with the device
+        MDEBUG( "generate_key_derivations : PARSE mode with known viewkey");
+        assert(is_fake_view_key(sec));
+        return crypto::generate_key_derivations_batch(pubs, count, this->viewkey, derivations, valid);
+      }
+      #endif
+
+      //the device application takes one derivation per command
+      return device::generate_key_derivations(pubs, count, sec, derivations, valid);
+    }
+
     bool device_ledger::conceal_derivation(crypto::key_derivation &derivation, const crypto::public_key &tx_pub_key, const std::vector<crypto::public_key> &additional_tx_pub_keys, const crypto::key_derivation &main_derivation, const std::vector<crypto::key_derivation> &additional_derivations) {
       const crypto::public_key *pkey=NULL;
       if (derivation == main_derivation) {        
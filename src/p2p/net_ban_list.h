@@ -0,0 +1,245 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+#include "string_tools.h"
+#include "net/net_utils_base.h"
+
+namespace nodetool
+{
+  /************************************************************************/
+  /* Banned hosts and IPv4 subnets, keyed by address rather than string.  */
+  /* Lookups walk an immutable prefix trie snapshot without locking;      */
+  /* changes rebuild the snapshot under a lock and publish it atomically. */
+  /************************************************************************/
+  class ban_list
+  {
+  public:
+    ban_list(): m_snapshot(std::make_shared<const snapshot>()) {}
+
+    bool is_banned(const epee::net_utils::network_address &address, time_t now) const
+    {
+      const std::shared_ptr<const snapshot> s = std::atomic_load(&m_snapshot);
+      if (address.get_type_id() == epee::net_utils::ipv4_network_address::ID)
+        return is_banned(*s, to_host_order(address.as<epee::net_utils::ipv4_network_address>().ip()), now);
+      if (s->others.empty())
+        return false;
+      const auto i = s->others.find(address.host_str());
+      return i != s->others.end() && i->second > now;
+    }
+
+    void ban_host(const epee::net_utils::network_address &address, time_t until)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      if (address.get_type_id() == epee::net_utils::ipv4_network_address::ID)
+        m_subnets[std::make_pair(to_host_order(address.as<epee::net_utils::ipv4_network_address>().ip()), (uint8_t)32)] = until;
+      else
+        m_others[address.host_str()] = until;
+      publish();
+    }
+
+    bool unban_host(const epee::net_utils::network_address &address)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      bool removed;
+      if (address.get_type_id() == epee::net_utils::ipv4_network_address::ID)
+        removed = m_subnets.erase(std::make_pair(to_host_order(address.as<epee::net_utils::ipv4_network_address>().ip()), (uint8_t)32)) > 0;
+      else
+        removed = m_others.erase(address.host_str()) > 0;
+      if (removed)
+        publish();
+      return removed;
+    }
+
+    // ip is in network byte order, as in ipv4_network_address
+    bool ban_subnet(uint32_t ip, uint8_t bits, time_t until)
+    {
+      if (bits == 0 || bits > 32)
+        return false;
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      m_subnets[std::make_pair(to_host_order(ip) & mask(bits), bits)] = until;
+      publish();
+      return true;
+    }
+
+    bool unban_subnet(uint32_t ip, uint8_t bits)
+    {
+      if (bits == 0 || bits > 32)
+        return false;
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      if (!m_subnets.erase(std::make_pair(to_host_order(ip) & mask(bits), bits)))
+        return false;
+      publish();
+      return true;
+    }
+
+    // single hosts, with the time their ban ends
+    std::map<std::string, time_t> get_hosts(time_t now) const
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      std::map<std::string, time_t> hosts;
+      for (const auto &e: m_subnets)
+        if (e.first.second == 32 && e.second > now)
+          hosts[epee::string_tools::get_ip_string_from_int32(to_network_order(e.first.first))] = e.second;
+      for (const auto &e: m_others)
+        if (e.second > now)
+          hosts.insert(e);
+      return hosts;
+    }
+
+    // subnets in a.b.c.d/n notation, with the time their ban ends
+    std::map<std::string, time_t> get_subnets(time_t now) const
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      std::map<std::string, time_t> subnets;
+      for (const auto &e: m_subnets)
+        if (e.first.second < 32 && e.second > now)
+          subnets[subnet_to_string(to_network_order(e.first.first), e.first.second)] = e.second;
+      return subnets;
+    }
+
+    // parses a.b.c.d/n, ip in network byte order
+    static bool parse_subnet(const std::string &str, uint32_t &ip, uint8_t &bits)
+    {
+      const size_t slash = str.find('/');
+      if (slash == std::string::npos || slash + 1 == str.size() || str.size() - slash > 3)
+        return false;
+      if (!epee::string_tools::get_ip_int32_from_string(ip, str.substr(0, slash)))
+        return false;
+      unsigned n = 0;
+      for (size_t i = slash + 1; i < str.size(); ++i)
+      {
+        if (str[i] < '0' || str[i] > '9')
+          return false;
+        n = n * 10 + (str[i] - '0');
+      }
+      if (n == 0 || n > 32)
+        return false;
+      bits = n;
+      return true;
+    }
+
+    static std::string subnet_to_string(uint32_t ip, uint8_t bits)
+    {
+      return epee::string_tools::get_ip_string_from_int32(ip) + "/" + std::to_string(bits);
+    }
+
+  private:
+    struct node
+    {
+      uint32_t child[2];
+      time_t until;
+    };
+
+    struct snapshot
+    {
+      snapshot(): trie(1, node{{0, 0}, 0}) {}
+      std::vector<node> trie; // trie[0] is the root, a zero child means none
+      std::map<std::string, time_t> others;
+    };
+
+    // the bytes of an ipv4_network_address ip are in network order
+    static uint32_t to_host_order(uint32_t ip)
+    {
+      const uint8_t *b = (const uint8_t*)&ip;
+      return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    }
+
+    // the conversion is its own inverse
+    static uint32_t to_network_order(uint32_t ip) { return to_host_order(ip); }
+
+    static uint32_t mask(uint8_t bits)
+    {
+      return bits ? 0xffffffffu << (32 - bits) : 0;
+    }
+
+    static bool is_banned(const snapshot &s, uint32_t ip, time_t now)
+    {
+      uint32_t n = 0;
+      for (int bit = 31; ; --bit)
+      {
+        if (s.trie[n].until > now)
+          return true;
+        if (bit < 0)
+          return false;
+        n = s.trie[n].child[(ip >> bit) & 1];
+        if (!n)
+          return false;
+      }
+    }
+
+    // caller holds m_lock; expired entries are dropped here
+    void publish()
+    {
+      const time_t now = time(NULL);
+      std::shared_ptr<snapshot> s = std::make_shared<snapshot>();
+      for (auto i = m_subnets.begin(); i != m_subnets.end(); )
+      {
+        if (i->second <= now)
+        {
+          i = m_subnets.erase(i);
+          continue;
+        }
+        uint32_t n = 0;
+        for (uint8_t b = 0; b < i->first.second; ++b)
+        {
+          const unsigned dir = (i->first.first >> (31 - b)) & 1;
+          if (!s->trie[n].child[dir])
+          {
+            s->trie[n].child[dir] = s->trie.size();
+            s->trie.push_back(node{{0, 0}, 0});
+          }
+          n = s->trie[n].child[dir];
+        }
+        s->trie[n].until = i->second;
+        ++i;
+      }
+      for (auto i = m_others.begin(); i != m_others.end(); )
+      {
+        if (i->second <= now)
+          i = m_others.erase(i);
+        else
+          s->others.insert(*i++);
+      }
+      std::atomic_store(&m_snapshot, std::shared_ptr<const snapshot>(std::move(s)));
+    }
+
+    mutable boost::mutex m_lock;
+    std::map<std::pair<uint32_t, uint8_t>, time_t> m_subnets; // host order ip, prefix length
+    std::map<std::string, time_t> m_others;
+    std::shared_ptr<const snapshot> m_snapshot;
+  };
+}
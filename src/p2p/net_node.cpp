@@ -68,4 +68,6 @@ namespace nodetool
     const command_line::arg_descriptor<int64_t> arg_limit_rate = {"limit-rate", "set limit-rate [kB/s]", -1};
 
     const command_line::arg_descriptor<bool> arg_save_graph = {"save-graph", "Save data for dr etnc", false};
+
+    const command_line::arg_descriptor<uint32_t> arg_p2p_io_shards = {"p2p-io-shards", "Spread p2p connections over this many separately run io_services (0 to use a single one)", 0};
 }
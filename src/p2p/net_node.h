@@ -55,11 +55,12 @@ namespace nodetool
   template<class base_type>
   struct p2p_connection_context_t: base_type //t_payload_net_handler::connection_context //public net_utils::connection_context_base
   {
-    p2p_connection_context_t(): peer_id(0), support_flags(0), m_in_timedsync(false) {}
+    p2p_connection_context_t(): peer_id(0), support_flags(0), m_in_timedsync(false), m_peerlist_sent_time(0) {}
 
     peerid_type peer_id;
     uint32_t support_flags;
     bool m_in_timedsync;
+    int64_t m_peerlist_sent_time; //!< when our peerlist was last sent, later syncs only send what changed since
   };
 
   template<class t_payload_net_handler>
@@ -87,6 +88,7 @@ namespace nodetool
     m_hide_my_port(false),
     m_no_igd(false),
     m_offline(false),
+    m_read_only(false),
     m_save_graph(false),
     is_closing(false),
     m_net_server( epee::net_utils::e_connection_type_P2P ) // this is a P2P connection of the main p2p node server, because this is class node_server<>
@@ -125,7 +127,10 @@ namespace nodetool
     void delete_in_connections(size_t count);
     virtual bool block_host(const epee::net_utils::network_address &adress, time_t seconds = P2P_IP_BLOCKTIME);
     virtual bool unblock_host(const epee::net_utils::network_address &address);
-    virtual std::map<std::string, time_t> get_blocked_hosts() { CRITICAL_REGION_LOCAL(m_blocked_hosts_lock); return m_blocked_hosts; }
+    virtual std::map<std::string, time_t> get_blocked_hosts() { return m_ban_list.get_hosts(time(nullptr)); }
+    virtual bool block_subnet(uint32_t ip, uint8_t bits, time_t seconds = P2P_IP_BLOCKTIME);
+    virtual bool unblock_subnet(uint32_t ip, uint8_t bits);
+    virtual std::map<std::string, time_t> get_blocked_subnets() { return m_ban_list.get_subnets(time(nullptr)); }
   private:
     const std::vector<std::string> m_seed_nodes_list =
     { ""
@@ -185,7 +190,9 @@ namespace nodetool
     virtual void request_callback(const epee::net_utils::connection_context_base& context);
     virtual void for_each_connection(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, uint32_t)> f);
     virtual bool for_connection(const boost::uuids::uuid&, std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, uint32_t)> f);
+    virtual void for_each_connection_command_stats(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, const std::vector<epee::levin::command_stats_snapshot>&)> f);
     virtual bool add_host_fail(const epee::net_utils::network_address &address);
+    virtual void add_peer_sync_rate(const epee::net_utils::connection_context_base& context, float rate);
     //----------------- i_connection_filter  --------------------------------------------------------
     virtual bool is_remote_host_allowed(const epee::net_utils::network_address &address);
     //-----------------------------------------------------------------------------------------------
@@ -294,6 +301,7 @@ namespace nodetool
     bool m_hide_my_port;
     bool m_no_igd;
     bool m_offline;
+    bool m_read_only; // the data dir belongs to another daemon, which saves the p2p state
     std::atomic<bool> m_save_graph;
     std::atomic<bool> is_closing;
     std::unique_ptr<boost::thread> mPeersLoggerThread;
@@ -327,8 +335,7 @@ namespace nodetool
     std::map<epee::net_utils::network_address, time_t> m_conn_fails_cache;
     epee::critical_section m_conn_fails_cache_lock;
 
-    epee::critical_section m_blocked_hosts_lock;
-    std::map<std::string, time_t> m_blocked_hosts;
+    ban_list m_ban_list;
 
     epee::critical_section m_host_fails_score_lock;
     std::map<std::string, uint64_t> m_host_fails_score;
@@ -359,6 +366,8 @@ namespace nodetool
     extern const command_line::arg_descriptor<int64_t> arg_limit_rate;
 
     extern const command_line::arg_descriptor<bool> arg_save_graph;
+
+    extern const command_line::arg_descriptor<uint32_t> arg_p2p_io_shards;
 }
 
 POP_WARNINGS
@@ -85,6 +85,7 @@ namespace nodetool
     command_line::add_arg(desc, arg_limit_rate_down);
     command_line::add_arg(desc, arg_limit_rate);
     command_line::add_arg(desc, arg_save_graph);
+    command_line::add_arg(desc, arg_p2p_io_shards);
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
@@ -167,19 +168,17 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::for_each_connection_command_stats(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, const std::vector<epee::levin::command_stats_snapshot>&)> f)
+  {
+    m_net_server.get_config_object().foreach_connection_command_stats([&](p2p_connection_context& cntx, const std::vector<epee::levin::command_stats_snapshot>& stats){
+      return f(cntx, cntx.peer_id, stats);
+    });
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_remote_host_allowed(const epee::net_utils::network_address &address)
   {
-    CRITICAL_REGION_LOCAL(m_blocked_hosts_lock);
-    auto it = m_blocked_hosts.find(address.host_str());
-    if(it == m_blocked_hosts.end())
-      return true;
-    if(time(nullptr) >= it->second)
-    {
-      m_blocked_hosts.erase(it);
-      MCLOG_CYAN(el::Level::Info, "global", "Host " << address.host_str() << " unblocked.");
-      return true;
-    }
-    return false;
+    return !m_ban_list.is_banned(address, time(nullptr));
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
@@ -198,8 +197,7 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::block_host(const epee::net_utils::network_address &addr, time_t seconds)
   {
-    CRITICAL_REGION_LOCAL(m_blocked_hosts_lock);
-    m_blocked_hosts[addr.host_str()] = time(nullptr) + seconds;
+    m_ban_list.ban_host(addr, time(nullptr) + seconds);
 
     // drop any connection to that IP
     std::list<boost::uuids::uuid> conns;
@@ -221,16 +219,44 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::unblock_host(const epee::net_utils::network_address &address)
   {
-    CRITICAL_REGION_LOCAL(m_blocked_hosts_lock);
-    auto i = m_blocked_hosts.find(address.host_str());
-    if (i == m_blocked_hosts.end())
+    if (!m_ban_list.unban_host(address))
       return false;
-    m_blocked_hosts.erase(i);
     MCLOG_CYAN(el::Level::Info, "global", "Host " << address.host_str() << " unblocked.");
     return true;
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::block_subnet(uint32_t ip, uint8_t bits, time_t seconds)
+  {
+    const time_t now = time(nullptr);
+    if (!m_ban_list.ban_subnet(ip, bits, now + seconds))
+      return false;
+
+    // drop any connection from that subnet
+    std::list<boost::uuids::uuid> conns;
+    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
+    {
+      if (m_ban_list.is_banned(cntxt.m_remote_address, now))
+        conns.push_back(cntxt.m_connection_id);
+      return true;
+    });
+    for (const auto &c: conns)
+      m_net_server.get_config_object().close(c);
+
+    MCLOG_CYAN(el::Level::Info, "global", "Subnet " << ban_list::subnet_to_string(ip, bits) << " blocked.");
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::unblock_subnet(uint32_t ip, uint8_t bits)
+  {
+    if (!m_ban_list.unban_subnet(ip, bits))
+      return false;
+    MCLOG_CYAN(el::Level::Info, "global", "Subnet " << ban_list::subnet_to_string(ip, bits) << " unblocked.");
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::add_host_fail(const epee::net_utils::network_address &address)
   {
     CRITICAL_REGION_LOCAL(m_host_fails_score_lock);
@@ -247,6 +273,14 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::add_peer_sync_rate(const epee::net_utils::connection_context_base& context, float rate)
+  {
+    // only peers we connected to are in the peerlist under the address we see
+    if(!context.m_is_income)
+      m_peerlist.add_peer_sync_rate(context.m_remote_address, rate);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::parse_peer_from_string(epee::net_utils::network_address& pe, const std::string& node_addr, uint16_t default_port)
   {
     return epee::net_utils::create_network_address(pe, node_addr, default_port);
@@ -266,7 +300,8 @@ namespace nodetool
     m_external_port = command_line::get_arg(vm, arg_p2p_external_port);
     m_allow_local_ip = command_line::get_arg(vm, arg_p2p_allow_local_ip);
     m_no_igd = command_line::get_arg(vm, arg_no_igd);
-    m_offline = command_line::get_arg(vm, cryptonote::arg_offline);
+    m_read_only = command_line::get_arg(vm, cryptonote::arg_rpc_only_readonly_db);
+    m_offline = command_line::get_arg(vm, cryptonote::arg_offline) || m_read_only;
 
     if (command_line::has_arg(vm, arg_p2p_add_peer))
     {
@@ -338,6 +373,8 @@ namespace nodetool
     if ( !set_rate_limit(vm, command_line::get_arg(vm, arg_limit_rate) ) )
       return false;
 
+    m_net_server.set_io_shards(command_line::get_arg(vm, arg_p2p_io_shards));
+
     return true;
   }
   //-----------------------------------------------------------------------------------
@@ -441,68 +478,20 @@ namespace nodetool
       // TODO: at some point add IPv6 support, but that won't be relevant
       // for some time yet.
 
-      std::vector<std::vector<std::string>> dns_results;
-      dns_results.resize(m_seed_nodes_list.size());
-
-      std::list<boost::thread> dns_threads;
-      uint64_t result_index = 0;
-      for (const std::string& addr_str : m_seed_nodes_list)
-      {
-        boost::thread th = boost::thread([=, &dns_results, &addr_str]
-        {
-          MDEBUG("dns_threads[" << result_index << "] created for: " << addr_str);
-          // TODO: care about dnssec avail/valid
-          bool avail, valid;
-          std::vector<std::string> addr_list;
-
-          try
-          {
-            addr_list = tools::DNSResolver::instance().get_ipv4(addr_str, avail, valid);
-            MDEBUG("dns_threads[" << result_index << "] DNS resolve done");
-            boost::this_thread::interruption_point();
-          }
-          catch(const boost::thread_interrupted&)
-          {
-            // thread interruption request
-            // even if we now have results, finish thread without setting
-            // result variables, which are now out of scope in main thread
-            MWARNING("dns_threads[" << result_index << "] interrupted");
-            return;
-          }
-
-          MINFO("dns_threads[" << result_index << "] addr_str: " << addr_str << "  number of results: " << addr_list.size());
-          dns_results[result_index] = addr_list;
-        });
-
-        dns_threads.push_back(std::move(th));
-        ++result_index;
-      }
-
-      MDEBUG("dns_threads created, now waiting for completion or timeout of " << CRYPTONOTE_DNS_TIMEOUT_MS << "ms");
-      boost::chrono::system_clock::time_point deadline = boost::chrono::system_clock::now() + boost::chrono::milliseconds(CRYPTONOTE_DNS_TIMEOUT_MS);
-      uint64_t i = 0;
-      for (boost::thread& th : dns_threads)
-      {
-        if (! th.try_join_until(deadline))
-        {
-          MWARNING("dns_threads[" << i << "] timed out, sending interrupt");
-          th.interrupt();
-        }
-        ++i;
-      }
-
-      i = 0;
-      for (const auto& result : dns_results)
+      // all names are queried at once, and addresses are added as each
+      // answer arrives; whatever is still outstanding at the deadline is dropped
+      MDEBUG("Resolving " << m_seed_nodes_list.size() << " seed node names, timeout " << CRYPTONOTE_DNS_TIMEOUT_MS << "ms");
+      const size_t answered = tools::DNSResolver::instance().get_ipv4(m_seed_nodes_list,
+        [this, &full_addrs](size_t i, const std::vector<std::string> &result, bool avail, bool valid)
       {
+        // TODO: care about dnssec avail/valid
         MDEBUG("DNS lookup for " << m_seed_nodes_list[i] << ": " << result.size() << " results");
-        // if no results for node, thread's lookup likely timed out
-        if (result.size())
-        {
-          for (const auto& addr_string : result)
-            full_addrs.insert(addr_string + ":" + std::to_string(cryptonote::get_config(m_nettype).P2P_DEFAULT_PORT));
-        }
-        ++i;
-      }
+        for (const auto& addr_string : result)
+          full_addrs.insert(addr_string + ":" + std::to_string(cryptonote::get_config(m_nettype).P2P_DEFAULT_PORT));
+        return true;
+      }, CRYPTONOTE_DNS_TIMEOUT_MS);
+      if (answered < m_seed_nodes_list.size())
+        MWARNING((m_seed_nodes_list.size() - answered) << " seed node DNS lookups failed or timed out");
 
       // append the fallback nodes if we have too few seed nodes to start with
       if (full_addrs.size() < MIN_WANTED_SEED_NODES)
@@ -539,6 +528,7 @@ namespace nodetool
 
     res = m_peerlist.init(m_allow_local_ip);
     CHECK_AND_ASSERT_MES(res, false, "Failed to init peerlist.");
+    m_peerlist.set_ban_list(&m_ban_list);
 
 
     for(auto& p: m_command_line_peers)
@@ -657,6 +647,8 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::store_config()
   {
+    if (m_read_only)
+      return true;
 
     TRY_ENTRY();
     if (!tools::create_directories_if_necessary(m_config_folder))
@@ -926,10 +918,13 @@ namespace nodetool
     const epee::net_utils::ipv4_network_address &ipv4 = na.as<const epee::net_utils::ipv4_network_address>();
 
     typename net_server::t_connection_context con = AUTO_VAL_INIT(con);
+    const boost::posix_time::ptime connect_start = boost::posix_time::microsec_clock::universal_time();
     bool res = m_net_server.connect(epee::string_tools::get_ip_string_from_int32(ipv4.ip()),
       epee::string_tools::num_to_string_fast(ipv4.port()),
       m_config.m_net_config.connection_timeout,
       con);
+    // the TCP connect takes about one round trip
+    const uint32_t rtt_ms = (boost::posix_time::microsec_clock::universal_time() - connect_start).total_milliseconds();
 
     if(!res)
     {
@@ -937,6 +932,7 @@ namespace nodetool
       LOG_PRINT_CC_PRIORITY_NODE(is_priority, con, "Connect failed to " << na.str()
         /*<< ", try " << try_count*/);
       //m_peerlist.set_peer_unreachable(pe);
+      m_peerlist.add_peer_connect_result(na, false, 0);
       return false;
     }
 
@@ -949,6 +945,7 @@ namespace nodetool
       LOG_PRINT_CC_PRIORITY_NODE(is_priority, con, "Failed to HANDSHAKE with peer "
         << na.str()
         /*<< ", try " << try_count*/);
+      m_peerlist.add_peer_connect_result(na, false, 0);
       return false;
     }
 
@@ -967,6 +964,7 @@ namespace nodetool
     pe_local.last_seen = static_cast<int64_t>(last_seen);
     m_peerlist.append_with_peer_white(pe_local);
     //update last seen and push it to peerlist manager
+    m_peerlist.add_peer_connect_result(na, true, rtt_ms);
 
     anchor_peerlist_entry ape = AUTO_VAL_INIT(ape);
     ape.adr = na;
@@ -1089,7 +1087,7 @@ namespace nodetool
     while(rand_count < (max_random_index+1)*3 &&  try_count < 10 && !m_net_server.is_stop_signal_sent())
     {
       ++rand_count;
-      size_t random_index;
+      size_t random_index, other_index;
 
       if (use_white_list) {
         local_peers_count = m_peerlist.get_white_peers_count();
@@ -1097,23 +1095,38 @@ namespace nodetool
           return false;
         max_random_index = std::min<uint64_t>(local_peers_count -1, 20);
         random_index = get_random_index_with_fixed_probability(max_random_index);
+        other_index = get_random_index_with_fixed_probability(max_random_index);
       } else {
         local_peers_count = m_peerlist.get_gray_peers_count();
         if (!local_peers_count)
           return false;
         random_index = crypto::rand<size_t>() % local_peers_count;
+        other_index = crypto::rand<size_t>() % local_peers_count;
       }
 
-      CHECK_AND_ASSERT_MES(random_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
+      CHECK_AND_ASSERT_MES(random_index < local_peers_count && other_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
 
+      if(tried_peers.count(random_index))
+        std::swap(random_index, other_index);
       if(tried_peers.count(random_index))
         continue;
 
-      tried_peers.insert(random_index);
       peerlist_entry pe = AUTO_VAL_INIT(pe);
       bool r = use_white_list ? m_peerlist.get_white_peer_by_index(pe, random_index):m_peerlist.get_gray_peer_by_index(pe, random_index);
       CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
 
+      // of two random candidates, go for the one that has been faster and more reliable so far
+      peerlist_entry other_pe = AUTO_VAL_INIT(other_pe);
+      if(other_index != random_index && !tried_peers.count(other_index) &&
+          (use_white_list ? m_peerlist.get_white_peer_by_index(other_pe, other_index):m_peerlist.get_gray_peer_by_index(other_pe, other_index)) &&
+          m_peerlist.get_peer_score(other_pe.adr) > m_peerlist.get_peer_score(pe.adr))
+      {
+        random_index = other_index;
+        pe = other_pe;
+      }
+
+      tried_peers.insert(random_index);
+
       ++try_count;
 
       _note("Considering connecting (out) to peer: " << peerid_to_string(pe.id) << " " << pe.adr.str());
@@ -1499,9 +1512,11 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections)
   {
+    // frame the message once; every connection queues the same buffer
+    const std::shared_ptr<const std::string> message = m_net_server.get_config_object().make_notify_buffer(command, data_buff);
     for(const auto& c_id: connections)
     {
-      m_net_server.get_config_object().notify(command, data_buff, c_id);
+      m_net_server.get_config_object().send_notify(message, c_id);
     }
     return true;
   }
@@ -1653,11 +1668,13 @@ namespace nodetool
       return 1;
     }
 
-    //fill response
+    //fill response, with only the entries seen since the last time this
+    //peer got our peerlist: it merged the older ones already
     rsp.local_time = time(NULL);
-    m_peerlist.get_peerlist_head(rsp.local_peerlist_new);
+    m_peerlist.get_peerlist_head(rsp.local_peerlist_new, P2P_DEFAULT_PEERS_IN_HANDSHAKE, context.m_peerlist_sent_time);
+    context.m_peerlist_sent_time = rsp.local_time;
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
-    LOG_DEBUG_CC(context, "COMMAND_TIMED_SYNC");
+    LOG_DEBUG_CC(context, "COMMAND_TIMED_SYNC, " << rsp.local_peerlist_new.size() << " peerlist entries");
     return 1;
   }
   //-----------------------------------------------------------------------------------
@@ -1743,6 +1760,7 @@ namespace nodetool
     //fill response
     m_peerlist.get_peerlist_head(rsp.local_peerlist_new);
     get_local_node_data(rsp.node_data);
+    context.m_peerlist_sent_time = rsp.node_data.local_time;
     m_payload_handler.get_payload_sync_data(rsp.payload_data);
     LOG_DEBUG_CC(context, "COMMAND_HANDSHAKE");
     return 1;
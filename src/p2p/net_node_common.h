@@ -32,6 +32,7 @@
 #pragma once
 
 #include <boost/uuid/uuid.hpp>
+#include "net/levin_base.h"
 #include "net/net_utils_base.h"
 #include "p2p_protocol_defs.h"
 
@@ -53,10 +54,15 @@ namespace nodetool
     virtual uint64_t get_connections_count()=0;
     virtual void for_each_connection(std::function<bool(t_connection_context&, peerid_type, uint32_t)> f)=0;
     virtual bool for_connection(const boost::uuids::uuid&, std::function<bool(t_connection_context&, peerid_type, uint32_t)> f)=0;
+    virtual void for_each_connection_command_stats(std::function<bool(t_connection_context&, peerid_type, const std::vector<epee::levin::command_stats_snapshot>&)> f)=0;
     virtual bool block_host(const epee::net_utils::network_address &address, time_t seconds = 0)=0;
     virtual bool unblock_host(const epee::net_utils::network_address &address)=0;
     virtual std::map<std::string, time_t> get_blocked_hosts()=0;
+    virtual bool block_subnet(uint32_t ip, uint8_t bits, time_t seconds = 0)=0;
+    virtual bool unblock_subnet(uint32_t ip, uint8_t bits)=0;
+    virtual std::map<std::string, time_t> get_blocked_subnets()=0;
     virtual bool add_host_fail(const epee::net_utils::network_address &address)=0;
+    virtual void add_peer_sync_rate(const epee::net_utils::connection_context_base& context, float rate)=0;
   };
 
   template<class t_connection_context>
@@ -94,6 +100,10 @@ namespace nodetool
     {
       return false;
     }
+    virtual void for_each_connection_command_stats(std::function<bool(t_connection_context&,peerid_type,const std::vector<epee::levin::command_stats_snapshot>&)> f)
+    {
+
+    }
 
     virtual uint64_t get_connections_count()    
     {
@@ -111,9 +121,24 @@ namespace nodetool
     {
       return std::map<std::string, time_t>();
     }
+    virtual bool block_subnet(uint32_t ip, uint8_t bits, time_t seconds)
+    {
+      return true;
+    }
+    virtual bool unblock_subnet(uint32_t ip, uint8_t bits)
+    {
+      return true;
+    }
+    virtual std::map<std::string, time_t> get_blocked_subnets()
+    {
+      return std::map<std::string, time_t>();
+    }
     virtual bool add_host_fail(const epee::net_utils::network_address &address)
     {
       return true;
     }
+    virtual void add_peer_sync_rate(const epee::net_utils::connection_context_base& context, float rate)
+    {
+    }
   };
 }
@@ -50,10 +50,12 @@
 #include "net/local_ip.h"
 #include "p2p_protocol_defs.h"
 #include "cryptonote_config.h"
+#include "common/memory_usage.h"
 #include "net_peerlist_boost_serialization.h"
+#include "net_ban_list.h"
 
 
-#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    6
+#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    7
 
 namespace nodetool
 {
@@ -66,11 +68,12 @@ namespace nodetool
   {
   public: 
     bool init(bool allow_local_ip);
+    void set_ban_list(const ban_list *bans) { m_ban_list = bans; }
     bool deinit();
     size_t get_white_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_white.size();}
     size_t get_gray_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_gray.size();}
     bool merge_peerlist(const std::list<peerlist_entry>& outer_bs);
-    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE);
+    bool get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth = P2P_DEFAULT_PEERS_IN_HANDSHAKE, int64_t since = 0);
     bool get_peerlist_full(std::list<peerlist_entry>& pl_gray, std::list<peerlist_entry>& pl_white);
     bool get_white_peer_by_index(peerlist_entry& p, size_t i);
     bool get_gray_peer_by_index(peerlist_entry& p, size_t i);
@@ -84,6 +87,12 @@ namespace nodetool
     bool remove_from_peer_gray(const peerlist_entry& pe);
     bool get_and_empty_anchor_peerlist(std::vector<anchor_peerlist_entry>& apl);
     bool remove_from_peer_anchor(const epee::net_utils::network_address& addr);
+    void add_peer_connect_result(const epee::net_utils::network_address& addr, bool success, uint32_t rtt_ms);
+    void add_peer_sync_rate(const epee::net_utils::network_address& addr, float rate);
+    bool get_peer_stats(const epee::net_utils::network_address& addr, peer_stats& stats);
+    double get_peer_score(const epee::net_utils::network_address& addr);
+    static double get_peer_score(const peer_stats& stats);
+    void get_memory_usage(std::vector<tools::memory_usage> &usage);
     
   private:
     struct by_time{};
@@ -201,22 +210,57 @@ namespace nodetool
       serialize_peers(a, m_peers_gray, peerlist_entry(), ver);
       serialize_peers(a, m_peers_anchor, anchor_peerlist_entry(), ver);
 #endif
+
+      // v7 adds what we measured about the peers
+      if (ver < 7)
+        return;
+      if (typename Archive::is_saving())
+      {
+        uint64_t size = m_peer_stats.size();
+        a & size;
+        for (auto &e: m_peer_stats)
+        {
+          epee::net_utils::network_address adr = e.first;
+          peer_stats stats = e.second;
+          a & adr;
+          a & stats;
+        }
+      }
+      else
+      {
+        uint64_t size;
+        a & size;
+        m_peer_stats.clear();
+        while (size--)
+        {
+          epee::net_utils::network_address adr;
+          peer_stats stats;
+          a & adr;
+          a & stats;
+          if (is_peer_listed(adr))
+            m_peer_stats[adr] = stats;
+        }
+      }
     }
 
   private: 
     bool peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi);
     void trim_white_peerlist();
     void trim_gray_peerlist();
+    bool is_peer_listed(const epee::net_utils::network_address& addr);
+    void drop_peer_stats_if_unlisted(const epee::net_utils::network_address& addr);
 
     friend class boost::serialization::access;
     epee::critical_section m_peerlist_lock;
     std::string m_config_folder;
     bool m_allow_local_ip;
+    const ban_list *m_ban_list = nullptr;
 
 
     peers_indexed m_peers_gray;
     peers_indexed m_peers_white;
     anchor_peers_indexed m_peers_anchor;
+    std::map<epee::net_utils::network_address, peer_stats> m_peer_stats; // only for addresses in the white or gray list
   };
   //--------------------------------------------------------------------------------------------------
   inline
@@ -252,7 +296,9 @@ namespace nodetool
     while(m_peers_gray.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
     {
       peers_indexed::index<by_time>::type& sorted_index=m_peers_gray.get<by_time>();
+      const epee::net_utils::network_address adr = sorted_index.begin()->adr;
       sorted_index.erase(sorted_index.begin());
+      drop_peer_stats_if_unlisted(adr);
     }
   }
   //--------------------------------------------------------------------------------------------------
@@ -261,16 +307,25 @@ namespace nodetool
     while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
     {
       peers_indexed::index<by_time>::type& sorted_index=m_peers_white.get<by_time>();
+      const epee::net_utils::network_address adr = sorted_index.begin()->adr;
       sorted_index.erase(sorted_index.begin());
+      drop_peer_stats_if_unlisted(adr);
     }
   }
   //--------------------------------------------------------------------------------------------------
   inline 
   bool peerlist_manager::merge_peerlist(const std::list<peerlist_entry>& outer_bs)
   {
+    // honest peers send at most a handshake's worth, the rest are ignored
+    // so a peer can't hold the lock for long
+    if (outer_bs.size() > P2P_DEFAULT_PEERS_IN_HANDSHAKE)
+      MDEBUG("Merging only " << P2P_DEFAULT_PEERS_IN_HANDSHAKE << " of " << outer_bs.size() << " peerlist entries");
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    size_t n = 0;
     for(const peerlist_entry& be:  outer_bs)
     {
+      if (n++ >= P2P_DEFAULT_PEERS_IN_HANDSHAKE)
+        break;
       append_with_peer_gray(be);
     }
     // delete extra elements
@@ -312,11 +367,14 @@ namespace nodetool
     if(!m_allow_local_ip && address.is_local())
       return false;
 
+    if(m_ban_list && m_ban_list->is_banned(address, time(nullptr)))
+      return false;
+
     return true;
   }
   //--------------------------------------------------------------------------------------------------
   inline 
-  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth)
+  bool peerlist_manager::get_peerlist_head(std::list<peerlist_entry>& bs_head, uint32_t depth, int64_t since)
   {
     
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
@@ -327,6 +385,10 @@ namespace nodetool
       if(!vl.last_seen)
         continue;
 
+      // newest first, so the rest did not change either
+      if(vl.last_seen < since)
+        break;
+
       if(cnt++ >= depth)
         break;
 
@@ -477,6 +539,7 @@ namespace nodetool
 
     if (iterator != m_peers_gray.get<by_addr>().end()) {
       m_peers_gray.erase(iterator);
+      drop_peer_stats_if_unlisted(pe.adr);
     }
 
     return true;
@@ -523,6 +586,96 @@ namespace nodetool
     CATCH_ENTRY_L0("peerlist_manager::remove_from_peer_anchor()", false);
   }
   //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::is_peer_listed(const epee::net_utils::network_address& addr)
+  {
+    return m_peers_white.get<by_addr>().count(addr) || m_peers_gray.get<by_addr>().count(addr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::drop_peer_stats_if_unlisted(const epee::net_utils::network_address& addr)
+  {
+    if (!is_peer_listed(addr))
+      m_peer_stats.erase(addr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::add_peer_connect_result(const epee::net_utils::network_address& addr, bool success, uint32_t rtt_ms)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    if (!is_peer_listed(addr))
+      return;
+    peer_stats &stats = m_peer_stats[addr];
+    // halve old counts once they get large, so a peer that went bad (or got better) is noticed
+    if (stats.successes + stats.failures >= 32)
+    {
+      stats.successes /= 2;
+      stats.failures /= 2;
+    }
+    if (success)
+    {
+      ++stats.successes;
+      stats.rtt_ms = stats.rtt_ms ? (stats.rtt_ms * 3 + rtt_ms) / 4 : std::max<uint32_t>(rtt_ms, 1);
+    }
+    else
+    {
+      ++stats.failures;
+    }
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::add_peer_sync_rate(const epee::net_utils::network_address& addr, float rate)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    if (!is_peer_listed(addr))
+      return;
+    peer_stats &stats = m_peer_stats[addr];
+    stats.sync_rate = stats.sync_rate > 0 ? stats.sync_rate * 0.75f + rate * 0.25f : rate;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  bool peerlist_manager::get_peer_stats(const epee::net_utils::network_address& addr, peer_stats& stats)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    const auto i = m_peer_stats.find(addr);
+    if (i == m_peer_stats.end())
+      return false;
+    stats = i->second;
+    return true;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  double peerlist_manager::get_peer_score(const epee::net_utils::network_address& addr)
+  {
+    peer_stats stats;
+    get_peer_stats(addr, stats);
+    return get_peer_score(stats);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  double peerlist_manager::get_peer_score(const peer_stats& stats)
+  {
+    // peers we know nothing about score as a half reliable peer 500 ms away that never sent us blocks
+    const double reliability = (stats.successes + 1.0) / (stats.successes + stats.failures + 2.0);
+    const double rtt = stats.rtt_ms ? stats.rtt_ms : 500;
+    const double rate = std::min<double>(stats.sync_rate, 4 * 1024 * 1024);
+    return reliability * (1.0 + rate / (1024 * 1024)) / (1.0 + rtt / 1000);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::get_memory_usage(std::vector<tools::memory_usage> &usage)
+  {
+    // entries sit in a node per index, and each address holds its own heap allocated implementation
+    const auto entry_bytes = [](size_t n, size_t value_size, size_t indices) {
+      return n * (uint64_t)(value_size + indices * 3 * sizeof(void*) + 64);
+    };
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    usage.push_back({"p2p.peerlist_white", m_peers_white.size(), entry_bytes(m_peers_white.size(), sizeof(peerlist_entry), 2), P2P_LOCAL_WHITE_PEERLIST_LIMIT, 0});
+    usage.push_back({"p2p.peerlist_gray", m_peers_gray.size(), entry_bytes(m_peers_gray.size(), sizeof(peerlist_entry), 2), P2P_LOCAL_GRAY_PEERLIST_LIMIT, 0});
+    usage.push_back({"p2p.peerlist_anchor", m_peers_anchor.size(), entry_bytes(m_peers_anchor.size(), sizeof(anchor_peerlist_entry), 2), 0, 0});
+    usage.push_back({"p2p.peer_stats", m_peer_stats.size(), entry_bytes(m_peer_stats.size(), sizeof(decltype(m_peer_stats)::value_type), 1), 0, 0});
+  }
+  //--------------------------------------------------------------------------------------------------
 }
 
 BOOST_CLASS_VERSION(nodetool::peerlist_manager, CURRENT_PEERLIST_STORAGE_ARCHIVE_VER)
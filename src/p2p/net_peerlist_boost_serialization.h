@@ -80,6 +80,15 @@ namespace boost
       a & pl.last_seen;
     }
 
+    template <class Archive, class ver_type>
+    inline void serialize(Archive &a, nodetool::peer_stats& ps, const ver_type ver)
+    {
+      a & ps.rtt_ms;
+      a & ps.sync_rate;
+      a & ps.successes;
+      a & ps.failures;
+    }
+
     template <class Archive, class ver_type>
     inline void serialize(Archive &a, nodetool::anchor_peerlist_entry& pl, const ver_type ver)
     {
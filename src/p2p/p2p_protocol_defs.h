@@ -97,6 +97,17 @@ namespace nodetool
   };
   typedef anchor_peerlist_entry_base<epee::net_utils::network_address> anchor_peerlist_entry;
 
+  // what we measured ourselves about a peer we connect out to, never sent to other peers
+  struct peer_stats
+  {
+    uint32_t rtt_ms; // smoothed TCP connect time
+    float sync_rate; // smoothed block download rate, bytes/s
+    uint32_t successes;
+    uint32_t failures;
+
+    peer_stats(): rtt_ms(0), sync_rate(0), successes(0), failures(0) {}
+  };
+
   template<typename AddressType>
   struct connection_entry_base
   {
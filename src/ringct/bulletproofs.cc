@@ -29,6 +29,7 @@
 // Adapted from Java code by Sarang Noether
 
 #include <stdlib.h>
+#include <atomic>
 #include <openssl/ssl.h>
 #include <openssl/bn.h>
 #include <boost/thread/mutex.hpp>
@@ -50,7 +51,7 @@ extern "C"
 
 #define PERF_TIMER_START_BP(x) PERF_TIMER_START_UNIT(x, 1000000)
 
-#define STRAUS_SIZE_LIMIT 128
+#define STRAUS_SIZE_LIMIT STRAUS_CACHED_MAX_POINTS
 #define PIPPENGER_SIZE_LIMIT 0
 
 namespace rct
@@ -74,16 +75,14 @@ static const rct::keyV oneN = vector_dup(rct::identity(), maxN);
 static const rct::keyV twoN = vector_powers(TWO, maxN);
 static const rct::key ip12 = inner_product(oneN, twoN);
 static boost::mutex init_mutex;
+static std::atomic<bool> init_done(false);
 
 static inline rct::key multiexp(const std::vector<MultiexpData> &data, bool HiGi)
 {
   if (HiGi)
-  {
-    static_assert(128 <= STRAUS_SIZE_LIMIT, "Straus in precalc mode can only be calculated till STRAUS_SIZE_LIMIT");
-    return data.size() <= 128 ? straus(data, straus_HiGi_cache, 0) : pippenger(data, pippenger_HiGi_cache, get_pippenger_c(data.size()));
-  }
+    return rct::multiexp(data, straus_HiGi_cache, pippenger_HiGi_cache);
   else
-    return data.size() <= 64 ? straus(data, NULL, 0) : pippenger(data, NULL, get_pippenger_c(data.size()));
+    return rct::multiexp(data, NULL, NULL);
 }
 
 static bool is_reduced(const rct::key &scalar)
@@ -147,10 +146,11 @@ static rct::key get_exponent(const rct::key &base, size_t idx)
 
 static void init_exponents()
 {
+  // the tables are built once per process, skip the lock once they are
+  if (init_done.load(std::memory_order_acquire))
+    return;
   boost::lock_guard<boost::mutex> lock(init_mutex);
-
-  static bool init_done = false;
-  if (init_done)
+  if (init_done.load(std::memory_order_relaxed))
     return;
   std::vector<MultiexpData> data;
   for (size_t i = 0; i < maxN*maxM; ++i)
@@ -173,7 +173,7 @@ static void init_exponents()
   MINFO("Pippenger cache size: " << pippenger_get_cache_size(pippenger_HiGi_cache)/1024 << " kB");
   size_t cache_size = (sizeof(Hi)+sizeof(Hi_p3))*2 + straus_get_cache_size(straus_HiGi_cache) + pippenger_get_cache_size(pippenger_HiGi_cache);
   MINFO("Total cache size: " << cache_size/1024 << "kB");
-  init_done = true;
+  init_done.store(true, std::memory_order_release);
 }
 
 /* Given two scalar arrays, construct a vector commitment */
@@ -449,7 +449,7 @@ Bulletproof bulletproof_PROVE(const rct::key &sv, const rct::key &gamma)
   rct::keyV aL(N), aR(N);
 
   PERF_TIMER_START_BP(PROVE_v);
-  rct::addKeys2(V, gamma, sv, rct::H);
+  rct::addKeysGH(V, gamma, sv);
   V = rct::scalarmultKey(V, INV_EIGHT);
   PERF_TIMER_STOP(PROVE_v);
 
@@ -575,9 +575,11 @@ try_again:
   // PAPER LINES 47-48
   rct::key tau1 = rct::skGen(), tau2 = rct::skGen();
 
-  rct::key T1 = rct::addKeys(rct::scalarmultH(t1), rct::scalarmultBase(tau1));
+  rct::key T1;
+  rct::addKeysGH(T1, tau1, t1);
   T1 = rct::scalarmultKey(T1, INV_EIGHT);
-  rct::key T2 = rct::addKeys(rct::scalarmultH(t2), rct::scalarmultBase(tau2));
+  rct::key T2;
+  rct::addKeysGH(T2, tau2, t2);
   T2 = rct::scalarmultKey(T2, INV_EIGHT);
 
   // PAPER LINES 49-51
@@ -733,7 +735,7 @@ Bulletproof bulletproof_PROVE(const rct::keyV &sv, const rct::keyV &gamma)
   PERF_TIMER_START_BP(PROVE_v);
   for (size_t i = 0; i < sv.size(); ++i)
   {
-    rct::addKeys2(V[i], gamma[i], sv[i], rct::H);
+    rct::addKeysGH(V[i], gamma[i], sv[i]);
     V[i] = rct::scalarmultKey(V[i], INV_EIGHT);
   }
   PERF_TIMER_STOP(PROVE_v);
@@ -856,9 +858,11 @@ try_again:
   // PAPER LINES 47-48
   rct::key tau1 = rct::skGen(), tau2 = rct::skGen();
 
-  rct::key T1 = rct::addKeys(rct::scalarmultH(t1), rct::scalarmultBase(tau1));
+  rct::key T1;
+  rct::addKeysGH(T1, tau1, t1);
   T1 = rct::scalarmultKey(T1, INV_EIGHT);
-  rct::key T2 = rct::addKeys(rct::scalarmultH(t2), rct::scalarmultBase(tau2));
+  rct::key T2;
+  rct::addKeysGH(T2, tau2, t2);
   T2 = rct::scalarmultKey(T2, INV_EIGHT);
 
   // PAPER LINES 49-51
@@ -662,4 +662,26 @@ rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<
   return res;
 }
 
+static size_t straus_get_cache_points(const std::shared_ptr<straus_cached_data> &cache)
+{
+#ifdef RAW_MEMORY_BLOCK
+  return cache->size;
+#elif defined(ALTERNATE_LAYOUT)
+  return cache->multiples.size();
+#else
+  return cache->multiples.empty() ? 0 : cache->multiples[1].size();
+#endif
+}
+
+rct::key multiexp(const std::vector<MultiexpData> &data, const std::shared_ptr<straus_cached_data> &straus_cache, const std::shared_ptr<pippenger_cached_data> &pippenger_cache)
+{
+  // straus wins on small sets, and precomputed multiples push the crossover up
+  const size_t N = data.size();
+  const bool straus_cached = straus_cache && straus_get_cache_points(straus_cache) >= N;
+  if (N <= (straus_cached ? STRAUS_CACHED_MAX_POINTS : STRAUS_MAX_POINTS))
+    return straus(data, straus_cached ? straus_cache : NULL, 0);
+  const bool pippenger_cached = pippenger_cache && pippenger_cache->size >= N;
+  return pippenger(data, pippenger_cached ? pippenger_cache : NULL, get_pippenger_c(N));
+}
+
 }
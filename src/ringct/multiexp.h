@@ -66,6 +66,12 @@ size_t pippenger_get_cache_size(const std::shared_ptr<pippenger_cached_data> &ca
 size_t get_pippenger_c(size_t N);
 rct::key pippenger(const std::vector<MultiexpData> &data, const std::shared_ptr<pippenger_cached_data> &cache = NULL, size_t c = 0);
 
+// up to how many points straus beats pippenger, without and with precomputed multiples
+static constexpr size_t STRAUS_MAX_POINTS = 64;
+static constexpr size_t STRAUS_CACHED_MAX_POINTS = 128;
+// picks straus or pippenger depending on data size, using a cache if it covers the data
+rct::key multiexp(const std::vector<MultiexpData> &data, const std::shared_ptr<straus_cached_data> &straus_cache, const std::shared_ptr<pippenger_cached_data> &pippenger_cache);
+
 }
 
 #endif
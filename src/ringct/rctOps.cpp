@@ -41,6 +41,45 @@ using namespace std;
 
 namespace rct {
 
+    namespace {
+        // H in the fixed-base table layout ref10 uses for G
+        struct H_table_t {
+            ge_precomp table[32][8];
+            H_table_t() { ge_base_table_init(table, &ge_p3_H); }
+        };
+
+        const H_table_t &get_H_table() {
+            static const H_table_t H_table;
+            return H_table;
+        }
+
+        const ge_p3 &get_G_p3() {
+            static const ge_p3 G_p3 = [](){
+                ge_p3 p3;
+                CHECK_AND_ASSERT_THROW_MES_L1(ge_frombytes_vartime(&p3, G.bytes) == 0, "ge_frombytes_vartime failed at "+boost::lexical_cast<std::string>(__LINE__));
+                return p3;
+            }();
+            return G_p3;
+        }
+
+        //the table walk needs a[31] <= 127, reducing first leaves aH unchanged as H has prime order
+        void scalarmultH_p3(ge_p3 &aH, const key &a) {
+            key reduced;
+            sc_reduce32copy(reduced.bytes, a.bytes);
+            ge_scalarmult_base_table(&aH, reduced.bytes, get_H_table().table);
+        }
+
+        void add_p3(key &AB, const ge_p3 &A, const ge_p3 &B) {
+            ge_cached tmp2;
+            ge_p1p1 tmp3;
+            ge_p3 sum;
+            ge_p3_to_cached(&tmp2, &B);
+            ge_add(&tmp3, &A, &tmp2);
+            ge_p1p1_to_p3(&sum, &tmp3);
+            ge_p3_tobytes(AB.bytes, &sum);
+        }
+    }
+
     //Various key initialization functions
 
     //initializes a key matrix;
@@ -117,8 +156,7 @@ namespace rct {
 
     //generates C =aG + bH from b, a is given..
     void genC(key & C, const key & a, xmr_amount amount) {
-        key bH = scalarmultH(d2h(amount));
-        addKeys1(C, a, bH);
+        addKeysGH(C, a, d2h(amount));
     }
 
     //generates a <secret , public> / Pedersen commitment to the amount
@@ -143,16 +181,16 @@ namespace rct {
     }
     
     key zeroCommit(xmr_amount amount) {
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        return addKeys(G, bH);
+        ge_p3 bH;
+        scalarmultH_p3(bH, d2h(amount));
+        key c;
+        add_p3(c, get_G_p3(), bH);
+        return c;
     }
 
     key commit(xmr_amount amount, const key &mask) {
-        key c = scalarmultBase(mask);
-        key am = d2h(amount);
-        key bH = scalarmultH(am);
-        addKeys(c, c, bH);
+        key c;
+        addKeysGH(c, mask, d2h(amount));
         return c;
     }
 
@@ -204,10 +242,10 @@ namespace rct {
 
     //Computes aH where H= toPoint(cn_fast_hash(G)), G the basepoint
     key scalarmultH(const key & a) {
-        ge_p2 R;
-        ge_scalarmult(&R, a.bytes, &ge_p3_H);
+        ge_p3 R;
+        scalarmultH_p3(R, a);
         key aP;
-        ge_tobytes(aP.bytes, &R);
+        ge_p3_tobytes(aP.bytes, &R);
         return aP;
     }
 
@@ -288,6 +326,23 @@ namespace rct {
         ge_tobytes(aGbB.bytes, &rv);
     }
 
+    //addKeys2 for an already decompressed B
+    void addKeys2(key &aGbB, const key &a, const key &b, const ge_p3 &B) {
+        ge_p2 rv;
+        ge_double_scalarmult_base_vartime(&rv, b.bytes, &B, a.bytes);
+        ge_tobytes(aGbB.bytes, &rv);
+    }
+
+    //aGbH = aG + bH, constant time through the fixed-base tables of G and H
+    void addKeysGH(key &aGbH, const key &a, const key &b) {
+        ge_p3 aG, bH;
+        key reduced;
+        sc_reduce32copy(reduced.bytes, a.bytes);
+        ge_scalarmult_base(&aG, reduced.bytes);
+        scalarmultH_p3(bH, b);
+        add_p3(aGbH, aG, bH);
+    }
+
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key & B) {
@@ -316,6 +371,15 @@ namespace rct {
         ge_tobytes(aAbB.bytes, &rv);
     }
 
+    //addKeys3
+    //aAbB = a*A + b*B where a, b are scalars, A, B are curve points
+    //A already decompressed, B must be input after applying "precomp"
+    void addKeys3(key &aAbB, const key &a, const ge_p3 &A, const key &b, const ge_dsmp B) {
+        ge_p2 rv;
+        ge_double_scalarmult_precomp_vartime(&rv, a.bytes, &A, b.bytes, B);
+        ge_tobytes(aAbB.bytes, &rv);
+    }
+
 
     //subtract Keys (subtracts curve points)
     //AB = A - B where A, B are curve points
@@ -476,6 +540,15 @@ namespace rct {
         ge_p3_tobytes(pointk.bytes, &res);
     }    
 
+    void hashToPoint(ge_p3 & res, const key & hh) {
+        ge_p2 point;
+        ge_p1p1 point2;
+        key h = cn_fast_hash(hh);
+        ge_fromfe_frombytes_vartime(&point, h.bytes);
+        ge_mul8(&point2, &point);
+        ge_p1p1_to_p3(&res, &point2);
+    }
+
     //sums a vector of curve points (for scalars use sc_add)
     void sumKeys(key & Csum, const keyV &  Cis) {
         identity(Csum);
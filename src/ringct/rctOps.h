@@ -137,6 +137,9 @@ namespace rct {
     void addKeys1(key &aGB, const key &a, const key & B);
     //aGbB = aG + bB where a, b are scalars, G is the basepoint and B is a point
     void addKeys2(key &aGbB, const key &a, const key &b, const key &B);
+    void addKeys2(key &aGbB, const key &a, const key &b, const ge_p3 &B);
+    //aGbH = aG + bH where a, b are scalars and G, H the commitment generators, in constant time
+    void addKeysGH(key &aGbH, const key &a, const key &b);
     //Does some precomputation to make addKeys3 more efficient
     // input B a curve point and output a ge_dsmp which has precomputation applied
     void precomp(ge_dsmp rv, const key &B);
@@ -144,6 +147,7 @@ namespace rct {
     //B must be input after applying "precomp"
     void addKeys3(key &aAbB, const key &a, const key &A, const key &b, const ge_dsmp B);
     void addKeys3(key &aAbB, const key &a, const ge_dsmp A, const key &b, const ge_dsmp B);
+    void addKeys3(key &aAbB, const key &a, const ge_p3 &A, const key &b, const ge_dsmp B);
     //AB = A - B where A, B are curve points
     void subKeys(key &AB, const key &A, const  key &B);
     //checks if A, B are equal as curve points
@@ -176,6 +180,8 @@ namespace rct {
     key hashToPointSimple(const key &in);
     key hashToPoint(const key &in);
     void hashToPoint(key &out, const key &in);
+    //hashToPoint left decompressed, for callers which go on to use it in curve operations
+    void hashToPoint(ge_p3 &out, const key &in);
 
     //sums a vector of curve points (for scalars use sc_add)
     void sumKeys(key & Csum, const key &Cis);
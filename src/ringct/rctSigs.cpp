@@ -44,6 +44,34 @@ using namespace std;
 
 #define CHECK_AND_ASSERT_MES_L1(expr, ret, message) {if(!(expr)) {MCERROR("verify", message); return ret;}}
 
+namespace
+{
+    // runs f(0)..f(n-1), on the threadpool if allowed, each writing to its own slot so the
+    // result does not depend on scheduling; the first exception by index is rethrown
+    template<typename F>
+    void run_indexed(size_t n, bool parallel, const F &f)
+    {
+        tools::threadpool& tpool = tools::threadpool::getInstance();
+        if (!parallel || n < 2 || tpool.get_max_concurrency() < 2)
+        {
+            for (size_t i = 0; i < n; ++i)
+                f(i);
+            return;
+        }
+        tools::threadpool::waiter waiter;
+        std::vector<std::exception_ptr> errors(n);
+        for (size_t i = 0; i < n; ++i)
+            tpool.submit(&waiter, [&f, &errors, i] {
+                try { f(i); }
+                catch (...) { errors[i] = std::current_exception(); }
+            });
+        waiter.wait(&tpool);
+        for (const std::exception_ptr &e: errors)
+            if (e)
+                std::rethrow_exception(e);
+    }
+}
+
 namespace rct {
     Bulletproof proveRangeBulletproof(key &C, key &mask, uint64_t amount)
     {
@@ -240,7 +268,10 @@ namespace rct {
     // Gen creates a signature which proves that for some column in the keymatrix "pk"
     //   the signer knows a secret key for each row in that column
     // Ver verifies that the MG sig was created correctly            
-    bool MLSAG_Ver(const key &message, const keyM & pk, const mgSig & rv, size_t dsRows) {
+    // This one also takes the keys of pk decompressed, pk_p3[i * rows + j]
+    // for pk[i][j], so they and the hashed points stay decompressed for the
+    // whole loop instead of going back and forth through their encodings
+    static bool MLSAG_Ver(const key &message, const keyM & pk, const std::vector<ge_p3> &pk_p3, const mgSig & rv, size_t dsRows) {
 
         size_t cols = pk.size();
         CHECK_AND_ASSERT_MES(cols >= 2, false, "Error! What is c if cols = 1!");
@@ -255,6 +286,7 @@ namespace rct {
           CHECK_AND_ASSERT_MES(rv.ss[i].size() == rows, false, "rv.ss is not rectangular");
         }
         CHECK_AND_ASSERT_MES(dsRows <= rows, false, "Bad dsRows value");
+        CHECK_AND_ASSERT_MES(pk_p3.size() == cols * rows, false, "Bad pk_p3 size");
 
         for (size_t i = 0; i < rv.ss.size(); ++i)
           for (size_t j = 0; j < rv.ss[i].size(); ++j)
@@ -262,7 +294,8 @@ namespace rct {
         CHECK_AND_ASSERT_MES(sc_check(rv.cc.bytes) == 0, false, "Bad cc");
 
         size_t i = 0, j = 0, ii = 0;
-        key c,  L, R, Hi;
+        key c,  L, R;
+        ge_p3 Hi;
         key c_old = copy(rv.cc);
         vector<geDsmp> Ip(dsRows);
         for (i = 0 ; i < dsRows ; i++) {
@@ -275,16 +308,16 @@ namespace rct {
         while (i < cols) {
             sc_0(c.bytes);
             for (j = 0; j < dsRows; j++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
+                addKeys2(L, rv.ss[i][j], c_old, pk_p3[i * rows + j]);
                 hashToPoint(Hi, pk[i][j]);
-                CHECK_AND_ASSERT_MES(!(Hi == rct::identity()), false, "Data hashed to point at infinity");
+                CHECK_AND_ASSERT_MES(!ge_p3_is_identity_vartime(&Hi), false, "Data hashed to point at infinity");
                 addKeys3(R, rv.ss[i][j], Hi, c_old, Ip[j].k);
                 toHash[3 * j + 1] = pk[i][j];
                 toHash[3 * j + 2] = L; 
                 toHash[3 * j + 3] = R;
             }
             for (j = dsRows, ii = 0 ; j < rows ; j++, ii++) {
-                addKeys2(L, rv.ss[i][j], c_old, pk[i][j]);
+                addKeys2(L, rv.ss[i][j], c_old, pk_p3[i * rows + j]);
                 toHash[ndsRows + 2 * ii + 1] = pk[i][j];
                 toHash[ndsRows + 2 * ii + 2] = L;
             }
@@ -295,6 +328,17 @@ namespace rct {
         sc_sub(c.bytes, c_old.bytes, rv.cc.bytes);
         return sc_isnonzero(c.bytes) == 0;  
     }
+
+    bool MLSAG_Ver(const key &message, const keyM & pk, const mgSig & rv, size_t dsRows) {
+        std::vector<ge_p3> pk_p3;
+        for (const keyV &column: pk) {
+            for (const key &k: column) {
+                pk_p3.emplace_back();
+                CHECK_AND_ASSERT_MES_L1(ge_frombytes_vartime(&pk_p3.back(), k.bytes) == 0, false, "point conv failed");
+            }
+        }
+        return MLSAG_Ver(message, pk, pk_p3, rv, dsRows);
+    }
     
 
 
@@ -580,13 +624,25 @@ namespace rct {
             keyV tmp(rows + 1);
             size_t i;
             keyM M(cols, tmp);
-            //create the matrix to mg sig
+            //create the matrix to mg sig, keeping the points decompressed
+            //for MLSAG_Ver so C is decompressed once per ring, not per member
+            std::vector<ge_p3> M_p3(cols * (rows + 1));
+            ge_p3 C_p3;
+            ge_cached C_cached;
+            CHECK_AND_ASSERT_MES(ge_frombytes_vartime(&C_p3, C.bytes) == 0, false, "point conv failed");
+            ge_p3_to_cached(&C_cached, &C_p3);
             for (i = 0; i < cols; i++) {
+                    ge_p3 mask;
+                    ge_p1p1 diff;
                     M[i][0] = pubs[i].dest;
-                    subKeys(M[i][1], pubs[i].mask, C);
+                    CHECK_AND_ASSERT_MES(ge_frombytes_vartime(&M_p3[2 * i], pubs[i].dest.bytes) == 0, false, "point conv failed");
+                    CHECK_AND_ASSERT_MES(ge_frombytes_vartime(&mask, pubs[i].mask.bytes) == 0, false, "point conv failed");
+                    ge_sub(&diff, &mask, &C_cached);
+                    ge_p1p1_to_p3(&M_p3[2 * i + 1], &diff);
+                    ge_p3_tobytes(M[i][1].bytes, &M_p3[2 * i + 1]);
             }
             //DP(C);
-            return MLSAG_Ver(message, M, mg, rows);
+            return MLSAG_Ver(message, M, M_p3, mg, rows);
         }
         catch (...) { return false; }
     }
@@ -737,20 +793,26 @@ namespace rct {
           rv.p.rangeSigs.resize(destinations.size());
         rv.ecdhInfo.resize(destinations.size());
 
+        // the proofs and signatures only go through the device for hardware wallets,
+        // which can't take several calls at once
+        const bool parallel = hwdev.get_type() == hw::device::device_type::SOFTWARE;
+
         size_t i;
         keyV masks(destinations.size()); //sk mask..
         outSk.resize(destinations.size());
         for (i = 0; i < destinations.size(); i++) {
-
             //add destination to sig
             rv.outPk[i].dest = copy(destinations[i]);
+        }
+        if (!bulletproof)
+        {
+          run_indexed(destinations.size(), parallel, [&](size_t i) {
             //compute range proof
-            if (!bulletproof)
-              rv.p.rangeSigs[i] = proveRange(rv.outPk[i].mask, outSk[i].mask, outamounts[i]);
+            rv.p.rangeSigs[i] = proveRange(rv.outPk[i].mask, outSk[i].mask, outamounts[i]);
             #ifdef DBG
-            if (!bulletproof)
-                CHECK_AND_ASSERT_THROW_MES(verRange(rv.outPk[i].mask, rv.p.rangeSigs[i]), "verRange failed on newly created proof");
+            CHECK_AND_ASSERT_THROW_MES(verRange(rv.outPk[i].mask, rv.p.rangeSigs[i]), "verRange failed on newly created proof");
             #endif
+          });
         }
 
         rv.p.bulletproofs.clear();
@@ -772,26 +834,34 @@ namespace rct {
                     outSk[i].mask = masks[i];
                 }
             }
-            else while (amounts_proved < n_amounts)
+            else
             {
-                size_t batch_size = 1;
-                if (range_proof_type == RangeProofMultiOutputBulletproof)
-                  while (batch_size * 2 + amounts_proved <= n_amounts && batch_size * 2 <= BULLETPROOF_MAX_OUTPUTS)
-                    batch_size *= 2;
-                rct::keyV C, masks;
-                std::vector<uint64_t> batch_amounts(batch_size);
-                for (i = 0; i < batch_size; ++i)
-                  batch_amounts[i] = outamounts[i + amounts_proved];
-                rv.p.bulletproofs.push_back(proveRangeBulletproof(C, masks, batch_amounts));
-            #ifdef DBG
-                CHECK_AND_ASSERT_THROW_MES(verBulletproof(rv.p.bulletproofs.back()), "verBulletproof failed on newly created proof");
-            #endif
-                for (i = 0; i < batch_size; ++i)
+                // the batches are independent proofs, split them up front and prove them at once
+                std::vector<std::pair<size_t, size_t>> batches; // first amount, number of amounts
+                while (amounts_proved < n_amounts)
                 {
-                  rv.outPk[i + amounts_proved].mask = rct::scalarmult8(C[i]);
-                  outSk[i + amounts_proved].mask = masks[i];
+                    size_t batch_size = 1;
+                    if (range_proof_type == RangeProofMultiOutputBulletproof)
+                      while (batch_size * 2 + amounts_proved <= n_amounts && batch_size * 2 <= BULLETPROOF_MAX_OUTPUTS)
+                        batch_size *= 2;
+                    batches.push_back(std::make_pair(amounts_proved, batch_size));
+                    amounts_proved += batch_size;
                 }
-                amounts_proved += batch_size;
+                rv.p.bulletproofs.resize(batches.size());
+                run_indexed(batches.size(), parallel, [&](size_t b) {
+                    const size_t first = batches[b].first, batch_size = batches[b].second;
+                    rct::keyV C, masks;
+                    std::vector<uint64_t> batch_amounts(outamounts.begin() + first, outamounts.begin() + first + batch_size);
+                    rv.p.bulletproofs[b] = proveRangeBulletproof(C, masks, batch_amounts);
+                #ifdef DBG
+                    CHECK_AND_ASSERT_THROW_MES(verBulletproof(rv.p.bulletproofs[b]), "verBulletproof failed on newly created proof");
+                #endif
+                    for (size_t i = 0; i < batch_size; ++i)
+                    {
+                      rv.outPk[i + first].mask = rct::scalarmult8(C[i]);
+                      outSk[i + first].mask = masks[i];
+                    }
+                });
             }
         }
 
@@ -829,9 +899,9 @@ namespace rct {
         key full_message = get_pre_mlsag_hash(rv,hwdev);
         if (msout)
           msout->c.resize(inamounts.size());
-        for (i = 0 ; i < inamounts.size(); i++) {
+        run_indexed(inamounts.size(), parallel, [&](size_t i) {
             rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i]: NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
-        }
+        });
         return rv;
     }
 
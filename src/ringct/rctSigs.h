@@ -100,6 +100,7 @@ namespace rct {
     mgSig proveRctMGSimple(const key & message, const ctkeyV & pubs, const ctkey & inSk, const key &a , const key &Cout, const multisig_kLRki *kLRki, key *mscout, unsigned int index, hw::device &hwdev);
     bool verRctMG(const mgSig &mg, const ctkeyM & pubs, const ctkeyV & outPk, key txnFee, const key &message);
     bool verRctMGSimple(const key &message, const mgSig &mg, const ctkeyV & pubs, const key & C);
+    key get_pre_mlsag_hash(const rctSig &rv, hw::device &hwdev);
 
     //These functions get keys from blockchain
     //replace these when connecting blockchain
@@ -0,0 +1,171 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "bootstrap_daemon.h"
+#include "core_rpc_server_commands_defs.h"
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc.bootstrap"
+
+namespace
+{
+  // read only calls whose replies may be a few seconds old. Calls about
+  // key images and the pool are left out, as a wallet which just sent a tx
+  // must see it at once, and so are /getblocks.bin and the like, whose
+  // requests seldom repeat and whose replies are large.
+  const char *const cacheable_rpcs[] = {
+    "/getheight",
+    "/getinfo",
+    "get_info",
+    "/gethashes.bin",
+    "/get_outs.bin",
+    "/get_outs",
+    "/get_o_indexes.bin",
+    "/gettransactions",
+    "getlastblockheader",
+    "getblockheaderbyhash",
+    "getblockheaderbyheight",
+    "getblockheadersrange",
+    "getblock",
+    "hard_fork_info",
+    "get_output_histogram",
+    "get_output_distribution",
+    "get_version",
+    "get_fee_estimate",
+  };
+}
+
+namespace cryptonote
+{
+
+constexpr size_t bootstrap_daemon::DEFAULT_MAX_CONNECTIONS;
+constexpr size_t bootstrap_daemon::CACHE_MAX_ENTRIES;
+constexpr std::chrono::seconds bootstrap_daemon::CACHE_TTL;
+
+bootstrap_daemon::bootstrap_daemon(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, size_t max_connections):
+  m_address(address),
+  m_login(login),
+  m_max_connections(std::max<size_t>(max_connections, 1)),
+  m_connections(0),
+  m_cache(CACHE_MAX_ENTRIES, CACHE_TTL),
+  m_requests(0),
+  m_forwarded(0)
+{
+}
+
+bool bootstrap_daemon::is_cacheable(const std::string &name)
+{
+  for (const char *rpc: cacheable_rpcs)
+    if (name == rpc)
+      return true;
+  return false;
+}
+
+bool bootstrap_daemon::get_height(uint64_t &height)
+{
+  COMMAND_RPC_GET_HEIGHT::request req;
+  COMMAND_RPC_GET_HEIGHT::response res;
+  transport t(*this, false);
+  if (!epee::net_utils::invoke_http_json("/getheight", req, res, t) || res.status != CORE_RPC_STATUS_OK)
+    return false;
+  height = res.height;
+  return true;
+}
+
+void bootstrap_daemon::get_stats(uint64_t &requests, uint64_t &forwarded, size_t &connections) const
+{
+  requests = m_requests.load(std::memory_order_relaxed);
+  forwarded = m_forwarded.load(std::memory_order_relaxed);
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  connections = m_connections;
+}
+
+std::shared_ptr<const bootstrap_daemon::response_info> bootstrap_daemon::invoke(const boost::string_ref uri, const boost::string_ref method, const std::string &body,
+    std::chrono::milliseconds timeout, const epee::net_utils::http::fields_list &additional_params, bool cacheable)
+{
+  ++m_requests;
+  if (!cacheable)
+    return forward(uri, method, body, timeout, additional_params);
+
+  // JSON RPC calls all go to /json_rpc, their body has the method
+  std::string key(uri.data(), uri.size());
+  key.push_back('\n');
+  key += body;
+  return m_cache.get(key, [&]() { return forward(uri, method, body, timeout, additional_params); });
+}
+
+std::shared_ptr<const bootstrap_daemon::response_info> bootstrap_daemon::forward(const boost::string_ref uri, const boost::string_ref method, const std::string &body,
+    std::chrono::milliseconds timeout, const epee::net_utils::http::fields_list &additional_params)
+{
+  ++m_forwarded;
+  std::unique_ptr<epee::net_utils::http::http_simple_client> client = acquire();
+  std::shared_ptr<const response_info> response;
+  try
+  {
+    const response_info *info = NULL;
+    // failed replies are not cached, and epee rejects them anyway
+    if (client->invoke(uri, method, body, timeout, &info, additional_params) && info && info->m_response_code == 200)
+      response = std::make_shared<response_info>(*info);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to forward " << uri << " to the bootstrap daemon: " << e.what());
+  }
+  release(std::move(client));
+  return response;
+}
+
+std::unique_ptr<epee::net_utils::http::http_simple_client> bootstrap_daemon::acquire()
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  while (m_idle.empty() && m_connections >= m_max_connections)
+    m_released.wait(lock);
+  if (!m_idle.empty())
+  {
+    std::unique_ptr<epee::net_utils::http::http_simple_client> client = std::move(m_idle.back());
+    m_idle.pop_back();
+    return client;
+  }
+  const size_t connections = ++m_connections;
+  lock.unlock();
+
+  MDEBUG("Opening connection " << connections << " to the bootstrap daemon " << m_address);
+  std::unique_ptr<epee::net_utils::http::http_simple_client> client(new epee::net_utils::http::http_simple_client());
+  client->set_server(m_address, m_login, false);
+  return client;
+}
+
+void bootstrap_daemon::release(std::unique_ptr<epee::net_utils::http::http_simple_client> client)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_idle.push_back(std::move(client));
+  m_released.notify_one();
+}
+
+}
@@ -0,0 +1,156 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <boost/optional/optional.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/single_flight_cache.h"
+#include "net/http_client.h"
+#include "storages/http_abstract_invoke.h"
+
+namespace cryptonote
+{
+
+/**
+ * Forwards RPC calls to the bootstrap daemon while the local one syncs.
+ *
+ * Calls go through a pool of keep-alive connections, opened as needed up
+ * to a bound, so concurrent calls are forwarded concurrently. A call
+ * waits for a connection once they are all busy.
+ *
+ * The replies to the read only calls listed in bootstrap_daemon.cpp are
+ * kept for a few seconds, keyed by the URI and the request body, and a
+ * call made while the same one is being forwarded waits for its reply
+ * rather than being forwarded again (see tools::single_flight_cache).
+ */
+class bootstrap_daemon
+{
+  public:
+
+    static constexpr size_t DEFAULT_MAX_CONNECTIONS = 4;
+    static constexpr size_t CACHE_MAX_ENTRIES = 64;
+    static constexpr std::chrono::seconds CACHE_TTL{5};
+
+    bootstrap_daemon(const std::string &address, const boost::optional<epee::net_utils::http::login> &login, size_t max_connections = DEFAULT_MAX_CONNECTIONS);
+
+    const std::string &get_address() const { return m_address; }
+
+    //! the bootstrap daemon's blockchain height, never cached
+    bool get_height(uint64_t &height);
+
+    template<class t_request, class t_response>
+    bool invoke_http_json(const std::string &uri, const t_request &req, t_response &res)
+    {
+      transport t(*this, is_cacheable(uri));
+      return epee::net_utils::invoke_http_json(uri, req, res, t);
+    }
+
+    template<class t_request, class t_response>
+    bool invoke_http_bin(const std::string &uri, const t_request &req, t_response &res)
+    {
+      transport t(*this, is_cacheable(uri));
+      return epee::net_utils::invoke_http_bin(uri, req, res, t);
+    }
+
+    template<class t_request, class t_response>
+    bool invoke_http_json_rpc(const std::string &method, const t_request &req, t_response &res)
+    {
+      epee::json_rpc::request<t_request> json_req = AUTO_VAL_INIT(json_req);
+      epee::json_rpc::response<t_response, std::string> json_resp = AUTO_VAL_INIT(json_resp);
+      json_req.jsonrpc = "2.0";
+      json_req.id = epee::serialization::storage_entry(0);
+      json_req.method = method;
+      json_req.params = req;
+      transport t(*this, is_cacheable(method));
+      if (!epee::net_utils::invoke_http_json("/json_rpc", json_req, json_resp, t))
+        return false;
+      res = json_resp.result;
+      return true;
+    }
+
+    //! @param name the URI of a plain call, or the method of a JSON RPC call
+    static bool is_cacheable(const std::string &name);
+
+    void get_stats(uint64_t &requests, uint64_t &forwarded, size_t &connections) const;
+
+  private:
+    typedef epee::net_utils::http::http_response_info response_info;
+
+    // what epee's invoke_http_* expect of a transport
+    class transport
+    {
+      public:
+        transport(bootstrap_daemon &daemon, bool cacheable): m_daemon(daemon), m_cacheable(cacheable) {}
+
+        bool invoke(const boost::string_ref uri, const boost::string_ref method, const std::string &body, std::chrono::milliseconds timeout,
+            const response_info **ppresponse_info = NULL, const epee::net_utils::http::fields_list &additional_params = epee::net_utils::http::fields_list())
+        {
+          m_response = m_daemon.invoke(uri, method, body, timeout, additional_params, m_cacheable);
+          if (ppresponse_info)
+            *ppresponse_info = m_response.get();
+          return m_response != nullptr;
+        }
+
+      private:
+        bootstrap_daemon &m_daemon;
+        const bool m_cacheable;
+        std::shared_ptr<const response_info> m_response;
+    };
+
+    std::shared_ptr<const response_info> invoke(const boost::string_ref uri, const boost::string_ref method, const std::string &body,
+        std::chrono::milliseconds timeout, const epee::net_utils::http::fields_list &additional_params, bool cacheable);
+    std::shared_ptr<const response_info> forward(const boost::string_ref uri, const boost::string_ref method, const std::string &body,
+        std::chrono::milliseconds timeout, const epee::net_utils::http::fields_list &additional_params);
+
+    std::unique_ptr<epee::net_utils::http::http_simple_client> acquire();
+    void release(std::unique_ptr<epee::net_utils::http::http_simple_client> client);
+
+    const std::string m_address;
+    const boost::optional<epee::net_utils::http::login> m_login;
+    const size_t m_max_connections;
+
+    mutable boost::mutex m_lock;
+    boost::condition_variable m_released;
+    std::vector<std::unique_ptr<epee::net_utils::http::http_simple_client>> m_idle;
+    size_t m_connections;
+
+    tools::single_flight_cache<response_info> m_cache;
+    std::atomic<uint64_t> m_requests;
+    std::atomic<uint64_t> m_forwarded;
+};
+
+}  // namespace cryptonote
@@ -29,6 +29,9 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <chrono>
+#include <fstream>
+#include <boost/thread/mutex.hpp>
 #include "include_base_utils.h"
 #include "string_tools.h"
 using namespace epee;
@@ -39,6 +42,7 @@ using namespace epee;
 #include "common/download.h"
 #include "common/util.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_basic/account.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
@@ -56,6 +60,16 @@ using namespace epee;
 #define MAX_RESTRICTED_FAKE_OUTS_COUNT 40
 #define MAX_RESTRICTED_GLOBAL_FAKE_OUTS_COUNT 5000
 
+// JSON-RPC methods report overload as an error, as the HTTP request itself succeeded
+#define LIMIT_HEAVY_JSON_RPC(kind) \
+  tools::request_limiter::slot heavy_slot(m_request_limiter, kind); \
+  if (!heavy_slot) \
+  { \
+    error_resp.code = CORE_RPC_ERROR_CODE_SERVER_BUSY; \
+    error_resp.message = "Server busy, try again later"; \
+    return false; \
+  }
+
 namespace
 {
   void add_reason(std::string &reasons, const char *reason)
@@ -64,6 +78,87 @@ namespace
       reasons += ", ";
     reasons += reason;
   }
+
+  // the rules the wallet applies to its own outputs
+  bool is_light_wallet_output_unlocked(const cryptonote::light_wallet_scanner::received_output &out, uint64_t height)
+  {
+    if (out.height + (out.coinbase ? CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW : CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE) > height)
+      return false;
+    if (out.unlock_time < CRYPTONOTE_MAX_BLOCK_NUMBER)
+      return out.unlock_time <= height + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_BLOCKS - 1;
+    return out.unlock_time <= (uint64_t)time(NULL) + CRYPTONOTE_LOCKED_TX_ALLOWED_DELTA_SECONDS_V2;
+  }
+
+  // calls expensive enough that they may not take all the RPC threads;
+  // a per call limit of 0 means only the total limit applies
+  struct heavy_rpc
+  {
+    const char *name;
+    unsigned limit;
+  };
+  const heavy_rpc heavy_rpcs[] = {
+    { "/get_blocks.bin", 0 },
+    { "/get_blocks_by_height.bin", 0 },
+    { "/get_block_filters.bin", 0 },
+    { "/get_hashes.bin", 0 },
+    { "/get_outs.bin", 0 },
+    { "/get_outs", 0 },
+    { "/get_transactions", 0 },
+    { "/get_transaction_pool", 0 },
+    { "get_block_headers_range", 0 },
+    { "get_txpool_backlog", 0 },
+    { "get_output_histogram", 1 },
+    { "get_coinbase_tx_sum", 1 },
+    { "get_output_distribution", 1 },
+    { "/get_address_txs", 0 },
+    { "/get_unspent_outs", 0 },
+    { "/get_random_outs", 0 },
+  };
+  // one log shared by the restricted and unrestricted servers, one line
+  // per request: milliseconds since recording started, URI, hex body
+  class request_recorder
+  {
+  public:
+    bool open(const std::string &path)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (m_file.is_open())
+        return path == m_path;
+      m_file.open(path, std::ios_base::out | std::ios_base::app);
+      if (!m_file.is_open())
+        return false;
+      m_path = path;
+      m_start = std::chrono::steady_clock::now();
+      return true;
+    }
+
+    void record(const std::string &uri, const std::string &body)
+    {
+      const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_start).count();
+      const std::string hex = body.empty() ? std::string("-") : epee::string_tools::buff_to_hex_nodelimer(body);
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      m_file << ms << " " << uri << " " << hex << "\n";
+    }
+
+  private:
+    boost::mutex m_lock;
+    std::ofstream m_file;
+    std::string m_path;
+    std::chrono::steady_clock::time_point m_start;
+  };
+
+  request_recorder &get_request_recorder()
+  {
+    static request_recorder recorder;
+    return recorder;
+  }
+
+  const std::pair<const char*, const char*> heavy_rpc_aliases[] = {
+    { "/getblocks.bin", "/get_blocks.bin" },
+    { "/getblocks_by_height.bin", "/get_blocks_by_height.bin" },
+    { "/gethashes.bin", "/get_hashes.bin" },
+    { "/gettransactions", "/get_transactions" },
+  };
 }
 
 namespace cryptonote
@@ -77,6 +172,13 @@ namespace cryptonote
     command_line::add_arg(desc, arg_restricted_rpc);
     command_line::add_arg(desc, arg_bootstrap_daemon_address);
     command_line::add_arg(desc, arg_bootstrap_daemon_login);
+    command_line::add_arg(desc, arg_bootstrap_daemon_connections);
+    command_line::add_arg(desc, arg_rpc_threads);
+    command_line::add_arg(desc, arg_rpc_max_concurrent_heavy);
+    command_line::add_arg(desc, arg_perf_stats);
+    command_line::add_arg(desc, arg_rpc_metrics);
+    command_line::add_arg(desc, arg_rpc_response_cache_size);
+    command_line::add_arg(desc, arg_rpc_record_requests);
     cryptonote::rpc_args::init_options(desc);
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -86,6 +188,7 @@ namespace cryptonote
     )
     : m_core(cr)
     , m_p2p(p2p)
+    , m_mining_jobs(cr)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::init(
@@ -108,17 +211,14 @@ namespace cryptonote
     {
       const std::string &bootstrap_daemon_login = command_line::get_arg(vm, arg_bootstrap_daemon_login);
       const auto loc = bootstrap_daemon_login.find(':');
+      boost::optional<epee::net_utils::http::login> login;
       if (!bootstrap_daemon_login.empty() && loc != std::string::npos)
       {
-        epee::net_utils::http::login login;
-        login.username = bootstrap_daemon_login.substr(0, loc);
-        login.password = bootstrap_daemon_login.substr(loc + 1);
-        m_http_client.set_server(m_bootstrap_daemon_address, login, false);
-      }
-      else
-      {
-        m_http_client.set_server(m_bootstrap_daemon_address, boost::none, false);
+        login.emplace();
+        login->username = bootstrap_daemon_login.substr(0, loc);
+        login->password = bootstrap_daemon_login.substr(loc + 1);
       }
+      m_bootstrap_daemon.reset(new bootstrap_daemon(m_bootstrap_daemon_address, login, command_line::get_arg(vm, arg_bootstrap_daemon_connections)));
       m_should_use_bootstrap_daemon = true;
     }
     else
@@ -127,6 +227,29 @@ namespace cryptonote
     }
     m_was_bootstrap_ever_used = false;
 
+    // by default, expensive calls leave at least one thread for the others
+    const unsigned threads = std::max(1u, command_line::get_arg(vm, arg_rpc_threads));
+    unsigned max_heavy = command_line::get_arg(vm, arg_rpc_max_concurrent_heavy);
+    if (max_heavy == 0)
+      max_heavy = std::max(1u, threads - 1);
+    m_request_limiter.set_total_limit(max_heavy);
+    for (const heavy_rpc &rpc: heavy_rpcs)
+      m_request_limiter.set_limit(rpc.name, rpc.limit);
+    for (const auto &alias: heavy_rpc_aliases)
+      m_request_limiter.add_alias(alias.first, alias.second);
+
+    if (command_line::get_arg(vm, arg_perf_stats))
+      tools::set_performance_stats_enabled(true);
+    m_metrics = command_line::get_arg(vm, arg_rpc_metrics);
+    m_response_cache.set_max_size(command_line::get_arg(vm, arg_rpc_response_cache_size));
+    const std::string record_requests = command_line::get_arg(vm, arg_rpc_record_requests);
+    m_record_requests = !record_requests.empty();
+    if (m_record_requests && !get_request_recorder().open(record_requests))
+    {
+      MERROR("Failed to open " << record_requests << " to record RPC requests");
+      return false;
+    }
+
     boost::optional<epee::net_utils::http::login> http_login{};
 
     if (rpc_config->login)
@@ -138,6 +261,207 @@ namespace cryptonote
     );
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context)
+  {
+    LOG_PRINT_L2("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+    if (m_record_requests)
+      get_request_recorder().record(query_info.m_URI, query_info.m_body);
+    tools::request_limiter::slot slot(m_request_limiter, query_info.m_URI);
+    if (!slot)
+    {
+      MDEBUG("Too many expensive requests running, turning away " << query_info.m_URI);
+      response.m_response_code = 503;
+      response.m_response_comment = "Service Unavailable";
+      return true;
+    }
+    response.m_response_code = 200;
+    response.m_response_comment = "Ok";
+    if (m_metrics && !m_restricted && query_info.m_URI == "/metrics")
+    {
+      get_metrics(response.m_body);
+      response.m_mime_tipe = "text/plain; version=0.0.4";
+      return true;
+    }
+
+    // replies coming from a bootstrap daemon do not follow our chain state, so they are never cached
+    rpc_response_cache::request_key cache_key;
+    const bool cacheable = m_bootstrap_daemon_address.empty() && m_response_cache.get_key(query_info.m_URI, query_info.m_body, cache_key);
+    crypto::hash top_hash = crypto::null_hash;
+    uint64_t pool_cookie = 0;
+    if (cacheable)
+    {
+      top_hash = m_core.get_tail_id();
+      pool_cookie = m_core.get_pool().cookie();
+      if (m_response_cache.find(cache_key, top_hash, pool_cookie, response.m_body, response.m_mime_tipe))
+      {
+        response.m_header_info.m_content_type = " " + response.m_mime_tipe;
+        return true;
+      }
+    }
+
+    // all the calls of a JSON-RPC batch read the chain through a single read txn
+    std::unique_ptr<db_rtxn_guard> batch_rtxn;
+    if (query_info.m_URI == "/json_rpc" && epee::json_rpc::is_batch(query_info.m_body))
+      batch_rtxn.reset(new db_rtxn_guard(&m_core.get_blockchain_storage().get_db()));
+
+    if(!handle_http_request_map(query_info, response, m_conn_context))
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+    }
+    else if (cacheable && response.m_response_code == 200)
+    {
+      m_response_cache.add(cache_key, top_hash, pool_cookie, response.m_body, response.m_mime_tipe);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::get_metrics(std::string &text)
+  {
+    // Prometheus text exposition format
+    std::ostringstream ss;
+    auto metric = [&ss](const char *name, const char *type, const char *help) {
+      ss << "# HELP electroneum_" << name << " " << help << "\n";
+      ss << "# TYPE electroneum_" << name << " " << type << "\n";
+    };
+
+    metric("txpool_transactions", "gauge", "Transactions in the pool");
+    ss << "electroneum_txpool_transactions " << m_core.get_pool_transactions_count() << "\n";
+    metric("txpool_weight_bytes", "gauge", "Cumulative weight of the pool");
+    ss << "electroneum_txpool_weight_bytes " << m_core.get_pool().get_txpool_weight() << "\n";
+    uint64_t input_cache_hits, input_cache_misses;
+    m_core.get_pool().get_input_cache_stats(input_cache_hits, input_cache_misses);
+    metric("txpool_input_cache_lookups_total", "counter", "Pool input checks, by whether the input cache had the result");
+    ss << "electroneum_txpool_input_cache_lookups_total{result=\"hit\"} " << input_cache_hits << "\n";
+    ss << "electroneum_txpool_input_cache_lookups_total{result=\"miss\"} " << input_cache_misses << "\n";
+
+    const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+    size_t spans = 0;
+    block_queue.foreach([&spans](const cryptonote::block_queue::span&) { ++spans; return true; });
+    metric("block_queue_spans", "gauge", "Block spans queued for download or being downloaded");
+    ss << "electroneum_block_queue_spans " << spans << "\n";
+    metric("block_queue_filled_spans", "gauge", "Downloaded block spans waiting to be added");
+    ss << "electroneum_block_queue_filled_spans " << block_queue.get_num_filled_spans() << "\n";
+    metric("block_queue_bytes", "gauge", "Size of the downloaded blocks waiting to be added");
+    ss << "electroneum_block_queue_bytes " << block_queue.get_data_size() << "\n";
+
+    std::map<std::string, size_t> connection_states;
+    for (const auto &c: m_p2p.get_payload_object().get_connections())
+      ++connection_states[c.state];
+    metric("connections", "gauge", "P2P connections by protocol state");
+    for (const auto &e: connection_states)
+      ss << "electroneum_connections{state=\"" << e.first << "\"} " << e.second << "\n";
+
+    uint64_t map_size, map_used;
+    if (m_core.get_blockchain_storage().get_db().get_map_usage(map_size, map_used))
+    {
+      metric("db_map_size_bytes", "gauge", "Size of the database memory map");
+      ss << "electroneum_db_map_size_bytes " << map_size << "\n";
+      metric("db_map_used_bytes", "gauge", "Bytes of the database memory map in use");
+      ss << "electroneum_db_map_used_bytes " << map_used << "\n";
+    }
+    uint64_t map_resizes, map_resize_blocked_ns;
+    if (m_core.get_blockchain_storage().get_db().get_resize_stats(map_resizes, map_resize_blocked_ns))
+    {
+      metric("db_map_resizes_total", "counter", "Resizes of the database memory map");
+      ss << "electroneum_db_map_resizes_total " << map_resizes << "\n";
+      metric("db_map_resize_blocked_seconds_total", "counter", "Time new database transactions were held back by map resizes");
+      ss << "electroneum_db_map_resize_blocked_seconds_total " << map_resize_blocked_ns / 1e9 << "\n";
+    }
+
+    uint64_t tx_hashes_calculated, tx_hashes_cached, block_hashes_calculated, block_hashes_cached;
+    cryptonote::get_hash_stats(tx_hashes_calculated, tx_hashes_cached, block_hashes_calculated, block_hashes_cached);
+    uint64_t prunable_hashes_calculated, prunable_hashes_cached;
+    cryptonote::get_prunable_hash_stats(prunable_hashes_calculated, prunable_hashes_cached);
+    metric("hashes_total", "counter", "Transaction and block hash lookups, by whether the cached value was used");
+    ss << "electroneum_hashes_total{hash=\"tx\",result=\"calculated\"} " << tx_hashes_calculated << "\n";
+    ss << "electroneum_hashes_total{hash=\"tx\",result=\"cached\"} " << tx_hashes_cached << "\n";
+    ss << "electroneum_hashes_total{hash=\"tx_prunable\",result=\"calculated\"} " << prunable_hashes_calculated << "\n";
+    ss << "electroneum_hashes_total{hash=\"tx_prunable\",result=\"cached\"} " << prunable_hashes_cached << "\n";
+    ss << "electroneum_hashes_total{hash=\"block\",result=\"calculated\"} " << block_hashes_calculated << "\n";
+    ss << "electroneum_hashes_total{hash=\"block\",result=\"cached\"} " << block_hashes_cached << "\n";
+    uint64_t tx_hashes_redundant, prunable_hashes_redundant;
+    if (cryptonote::get_tx_hash_audit_stats(tx_hashes_redundant, prunable_hashes_redundant))
+    {
+      metric("redundant_hashes_total", "counter", "Transaction hashes calculated again for data already hashed, with --tx-hash-audit");
+      ss << "electroneum_redundant_hashes_total{hash=\"tx\"} " << tx_hashes_redundant << "\n";
+      ss << "electroneum_redundant_hashes_total{hash=\"tx_prunable\"} " << prunable_hashes_redundant << "\n";
+    }
+
+    uint64_t response_cache_hits, response_cache_misses;
+    size_t response_cache_size, response_cache_entries;
+    m_response_cache.get_stats(response_cache_hits, response_cache_misses, response_cache_size, response_cache_entries);
+    metric("rpc_response_cache_lookups_total", "counter", "Cacheable RPC calls, by whether a ready reply was found");
+    ss << "electroneum_rpc_response_cache_lookups_total{result=\"hit\"} " << response_cache_hits << "\n";
+    ss << "electroneum_rpc_response_cache_lookups_total{result=\"miss\"} " << response_cache_misses << "\n";
+    metric("rpc_response_cache_bytes", "gauge", "Size of the cached RPC replies");
+    ss << "electroneum_rpc_response_cache_bytes " << response_cache_size << "\n";
+    metric("rpc_response_cache_entries", "gauge", "Cached RPC replies");
+    ss << "electroneum_rpc_response_cache_entries " << response_cache_entries << "\n";
+
+    if (m_bootstrap_daemon)
+    {
+      uint64_t bootstrap_requests, bootstrap_forwarded;
+      size_t bootstrap_connections;
+      m_bootstrap_daemon->get_stats(bootstrap_requests, bootstrap_forwarded, bootstrap_connections);
+      metric("bootstrap_daemon_requests_total", "counter", "Calls to the bootstrap daemon, by whether they were forwarded or served from its cache");
+      ss << "electroneum_bootstrap_daemon_requests_total{result=\"forwarded\"} " << bootstrap_forwarded << "\n";
+      ss << "electroneum_bootstrap_daemon_requests_total{result=\"cached\"} " << bootstrap_requests - bootstrap_forwarded << "\n";
+      metric("bootstrap_daemon_connections", "gauge", "Connections opened to the bootstrap daemon");
+      ss << "electroneum_bootstrap_daemon_connections " << bootstrap_connections << "\n";
+    }
+
+    metric("threadpool_pending_tasks", "gauge", "Tasks queued in the global thread pool");
+    ss << "electroneum_threadpool_pending_tasks " << tools::threadpool::getInstance().get_pending() << "\n";
+
+    const std::vector<epee::levin::command_stats_snapshot> command_stats = epee::levin::snapshot_command_stats(epee::levin::get_command_stats(), LEVIN_COMMAND_STATS_SLOTS);
+    metric("levin_bytes_total", "counter", "P2P bytes by levin command and direction, headers included");
+    for (const auto &s: command_stats)
+    {
+      ss << "electroneum_levin_bytes_total{command=\"" << s.command << "\",direction=\"in\"} " << s.bytes_in << "\n";
+      ss << "electroneum_levin_bytes_total{command=\"" << s.command << "\",direction=\"out\"} " << s.bytes_out << "\n";
+    }
+    metric("levin_packets_total", "counter", "P2P packets by levin command and direction");
+    for (const auto &s: command_stats)
+    {
+      ss << "electroneum_levin_packets_total{command=\"" << s.command << "\",direction=\"in\"} " << s.packets_in << "\n";
+      ss << "electroneum_levin_packets_total{command=\"" << s.command << "\",direction=\"out\"} " << s.packets_out << "\n";
+    }
+    metric("levin_handler_seconds", "summary", "Time spent handling the levin requests and notifications received, by command");
+    for (const auto &s: command_stats)
+    {
+      ss << "electroneum_levin_handler_seconds_sum{command=\"" << s.command << "\"} " << s.handler_ns / 1e9 << "\n";
+      ss << "electroneum_levin_handler_seconds_count{command=\"" << s.command << "\"} " << s.handled << "\n";
+    }
+    metric("levin_invoke_seconds", "summary", "Time until the levin requests we sent were answered, by command");
+    for (const auto &s: command_stats)
+    {
+      ss << "electroneum_levin_invoke_seconds_sum{command=\"" << s.command << "\"} " << s.invoke_ns / 1e9 << "\n";
+      ss << "electroneum_levin_invoke_seconds_count{command=\"" << s.command << "\"} " << s.invokes << "\n";
+    }
+    metric("levin_invoke_timeouts_total", "counter", "Levin requests we sent which timed out, by command");
+    for (const auto &s: command_stats)
+      ss << "electroneum_levin_invoke_timeouts_total{command=\"" << s.command << "\"} " << s.invoke_timeouts << "\n";
+
+    // one summary per PERF_TIMER name, when --perf-stats is on
+    const std::vector<tools::performance_stats_entry> stats = tools::get_performance_stats();
+    if (!stats.empty())
+    {
+      metric("perf_timer_seconds", "summary", "PERF_TIMER durations");
+      for (const auto &e: stats)
+      {
+        ss << "electroneum_perf_timer_seconds{name=\"" << e.name << "\",quantile=\"0.5\"} " << e.p50_ns / 1e9 << "\n";
+        ss << "electroneum_perf_timer_seconds{name=\"" << e.name << "\",quantile=\"0.99\"} " << e.p99_ns / 1e9 << "\n";
+        ss << "electroneum_perf_timer_seconds_sum{name=\"" << e.name << "\"} " << e.total_ns / 1e9 << "\n";
+        ss << "electroneum_perf_timer_seconds_count{name=\"" << e.name << "\"} " << e.count << "\n";
+      }
+      metric("perf_timer_max_seconds", "gauge", "Longest PERF_TIMER duration");
+      for (const auto &e: stats)
+        ss << "electroneum_perf_timer_max_seconds{name=\"" << e.name << "\"} " << e.max_ns / 1e9 << "\n";
+    }
+    text = ss.str();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::check_core_ready()
   {
     if(!m_p2p.get_payload_object().is_synchronized())
@@ -147,6 +471,8 @@ namespace cryptonote
     return true;
   }
 #define CHECK_CORE_READY() do { if(!check_core_ready()){res.status =  CORE_RPC_STATUS_BUSY;return true;} } while(0)
+#define CHECK_CORE_WRITABLE() do { if(m_core.read_only()){res.status = "Failed, the daemon is read only";return true;} } while(0)
+#define CHECK_CORE_WRITABLE_WE() do { if(m_core.read_only()){error_resp.code = CORE_RPC_ERROR_CODE_READ_ONLY;error_resp.message = "The daemon is read only";return false;} } while(0)
 
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res)
@@ -210,6 +536,20 @@ namespace cryptonote
     }
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     res.update_available = m_core.is_update_available();
+    cryptonote::key_image_filter_stats kif;
+    if (m_core.get_blockchain_storage().get_db().get_key_image_filter_stats(kif) && kif.enabled)
+    {
+      res.key_image_filter_size = kif.memory_size;
+      // measured over the lookups for key images which were not spent
+      res.key_image_filter_fp_rate = kif.filtered + kif.false_positives ? kif.false_positives / (double)(kif.filtered + kif.false_positives) : kif.estimated_fp_rate;
+      res.key_image_filter_hit_rate = kif.lookups ? kif.filtered / (double)kif.lookups : 0.0;
+    }
+    else
+    {
+      res.key_image_filter_size = 0;
+      res.key_image_filter_fp_rate = 0.0;
+      res.key_image_filter_hit_rate = 0.0;
+    }
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -224,11 +564,12 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   static cryptonote::blobdata get_pruned_tx_json(cryptonote::transaction &tx)
   {
-    std::stringstream ss;
+    cryptonote::blobdata s;
+    json_string_ostream ss(s);
     json_archive<true> ar(ss);
     bool r = tx.serialize_base(ar);
     CHECK_AND_ASSERT_MES(r, cryptonote::blobdata(), "Failed to serialize rct signatures base");
-    return ss.str();
+    return s;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res)
@@ -239,9 +580,19 @@ namespace cryptonote
       return r;
 
     std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata> > > > bs;
+    std::vector<std::vector<std::vector<uint64_t>>> indices;
 
-    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    try
     {
+      if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, bs, res.current_height, res.start_height, req.prune, !req.no_miner_tx, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, &indices))
+      {
+        res.status = "Failed";
+        return false;
+      }
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to get blocks: " << e.what());
       res.status = "Failed";
       return false;
     }
@@ -252,38 +603,25 @@ namespace cryptonote
     for(auto& bd: bs)
     {
       res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().block = bd.first.first;
       pruned_size += bd.first.first.size();
       unpruned_size += bd.first.first.size();
+      res.blocks.back().block = std::move(bd.first.first);
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+      std::vector<std::vector<uint64_t>> &block_indices = indices[&bd - bs.data()];
       res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
       if (!req.no_miner_tx)
-      {
-        bool r = m_core.get_tx_outputs_gindexs(bd.first.second, res.output_indices.back().indices.back().indices);
-        if (!r)
-        {
-          res.status = "Failed";
-          return false;
-        }
-      }
+        res.output_indices.back().indices.back().indices = std::move(block_indices[0]);
       ntxes += bd.second.size();
       res.blocks.back().txs.reserve(bd.second.size());
-      res.output_indices.back().indices.reserve(bd.second.size());
-      for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
+      res.output_indices.back().indices.reserve(1 + bd.second.size());
+      for (size_t i = 0; i < bd.second.size(); ++i)
       {
-        unpruned_size += i->second.size();
-        res.blocks.back().txs.push_back(std::move(i->second));
-        i->second.clear();
-        i->second.shrink_to_fit();
+        unpruned_size += bd.second[i].second.size();
+        res.blocks.back().txs.push_back(std::move(bd.second[i].second));
         pruned_size += res.blocks.back().txs.back().size();
 
         res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
-        bool r = m_core.get_tx_outputs_gindexs(i->first, res.output_indices.back().indices.back().indices);
-        if (!r)
-        {
-          res.status = "Failed";
-          return false;
-        }
+        res.output_indices.back().indices.back().indices = std::move(block_indices[1 + i]);
       }
     }
 
@@ -352,6 +690,24 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_filters(const COMMAND_RPC_GET_BLOCK_FILTERS::request& req, COMMAND_RPC_GET_BLOCK_FILTERS::response& res)
+  {
+    PERF_TIMER(on_get_block_filters);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCK_FILTERS>(invoke_http_mode::BIN, "/get_block_filters.bin", req, res, r))
+      return r;
+
+    const uint64_t count = std::min<uint64_t>(req.count, COMMAND_RPC_GET_BLOCK_FILTERS_MAX_COUNT);
+    res.current_height = m_core.get_current_blockchain_height();
+    res.start_height = req.start_height;
+    if (!m_core.get_block_filters(req.start_height, count, res.filters))
+    {
+      res.status = "Failed";
+      return true;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
   bool core_rpc_server::on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res)
   {
     PERF_TIMER(on_get_hashes);
@@ -636,6 +992,7 @@ namespace cryptonote
       if(b.size() != sizeof(crypto::key_image))
       {
         res.status = "Failed, size of data mismatch";
+        return true;
       }
       key_images.push_back(*reinterpret_cast<const crypto::key_image*>(b.data()));
     }
@@ -650,35 +1007,143 @@ namespace cryptonote
     for (size_t n = 0; n < spent_status.size(); ++n)
       res.spent_status.push_back(spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT);
 
-    // check the pool too
-    std::vector<cryptonote::tx_info> txs;
-    std::vector<cryptonote::spent_key_image_info> ki;
-    r = m_core.get_pool_transactions_and_spent_keys_info(txs, ki, !request_has_rpc_origin || !m_restricted);
-    if(!r)
+    // check the pool too, hiding txes not meant to be relayed from restricted callers
+    if (!m_core.are_key_images_spent_in_pool(key_images, spent_status, !request_has_rpc_origin || !m_restricted) || spent_status.size() != key_images.size())
+    {
+      res.status = "Failed";
+      return true;
+    }
+    for (size_t n = 0; n < spent_status.size(); ++n)
+      if (spent_status[n] && res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
+        res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_is_key_image_spent_bin(const COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response& res, bool request_has_rpc_origin)
+  {
+    PERF_TIMER(on_is_key_image_spent_bin);
+    bool ok;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN>(invoke_http_mode::BIN, "/is_key_image_spent.bin", req, res, ok))
+      return ok;
+
+    std::vector<bool> spent_status;
+    if (!m_core.are_key_images_spent(req.key_images, spent_status) || spent_status.size() != req.key_images.size())
+    {
+      res.status = "Failed";
+      return true;
+    }
+    res.spent_status.resize(spent_status.size());
+    for (size_t n = 0; n < spent_status.size(); ++n)
+      res.spent_status[n] = spent_status[n] ? COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN : COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+
+    // check the pool too, hiding txes not meant to be relayed from restricted callers
+    if (!m_core.are_key_images_spent_in_pool(req.key_images, spent_status, !request_has_rpc_origin || !m_restricted) || spent_status.size() != req.key_images.size())
     {
       res.status = "Failed";
       return true;
     }
-    for (std::vector<cryptonote::spent_key_image_info>::const_iterator i = ki.begin(); i != ki.end(); ++i)
+    for (size_t n = 0; n < spent_status.size(); ++n)
+      if (spent_status[n] && res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
+        res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_key_image_spenders(const COMMAND_RPC_GET_KEY_IMAGE_SPENDERS::request& req, COMMAND_RPC_GET_KEY_IMAGE_SPENDERS::response& res)
+  {
+    PERF_TIMER(on_get_key_image_spenders);
+    bool ok;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_KEY_IMAGE_SPENDERS>(invoke_http_mode::JON, "/get_key_image_spenders", req, res, ok))
+      return ok;
+
+    const BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    if (!db.has_explorer_index())
+    {
+      res.status = "Failed: the daemon was not started with --explorer-index";
+      return true;
+    }
+    if (req.key_images.size() > COMMAND_RPC_EXPLORER_INDEX_MAX_COUNT)
+    {
+      res.status = "Failed: too many key images requested";
+      return true;
+    }
+
+    res.spent_txs.clear();
+    res.spent_txs.reserve(req.key_images.size());
+    for (const auto &ki_hex_str: req.key_images)
     {
-      crypto::hash hash;
-      crypto::key_image spent_key_image;
-      if (parse_hash256(i->id_hash, hash))
+      crypto::key_image ki;
+      if (!epee::string_tools::hex_to_pod(ki_hex_str, ki))
       {
-        memcpy(&spent_key_image, &hash, sizeof(hash)); // a bit dodgy, should be other parse functions somewhere
-        for (size_t n = 0; n < res.spent_status.size(); ++n)
+        res.status = "Failed to parse hex representation of key image";
+        return true;
+      }
+      crypto::hash tx_hash;
+      if (db.get_key_image_spender(ki, tx_hash))
+        res.spent_txs.push_back(epee::string_tools::pod_to_hex(tx_hash));
+      else
+        res.spent_txs.push_back(std::string());
+    }
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_output_key_locations(const COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS::request& req, COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS::response& res)
+  {
+    PERF_TIMER(on_get_output_key_locations);
+    bool ok;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS>(invoke_http_mode::JON, "/get_output_key_locations", req, res, ok))
+      return ok;
+
+    BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    if (!db.has_explorer_index())
+    {
+      res.status = "Failed: the daemon was not started with --explorer-index";
+      return true;
+    }
+    if (req.keys.size() > COMMAND_RPC_EXPLORER_INDEX_MAX_COUNT)
+    {
+      res.status = "Failed: too many keys requested";
+      return true;
+    }
+
+    res.outputs.clear();
+    std::vector<output_location_t> locations;
+    try
+    {
+      for (const auto &key_hex_str: req.keys)
+      {
+        crypto::public_key key;
+        if (!epee::string_tools::hex_to_pod(key_hex_str, key))
         {
-          if (res.spent_status[n] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT)
-          {
-            if (key_images[n] == spent_key_image)
-            {
-              res.spent_status[n] = COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_POOL;
-              break;
-            }
-          }
+          res.status = "Failed to parse hex representation of output key";
+          return true;
+        }
+        db.get_output_locations(key, locations);
+        for (const output_location_t &location: locations)
+        {
+          const tx_out_index toi = db.get_output_tx_and_index(location.amount, location.amount_index);
+          const output_data_t od = db.get_output_key(location.amount, location.amount_index);
+          COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS::entry e;
+          e.key = key_hex_str;
+          e.amount = location.amount;
+          e.index = location.amount_index;
+          e.tx_hash = epee::string_tools::pod_to_hex(toi.first);
+          e.local_index = toi.second;
+          e.height = od.height;
+          res.outputs.push_back(std::move(e));
         }
       }
     }
+    catch (const std::exception &e)
+    {
+      res.status = std::string("Failed: ") + e.what();
+      return true;
+    }
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -692,6 +1157,7 @@ namespace cryptonote
       return ok;
 
     CHECK_CORE_READY();
+    CHECK_CORE_WRITABLE();
 
     std::string tx_blob;
     if(!string_tools::parse_hexstr_to_binbuff(req.tx_as_hex, tx_blob))
@@ -752,10 +1218,313 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_light_wallet_account(const std::string &address, const std::string &view_key, account_public_address &addr, crypto::secret_key &view_secret_key) const
+  {
+    cryptonote::address_parse_info info;
+    if (!get_account_address_from_str(info, m_nettype, address) || info.is_subaddress)
+      return false;
+    addr = info.address;
+    return epee::string_tools::hex_to_pod(view_key, view_secret_key);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res)
+  {
+    PERF_TIMER(on_light_wallet_login);
+    res.new_address = false;
+    account_public_address address;
+    crypto::secret_key view_secret_key;
+    if (!get_light_wallet_account(req.address, req.view_key, address, view_secret_key))
+    {
+      res.status = "error";
+      res.reason = "Invalid address or view key";
+      return true;
+    }
+
+    switch (m_core.get_light_wallet_scanner()->login(address, view_secret_key, req.create_account))
+    {
+      case light_wallet_scanner::login_existing:
+        res.status = LIGHT_WALLET_RPC_STATUS_OK;
+        break;
+      case light_wallet_scanner::login_created:
+        res.status = LIGHT_WALLET_RPC_STATUS_OK;
+        res.new_address = true;
+        break;
+      case light_wallet_scanner::login_not_found:
+        res.status = "error";
+        res.reason = "Account not found";
+        break;
+      case light_wallet_scanner::login_wrong_key:
+        res.status = "error";
+        res.reason = "View key does not match the address";
+        break;
+      case light_wallet_scanner::login_too_many_accounts:
+        res.status = "error";
+        res.reason = "Too many accounts";
+        break;
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_import_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res)
+  {
+    PERF_TIMER(on_light_wallet_import_request);
+    res.import_fee = 0;
+    res.new_request = false;
+    res.request_fulfilled = false;
+    account_public_address address;
+    crypto::secret_key view_secret_key;
+    light_wallet_scanner::account_state state;
+    light_wallet_scanner *scanner = m_core.get_light_wallet_scanner();
+    if (!get_light_wallet_account(req.address, req.view_key, address, view_secret_key) || !scanner->get_account(address, view_secret_key, state))
+    {
+      res.status = "error";
+      return true;
+    }
+
+    // imports are free, the account is rescanned from the genesis block
+    res.new_request = state.start_height != 0;
+    res.request_fulfilled = scanner->import_from_genesis(address, view_secret_key);
+    res.status = res.request_fulfilled ? LIGHT_WALLET_RPC_STATUS_OK : "error";
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res)
+  {
+    PERF_TIMER(on_light_wallet_get_address_info);
+    account_public_address address;
+    crypto::secret_key view_secret_key;
+    light_wallet_scanner::account_state state;
+    if (!get_light_wallet_account(req.address, req.view_key, address, view_secret_key) || !m_core.get_light_wallet_scanner()->get_account(address, view_secret_key, state))
+      return false;
+
+    const uint64_t height = m_core.get_current_blockchain_height();
+    res.locked_funds = 0;
+    res.total_received = 0;
+    res.total_sent = 0;
+    for (const auto &out: state.outputs)
+    {
+      res.total_received += out.amount;
+      if (!is_light_wallet_output_unlocked(out, height))
+        res.locked_funds += out.amount;
+    }
+    for (const auto &spend: state.spends)
+    {
+      const auto &out = state.outputs[spend.output];
+      res.total_sent += out.amount;
+      res.spent_outputs.push_back({out.amount, epee::string_tools::pod_to_hex(spend.key_image), epee::string_tools::pod_to_hex(out.tx_pub_key), out.out_index, spend.mixin});
+    }
+    res.scanned_height = state.scanned_height;
+    res.scanned_block_height = state.scanned_height;
+    res.start_height = state.start_height;
+    res.transaction_height = height;
+    res.blockchain_height = height;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res)
+  {
+    PERF_TIMER(on_light_wallet_get_address_txs);
+    res.total_received = 0;
+    res.total_received_unlocked = 0;
+    res.scanned_height = 0;
+    res.scanned_block_height = 0;
+    res.blockchain_height = m_core.get_current_blockchain_height();
+    account_public_address address;
+    crypto::secret_key view_secret_key;
+    light_wallet_scanner::account_state state;
+    if (!get_light_wallet_account(req.address, req.view_key, address, view_secret_key) || !m_core.get_light_wallet_scanner()->get_account(address, view_secret_key, state))
+    {
+      res.status = "error";
+      return true;
+    }
+
+    // outputs and spends are both in height order, and are merged into
+    // one entry per tx
+    std::unordered_map<crypto::hash, size_t> txs;
+    auto get_tx = [&](const crypto::hash &tx_hash, uint64_t height, uint64_t timestamp, uint64_t unlock_time) -> COMMAND_RPC_GET_ADDRESS_TXS::transaction& {
+      const auto i = txs.find(tx_hash);
+      if (i != txs.end())
+        return res.transactions[i->second];
+      txs.emplace(tx_hash, res.transactions.size());
+      res.transactions.push_back(COMMAND_RPC_GET_ADDRESS_TXS::transaction());
+      COMMAND_RPC_GET_ADDRESS_TXS::transaction &tx = res.transactions.back();
+      tx.hash = epee::string_tools::pod_to_hex(tx_hash);
+      tx.timestamp = timestamp;
+      tx.total_received = 0;
+      tx.total_sent = 0;
+      tx.unlock_time = unlock_time;
+      tx.height = height;
+      tx.payment_id = epee::string_tools::pod_to_hex(crypto::null_hash);
+      tx.coinbase = false;
+      tx.mempool = false;
+      tx.mixin = 0;
+      return tx;
+    };
+    size_t o = 0, s = 0;
+    while (o < state.outputs.size() || s < state.spends.size())
+    {
+      if (s == state.spends.size() || (o < state.outputs.size() && state.outputs[o].height <= state.spends[s].height))
+      {
+        const auto &out = state.outputs[o++];
+        COMMAND_RPC_GET_ADDRESS_TXS::transaction &tx = get_tx(out.tx_hash, out.height, out.timestamp, out.unlock_time);
+        tx.total_received += out.amount;
+        tx.coinbase = out.coinbase;
+        if (out.payment_id != crypto::null_hash)
+          tx.payment_id = epee::string_tools::pod_to_hex(out.payment_id);
+        res.total_received += out.amount;
+        if (is_light_wallet_output_unlocked(out, res.blockchain_height))
+          res.total_received_unlocked += out.amount;
+      }
+      else
+      {
+        const auto &spend = state.spends[s++];
+        const auto &out = state.outputs[spend.output];
+        COMMAND_RPC_GET_ADDRESS_TXS::transaction &tx = get_tx(spend.tx_hash, spend.height, spend.timestamp, spend.unlock_time);
+        tx.total_sent += out.amount;
+        tx.mixin = spend.mixin;
+        tx.spent_outputs.push_back({out.amount, epee::string_tools::pod_to_hex(spend.key_image), epee::string_tools::pod_to_hex(out.tx_pub_key), out.out_index, spend.mixin});
+      }
+    }
+    for (size_t i = 0; i < res.transactions.size(); ++i)
+      res.transactions[i].id = i;
+
+    res.scanned_height = state.scanned_height;
+    res.scanned_block_height = state.scanned_height;
+    res.status = LIGHT_WALLET_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res)
+  {
+    PERF_TIMER(on_light_wallet_get_unspent_outs);
+    res.amount = 0;
+    res.per_kb_fee = 0;
+    account_public_address address;
+    crypto::secret_key view_secret_key;
+    light_wallet_scanner::account_state state;
+    if (!get_light_wallet_account(req.address, req.view_key, address, view_secret_key) || !m_core.get_light_wallet_scanner()->get_account(address, view_secret_key, state))
+    {
+      res.status = "error";
+      res.reason = "Account not found";
+      return true;
+    }
+    uint64_t dust_threshold = 0;
+    if (!req.use_dust && !req.dust_threshold.empty() && !epee::string_tools::get_xtype_from_string(dust_threshold, req.dust_threshold))
+    {
+      res.status = "error";
+      res.reason = "Invalid dust threshold";
+      return true;
+    }
+
+    // the wallet tells its own spends from decoys by their key images
+    std::vector<std::vector<std::string>> key_images(state.outputs.size());
+    for (const auto &spend: state.spends)
+      key_images[spend.output].push_back(epee::string_tools::pod_to_hex(spend.key_image));
+
+    for (size_t i = 0; i < state.outputs.size(); ++i)
+    {
+      const auto &out = state.outputs[i];
+      if (!out.rct && out.amount < dust_threshold)
+        continue;
+      res.outputs.push_back(COMMAND_RPC_GET_UNSPENT_OUTS::output());
+      COMMAND_RPC_GET_UNSPENT_OUTS::output &o = res.outputs.back();
+      o.amount = out.amount;
+      o.public_key = epee::string_tools::pod_to_hex(out.key);
+      o.index = out.out_index;
+      o.global_index = out.global_index;
+      if (out.rct)
+        o.rct = epee::string_tools::pod_to_hex(out.commitment) + epee::string_tools::pod_to_hex(out.encrypted_mask) + epee::string_tools::pod_to_hex(out.encrypted_amount);
+      o.tx_hash = epee::string_tools::pod_to_hex(out.tx_hash);
+      o.tx_pub_key = epee::string_tools::pod_to_hex(out.tx_pub_key);
+      o.tx_prefix_hash = epee::string_tools::pod_to_hex(out.tx_prefix_hash);
+      o.spend_key_images = std::move(key_images[i]);
+      o.timestamp = out.timestamp;
+      o.height = out.height;
+      res.amount += out.amount;
+    }
+
+    // the light wallet protocol always has a per kB fee
+    const uint8_t version = m_core.get_blockchain_storage().get_current_hard_fork_version();
+    const uint64_t fee = version >= HF_VERSION_DYNAMIC_FEE ? m_core.get_blockchain_storage().get_dynamic_base_fee_estimate(10) : FEE_PER_KB_V9;
+    res.per_kb_fee = version >= HF_VERSION_PER_BYTE_FEE ? fee * 1024 : fee;
+    res.status = LIGHT_WALLET_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTS::request& req, COMMAND_RPC_GET_RANDOM_OUTS::response& res)
+  {
+    PERF_TIMER(on_light_wallet_get_random_outs);
+    if (req.count > MAX_RESTRICTED_FAKE_OUTS_COUNT || req.amounts.size() > MAX_RESTRICTED_FAKE_OUTS_COUNT)
+    {
+      res.Error = "Too many outs requested";
+      return true;
+    }
+
+    const BlockchainDB &db = m_core.get_blockchain_storage().get_db();
+    for (const std::string &amount_str: req.amounts)
+    {
+      uint64_t amount;
+      if (!epee::string_tools::get_xtype_from_string(amount, amount_str))
+      {
+        res.amount_outs.clear();
+        res.Error = "Invalid amount";
+        return true;
+      }
+      res.amount_outs.push_back({amount, {}});
+      COMMAND_RPC_GET_RANDOM_OUTS::amount_out &amount_out = res.amount_outs.back();
+      const uint64_t num_outs = db.get_num_outputs(amount);
+      if (num_outs == 0)
+        continue;
+
+      // picked on a triangular distribution favouring recent outputs, in a
+      // few rounds as some of the picks are still locked
+      std::unordered_set<uint64_t> picked;
+      for (int round = 0; round < 4 && amount_out.outputs.size() < req.count && picked.size() < num_outs; ++round)
+      {
+        COMMAND_RPC_GET_OUTPUTS_BIN::request outs_req;
+        COMMAND_RPC_GET_OUTPUTS_BIN::response outs_res;
+        for (size_t n = 0; n < 2 * (req.count - amount_out.outputs.size()) && picked.size() < num_outs; ++n)
+        {
+          const uint64_t r = crypto::rand<uint64_t>() % ((uint64_t)1 << 53);
+          const double frac = std::sqrt((double)r / ((uint64_t)1 << 53));
+          const uint64_t index = std::min<uint64_t>(frac * num_outs, num_outs - 1);
+          if (picked.insert(index).second)
+            outs_req.outputs.push_back({amount, index});
+        }
+        if (!m_core.get_outs(outs_req, outs_res))
+          break;
+        for (size_t n = 0; n < outs_res.outs.size() && amount_out.outputs.size() < req.count; ++n)
+        {
+          const auto &out = outs_res.outs[n];
+          if (!out.unlocked)
+            continue;
+          amount_out.outputs.push_back({epee::string_tools::pod_to_hex(out.key), outs_req.outputs[n].index,
+              amount == 0 ? epee::string_tools::pod_to_hex(out.mask) + std::string(128, '0') : std::string()});
+        }
+      }
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_light_wallet_submit_raw_tx(const COMMAND_RPC_SUBMIT_RAW_TX::request& req, COMMAND_RPC_SUBMIT_RAW_TX::response& res)
+  {
+    PERF_TIMER(on_light_wallet_submit_raw_tx);
+    COMMAND_RPC_SEND_RAW_TX::request send_req;
+    COMMAND_RPC_SEND_RAW_TX::response send_res;
+    send_req.tx_as_hex = req.tx;
+    send_req.do_not_relay = false;
+    if (!on_send_raw_tx(send_req, send_res))
+      return false;
+    res.status = send_res.status;
+    res.error = send_res.reason;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_start_mining(const COMMAND_RPC_START_MINING::request& req, COMMAND_RPC_START_MINING::response& res)
   {
     PERF_TIMER(on_start_mining);
     CHECK_CORE_READY();
+    CHECK_CORE_WRITABLE();
     cryptonote::address_parse_info info;
     if(!get_account_address_from_str(info, m_nettype, req.miner_address))
     {
@@ -834,6 +1603,13 @@ namespace cryptonote
       res.address = get_account_address_as_str(m_nettype, false, lMiningAdr);
     }
 
+    crypto::slow_hash_allocation_stats stats;
+    crypto::slow_hash_get_allocation_stats(&stats);
+    res.small_page_scratchpads = stats.small_pages;
+    res.transparent_hugepage_scratchpads = stats.transparent_huge_pages;
+    res.hugepage_scratchpads = stats.huge_pages;
+    res.numa_bound_scratchpads = stats.numa_bound;
+
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
@@ -943,6 +1719,18 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_transaction_pool_changes_bin(const COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN::response& res, bool request_has_rpc_origin)
+  {
+    PERF_TIMER(on_get_transaction_pool_changes_bin);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN>(invoke_http_mode::BIN, "/get_transaction_pool_changes.bin", req, res, r))
+      return r;
+
+    res.full = !m_core.get_pool_transaction_changes(req.instance, req.cookie, res.instance, res.cookie, res.added, res.removed, !request_has_rpc_origin || !m_restricted);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_transaction_pool_hashes(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response& res, bool request_has_rpc_origin)
   {
     PERF_TIMER(on_get_transaction_pool_hashes);
@@ -1132,6 +1920,7 @@ namespace cryptonote
       }
     }
     CHECK_CORE_READY();
+    CHECK_CORE_WRITABLE_WE();
     if(req.size()!=1)
     {
       error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
@@ -1175,11 +1964,89 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_mining_job(const COMMAND_RPC_GET_MINING_JOB::request& req, COMMAND_RPC_GET_MINING_JOB::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_get_mining_job);
+    {
+      boost::shared_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      if (m_should_use_bootstrap_daemon)
+      {
+        res.status = "This command is unsupported for bootstrap daemon";
+        return false;
+      }
+    }
+    if(!check_core_ready())
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;
+      error_resp.message = "Core is busy";
+      return false;
+    }
+
+    cryptonote::address_parse_info info;
+    if(!req.wallet_address.size() || !cryptonote::get_account_address_from_str(info, m_nettype, req.wallet_address))
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_WRONG_WALLET_ADDRESS;
+      error_resp.message = "Failed to parse wallet address";
+      return false;
+    }
+    if (info.is_subaddress)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_MINING_TO_SUBADDRESS;
+      error_resp.message = "Mining to subaddress is not supported yet";
+      return false;
+    }
+
+    mining_job_cache::job job;
+    if (!m_mining_jobs.get_job(info.address, req.prev_template_id, req.wait_ms, job))
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = "Internal error: failed to create block template";
+      return false;
+    }
+    res.template_id = job.template_id;
+    res.extra_nonce = job.extra_nonce;
+    res.difficulty = job.difficulty;
+    res.height = job.height;
+    res.expected_reward = job.expected_reward;
+    res.prev_hash = string_tools::pod_to_hex(job.prev_hash);
+    res.blockhashing_blob = string_tools::buff_to_hex_nodelimer(job.hashing_blob);
+    res.untrusted = false;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_submit_share(const COMMAND_RPC_SUBMIT_SHARE::request& req, COMMAND_RPC_SUBMIT_SHARE::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_submit_share);
+    CHECK_CORE_READY();
+    CHECK_CORE_WRITABLE_WE();
+
+    crypto::hash pow_hash;
+    switch (m_mining_jobs.submit_share(req.template_id, req.extra_nonce, req.nonce, req.share_difficulty, pow_hash))
+    {
+      case mining_job_cache::share_stale: res.result = "stale"; break;
+      case mining_job_cache::share_invalid: res.result = "invalid"; break;
+      case mining_job_cache::share_duplicate: res.result = "duplicate"; break;
+      case mining_job_cache::share_low_difficulty: res.result = "low difficulty"; break;
+      case mining_job_cache::share_accepted: res.result = "accepted"; break;
+      case mining_job_cache::share_block_found: res.result = "block"; break;
+      case mining_job_cache::share_block_rejected:
+        error_resp.code = CORE_RPC_ERROR_CODE_BLOCK_NOT_ACCEPTED;
+        error_resp.message = "Block not accepted";
+        return false;
+    }
+    if (pow_hash != crypto::null_hash)
+      res.pow_hash = string_tools::pod_to_hex(pow_hash);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_generateblocks(const COMMAND_RPC_GENERATEBLOCKS::request& req, COMMAND_RPC_GENERATEBLOCKS::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_generateblocks);
 
     CHECK_CORE_READY();
+    CHECK_CORE_WRITABLE_WE();
     
     res.status = CORE_RPC_STATUS_OK;
 
@@ -1250,6 +2117,19 @@ namespace cryptonote
   bool core_rpc_server::fill_block_header_response(const block& blk, bool orphan_status, uint64_t height, const crypto::hash& hash, block_header_response& response, bool fill_pow_hash)
   {
     PERF_TIMER(fill_block_header_response);
+    block_header_entry_t entry;
+    entry.blk = blk;
+    entry.hash = hash;
+    entry.difficulty = m_core.get_blockchain_storage().block_difficulty(height);
+    entry.cumulative_difficulty = m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(height);
+    entry.weight = m_core.get_blockchain_storage().get_db().get_block_weight(height);
+    fill_block_header_response(entry, orphan_status, height, m_core.get_current_blockchain_height() - height - 1, response, fill_pow_hash);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::fill_block_header_response(const block_header_entry_t& entry, bool orphan_status, uint64_t height, uint64_t depth, block_header_response& response, bool fill_pow_hash)
+  {
+    const block &blk = entry.blk;
     response.major_version = blk.major_version;
     response.minor_version = blk.minor_version;
     response.timestamp = blk.timestamp;
@@ -1257,79 +2137,79 @@ namespace cryptonote
     response.nonce = blk.nonce;
     response.orphan_status = orphan_status;
     response.height = height;
-    response.depth = m_core.get_current_blockchain_height() - height - 1;
-    response.hash = string_tools::pod_to_hex(hash);
-    response.difficulty = m_core.get_blockchain_storage().block_difficulty(height);
-    response.cumulative_difficulty = response.block_weight = m_core.get_blockchain_storage().get_db().get_block_cumulative_difficulty(height);
+    response.depth = depth;
+    response.hash = string_tools::pod_to_hex(entry.hash);
+    response.difficulty = entry.difficulty;
+    response.cumulative_difficulty = entry.cumulative_difficulty;
     response.reward = get_block_reward(blk);
-    response.block_size = response.block_weight = m_core.get_blockchain_storage().get_db().get_block_weight(height);
+    response.block_size = response.block_weight = entry.weight;
     response.num_txes = blk.tx_hashes.size();
     response.pow_hash = fill_pow_hash ? string_tools::pod_to_hex(get_block_longhash(blk, height)) : "";
-    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
-  template <typename COMMAND_TYPE>
-  bool core_rpc_server::use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r)
+  bool core_rpc_server::should_use_bootstrap_daemon()
   {
-    res.untrusted = false;
-    if (m_bootstrap_daemon_address.empty())
-      return false;
-
-    boost::unique_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
-    if (!m_should_use_bootstrap_daemon)
     {
-      MINFO("The local daemon is fully synced. Not switching back to the bootstrap daemon");
-      return false;
-    }
+      boost::unique_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      if (!m_should_use_bootstrap_daemon)
+      {
+        MINFO("The local daemon is fully synced. Not switching back to the bootstrap daemon");
+        return false;
+      }
 
-    auto current_time = std::chrono::system_clock::now();
-    if (current_time - m_bootstrap_height_check_time > std::chrono::seconds(30))  // update every 30s
-    {
+      // one call checks the heights, the others go on with the last decision meanwhile
+      auto current_time = std::chrono::system_clock::now();
+      if (current_time - m_bootstrap_height_check_time <= std::chrono::seconds(30))  // update every 30s
+        return true;
       m_bootstrap_height_check_time = current_time;
+    }
 
-      uint64_t top_height;
-      crypto::hash top_hash;
-      m_core.get_blockchain_top(top_height, top_hash);
-      ++top_height; // turn top block height into blockchain height
+    uint64_t top_height;
+    crypto::hash top_hash;
+    m_core.get_blockchain_top(top_height, top_hash);
+    ++top_height; // turn top block height into blockchain height
 
-      // query bootstrap daemon's height
-      cryptonote::COMMAND_RPC_GET_HEIGHT::request getheight_req;
-      cryptonote::COMMAND_RPC_GET_HEIGHT::response getheight_res;
-      bool ok = epee::net_utils::invoke_http_json("/getheight", getheight_req, getheight_res, m_http_client);
-      ok = ok && getheight_res.status == CORE_RPC_STATUS_OK;
+    uint64_t bootstrap_height = 0;
+    const bool ok = m_bootstrap_daemon->get_height(bootstrap_height);
 
-      m_should_use_bootstrap_daemon = ok && top_height + 10 < getheight_res.height;
-      MINFO((m_should_use_bootstrap_daemon ? "Using" : "Not using") << " the bootstrap daemon (our height: " << top_height << ", bootstrap daemon's height: " << getheight_res.height << ")");
-    }
-    if (!m_should_use_bootstrap_daemon)
+    boost::unique_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+    m_should_use_bootstrap_daemon = ok && top_height + 10 < bootstrap_height;
+    MINFO((m_should_use_bootstrap_daemon ? "Using" : "Not using") << " the bootstrap daemon (our height: " << top_height << ", bootstrap daemon's height: " << bootstrap_height << ")");
+    return m_should_use_bootstrap_daemon;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  template <typename COMMAND_TYPE>
+  bool core_rpc_server::use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r)
+  {
+    res.untrusted = false;
+    if (!m_bootstrap_daemon)
       return false;
 
+    if (!should_use_bootstrap_daemon())
+      return false;
+
+    // the call is forwarded without holding the lock, so concurrent ones go through the pool together
     if (mode == invoke_http_mode::JON)
     {
-      r = epee::net_utils::invoke_http_json(command_name, req, res, m_http_client);
+      r = m_bootstrap_daemon->invoke_http_json(command_name, req, res);
     }
     else if (mode == invoke_http_mode::BIN)
     {
-      r = epee::net_utils::invoke_http_bin(command_name, req, res, m_http_client);
+      r = m_bootstrap_daemon->invoke_http_bin(command_name, req, res);
     }
     else if (mode == invoke_http_mode::JON_RPC)
     {
-      epee::json_rpc::request<typename COMMAND_TYPE::request> json_req = AUTO_VAL_INIT(json_req);
-      epee::json_rpc::response<typename COMMAND_TYPE::response, std::string> json_resp = AUTO_VAL_INIT(json_resp);
-      json_req.jsonrpc = "2.0";
-      json_req.id = epee::serialization::storage_entry(0);
-      json_req.method = command_name;
-      json_req.params = req;
-      r = net_utils::invoke_http_json("/json_rpc", json_req, json_resp, m_http_client);
-      if (r)
-        res = json_resp.result;
+      r = m_bootstrap_daemon->invoke_http_json_rpc(command_name, req, res);
     }
     else
     {
       MERROR("Unknown invoke_http_mode: " << mode);
       return false;
     }
-    m_was_bootstrap_ever_used = true;
+    {
+      boost::unique_lock<boost::shared_mutex> lock(m_bootstrap_daemon_mutex);
+      m_was_bootstrap_ever_used = true;
+    }
     r = r && res.status == CORE_RPC_STATUS_OK;
     res.untrusted = true;
     return true;
@@ -1408,6 +2288,7 @@ namespace cryptonote
   //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_block_headers_range(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, epee::json_rpc::error& error_resp){
     PERF_TIMER(on_get_block_headers_range);
+    LIMIT_HEAVY_JSON_RPC("get_block_headers_range");
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCK_HEADERS_RANGE>(invoke_http_mode::JON_RPC, "getblockheadersrange", req, res, r))
       return r;
@@ -1419,17 +2300,23 @@ namespace cryptonote
       error_resp.message = "Invalid start/end heights.";
       return false;
     }
+    // the blocks and their metadata are read in one pass of a single db txn
+    std::vector<block_header_entry_t> entries;
+    try
+    {
+      m_core.get_blockchain_storage().get_db().get_block_header_entries(req.start_height, req.end_height, entries);
+    }
+    catch (const std::exception &e)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = std::string("Internal error: can't get blocks in range: ") + e.what();
+      return false;
+    }
+    res.headers.reserve(entries.size());
     for (uint64_t h = req.start_height; h <= req.end_height; ++h)
     {
-      crypto::hash block_hash = m_core.get_block_id_by_height(h);
-      block blk;
-      bool have_block = m_core.get_block_by_hash(block_hash, blk);
-      if (!have_block)
-      {
-        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
-        error_resp.message = "Internal error: can't get block by height. Height = " + boost::lexical_cast<std::string>(h) + ". Hash = " + epee::string_tools::pod_to_hex(block_hash) + '.';
-        return false;
-      }
+      const block_header_entry_t &entry = entries[h - req.start_height];
+      const block &blk = entry.blk;
       if (blk.miner_tx.vin.size() != 1 || blk.miner_tx.vin.front().type() != typeid(txin_gen))
       {
         error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
@@ -1444,13 +2331,7 @@ namespace cryptonote
         return false;
       }
       res.headers.push_back(block_header_response());
-      bool response_filled = fill_block_header_response(blk, false, block_height, block_hash, res.headers.back(), req.fill_pow_hash);
-      if (!response_filled)
-      {
-        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
-        error_resp.message = "Internal error: can't produce valid response.";
-        return false;
-      }
+      fill_block_header_response(entry, false, block_height, bc_height - block_height - 1, res.headers.back(), req.fill_pow_hash);
     }
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -1609,6 +2490,20 @@ namespace cryptonote
     }
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     res.update_available = m_core.is_update_available();
+    cryptonote::key_image_filter_stats kif;
+    if (m_core.get_blockchain_storage().get_db().get_key_image_filter_stats(kif) && kif.enabled)
+    {
+      res.key_image_filter_size = kif.memory_size;
+      // measured over the lookups for key images which were not spent
+      res.key_image_filter_fp_rate = kif.filtered + kif.false_positives ? kif.false_positives / (double)(kif.filtered + kif.false_positives) : kif.estimated_fp_rate;
+      res.key_image_filter_hit_rate = kif.lookups ? kif.filtered / (double)kif.lookups : 0.0;
+    }
+    else
+    {
+      res.key_image_filter_size = 0;
+      res.key_image_filter_fp_rate = 0.0;
+      res.key_image_filter_hit_rate = 0.0;
+    }
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -1647,6 +2542,17 @@ namespace cryptonote
         res.bans.push_back(b);
       }
     }
+    std::map<std::string, time_t> blocked_subnets = m_p2p.get_blocked_subnets();
+    for (std::map<std::string, time_t>::const_iterator i = blocked_subnets.begin(); i != blocked_subnets.end(); ++i)
+    {
+      if (i->second > now) {
+        COMMAND_RPC_GETBANS::ban b;
+        b.host = i->first;
+        b.ip = 0;
+        b.seconds = i->second - now;
+        res.bans.push_back(b);
+      }
+    }
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -1658,6 +2564,23 @@ namespace cryptonote
 
     for (auto i = req.bans.begin(); i != req.bans.end(); ++i)
     {
+      uint32_t subnet_ip;
+      uint8_t subnet_bits;
+      if (i->host.find('/') != std::string::npos)
+      {
+        if (!nodetool::ban_list::parse_subnet(i->host, subnet_ip, subnet_bits))
+        {
+          error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+          error_resp.message = "Invalid subnet";
+          return false;
+        }
+        if (i->ban)
+          m_p2p.block_subnet(subnet_ip, subnet_bits, i->seconds);
+        else
+          m_p2p.unblock_subnet(subnet_ip, subnet_bits);
+        continue;
+      }
+
       epee::net_utils::network_address na;
       if (!i->host.empty())
       {
@@ -1685,6 +2608,7 @@ namespace cryptonote
   bool core_rpc_server::on_flush_txpool(const COMMAND_RPC_FLUSH_TRANSACTION_POOL::request& req, COMMAND_RPC_FLUSH_TRANSACTION_POOL::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_flush_txpool);
+    CHECK_CORE_WRITABLE_WE();
 
     bool failed = false;
     std::vector<crypto::hash> txids;
@@ -1740,6 +2664,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_output_histogram(const COMMAND_RPC_GET_OUTPUT_HISTOGRAM::request& req, COMMAND_RPC_GET_OUTPUT_HISTOGRAM::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_get_output_histogram);
+    LIMIT_HEAVY_JSON_RPC("get_output_histogram");
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_HISTOGRAM>(invoke_http_mode::JON_RPC, "get_output_histogram", req, res, r))
       return r;
@@ -1782,6 +2707,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_coinbase_tx_sum(const COMMAND_RPC_GET_COINBASE_TX_SUM::request& req, COMMAND_RPC_GET_COINBASE_TX_SUM::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_get_coinbase_tx_sum);
+    LIMIT_HEAVY_JSON_RPC("get_coinbase_tx_sum");
     std::pair<uint64_t, uint64_t> amounts = m_core.get_coinbase_tx_sum(req.height, req.count);
     res.emission_amount = amounts.first;
     res.fee_amount = amounts.second;
@@ -1802,6 +2728,86 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_tx_construction_info(const COMMAND_RPC_GET_TX_CONSTRUCTION_INFO::request& req, COMMAND_RPC_GET_TX_CONSTRUCTION_INFO::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_get_tx_construction_info);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TX_CONSTRUCTION_INFO>(invoke_http_mode::JON_RPC, "get_tx_construction_info", req, res, r))
+      return r;
+
+    const Blockchain &blockchain = m_core.get_blockchain_storage();
+    crypto::hash top_hash;
+    m_core.get_blockchain_top(res.height, top_hash);
+    ++res.height; // turn top block height into blockchain height
+    res.target_height = m_core.get_target_blockchain_height();
+    res.block_weight_limit = blockchain.get_current_cumulative_block_weight_limit();
+    res.fee = blockchain.get_dynamic_base_fee_estimate(req.grace_blocks);
+    res.quantization_mask = Blockchain::get_fee_quantization_mask();
+    res.hard_fork_version = blockchain.get_current_hard_fork_version();
+
+    // every version up to the last one the daemon knows about
+    uint32_t window, votes, threshold;
+    uint64_t earliest_height;
+    uint8_t voting, last_version;
+    blockchain.get_hard_fork_voting_info(1, window, votes, threshold, earliest_height, last_version);
+    res.earliest_heights.resize(last_version + 1, 0);
+    for (unsigned version = 1; version <= last_version; ++version)
+    {
+      blockchain.get_hard_fork_voting_info(version, window, votes, threshold, earliest_height, voting);
+      res.earliest_heights[version] = earliest_height;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_memory_usage(const COMMAND_RPC_GET_MEMORY_USAGE::request& req, COMMAND_RPC_GET_MEMORY_USAGE::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_get_memory_usage);
+    std::vector<tools::memory_usage> usage;
+    try
+    {
+      m_core.get_blockchain_storage().get_memory_usage(usage);
+      m_core.get_pool().get_memory_usage(usage);
+      if (m_core.get_light_wallet_scanner())
+        m_core.get_light_wallet_scanner()->get_memory_usage(usage);
+      m_p2p.get_payload_object().get_memory_usage(usage);
+      m_p2p.get_peerlist_manager().get_memory_usage(usage);
+      uint64_t count, bytes;
+      epee::net_utils::connection_basic::get_send_que_totals(count, bytes);
+      usage.push_back({"net.send_queues", count, bytes, 0, 0});
+    }
+    catch (const std::exception &e)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = std::string("Failed to get memory usage: ") + e.what();
+      return false;
+    }
+
+    res.total_bytes = 0;
+    res.entries.reserve(usage.size());
+    for (const tools::memory_usage &u: usage)
+    {
+      res.entries.push_back({u.name, u.count, u.bytes, u.max_count, u.max_bytes});
+      res.total_bytes += u.bytes;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_backup_blockchain(const COMMAND_RPC_BACKUP_BLOCKCHAIN::request& req, COMMAND_RPC_BACKUP_BLOCKCHAIN::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_backup_blockchain);
+    if (!req.folder.empty() && !m_core.start_blockchain_backup(req.folder, req.max_bytes_per_second))
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = "A copy of the blockchain is being written already";
+      return false;
+    }
+    m_core.get_blockchain_backup_status(res.in_progress, res.bytes_written, res.error);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_alternate_chains(const COMMAND_RPC_GET_ALTERNATE_CHAINS::request& req, COMMAND_RPC_GET_ALTERNATE_CHAINS::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_get_alternate_chains);
@@ -2024,6 +3030,7 @@ namespace cryptonote
   bool core_rpc_server::on_relay_tx(const COMMAND_RPC_RELAY_TX::request& req, COMMAND_RPC_RELAY_TX::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_relay_tx);
+    CHECK_CORE_WRITABLE_WE();
 
     bool failed = false;
     res.status = "";
@@ -2089,6 +3096,22 @@ namespace cryptonote
       res.spans.push_back({span.start_block_height, span.nblocks, span_connection_id, (uint32_t)(span.rate + 0.5f), speed, span.size, address});
       return true;
     });
+    res.queued_bytes = block_queue.get_data_size();
+    res.inflight_bytes = block_queue.get_inflight_size();
+    size_t high_watermark, low_watermark;
+    m_p2p.get_payload_object().get_block_queue_watermarks(high_watermark, low_watermark, res.queue_paused);
+    res.queue_high_watermark = high_watermark;
+    res.queue_low_watermark = low_watermark;
+
+    const cryptonote::Blockchain &blockchain = m_core.get_blockchain_storage();
+    const cryptonote::db_sync_tuner::state db_sync = blockchain.get_db_sync_state();
+    res.db_batch_blocks = m_core.get_block_sync_size(res.height);
+    res.db_sync_blocks = blockchain.get_db_sync_blocks();
+    res.db_adaptive_batch = db_sync.batch_blocks != 0;
+    res.db_adaptive_sync = db_sync.sync_blocks != 0;
+    res.db_commit_time_us = db_sync.avg_commit_us;
+    res.db_sync_time_us = db_sync.avg_sync_us;
+    res.db_rotating_drive = db_sync.rotating_drive;
 
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -2097,6 +3120,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_txpool_backlog(const COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_get_txpool_backlog);
+    LIMIT_HEAVY_JSON_RPC("get_txpool_backlog");
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG>(invoke_http_mode::JON_RPC, "get_txpool_backlog", req, res, r))
       return r;
@@ -2115,6 +3139,7 @@ namespace cryptonote
   bool core_rpc_server::on_get_output_distribution(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, epee::json_rpc::error& error_resp)
   {
     PERF_TIMER(on_get_output_distribution);
+    LIMIT_HEAVY_JSON_RPC("get_output_distribution");
     bool r;
     if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_OUTPUT_DISTRIBUTION>(invoke_http_mode::JON_RPC, "get_output_distribution", req, res, r))
       return r;
@@ -2194,6 +3219,51 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_perf_stats(const COMMAND_RPC_GET_PERF_STATS::request& req, COMMAND_RPC_GET_PERF_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    res.enabled = tools::performance_stats_enabled.load(std::memory_order_relaxed);
+    for (const auto &e: tools::get_performance_stats(req.reset))
+      res.stats.push_back({e.name, e.count, e.total_ns, e.max_ns, e.p50_ns, e.p99_ns});
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_processing_trace(const COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE::request& req, COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE::response& res, epee::json_rpc::error& error_resp)
+  {
+    const block_tracer &tracer = m_core.get_blockchain_storage().get_block_tracer();
+    res.enabled = tracer.enabled();
+    const std::vector<block_trace> traces = tracer.get_traces();
+    if (req.chrome_trace)
+    {
+      res.chrome_trace = block_tracer::to_chrome_trace(traces);
+    }
+    else
+    {
+      res.blocks.reserve(traces.size());
+      for (const block_trace &b: traces)
+      {
+        res.blocks.push_back({b.height, epee::string_tools::pod_to_hex(b.id), b.timestamp_us, b.duration_us, b.added, {}, {}});
+        COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE::block &block = res.blocks.back();
+        for (const block_trace::phase &p: b.phases)
+          block.phases.push_back({p.name, p.start_us, p.duration_us});
+        for (const block_trace::tx &tx: b.txs)
+          block.txs.push_back({epee::string_tools::pod_to_hex(tx.id), tx.start_us, tx.duration_us, tx.pool_us, tx.ring_members_us});
+      }
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_levin_stats(const COMMAND_RPC_GET_LEVIN_STATS::request& req, COMMAND_RPC_GET_LEVIN_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_get_levin_stats);
+    res.commands = m_p2p.get_payload_object().get_levin_command_stats();
+    if (req.connections)
+      res.connections = m_p2p.get_payload_object().get_connection_levin_stats();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
 
 
   const command_line::arg_descriptor<std::string, false, true, 2> core_rpc_server::arg_rpc_bind_port = {
@@ -2233,4 +3303,46 @@ namespace cryptonote
     , "Specify username:password for the bootstrap daemon login"
     , ""
     };
+
+  const command_line::arg_descriptor<size_t> core_rpc_server::arg_bootstrap_daemon_connections = {
+      "bootstrap-daemon-connections"
+    , "Keep-alive connections to the bootstrap daemon, for forwarding calls concurrently"
+    , bootstrap_daemon::DEFAULT_MAX_CONNECTIONS
+    };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_threads = {
+      "rpc-threads"
+    , "Number of threads serving RPC requests"
+    , 2
+    };
+
+  const command_line::arg_descriptor<unsigned> core_rpc_server::arg_rpc_max_concurrent_heavy = {
+      "rpc-max-concurrent-heavy"
+    , "Max number of expensive RPC calls running at once, others get a busy reply (0 = one less than rpc-threads)"
+    , 0
+    };
+
+  const command_line::arg_descriptor<bool> core_rpc_server::arg_perf_stats = {
+      "perf-stats"
+    , "Aggregate PERF_TIMER timings, for the get_perf_stats RPC and /metrics"
+    , false
+    };
+
+  const command_line::arg_descriptor<bool> core_rpc_server::arg_rpc_metrics = {
+      "rpc-metrics"
+    , "Serve daemon metrics in the Prometheus text format on /metrics, unrestricted RPC only"
+    , false
+    };
+
+  const command_line::arg_descriptor<uint64_t> core_rpc_server::arg_rpc_response_cache_size = {
+      "rpc-response-cache-size"
+    , "Bytes of replies to repeated read only RPC calls kept until the chain changes (0 to disable)"
+    , rpc_response_cache::DEFAULT_MAX_SIZE
+    };
+
+  const command_line::arg_descriptor<std::string> core_rpc_server::arg_rpc_record_requests = {
+      "rpc-record-requests"
+    , "Append every RPC request received to this file, for replay with net_load_tests_rpc. Requests may identify wallet outputs, keep the file private"
+    , ""
+    };
 }  // namespace cryptonote
@@ -35,8 +35,11 @@
 #include <boost/program_options/variables_map.hpp>
 
 #include "net/http_server_impl_base.h"
-#include "net/http_client.h"
+#include "common/request_limiter.h"
+#include "bootstrap_daemon.h"
 #include "core_rpc_server_commands_defs.h"
+#include "mining_jobs.h"
+#include "rpc_response_cache.h"
 #include "cryptonote_core/cryptonote_core.h"
 #include "p2p/net_node.h"
 #include "cryptonote_protocol/cryptonote_protocol_handler.h"
@@ -59,6 +62,13 @@ namespace cryptonote
     static const command_line::arg_descriptor<bool> arg_restricted_rpc;
     static const command_line::arg_descriptor<std::string> arg_bootstrap_daemon_address;
     static const command_line::arg_descriptor<std::string> arg_bootstrap_daemon_login;
+    static const command_line::arg_descriptor<size_t> arg_bootstrap_daemon_connections;
+    static const command_line::arg_descriptor<unsigned> arg_rpc_threads;
+    static const command_line::arg_descriptor<unsigned> arg_rpc_max_concurrent_heavy;
+    static const command_line::arg_descriptor<bool> arg_perf_stats;
+    static const command_line::arg_descriptor<bool> arg_rpc_metrics;
+    static const command_line::arg_descriptor<uint64_t> arg_rpc_response_cache_size;
+    static const command_line::arg_descriptor<std::string> arg_rpc_record_requests;
 
     typedef epee::net_utils::connection_context_base connection_context;
 
@@ -76,7 +86,9 @@ namespace cryptonote
       );
     network_type nettype() const { return m_nettype; }
 
-    CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
+    // forwards http requests to the uri map, like CHAIN_HTTP_TO_MAP2, but
+    // turns expensive requests away when too many of them are running
+    bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context);
 
     BEGIN_URI_MAP2()
       MAP_URI_AUTO_JON2("/get_height", on_get_height, COMMAND_RPC_GET_HEIGHT)
@@ -85,6 +97,7 @@ namespace cryptonote
       MAP_URI_AUTO_BIN2("/getblocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST)
       MAP_URI_AUTO_BIN2("/get_blocks_by_height.bin", on_get_blocks_by_height, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT)
       MAP_URI_AUTO_BIN2("/getblocks_by_height.bin", on_get_blocks_by_height, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT)
+      MAP_URI_AUTO_BIN2("/get_block_filters.bin", on_get_block_filters, COMMAND_RPC_GET_BLOCK_FILTERS)
       MAP_URI_AUTO_BIN2("/get_hashes.bin", on_get_hashes, COMMAND_RPC_GET_HASHES_FAST)
       MAP_URI_AUTO_BIN2("/gethashes.bin", on_get_hashes, COMMAND_RPC_GET_HASHES_FAST)
       MAP_URI_AUTO_BIN2("/get_o_indexes.bin", on_get_indexes, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES)      
@@ -93,6 +106,9 @@ namespace cryptonote
       MAP_URI_AUTO_JON2("/gettransactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
       MAP_URI_AUTO_JON2("/get_alt_blocks_hashes", on_get_alt_blocks_hashes, COMMAND_RPC_GET_ALT_BLOCKS_HASHES)
       MAP_URI_AUTO_JON2("/is_key_image_spent", on_is_key_image_spent, COMMAND_RPC_IS_KEY_IMAGE_SPENT)
+      MAP_URI_AUTO_BIN2("/is_key_image_spent.bin", on_is_key_image_spent_bin, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN)
+      MAP_URI_AUTO_JON2("/get_key_image_spenders", on_get_key_image_spenders, COMMAND_RPC_GET_KEY_IMAGE_SPENDERS)
+      MAP_URI_AUTO_JON2("/get_output_key_locations", on_get_output_key_locations, COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS)
       MAP_URI_AUTO_JON2("/send_raw_transaction", on_send_raw_tx, COMMAND_RPC_SEND_RAW_TX)
       MAP_URI_AUTO_JON2("/sendrawtransaction", on_send_raw_tx, COMMAND_RPC_SEND_RAW_TX)
       MAP_URI_AUTO_JON2_IF("/start_mining", on_start_mining, COMMAND_RPC_START_MINING, !m_restricted)
@@ -105,6 +121,7 @@ namespace cryptonote
       MAP_URI_AUTO_JON2_IF("/set_log_categories", on_set_log_categories, COMMAND_RPC_SET_LOG_CATEGORIES, !m_restricted)
       MAP_URI_AUTO_JON2("/get_transaction_pool", on_get_transaction_pool, COMMAND_RPC_GET_TRANSACTION_POOL)
       MAP_URI_AUTO_JON2("/get_transaction_pool_hashes.bin", on_get_transaction_pool_hashes_bin, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN)
+      MAP_URI_AUTO_BIN2("/get_transaction_pool_changes.bin", on_get_transaction_pool_changes_bin, COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN)
       MAP_URI_AUTO_JON2("/get_transaction_pool_hashes", on_get_transaction_pool_hashes, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES)
       MAP_URI_AUTO_JON2("/get_transaction_pool_stats", on_get_transaction_pool_stats, COMMAND_RPC_GET_TRANSACTION_POOL_STATS)
       MAP_URI_AUTO_JON2_IF("/stop_daemon", on_stop_daemon, COMMAND_RPC_STOP_DAEMON, !m_restricted)
@@ -118,6 +135,13 @@ namespace cryptonote
       MAP_URI_AUTO_JON2_IF("/stop_save_graph", on_stop_save_graph, COMMAND_RPC_STOP_SAVE_GRAPH, !m_restricted)
       MAP_URI_AUTO_JON2("/get_outs", on_get_outs, COMMAND_RPC_GET_OUTPUTS)      
       MAP_URI_AUTO_JON2_IF("/update", on_update, COMMAND_RPC_UPDATE, !m_restricted)
+      MAP_URI_AUTO_JON2_IF("/login", on_light_wallet_login, COMMAND_RPC_LOGIN, m_core.get_light_wallet_scanner())
+      MAP_URI_AUTO_JON2_IF("/import_wallet_request", on_light_wallet_import_request, COMMAND_RPC_IMPORT_WALLET_REQUEST, m_core.get_light_wallet_scanner())
+      MAP_URI_AUTO_JON2_IF("/get_address_info", on_light_wallet_get_address_info, COMMAND_RPC_GET_ADDRESS_INFO, m_core.get_light_wallet_scanner())
+      MAP_URI_AUTO_JON2_IF("/get_address_txs", on_light_wallet_get_address_txs, COMMAND_RPC_GET_ADDRESS_TXS, m_core.get_light_wallet_scanner())
+      MAP_URI_AUTO_JON2_IF("/get_unspent_outs", on_light_wallet_get_unspent_outs, COMMAND_RPC_GET_UNSPENT_OUTS, m_core.get_light_wallet_scanner())
+      MAP_URI_AUTO_JON2_IF("/get_random_outs", on_light_wallet_get_random_outs, COMMAND_RPC_GET_RANDOM_OUTS, m_core.get_light_wallet_scanner())
+      MAP_URI_AUTO_JON2_IF("/submit_raw_tx", on_light_wallet_submit_raw_tx, COMMAND_RPC_SUBMIT_RAW_TX, m_core.get_light_wallet_scanner())
       BEGIN_JSON_RPC_MAP("/json_rpc")
         MAP_JON_RPC("get_block_count",           on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
         MAP_JON_RPC("getblockcount",             on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
@@ -127,6 +151,8 @@ namespace cryptonote
         MAP_JON_RPC_WE("getblocktemplate",       on_getblocktemplate,           COMMAND_RPC_GETBLOCKTEMPLATE)
         MAP_JON_RPC_WE("submit_block",           on_submitblock,                COMMAND_RPC_SUBMITBLOCK)
         MAP_JON_RPC_WE("submitblock",            on_submitblock,                COMMAND_RPC_SUBMITBLOCK)
+        MAP_JON_RPC_WE("get_mining_job",         on_get_mining_job,             COMMAND_RPC_GET_MINING_JOB)
+        MAP_JON_RPC_WE("submit_share",           on_submit_share,               COMMAND_RPC_SUBMIT_SHARE)
         MAP_JON_RPC_WE_IF("generateblocks",         on_generateblocks,             COMMAND_RPC_GENERATEBLOCKS, !m_restricted)
         MAP_JON_RPC_WE("get_last_block_header",  on_get_last_block_header,      COMMAND_RPC_GET_LAST_BLOCK_HEADER)
         MAP_JON_RPC_WE("getlastblockheader",     on_get_last_block_header,      COMMAND_RPC_GET_LAST_BLOCK_HEADER)
@@ -148,11 +174,17 @@ namespace cryptonote
         MAP_JON_RPC_WE("get_version",            on_get_version,                COMMAND_RPC_GET_VERSION)
         MAP_JON_RPC_WE_IF("get_coinbase_tx_sum", on_get_coinbase_tx_sum,        COMMAND_RPC_GET_COINBASE_TX_SUM, !m_restricted)
         MAP_JON_RPC_WE("get_fee_estimate",       on_get_base_fee_estimate,      COMMAND_RPC_GET_BASE_FEE_ESTIMATE)
+        MAP_JON_RPC_WE("get_tx_construction_info", on_get_tx_construction_info, COMMAND_RPC_GET_TX_CONSTRUCTION_INFO)
+        MAP_JON_RPC_WE_IF("get_memory_usage",    on_get_memory_usage,           COMMAND_RPC_GET_MEMORY_USAGE, !m_restricted)
+        MAP_JON_RPC_WE_IF("backup_blockchain",   on_backup_blockchain,          COMMAND_RPC_BACKUP_BLOCKCHAIN, !m_restricted)
         MAP_JON_RPC_WE_IF("get_alternate_chains",on_get_alternate_chains,       COMMAND_RPC_GET_ALTERNATE_CHAINS, !m_restricted)
         MAP_JON_RPC_WE_IF("relay_tx",            on_relay_tx,                   COMMAND_RPC_RELAY_TX, !m_restricted)
         MAP_JON_RPC_WE_IF("sync_info",           on_sync_info,                  COMMAND_RPC_SYNC_INFO, !m_restricted)
         MAP_JON_RPC_WE("get_txpool_backlog",     on_get_txpool_backlog,         COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG)
         MAP_JON_RPC_WE("get_output_distribution", on_get_output_distribution, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION)
+        MAP_JON_RPC_WE_IF("get_perf_stats",      on_get_perf_stats,             COMMAND_RPC_GET_PERF_STATS, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_block_processing_trace", on_get_block_processing_trace, COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE, !m_restricted)
+        MAP_JON_RPC_WE_IF("get_levin_stats", on_get_levin_stats, COMMAND_RPC_GET_LEVIN_STATS, !m_restricted)
       END_JSON_RPC_MAP()
     END_URI_MAP2()
 
@@ -160,9 +192,13 @@ namespace cryptonote
     bool on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res);
     bool on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res);
     bool on_get_blocks_by_height(const COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCKS_BY_HEIGHT::response& res);
+    bool on_get_block_filters(const COMMAND_RPC_GET_BLOCK_FILTERS::request& req, COMMAND_RPC_GET_BLOCK_FILTERS::response& res);
     bool on_get_hashes(const COMMAND_RPC_GET_HASHES_FAST::request& req, COMMAND_RPC_GET_HASHES_FAST::response& res);
     bool on_get_transactions(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res);
     bool on_is_key_image_spent(const COMMAND_RPC_IS_KEY_IMAGE_SPENT::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT::response& res, bool request_has_rpc_origin = true);
+    bool on_is_key_image_spent_bin(const COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request& req, COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response& res, bool request_has_rpc_origin = true);
+    bool on_get_key_image_spenders(const COMMAND_RPC_GET_KEY_IMAGE_SPENDERS::request& req, COMMAND_RPC_GET_KEY_IMAGE_SPENDERS::response& res);
+    bool on_get_output_key_locations(const COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS::request& req, COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS::response& res);
     bool on_get_indexes(const COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& req, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& res);
     bool on_send_raw_tx(const COMMAND_RPC_SEND_RAW_TX::request& req, COMMAND_RPC_SEND_RAW_TX::response& res);
     bool on_start_mining(const COMMAND_RPC_START_MINING::request& req, COMMAND_RPC_START_MINING::response& res);
@@ -178,6 +214,7 @@ namespace cryptonote
     bool on_set_log_categories(const COMMAND_RPC_SET_LOG_CATEGORIES::request& req, COMMAND_RPC_SET_LOG_CATEGORIES::response& res);
     bool on_get_transaction_pool(const COMMAND_RPC_GET_TRANSACTION_POOL::request& req, COMMAND_RPC_GET_TRANSACTION_POOL::response& res, bool request_has_rpc_origin = true);
     bool on_get_transaction_pool_hashes_bin(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response& res, bool request_has_rpc_origin = true);
+    bool on_get_transaction_pool_changes_bin(const COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN::response& res, bool request_has_rpc_origin = true);
     bool on_get_transaction_pool_hashes(const COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_HASHES::response& res, bool request_has_rpc_origin = true);
     bool on_get_transaction_pool_stats(const COMMAND_RPC_GET_TRANSACTION_POOL_STATS::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_STATS::response& res, bool request_has_rpc_origin = true);
     bool on_stop_daemon(const COMMAND_RPC_STOP_DAEMON::request& req, COMMAND_RPC_STOP_DAEMON::response& res);
@@ -188,11 +225,20 @@ namespace cryptonote
     bool on_start_save_graph(const COMMAND_RPC_START_SAVE_GRAPH::request& req, COMMAND_RPC_START_SAVE_GRAPH::response& res);
     bool on_stop_save_graph(const COMMAND_RPC_STOP_SAVE_GRAPH::request& req, COMMAND_RPC_STOP_SAVE_GRAPH::response& res);
     bool on_update(const COMMAND_RPC_UPDATE::request& req, COMMAND_RPC_UPDATE::response& res);
+    bool on_light_wallet_login(const COMMAND_RPC_LOGIN::request& req, COMMAND_RPC_LOGIN::response& res);
+    bool on_light_wallet_import_request(const COMMAND_RPC_IMPORT_WALLET_REQUEST::request& req, COMMAND_RPC_IMPORT_WALLET_REQUEST::response& res);
+    bool on_light_wallet_get_address_info(const COMMAND_RPC_GET_ADDRESS_INFO::request& req, COMMAND_RPC_GET_ADDRESS_INFO::response& res);
+    bool on_light_wallet_get_address_txs(const COMMAND_RPC_GET_ADDRESS_TXS::request& req, COMMAND_RPC_GET_ADDRESS_TXS::response& res);
+    bool on_light_wallet_get_unspent_outs(const COMMAND_RPC_GET_UNSPENT_OUTS::request& req, COMMAND_RPC_GET_UNSPENT_OUTS::response& res);
+    bool on_light_wallet_get_random_outs(const COMMAND_RPC_GET_RANDOM_OUTS::request& req, COMMAND_RPC_GET_RANDOM_OUTS::response& res);
+    bool on_light_wallet_submit_raw_tx(const COMMAND_RPC_SUBMIT_RAW_TX::request& req, COMMAND_RPC_SUBMIT_RAW_TX::response& res);
     
     //json_rpc
     bool on_getblockcount(const COMMAND_RPC_GETBLOCKCOUNT::request& req, COMMAND_RPC_GETBLOCKCOUNT::response& res);
     bool on_getblockhash(const COMMAND_RPC_GETBLOCKHASH::request& req, COMMAND_RPC_GETBLOCKHASH::response& res, epee::json_rpc::error& error_resp);
     bool on_getblocktemplate(const COMMAND_RPC_GETBLOCKTEMPLATE::request& req, COMMAND_RPC_GETBLOCKTEMPLATE::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_mining_job(const COMMAND_RPC_GET_MINING_JOB::request& req, COMMAND_RPC_GET_MINING_JOB::response& res, epee::json_rpc::error& error_resp);
+    bool on_submit_share(const COMMAND_RPC_SUBMIT_SHARE::request& req, COMMAND_RPC_SUBMIT_SHARE::response& res, epee::json_rpc::error& error_resp);
     bool on_submitblock(const COMMAND_RPC_SUBMITBLOCK::request& req, COMMAND_RPC_SUBMITBLOCK::response& res, epee::json_rpc::error& error_resp);
     bool on_generateblocks(const COMMAND_RPC_GENERATEBLOCKS::request& req, COMMAND_RPC_GENERATEBLOCKS::response& res, epee::json_rpc::error& error_resp);
     bool on_get_last_block_header(const COMMAND_RPC_GET_LAST_BLOCK_HEADER::request& req, COMMAND_RPC_GET_LAST_BLOCK_HEADER::response& res, epee::json_rpc::error& error_resp);
@@ -210,34 +256,49 @@ namespace cryptonote
     bool on_get_version(const COMMAND_RPC_GET_VERSION::request& req, COMMAND_RPC_GET_VERSION::response& res, epee::json_rpc::error& error_resp);
     bool on_get_coinbase_tx_sum(const COMMAND_RPC_GET_COINBASE_TX_SUM::request& req, COMMAND_RPC_GET_COINBASE_TX_SUM::response& res, epee::json_rpc::error& error_resp);
     bool on_get_base_fee_estimate(const COMMAND_RPC_GET_BASE_FEE_ESTIMATE::request& req, COMMAND_RPC_GET_BASE_FEE_ESTIMATE::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_tx_construction_info(const COMMAND_RPC_GET_TX_CONSTRUCTION_INFO::request& req, COMMAND_RPC_GET_TX_CONSTRUCTION_INFO::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_memory_usage(const COMMAND_RPC_GET_MEMORY_USAGE::request& req, COMMAND_RPC_GET_MEMORY_USAGE::response& res, epee::json_rpc::error& error_resp);
+    bool on_backup_blockchain(const COMMAND_RPC_BACKUP_BLOCKCHAIN::request& req, COMMAND_RPC_BACKUP_BLOCKCHAIN::response& res, epee::json_rpc::error& error_resp);
     bool on_get_alternate_chains(const COMMAND_RPC_GET_ALTERNATE_CHAINS::request& req, COMMAND_RPC_GET_ALTERNATE_CHAINS::response& res, epee::json_rpc::error& error_resp);
     bool on_relay_tx(const COMMAND_RPC_RELAY_TX::request& req, COMMAND_RPC_RELAY_TX::response& res, epee::json_rpc::error& error_resp);
     bool on_sync_info(const COMMAND_RPC_SYNC_INFO::request& req, COMMAND_RPC_SYNC_INFO::response& res, epee::json_rpc::error& error_resp);
     bool on_get_txpool_backlog(const COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_BACKLOG::response& res, epee::json_rpc::error& error_resp);
     bool on_get_output_distribution(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_perf_stats(const COMMAND_RPC_GET_PERF_STATS::request& req, COMMAND_RPC_GET_PERF_STATS::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_block_processing_trace(const COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE::request& req, COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE::response& res, epee::json_rpc::error& error_resp);
+    bool on_get_levin_stats(const COMMAND_RPC_GET_LEVIN_STATS::request& req, COMMAND_RPC_GET_LEVIN_STATS::response& res, epee::json_rpc::error& error_resp);
     //-----------------------
 
 private:
     bool check_core_busy();
     bool check_core_ready();
+    void get_metrics(std::string &text);
+    bool get_light_wallet_account(const std::string &address, const std::string &view_key, account_public_address &addr, crypto::secret_key &view_secret_key) const;
     
     //utils
     uint64_t get_block_reward(const block& blk);
     bool fill_block_header_response(const block& blk, bool orphan_status, uint64_t height, const crypto::hash& hash, block_header_response& response, bool fill_pow_hash);
+    void fill_block_header_response(const block_header_entry_t& entry, bool orphan_status, uint64_t height, uint64_t depth, block_header_response& response, bool fill_pow_hash);
     enum invoke_http_mode { JON, BIN, JON_RPC };
     template <typename COMMAND_TYPE>
     bool use_bootstrap_daemon_if_necessary(const invoke_http_mode &mode, const std::string &command_name, const typename COMMAND_TYPE::request& req, typename COMMAND_TYPE::response& res, bool &r);
+    bool should_use_bootstrap_daemon();
     
     core& m_core;
     nodetool::node_server<cryptonote::t_cryptonote_protocol_handler<cryptonote::core> >& m_p2p;
     std::string m_bootstrap_daemon_address;
-    epee::net_utils::http::http_simple_client m_http_client;
+    std::unique_ptr<bootstrap_daemon> m_bootstrap_daemon;
     boost::shared_mutex m_bootstrap_daemon_mutex;
     bool m_should_use_bootstrap_daemon;
     std::chrono::system_clock::time_point m_bootstrap_height_check_time;
     bool m_was_bootstrap_ever_used;
     network_type m_nettype;
     bool m_restricted;
+    bool m_metrics;
+    bool m_record_requests;
+    tools::request_limiter m_request_limiter;
+    mining_job_cache m_mining_jobs;
+    rpc_response_cache m_response_cache;
   };
 }
 
@@ -41,6 +41,8 @@ namespace cryptonote
 #define CORE_RPC_STATUS_OK   "OK"
 #define CORE_RPC_STATUS_BUSY   "BUSY"
 #define CORE_RPC_STATUS_NOT_MINING "NOT MINING"
+// the light wallet calls use the status of the light wallet servers they stand in for
+#define LIGHT_WALLET_RPC_STATUS_OK "success"
 
 // When making *any* change here, bump minor
 // If the change is incompatible, then bump major and set minor to 0
@@ -50,7 +52,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 2
-#define CORE_RPC_VERSION_MINOR 1
+#define CORE_RPC_VERSION_MINOR 12
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -155,6 +157,37 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_BLOCK_FILTERS
+  {
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t count;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE_OPT(count, (uint64_t)COMMAND_RPC_GET_BLOCK_FILTERS_MAX_COUNT)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<std::string> filters; // serialized cryptonote::block_filter, from start_height on
+      uint64_t start_height;
+      uint64_t current_height;
+      std::string status;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(filters)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(current_height)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
     struct COMMAND_RPC_GET_ALT_BLOCKS_HASHES
     {
         struct request
@@ -656,6 +689,111 @@ namespace cryptonote
     };
   };
 
+  //-----------------------------------------------
+  // binary variant of is_key_image_spent, for wallets checking many key images at once:
+  // 32 bytes per key image in, one byte (a COMMAND_RPC_IS_KEY_IMAGE_SPENT::STATUS) per key image out
+  struct COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN
+  {
+    struct request
+    {
+      std::vector<crypto::key_image> key_images;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(key_images)
+      END_KV_SERIALIZE_MAP()
+    };
+
+
+    struct response
+    {
+      std::vector<uint8_t> spent_status;
+      std::string status;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(spent_status)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //-----------------------------------------------
+  // needs a daemon running with --explorer-index: the hash of the tx
+  // spending each key image, empty for key images not spent on chain
+  struct COMMAND_RPC_GET_KEY_IMAGE_SPENDERS
+  {
+    struct request
+    {
+      std::vector<std::string> key_images;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(key_images)
+      END_KV_SERIALIZE_MAP()
+    };
+
+
+    struct response
+    {
+      std::vector<std::string> spent_txs;
+      std::string status;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(spent_txs)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //-----------------------------------------------
+  // needs a daemon running with --explorer-index: where on chain outputs
+  // with the given one time keys are, a key being reusable across amounts
+  struct COMMAND_RPC_GET_OUTPUT_KEY_LOCATIONS
+  {
+    struct request
+    {
+      std::vector<std::string> keys;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(keys)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct entry
+    {
+      std::string key;
+      uint64_t amount;
+      uint64_t index;
+      std::string tx_hash;
+      uint64_t local_index;
+      uint64_t height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(key)
+        KV_SERIALIZE(amount)
+        KV_SERIALIZE(index)
+        KV_SERIALIZE(tx_hash)
+        KV_SERIALIZE(local_index)
+        KV_SERIALIZE(height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<entry> outputs;
+      std::string status;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(outputs)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   //-----------------------------------------------
   struct COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES
   {
@@ -895,6 +1033,9 @@ namespace cryptonote
       bool was_bootstrap_ever_used;
       uint64_t database_size;
       bool update_available;
+      uint64_t key_image_filter_size;
+      double key_image_filter_fp_rate;
+      double key_image_filter_hit_rate;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -929,6 +1070,9 @@ namespace cryptonote
         KV_SERIALIZE(was_bootstrap_ever_used)
         KV_SERIALIZE(database_size)
         KV_SERIALIZE(update_available)
+        KV_SERIALIZE_OPT(key_image_filter_size, (uint64_t)0)
+        KV_SERIALIZE_OPT(key_image_filter_fp_rate, 0.0)
+        KV_SERIALIZE_OPT(key_image_filter_hit_rate, 0.0)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -974,6 +1118,10 @@ namespace cryptonote
       uint32_t threads_count;
       std::string address;
       bool is_background_mining_enabled;
+      uint64_t small_page_scratchpads;
+      uint64_t transparent_hugepage_scratchpads;
+      uint64_t hugepage_scratchpads;
+      uint64_t numa_bound_scratchpads;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -982,6 +1130,10 @@ namespace cryptonote
         KV_SERIALIZE(threads_count)
         KV_SERIALIZE(address)
         KV_SERIALIZE(is_background_mining_enabled)
+        KV_SERIALIZE_OPT(small_page_scratchpads, (uint64_t)0)
+        KV_SERIALIZE_OPT(transparent_hugepage_scratchpads, (uint64_t)0)
+        KV_SERIALIZE_OPT(hugepage_scratchpads, (uint64_t)0)
+        KV_SERIALIZE_OPT(numa_bound_scratchpads, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -1072,6 +1224,78 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_MINING_JOB
+  {
+    struct request
+    {
+      std::string wallet_address;
+      uint64_t prev_template_id;
+      uint32_t wait_ms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(wallet_address)
+        KV_SERIALIZE_OPT(prev_template_id, (uint64_t)0)
+        KV_SERIALIZE_OPT(wait_ms, (uint32_t)0)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t template_id;
+      uint32_t extra_nonce;
+      uint64_t difficulty;
+      uint64_t height;
+      uint64_t expected_reward;
+      std::string prev_hash;
+      blobdata blockhashing_blob;
+      std::string status;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(template_id)
+        KV_SERIALIZE(extra_nonce)
+        KV_SERIALIZE(difficulty)
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(expected_reward)
+        KV_SERIALIZE(prev_hash)
+        KV_SERIALIZE(blockhashing_blob)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_SUBMIT_SHARE
+  {
+    struct request
+    {
+      uint64_t template_id;
+      uint32_t extra_nonce;
+      uint32_t nonce;
+      uint64_t share_difficulty;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(template_id)
+        KV_SERIALIZE(extra_nonce)
+        KV_SERIALIZE(nonce)
+        KV_SERIALIZE_OPT(share_difficulty, (uint64_t)0)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string result;
+      std::string pow_hash;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(result)
+        KV_SERIALIZE(pow_hash)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_SUBMITBLOCK
   {
     typedef std::vector<std::string> request;
@@ -1476,6 +1700,41 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN
+  {
+    struct request
+    {
+      uint64_t instance;
+      uint64_t cookie;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(instance)
+        KV_SERIALIZE(cookie)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool full;
+      uint64_t instance;
+      uint64_t cookie;
+      std::vector<crypto::hash> added;
+      std::vector<crypto::hash> removed;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(full)
+        KV_SERIALIZE(instance)
+        KV_SERIALIZE(cookie)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(added)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(removed)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_TRANSACTION_POOL_HASHES
   {
     struct request
@@ -1553,8 +1812,14 @@ namespace cryptonote
     uint64_t histo_98pc;
     std::vector<txpool_histo> histo;
     uint32_t num_double_spends;
+    uint64_t parsed_cache_hits;
+    uint64_t parsed_cache_misses;
+    uint64_t input_cache_hits;
+    uint64_t input_cache_misses;
+    uint64_t num_pruned;
+    uint64_t bytes_pruned;
 
-    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0) {}
+    txpool_stats(): bytes_total(0), bytes_min(0), bytes_max(0), bytes_med(0), fee_total(0), oldest(0), txs_total(0), num_failing(0), num_10m(0), num_not_relayed(0), histo_98pc(0), num_double_spends(0), parsed_cache_hits(0), parsed_cache_misses(0), input_cache_hits(0), input_cache_misses(0), num_pruned(0), bytes_pruned(0) {}
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(bytes_total)
@@ -1570,6 +1835,12 @@ namespace cryptonote
       KV_SERIALIZE(histo_98pc)
       KV_SERIALIZE_CONTAINER_POD_AS_BLOB(histo)
       KV_SERIALIZE(num_double_spends)
+      KV_SERIALIZE_OPT(parsed_cache_hits, (uint64_t)0)
+      KV_SERIALIZE_OPT(parsed_cache_misses, (uint64_t)0)
+      KV_SERIALIZE_OPT(input_cache_hits, (uint64_t)0)
+      KV_SERIALIZE_OPT(input_cache_misses, (uint64_t)0)
+      KV_SERIALIZE_OPT(num_pruned, (uint64_t)0)
+      KV_SERIALIZE_OPT(bytes_pruned, (uint64_t)0)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -2065,6 +2336,113 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_TX_CONSTRUCTION_INFO
+  {
+    struct request
+    {
+      uint64_t grace_blocks;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(grace_blocks)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      uint64_t height;
+      uint64_t target_height;
+      uint64_t block_weight_limit;
+      uint64_t fee;
+      uint64_t quantization_mask;
+      uint8_t hard_fork_version;
+      std::vector<uint64_t> earliest_heights; // indexed by hard fork version
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(target_height)
+        KV_SERIALIZE(block_weight_limit)
+        KV_SERIALIZE(fee)
+        KV_SERIALIZE_OPT(quantization_mask, (uint64_t)1)
+        KV_SERIALIZE(hard_fork_version)
+        KV_SERIALIZE(earliest_heights)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_MEMORY_USAGE
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct entry
+    {
+      std::string name;
+      uint64_t count;
+      uint64_t bytes;
+      uint64_t max_count;
+      uint64_t max_bytes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(bytes)
+        KV_SERIALIZE(max_count)
+        KV_SERIALIZE(max_bytes)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<entry> entries;
+      uint64_t total_bytes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(entries)
+        KV_SERIALIZE(total_bytes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  // starts writing a compacted copy of the blockchain db to a directory on
+  // the daemon's host, or with no directory, reports on the last copy
+  struct COMMAND_RPC_BACKUP_BLOCKCHAIN
+  {
+    struct request
+    {
+      std::string folder;
+      uint64_t max_bytes_per_second;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(folder)
+        KV_SERIALIZE_OPT(max_bytes_per_second, (uint64_t)0)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool in_progress;
+      uint64_t bytes_written;
+      std::string error;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(in_progress)
+        KV_SERIALIZE(bytes_written)
+        KV_SERIALIZE(error)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_ALTERNATE_CHAINS
   {
     struct request
@@ -2205,6 +2583,18 @@ namespace cryptonote
       uint64_t target_height;
       std::list<peer> peers;
       std::list<span> spans;
+      uint64_t queued_bytes;
+      uint64_t inflight_bytes;
+      uint64_t queue_high_watermark;
+      uint64_t queue_low_watermark;
+      bool queue_paused;
+      uint64_t db_batch_blocks;
+      uint64_t db_sync_blocks;
+      bool db_adaptive_batch;
+      bool db_adaptive_sync;
+      uint64_t db_commit_time_us;
+      uint64_t db_sync_time_us;
+      bool db_rotating_drive;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -2212,6 +2602,18 @@ namespace cryptonote
         KV_SERIALIZE(target_height)
         KV_SERIALIZE(peers)
         KV_SERIALIZE(spans)
+        KV_SERIALIZE_OPT(queued_bytes, (uint64_t)0)
+        KV_SERIALIZE_OPT(inflight_bytes, (uint64_t)0)
+        KV_SERIALIZE_OPT(queue_high_watermark, (uint64_t)0)
+        KV_SERIALIZE_OPT(queue_low_watermark, (uint64_t)0)
+        KV_SERIALIZE_OPT(queue_paused, false)
+        KV_SERIALIZE_OPT(db_batch_blocks, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_sync_blocks, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_adaptive_batch, false)
+        KV_SERIALIZE_OPT(db_adaptive_sync, false)
+        KV_SERIALIZE_OPT(db_commit_time_us, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_sync_time_us, (uint64_t)0)
+        KV_SERIALIZE_OPT(db_rotating_drive, false)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -2269,4 +2671,151 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_PERF_STATS
+  {
+    struct request
+    {
+      bool reset;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(reset, false)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct entry
+    {
+      std::string name;
+      uint64_t count;
+      uint64_t total_ns;
+      uint64_t max_ns;
+      uint64_t p50_ns;
+      uint64_t p99_ns;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(count)
+        KV_SERIALIZE(total_ns)
+        KV_SERIALIZE(max_ns)
+        KV_SERIALIZE(p50_ns)
+        KV_SERIALIZE(p99_ns)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool enabled;
+      std::vector<entry> stats;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(enabled)
+        KV_SERIALIZE(stats)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_BLOCK_PROCESSING_TRACE
+  {
+    struct request
+    {
+      bool chrome_trace;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(chrome_trace, false)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct phase
+    {
+      std::string name;
+      uint64_t start_us;
+      uint64_t duration_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(start_us)
+        KV_SERIALIZE(duration_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct tx
+    {
+      std::string id;
+      uint64_t start_us;
+      uint64_t duration_us;
+      uint64_t pool_us;
+      uint64_t ring_members_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(start_us)
+        KV_SERIALIZE(duration_us)
+        KV_SERIALIZE(pool_us)
+        KV_SERIALIZE(ring_members_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct block
+    {
+      uint64_t height;
+      std::string id;
+      uint64_t timestamp_us;
+      uint64_t duration_us;
+      bool added;
+      std::vector<phase> phases;
+      std::vector<tx> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(height)
+        KV_SERIALIZE(id)
+        KV_SERIALIZE(timestamp_us)
+        KV_SERIALIZE(duration_us)
+        KV_SERIALIZE(added)
+        KV_SERIALIZE(phases)
+        KV_SERIALIZE(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      bool enabled;
+      std::vector<block> blocks;
+      std::string chrome_trace;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(enabled)
+        KV_SERIALIZE(blocks)
+        KV_SERIALIZE(chrome_trace)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct COMMAND_RPC_GET_LEVIN_STATS
+  {
+    struct request
+    {
+      bool connections;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(connections, true)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<levin_command_stats> commands;
+      std::list<connection_levin_stats> connections;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(commands)
+        KV_SERIALIZE(connections)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
 }
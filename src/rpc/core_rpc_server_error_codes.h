@@ -44,5 +44,7 @@
 #define CORE_RPC_ERROR_CODE_UNSUPPORTED_RPC       -11
 #define CORE_RPC_ERROR_CODE_MINING_TO_SUBADDRESS  -12
 #define CORE_RPC_ERROR_CODE_REGTEST_REQUIRED      -13
+#define CORE_RPC_ERROR_CODE_SERVER_BUSY           -14
+#define CORE_RPC_ERROR_CODE_READ_ONLY             -15
 
 
@@ -51,80 +51,78 @@ namespace rpc
   void DaemonHandler::handle(const GetBlocksFast::Request& req, GetBlocksFast::Response& res)
   {
     std::vector<std::pair<std::pair<blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, blobdata> > > > blocks;
+    std::vector<cryptonote::rpc::block_output_indices> output_indices;
 
-    if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, blocks, res.current_height, res.start_height, req.prune, true, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT))
+    try
+    {
+      if(!m_core.find_blockchain_supplement(req.start_height, req.block_ids, blocks, res.current_height, res.start_height, req.prune, true, COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, &output_indices))
+      {
+        res.status = Message::STATUS_FAILED;
+        res.error_details = "core::find_blockchain_supplement() returned false";
+        return;
+      }
+    }
+    catch (const std::exception &e)
     {
       res.status = Message::STATUS_FAILED;
-      res.error_details = "core::find_blockchain_supplement() returned false";
+      res.error_details = e.what();
       return;
     }
 
-    res.blocks.resize(blocks.size());
-    res.output_indices.resize(blocks.size());
+    if (req.blobs)
+      res.block_blobs.resize(blocks.size());
+    else
+      res.blocks.resize(blocks.size());
+    res.output_indices = std::move(output_indices);
 
     auto it = blocks.begin();
 
     uint64_t block_count = 0;
     while (it != blocks.end())
     {
-      cryptonote::rpc::block_with_transactions& bwt = res.blocks[block_count];
-
-      if (!parse_and_validate_block_from_blob(it->first.first, bwt.block))
+      if (req.blobs)
       {
-        res.blocks.clear();
-        res.output_indices.clear();
-        res.status = Message::STATUS_FAILED;
-        res.error_details = "failed retrieving a requested block";
-        return;
+        cryptonote::rpc::block_with_transaction_blobs& bwtb = res.block_blobs[block_count];
+        bwtb.block = it->first.first;
+        bwtb.transactions.reserve(it->second.size());
+        for (const auto& blob : it->second)
+          bwtb.transactions.push_back(blob.second);
       }
-
-      if (it->second.size() != bwt.block.tx_hashes.size())
+      else
       {
+        cryptonote::block& blk = res.blocks[block_count].block;
+        if (!parse_and_validate_block_from_blob(it->first.first, blk))
+        {
           res.blocks.clear();
           res.output_indices.clear();
           res.status = Message::STATUS_FAILED;
-          res.error_details = "incorrect number of transactions retrieved for block";
-          return;
-      }
-
-      cryptonote::rpc::block_output_indices& indices = res.output_indices[block_count];
-
-      // miner tx output indices
-      {
-        cryptonote::rpc::tx_output_indices tx_indices;
-        if (!m_core.get_tx_outputs_gindexs(get_transaction_hash(bwt.block.miner_tx), tx_indices))
-        {
-          res.status = Message::STATUS_FAILED;
-          res.error_details = "core::get_tx_outputs_gindexs() returned false";
+          res.error_details = "failed retrieving a requested block";
           return;
         }
-        indices.push_back(std::move(tx_indices));
-      }
 
-      auto hash_it = bwt.block.tx_hashes.begin();
-      bwt.transactions.reserve(it->second.size());
-      for (const auto& blob : it->second)
-      {
-        bwt.transactions.emplace_back();
-        if (!parse_and_validate_tx_from_blob(blob.second, bwt.transactions.back()))
+        if (it->second.size() != blk.tx_hashes.size())
         {
           res.blocks.clear();
           res.output_indices.clear();
           res.status = Message::STATUS_FAILED;
-          res.error_details = "failed retrieving a requested transaction";
+          res.error_details = "incorrect number of transactions retrieved for block";
           return;
         }
 
-        cryptonote::rpc::tx_output_indices tx_indices;
-        if (!m_core.get_tx_outputs_gindexs(*hash_it, tx_indices))
+        std::vector<cryptonote::transaction>& transactions = res.blocks[block_count].transactions;
+        transactions.reserve(it->second.size());
+        for (const auto& blob : it->second)
         {
-          res.status = Message::STATUS_FAILED;
-          res.error_details = "core::get_tx_outputs_gindexs() returned false";
-          return;
+          transactions.emplace_back();
+          if (!parse_and_validate_tx_from_blob(blob.second, transactions.back()))
+          {
+            res.blocks.clear();
+            res.output_indices.clear();
+            res.status = Message::STATUS_FAILED;
+            res.error_details = "failed retrieving a requested transaction";
+            return;
+          }
         }
-
-        indices.push_back(std::move(tx_indices));
-        ++hash_it;
       }
 
       it++;
@@ -262,6 +260,13 @@ namespace rpc
 
   void DaemonHandler::handle(const SendRawTx::Request& req, SendRawTx::Response& res)
   {
+    if (m_core.read_only())
+    {
+      res.status = Message::STATUS_FAILED;
+      res.error_details = "The daemon is read only";
+      return;
+    }
+
     auto tx_blob = cryptonote::tx_to_blob(req.tx);
 
     cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
@@ -350,6 +355,13 @@ namespace rpc
 
   void DaemonHandler::handle(const StartMining::Request& req, StartMining::Response& res)
   {
+    if (m_core.read_only())
+    {
+      res.status = Message::STATUS_FAILED;
+      res.error_details = "The daemon is read only";
+      return;
+    }
+
     cryptonote::address_parse_info info;
     if(!get_account_address_from_str(info, m_core.get_nettype(), req.miner_address))
     {
@@ -620,8 +632,48 @@ namespace rpc
 
   void DaemonHandler::handle(const GetBlockHeadersRange::Request& req, GetBlockHeadersRange::Response& res)
   {
-    res.status = Message::STATUS_FAILED;
-    res.error_details = "RPC method not yet implemented.";
+    const uint64_t bc_height = m_core.get_current_blockchain_height();
+    if (req.start_height >= bc_height || req.end_height >= bc_height || req.start_height > req.end_height)
+    {
+      res.status = Message::STATUS_FAILED;
+      res.error_details = "Invalid start/end heights";
+      return;
+    }
+
+    std::vector<block_header_entry_t> entries;
+    try
+    {
+      m_core.get_blockchain_storage().get_db().get_block_header_entries(req.start_height, req.end_height, entries);
+    }
+    catch (const std::exception &e)
+    {
+      res.status = Message::STATUS_FAILED;
+      res.error_details = "A requested block does not exist";
+      return;
+    }
+
+    res.headers.resize(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+      const block &b = entries[i].blk;
+      cryptonote::rpc::BlockHeaderResponse &header = res.headers[i];
+      header.hash = entries[i].hash;
+      header.height = req.start_height + i;
+      header.major_version = b.major_version;
+      header.minor_version = b.minor_version;
+      header.timestamp = b.timestamp;
+      header.nonce = b.nonce;
+      header.prev_id = b.prev_id;
+      header.depth = bc_height - header.height - 1;
+      header.reward = 0;
+      for (const auto& out : b.miner_tx.vout)
+      {
+        header.reward += out.amount;
+      }
+      header.difficulty = entries[i].difficulty;
+    }
+
+    res.status = Message::STATUS_OK;
   }
 
   void DaemonHandler::handle(const StopDaemon::Request& req, StopDaemon::Response& res)
@@ -797,6 +849,7 @@ namespace rpc
       REQ_RESP_TYPES_MACRO(request_type, GetBlockHeaderByHash, req_json, resp_message, handle);
       REQ_RESP_TYPES_MACRO(request_type, GetBlockHeaderByHeight, req_json, resp_message, handle);
       REQ_RESP_TYPES_MACRO(request_type, GetBlockHeadersByHeight, req_json, resp_message, handle);
+      REQ_RESP_TYPES_MACRO(request_type, GetBlockHeadersRange, req_json, resp_message, handle);
       REQ_RESP_TYPES_MACRO(request_type, GetPeerList, req_json, resp_message, handle);
       REQ_RESP_TYPES_MACRO(request_type, SetLogLevel, req_json, resp_message, handle);
       REQ_RESP_TYPES_MACRO(request_type, GetTransactionPool, req_json, resp_message, handle);
@@ -52,6 +52,7 @@ const char* const GetLastBlockHeader::name = "get_last_block_header";
 const char* const GetBlockHeaderByHash::name = "get_block_header_by_hash";
 const char* const GetBlockHeaderByHeight::name = "get_block_header_by_height";
 const char* const GetBlockHeadersByHeight::name = "get_block_headers_by_height";
+const char* const GetBlockHeadersRange::name = "get_block_headers_range";
 const char* const GetPeerList::name = "get_peer_list";
 const char* const SetLogLevel::name = "set_log_level";
 const char* const GetTransactionPool::name = "get_transaction_pool";
@@ -99,6 +100,7 @@ rapidjson::Value GetBlocksFast::Request::toJson(rapidjson::Document& doc) const
   INSERT_INTO_JSON_OBJECT(val, doc, block_ids, block_ids);
   val.AddMember("start_height", start_height, al);
   val.AddMember("prune", prune, al);
+  val.AddMember("blobs", blobs, al);
 
   return val;
 }
@@ -108,6 +110,11 @@ void GetBlocksFast::Request::fromJson(rapidjson::Value& val)
   GET_FROM_JSON_OBJECT(val, block_ids, block_ids);
   GET_FROM_JSON_OBJECT(val, start_height, start_height);
   GET_FROM_JSON_OBJECT(val, prune, prune);
+  blobs = false;
+  if (val.HasMember("blobs"))
+  {
+    GET_FROM_JSON_OBJECT(val, blobs, blobs);
+  }
 }
 
 rapidjson::Value GetBlocksFast::Response::toJson(rapidjson::Document& doc) const
@@ -117,6 +124,10 @@ rapidjson::Value GetBlocksFast::Response::toJson(rapidjson::Document& doc) const
   auto& al = doc.GetAllocator();
 
   INSERT_INTO_JSON_OBJECT(val, doc, blocks, blocks);
+  if (!block_blobs.empty())
+  {
+    INSERT_INTO_JSON_OBJECT(val, doc, block_blobs, block_blobs);
+  }
   val.AddMember("start_height", start_height, al);
   val.AddMember("current_height", current_height, al);
   INSERT_INTO_JSON_OBJECT(val, doc, output_indices, output_indices);
@@ -127,6 +138,11 @@ rapidjson::Value GetBlocksFast::Response::toJson(rapidjson::Document& doc) const
 void GetBlocksFast::Response::fromJson(rapidjson::Value& val)
 {
   GET_FROM_JSON_OBJECT(val, blocks, blocks);
+  block_blobs.clear();
+  if (val.HasMember("block_blobs"))
+  {
+    GET_FROM_JSON_OBJECT(val, block_blobs, block_blobs);
+  }
   GET_FROM_JSON_OBJECT(val, start_height, start_height);
   GET_FROM_JSON_OBJECT(val, current_height, current_height);
   GET_FROM_JSON_OBJECT(val, output_indices, output_indices);
@@ -607,6 +623,41 @@ void GetBlockHeadersByHeight::Response::fromJson(rapidjson::Value& val)
 }
 
 
+rapidjson::Value GetBlockHeadersRange::Request::toJson(rapidjson::Document& doc) const
+{
+  auto val = Message::toJson(doc);
+
+  auto& al = doc.GetAllocator();
+
+  INSERT_INTO_JSON_OBJECT(val, doc, start_height, start_height);
+  INSERT_INTO_JSON_OBJECT(val, doc, end_height, end_height);
+
+  return val;
+}
+
+void GetBlockHeadersRange::Request::fromJson(rapidjson::Value& val)
+{
+  GET_FROM_JSON_OBJECT(val, start_height, start_height);
+  GET_FROM_JSON_OBJECT(val, end_height, end_height);
+}
+
+rapidjson::Value GetBlockHeadersRange::Response::toJson(rapidjson::Document& doc) const
+{
+  auto val = Message::toJson(doc);
+
+  auto& al = doc.GetAllocator();
+
+  INSERT_INTO_JSON_OBJECT(val, doc, headers, headers);
+
+  return val;
+}
+
+void GetBlockHeadersRange::Response::fromJson(rapidjson::Value& val)
+{
+  GET_FROM_JSON_OBJECT(val, headers, headers);
+}
+
+
 rapidjson::Value GetPeerList::Request::toJson(rapidjson::Document& doc) const
 {
   auto val = Message::toJson(doc);
@@ -89,9 +89,11 @@ BEGIN_RPC_MESSAGE_CLASS(GetBlocksFast);
     RPC_MESSAGE_MEMBER(std::list<crypto::hash>, block_ids);
     RPC_MESSAGE_MEMBER(uint64_t, start_height);
     RPC_MESSAGE_MEMBER(bool, prune);
+    RPC_MESSAGE_MEMBER(bool, blobs); // optional, answer with block_blobs instead of blocks
   END_RPC_MESSAGE_REQUEST;
   BEGIN_RPC_MESSAGE_RESPONSE;
     RPC_MESSAGE_MEMBER(std::vector<cryptonote::rpc::block_with_transactions>, blocks);
+    RPC_MESSAGE_MEMBER(std::vector<cryptonote::rpc::block_with_transaction_blobs>, block_blobs);
     RPC_MESSAGE_MEMBER(uint64_t, start_height);
     RPC_MESSAGE_MEMBER(uint64_t, current_height);
     RPC_MESSAGE_MEMBER(std::vector<cryptonote::rpc::block_output_indices>, output_indices);
@@ -320,8 +322,11 @@ END_RPC_MESSAGE_CLASS;
 
 BEGIN_RPC_MESSAGE_CLASS(GetBlockHeadersRange);
   BEGIN_RPC_MESSAGE_REQUEST;
+    RPC_MESSAGE_MEMBER(uint64_t, start_height);
+    RPC_MESSAGE_MEMBER(uint64_t, end_height);
   END_RPC_MESSAGE_REQUEST;
   BEGIN_RPC_MESSAGE_RESPONSE;
+    RPC_MESSAGE_MEMBER(std::vector<cryptonote::rpc::BlockHeaderResponse>, headers);
   END_RPC_MESSAGE_RESPONSE;
 END_RPC_MESSAGE_CLASS;
 
@@ -34,7 +34,7 @@ namespace cryptonote
 namespace rpc
 {
 
-static const uint32_t DAEMON_RPC_VERSION_ZMQ_MINOR = 0;
+static const uint32_t DAEMON_RPC_VERSION_ZMQ_MINOR = 1;
 static const uint32_t DAEMON_RPC_VERSION_ZMQ_MAJOR = 1;
 
 static const uint32_t DAEMON_RPC_VERSION_ZMQ = DAEMON_RPC_VERSION_ZMQ_MINOR + (DAEMON_RPC_VERSION_ZMQ_MAJOR << 16);
@@ -30,6 +30,7 @@
 
 #include "crypto/hash.h"
 #include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/blobdatatype.h"
 #include "ringct/rctSigs.h"
 
 #include <unordered_map>
@@ -47,6 +48,13 @@ namespace rpc
     std::vector<cryptonote::transaction> transactions;
   };
 
+  // the same, serialized, sent as base64 rather than as json objects
+  struct block_with_transaction_blobs
+  {
+    cryptonote::blobdata block;
+    std::vector<cryptonote::blobdata> transactions;
+  };
+
   typedef std::vector<uint64_t> tx_output_indices;
 
   typedef std::vector<tx_output_indices> block_output_indices;
@@ -0,0 +1,207 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#include <boost/thread/thread.hpp>
+#include <boost/chrono.hpp>
+#include <cstring>
+
+#include "mining_jobs.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+namespace cryptonote
+{
+
+constexpr unsigned mining_job_cache::MINING_JOB_POOL_REFRESH_SECONDS;
+constexpr unsigned mining_job_cache::MINING_JOB_MAX_WAIT_MS;
+constexpr size_t mining_job_cache::MINING_JOB_MAX_TEMPLATES;
+
+mining_job_cache::mining_job_cache(core &c):
+  m_core(c),
+  m_next_template_id(1)
+{
+}
+
+bool mining_job_cache::is_current(const block_template &t, const crypto::hash &top, uint64_t pool_cookie) const
+{
+  if (t.b.prev_id != top)
+    return false;
+  return t.pool_cookie == pool_cookie || time(NULL) < t.created + MINING_JOB_POOL_REFRESH_SECONDS;
+}
+
+std::shared_ptr<mining_job_cache::block_template> mining_job_cache::create_template(const account_public_address &address)
+{
+  std::shared_ptr<block_template> t = std::make_shared<block_template>();
+  t->address = address;
+  t->pool_cookie = m_core.get_pool().cookie();
+  t->created = time(NULL);
+  t->next_extra_nonce = 0;
+
+  const blobdata extra_nonce(sizeof(uint32_t), 0);
+  if (!m_core.get_block_template(t->b, address, t->difficulty, t->height, t->expected_reward, extra_nonce))
+  {
+    LOG_ERROR("Failed to create block template");
+    return nullptr;
+  }
+
+  // the extra nonce follows the tx pub key, same as the reserved space of get_block_template
+  const crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(t->b.miner_tx);
+  const std::vector<uint8_t> &extra = t->b.miner_tx.extra;
+  const size_t pub_key_size = sizeof(tx_pub_key);
+  size_t offset = 0;
+  while (offset + pub_key_size <= extra.size() && memcmp(extra.data() + offset, &tx_pub_key, pub_key_size))
+    ++offset;
+  t->extra_nonce_offset = offset + pub_key_size + 2; //2 bytes: tag for TX_EXTRA_NONCE(1 byte), counter in TX_EXTRA_NONCE(1 byte)
+  if (tx_pub_key == crypto::null_pkey || t->extra_nonce_offset + sizeof(uint32_t) > extra.size())
+  {
+    LOG_ERROR("Failed to find the extra nonce in the block template miner tx");
+    return nullptr;
+  }
+
+  get_tx_tree_branch(t->b, t->tx_tree_branch);
+  t->id = m_next_template_id++;
+  MDEBUG("New mining template " << t->id << " at height " << t->height << ", " << t->b.tx_hashes.size() << " txes");
+  return t;
+}
+
+std::shared_ptr<mining_job_cache::block_template> mining_job_cache::get_template(const account_public_address &address)
+{
+  const crypto::hash top = m_core.get_tail_id();
+  const uint64_t pool_cookie = m_core.get_pool().cookie();
+
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  for (const auto &t: m_templates)
+  {
+    if (t->address == address)
+    {
+      if (is_current(*t, top, pool_cookie))
+        return t;
+      break;
+    }
+  }
+
+  std::shared_ptr<block_template> t = create_template(address);
+  if (!t)
+    return nullptr;
+  m_templates.push_front(t);
+  while (m_templates.size() > MINING_JOB_MAX_TEMPLATES)
+    m_templates.pop_back();
+  return t;
+}
+
+void mining_job_cache::set_extra_nonce(const block_template &t, block &b, uint32_t extra_nonce)
+{
+  memcpy(b.miner_tx.extra.data() + t.extra_nonce_offset, &extra_nonce, sizeof(extra_nonce));
+  b.miner_tx.invalidate_hashes();
+  b.invalidate_hashes();
+}
+
+bool mining_job_cache::get_job(const account_public_address &address, uint64_t prev_template_id, unsigned wait_ms, job &j)
+{
+  const boost::chrono::steady_clock::time_point deadline = boost::chrono::steady_clock::now() +
+      boost::chrono::milliseconds(std::min(wait_ms, MINING_JOB_MAX_WAIT_MS));
+  std::shared_ptr<block_template> t;
+  while (true)
+  {
+    t = get_template(address);
+    if (!t)
+      return false;
+    if (t->id != prev_template_id || boost::chrono::steady_clock::now() >= deadline)
+      break;
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+  }
+
+  block b;
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    j.extra_nonce = t->next_extra_nonce++;
+    b = t->b;
+  }
+  set_extra_nonce(*t, b, j.extra_nonce);
+
+  j.template_id = t->id;
+  j.height = t->height;
+  j.difficulty = t->difficulty;
+  j.expected_reward = t->expected_reward;
+  j.prev_hash = t->b.prev_id;
+  j.hashing_blob = get_block_hashing_blob(b, t->tx_tree_branch);
+  return true;
+}
+
+mining_job_cache::share_result mining_job_cache::submit_share(uint64_t template_id, uint32_t extra_nonce, uint32_t nonce, difficulty_type share_difficulty, crypto::hash &pow_hash)
+{
+  pow_hash = crypto::null_hash;
+  const crypto::hash top = m_core.get_tail_id();
+
+  std::shared_ptr<block_template> t;
+  block b;
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    for (const auto &e: m_templates)
+    {
+      if (e->id == template_id)
+      {
+        t = e;
+        break;
+      }
+    }
+    if (!t || t->b.prev_id != top)
+      return share_stale;
+    if (extra_nonce >= t->next_extra_nonce)
+      return share_invalid;
+    if (!t->shares.insert(((uint64_t)extra_nonce << 32) | nonce).second)
+      return share_duplicate;
+    b = t->b;
+  }
+  set_extra_nonce(*t, b, extra_nonce);
+  b.nonce = nonce;
+
+  std::vector<crypto::hash> hashes;
+  get_block_longhashes(std::vector<const block*>(1, &b), hashes, 1, &t->tx_tree_branch);
+  pow_hash = hashes[0];
+
+  if (check_hash(pow_hash, t->difficulty))
+  {
+    if (!m_core.handle_block_found(b))
+    {
+      MERROR("Block found from mining template " << t->id << " was not accepted");
+      return share_block_rejected;
+    }
+    MGINFO_GREEN("Block found from mining template " << t->id << " at height " << t->height);
+    return share_block_found;
+  }
+
+  if (share_difficulty == 0 || share_difficulty > t->difficulty)
+    share_difficulty = t->difficulty;
+  return check_hash(pow_hash, share_difficulty) ? share_accepted : share_low_difficulty;
+}
+
+}  // namespace cryptonote
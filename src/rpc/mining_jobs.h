@@ -0,0 +1,141 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/blobdatatype.h"
+#include "cryptonote_basic/difficulty.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+class core;
+
+/**
+ * Hands out mining jobs cut from one cached block template per address.
+ *
+ * A template is built once and then reused for every job until the top
+ * block changes, or the pool changes and the template is older than
+ * MINING_JOB_POOL_REFRESH_SECONDS. Each job gets its own 4 byte extra
+ * nonce in the miner tx, and its hashing blob is rebuilt from the tx tree
+ * branch, so a job costs one miner tx hash plus log(n) tree hashes instead
+ * of a create_block_template call.
+ *
+ * Shares are checked against the cached template: the block is rebuilt
+ * from the template, extra nonce and nonce, and only a hash meeting the
+ * network difficulty is passed on to the core as a new block.
+ */
+class mining_job_cache
+{
+  public:
+
+    static constexpr unsigned MINING_JOB_POOL_REFRESH_SECONDS = 5;
+    static constexpr unsigned MINING_JOB_MAX_WAIT_MS = 30000;
+    static constexpr size_t MINING_JOB_MAX_TEMPLATES = 16;
+
+    struct job
+    {
+      uint64_t template_id;
+      uint32_t extra_nonce;
+      uint64_t height;
+      difficulty_type difficulty;
+      uint64_t expected_reward;
+      crypto::hash prev_hash;
+      blobdata hashing_blob;
+    };
+
+    enum share_result
+    {
+      share_stale,
+      share_invalid,
+      share_duplicate,
+      share_low_difficulty,
+      share_accepted,
+      share_block_found,
+      share_block_rejected,
+    };
+
+    explicit mining_job_cache(core &c);
+
+    /**
+     * @brief gets a new job for the given address
+     *
+     * If wait_ms is not zero and the current template is still
+     * prev_template_id, waits up to that long (capped at
+     * MINING_JOB_MAX_WAIT_MS) for a new template before handing out a
+     * job from the current one.
+     *
+     * @return false if no template could be created
+     */
+    bool get_job(const account_public_address &address, uint64_t prev_template_id, unsigned wait_ms, job &j);
+
+    /**
+     * @brief checks a share found on a job
+     *
+     * @param share_difficulty the difficulty the share has to meet, capped at the network difficulty
+     * @param pow_hash the PoW hash of the share, if it could be computed
+     */
+    share_result submit_share(uint64_t template_id, uint32_t extra_nonce, uint32_t nonce, difficulty_type share_difficulty, crypto::hash &pow_hash);
+
+  private:
+    struct block_template
+    {
+      uint64_t id;
+      account_public_address address;
+      block b;
+      size_t extra_nonce_offset;
+      std::vector<crypto::hash> tx_tree_branch;
+      difficulty_type difficulty;
+      uint64_t height;
+      uint64_t expected_reward;
+      uint64_t pool_cookie;
+      time_t created;
+      uint32_t next_extra_nonce;
+      std::unordered_set<uint64_t> shares;
+    };
+
+    bool is_current(const block_template &t, const crypto::hash &top, uint64_t pool_cookie) const;
+    std::shared_ptr<block_template> get_template(const account_public_address &address);
+    std::shared_ptr<block_template> create_template(const account_public_address &address);
+    static void set_extra_nonce(const block_template &t, block &b, uint32_t extra_nonce);
+
+    core &m_core;
+    boost::mutex m_lock;
+    std::deque<std::shared_ptr<block_template>> m_templates;  //!< newest first
+    uint64_t m_next_template_id;
+};
+
+}  // namespace cryptonote
@@ -0,0 +1,234 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <ostream>
+#include <string.h>
+
+#include "rpc_response_cache.h"
+#include "misc_log_ex.h"
+#include "storages/portable_storage.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "daemon.rpc"
+
+namespace
+{
+  struct cacheable_rpc
+  {
+    const char *name;
+    bool depends_on_pool;
+    unsigned max_age;
+  };
+
+  // get_info also reports connections and sync state, which change without a new block
+  const cacheable_rpc cacheable_rpcs[] = {
+    { "/get_info",                  true,  2 },
+    { "/getinfo",                   true,  2 },
+    { "get_info",                   true,  2 },
+    { "get_last_block_header",      false, 0 },
+    { "getlastblockheader",         false, 0 },
+    { "get_block_header_by_hash",   false, 0 },
+    { "getblockheaderbyhash",       false, 0 },
+    { "get_block_header_by_height", false, 0 },
+    { "getblockheaderbyheight",     false, 0 },
+    { "get_block_headers_range",    false, 0 },
+    { "getblockheadersrange",       false, 0 },
+    { "get_fee_estimate",           false, 0 },
+  };
+
+  const cacheable_rpc *find_cacheable(const std::string &name)
+  {
+    for (const cacheable_rpc &rpc: cacheable_rpcs)
+      if (name == rpc.name)
+        return &rpc;
+    return nullptr;
+  }
+
+  // compact JSON of an entry; sections keep their fields sorted, so equal params give equal strings
+  std::string to_json(const epee::serialization::storage_entry &se)
+  {
+    std::string json;
+    epee::serialization::string_append_buf sb(json);
+    std::ostream s(&sb);
+    epee::serialization::dump_as_json(s, se, 0, false);
+    return json;
+  }
+
+  const char ID_FIELD[] = "\"id\": ";
+  const char STATUS_OK[] = "\"status\": \"OK\"";
+}
+
+namespace cryptonote
+{
+
+constexpr size_t rpc_response_cache::DEFAULT_MAX_SIZE;
+
+rpc_response_cache::rpc_response_cache(size_t max_size):
+  m_size(0),
+  m_max_size(max_size),
+  m_hits(0),
+  m_misses(0)
+{
+}
+
+void rpc_response_cache::set_max_size(size_t max_size)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  m_max_size = max_size;
+  while (m_size > m_max_size && !m_lru.empty())
+    erase(m_entries.find(m_lru.back()));
+}
+
+bool rpc_response_cache::get_key(const std::string &uri, const std::string &body, request_key &key) const
+{
+  {
+    boost::unique_lock<boost::mutex> lock(m_lock);
+    if (m_max_size == 0)
+      return false;
+  }
+
+  const cacheable_rpc *rpc;
+  if (uri == "/json_rpc")
+  {
+    epee::serialization::portable_storage ps;
+    if (!ps.load_from_json(body))
+      return false;
+    std::string method;
+    if (!ps.get_value("method", method, nullptr))
+      return false;
+    rpc = find_cacheable(method);
+    if (!rpc)
+      return false;
+    epee::serialization::storage_entry params(std::string{});
+    ps.get_value("params", params, nullptr);
+    epee::serialization::storage_entry id(std::string{});
+    ps.get_value("id", id, nullptr);
+    key.key = method + '\n' + to_json(params);
+    key.id = to_json(id);
+  }
+  else
+  {
+    rpc = find_cacheable(uri);
+    if (!rpc)
+      return false;
+    key.key = uri + '\n' + body;
+    key.id.clear();
+  }
+  key.depends_on_pool = rpc->depends_on_pool;
+  key.max_age = rpc->max_age;
+  return true;
+}
+
+bool rpc_response_cache::find(const request_key &key, const crypto::hash &top_hash, uint64_t pool_cookie, std::string &body, std::string &mime_type)
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  auto it = m_entries.find(key.key);
+  if (it == m_entries.end())
+  {
+    ++m_misses;
+    return false;
+  }
+  const entry &e = it->second;
+  if (e.top_hash != top_hash || (key.depends_on_pool && e.pool_cookie != pool_cookie) || (key.max_age && time(NULL) >= e.created + key.max_age))
+  {
+    erase(it);
+    ++m_misses;
+    return false;
+  }
+  m_lru.splice(m_lru.begin(), m_lru, e.lru);
+  body.clear();
+  body.reserve(e.head.size() + key.id.size() + e.tail.size());
+  body.append(e.head);
+  if (!key.id.empty())
+    body.append(key.id);
+  body.append(e.tail);
+  mime_type = e.mime_type;
+  ++m_hits;
+  return true;
+}
+
+void rpc_response_cache::add(const request_key &key, const crypto::hash &top_hash, uint64_t pool_cookie, const std::string &body, const std::string &mime_type)
+{
+  // errors and busy replies are left out, they may well clear up on the next call
+  if (body.find(STATUS_OK) == std::string::npos)
+    return;
+
+  entry e;
+  e.top_hash = top_hash;
+  e.pool_cookie = pool_cookie;
+  e.created = time(NULL);
+  e.mime_type = mime_type;
+  if (key.id.empty())
+  {
+    e.head = body;
+  }
+  else
+  {
+    // the envelope fields are sorted, so the id is the first field in the body
+    const size_t pos = body.find(ID_FIELD);
+    if (pos == std::string::npos)
+      return;
+    const size_t id_pos = pos + strlen(ID_FIELD);
+    if (body.compare(id_pos, key.id.size(), key.id) != 0)
+      return;
+    e.head = body.substr(0, id_pos);
+    e.tail = body.substr(id_pos + key.id.size());
+  }
+
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  const size_t size = entry_size(key.key, e);
+  if (size > m_max_size)
+    return;
+  auto it = m_entries.find(key.key);
+  if (it != m_entries.end())
+    erase(it);
+  while (m_size + size > m_max_size && !m_lru.empty())
+    erase(m_entries.find(m_lru.back()));
+  m_lru.push_front(key.key);
+  e.lru = m_lru.begin();
+  m_entries.emplace(key.key, std::move(e));
+  m_size += size;
+}
+
+void rpc_response_cache::erase(std::unordered_map<std::string, entry>::iterator it)
+{
+  m_size -= entry_size(it->first, it->second);
+  m_lru.erase(it->second.lru);
+  m_entries.erase(it);
+}
+
+void rpc_response_cache::get_stats(uint64_t &hits, uint64_t &misses, size_t &size, size_t &entries) const
+{
+  boost::unique_lock<boost::mutex> lock(m_lock);
+  hits = m_hits;
+  misses = m_misses;
+  size = m_size;
+  entries = m_entries.size();
+}
+
+}  // namespace cryptonote
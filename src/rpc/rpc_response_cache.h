@@ -0,0 +1,110 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <ctime>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+/**
+ * Keeps ready-to-send bodies of hot read only RPC calls.
+ *
+ * Only the calls listed in rpc_response_cache.cpp are cached. An entry is
+ * keyed by the URI or JSON RPC method and its canonicalized params, and is
+ * only served while the top block hash, and the pool cookie for calls that
+ * report pool state, are the ones it was built with. JSON RPC bodies are
+ * stored without their id, so requests differing only by id share an entry.
+ * The oldest entries are dropped once the bodies go over the size bound.
+ */
+class rpc_response_cache
+{
+  public:
+
+    static constexpr size_t DEFAULT_MAX_SIZE = 16 * 1024 * 1024;
+
+    struct request_key
+    {
+      std::string key;
+      std::string id;           //!< JSON RPC id as it is written in the response, empty for plain URIs
+      bool depends_on_pool;
+      unsigned max_age;         //!< seconds an entry stays valid for, 0 for as long as the chain does not change
+    };
+
+    explicit rpc_response_cache(size_t max_size = DEFAULT_MAX_SIZE);
+
+    //! 0 disables the cache
+    void set_max_size(size_t max_size);
+
+    /**
+     * @brief works out the key of a request
+     *
+     * @return false if the request is not one of the cached calls, or the cache is disabled
+     */
+    bool get_key(const std::string &uri, const std::string &body, request_key &key) const;
+
+    //! @return false on a miss, or if the entry was built for another chain or pool state
+    bool find(const request_key &key, const crypto::hash &top_hash, uint64_t pool_cookie, std::string &body, std::string &mime_type);
+
+    //! stores a successful response, others are ignored
+    void add(const request_key &key, const crypto::hash &top_hash, uint64_t pool_cookie, const std::string &body, const std::string &mime_type);
+
+    void get_stats(uint64_t &hits, uint64_t &misses, size_t &size, size_t &entries) const;
+
+  private:
+    struct entry
+    {
+      crypto::hash top_hash;
+      uint64_t pool_cookie;
+      time_t created;
+      std::string head;         //!< body up to the JSON RPC id
+      std::string tail;         //!< body after the JSON RPC id
+      std::string mime_type;
+      std::list<std::string>::iterator lru;
+    };
+
+    void erase(std::unordered_map<std::string, entry>::iterator it);
+    static size_t entry_size(const std::string &key, const entry &e) { return key.size() + e.head.size() + e.tail.size(); }
+
+    mutable boost::mutex m_lock;
+    std::unordered_map<std::string, entry> m_entries;
+    std::list<std::string> m_lru;  //!< most recently used first
+    size_t m_size;
+    size_t m_max_size;
+    uint64_t m_hits;
+    uint64_t m_misses;
+};
+
+}  // namespace cryptonote
@@ -0,0 +1,257 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+
+#include "zmq_pub.h"
+
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#include "string_tools.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.zmq"
+
+namespace
+{
+  typedef rapidjson::Writer<rapidjson::StringBuffer> json_writer;
+
+  void write_hash(json_writer &writer, const char *key, const crypto::hash &h)
+  {
+    const std::string hex = epee::string_tools::pod_to_hex(h);
+    writer.Key(key);
+    writer.String(hex.data(), hex.size());
+  }
+
+  void write_uint64(json_writer &writer, const char *key, uint64_t value)
+  {
+    writer.Key(key);
+    writer.Uint64(value);
+  }
+
+  std::string to_string(const rapidjson::StringBuffer &buf)
+  {
+    return std::string(buf.GetString(), buf.GetSize());
+  }
+}
+
+namespace cryptonote
+{
+
+namespace rpc
+{
+
+ZmqPublisher::ZmqPublisher() :
+    context(1),
+    dropped(0),
+    stop_signal(false),
+    running(false)
+{
+}
+
+ZmqPublisher::~ZmqPublisher()
+{
+  stop();
+}
+
+bool ZmqPublisher::bind(const std::string &address)
+{
+  try
+  {
+    pub_socket.reset(new zmq::socket_t(context, ZMQ_PUB));
+    const int linger_ms = 0;
+    pub_socket->setsockopt(ZMQ_LINGER, &linger_ms, sizeof(linger_ms));
+    pub_socket->bind(address.c_str());
+  }
+  catch (const std::exception& e)
+  {
+    MERROR(std::string("Error creating ZMQ PUB socket: ") + e.what());
+    pub_socket.reset();
+    return false;
+  }
+  return true;
+}
+
+void ZmqPublisher::run()
+{
+  running = true;
+  run_thread = boost::thread(boost::bind(&ZmqPublisher::serve, this));
+}
+
+void ZmqPublisher::stop()
+{
+  if (!running) return;
+
+  {
+    boost::unique_lock<boost::mutex> lock(queue_lock);
+    stop_signal = true;
+  }
+  queue_cond.notify_one();
+  run_thread.join();
+
+  running = false;
+}
+
+void ZmqPublisher::attach(const std::shared_ptr<ZmqPublisher> &publisher, cryptonote::core &core)
+{
+  core.get_blockchain_storage().set_chain_callbacks(
+    [publisher](uint64_t height, const cryptonote::block &b) { publisher->publish_block(height, b); },
+    [publisher](uint64_t split_height, uint64_t old_height, uint64_t new_height) { publisher->publish_reorg(split_height, old_height, new_height); });
+  core.get_pool().set_tx_callbacks(
+    [publisher](const crypto::hash &txid, uint64_t weight, uint64_t fee) { publisher->publish_txpool_add(txid, weight, fee); },
+    [publisher](const crypto::hash &txid) { publisher->publish_txpool_remove(txid); });
+}
+
+void ZmqPublisher::detach(cryptonote::core &core)
+{
+  core.get_blockchain_storage().set_chain_callbacks(nullptr, nullptr);
+  core.get_pool().set_tx_callbacks(nullptr, nullptr);
+}
+
+void ZmqPublisher::publish_block(uint64_t height, const cryptonote::block &b)
+{
+  rapidjson::StringBuffer buf;
+  json_writer writer(buf);
+  writer.StartObject();
+  write_uint64(writer, "height", height);
+  write_hash(writer, "hash", cryptonote::get_block_hash(b));
+  write_hash(writer, "prev_hash", b.prev_id);
+  write_uint64(writer, "major_version", b.major_version);
+  write_uint64(writer, "minor_version", b.minor_version);
+  write_uint64(writer, "timestamp", b.timestamp);
+  write_uint64(writer, "nonce", b.nonce);
+  write_hash(writer, "miner_tx_hash", cryptonote::get_transaction_hash(b.miner_tx));
+  writer.Key("tx_hashes");
+  writer.StartArray();
+  for (const crypto::hash &h: b.tx_hashes)
+  {
+    const std::string hex = epee::string_tools::pod_to_hex(h);
+    writer.String(hex.data(), hex.size());
+  }
+  writer.EndArray();
+  writer.EndObject();
+  enqueue("block", to_string(buf));
+}
+
+void ZmqPublisher::publish_reorg(uint64_t split_height, uint64_t old_height, uint64_t new_height)
+{
+  rapidjson::StringBuffer buf;
+  json_writer writer(buf);
+  writer.StartObject();
+  write_uint64(writer, "split_height", split_height);
+  write_uint64(writer, "old_height", old_height);
+  write_uint64(writer, "new_height", new_height);
+  writer.EndObject();
+  enqueue("reorg", to_string(buf));
+}
+
+void ZmqPublisher::publish_txpool_add(const crypto::hash &txid, uint64_t weight, uint64_t fee)
+{
+  rapidjson::StringBuffer buf;
+  json_writer writer(buf);
+  writer.StartObject();
+  write_hash(writer, "id", txid);
+  write_uint64(writer, "weight", weight);
+  write_uint64(writer, "fee", fee);
+  writer.EndObject();
+  enqueue("txpool_add", to_string(buf));
+}
+
+void ZmqPublisher::publish_txpool_remove(const crypto::hash &txid)
+{
+  rapidjson::StringBuffer buf;
+  json_writer writer(buf);
+  writer.StartObject();
+  write_hash(writer, "id", txid);
+  writer.EndObject();
+  enqueue("txpool_remove", to_string(buf));
+}
+
+void ZmqPublisher::enqueue(const char *topic, std::string body)
+{
+  {
+    boost::unique_lock<boost::mutex> lock(queue_lock);
+    if (!running || stop_signal)
+      return;
+    if (queue.size() >= DEFAULT_ZMQ_PUB_MAX_QUEUED)
+    {
+      if (dropped++ == 0)
+        MWARNING("ZMQ publish queue full, dropping events");
+      return;
+    }
+    queue.emplace_back(topic, std::move(body));
+  }
+  queue_cond.notify_one();
+}
+
+void ZmqPublisher::serve()
+{
+  while (1)
+  {
+    std::deque<std::pair<const char*, std::string>> events;
+    {
+      boost::unique_lock<boost::mutex> lock(queue_lock);
+      while (queue.empty() && !stop_signal)
+        queue_cond.wait(lock);
+      if (stop_signal)
+        return;
+      events.swap(queue);
+      if (dropped)
+      {
+        MWARNING("Dropped " << dropped << " ZMQ events, subscribers may need to resync");
+        dropped = 0;
+      }
+    }
+
+    for (const auto &e: events)
+    {
+      try
+      {
+        const size_t topic_size = strlen(e.first);
+        zmq::message_t topic(topic_size);
+        memcpy(topic.data(), e.first, topic_size);
+        zmq::message_t body(e.second.size());
+        memcpy(body.data(), e.second.data(), e.second.size());
+        pub_socket->send(topic, ZMQ_SNDMORE);
+        pub_socket->send(body);
+        MDEBUG("Published ZMQ " << e.first << " event: " << e.second);
+      }
+      catch (const zmq::error_t& ex)
+      {
+        MERROR(std::string("ZMQ error: ") + ex.what());
+      }
+    }
+  }
+}
+
+
+}  // namespace rpc
+
+}  // namespace cryptonote
@@ -0,0 +1,106 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <zmq.hpp>
+#include <deque>
+#include <string>
+#include <memory>
+
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+class core;
+
+namespace rpc
+{
+
+static constexpr size_t DEFAULT_ZMQ_PUB_MAX_QUEUED = 10000;
+
+/**
+ * Publishes chain and tx pool events on a ZMQ PUB socket.
+ *
+ * Each event is a two part message: a topic and a JSON body. Topics are
+ * "block" (a new main chain block header and its tx hashes), "reorg" (the
+ * split height and the old and new chain heights), "txpool_add" and
+ * "txpool_remove". Subscribers filter on the topic prefix as usual.
+ *
+ * The publish_* calls come from the core with its locks held, so they only
+ * queue the event; a separate thread does the sending. Events are dropped
+ * if the queue fills up.
+ */
+class ZmqPublisher
+{
+  public:
+
+    ZmqPublisher();
+
+    ~ZmqPublisher();
+
+    bool bind(const std::string &address);
+
+    void run();
+    void stop();
+
+    //! hooks this publisher up to the core's chain and pool callbacks
+    static void attach(const std::shared_ptr<ZmqPublisher> &publisher, cryptonote::core &core);
+    static void detach(cryptonote::core &core);
+
+    void publish_block(uint64_t height, const cryptonote::block &b);
+    void publish_reorg(uint64_t split_height, uint64_t old_height, uint64_t new_height);
+    void publish_txpool_add(const crypto::hash &txid, uint64_t weight, uint64_t fee);
+    void publish_txpool_remove(const crypto::hash &txid);
+
+  private:
+    void enqueue(const char *topic, std::string body);
+    void serve();
+
+    zmq::context_t context;
+    std::unique_ptr<zmq::socket_t> pub_socket;
+
+    boost::mutex queue_lock;
+    boost::condition_variable queue_cond;
+    std::deque<std::pair<const char*, std::string>> queue;
+    size_t dropped;
+    bool stop_signal;
+    bool running;
+
+    boost::thread run_thread;
+};
+
+
+}  // namespace rpc
+
+}  // namespace cryptonote
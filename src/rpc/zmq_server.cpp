@@ -28,6 +28,8 @@
 
 #include "zmq_server.h"
 #include <boost/chrono/chrono.hpp>
+#include <algorithm>
+#include <deque>
 
 namespace cryptonote
 {
@@ -35,8 +37,37 @@ namespace cryptonote
 namespace rpc
 {
 
-ZmqServer::ZmqServer(RpcHandler& h) :
+namespace
+{
+  const char WORKERS_ADDRESS[] = "inproc://zmq-rpc-workers";
+  const char WORKER_READY[] = "READY";
+
+  // returns false if nothing arrived before the receive timeout
+  bool recv_frames(zmq::socket_t& socket, std::vector<zmq::message_t>& frames)
+  {
+    frames.clear();
+    do
+    {
+      frames.emplace_back();
+      if (!socket.recv(&frames.back()))
+      {
+        frames.clear();
+        return false;
+      }
+    } while (frames.back().more());
+    return true;
+  }
+
+  void send_frames(zmq::socket_t& socket, std::vector<zmq::message_t>& frames, size_t start)
+  {
+    for (size_t i = start; i < frames.size(); ++i)
+      socket.send(frames[i], i + 1 < frames.size() ? ZMQ_SNDMORE : 0);
+  }
+}
+
+ZmqServer::ZmqServer(RpcHandler& h, unsigned int num_workers) :
     handler(h),
+    num_workers(std::max(1u, num_workers)),
     stop_signal(false),
     running(false),
     context(DEFAULT_NUM_ZMQ_THREADS) // TODO: make this configurable
@@ -49,31 +80,41 @@ ZmqServer::~ZmqServer()
 
 void ZmqServer::serve()
 {
+  // workers announce themselves on the backend when idle, and a client
+  // request is only read off the frontend once one of them is available
+  std::deque<zmq::message_t> idle_workers;
+  std::vector<zmq::message_t> frames;
 
-  while (1)
+  while (!stop_signal)
   {
     try
     {
-      zmq::message_t message;
-
-      if (!rep_socket)
+      if (!frontend_socket || !backend_socket)
       {
-        throw std::runtime_error("ZMQ RPC server reply socket is null");
+        throw std::runtime_error("ZMQ RPC server sockets are null");
       }
-      while (rep_socket->recv(&message))
-      {
-        std::string message_string(reinterpret_cast<const char *>(message.data()), message.size());
 
-        MDEBUG(std::string("Received RPC request: \"") + message_string + "\"");
+      zmq::pollitem_t items[] = {
+        { static_cast<void*>(*backend_socket), 0, ZMQ_POLLIN, 0 },
+        { static_cast<void*>(*frontend_socket), 0, ZMQ_POLLIN, 0 }
+      };
+      zmq::poll(items, idle_workers.empty() ? 1 : 2, DEFAULT_RPC_RECV_TIMEOUT_MS);
 
-        std::string response = handler.handle(message_string);
-
-        zmq::message_t reply(response.size());
-        memcpy((void *) reply.data(), response.c_str(), response.size());
-
-        rep_socket->send(reply);
-        MDEBUG(std::string("Sent RPC reply: \"") + response + "\"");
+      // worker, empty delimiter, then either READY or the reply envelope
+      if ((items[0].revents & ZMQ_POLLIN) && recv_frames(*backend_socket, frames) && frames.size() >= 3)
+      {
+        idle_workers.push_back(std::move(frames[0]));
+        if (frames.size() > 3)
+          send_frames(*frontend_socket, frames, 2);
+      }
 
+      if (!idle_workers.empty() && (items[1].revents & ZMQ_POLLIN) && recv_frames(*frontend_socket, frames))
+      {
+        backend_socket->send(idle_workers.front(), ZMQ_SNDMORE);
+        idle_workers.pop_front();
+        zmq::message_t delimiter;
+        backend_socket->send(delimiter, ZMQ_SNDMORE);
+        send_frames(*backend_socket, frames, 0);
       }
     }
     catch (const boost::thread_interrupted& e)
@@ -88,6 +129,49 @@ void ZmqServer::serve()
   }
 }
 
+void ZmqServer::work()
+{
+  try
+  {
+    zmq::socket_t socket(context, ZMQ_REQ);
+    const int linger = 0;
+    socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    socket.setsockopt(ZMQ_RCVTIMEO, &DEFAULT_RPC_RECV_TIMEOUT_MS, sizeof(DEFAULT_RPC_RECV_TIMEOUT_MS));
+    socket.connect(WORKERS_ADDRESS);
+
+    zmq::message_t ready(sizeof(WORKER_READY) - 1);
+    memcpy(ready.data(), WORKER_READY, ready.size());
+    socket.send(ready);
+
+    // the client envelope comes first, the request body is the last frame
+    std::vector<zmq::message_t> frames;
+    while (!stop_signal)
+    {
+      if (!recv_frames(socket, frames))
+        continue;
+
+      zmq::message_t& message = frames.back();
+      std::string message_string(reinterpret_cast<const char *>(message.data()), message.size());
+
+      MDEBUG(std::string("Received RPC request: \"") + message_string + "\"");
+
+      std::string response = handler.handle(message_string);
+
+      zmq::message_t reply(response.size());
+      memcpy((void *) reply.data(), response.c_str(), response.size());
+      frames.back() = std::move(reply);
+
+      send_frames(socket, frames, 0);
+      MDEBUG(std::string("Sent RPC reply: \"") + response + "\"");
+    }
+  }
+  catch (const zmq::error_t& e)
+  {
+    if (!stop_signal)
+      MERROR(std::string("ZMQ RPC worker error: ") + e.what());
+  }
+}
+
 bool ZmqServer::addIPCSocket(std::string address, std::string port)
 {
   MERROR("ZmqServer::addIPCSocket not yet implemented!");
@@ -100,16 +184,17 @@ bool ZmqServer::addTCPSocket(std::string address, std::string port)
   {
     std::string addr_prefix("tcp://");
 
-    rep_socket.reset(new zmq::socket_t(context, ZMQ_REP));
-
-    rep_socket->setsockopt(ZMQ_RCVTIMEO, &DEFAULT_RPC_RECV_TIMEOUT_MS, sizeof(DEFAULT_RPC_RECV_TIMEOUT_MS));
+    const int linger = 0;
+    frontend_socket.reset(new zmq::socket_t(context, ZMQ_ROUTER));
+    frontend_socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    frontend_socket->setsockopt(ZMQ_RCVTIMEO, &DEFAULT_RPC_RECV_TIMEOUT_MS, sizeof(DEFAULT_RPC_RECV_TIMEOUT_MS));
 
     if (address.empty())
       address = "*";
     if (port.empty())
       port = "*";
     std::string bind_address = addr_prefix + address + std::string(":") + port;
-    rep_socket->bind(bind_address.c_str());
+    frontend_socket->bind(bind_address.c_str());
   }
   catch (const std::exception& e)
   {
@@ -121,7 +206,17 @@ bool ZmqServer::addTCPSocket(std::string address, std::string port)
 
 void ZmqServer::run()
 {
+  // inproc endpoints must be bound before the workers connect to them
+  const int linger = 0;
+  backend_socket.reset(new zmq::socket_t(context, ZMQ_ROUTER));
+  backend_socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+  backend_socket->setsockopt(ZMQ_RCVTIMEO, &DEFAULT_RPC_RECV_TIMEOUT_MS, sizeof(DEFAULT_RPC_RECV_TIMEOUT_MS));
+  backend_socket->bind(WORKERS_ADDRESS);
+
   running = true;
+  worker_threads.reserve(num_workers);
+  for (unsigned int i = 0; i < num_workers; ++i)
+    worker_threads.emplace_back(boost::bind(&ZmqServer::work, this));
   run_thread = boost::thread(boost::bind(&ZmqServer::serve, this));
 }
 
@@ -133,6 +228,9 @@ void ZmqServer::stop()
 
   run_thread.interrupt();
   run_thread.join();
+  for (auto& worker: worker_threads)
+    worker.join();
+  worker_threads.clear();
 
   running = false;
 
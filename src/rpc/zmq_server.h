@@ -32,6 +32,7 @@
 #include <zmq.hpp>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "common/command_line.h"
 
@@ -45,12 +46,13 @@ namespace rpc
 
 static constexpr int DEFAULT_NUM_ZMQ_THREADS = 1;
 static constexpr int DEFAULT_RPC_RECV_TIMEOUT_MS = 1000;
+static constexpr unsigned int DEFAULT_NUM_ZMQ_RPC_WORKERS = 2;
 
 class ZmqServer
 {
   public:
 
-    ZmqServer(RpcHandler& h);
+    ZmqServer(RpcHandler& h, unsigned int num_workers = DEFAULT_NUM_ZMQ_RPC_WORKERS);
 
     ~ZmqServer();
 
@@ -65,16 +67,25 @@ class ZmqServer
     void stop();
 
   private:
+    void work();
+
     RpcHandler& handler;
 
+    unsigned int num_workers;
+
     volatile bool stop_signal;
     volatile bool running;
 
     zmq::context_t context;
 
     boost::thread run_thread;
+    std::vector<boost::thread> worker_threads;
 
-    std::unique_ptr<zmq::socket_t> rep_socket;
+    // clients talk to the ROUTER frontend, each request is handed to an idle
+    // worker through the ROUTER backend so a slow request does not hold up
+    // the ones queued behind it
+    std::unique_ptr<zmq::socket_t> frontend_socket;
+    std::unique_ptr<zmq::socket_t> backend_socket;
 };
 
 
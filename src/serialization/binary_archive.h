@@ -35,11 +35,14 @@
 #pragma once
 
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <boost/mpl/bool.hpp>
 #include <boost/type_traits/make_unsigned.hpp>
 
 #include "common/varint.h"
+#include "span.h"
 #include "warnings.h"
 
 /* I have no clue what these lines means */
@@ -56,16 +59,15 @@ DISABLE_VS_WARNINGS(4244)
  * purpse is to define the functions used for the binary_archive. Its
  * a header, basically. I think it was declared simply to save typing...
  */
-template <class Stream, bool IsSaving>
+template <bool IsSaving>
 struct binary_archive_base
 {
-  typedef Stream stream_type;
-  typedef binary_archive_base<Stream, IsSaving> base_type;
+  typedef binary_archive_base<IsSaving> base_type;
   typedef boost::mpl::bool_<IsSaving> is_saving;
 
   typedef uint8_t variant_tag_type;
 
-  explicit binary_archive_base(stream_type &s) : stream_(s) { }
+  binary_archive_base() { }
   
   /* definition of standard API functions */
   void tag(const char *) { }
@@ -73,12 +75,6 @@ struct binary_archive_base
   void end_object() { }
   void begin_variant() { }
   void end_variant() { }
-  /* I just want to leave a comment saying how this line really shows
-     flaws in the ownership model of many OOP languages, that is all. */
-  stream_type &stream() { return stream_; } 
-
-protected:
-  stream_type &stream_;
 };
 
 /* \struct binary_archive
@@ -95,16 +91,25 @@ template <bool W>
 struct binary_archive;
 
 
+/*! \struct binary_archive<false>
+ *
+ * \brief reads directly from a byte span
+ *
+ * \detailed Parsing blobs is on the hot path of block and tx
+ * relay, so the reader walks a pointer over the input instead of
+ * going through std::istream. Reading past the end leaves the
+ * destination untouched and puts the archive in the failed state,
+ * which is what the stream based reader did.
+ */
 template <>
-struct binary_archive<false> : public binary_archive_base<std::istream, false>
+struct binary_archive<false> : public binary_archive_base<false>
 {
 
-  explicit binary_archive(stream_type &s) : base_type(s) {
-    stream_type::streampos pos = stream_.tellg();
-    stream_.seekg(0, std::ios_base::end);
-    eof_pos_ = stream_.tellg();
-    stream_.seekg(pos);
-  }
+  explicit binary_archive(epee::span<const std::uint8_t> s)
+    : base_type(), bytes_(s), good_(true) { }
+
+  bool good() const noexcept { return good_; }
+  void set_fail() noexcept { good_ = false; }
 
   template <class T>
   void serialize_int(T &v)
@@ -119,22 +124,32 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
   template <class T>
   void serialize_uint(T &v, size_t width = sizeof(T))
   {
+    if (width > bytes_.size())
+    {
+      bytes_.remove_prefix(bytes_.size());
+      good_ = false;
+      return;
+    }
     T ret = 0;
     unsigned shift = 0;
     for (size_t i = 0; i < width; i++) {
-      //std::cerr << "tell: " << stream_.tellg() << " value: " << ret << std::endl;
-      char c;
-      stream_.get(c);
-      T b = (unsigned char)c;
-      ret += (b << shift);	// can this be changed to OR, i think it can.
+      ret |= T(bytes_.data()[i]) << shift;
       shift += 8;
     }
+    bytes_.remove_prefix(width);
     v = ret;
   }
   
   void serialize_blob(void *buf, size_t len, const char *delimiter="")
   {
-    stream_.read((char *)buf, len);
+    if (len > bytes_.size())
+    {
+      bytes_.remove_prefix(bytes_.size());
+      good_ = false;
+      return;
+    }
+    std::memcpy(buf, bytes_.data(), len);
+    bytes_.remove_prefix(len);
   }
   
   template <class T>
@@ -146,8 +161,13 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
   template <class T>
   void serialize_uvarint(T &v)
   {
-    typedef std::istreambuf_iterator<char> it;
-    tools::read_varint(it(stream_), it(), v); // XXX handle failure
+    const std::uint8_t *current = bytes_.data();
+    const std::uint8_t *end = current + bytes_.size();
+    // a varint cut short by the end of the input is as bad as a malformed one
+    const int read = tools::read_varint(current, end, v);
+    if (read <= 0 || (current[-1] & 0x80))
+      good_ = false;
+    bytes_.remove_prefix(current - bytes_.data());
   }
 
   void begin_array(size_t &s)
@@ -166,21 +186,26 @@ struct binary_archive<false> : public binary_archive_base<std::istream, false>
     serialize_int(t);
   }
 
-  size_t remaining_bytes() {
-    if (!stream_.good())
-      return 0;
-    //std::cerr << "tell: " << stream_.tellg() << std::endl;
-    assert(stream_.tellg() <= eof_pos_);
-    return eof_pos_ - stream_.tellg();
+  size_t remaining_bytes() const noexcept {
+    return good_ ? bytes_.size() : 0;
   }
 protected:
-  std::streamoff eof_pos_;
+  epee::span<const std::uint8_t> bytes_;
+  bool good_;
 };
 
 template <>
-struct binary_archive<true> : public binary_archive_base<std::ostream, true>
+struct binary_archive<true> : public binary_archive_base<true>
 {
-  explicit binary_archive(stream_type &s) : base_type(s) { }
+  typedef std::ostream stream_type;
+
+  explicit binary_archive(stream_type &s) : base_type(), stream_(s) { }
+
+  bool good() const { return stream_.good(); }
+  void set_fail() { stream_.setstate(std::ios::failbit); }
+  /* I just want to leave a comment saying how this line really shows
+     flaws in the ownership model of many OOP languages, that is all. */
+  stream_type &stream() { return stream_; }
 
   template <class T>
   void serialize_int(T v)
@@ -190,15 +215,17 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   template <class T>
   void serialize_uint(T v)
   {
+    char buf[sizeof(T)];
     for (size_t i = 0; i < sizeof(T); i++) {
-      stream_.put((char)(v & 0xff));
+      buf[i] = (char)(v & 0xff);
       if (1 < sizeof(T)) v >>= 8;
     }
+    write(buf, sizeof(T));
   }
 
   void serialize_blob(void *buf, size_t len, const char *delimiter="")
   {
-    stream_.write((char *)buf, len);
+    write((const char *)buf, len);
   }
 
   template <class T>
@@ -210,8 +237,10 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   template <class T>
   void serialize_uvarint(T &v)
   {
-    typedef std::ostreambuf_iterator<char> it;
-    tools::write_varint(it(stream_), v);
+    char buf[(sizeof(T) * 8 + 6) / 7];
+    char *end = buf;
+    tools::write_varint(end, v);
+    write(buf, end - buf);
   }
   void begin_array(size_t s)
   {
@@ -227,6 +256,16 @@ struct binary_archive<true> : public binary_archive_base<std::ostream, true>
   void write_variant_tag(variant_tag_type t) {
     serialize_int(t);
   }
+
+protected:
+  void write(const char *buf, size_t len)
+  {
+    // one call into the streambuf per value rather than per byte
+    if (stream_.good() && stream_.rdbuf()->sputn(buf, len) != (std::streamsize)len)
+      stream_.setstate(std::ios::badbit);
+  }
+
+  stream_type &stream_;
 };
 
 POP_WARNINGS
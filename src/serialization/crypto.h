@@ -48,7 +48,7 @@ bool do_serialize(Archive<false> &ar, std::vector<crypto::signature> &v)
 
   // very basic sanity check
   if (ar.remaining_bytes() < cnt*sizeof(crypto::signature)) {
-    ar.stream().setstate(std::ios::failbit);
+    ar.set_fail();
     return false;
   }
 
@@ -56,7 +56,7 @@ bool do_serialize(Archive<false> &ar, std::vector<crypto::signature> &v)
   for (size_t i = 0; i < cnt; i++) {
     v.resize(i+1);
     ar.serialize_blob(&(v[i]), sizeof(crypto::signature), "");
-    if (!ar.stream().good())
+    if (!ar.good())
       return false;
   }
   return true;
@@ -71,7 +71,7 @@ bool do_serialize(Archive<true> &ar, std::vector<crypto::signature> &v)
   size_t cnt = v.size();
   for (size_t i = 0; i < cnt; i++) {
     ar.serialize_blob(&(v[i]), sizeof(crypto::signature), "");
-    if (!ar.stream().good())
+    if (!ar.good())
       return false;
   }
   ar.end_string();
@@ -37,9 +37,52 @@
 #pragma once
 
 #include "serialization.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <iomanip>
+#include <string>
+
+/*! \class json_string_buf
+ *
+ * \brief a stream buffer appending to a caller's string
+ */
+class json_string_buf : public std::streambuf
+{
+public:
+  explicit json_string_buf(std::string &s) : s_(s) { }
+
+protected:
+  int_type overflow(int_type c)
+  {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+      s_.push_back(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+  }
+  std::streamsize xsputn(const char *p, std::streamsize n)
+  {
+    s_.append(p, n);
+    return n;
+  }
+
+private:
+  std::string &s_;
+};
+
+/*! \class json_string_ostream
+ *
+ * \brief an output stream appending to a caller's string
+ *
+ * \detailed saves the stringstream buffer and the copy made by str()
+ * when a json archive is only wanted as a string. The buffer is the
+ * first base so it is built before the ostream uses it.
+ */
+class json_string_ostream : private json_string_buf, public std::ostream
+{
+public:
+  explicit json_string_ostream(std::string &s) : json_string_buf(s), std::ostream(this) { }
+};
+
 
 /*! \struct json_archive_base
  *
@@ -85,12 +128,22 @@ struct json_archive_base
   void end_variant() { end_object(); }
   Stream &stream() { return stream_; }
 
+  bool good() const { return stream_.good(); }
+  void set_fail() { stream_.setstate(std::ios::failbit); }
+
 protected:
   void make_indent()
   {
     if (indent_)
     {
-      stream_ << '\n' << std::string(2 * depth_, ' ');
+      static const char spaces[] = "                                                                ";
+      stream_.put('\n');
+      for (size_t n = 2 * depth_; n > 0; )
+      {
+        const size_t chunk = std::min(n, sizeof(spaces) - 1);
+        stream_.write(spaces, chunk);
+        n -= chunk;
+      }
     }
   }
 
@@ -131,10 +184,19 @@ struct json_archive<true> : public json_archive_base<std::ostream, true>
   }
 
   void serialize_blob(void *buf, size_t len, const char *delimiter="\"") {
+    static const char hexmap[] = "0123456789abcdef";
+    char hex[256];
+    const unsigned char *p = (const unsigned char *)buf;
     begin_string(delimiter);
-    for (size_t i = 0; i < len; i++) {
-      unsigned char c = ((unsigned char *)buf)[i];
-      stream_ << std::hex << std::setw(2) << std::setfill('0') << (int)c;
+    while (len > 0) {
+      const size_t n = std::min(len, sizeof(hex) / 2);
+      for (size_t i = 0; i < n; i++) {
+        hex[2 * i] = hexmap[p[i] >> 4];
+        hex[2 * i + 1] = hexmap[p[i] & 0xf];
+      }
+      stream_.write(hex, 2 * n);
+      p += n;
+      len -= n;
     }
     end_string(delimiter);
   }
@@ -32,6 +32,7 @@
 #include <boost/variant/apply_visitor.hpp>
 #include <limits>
 #include <type_traits>
+#include "string_coding.h"
 #include "string_tools.h"
 
 namespace cryptonote
@@ -664,6 +665,43 @@ void fromJsonValue(const rapidjson::Value& val, cryptonote::rpc::block_with_tran
   GET_FROM_JSON_OBJECT(val, blk.transactions, transactions);
 }
 
+void toJsonValue(rapidjson::Document& doc, const cryptonote::rpc::block_with_transaction_blobs& blk, rapidjson::Value& val)
+{
+  val.SetObject();
+
+  auto& al = doc.GetAllocator();
+
+  const std::string block = epee::string_encoding::base64_encode(blk.block);
+  val.AddMember("block", rapidjson::Value(block.data(), block.size(), al), al);
+  rapidjson::Value transactions(rapidjson::kArrayType);
+  transactions.Reserve(blk.transactions.size(), al);
+  for (const auto& tx: blk.transactions)
+  {
+    const std::string encoded = epee::string_encoding::base64_encode(tx);
+    transactions.PushBack(rapidjson::Value(encoded.data(), encoded.size(), al), al);
+  }
+  val.AddMember("transactions", transactions, al);
+}
+
+
+void fromJsonValue(const rapidjson::Value& val, cryptonote::rpc::block_with_transaction_blobs& blk)
+{
+  if (!val.IsObject())
+  {
+    throw WRONG_TYPE("json object");
+  }
+
+  std::string block;
+  GET_FROM_JSON_OBJECT(val, block, block);
+  blk.block = epee::string_encoding::base64_decode(block);
+  std::vector<std::string> transactions;
+  GET_FROM_JSON_OBJECT(val, transactions, transactions);
+  blk.transactions.clear();
+  blk.transactions.reserve(transactions.size());
+  for (const auto& tx: transactions)
+    blk.transactions.push_back(epee::string_encoding::base64_decode(tx));
+}
+
 void toJsonValue(rapidjson::Document& doc, const cryptonote::rpc::transaction_info& tx_info, rapidjson::Value& val)
 {
   val.SetObject();
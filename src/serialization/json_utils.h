@@ -39,10 +39,11 @@ namespace serialization {
 template<class T>
 std::string dump_json(T &v)
 {
-  std::stringstream ostr;
+  std::string s;
+  json_string_ostream ostr(s);
   json_archive<true> oar(ostr);
   assert(serialization::serialize(oar, v));
-  return ostr.str();
+  return s;
 };
 
 } // namespace serialization
@@ -39,10 +39,24 @@ bool do_serialize(Archive<false> &ar, std::vector<T> &v);
 template <template <bool> class Archive, class T>
 bool do_serialize(Archive<true> &ar, std::vector<T> &v);
 
+template <bool W>
+struct binary_archive;
+
 namespace serialization
 {
   namespace detail
   {
+    /*! \struct is_bulk_vector
+     *
+     * \brief true when a vector of T is laid out in the archive as its raw
+     * element bytes, so it can be copied in one go rather than per element
+     */
+    template <class Archive, class T>
+    struct is_bulk_vector { typedef boost::false_type type; };
+
+    template <bool W, class T>
+    struct is_bulk_vector<binary_archive<W>, T> { typedef typename is_blob_type<T>::type type; };
+
     template <typename T>
     void do_reserve(std::vector<T> &c, size_t N)
     {
@@ -59,8 +73,57 @@ namespace serialization
 
 #include "container.h"
 
+namespace serialization
+{
+  namespace detail
+  {
+    template <class Archive, class T>
+    bool serialize_vector(Archive &ar, std::vector<T> &v, boost::false_type)
+    {
+      return ::do_serialize_container(ar, v);
+    }
+
+    template <template <bool> class Archive, class T>
+    bool serialize_vector(Archive<false> &ar, std::vector<T> &v, boost::true_type)
+    {
+      size_t cnt;
+      ar.begin_array(cnt);
+      if (!ar.good())
+        return false;
+      v.clear();
+
+      // very basic sanity check
+      if (ar.remaining_bytes() / sizeof(T) < cnt) {
+        ar.set_fail();
+        return false;
+      }
+
+      v.resize(cnt);
+      ar.serialize_blob(v.data(), cnt * sizeof(T));
+      ar.end_array();
+      return ar.good();
+    }
+
+    template <template <bool> class Archive, class T>
+    bool serialize_vector(Archive<true> &ar, std::vector<T> &v, boost::true_type)
+    {
+      size_t cnt = v.size();
+      ar.begin_array(cnt);
+      ar.serialize_blob(v.data(), cnt * sizeof(T));
+      ar.end_array();
+      return ar.good();
+    }
+  }
+}
+
 template <template <bool> class Archive, class T>
-bool do_serialize(Archive<false> &ar, std::vector<T> &v) { return do_serialize_container(ar, v); }
+bool do_serialize(Archive<false> &ar, std::vector<T> &v)
+{
+  return ::serialization::detail::serialize_vector(ar, v, typename ::serialization::detail::is_bulk_vector<Archive<false>, T>::type());
+}
 template <template <bool> class Archive, class T>
-bool do_serialize(Archive<true> &ar, std::vector<T> &v) { return do_serialize_container(ar, v); }
+bool do_serialize(Archive<true> &ar, std::vector<T> &v)
+{
+  return ::serialization::detail::serialize_vector(ar, v, typename ::serialization::detail::is_bulk_vector<Archive<true>, T>::type());
+}
 
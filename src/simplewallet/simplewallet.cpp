@@ -2235,6 +2235,40 @@ bool simple_wallet::set_segregation_height(const std::vector<std::string> &args/
   return true;
 }
 
+bool simple_wallet::set_refresh_pipeline_depth(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  const auto pwd_container = get_and_verify_password();
+  if (pwd_container)
+  {
+    uint32_t depth;
+    if (!epee::string_tools::get_xtype_from_string(depth, args[1]) || depth == 0)
+    {
+      fail_msg_writer() << tr("Invalid depth");
+      return true;
+    }
+    m_wallet->refresh_pipeline_depth(depth);
+    m_wallet->rewrite(m_wallet_file, pwd_container->password());
+  }
+  return true;
+}
+
+bool simple_wallet::set_hashchain_tail(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  const auto pwd_container = get_and_verify_password();
+  if (pwd_container)
+  {
+    uint64_t blocks;
+    if (!epee::string_tools::get_xtype_from_string(blocks, args[1]) || (blocks > 0 && blocks < CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE))
+    {
+      fail_msg_writer() << tr("Invalid number of blocks, must be 0 or at least ") << CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
+      return true;
+    }
+    m_wallet->hashchain_tail(blocks);
+    m_wallet->rewrite(m_wallet_file, pwd_container->password());
+  }
+  return true;
+}
+
 bool simple_wallet::set_ignore_fractional_outputs(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
 {
   const auto pwd_container = get_and_verify_password();
@@ -2248,6 +2282,19 @@ bool simple_wallet::set_ignore_fractional_outputs(const std::vector<std::string>
   return true;
 }
 
+bool simple_wallet::set_parallel_tx_construction(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  const auto pwd_container = get_and_verify_password();
+  if (pwd_container)
+  {
+    parse_bool_and_use(args[1], [&](bool r) {
+      m_wallet->parallel_tx_construction(r);
+      m_wallet->rewrite(m_wallet_file, pwd_container->password());
+    });
+  }
+  return true;
+}
+
 bool simple_wallet::help(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
 {
   if(args.empty())
@@ -2431,7 +2478,13 @@ simple_wallet::simple_wallet()
                                   "  Set the lookahead sizes for the subaddress hash table.\n "
                                   "  Set this if you are not sure whether you will spend on a key reusing Electroneum Classic fork later.\n "
                                   "segregation-height <n>\n "
-                                  "  Set to the height of a key reusing fork you want to use, 0 to use default."));
+                                  "  Set to the height of a key reusing fork you want to use, 0 to use default.\n "
+                                  "refresh-pipeline-depth <n>\n "
+                                  "  Set how many block batches refresh fetches and prepares ahead of scanning.\n "
+                                  "hashchain-tail <n>\n "
+                                  "  Set to keep only the last <n> block hashes in full and a sparse subset of older ones, 0 to keep them all.\n "
+                                  "parallel-tx-construction <1|0>\n "
+                                  "  Set this to pick the inputs of all transactions of a transfer up front and build them in parallel, paying the estimated fee."));
   m_cmd_binder.set_handler("encrypted_seed",
                            boost::bind(&simple_wallet::encrypted_seed, this, _1),
                            tr("Display the encrypted Electrum-style mnemonic seed."));
@@ -2518,8 +2571,8 @@ simple_wallet::simple_wallet()
                            tr("Verify a signature on the contents of a file."));
   m_cmd_binder.set_handler("export_key_images",
                            boost::bind(&simple_wallet::export_key_images, this, _1),
-                           tr("export_key_images <file>"),
-                           tr("Export a signed set of key images to a <file>."));
+                           tr("export_key_images <file> [<start_index>]"),
+                           tr("Export a signed set of key images to a <file>, optionally only for outputs from <start_index> on."));
   m_cmd_binder.set_handler("import_key_images",
                            boost::bind(&simple_wallet::import_key_images, this, _1),
                            tr("import_key_images <file>"),
@@ -2530,8 +2583,8 @@ simple_wallet::simple_wallet()
                            tr("Attempts to reconnect HW wallet."));
   m_cmd_binder.set_handler("export_outputs",
                            boost::bind(&simple_wallet::export_outputs, this, _1),
-                           tr("export_outputs <file>"),
-                           tr("Export a set of outputs owned by this wallet."));
+                           tr("export_outputs <file> [<start_index>]"),
+                           tr("Export a set of outputs owned by this wallet, optionally only from <start_index> on."));
   m_cmd_binder.set_handler("import_outputs",
                            boost::bind(&simple_wallet::import_outputs, this, _1),
                            tr("import_outputs <file>"),
@@ -2658,7 +2711,10 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     const std::pair<size_t, size_t> lookahead = m_wallet->get_subaddress_lookahead();
     success_msg_writer() << "subaddress-lookahead = " << lookahead.first << ":" << lookahead.second;
     success_msg_writer() << "segregation-height = " << m_wallet->segregation_height();
+    success_msg_writer() << "refresh-pipeline-depth = " << m_wallet->refresh_pipeline_depth();
+    success_msg_writer() << "hashchain-tail = " << m_wallet->hashchain_tail();
     success_msg_writer() << "ignore-fractional-outputs = " << m_wallet->ignore_fractional_outputs();
+    success_msg_writer() << "parallel-tx-construction = " << m_wallet->parallel_tx_construction();
     success_msg_writer() << "device_name = " << m_wallet->device_name();
     return true;
   }
@@ -2714,7 +2770,10 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     CHECK_SIMPLE_VARIABLE("key-reuse-mitigation2", set_key_reuse_mitigation2, tr("0 or 1"));
     CHECK_SIMPLE_VARIABLE("subaddress-lookahead", set_subaddress_lookahead, tr("<major>:<minor>"));
     CHECK_SIMPLE_VARIABLE("segregation-height", set_segregation_height, tr("unsigned integer"));
+    CHECK_SIMPLE_VARIABLE("refresh-pipeline-depth", set_refresh_pipeline_depth, tr("unsigned integer"));
+    CHECK_SIMPLE_VARIABLE("hashchain-tail", set_hashchain_tail, tr("unsigned integer"));
     CHECK_SIMPLE_VARIABLE("ignore-fractional-outputs", set_ignore_fractional_outputs, tr("0 or 1"));
+    CHECK_SIMPLE_VARIABLE("parallel-tx-construction", set_parallel_tx_construction, tr("0 or 1"));
   }
   fail_msg_writer() << tr("set: unrecognized argument(s)");
   return true;
@@ -4206,6 +4265,12 @@ void simple_wallet::on_skip_transaction(uint64_t height, const crypto::hash &txi
 {
 }
 //----------------------------------------------------------------------------------------------------
+void simple_wallet::on_sign_tx_progress(size_t signed_count, size_t total)
+{
+  if (total > 1)
+    message_writer() << boost::format(tr("Signed %u/%u transactions")) % signed_count % total;
+}
+//----------------------------------------------------------------------------------------------------
 boost::optional<epee::wipeable_string> simple_wallet::on_get_password(const char *reason)
 {
   // can't ask for password from a background thread
@@ -7012,7 +7077,18 @@ void simple_wallet::wallet_idle_thread()
 
     if (!m_idle_run.load(std::memory_order_relaxed))
       break;
-    m_idle_cond.wait_for(lock, boost::chrono::seconds(90));
+    if (!m_wallet->daemon_events_enabled())
+    {
+      m_idle_cond.wait_for(lock, boost::chrono::seconds(90));
+      continue;
+    }
+    // subscribed to the daemon's events: refresh when one comes in, and
+    // otherwise only every 10 minutes in case some were lost
+    for (int i = 0; i < 600 && m_idle_run.load(std::memory_order_relaxed) && !m_wallet->take_daemon_event(); ++i)
+    {
+      if (m_idle_cond.wait_for(lock, boost::chrono::seconds(1)) == boost::cv_status::no_timeout)
+        break;
+    }
   }
 }
 //----------------------------------------------------------------------------------------------------
@@ -7710,9 +7786,10 @@ bool simple_wallet::export_key_images(const std::vector<std::string> &args)
     fail_msg_writer() << tr("command not supported by HW wallet");
     return true;
   }
-  if (args.size() != 1)
+  size_t start_index = 0;
+  if (args.size() < 1 || args.size() > 2 || (args.size() == 2 && !epee::string_tools::get_xtype_from_string(start_index, args[1])))
   {
-    fail_msg_writer() << tr("usage: export_key_images <filename>");
+    fail_msg_writer() << tr("usage: export_key_images <filename> [<start_index>]");
     return true;
   }
   if (m_wallet->watch_only())
@@ -7728,7 +7805,7 @@ bool simple_wallet::export_key_images(const std::vector<std::string> &args)
 
   try
   {
-    if (!m_wallet->export_key_images(filename))
+    if (!m_wallet->export_key_images(filename, start_index))
     {
       fail_msg_writer() << tr("failed to save file ") << filename;
       return true;
@@ -7819,9 +7896,10 @@ bool simple_wallet::export_outputs(const std::vector<std::string> &args)
     fail_msg_writer() << tr("command not supported by HW wallet");
     return true;
   }
-  if (args.size() != 1)
+  size_t start_index = 0;
+  if (args.size() < 1 || args.size() > 2 || (args.size() == 2 && !epee::string_tools::get_xtype_from_string(start_index, args[1])))
   {
-    fail_msg_writer() << tr("usage: export_outputs <filename>");
+    fail_msg_writer() << tr("usage: export_outputs <filename> [<start_index>]");
     return true;
   }
 
@@ -7832,7 +7910,7 @@ bool simple_wallet::export_outputs(const std::vector<std::string> &args)
 
   try
   {
-    std::string data = m_wallet->export_outputs_to_str();
+    std::string data = m_wallet->export_outputs_to_str(start_index);
     bool r = epee::file_io_utils::save_string_to_file(filename, data);
     if (!r)
     {
@@ -28,6 +28,7 @@
 
 #include "subaddress.h"
 #include "wallet.h"
+#include "transaction_history.h"
 #include "crypto/hash.h"
 #include "wallet/wallet2.h"
 #include "common_defines.h"
@@ -52,6 +53,7 @@ void SubaddressImpl::setLabel(uint32_t accountIndex, uint32_t addressIndex, cons
   try
   {
     m_wallet->m_wallet->set_subaddress_label({accountIndex, addressIndex}, label);
+    m_wallet->m_history->invalidate();
     refresh(accountIndex);
   }
   catch (const std::exception& e)
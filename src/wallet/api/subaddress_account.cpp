@@ -28,6 +28,7 @@
 
 #include "subaddress_account.h"
 #include "wallet.h"
+#include "transaction_history.h"
 #include "crypto/hash.h"
 #include "wallet/wallet2.h"
 #include "common_defines.h"
@@ -50,6 +51,7 @@ void SubaddressAccountImpl::addRow(const std::string &label)
 void SubaddressAccountImpl::setLabel(uint32_t accountIndex, const std::string &label)
 {
   m_wallet->m_wallet->set_subaddress_label({accountIndex, 0}, label);
+  m_wallet->m_history->invalidate();
   refresh();
 }
 
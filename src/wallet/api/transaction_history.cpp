@@ -38,6 +38,7 @@
 #include "wallet/wallet2.h"
 
 
+#include <algorithm>
 #include <string>
 #include <list>
 
@@ -49,7 +50,12 @@ TransactionHistory::~TransactionHistory() {}
 
 
 TransactionHistoryImpl::TransactionHistoryImpl(WalletImpl *wallet)
-    : m_wallet(wallet)
+    : m_confirmedCount(0)
+    , m_scannedHeight(0)
+    , m_dirtyHeight((uint64_t)-1)
+    , m_invalidated(false)
+    , m_walletHeight(0)
+    , m_wallet(wallet)
 {
 
 }
@@ -93,6 +99,26 @@ std::vector<TransactionInfo *> TransactionHistoryImpl::getAll() const
     return m_history;
 }
 
+std::vector<TransactionInfo *> TransactionHistoryImpl::getRange(int offset, int count) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(m_historyMutex);
+    if (offset < 0 || count <= 0 || static_cast<size_t>(offset) >= m_history.size())
+        return {};
+    const size_t end = std::min(m_history.size(), static_cast<size_t>(offset) + count);
+    return std::vector<TransactionInfo *>(m_history.begin() + offset, m_history.begin() + end);
+}
+
+void TransactionHistoryImpl::onChanged(uint64_t height)
+{
+    uint64_t current = m_dirtyHeight.load();
+    while (height < current && !m_dirtyHeight.compare_exchange_weak(current, height));
+}
+
+void TransactionHistoryImpl::invalidate()
+{
+    m_invalidated = true;
+}
+
 void TransactionHistoryImpl::refresh()
 {
     // multithreaded access:
@@ -100,20 +126,52 @@ void TransactionHistoryImpl::refresh()
     // for "write" access, locking exclusively
     boost::unique_lock<boost::shared_mutex> lock(m_historyMutex);
 
-    // TODO: configurable values;
-    uint64_t min_height = 0;
-    uint64_t max_height = (uint64_t)-1;
     uint64_t wallet_height = m_wallet->blockChainHeight();
 
-    // delete old transactions;
-    for (auto t : m_history)
-        delete t;
-    m_history.clear();
-
     // transactions are stored in wallet2:
     // - confirmed_transfer_details   - out transfers
     // - unconfirmed_transfer_details - pending out transfers
     // - payment_details              - input transfers
+    //
+    // confirmed entries are kept across refreshes: only those at or above the
+    // lowest height wallet2 reported a change for (new, confirmed or detached
+    // entries) are dropped and read again, along with the ones in the last
+    // scanned block, which may have been read while wallet2 was processing it.
+    // Light wallets replace their containers wholesale, and a wallet height
+    // going backwards means wallet2 was cleared, so both start from scratch.
+    uint64_t from = std::min(m_dirtyHeight.exchange((uint64_t)-1), m_scannedHeight);
+    if (m_invalidated.exchange(false) || m_wallet->m_wallet->light_wallet() || wallet_height < m_scannedHeight)
+        from = 0;
+
+    // pending entries are few, and change state without any callback: always redone
+    for (size_t i = m_confirmedCount; i < m_history.size(); ++i)
+        delete m_history[i];
+    m_history.resize(m_confirmedCount);
+
+    dropConfirmedFrom(from);
+    addConfirmedFrom(from);
+    m_confirmedCount = m_history.size();
+    addPending();
+
+    m_scannedHeight = wallet_height;
+    m_walletHeight = wallet_height;
+}
+
+void TransactionHistoryImpl::dropConfirmedFrom(uint64_t height)
+{
+    while (!m_history.empty() && m_history.back()->blockHeight() >= height)
+    {
+        delete m_history.back();
+        m_history.pop_back();
+    }
+}
+
+void TransactionHistoryImpl::addConfirmedFrom(uint64_t height)
+{
+    // get_payments returns entries strictly above min_height
+    uint64_t min_height = height ? height - 1 : 0;
+    uint64_t max_height = (uint64_t)-1;
+    const size_t first = m_history.size();
 
     // payments are "input transactions";
     // one input transaction contains only one transfer. e.g. <transaction_id> - <100XMR>
@@ -135,7 +193,7 @@ void TransactionHistoryImpl::refresh()
         ti->m_subaddrAccount = pd.m_subaddr_index.major;
         ti->m_label     = m_wallet->m_wallet->get_subaddress_label(pd.m_subaddr_index);
         ti->m_timestamp = pd.m_timestamp;
-        ti->m_confirmations = (wallet_height > pd.m_block_height) ? wallet_height - pd.m_block_height : 0;
+        ti->m_walletHeight = &m_walletHeight;
         ti->m_unlock_time = pd.m_unlock_time;
         m_history.push_back(ti);
 
@@ -178,7 +236,7 @@ void TransactionHistoryImpl::refresh()
         ti->m_subaddrAccount = pd.m_subaddr_account;
         ti->m_label = pd.m_subaddr_indices.size() == 1 ? m_wallet->m_wallet->get_subaddress_label({pd.m_subaddr_account, *pd.m_subaddr_indices.begin()}) : "";
         ti->m_timestamp = pd.m_timestamp;
-        ti->m_confirmations = (wallet_height > pd.m_block_height) ? wallet_height - pd.m_block_height : 0;
+        ti->m_walletHeight = &m_walletHeight;
 
         // single output transaction might contain multiple transfers
         for (const auto &d: pd.m_dests) {
@@ -187,6 +245,14 @@ void TransactionHistoryImpl::refresh()
         m_history.push_back(ti);
     }
 
+    // keep confirmed entries ordered by height, so a detach only drops a tail
+    std::stable_sort(m_history.begin() + first, m_history.end(), [](const TransactionInfo *a, const TransactionInfo *b) {
+        return a->blockHeight() < b->blockHeight();
+    });
+}
+
+void TransactionHistoryImpl::addPending()
+{
     // unconfirmed output transactions
     std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>> upayments_out;
     m_wallet->m_wallet->get_unconfirmed_payments_out(upayments_out);
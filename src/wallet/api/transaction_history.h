@@ -31,6 +31,7 @@
 
 #include "wallet/api/wallet2_api.h"
 #include <boost/thread/shared_mutex.hpp>
+#include <atomic>
 
 namespace Monero {
 
@@ -45,12 +46,31 @@ public:
     virtual TransactionInfo * transaction(int index)  const;
     virtual TransactionInfo * transaction(const std::string &id) const;
     virtual std::vector<TransactionInfo*> getAll() const;
+    virtual std::vector<TransactionInfo*> getRange(int offset, int count) const;
     virtual void refresh();
 
+    // called from the wallet2 callbacks: entries at or above height were
+    // added, confirmed or detached
+    void onChanged(uint64_t height);
+    // forces the next refresh to rebuild everything (e.g. labels changed)
+    void invalidate();
+
 private:
+    void dropConfirmedFrom(uint64_t height);
+    void addConfirmedFrom(uint64_t height);
+    void addPending();
 
     // TransactionHistory is responsible of memory management
+    // confirmed entries, sorted by block height, followed by the pending ones
     std::vector<TransactionInfo*> m_history;
+    size_t m_confirmedCount;
+    // entries below this height are in m_history
+    uint64_t m_scannedHeight;
+    // lowest height touched by wallet2 since the last refresh, -1 if none
+    std::atomic<uint64_t> m_dirtyHeight;
+    std::atomic<bool> m_invalidated;
+    // wallet height at the last refresh, confirmations are derived from it
+    std::atomic<uint64_t> m_walletHeight;
     WalletImpl *m_wallet;
     mutable boost::shared_mutex   m_historyMutex;
 };
@@ -53,6 +53,7 @@ TransactionInfoImpl::TransactionInfoImpl()
       , m_timestamp(0)
       , m_confirmations(0)
       , m_unlock_time(0)
+      , m_walletHeight(nullptr)
 {
 
 }
@@ -131,7 +132,10 @@ const std::vector<TransactionInfo::Transfer> &TransactionInfoImpl::transfers() c
 
 uint64_t TransactionInfoImpl::confirmations() const
 {
-    return m_confirmations;
+    if (!m_walletHeight)
+        return m_confirmations;
+    const uint64_t height = m_walletHeight->load(std::memory_order_relaxed);
+    return height > m_blockheight ? height - m_blockheight : 0;
 }
 
 uint64_t TransactionInfoImpl::unlockTime() const
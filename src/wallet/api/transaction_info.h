@@ -32,6 +32,7 @@
 #include "wallet/api/wallet2_api.h"
 #include <string>
 #include <ctime>
+#include <atomic>
 
 namespace Monero {
 
@@ -78,6 +79,8 @@ private:
     std::vector<Transfer> m_transfers;
     uint64_t    m_confirmations;
     uint64_t    m_unlock_time;
+    // set for confirmed entries owned by a history, so confirmations follow the chain
+    const std::atomic<uint64_t> *m_walletHeight;
 
     friend class TransactionHistoryImpl;
 
@@ -37,6 +37,7 @@
 #include "address_book.h"
 #include "subaddress.h"
 #include "subaddress_account.h"
+#include "wallet_executor.h"
 #include "common_defines.h"
 #include "common/util.h"
 
@@ -146,6 +147,41 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
     }
 
     virtual void on_new_block(uint64_t height, const cryptonote::block& block)
+    {
+        newBlock(height);
+    }
+
+    virtual void on_money_received(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
+    {
+        moneyReceived(height, txid, amount, subaddr_index);
+    }
+
+    virtual void on_unconfirmed_money_received(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
+    {
+        unconfirmedMoneyReceived(height, txid, amount, subaddr_index);
+    }
+
+    virtual void on_money_spent(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& in_tx,
+                                uint64_t amount, const cryptonote::transaction& spend_tx, const cryptonote::subaddress_index& subaddr_index)
+    {
+        moneySpent(height, txid, amount, subaddr_index);
+    }
+
+    virtual void on_events(const std::vector<tools::wallet_event> &events)
+    {
+        for (const tools::wallet_event &e: events)
+        {
+            switch (e.type)
+            {
+            case tools::wallet_event::new_block: newBlock(e.height); break;
+            case tools::wallet_event::money_received: moneyReceived(e.height, e.id, e.amount, e.subaddr_index); break;
+            case tools::wallet_event::unconfirmed_money_received: unconfirmedMoneyReceived(e.height, e.id, e.amount, e.subaddr_index); break;
+            case tools::wallet_event::money_spent: moneySpent(e.height, e.id, e.amount, e.subaddr_index); break;
+            }
+        }
+    }
+
+    void newBlock(uint64_t height)
     {
         // Don't flood the GUI with signals. On fast refresh - send signal every 1000th block
         // get_refresh_from_block_height() returns the blockheight from when the wallet was 
@@ -158,7 +194,7 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
         }
     }
 
-    virtual void on_money_received(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
+    void moneyReceived(uint64_t height, const crypto::hash &txid, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
     {
 
         std::string tx_hash =  epee::string_tools::pod_to_hex(txid);
@@ -167,6 +203,8 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
                      << ", tx: " << tx_hash
                      << ", amount: " << print_money(amount)
                      << ", idx: " << subaddr_index);
+        if (m_wallet->m_history)
+            m_wallet->m_history->onChanged(height);
         // do not signal on received tx if wallet is not syncronized completely
         if (m_listener && m_wallet->synchronized()) {
             m_listener->moneyReceived(tx_hash, amount);
@@ -174,7 +212,7 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
         }
     }
 
-    virtual void on_unconfirmed_money_received(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
+    void unconfirmedMoneyReceived(uint64_t height, const crypto::hash &txid, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
     {
 
         std::string tx_hash =  epee::string_tools::pod_to_hex(txid);
@@ -190,8 +228,7 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
         }
     }
 
-    virtual void on_money_spent(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& in_tx,
-                                uint64_t amount, const cryptonote::transaction& spend_tx, const cryptonote::subaddress_index& subaddr_index)
+    void moneySpent(uint64_t height, const crypto::hash &txid, uint64_t amount, const cryptonote::subaddress_index& subaddr_index)
     {
         // TODO;
         std::string tx_hash = epee::string_tools::pod_to_hex(txid);
@@ -199,6 +236,8 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
                      << ", tx: " << tx_hash
                      << ", amount: " << print_money(amount)
                      << ", idx: " << subaddr_index);
+        if (m_wallet->m_history)
+            m_wallet->m_history->onChanged(height);
         // do not signal on sent tx if wallet is not syncronized completely
         if (m_listener && m_wallet->synchronized()) {
             m_listener->moneySpent(tx_hash, amount);
@@ -211,6 +250,13 @@ struct Wallet2CallbackImpl : public tools::i_wallet2_callback
         // TODO;
     }
 
+    virtual void on_reorg(uint64_t height)
+    {
+        LOG_PRINT_L3(__FUNCTION__ << ": reorg. height: " << height);
+        if (m_wallet->m_history)
+            m_wallet->m_history->onChanged(height);
+    }
+
     // Light wallet callbacks
     virtual void on_lw_new_block(uint64_t height)
     {
@@ -377,6 +423,10 @@ WalletImpl::WalletImpl(NetworkType nettype, uint64_t kdf_rounds)
     :m_wallet(nullptr)
     , m_status(Wallet::Status_Ok)
     , m_wallet2Callback(nullptr)
+    , m_refreshTimer(WalletExecutor::instance().ioService())
+    , m_asyncPending(0)
+    , m_refreshRunning(false)
+    , m_refreshWake(false)
     , m_recoveringFromSeed(false)
     , m_recoveringFromDevice(false)
     , m_synchronized(false)
@@ -387,7 +437,7 @@ WalletImpl::WalletImpl(NetworkType nettype, uint64_t kdf_rounds)
     m_history.reset(new TransactionHistoryImpl(this));
     m_wallet2Callback.reset(new Wallet2CallbackImpl(this));
     m_wallet->callback(m_wallet2Callback.get());
-    m_refreshThreadDone = false;
+    m_refreshStopped = false;
     m_refreshEnabled = false;
     m_addressBook.reset(new AddressBookImpl(this));
     m_subaddress.reset(new SubaddressImpl(this));
@@ -396,10 +446,8 @@ WalletImpl::WalletImpl(NetworkType nettype, uint64_t kdf_rounds)
 
     m_refreshIntervalMillis = DEFAULT_REFRESH_INTERVAL_MILLIS;
 
-    m_refreshThread = boost::thread([this] () {
-        this->refreshThreadFunc();
-    });
-
+    boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+    armRefreshTimer(m_refreshIntervalMillis);
 }
 
 WalletImpl::~WalletImpl()
@@ -407,12 +455,12 @@ WalletImpl::~WalletImpl()
 
     LOG_PRINT_L1(__FUNCTION__);
     m_wallet->callback(NULL);
-    // Pause refresh thread - prevents refresh from starting again
+    // Pause refresh - prevents refresh from starting again
     pauseRefresh();
-    // Close wallet - stores cache and stops ongoing refresh operation 
-    close(false); // do not store wallet as part of the closing activities
-    // Stop refresh thread
+    // Stop refresh - stops ongoing refresh operation, and waits for the executor to be done with the wallet
     stopRefresh();
+    // Close wallet - stores cache
+    close(false); // do not store wallet as part of the closing activities
     LOG_PRINT_L1(__FUNCTION__ << " finished");
 }
 
@@ -852,6 +900,11 @@ bool WalletImpl::store(const std::string &path)
     return true;
 }
 
+std::future<bool> WalletImpl::storeFuture(const std::string &path)
+{
+    return runAsync<bool>([this, path]() { return store(path); });
+}
+
 string WalletImpl::filename() const
 {
     return m_wallet->get_wallet_file();
@@ -921,6 +974,12 @@ void WalletImpl::setSubaddressLookahead(uint32_t major, uint32_t minor)
     m_wallet->set_subaddress_lookahead(major, minor);
 }
 
+void WalletImpl::setSharedScanning(const std::shared_ptr<tools::wallet2::shared_block_cache> &cache, const std::shared_ptr<tools::scan_group> &group)
+{
+    m_wallet->set_shared_block_cache(cache);
+    m_wallet->set_scan_group(group);
+}
+
 uint64_t WalletImpl::balance(uint32_t accountIndex) const
 {
     return m_wallet->balance(accountIndex);
@@ -1009,7 +1068,12 @@ void WalletImpl::refreshAsync()
 {
     LOG_PRINT_L3(__FUNCTION__ << ": Refreshing asynchronously..");
     clearStatus();
-    m_refreshCV.notify_one();
+    wakeRefresh();
+}
+
+std::future<bool> WalletImpl::refreshFuture()
+{
+    return runAsync<bool>([this]() { return refresh(); });
 }
 
 void WalletImpl::setAutoRefreshInterval(int millis)
@@ -1135,7 +1199,7 @@ std::string WalletImpl::getSubaddressLabel(uint32_t accountIndex, uint32_t addre
     }
     catch (const std::exception &e)
     {
-        LOG_ERROR("Error getting subaddress label: ") << e.what();
+        LOG_ERROR("Error getting subaddress label: " << e.what());
         setStatusError(string(tr("Failed to get subaddress label: ")) + e.what());
         return "";
     }
@@ -1144,11 +1208,12 @@ void WalletImpl::setSubaddressLabel(uint32_t accountIndex, uint32_t addressIndex
 {
     try
     {
-        return m_wallet->set_subaddress_label({accountIndex, addressIndex}, label);
+        m_wallet->set_subaddress_label({accountIndex, addressIndex}, label);
+        m_history->invalidate();
     }
     catch (const std::exception &e)
     {
-        LOG_ERROR("Error setting subaddress label: ") << e.what();
+        LOG_ERROR("Error setting subaddress label: " << e.what());
         setStatusError(string(tr("Failed to set subaddress label: ")) + e.what());
     }
 }
@@ -1165,7 +1230,7 @@ string WalletImpl::getMultisigInfo() const {
         clearStatus();
         return m_wallet->get_multisig_info();
     } catch (const exception& e) {
-        LOG_ERROR("Error on generating multisig info: ") << e.what();
+        LOG_ERROR("Error on generating multisig info: " << e.what());
         setStatusError(string(tr("Failed to get multisig info: ")) + e.what());
     }
 
@@ -1182,7 +1247,7 @@ string WalletImpl::makeMultisig(const vector<string>& info, uint32_t threshold)
 
         return m_wallet->make_multisig(epee::wipeable_string(m_password), info, threshold);
     } catch (const exception& e) {
-        LOG_ERROR("Error on making multisig wallet: ") << e.what();
+        LOG_ERROR("Error on making multisig wallet: " << e.what());
         setStatusError(string(tr("Failed to make multisig: ")) + e.what());
     }
 
@@ -1196,7 +1261,7 @@ std::string WalletImpl::exchangeMultisigKeys(const std::vector<std::string> &inf
 
         return m_wallet->exchange_multisig_keys(epee::wipeable_string(m_password), info);
     } catch (const exception& e) {
-        LOG_ERROR("Error on exchanging multisig keys: ") << e.what();
+        LOG_ERROR("Error on exchanging multisig keys: " << e.what());
         setStatusError(string(tr("Failed to make multisig: ")) + e.what());
     }
 
@@ -1214,7 +1279,7 @@ bool WalletImpl::finalizeMultisig(const vector<string>& extraMultisigInfo) {
 
         setStatusError(tr("Failed to finalize multisig wallet creation"));
     } catch (const exception& e) {
-        LOG_ERROR("Error on finalizing multisig wallet creation: ") << e.what();
+        LOG_ERROR("Error on finalizing multisig wallet creation: " << e.what());
         setStatusError(string(tr("Failed to finalize multisig wallet creation: ")) + e.what());
     }
 
@@ -1230,7 +1295,7 @@ bool WalletImpl::exportMultisigImages(string& images) {
         images = epee::string_tools::buff_to_hex_nodelimer(blob);
         return true;
     } catch (const exception& e) {
-        LOG_ERROR("Error on exporting multisig images: ") << e.what();
+        LOG_ERROR("Error on exporting multisig images: " << e.what());
         setStatusError(string(tr("Failed to export multisig images: ")) + e.what());
     }
 
@@ -1258,7 +1323,7 @@ size_t WalletImpl::importMultisigImages(const vector<string>& images) {
 
         return m_wallet->import_multisig(blobs);
     } catch (const exception& e) {
-        LOG_ERROR("Error on importing multisig images: ") << e.what();
+        LOG_ERROR("Error on importing multisig images: " << e.what());
         setStatusError(string(tr("Failed to import multisig images: ")) + e.what());
     }
 
@@ -1272,7 +1337,7 @@ bool WalletImpl::hasMultisigPartialKeyImages() const {
 
         return m_wallet->has_multisig_partial_key_images();
     } catch (const exception& e) {
-        LOG_ERROR("Error on checking for partial multisig key images: ") << e.what();
+        LOG_ERROR("Error on checking for partial multisig key images: " << e.what());
         setStatusError(string(tr("Failed to check for partial multisig key images: ")) + e.what());
     }
 
@@ -1300,7 +1365,7 @@ PendingTransaction* WalletImpl::restoreMultisigTransaction(const string& signDat
 
         return ptx;
     } catch (exception& e) {
-        LOG_ERROR("Error on restoring multisig transaction: ") << e.what();
+        LOG_ERROR("Error on restoring multisig transaction: " << e.what());
         setStatusError(string(tr("Failed to restore multisig transaction: ")) + e.what());
     }
 
@@ -1478,6 +1543,14 @@ PendingTransaction *WalletImpl::createTransaction(const string &dst_addr, const
     return transaction;
 }
 
+std::future<PendingTransaction *> WalletImpl::createTransactionFuture(const string &dst_addr, const string &payment_id, optional<uint64_t> amount, uint32_t mixin_count,
+                                                                     PendingTransaction::Priority priority, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices)
+{
+    return runAsync<PendingTransaction *>([=]() {
+        return createTransaction(dst_addr, payment_id, amount, mixin_count, priority, subaddr_account, subaddr_indices);
+    });
+}
+
 PendingTransaction *WalletImpl::createSweepUnmixableTransaction()
 
 {
@@ -1570,6 +1643,11 @@ TransactionHistory *WalletImpl::history()
     return m_history.get();
 }
 
+std::future<void> WalletImpl::refreshHistoryFuture()
+{
+    return runAsync<void>([this]() { m_history->refresh(); });
+}
+
 AddressBook *WalletImpl::addressBook()
 {
     return m_addressBook.get();
@@ -1591,6 +1669,13 @@ void WalletImpl::setListener(WalletListener *l)
     m_wallet2Callback->setListener(l);
 }
 
+void WalletImpl::setBatchedListenerEvents(bool batched)
+{
+    // not while a refresh is producing events
+    boost::lock_guard<boost::mutex> guarg(m_refreshMutex2);
+    m_wallet->batch_callbacks(batched);
+}
+
 uint32_t WalletImpl::defaultMixin() const
 {
     return m_wallet->default_mixin();
@@ -1963,34 +2048,80 @@ void WalletImpl::setStatus(int status, const std::string& message) const
     m_errorString = message;
 }
 
-void WalletImpl::refreshThreadFunc()
+// m_asyncMutex must be held
+void WalletImpl::armRefreshTimer(int millis)
 {
-    LOG_PRINT_L3(__FUNCTION__ << ": starting refresh thread");
+    // if auto refresh enabled, we wait for the "m_refreshIntervalMillis" interval.
+    // if not - we wait until woken
+    if (millis <= 0) {
+        m_refreshTimer.cancel();
+        return;
+    }
+    // cancels the wait already set, if any
+    m_refreshTimer.expires_from_now(boost::posix_time::milliseconds(millis));
+    ++m_asyncPending;
+    m_refreshTimer.async_wait([this](const boost::system::error_code &e) { onRefreshTimer(e); });
+}
 
-    while (true) {
-        boost::mutex::scoped_lock lock(m_refreshMutex);
-        if (m_refreshThreadDone) {
-            break;
-        }
-        LOG_PRINT_L3(__FUNCTION__ << ": waiting for refresh...");
-        // if auto refresh enabled, we wait for the "m_refreshIntervalSeconds" interval.
-        // if not - we wait forever
-        if (m_refreshIntervalMillis > 0) {
-            boost::posix_time::milliseconds wait_for_ms(m_refreshIntervalMillis.load());
-            m_refreshCV.timed_wait(lock, wait_for_ms);
-        } else {
-            m_refreshCV.wait(lock);
+void WalletImpl::onRefreshTimer(const boost::system::error_code &e)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+        if (e == boost::asio::error::operation_aborted || m_refreshStopped) {
+            --m_asyncPending;
+            m_asyncCV.notify_all();
+            return;
         }
+        m_refreshRunning = true;
+        m_refreshWake = false;
+    }
 
-        LOG_PRINT_L3(__FUNCTION__ << ": refresh lock acquired...");
-        LOG_PRINT_L3(__FUNCTION__ << ": m_refreshEnabled: " << m_refreshEnabled);
-        LOG_PRINT_L3(__FUNCTION__ << ": m_status: " << status());
-        if (m_refreshEnabled) {
-            LOG_PRINT_L3(__FUNCTION__ << ": refreshing...");
-            doRefresh();
-        }
+    LOG_PRINT_L3(__FUNCTION__ << ": m_refreshEnabled: " << m_refreshEnabled);
+    LOG_PRINT_L3(__FUNCTION__ << ": m_status: " << status());
+    if (m_refreshEnabled) {
+        LOG_PRINT_L3(__FUNCTION__ << ": refreshing...");
+        doRefresh();
+    }
+
+    boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+    m_refreshRunning = false;
+    if (!m_refreshStopped)
+        armRefreshTimer(m_refreshWake ? 1 : m_refreshIntervalMillis.load());
+    --m_asyncPending;
+    m_asyncCV.notify_all();
+}
+
+void WalletImpl::wakeRefresh()
+{
+    boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+    if (m_refreshStopped)
+        return;
+    // a refresh running now may have missed what it is woken for
+    if (m_refreshRunning)
+        m_refreshWake = true;
+    else
+        armRefreshTimer(1);
+}
+
+// the task is dropped if the wallet is closing before it runs, and its
+// future then throws a broken_promise future_error
+template<typename T>
+std::future<T> WalletImpl::runAsync(std::function<T()> f)
+{
+    std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(std::move(f));
+    std::future<T> future = task->get_future();
+    {
+        boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+        ++m_asyncPending;
     }
-    LOG_PRINT_L3(__FUNCTION__ << ": refresh thread stopped");
+    WalletExecutor::instance().post([this, task]() {
+        if (!m_refreshStopped)
+            (*task)();
+        boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+        --m_asyncPending;
+        m_asyncCV.notify_all();
+    });
+    return future;
 }
 
 void WalletImpl::doRefresh()
@@ -2029,7 +2160,7 @@ void WalletImpl::startRefresh()
     if (!m_refreshEnabled) {
         LOG_PRINT_L2(__FUNCTION__ << ": refresh started/resumed...");
         m_refreshEnabled = true;
-        m_refreshCV.notify_one();
+        wakeRefresh();
     }
 }
 
@@ -2037,19 +2168,23 @@ void WalletImpl::startRefresh()
 
 void WalletImpl::stopRefresh()
 {
-    if (!m_refreshThreadDone) {
+    boost::unique_lock<boost::mutex> lock(m_asyncMutex);
+    if (!m_refreshStopped) {
         m_refreshEnabled = false;
-        m_refreshThreadDone = true;
-        m_refreshCV.notify_one();
-        m_refreshThread.join();
+        m_refreshStopped = true;
+        m_refreshTimer.cancel();
+        // cuts short a refresh the executor is running for this wallet
+        m_wallet->stop();
     }
+    while (m_asyncPending > 0)
+        m_asyncCV.wait(lock);
 }
 
 void WalletImpl::pauseRefresh()
 {
     LOG_PRINT_L2(__FUNCTION__ << ": refresh paused...");
     // TODO synchronize access
-    if (!m_refreshThreadDone) {
+    if (!m_refreshStopped) {
         m_refreshEnabled = false;
     }
 }
@@ -36,6 +36,7 @@
 #include "wallet/wallet2.h"
 
 #include <string>
+#include <boost/asio/deadline_timer.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <boost/thread/condition_variable.hpp>
@@ -99,6 +100,7 @@ public:
     std::string publicMultisigSignerKey() const override;
     std::string path() const override;
     bool store(const std::string &path) override;
+    std::future<bool> storeFuture(const std::string &path) override;
     std::string filename() const override;
     std::string keysFilename() const override;
     bool init(const std::string &daemon_address, uint64_t upper_transaction_size_limit = 0, const std::string &daemon_username = "", const std::string &daemon_password = "", bool use_ssl = false, bool lightWallet = false) override;
@@ -115,6 +117,7 @@ public:
     bool synchronized() const override;
     bool refresh() override;
     void refreshAsync() override;
+    std::future<bool> refreshFuture() override;
     void setAutoRefreshInterval(int millis) override;
     int autoRefreshInterval() const override;
     void setRefreshFromBlockHeight(uint64_t refresh_from_block_height) override;
@@ -150,6 +153,11 @@ public:
                                         PendingTransaction::Priority priority = PendingTransaction::Priority_Low,
                                         uint32_t subaddr_account = 0,
                                         std::set<uint32_t> subaddr_indices = {}) override;
+    std::future<PendingTransaction *> createTransactionFuture(const std::string &dst_addr, const std::string &payment_id,
+                                                              optional<uint64_t> amount, uint32_t mixin_count,
+                                                              PendingTransaction::Priority priority = PendingTransaction::Priority_Low,
+                                                              uint32_t subaddr_account = 0,
+                                                              std::set<uint32_t> subaddr_indices = {}) override;
     virtual PendingTransaction * createSweepUnmixableTransaction() override;
     bool submitTransaction(const std::string &fileName) override;
     virtual UnsignedTransaction * loadUnsignedTx(const std::string &unsigned_filename) override;
@@ -158,10 +166,12 @@ public:
 
     virtual void disposeTransaction(PendingTransaction * t) override;
     virtual TransactionHistory * history() override;
+    std::future<void> refreshHistoryFuture() override;
     virtual AddressBook * addressBook() override;
     virtual Subaddress * subaddress() override;
     virtual SubaddressAccount * subaddressAccount() override;
     virtual void setListener(WalletListener * l) override;
+    virtual void setBatchedListenerEvents(bool batched) override;
     virtual uint32_t defaultMixin() const override;
     virtual void setDefaultMixin(uint32_t arg) override;
     virtual bool setUserNote(const std::string &txid, const std::string &note) override;
@@ -196,14 +206,19 @@ public:
     virtual bool lockKeysFile() override;
     virtual bool unlockKeysFile() override;
     virtual bool isKeysFileLocked() override;
+    // see WalletManager::setSharedScanning
+    void setSharedScanning(const std::shared_ptr<tools::wallet2::shared_block_cache> &cache, const std::shared_ptr<tools::scan_group> &group);
 
 private:
     void clearStatus() const;
     void setStatusError(const std::string& message) const;
     void setStatusCritical(const std::string& message) const;
     void setStatus(int status, const std::string& message) const;
-    void refreshThreadFunc();
+    void armRefreshTimer(int millis);
+    void onRefreshTimer(const boost::system::error_code &e);
+    void wakeRefresh();
     void doRefresh();
+    template<typename T> std::future<T> runAsync(std::function<T()> f);
     bool daemonSynced() const;
     void stopRefresh();
     bool isNewWallet() const;
@@ -231,15 +246,21 @@ private:
 
     // multi-threaded refresh stuff
     std::atomic<bool> m_refreshEnabled;
-    std::atomic<bool> m_refreshThreadDone;
+    std::atomic<bool> m_refreshStopped;
     std::atomic<int>  m_refreshIntervalMillis;
-    // synchronizing  refresh loop;
-    boost::mutex        m_refreshMutex;
 
     // synchronizing  sync and async refresh
     boost::mutex        m_refreshMutex2;
-    boost::condition_variable m_refreshCV;
-    boost::thread       m_refreshThread;
+    // automatic refresh runs on the WalletExecutor when the timer expires
+    boost::asio::deadline_timer m_refreshTimer;
+    // guards the timer, and counts the timer waits and tasks on the executor
+    // which are not done with this wallet yet
+    boost::mutex        m_asyncMutex;
+    boost::condition_variable m_asyncCV;
+    unsigned            m_asyncPending;
+    bool                m_refreshRunning;
+    // refresh asked for while one was running
+    bool                m_refreshWake;
     // flag indicating wallet is recovering from seed
     // so it shouldn't be considered as new and pull blocks (slow-refresh)
     // instead of pulling hashes (fast-refresh)
@@ -37,6 +37,7 @@
 #include <list>
 #include <set>
 #include <ctime>
+#include <future>
 #include <iostream>
 
 //  Public interface for libwallet library
@@ -207,6 +208,9 @@ struct TransactionHistory
     virtual TransactionInfo * transaction(int index)  const = 0;
     virtual TransactionInfo * transaction(const std::string &id) const = 0;
     virtual std::vector<TransactionInfo*> getAll() const = 0;
+    //! up to count transactions starting at offset, in the same order as getAll
+    virtual std::vector<TransactionInfo*> getRange(int offset, int count) const = 0;
+    //! picks up entries added, confirmed or detached since the last refresh
     virtual void refresh() = 0;
 };
 
@@ -461,6 +465,12 @@ struct Wallet
      * \return
      */
     virtual bool store(const std::string &path) = 0;
+    /*!
+     * \brief storeFuture - stores wallet to file on the wallet executor, see WalletManagerFactory::setExecutorThreads
+     * \param path - as for store
+     * \return     - a future set to what store returns
+     */
+    virtual std::future<bool> storeFuture(const std::string &path) = 0;
     /*!
      * \brief filename - returns wallet filename
      * \return
@@ -644,6 +654,13 @@ struct Wallet
      */
     virtual void refreshAsync() = 0;
 
+    /**
+     * @brief refreshFuture - refreshes the wallet on the wallet executor, shared by all the
+     *                        wallets of the process, see WalletManagerFactory::setExecutorThreads
+     * @return - a future set to true if refreshed successfully
+     */
+    virtual std::future<bool> refreshFuture() = 0;
+
     /**
      * @brief setAutoRefreshInterval - setup interval for automatic refresh.
      * @param seconds - interval in millis. if zero or less than zero - automatic refresh disabled;
@@ -762,6 +779,16 @@ struct Wallet
                                                    uint32_t subaddr_account = 0,
                                                    std::set<uint32_t> subaddr_indices = {}) = 0;
 
+    /*!
+     * \brief createTransactionFuture creates transaction on the wallet executor, as createTransaction does
+     * \return                  a future set to the PendingTransaction object, which the caller is responsible for
+     */
+    virtual std::future<PendingTransaction *> createTransactionFuture(const std::string &dst_addr, const std::string &payment_id,
+                                                                      optional<uint64_t> amount, uint32_t mixin_count,
+                                                                      PendingTransaction::Priority = PendingTransaction::Priority_Low,
+                                                                      uint32_t subaddr_account = 0,
+                                                                      std::set<uint32_t> subaddr_indices = {}) = 0;
+
     /*!
      * \brief createSweepUnmixableTransaction creates transaction with unmixable outputs.
      * \return                  PendingTransaction object. caller is responsible to check PendingTransaction::status()
@@ -806,10 +833,20 @@ struct Wallet
 
 
     virtual TransactionHistory * history() = 0;
+    //! refreshes history() on the wallet executor
+    virtual std::future<void> refreshHistoryFuture() = 0;
     virtual AddressBook * addressBook() = 0;
     virtual Subaddress * subaddress() = 0;
     virtual SubaddressAccount * subaddressAccount() = 0;
     virtual void setListener(WalletListener *) = 0;
+    /*!
+     * \brief setBatchedListenerEvents - calls the listener's newBlock, moneyReceived, unconfirmedMoneyReceived
+     *                                   and moneySpent from a separate thread, once per chunk of refreshed blocks,
+     *                                   so a slow listener does not slow down refresh. They may then arrive
+     *                                   after refreshed()
+     * \param batched
+     */
+    virtual void setBatchedListenerEvents(bool batched) = 0;
     /*!
      * \brief defaultMixin - returns number of mixins used in transactions
      * \return
@@ -1171,6 +1208,15 @@ struct WalletManager
     //! resolves an OpenAlias address to a monero address
     virtual std::string resolveOpenAlias(const std::string &address, bool &dnssec_valid) const = 0;
 
+    /*!
+     * \brief setSharedScanning - wallets created or opened from now on fetch and parse the blocks
+     *                             they have in common once, and derive them against the view keys
+     *                             of all of them in one pass. Hardware wallets only share the blocks
+     * \param enabled - false for wallets created or opened from now on to scan on their own
+     */
+    virtual void setSharedScanning(bool enabled) = 0;
+    virtual bool sharedScanning() const = 0;
+
     //! checks for an update and returns version, hash and url
     static std::tuple<bool, std::string, std::string, std::string, std::string> checkUpdates(const std::string &software, std::string subdir);
 };
@@ -1193,6 +1239,9 @@ struct WalletManagerFactory
     static WalletManager * getWalletManager();
     static void setLogLevel(int level);
     static void setLogCategories(const std::string &categories);
+    //! number of threads running wallet refreshes and the future returning calls of all wallets, 0 for one per CPU.
+    //! Takes effect only if called before the first wallet is created
+    static void setExecutorThreads(size_t threads);
 };
 
 
@@ -0,0 +1,74 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <atomic>
+#include "wallet_executor.h"
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "WalletAPI"
+
+namespace Monero {
+
+static std::atomic<size_t> g_threads(0);
+
+WalletExecutor &WalletExecutor::instance()
+{
+    static WalletExecutor executor(g_threads.load());
+    return executor;
+}
+
+void WalletExecutor::setThreads(size_t threads)
+{
+    g_threads = threads;
+}
+
+WalletExecutor::WalletExecutor(size_t threads)
+    : m_work(new boost::asio::io_service::work(m_ioService))
+{
+    if (threads == 0)
+        threads = std::max<size_t>(DEFAULT_MIN_THREADS, boost::thread::hardware_concurrency());
+    LOG_PRINT_L1("Starting wallet executor with " << threads << " threads");
+    for (size_t n = 0; n < threads; ++n)
+        m_threads.create_thread([this]() { m_ioService.run(); });
+}
+
+WalletExecutor::~WalletExecutor()
+{
+    m_work.reset();
+    m_ioService.stop();
+    m_threads.join_all();
+}
+
+void WalletExecutor::post(std::function<void()> f)
+{
+    m_ioService.post(std::move(f));
+}
+
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <boost/asio/io_service.hpp>
+#include <boost/thread/thread.hpp>
+
+namespace Monero {
+
+/**
+ * Runs wallet work for all the wallets of a process on one set of threads:
+ * the periodic refreshes of every WalletImpl, and the calls made through the
+ * future returning variants of the Wallet API. Wallets keep their own timers
+ * on the executor's io_service, so a wallet waiting for its next refresh
+ * takes no thread.
+ */
+class WalletExecutor
+{
+public:
+    static const size_t DEFAULT_MIN_THREADS = 2;
+
+    static WalletExecutor &instance();
+
+    /**
+     * @brief setThreads - sets the number of threads, 0 for one per CPU. Takes effect
+     *                     only if called before the first wallet is created
+     */
+    static void setThreads(size_t threads);
+
+    ~WalletExecutor();
+
+    boost::asio::io_service &ioService() { return m_ioService; }
+    void post(std::function<void()> f);
+    size_t threads() const { return m_threads.size(); }
+
+private:
+    WalletExecutor(size_t threads);
+
+    boost::asio::io_service m_ioService;
+    std::unique_ptr<boost::asio::io_service::work> m_work;
+    boost::thread_group m_threads;
+};
+
+}
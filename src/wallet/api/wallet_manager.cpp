@@ -32,6 +32,7 @@
 
 #include "wallet_manager.h"
 #include "wallet.h"
+#include "wallet_executor.h"
 #include "common_defines.h"
 #include "common/dns_utils.h"
 #include "common/util.h"
@@ -48,19 +49,33 @@ namespace epee {
     unsigned int g_test_dbg_lock_sleep = 0;
 }
 
+namespace {
+    // as the wallet RPC server's
+    constexpr const size_t SHARED_BLOCK_CACHE_ENTRIES = 16;
+    constexpr const std::chrono::seconds SHARED_BLOCK_CACHE_TTL = std::chrono::seconds(30);
+}
+
 namespace Monero {
 
+WalletImpl *WalletManagerImpl::newWallet(NetworkType nettype, uint64_t kdf_rounds)
+{
+    WalletImpl * wallet = new WalletImpl(nettype, kdf_rounds);
+    if (m_scanGroup)
+        wallet->setSharedScanning(m_sharedBlockCache, m_scanGroup);
+    return wallet;
+}
+
 Wallet *WalletManagerImpl::createWallet(const std::string &path, const std::string &password,
                                     const std::string &language, NetworkType nettype, uint64_t kdf_rounds)
 {
-    WalletImpl * wallet = new WalletImpl(nettype, kdf_rounds);
+    WalletImpl * wallet = newWallet(nettype, kdf_rounds);
     wallet->create(path, password, language);
     return wallet;
 }
 
 Wallet *WalletManagerImpl::openWallet(const std::string &path, const std::string &password, NetworkType nettype, uint64_t kdf_rounds)
 {
-    WalletImpl * wallet = new WalletImpl(nettype, kdf_rounds);
+    WalletImpl * wallet = newWallet(nettype, kdf_rounds);
     wallet->open(path, password);
     //Refresh addressBook
     wallet->addressBook()->refresh(); 
@@ -91,7 +106,7 @@ Wallet *WalletManagerImpl::recoveryWallet(const std::string &path,
                                                 uint64_t restoreHeight,
                                                 uint64_t kdf_rounds)
 {
-    WalletImpl * wallet = new WalletImpl(nettype, kdf_rounds);
+    WalletImpl * wallet = newWallet(nettype, kdf_rounds);
     if(restoreHeight > 0){
         wallet->setRefreshFromBlockHeight(restoreHeight);
     }
@@ -109,7 +124,7 @@ Wallet *WalletManagerImpl::createWalletFromKeys(const std::string &path,
                                                 const std::string &spendKeyString,
                                                 uint64_t kdf_rounds)
 {
-    WalletImpl * wallet = new WalletImpl(nettype, kdf_rounds);
+    WalletImpl * wallet = newWallet(nettype, kdf_rounds);
     if(restoreHeight > 0){
         wallet->setRefreshFromBlockHeight(restoreHeight);
     }
@@ -125,7 +140,7 @@ Wallet *WalletManagerImpl::createWalletFromDevice(const std::string &path,
                                                   const std::string &subaddressLookahead,
                                                   uint64_t kdf_rounds)
 {
-    WalletImpl * wallet = new WalletImpl(nettype, kdf_rounds);
+    WalletImpl * wallet = newWallet(nettype, kdf_rounds);
     if(restoreHeight > 0){
         wallet->setRefreshFromBlockHeight(restoreHeight);
     }
@@ -332,6 +347,25 @@ std::string WalletManagerImpl::resolveOpenAlias(const std::string &address, bool
     return addresses.front();
 }
 
+void WalletManagerImpl::setSharedScanning(bool enabled)
+{
+    if (!enabled)
+    {
+        m_sharedBlockCache.reset();
+        m_scanGroup.reset();
+    }
+    else if (!m_scanGroup)
+    {
+        m_sharedBlockCache = std::make_shared<tools::wallet2::shared_block_cache>(SHARED_BLOCK_CACHE_ENTRIES, SHARED_BLOCK_CACHE_TTL);
+        m_scanGroup = std::make_shared<tools::scan_group>();
+    }
+}
+
+bool WalletManagerImpl::sharedScanning() const
+{
+    return m_scanGroup != nullptr;
+}
+
 std::tuple<bool, std::string, std::string, std::string, std::string> WalletManager::checkUpdates(const std::string &software, std::string subdir)
 {
 #ifdef BUILD_TAG
@@ -381,6 +415,11 @@ void WalletManagerFactory::setLogCategories(const std::string &categories)
     mlog_set_log(categories.c_str());
 }
 
+void WalletManagerFactory::setExecutorThreads(size_t threads)
+{
+    WalletExecutor::setThreads(threads);
+}
+
 
 
 }
@@ -31,11 +31,14 @@
 
 
 #include "wallet/api/wallet2_api.h"
+#include "wallet/wallet2.h"
 #include "net/http_client.h"
 #include <string>
 
 namespace Monero {
 
+class WalletImpl;
+
 class WalletManagerImpl : public WalletManager
 {
 public:
@@ -91,10 +94,15 @@ public:
     bool startMining(const std::string &address, uint32_t threads = 1, bool background_mining = false, bool ignore_battery = true) override;
     bool stopMining() override;
     std::string resolveOpenAlias(const std::string &address, bool &dnssec_valid) const override;
+    void setSharedScanning(bool enabled) override;
+    bool sharedScanning() const override;
 
 private:
     WalletManagerImpl() {}
     friend struct WalletManagerFactory;
+    WalletImpl *newWallet(NetworkType nettype, uint64_t kdf_rounds);
+    std::shared_ptr<tools::wallet2::shared_block_cache> m_sharedBlockCache;
+    std::shared_ptr<tools::scan_group> m_scanGroup;
     std::string m_daemonAddress;
     epee::net_utils::http::http_simple_client m_http_client;
     std::string m_errorString;
@@ -0,0 +1,245 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include "misc_log_ex.h"
+#include "misc_language.h"
+#include "storages/portable_storage_template_helper.h"
+#include "common/util.h"
+#include "wallet_errors.h"
+#include "blockdb.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.blockdb"
+
+static int resize_env(MDB_env *env, const char *db_path, size_t needed)
+{
+  MDB_envinfo mei;
+  MDB_stat mst;
+  int ret;
+
+  needed = std::max(needed, (size_t)(100ul * 1024 * 1024)); // at least 100 MB
+
+  ret = mdb_env_info(env, &mei);
+  if (ret)
+    return ret;
+  ret = mdb_env_stat(env, &mst);
+  if (ret)
+    return ret;
+  uint64_t size_used = mst.ms_psize * mei.me_last_pgno;
+  if (size_used + needed <= mei.me_mapsize)
+    return 0;
+
+  try
+  {
+    boost::filesystem::space_info si = boost::filesystem::space(boost::filesystem::path(db_path));
+    if(si.available < needed)
+    {
+      MERROR("!! WARNING: Insufficient free space to extend database !!: " << (si.available >> 20L) << " MB available");
+      return ENOSPC;
+    }
+  }
+  catch(...)
+  {
+    // print something but proceed.
+    MWARNING("Unable to query free disk space.");
+  }
+  return mdb_env_set_mapsize(env, mei.me_mapsize + needed);
+}
+
+static bool get_entry(MDB_txn *txn, MDB_dbi dbi, uint64_t height, tools::blockdb::entry &e)
+{
+  MDB_val key = { sizeof(height), (void*)&height }, data;
+  int dbr = mdb_get(txn, dbi, &key, &data);
+  THROW_WALLET_EXCEPTION_IF(dbr && dbr != MDB_NOTFOUND, tools::error::wallet_internal_error, "Failed to look up block in LMDB table: " + std::string(mdb_strerror(dbr)));
+  if (dbr == MDB_NOTFOUND)
+    return false;
+  return epee::serialization::load_t_from_binary(e, std::string((const char*)data.mv_data, data.mv_size));
+}
+
+namespace tools
+{
+
+std::shared_ptr<blockdb> blockdb::open(const std::string &filename, const std::string &genesis)
+{
+  static boost::mutex mutex;
+  static std::map<std::string, std::weak_ptr<blockdb>> open_dbs;
+
+  boost::lock_guard<boost::mutex> lock(mutex);
+  std::shared_ptr<blockdb> db = open_dbs[filename].lock();
+  if (!db)
+  {
+    db = std::make_shared<blockdb>(filename, genesis);
+    open_dbs[filename] = db;
+  }
+  THROW_WALLET_EXCEPTION_IF(db->genesis != genesis, tools::error::wallet_internal_error,
+      "Block database " + filename + " is already open for another network");
+  return db;
+}
+
+blockdb::blockdb(std::string filename, const std::string &genesis):
+  filename(filename),
+  genesis(genesis),
+  env(NULL)
+{
+  MDB_txn *txn;
+  bool tx_active = false;
+  int dbr;
+
+  tools::create_directories_if_necessary(filename);
+
+  dbr = mdb_env_create(&env);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LDMB environment: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_env_set_maxdbs(env, 2);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set max env dbs: " + std::string(mdb_strerror(dbr)));
+  // blocks are read from the refresh fetcher threads
+  dbr = mdb_env_open(env, filename.c_str(), MDB_NOTLS, 0664);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to open block database file '"
+      + filename + "': " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_begin(env, NULL, 0, &txn);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  dbr = mdb_dbi_open(txn, ("blocks-" + genesis).c_str(), MDB_CREATE | MDB_INTEGERKEY, &dbi_blocks);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_dbi_open(txn, ("heights-" + genesis).c_str(), MDB_CREATE, &dbi_heights);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to open LMDB dbi: " + std::string(mdb_strerror(dbr)));
+
+  dbr = mdb_txn_commit(txn);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn creating/opening database: " + std::string(mdb_strerror(dbr)));
+  tx_active = false;
+}
+
+blockdb::~blockdb()
+{
+  close();
+}
+
+void blockdb::close()
+{
+  if (env)
+  {
+    mdb_dbi_close(env, dbi_blocks);
+    mdb_dbi_close(env, dbi_heights);
+    mdb_env_close(env);
+    env = NULL;
+  }
+}
+
+bool blockdb::add_blocks(uint64_t start_height, const std::vector<entry> &entries)
+{
+  MDB_txn *txn;
+  int dbr;
+  bool tx_active = false;
+
+  if (entries.empty())
+    return true;
+
+  std::vector<std::string> blobs(entries.size());
+  size_t needed = 0;
+  for (size_t n = 0; n < entries.size(); ++n)
+  {
+    THROW_WALLET_EXCEPTION_IF(!epee::serialization::store_t_to_binary(entries[n], blobs[n]),
+        tools::error::wallet_internal_error, "Failed to serialize block");
+    needed += blobs[n].size() + 2 * sizeof(crypto::hash);
+  }
+
+  dbr = resize_env(env, filename.c_str(), needed * 2);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size");
+  dbr = mdb_txn_begin(env, NULL, 0, &txn);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  for (size_t n = 0; n < entries.size(); ++n)
+  {
+    uint64_t height = start_height + n;
+    MDB_val key = { sizeof(height), (void*)&height }, data;
+
+    // a block replaced after a reorg must not be found by hash anymore
+    entry previous;
+    if (get_entry(txn, dbi_blocks, height, previous) && previous.hash != entries[n].hash)
+    {
+      MDB_val hkey = { sizeof(previous.hash), (void*)&previous.hash };
+      dbr = mdb_del(txn, dbi_heights, &hkey, NULL);
+      THROW_WALLET_EXCEPTION_IF(dbr && dbr != MDB_NOTFOUND, tools::error::wallet_internal_error, "Failed to remove block hash from LMDB table: " + std::string(mdb_strerror(dbr)));
+    }
+
+    data.mv_data = (void*)blobs[n].data();
+    data.mv_size = blobs[n].size();
+    dbr = mdb_put(txn, dbi_blocks, &key, &data, 0);
+    THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to add block to LMDB table: " + std::string(mdb_strerror(dbr)));
+
+    MDB_val hkey = { sizeof(entries[n].hash), (void*)&entries[n].hash };
+    dbr = mdb_put(txn, dbi_heights, &hkey, &key, 0);
+    THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to add block hash to LMDB table: " + std::string(mdb_strerror(dbr)));
+  }
+
+  dbr = mdb_txn_commit(txn);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn adding blocks to database: " + std::string(mdb_strerror(dbr)));
+  tx_active = false;
+  return true;
+}
+
+bool blockdb::get_blocks(const crypto::hash &top, size_t max_count, uint64_t &start_height, std::vector<entry> &entries)
+{
+  MDB_txn *txn;
+  int dbr;
+  bool tx_active = false;
+
+  entries.clear();
+  dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  MDB_val hkey = { sizeof(top), (void*)&top }, data;
+  dbr = mdb_get(txn, dbi_heights, &hkey, &data);
+  THROW_WALLET_EXCEPTION_IF(dbr && dbr != MDB_NOTFOUND, tools::error::wallet_internal_error, "Failed to look up block hash in LMDB table: " + std::string(mdb_strerror(dbr)));
+  if (dbr == MDB_NOTFOUND || data.mv_size != sizeof(uint64_t))
+    return false;
+  memcpy(&start_height, data.mv_data, sizeof(start_height));
+
+  entry e;
+  for (uint64_t height = start_height; entries.size() < max_count; ++height)
+  {
+    if (!get_entry(txn, dbi_blocks, height, e))
+      break;
+    if (entries.empty() ? e.hash != top : e.prev_id != entries.back().hash)
+      break;
+    entries.push_back(std::move(e));
+  }
+  return !entries.empty();
+}
+
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <lmdb.h>
+#include "serialization/keyvalue_serialization.h"
+#include "crypto/hash.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace tools
+{
+  // Blocks as returned by getblocks.bin (pruned, with output indices), kept on
+  // disk so rescans, restores and other wallets on the same host can scan them
+  // without downloading them again. This is public chain data, so it is shared
+  // between wallets and not encrypted.
+  class blockdb
+  {
+  public:
+    struct entry
+    {
+      crypto::hash hash;
+      crypto::hash prev_id;
+      cryptonote::block_complete_entry block;
+      cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices o_indices;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(hash)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(prev_id)
+        KV_SERIALIZE(block)
+        KV_SERIALIZE(o_indices)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    // LMDB must not be opened twice in a process, so wallets share one instance per path
+    static std::shared_ptr<blockdb> open(const std::string &filename, const std::string &genesis);
+
+    blockdb(std::string filename, const std::string &genesis);
+    void close();
+    ~blockdb();
+
+    // stores entries for consecutive heights from start_height, replacing what was there
+    bool add_blocks(uint64_t start_height, const std::vector<entry> &entries);
+    // the stored chain from the block with hash top (included), up to max_count blocks,
+    // stopping where the next stored block does not build on the previous one
+    bool get_blocks(const crypto::hash &top, size_t max_count, uint64_t &start_height, std::vector<entry> &entries);
+
+  private:
+    std::string filename;
+    std::string genesis;
+    MDB_env *env;
+    MDB_dbi dbi_blocks;
+    MDB_dbi dbi_heights;
+  };
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include "misc_log_ex.h"
+#include "daemon_notifier.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.notifier"
+
+namespace
+{
+  const char *const topics[] = { "block", "reorg", "txpool_add", "txpool_remove" };
+  const int poll_timeout_ms = 500;
+}
+
+namespace tools
+{
+
+daemon_notifier::daemon_notifier(std::function<void()> on_event):
+  on_event(std::move(on_event)),
+  context(1),
+  stop_signal(false)
+{
+}
+
+daemon_notifier::~daemon_notifier()
+{
+  stop();
+}
+
+bool daemon_notifier::connect(const std::string &address)
+{
+  stop();
+  try
+  {
+    socket.reset(new zmq::socket_t(context, ZMQ_SUB));
+    const int linger = 0;
+    socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+    for (const char *topic: topics)
+      socket->setsockopt(ZMQ_SUBSCRIBE, topic, strlen(topic));
+    socket->connect(address.c_str());
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to subscribe to daemon events at " << address << ": " << e.what());
+    socket.reset();
+    return false;
+  }
+
+  MINFO("Subscribed to daemon events at " << address);
+  stop_signal = false;
+  thread = boost::thread([this]() { run(); });
+  return true;
+}
+
+void daemon_notifier::stop()
+{
+  stop_signal = true;
+  if (thread.joinable())
+    thread.join();
+  socket.reset();
+}
+
+void daemon_notifier::run()
+{
+  // the socket is only used from this thread once it runs
+  while (!stop_signal)
+  {
+    try
+    {
+      zmq::pollitem_t items[] = { { static_cast<void*>(*socket), 0, ZMQ_POLLIN, 0 } };
+      zmq::poll(items, 1, poll_timeout_ms);
+      if (!(items[0].revents & ZMQ_POLLIN))
+        continue;
+
+      // drain everything that is queued, a single wakeup covers it all
+      size_t events = 0;
+      zmq::message_t frame;
+      while (socket->recv(&frame, ZMQ_DONTWAIT))
+      {
+        if (!frame.more())
+          ++events;
+      }
+      if (events)
+      {
+        MDEBUG("Got " << events << " daemon events");
+        on_event();
+      }
+    }
+    catch (const zmq::error_t &e)
+    {
+      if (!stop_signal)
+        MERROR("ZMQ error receiving daemon events: " << e.what());
+    }
+  }
+}
+
+}
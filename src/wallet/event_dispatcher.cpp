@@ -0,0 +1,110 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#include "misc_log_ex.h"
+#include "event_dispatcher.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.events"
+
+namespace tools
+{
+
+event_dispatcher::event_dispatcher(std::function<void(const std::vector<wallet_event>&)> deliver):
+  deliver(std::move(deliver)),
+  delivering(false),
+  stop_signal(false)
+{
+  thread = boost::thread([this]() { run(); });
+}
+
+event_dispatcher::~event_dispatcher()
+{
+  stop();
+}
+
+void event_dispatcher::post(std::vector<wallet_event> events)
+{
+  if (events.empty())
+    return;
+  boost::unique_lock<boost::mutex> lock(mutex);
+  if (queued.empty())
+    queued = std::move(events);
+  else
+    queued.insert(queued.end(), events.begin(), events.end());
+  cond.notify_all();
+}
+
+void event_dispatcher::wait_idle()
+{
+  boost::unique_lock<boost::mutex> lock(mutex);
+  while ((!queued.empty() || delivering) && thread.joinable())
+    cond.wait(lock);
+}
+
+void event_dispatcher::stop()
+{
+  {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    stop_signal = true;
+    cond.notify_all();
+  }
+  if (thread.joinable() && thread.get_id() != boost::this_thread::get_id())
+    thread.join();
+}
+
+void event_dispatcher::run()
+{
+  boost::unique_lock<boost::mutex> lock(mutex);
+  while (true)
+  {
+    while (queued.empty() && !stop_signal)
+      cond.wait(lock);
+    if (queued.empty())
+      break;
+
+    std::vector<wallet_event> events;
+    events.swap(queued);
+    delivering = true;
+    lock.unlock();
+    MDEBUG("Delivering " << events.size() << " wallet events");
+    try
+    {
+      deliver(events);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Wallet event listener threw: " << e.what());
+    }
+    lock.lock();
+    delivering = false;
+    cond.notify_all();
+  }
+  cond.notify_all();
+}
+
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <vector>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "crypto/hash.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/subaddress_index.h"
+
+namespace tools
+{
+  // What a refresh found, as delivered in batched callback mode
+  struct wallet_event
+  {
+    enum type_t { new_block, money_received, unconfirmed_money_received, money_spent };
+
+    type_t type;
+    uint64_t height;
+    crypto::hash id; // block id for new_block, txid otherwise
+    uint64_t amount;
+    cryptonote::subaddress_index subaddr_index;
+  };
+
+  // Calls deliver with batches of wallet events from its own thread, in the
+  // order they were posted, so a slow listener only delays its own
+  // notifications and not the refresh producing them. Batches posted while
+  // the previous one is still being delivered are merged.
+  class event_dispatcher
+  {
+  public:
+    event_dispatcher(std::function<void(const std::vector<wallet_event>&)> deliver);
+    ~event_dispatcher();
+
+    void post(std::vector<wallet_event> events);
+    // returns once everything posted so far has been delivered
+    void wait_idle();
+    // delivers what is queued, then stops the thread
+    void stop();
+
+  private:
+    void run();
+
+    std::function<void(const std::vector<wallet_event>&)> deliver;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<wallet_event> queued;
+    bool delivering;
+    bool stop_signal;
+    boost::thread thread;
+  };
+}
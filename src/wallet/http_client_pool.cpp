@@ -0,0 +1,120 @@
+// Copyright (c) 2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "http_client_pool.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
+
+namespace tools
+{
+
+http_client_pool::lease::lease(http_client_pool &pool, std::unique_ptr<epee::net_utils::http::http_simple_client> client, uint64_t generation)
+  : m_pool(&pool)
+  , m_client(std::move(client))
+  , m_generation(generation)
+{
+}
+
+http_client_pool::lease::lease(lease &&other)
+  : m_pool(other.m_pool)
+  , m_client(std::move(other.m_client))
+  , m_generation(other.m_generation)
+{
+  other.m_pool = NULL;
+}
+
+http_client_pool::lease::~lease()
+{
+  if (m_pool && m_client)
+    m_pool->release(std::move(m_client), m_generation);
+}
+
+http_client_pool::http_client_pool(size_t max_connections)
+  : m_max_connections(std::max<size_t>(max_connections, 1))
+  , m_in_use(0)
+  , m_ssl(false)
+  , m_generation(0)
+{
+}
+
+bool http_client_pool::set_server(const std::string &address, boost::optional<epee::net_utils::http::login> login, bool ssl)
+{
+  epee::net_utils::http::url_content parsed{};
+  CHECK_AND_ASSERT_MES(epee::net_utils::parse_url(address, parsed), false, "failed to parse url: " << address);
+
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_address = address;
+  m_login = std::move(login);
+  m_ssl = ssl;
+  ++m_generation;
+  m_idle.clear();
+  return true;
+}
+
+void http_client_pool::disconnect()
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  for (auto &client: m_idle)
+    client->disconnect();
+}
+
+http_client_pool::lease http_client_pool::acquire()
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  while (m_idle.empty() && m_in_use >= m_max_connections)
+    m_cond.wait(lock);
+
+  std::unique_ptr<epee::net_utils::http::http_simple_client> client;
+  if (!m_idle.empty())
+  {
+    client = std::move(m_idle.back());
+    m_idle.pop_back();
+  }
+  else
+  {
+    // connects on first use
+    client.reset(new epee::net_utils::http::http_simple_client());
+    client->set_server(m_address, m_login, m_ssl);
+  }
+  ++m_in_use;
+  return lease(*this, std::move(client), m_generation);
+}
+
+void http_client_pool::release(std::unique_ptr<epee::net_utils::http::http_simple_client> client, uint64_t generation)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+    --m_in_use;
+    if (generation == m_generation)
+      m_idle.push_back(std::move(client));
+  }
+  m_cond.notify_one();
+}
+
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/optional/optional.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include "net/http_client.h"
+
+namespace tools
+{
+
+// A few keep-alive connections to the same daemon, so that requests from
+// different threads (refresh, pool polling, tx construction) do not queue
+// behind each other on a single connection.
+class http_client_pool
+{
+public:
+  // exclusive use of one connection, handed back to the pool on destruction
+  class lease
+  {
+  public:
+    lease(lease &&other);
+    ~lease();
+    epee::net_utils::http::http_simple_client &operator*() const { return *m_client; }
+    epee::net_utils::http::http_simple_client *operator->() const { return m_client.get(); }
+
+  private:
+    friend class http_client_pool;
+    lease(http_client_pool &pool, std::unique_ptr<epee::net_utils::http::http_simple_client> client, uint64_t generation);
+    lease(const lease&) = delete;
+    lease &operator=(const lease&) = delete;
+
+    http_client_pool *m_pool;
+    std::unique_ptr<epee::net_utils::http::http_simple_client> m_client;
+    uint64_t m_generation;
+  };
+
+  explicit http_client_pool(size_t max_connections);
+
+  // connections to the previous server are closed as they come back
+  bool set_server(const std::string &address, boost::optional<epee::net_utils::http::login> login, bool ssl);
+  void disconnect();
+
+  // blocks until a connection is free if max_connections are in use
+  lease acquire();
+
+private:
+  void release(std::unique_ptr<epee::net_utils::http::http_simple_client> client, uint64_t generation);
+
+  boost::mutex m_mutex;
+  boost::condition_variable m_cond;
+  std::vector<std::unique_ptr<epee::net_utils::http::http_simple_client>> m_idle;
+  const size_t m_max_connections;
+  size_t m_in_use;
+  std::string m_address;
+  boost::optional<epee::net_utils::http::login> m_login;
+  bool m_ssl;
+  uint64_t m_generation;
+};
+
+}
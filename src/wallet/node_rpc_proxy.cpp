@@ -30,6 +30,7 @@
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "common/json_util.h"
 #include "storages/http_abstract_invoke.h"
+#include <map>
 
 using namespace epee;
 
@@ -38,71 +39,144 @@ namespace tools
 
 static const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
 
+struct NodeRPCProxy::cache_t
+{
+  boost::mutex mutex;
+  uint64_t height;
+  uint64_t earliest_height[256];
+  uint64_t dynamic_base_fee_estimate;
+  uint64_t dynamic_base_fee_estimate_cached_height;
+  uint64_t dynamic_base_fee_estimate_grace_blocks;
+  uint64_t fee_quantization_mask;
+  uint32_t rpc_version;
+  uint64_t target_height;
+  uint64_t block_weight_limit;
+  time_t get_info_time;
+
+  cache_t() { reset(); }
+
+  void reset()
+  {
+    height = 0;
+    for (size_t n = 0; n < 256; ++n)
+      earliest_height[n] = 0;
+    dynamic_base_fee_estimate = 0;
+    dynamic_base_fee_estimate_cached_height = 0;
+    dynamic_base_fee_estimate_grace_blocks = 0;
+    fee_quantization_mask = 1;
+    rpc_version = 0;
+    target_height = 0;
+    block_weight_limit = 0;
+    get_info_time = 0;
+  }
+};
+
 NodeRPCProxy::NodeRPCProxy(epee::net_utils::http::http_simple_client &http_client, boost::mutex &mutex)
   : m_http_client(http_client)
   , m_daemon_rpc_mutex(mutex)
+  , m_cache(std::make_shared<cache_t>())
+  , m_prefetching(false)
 {
-  invalidate();
+}
+
+NodeRPCProxy::~NodeRPCProxy()
+{
+  if (m_prefetch_thread.joinable())
+    m_prefetch_thread.join();
+}
+
+std::shared_ptr<NodeRPCProxy::cache_t> NodeRPCProxy::get_shared_cache(const std::string &address)
+{
+  static boost::mutex registry_mutex;
+  static std::map<std::string, std::weak_ptr<cache_t>> registry;
+
+  boost::lock_guard<boost::mutex> lock(registry_mutex);
+  for (auto i = registry.begin(); i != registry.end(); )
+  {
+    if (i->second.expired())
+      i = registry.erase(i);
+    else
+      ++i;
+  }
+  std::shared_ptr<cache_t> cache = registry[address].lock();
+  if (!cache)
+  {
+    cache = std::make_shared<cache_t>();
+    registry[address] = cache;
+  }
+  return cache;
+}
+
+void NodeRPCProxy::set_daemon_address(const std::string &address)
+{
+  if (m_prefetch_thread.joinable())
+    m_prefetch_thread.join();
+  m_cache = get_shared_cache(address);
 }
 
 void NodeRPCProxy::invalidate()
 {
-  m_height = 0;
-  for (size_t n = 0; n < 256; ++n)
-    m_earliest_height[n] = 0;
-  m_dynamic_base_fee_estimate = 0;
-  m_dynamic_base_fee_estimate_cached_height = 0;
-  m_dynamic_base_fee_estimate_grace_blocks = 0;
-  m_fee_quantization_mask = 1;
-  m_rpc_version = 0;
-  m_target_height = 0;
-  m_block_weight_limit = 0;
-  m_get_info_time = 0;
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->reset();
 }
 
 boost::optional<std::string> NodeRPCProxy::get_rpc_version(uint32_t &rpc_version) const
 {
-  if (m_rpc_version == 0)
   {
-    cryptonote::COMMAND_RPC_GET_VERSION::request req_t = AUTO_VAL_INIT(req_t);
-    cryptonote::COMMAND_RPC_GET_VERSION::response resp_t = AUTO_VAL_INIT(resp_t);
-    m_daemon_rpc_mutex.lock();
-    bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_version", req_t, resp_t, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get daemon RPC version");
-    m_rpc_version = resp_t.version;
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    if (m_cache->rpc_version != 0)
+    {
+      rpc_version = m_cache->rpc_version;
+      return boost::optional<std::string>();
+    }
   }
-  rpc_version = m_rpc_version;
+
+  cryptonote::COMMAND_RPC_GET_VERSION::request req_t = AUTO_VAL_INIT(req_t);
+  cryptonote::COMMAND_RPC_GET_VERSION::response resp_t = AUTO_VAL_INIT(resp_t);
+  m_daemon_rpc_mutex.lock();
+  bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_version", req_t, resp_t, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get daemon RPC version");
+
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->rpc_version = resp_t.version;
+  rpc_version = resp_t.version;
   return boost::optional<std::string>();
 }
 
 void NodeRPCProxy::set_height(uint64_t h)
 {
-  m_height = h;
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->height = h;
 }
 
 boost::optional<std::string> NodeRPCProxy::get_info() const
 {
   const time_t now = time(NULL);
-  if (now >= m_get_info_time + 30) // re-cache every 30 seconds
   {
-    cryptonote::COMMAND_RPC_GET_INFO::request req_t = AUTO_VAL_INIT(req_t);
-    cryptonote::COMMAND_RPC_GET_INFO::response resp_t = AUTO_VAL_INIT(resp_t);
-
-    m_daemon_rpc_mutex.lock();
-    bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_info", req_t, resp_t, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-
-    CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get target blockchain height");
-    m_height = resp_t.height;
-    m_target_height = resp_t.target_height;
-    m_block_weight_limit = resp_t.block_weight_limit ? resp_t.block_weight_limit : resp_t.block_size_limit;
-    m_get_info_time = now;
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    if (now < m_cache->get_info_time + 30) // re-cache every 30 seconds
+      return boost::optional<std::string>();
   }
+
+  cryptonote::COMMAND_RPC_GET_INFO::request req_t = AUTO_VAL_INIT(req_t);
+  cryptonote::COMMAND_RPC_GET_INFO::response resp_t = AUTO_VAL_INIT(resp_t);
+
+  m_daemon_rpc_mutex.lock();
+  bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_info", req_t, resp_t, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+
+  CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get target blockchain height");
+
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->height = resp_t.height;
+  m_cache->target_height = resp_t.target_height;
+  m_cache->block_weight_limit = resp_t.block_weight_limit ? resp_t.block_weight_limit : resp_t.block_size_limit;
+  m_cache->get_info_time = now;
   return boost::optional<std::string>();
 }
 
@@ -111,7 +185,8 @@ boost::optional<std::string> NodeRPCProxy::get_height(uint64_t &height) const
   auto res = get_info();
   if (res)
     return res;
-  height = m_height;
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  height = m_cache->height;
   return boost::optional<std::string>();
 }
 
@@ -120,7 +195,8 @@ boost::optional<std::string> NodeRPCProxy::get_target_height(uint64_t &height) c
   auto res = get_info();
   if (res)
     return res;
-  height = m_target_height;
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  height = m_cache->target_height;
   return boost::optional<std::string>();
 }
 
@@ -129,28 +205,57 @@ boost::optional<std::string> NodeRPCProxy::get_block_weight_limit(uint64_t &bloc
   auto res = get_info();
   if (res)
     return res;
-  block_weight_limit = m_block_weight_limit;
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  block_weight_limit = m_cache->block_weight_limit;
   return boost::optional<std::string>();
 }
 
 boost::optional<std::string> NodeRPCProxy::get_earliest_height(uint8_t version, uint64_t &earliest_height) const
 {
-  if (m_earliest_height[version] == 0)
   {
-    cryptonote::COMMAND_RPC_HARD_FORK_INFO::request req_t = AUTO_VAL_INIT(req_t);
-    cryptonote::COMMAND_RPC_HARD_FORK_INFO::response resp_t = AUTO_VAL_INIT(resp_t);
-
-    m_daemon_rpc_mutex.lock();
-    req_t.version = version;
-    bool r = net_utils::invoke_http_json_rpc("/json_rpc", "hard_fork_info", req_t, resp_t, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get hard fork status");
-    m_earliest_height[version] = resp_t.earliest_height;
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    if (m_cache->earliest_height[version] != 0)
+    {
+      earliest_height = m_cache->earliest_height[version];
+      return boost::optional<std::string>();
+    }
   }
 
-  earliest_height = m_earliest_height[version];
+  cryptonote::COMMAND_RPC_HARD_FORK_INFO::request req_t = AUTO_VAL_INIT(req_t);
+  cryptonote::COMMAND_RPC_HARD_FORK_INFO::response resp_t = AUTO_VAL_INIT(resp_t);
+
+  m_daemon_rpc_mutex.lock();
+  req_t.version = version;
+  bool r = net_utils::invoke_http_json_rpc("/json_rpc", "hard_fork_info", req_t, resp_t, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get hard fork status");
+
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->earliest_height[version] = resp_t.earliest_height;
+  earliest_height = resp_t.earliest_height;
+  return boost::optional<std::string>();
+}
+
+boost::optional<std::string> NodeRPCProxy::get_fee_estimate(uint64_t height, uint64_t grace_blocks) const
+{
+  cryptonote::COMMAND_RPC_GET_BASE_FEE_ESTIMATE::request req_t = AUTO_VAL_INIT(req_t);
+  cryptonote::COMMAND_RPC_GET_BASE_FEE_ESTIMATE::response resp_t = AUTO_VAL_INIT(resp_t);
+
+  m_daemon_rpc_mutex.lock();
+  req_t.grace_blocks = grace_blocks;
+  bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_fee_estimate", req_t, resp_t, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get fee estimate");
+
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->dynamic_base_fee_estimate = resp_t.fee;
+  m_cache->dynamic_base_fee_estimate_cached_height = height;
+  m_cache->dynamic_base_fee_estimate_grace_blocks = grace_blocks;
+  m_cache->fee_quantization_mask = resp_t.quantization_mask;
   return boost::optional<std::string>();
 }
 
@@ -162,54 +267,49 @@ boost::optional<std::string> NodeRPCProxy::get_dynamic_base_fee_estimate(uint64_
   if (result)
     return result;
 
-  if (m_dynamic_base_fee_estimate_cached_height != height || m_dynamic_base_fee_estimate_grace_blocks != grace_blocks)
   {
-    cryptonote::COMMAND_RPC_GET_BASE_FEE_ESTIMATE::request req_t = AUTO_VAL_INIT(req_t);
-    cryptonote::COMMAND_RPC_GET_BASE_FEE_ESTIMATE::response resp_t = AUTO_VAL_INIT(resp_t);
-
-    m_daemon_rpc_mutex.lock();
-    req_t.grace_blocks = grace_blocks;
-    bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_fee_estimate", req_t, resp_t, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get fee estimate");
-    m_dynamic_base_fee_estimate = resp_t.fee;
-    m_dynamic_base_fee_estimate_cached_height = height;
-    m_dynamic_base_fee_estimate_grace_blocks = grace_blocks;
-    m_fee_quantization_mask = resp_t.quantization_mask;
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    if (m_cache->dynamic_base_fee_estimate_cached_height == height && m_cache->dynamic_base_fee_estimate_grace_blocks == grace_blocks)
+    {
+      fee = m_cache->dynamic_base_fee_estimate;
+      return boost::optional<std::string>();
+    }
   }
 
-  fee = m_dynamic_base_fee_estimate;
+  result = get_fee_estimate(height, grace_blocks);
+  if (result)
+    return result;
+
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  fee = m_cache->dynamic_base_fee_estimate;
   return boost::optional<std::string>();
 }
 
 boost::optional<std::string> NodeRPCProxy::get_fee_quantization_mask(uint64_t &fee_quantization_mask) const
 {
-  uint64_t height;
+  uint64_t height, grace_blocks;
 
   boost::optional<std::string> result = get_height(height);
   if (result)
     return result;
 
-  if (m_dynamic_base_fee_estimate_cached_height != height)
+  bool cached;
+  {
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    cached = m_cache->dynamic_base_fee_estimate_cached_height == height;
+    grace_blocks = m_cache->dynamic_base_fee_estimate_grace_blocks;
+  }
+  if (!cached)
   {
-    cryptonote::COMMAND_RPC_GET_BASE_FEE_ESTIMATE::request req_t = AUTO_VAL_INIT(req_t);
-    cryptonote::COMMAND_RPC_GET_BASE_FEE_ESTIMATE::response resp_t = AUTO_VAL_INIT(resp_t);
-
-    m_daemon_rpc_mutex.lock();
-    req_t.grace_blocks = m_dynamic_base_fee_estimate_grace_blocks;
-    bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_fee_estimate", req_t, resp_t, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
-    CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get fee estimate");
-    m_dynamic_base_fee_estimate = resp_t.fee;
-    m_dynamic_base_fee_estimate_cached_height = height;
-    m_fee_quantization_mask = resp_t.quantization_mask;
+    result = get_fee_estimate(height, grace_blocks);
+    if (result)
+      return result;
   }
 
-  fee_quantization_mask = m_fee_quantization_mask;
+  {
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    fee_quantization_mask = m_cache->fee_quantization_mask;
+  }
   if (fee_quantization_mask == 0)
   {
     MERROR("Fee quantization mask is 0, forcing to 1");
@@ -218,4 +318,71 @@ boost::optional<std::string> NodeRPCProxy::get_fee_quantization_mask(uint64_t &f
   return boost::optional<std::string>();
 }
 
+boost::optional<std::string> NodeRPCProxy::refresh_tx_construction_info(uint64_t grace_blocks) const
+{
+  uint32_t rpc_version;
+  boost::optional<std::string> result = get_rpc_version(rpc_version);
+  if (result)
+    return result;
+
+  if (rpc_version < MAKE_CORE_RPC_VERSION(2, 7))
+  {
+    // older daemons: one call for the chain info, one for the fee
+    uint64_t fee;
+    return get_dynamic_base_fee_estimate(grace_blocks, fee);
+  }
+
+  cryptonote::COMMAND_RPC_GET_TX_CONSTRUCTION_INFO::request req_t = AUTO_VAL_INIT(req_t);
+  cryptonote::COMMAND_RPC_GET_TX_CONSTRUCTION_INFO::response resp_t = AUTO_VAL_INIT(resp_t);
+
+  m_daemon_rpc_mutex.lock();
+  req_t.grace_blocks = grace_blocks;
+  bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_tx_construction_info", req_t, resp_t, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  CHECK_AND_ASSERT_MES(r, std::string("Failed to connect to daemon"), "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status != CORE_RPC_STATUS_BUSY, resp_t.status, "Failed to connect to daemon");
+  CHECK_AND_ASSERT_MES(resp_t.status == CORE_RPC_STATUS_OK, resp_t.status, "Failed to get tx construction info");
+
+  boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+  m_cache->height = resp_t.height;
+  m_cache->target_height = resp_t.target_height;
+  m_cache->block_weight_limit = resp_t.block_weight_limit;
+  m_cache->get_info_time = time(NULL);
+  m_cache->dynamic_base_fee_estimate = resp_t.fee;
+  m_cache->dynamic_base_fee_estimate_cached_height = resp_t.height;
+  m_cache->dynamic_base_fee_estimate_grace_blocks = grace_blocks;
+  m_cache->fee_quantization_mask = resp_t.quantization_mask;
+  for (size_t version = 1; version < std::min<size_t>(resp_t.earliest_heights.size(), 256); ++version)
+    m_cache->earliest_height[version] = resp_t.earliest_heights[version];
+  return boost::optional<std::string>();
+}
+
+void NodeRPCProxy::prefetch(uint64_t grace_blocks)
+{
+  {
+    boost::lock_guard<boost::mutex> lock(m_cache->mutex);
+    if (m_cache->rpc_version == 0 || (m_cache->dynamic_base_fee_estimate_cached_height == m_cache->height && m_cache->dynamic_base_fee_estimate_grace_blocks == grace_blocks))
+      return;
+  }
+
+  // one at a time, the next new block will catch up if this one is still running
+  if (m_prefetching.exchange(true))
+    return;
+  if (m_prefetch_thread.joinable())
+    m_prefetch_thread.join();
+  m_prefetch_thread = boost::thread([this, grace_blocks]() {
+    try
+    {
+      const boost::optional<std::string> result = refresh_tx_construction_info(grace_blocks);
+      if (result)
+        MDEBUG("Failed to prefetch tx construction info: " << *result);
+    }
+    catch (const std::exception &e)
+    {
+      MDEBUG("Failed to prefetch tx construction info: " << e.what());
+    }
+    m_prefetching = false;
+  });
+}
+
 }
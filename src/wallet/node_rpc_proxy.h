@@ -29,7 +29,10 @@
 #pragma once
 
 #include <string>
+#include <atomic>
+#include <memory>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include "include_base_utils.h"
 #include "net/http_client.h"
 
@@ -40,8 +43,11 @@ class NodeRPCProxy
 {
 public:
   NodeRPCProxy(epee::net_utils::http::http_simple_client &http_client, boost::mutex &mutex);
+  ~NodeRPCProxy();
 
   void invalidate();
+  // the cached values are shared with the other proxies in this process using the same daemon
+  void set_daemon_address(const std::string &address);
 
   boost::optional<std::string> get_rpc_version(uint32_t &version) const;
   boost::optional<std::string> get_height(uint64_t &height) const;
@@ -52,22 +58,24 @@ public:
   boost::optional<std::string> get_dynamic_base_fee_estimate(uint64_t grace_blocks, uint64_t &fee) const;
   boost::optional<std::string> get_fee_quantization_mask(uint64_t &fee_quantization_mask) const;
 
+  // height, target height, block weight limit, fee estimate and hard fork heights in one call
+  boost::optional<std::string> refresh_tx_construction_info(uint64_t grace_blocks) const;
+  // refreshes the above in the background if the fee estimate is older than the last set height
+  void prefetch(uint64_t grace_blocks);
+
 private:
+  struct cache_t;
+
   boost::optional<std::string> get_info() const;
+  boost::optional<std::string> get_fee_estimate(uint64_t height, uint64_t grace_blocks) const;
+  static std::shared_ptr<cache_t> get_shared_cache(const std::string &address);
 
   epee::net_utils::http::http_simple_client &m_http_client;
   boost::mutex &m_daemon_rpc_mutex;
 
-  mutable uint64_t m_height;
-  mutable uint64_t m_earliest_height[256];
-  mutable uint64_t m_dynamic_base_fee_estimate;
-  mutable uint64_t m_dynamic_base_fee_estimate_cached_height;
-  mutable uint64_t m_dynamic_base_fee_estimate_grace_blocks;
-  mutable uint64_t m_fee_quantization_mask;
-  mutable uint32_t m_rpc_version;
-  mutable uint64_t m_target_height;
-  mutable uint64_t m_block_weight_limit;
-  mutable time_t m_get_info_time;
+  std::shared_ptr<cache_t> m_cache;
+  boost::thread m_prefetch_thread;
+  std::atomic<bool> m_prefetching;
 };
 
 }
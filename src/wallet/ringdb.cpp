@@ -191,14 +191,16 @@ static size_t get_ring_data_size(size_t n_entries)
   return n_entries * (32 + 1024); // highball 1kB for the ring data to make sure
 }
 
-enum { BLACKBALL_BLACKBALL, BLACKBALL_UNBLACKBALL, BLACKBALL_QUERY, BLACKBALL_CLEAR};
+enum { BLACKBALL_BLACKBALL, BLACKBALL_UNBLACKBALL, BLACKBALL_CLEAR};
 
 namespace tools
 {
 
 ringdb::ringdb(std::string filename, const std::string &genesis):
   filename(filename),
-  env(NULL)
+  env(NULL),
+  blackballs_txnid(0),
+  blackballs_loaded(false)
 {
   MDB_txn *txn;
   bool tx_active = false;
@@ -250,33 +252,49 @@ void ringdb::close()
 }
 
 bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx)
+{
+  std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> rings;
+  for (const auto &in: tx.vin)
+  {
+    if (in.type() != typeid(cryptonote::txin_to_key))
+      continue;
+    const auto &txin = boost::get<cryptonote::txin_to_key>(in);
+    rings.push_back(std::make_pair(txin.k_image, txin.key_offsets));
+  }
+  return add_rings(chacha_key, rings);
+}
+
+bool ringdb::add_rings(const crypto::chacha_key &chacha_key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings)
 {
   MDB_txn *txn;
   int dbr;
   bool tx_active = false;
 
-  dbr = resize_env(env, filename.c_str(), get_ring_data_size(tx.vin.size()));
+  if (rings.empty())
+    return true;
+
+  dbr = resize_env(env, filename.c_str(), get_ring_data_size(rings.size()));
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size");
   dbr = mdb_txn_begin(env, NULL, 0, &txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
   epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
   tx_active = true;
 
-  for (const auto &in: tx.vin)
+  bool wrote = false;
+  for (const auto &ring: rings)
   {
-    if (in.type() != typeid(cryptonote::txin_to_key))
-      continue;
-    const auto &txin = boost::get<cryptonote::txin_to_key>(in);
-    const uint32_t ring_size = txin.key_offsets.size();
-    if (ring_size == 1)
+    if (ring.second.size() == 1)
       continue;
 
-    store_relative_ring(txn, dbi_rings, txin.k_image, txin.key_offsets, chacha_key);
+    store_relative_ring(txn, dbi_rings, ring.first, ring.second, chacha_key);
+    wrote = true;
   }
 
+  const mdb_size_t txnid = mdb_txn_id(txn);
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn adding ring to database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
+  committed(txnid, wrote);
   return true;
 }
 
@@ -285,6 +303,7 @@ bool ringdb::remove_rings(const crypto::chacha_key &chacha_key, const cryptonote
   MDB_txn *txn;
   int dbr;
   bool tx_active = false;
+  bool wrote = false;
 
   dbr = resize_env(env, filename.c_str(), 0);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size");
@@ -316,11 +335,14 @@ bool ringdb::remove_rings(const crypto::chacha_key &chacha_key, const cryptonote
     MDEBUG("Removing ring data for key image " << txin.k_image);
     dbr = mdb_del(txn, dbi_rings, &key, NULL);
     THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to remove ring to database: " + std::string(mdb_strerror(dbr)));
+    wrote = true;
   }
 
+  const mdb_size_t txnid = mdb_txn_id(txn);
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn removing ring to database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
+  committed(txnid, wrote);
   return true;
 }
 
@@ -375,9 +397,11 @@ bool ringdb::set_ring(const crypto::chacha_key &chacha_key, const crypto::key_im
 
   store_relative_ring(txn, dbi_rings, key_image, relative ? outs : cryptonote::absolute_output_offsets_to_relative(outs), chacha_key);
 
+  const mdb_size_t txnid = mdb_txn_id(txn);
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn setting ring to database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
+  committed(txnid, true);
   return true;
 }
 
@@ -387,9 +411,7 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
   MDB_cursor *cursor;
   int dbr;
   bool tx_active = false;
-  bool ret = true;
-
-  THROW_WALLET_EXCEPTION_IF(outputs.size() > 1 && op == BLACKBALL_QUERY, tools::error::wallet_internal_error, "Blackball query only makes sense for a single output");
+  bool wrote = false;
 
   dbr = resize_env(env, filename.c_str(), 32 * 2 * outputs.size()); // a pubkey, and some slack
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
@@ -414,21 +436,19 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
       case BLACKBALL_BLACKBALL:
         MDEBUG("Marking output " << output.first << "/" << output.second << " as spent");
         dbr = mdb_cursor_put(cursor, &key, &data, MDB_APPENDDUP);
-        if (dbr == MDB_KEYEXIST)
+        if (dbr == 0)
+          wrote = true;
+        else if (dbr == MDB_KEYEXIST)
           dbr = 0;
         break;
       case BLACKBALL_UNBLACKBALL:
         MDEBUG("Marking output " << output.first << "/" << output.second << " as unspent");
         dbr = mdb_cursor_get(cursor, &key, &data, MDB_GET_BOTH);
         if (dbr == 0)
+        {
           dbr = mdb_cursor_del(cursor, 0);
-        break;
-      case BLACKBALL_QUERY:
-        dbr = mdb_cursor_get(cursor, &key, &data, MDB_GET_BOTH);
-        THROW_WALLET_EXCEPTION_IF(dbr && dbr != MDB_NOTFOUND, tools::error::wallet_internal_error, "Failed to lookup in blackballs table: " + std::string(mdb_strerror(dbr)));
-        ret = dbr != MDB_NOTFOUND;
-        if (dbr == MDB_NOTFOUND)
-          dbr = 0;
+          wrote = true;
+        }
         break;
       case BLACKBALL_CLEAR:
         break;
@@ -446,10 +466,79 @@ bool ringdb::blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &
     THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to clear blackballs table: " + std::string(mdb_strerror(dbr)));
   }
 
+  const mdb_size_t txnid = mdb_txn_id(txn);
   dbr = mdb_txn_commit(txn);
   THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to commit txn blackballing output to database: " + std::string(mdb_strerror(dbr)));
   tx_active = false;
-  return ret;
+
+  // keep the loaded set in step when nothing else got in between,
+  // otherwise the next lookup reloads it
+  if (blackballs_loaded && wrote && txnid == blackballs_txnid + 1)
+  {
+    for (const std::pair<uint64_t, uint64_t> &output: outputs)
+    {
+      if (op == BLACKBALL_BLACKBALL)
+        blackballs.insert(output);
+      else
+        blackballs.erase(output);
+    }
+  }
+  committed(txnid, wrote);
+  if (op == BLACKBALL_CLEAR)
+  {
+    blackballs.clear();
+    blackballs_loaded = false;
+  }
+  return true;
+}
+
+void ringdb::committed(mdb_size_t txnid, bool wrote)
+{
+  // a txn which wrote something is the db's next txn once committed. One
+  // which did not may not have moved it on, so leave that to the reload
+  if (blackballs_loaded && wrote && txnid == blackballs_txnid + 1)
+    blackballs_txnid = txnid;
+}
+
+void ringdb::load_blackballs()
+{
+  MDB_envinfo mei;
+  int dbr = mdb_env_info(env, &mei);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to get env info: " + std::string(mdb_strerror(dbr)));
+  if (blackballs_loaded && mei.me_last_txnid == blackballs_txnid)
+    return;
+
+  MDB_txn *txn;
+  MDB_cursor *cursor;
+  bool tx_active = false;
+
+  dbr = resize_env(env, filename.c_str(), 0);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to set env map size: " + std::string(mdb_strerror(dbr)));
+  dbr = mdb_txn_begin(env, NULL, MDB_RDONLY, &txn);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create LMDB transaction: " + std::string(mdb_strerror(dbr)));
+  epee::misc_utils::auto_scope_leave_caller txn_dtor = epee::misc_utils::create_scope_leave_handler([&](){if (tx_active) mdb_txn_abort(txn);});
+  tx_active = true;
+
+  dbr = mdb_cursor_open(txn, dbi_blackballs, &cursor);
+  THROW_WALLET_EXCEPTION_IF(dbr, tools::error::wallet_internal_error, "Failed to create cursor for blackballs table: " + std::string(mdb_strerror(dbr)));
+
+  blackballs_loaded = false;
+  blackballs.clear();
+  MDB_val key, data;
+  for (MDB_cursor_op op = MDB_FIRST; (dbr = mdb_cursor_get(cursor, &key, &data, op)) == 0; op = MDB_NEXT)
+  {
+    THROW_WALLET_EXCEPTION_IF(key.mv_size != sizeof(uint64_t) || data.mv_size != sizeof(uint64_t), tools::error::wallet_internal_error, "Invalid blackball entry size");
+    uint64_t amount, index;
+    memcpy(&amount, key.mv_data, sizeof(amount));
+    memcpy(&index, data.mv_data, sizeof(index));
+    blackballs.insert(std::make_pair(amount, index));
+  }
+  mdb_cursor_close(cursor);
+  THROW_WALLET_EXCEPTION_IF(dbr != MDB_NOTFOUND, tools::error::wallet_internal_error, "Failed to read blackballs table: " + std::string(mdb_strerror(dbr)));
+
+  blackballs_txnid = mdb_txn_id(txn);
+  blackballs_loaded = true;
+  MDEBUG("Loaded " << blackballs.size() << " blackballed outputs");
 }
 
 bool ringdb::blackball(const std::vector<std::pair<uint64_t, uint64_t>> &outputs)
@@ -471,8 +560,8 @@ bool ringdb::unblackball(const std::pair<uint64_t, uint64_t> &output)
 
 bool ringdb::blackballed(const std::pair<uint64_t, uint64_t> &output)
 {
-  std::vector<std::pair<uint64_t, uint64_t>> outputs(1, output);
-  return blackball_worker(outputs, BLACKBALL_QUERY);
+  load_blackballs();
+  return blackballs.find(output) != blackballs.end();
 }
 
 bool ringdb::clear_blackballs()
@@ -29,7 +29,9 @@
 #pragma once
 
 #include <string>
+#include <unordered_set>
 #include <vector>
+#include <boost/functional/hash.hpp>
 #include <lmdb.h>
 #include "wipeable_string.h"
 #include "crypto/crypto.h"
@@ -45,6 +47,7 @@ namespace tools
     ~ringdb();
 
     bool add_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx);
+    bool add_rings(const crypto::chacha_key &chacha_key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings);
     bool remove_rings(const crypto::chacha_key &chacha_key, const cryptonote::transaction_prefix &tx);
     bool get_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, std::vector<uint64_t> &outs);
     bool set_ring(const crypto::chacha_key &chacha_key, const crypto::key_image &key_image, const std::vector<uint64_t> &outs, bool relative);
@@ -57,11 +60,19 @@ namespace tools
 
   private:
     bool blackball_worker(const std::vector<std::pair<uint64_t, uint64_t>> &outputs, int op);
+    void load_blackballs();
+    void committed(mdb_size_t txnid, bool wrote);
 
   private:
     std::string filename;
     MDB_env *env;
     MDB_dbi dbi_rings;
     MDB_dbi dbi_blackballs;
+
+    // the blackballs table as of db txn blackballs_txnid; the db may be
+    // shared with other wallets, so any newer txn means reloading it
+    std::unordered_set<std::pair<uint64_t, uint64_t>, boost::hash<std::pair<uint64_t, uint64_t>>> blackballs;
+    mdb_size_t blackballs_txnid;
+    bool blackballs_loaded;
   };
 }
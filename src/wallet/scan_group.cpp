@@ -0,0 +1,121 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include "scan_group.h"
+#include "common/threadpool.h"
+#include "ringct/rctOps.h"
+#include "misc_log_ex.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
+
+namespace tools
+{
+
+void scan_group::add(const crypto::public_key &view_public_key, const crypto::secret_key &view_secret_key)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  auto i = m_members.find(view_public_key);
+  if (i != m_members.end())
+    ++i->second.refs;
+  else
+    m_members.emplace(view_public_key, member{view_secret_key, 1});
+}
+
+void scan_group::remove(const crypto::public_key &view_public_key)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  auto i = m_members.find(view_public_key);
+  if (i != m_members.end() && --i->second.refs == 0)
+    m_members.erase(i);
+}
+
+bool scan_group::has(const crypto::public_key &view_public_key) const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_members.find(view_public_key) != m_members.end();
+}
+
+size_t scan_group::size() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_members.size();
+}
+
+scan_group::derivations_t scan_group::derive(const std::vector<crypto::public_key> &pkeys) const
+{
+  std::vector<std::pair<crypto::public_key, crypto::secret_key>> members;
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    members.reserve(m_members.size());
+    for (const auto &e: m_members)
+      members.push_back(std::make_pair(e.first, e.second.view_secret_key));
+  }
+
+  std::vector<std::shared_ptr<std::vector<crypto::key_derivation>>> results(members.size());
+  for (auto &r: results)
+    r = std::make_shared<std::vector<crypto::key_derivation>>(pkeys.size());
+
+  // one task per member and batch of keys, all in the same pass
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  std::vector<std::function<void()>> jobs;
+  for (size_t m = 0; m < members.size(); ++m)
+  {
+    for (size_t start = 0; start < pkeys.size(); start += derivation_batch_size)
+    {
+      const size_t count = std::min(derivation_batch_size, pkeys.size() - start);
+      jobs.push_back([&pkeys, &members, &results, m, start, count]() {
+        crypto::key_derivation *derivations = results[m]->data() + start;
+        std::unique_ptr<bool[]> valid(new bool[count]);
+        crypto::generate_key_derivations_batch(pkeys.data() + start, count, members[m].second, derivations, valid.get());
+        for (size_t k = 0; k < count; ++k)
+        {
+          if (!valid[k])
+          {
+            MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+            static_assert(sizeof(crypto::key_derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+            memcpy(&derivations[k], rct::identity().bytes, sizeof(crypto::key_derivation));
+          }
+        }
+      });
+    }
+  }
+  tpool.submit_bulk(&waiter, std::move(jobs), true);
+  waiter.wait(&tpool);
+
+  derivations_t derivations;
+  for (size_t m = 0; m < members.size(); ++m)
+    derivations.emplace(members[m].first, std::move(results[m]));
+  return derivations;
+}
+
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "crypto/crypto.h"
+
+namespace tools
+{
+
+// The view keys of the wallets of a process which scan the same blocks, so
+// that the tx pubkeys of a span are derived against all of them in a single
+// pass on the threadpool, instead of one pass per wallet.
+class scan_group
+{
+public:
+  typedef std::unordered_map<crypto::public_key, std::shared_ptr<const std::vector<crypto::key_derivation>>> derivations_t;
+
+  static const size_t derivation_batch_size = 256;
+
+  // wallets sharing a view key (eg, the same wallet opened twice) share its entry
+  void add(const crypto::public_key &view_public_key, const crypto::secret_key &view_secret_key);
+  void remove(const crypto::public_key &view_public_key);
+  bool has(const crypto::public_key &view_public_key) const;
+  size_t size() const;
+
+  // derivations of each key against each member view key, in the order of the keys,
+  // with the identity for keys which are not valid points
+  derivations_t derive(const std::vector<crypto::public_key> &pkeys) const;
+
+private:
+  struct member
+  {
+    crypto::secret_key view_secret_key;
+    size_t refs;
+  };
+
+  mutable boost::mutex m_mutex;
+  std::unordered_map<crypto::public_key, member> m_members;
+};
+
+}
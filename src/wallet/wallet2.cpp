@@ -61,6 +61,7 @@ using namespace epee;
 #include "mnemonics/electrum-words.h"
 #include "common/i18n.h"
 #include "common/util.h"
+#include "common/int-util.h"
 #include "common/apply_permutation.h"
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
@@ -72,6 +73,8 @@ using namespace epee;
 #include "common/notify.h"
 #include "ringct/rctSigs.h"
 #include "ringdb.h"
+#include "blockdb.h"
+#include "daemon_notifier.h"
 
 extern "C"
 {
@@ -95,6 +98,8 @@ using namespace cryptonote;
 #define CHACHA8_KEY_TAIL 0x8c
 #define CACHE_KEY_TAIL 0x8d
 
+#define MAX_KDF_LANES 64 // each lane has its own 2 MB scratchpad while the key is derived
+
 #define UNSIGNED_TX_PREFIX "Electroneum unsigned tx set\003"
 #define SIGNED_TX_PREFIX "Electroneum signed tx set\003"
 #define MULTISIG_UNSIGNED_TX_PREFIX "Electroneum multisig unsigned tx set\001"
@@ -105,17 +110,21 @@ using namespace cryptonote;
 #define RECENT_OUTPUT_BLOCKS (RECENT_OUTPUT_DAYS * 720)
 
 #define FEE_ESTIMATE_GRACE_BLOCKS 10 // estimate fee valid for that many blocks
+#define BLOCKDB_MIN_DEPTH 10 // blocks closer to the top may still be reorganized away, don't keep them on disk
+#define DAEMON_RPC_POOL_CONNECTIONS 2 // besides m_http_client
 
 #define SECOND_OUTPUT_RELATEDNESS_THRESHOLD 0.0f
 
 #define SUBADDRESS_LOOKAHEAD_MAJOR 50
 #define SUBADDRESS_LOOKAHEAD_MINOR 200
 
-#define KEY_IMAGE_EXPORT_FILE_MAGIC "Electroneum key image export\002"
+#define KEY_IMAGE_EXPORT_FILE_MAGIC "Electroneum key image export\003"
+#define KEY_IMAGE_EXPORT_FILE_MAGIC_V2 "Electroneum key image export\002" // no offset
 
 #define MULTISIG_EXPORT_FILE_MAGIC "Electroneum multisig export\001"
 
-#define OUTPUT_EXPORT_FILE_MAGIC "Electroneum output export\003"
+#define OUTPUT_EXPORT_FILE_MAGIC "Electroneum output export\004"
+#define OUTPUT_EXPORT_FILE_MAGIC_V3 "Electroneum output export\003" // boost serialized transfer_details
 
 #define SEGREGATION_FORK_HEIGHT 99999999
 #define TESTNET_SEGREGATION_FORK_HEIGHT 99999999
@@ -124,6 +133,15 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY     1024
 
+#define DEFAULT_REFRESH_PIPELINE_DEPTH 2 // batches buffered between each pair of refresh stages
+#define HASHCHAIN_SPARSE_INTERVAL 1000 // blocks between hashes kept below the hash chain tail
+
+#define CACHE_JOURNAL_SUFFIX ".journal"
+
+#define RCT_DISTRIBUTION_REFRESH_OVERLAP 32 // blocks re-requested on top of the cached rct distribution, to catch reorgs
+#define CACHE_JOURNAL_MAX_RECORDS 256 // the cache file is rewritten after that many stores...
+#define CACHE_JOURNAL_MAX_RATIO 2 // ... or once the journal reaches 1/ratio of its size
+
 #define GAMMA_PICK_HALF_WINDOW 5
 
 static const std::string MULTISIG_SIGNATURE_MAGIC = "SigMultisigPkV1";
@@ -203,7 +221,10 @@ struct options {
       return val;
     }
   };
+  const command_line::arg_descriptor<std::string> shared_blockdb_dir = {"shared-blockdb-dir", tools::wallet2::tr("Keep fetched blocks in a database at this path, shared by the wallets of this host, so rescans and restores do not download them again"), ""};
+  const command_line::arg_descriptor<std::string> daemon_zmq_pub = {"daemon-zmq-pub", tools::wallet2::tr("Refresh when the daemon publishes block or tx pool events at this ZMQ address (its --zmq-pub) instead of polling it"), ""};
   const command_line::arg_descriptor<uint64_t> kdf_rounds = {"kdf-rounds", tools::wallet2::tr("Number of rounds for the key derivation function"), 1};
+  const command_line::arg_descriptor<uint32_t> kdf_lanes = {"kdf-lanes", tools::wallet2::tr("Number of parallel key derivation chains for new wallets, each of kdf-rounds rounds (0 for the original single chain)"), 0};
   const command_line::arg_descriptor<std::string> hw_device = {"hw-device", tools::wallet2::tr("HW device to use"), ""};
   const command_line::arg_descriptor<std::string> tx_notify = { "tx-notify" , "Run a program for each new incoming transaction, '%s' will be replaced by the transaction hash" , "" };
 };
@@ -252,6 +273,8 @@ std::unique_ptr<tools::wallet2> make_basic(const boost::program_options::variabl
   const network_type nettype = testnet ? TESTNET : stagenet ? STAGENET : MAINNET;
   const uint64_t kdf_rounds = command_line::get_arg(vm, opts.kdf_rounds);
   THROW_WALLET_EXCEPTION_IF(kdf_rounds == 0, tools::error::wallet_internal_error, "KDF rounds must not be 0");
+  const uint32_t kdf_lanes = command_line::get_arg(vm, opts.kdf_lanes);
+  THROW_WALLET_EXCEPTION_IF(kdf_lanes > MAX_KDF_LANES, tools::error::wallet_internal_error, "KDF lanes must not be more than " + std::to_string(MAX_KDF_LANES));
 
   auto daemon_address = command_line::get_arg(vm, opts.daemon_address);
   auto daemon_host = command_line::get_arg(vm, opts.daemon_host);
@@ -311,7 +334,10 @@ std::unique_ptr<tools::wallet2> make_basic(const boost::program_options::variabl
   wallet->init(std::move(daemon_address), std::move(login), 0, false, *trusted_daemon);
   boost::filesystem::path ringdb_path = command_line::get_arg(vm, opts.shared_ringdb_dir);
   wallet->set_ring_database(ringdb_path.string());
+  wallet->set_block_database(command_line::get_arg(vm, opts.shared_blockdb_dir));
+  wallet->set_daemon_events_address(command_line::get_arg(vm, opts.daemon_zmq_pub));
   wallet->device_name(device_name);
+  wallet->kdf_lanes(kdf_lanes);
 
   try
   {
@@ -603,6 +629,25 @@ static void emplace_or_replace(std::unordered_multimap<crypto::hash, tools::wall
   container.emplace(key, pd);
 }
 
+static crypto::hash get_transfer_state_hash(const tools::wallet2::transfer_details &td)
+{
+  // m_tx does not change once an output is recorded, so it is left out
+  tools::wallet2::transfer_details &t = const_cast<tools::wallet2::transfer_details&>(td);
+  std::ostringstream oss;
+  binary_archive<true> ar(oss);
+  bool r = ::do_serialize(ar, t.m_block_height) && ::do_serialize(ar, t.m_txid) &&
+      ::do_serialize(ar, t.m_internal_output_index) && ::do_serialize(ar, t.m_global_output_index) &&
+      ::do_serialize(ar, t.m_spent) && ::do_serialize(ar, t.m_spent_height) &&
+      ::do_serialize(ar, t.m_key_image) && ::do_serialize(ar, t.m_mask) &&
+      ::do_serialize(ar, t.m_amount) && ::do_serialize(ar, t.m_rct) &&
+      ::do_serialize(ar, t.m_key_image_known) && ::do_serialize(ar, t.m_pk_index) &&
+      ::do_serialize(ar, t.m_subaddr_index) && ::do_serialize(ar, t.m_key_image_partial) &&
+      ::do_serialize(ar, t.m_multisig_k) && ::do_serialize(ar, t.m_multisig_info);
+  THROW_WALLET_EXCEPTION_IF(!r, tools::error::wallet_internal_error, "Failed to serialize transfer details");
+  const std::string blob = oss.str();
+  return crypto::cn_fast_hash(blob.data(), blob.size());
+}
+
 void drop_from_short_history(std::list<crypto::hash> &short_chain_history, size_t N)
 {
   std::list<crypto::hash>::iterator right;
@@ -812,9 +857,12 @@ wallet_keys_unlocker::~wallet_keys_unlocker()
 }
 
 wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
+  m_http_client_pool(DAEMON_RPC_POOL_CONNECTIONS),
   m_multisig_rescan_info(NULL),
   m_multisig_rescan_k(NULL),
   m_run(true),
+  m_transfer_indexes_valid(false),
+  m_balance_cache_transfers(0),
   m_callback(0),
   m_trusted_daemon(false),
   m_nettype(nettype),
@@ -827,6 +875,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_refresh_type(RefreshOptimizeCoinbase),
   m_auto_refresh(true),
   m_first_refresh_done(false),
+  m_cache_journal(),
+  m_history_loaded(true),
   m_refresh_from_block_height(0),
   m_explicit_refresh_from_block_height(true),
   m_confirm_missing_payment_id(true),
@@ -842,11 +892,18 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_segregate_pre_fork_outputs(true),
   m_key_reuse_mitigation2(true),
   m_segregation_height(0),
+  m_refresh_pipeline_depth(DEFAULT_REFRESH_PIPELINE_DEPTH),
+  m_hashchain_tail(0),
   m_ignore_fractional_outputs(true),
+  m_parallel_tx_construction(false),
   m_is_initialized(false),
   m_kdf_rounds(kdf_rounds),
+  m_kdf_lanes(0),
   is_old_file_format(false),
   m_node_rpc_proxy(m_http_client, m_daemon_rpc_mutex),
+  m_rct_distribution_start_height(0),
+  m_pool_instance(0),
+  m_pool_cookie(0),
   m_subaddress_lookahead_major(SUBADDRESS_LOOKAHEAD_MAJOR),
   m_subaddress_lookahead_minor(SUBADDRESS_LOOKAHEAD_MINOR),
   m_light_wallet(false),
@@ -858,6 +915,9 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
   m_key_device_type(hw::device::device_type::SOFTWARE),
   m_ring_history_saved(false),
   m_ringdb(),
+  m_blockdb(),
+  m_daemon_event(false),
+  m_batch_rings(false),
   m_last_block_reward(0),
   m_encrypt_keys_after_refresh(boost::none),
   m_unattended(unattended)
@@ -866,6 +926,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended):
 
 wallet2::~wallet2()
 {
+  batch_callbacks(false);
+  leave_scan_group();
 }
 
 bool wallet2::has_testnet_option(const boost::program_options::variables_map& vm)
@@ -897,7 +959,10 @@ void wallet2::init_options(boost::program_options::options_description& desc_par
   command_line::add_arg(desc_params, opts.testnet);
   command_line::add_arg(desc_params, opts.stagenet);
   command_line::add_arg(desc_params, opts.shared_ringdb_dir);
+  command_line::add_arg(desc_params, opts.shared_blockdb_dir);
+  command_line::add_arg(desc_params, opts.daemon_zmq_pub);
   command_line::add_arg(desc_params, opts.kdf_rounds);
+  command_line::add_arg(desc_params, opts.kdf_lanes);
   command_line::add_arg(desc_params, opts.hw_device);
   command_line::add_arg(desc_params, opts.tx_notify);
 }
@@ -946,13 +1011,17 @@ std::unique_ptr<wallet2> wallet2::make_dummy(const boost::program_options::varia
 bool wallet2::init(std::string daemon_address, boost::optional<epee::net_utils::http::login> daemon_login, uint64_t upper_transaction_weight_limit, bool ssl, bool trusted_daemon)
 {
   m_checkpoints.init_default_checkpoints(m_nettype);
-  if(m_http_client.is_connected())
-    m_http_client.disconnect();
   m_is_initialized = true;
   m_upper_transaction_weight_limit = upper_transaction_weight_limit;
   m_daemon_address = std::move(daemon_address);
   m_daemon_login = std::move(daemon_login);
   m_trusted_daemon = trusted_daemon;
+  // waits for any background refresh on the old connection
+  m_node_rpc_proxy.set_daemon_address(get_daemon_address());
+  if(m_http_client.is_connected())
+    m_http_client.disconnect();
+  invalidate_output_distribution_cache();
+  m_http_client_pool.set_server(get_daemon_address(), get_daemon_login(), ssl);
   // When switching from light wallet to full wallet, we need to reset the height we got from lw node.
   return m_http_client.set_server(get_daemon_address(), get_daemon_login(), ssl);
 }
@@ -1113,8 +1182,25 @@ crypto::public_key wallet2::get_subaddress_spend_public_key(const cryptonote::su
 //----------------------------------------------------------------------------------------------------
 std::string wallet2::get_subaddress_as_str(const cryptonote::subaddress_index& index) const
 {
+  // deriving the subaddress keys costs far more than encoding them, and RPC
+  // listings ask for the same few addresses once per entry
+  {
+    boost::lock_guard<boost::mutex> lock(m_subaddress_str_cache_mutex);
+    auto i = m_subaddress_str_cache.find(index);
+    if (i != m_subaddress_str_cache.end())
+      return i->second;
+  }
   cryptonote::account_public_address address = get_subaddress(index);
-  return cryptonote::get_account_address_as_str(m_nettype, !index.is_zero(), address);
+  std::string str = cryptonote::get_account_address_as_str(m_nettype, !index.is_zero(), address);
+  boost::lock_guard<boost::mutex> lock(m_subaddress_str_cache_mutex);
+  m_subaddress_str_cache.emplace(index, str);
+  return str;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::clear_subaddress_str_cache()
+{
+  boost::lock_guard<boost::mutex> lock(m_subaddress_str_cache_mutex);
+  m_subaddress_str_cache.clear();
 }
 //----------------------------------------------------------------------------------------------------
 std::string wallet2::get_integrated_address_as_str(const crypto::hash8& payment_id) const
@@ -1137,23 +1223,65 @@ void wallet2::add_subaddress(uint32_t index_major, const std::string& label)
   m_subaddress_labels[index_major][index_minor] = label;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
+void wallet2::add_subaddress_spend_keys(uint32_t index_major, uint32_t begin, uint32_t end)
 {
+  if (m_subaddress_keys_generated.size() <= index_major)
+    m_subaddress_keys_generated.resize(index_major + 1, 0);
+  // keys already derived by an earlier expansion in this session need not be derived again
+  begin = std::max(begin, m_subaddress_keys_generated[index_major]);
+  if (begin >= end)
+    return;
+
   hw::device &hwdev = m_account.get_device();
+  const cryptonote::account_keys &keys = m_account.get_keys();
+  std::vector<crypto::public_key> pkeys;
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  static const uint32_t chunk_size = 256;
+  if (hwdev.get_type() == hw::device::device_type::SOFTWARE && end - begin > chunk_size && tpool.get_max_concurrency() > 1)
+  {
+    // large lookaheads: derive the keys in chunks on the threadpool
+    pkeys.resize(end - begin);
+    std::atomic<bool> failed(false);
+    tools::threadpool::waiter waiter;
+    for (uint32_t chunk_begin = begin; chunk_begin < end; chunk_begin += std::min(chunk_size, end - chunk_begin))
+    {
+      const uint32_t chunk_end = chunk_begin + std::min(chunk_size, end - chunk_begin);
+      tpool.submit(&waiter, [&, chunk_begin, chunk_end](){
+        try
+        {
+          const std::vector<crypto::public_key> chunk = hwdev.get_subaddress_spend_public_keys(keys, index_major, chunk_begin, chunk_end);
+          std::copy(chunk.begin(), chunk.end(), pkeys.begin() + (chunk_begin - begin));
+        }
+        catch (...)
+        {
+          failed = true;
+        }
+      });
+    }
+    waiter.wait(&tpool);
+    THROW_WALLET_EXCEPTION_IF(failed, error::wallet_internal_error, "Failed to derive subaddress spend public keys");
+  }
+  else
+  {
+    pkeys = hwdev.get_subaddress_spend_public_keys(keys, index_major, begin, end);
+  }
+
+  m_subaddresses.reserve(m_subaddresses.size() + pkeys.size());
+  for (uint32_t minor = begin; minor < end; ++minor)
+    m_subaddresses[pkeys[minor - begin]] = {index_major, minor};
+  m_subaddress_keys_generated[index_major] = end;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
+{
   if (m_subaddress_labels.size() <= index.major)
   {
     // add new accounts
-    cryptonote::subaddress_index index2;
     const uint32_t major_end = get_subaddress_clamped_sum(index.major, m_subaddress_lookahead_major);
-    for (index2.major = m_subaddress_labels.size(); index2.major < major_end; ++index2.major)
+    for (uint32_t major = m_subaddress_labels.size(); major < major_end; ++major)
     {
-      const uint32_t end = get_subaddress_clamped_sum((index2.major == index.major ? index.minor : 0), m_subaddress_lookahead_minor);
-      const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, 0, end);
-      for (index2.minor = 0; index2.minor < end; ++index2.minor)
-      {
-         const crypto::public_key &D = pkeys[index2.minor];
-         m_subaddresses[D] = index2;
-      }
+      const uint32_t end = get_subaddress_clamped_sum((major == index.major ? index.minor : 0), m_subaddress_lookahead_minor);
+      add_subaddress_spend_keys(major, 0, end);
     }
     m_subaddress_labels.resize(index.major + 1, {"Untitled account"});
     m_subaddress_labels[index.major].resize(index.minor + 1);
@@ -1163,14 +1291,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
   {
     // add new subaddresses
     const uint32_t end = get_subaddress_clamped_sum(index.minor, m_subaddress_lookahead_minor);
-    const uint32_t begin = m_subaddress_labels[index.major].size();
-    cryptonote::subaddress_index index2 = {index.major, begin};
-    const std::vector<crypto::public_key> pkeys = hwdev.get_subaddress_spend_public_keys(m_account.get_keys(), index2.major, index2.minor, end);
-    for (; index2.minor < end; ++index2.minor)
-    {
-       const crypto::public_key &D = pkeys[index2.minor - begin];
-       m_subaddresses[D] = index2;
-    }
+    add_subaddress_spend_keys(index.major, m_subaddress_labels[index.major].size(), end);
     m_subaddress_labels[index.major].resize(index.minor + 1);
   }
 }
@@ -1212,6 +1333,19 @@ void wallet2::set_spent(size_t idx, uint64_t height)
 {
   transfer_details &td = m_transfers[idx];
   LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
+  if (!td.m_spent && idx < m_balance_cache_transfers)
+  {
+    balance_cache_entry &e = m_balance_cache[td.m_subaddr_index.major][td.m_subaddr_index.minor];
+    e.amount -= td.amount();
+    --e.count;
+    m_unspent_transfers[td.m_subaddr_index.major][td.m_subaddr_index.minor].erase(idx);
+    if (m_locked_transfers.erase(idx) == 0)
+    {
+      balance_cache_entry &u = m_unlocked_balance_cache[td.m_subaddr_index.major][td.m_subaddr_index.minor];
+      u.amount -= td.amount();
+      --u.count;
+    }
+  }
   td.m_spent = true;
   td.m_spent_height = height;
 }
@@ -1220,6 +1354,14 @@ void wallet2::set_unspent(size_t idx)
 {
   transfer_details &td = m_transfers[idx];
   LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
+  if (td.m_spent && idx < m_balance_cache_transfers)
+  {
+    balance_cache_entry &e = m_balance_cache[td.m_subaddr_index.major][td.m_subaddr_index.minor];
+    e.amount += td.amount();
+    ++e.count;
+    m_locked_transfers.insert(idx);
+    m_unspent_transfers[td.m_subaddr_index.major][td.m_subaddr_index.minor].insert(idx);
+  }
   td.m_spent = false;
   td.m_spent_height = 0;
 }
@@ -1236,6 +1378,7 @@ void wallet2::check_acc_out_precomp(const tx_out &o, const crypto::key_derivatio
      return;
   }
   tx_scan_info.received = is_out_to_acc_precomp(m_subaddresses, boost::get<txout_to_key>(o.target).key, derivation, additional_derivations, i, hwdev);
+  tx_scan_info.key_image_precomputed = false;
   if(tx_scan_info.received)
   {
     tx_scan_info.money_transfered = o.amount; // may be 0 for ringct outputs
@@ -1253,6 +1396,13 @@ void wallet2::check_acc_out_precomp(const tx_out &o, const crypto::key_derivatio
     return check_acc_out_precomp(o, derivation, additional_derivations, i, tx_scan_info);
 
   tx_scan_info.received = is_out_data->received[i];
+  tx_scan_info.key_image_precomputed = false;
+  if (tx_scan_info.received && i < is_out_data->key_images.size() && is_out_data->key_images[i])
+  {
+    tx_scan_info.in_ephemeral = is_out_data->key_images[i]->first;
+    tx_scan_info.ki = is_out_data->key_images[i]->second;
+    tx_scan_info.key_image_precomputed = true;
+  }
   if(tx_scan_info.received)
   {
     tx_scan_info.money_transfered = o.amount; // may be 0 for ringct outputs
@@ -1304,7 +1454,7 @@ void wallet2::scan_output(const cryptonote::transaction &tx, const crypto::publi
   THROW_WALLET_EXCEPTION_IF(i >= tx.vout.size(), error::wallet_internal_error, "Invalid vout index");
 
   // if keys are encrypted, ask for password
-  if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_watch_only && !m_multisig_rescan_k)
+  if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_watch_only && !m_multisig_rescan_k && !tx_scan_info.key_image_precomputed)
   {
     static critical_section password_lock;
     CRITICAL_REGION_LOCAL(password_lock);
@@ -1324,7 +1474,7 @@ void wallet2::scan_output(const cryptonote::transaction &tx, const crypto::publi
     tx_scan_info.in_ephemeral.sec = crypto::null_skey;
     tx_scan_info.ki = rct::rct2ki(rct::zero());
   }
-  else
+  else if (!tx_scan_info.key_image_precomputed)
   {
     bool r = cryptonote::generate_key_image_helper_precomp(m_account.get_keys(), boost::get<cryptonote::txout_to_key>(tx.vout[i].target).key, tx_scan_info.received->derivation, i, tx_scan_info.received->index, tx_scan_info.in_ephemeral, tx_scan_info.ki, m_account.get_device());
     THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to generate key image");
@@ -1342,11 +1492,66 @@ void wallet2::scan_output(const cryptonote::transaction &tx, const crypto::publi
   ++num_vouts_received;
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::precompute_key_images(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
+{
+  // key images need the spend key, a hardware device computes them one at a time on the device,
+  // and encrypted keys are left for scan_output to ask the password for
+  if (m_watch_only || m_multisig || m_account.get_device().get_type() != hw::device::SOFTWARE)
+    return;
+  if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_encrypt_keys_after_refresh)
+    return;
+
+  const cryptonote::account_keys &keys = m_account.get_keys();
+  hw::device &hwdev = m_account.get_device();
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+
+  auto genki = [&](const cryptonote::transaction &tx, size_t txidx) {
+    for (is_out_data &iod: tx_cache_data[txidx].primary)
+    {
+      iod.key_images.resize(iod.received.size());
+      for (size_t k = 0; k < iod.received.size() && k < tx.vout.size(); ++k)
+      {
+        if (!iod.received[k])
+          continue;
+        const crypto::public_key &out_key = boost::get<cryptonote::txout_to_key>(tx.vout[k].target).key;
+        cryptonote::keypair in_ephemeral;
+        crypto::key_image ki;
+        // failures are left for scan_output to report
+        if (cryptonote::generate_key_image_helper_precomp(keys, out_key, iod.received[k]->derivation, k, iod.received[k]->index, in_ephemeral, ki, hwdev) && in_ephemeral.pub == out_key)
+          iod.key_images[k] = std::make_pair(in_ephemeral, ki);
+      }
+    }
+  };
+  auto has_received = [&](size_t txidx) {
+    for (const is_out_data &iod: tx_cache_data[txidx].primary)
+      for (const auto &received: iod.received)
+        if (received)
+          return true;
+    return false;
+  };
+
+  size_t txidx = 0;
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
+  {
+    if (txidx < tx_cache_data.size() && has_received(txidx))
+      tpool.submit(&waiter, [&, i, txidx](){ genki(parsed_blocks[i].block.miner_tx, txidx); }, true);
+    ++txidx;
+    for (size_t j = 0; j < parsed_blocks[i].txes.size(); ++j)
+    {
+      if (txidx < tx_cache_data.size() && has_received(txidx))
+        tpool.submit(&waiter, [&, i, j, txidx](){ genki(parsed_blocks[i].txes[j], txidx); }, true);
+      ++txidx;
+    }
+  }
+  waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::cache_tx_data(const cryptonote::transaction& tx, const crypto::hash &txid, tx_cache_data &tx_cache_data) const
 {
   const cryptonote::account_keys& keys = m_account.get_keys();
 
-  if(!parse_tx_extra(tx.extra, tx_cache_data.tx_extra_fields))
+  if(!parse_tx_extra(tx, tx_cache_data.tx_extra_fields))
   {
     // Extra may only be partially parsed, it's OK if tx_extra_fields contains public key
     LOG_PRINT_L0("Transaction extra has unsupported format: " << txid);
@@ -1367,7 +1572,7 @@ void wallet2::cache_tx_data(const cryptonote::transaction& tx, const crypto::has
       tx_extra_pub_key pub_key_field;
       size_t pk_index = 0;
       while (find_tx_extra_field_by_type(tx_cache_data.tx_extra_fields, pub_key_field, pk_index++))
-        tx_cache_data.primary.push_back({pub_key_field.pub_key, {}, rec});
+        tx_cache_data.primary.push_back({pub_key_field.pub_key, {}, rec, {}});
 
       // additional tx pubkeys and derivations for multi-destination transfers involving one or more subaddresses
       tx_extra_additional_pub_keys additional_tx_pub_keys;
@@ -1375,7 +1580,7 @@ void wallet2::cache_tx_data(const cryptonote::transaction& tx, const crypto::has
       if (find_tx_extra_field_by_type(tx_cache_data.tx_extra_fields, additional_tx_pub_keys))
       {
         for (size_t i = 0; i < additional_tx_pub_keys.data.size(); ++i)
-          tx_cache_data.additional.push_back({additional_tx_pub_keys.data[i], {}, {}});
+          tx_cache_data.additional.push_back({additional_tx_pub_keys.data[i], {}, {}, {}});
       }
     }
   }
@@ -1383,6 +1588,7 @@ void wallet2::cache_tx_data(const cryptonote::transaction& tx, const crypto::has
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote::transaction& tx, const std::vector<uint64_t> &o_indices, uint64_t height, uint64_t ts, bool miner_tx, bool pool, bool double_spend_seen, const tx_cache_data &tx_cache_data)
 {
+  load_history();
   // In this function, tx (probably) only contains the base information
   // (that is, the prunable stuff may or may not be included)
   if (!miner_tx && !pool)
@@ -1394,7 +1600,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
   std::vector<tx_extra_field> local_tx_extra_fields;
   if (tx_cache_data.tx_extra_fields.empty())
   {
-    if(!parse_tx_extra(tx.extra, local_tx_extra_fields))
+    if(!parse_tx_extra(tx, local_tx_extra_fields))
     {
       // Extra may only be partially parsed, it's OK if tx_extra_fields contains public key
       LOG_PRINT_L0("Transaction extra has unsupported format: " << txid);
@@ -1591,6 +1797,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 	    td.m_internal_output_index = o;
 	    td.m_global_output_index = o_indices[o];
 	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
+	    td.compact_tx();
 	    td.m_txid = txid;
             td.m_key_image = tx_scan_info[o].ki;
             td.m_key_image_known = !m_watch_only && !m_multisig;
@@ -1626,7 +1833,9 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
                 update_multisig_rescan_info(*m_multisig_rescan_k, *m_multisig_rescan_info, m_transfers.size() - 1);
             }
 	    LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << txid);
-	    if (0 != m_callback)
+	    if (m_event_dispatcher)
+	      m_pending_events.push_back({wallet_event::money_received, height, txid, td.m_amount, td.m_subaddr_index});
+	    else if (0 != m_callback)
 	      m_callback->on_money_received(height, txid, tx, td.m_amount, td.m_subaddr_index);
           }
           total_received_1 += amount;
@@ -1659,10 +1868,12 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           if (!pool)
           {
             transfer_details &td = m_transfers[kit->second];
+            invalidate_balance_cache();
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
 	    td.m_global_output_index = o_indices[o];
 	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
+	    td.compact_tx();
 	    td.m_txid = txid;
             td.m_amount = amount;
             td.m_pk_index = pk_index - 1;
@@ -1694,7 +1905,9 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 	    THROW_WALLET_EXCEPTION_IF(td.m_spent, error::wallet_internal_error, "Inconsistent spent status");
 
 	    LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << txid);
-	    if (0 != m_callback)
+	    if (m_event_dispatcher)
+	      m_pending_events.push_back({wallet_event::money_received, height, txid, td.m_amount, td.m_subaddr_index});
+	    else if (0 != m_callback)
 	      m_callback->on_money_received(height, txid, tx, td.m_amount, td.m_subaddr_index);
           }
           total_received_1 += extra_amount;
@@ -1729,6 +1942,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           //   1) the same output pub key was used as destination multiple times,
           //   2) the wallet set the highest amount among them to transfer_details::m_amount, and
           //   3) the wallet somehow spent that output with an amount smaller than the above amount, causing inconsistency
+          invalidate_balance_cache();
           td.m_amount = amount;
         }
       }
@@ -1745,7 +1959,9 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
       {
         LOG_PRINT_L0("Spent money: " << print_money(amount) << ", with tx: " << txid);
         set_spent(it->second, height);
-        if (0 != m_callback)
+        if (m_event_dispatcher)
+          m_pending_events.push_back({wallet_event::money_spent, height, txid, amount, td.m_subaddr_index});
+        else if (0 != m_callback)
           m_callback->on_money_spent(height, txid, tx, amount, tx, td.m_subaddr_index);
       }
     }
@@ -1851,11 +2067,13 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
       payment.m_subaddr_index = i.first;
       if (pool) {
         emplace_or_replace(m_unconfirmed_payments, payment_id, pool_payment_details{payment, double_spend_seen});
-        if (0 != m_callback)
+        if (m_event_dispatcher)
+          m_pending_events.push_back({wallet_event::unconfirmed_money_received, height, txid, payment.m_amount, payment.m_subaddr_index});
+        else if (0 != m_callback)
           m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
       }
       else
-        m_payments.emplace(payment_id, payment);
+        index_payment(*m_payments.emplace(payment_id, payment));
       LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
     }
   }
@@ -1870,6 +2088,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height)
 {
+  load_history();
   if (m_unconfirmed_txs.empty())
     return;
 
@@ -1877,7 +2096,9 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
   if(unconf_it != m_unconfirmed_txs.end()) {
     if (store_tx_info()) {
       try {
-        m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        auto entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        if (entry.second)
+          index_confirmed_tx(*entry.first);
       }
       catch (...) {
         // can fail if the tx has unexpected input types
@@ -1890,7 +2111,11 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
 //----------------------------------------------------------------------------------------------------
 void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::transaction &tx, uint64_t height, uint64_t ts, uint64_t spent, uint64_t received, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices)
 {
+  load_history();
   std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
+  // an existing entry may be indexed under another height
+  if (!entry.second && entry.first->second.m_block_height != height)
+    invalidate_transfer_indexes();
   // fill with the info we know, some info might already be there
   if (entry.second)
   {
@@ -1905,7 +2130,7 @@ void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::trans
     entry.first->second.m_change = received;
 
     std::vector<tx_extra_field> tx_extra_fields;
-    parse_tx_extra(tx.extra, tx_extra_fields); // ok if partially parsed
+    parse_tx_extra(tx, tx_extra_fields); // ok if partially parsed
     tx_extra_nonce extra_nonce;
     if (find_tx_extra_field_by_type(tx_extra_fields, extra_nonce))
     {
@@ -1926,6 +2151,8 @@ void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::trans
   entry.first->second.m_block_height = height;
   entry.first->second.m_timestamp = ts;
   entry.first->second.m_unlock_time = tx.unlock_time;
+  if (entry.second)
+    index_confirmed_tx(*entry.first);
 
   add_rings(tx);
 }
@@ -1964,7 +2191,9 @@ void wallet2::process_new_blockchain_entry(const cryptonote::block& b, const cry
   }
   m_blockchain.push_back(bl_id);
 
-  if (0 != m_callback)
+  if (m_event_dispatcher)
+    m_pending_events.push_back({wallet_event::new_block, height, bl_id, 0, {}});
+  else if (0 != m_callback)
     m_callback->on_new_block(height, b);
 }
 //----------------------------------------------------------------------------------------------------
@@ -1997,6 +2226,16 @@ void wallet2::get_short_chain_history(std::list<crypto::hash>& ids, uint64_t gra
   }
   if(!base_included)
     ids.push_back(m_blockchain[m_blockchain.offset()]);
+  // sparse hashes below the offset, so a reorg deeper than the tail still finds a recent common block
+  const std::map<size_t, crypto::hash> &sparse = m_blockchain.sparse();
+  size_t n = 0, next = 0, step = 1;
+  for (auto it = sparse.rbegin(); it != sparse.rend(); ++it, ++n)
+  {
+    if (n != next)
+      continue;
+    ids.push_back(it->second);
+    next += n < 10 ? 1 : (step *= 2);
+  }
   if(m_blockchain.offset())
     ids.push_back(m_blockchain.genesis());
 }
@@ -2008,7 +2247,7 @@ void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::bl
     bl_id = get_block_hash(bl);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t &current_height)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
@@ -2017,9 +2256,7 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
   req.prune = true;
   req.start_height = start_height;
   req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, *m_http_client_pool.acquire(), rpc_timeout);
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
@@ -2028,10 +2265,74 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
       boost::lexical_cast<std::string>(res.output_indices.size()) + ") sizes from daemon");
 
   blocks_start_height = res.start_height;
+  current_height = res.current_height;
   blocks = std::move(res.blocks);
   o_indices = std::move(res.output_indices);
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::pull_blocks_from_blockdb(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+{
+  // the daemon answers from the top of the history, unless given a start height
+  if (!m_blockdb || start_height != 0 || short_chain_history.empty())
+    return false;
+
+  std::vector<blockdb::entry> entries;
+  try
+  {
+    if (!m_blockdb->get_blocks(short_chain_history.front(), COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT, blocks_start_height, entries))
+      return false;
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to read blocks from the block database: " << e.what());
+    return false;
+  }
+  // nothing past the block we already have, the daemon may know more
+  if (entries.size() < 2)
+    return false;
+
+  // once past the last stored block, pulling from the daemon again checks they are on its chain
+  blocks.clear();
+  o_indices.clear();
+  blocks.reserve(entries.size());
+  o_indices.reserve(entries.size());
+  for (blockdb::entry &e: entries)
+  {
+    blocks.push_back(std::move(e.block));
+    o_indices.push_back(std::move(e.o_indices));
+    if (m_refresh_type == RefreshNoCoinbase && !o_indices.back().indices.empty())
+      o_indices.back().indices[0].indices.clear();
+  }
+  MDEBUG("Got " << blocks.size() << " blocks from the block database at height " << blocks_start_height);
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_blocks_to_blockdb(uint64_t blocks_start_height, uint64_t current_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks)
+{
+  // without the coinbase output indices, the blocks can't be served to other wallets
+  if (!m_blockdb || m_refresh_type == RefreshNoCoinbase)
+    return;
+
+  std::vector<blockdb::entry> entries;
+  for (size_t i = 0; i < blocks.size() && blocks_start_height + i + BLOCKDB_MIN_DEPTH <= current_height; ++i)
+  {
+    entries.push_back(blockdb::entry());
+    blockdb::entry &e = entries.back();
+    e.hash = parsed_blocks[i].hash;
+    e.prev_id = parsed_blocks[i].block.prev_id;
+    e.block = blocks[i];
+    e.o_indices = parsed_blocks[i].o_indices;
+  }
+  try
+  {
+    m_blockdb->add_blocks(blocks_start_height, entries);
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to add blocks to the block database: " << e.what());
+  }
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes)
 {
   cryptonote::COMMAND_RPC_GET_HASHES_FAST::request req = AUTO_VAL_INIT(req);
@@ -2039,9 +2340,7 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   req.block_ids = short_chain_history;
 
   req.start_height = start_height;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin("/gethashes.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_bin("/gethashes.bin", req, res, *m_http_client_pool.acquire(), rpc_timeout);
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "gethashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gethashes.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_hashes_error, res.status);
@@ -2050,24 +2349,80 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   hashes = std::move(res.m_block_ids);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added)
+void wallet2::prepare_tx_cache_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, const std::shared_ptr<shared_scan> &scan)
 {
-  size_t current_index = start_height;
-  blocks_added = 0;
+  // the software device's view key can be handed to the group, a hardware one's can't
+  if (!scan || !m_scan_group || m_account.get_device().get_type() != hw::device::SOFTWARE)
+  {
+    cache_blocks_tx_data(parsed_blocks, tx_cache_data);
+    derive_tx_cache_data(tx_cache_data);
+    return;
+  }
 
-  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
-  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
+  const crypto::public_key &view_public_key = m_account.get_keys().m_account_address.m_view_public_key;
+  if (m_scan_group_key && *m_scan_group_key != view_public_key)
+    leave_scan_group();
+  if (!m_scan_group_key)
+  {
+    m_scan_group->add(view_public_key, m_account.get_keys().m_view_secret_key);
+    m_scan_group_key = view_public_key;
+  }
+
+  // the first wallet of the group to get to these blocks prepares them for all
+  std::shared_ptr<const shared_scan::prepared> prepared;
+  {
+    boost::unique_lock<boost::mutex> lock(scan->mutex);
+    std::shared_ptr<const shared_scan::prepared> &slot = scan->by_refresh_type[m_refresh_type];
+    if (!slot)
+    {
+      std::shared_ptr<shared_scan::prepared> p = std::make_shared<shared_scan::prepared>();
+      cache_blocks_tx_data(parsed_blocks, p->cache);
+      std::vector<crypto::public_key> pkeys;
+      for (const auto &entry: p->cache)
+      {
+        for (const auto &iod: entry.primary)
+          pkeys.push_back(iod.pkey);
+        for (const auto &iod: entry.additional)
+          pkeys.push_back(iod.pkey);
+      }
+      p->derivations = m_scan_group->derive(pkeys);
+      slot = p;
+    }
+    prepared = slot;
+  }
 
+  tx_cache_data = prepared->cache;
+  const auto i = prepared->derivations.find(view_public_key);
+  if (i == prepared->derivations.end())
+  {
+    // we joined after these blocks were derived
+    derive_tx_cache_data(tx_cache_data);
+    return;
+  }
+  const std::vector<crypto::key_derivation> &derivations = *i->second;
+  size_t k = 0;
+  for (auto &slot: tx_cache_data)
+  {
+    for (auto &iod: slot.primary)
+      iod.derivation = derivations[k++];
+    for (auto &iod: slot.additional)
+      iod.derivation = derivations[k++];
+  }
+  THROW_WALLET_EXCEPTION_IF(k != derivations.size(), error::wallet_internal_error, "Mismatched shared derivations size");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::cache_blocks_tx_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
+{
   tools::threadpool& tpool = tools::threadpool::getInstance();
   tools::threadpool::waiter waiter;
 
   size_t num_txes = 0;
-  std::vector<tx_cache_data> tx_cache_data;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
     num_txes += 1 + parsed_blocks[i].txes.size();
+  tx_cache_data.clear();
   tx_cache_data.resize(num_txes);
   size_t txidx = 0;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     THROW_WALLET_EXCEPTION_IF(parsed_blocks[i].txes.size() != parsed_blocks[i].block.tx_hashes.size(),
         error::wallet_internal_error, "Mismatched parsed_blocks[i].txes.size() and parsed_blocks[i].block.tx_hashes.size()");
@@ -2082,30 +2437,92 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   }
   THROW_WALLET_EXCEPTION_IF(txidx != num_txes, error::wallet_internal_error, "txidx does not match tx_cache_data size");
   waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::derive_tx_cache_data(std::vector<tx_cache_data> &tx_cache_data)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
 
   hw::device &hwdev =  m_account.get_device();
   hw::reset_mode rst(hwdev);
   hwdev.set_mode(hw::device::TRANSACTION_PARSE);
   const cryptonote::account_keys &keys = m_account.get_keys();
 
-  auto gender = [&](wallet2::is_out_data &iod) {
-    boost::unique_lock<hw::device> hwdev_lock(hwdev);
-    if (!hwdev.generate_key_derivation(iod.pkey, keys.m_view_secret_key, iod.derivation))
-    {
-      MWARNING("Failed to generate key derivation from tx pubkey, skipping");
-      static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
-      memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
-    }
-  };
-
+  // one task per batch of tx pubkeys across the whole span, instead of one per key,
+  // so the device sees a single call (and lock) per batch
+  static const size_t derivation_batch_size = scan_group::derivation_batch_size;
+  std::vector<wallet2::is_out_data*> iods;
   for (auto &slot: tx_cache_data)
   {
     for (auto &iod: slot.primary)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      iods.push_back(&iod);
     for (auto &iod: slot.additional)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      iods.push_back(&iod);
+  }
+  std::vector<std::function<void()>> jobs;
+  for (size_t start = 0; start < iods.size(); start += derivation_batch_size)
+  {
+    const size_t count = std::min(derivation_batch_size, iods.size() - start);
+    jobs.push_back([&iods, &keys, &hwdev, start, count]() {
+      std::vector<crypto::public_key> pkeys(count);
+      std::vector<crypto::key_derivation> derivations(count);
+      std::unique_ptr<bool[]> valid(new bool[count]);
+      for (size_t k = 0; k < count; ++k)
+        pkeys[k] = iods[start + k]->pkey;
+      {
+        boost::unique_lock<hw::device> hwdev_lock(hwdev);
+        hwdev.generate_key_derivations(pkeys.data(), count, keys.m_view_secret_key, derivations.data(), valid.get());
+      }
+      for (size_t k = 0; k < count; ++k)
+      {
+        wallet2::is_out_data &iod = *iods[start + k];
+        if (valid[k])
+        {
+          iod.derivation = derivations[k];
+        }
+        else
+        {
+          MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+          static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
+          memcpy(&iod.derivation, rct::identity().bytes, sizeof(iod.derivation));
+        }
+      }
+    });
   }
+  tpool.submit_bulk(&waiter, std::move(jobs), true);
   waiter.wait(&tpool);
+  hwdev.set_mode(hw::device::NONE);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added)
+{
+  size_t current_index = start_height;
+  blocks_added = 0;
+
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  if (current_index < m_blockchain.offset() && !parsed_blocks.empty())
+  {
+    // the daemon went back to one of the sparse hashes, everything above it has to be scanned again
+    auto it = m_blockchain.sparse().find(current_index);
+    if (it != m_blockchain.sparse().end() && it->second == parsed_blocks[0].hash)
+    {
+      MINFO("Reorg below the hash chain tail, resuming from height " << current_index);
+      m_blockchain.rebase(current_index);
+      detach_blockchain(current_index + 1);
+    }
+  }
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
+
+  m_batch_rings = true;
+  auto ring_flusher = epee::misc_utils::create_scope_leave_handler([this]() { m_batch_rings = false; flush_pending_rings(); });
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+
+  hw::device &hwdev =  m_account.get_device();
+  hw::reset_mode rst(hwdev);
+  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
 
   auto geniod = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
     for (size_t k = 0; k < n_vouts; ++k)
@@ -2128,7 +2545,7 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     }
   };
 
-  txidx = 0;
+  size_t txidx = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
     if (m_refresh_type != RefreshType::RefreshNoCoinbase)
@@ -2149,6 +2566,11 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   waiter.wait(&tpool);
   hwdev.set_mode(hw::device::NONE);
 
+  // detection only touched the view key; key images for what it found are
+  // computed as a separate parallel pass, before the sequential bookkeeping
+  // that needs them to spot spends later in this batch
+  precompute_key_images(parsed_blocks, tx_cache_data);
+
   size_t tx_cache_data_offset = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
@@ -2178,6 +2600,7 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
     ++current_index;
     tx_cache_data_offset += 1 + parsed_blocks[i].txes.size();
   }
+  flush_events();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::refresh(bool trusted_daemon)
@@ -2192,16 +2615,64 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   refresh(trusted_daemon, start_height, blocks_fetched, received_money);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error)
+void wallet2::pull_and_parse_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error)
+{
+  std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+  uint64_t current_height = 0;
+  const bool from_blockdb = pull_blocks_from_blockdb(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
+  if (!from_blockdb)
+    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices, current_height);
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  parsed_blocks.resize(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
+      std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+  }
+  waiter.wait(&tpool);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (parsed_blocks[i].error)
+    {
+      error = true;
+      break;
+    }
+    parsed_blocks[i].o_indices = std::move(o_indices[i]);
+  }
+
+  boost::mutex error_lock;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    parsed_blocks[i].txes.resize(blocks[i].txs.size());
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+    {
+      tpool.submit(&waiter, [&, i, j](){
+        if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j], parsed_blocks[i].txes[j]))
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          error = true;
+        }
+      }, true);
+    }
+  }
+  waiter.wait(&tpool);
+
+  if (!from_blockdb && !error)
+    add_blocks_to_blockdb(blocks_start_height, current_height, blocks, parsed_blocks);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, std::shared_ptr<shared_scan> &scan, bool &error)
 {
   error = false;
+  scan.reset();
 
   try
   {
     drop_from_short_history(short_chain_history, 3);
 
-    THROW_WALLET_EXCEPTION_IF(prev_blocks.size() != prev_parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
-
     // prepend the last 3 blocks, should be enough to guard against a block or two's reorg
     std::vector<parsed_block>::const_reverse_iterator i = prev_parsed_blocks.rbegin();
     for (size_t n = 0; n < std::min((size_t)3, prev_parsed_blocks.size()); ++n)
@@ -2210,46 +2681,46 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
       ++i;
     }
 
-    // pull the new blocks
-    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
-    pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
-    THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+    if (!m_shared_block_cache || short_chain_history.empty())
+    {
+      pull_and_parse_blocks(start_height, blocks_start_height, short_chain_history, blocks, parsed_blocks, error);
+      return;
+    }
 
-    tools::threadpool& tpool = tools::threadpool::getInstance();
-    tools::threadpool::waiter waiter;
-    parsed_blocks.resize(blocks.size());
-    for (size_t i = 0; i < blocks.size(); ++i)
+    // wallets at the same height ask for the same blocks, so one of them fetches and parses for all
+    const crypto::hash &top = short_chain_history.front();
+    const std::string key = m_daemon_address + (m_refresh_type == RefreshNoCoinbase ? "|no-miner-tx|" : "|") +
+        std::to_string(start_height) + "|" + std::string(top.data, sizeof(top.data));
+    std::shared_ptr<shared_blocks> own;
+    shared_block_cache::value_ptr shared = m_shared_block_cache->get(key, [&]() {
+      own = std::make_shared<shared_blocks>();
+      own->scan = std::make_shared<shared_scan>();
+      bool fetch_error = false;
+      pull_and_parse_blocks(start_height, own->start_height, short_chain_history, own->blocks, own->parsed_blocks, fetch_error);
+      error = fetch_error;
+      // the daemon answers from the first block it knows, which only depends on the
+      // top of the history when it starts there
+      const bool shareable = !fetch_error && !own->parsed_blocks.empty() && own->parsed_blocks[0].hash == top;
+      return shareable ? shared_block_cache::value_ptr(own) : shared_block_cache::value_ptr();
+    });
+    if (shared)
     {
-      tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
-        std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+      blocks_start_height = shared->start_height;
+      blocks = shared->blocks;
+      parsed_blocks = shared->parsed_blocks;
+      scan = shared->scan;
     }
-    waiter.wait(&tpool);
-    for (size_t i = 0; i < blocks.size(); ++i)
+    else if (own)
     {
-      if (parsed_blocks[i].error)
-      {
-        error = true;
-        break;
-      }
-      parsed_blocks[i].o_indices = std::move(o_indices[i]);
+      blocks_start_height = own->start_height;
+      blocks = std::move(own->blocks);
+      parsed_blocks = std::move(own->parsed_blocks);
     }
-
-    boost::mutex error_lock;
-    for (size_t i = 0; i < blocks.size(); ++i)
+    else
     {
-      parsed_blocks[i].txes.resize(blocks[i].txs.size());
-      for (size_t j = 0; j < blocks[i].txs.size(); ++j)
-      {
-        tpool.submit(&waiter, [&, i, j](){
-          if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j], parsed_blocks[i].txes[j]))
-          {
-            boost::unique_lock<boost::mutex> lock(error_lock);
-            error = true;
-          }
-        }, true);
-      }
+      // another wallet got an answer which was not shared, ask ourselves
+      pull_and_parse_blocks(start_height, blocks_start_height, short_chain_history, blocks, parsed_blocks, error);
     }
-    waiter.wait(&tpool);
   }
   catch(...)
   {
@@ -2288,6 +2759,7 @@ void wallet2::remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashe
 void wallet2::update_pool_state(bool refreshed)
 {
   MDEBUG("update_pool_state start");
+  auto events_flusher = epee::misc_utils::create_scope_leave_handler([this]() { flush_events(); });
 
   auto keys_reencryptor = epee::misc_utils::create_scope_leave_handler([&, this]() {
     if (m_encrypt_keys_after_refresh)
@@ -2297,33 +2769,53 @@ void wallet2::update_pool_state(bool refreshed)
     }
   });
 
-  // get the pool state
-  cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request req;
-  cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response res;
-  m_daemon_rpc_mutex.lock();
-  bool r = epee::net_utils::invoke_http_json("/get_transaction_pool_hashes.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
-  THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool_hashes.bin");
-  THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool_hashes.bin");
-  THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_tx_pool_error);
-  MDEBUG("update_pool_state got pool");
+  // get the pool state: recent daemons send what changed since we last asked,
+  // so a wallet polling a busy pool does not download every txid each time
+  uint32_t rpc_version = 0;
+  boost::optional<std::string> result = m_node_rpc_proxy.get_rpc_version(rpc_version);
+  if (!result && rpc_version >= MAKE_CORE_RPC_VERSION(2, 6))
+  {
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN::request req;
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_CHANGES_BIN::response res;
+    req.instance = m_pool_instance;
+    req.cookie = m_pool_cookie;
+    bool r = epee::net_utils::invoke_http_bin("/get_transaction_pool_changes.bin", req, res, *m_http_client_pool.acquire(), rpc_timeout);
+    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool_changes.bin");
+    THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool_changes.bin");
+    THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_tx_pool_error);
+    if (res.full)
+      m_pool_hashes.clear();
+    for (const crypto::hash &txid: res.removed)
+      m_pool_hashes.erase(txid);
+    m_pool_hashes.insert(res.added.begin(), res.added.end());
+    m_pool_instance = res.instance;
+    m_pool_cookie = res.cookie;
+    MDEBUG("update_pool_state got pool changes: " << res.added.size() << " added, " << res.removed.size() << " removed" << (res.full ? " (full)" : ""));
+  }
+  else
+  {
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::request req;
+    cryptonote::COMMAND_RPC_GET_TRANSACTION_POOL_HASHES_BIN::response res;
+    bool r = epee::net_utils::invoke_http_json("/get_transaction_pool_hashes.bin", req, res, *m_http_client_pool.acquire(), rpc_timeout);
+    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "get_transaction_pool_hashes.bin");
+    THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_transaction_pool_hashes.bin");
+    THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_tx_pool_error);
+    m_pool_hashes.clear();
+    m_pool_hashes.insert(res.tx_hashes.begin(), res.tx_hashes.end());
+    m_pool_instance = 0;
+    m_pool_cookie = 0;
+    MDEBUG("update_pool_state got pool");
+  }
+  const std::vector<crypto::hash> pool_hashes(m_pool_hashes.begin(), m_pool_hashes.end());
 
   // remove any pending tx that's not in the pool
   std::unordered_map<crypto::hash, wallet2::unconfirmed_transfer_details>::iterator it = m_unconfirmed_txs.begin();
   while (it != m_unconfirmed_txs.end())
   {
     const crypto::hash &txid = it->first;
-    bool found = false;
-    for (const auto &it2: res.tx_hashes)
-    {
-      if (it2 == txid)
-      {
-        found = true;
-        break;
-      }
-    }
-    auto pit = it++;
-    if (!found)
+    const bool found = m_pool_hashes.find(txid) != m_pool_hashes.end();
+    auto pit = it++;
+    if (!found)
     {
       // we want to avoid a false positive when we ask for the pool just after
       // a tx is removed from the pool due to being found in a new block, but
@@ -2370,13 +2862,13 @@ void wallet2::update_pool_state(bool refreshed)
   // the in transfers list instead (or nowhere if it just
   // disappeared without being mined)
   if (refreshed)
-    remove_obsolete_pool_txs(res.tx_hashes);
+    remove_obsolete_pool_txs(pool_hashes);
 
   MDEBUG("update_pool_state done second loop");
 
   // gather txids of new pool txes to us
   std::vector<std::pair<crypto::hash, bool>> txids;
-  for (const auto &txid: res.tx_hashes)
+  for (const auto &txid: pool_hashes)
   {
     bool txid_found_in_up = false;
     for (const auto &up: m_unconfirmed_payments)
@@ -2447,9 +2939,7 @@ void wallet2::update_pool_state(bool refreshed)
     MDEBUG("asking for " << txids.size() << " transactions");
     req.decode_as_json = false;
     req.prune = false;
-    m_daemon_rpc_mutex.lock();
-    bool r = epee::net_utils::invoke_http_json("/gettransactions", req, res, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
+    bool r = epee::net_utils::invoke_http_json("/gettransactions", req, res, *m_http_client_pool.acquire(), rpc_timeout);
     MDEBUG("Got " << r << " and " << res.status);
     if (r && res.status == CORE_RPC_STATUS_OK)
     {
@@ -2558,7 +3048,9 @@ void wallet2::fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height,
           LOG_PRINT_L2( "Skipped block by height: " << current_index);
         m_blockchain.push_back(bl_id);
 
-        if (0 != m_callback)
+        if (m_event_dispatcher)
+          m_pending_events.push_back({wallet_event::new_block, current_index, bl_id, 0, {}});
+        else if (0 != m_callback)
         { // FIXME: this isn't right, but simplewallet just logs that we got a block.
           cryptonote::block dummy;
           m_callback->on_new_block(current_index, dummy);
@@ -2579,6 +3071,7 @@ void wallet2::fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height,
 
 bool wallet2::add_address_book_row(const cryptonote::account_public_address &address, const crypto::hash &payment_id, const std::string &description, bool is_subaddress)
 {
+  load_history();
   wallet2::address_book_row a;
   a.m_address = address;
   a.m_payment_id = payment_id;
@@ -2601,6 +3094,70 @@ bool wallet2::delete_address_book_row(std::size_t row_id) {
   return true;
 }
 
+//----------------------------------------------------------------------------------------------------
+void wallet2::fetch_refresh_batches(uint64_t start_height, std::list<crypto::hash> &short_chain_history, tools::bounded_queue<refresh_batch> &fetched)
+{
+  load_history();
+  // the last few blocks of the previous batch, to extend the chain history with
+  std::vector<parsed_block> prev_tail;
+  bool first = true;
+  uint64_t prev_start_height = 0;
+  while (m_run.load(std::memory_order_relaxed))
+  {
+    refresh_batch batch;
+    bool error = false;
+    pull_and_parse_next_blocks(start_height, batch.start_height, short_chain_history, prev_tail, batch.blocks, batch.parsed_blocks, batch.scan, error);
+    batch.cached = false;
+    if (error)
+      batch.status = refresh_batch::failed;
+    else if (!first && batch.start_height == prev_start_height)
+      batch.status = refresh_batch::end_of_chain;
+    else if (batch.blocks.empty())
+      batch.status = refresh_batch::empty_response;
+    else
+      batch.status = refresh_batch::blocks_ready;
+
+    const bool last = batch.status != refresh_batch::blocks_ready;
+    if (!last)
+    {
+      const size_t tail = std::min((size_t)3, batch.parsed_blocks.size());
+      prev_tail.resize(tail);
+      for (size_t n = 0; n < tail; ++n)
+        prev_tail[n].hash = batch.parsed_blocks[batch.parsed_blocks.size() - tail + n].hash;
+      prev_start_height = batch.start_height;
+    }
+    first = false;
+    if (!fetched.push(std::move(batch)) || last)
+      break;
+  }
+  fetched.close();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::prepare_refresh_batches(tools::bounded_queue<refresh_batch> &fetched, tools::bounded_queue<refresh_batch> &prepared)
+{
+  refresh_batch batch;
+  while (fetched.pop(batch))
+  {
+    const bool last = batch.status != refresh_batch::blocks_ready;
+    if (!last)
+    {
+      try
+      {
+        prepare_tx_cache_data(batch.parsed_blocks, batch.cache, batch.scan);
+        batch.cached = true;
+      }
+      catch (const std::exception &e)
+      {
+        // leave it to the apply stage, which reports errors
+        MDEBUG("Failed to prepare refresh batch: " << e.what());
+        batch.cache.clear();
+      }
+    }
+    if (!prepared.push(std::move(batch)) || last)
+      break;
+  }
+  prepared.close();
+}
 //----------------------------------------------------------------------------------------------------
 void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blocks_fetched, bool& received_money)
 {
@@ -2639,14 +3196,11 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
   received_money = false;
   blocks_fetched = 0;
   uint64_t added_blocks = 0;
+  auto events_flusher = epee::misc_utils::create_scope_leave_handler([this]() { flush_events(); });
   size_t try_count = 0;
   crypto::hash last_tx_hash_id = m_transfers.size() ? m_transfers.back().m_txid : null_hash;
   std::list<crypto::hash> short_chain_history;
-  tools::threadpool& tpool = tools::threadpool::getInstance();
-  tools::threadpool::waiter waiter;
   uint64_t blocks_start_height;
-  std::vector<cryptonote::block_complete_entry> blocks;
-  std::vector<parsed_block> parsed_blocks;
   bool refreshed = false;
 
   // pull the first set of blocks
@@ -2679,33 +3233,75 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     }
   });
 
-  bool first = true;
-  while(m_run.load(std::memory_order_relaxed))
-  {
+  // Blocks go through a pipeline: a fetcher thread pulls and deserializes them, a
+  // second thread caches tx data and key derivations (software devices only), and
+  // here the outputs are scanned in parallel and the results applied in order.
+  // Scanning stays here since it reads the subaddress table the apply step grows.
+  const bool prepare_ahead = m_account.get_device().get_type() == hw::device::SOFTWARE;
+  bool done = false;
+  while(!done && m_run.load(std::memory_order_relaxed))
+  {
+    tools::bounded_queue<refresh_batch> fetched(m_refresh_pipeline_depth);
+    tools::bounded_queue<refresh_batch> prepared(m_refresh_pipeline_depth);
+    tools::bounded_queue<refresh_batch> &ready = prepare_ahead ? prepared : fetched;
+    boost::thread fetcher([&]{ fetch_refresh_batches(start_height, short_chain_history, fetched); });
+    boost::thread preparer;
+    if (prepare_ahead)
+      preparer = boost::thread([&]{ prepare_refresh_batches(fetched, prepared); });
+    auto stop_pipeline = [&]() {
+      fetched.close();
+      prepared.close();
+      if (fetcher.joinable())
+        fetcher.join();
+      if (preparer.joinable())
+        preparer.join();
+    };
+    auto pipeline_stopper = epee::misc_utils::create_scope_leave_handler(stop_pipeline);
+
     try
     {
-      // pull the next set of blocks while we're processing the current one
-      uint64_t next_blocks_start_height;
-      std::vector<cryptonote::block_complete_entry> next_blocks;
-      std::vector<parsed_block> next_parsed_blocks;
-      bool error = false;
-      added_blocks = 0;
-      if (!first && blocks.empty())
+      refresh_batch batch;
+      while (m_run.load(std::memory_order_relaxed))
       {
-        refreshed = false;
-        break;
-      }
-      tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error);});
+        if (!ready.pop(batch))
+        {
+          // stopped
+          refreshed = false;
+          done = true;
+          break;
+        }
+        if (batch.status == refresh_batch::failed)
+        {
+          throw std::runtime_error("proxy exception in refresh thread");
+        }
+        if (batch.status == refresh_batch::end_of_chain)
+        {
+          m_node_rpc_proxy.set_height(m_blockchain.size());
+          // new blocks change the fee estimate, get it ready before a tx needs it
+          m_node_rpc_proxy.prefetch(FEE_ESTIMATE_GRACE_BLOCKS);
+          refreshed = true;
+          done = true;
+          break;
+        }
+        if (batch.status == refresh_batch::empty_response)
+        {
+          refreshed = false;
+          done = true;
+          break;
+        }
 
-      if (!first)
-      {
+        added_blocks = 0;
         try
         {
-          process_parsed_blocks(blocks_start_height, blocks, parsed_blocks, added_blocks);
+          if (!batch.cached)
+            prepare_tx_cache_data(batch.parsed_blocks, batch.cache, batch.scan);
+          process_parsed_blocks(batch.start_height, batch.blocks, batch.parsed_blocks, batch.cache, added_blocks);
         }
         catch (const tools::error::out_of_hashchain_bounds_error&)
         {
           MINFO("Daemon claims next refresh block is out of hash chain bounds, resetting hash chain");
+          // the fetcher works on short_chain_history
+          stop_pipeline();
           uint64_t stop_height = m_blockchain.offset();
           std::vector<crypto::hash> tip(m_blockchain.size() - m_blockchain.offset());
           for (size_t i = m_blockchain.offset(); i < m_blockchain.size(); ++i)
@@ -2727,43 +3323,26 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
           throw std::runtime_error(""); // loop again
         }
         blocks_fetched += added_blocks;
+        added_blocks = 0;
       }
-      waiter.wait(&tpool);
-      if(!first && blocks_start_height == next_blocks_start_height)
-      {
-        m_node_rpc_proxy.set_height(m_blockchain.size());
-        refreshed = true;
-        break;
-      }
-
-      first = false;
-
-      // handle error from async fetching thread
-      if (error)
-      {
-        throw std::runtime_error("proxy exception in refresh thread");
-      }
-
-      // switch to the new blocks from the daemon
-      blocks_start_height = next_blocks_start_height;
-      blocks = std::move(next_blocks);
-      parsed_blocks = std::move(next_parsed_blocks);
     }
     catch (const tools::error::password_needed&)
     {
       blocks_fetched += added_blocks;
-      waiter.wait(&tpool);
       throw;
     }
     catch (const std::exception&)
     {
       blocks_fetched += added_blocks;
-      waiter.wait(&tpool);
+      added_blocks = 0;
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
-        first = true;
         ++try_count;
+        // batches fetched ahead were dropped, so the fetcher's history may be ahead of us
+        stop_pipeline();
+        short_chain_history.clear();
+        get_short_chain_history(short_chain_history);
       }
       else
       {
@@ -2834,10 +3413,13 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     }
   }
 
+  // only ask for what was added since last time, plus a few blocks to notice a reorg
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response res = AUTO_VAL_INIT(res);
   req.amounts.push_back(0);
   req.from_height = 0;
+  if (!m_rct_distribution.empty())
+    req.from_height = m_rct_distribution_start_height + m_rct_distribution.size() - std::min<uint64_t>(m_rct_distribution.size(), RCT_DISTRIBUTION_REFRESH_OVERLAP);
   req.cumulative = true;
   req.binary = true;
   m_daemon_rpc_mutex.lock();
@@ -2868,13 +3450,43 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     MWARNING("Failed to request output distribution: results are not for amount 0");
     return false;
   }
-  start_height = res.distributions[0].start_height;
-  distribution = std::move(res.distributions[0].distribution);
+  const uint64_t res_start_height = res.distributions[0].start_height;
+  std::vector<uint64_t> &res_distribution = res.distributions[0].distribution;
+  if (req.from_height > 0)
+  {
+    // the rct distribution is cumulative from the start of rct, so the overlapping
+    // part must match what we have, or the reorg was deeper than the overlap
+    const uint64_t cached_end = m_rct_distribution_start_height + m_rct_distribution.size();
+    if (res_start_height < m_rct_distribution_start_height || res_start_height > cached_end || res_distribution.empty() ||
+        (res_start_height < cached_end && m_rct_distribution[res_start_height - m_rct_distribution_start_height] != res_distribution[0]))
+    {
+      MDEBUG("Cached rct distribution does not match the daemon's, requesting it in full");
+      invalidate_output_distribution_cache();
+      return get_rct_distribution(start_height, distribution);
+    }
+    m_rct_distribution.resize(res_start_height - m_rct_distribution_start_height);
+    m_rct_distribution.insert(m_rct_distribution.end(), res_distribution.begin(), res_distribution.end());
+  }
+  else
+  {
+    m_rct_distribution_start_height = res_start_height;
+    m_rct_distribution = std::move(res_distribution);
+  }
+  start_height = m_rct_distribution_start_height;
+  distribution = m_rct_distribution;
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_output_distribution_cache()
+{
+  m_rct_distribution_start_height = 0;
+  m_rct_distribution.clear();
+  m_segregation_limits.clear();
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::detach_blockchain(uint64_t height)
 {
+  load_history();
   LOG_PRINT_L0("Detaching blockchain on height " << height);
 
   // size  1 2 3 4 5 6 7 8 9
@@ -2914,10 +3526,12 @@ void wallet2::detach_blockchain(uint64_t height)
     m_pub_keys.erase(it_pk);
   }
   m_transfers.erase(it, m_transfers.end());
+  invalidate_balance_cache();
 
   size_t blocks_detached = m_blockchain.size() - height;
   m_blockchain.crop(height);
 
+  invalidate_transfer_indexes();
   for (auto it = m_payments.begin(); it != m_payments.end(); )
   {
     if(height <= it->second.m_block_height)
@@ -2935,33 +3549,61 @@ void wallet2::detach_blockchain(uint64_t height)
   }
 
   LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
+  if (m_callback)
+    m_callback->on_reorg(height);
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::deinit()
 {
   m_is_initialized=false;
+  leave_scan_group();
   unlock_keys_file();
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::set_scan_group(const std::shared_ptr<scan_group> &group)
+{
+  leave_scan_group();
+  m_scan_group = group;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::leave_scan_group()
+{
+  if (m_scan_group && m_scan_group_key)
+    m_scan_group->remove(*m_scan_group_key);
+  m_scan_group_key = boost::none;
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::clear()
 {
   m_blockchain.clear();
   m_transfers.clear();
+  invalidate_balance_cache();
   m_key_images.clear();
   m_pub_keys.clear();
   m_unconfirmed_txs.clear();
   m_payments.clear();
+  invalidate_transfer_indexes();
   m_tx_keys.clear();
   m_additional_tx_keys.clear();
   m_confirmed_txs.clear();
   m_unconfirmed_payments.clear();
   m_scanned_pool_txs[0].clear();
   m_scanned_pool_txs[1].clear();
+  m_pool_hashes.clear();
+  m_pool_instance = 0;
+  m_pool_cookie = 0;
   m_address_book.clear();
+  m_tx_notes.clear();
+  m_history_blob.clear();
+  m_history_loaded = true;
   m_subaddresses.clear();
   m_subaddress_labels.clear();
+  m_subaddress_keys_generated.clear();
+  clear_subaddress_str_cache();
   m_multisig_rounds_passed = 0;
+  m_cache_journal.valid = false;
+  m_cache_journal.transfer_hashes.clear();
   return true;
 }
 
@@ -2980,7 +3622,7 @@ bool wallet2::store_keys(const std::string& keys_file_name, const epee::wipeable
   cryptonote::account_base account = m_account;
 
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(password, key);
 
   if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_watch_only)
   {
@@ -3108,9 +3750,18 @@ bool wallet2::store_keys(const std::string& keys_file_name, const epee::wipeable
   value2.SetUint(m_segregation_height);
   json.AddMember("segregation_height", value2, json.GetAllocator());
 
+  value2.SetUint(m_refresh_pipeline_depth);
+  json.AddMember("refresh_pipeline_depth", value2, json.GetAllocator());
+
+  value2.SetUint64(m_hashchain_tail);
+  json.AddMember("hashchain_tail", value2, json.GetAllocator());
+
   value2.SetInt(m_ignore_fractional_outputs ? 1 : 0);
   json.AddMember("ignore_fractional_outputs", value2, json.GetAllocator());
 
+  value2.SetInt(m_parallel_tx_construction ? 1 : 0);
+  json.AddMember("parallel_tx_construction", value2, json.GetAllocator());
+
   value2.SetUint(m_subaddress_lookahead_major);
   json.AddMember("subaddress_lookahead_major", value2, json.GetAllocator());
 
@@ -3130,10 +3781,11 @@ bool wallet2::store_keys(const std::string& keys_file_name, const epee::wipeable
   account_data = buffer.GetString();
 
   // Encrypt the entire JSON object.
-  crypto::generate_chacha_key(password.data(), password.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(password, key);
   std::string cipher;
   cipher.resize(account_data.size());
   keys_file_data.iv = crypto::rand<crypto::chacha_iv>();
+  keys_file_data.kdf_lanes = m_kdf_lanes;
   crypto::chacha20(account_data.data(), account_data.size(), key, keys_file_data.iv, &cipher[0]);
   keys_file_data.account_data = cipher;
 
@@ -3150,7 +3802,7 @@ bool wallet2::store_keys(const std::string& keys_file_name, const epee::wipeable
 void wallet2::setup_keys(const epee::wipeable_string &password)
 {
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(password, key);
 
   // re-encrypt, but keep viewkey unencrypted
   if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_watch_only)
@@ -3193,8 +3845,11 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
   // Decrypt the contents
   r = ::serialization::parse_binary(buf, keys_file_data);
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "internal error: failed to deserialize \"" + keys_file_name + '\"');
+  // the file's own KDF, whatever new wallets are set to use
+  THROW_WALLET_EXCEPTION_IF(keys_file_data.kdf_lanes > MAX_KDF_LANES, error::wallet_internal_error, "Unsupported KDF lanes in \"" + keys_file_name + '\"');
+  m_kdf_lanes = keys_file_data.kdf_lanes;
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(password, key);
   std::string account_data;
   account_data.resize(keys_file_data.account_data.size());
   crypto::chacha20(keys_file_data.account_data.data(), keys_file_data.account_data.size(), key, keys_file_data.iv, &account_data[0]);
@@ -3230,7 +3885,10 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
     m_segregate_pre_fork_outputs = true;
     m_key_reuse_mitigation2 = true;
     m_segregation_height = 0;
+    m_refresh_pipeline_depth = DEFAULT_REFRESH_PIPELINE_DEPTH;
+    m_hashchain_tail = 0;
     m_ignore_fractional_outputs = true;
+    m_parallel_tx_construction = false;
     m_subaddress_lookahead_major = SUBADDRESS_LOOKAHEAD_MAJOR;
     m_subaddress_lookahead_minor = SUBADDRESS_LOOKAHEAD_MINOR;
     m_device_name = "";
@@ -3379,8 +4037,14 @@ bool wallet2::load_keys(const std::string& keys_file_name, const epee::wipeable_
     m_key_reuse_mitigation2 = field_key_reuse_mitigation2;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, segregation_height, int, Uint, false, 0);
     m_segregation_height = field_segregation_height;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, refresh_pipeline_depth, uint32_t, Uint, false, DEFAULT_REFRESH_PIPELINE_DEPTH);
+    m_refresh_pipeline_depth = field_refresh_pipeline_depth;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, hashchain_tail, uint64_t, Uint64, false, 0);
+    m_hashchain_tail = field_hashchain_tail;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, ignore_fractional_outputs, int, Int, false, true);
     m_ignore_fractional_outputs = field_ignore_fractional_outputs;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, parallel_tx_construction, int, Int, false, false);
+    m_parallel_tx_construction = field_parallel_tx_construction;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, subaddress_lookahead_major, uint32_t, Uint, false, SUBADDRESS_LOOKAHEAD_MAJOR);
     m_subaddress_lookahead_major = field_subaddress_lookahead_major;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, subaddress_lookahead_minor, uint32_t, Uint, false, SUBADDRESS_LOOKAHEAD_MINOR);
@@ -3501,8 +4165,9 @@ bool wallet2::verify_password(const std::string& keys_file_name, const epee::wip
   // Decrypt the contents
   r = ::serialization::parse_binary(buf, keys_file_data);
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "internal error: failed to deserialize \"" + keys_file_name + '\"');
+  THROW_WALLET_EXCEPTION_IF(keys_file_data.kdf_lanes > MAX_KDF_LANES, error::wallet_internal_error, "Unsupported KDF lanes in \"" + keys_file_name + '\"');
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, kdf_rounds);
+  generate_chacha_key_from_password(password, key, kdf_rounds, keys_file_data.kdf_lanes);
   std::string account_data;
   account_data.resize(keys_file_data.account_data.size());
   crypto::chacha20(keys_file_data.account_data.data(), keys_file_data.account_data.size(), key, keys_file_data.iv, &account_data[0]);
@@ -3551,14 +4216,14 @@ void wallet2::decrypt_keys(const crypto::chacha_key &key)
 void wallet2::encrypt_keys(const epee::wipeable_string &password)
 {
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(password, key);
   encrypt_keys(key);
 }
 
 void wallet2::decrypt_keys(const epee::wipeable_string &password)
 {
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(password, key);
   decrypt_keys(key);
 }
 
@@ -3568,6 +4233,7 @@ void wallet2::setup_new_blockchain()
   generate_genesis(b);
   m_blockchain.push_back(get_block_hash(b));
   m_last_block_reward = cryptonote::get_outs_money_amount(b.miner_tx);
+  clear_subaddress_str_cache();
   add_subaddress_account(tr("Primary account"));
 }
 
@@ -3608,8 +4274,9 @@ bool wallet2::query_device(hw::device::device_type& device_type, const std::stri
   // Decrypt the contents
   r = ::serialization::parse_binary(buf, keys_file_data);
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "internal error: failed to deserialize \"" + keys_file_name + '\"');
+  THROW_WALLET_EXCEPTION_IF(keys_file_data.kdf_lanes > MAX_KDF_LANES, error::wallet_internal_error, "Unsupported KDF lanes in \"" + keys_file_name + '\"');
   crypto::chacha_key key;
-  crypto::generate_chacha_key(password.data(), password.size(), key, kdf_rounds);
+  generate_chacha_key_from_password(password, key, kdf_rounds, keys_file_data.kdf_lanes);
   std::string account_data;
   account_data.resize(keys_file_data.account_data.size());
   crypto::chacha20(keys_file_data.account_data.data(), keys_file_data.account_data.size(), key, keys_file_data.iv, &account_data[0]);
@@ -3957,7 +4624,7 @@ std::string wallet2::make_multisig(const epee::wipeable_string &password,
   if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_watch_only)
   {
     crypto::chacha_key chacha_key;
-    crypto::generate_chacha_key(password.data(), password.size(), chacha_key, m_kdf_rounds);
+    generate_chacha_key_from_password(password, chacha_key);
     m_account.encrypt_viewkey(chacha_key);
     m_account.decrypt_keys(chacha_key);
     keys_reencryptor = epee::misc_utils::create_scope_leave_handler([&, this, chacha_key]() { m_account.encrypt_keys(chacha_key); m_account.decrypt_viewkey(chacha_key); });
@@ -4101,7 +4768,7 @@ std::string wallet2::exchange_multisig_keys(const epee::wipeable_string &passwor
   if (m_ask_password == AskPasswordToDecrypt && !m_unattended && !m_watch_only)
   {
     crypto::chacha_key chacha_key;
-    crypto::generate_chacha_key(password.data(), password.size(), chacha_key, m_kdf_rounds);
+    generate_chacha_key_from_password(password, chacha_key);
     m_account.encrypt_viewkey(chacha_key);
     m_account.decrypt_keys(chacha_key);
     keys_reencryptor = epee::misc_utils::create_scope_leave_handler([&, this, chacha_key]() { m_account.encrypt_keys(chacha_key); m_account.decrypt_viewkey(chacha_key); });
@@ -4152,6 +4819,8 @@ std::string wallet2::exchange_multisig_keys(const epee::wipeable_string &passwor
 
     m_subaddresses.clear();
     m_subaddress_labels.clear();
+    m_subaddress_keys_generated.clear();
+    clear_subaddress_str_cache();
     add_subaddress_account(tr("Primary account"));
 
     if (!m_wallet_file.empty())
@@ -4180,6 +4849,7 @@ std::string wallet2::exchange_multisig_keys(const epee::wipeable_string &passwor
     crypto::secret_key spend_skey = cryptonote::calculate_multisig_signer_key(multisig_keys);
 
     m_account.make_multisig(m_account.get_keys().m_view_secret_key, spend_skey, rct::rct2pk(rct::identity()), multisig_keys);
+    clear_subaddress_str_cache();
 
     // Packing public multisig keys to exchange with others and calculate common public spend key in the last round
     extra_multisig_info = pack_multisignature_keys(MULTISIG_EXTRA_INFO_MAGIC, secret_keys_to_public_keys(multisig_keys), spend_skey);
@@ -4570,7 +5240,42 @@ bool wallet2::generate_chacha_key_from_secret_keys(crypto::chacha_key &key) cons
 //----------------------------------------------------------------------------------------------------
 void wallet2::generate_chacha_key_from_password(const epee::wipeable_string &pass, crypto::chacha_key &key) const
 {
-  crypto::generate_chacha_key(pass.data(), pass.size(), key, m_kdf_rounds);
+  generate_chacha_key_from_password(pass, key, m_kdf_rounds, m_kdf_lanes);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::generate_chacha_key_from_password(const epee::wipeable_string &pass, crypto::chacha_key &key, uint64_t kdf_rounds, uint32_t kdf_lanes)
+{
+  if (kdf_lanes == 0)
+  {
+    crypto::generate_chacha_key(pass.data(), pass.size(), key, kdf_rounds);
+    return;
+  }
+
+  // Each lane is the original chain over the password and the lane index,
+  // with a scratchpad of its own, so guessing costs kdf_lanes chains while
+  // an unlock with as many cores waits for about one. The lane results are
+  // hashed together into the key.
+  epee::wipeable_string lane_hashes;
+  lane_hashes.resize(kdf_lanes * sizeof(crypto::chacha_key));
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  for (uint32_t lane = 0; lane < kdf_lanes; ++lane)
+  {
+    tpool.submit(&waiter, [&pass, &lane_hashes, kdf_rounds, lane](){
+      epee::wipeable_string seed = pass;
+      for (size_t i = 0; i < sizeof(lane); ++i)
+        seed.push_back((char)(lane >> (8 * i)));
+      crypto::chacha_key lane_key;
+      crypto::generate_chacha_key(seed.data(), seed.size(), lane_key, kdf_rounds);
+      memcpy(lane_hashes.data() + lane * sizeof(crypto::chacha_key), &unwrap(unwrap(lane_key)), sizeof(crypto::chacha_key));
+      memwipe(&unwrap(unwrap(lane_key)), sizeof(lane_key));
+    });
+  }
+  waiter.wait(&tpool);
+
+  epee::mlocked<tools::scrubbed_arr<char, HASH_SIZE>> key_hash;
+  crypto::cn_fast_hash(lane_hashes.data(), lane_hashes.size(), key_hash.data());
+  memcpy(&unwrap(unwrap(key)), key_hash.data(), sizeof(key));
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::load(const std::string& wallet_, const epee::wipeable_string& password)
@@ -4606,6 +5311,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
   {
     wallet2::cache_file_data cache_file_data;
     std::string buf;
+    bool journaled = false;
     bool r = epee::file_io_utils::load_file_to_string(m_wallet_file, buf, std::numeric_limits<size_t>::max());
     THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, m_wallet_file);
 
@@ -4625,6 +5331,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
         iss << cache_data;
         boost::archive::portable_binary_iarchive ar(iss);
         ar >> *this;
+        journaled = true;
       }
       catch(...)
       {
@@ -4685,6 +5392,10 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
       error::wallet_files_doesnt_correspond, m_keys_file, m_wallet_file);
+
+    // only caches written with the current scheme can have a journal
+    if (journaled)
+      load_cache_journal(cache_file_data.iv, buf.size());
   }
 
   cryptonote::block genesis;
@@ -4716,6 +5427,56 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
   }
 }
 //----------------------------------------------------------------------------------------------------
+std::string wallet2::get_history_blob() const
+{
+  // not used since load, it can be written back as it was read
+  if (!m_history_loaded)
+    return m_history_blob;
+  std::stringstream oss;
+  boost::archive::portable_binary_oarchive ar(oss);
+  ar << m_payments << m_confirmed_txs << m_tx_keys << m_additional_tx_keys << m_tx_notes << m_address_book;
+  return oss.str();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_history_blob(std::string blob)
+{
+  m_payments.clear();
+  invalidate_transfer_indexes();
+  m_confirmed_txs.clear();
+  m_tx_keys.clear();
+  m_additional_tx_keys.clear();
+  m_tx_notes.clear();
+  m_address_book.clear();
+  m_history_blob = std::move(blob);
+  m_history_loaded = m_history_blob.empty();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_history() const
+{
+  if (m_history_loaded)
+    return;
+  // the history is part of the wallet state, it is only parsed late to open large wallets faster
+  wallet2 *self = const_cast<wallet2*>(this);
+  TIME_MEASURE_START(load_time);
+  try
+  {
+    std::stringstream iss;
+    iss << m_history_blob;
+    boost::archive::portable_binary_iarchive ar(iss);
+    ar >> self->m_payments >> self->m_confirmed_txs >> self->m_tx_keys >> self->m_additional_tx_keys >> self->m_tx_notes >> self->m_address_book;
+  }
+  catch (const std::exception &e)
+  {
+    THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to load wallet history: ") + e.what());
+  }
+  TIME_MEASURE_FINISH(load_time);
+  LOG_PRINT_L1("Loaded wallet history in " << load_time << " ms: " << m_payments.size() << " payments, " << m_confirmed_txs.size() << " outgoing txes");
+  self->m_history_blob.clear();
+  self->m_history_blob.shrink_to_fit();
+  self->m_history_loaded = true;
+  invalidate_transfer_indexes();
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::trim_hashchain()
 {
   uint64_t height = m_checkpoints.get_max_height();
@@ -4744,11 +5505,224 @@ void wallet2::trim_hashchain()
       MERROR("Failed to request block header from daemon, hash chain may be unable to sync till the wallet is loaded with a usable daemon");
     }
   }
+  // in tail mode, only keep recent hashes in full, whatever the transfers
+  if (m_hashchain_tail > 0 && m_blockchain.size() > m_hashchain_tail + 1)
+    height = std::max<uint64_t>(height, m_blockchain.size() - m_hashchain_tail);
+
   if (height > 0 && m_blockchain.size() > height)
   {
     --height;
     MDEBUG("trimming to " << height << ", offset " << m_blockchain.offset());
-    m_blockchain.trim(height);
+    m_blockchain.trim(height, m_hashchain_tail > 0 ? HASHCHAIN_SPARSE_INTERVAL : 0);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::store_cache_journal()
+{
+  if (!m_cache_journal.valid)
+    return false;
+  if (m_cache_journal.records >= CACHE_JOURNAL_MAX_RECORDS || m_cache_journal.journal_size * CACHE_JOURNAL_MAX_RATIO > m_cache_journal.base_size)
+    return false;
+  boost::system::error_code e;
+  if (!boost::filesystem::exists(m_wallet_file, e) || e)
+    return false;
+
+  // hashes can only be appended, anything else needs a full store
+  const size_t stored_size = m_cache_journal.blockchain_size;
+  if (m_blockchain.offset() != m_cache_journal.blockchain_offset || m_blockchain.size() < stored_size)
+    return false;
+  if (!m_blockchain.is_in_bounds(stored_size - 1) || m_blockchain[stored_size - 1] != m_cache_journal.last_hash)
+    return false;
+  if (m_transfers.size() < m_cache_journal.transfer_hashes.size())
+    return false;
+
+  cache_journal_record record;
+  record.base_iv = std::string((const char*)m_cache_journal.base_iv.data, sizeof(m_cache_journal.base_iv.data));
+  record.index = m_cache_journal.records;
+  record.blockchain_size = stored_size;
+  for (size_t i = stored_size; i < m_blockchain.size(); ++i)
+    record.new_hashes.push_back(m_blockchain[i]);
+  record.transfers_size = m_transfers.size();
+  std::vector<crypto::hash> transfer_hashes(m_transfers.size());
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+  {
+    transfer_hashes[i] = get_transfer_state_hash(m_transfers[i]);
+    if (i >= m_cache_journal.transfer_hashes.size() || transfer_hashes[i] != m_cache_journal.transfer_hashes[i])
+      record.transfers.push_back(std::make_pair(i, m_transfers[i]));
+  }
+
+  // the rest is small enough to be stored whole, without the two containers above
+  {
+    hashchain blockchain;
+    transfer_container transfers;
+    std::swap(blockchain, m_blockchain);
+    std::swap(transfers, m_transfers);
+    auto restore = epee::misc_utils::create_scope_leave_handler([&](){
+      std::swap(blockchain, m_blockchain);
+      std::swap(transfers, m_transfers);
+    });
+    std::stringstream oss;
+    boost::archive::portable_binary_oarchive ar(oss);
+    ar << *this;
+    record.state = oss.str();
+  }
+
+  std::stringstream oss;
+  {
+    boost::archive::portable_binary_oarchive ar(oss);
+    ar << record;
+  }
+  wallet2::cache_file_data cache_file_data = boost::value_initialized<wallet2::cache_file_data>();
+  cache_file_data.cache_data = oss.str();
+  std::string cipher;
+  cipher.resize(cache_file_data.cache_data.size());
+  cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
+  crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cipher[0]);
+  cache_file_data.cache_data = cipher;
+
+  std::ostringstream blob;
+  binary_archive<true> oar(blob);
+  if (!::serialization::serialize(oar, cache_file_data))
+    return false;
+  const std::string data = blob.str();
+
+  // a partly written record is dropped on load, and the next store compacts
+  const std::string journal_file = m_wallet_file + CACHE_JOURNAL_SUFFIX;
+#ifdef WIN32
+  // On Windows avoid using std::ofstream which does not work with UTF-8 filenames
+  std::string journal;
+  if (m_cache_journal.journal_size > 0 && !epee::file_io_utils::load_file_to_string(journal_file, journal))
+    return false;
+  if (journal.size() != m_cache_journal.journal_size)
+    return false;
+  if (!epee::file_io_utils::save_string_to_file(journal_file, journal + data))
+    return false;
+#else
+  std::ofstream ostr;
+  ostr.open(journal_file, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+  ostr.write(data.data(), data.size());
+  ostr.close();
+  if (!ostr.good())
+  {
+    MWARNING("Failed to append to " << journal_file << ", storing the full wallet cache");
+    return false;
+  }
+#endif
+
+  m_cache_journal.journal_size += data.size();
+  ++m_cache_journal.records;
+  m_cache_journal.blockchain_size = m_blockchain.size();
+  m_cache_journal.last_hash = m_blockchain[m_blockchain.size() - 1];
+  m_cache_journal.transfer_hashes = std::move(transfer_hashes);
+  MDEBUG("Appended " << data.size() << " bytes to the cache journal, " << record.new_hashes.size() << " hashes, " << record.transfers.size() << " transfers");
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::reset_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size)
+{
+  m_cache_journal.valid = !m_blockchain.empty();
+  m_cache_journal.base_iv = base_iv;
+  m_cache_journal.base_size = base_size;
+  m_cache_journal.journal_size = 0;
+  m_cache_journal.records = 0;
+  m_cache_journal.blockchain_offset = m_blockchain.offset();
+  m_cache_journal.blockchain_size = m_blockchain.size();
+  m_cache_journal.last_hash = m_blockchain.empty() ? crypto::null_hash : m_blockchain[m_blockchain.size() - 1];
+  m_cache_journal.transfer_hashes.resize(m_transfers.size());
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+    m_cache_journal.transfer_hashes[i] = get_transfer_state_hash(m_transfers[i]);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::load_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size)
+{
+  const std::string journal_file = m_wallet_file + CACHE_JOURNAL_SUFFIX;
+  std::string buf;
+  boost::system::error_code e;
+  if (boost::filesystem::exists(journal_file, e) && !e)
+  {
+    if (!epee::file_io_utils::load_file_to_string(journal_file, buf, std::numeric_limits<size_t>::max()))
+    {
+      MWARNING("Failed to read " << journal_file << ", ignoring it");
+      buf.clear();
+    }
+  }
+
+  // records are applied until the first one that does not decrypt or does not follow,
+  // this is where a store was interrupted, or the journal of an older cache file
+  bool complete = true;
+  uint64_t consumed = 0, records = 0;
+  if (!buf.empty())
+  {
+    binary_archive<false> iar{epee::strspan<std::uint8_t>(buf)};
+    const std::string iv((const char*)base_iv.data, sizeof(base_iv.data));
+    while (consumed < buf.size())
+    {
+      cache_journal_record record;
+      try
+      {
+        wallet2::cache_file_data cache_file_data;
+        if (!::serialization::serialize_noeof(iar, cache_file_data))
+          throw std::runtime_error("truncated record");
+        std::string cache_data;
+        cache_data.resize(cache_file_data.cache_data.size());
+        crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cache_data[0]);
+        std::stringstream ss;
+        ss << cache_data;
+        boost::archive::portable_binary_iarchive ar(ss);
+        ar >> record;
+      }
+      catch (const std::exception &ex)
+      {
+        MWARNING("Cache journal ends with an unreadable record (" << ex.what() << "), dropping it");
+        complete = false;
+        break;
+      }
+      if (record.base_iv != iv || record.index != records || record.blockchain_size != m_blockchain.size())
+      {
+        MWARNING("Cache journal does not follow the wallet cache, dropping it");
+        complete = false;
+        break;
+      }
+      apply_cache_journal_record(record);
+      consumed = buf.size() - iar.remaining_bytes();
+      ++records;
+    }
+    LOG_PRINT_L1("Applied " << records << " cache journal records");
+  }
+
+  reset_cache_journal(base_iv, base_size);
+  m_cache_journal.valid = m_cache_journal.valid && complete;
+  m_cache_journal.journal_size = consumed;
+  m_cache_journal.records = records;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::apply_cache_journal_record(cache_journal_record &record)
+{
+  THROW_WALLET_EXCEPTION_IF(record.transfers_size < m_transfers.size(), error::wallet_internal_error,
+      "Cache journal record drops transfers");
+  {
+    hashchain blockchain;
+    transfer_container transfers;
+    std::swap(blockchain, m_blockchain);
+    std::swap(transfers, m_transfers);
+    auto restore = epee::misc_utils::create_scope_leave_handler([&](){
+      std::swap(blockchain, m_blockchain);
+      std::swap(transfers, m_transfers);
+    });
+    std::stringstream iss;
+    iss << record.state;
+    boost::archive::portable_binary_iarchive ar(iss);
+    ar >> *this;
+  }
+  for (const crypto::hash &hash: record.new_hashes)
+    m_blockchain.push_back(hash);
+  m_transfers.resize(record.transfers_size);
+  invalidate_balance_cache();
+  for (auto &t: record.transfers)
+  {
+    THROW_WALLET_EXCEPTION_IF(t.first >= m_transfers.size(), error::wallet_internal_error,
+        "Cache journal record has an out of range transfer");
+    m_transfers[t.first] = std::move(t.second);
   }
 }
 //----------------------------------------------------------------------------------------------------
@@ -4786,6 +5760,9 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     same_file = pos != std::string::npos;
   }
 
+  // most stores only add to the journal, the cache file is rewritten when it needs compacting
+  if (same_file && store_cache_journal())
+    return;
 
   if (!same_file)
   {
@@ -4838,6 +5815,10 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_file);
     }
+    // remove old cache journal, if any
+    boost::system::error_code ec;
+    boost::filesystem::remove(old_file + CACHE_JOURNAL_SUFFIX, ec);
+    m_cache_journal.valid = false;
     // remove old keys file
     r = boost::filesystem::remove(old_keys_file);
     if (!r) {
@@ -4872,6 +5853,16 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+
+    // the new cache file holds everything the journal did
+    boost::system::error_code ec;
+    boost::filesystem::remove(m_wallet_file + CACHE_JOURNAL_SUFFIX, ec);
+    reset_cache_journal(cache_file_data.iv, cache_file_data.cache_data.size());
+    if (ec)
+    {
+      MWARNING("Failed to remove " << m_wallet_file << CACHE_JOURNAL_SUFFIX << ": " << ec.message());
+      m_cache_journal.valid = false;
+    }
   }
 }
 //----------------------------------------------------------------------------------------------------
@@ -4895,19 +5886,98 @@ uint64_t wallet2::unlocked_balance(uint32_t index_major) const
   return amount;
 }
 //----------------------------------------------------------------------------------------------------
-std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_major) const
+void wallet2::batch_callbacks(bool batch)
 {
-  std::map<uint32_t, uint64_t> amount_per_subaddr;
-  for (const auto& td: m_transfers)
+  if (batch == (m_event_dispatcher != nullptr))
+    return;
+  if (batch)
+  {
+    m_event_dispatcher.reset(new event_dispatcher([this](const std::vector<wallet_event> &events) {
+      if (0 != m_callback)
+        m_callback->on_events(events);
+    }));
+  }
+  else
+  {
+    flush_events();
+    m_event_dispatcher.reset();
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::flush_events()
+{
+  if (!m_event_dispatcher || m_pending_events.empty())
+    return;
+  m_event_dispatcher->post(std::move(m_pending_events));
+  m_pending_events.clear();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_balance_cache() const
+{
+  m_balance_cache.clear();
+  m_unlocked_balance_cache.clear();
+  m_locked_transfers.clear();
+  m_unspent_transfers.clear();
+  m_balance_cache_transfers = 0;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_balance_cache() const
+{
+  if (m_balance_cache_transfers > m_transfers.size())
+    invalidate_balance_cache();
+  for (; m_balance_cache_transfers < m_transfers.size(); ++m_balance_cache_transfers)
   {
-    if (td.m_subaddr_index.major == index_major && !td.m_spent)
+    const transfer_details &td = m_transfers[m_balance_cache_transfers];
+    if (td.m_spent)
+      continue;
+    balance_cache_entry &e = m_balance_cache[td.m_subaddr_index.major][td.m_subaddr_index.minor];
+    e.amount += td.amount();
+    ++e.count;
+    m_locked_transfers.insert(m_balance_cache_transfers);
+    m_unspent_transfers[td.m_subaddr_index.major][td.m_subaddr_index.minor].insert(m_balance_cache_transfers);
+  }
+  // only recently received or time locked outputs are in there
+  for (auto i = m_locked_transfers.begin(); i != m_locked_transfers.end(); )
+  {
+    const transfer_details &td = m_transfers[*i];
+    if (is_transfer_unlocked(td))
     {
-      auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
-      else
-        found->second += td.amount();
+      balance_cache_entry &u = m_unlocked_balance_cache[td.m_subaddr_index.major][td.m_subaddr_index.minor];
+      u.amount += td.amount();
+      ++u.count;
+      i = m_locked_transfers.erase(i);
     }
+    else
+      ++i;
+  }
+}
+//----------------------------------------------------------------------------------------------------
+std::vector<size_t> wallet2::get_unspent_transfers(uint32_t subaddr_account, const std::set<uint32_t> &subaddr_indices) const
+{
+  // unspent transfers of the account (all subaddresses if none are given), oldest first;
+  // callers still check whether they are unlocked and usable
+  std::vector<size_t> indices;
+  update_balance_cache();
+  auto account = m_unspent_transfers.find(subaddr_account);
+  if (account == m_unspent_transfers.end())
+    return indices;
+  for (const auto &e: account->second)
+    if (subaddr_indices.empty() || subaddr_indices.count(e.first) == 1)
+      indices.insert(indices.end(), e.second.begin(), e.second.end());
+  std::sort(indices.begin(), indices.end());
+  return indices;
+}
+//----------------------------------------------------------------------------------------------------
+std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_major) const
+{
+  std::map<uint32_t, uint64_t> amount_per_subaddr;
+  update_balance_cache();
+  auto account = m_balance_cache.find(index_major);
+  if (account != m_balance_cache.end())
+  {
+    for (const auto &e: account->second)
+      if (e.second.count > 0)
+        amount_per_subaddr.emplace_hint(amount_per_subaddr.end(), e.first, e.second.amount);
   }
   for (const auto& utx: m_unconfirmed_txs)
   {
@@ -4927,16 +5997,13 @@ std::map<uint32_t, uint64_t> wallet2::balance_per_subaddress(uint32_t index_majo
 std::map<uint32_t, uint64_t> wallet2::unlocked_balance_per_subaddress(uint32_t index_major) const
 {
   std::map<uint32_t, uint64_t> amount_per_subaddr;
-  for(const transfer_details& td: m_transfers)
+  update_balance_cache();
+  auto account = m_unlocked_balance_cache.find(index_major);
+  if (account != m_unlocked_balance_cache.end())
   {
-    if(td.m_subaddr_index.major == index_major && !td.m_spent && is_transfer_unlocked(td))
-    {
-      auto found = amount_per_subaddr.find(td.m_subaddr_index.minor);
-      if (found == amount_per_subaddr.end())
-        amount_per_subaddr[td.m_subaddr_index.minor] = td.amount();
-      else
-        found->second += td.amount();
-    }
+    for (const auto &e: account->second)
+      if (e.second.count > 0)
+        amount_per_subaddr.emplace_hint(amount_per_subaddr.end(), e.first, e.second.amount);
   }
   return amount_per_subaddr;
 }
@@ -4964,6 +6031,7 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
+  load_history();
   auto range = m_payments.equal_range(payment_id);
   std::for_each(range.first, range.second, [&payments, &min_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
     if (min_height < x.second.m_block_height &&
@@ -4975,31 +6043,130 @@ void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::pa
   });
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
+bool wallet2::transfer_cursor::operator<(const transfer_cursor &other) const
 {
-  auto range = std::make_pair(m_payments.begin(), m_payments.end());
-  std::for_each(range.first, range.second, [&payments, &min_height, &max_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
-    if (min_height < x.second.m_block_height && max_height >= x.second.m_block_height &&
-      (!subaddr_account || *subaddr_account == x.second.m_subaddr_index.major) &&
-      (subaddr_indices.empty() || subaddr_indices.count(x.second.m_subaddr_index.minor) == 1))
-    {
-      payments.push_back(x);
+  if (account != other.account)
+    return account < other.account;
+  if (height != other.height)
+    return height < other.height;
+  const int cmp = memcmp(&txid, &other.txid, sizeof(txid));
+  if (cmp)
+    return cmp < 0;
+  return minor < other.minor;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_transfer_indexes() const
+{
+  m_transfer_indexes_valid = false;
+  m_payments_index.clear();
+  m_confirmed_txs_index.clear();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_payment(const payment_container::value_type &p) const
+{
+  if (m_transfer_indexes_valid)
+    m_payments_index[transfer_cursor(p.second.m_subaddr_index.major, p.second.m_block_height, p.second.m_tx_hash, p.second.m_subaddr_index.minor)] = &p;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &p) const
+{
+  if (m_transfer_indexes_valid)
+    m_confirmed_txs_index[transfer_cursor(p.second.m_subaddr_account, p.second.m_block_height, p.first)] = &p;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_transfer_indexes() const
+{
+  load_history();
+  if (m_transfer_indexes_valid)
+    return;
+  m_transfer_indexes_valid = true;
+  for (const auto &p: m_payments)
+    index_payment(p);
+  for (const auto &p: m_confirmed_txs)
+    index_confirmed_tx(p);
+}
+//----------------------------------------------------------------------------------------------------
+namespace
+{
+  // walks the entries of an account/height index with min_height < height <= max_height,
+  // skipping whole ranges outside of it; stops with the cursor on the first matching entry past max_count
+  template<typename Index, typename Match, typename Emit>
+  bool walk_transfer_index(const Index &index, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, size_t max_count, wallet2::transfer_cursor &cursor, Match match, Emit emit)
+  {
+    if (max_height <= min_height)
+      return false;
+    wallet2::transfer_cursor start(subaddr_account ? *subaddr_account : 0, min_height + 1);
+    if (start < cursor)
+      start = cursor;
+    size_t count = 0;
+    auto it = index.lower_bound(start);
+    while (it != index.end())
+    {
+      const uint32_t account = it->first.account;
+      if (subaddr_account && account != *subaddr_account)
+        break;
+      if (it->first.height <= min_height)
+      {
+        it = index.lower_bound(wallet2::transfer_cursor(account, min_height + 1));
+        continue;
+      }
+      if (it->first.height > max_height)
+      {
+        if (subaddr_account || account == std::numeric_limits<uint32_t>::max())
+          break;
+        it = index.lower_bound(wallet2::transfer_cursor(account + 1, min_height + 1));
+        continue;
+      }
+      if (match(*it->second))
+      {
+        if (max_count && count == max_count)
+        {
+          cursor = it->first;
+          return true;
+        }
+        emit(*it->second);
+        ++count;
+      }
+      ++it;
     }
+    return false;
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
+{
+  load_history();
+  transfer_cursor cursor;
+  get_payments(payments, min_height, max_height, subaddr_account, subaddr_indices, 0, cursor);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices, size_t max_count, transfer_cursor &cursor) const
+{
+  load_history();
+  update_transfer_indexes();
+  return walk_transfer_index(m_payments_index, min_height, max_height, subaddr_account, max_count, cursor, [&subaddr_indices](const payment_container::value_type& x) {
+    return subaddr_indices.empty() || subaddr_indices.count(x.second.m_subaddr_index.minor) == 1;
+  }, [&payments](const payment_container::value_type& x) {
+    payments.push_back(x);
   });
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
     uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
-  for (auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); ++i) {
-    if (i->second.m_block_height <= min_height || i->second.m_block_height > max_height)
-      continue;
-    if (subaddr_account && *subaddr_account != i->second.m_subaddr_account)
-      continue;
-    if (!subaddr_indices.empty() && std::count_if(i->second.m_subaddr_indices.begin(), i->second.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) == 0)
-      continue;
-    confirmed_payments.push_back(*i);
-  }
+  transfer_cursor cursor;
+  get_payments_out(confirmed_payments, min_height, max_height, subaddr_account, subaddr_indices, 0, cursor);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
+    uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices, size_t max_count, transfer_cursor &cursor) const
+{
+  update_transfer_indexes();
+  return walk_transfer_index(m_confirmed_txs_index, min_height, max_height, subaddr_account, max_count, cursor, [&subaddr_indices](const std::pair<const crypto::hash, confirmed_transfer_details>& x) {
+    return subaddr_indices.empty() || std::count_if(x.second.m_subaddr_indices.begin(), x.second.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) != 0;
+  }, [&confirmed_payments](const std::pair<const crypto::hash, confirmed_transfer_details>& x) {
+    confirmed_payments.push_back(x);
+  });
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
@@ -5022,32 +6189,68 @@ void wallet2::get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2:
   }
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::rescan_spent()
+void wallet2::get_key_images_spent_status(const std::vector<crypto::key_image> &key_images, std::vector<int> &spent_status)
 {
+  spent_status.clear();
+  spent_status.reserve(key_images.size());
+
+  // recent daemons take the key images as one binary blob, which is much cheaper
+  // to send and parse than hex strings, so we can ask for many more at a time
+  uint32_t rpc_version = 0;
+  boost::optional<std::string> result = m_node_rpc_proxy.get_rpc_version(rpc_version);
+  const bool use_bin = !result && rpc_version >= MAKE_CORE_RPC_VERSION(2, 5);
+
   // This is RPC call that can take a long time if there are many outputs,
   // so we call it several times, in stripes, so we don't time out spuriously
-  std::vector<int> spent_status;
-  spent_status.reserve(m_transfers.size());
-  const size_t chunk_size = 1000;
-  for (size_t start_offset = 0; start_offset < m_transfers.size(); start_offset += chunk_size)
-  {
-    const size_t n_outputs = std::min<size_t>(chunk_size, m_transfers.size() - start_offset);
-    MDEBUG("Calling is_key_image_spent on " << start_offset << " - " << (start_offset + n_outputs - 1) << ", out of " << m_transfers.size());
-    COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
-    COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
-    for (size_t n = start_offset; n < start_offset + n_outputs; ++n)
-      req.key_images.push_back(string_tools::pod_to_hex(m_transfers[n].m_key_image));
-    m_daemon_rpc_mutex.lock();
-    bool r = epee::net_utils::invoke_http_json("/is_key_image_spent", req, daemon_resp, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent");
-    THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent");
-    THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, daemon_resp.status);
-    THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != n_outputs, error::wallet_internal_error,
-      "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
-      std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(n_outputs));
-    std::copy(daemon_resp.spent_status.begin(), daemon_resp.spent_status.end(), std::back_inserter(spent_status));
+  const size_t chunk_size = use_bin ? 10000 : 1000;
+  for (size_t start_offset = 0; start_offset < key_images.size(); start_offset += chunk_size)
+  {
+    const size_t n_outputs = std::min<size_t>(chunk_size, key_images.size() - start_offset);
+    MDEBUG("Calling is_key_image_spent on " << start_offset << " - " << (start_offset + n_outputs - 1) << ", out of " << key_images.size());
+    if (use_bin)
+    {
+      COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::request req = AUTO_VAL_INIT(req);
+      COMMAND_RPC_IS_KEY_IMAGE_SPENT_BIN::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
+      req.key_images.assign(key_images.begin() + start_offset, key_images.begin() + start_offset + n_outputs);
+      m_daemon_rpc_mutex.lock();
+      bool r = epee::net_utils::invoke_http_bin("/is_key_image_spent.bin", req, daemon_resp, m_http_client, rpc_timeout);
+      m_daemon_rpc_mutex.unlock();
+      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent.bin");
+      THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent.bin");
+      THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, daemon_resp.status);
+      THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != n_outputs, error::wallet_internal_error,
+        "daemon returned wrong response for is_key_image_spent.bin, wrong amounts count = " +
+        std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(n_outputs));
+      std::copy(daemon_resp.spent_status.begin(), daemon_resp.spent_status.end(), std::back_inserter(spent_status));
+    }
+    else
+    {
+      COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
+      COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
+      for (size_t n = start_offset; n < start_offset + n_outputs; ++n)
+        req.key_images.push_back(string_tools::pod_to_hex(key_images[n]));
+      m_daemon_rpc_mutex.lock();
+      bool r = epee::net_utils::invoke_http_json("/is_key_image_spent", req, daemon_resp, m_http_client, rpc_timeout);
+      m_daemon_rpc_mutex.unlock();
+      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent");
+      THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent");
+      THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, daemon_resp.status);
+      THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != n_outputs, error::wallet_internal_error,
+        "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
+        std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(n_outputs));
+      std::copy(daemon_resp.spent_status.begin(), daemon_resp.spent_status.end(), std::back_inserter(spent_status));
+    }
   }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rescan_spent()
+{
+  std::vector<crypto::key_image> key_images;
+  key_images.reserve(m_transfers.size());
+  for (const transfer_details &td: m_transfers)
+    key_images.push_back(td.m_key_image);
+  std::vector<int> spent_status;
+  get_key_images_spent_status(key_images, spent_status);
 
   // update spent status
   for (size_t i = 0; i < m_transfers.size(); ++i)
@@ -5084,6 +6287,38 @@ void wallet2::rescan_blockchain(bool refresh)
     this->refresh(false);
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::transfer_details::compact_tx()
+{
+  // Spending and reporting only need our output (at its index), the input
+  // key images, the tx pubkeys and the unlock time: drop rings, the other
+  // outputs and the rest of extra.
+  for (cryptonote::txin_v &in: m_tx.vin)
+  {
+    if (in.type() == typeid(cryptonote::txin_to_key))
+      std::vector<uint64_t>().swap(boost::get<cryptonote::txin_to_key>(in).key_offsets);
+  }
+
+  if (m_internal_output_index < m_tx.vout.size())
+  {
+    std::vector<cryptonote::tx_out> vout(m_internal_output_index + 1);
+    vout.back() = m_tx.vout[m_internal_output_index];
+    m_tx.vout.swap(vout);
+  }
+
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  if (!cryptonote::parse_tx_extra(m_tx.extra, tx_extra_fields))
+    return; // keep it all rather than lose a pubkey past the bad field
+  std::vector<uint8_t> extra;
+  for (const cryptonote::tx_extra_field &field: tx_extra_fields)
+  {
+    if (field.type() == typeid(cryptonote::tx_extra_pub_key))
+      cryptonote::add_tx_pub_key_to_extra(extra, boost::get<cryptonote::tx_extra_pub_key>(field).pub_key);
+    else if (field.type() == typeid(cryptonote::tx_extra_additional_pub_keys))
+      cryptonote::add_additional_tx_pub_keys_to_extra(extra, boost::get<cryptonote::tx_extra_additional_pub_keys>(field).data);
+  }
+  m_tx.extra.swap(extra);
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::is_transfer_unlocked(const transfer_details& td) const
 {
   return is_transfer_unlocked(td.m_tx.unlock_time, td.m_block_height);
@@ -5341,6 +6576,7 @@ crypto::hash wallet2::get_payment_id(const pending_tx &ptx) const
 // take a pending tx and actually send it to the daemon
 void wallet2::commit_tx(pending_tx& ptx)
 {
+  load_history();
   using namespace cryptonote;
   
   if(m_light_wallet) 
@@ -5418,6 +6654,7 @@ void wallet2::commit_tx(pending_tx& ptx)
 
 void wallet2::commit_tx(std::vector<pending_tx>& ptx_vector)
 {
+  load_history();
   for (auto & ptx : ptx_vector)
   {
     commit_tx(ptx);
@@ -5542,6 +6779,7 @@ bool wallet2::parse_unsigned_tx_from_str(const std::string &unsigned_tx_st, unsi
 //----------------------------------------------------------------------------------------------------
 bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &signed_filename, std::vector<wallet2::pending_tx> &txs, std::function<bool(const unsigned_tx_set&)> accept_func, bool export_raw)
 {
+  load_history();
   unsigned_tx_set exported_txs;
   if(!load_unsigned_tx(unsigned_filename, exported_txs))
     return false;
@@ -5556,26 +6794,74 @@ bool wallet2::sign_tx(const std::string &unsigned_filename, const std::string &s
 //----------------------------------------------------------------------------------------------------
 bool wallet2::sign_tx(unsigned_tx_set &exported_txs, std::vector<wallet2::pending_tx> &txs, signed_tx_set &signed_txes)
 {
+  load_history();
   import_outputs(exported_txs.transfers);
 
-  // sign the transactions
-  for (size_t n = 0; n < exported_txs.txes.size(); ++n)
-  {
-    tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
+  // sign the transactions; each one only reads the keys and its own construction
+  // data, so with a software device they are built in parallel, a wave at a time
+  // so progress can be reported from this thread, and collected in order
+  const size_t n_txes = exported_txs.txes.size();
+  std::vector<cryptonote::transaction> signed_txs(n_txes);
+  std::vector<crypto::secret_key> tx_keys(n_txes);
+  std::vector<std::vector<crypto::secret_key>> all_additional_tx_keys(n_txes);
+  std::vector<uint8_t> constructed(n_txes, 0);
+  std::vector<std::exception_ptr> errors(n_txes);
+  for (size_t n = 0; n < n_txes; ++n)
+  {
+    const tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
     THROW_WALLET_EXCEPTION_IF(sd.sources.empty(), error::wallet_internal_error, "Empty sources");
     LOG_PRINT_L1(" " << (n+1) << ": " << sd.sources.size() << " inputs, ring size " << sd.sources[0].outputs.size());
-    signed_txes.ptx.push_back(pending_tx());
-    tools::wallet2::pending_tx &ptx = signed_txes.ptx.back();
-    rct::RangeProofType range_proof_type = rct::RangeProofBorromean;
-    if (sd.use_bulletproofs)
+  }
+  const auto construct = [&](size_t n)
+  {
+    tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
+    const rct::RangeProofType range_proof_type = sd.use_bulletproofs ? rct::RangeProofPaddedBulletproof : rct::RangeProofBorromean;
+    rct::multisig_out msout;
+    try
     {
-      range_proof_type = rct::RangeProofPaddedBulletproof;
+      constructed[n] = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), m_subaddresses, sd.sources, sd.splitted_dsts, sd.change_dts.addr, sd.extra, signed_txs[n], sd.unlock_time, tx_keys[n], all_additional_tx_keys[n], sd.use_rct, range_proof_type, m_multisig ? &msout : NULL);
     }
-    crypto::secret_key tx_key;
-    std::vector<crypto::secret_key> additional_tx_keys;
-    rct::multisig_out msout;
-    bool r = cryptonote::construct_tx_and_get_tx_key(m_account.get_keys(), m_subaddresses, sd.sources, sd.splitted_dsts, sd.change_dts.addr, sd.extra, ptx.tx, sd.unlock_time, tx_key, additional_tx_keys, sd.use_rct, range_proof_type, m_multisig ? &msout : NULL);
-    THROW_WALLET_EXCEPTION_IF(!r, error::tx_not_constructed, sd.sources, sd.splitted_dsts, sd.unlock_time, m_nettype);
+    catch (...)
+    {
+      errors[n] = std::current_exception();
+    }
+  };
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const bool parallel = n_txes > 1 && tpool.get_max_concurrency() > 1 && m_account.get_device().get_type() == hw::device::device_type::SOFTWARE;
+  const size_t wave_size = parallel ? tpool.get_max_concurrency() : 1;
+  for (size_t begin = 0; begin < n_txes; begin += wave_size)
+  {
+    const size_t end = std::min(begin + wave_size, n_txes);
+    if (parallel)
+    {
+      tools::threadpool::waiter waiter;
+      for (size_t n = begin; n < end; ++n)
+        tpool.submit(&waiter, std::bind(construct, n));
+      waiter.wait(&tpool);
+    }
+    else
+    {
+      construct(begin);
+    }
+    for (size_t n = begin; n < end; ++n)
+    {
+      const tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
+      if (errors[n])
+        std::rethrow_exception(errors[n]);
+      THROW_WALLET_EXCEPTION_IF(!constructed[n], error::tx_not_constructed, sd.sources, sd.splitted_dsts, sd.unlock_time, m_nettype);
+    }
+    if (m_callback)
+      m_callback->on_sign_tx_progress(end, n_txes);
+  }
+
+  for (size_t n = 0; n < n_txes; ++n)
+  {
+    tools::wallet2::tx_construction_data &sd = exported_txs.txes[n];
+    signed_txes.ptx.push_back(pending_tx());
+    tools::wallet2::pending_tx &ptx = signed_txes.ptx.back();
+    ptx.tx = std::move(signed_txs[n]);
+    const crypto::secret_key &tx_key = tx_keys[n];
+    const std::vector<crypto::secret_key> &additional_tx_keys = all_additional_tx_keys[n];
     // we don't test tx size, because we don't know the current limit, due to not having a blockchain,
     // and it's a bit pointless to fail there anyway, since it'd be a (good) guess only. We sign anyway,
     // and if we really go over limit, the daemon will reject when it gets submitted. Chances are it's
@@ -5629,6 +6915,7 @@ bool wallet2::sign_tx(unsigned_tx_set &exported_txs, std::vector<wallet2::pendin
 //----------------------------------------------------------------------------------------------------
 bool wallet2::sign_tx(unsigned_tx_set &exported_txs, const std::string &signed_filename, std::vector<wallet2::pending_tx> &txs, bool export_raw)
 {
+  load_history();
   // sign the transactions
   signed_tx_set signed_txes;
   std::string ciphertext = sign_tx_dump_to_str(exported_txs, txs, signed_txes);
@@ -5872,6 +7159,7 @@ bool wallet2::save_multisig_tx(const std::vector<pending_tx>& ptx_vector, const
 //----------------------------------------------------------------------------------------------------
 bool wallet2::load_multisig_tx(cryptonote::blobdata s, multisig_tx_set &exported_txs, std::function<bool(const multisig_tx_set&)> accept_func)
 {
+  load_history();
   const size_t magiclen = strlen(MULTISIG_UNSIGNED_TX_PREFIX);
   if (strncmp(s.c_str(), MULTISIG_UNSIGNED_TX_PREFIX, magiclen))
   {
@@ -5963,6 +7251,7 @@ bool wallet2::load_multisig_tx_from_file(const std::string &filename, multisig_t
 //----------------------------------------------------------------------------------------------------
 bool wallet2::sign_multisig_tx(multisig_tx_set &exported_txs, std::vector<crypto::hash> &txids)
 {
+  load_history();
   THROW_WALLET_EXCEPTION_IF(exported_txs.m_ptx.empty(), error::wallet_internal_error, "No tx found");
 
   const crypto::public_key local_signer = get_multisig_signer_public_key();
@@ -6326,6 +7615,48 @@ bool wallet2::set_ring_database(const std::string &filename)
   }
   return true;
 }
+//----------------------------------------------------------------------------------------------------
+bool wallet2::set_daemon_events_address(const std::string &address)
+{
+  m_daemon_notifier.reset();
+  m_daemon_events_address = address;
+  if (address.empty())
+    return true;
+
+  // the first refresh after subscribing catches up with anything missed before
+  m_daemon_event.store(true, std::memory_order_relaxed);
+  m_daemon_notifier.reset(new daemon_notifier([this]() { m_daemon_event.store(true, std::memory_order_relaxed); }));
+  if (!m_daemon_notifier->connect(address))
+  {
+    m_daemon_notifier.reset();
+    m_daemon_events_address = "";
+    return false;
+  }
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::set_block_database(const std::string &filename)
+{
+  m_block_database = filename;
+  m_blockdb.reset();
+  if (!m_block_database.empty())
+  {
+    MINFO("blockdb path set to " << filename);
+    try
+    {
+      cryptonote::block b;
+      generate_genesis(b);
+      m_blockdb = tools::blockdb::open(m_block_database, epee::string_tools::pod_to_hex(get_block_hash(b)));
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to initialize blockdb: " << e.what());
+      m_block_database = "";
+      return false;
+    }
+  }
+  return true;
+}
 
 crypto::chacha_key wallet2::get_ringdb_key()
 {
@@ -6347,16 +7678,51 @@ bool wallet2::add_rings(const crypto::chacha_key &key, const cryptonote::transac
   catch (const std::exception &e) { return false; }
 }
 
-bool wallet2::add_rings(const cryptonote::transaction_prefix &tx)
+bool wallet2::add_rings(const crypto::chacha_key &key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings)
+{
+  if (!m_ringdb)
+    return false;
+  try { return m_ringdb->add_rings(key, rings); }
+  catch (const std::exception &e) { return false; }
+}
+
+bool wallet2::add_rings(const cryptonote::transaction_prefix &tx)
+{
+  if (m_batch_rings)
+  {
+    if (!m_ringdb)
+      return false;
+    for (const auto &in: tx.vin)
+    {
+      if (in.type() != typeid(cryptonote::txin_to_key))
+        continue;
+      const auto &txin = boost::get<cryptonote::txin_to_key>(in);
+      m_pending_rings.push_back(std::make_pair(txin.k_image, txin.key_offsets));
+    }
+    return true;
+  }
+  try { return add_rings(get_ringdb_key(), tx); }
+  catch (const std::exception &e) { return false; }
+}
+
+bool wallet2::flush_pending_rings()
 {
-  try { return add_rings(get_ringdb_key(), tx); }
-  catch (const std::exception &e) { return false; }
+  if (m_pending_rings.empty())
+    return true;
+  bool r = false;
+  try { r = add_rings(get_ringdb_key(), m_pending_rings); }
+  catch (const std::exception &e) { }
+  if (!r)
+    MWARNING("Failed to save " << m_pending_rings.size() << " rings");
+  m_pending_rings.clear();
+  return r;
 }
 
 bool wallet2::remove_rings(const cryptonote::transaction_prefix &tx)
 {
   if (!m_ringdb)
     return false;
+  flush_pending_rings();
   try { return m_ringdb->remove_rings(get_ringdb_key(), tx); }
   catch (const std::exception &e) { return false; }
 }
@@ -6371,6 +7737,7 @@ bool wallet2::get_ring(const crypto::chacha_key &key, const crypto::key_image &k
 
 bool wallet2::get_rings(const crypto::hash &txid, std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &outs)
 {
+  load_history();
   for (auto i: m_confirmed_txs)
   {
     if (txid == i.first)
@@ -6455,6 +7822,7 @@ bool wallet2::find_and_save_rings(bool force)
 
     MDEBUG("Scanning " << res.txs.size() << " transactions");
     THROW_WALLET_EXCEPTION_IF(slice + res.txs.size() > txs_hashes.size(), error::wallet_internal_error, "Unexpected tx array size");
+    std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> rings;
     auto it = req.txs_hashes.begin();
     for (size_t i = 0; i < res.txs.size(); ++i, ++it)
     {
@@ -6467,8 +7835,15 @@ bool wallet2::find_and_save_rings(bool force)
     crypto::hash tx_hash, tx_prefix_hash;
     THROW_WALLET_EXCEPTION_IF(!cryptonote::parse_and_validate_tx_from_blob(bd, tx, tx_hash, tx_prefix_hash), error::wallet_internal_error, "failed to parse tx from blob");
     THROW_WALLET_EXCEPTION_IF(epee::string_tools::pod_to_hex(tx_hash) != tx_info.tx_hash, error::wallet_internal_error, "txid mismatch");
-    THROW_WALLET_EXCEPTION_IF(!add_rings(get_ringdb_key(), tx), error::wallet_internal_error, "Failed to save ring");
+    for (const auto &in: tx.vin)
+    {
+      if (in.type() != typeid(cryptonote::txin_to_key))
+        continue;
+      const auto &txin = boost::get<cryptonote::txin_to_key>(in);
+      rings.push_back(std::make_pair(txin.k_image, txin.key_offsets));
+    }
     }
+    THROW_WALLET_EXCEPTION_IF(!add_rings(get_ringdb_key(), rings), error::wallet_internal_error, "Failed to save ring");
   }
 
   MINFO("Found and saved rings for " << txs_hashes.size() << " transactions");
@@ -6723,46 +8098,63 @@ void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>>
     std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> segregation_limit;
     if (is_after_segregation_fork && (m_segregate_pre_fork_outputs || m_key_reuse_mitigation2))
     {
+      // those are settled once we're past the fork vicinity, so keep them across transactions
+      if (is_shortly_after_segregation_fork)
+        m_segregation_limits.clear();
       cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req_t = AUTO_VAL_INIT(req_t);
       cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response resp_t = AUTO_VAL_INIT(resp_t);
-      for(size_t idx: selected_transfers)
-        req_t.amounts.push_back(m_transfers[idx].is_rct() ? 0 : m_transfers[idx].amount());
-      std::sort(req_t.amounts.begin(), req_t.amounts.end());
-      auto end = std::unique(req_t.amounts.begin(), req_t.amounts.end());
-      req_t.amounts.resize(std::distance(req_t.amounts.begin(), end));
-      req_t.from_height = std::max<uint64_t>(segregation_fork_height, RECENT_OUTPUT_BLOCKS) - RECENT_OUTPUT_BLOCKS;
-      req_t.to_height = segregation_fork_height + 1;
-      req_t.cumulative = true;
-      req_t.binary = true;
-      m_daemon_rpc_mutex.lock();
-      bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_output_distribution", req_t, resp_t, m_http_client, rpc_timeout * 1000);
-      m_daemon_rpc_mutex.unlock();
-      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "transfer_selected");
-      THROW_WALLET_EXCEPTION_IF(resp_t.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_distribution");
-      THROW_WALLET_EXCEPTION_IF(resp_t.status != CORE_RPC_STATUS_OK, error::get_output_distribution, resp_t.status);
-
-      // check we got all data
       for(size_t idx: selected_transfers)
       {
         const uint64_t amount = m_transfers[idx].is_rct() ? 0 : m_transfers[idx].amount();
-        bool found = false;
-        for (const auto &d: resp_t.distributions)
+        auto cached = m_segregation_limits.find(amount);
+        if (cached != m_segregation_limits.end())
+          segregation_limit[amount] = cached->second;
+        else
+          req_t.amounts.push_back(amount);
+      }
+      if (!req_t.amounts.empty())
+      {
+        std::sort(req_t.amounts.begin(), req_t.amounts.end());
+        auto end = std::unique(req_t.amounts.begin(), req_t.amounts.end());
+        req_t.amounts.resize(std::distance(req_t.amounts.begin(), end));
+        req_t.from_height = std::max<uint64_t>(segregation_fork_height, RECENT_OUTPUT_BLOCKS) - RECENT_OUTPUT_BLOCKS;
+        req_t.to_height = segregation_fork_height + 1;
+        req_t.cumulative = true;
+        req_t.binary = true;
+        m_daemon_rpc_mutex.lock();
+        bool r = net_utils::invoke_http_json_rpc("/json_rpc", "get_output_distribution", req_t, resp_t, m_http_client, rpc_timeout * 1000);
+        m_daemon_rpc_mutex.unlock();
+        THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "transfer_selected");
+        THROW_WALLET_EXCEPTION_IF(resp_t.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_output_distribution");
+        THROW_WALLET_EXCEPTION_IF(resp_t.status != CORE_RPC_STATUS_OK, error::get_output_distribution, resp_t.status);
+
+        // check we got all data
+        for(size_t idx: selected_transfers)
         {
-          if (d.amount == amount)
+          const uint64_t amount = m_transfers[idx].is_rct() ? 0 : m_transfers[idx].amount();
+          if (segregation_limit.count(amount))
+            continue;
+          bool found = false;
+          for (const auto &d: resp_t.distributions)
           {
-            THROW_WALLET_EXCEPTION_IF(d.start_height > segregation_fork_height, error::get_output_distribution, "Distribution start_height too high");
-            THROW_WALLET_EXCEPTION_IF(segregation_fork_height - d.start_height >= d.distribution.size(), error::get_output_distribution, "Distribution size too small");
-            THROW_WALLET_EXCEPTION_IF(segregation_fork_height - RECENT_OUTPUT_BLOCKS - d.start_height >= d.distribution.size(), error::get_output_distribution, "Distribution size too small");
-            THROW_WALLET_EXCEPTION_IF(segregation_fork_height <= RECENT_OUTPUT_BLOCKS, error::wallet_internal_error, "Fork height too low");
-            THROW_WALLET_EXCEPTION_IF(segregation_fork_height - RECENT_OUTPUT_BLOCKS < d.start_height, error::get_output_distribution, "Bad start height");
-            uint64_t till_fork = d.distribution[segregation_fork_height - d.start_height];
-            uint64_t recent = till_fork - d.distribution[segregation_fork_height - RECENT_OUTPUT_BLOCKS - d.start_height];
-            segregation_limit[amount] = std::make_pair(till_fork, recent);
-            found = true;
-            break;
+            if (d.amount == amount)
+            {
+              THROW_WALLET_EXCEPTION_IF(d.start_height > segregation_fork_height, error::get_output_distribution, "Distribution start_height too high");
+              THROW_WALLET_EXCEPTION_IF(segregation_fork_height - d.start_height >= d.distribution.size(), error::get_output_distribution, "Distribution size too small");
+              THROW_WALLET_EXCEPTION_IF(segregation_fork_height - RECENT_OUTPUT_BLOCKS - d.start_height >= d.distribution.size(), error::get_output_distribution, "Distribution size too small");
+              THROW_WALLET_EXCEPTION_IF(segregation_fork_height <= RECENT_OUTPUT_BLOCKS, error::wallet_internal_error, "Fork height too low");
+              THROW_WALLET_EXCEPTION_IF(segregation_fork_height - RECENT_OUTPUT_BLOCKS < d.start_height, error::get_output_distribution, "Bad start height");
+              uint64_t till_fork = d.distribution[segregation_fork_height - d.start_height];
+              uint64_t recent = till_fork - d.distribution[segregation_fork_height - RECENT_OUTPUT_BLOCKS - d.start_height];
+              segregation_limit[amount] = std::make_pair(till_fork, recent);
+              if (!is_shortly_after_segregation_fork)
+                m_segregation_limits[amount] = segregation_limit[amount];
+              found = true;
+              break;
+            }
           }
+          THROW_WALLET_EXCEPTION_IF(!found, error::get_output_distribution, "Requested amount not found in response");
         }
-        THROW_WALLET_EXCEPTION_IF(!found, error::get_output_distribution, "Requested amount not found in response");
       }
     }
 
@@ -7415,13 +8807,14 @@ void wallet2::transfer_selected(const std::vector<cryptonote::tx_destination_ent
 
 void wallet2::transfer_selected_rct(std::vector<cryptonote::tx_destination_entry> dsts, const std::vector<size_t>& selected_transfers, size_t fake_outputs_count,
   std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs,
-  uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, cryptonote::transaction& tx, pending_tx &ptx, rct::RangeProofType range_proof_type)
+  uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, cryptonote::transaction& tx, pending_tx &ptx, rct::RangeProofType range_proof_type, uint64_t upper_transaction_weight_limit)
 {
   using namespace cryptonote;
   // throw if attempting a transaction with no destinations
   THROW_WALLET_EXCEPTION_IF(dsts.empty(), error::zero_destination);
 
-  uint64_t upper_transaction_weight_limit = get_upper_transaction_weight_limit();
+  if (upper_transaction_weight_limit == 0)
+    upper_transaction_weight_limit = get_upper_transaction_weight_limit();
   uint64_t needed_money = fee;
   LOG_PRINT_L2("transfer_selected_rct: starting with fee " << print_money (needed_money));
   LOG_PRINT_L2("selected transfers: " << strjoin(selected_transfers, " "));
@@ -7676,11 +9069,15 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
 
   LOG_PRINT_L2("pick_preferred_rct_inputs: needed_money " << print_money(needed_money));
 
+  if (subaddr_indices.empty())
+    return picks;
+  const std::vector<size_t> candidates = get_unspent_transfers(subaddr_account, subaddr_indices);
+
   // try to find a rct input of enough size
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: candidates)
   {
     const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && td.is_rct() && td.amount() >= needed_money && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+    if (!td.m_spent && td.is_rct() && td.amount() >= needed_money && is_transfer_unlocked(td))
     {
       LOG_PRINT_L2("We can use " << i << " alone: " << print_money(td.amount()));
       picks.push_back(i);
@@ -7692,14 +9089,16 @@ std::vector<size_t> wallet2::pick_preferred_rct_inputs(uint64_t needed_money, ui
   // this could be made better by picking one of the outputs to be a small one, since those
   // are less useful since often below the needed money, so if one can be used in a pair,
   // it gets rid of it for the future
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t n = 0; n < candidates.size(); ++n)
   {
+    const size_t i = candidates[n];
     const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && !td.m_key_image_partial && td.is_rct() && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && subaddr_indices.count(td.m_subaddr_index.minor) == 1)
+    if (!td.m_spent && !td.m_key_image_partial && td.is_rct() && is_transfer_unlocked(td))
     {
       LOG_PRINT_L2("Considering input " << i << ", " << print_money(td.amount()));
-      for (size_t j = i + 1; j < m_transfers.size(); ++j)
+      for (size_t n2 = n + 1; n2 < candidates.size(); ++n2)
       {
+        const size_t j = candidates[n2];
         const transfer_details& td2 = m_transfers[j];
         if (!td2.m_spent && !td.m_key_image_partial && td2.is_rct() && td.amount() + td2.amount() >= needed_money && is_transfer_unlocked(td2) && td2.m_subaddr_index == td.m_subaddr_index)
         {
@@ -7785,6 +9184,7 @@ static uint32_t get_count_above(const std::vector<wallet2::transfer_details> &tr
 
 bool wallet2::light_wallet_login(bool &new_address)
 {
+  load_history();
   MDEBUG("Light wallet login request");
   m_light_wallet_connected = false;
   cryptonote::COMMAND_RPC_LOGIN::request request;
@@ -7864,6 +9264,7 @@ void wallet2::light_wallet_get_unspent_outs()
   
   // Clear old outputs
   m_transfers.clear();
+  invalidate_balance_cache();
   
   for (const auto &o: ores.outputs) {
     bool spent = false;
@@ -7901,6 +9302,8 @@ void wallet2::light_wallet_get_unspent_outs()
     
     for(auto &t: m_transfers){
       if(t.get_public_key() == public_key) {
+        if (t.m_spent != spent)
+          invalidate_balance_cache();
         t.m_spent = spent;
         add_transfer = false;
         break;
@@ -7997,6 +9400,7 @@ bool wallet2::light_wallet_get_address_info(cryptonote::COMMAND_RPC_GET_ADDRESS_
 
 void wallet2::light_wallet_get_address_txs()
 {
+  load_history();
   MDEBUG("Refreshing light wallet");
   
   cryptonote::COMMAND_RPC_GET_ADDRESS_TXS::request ireq;
@@ -8102,7 +9506,7 @@ void wallet2::light_wallet_get_address_txs()
         }
       } else {
         if (std::find(payments_txs.begin(), payments_txs.end(), tx_hash) == payments_txs.end()) {
-          m_payments.emplace(tx_hash, payment);
+          index_payment(*m_payments.emplace(tx_hash, payment));
           if (0 != m_callback) {
             m_callback->on_lw_money_received(t.height, payment.m_tx_hash, payment.m_amount);
           }
@@ -8150,7 +9554,7 @@ void wallet2::light_wallet_get_address_txs()
             ctd.m_payment_id = payment_id;
             ctd.m_block_height = t.height;
             ctd.m_timestamp = t.timestamp;
-            m_confirmed_txs.emplace(tx_hash,ctd);
+            index_confirmed_tx(*m_confirmed_txs.emplace(tx_hash,ctd).first);
           }
           if (0 != m_callback)
           {
@@ -8269,6 +9673,20 @@ bool wallet2::light_wallet_key_image_is_ours(const crypto::key_image& key_image,
 // usable balance.
 std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices)
 {
+  std::vector<wallet2::pending_tx> ptx_vector;
+  if (m_parallel_tx_construction && create_transactions_2(ptx_vector, dsts, fake_outs_count, unlock_time, priority, extra, subaddr_account, subaddr_indices, true))
+    return ptx_vector;
+  create_transactions_2(ptx_vector, dsts, fake_outs_count, unlock_time, priority, extra, subaddr_account, subaddr_indices, false);
+  return ptx_vector;
+}
+//----------------------------------------------------------------------------------------------------
+// with independent_inputs, the inputs of all txes are picked up front against the estimated fee,
+// and the txes then built and proven in parallel; returns false if an estimate was too short to
+// be made up from the change, so the caller can start over the serial way
+bool wallet2::create_transactions_2(std::vector<wallet2::pending_tx> &ptx_vector, std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices, bool independent_inputs)
+{
+  ptx_vector.clear();
+
   //ensure device is let in NONE mode in any case
   hw::device &hwdev = m_account.get_device();
   boost::unique_lock<hw::device> hwdev_lock (hwdev);
@@ -8324,6 +9742,8 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   const bool use_rct = use_fork_rules(4, 0);
   const bool bulletproof = use_fork_rules(get_bulletproof_fork(), 0);
   const rct::RangeProofType range_proof_type = bulletproof ? rct::RangeProofPaddedBulletproof : rct::RangeProofBorromean;
+  // the trial txes are real ones on a software device, on others they'd have to be rebuilt anyway
+  independent_inputs = independent_inputs && use_rct && !m_multisig && hwdev.get_type() == hw::device::device_type::SOFTWARE;
 
   const uint64_t base_fee  = get_base_fee();
   const uint64_t fee_multiplier = get_fee_multiplier(priority, get_fee_algorithm());
@@ -8385,7 +9805,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   // gather all dust and non-dust outputs belonging to specified subaddresses
   size_t num_nondust_outputs = 0;
   size_t num_dust_outputs = 0;
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: get_unspent_transfers(subaddr_account, subaddr_indices))
   {
     const transfer_details& td = m_transfers[i];
     if (m_ignore_fractional_outputs && td.amount() < fractional_threshold)
@@ -8443,7 +9863,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
   LOG_PRINT_L2("Starting with " << num_nondust_outputs << " non-dust outputs and " << num_dust_outputs << " dust outputs");
 
   if (unused_dust_indices_per_subaddr.empty() && unused_transfers_indices_per_subaddr.empty())
-    return std::vector<wallet2::pending_tx>();
+    return true;
 
   // if empty, put dummy entry so that the front can be referenced later in the loop
   if (unused_dust_indices_per_subaddr.empty())
@@ -8632,10 +10052,30 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_2(std::vector<cryp
       if (inputs < outputs)
       {
         LOG_PRINT_L2("We don't have enough for the basic fee, switching to adding_fee");
+        if (independent_inputs)
+          available_for_fee = inputs + needed_fee - outputs;
         adding_fee = true;
         goto skip_tx;
       }
 
+      if (independent_inputs)
+      {
+        // the tx is built later, along with the others
+        LOG_PRINT_L2("Picked " << tx.selected_transfers.size() << " inputs for a tx with " << tx.dsts.size() <<
+          " outputs, estimated fee " << print_money(needed_fee));
+        tx.needed_fee = needed_fee;
+        accumulated_fee += needed_fee;
+        accumulated_change += inputs - outputs;
+        adding_fee = false;
+        if (!dsts.empty())
+        {
+          LOG_PRINT_L2("We have more to pay, starting another tx");
+          txes.push_back(TX());
+          original_output_index = 0;
+        }
+        goto skip_tx;
+      }
+
       LOG_PRINT_L2("Trying to create a tx now, with " << tx.dsts.size() << " outputs and " <<
         tx.selected_transfers.size() << " inputs");
       if (use_rct)
@@ -8741,7 +10181,57 @@ skip_tx:
     " total fee, " << print_money(accumulated_change) << " total change");
 
   hwdev.set_mode(hw::device::TRANSACTION_CREATE_REAL);
-  for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
+  if (independent_inputs)
+  {
+    // ring members are fetched one tx at a time, the daemon connection is not shared
+    for (TX &tx: txes)
+      if (tx.outs.empty())
+        get_outs(tx.outs, tx.selected_transfers, fake_outs_count);
+
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    std::vector<std::exception_ptr> errors(txes.size());
+    std::vector<uint8_t> short_fee(txes.size(), 0);
+    for (size_t n = 0; n < txes.size(); ++n)
+    {
+      tpool.submit(&waiter, [&, n]() {
+        TX &tx = txes[n];
+        try
+        {
+          // the estimate errs on the high side, but if it falls short the change makes up for it
+          while (true)
+          {
+            transfer_selected_rct(tx.dsts, tx.selected_transfers, fake_outs_count, tx.outs, unlock_time, tx.needed_fee, extra,
+                tx.tx, tx.ptx, range_proof_type, upper_transaction_weight_limit);
+            const size_t blob_size = t_serializable_object_to_blob(tx.ptx.tx).size();
+            const uint64_t fee = calculate_fee(use_per_byte_fee, tx.ptx.tx, blob_size, base_fee, fee_multiplier, fee_quantization_mask);
+            tx.weight = get_transaction_weight(tx.ptx.tx, blob_size);
+            if (fee <= tx.needed_fee)
+              break;
+            tx.needed_fee = fee;
+          }
+        }
+        catch (const error::not_enough_unlocked_money &)
+        {
+          short_fee[n] = 1;
+        }
+        catch (...)
+        {
+          errors[n] = std::current_exception();
+        }
+      });
+    }
+    waiter.wait(&tpool);
+    for (const std::exception_ptr &e: errors)
+      if (e)
+        std::rethrow_exception(e);
+    if (std::find(short_fee.begin(), short_fee.end(), 1) != short_fee.end())
+    {
+      LOG_PRINT_L1("Estimated fee too short to build all txes in parallel, building them one after the other");
+      return false;
+    }
+  }
+  else for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
   {
     TX &tx = *i;
     cryptonote::transaction test_tx;
@@ -8776,7 +10266,6 @@ skip_tx:
     tx.weight = get_transaction_weight(test_tx, txBlob.size());
   }
 
-  std::vector<wallet2::pending_tx> ptx_vector;
   for (std::vector<TX>::iterator i = txes.begin(); i != txes.end(); ++i)
   {
     TX &tx = *i;
@@ -8791,7 +10280,7 @@ skip_tx:
   }
 
   // if we made it this far, we're OK to actually send the transactions
-  return ptx_vector;
+  return true;
 }
 
 std::vector<wallet2::pending_tx> wallet2::create_transactions_all(uint64_t below, const cryptonote::account_public_address &address, bool is_subaddress, const size_t outputs, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices)
@@ -8806,7 +10295,7 @@ std::vector<wallet2::pending_tx> wallet2::create_transactions_all(uint64_t below
 
   // gather all dust and non-dust outputs of specified subaddress (if any) and below specified threshold (if any)
   bool fund_found = false;
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (size_t i: get_unspent_transfers(subaddr_account, subaddr_indices))
   {
     const transfer_details& td = m_transfers[i];
     if (!td.m_spent && !td.m_key_image_partial && (use_rct ? true : !td.is_rct()) && is_transfer_unlocked(td) && td.m_subaddr_index.major == subaddr_account && (subaddr_indices.empty() || subaddr_indices.count(td.m_subaddr_index.minor) == 1))
@@ -9214,6 +10703,34 @@ const wallet2::transfer_details &wallet2::get_transfer_details(size_t idx) const
   return m_transfers[idx];
 }
 //----------------------------------------------------------------------------------------------------
+cryptonote::transaction_prefix wallet2::get_transfer_tx_prefix(size_t idx)
+{
+  // transfer_details only keeps a compacted prefix, the full one is in the chain
+  const transfer_details &td = get_transfer_details(idx);
+  COMMAND_RPC_GET_TRANSACTIONS::request req;
+  COMMAND_RPC_GET_TRANSACTIONS::response res;
+  req.txs_hashes.push_back(epee::string_tools::pod_to_hex(td.m_txid));
+  req.decode_as_json = false;
+  req.prune = false;
+  m_daemon_rpc_mutex.lock();
+  bool ok = epee::net_utils::invoke_http_json("/gettransactions", req, res, m_http_client, rpc_timeout);
+  m_daemon_rpc_mutex.unlock();
+  THROW_WALLET_EXCEPTION_IF(!ok, error::no_connection_to_daemon, "gettransactions");
+  THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gettransactions");
+  THROW_WALLET_EXCEPTION_IF(res.txs.size() != 1, error::wallet_internal_error, "Failed to get transaction from daemon");
+
+  cryptonote::blobdata tx_data;
+  ok = epee::string_tools::parse_hexstr_to_binbuff(res.txs.front().as_hex, tx_data);
+  THROW_WALLET_EXCEPTION_IF(!ok, error::wallet_internal_error, "Failed to parse transaction from daemon");
+  crypto::hash tx_hash, tx_prefix_hash;
+  cryptonote::transaction tx;
+  THROW_WALLET_EXCEPTION_IF(!cryptonote::parse_and_validate_tx_from_blob(tx_data, tx, tx_hash, tx_prefix_hash), error::wallet_internal_error,
+    "Failed to validate transaction from daemon");
+  THROW_WALLET_EXCEPTION_IF(tx_hash != td.m_txid, error::wallet_internal_error,
+    "Failed to get the right transaction from daemon");
+  return (const cryptonote::transaction_prefix&)tx;
+}
+//----------------------------------------------------------------------------------------------------
 std::vector<size_t> wallet2::select_available_unmixable_outputs()
 {
   // request all outputs with less instances than the min ring size
@@ -9262,12 +10779,13 @@ void wallet2::discard_unmixable_outputs()
   std::vector<size_t> unmixable_outputs = select_available_unmixable_outputs();
   for (size_t idx : unmixable_outputs)
   {
-    m_transfers[idx].m_spent = true;
+    set_spent(idx, 0);
   }
 }
 
 bool wallet2::get_tx_key(const crypto::hash &txid, crypto::secret_key &tx_key, std::vector<crypto::secret_key> &additional_tx_keys) const
 {
+  load_history();
   additional_tx_keys.clear();
   const std::unordered_map<crypto::hash, crypto::secret_key>::const_iterator i = m_tx_keys.find(txid);
   if (i == m_tx_keys.end())
@@ -9281,6 +10799,7 @@ bool wallet2::get_tx_key(const crypto::hash &txid, crypto::secret_key &tx_key, s
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_tx_key(const crypto::hash &txid, const crypto::secret_key &tx_key, const std::vector<crypto::secret_key> &additional_tx_keys)
 {
+  load_history();
   // fetch tx from daemon and check if secret keys agree with corresponding public keys
   COMMAND_RPC_GET_TRANSACTIONS::request req = AUTO_VAL_INIT(req);
   req.txs_hashes.push_back(epee::string_tools::pod_to_hex(txid));
@@ -10222,11 +11741,13 @@ uint64_t wallet2::get_approximate_blockchain_height() const
 
 void wallet2::set_tx_note(const crypto::hash &txid, const std::string &note)
 {
+  load_history();
   m_tx_notes[txid] = note;
 }
 
 std::string wallet2::get_tx_note(const crypto::hash &txid) const
 {
+  load_history();
   std::unordered_map<crypto::hash, std::string>::const_iterator i = m_tx_notes.find(txid);
   if (i == m_tx_notes.end())
     return std::string();
@@ -10406,13 +11927,11 @@ crypto::public_key wallet2::get_tx_pub_key_from_received_outs(const tools::walle
     bool r = hwdev.generate_key_derivation(tx_pub_key, keys.m_view_secret_key, derivation);
     THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to generate key derivation");
 
-    for (size_t i = 0; i < td.m_tx.vout.size(); ++i)
-    {
-      tx_scan_info_t tx_scan_info;
-      check_acc_out_precomp(td.m_tx.vout[i], derivation, additional_derivations, i, tx_scan_info);
-      if (!tx_scan_info.error && tx_scan_info.received)
-        return tx_pub_key;
-    }
+    // only our own output is kept, see transfer_details::compact_tx
+    tx_scan_info_t tx_scan_info;
+    check_acc_out_precomp(td.m_tx.vout[td.m_internal_output_index], derivation, additional_derivations, td.m_internal_output_index, tx_scan_info);
+    if (!tx_scan_info.error && tx_scan_info.received)
+      return tx_pub_key;
   }
 
   // we found no key yielding an output
@@ -10421,15 +11940,18 @@ crypto::public_key wallet2::get_tx_pub_key_from_received_outs(const tools::walle
   return crypto::null_pkey;
 }
 
-bool wallet2::export_key_images(const std::string &filename) const
+bool wallet2::export_key_images(const std::string &filename, size_t offset) const
 {
-  std::vector<std::pair<crypto::key_image, crypto::signature>> ski = export_key_images();
+  std::vector<std::pair<crypto::key_image, crypto::signature>> ski = export_key_images(offset);
   std::string magic(KEY_IMAGE_EXPORT_FILE_MAGIC, strlen(KEY_IMAGE_EXPORT_FILE_MAGIC));
   const cryptonote::account_public_address &keys = get_account().get_keys().m_account_address;
+  const uint32_t offset_le = SWAP32LE((uint32_t)offset);
 
   std::string data;
+  data.reserve(2 * sizeof(crypto::public_key) + sizeof(offset_le) + ski.size() * (sizeof(crypto::key_image) + sizeof(crypto::signature)));
   data += std::string((const char *)&keys.m_spend_public_key, sizeof(crypto::public_key));
   data += std::string((const char *)&keys.m_view_public_key, sizeof(crypto::public_key));
+  data += std::string((const char *)&offset_le, sizeof(offset_le));
   for (const auto &i: ski)
   {
     data += std::string((const char *)&i.first, sizeof(crypto::key_image));
@@ -10442,12 +11964,14 @@ bool wallet2::export_key_images(const std::string &filename) const
 }
 
 //----------------------------------------------------------------------------------------------------
-std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key_images() const
+std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key_images(size_t offset) const
 {
   std::vector<std::pair<crypto::key_image, crypto::signature>> ski;
 
-  ski.reserve(m_transfers.size());
-  for (size_t n = 0; n < m_transfers.size(); ++n)
+  THROW_WALLET_EXCEPTION_IF(offset > m_transfers.size() || offset > std::numeric_limits<uint32_t>::max(),
+      error::wallet_internal_error, "Offset larger than known outputs");
+  ski.reserve(m_transfers.size() - offset);
+  for (size_t n = offset; n < m_transfers.size(); ++n)
   {
     const transfer_details &td = m_transfers[n];
 
@@ -10496,13 +12020,18 @@ std::vector<std::pair<crypto::key_image, crypto::signature>> wallet2::export_key
 
 uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent, uint64_t &unspent)
 {
+  load_history();
   std::string data;
   bool r = epee::file_io_utils::load_file_to_string(filename, data);
 
   THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, std::string(tr("failed to read file ")) + filename);
 
   const size_t magiclen = strlen(KEY_IMAGE_EXPORT_FILE_MAGIC);
-  if (data.size() < magiclen || memcmp(data.data(), KEY_IMAGE_EXPORT_FILE_MAGIC, magiclen))
+  static_assert(sizeof(KEY_IMAGE_EXPORT_FILE_MAGIC) == sizeof(KEY_IMAGE_EXPORT_FILE_MAGIC_V2), "Key image export magics differ in size");
+  bool has_offset = true;
+  if (data.size() >= magiclen && !memcmp(data.data(), KEY_IMAGE_EXPORT_FILE_MAGIC_V2, magiclen))
+    has_offset = false;
+  else if (data.size() < magiclen || memcmp(data.data(), KEY_IMAGE_EXPORT_FILE_MAGIC, magiclen))
   {
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Bad key image export file magic in ") + filename);
   }
@@ -10516,7 +12045,7 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to decrypt ") + filename + ": " + e.what());
   }
 
-  const size_t headerlen = 2 * sizeof(crypto::public_key);
+  const size_t headerlen = 2 * sizeof(crypto::public_key) + (has_offset ? sizeof(uint32_t) : 0);
   THROW_WALLET_EXCEPTION_IF(data.size() < headerlen, error::wallet_internal_error, std::string("Bad data size from file ") + filename);
   const crypto::public_key &public_spend_key = *(const crypto::public_key*)&data[0];
   const crypto::public_key &public_view_key = *(const crypto::public_key*)&data[sizeof(crypto::public_key)];
@@ -10525,6 +12054,14 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
   {
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string( "Key images from ") + filename + " are for a different account");
   }
+  uint32_t offset = 0;
+  if (has_offset)
+  {
+    memcpy(&offset, &data[2 * sizeof(crypto::public_key)], sizeof(offset));
+    offset = SWAP32LE(offset);
+  }
+  THROW_WALLET_EXCEPTION_IF(offset > m_transfers.size(), error::wallet_internal_error,
+      std::string("Key images from ") + filename + " start past the known outputs, import outputs first");
 
   const size_t record_size = sizeof(crypto::key_image) + sizeof(crypto::signature);
   THROW_WALLET_EXCEPTION_IF((data.size() - headerlen) % record_size,
@@ -10541,16 +12078,21 @@ uint64_t wallet2::import_key_images(const std::string &filename, uint64_t &spent
     ski.push_back(std::make_pair(key_image, signature));
   }
   
-  return import_key_images(ski, spent, unspent);    
+  return import_key_images(ski, offset, spent, unspent);    
 }
 
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, uint64_t &spent, uint64_t &unspent, bool check_spent)
 {
-  COMMAND_RPC_IS_KEY_IMAGE_SPENT::request req = AUTO_VAL_INIT(req);
-  COMMAND_RPC_IS_KEY_IMAGE_SPENT::response daemon_resp = AUTO_VAL_INIT(daemon_resp);
+  return import_key_images(signed_key_images, 0, spent, unspent, check_spent);
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, size_t offset, uint64_t &spent, uint64_t &unspent, bool check_spent)
+{
+  load_history();
+  std::vector<int> spent_status;
 
-  THROW_WALLET_EXCEPTION_IF(signed_key_images.size() > m_transfers.size(), error::wallet_internal_error,
+  THROW_WALLET_EXCEPTION_IF(offset > m_transfers.size() || signed_key_images.size() > m_transfers.size() - offset, error::wallet_internal_error,
       "The blockchain is out of date compared to the signed key images");
 
   if (signed_key_images.empty())
@@ -10560,57 +12102,82 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
     return 0;
   }
 
+  std::vector<crypto::public_key> pkeys(signed_key_images.size());
   for (size_t n = 0; n < signed_key_images.size(); ++n)
   {
-    const transfer_details &td = m_transfers[n];
-    const crypto::key_image &key_image = signed_key_images[n].first;
-    const crypto::signature &signature = signed_key_images[n].second;
-
     // get ephemeral public key
+    const transfer_details &td = m_transfers[offset + n];
     const cryptonote::tx_out &out = td.m_tx.vout[td.m_internal_output_index];
     THROW_WALLET_EXCEPTION_IF(out.target.type() != typeid(txout_to_key), error::wallet_internal_error,
       "Non txout_to_key output found");
-    const cryptonote::txout_to_key &o = boost::get<cryptonote::txout_to_key>(out.target);
-    const crypto::public_key pkey = o.key;
+    pkeys[n] = boost::get<cryptonote::txout_to_key>(out.target).key;
+  }
+
+  // check the signatures on the threadpool, in chunks, noting what failed
+  // for each key image so errors are still reported for the first bad one
+  enum { ki_ok, ki_bad_domain, ki_bad_signature };
+  std::vector<uint8_t> check_result(signed_key_images.size(), ki_ok);
+  const auto check_key_images = [&](size_t begin, size_t end)
+  {
+    for (size_t n = begin; n < end; ++n)
+    {
+      const crypto::key_image &key_image = signed_key_images[n].first;
+      std::vector<const crypto::public_key*> ring(1, &pkeys[n]);
+      if (!(rct::scalarmultKey(rct::ki2rct(key_image), rct::curveOrder()) == rct::identity()))
+        check_result[n] = ki_bad_domain;
+      else if (!crypto::check_ring_signature((const crypto::hash&)key_image, key_image, ring, &signed_key_images[n].second))
+        check_result[n] = ki_bad_signature;
+    }
+  };
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  static const size_t chunk_size = 256;
+  if (signed_key_images.size() > chunk_size && tpool.get_max_concurrency() > 1)
+  {
+    tools::threadpool::waiter waiter;
+    for (size_t begin = 0; begin < signed_key_images.size(); begin += chunk_size)
+      tpool.submit(&waiter, std::bind(check_key_images, begin, std::min(begin + chunk_size, signed_key_images.size())));
+    waiter.wait(&tpool);
+  }
+  else
+  {
+    check_key_images(0, signed_key_images.size());
+  }
 
-    std::vector<const crypto::public_key*> pkeys;
-    pkeys.push_back(&pkey);
-    THROW_WALLET_EXCEPTION_IF(!(rct::scalarmultKey(rct::ki2rct(key_image), rct::curveOrder()) == rct::identity()),
+  for (size_t n = 0; n < signed_key_images.size(); ++n)
+  {
+    const crypto::key_image &key_image = signed_key_images[n].first;
+    THROW_WALLET_EXCEPTION_IF(check_result[n] == ki_bad_domain,
         error::wallet_internal_error, "Key image out of validity domain: input " + boost::lexical_cast<std::string>(n) + "/"
         + boost::lexical_cast<std::string>(signed_key_images.size()) + ", key image " + epee::string_tools::pod_to_hex(key_image));
 
-    THROW_WALLET_EXCEPTION_IF(!crypto::check_ring_signature((const crypto::hash&)key_image, key_image, pkeys, &signature),
+    THROW_WALLET_EXCEPTION_IF(check_result[n] == ki_bad_signature,
         error::wallet_internal_error, "Signature check failed: input " + boost::lexical_cast<std::string>(n) + "/"
         + boost::lexical_cast<std::string>(signed_key_images.size()) + ", key image " + epee::string_tools::pod_to_hex(key_image)
-        + ", signature " + epee::string_tools::pod_to_hex(signature) + ", pubkey " + epee::string_tools::pod_to_hex(*pkeys[0]));
-
-    req.key_images.push_back(epee::string_tools::pod_to_hex(key_image));
+        + ", signature " + epee::string_tools::pod_to_hex(signed_key_images[n].second) + ", pubkey " + epee::string_tools::pod_to_hex(pkeys[n]));
   }
 
   for (size_t n = 0; n < signed_key_images.size(); ++n)
   {
-    m_transfers[n].m_key_image = signed_key_images[n].first;
-    m_key_images[m_transfers[n].m_key_image] = n;
-    m_transfers[n].m_key_image_known = true;
-    m_transfers[n].m_key_image_partial = false;
+    transfer_details &td = m_transfers[offset + n];
+    td.m_key_image = signed_key_images[n].first;
+    m_key_images[td.m_key_image] = offset + n;
+    td.m_key_image_known = true;
+    td.m_key_image_partial = false;
   }
 
   if(check_spent)
   {
-    m_daemon_rpc_mutex.lock();
-    bool r = epee::net_utils::invoke_http_json("/is_key_image_spent", req, daemon_resp, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "is_key_image_spent");
-    THROW_WALLET_EXCEPTION_IF(daemon_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "is_key_image_spent");
-    THROW_WALLET_EXCEPTION_IF(daemon_resp.status != CORE_RPC_STATUS_OK, error::is_key_image_spent_error, daemon_resp.status);
-    THROW_WALLET_EXCEPTION_IF(daemon_resp.spent_status.size() != signed_key_images.size(), error::wallet_internal_error,
-      "daemon returned wrong response for is_key_image_spent, wrong amounts count = " +
-      std::to_string(daemon_resp.spent_status.size()) + ", expected " +  std::to_string(signed_key_images.size()));
-    for (size_t n = 0; n < daemon_resp.spent_status.size(); ++n)
+    std::vector<crypto::key_image> key_images;
+    key_images.reserve(signed_key_images.size());
+    for (const auto &ski: signed_key_images)
+      key_images.push_back(ski.first);
+    get_key_images_spent_status(key_images, spent_status);
+    for (size_t n = 0; n < spent_status.size(); ++n)
     {
-      transfer_details &td = m_transfers[n];
-      td.m_spent = daemon_resp.spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
+      transfer_details &td = m_transfers[offset + n];
+      td.m_spent = spent_status[n] != COMMAND_RPC_IS_KEY_IMAGE_SPENT::UNSPENT;
     }
+    invalidate_balance_cache();
   }
   spent = 0;
   unspent = 0;
@@ -10630,20 +12197,20 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 
   for(size_t i = 0; i < signed_key_images.size(); ++i)
   {
-    transfer_details &td = m_transfers[i];
+    transfer_details &td = m_transfers[offset + i];
     uint64_t amount = td.amount();
     if (td.m_spent)
       spent += amount;
     else
       unspent += amount;
-    LOG_PRINT_L2("Transfer " << i << ": " << print_money(amount) << " (" << td.m_global_output_index << "): "
-        << (td.m_spent ? "spent" : "unspent") << " (key image " << req.key_images[i] << ")");
+    LOG_PRINT_L2("Transfer " << offset + i << ": " << print_money(amount) << " (" << td.m_global_output_index << "): "
+        << (td.m_spent ? "spent" : "unspent") << " (key image " << td.m_key_image << ")");
 
-    if (i < daemon_resp.spent_status.size() && daemon_resp.spent_status[i] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN)
+    if (i < spent_status.size() && spent_status[i] == COMMAND_RPC_IS_KEY_IMAGE_SPENT::SPENT_IN_BLOCKCHAIN)
     {
       const std::unordered_map<crypto::key_image, crypto::hash>::const_iterator skii = spent_key_images.find(td.m_key_image);
       if (skii == spent_key_images.end())
-        swept_transfers.push_back(i);
+        swept_transfers.push_back(offset + i);
       else
         spent_txids.insert(skii->second);
     }
@@ -10652,20 +12219,30 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
 
   if (check_spent)
   {
-    // query outgoing txes
-    COMMAND_RPC_GET_TRANSACTIONS::request gettxs_req;
+    // query outgoing txes, in stripes so large imports don't time out
     COMMAND_RPC_GET_TRANSACTIONS::response gettxs_res;
-    gettxs_req.decode_as_json = false;
-    gettxs_req.prune = false;
+    static const size_t gettxs_chunk_size = 100;
+    std::vector<std::string> spent_txids_hex;
+    spent_txids_hex.reserve(spent_txids.size());
     for (const crypto::hash& spent_txid : spent_txids)
-      gettxs_req.txs_hashes.push_back(epee::string_tools::pod_to_hex(spent_txid));
-    m_daemon_rpc_mutex.lock();
-    bool r = epee::net_utils::invoke_http_json("/gettransactions", gettxs_req, gettxs_res, m_http_client, rpc_timeout);
-    m_daemon_rpc_mutex.unlock();
-    THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "gettransactions");
-    THROW_WALLET_EXCEPTION_IF(gettxs_res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gettransactions");
-    THROW_WALLET_EXCEPTION_IF(gettxs_res.txs.size() != spent_txids.size(), error::wallet_internal_error,
-      "daemon returned wrong response for gettransactions, wrong count = " + std::to_string(gettxs_res.txs.size()) + ", expected " + std::to_string(spent_txids.size()));
+      spent_txids_hex.push_back(epee::string_tools::pod_to_hex(spent_txid));
+    for (size_t start_offset = 0; start_offset < spent_txids_hex.size(); start_offset += gettxs_chunk_size)
+    {
+      const size_t n_txes = std::min(gettxs_chunk_size, spent_txids_hex.size() - start_offset);
+      COMMAND_RPC_GET_TRANSACTIONS::request gettxs_req;
+      COMMAND_RPC_GET_TRANSACTIONS::response chunk_res;
+      gettxs_req.decode_as_json = false;
+      gettxs_req.prune = false;
+      gettxs_req.txs_hashes.assign(spent_txids_hex.begin() + start_offset, spent_txids_hex.begin() + start_offset + n_txes);
+      m_daemon_rpc_mutex.lock();
+      bool r = epee::net_utils::invoke_http_json("/gettransactions", gettxs_req, chunk_res, m_http_client, rpc_timeout);
+      m_daemon_rpc_mutex.unlock();
+      THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "gettransactions");
+      THROW_WALLET_EXCEPTION_IF(chunk_res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "gettransactions");
+      THROW_WALLET_EXCEPTION_IF(chunk_res.txs.size() != n_txes, error::wallet_internal_error,
+        "daemon returned wrong response for gettransactions, wrong count = " + std::to_string(chunk_res.txs.size()) + ", expected " + std::to_string(n_txes));
+      std::move(chunk_res.txs.begin(), chunk_res.txs.end(), std::back_inserter(gettxs_res.txs));
+    }
 
     // process each outgoing tx
     auto spent_txid = spent_txids.begin();
@@ -10756,6 +12333,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       {
         if (j->second.m_tx_hash == *spent_txid)
         {
+          invalidate_transfer_indexes();
           m_payments.erase(j);
           break;
         }
@@ -10772,14 +12350,17 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       pd.m_amount_in = pd.m_amount_out = td.amount();         // fee is unknown
       pd.m_block_height = 0;  // spent block height is unknown
       const crypto::hash &spent_txid = crypto::null_hash; // spent txid is unknown
-      m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+      auto entry = m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+      if (entry.second)
+        index_confirmed_tx(*entry.first);
     }
   }
 
-  return m_transfers[signed_key_images.size() - 1].m_block_height;
+  return m_transfers[offset + signed_key_images.size() - 1].m_block_height;
 }
 wallet2::payment_container wallet2::export_payments() const
 {
+  load_history();
   payment_container payments;
   for (auto const &p : m_payments)
   {
@@ -10789,6 +12370,8 @@ wallet2::payment_container wallet2::export_payments() const
 }
 void wallet2::import_payments(const payment_container &payments)
 {
+  load_history();
+  invalidate_transfer_indexes();
   m_payments.clear();
   for (auto const &p : payments)
   {
@@ -10797,6 +12380,8 @@ void wallet2::import_payments(const payment_container &payments)
 }
 void wallet2::import_payments_out(const std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments)
 {
+  load_history();
+  invalidate_transfer_indexes();
   m_confirmed_txs.clear();
   for (auto const &p : confirmed_payments)
   {
@@ -10851,26 +12436,68 @@ std::vector<tools::wallet2::transfer_details> wallet2::export_outputs() const
   return outs;
 }
 //----------------------------------------------------------------------------------------------------
-std::string wallet2::export_outputs_to_str() const
+wallet2::exported_outputs wallet2::export_outputs_compact(size_t start) const
 {
-  std::vector<tools::wallet2::transfer_details> outs = export_outputs();
+  THROW_WALLET_EXCEPTION_IF(start > m_transfers.size(), error::wallet_internal_error, "Start index larger than known outputs");
 
-  std::stringstream oss;
-  boost::archive::portable_binary_oarchive ar(oss);
-  ar << outs;
+  exported_outputs outs;
+  outs.m_offset = start;
+  outs.m_total = m_transfers.size();
+  outs.m_outputs.resize(m_transfers.size() - start);
+  for (size_t n = start; n < m_transfers.size(); ++n)
+  {
+    const transfer_details &td = m_transfers[n];
+    exported_transfer_details &etd = outs.m_outputs[n - start];
+
+    THROW_WALLET_EXCEPTION_IF(td.m_internal_output_index >= td.m_tx.vout.size(), error::wallet_internal_error,
+        "Output index out of range at index " + boost::lexical_cast<std::string>(n));
+    etd.m_pubkey = td.get_public_key();
+    etd.m_internal_output_index = td.m_internal_output_index;
+    etd.m_global_output_index = td.m_global_output_index;
+    etd.m_tx_pubkey = get_tx_pub_key_from_received_outs(td);
+    etd.m_additional_tx_keys = get_additional_tx_pub_keys_from_extra(td.m_tx);
+    etd.m_txid = td.m_txid;
+    etd.m_block_height = td.m_block_height;
+    etd.m_unlock_time = td.m_tx.unlock_time;
+    etd.m_spent_height = td.m_spent_height;
+    etd.m_amount = td.m_amount;
+    etd.m_mask = td.m_mask;
+    etd.m_subaddr_index = td.m_subaddr_index;
+    etd.m_flags = 0;
+    if (td.m_spent)
+      etd.m_flags |= exported_transfer_details::flag_spent;
+    if (td.m_rct)
+      etd.m_flags |= exported_transfer_details::flag_rct;
+    if (td.m_key_image_known)
+      etd.m_flags |= exported_transfer_details::flag_key_image_known;
+    if (td.m_key_image_partial)
+      etd.m_flags |= exported_transfer_details::flag_key_image_partial;
+  }
+
+  return outs;
+}
+//----------------------------------------------------------------------------------------------------
+std::string wallet2::export_outputs_to_str(size_t start) const
+{
+  exported_outputs outs = export_outputs_compact(start);
 
   std::string magic(OUTPUT_EXPORT_FILE_MAGIC, strlen(OUTPUT_EXPORT_FILE_MAGIC));
   const cryptonote::account_public_address &keys = get_account().get_keys().m_account_address;
-  std::string header;
-  header += std::string((const char *)&keys.m_spend_public_key, sizeof(crypto::public_key));
-  header += std::string((const char *)&keys.m_view_public_key, sizeof(crypto::public_key));
-  std::string ciphertext = encrypt_with_view_secret_key(header + oss.str());
+  std::string data;
+  data += std::string((const char *)&keys.m_spend_public_key, sizeof(crypto::public_key));
+  data += std::string((const char *)&keys.m_view_public_key, sizeof(crypto::public_key));
+  std::string body;
+  THROW_WALLET_EXCEPTION_IF(!::serialization::dump_binary(outs, body),
+      error::wallet_internal_error, "Failed to serialize outputs");
+  data += body;
+  std::string ciphertext = encrypt_with_view_secret_key(data);
   return magic + ciphertext;
 }
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs)
 {
   m_transfers.clear();
+  invalidate_balance_cache();
   m_transfers.reserve(outputs.size());
   for (size_t i = 0; i < outputs.size(); ++i)
   {
@@ -10902,11 +12529,107 @@ size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_detail
   return m_transfers.size();
 }
 //----------------------------------------------------------------------------------------------------
+size_t wallet2::import_outputs(const exported_outputs &outputs)
+{
+  THROW_WALLET_EXCEPTION_IF(outputs.m_offset > m_transfers.size(), error::wallet_internal_error,
+      "Imported outputs start at " + boost::lexical_cast<std::string>(outputs.m_offset) + ", but only " +
+      boost::lexical_cast<std::string>(m_transfers.size()) + " outputs are known: import the earlier ones first");
+  THROW_WALLET_EXCEPTION_IF(outputs.m_offset + outputs.m_outputs.size() != outputs.m_total, error::wallet_internal_error,
+      "Inconsistent output count in imported outputs");
+
+  // outputs before the offset are kept as they are, later ones are replaced
+  for (size_t i = outputs.m_offset; i < m_transfers.size(); ++i)
+  {
+    const transfer_details &td = m_transfers[i];
+    if (td.m_key_image_known)
+      m_key_images.erase(td.m_key_image);
+    m_pub_keys.erase(td.get_public_key());
+  }
+  m_transfers.resize(outputs.m_offset);
+  invalidate_balance_cache();
+
+  // rebuild what transfer_details::compact_tx would have kept of the tx
+  std::vector<transfer_details> tds(outputs.m_outputs.size());
+  for (size_t i = 0; i < outputs.m_outputs.size(); ++i)
+  {
+    const exported_transfer_details &etd = outputs.m_outputs[i];
+    transfer_details &td = tds[i];
+
+    td.m_block_height = etd.m_block_height;
+    td.m_tx.unlock_time = etd.m_unlock_time;
+    td.m_tx.vout.resize(etd.m_internal_output_index + 1);
+    td.m_tx.vout.back().amount = (etd.m_flags & exported_transfer_details::flag_rct) ? 0 : etd.m_amount;
+    td.m_tx.vout.back().target = cryptonote::txout_to_key(etd.m_pubkey);
+    cryptonote::add_tx_pub_key_to_extra(td.m_tx.extra, etd.m_tx_pubkey);
+    if (!etd.m_additional_tx_keys.empty())
+      cryptonote::add_additional_tx_pub_keys_to_extra(td.m_tx.extra, etd.m_additional_tx_keys);
+    td.m_txid = etd.m_txid;
+    td.m_internal_output_index = etd.m_internal_output_index;
+    td.m_global_output_index = etd.m_global_output_index;
+    td.m_spent = etd.m_flags & exported_transfer_details::flag_spent;
+    td.m_spent_height = etd.m_spent_height;
+    td.m_mask = (etd.m_flags & exported_transfer_details::flag_rct) ? etd.m_mask : rct::identity();
+    td.m_amount = etd.m_amount;
+    td.m_rct = etd.m_flags & exported_transfer_details::flag_rct;
+    td.m_pk_index = 0;
+    td.m_subaddr_index = etd.m_subaddr_index;
+    // subaddresses must be known before deriving key images for them
+    expand_subaddresses(td.m_subaddr_index);
+  }
+
+  // the hot wallet wouldn't have known about key images (except if we already exported them),
+  // derive them on the threadpool when the keys are in software
+  std::vector<uint8_t> derived(tds.size(), 0);
+  const auto derive_key_images = [&](size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; ++i)
+    {
+      const exported_transfer_details &etd = outputs.m_outputs[i];
+      transfer_details &td = tds[i];
+      cryptonote::keypair in_ephemeral;
+      derived[i] = cryptonote::generate_key_image_helper(m_account.get_keys(), m_subaddresses, etd.m_pubkey, etd.m_tx_pubkey, etd.m_additional_tx_keys,
+          td.m_internal_output_index, in_ephemeral, td.m_key_image, m_account.get_device()) && in_ephemeral.pub == etd.m_pubkey;
+    }
+  };
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  static const size_t chunk_size = 256;
+  if (tds.size() > chunk_size && tpool.get_max_concurrency() > 1 && m_account.get_device().get_type() == hw::device::device_type::SOFTWARE)
+  {
+    tools::threadpool::waiter waiter;
+    for (size_t begin = 0; begin < tds.size(); begin += chunk_size)
+      tpool.submit(&waiter, std::bind(derive_key_images, begin, std::min(begin + chunk_size, tds.size())));
+    waiter.wait(&tpool);
+  }
+  else
+  {
+    derive_key_images(0, tds.size());
+  }
+
+  m_transfers.reserve(outputs.m_total);
+  for (size_t i = 0; i < tds.size(); ++i)
+  {
+    transfer_details &td = tds[i];
+    THROW_WALLET_EXCEPTION_IF(!derived[i], error::wallet_internal_error,
+        "Failed to generate key image at index " + boost::lexical_cast<std::string>(outputs.m_offset + i));
+    td.m_key_image_known = true;
+    td.m_key_image_partial = false;
+    m_key_images[td.m_key_image] = m_transfers.size();
+    m_pub_keys[td.get_public_key()] = m_transfers.size();
+    m_transfers.push_back(std::move(td));
+  }
+
+  return m_transfers.size();
+}
+//----------------------------------------------------------------------------------------------------
 size_t wallet2::import_outputs_from_str(const std::string &outputs_st)
 {
   std::string data = outputs_st;
   const size_t magiclen = strlen(OUTPUT_EXPORT_FILE_MAGIC);
-  if (data.size() < magiclen || memcmp(data.data(), OUTPUT_EXPORT_FILE_MAGIC, magiclen))
+  static_assert(sizeof(OUTPUT_EXPORT_FILE_MAGIC) == sizeof(OUTPUT_EXPORT_FILE_MAGIC_V3), "Output export magics differ in size");
+  bool compact = true;
+  if (data.size() >= magiclen && !memcmp(data.data(), OUTPUT_EXPORT_FILE_MAGIC_V3, magiclen))
+    compact = false;
+  else if (data.size() < magiclen || memcmp(data.data(), OUTPUT_EXPORT_FILE_MAGIC, magiclen))
   {
     THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Bad magic from outputs"));
   }
@@ -10934,6 +12657,22 @@ size_t wallet2::import_outputs_from_str(const std::string &outputs_st)
   }
 
   size_t imported_outputs = 0;
+  if (compact)
+  {
+    exported_outputs outputs;
+    THROW_WALLET_EXCEPTION_IF(!::serialization::parse_binary(std::string(data, headerlen), outputs),
+        error::wallet_internal_error, std::string("Failed to parse outputs"));
+    try
+    {
+      imported_outputs = import_outputs(outputs);
+    }
+    catch (const std::exception &e)
+    {
+      THROW_WALLET_EXCEPTION(error::wallet_internal_error, std::string("Failed to import outputs: ") + e.what());
+    }
+    return imported_outputs;
+  }
+
   try
   {
     std::string body(data, headerlen);
@@ -11072,10 +12811,9 @@ cryptonote::blobdata wallet2::export_multisig()
   const crypto::public_key signer = get_multisig_signer_public_key();
 
   info.resize(m_transfers.size());
-  for (size_t n = 0; n < m_transfers.size(); ++n)
+  auto export_output = [&](size_t n)
   {
     transfer_details &td = m_transfers[n];
-    const std::vector<crypto::public_key> additional_tx_pub_keys = get_additional_tx_pub_keys_from_extra(td.m_tx);
     crypto::key_image ki;
     td.m_multisig_k.clear();
     info[n].m_LR.clear();
@@ -11098,6 +12836,38 @@ cryptonote::blobdata wallet2::export_multisig()
     }
 
     info[n].m_signer = signer;
+  };
+
+  // outputs are independent, and each takes a few scalar multiplications,
+  // so large wallets export them in chunks on the threadpool
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  static const size_t chunk_size = 64;
+  if (m_transfers.size() > chunk_size && tpool.get_max_concurrency() > 1)
+  {
+    std::atomic<bool> failed(false);
+    tools::threadpool::waiter waiter;
+    for (size_t chunk_begin = 0; chunk_begin < m_transfers.size(); chunk_begin += chunk_size)
+    {
+      const size_t chunk_end = std::min(chunk_begin + chunk_size, m_transfers.size());
+      tpool.submit(&waiter, [&, chunk_begin, chunk_end](){
+        try
+        {
+          for (size_t n = chunk_begin; n < chunk_end; ++n)
+            export_output(n);
+        }
+        catch (...)
+        {
+          failed = true;
+        }
+      });
+    }
+    waiter.wait(&tpool);
+    THROW_WALLET_EXCEPTION_IF(failed, error::wallet_internal_error, "Failed to export multisig info");
+  }
+  else
+  {
+    for (size_t n = 0; n < m_transfers.size(); ++n)
+      export_output(n);
   }
 
   std::stringstream oss;
@@ -11117,23 +12887,69 @@ cryptonote::blobdata wallet2::export_multisig()
 //----------------------------------------------------------------------------------------------------
 void wallet2::update_multisig_rescan_info(const std::vector<std::vector<rct::key>> &multisig_k, const std::vector<std::vector<tools::wallet2::multisig_info>> &info, size_t n)
 {
-  CHECK_AND_ASSERT_THROW_MES(n < m_transfers.size(), "Bad index in update_multisig_info");
+  update_multisig_rescan_info(multisig_k, info, n, n + 1);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_multisig_rescan_info(const std::vector<std::vector<rct::key>> &multisig_k, const std::vector<std::vector<tools::wallet2::multisig_info>> &info, size_t begin, size_t end)
+{
+  CHECK_AND_ASSERT_THROW_MES(begin < end && end <= m_transfers.size(), "Bad index in update_multisig_info");
   CHECK_AND_ASSERT_THROW_MES(multisig_k.size() >= m_transfers.size(), "Mismatched sizes of multisig_k and info");
 
-  MDEBUG("update_multisig_rescan_info: updating index " << n);
-  transfer_details &td = m_transfers[n];
-  td.m_multisig_info.clear();
-  for (const auto &pi: info)
+  for (size_t n = begin; n < end; ++n)
+  {
+    MDEBUG("update_multisig_rescan_info: updating index " << n);
+    transfer_details &td = m_transfers[n];
+    td.m_multisig_info.clear();
+    for (const auto &pi: info)
+    {
+      CHECK_AND_ASSERT_THROW_MES(n < pi.size(), "Bad pi size");
+      td.m_multisig_info.push_back(pi[n]);
+    }
+  }
+
+  // each composite key image takes a key derivation, so large imports
+  // compute them in chunks on the threadpool when the keys are in software
+  std::vector<crypto::key_image> key_images(end - begin);
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  static const size_t chunk_size = 64;
+  if (m_account.get_device().get_type() == hw::device::device_type::SOFTWARE && end - begin > chunk_size && tpool.get_max_concurrency() > 1)
+  {
+    std::atomic<bool> failed(false);
+    tools::threadpool::waiter waiter;
+    for (size_t chunk_begin = begin; chunk_begin < end; chunk_begin += chunk_size)
+    {
+      const size_t chunk_end = std::min(chunk_begin + chunk_size, end);
+      tpool.submit(&waiter, [&, chunk_begin, chunk_end](){
+        try
+        {
+          for (size_t n = chunk_begin; n < chunk_end; ++n)
+            key_images[n - begin] = get_multisig_composite_key_image(n);
+        }
+        catch (...)
+        {
+          failed = true;
+        }
+      });
+    }
+    waiter.wait(&tpool);
+    THROW_WALLET_EXCEPTION_IF(failed, error::wallet_internal_error, "Failed to generate key image");
+  }
+  else
   {
-    CHECK_AND_ASSERT_THROW_MES(n < pi.size(), "Bad pi size");
-    td.m_multisig_info.push_back(pi[n]);
+    for (size_t n = begin; n < end; ++n)
+      key_images[n - begin] = get_multisig_composite_key_image(n);
+  }
+
+  for (size_t n = begin; n < end; ++n)
+  {
+    transfer_details &td = m_transfers[n];
+    m_key_images.erase(td.m_key_image);
+    td.m_key_image = key_images[n - begin];
+    td.m_key_image_known = true;
+    td.m_key_image_partial = false;
+    td.m_multisig_k = multisig_k[n];
+    m_key_images[td.m_key_image] = n;
   }
-  m_key_images.erase(td.m_key_image);
-  td.m_key_image = get_multisig_composite_key_image(n);
-  td.m_key_image_known = true;
-  td.m_key_image_partial = false;
-  td.m_multisig_k = multisig_k[n];
-  m_key_images[td.m_key_image] = n;
 }
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::import_multisig(std::vector<cryptonote::blobdata> blobs)
@@ -11226,10 +13042,10 @@ size_t wallet2::import_multisig(std::vector<cryptonote::blobdata> blobs)
     break;
   }
 
-  for (size_t n = 0; n < n_outputs && n < m_transfers.size(); ++n)
-  {
-    update_multisig_rescan_info(k, info, n);
-  }
+  // detaching may have dropped some of them
+  const size_t n_update = std::min(n_outputs, m_transfers.size());
+  if (n_update > 0)
+    update_multisig_rescan_info(k, info, 0, n_update);
 
   m_multisig_rescan_k = &k;
   m_multisig_rescan_info = &info;
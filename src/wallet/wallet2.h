@@ -38,6 +38,7 @@
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/deque.hpp>
+#include <boost/serialization/map.hpp>
 #include <atomic>
 
 #include "include_base_utils.h"
@@ -50,6 +51,8 @@
 #include "cryptonote_basic/cryptonote_format_utils.h"
 #include "cryptonote_core/cryptonote_tx_utils.h"
 #include "common/unordered_containers_boost_serialization.h"
+#include "common/bounded_queue.h"
+#include "common/single_flight_cache.h"
 #include "crypto/chacha.h"
 #include "crypto/hash.h"
 #include "ringct/rctTypes.h"
@@ -59,15 +62,22 @@
 #include "wallet_errors.h"
 #include "common/password.h"
 #include "node_rpc_proxy.h"
+#include "http_client_pool.h"
+#include "scan_group.h"
+#include "event_dispatcher.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
 
 class Serialization_portability_wallet_Test;
+class Serialization_wallet_lazy_history_Test;
+template<size_t, size_t> class test_wallet_refresh;
 
 namespace tools
 {
   class ringdb;
+  class blockdb;
+  class daemon_notifier;
   class wallet2;
   class Notify;
 
@@ -92,6 +102,7 @@ namespace tools
     virtual void on_unconfirmed_money_received(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t amount, const cryptonote::subaddress_index& subaddr_index) {}
     virtual void on_money_spent(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& in_tx, uint64_t amount, const cryptonote::transaction& spend_tx, const cryptonote::subaddress_index& subaddr_index) {}
     virtual void on_skip_transaction(uint64_t height, const crypto::hash &txid, const cryptonote::transaction& tx) {}
+    virtual void on_reorg(uint64_t height) {}
     virtual boost::optional<epee::wipeable_string> on_get_password(const char *reason) { return boost::none; }
     // Light wallet callbacks
     virtual void on_lw_new_block(uint64_t height) {}
@@ -100,6 +111,10 @@ namespace tools
     virtual void on_lw_money_spent(uint64_t height, const crypto::hash &txid, uint64_t amount) {}
     // Common callbacks
     virtual void on_pool_tx_removed(const crypto::hash &txid) {}
+    virtual void on_sign_tx_progress(size_t signed_count, size_t total) {}
+    // Batched mode (wallet2::batch_callbacks): new blocks, received, unconfirmed and spent
+    // money come here instead, a chunk of refresh at a time, from a separate thread
+    virtual void on_events(const std::vector<wallet_event> &events) {}
     virtual ~i_wallet2_callback() {}
   };
 
@@ -130,10 +145,23 @@ namespace tools
     const crypto::hash &operator[](size_t idx) const { return m_blockchain[idx - m_offset]; }
     crypto::hash &operator[](size_t idx) { return m_blockchain[idx - m_offset]; }
     void crop(size_t height) { m_blockchain.resize(height - m_offset); }
-    void clear() { m_offset = 0; m_blockchain.clear(); }
+    void clear() { m_offset = 0; m_blockchain.clear(); m_sparse.clear(); }
     bool empty() const { return m_blockchain.empty() && m_offset == 0; }
-    void trim(size_t height) { while (height > m_offset && m_blockchain.size() > 1) { m_blockchain.pop_front(); ++m_offset; } m_blockchain.shrink_to_fit(); }
+    void trim(size_t height, size_t sparse_interval = 0) { while (height > m_offset && m_blockchain.size() > 1) { if (sparse_interval && m_offset && m_offset % sparse_interval == 0 && m_blockchain.front() != crypto::null_hash) m_sparse[m_offset] = m_blockchain.front(); m_blockchain.pop_front(); ++m_offset; } m_blockchain.shrink_to_fit(); }
     void refill(const crypto::hash &hash) { m_blockchain.push_back(hash); --m_offset; }
+    const std::map<size_t, crypto::hash> &sparse() const { return m_sparse; }
+    bool rebase(size_t height)
+    {
+      // restart the dense part from a hash kept below it, dropping everything above
+      std::map<size_t, crypto::hash>::iterator i = m_sparse.find(height);
+      if (height >= m_offset || i == m_sparse.end())
+        return false;
+      m_blockchain.clear();
+      m_blockchain.push_back(i->second);
+      m_offset = height;
+      m_sparse.erase(i, m_sparse.end());
+      return true;
+    }
 
     template <class t_archive>
     inline void serialize(t_archive &a, const unsigned int ver)
@@ -141,18 +169,27 @@ namespace tools
       a & m_offset;
       a & m_genesis;
       a & m_blockchain;
+      if (ver < 1)
+      {
+        m_sparse.clear();
+        return;
+      }
+      a & m_sparse;
     }
 
   private:
     size_t m_offset;
     crypto::hash m_genesis;
     std::deque<crypto::hash> m_blockchain;
+    std::map<size_t, crypto::hash> m_sparse; // every few blocks below m_offset, when trimmed with an interval
   };
 
   class wallet_keys_unlocker;
   class wallet2
   {
     friend class ::Serialization_portability_wallet_Test;
+    friend class ::Serialization_wallet_lazy_history_Test;
+    template<size_t, size_t> friend class ::test_wallet_refresh;
     friend class wallet_keys_unlocker;
   public:
     static constexpr const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
@@ -192,6 +229,7 @@ namespace tools
 
     static bool verify_password(const std::string& keys_file_name, const epee::wipeable_string& password, bool no_spend_key, hw::device &hwdev, uint64_t kdf_rounds);
     static bool query_device(hw::device::device_type& device_type, const std::string& keys_file_name, const epee::wipeable_string& password, uint64_t kdf_rounds = 1);
+    static void generate_chacha_key_from_password(const epee::wipeable_string &pass, crypto::chacha_key &key, uint64_t kdf_rounds, uint32_t kdf_lanes);
 
     wallet2(cryptonote::network_type nettype = cryptonote::MAINNET, uint64_t kdf_rounds = 1, bool unattended = false);
     ~wallet2();
@@ -228,9 +266,10 @@ namespace tools
       uint64_t amount;
       uint64_t money_transfered;
       bool error;
+      bool key_image_precomputed;
       boost::optional<cryptonote::subaddress_receive_info> received;
 
-      tx_scan_info_t(): money_transfered(0), error(true) {}
+      tx_scan_info_t(): money_transfered(0), error(true), key_image_precomputed(false) {}
     };
 
     struct transfer_details
@@ -256,6 +295,8 @@ namespace tools
       bool is_rct() const { return m_rct; }
       uint64_t amount() const { return m_amount; }
       const crypto::public_key &get_public_key() const { return boost::get<const cryptonote::txout_to_key>(m_tx.vout[m_internal_output_index].target).key; }
+      // drops what is not needed after the output is received, see wallet2::get_transfer_tx_prefix
+      void compact_tx();
 
       BEGIN_SERIALIZE_OBJECT()
         FIELD(m_block_height)
@@ -278,6 +319,58 @@ namespace tools
       END_SERIALIZE()
     };
 
+    // what export_outputs_to_str sends to the cold wallet for each output:
+    // enough to rebuild our vout and derive the key image, without the rest
+    // of the tx prefix
+    struct exported_transfer_details
+    {
+      enum flags_t { flag_spent = 1, flag_rct = 2, flag_key_image_known = 4, flag_key_image_partial = 8 };
+
+      crypto::public_key m_pubkey;
+      uint64_t m_internal_output_index;
+      uint64_t m_global_output_index;
+      crypto::public_key m_tx_pubkey;
+      std::vector<crypto::public_key> m_additional_tx_keys;
+      crypto::hash m_txid;
+      uint64_t m_block_height;
+      uint64_t m_unlock_time;
+      uint64_t m_spent_height;
+      uint64_t m_amount;
+      rct::key m_mask;
+      cryptonote::subaddress_index m_subaddr_index;
+      uint8_t m_flags;
+
+      BEGIN_SERIALIZE_OBJECT()
+        FIELD(m_flags)
+        FIELD(m_pubkey)
+        VARINT_FIELD(m_internal_output_index)
+        VARINT_FIELD(m_global_output_index)
+        FIELD(m_tx_pubkey)
+        FIELD(m_additional_tx_keys)
+        FIELD(m_txid)
+        VARINT_FIELD(m_block_height)
+        VARINT_FIELD(m_unlock_time)
+        VARINT_FIELD(m_spent_height)
+        VARINT_FIELD(m_amount)
+        if (m_flags & flag_rct)
+          FIELD(m_mask)
+        FIELD(m_subaddr_index)
+      END_SERIALIZE()
+    };
+
+    struct exported_outputs
+    {
+      uint64_t m_offset;
+      uint64_t m_total;
+      std::vector<exported_transfer_details> m_outputs;
+
+      BEGIN_SERIALIZE_OBJECT()
+        VARINT_FIELD(m_offset)
+        VARINT_FIELD(m_total)
+        FIELD(m_outputs)
+      END_SERIALIZE()
+    };
+
     struct payment_details
     {
       crypto::hash m_tx_hash;
@@ -369,6 +462,21 @@ namespace tools
     typedef std::vector<transfer_details> transfer_container;
     typedef std::unordered_multimap<crypto::hash, payment_details> payment_container;
 
+    // Position in the account/height ordered indexes over incoming and outgoing
+    // confirmed transfers, used as a cursor by the paginated queries. A default
+    // constructed cursor starts at the beginning.
+    struct transfer_cursor
+    {
+      uint32_t account;
+      uint64_t height;
+      crypto::hash txid;
+      uint32_t minor;
+
+      transfer_cursor(): account(0), height(0), txid(crypto::null_hash), minor(0) {}
+      transfer_cursor(uint32_t account, uint64_t height, const crypto::hash &txid = crypto::null_hash, uint32_t minor = 0): account(account), height(height), txid(txid), minor(minor) {}
+      bool operator<(const transfer_cursor &other) const;
+    };
+
     struct multisig_sig
     {
       rct::rctSig sigs;
@@ -441,11 +549,22 @@ namespace tools
     {
       crypto::chacha_iv iv;
       std::string account_data;
+      uint32_t kdf_lanes; // 0 for the single chain KDF
 
       BEGIN_SERIALIZE_OBJECT()
         FIELD(iv)
         FIELD(account_data)
+        // files using the single chain KDF end here, as they always did
+        if (!has_kdf_lanes(ar, kdf_lanes))
+          return true;
+        VARINT_FIELD(kdf_lanes)
       END_SERIALIZE()
+
+    private:
+      template <template <bool> class Archive>
+      static bool has_kdf_lanes(Archive<false> &ar, uint32_t &kdf_lanes) { kdf_lanes = 0; return ar.remaining_bytes() > 0; }
+      template <template <bool> class Archive>
+      static bool has_kdf_lanes(Archive<true> &ar, uint32_t kdf_lanes) { return kdf_lanes != 0; }
     };
 
     struct cache_file_data
@@ -458,6 +577,19 @@ namespace tools
         FIELD(cache_data)
       END_SERIALIZE()
     };
+
+    // An incremental store appended to the cache journal. It applies on top of the
+    // cache file whose iv it names and of the journal records before it.
+    struct cache_journal_record
+    {
+      std::string base_iv;
+      uint64_t index;
+      uint64_t blockchain_size; // hashes already stored, new_hashes follow
+      std::vector<crypto::hash> new_hashes;
+      uint64_t transfers_size;
+      std::vector<std::pair<uint64_t, transfer_details>> transfers; // new or changed
+      std::string state; // everything else, as a wallet archive without hashes and transfers
+    };
     
     // GUI Address book
     struct address_book_row
@@ -489,11 +621,25 @@ namespace tools
       bool error;
     };
 
+    struct shared_scan;
+
+    // blocks as fetched and parsed, shared by the wallets of a process
+    struct shared_blocks
+    {
+      uint64_t start_height;
+      std::vector<cryptonote::block_complete_entry> blocks;
+      std::vector<parsed_block> parsed_blocks;
+      std::shared_ptr<shared_scan> scan;
+    };
+    typedef tools::single_flight_cache<shared_blocks> shared_block_cache;
+
     struct is_out_data
     {
       crypto::public_key pkey;
       crypto::key_derivation derivation;
       std::vector<boost::optional<cryptonote::subaddress_receive_info>> received;
+      // ephemeral keys and key images of the received outputs, filled in a batch after detection
+      std::vector<boost::optional<std::pair<cryptonote::keypair, crypto::key_image>>> key_images;
     };
 
     struct tx_cache_data
@@ -503,6 +649,33 @@ namespace tools
       std::vector<is_out_data> additional;
     };
 
+    // the tx caches of shared blocks and their derivations against the keys of
+    // a scan group, prepared by the first wallet of the group to get there, per
+    // refresh type as it decides which tx pubkeys are scanned
+    struct shared_scan
+    {
+      struct prepared
+      {
+        std::vector<tx_cache_data> cache;
+        scan_group::derivations_t derivations;
+      };
+      boost::mutex mutex;
+      std::map<int, std::shared_ptr<const prepared>> by_refresh_type;
+    };
+
+    // A span of blocks moving through the refresh pipeline
+    struct refresh_batch
+    {
+      enum status_t { blocks_ready, end_of_chain, empty_response, failed };
+      status_t status;
+      uint64_t start_height;
+      std::vector<cryptonote::block_complete_entry> blocks;
+      std::vector<parsed_block> parsed_blocks;
+      std::vector<tx_cache_data> cache;
+      bool cached;
+      std::shared_ptr<shared_scan> scan;
+    };
+
     /*!
      * \brief  Generates a wallet or restores one.
      * \param  wallet_              Name of wallet file
@@ -656,7 +829,9 @@ namespace tools
     void stop() { m_run.store(false, std::memory_order_relaxed); }
 
     i_wallet2_callback* callback() const { return m_callback; }
-    void callback(i_wallet2_callback* callback) { m_callback = callback; }
+    void callback(i_wallet2_callback* callback) { if (m_event_dispatcher) m_event_dispatcher->wait_idle(); m_callback = callback; }
+    bool batch_callbacks() const { return m_event_dispatcher != nullptr; }
+    void batch_callbacks(bool batch);
 
     bool is_trusted_daemon() const { return m_trusted_daemon; }
     void set_trusted_daemon(bool trusted) { m_trusted_daemon = trusted; }
@@ -739,7 +914,7 @@ namespace tools
       uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, T destination_split_strategy, const tx_dust_policy& dust_policy, cryptonote::transaction& tx, pending_tx &ptx);
     void transfer_selected_rct(std::vector<cryptonote::tx_destination_entry> dsts, const std::vector<size_t>& selected_transfers, size_t fake_outputs_count,
       std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs,
-      uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, cryptonote::transaction& tx, pending_tx &ptx, rct::RangeProofType range_proof_type);
+      uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, cryptonote::transaction& tx, pending_tx &ptx, rct::RangeProofType range_proof_type, uint64_t upper_transaction_weight_limit = 0);
 
     void commit_tx(pending_tx& ptx_vector);
     void commit_tx(std::vector<pending_tx>& ptx_vector);
@@ -778,6 +953,11 @@ namespace tools
     void get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
     void get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
       uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
+    // paginated versions, returning at most max_count entries (0 for all) in account then height
+    // order from cursor, which is moved past them; return true if there are more
+    bool get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices, size_t max_count, transfer_cursor &cursor) const;
+    bool get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
+      uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices, size_t max_count, transfer_cursor &cursor) const;
     void get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
     void get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2::pool_payment_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
 
@@ -808,6 +988,12 @@ namespace tools
       {
         a & m_blockchain;
       }
+      if (t_archive::is_loading::value)
+      {
+        invalidate_balance_cache();
+        m_subaddress_keys_generated.clear();
+        clear_subaddress_str_cache();
+      }
       a & m_transfers;
       a & m_account_public_address;
       a & m_key_images;
@@ -816,19 +1002,26 @@ namespace tools
       a & m_unconfirmed_txs;
       if(ver < 7)
         return;
-      a & m_payments;
+      if (t_archive::is_loading::value)
+        invalidate_transfer_indexes();
+      // from 26 on, the history containers are stored together at the end, see m_history_blob
+      if (ver < 26)
+        a & m_payments;
       if(ver < 8)
         return;
-      a & m_tx_keys;
+      if (ver < 26)
+        a & m_tx_keys;
       if(ver < 9)
         return;
-      a & m_confirmed_txs;
+      if (ver < 26)
+        a & m_confirmed_txs;
       if(ver < 11)
         return;
       a & dummy_refresh_height;
       if(ver < 12)
         return;
-      a & m_tx_notes;
+      if (ver < 26)
+        a & m_tx_notes;
       if(ver < 13)
         return;
       if (ver < 17)
@@ -856,7 +1049,8 @@ namespace tools
       a & m_pub_keys;
       if(ver < 16)
         return;
-      a & m_address_book;
+      if (ver < 26)
+        a & m_address_book;
       if(ver < 17)
         return;
       if (ver < 22)
@@ -877,7 +1071,8 @@ namespace tools
       std::unordered_map<cryptonote::subaddress_index, crypto::public_key> dummy_subaddresses_inv;
       a & dummy_subaddresses_inv;
       a & m_subaddress_labels;
-      a & m_additional_tx_keys;
+      if (ver < 26)
+        a & m_additional_tx_keys;
       if(ver < 21)
         return;
       a & m_attributes;
@@ -893,6 +1088,14 @@ namespace tools
       if(ver < 25)
         return;
       a & m_last_block_reward;
+      if(ver < 26)
+        return;
+      std::string history;
+      if (t_archive::is_saving::value)
+        history = get_history_blob();
+      a & history;
+      if (t_archive::is_loading::value)
+        set_history_blob(std::move(history));
     }
 
     /*!
@@ -948,12 +1151,23 @@ namespace tools
     void key_reuse_mitigation2(bool value) { m_key_reuse_mitigation2 = value; }
     uint64_t segregation_height() const { return m_segregation_height; }
     void segregation_height(uint64_t height) { m_segregation_height = height; }
+    uint32_t refresh_pipeline_depth() const { return m_refresh_pipeline_depth; }
+    void refresh_pipeline_depth(uint32_t depth) { m_refresh_pipeline_depth = depth; }
+    uint64_t hashchain_tail() const { return m_hashchain_tail; }
+    void hashchain_tail(uint64_t blocks) { m_hashchain_tail = blocks; }
+    void set_shared_block_cache(const std::shared_ptr<shared_block_cache> &cache) { m_shared_block_cache = cache; }
+    // wallets of a group sharing a block cache derive the blocks they share in one pass
+    void set_scan_group(const std::shared_ptr<scan_group> &group);
     bool ignore_fractional_outputs() const { return m_ignore_fractional_outputs; }
     void ignore_fractional_outputs(bool value) { m_ignore_fractional_outputs = value; }
+    bool parallel_tx_construction() const { return m_parallel_tx_construction; }
+    void parallel_tx_construction(bool value) { m_parallel_tx_construction = value; }
     bool confirm_non_default_ring_size() const { return m_confirm_non_default_ring_size; }
     void confirm_non_default_ring_size(bool always) { m_confirm_non_default_ring_size = always; }
     const std::string & device_name() const { return m_device_name; }
     void device_name(const std::string & device_name) { m_device_name = device_name; }
+    uint32_t kdf_lanes() const { return m_kdf_lanes; }
+    void kdf_lanes(uint32_t lanes) { m_kdf_lanes = lanes; }
 
     bool get_tx_key(const crypto::hash &txid, crypto::secret_key &tx_key, std::vector<crypto::secret_key> &additional_tx_keys) const;
     void set_tx_key(const crypto::hash &txid, const crypto::secret_key &tx_key, const std::vector<crypto::secret_key> &additional_tx_keys);
@@ -987,13 +1201,14 @@ namespace tools
    /*!
     * \brief GUI Address book get/store
     */
-    std::vector<address_book_row> get_address_book() const { return m_address_book; }
+    std::vector<address_book_row> get_address_book() const { load_history(); return m_address_book; }
     bool add_address_book_row(const cryptonote::account_public_address &address, const crypto::hash &payment_id, const std::string &description, bool is_subaddress);
     bool delete_address_book_row(std::size_t row_id);
         
     uint64_t get_num_rct_outputs();
     size_t get_num_transfer_details() const { return m_transfers.size(); }
     const transfer_details &get_transfer_details(size_t idx) const;
+    cryptonote::transaction_prefix get_transfer_tx_prefix(size_t idx);
 
     void get_hard_fork_info(uint8_t version, uint64_t &earliest_height) const;
     bool use_fork_rules(uint8_t version, int64_t early_blocks = 0) const;
@@ -1063,17 +1278,20 @@ namespace tools
 
     // Import/Export wallet data
     std::vector<tools::wallet2::transfer_details> export_outputs() const;
-    std::string export_outputs_to_str() const;
+    exported_outputs export_outputs_compact(size_t start = 0) const;
+    std::string export_outputs_to_str(size_t start = 0) const;
     size_t import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs);
+    size_t import_outputs(const exported_outputs &outputs);
     size_t import_outputs_from_str(const std::string &outputs_st);
     payment_container export_payments() const;
     void import_payments(const payment_container &payments);
     void import_payments_out(const std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments);
     std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> export_blockchain() const;
     void import_blockchain(const std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> &bc);
-    bool export_key_images(const std::string &filename) const;
-    std::vector<std::pair<crypto::key_image, crypto::signature>> export_key_images() const;
+    bool export_key_images(const std::string &filename, size_t offset = 0) const;
+    std::vector<std::pair<crypto::key_image, crypto::signature>> export_key_images(size_t offset = 0) const;
     uint64_t import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, uint64_t &spent, uint64_t &unspent, bool check_spent = true);
+    uint64_t import_key_images(const std::vector<std::pair<crypto::key_image, crypto::signature>> &signed_key_images, size_t offset, uint64_t &spent, uint64_t &unspent, bool check_spent = true);
     uint64_t import_key_images(const std::string &filename, uint64_t &spent, uint64_t &unspent);
 
     void update_pool_state(bool refreshed = false);
@@ -1170,6 +1388,14 @@ namespace tools
 
     bool set_ring_database(const std::string &filename);
     const std::string get_ring_database() const { return m_ring_database; }
+    bool set_block_database(const std::string &filename);
+    const std::string get_block_database() const { return m_block_database; }
+    // refresh on the daemon's ZMQ events (its --zmq-pub address) rather than on a timer
+    bool set_daemon_events_address(const std::string &address);
+    const std::string &get_daemon_events_address() const { return m_daemon_events_address; }
+    bool daemon_events_enabled() const { return m_daemon_notifier != nullptr; }
+    // whether the daemon published anything since the last call
+    bool take_daemon_event() { return m_daemon_event.exchange(false, std::memory_order_relaxed); }
     bool get_ring(const crypto::key_image &key_image, std::vector<uint64_t> &outs);
     bool get_rings(const crypto::hash &txid, std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &outs);
     bool set_ring(const crypto::key_image &key_image, const std::vector<uint64_t> &outs, bool relative);
@@ -1209,15 +1435,36 @@ namespace tools
     void get_short_chain_history(std::list<crypto::hash>& ids, uint64_t granularity = 1) const;
     bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint64_t block_height) const;
     bool clear();
-    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, uint64_t &current_height);
+    bool pull_blocks_from_blockdb(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    void add_blocks_to_blockdb(uint64_t blocks_start_height, uint64_t current_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
-    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
-    void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added);
+    void pull_and_parse_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
+    void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, std::shared_ptr<shared_scan> &scan, bool &error);
+    void prepare_tx_cache_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, const std::shared_ptr<shared_scan> &scan = std::shared_ptr<shared_scan>());
+    void cache_blocks_tx_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
+    void derive_tx_cache_data(std::vector<tx_cache_data> &tx_cache_data);
+    void leave_scan_group();
+    void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added);
+    void fetch_refresh_batches(uint64_t start_height, std::list<crypto::hash> &short_chain_history, tools::bounded_queue<refresh_batch> &fetched);
+    void prepare_refresh_batches(tools::bounded_queue<refresh_batch> &fetched, tools::bounded_queue<refresh_batch> &prepared);
     uint64_t select_transfers(uint64_t needed_money, std::vector<size_t> unused_transfers_indices, std::vector<size_t>& selected_transfers) const;
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height);
     void process_outgoing(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height, uint64_t ts, uint64_t spent, uint64_t received, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices);
+    void invalidate_transfer_indexes() const;
+    std::string get_history_blob() const;
+    void set_history_blob(std::string blob);
+    void load_history() const;
+    void update_transfer_indexes() const;
+    void index_payment(const payment_container::value_type &p) const;
+    void index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &p) const;
+    void invalidate_balance_cache() const;
+    void update_balance_cache() const;
+    void flush_events();
+    void clear_subaddress_str_cache();
+    std::vector<size_t> get_unspent_transfers(uint32_t subaddr_account, const std::set<uint32_t> &subaddr_indices) const;
     void add_unconfirmed_tx(const cryptonote::transaction& tx, uint64_t amount_in, const std::vector<cryptonote::tx_destination_entry> &dests, const crypto::hash &payment_id, uint64_t change_amount, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices);
     void generate_genesis(cryptonote::block& b) const;
     void check_genesis(const crypto::hash& genesis_hash) const; //throws
@@ -1240,21 +1487,33 @@ namespace tools
     crypto::public_key get_tx_pub_key_from_received_outs(const tools::wallet2::transfer_details &td) const;
     bool should_pick_a_second_output(bool use_rct, size_t n_transfers, const std::vector<size_t> &unused_transfers_indices, const std::vector<size_t> &unused_dust_indices) const;
     std::vector<size_t> get_only_rct(const std::vector<size_t> &unused_dust_indices, const std::vector<size_t> &unused_transfers_indices) const;
+    void precompute_key_images(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
     void scan_output(const cryptonote::transaction &tx, const crypto::public_key &tx_pub_key, size_t i, tx_scan_info_t &tx_scan_info, int &num_vouts_received, std::unordered_map<cryptonote::subaddress_index, uint64_t> &tx_money_got_in_outs, std::vector<size_t> &outs);
     void trim_hashchain();
+    bool store_cache_journal();
+    void reset_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size);
+    void load_cache_journal(const crypto::chacha_iv &base_iv, uint64_t base_size);
+    void apply_cache_journal_record(cache_journal_record &record);
     crypto::key_image get_multisig_composite_key_image(size_t n) const;
     rct::multisig_kLRki get_multisig_composite_kLRki(size_t n, const crypto::public_key &ignore, std::unordered_set<rct::key> &used_L, std::unordered_set<rct::key> &new_used_L) const;
     rct::multisig_kLRki get_multisig_kLRki(size_t n, const rct::key &k) const;
     rct::key get_multisig_k(size_t idx, const std::unordered_set<rct::key> &used_L) const;
     void update_multisig_rescan_info(const std::vector<std::vector<rct::key>> &multisig_k, const std::vector<std::vector<tools::wallet2::multisig_info>> &info, size_t n);
+    void update_multisig_rescan_info(const std::vector<std::vector<rct::key>> &multisig_k, const std::vector<std::vector<tools::wallet2::multisig_info>> &info, size_t begin, size_t end);
     bool add_rings(const crypto::chacha_key &key, const cryptonote::transaction_prefix &tx);
+    bool add_rings(const crypto::chacha_key &key, const std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> &rings);
     bool add_rings(const cryptonote::transaction_prefix &tx);
+    bool flush_pending_rings();
     bool remove_rings(const cryptonote::transaction_prefix &tx);
     bool get_ring(const crypto::chacha_key &key, const crypto::key_image &key_image, std::vector<uint64_t> &outs);
     crypto::chacha_key get_ringdb_key();
     void setup_keys(const epee::wipeable_string &password);
+    void add_subaddress_spend_keys(uint32_t index_major, uint32_t begin, uint32_t end);
 
     bool get_rct_distribution(uint64_t &start_height, std::vector<uint64_t> &distribution);
+    bool create_transactions_2(std::vector<wallet2::pending_tx> &ptx_vector, std::vector<cryptonote::tx_destination_entry> dsts, const size_t fake_outs_count, const uint64_t unlock_time, uint32_t priority, const std::vector<uint8_t>& extra, uint32_t subaddr_account, std::set<uint32_t> subaddr_indices, bool independent_inputs);
+    void invalidate_output_distribution_cache();
+    void get_key_images_spent_status(const std::vector<crypto::key_image> &key_images, std::vector<int> &spent_status);
 
     uint64_t get_segregation_fork_height() const;
     void unpack_multisig_info(const std::vector<std::string>& info,
@@ -1275,6 +1534,9 @@ namespace tools
     std::string m_wallet_file;
     std::string m_keys_file;
     epee::net_utils::http::http_simple_client m_http_client;
+    // extra connections for the refresh thread and pool polling, so they run
+    // alongside the requests using m_http_client
+    http_client_pool m_http_client_pool;
     hashchain m_blockchain;
     std::unordered_map<crypto::hash, unconfirmed_transfer_details> m_unconfirmed_txs;
     std::unordered_map<crypto::hash, confirmed_transfer_details> m_confirmed_txs;
@@ -1285,14 +1547,39 @@ namespace tools
 
     transfer_container m_transfers;
     payment_container m_payments;
+    // m_payments and m_confirmed_txs by account and height, rebuilt on the next query after
+    // anything but adding a transfer (elements of unordered containers keep their address)
+    mutable std::map<transfer_cursor, const payment_container::value_type*> m_payments_index;
+    mutable std::map<transfer_cursor, const std::pair<const crypto::hash, confirmed_transfer_details>*> m_confirmed_txs_index;
+    mutable bool m_transfer_indexes_valid;
+    // unspent m_transfers[0, m_balance_cache_transfers) summed per account and subaddress,
+    // kept up to date by set_spent/set_unspent; anything else touching m_transfers but
+    // appending to it must call invalidate_balance_cache
+    struct balance_cache_entry
+    {
+      uint64_t amount;
+      size_t count;
+    };
+    mutable std::map<uint32_t, std::map<uint32_t, balance_cache_entry>> m_balance_cache;
+    mutable std::map<uint32_t, std::map<uint32_t, balance_cache_entry>> m_unlocked_balance_cache;
+    mutable std::set<size_t> m_locked_transfers; // counted in m_balance_cache but not in m_unlocked_balance_cache yet
+    mutable std::map<uint32_t, std::map<uint32_t, std::set<size_t>>> m_unspent_transfers; // indices counted in m_balance_cache
+    mutable size_t m_balance_cache_transfers;
     std::unordered_map<crypto::key_image, size_t> m_key_images;
     std::unordered_map<crypto::public_key, size_t> m_pub_keys;
     cryptonote::account_public_address m_account_public_address;
     std::unordered_map<crypto::public_key, cryptonote::subaddress_index> m_subaddresses;
     std::vector<std::vector<std::string>> m_subaddress_labels;
+    std::vector<uint32_t> m_subaddress_keys_generated; // per account, minor indices below this are in m_subaddresses; not stored, rebuilt as needed
+    mutable boost::mutex m_subaddress_str_cache_mutex;
+    mutable std::unordered_map<cryptonote::subaddress_index, std::string> m_subaddress_str_cache; // get_subaddress_as_str results, not stored
     std::unordered_map<crypto::hash, std::string> m_tx_notes;
     std::unordered_map<std::string, std::string> m_attributes;
     std::vector<tools::wallet2::address_book_row> m_address_book;
+    // m_payments, m_confirmed_txs, m_tx_keys, m_additional_tx_keys, m_tx_notes and m_address_book
+    // as stored, until load_history parses them on first use; empty once they are loaded
+    std::string m_history_blob;
+    bool m_history_loaded;
     std::pair<std::map<std::string, std::string>, std::vector<std::string>> m_account_tags;
     uint64_t m_upper_transaction_weight_limit; //TODO: auto-calc this value or request from daemon, now use some fixed value
     const std::vector<std::vector<tools::wallet2::multisig_info>> *m_multisig_rescan_info;
@@ -1304,9 +1591,12 @@ namespace tools
 
     bool m_trusted_daemon;
     i_wallet2_callback* m_callback;
+    std::vector<wallet_event> m_pending_events; // batched mode, not delivered yet
+    std::unique_ptr<event_dispatcher> m_event_dispatcher;
     hw::device::device_type m_key_device_type;
     cryptonote::network_type m_nettype;
     uint64_t m_kdf_rounds;
+    uint32_t m_kdf_lanes; /*!< parallel KDF chains for the keys file, 0 for the original single chain */
     std::string seed_language; /*!< Language of the mnemonics (seed). */
     bool is_old_file_format; /*!< Whether the wallet file is of an old file format */
     bool m_watch_only; /*!< no spend key */
@@ -1324,6 +1614,21 @@ namespace tools
     RefreshType m_refresh_type;
     bool m_auto_refresh;
     bool m_first_refresh_done;
+
+    // what the cache file and its journal hold, to work out the next record
+    struct cache_journal_state
+    {
+      bool valid;
+      crypto::chacha_iv base_iv;
+      uint64_t base_size;
+      uint64_t journal_size;
+      uint64_t records;
+      size_t blockchain_offset;
+      size_t blockchain_size;
+      crypto::hash last_hash;
+      std::vector<crypto::hash> transfer_hashes;
+    };
+    cache_journal_state m_cache_journal;
     uint64_t m_refresh_from_block_height;
     // If m_refresh_from_block_height is explicitly set to zero we need this to differentiate it from the case that
     // m_refresh_from_block_height was defaulted to zero.*/
@@ -1341,10 +1646,25 @@ namespace tools
     bool m_segregate_pre_fork_outputs;
     bool m_key_reuse_mitigation2;
     uint64_t m_segregation_height;
+    uint32_t m_refresh_pipeline_depth;
+    uint64_t m_hashchain_tail; // if non zero, hashes older than that are only kept sparsely
+    std::shared_ptr<shared_block_cache> m_shared_block_cache;
+    std::shared_ptr<scan_group> m_scan_group;
+    boost::optional<crypto::public_key> m_scan_group_key; // our view key, once added to m_scan_group
     bool m_ignore_fractional_outputs;
+    bool m_parallel_tx_construction;
     bool m_is_initialized;
     NodeRPCProxy m_node_rpc_proxy;
+    // cumulative rct outputs per height, topped up from the daemon by height, and the
+    // pre fork output counts per amount, which do not change once well past the fork
+    uint64_t m_rct_distribution_start_height;
+    std::vector<uint64_t> m_rct_distribution;
+    std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> m_segregation_limits;
     std::unordered_set<crypto::hash> m_scanned_pool_txs[2];
+    // the daemon's pool as of m_pool_cookie, kept up to date from the changes since
+    std::unordered_set<crypto::hash> m_pool_hashes;
+    uint64_t m_pool_instance;
+    uint64_t m_pool_cookie;
     size_t m_subaddress_lookahead_major, m_subaddress_lookahead_minor;
     std::string m_device_name;
 
@@ -1366,6 +1686,14 @@ namespace tools
     bool m_ring_history_saved;
     std::unique_ptr<ringdb> m_ringdb;
     boost::optional<crypto::chacha_key> m_ringdb_key;
+    std::string m_block_database;
+    std::shared_ptr<blockdb> m_blockdb;
+    std::string m_daemon_events_address;
+    std::atomic<bool> m_daemon_event;
+    std::unique_ptr<daemon_notifier> m_daemon_notifier;
+    // rings of our txes met while processing a refresh chunk, saved in one db txn at its end
+    bool m_batch_rings;
+    std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> m_pending_rings;
 
     uint64_t m_last_block_reward;
     std::unique_ptr<tools::file_locker> m_keys_file_locker;
@@ -1378,8 +1706,9 @@ namespace tools
     std::shared_ptr<tools::Notify> m_tx_notify;
   };
 }
-BOOST_CLASS_VERSION(tools::wallet2, 25)
-BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 9)
+BOOST_CLASS_VERSION(tools::hashchain, 1)
+BOOST_CLASS_VERSION(tools::wallet2, 26)
+BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 10)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info, 1)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info::LR, 0)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_tx_set, 1)
@@ -1394,6 +1723,7 @@ BOOST_CLASS_VERSION(tools::wallet2::signed_tx_set, 0)
 BOOST_CLASS_VERSION(tools::wallet2::tx_construction_data, 3)
 BOOST_CLASS_VERSION(tools::wallet2::pending_tx, 3)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_sig, 0)
+BOOST_CLASS_VERSION(tools::wallet2::cache_journal_record, 0)
 
 namespace boost
 {
@@ -1437,6 +1767,10 @@ namespace boost
           x.m_multisig_k.clear();
           x.m_multisig_info.clear();
         }
+        if (ver < 10)
+        {
+          x.compact_tx();
+        }
     }
 
     template <class Archive>
@@ -1793,6 +2127,18 @@ namespace boost
         return;
       a & x.multisig_sigs;
     }
+
+    template <class Archive>
+    inline void serialize(Archive &a, tools::wallet2::cache_journal_record &x, const boost::serialization::version_type ver)
+    {
+      a & x.base_iv;
+      a & x.index;
+      a & x.blockchain_size;
+      a & x.new_hashes;
+      a & x.transfers_size;
+      a & x.transfers;
+      a & x.state;
+    }
   }
 }
 
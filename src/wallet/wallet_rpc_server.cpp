@@ -32,6 +32,7 @@
 #include <boost/asio/ip/address.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/thread.hpp>
 #include <cstdint>
 #include "include_base_utils.h"
 using namespace epee;
@@ -64,6 +65,11 @@ namespace
   const command_line::arg_descriptor<bool> arg_restricted = {"restricted-rpc", "Restricts to view-only commands", false};
   const command_line::arg_descriptor<std::string> arg_wallet_dir = {"wallet-dir", "Directory for newly created wallets"};
   const command_line::arg_descriptor<bool> arg_prompt_for_password = {"prompt-for-password", "Prompts for password when not provided", false};
+  const command_line::arg_descriptor<unsigned> arg_max_open_wallets = {"max-open-wallets", "Keep up to this many wallets from --wallet-dir open and refreshing, sharing block downloads", 1};
+
+  // batches of blocks kept for the other wallets to catch up, and for how long
+  constexpr const size_t SHARED_BLOCK_CACHE_ENTRIES = 16;
+  constexpr const std::chrono::seconds SHARED_BLOCK_CACHE_TTL = std::chrono::seconds(30);
 
   constexpr const char default_rpc_username[] = "etnc";
 
@@ -91,6 +97,35 @@ namespace
     else
       entry.suggested_confirmations_threshold = (entry.amount + block_reward - 1) / block_reward;
   }
+  //------------------------------------------------------------------------------------------------------------------------------
+  // cursors are opaque to clients: hex of account, height, txid, minor
+  std::string transfer_cursor_to_string(const tools::wallet2::transfer_cursor &cursor)
+  {
+    std::string blob;
+    blob.append((const char*)&cursor.account, sizeof(cursor.account));
+    blob.append((const char*)&cursor.height, sizeof(cursor.height));
+    blob.append((const char*)&cursor.txid, sizeof(cursor.txid));
+    blob.append((const char*)&cursor.minor, sizeof(cursor.minor));
+    return epee::string_tools::buff_to_hex_nodelimer(blob);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool parse_transfer_cursor(const std::string &str, tools::wallet2::transfer_cursor &cursor)
+  {
+    cursor = tools::wallet2::transfer_cursor();
+    if (str.empty())
+      return true;
+    std::string blob;
+    if (!epee::string_tools::parse_hexstr_to_binbuff(str, blob))
+      return false;
+    if (blob.size() != sizeof(cursor.account) + sizeof(cursor.height) + sizeof(cursor.txid) + sizeof(cursor.minor))
+      return false;
+    const char *ptr = blob.data();
+    memcpy(&cursor.account, ptr, sizeof(cursor.account)); ptr += sizeof(cursor.account);
+    memcpy(&cursor.height, ptr, sizeof(cursor.height)); ptr += sizeof(cursor.height);
+    memcpy(&cursor.txid, ptr, sizeof(cursor.txid)); ptr += sizeof(cursor.txid);
+    memcpy(&cursor.minor, ptr, sizeof(cursor.minor));
+    return true;
+  }
 }
 
 namespace tools
@@ -101,7 +136,8 @@ namespace tools
   }
 
   //------------------------------------------------------------------------------------------------------------------------------
-  wallet_rpc_server::wallet_rpc_server():m_wallet(NULL), rpc_login_file(), m_stop(false), m_restricted(false), m_vm(NULL)
+  wallet_rpc_server::wallet_rpc_server():m_wallet(NULL), rpc_login_file(), m_stop(false), m_restricted(false), m_vm(NULL), m_max_open_wallets(1),
+    m_shared_block_cache(std::make_shared<wallet2::shared_block_cache>(SHARED_BLOCK_CACHE_ENTRIES, SHARED_BLOCK_CACHE_TTL)), m_refresh_stop(false)
   {
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -109,24 +145,232 @@ namespace tools
   {
     if (m_wallet)
       delete m_wallet;
+    for (wallet2 *w: m_open_wallets)
+      delete w;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   void wallet_rpc_server::set_wallet(wallet2 *cr)
   {
     m_wallet = cr;
+    if (m_wallet)
+      m_wallet->set_shared_block_cache(m_shared_block_cache);
   }
   //------------------------------------------------------------------------------------------------------------------------------
-  bool wallet_rpc_server::run()
+  bool wallet_rpc_server::release_wallet(epee::json_rpc::error& er)
   {
-    m_stop = false;
-    m_net_server.add_idle_handler([this](){
+    if (!m_wallet)
+      return true;
+
+    // keep it open in the background if there is room, closing the least recently used one otherwise
+    std::list<wallet2*> closing;
+    if (m_max_open_wallets > 1)
+    {
+      m_open_wallets.push_front(m_wallet);
+      m_wallet = NULL;
+      while (m_open_wallets.size() >= m_max_open_wallets)
+      {
+        closing.push_back(m_open_wallets.back());
+        m_open_wallets.pop_back();
+      }
+    }
+    else
+    {
+      closing.push_back(m_wallet);
+      m_wallet = NULL;
+    }
+
+    bool success = true;
+    for (wallet2 *w: closing)
+    {
+      try
+      {
+        w->store();
+      }
+      catch (const std::exception& e)
+      {
+        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
+        success = false;
+      }
+      delete w;
+    }
+    return success;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::refresh_wallets()
+  {
+    std::vector<wallet2*> wallets(m_open_wallets.begin(), m_open_wallets.end());
+    if (m_wallet)
+      wallets.push_back(m_wallet);
+
+    auto refresh = [](wallet2 *w) {
       try {
-        if (m_wallet) m_wallet->refresh(m_wallet->is_trusted_daemon());
+        w->refresh(w->is_trusted_daemon());
       } catch (const std::exception& ex) {
         LOG_ERROR("Exception at while refreshing, what=" << ex.what());
       }
-      return true;
-    }, 20000);
+    };
+    if (wallets.size() == 1)
+    {
+      refresh(wallets[0]);
+      return;
+    }
+
+    // refreshing together lets a wallet reuse the blocks another one has just fetched and parsed
+    std::vector<boost::thread> threads;
+    threads.reserve(wallets.size());
+    for (wallet2 *w: wallets)
+      threads.emplace_back(refresh, w);
+    for (boost::thread &t: threads)
+      t.join();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::take_daemon_events(bool &subscribed)
+  {
+    boost::unique_lock<boost::mutex> lock(m_wallet_mutex);
+    bool event = false;
+    subscribed = false;
+    auto take = [&](wallet2 *w) {
+      if (w->daemon_events_enabled())
+      {
+        subscribed = true;
+        event = w->take_daemon_event() || event;
+      }
+    };
+    if (m_wallet)
+      take(m_wallet);
+    for (wallet2 *w: m_open_wallets)
+      take(w);
+    return event;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::auto_refresh()
+  {
+    while (true)
+    {
+      // poll the daemon every 20 seconds, or when subscribed to its events, refresh
+      // as soon as one comes in and otherwise only every 10 minutes in case some were lost
+      bool subscribed = false;
+      for (int i = 0; !m_refresh_stop.load(std::memory_order_relaxed); ++i)
+      {
+        if (take_daemon_events(subscribed) || i >= (subscribed ? 1200 : 40))
+          break;
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(500));
+      }
+      if (m_refresh_stop.load(std::memory_order_relaxed))
+        break;
+
+      boost::unique_lock<boost::mutex> lock(m_wallet_mutex);
+      if (m_refresh_stop.load(std::memory_order_relaxed))
+        break;
+      if (m_wallet)
+      {
+        std::shared_ptr<const wallet_snapshot> snapshot;
+        try
+        {
+          snapshot = make_snapshot(*m_wallet);
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to snapshot wallet: " << e.what());
+        }
+        boost::unique_lock<boost::mutex> snapshot_lock(m_snapshot_mutex);
+        m_snapshot = snapshot;
+      }
+      refresh_wallets();
+      boost::unique_lock<boost::mutex> snapshot_lock(m_snapshot_mutex);
+      m_snapshot.reset();
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  std::shared_ptr<const wallet_rpc_server::wallet_snapshot> wallet_rpc_server::make_snapshot(const wallet2 &w)
+  {
+    std::shared_ptr<wallet_snapshot> snapshot = std::make_shared<wallet_snapshot>();
+    snapshot->height = w.get_blockchain_current_height();
+    snapshot->multisig_import_needed = w.multisig() && w.has_multisig_partial_key_images();
+    snapshot->accounts.resize(w.get_num_subaddress_accounts());
+    for (uint32_t major = 0; major < snapshot->accounts.size(); ++major)
+    {
+      wallet_snapshot::account_info &account = snapshot->accounts[major];
+      account.balance = w.balance(major);
+      account.unlocked_balance = w.unlocked_balance(major);
+      account.subaddresses.resize(w.get_num_subaddresses(major));
+      const std::map<uint32_t, uint64_t> balance_per_subaddress = w.balance_per_subaddress(major);
+      const std::map<uint32_t, uint64_t> unlocked_balance_per_subaddress = w.unlocked_balance_per_subaddress(major);
+      for (uint32_t minor = 0; minor < account.subaddresses.size(); ++minor)
+      {
+        wallet_snapshot::subaddress_info &info = account.subaddresses[minor];
+        const cryptonote::subaddress_index index = {major, minor};
+        info.address = w.get_subaddress_as_str(index);
+        info.label = w.get_subaddress_label(index);
+        const auto b = balance_per_subaddress.find(minor);
+        info.has_balance = b != balance_per_subaddress.end();
+        info.balance = info.has_balance ? b->second : 0;
+        const auto ub = unlocked_balance_per_subaddress.find(minor);
+        info.unlocked_balance = ub == unlocked_balance_per_subaddress.end() ? 0 : ub->second;
+        info.num_unspent_outputs = 0;
+        info.used = false;
+      }
+    }
+    for (size_t i = 0; i < w.get_num_transfer_details(); ++i)
+    {
+      const wallet2::transfer_details &td = w.get_transfer_details(i);
+      if (td.m_subaddr_index.major >= snapshot->accounts.size() || td.m_subaddr_index.minor >= snapshot->accounts[td.m_subaddr_index.major].subaddresses.size())
+        continue;
+      wallet_snapshot::subaddress_info &info = snapshot->accounts[td.m_subaddr_index.major].subaddresses[td.m_subaddr_index.minor];
+      info.used = true;
+      if (!td.m_spent)
+        ++info.num_unspent_outputs;
+    }
+    return snapshot;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::is_snapshot_request(const epee::net_utils::http::http_request_info& query_info) const
+  {
+    if (query_info.m_URI != "/json_rpc")
+      return false;
+    epee::serialization::portable_storage ps;
+    if (!ps.load_from_json(query_info.m_body))
+      return false;
+    std::string method;
+    if (!ps.get_value("method", method, nullptr))
+      return false;
+    return method == "get_balance" || method == "getbalance" || method == "get_address" || method == "getaddress" || method == "get_height" || method == "getheight";
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context)
+  {
+    LOG_PRINT_L2("HTTP [" << m_conn_context.m_remote_address.host_str() << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+    response.m_response_code = 200;
+    response.m_response_comment = "Ok";
+
+    // a background refresh holds the wallet for a whole batch of blocks, so rather than
+    // stall, read only calls get the state as it was just before that refresh started
+    boost::unique_lock<boost::mutex> lock(m_wallet_mutex, boost::try_to_lock);
+    if (!lock.owns_lock())
+    {
+      if (is_snapshot_request(query_info))
+      {
+        boost::unique_lock<boost::mutex> snapshot_lock(m_snapshot_mutex);
+        m_request_snapshot = m_snapshot;
+      }
+      if (!m_request_snapshot)
+        lock.lock();
+    }
+    auto snapshot_reset = epee::misc_utils::create_scope_leave_handler([this]() { m_request_snapshot.reset(); });
+
+    if(!handle_http_request_map(query_info, response, m_conn_context))
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::run()
+  {
+    m_stop = false;
+    m_refresh_stop = false;
+    m_refresh_thread = boost::thread([this](){ auto_refresh(); });
     m_net_server.add_idle_handler([this](){
       if (m_stop.load(std::memory_order_relaxed))
       {
@@ -137,7 +381,16 @@ namespace tools
     }, 500);
 
     //DO NOT START THIS SERVER IN MORE THEN 1 THREADS WITHOUT REFACTORING
-    return epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+    bool r = epee::http_server_impl_base<wallet_rpc_server, connection_context>::run(1, true);
+
+    // the server is down, so nothing changes the set of open wallets anymore
+    m_refresh_stop = true;
+    if (m_wallet)
+      m_wallet->stop();
+    for (wallet2 *w: m_open_wallets)
+      w->stop();
+    m_refresh_thread.join();
+    return r;
   }
   //------------------------------------------------------------------------------------------------------------------------------
   void wallet_rpc_server::stop()
@@ -148,6 +401,20 @@ namespace tools
       delete m_wallet;
       m_wallet = NULL;
     }
+    while (!m_open_wallets.empty())
+    {
+      wallet2 *w = m_open_wallets.front();
+      m_open_wallets.pop_front();
+      try
+      {
+        w->store();
+      }
+      catch (const std::exception& e)
+      {
+        LOG_ERROR("Failed to store " << w->get_wallet_file() << ": " << e.what());
+      }
+      delete w;
+    }
   }
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::init(const boost::program_options::variables_map *vm)
@@ -162,6 +429,7 @@ namespace tools
     std::string bind_port = command_line::get_arg(*m_vm, arg_rpc_bind_port);
     const bool disable_auth = command_line::get_arg(*m_vm, arg_disable_rpc_login);
     m_restricted = command_line::get_arg(*m_vm, arg_restricted);
+    m_max_open_wallets = std::max(command_line::get_arg(*m_vm, arg_max_open_wallets), 1u);
     if (!command_line::is_arg_defaulted(*m_vm, arg_wallet_dir))
     {
       if (!command_line::is_arg_defaulted(*m_vm, wallet_args::arg_wallet_file()))
@@ -335,6 +603,44 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_getbalance(const wallet_rpc::COMMAND_RPC_GET_BALANCE::request& req, wallet_rpc::COMMAND_RPC_GET_BALANCE::response& res, epee::json_rpc::error& er)
   {
+    if (m_request_snapshot)
+    {
+      try
+      {
+        THROW_WALLET_EXCEPTION_IF(req.account_index >= m_request_snapshot->accounts.size(), error::account_index_outofbound);
+        const wallet_snapshot::account_info &account = m_request_snapshot->accounts[req.account_index];
+        res.balance = account.balance;
+        res.unlocked_balance = account.unlocked_balance;
+        res.multisig_import_needed = m_request_snapshot->multisig_import_needed;
+        std::set<uint32_t> address_indices = req.address_indices;
+        if (address_indices.empty())
+        {
+          for (uint32_t i = 0; i < account.subaddresses.size(); ++i)
+            if (account.subaddresses[i].has_balance)
+              address_indices.insert(i);
+        }
+        for (uint32_t i : address_indices)
+        {
+          THROW_WALLET_EXCEPTION_IF(i >= account.subaddresses.size(), error::address_index_outofbound);
+          const wallet_snapshot::subaddress_info &subaddress = account.subaddresses[i];
+          wallet_rpc::COMMAND_RPC_GET_BALANCE::per_subaddress_info info;
+          info.address_index = i;
+          info.address = subaddress.address;
+          info.balance = subaddress.balance;
+          info.unlocked_balance = subaddress.unlocked_balance;
+          info.label = subaddress.label;
+          info.num_unspent_outputs = subaddress.num_unspent_outputs;
+          res.per_subaddress.push_back(info);
+        }
+      }
+      catch (const std::exception& e)
+      {
+        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
+        return false;
+      }
+      return true;
+    }
+
     if (!m_wallet) return not_open(er);
     try
     {
@@ -374,6 +680,40 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_getaddress(const wallet_rpc::COMMAND_RPC_GET_ADDRESS::request& req, wallet_rpc::COMMAND_RPC_GET_ADDRESS::response& res, epee::json_rpc::error& er)
   {
+    if (m_request_snapshot)
+    {
+      try
+      {
+        THROW_WALLET_EXCEPTION_IF(req.account_index >= m_request_snapshot->accounts.size(), error::account_index_outofbound);
+        const wallet_snapshot::account_info &account = m_request_snapshot->accounts[req.account_index];
+        THROW_WALLET_EXCEPTION_IF(account.subaddresses.empty(), error::address_index_outofbound);
+        res.addresses.clear();
+        std::vector<uint32_t> req_address_index = req.address_index;
+        if (req_address_index.empty())
+        {
+          for (uint32_t i = 0; i < account.subaddresses.size(); ++i)
+            req_address_index.push_back(i);
+        }
+        for (uint32_t i : req_address_index)
+        {
+          THROW_WALLET_EXCEPTION_IF(i >= account.subaddresses.size(), error::address_index_outofbound);
+          res.addresses.resize(res.addresses.size() + 1);
+          auto& info = res.addresses.back();
+          info.address = account.subaddresses[i].address;
+          info.label = account.subaddresses[i].label;
+          info.address_index = i;
+          info.used = account.subaddresses[i].used;
+        }
+        res.address = account.subaddresses[0].address;
+      }
+      catch (const std::exception& e)
+      {
+        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
+        return false;
+      }
+      return true;
+    }
+
     if (!m_wallet) return not_open(er);
     try
     {
@@ -602,6 +942,11 @@ namespace tools
   //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_getheight(const wallet_rpc::COMMAND_RPC_GET_HEIGHT::request& req, wallet_rpc::COMMAND_RPC_GET_HEIGHT::response& res, epee::json_rpc::error& er)
   {
+    if (m_request_snapshot)
+    {
+      res.height = m_request_snapshot->height;
+      return true;
+    }
     if (!m_wallet) return not_open(er);
     try
     {
@@ -1548,7 +1893,6 @@ namespace tools
         {
           transfers_found = true;
         }
-        auto txBlob = t_serializable_object_to_blob(td.m_tx);
         wallet_rpc::transfer_details rpc_transfers;
         rpc_transfers.amount       = td.amount();
         rpc_transfers.spent        = td.m_spent;
@@ -2083,10 +2427,19 @@ namespace tools
       max_height = req.max_height <= max_height ? req.max_height : max_height;
     }
 
+    tools::wallet2::transfer_cursor in_cursor, out_cursor;
+    if (!parse_transfer_cursor(req.in_cursor, in_cursor) || !parse_transfer_cursor(req.out_cursor, out_cursor))
+    {
+      er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+      er.message = "Invalid cursor";
+      return false;
+    }
+
     if (req.in)
     {
       std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-      m_wallet->get_payments(payments, min_height, max_height, req.account_index, req.subaddr_indices);
+      if (m_wallet->get_payments(payments, min_height, max_height, req.account_index, req.subaddr_indices, req.max_count, in_cursor))
+        res.in_cursor = transfer_cursor_to_string(in_cursor);
       for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
         res.in.push_back(wallet_rpc::transfer_entry());
         fill_transfer_entry(res.in.back(), i->second.m_tx_hash, i->first, i->second);
@@ -2096,7 +2449,8 @@ namespace tools
     if (req.out)
     {
       std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments;
-      m_wallet->get_payments_out(payments, min_height, max_height, req.account_index, req.subaddr_indices);
+      if (m_wallet->get_payments_out(payments, min_height, max_height, req.account_index, req.subaddr_indices, req.max_count, out_cursor))
+        res.out_cursor = transfer_cursor_to_string(out_cursor);
       for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
         res.out.push_back(wallet_rpc::transfer_entry());
         fill_transfer_entry(res.out.back(), i->first, i->second);
@@ -2240,7 +2594,7 @@ namespace tools
 
     try
     {
-      res.outputs_data_hex = epee::string_tools::buff_to_hex_nodelimer(m_wallet->export_outputs_to_str());
+      res.outputs_data_hex = epee::string_tools::buff_to_hex_nodelimer(m_wallet->export_outputs_to_str(req.start));
     }
     catch (const std::exception &e)
     {
@@ -2293,7 +2647,8 @@ namespace tools
     if (!m_wallet) return not_open(er);
     try
     {
-      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet->export_key_images();
+      std::vector<std::pair<crypto::key_image, crypto::signature>> ski = m_wallet->export_key_images(req.offset);
+      res.offset = req.offset;
       res.signed_key_images.resize(ski.size());
       for (size_t n = 0; n < ski.size(); ++n)
       {
@@ -2351,7 +2706,7 @@ namespace tools
         ski[n].second = *reinterpret_cast<const crypto::signature*>(bd.data());
       }
       uint64_t spent = 0, unspent = 0;
-      uint64_t height = m_wallet->import_key_images(ski, spent, unspent);
+      uint64_t height = m_wallet->import_key_images(ski, req.offset, spent, unspent);
       res.spent = spent;
       res.unspent = unspent;
       res.height = height;
@@ -2705,20 +3060,10 @@ namespace tools
       return false;
     }
 
-    if (m_wallet)
-    {
-      try
-      {
-        m_wallet->store();
-      }
-      catch (const std::exception& e)
-      {
-        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
-        return false;
-      }
-      delete m_wallet;
-    }
+    if (!release_wallet(er))
+      return false;
     m_wallet = wal.release();
+    m_wallet->set_shared_block_cache(m_shared_block_cache);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -2747,6 +3092,27 @@ namespace tools
       return false;
     }
     std::string wallet_file = m_wallet_dir + "/" + req.filename;
+    for (auto i = m_open_wallets.begin(); i != m_open_wallets.end(); ++i)
+    {
+      if ((*i)->get_wallet_file() != wallet_file)
+        continue;
+      // still open from earlier, just switch to it
+      wallet2 *wal = *i;
+      if (!wal->verify_password(req.password))
+      {
+        er.code = WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR;
+        er.message = "Failed to open wallet";
+        return false;
+      }
+      m_open_wallets.erase(i);
+      if (!release_wallet(er))
+      {
+        delete wal;
+        return false;
+      }
+      m_wallet = wal;
+      return true;
+    }
     {
       po::options_description desc("dummy");
       const command_line::arg_descriptor<std::string, true> arg_password = {"password", "password"};
@@ -2775,20 +3141,10 @@ namespace tools
       return false;
     }
 
-    if (m_wallet)
-    {
-      try
-      {
-        m_wallet->store();
-      }
-      catch (const std::exception& e)
-      {
-        handle_rpc_exception(std::current_exception(), er, WALLET_RPC_ERROR_CODE_UNKNOWN_ERROR);
-        return false;
-      }
-      delete m_wallet;
-    }
+    if (!release_wallet(er))
+      return false;
     m_wallet = wal.release();
+    m_wallet->set_shared_block_cache(m_shared_block_cache);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -3532,6 +3888,7 @@ int main(int argc, char** argv) {
   command_line::add_arg(desc_params, arg_from_json);
   command_line::add_arg(desc_params, arg_wallet_dir);
   command_line::add_arg(desc_params, arg_prompt_for_password);
+  command_line::add_arg(desc_params, arg_max_open_wallets);
 
   daemonizer::init_options(hidden_options, desc_params);
   desc_params.add(hidden_options);
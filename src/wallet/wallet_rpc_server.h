@@ -33,6 +33,10 @@
 
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/variables_map.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <list>
+#include <memory>
 #include <string>
 #include "common/util.h"
 #include "net/http_server_impl_base.h"
@@ -65,7 +69,8 @@ namespace tools
 
   private:
 
-    CHAIN_HTTP_TO_MAP2(connection_context); //forward http requests to uri map
+    // forwards http requests to the uri map, see m_wallet_mutex
+    bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response, connection_context& m_conn_context);
 
     BEGIN_URI_MAP2()
       BEGIN_JSON_RPC_MAP("/json_rpc")
@@ -235,6 +240,37 @@ namespace tools
       void fill_transfer_entry(tools::wallet_rpc::transfer_entry &entry, const crypto::hash &txid, const tools::wallet2::unconfirmed_transfer_details &pd);
       void fill_transfer_entry(tools::wallet_rpc::transfer_entry &entry, const crypto::hash &payment_id, const tools::wallet2::pool_payment_details &pd);
       bool not_open(epee::json_rpc::error& er);
+      // what the read only calls need, copied from the open wallet before each background refresh
+      struct wallet_snapshot
+      {
+        struct subaddress_info
+        {
+          std::string address;
+          std::string label;
+          uint64_t balance;
+          uint64_t unlocked_balance;
+          uint64_t num_unspent_outputs;
+          bool has_balance; // listed by get_balance by default
+          bool used;
+        };
+        struct account_info
+        {
+          uint64_t balance;
+          uint64_t unlocked_balance;
+          std::vector<subaddress_info> subaddresses;
+        };
+
+        uint64_t height;
+        bool multisig_import_needed;
+        std::vector<account_info> accounts;
+      };
+
+      bool release_wallet(epee::json_rpc::error& er);
+      void refresh_wallets();
+      void auto_refresh();
+      bool take_daemon_events(bool &subscribed);
+      static std::shared_ptr<const wallet_snapshot> make_snapshot(const wallet2 &w);
+      bool is_snapshot_request(const epee::net_utils::http::http_request_info& query_info) const;
       void handle_rpc_exception(const std::exception_ptr& e, epee::json_rpc::error& er, int default_error_code);
 
       template<typename Ts, typename Tu>
@@ -248,5 +284,17 @@ namespace tools
       std::atomic<bool> m_stop;
       bool m_restricted;
       const boost::program_options::variables_map *m_vm;
+      unsigned m_max_open_wallets;
+      std::list<wallet2*> m_open_wallets; // open besides m_wallet, most recently used first
+      std::shared_ptr<wallet2::shared_block_cache> m_shared_block_cache;
+
+      // held by the rpc thread while handling a request, and by m_refresh_thread while refreshing;
+      // when a refresh holds it, read only requests are answered from m_snapshot instead of waiting
+      boost::mutex m_wallet_mutex;
+      boost::mutex m_snapshot_mutex;
+      std::shared_ptr<const wallet_snapshot> m_snapshot; // only set while m_refresh_thread holds m_wallet_mutex
+      std::shared_ptr<const wallet_snapshot> m_request_snapshot; // rpc thread only, set when answering from m_snapshot
+      boost::thread m_refresh_thread;
+      std::atomic<bool> m_refresh_stop;
   };
 }
@@ -48,7 +48,7 @@
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define WALLET_RPC_VERSION_MAJOR 1
-#define WALLET_RPC_VERSION_MINOR 4
+#define WALLET_RPC_VERSION_MINOR 5
 #define MAKE_WALLET_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define WALLET_RPC_VERSION MAKE_WALLET_RPC_VERSION(WALLET_RPC_VERSION_MAJOR, WALLET_RPC_VERSION_MINOR)
 namespace tools
@@ -1351,6 +1351,9 @@ namespace wallet_rpc
       uint64_t max_height;
       uint32_t account_index;
       std::set<uint32_t> subaddr_indices;
+      uint32_t max_count; // per list for in and out, 0 for all
+      std::string in_cursor;
+      std::string out_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -1363,6 +1366,9 @@ namespace wallet_rpc
         KV_SERIALIZE_OPT(max_height, (uint64_t)CRYPTONOTE_MAX_BLOCK_NUMBER);
         KV_SERIALIZE(account_index);
         KV_SERIALIZE(subaddr_indices);
+        KV_SERIALIZE_OPT(max_count, (uint32_t)0);
+        KV_SERIALIZE_OPT(in_cursor, std::string());
+        KV_SERIALIZE_OPT(out_cursor, std::string());
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1373,6 +1379,8 @@ namespace wallet_rpc
       std::list<transfer_entry> pending;
       std::list<transfer_entry> failed;
       std::list<transfer_entry> pool;
+      std::string in_cursor; // pass back to get the next page, empty when there is none
+      std::string out_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -1380,6 +1388,8 @@ namespace wallet_rpc
         KV_SERIALIZE(pending);
         KV_SERIALIZE(failed);
         KV_SERIALIZE(pool);
+        KV_SERIALIZE(in_cursor);
+        KV_SERIALIZE(out_cursor);
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -1459,7 +1469,10 @@ namespace wallet_rpc
   {
     struct request
     {
+      uint64_t start;
+
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(start, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1498,7 +1511,10 @@ namespace wallet_rpc
   {
     struct request
     {
+      uint64_t offset;
+
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(offset, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1515,9 +1531,11 @@ namespace wallet_rpc
 
     struct response
     {
+      uint64_t offset;
       std::vector<signed_key_image> signed_key_images;
 
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(offset);
         KV_SERIALIZE(signed_key_images);
       END_KV_SERIALIZE_MAP()
     };
@@ -1538,9 +1556,11 @@ namespace wallet_rpc
 
     struct request
     {
+      uint64_t offset;
       std::vector<signed_key_image> signed_key_images;
 
       BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_OPT(offset, (uint64_t)0);
         KV_SERIALIZE(signed_key_images);
       END_KV_SERIALIZE_MAP()
     };
@@ -414,11 +414,9 @@ public:
     m_c.handle_incoming_block(sr_block.data, bvc);
 
     cryptonote::block blk;
-    std::stringstream ss;
-    ss << sr_block.data;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(sr_block.data)};
     ::serialization::serialize(ba, blk);
-    if (!ss.good())
+    if (!ba.good())
     {
       blk = cryptonote::block();
     }
@@ -437,11 +435,9 @@ public:
     bool tx_added = pool_size + 1 == m_c.get_pool_transactions_count();
 
     cryptonote::transaction tx;
-    std::stringstream ss;
-    ss << sr_tx.data;
-    binary_archive<false> ba(ss);
+    binary_archive<false> ba{epee::strspan<std::uint8_t>(sr_tx.data)};
     ::serialization::serialize(ba, tx);
-    if (!ss.good())
+    if (!ba.good())
     {
       tx = cryptonote::transaction();
     }
@@ -499,7 +495,9 @@ inline bool do_replay_events(std::vector<test_event_entry>& events)
   boost::program_options::variables_map vm;
   bool r = command_line::handle_error_helper(desc, [&]()
   {
-    boost::program_options::store(boost::program_options::basic_parsed_options<char>(&desc), vm);
+    // each replay starts a new chain, which need not outlive it
+    const char *argv[] = {"core_tests", "--db-type=memory"};
+    boost::program_options::store(boost::program_options::parse_command_line(2, argv, desc), vm);
     boost::program_options::notify(vm);
     return true;
   });
@@ -56,6 +56,33 @@ class Daemon(object):
         }    
         return self.rpc.send_request(submitblock)
 
+    def get_mining_job(self, address, prev_template_id=0, wait_ms=0):
+        get_mining_job = {
+            'method': 'get_mining_job',
+            'params': {
+                'wallet_address': address,
+                'prev_template_id': prev_template_id,
+                'wait_ms': wait_ms
+            },
+            'jsonrpc': '2.0',
+            'id': '0'
+        }
+        return self.rpc.send_request(get_mining_job)
+
+    def submit_share(self, template_id, extra_nonce, nonce, share_difficulty=0):
+        submit_share = {
+            'method': 'submit_share',
+            'params': {
+                'template_id': template_id,
+                'extra_nonce': extra_nonce,
+                'nonce': nonce,
+                'share_difficulty': share_difficulty
+            },
+            'jsonrpc': '2.0',
+            'id': '0'
+        }
+        return self.rpc.send_request(submit_share)
+
     def getblock(self, height=0):
         getblock = {
             'method': 'getblock',
@@ -50,9 +50,7 @@ int BulletproofFuzzer::run(const std::string &filename)
     std::cout << "Error: failed to load file " << filename << std::endl;
     return 1;
   }
-  std::stringstream ss;
-  ss << s;
-  binary_archive<false> ba(ss);
+  binary_archive<false> ba{epee::strspan<std::uint8_t>(s)};
   rct::Bulletproof proof = AUTO_VAL_INIT(proof);
   bool r = ::serialization::serialize(ba, proof);
   if(!r)
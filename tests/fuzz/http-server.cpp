@@ -0,0 +1,116 @@
+// Copyright (c) 2019, The Electroneum Classic Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include "include_base_utils.h"
+#include "file_io_utils.h"
+#include "syncobj.h"
+#include "net/net_utils_base.h"
+#include "net/http_protocol_handler.h"
+#include "fuzzer.h"
+
+namespace
+{
+  struct test_http_handler: public epee::net_utils::http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+    virtual bool handle_http_request(const epee::net_utils::http::http_request_info& query_info,
+                                     epee::net_utils::http::http_response_info& response,
+                                     epee::net_utils::connection_context_base& m_conn_context)
+    {
+      response.m_body = query_info.m_body;
+      return true;
+    }
+  };
+
+  class test_connection: public epee::net_utils::i_service_endpoint
+  {
+  public:
+    virtual bool do_send(const void* ptr, size_t cb)  { return true; }
+    virtual bool close()                              { return true; }
+    virtual bool send_done()                          { return true; }
+    virtual bool call_run_once_service_io()           { return true; }
+    virtual bool request_callback()                   { return true; }
+    virtual boost::asio::io_service& get_io_service() { return m_io_service; }
+    virtual bool add_ref()                            { return true; }
+    virtual bool release()                            { return true; }
+
+  private:
+    boost::asio::io_service m_io_service;
+  };
+}
+
+class HTTPServerFuzzer: public Fuzzer
+{
+public:
+  HTTPServerFuzzer() {}
+  virtual int init();
+  virtual int run(const std::string &filename);
+
+private:
+  test_http_handler handler;
+  epee::net_utils::http::custum_handler_config<epee::net_utils::connection_context_base> config;
+};
+
+int HTTPServerFuzzer::init()
+{
+  config.m_phandler = &handler;
+  return 0;
+}
+
+int HTTPServerFuzzer::run(const std::string &filename)
+{
+  std::string s;
+
+  if (!epee::file_io_utils::load_file_to_string(filename, s))
+  {
+    std::cout << "Error: failed to load file " << filename << std::endl;
+    return 1;
+  }
+  try
+  {
+    // fed in two halves, so requests split across reads are exercised too
+    test_connection connection;
+    epee::net_utils::connection_context_base context;
+    epee::net_utils::http::http_custom_handler<epee::net_utils::connection_context_base> protocol_handler(&connection, config, context);
+    const size_t half = s.size() / 2;
+    if (protocol_handler.handle_recv(s.data(), half))
+      protocol_handler.handle_recv(s.data() + half, s.size() - half);
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "Failed to handle http request: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  TRY_ENTRY();
+  HTTPServerFuzzer fuzzer;
+  return run_fuzzer(argc, argv, fuzzer);
+  CATCH_ENTRY_L0("main", 1);
+}
@@ -33,6 +33,32 @@
 #include "storages/portable_storage_base.h"
 #include "fuzzer.h"
 
+// exercises pulling typed fields out of whatever the parser built
+struct fuzz_request
+{
+  std::string jsonrpc;
+  std::string method;
+  uint64_t height;
+  int64_t delta;
+  double ratio;
+  bool flag;
+  std::vector<uint64_t> indices;
+  std::list<std::string> blobs;
+  std::string hex_blob;
+
+  BEGIN_KV_SERIALIZE_MAP()
+    KV_SERIALIZE(jsonrpc)
+    KV_SERIALIZE(method)
+    KV_SERIALIZE(height)
+    KV_SERIALIZE(delta)
+    KV_SERIALIZE(ratio)
+    KV_SERIALIZE(flag)
+    KV_SERIALIZE(indices)
+    KV_SERIALIZE(blobs)
+    KV_SERIALIZE(hex_blob)
+  END_KV_SERIALIZE_MAP()
+};
+
 class PortableStorageFuzzer: public Fuzzer
 {
 public:
@@ -58,7 +84,20 @@ int PortableStorageFuzzer::run(const std::string &filename)
   try
   {
     epee::serialization::portable_storage ps;
-    ps.load_from_json(s);
+    if (ps.load_from_json(s))
+    {
+      // whatever was accepted must survive a round trip
+      std::string json;
+      ps.dump_as_json(json);
+      epee::serialization::portable_storage ps2;
+      if (!ps2.load_from_json(json))
+      {
+        std::cerr << "Failed to reload stored json" << std::endl;
+        return 1;
+      }
+    }
+    fuzz_request req;
+    epee::serialization::load_t_from_json(req, s);
   }
   catch (const std::exception &e)
   {
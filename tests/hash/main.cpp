@@ -62,6 +62,31 @@ extern "C" {
   static void cn_slow_hash_2(const void *data, size_t length, char *hash) {
     return cn_slow_hash(data, length, hash, 2/*variant*/, 0/*prehashed*/);
   }
+  // hashes the test data in ways 0 and 2, next to altered copies in ways 1 and 3,
+  // so ways leaking state into each other give a wrong result
+  static void cn_slow_hash_multi_variant(const void *data, size_t length, char *hash, int variant) {
+    vector<char> other1((const char*)data, (const char*)data + length), other2 = other1;
+    if (length > 0) {
+      other1[0] ^= 1;
+      other2[length - 1] ^= 0x80;
+    }
+    const void *ptrs[4] = {data, other1.data(), data, other2.data()};
+    const size_t lengths[4] = {length, length, length, length};
+    char hashes[4][HASH_SIZE];
+    cn_slow_hash_multi(ptrs, lengths, 4, hashes[0], variant);
+    memcpy(hash, hashes[2], HASH_SIZE);
+    if (memcmp(hashes[0], hashes[2], HASH_SIZE) != 0)
+      memset(hash, 0, HASH_SIZE);
+  }
+  static void cn_slow_hash_multi_0(const void *data, size_t length, char *hash) {
+    cn_slow_hash_multi_variant(data, length, hash, 0);
+  }
+  static void cn_slow_hash_multi_1(const void *data, size_t length, char *hash) {
+    cn_slow_hash_multi_variant(data, length, hash, 1);
+  }
+  static void cn_slow_hash_multi_2(const void *data, size_t length, char *hash) {
+    cn_slow_hash_multi_variant(data, length, hash, 2);
+  }
 }
 POP_WARNINGS
 
@@ -72,7 +97,8 @@ struct hash_func {
 } hashes[] = {{"fast", cn_fast_hash}, {"slow", cn_slow_hash_0}, {"tree", hash_tree},
   {"extra-blake", hash_extra_blake}, {"extra-groestl", hash_extra_groestl},
   {"extra-jh", hash_extra_jh}, {"extra-skein", hash_extra_skein},
-  {"slow-1", cn_slow_hash_1}, {"slow-2", cn_slow_hash_2}};
+  {"slow-1", cn_slow_hash_1}, {"slow-2", cn_slow_hash_2},
+  {"slow-multi", cn_slow_hash_multi_0}, {"slow-1-multi", cn_slow_hash_multi_1}, {"slow-2-multi", cn_slow_hash_multi_2}};
 
 int test_variant2_int_sqrt();
 int test_variant2_int_sqrt_ref();
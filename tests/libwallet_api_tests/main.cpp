@@ -336,6 +336,20 @@ TEST_F(WalletManagerTest, WalletManagerStoresWallet)
 }
 
 
+TEST_F(WalletManagerTest, WalletManagerStoresWalletAsync)
+{
+
+    Monero::Wallet * wallet1 = wmgr->createWallet(WALLET_NAME, WALLET_PASS, WALLET_LANG, Monero::NetworkType::MAINNET);
+    std::string seed1 = wallet1->seed();
+    std::future<bool> stored = wallet1->storeFuture("");
+    ASSERT_TRUE(stored.get());
+    ASSERT_TRUE(wmgr->closeWallet(wallet1));
+    Monero::Wallet * wallet2 = wmgr->openWallet(WALLET_NAME, WALLET_PASS, Monero::NetworkType::MAINNET);
+    ASSERT_TRUE(wallet2->status() == Monero::Wallet::Status_Ok);
+    ASSERT_TRUE(wallet2->seed() == seed1);
+}
+
+
 TEST_F(WalletManagerTest, WalletManagerMovesWallet)
 {
 
@@ -550,6 +564,20 @@ TEST_F(WalletTest1, WalletRefresh)
     ASSERT_TRUE(wmgr->closeWallet(wallet1));
 }
 
+TEST_F(WalletTest1, WalletRefreshFuture)
+{
+
+    std::cout << "Opening wallet: " << CURRENT_SRC_WALLET << std::endl;
+    Monero::Wallet * wallet1 = wmgr->openWallet(CURRENT_SRC_WALLET, TESTNET_WALLET_PASS, Monero::NetworkType::TESTNET);
+    ASSERT_TRUE(wallet1->init(TESTNET_DAEMON_ADDRESS, 0));
+    std::future<bool> refreshed = wallet1->refreshFuture();
+    std::future<void> history = wallet1->refreshHistoryFuture();
+    ASSERT_TRUE(refreshed.get());
+    history.get();
+    ASSERT_TRUE(wallet1->history()->count() > 0);
+    ASSERT_TRUE(wmgr->closeWallet(wallet1));
+}
+
 TEST_F(WalletTest1, WalletConvertsToString)
 {
     std::string strAmount = Monero::Wallet::displayAmount(AMOUNT_5XMR);
@@ -0,0 +1,647 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Runs a set of p2p nodes in this process, wired on loopback in a chosen
+// topology, injects txes and blocks at one of them, and reports how long
+// they take to reach every node, how many bytes the relay puts on the
+// wire, and how much CPU it costs. The nodes run the real p2p and
+// cryptonote protocol code over a stub core which takes any object that
+// parses, so this measures the relay itself, not verification.
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <unordered_map>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "ringct/rctOps.h"
+#include "p2p/net_node.h"
+#include "p2p/net_node.inl"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.inl"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "net.relay_test"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  typedef std::chrono::steady_clock::time_point time_point;
+
+  const command_line::arg_descriptor<size_t> arg_nodes = {"nodes", "Number of nodes to run", 8};
+  const command_line::arg_descriptor<std::string> arg_topology = {"topology", "Node topology: ring, line, star, full or random", "ring"};
+  const command_line::arg_descriptor<size_t> arg_degree = {"degree", "Outgoing connections per node for the random topology", 3};
+  const command_line::arg_descriptor<uint32_t> arg_seed = {"seed", "Seed for the random topology and origin choice", 0};
+  const command_line::arg_descriptor<uint16_t> arg_base_port = {"base-port", "First p2p port, nodes use consecutive ports", 48080};
+  const command_line::arg_descriptor<size_t> arg_txes = {"txes", "Number of txes to relay", 20};
+  const command_line::arg_descriptor<size_t> arg_tx_size = {"tx-size", "Approximate size of each tx in bytes", 2000};
+  const command_line::arg_descriptor<size_t> arg_blocks = {"blocks", "Number of blocks to relay", 5};
+  const command_line::arg_descriptor<size_t> arg_block_txes = {"block-txes", "Number of already relayed txes each block includes", 4};
+  const command_line::arg_descriptor<bool> arg_no_fluffy_blocks = {"no-fluffy-blocks", "Relay full blocks instead of fluffy ones", false};
+  const command_line::arg_descriptor<uint32_t> arg_settle_ms = {"settle-ms", "Time to let duplicate announcements drain after each object, in ms", 2500};
+  const command_line::arg_descriptor<uint32_t> arg_timeout = {"timeout", "Time to wait for connections or propagation before giving up, in seconds", 60};
+  const command_line::arg_descriptor<std::string> arg_log_level = {"log-level", "0-4 or categories", "0"};
+
+  // Takes anything which parses. Remembers when each object first arrived
+  // so the harness can tell propagation latency per node.
+  class relay_core
+  {
+  public:
+    relay_core(bool fluffy): m_fluffy(fluffy) {}
+
+    void on_synchronized(){}
+    void safesyncmode(const bool){}
+    uint64_t get_current_blockchain_height() const {return 1;}
+    void set_target_blockchain_height(uint64_t) {}
+    bool init(const boost::program_options::variables_map& vm) {return true;}
+    bool deinit(){return true;}
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const {return true;}
+    bool have_block(const crypto::hash& id) const { return id == crypto::null_hash || seen(id); }
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=crypto::null_hash;}
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
+    {
+      cryptonote::transaction tx;
+      crypto::hash tx_hash;
+      if (!cryptonote::parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash))
+      {
+        tvc.m_verifivation_failed = true;
+        return false;
+      }
+      tvc.m_should_be_relayed = add_tx(tx_hash, tx_blob, std::chrono::steady_clock::now()) && !keeped_by_block;
+      return true;
+    }
+    bool handle_incoming_txs(const std::vector<cryptonote::blobdata>& tx_blobs, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay)
+    {
+      tvc.resize(tx_blobs.size());
+      bool ok = true;
+      for (size_t i = 0; i < tx_blobs.size(); ++i)
+        ok &= handle_incoming_tx(tx_blobs[i], tvc[i], keeped_by_block, relayed, do_not_relay);
+      return ok;
+    }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true)
+    {
+      cryptonote::block b;
+      if (!cryptonote::parse_and_validate_block_from_blob(block_blob, b))
+      {
+        bvc.m_verifivation_failed = true;
+        return false;
+      }
+      return handle_incoming_block(block_blob, &b, bvc, update_miner_blocktemplate);
+    }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, const cryptonote::block *b, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true)
+    {
+      bvc.m_added_to_main_chain = add_block(cryptonote::get_block_hash(*b), *b, std::chrono::steady_clock::now());
+      return true;
+    }
+    void pause_mine(){}
+    void resume_mine(){}
+    bool on_idle(){return true;}
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, size_t max_headers = 0){return true;}
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, std::string& rsp_blob, cryptonote::cryptonote_connection_context& context){return true;}
+    bool get_test_drop_download() const {return true;}
+    bool get_test_drop_download_height() const {return true;}
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks) { return true; }
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::block> &parsed_blocks) { parsed_blocks.clear(); return true; }
+    void prefetch_block_longhashes(const std::vector<cryptonote::block_complete_entry> &blocks, uint64_t start_height) {}
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    uint64_t get_target_blockchain_height() const { return 1; }
+    size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+    cryptonote::network_type get_nettype() const { return cryptonote::TESTNET; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_pool.find(id);
+      if (i == m_pool.end())
+        return false;
+      tx_blob = i->second;
+      return true;
+    }
+    bool pool_has_tx(const crypto::hash &txid) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      return m_pool.find(txid) != m_pool.end();
+    }
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata, cryptonote::block>>& blocks, std::vector<cryptonote::blobdata>& txs) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::transaction>& txs, std::vector<crypto::hash>& missed_txs) const
+    {
+      for (const crypto::hash &txid: txs_ids)
+      {
+        cryptonote::blobdata blob;
+        cryptonote::transaction tx;
+        if (get_pool_transaction(txid, blob) && cryptonote::parse_and_validate_tx_from_blob(blob, tx))
+          txs.push_back(std::move(tx));
+        else
+          missed_txs.push_back(txid);
+      }
+      return true;
+    }
+    bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_blocks.find(h);
+      if (i == m_blocks.end())
+        return false;
+      blk = i->second;
+      if (orphan)
+        *orphan = false;
+      return true;
+    }
+    uint8_t get_ideal_hard_fork_version() const { return 0; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    uint8_t get_hard_fork_version(uint64_t height) const { return 0; }
+    uint64_t get_earliest_ideal_height_for_version(uint8_t version) const { return 0; }
+    cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return m_fluffy; }
+    uint32_t get_blockchain_pruning_seed() const { return 0; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes) { return 0; }
+    bool verify_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<cryptonote::blobdata> &headers) { return true; }
+    void stop() {}
+
+    bool add_tx(const crypto::hash &txid, const cryptonote::blobdata &blob, const time_point &when)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (!m_pool.insert(std::make_pair(txid, blob)).second)
+        return false;
+      m_seen.insert(std::make_pair(txid, when));
+      return true;
+    }
+    bool add_block(const crypto::hash &id, const cryptonote::block &b, const time_point &when)
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      if (!m_blocks.insert(std::make_pair(id, b)).second)
+        return false;
+      m_seen.insert(std::make_pair(id, when));
+      return true;
+    }
+    bool seen(const crypto::hash &id, time_point *when = NULL) const
+    {
+      boost::unique_lock<boost::mutex> lock(m_lock);
+      const auto i = m_seen.find(id);
+      if (i == m_seen.end())
+        return false;
+      if (when)
+        *when = i->second;
+      return true;
+    }
+
+  private:
+    const bool m_fluffy;
+    mutable boost::mutex m_lock;
+    std::unordered_map<crypto::hash, cryptonote::blobdata> m_pool;
+    std::unordered_map<crypto::hash, cryptonote::block> m_blocks;
+    std::unordered_map<crypto::hash, time_point> m_seen;
+  };
+
+  typedef cryptonote::t_cryptonote_protocol_handler<relay_core> relay_protocol;
+  typedef nodetool::node_server<relay_protocol> relay_server;
+
+  struct relay_node
+  {
+    relay_node(bool fluffy): core(fluffy), protocol(core, NULL), server(protocol) { protocol.set_p2p_endpoint(&server); }
+
+    relay_core core;
+    relay_protocol protocol;
+    relay_server server;
+    boost::thread thread;
+    size_t degree = 0;
+  };
+
+  // (i, j) with i < j, j connects out to i
+  typedef std::vector<std::pair<size_t, size_t>> edge_list;
+
+  bool make_topology(const std::string &topology, size_t n, size_t degree, std::mt19937 &rng, edge_list &edges)
+  {
+    std::set<std::pair<size_t, size_t>> e;
+    if (topology == "ring" || topology == "line")
+    {
+      for (size_t i = 0; i + 1 < n; ++i)
+        e.insert(std::make_pair(i, i + 1));
+      if (topology == "ring" && n > 2)
+        e.insert(std::make_pair(0, n - 1));
+    }
+    else if (topology == "star")
+    {
+      for (size_t i = 1; i < n; ++i)
+        e.insert(std::make_pair(0, i));
+    }
+    else if (topology == "full")
+    {
+      for (size_t i = 0; i < n; ++i)
+        for (size_t j = i + 1; j < n; ++j)
+          e.insert(std::make_pair(i, j));
+    }
+    else if (topology == "random")
+    {
+      // a line first so the graph is connected, then random extra links
+      for (size_t i = 0; i + 1 < n; ++i)
+        e.insert(std::make_pair(i, i + 1));
+      for (size_t i = 0; i < n; ++i)
+      {
+        for (size_t k = 1; k < std::min(degree, n - 1); ++k)
+        {
+          size_t j = std::uniform_int_distribution<size_t>(0, n - 2)(rng);
+          if (j >= i)
+            ++j;
+          e.insert(std::make_pair(std::min(i, j), std::max(i, j)));
+        }
+      }
+    }
+    else
+    {
+      MERROR("Unknown topology: " << topology);
+      return false;
+    }
+    edges.assign(e.begin(), e.end());
+    return true;
+  }
+
+  // a tx which parses, with its extra padded to reach the requested size
+  cryptonote::blobdata make_tx(size_t size)
+  {
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = 0;
+    cryptonote::txin_to_key in;
+    in.amount = 0;
+    in.key_offsets.push_back(1);
+    in.k_image = rct::rct2ki(rct::pkGen());
+    tx.vin.push_back(in);
+    cryptonote::txout_to_key out;
+    out.key = rct::rct2pk(rct::pkGen());
+    tx.vout.push_back(cryptonote::tx_out{0, out});
+    tx.signatures.push_back(std::vector<crypto::signature>(1));
+    const size_t base = cryptonote::tx_to_blob(tx).size();
+    if (size > base + 3)
+      tx.extra.resize(size - base - 3, 0);
+    return cryptonote::tx_to_blob(tx);
+  }
+
+  uint64_t get_bytes_sent(std::vector<std::unique_ptr<relay_node>> &nodes)
+  {
+    uint64_t bytes = 0;
+    for (auto &node: nodes)
+    {
+      node->server.for_each_connection([&bytes](cryptonote::cryptonote_connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags)
+      {
+        bytes += context.m_send_cnt;
+        return true;
+      });
+    }
+    return bytes;
+  }
+
+  size_t get_normal_connections(relay_node &node)
+  {
+    size_t count = 0;
+    node.server.for_each_connection([&count](cryptonote::cryptonote_connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (peer_id && context.m_state == cryptonote::cryptonote_connection_context::state_normal)
+        ++count;
+      return true;
+    });
+    return count;
+  }
+
+  struct relay_stats
+  {
+    std::vector<uint64_t> full_us;
+    std::vector<uint64_t> median_us;
+    uint64_t bytes = 0;
+    uint64_t cpu_ms = 0;
+    size_t timeouts = 0;
+  };
+
+  // waits for every node to see id, and records the latest and median arrival
+  bool wait_for_propagation(std::vector<std::unique_ptr<relay_node>> &nodes, const crypto::hash &id, const time_point &start, uint32_t timeout, relay_stats &stats)
+  {
+    std::vector<uint64_t> arrivals;
+    const time_point deadline = start + std::chrono::seconds(timeout);
+    while (true)
+    {
+      arrivals.clear();
+      for (auto &node: nodes)
+      {
+        time_point when;
+        if (!node->core.seen(id, &when))
+          break;
+        arrivals.push_back(std::chrono::duration_cast<std::chrono::microseconds>(when - start).count());
+      }
+      if (arrivals.size() == nodes.size())
+        break;
+      if (std::chrono::steady_clock::now() > deadline)
+      {
+        MERROR("Timed out waiting for " << id << " to reach every node (" << arrivals.size() << "/" << nodes.size() << ")");
+        ++stats.timeouts;
+        return false;
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    }
+    std::sort(arrivals.begin(), arrivals.end());
+    stats.full_us.push_back(arrivals.back());
+    stats.median_us.push_back(arrivals[arrivals.size() / 2]);
+    return true;
+  }
+
+  void print_stats(const char *what, const relay_stats &stats, size_t objects, size_t nodes)
+  {
+    std::vector<uint64_t> full_us = stats.full_us;
+    std::sort(full_us.begin(), full_us.end());
+    uint64_t full_sum = 0, median_sum = 0;
+    for (uint64_t us: full_us)
+      full_sum += us;
+    for (uint64_t us: stats.median_us)
+      median_sum += us;
+    const size_t done = full_us.size();
+    std::cout << what << ": " << done << "/" << objects << " fully propagated" << std::endl;
+    if (done)
+    {
+      std::cout << std::fixed << std::setprecision(1)
+          << "  time to all nodes: avg " << full_sum / done / 1000.0 << " ms, p50 " << full_us[done / 2] / 1000.0
+          << " ms, max " << full_us.back() / 1000.0 << " ms" << std::endl
+          << "  time to half the nodes: avg " << median_sum / done / 1000.0 << " ms" << std::endl;
+    }
+    if (objects)
+    {
+      std::cout << "  bytes on the wire: " << stats.bytes / objects << " per object" << std::endl
+          << "  CPU: " << std::setprecision(2) << stats.cpu_ms / (float)objects / nodes << " ms per object per node" << std::endl;
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  tools::on_startup();
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  po::options_description desc("Allowed options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, arg_nodes);
+  command_line::add_arg(desc, arg_topology);
+  command_line::add_arg(desc, arg_degree);
+  command_line::add_arg(desc, arg_seed);
+  command_line::add_arg(desc, arg_base_port);
+  command_line::add_arg(desc, arg_txes);
+  command_line::add_arg(desc, arg_tx_size);
+  command_line::add_arg(desc, arg_blocks);
+  command_line::add_arg(desc, arg_block_txes);
+  command_line::add_arg(desc, arg_no_fluffy_blocks);
+  command_line::add_arg(desc, arg_settle_ms);
+  command_line::add_arg(desc, arg_timeout);
+  command_line::add_arg(desc, arg_log_level);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+  if (command_line::get_arg(vm, command_line::arg_help))
+  {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+
+  mlog_configure(mlog_get_default_log_path("net_load_tests_relay.log"), true);
+  mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+
+  const size_t n_nodes = command_line::get_arg(vm, arg_nodes);
+  const uint16_t base_port = command_line::get_arg(vm, arg_base_port);
+  const size_t n_txes = command_line::get_arg(vm, arg_txes);
+  const size_t tx_size = command_line::get_arg(vm, arg_tx_size);
+  const size_t n_blocks = command_line::get_arg(vm, arg_blocks);
+  const size_t block_txes = command_line::get_arg(vm, arg_block_txes);
+  const bool fluffy = !command_line::get_arg(vm, arg_no_fluffy_blocks);
+  const uint32_t settle_ms = command_line::get_arg(vm, arg_settle_ms);
+  const uint32_t timeout = command_line::get_arg(vm, arg_timeout);
+  if (n_nodes < 2 || n_nodes + base_port > 65535)
+  {
+    std::cerr << "Need at least two nodes, on ports below 65536" << std::endl;
+    return 1;
+  }
+
+  std::mt19937 rng(command_line::get_arg(vm, arg_seed));
+  edge_list edges;
+  if (!make_topology(command_line::get_arg(vm, arg_topology), n_nodes, command_line::get_arg(vm, arg_degree), rng, edges))
+    return 1;
+
+  boost::system::error_code ec;
+  const boost::filesystem::path data_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("etnc-relay-%%%%-%%%%");
+  boost::filesystem::create_directories(data_dir, ec);
+  if (ec)
+  {
+    std::cerr << "Failed to create " << data_dir.string() << ": " << ec.message() << std::endl;
+    return 1;
+  }
+
+  // every node gets its own command line, as if it were a daemon
+  std::vector<std::vector<std::string>> exclusive(n_nodes);
+  for (const auto &e: edges)
+    exclusive[e.second].push_back("127.0.0.1:" + std::to_string(base_port + e.first));
+
+  std::vector<std::unique_ptr<relay_node>> nodes;
+  for (size_t i = 0; i < n_nodes; ++i)
+  {
+    nodes.emplace_back(new relay_node(fluffy));
+    relay_node &node = *nodes.back();
+    for (const auto &e: edges)
+      if (e.first == i || e.second == i)
+        ++node.degree;
+
+    po::options_description node_desc;
+    command_line::add_arg(node_desc, cryptonote::arg_data_dir);
+    command_line::add_arg(node_desc, cryptonote::arg_testnet_on);
+    command_line::add_arg(node_desc, cryptonote::arg_stagenet_on);
+    command_line::add_arg(node_desc, cryptonote::arg_offline);
+    command_line::add_arg(node_desc, cryptonote::arg_rpc_only_readonly_db);
+    relay_server::init_options(node_desc);
+
+    // testnet, so no seed node names get resolved; the throttle is shared
+    // by all nodes in the process, so lift it out of the way
+    std::vector<std::string> args = {
+      "--testnet",
+      "--data-dir", data_dir.string(),
+      "--p2p-bind-ip", "127.0.0.1",
+      "--p2p-bind-port", std::to_string(base_port + i),
+      "--allow-local-ip",
+      "--no-igd",
+      "--hide-my-port",
+      "--limit-rate", "1048576",
+    };
+    // a node which only takes incoming connections still needs an
+    // exclusive peer, or it would go and look for seed nodes
+    if (exclusive[i].empty())
+      exclusive[i].push_back("127.0.0.1:1");
+    for (const std::string &peer: exclusive[i])
+    {
+      args.push_back("--add-exclusive-node");
+      args.push_back(peer);
+    }
+
+    po::variables_map node_vm;
+    po::store(po::command_line_parser(args).options(node_desc).run(), node_vm);
+    po::notify(node_vm);
+    if (!node.server.init(node_vm) || !node.protocol.init(node_vm) || !node.core.init(node_vm))
+    {
+      MERROR("Failed to initialize node " << i);
+      return 1;
+    }
+  }
+
+  for (auto &node: nodes)
+  {
+    relay_server *server = &node->server;
+    node->thread = boost::thread([server]() { server->run(); });
+  }
+
+  MGINFO("Waiting for " << n_nodes << " nodes to connect (" << edges.size() << " links)...");
+  const time_point connect_deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout);
+  bool connected = false;
+  while (!connected && std::chrono::steady_clock::now() < connect_deadline)
+  {
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    connected = true;
+    for (auto &node: nodes)
+      connected &= node->protocol.is_synchronized() && get_normal_connections(*node) >= node->degree;
+  }
+
+  relay_stats tx_stats, block_stats;
+  std::vector<std::pair<crypto::hash, cryptonote::blobdata>> relayed_txes;
+  if (connected)
+  {
+    std::cout << n_nodes << " nodes, " << edges.size() << " links, " << command_line::get_arg(vm, arg_topology) << " topology" << std::endl;
+    std::uniform_int_distribution<size_t> origin_dist(0, n_nodes - 1);
+
+    for (size_t k = 0; k < n_txes; ++k)
+    {
+      const cryptonote::blobdata blob = make_tx(tx_size);
+      cryptonote::transaction tx;
+      crypto::hash txid;
+      CHECK_AND_ASSERT_MES(cryptonote::parse_and_validate_tx_from_blob(blob, tx, txid), 1, "Failed to parse generated tx");
+      relay_node &origin = *nodes[origin_dist(rng)];
+
+      const uint64_t bytes = get_bytes_sent(nodes);
+      const std::clock_t cpu = std::clock();
+      const time_point start = std::chrono::steady_clock::now();
+      origin.core.add_tx(txid, blob, start);
+      cryptonote::NOTIFY_NEW_TRANSACTIONS::request arg;
+      arg.txs.push_back(blob);
+      cryptonote::cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+      origin.protocol.relay_transactions(arg, fake_context);
+      if (wait_for_propagation(nodes, txid, start, timeout, tx_stats))
+        relayed_txes.push_back(std::make_pair(txid, blob));
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(settle_ms));
+      tx_stats.cpu_ms += (std::clock() - cpu) * 1000 / CLOCKS_PER_SEC;
+      tx_stats.bytes += get_bytes_sent(nodes) - bytes;
+    }
+
+    cryptonote::account_base miner;
+    miner.generate();
+    crypto::hash prev_id = crypto::null_hash;
+    for (size_t k = 0; k < n_blocks; ++k)
+    {
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 0;
+      b.timestamp = time(NULL);
+      b.prev_id = prev_id;
+      b.nonce = k;
+      CHECK_AND_ASSERT_MES(cryptonote::construct_miner_tx(k + 1, 0, 0, 0, 0, miner.get_keys().m_account_address, b.miner_tx), 1, "Failed to construct miner tx");
+      cryptonote::NOTIFY_NEW_BLOCK::request arg;
+      for (size_t t = 0; t < block_txes && !relayed_txes.empty(); ++t)
+      {
+        b.tx_hashes.push_back(relayed_txes.back().first);
+        arg.b.txs.push_back(std::move(relayed_txes.back().second));
+        relayed_txes.pop_back();
+      }
+      arg.b.block = cryptonote::block_to_blob(b);
+      arg.current_blockchain_height = k + 2;
+      const crypto::hash id = cryptonote::get_block_hash(b);
+      prev_id = id;
+      relay_node &origin = *nodes[origin_dist(rng)];
+
+      const uint64_t bytes = get_bytes_sent(nodes);
+      const std::clock_t cpu = std::clock();
+      const time_point start = std::chrono::steady_clock::now();
+      origin.core.add_block(id, b, start);
+      cryptonote::cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
+      origin.protocol.relay_block(arg, fake_context);
+      wait_for_propagation(nodes, id, start, timeout, block_stats);
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(settle_ms));
+      block_stats.cpu_ms += (std::clock() - cpu) * 1000 / CLOCKS_PER_SEC;
+      block_stats.bytes += get_bytes_sent(nodes) - bytes;
+    }
+
+    print_stats("txes", tx_stats, n_txes, n_nodes);
+    print_stats(fluffy ? "fluffy blocks" : "full blocks", block_stats, n_blocks, n_nodes);
+  }
+  else
+  {
+    MERROR("Nodes failed to connect within " << timeout << " seconds");
+  }
+
+  for (auto &node: nodes)
+    node->server.send_stop_signal();
+  for (auto &node: nodes)
+  {
+    node->thread.join();
+    node->core.deinit();
+    node->protocol.deinit();
+    node->server.deinit();
+    node->protocol.set_p2p_endpoint(NULL);
+  }
+  boost::filesystem::remove_all(data_dir, ec);
+
+  return connected && !tx_stats.timeouts && !block_stats.timeouts ? 0 : 1;
+
+  CATCH_ENTRY_L0("main", 1);
+}
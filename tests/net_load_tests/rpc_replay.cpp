@@ -0,0 +1,299 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Replays RPC requests recorded by a daemon run with --rpc-record-requests
+// against a daemon, at the recorded pace or at a fixed rate, from several
+// connections at once, and reports latency per method and the throughput
+// the daemon sustained.
+//
+// Each line of the input is "<ms> <URI> <body>", where the body is hex, or
+// "-" for none. Lines written by hand may also give a JSON body as is, eg:
+//   0 /json_rpc {"jsonrpc":"2.0","id":"0","method":"get_info"}
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include <boost/program_options.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+#include "string_tools.h"
+#include "net/http_client.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+#include "common/command_line.h"
+#include "common/util.h"
+#include "cryptonote_config.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "rpc.replay"
+
+namespace po = boost::program_options;
+
+namespace
+{
+  const command_line::arg_descriptor<std::string> arg_input_file = {"input-file", "Requests recorded with --rpc-record-requests", ""};
+  const command_line::arg_descriptor<std::string> arg_daemon_address = {"daemon-address", "Daemon to send the requests to", "127.0.0.1:" + std::to_string(config::RPC_DEFAULT_PORT)};
+  const command_line::arg_descriptor<std::string> arg_daemon_login = {"daemon-login", "user:password for the daemon's RPC", ""};
+  const command_line::arg_descriptor<double> arg_rate = {"rate", "Requests per second to send (0 to keep the recorded pace)", 0};
+  const command_line::arg_descriptor<size_t> arg_requests = {"requests", "Requests to send, looping over the input (0 to send the input once)", 0};
+  const command_line::arg_descriptor<unsigned> arg_connections = {"connections", "Concurrent connections to the daemon", 8};
+  const command_line::arg_descriptor<unsigned> arg_timeout = {"timeout", "Per request timeout, in seconds", 60};
+  const command_line::arg_descriptor<std::string> arg_log_level = {"log-level", "0-4 or categories", "0"};
+
+  struct recorded_request
+  {
+    uint64_t offset_ms;
+    std::string uri;
+    std::string body;
+    std::string method;
+  };
+
+  struct json_rpc_method
+  {
+    std::string method;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(method)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct method_stats
+  {
+    std::vector<uint64_t> latencies_us;
+    size_t errors = 0;
+    uint64_t bytes_received = 0;
+  };
+
+  bool load_requests(const std::string &path, std::vector<recorded_request> &requests)
+  {
+    std::ifstream in(path);
+    if (!in.is_open())
+    {
+      MERROR("Failed to open " << path);
+      return false;
+    }
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(in, line))
+    {
+      ++line_number;
+      if (line.empty() || line[0] == '#')
+        continue;
+      std::istringstream ss(line);
+      recorded_request req;
+      std::string body;
+      if (!(ss >> req.offset_ms >> req.uri) || !std::getline(ss >> std::ws, body))
+      {
+        MERROR("Malformed line " << line_number << " in " << path);
+        return false;
+      }
+      if (body[0] == '{')
+        req.body = body;
+      else if (body != "-" && !epee::string_tools::parse_hexstr_to_binbuff(body, req.body))
+      {
+        MERROR("Bad body on line " << line_number << " in " << path);
+        return false;
+      }
+
+      req.method = req.uri;
+      if (req.uri == "/json_rpc")
+      {
+        json_rpc_method m;
+        if (epee::serialization::load_t_from_json(m, req.body) && !m.method.empty())
+          req.method = m.method;
+      }
+      requests.push_back(std::move(req));
+    }
+    return true;
+  }
+
+  uint64_t percentile(const std::vector<uint64_t> &sorted, double p)
+  {
+    return sorted[std::min<size_t>(sorted.size() - 1, sorted.size() * p)];
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  TRY_ENTRY();
+
+  tools::on_startup();
+  epee::string_tools::set_module_name_and_folder(argv[0]);
+
+  po::options_description desc("Allowed options");
+  command_line::add_arg(desc, command_line::arg_help);
+  command_line::add_arg(desc, arg_input_file);
+  command_line::add_arg(desc, arg_daemon_address);
+  command_line::add_arg(desc, arg_daemon_login);
+  command_line::add_arg(desc, arg_rate);
+  command_line::add_arg(desc, arg_requests);
+  command_line::add_arg(desc, arg_connections);
+  command_line::add_arg(desc, arg_timeout);
+  command_line::add_arg(desc, arg_log_level);
+
+  po::variables_map vm;
+  bool r = command_line::handle_error_helper(desc, [&]()
+  {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+    return true;
+  });
+  if (!r)
+    return 1;
+  if (command_line::get_arg(vm, command_line::arg_help) || command_line::get_arg(vm, arg_input_file).empty())
+  {
+    std::cout << desc << std::endl;
+    return command_line::get_arg(vm, command_line::arg_help) ? 0 : 1;
+  }
+
+  mlog_configure(mlog_get_default_log_path("net_load_tests_rpc.log"), true);
+  mlog_set_log(command_line::get_arg(vm, arg_log_level).c_str());
+
+  std::vector<recorded_request> requests;
+  if (!load_requests(command_line::get_arg(vm, arg_input_file), requests))
+    return 1;
+  if (requests.empty())
+  {
+    std::cerr << "No requests to replay" << std::endl;
+    return 1;
+  }
+
+  const std::string daemon_address = command_line::get_arg(vm, arg_daemon_address);
+  boost::optional<epee::net_utils::http::login> login;
+  const std::string daemon_login = command_line::get_arg(vm, arg_daemon_login);
+  if (!daemon_login.empty())
+  {
+    const auto loc = daemon_login.find(':');
+    login.emplace(daemon_login.substr(0, loc), loc == std::string::npos ? std::string() : daemon_login.substr(loc + 1));
+  }
+  const double rate = command_line::get_arg(vm, arg_rate);
+  const size_t total = command_line::get_arg(vm, arg_requests) ? command_line::get_arg(vm, arg_requests) : requests.size();
+  const unsigned connections = std::max(1u, command_line::get_arg(vm, arg_connections));
+  const std::chrono::milliseconds timeout(command_line::get_arg(vm, arg_timeout) * 1000);
+
+  // recorded offsets, with each pass over the input starting where the last ended
+  const uint64_t pass_ms = requests.back().offset_ms - requests.front().offset_ms + 1;
+  auto scheduled_us = [&](size_t i) -> uint64_t {
+    if (rate > 0)
+      return i * 1000000 / rate;
+    const recorded_request &req = requests[i % requests.size()];
+    return ((i / requests.size()) * pass_ms + req.offset_ms - requests.front().offset_ms) * 1000;
+  };
+
+  std::map<std::string, method_stats> stats;
+  boost::mutex stats_lock;
+  std::atomic<size_t> next(0);
+  std::atomic<uint64_t> max_lag_us(0);
+  const auto start = std::chrono::steady_clock::now();
+
+  std::vector<boost::thread> threads;
+  for (unsigned t = 0; t < connections; ++t)
+  {
+    threads.emplace_back([&]()
+    {
+      epee::net_utils::http::http_simple_client client;
+      client.set_server(daemon_address, login);
+      while (true)
+      {
+        const size_t i = next++;
+        if (i >= total)
+          break;
+        const recorded_request &req = requests[i % requests.size()];
+        const auto due = start + std::chrono::microseconds(scheduled_us(i));
+        const auto now = std::chrono::steady_clock::now();
+        if (due > now)
+          boost::this_thread::sleep_for(boost::chrono::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(due - now).count()));
+        else
+        {
+          // all connections busy: the daemon is not keeping up with the rate
+          uint64_t lag = std::chrono::duration_cast<std::chrono::microseconds>(now - due).count();
+          uint64_t prev = max_lag_us;
+          while (lag > prev && !max_lag_us.compare_exchange_weak(prev, lag));
+        }
+
+        const epee::net_utils::http::http_response_info *info = NULL;
+        const auto sent = std::chrono::steady_clock::now();
+        const bool ok = client.invoke_post(req.uri, req.body, timeout, &info);
+        const uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent).count();
+
+        boost::unique_lock<boost::mutex> lock(stats_lock);
+        method_stats &s = stats[req.method];
+        if (ok && info && info->m_response_code == 200)
+        {
+          s.latencies_us.push_back(us);
+          s.bytes_received += info->m_body.size();
+        }
+        else
+        {
+          MDEBUG(req.method << " failed" << (info ? " with code " + std::to_string(info->m_response_code) : std::string()));
+          ++s.errors;
+        }
+      }
+    });
+  }
+  for (auto &thread: threads)
+    thread.join();
+  const double elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() / 1e6;
+
+  size_t served = 0, errors = 0;
+  uint64_t bytes = 0;
+  std::cout << std::left << std::setw(32) << "method" << std::right << std::setw(8) << "calls" << std::setw(8) << "errors"
+      << std::setw(12) << "p50 ms" << std::setw(12) << "p99 ms" << std::setw(12) << "max ms" << std::endl;
+  for (auto &e: stats)
+  {
+    method_stats &s = e.second;
+    std::sort(s.latencies_us.begin(), s.latencies_us.end());
+    served += s.latencies_us.size();
+    errors += s.errors;
+    bytes += s.bytes_received;
+    std::cout << std::left << std::setw(32) << e.first << std::right << std::setw(8) << s.latencies_us.size() << std::setw(8) << s.errors << std::fixed << std::setprecision(2);
+    if (s.latencies_us.empty())
+      std::cout << std::setw(12) << "-" << std::setw(12) << "-" << std::setw(12) << "-" << std::endl;
+    else
+      std::cout << std::setw(12) << percentile(s.latencies_us, 0.5) / 1000.0 << std::setw(12) << percentile(s.latencies_us, 0.99) / 1000.0
+          << std::setw(12) << s.latencies_us.back() / 1000.0 << std::endl;
+  }
+  std::cout << std::fixed << std::setprecision(1)
+      << total << " requests in " << elapsed << " s, " << errors << " failed" << std::endl
+      << "daemon throughput: " << served / elapsed << " requests/s, " << bytes / elapsed / 1024 << " kB/s" << std::endl;
+  if (max_lag_us > 100000)
+    std::cout << "requests fell up to " << max_lag_us / 1000 << " ms behind schedule, the target rate was not sustained" << std::endl;
+
+  return errors ? 1 : 0;
+
+  CATCH_ENTRY_L0("main", 1);
+}
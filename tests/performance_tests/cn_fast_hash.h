@@ -33,6 +33,11 @@
 #include "crypto/crypto.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 
+extern "C"
+{
+#include "crypto/keccak.h"
+}
+
 template<size_t bytes>
 class test_cn_fast_hash
 {
@@ -55,3 +60,39 @@ public:
 private:
   std::array<uint8_t, bytes> m_data;
 };
+
+// hashes batch_size inputs of the given size per call with a keccak_multi
+// backend, so the backends can be compared by hash rate
+template<int backend, size_t bytes>
+class test_cn_fast_hash_multi
+{
+public:
+  static const size_t batch_size = 16;
+  static const size_t loop_count = bytes < 256 ? 10000 : bytes < 4096 ? 1000 : 100;
+  static const size_t hashes_per_call = batch_size;
+
+  bool init()
+  {
+    if (!keccak_backend_supported(backend))
+      return false;
+    for (size_t n = 0; n < batch_size; ++n)
+    {
+      crypto::rand(bytes, m_data[n].data());
+      m_ptrs[n] = m_data[n].data();
+      m_lengths[n] = bytes;
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::hash hashes[batch_size];
+    keccak_multi_backend(backend, m_ptrs, m_lengths, batch_size, (uint8_t*)hashes, sizeof(crypto::hash));
+    return true;
+  }
+
+private:
+  std::array<uint8_t, bytes> m_data[batch_size];
+  const uint8_t *m_ptrs[batch_size];
+  size_t m_lengths[batch_size];
+};
@@ -70,3 +70,43 @@ private:
   data_t m_data;
   crypto::hash m_expected_hash;
 };
+
+// hashes ways copies of a 76 byte block hashing blob per call with
+// cn_slow_hash_multi, so hashes per second per core can be compared
+// across numbers of interleaved scratchpads
+template<size_t ways, int variant>
+class test_cn_slow_hash_multi
+{
+public:
+  static const size_t loop_count = 8;
+  static const size_t hashes_per_call = ways;
+
+  bool init()
+  {
+    for (size_t n = 0; n < ways; ++n)
+    {
+      for (size_t i = 0; i < sizeof(m_data[n]); ++i)
+        m_data[n][i] = (char)(n * 31 + i);
+      m_ptrs[n] = m_data[n];
+      m_lengths[n] = sizeof(m_data[n]);
+      crypto::cn_slow_hash(m_data[n], sizeof(m_data[n]), m_expected_hashes[n], variant);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::hash hashes[ways];
+    crypto::cn_slow_hash_multi(m_ptrs, m_lengths, ways, hashes, variant);
+    for (size_t n = 0; n < ways; ++n)
+      if (hashes[n] != m_expected_hashes[n])
+        return false;
+    return true;
+  }
+
+private:
+  char m_data[ways][76];
+  const void *m_ptrs[ways];
+  size_t m_lengths[ways];
+  crypto::hash m_expected_hashes[ways];
+};
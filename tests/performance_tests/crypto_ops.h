@@ -46,6 +46,9 @@ enum test_op
   op_scalarmultBase,
   op_scalarmultKey,
   op_scalarmultH,
+  op_addKeysGH,
+  op_commit,
+  op_zeroCommit,
   op_scalarmult8,
   op_ge_double_scalarmult_base_vartime,
   op_ge_double_scalarmult_precomp_vartime,
@@ -66,6 +69,7 @@ public:
   {
     scalar0 = rct::skGen();
     scalar1 = rct::skGen();
+    amount = rct::randXmrAmount(1000000000000);
     point0 = rct::scalarmultBase(rct::skGen());
     point1 = rct::scalarmultBase(rct::skGen());
     if (ge_frombytes_vartime(&p3_0, point0.bytes) != 0)
@@ -100,6 +104,9 @@ public:
       case op_scalarmultBase: rct::scalarmultBase(scalar0); break;
       case op_scalarmultKey: rct::scalarmultKey(point0, scalar0); break;
       case op_scalarmultH: rct::scalarmultH(scalar0); break;
+      case op_addKeysGH: rct::addKeysGH(key, scalar0, scalar1); break;
+      case op_commit: rct::commit(amount, scalar0); break;
+      case op_zeroCommit: rct::zeroCommit(amount); break;
       case op_scalarmult8: rct::scalarmult8(point0); break;
       case op_ge_double_scalarmult_base_vartime: ge_double_scalarmult_base_vartime(&tmp_p2, scalar0.bytes, &p3_0, scalar1.bytes); break;
       case op_ge_double_scalarmult_precomp_vartime: ge_double_scalarmult_precomp_vartime(&tmp_p2, scalar0.bytes, &p3_0, scalar1.bytes, precomp0); break;
@@ -115,6 +122,7 @@ public:
 
 private:
   rct::key scalar0, scalar1;
+  rct::xmr_amount amount;
   rct::key point0, point1;
   ge_p3 p3_0, p3_1;
   ge_cached cached;
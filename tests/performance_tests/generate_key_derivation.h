@@ -30,6 +30,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include "crypto/crypto.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 
@@ -47,3 +49,52 @@ public:
     return true;
   }
 };
+
+// generate_key_derivation over a batch of tx keys, with the scalar
+// multiplications done by the given crypto-ops backend
+template<int backend, size_t batch_size>
+class test_generate_key_derivation_batch : public single_tx_test_base
+{
+public:
+  static const size_t loop_count = 1000 / batch_size + 1;
+
+  bool init()
+  {
+    if (!ge_batch_backend_supported(backend))
+      return false;
+    if (!single_tx_test_base::init())
+      return false;
+
+    m_points.resize(batch_size);
+    m_scalars.resize(batch_size);
+    m_results.resize(batch_size);
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+      const crypto::public_key tx_key = i == 0 ? m_tx_pub_key : cryptonote::keypair::generate(hw::get_device("default")).pub;
+      if (ge_frombytes_vartime(&m_points[i], (const unsigned char*)&tx_key) != 0)
+        return false;
+      m_scalars[i] = m_bob.get_keys().m_view_secret_key;
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    ge_scalarmult_batch_backend(backend, m_results.data(), (const unsigned char*)m_scalars.data(), m_points.data(), batch_size);
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+      ge_p1p1 point2;
+      ge_p2 point;
+      crypto::key_derivation derivation;
+      ge_mul8(&point2, &m_results[i]);
+      ge_p1p1_to_p2(&point, &point2);
+      ge_tobytes((unsigned char*)&derivation, &point);
+    }
+    return true;
+  }
+
+private:
+  std::vector<ge_p3> m_points;
+  std::vector<crypto::secret_key> m_scalars;
+  std::vector<ge_p2> m_results;
+};
@@ -0,0 +1,81 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <string>
+
+#include "crypto/crypto.h"
+#include "string_tools.h"
+
+template<size_t bytes>
+class test_to_hex
+{
+public:
+  static const size_t loop_count = bytes < 256 ? 100000 : bytes < 4096 ? 10000 : 1000;
+
+  bool init()
+  {
+    m_data.resize(bytes);
+    crypto::rand(bytes, (uint8_t*)&m_data[0]);
+    return true;
+  }
+
+  bool test()
+  {
+    return epee::string_tools::buff_to_hex_nodelimer(m_data).size() == 2 * bytes;
+  }
+
+private:
+  std::string m_data;
+};
+
+template<size_t bytes>
+class test_from_hex
+{
+public:
+  static const size_t loop_count = bytes < 256 ? 100000 : bytes < 4096 ? 10000 : 1000;
+
+  bool init()
+  {
+    std::string data(bytes, 0);
+    crypto::rand(bytes, (uint8_t*)&data[0]);
+    m_hex = epee::string_tools::buff_to_hex_nodelimer(data);
+    return true;
+  }
+
+  bool test()
+  {
+    std::string data;
+    return epee::string_tools::parse_hexstr_to_binbuff(m_hex, data) && data.size() == bytes;
+  }
+
+private:
+  std::string m_hex;
+};
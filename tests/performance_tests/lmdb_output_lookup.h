@@ -0,0 +1,167 @@
+// Copyright (c) 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <lmdb.h>
+#include <boost/filesystem.hpp>
+#include "crypto/crypto.h"
+
+// Random ring member lookups against the two layouts used for RCT outputs:
+// the legacy single amount 0 key with sorted duplicates (MDB_GET_BOTH), and
+// the integer keyed rct_outputs table (MDB_SET).
+template<bool flat>
+class test_lmdb_output_lookup
+{
+public:
+  static const size_t loop_count = 1000;
+  static const size_t num_outputs = 256 * 1024;
+  static const size_t ring_size = 11;
+
+  struct outval
+  {
+    uint64_t output_id;
+    char data[80];
+  };
+
+  ~test_lmdb_output_lookup()
+  {
+    if (m_env)
+      mdb_env_close(m_env);
+    if (!m_path.empty())
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_path, ec);
+    }
+  }
+
+  static int compare_output_id(const MDB_val *a, const MDB_val *b)
+  {
+    uint64_t va, vb;
+    memcpy(&va, a->mv_data, sizeof(va));
+    memcpy(&vb, b->mv_data, sizeof(vb));
+    return va < vb ? -1 : va > vb;
+  }
+
+  bool init()
+  {
+    m_path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    if (!boost::filesystem::create_directory(m_path))
+      return false;
+    if (mdb_env_create(&m_env) || mdb_env_set_maxdbs(m_env, 1) || mdb_env_set_mapsize(m_env, 1 << 30))
+      return false;
+    if (mdb_env_open(m_env, m_path.string().c_str(), MDB_NOSYNC, 0644))
+      return false;
+
+    MDB_txn *txn;
+    if (mdb_txn_begin(m_env, NULL, 0, &txn))
+      return false;
+    const unsigned int flags = flat ? MDB_INTEGERKEY : MDB_INTEGERKEY | MDB_DUPSORT | MDB_DUPFIXED;
+    if (mdb_dbi_open(txn, "outputs", flags | MDB_CREATE, &m_dbi))
+      return false;
+    if (!flat)
+      mdb_set_dupsort(txn, m_dbi, compare_output_id);
+
+    outval v;
+    memset(v.data, 0, sizeof(v.data));
+    uint64_t amount = 0;
+    for (uint64_t i = 0; i < num_outputs; ++i)
+    {
+      v.output_id = i;
+      crypto::rand(32, (uint8_t*)v.data);
+      MDB_val k, d;
+      if (flat)
+      {
+        k = {sizeof(i), (void*)&i};
+        d = {sizeof(v), (void*)&v};
+        if (mdb_put(txn, m_dbi, &k, &d, MDB_APPEND))
+          return false;
+      }
+      else
+      {
+        k = {sizeof(amount), (void*)&amount};
+        d = {sizeof(v), (void*)&v};
+        if (mdb_put(txn, m_dbi, &k, &d, MDB_APPENDDUP))
+          return false;
+      }
+    }
+    if (mdb_txn_commit(txn))
+      return false;
+
+    for (size_t i = 0; i < ring_size * loop_count; ++i)
+      m_indices.push_back(crypto::rand<uint64_t>() % num_outputs);
+    return true;
+  }
+
+  bool test()
+  {
+    MDB_txn *txn;
+    if (mdb_txn_begin(m_env, NULL, MDB_RDONLY, &txn))
+      return false;
+    MDB_cursor *cur;
+    if (mdb_cursor_open(txn, m_dbi, &cur))
+    {
+      mdb_txn_abort(txn);
+      return false;
+    }
+    bool ret = true;
+    const uint64_t amount = 0;
+    for (size_t i = 0; i < ring_size; ++i)
+    {
+      uint64_t index = m_indices[m_pos++ % m_indices.size()];
+      MDB_val k, v;
+      int result;
+      if (flat)
+      {
+        k = {sizeof(index), (void*)&index};
+        result = mdb_cursor_get(cur, &k, &v, MDB_SET);
+      }
+      else
+      {
+        k = {sizeof(amount), (void*)&amount};
+        v = {sizeof(index), (void*)&index};
+        result = mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH);
+      }
+      if (result || ((const outval*)v.mv_data)->output_id != index)
+      {
+        ret = false;
+        break;
+      }
+    }
+    mdb_cursor_close(cur);
+    mdb_txn_abort(txn);
+    return ret;
+  }
+
+private:
+  boost::filesystem::path m_path;
+  MDB_env *m_env = NULL;
+  MDB_dbi m_dbi;
+  std::vector<uint64_t> m_indices;
+  size_t m_pos = 0;
+};
@@ -51,6 +51,7 @@
 #include "subaddress_expand.h"
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
+#include "hex_codec.h"
 #include "rct_mlsag.h"
 #include "equality.h"
 #include "range_proof.h"
@@ -58,6 +59,12 @@
 #include "bulletproof.h"
 #include "crypto_ops.h"
 #include "multiexp.h"
+#include "portable_storage.h"
+#include "parse_tx.h"
+#include "tx_to_json.h"
+#include "lmdb_output_lookup.h"
+#include "txpool_index.h"
+#include "wallet_refresh.h"
 
 namespace po = boost::program_options;
 
@@ -65,8 +72,6 @@ int main(int argc, char** argv)
 {
   TRY_ENTRY();
   tools::on_startup();
-  set_process_affinity(1);
-  set_thread_high_priority();
 
   mlog_configure(mlog_get_default_log_path("performance_tests.log"), true);
 
@@ -75,10 +80,18 @@ int main(int argc, char** argv)
   const command_line::arg_descriptor<bool> arg_verbose = { "verbose", "Verbose output", false };
   const command_line::arg_descriptor<bool> arg_stats = { "stats", "Including statistics (min/median)", false };
   const command_line::arg_descriptor<unsigned> arg_loop_multiplier = { "loop-multiplier", "Run for that many times more loops", 1 };
+  const command_line::arg_descriptor<unsigned> arg_threads = { "threads", "Size the thread pool used by multithreaded tests, instead of pinning to one core", 0 };
+  const command_line::arg_descriptor<std::string> arg_output = { "output", "Write results, with statistics and machine details, to this CSV file" };
+  const command_line::arg_descriptor<std::string> arg_baseline = { "baseline", "Compare median times with a CSV file written by --output" };
+  const command_line::arg_descriptor<double> arg_regression_threshold = { "regression-threshold", "Percentage slowdown against the baseline reported as a regression", 10.0 };
   command_line::add_arg(desc_options, arg_filter);
   command_line::add_arg(desc_options, arg_verbose);
   command_line::add_arg(desc_options, arg_stats);
   command_line::add_arg(desc_options, arg_loop_multiplier);
+  command_line::add_arg(desc_options, arg_threads);
+  command_line::add_arg(desc_options, arg_output);
+  command_line::add_arg(desc_options, arg_baseline);
+  command_line::add_arg(desc_options, arg_regression_threshold);
 
   po::variables_map vm;
   bool r = command_line::handle_error_helper(desc_options, [&]()
@@ -96,6 +109,31 @@ int main(int argc, char** argv)
   p.stats = command_line::get_arg(vm, arg_stats);
   p.loop_multiplier = command_line::get_arg(vm, arg_loop_multiplier);
 
+  // saved and compared results need the per call statistics
+  const std::string output = command_line::get_arg(vm, arg_output);
+  const std::string baseline_file = command_line::get_arg(vm, arg_baseline);
+  std::vector<performance_result> results;
+  std::map<std::string, performance_result> baseline;
+  p.results = NULL;
+  if (!output.empty() || !baseline_file.empty())
+  {
+    p.stats = true;
+    p.results = &results;
+  }
+  if (!baseline_file.empty() && !read_performance_results(baseline_file, baseline))
+  {
+    std::cerr << "Failed to read baseline from " << baseline_file << std::endl;
+    return 1;
+  }
+
+  // the global thread pool is sized on first use, so this comes first
+  const unsigned threads = command_line::get_arg(vm, arg_threads);
+  if (threads)
+    tools::set_max_concurrency(threads);
+  else
+    set_process_affinity(1);
+  set_thread_high_priority();
+
   performance_timer timer;
   timer.start();
 
@@ -144,6 +182,11 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE4(filter, p, test_construct_tx, 100, 2, true, rct::RangeProofPaddedBulletproof);
   TEST_PERFORMANCE4(filter, p, test_construct_tx, 100, 10, true, rct::RangeProofPaddedBulletproof);
 
+  // wallet shaped: 2 outputs, from a single input up to a sweep's worth of MLSAGs
+  TEST_PERFORMANCE4(filter, p, test_construct_tx, 1, 2, true, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE4(filter, p, test_construct_tx, 8, 2, true, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE4(filter, p, test_construct_tx, 16, 2, true, rct::RangeProofPaddedBulletproof);
+
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 1, 2, false);
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 2, 2, false);
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 10, 2, false);
@@ -178,6 +221,10 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE0(filter, p, test_is_out_to_acc_precomp);
   TEST_PERFORMANCE0(filter, p, test_generate_key_image_helper);
   TEST_PERFORMANCE0(filter, p, test_generate_key_derivation);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivation_batch, GE_BATCH_BACKEND_REF10, 16);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivation_batch, GE_BATCH_BACKEND_AVX2, 16);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivation_batch, GE_BATCH_BACKEND_REF10, 64);
+  TEST_PERFORMANCE2(filter, p, test_generate_key_derivation_batch, GE_BATCH_BACKEND_AVX2, 64);
   TEST_PERFORMANCE0(filter, p, test_generate_key_image);
   TEST_PERFORMANCE0(filter, p, test_derive_public_key);
   TEST_PERFORMANCE0(filter, p, test_derive_secret_key);
@@ -190,8 +237,54 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(filter, p, test_wallet2_expand_subaddresses, 50, 200);
 
   TEST_PERFORMANCE0(filter, p, test_cn_slow_hash);
+  TEST_PERFORMANCE2(filter, p, test_cn_slow_hash_multi, 1, 2);
+  TEST_PERFORMANCE2(filter, p, test_cn_slow_hash_multi, 2, 2);
+  TEST_PERFORMANCE2(filter, p, test_cn_slow_hash_multi, 3, 2);
+  TEST_PERFORMANCE2(filter, p, test_cn_slow_hash_multi, 4, 2);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 16384);
+  TEST_PERFORMANCE2(filter, p, test_cn_fast_hash_multi, KECCAK_BACKEND_PORTABLE, 64);
+  TEST_PERFORMANCE2(filter, p, test_cn_fast_hash_multi, KECCAK_BACKEND_AVX2, 64);
+  TEST_PERFORMANCE2(filter, p, test_cn_fast_hash_multi, KECCAK_BACKEND_PORTABLE, 1024);
+  TEST_PERFORMANCE2(filter, p, test_cn_fast_hash_multi, KECCAK_BACKEND_AVX2, 1024);
+
+  TEST_PERFORMANCE1(filter, p, test_to_hex, 32);
+  TEST_PERFORMANCE1(filter, p, test_to_hex, 16384);
+  TEST_PERFORMANCE1(filter, p, test_from_hex, 32);
+  TEST_PERFORMANCE1(filter, p, test_from_hex, 16384);
+
+  TEST_PERFORMANCE2(filter, p, test_portable_storage_store, 20, false);
+  TEST_PERFORMANCE2(filter, p, test_portable_storage_store, 20, true);
+  TEST_PERFORMANCE2(filter, p, test_portable_storage_store, 1000, false);
+  TEST_PERFORMANCE2(filter, p, test_portable_storage_store, 1000, true);
+  TEST_PERFORMANCE1(filter, p, test_portable_storage_load, 20);
+  TEST_PERFORMANCE1(filter, p, test_portable_storage_load, 1000);
+
+  TEST_PERFORMANCE3(filter, p, test_parse_tx, 2, 2, rct::RangeProofBorromean);
+  TEST_PERFORMANCE3(filter, p, test_parse_tx, 10, 2, rct::RangeProofBorromean);
+  TEST_PERFORMANCE3(filter, p, test_parse_tx, 2, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_parse_tx, 10, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_parse_tx, 10, 16, rct::RangeProofPaddedBulletproof);
+
+  TEST_PERFORMANCE3(filter, p, test_tx_to_json, 2, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_tx_to_json, 10, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_tx_to_json, 10, 16, rct::RangeProofPaddedBulletproof);
+
+  TEST_PERFORMANCE1(filter, p, test_lmdb_output_lookup, false);
+  TEST_PERFORMANCE1(filter, p, test_lmdb_output_lookup, true);
+
+  TEST_PERFORMANCE1(filter, p, test_txpool_key_image_lookup, false);
+  TEST_PERFORMANCE1(filter, p, test_txpool_key_image_lookup, true);
+  TEST_PERFORMANCE1(filter, p, test_txpool_sorted_lookup, false);
+  TEST_PERFORMANCE1(filter, p, test_txpool_sorted_lookup, true);
+
+  // run with --threads to compare scanning rates by thread count
+  TEST_PERFORMANCE2(filter, p, test_wallet_refresh, 2, 0);
+  TEST_PERFORMANCE2(filter, p, test_wallet_refresh, 16, 0);
+  TEST_PERFORMANCE2(filter, p, test_wallet_refresh, 2, 1);
+  TEST_PERFORMANCE2(filter, p, test_wallet_refresh, 16, 1);
+  TEST_PERFORMANCE2(filter, p, test_wallet_refresh, 2, 2);
+  TEST_PERFORMANCE2(filter, p, test_wallet_refresh, 16, 16);
 
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 3, false);
   TEST_PERFORMANCE3(filter, p, test_ringct_mlsag, 1, 5, false);
@@ -248,6 +341,9 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmultBase);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmultKey);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmultH);
+  TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_addKeysGH);
+  TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_commit);
+  TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_zeroCommit);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_scalarmult8);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_double_scalarmult_base_vartime);
   TEST_PERFORMANCE1(filter, p, test_crypto_ops, op_ge_double_scalarmult_precomp_vartime);
@@ -296,6 +392,11 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE2(filter, p, test_multiexp, multiexp_straus_cached, 2048);
   TEST_PERFORMANCE2(filter, p, test_multiexp, multiexp_straus_cached, 4096);
 
+  TEST_PERFORMANCE2(filter, p, test_multiexp, multiexp_auto_cached, 2);
+  TEST_PERFORMANCE2(filter, p, test_multiexp, multiexp_auto_cached, 16);
+  TEST_PERFORMANCE2(filter, p, test_multiexp, multiexp_auto_cached, 128);
+  TEST_PERFORMANCE2(filter, p, test_multiexp, multiexp_auto_cached, 1024);
+
 #if 1
   TEST_PERFORMANCE3(filter, p, test_multiexp, multiexp_pippenger, 2, 1);
   TEST_PERFORMANCE3(filter, p, test_multiexp, multiexp_pippenger, 4, 2);
@@ -543,6 +644,14 @@ int main(int argc, char** argv)
 
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
+  if (!output.empty() && !write_performance_results(output, results))
+  {
+    std::cerr << "Failed to write results to " << output << std::endl;
+    return 1;
+  }
+  if (!baseline_file.empty() && compare_performance_results(results, baseline, command_line::get_arg(vm, arg_regression_threshold)))
+    return 2;
+
   return 0;
   CATCH_ENTRY_L0("main", 1);
 }
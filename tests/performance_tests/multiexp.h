@@ -41,6 +41,7 @@ enum test_multiexp_algorithm
   multiexp_straus_cached,
   multiexp_pippenger,
   multiexp_pippenger_cached,
+  multiexp_auto_cached,
 };
 
 template<test_multiexp_algorithm algorithm, size_t npoints, size_t c=0>
@@ -81,6 +82,8 @@ public:
         return res == pippenger(data, NULL, c);
       case multiexp_pippenger_cached:
         return res == pippenger(data, pippenger_cache, c);
+      case multiexp_auto_cached:
+        return res == multiexp(data, straus_cache, pippenger_cache);
       default:
         return false;
     }
@@ -0,0 +1,162 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "version.h"
+
+// Results in CSV, one line per test after "#" lines describing the build
+// and machine, so runs can be kept and compared with --baseline.
+struct performance_result
+{
+  std::string name;
+  uint64_t calls;
+  uint64_t elapsed_ms;
+  uint64_t mean_ns;
+  uint64_t min_ns;
+  uint64_t median_ns;
+  uint64_t stddev_ns;
+  uint64_t max_ns;
+};
+
+inline std::string get_compiler_description()
+{
+#if defined(__clang__)
+  std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+  std::string compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+  std::string compiler = "msvc " + std::to_string(_MSC_VER);
+#else
+  std::string compiler = "unknown";
+#endif
+#ifdef NDEBUG
+  compiler += ", NDEBUG";
+#endif
+  return compiler;
+}
+
+// model and current clock of the first CPU, where the OS tells
+inline std::string get_cpu_description()
+{
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  std::string line, model, mhz;
+  while (std::getline(cpuinfo, line) && (model.empty() || mhz.empty()))
+  {
+    const size_t colon = line.find(':');
+    if (colon == std::string::npos || colon + 2 > line.size())
+      continue;
+    if (model.empty() && line.compare(0, 10, "model name") == 0)
+      model = line.substr(colon + 2);
+    else if (mhz.empty() && line.compare(0, 7, "cpu MHz") == 0)
+      mhz = line.substr(colon + 2);
+  }
+  if (model.empty())
+    return "unknown";
+  return mhz.empty() ? model : model + " @ " + mhz + " MHz";
+}
+
+inline bool write_performance_results(const std::string &path, const std::vector<performance_result> &results)
+{
+  std::ofstream out(path);
+  if (!out.is_open())
+    return false;
+  const time_t now = time(NULL);
+  char date[32];
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", gmtime(&now));
+  out << "# version: " << MONERO_VERSION_FULL << "\n";
+  out << "# compiler: " << get_compiler_description() << "\n";
+  out << "# cpu: " << get_cpu_description() << "\n";
+  out << "# date: " << date << " UTC\n";
+  out << "test,calls,elapsed_ms,mean_ns,min_ns,median_ns,stddev_ns,max_ns\n";
+  for (const performance_result &r: results)
+  {
+    // test names have commas in their template arguments
+    out << "\"" << r.name << "\"," << r.calls << "," << r.elapsed_ms << "," << r.mean_ns << "," << r.min_ns
+        << "," << r.median_ns << "," << r.stddev_ns << "," << r.max_ns << "\n";
+  }
+  return out.good();
+}
+
+inline bool read_performance_results(const std::string &path, std::map<std::string, performance_result> &results)
+{
+  std::ifstream in(path);
+  if (!in.is_open())
+    return false;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    if (line.empty() || line[0] != '"')
+      continue;
+    const size_t end = line.find('"', 1);
+    if (end == std::string::npos || end + 1 >= line.size() || line[end + 1] != ',')
+      return false;
+    performance_result r;
+    r.name = line.substr(1, end - 1);
+    std::istringstream ss(line.substr(end + 2));
+    char c0, c1, c2, c3, c4, c5;
+    if (!(ss >> r.calls >> c0 >> r.elapsed_ms >> c1 >> r.mean_ns >> c2 >> r.min_ns >> c3 >> r.median_ns >> c4 >> r.stddev_ns >> c5 >> r.max_ns))
+      return false;
+    results[r.name] = r;
+  }
+  return true;
+}
+
+// Compares medians, which are less sensitive to the odd preempted call
+// than the mean. Returns the number of tests slower than the baseline by
+// more than threshold percent.
+inline size_t compare_performance_results(const std::vector<performance_result> &results, const std::map<std::string, performance_result> &baseline, double threshold)
+{
+  size_t regressions = 0;
+  std::cout << "\nComparison with baseline (median per call):" << std::endl;
+  for (const performance_result &r: results)
+  {
+    const auto i = baseline.find(r.name);
+    if (i == baseline.end() || i->second.median_ns == 0)
+    {
+      std::cout << "  " << r.name << ": no baseline" << std::endl;
+      continue;
+    }
+    const double change = (r.median_ns / (double)i->second.median_ns - 1.0) * 100.0;
+    const bool regressed = change > threshold;
+    regressions += regressed;
+    std::cout << "  " << r.name << ": " << i->second.median_ns << " -> " << r.median_ns << " ns ("
+        << std::showpos << std::fixed << std::setprecision(1) << change << "%" << std::noshowpos << ")"
+        << (regressed ? " REGRESSION" : "") << std::endl;
+  }
+  return regressions;
+}
@@ -38,6 +38,7 @@
 
 #include "misc_language.h"
 #include "common/perf_timer.h"
+#include "performance_results.h"
 
 class performance_timer
 {
@@ -70,6 +71,7 @@ struct Params
   bool verbose;
   bool stats;
   unsigned loop_multiplier;
+  std::vector<performance_result> *results;
 };
 
 template <typename T>
@@ -166,6 +168,7 @@ public:
     return sqrt(acc);
   }
 
+  uint64_t mean_time_ns() const { return tools::ticks_to_ns(per_call_mean()); }
   uint64_t min_time_ns() const { return tools::ticks_to_ns(per_call_min()); }
   uint64_t max_time_ns() const { return tools::ticks_to_ns(per_call_max()); }
   uint64_t median_time_ns() const { return tools::ticks_to_ns(per_call_median()); }
@@ -193,6 +196,34 @@ private:
   std::vector<tools::PerformanceTimer> m_per_call_timers;
 };
 
+// tests with a hashes_per_call member also report their hash rate
+template <typename T>
+auto print_hash_rate(const test_runner<T> &runner, const Params &params, int) -> decltype(T::hashes_per_call, void())
+{
+  const uint64_t hashes = T::loop_count * params.loop_multiplier * T::hashes_per_call;
+  const int elapsed = std::max(runner.elapsed_time(), 1);
+  std::cout << (params.verbose ? "  hash rate:     " : ", ") << hashes * 1000 / elapsed << " H/s" << (params.verbose ? "\n" : "");
+}
+
+template <typename T>
+void print_hash_rate(const test_runner<T> &runner, const Params &params, long)
+{
+}
+
+// and tests with an outputs_per_call member their output scanning rate
+template <typename T>
+auto print_output_rate(const test_runner<T> &runner, const Params &params, int) -> decltype(T::outputs_per_call, void())
+{
+  const uint64_t outputs = T::loop_count * params.loop_multiplier * T::outputs_per_call;
+  const int elapsed = std::max(runner.elapsed_time(), 1);
+  std::cout << (params.verbose ? "  output rate:   " : ", ") << outputs * 1000 / elapsed << " outputs/s" << (params.verbose ? "\n" : "");
+}
+
+template <typename T>
+void print_output_rate(const test_runner<T> &runner, const Params &params, long)
+{
+}
+
 template <typename T>
 void run_test(const std::string &filter, const Params &params, const char* test_name)
 {
@@ -233,6 +264,8 @@ void run_test(const std::string &filter, const Params &params, const char* test_
      scale = 1000;
     }
     std::cout << (params.verbose ? "  time per call: " : " ") << time_per_call << " " << unit << "/call" << (params.verbose ? "\n" : "");
+    print_hash_rate(runner, params, 0);
+    print_output_rate(runner, params, 0);
     if (params.stats)
     {
       uint64_t min_ns = runner.min_time_ns() / scale;
@@ -241,6 +274,11 @@ void run_test(const std::string &filter, const Params &params, const char* test_
       std::cout << " (min " << min_ns << " " << unit << ", median " << med_ns << " " << unit << ", std dev " << stddev_ns << " " << unit << ")";
     }
     std::cout << std::endl;
+    if (params.results)
+    {
+      params.results->push_back({test_name, T::loop_count * params.loop_multiplier, (uint64_t)runner.elapsed_time(), runner.mean_time_ns(),
+          runner.min_time_ns(), runner.median_time_ns(), runner.standard_deviation_time_ns(), runner.max_time_ns()});
+    }
   }
   else
   {
@@ -0,0 +1,103 @@
+// Copyright (c) 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+// Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
+
+#pragma once
+
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// a NOTIFY_RESPONSE_GET_OBJECTS as sent while syncing: small block blobs,
+// a few ringct sized tx blobs per block
+template<size_t blocks, bool stream_writer>
+class test_portable_storage_store
+{
+public:
+  static const size_t loop_count = blocks < 100 ? 1000 : 50;
+
+  bool init()
+  {
+    m_request.current_blockchain_height = 1000000;
+    for (size_t i = 0; i < blocks; ++i)
+    {
+      cryptonote::block_complete_entry bce;
+      bce.block.resize(150 + 32 * (i % 4));
+      crypto::rand(bce.block.size(), (uint8_t*)&bce.block[0]);
+      for (size_t t = 0; t < i % 4; ++t)
+      {
+        std::string tx(1500 + 1000 * t, 0);
+        crypto::rand(tx.size(), (uint8_t*)&tx[0]);
+        bce.txs.push_back(tx);
+      }
+      m_request.blocks.push_back(bce);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    std::string blob;
+    return store(blob);
+  }
+
+  bool store(std::string& blob) const
+  {
+    if (stream_writer)
+      return epee::serialization::store_t_to_binary(m_request, blob);
+    epee::serialization::portable_storage ps;
+    m_request.store(ps);
+    return ps.store_to_binary(blob);
+  }
+
+private:
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request m_request;
+};
+
+template<size_t blocks>
+class test_portable_storage_load
+{
+public:
+  static const size_t loop_count = blocks < 100 ? 1000 : 50;
+
+  bool init()
+  {
+    test_portable_storage_store<blocks, true> store;
+    return store.init() && store.store(m_blob);
+  }
+
+  bool test()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request request;
+    return epee::serialization::load_t_from_binary(request, m_blob);
+  }
+
+private:
+  std::string m_blob;
+};
@@ -0,0 +1,127 @@
+// Copyright (c) 2014-2018, The Monero Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include "crypto/crypto.h"
+#include "common/flat_hash_map.h"
+#include "cryptonote_core/tx_pool.h"
+
+// Key image lookups against a 50k tx pool index, as done for each input of
+// an incoming tx: the node based map of sets, and the flat table.
+template<bool flat>
+class test_txpool_key_image_lookup
+{
+public:
+  static const size_t loop_count = 10000;
+  static const size_t num_txes = 50000;
+  static const size_t inputs_per_tx = 2;
+  static const size_t lookups = 16;
+
+  bool init()
+  {
+    for (size_t i = 0; i < num_txes; ++i)
+    {
+      const crypto::hash txid = crypto::rand<crypto::hash>();
+      for (size_t j = 0; j < inputs_per_tx; ++j)
+      {
+        const crypto::key_image ki = crypto::rand<crypto::key_image>();
+        if (flat)
+          m_flat[ki].push_back(txid);
+        else
+          m_nodes[ki].insert(txid);
+        // half the lookups are for spent key images
+        if (m_queries.size() < lookups * 64 && j == 0)
+        {
+          m_queries.push_back(ki);
+          m_queries.push_back(crypto::rand<crypto::key_image>());
+        }
+      }
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    size_t found = 0;
+    for (size_t i = 0; i < lookups; ++i)
+    {
+      const crypto::key_image &ki = m_queries[m_pos++ % m_queries.size()];
+      found += flat ? m_flat.count(ki) : m_nodes.count(ki);
+    }
+    return found == lookups / 2;
+  }
+
+private:
+  std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash>> m_nodes;
+  tools::flat_hash_map<crypto::key_image, std::vector<crypto::hash>> m_flat;
+  std::vector<crypto::key_image> m_queries;
+  size_t m_pos = 0;
+};
+
+// Finding a tx in a 50k tx fee ordered container by walking it, and by the
+// key it was sorted by.
+template<bool keyed>
+class test_txpool_sorted_lookup
+{
+public:
+  static const size_t loop_count = keyed ? 100000 : 100;
+  static const size_t num_txes = 50000;
+
+  bool init()
+  {
+    for (size_t i = 0; i < num_txes; ++i)
+    {
+      const double fee_per_byte = (crypto::rand<uint64_t>() % 100000) / 10.0;
+      const std::time_t receive_time = 1500000000 + crypto::rand<uint32_t>() % 3600;
+      const cryptonote::tx_by_fee_and_receive_time_entry e(std::make_pair(fee_per_byte, receive_time), crypto::rand<crypto::hash>());
+      m_sorted.insert(e);
+      m_entries.push_back(e);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    const cryptonote::tx_by_fee_and_receive_time_entry &e = m_entries[m_pos++ % m_entries.size()];
+    cryptonote::sorted_tx_container::const_iterator it;
+    if (keyed)
+      it = m_sorted.find(e);
+    else
+      it = std::find_if(m_sorted.begin(), m_sorted.end(), [&e](const cryptonote::tx_by_fee_and_receive_time_entry &a) { return a.second == e.second; });
+    return it != m_sorted.end() && it->second == e.second;
+  }
+
+private:
+  cryptonote::sorted_tx_container m_sorted;
+  std::vector<cryptonote::tx_by_fee_and_receive_time_entry> m_entries;
+  size_t m_pos = 0;
+};
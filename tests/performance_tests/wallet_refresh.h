@@ -0,0 +1,161 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <ctime>
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_basic.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "wallet/wallet2.h"
+
+#include "multi_tx_test_base.h"
+
+// Scans a span of synthetic blocks full of RCT transactions with the
+// wallet's refresh path (prepare_tx_cache_data, then process_parsed_blocks),
+// and detaches them again so every call does the same work.
+// a_subaddresses is 0 for outputs to the main address, 1 for outputs to a
+// single subaddress, and more to spread the outputs of each tx over that
+// many subaddresses, which gives them additional tx pubkeys. One tx in
+// four pays the wallet, the others pay a stranger with the same layout.
+template<size_t a_out_count, size_t a_subaddresses>
+class test_wallet_refresh : private multi_tx_test_base<2>
+{
+  static_assert(0 < a_out_count && a_out_count <= BULLETPROOF_MAX_OUTPUTS, "out_count must be between 1 and BULLETPROOF_MAX_OUTPUTS");
+
+public:
+  static const size_t num_blocks = 4;
+  static const size_t txes_per_block = 8;
+  static const size_t loop_count = 10;
+  // the coinbase contributes one scanned output per block
+  static const size_t outputs_per_call = num_blocks * (txes_per_block * a_out_count + 1);
+
+  typedef multi_tx_test_base<2> base_class;
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    if (!base_class::init())
+      return false;
+
+    m_wallet = make_wallet();
+    m_stranger = make_wallet();
+
+    const std::vector<tx_destination_entry> ours = make_destinations(true);
+    const std::vector<tx_destination_entry> theirs = make_destinations(false);
+    const std::unordered_map<crypto::public_key, subaddress_index> subaddresses = {{this->m_miners[this->real_source_idx].get_keys().m_account_address.m_spend_public_key, {0, 0}}};
+    uint64_t global_index = 0;
+    for (size_t b = 0; b < num_blocks; ++b)
+    {
+      tools::wallet2::parsed_block pb;
+      pb.error = false;
+      pb.block.major_version = 1;
+      pb.block.minor_version = 0;
+      pb.block.timestamp = time(NULL);
+      if (!construct_miner_tx(b + 1, 0, 0, 2, 0, m_stranger->get_address(), pb.block.miner_tx))
+        return false;
+      add_output_indices(pb, pb.block.miner_tx, global_index);
+      for (size_t t = 0; t < txes_per_block; ++t)
+      {
+        std::vector<tx_destination_entry> destinations = t % 4 ? theirs : ours;
+        std::vector<tx_source_entry> sources = this->m_sources;
+        crypto::secret_key tx_key;
+        std::vector<crypto::secret_key> additional_tx_keys;
+        transaction tx;
+        if (!construct_tx_and_get_tx_key(this->m_miners[this->real_source_idx].get_keys(), subaddresses, sources, destinations, boost::none, std::vector<uint8_t>(), tx, 0, tx_key, additional_tx_keys, true, rct::RangeProofPaddedBulletproof))
+          return false;
+        pb.block.tx_hashes.push_back(get_transaction_hash(tx));
+        pb.txes.push_back(tx);
+        add_output_indices(pb, tx, global_index);
+      }
+      pb.hash = get_block_hash(pb.block);
+
+      block_complete_entry bce;
+      bce.block = block_to_blob(pb.block);
+      for (const auto &tx: pb.txes)
+        bce.txs.push_back(tx_to_blob(tx));
+      m_blocks.push_back(std::move(bce));
+      m_parsed_blocks.push_back(std::move(pb));
+    }
+
+    return true;
+  }
+
+  bool test()
+  {
+    std::vector<tools::wallet2::tx_cache_data> tx_cache_data;
+    uint64_t blocks_added = 0;
+    m_wallet->prepare_tx_cache_data(m_parsed_blocks, tx_cache_data);
+    m_wallet->process_parsed_blocks(1, m_blocks, m_parsed_blocks, tx_cache_data, blocks_added);
+    if (blocks_added != num_blocks)
+      return false;
+    const bool received = m_wallet->m_transfers.size() == num_blocks * (txes_per_block / 4) * a_out_count;
+    m_wallet->detach_blockchain(1);
+    return received;
+  }
+
+private:
+  static std::unique_ptr<tools::wallet2> make_wallet()
+  {
+    std::unique_ptr<tools::wallet2> wallet(new tools::wallet2(cryptonote::MAINNET, 1, true));
+    crypto::secret_key recovery_key;
+    crypto::public_key pub;
+    crypto::generate_keys(pub, recovery_key);
+    // as a restore, so the refresh height is not estimated from a daemon
+    wallet->generate("", "", recovery_key, true, false, false);
+    wallet->set_refresh_from_block_height(0);
+    return wallet;
+  }
+
+  std::vector<cryptonote::tx_destination_entry> make_destinations(bool ours) const
+  {
+    const tools::wallet2 &wallet = ours ? *m_wallet : *m_stranger;
+    const bool is_subaddress = a_subaddresses > 0;
+    std::vector<cryptonote::tx_destination_entry> destinations;
+    for (size_t i = 0; i < a_out_count; ++i)
+    {
+      const cryptonote::account_public_address address = wallet.get_subaddress({0, is_subaddress ? (uint32_t)(1 + i % a_subaddresses) : 0});
+      destinations.push_back(cryptonote::tx_destination_entry(this->m_source_amount / (a_out_count + 1), address, is_subaddress));
+    }
+    return destinations;
+  }
+
+  static void add_output_indices(tools::wallet2::parsed_block &pb, const cryptonote::transaction &tx, uint64_t &global_index)
+  {
+    pb.o_indices.indices.push_back({});
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+      pb.o_indices.indices.back().indices.push_back(global_index++);
+  }
+
+  std::unique_ptr<tools::wallet2> m_wallet;
+  std::unique_ptr<tools::wallet2> m_stranger;
+  std::vector<cryptonote::block_complete_entry> m_blocks;
+  std::vector<tools::wallet2::parsed_block> m_parsed_blocks;
+};
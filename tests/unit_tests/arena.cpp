@@ -0,0 +1,101 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "common/arena.h"
+
+TEST(arena, alignment)
+{
+  tools::arena a(64);
+  for (size_t align: {1, 2, 4, 8, 16, 32})
+  {
+    a.allocate(1, 1);
+    void *p = a.allocate(24, align);
+    ASSERT_EQ((uintptr_t)p % align, 0);
+  }
+}
+
+TEST(arena, large_allocation)
+{
+  tools::arena a(64);
+  char *p = (char*)a.allocate(1000, 1);
+  memset(p, 0x55, 1000);
+  ASSERT_GE(a.reserved(), 1000);
+  char *q = (char*)a.allocate(16, 1);
+  ASSERT_TRUE(q + 16 <= p || q >= p + 1000);
+}
+
+TEST(arena, release_keeps_one_block)
+{
+  tools::arena a(64, 1 << 20);
+  for (int i = 0; i < 100; ++i)
+    a.allocate(48, 8);
+  const size_t reserved = a.reserved();
+  a.release();
+  ASSERT_EQ(a.reserved(), reserved);
+  // the merged block holds the same load again without growing
+  for (int i = 0; i < 100; ++i)
+    a.allocate(48, 8);
+  ASSERT_EQ(a.reserved(), reserved);
+}
+
+TEST(arena, release_over_limit)
+{
+  tools::arena a(64, 256);
+  a.allocate(1000, 1);
+  a.release();
+  ASSERT_EQ(a.reserved(), 0);
+}
+
+TEST(arena, containers)
+{
+  tools::arena a;
+  typedef std::vector<uint64_t, tools::arena_allocator<uint64_t>> vector_t;
+  typedef std::map<uint64_t, vector_t, std::less<uint64_t>, tools::arena_allocator<std::pair<const uint64_t, vector_t>>> map_t;
+  map_t m{map_t::allocator_type(a)};
+  for (uint64_t i = 0; i < 100; ++i)
+  {
+    vector_t v{vector_t::allocator_type(a)};
+    for (uint64_t j = 0; j < i; ++j)
+      v.push_back(j);
+    m.emplace(i, std::move(v));
+  }
+  ASSERT_EQ(m.size(), 100);
+  for (const auto &e: m)
+  {
+    ASSERT_EQ(e.second.size(), e.first);
+    for (uint64_t j = 0; j < e.first; ++j)
+      ASSERT_EQ(e.second[j], j);
+  }
+  ASSERT_GT(a.reserved(), 0);
+  m.clear();
+  a.release();
+}
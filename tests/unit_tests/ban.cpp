@@ -57,15 +57,18 @@ public:
   bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
   bool handle_incoming_txs(const std::vector<cryptonote::blobdata>& tx_blob, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
   bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
+  bool handle_incoming_block(const cryptonote::blobdata& block_blob, const cryptonote::block *b, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
   void pause_mine(){}
   void resume_mine(){}
   bool on_idle(){return true;}
-  bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
-  bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+  bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp, size_t max_headers = 0){return true;}
+  bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, std::string& rsp_blob, cryptonote::cryptonote_connection_context& context){return true;}
   cryptonote::blockchain_storage &get_blockchain_storage() { throw std::runtime_error("Called invalid member function: please never call get_blockchain_storage on the TESTING class test_core."); }
   bool get_test_drop_download() const {return true;}
   bool get_test_drop_download_height() const {return true;}
   bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks) { return true; }
+  bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::block> &parsed_blocks) { parsed_blocks.clear(); return true; }
+  void prefetch_block_longhashes(const std::vector<cryptonote::block_complete_entry> &blocks, uint64_t start_height) {}
   bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
   uint64_t get_target_blockchain_height() const { return 1; }
   size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
@@ -82,7 +85,9 @@ public:
   uint64_t get_earliest_ideal_height_for_version(uint8_t version) const { return 0; }
   cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
   bool fluffy_blocks_enabled() const { return false; }
+  uint32_t get_blockchain_pruning_seed() const { return 0; }
   uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes) { return 0; }
+  bool verify_block_headers(uint64_t height, const std::vector<crypto::hash> &hashes, const std::vector<cryptonote::blobdata> &headers) { return true; }
   void stop() {}
 };
 
@@ -189,5 +194,65 @@ TEST(ban, add)
   ASSERT_TRUE(t >= 4);
 }
 
+TEST(ban, subnet)
+{
+  test_core pr_core;
+  cryptonote::t_cryptonote_protocol_handler<test_core> cprotocol(pr_core, NULL);
+  Server server(cprotocol);
+  cprotocol.set_p2p_endpoint(&server);
+
+  uint32_t ip;
+  uint8_t bits;
+  ASSERT_TRUE(nodetool::ban_list::parse_subnet("1.2.3.4/24", ip, bits));
+  ASSERT_EQ(bits, 24);
+  ASSERT_TRUE(server.get_blocked_subnets().empty());
+  ASSERT_TRUE(server.block_subnet(ip, bits, 10));
+  ASSERT_TRUE(server.get_blocked_hosts().empty());
+
+  std::map<std::string, time_t> subnets = server.get_blocked_subnets();
+  ASSERT_EQ(subnets.size(), 1);
+  ASSERT_EQ(subnets.begin()->first, "1.2.3.0/24");
+
+  // the whole range is refused, its neighbours are not
+  nodetool::ban_list bans;
+  ASSERT_TRUE(bans.ban_subnet(ip, bits, time(NULL) + 10));
+  ASSERT_TRUE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,3,0), time(NULL)));
+  ASSERT_TRUE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,3,127), time(NULL)));
+  ASSERT_FALSE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,4,0), time(NULL)));
+  ASSERT_FALSE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,2,127), time(NULL)));
+
+  // a host ban inside the subnet outlives the subnet ban
+  ASSERT_TRUE(server.block_host(MAKE_IPV4_ADDRESS(1,2,3,7), 20));
+  bans.ban_host(MAKE_IPV4_ADDRESS(1,2,3,7), time(NULL) + 20);
+  ASSERT_TRUE(bans.unban_subnet(ip, bits));
+  ASSERT_FALSE(bans.unban_subnet(ip, bits));
+  ASSERT_TRUE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,3,7), time(NULL)));
+  ASSERT_FALSE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,3,8), time(NULL)));
+
+  // expiry is checked against the time given
+  ASSERT_FALSE(bans.is_banned(MAKE_IPV4_ADDRESS(1,2,3,7), time(NULL) + 21));
+
+  ASSERT_TRUE(server.unblock_subnet(ip, bits));
+  ASSERT_FALSE(server.unblock_subnet(ip, bits));
+  ASSERT_TRUE(server.get_blocked_subnets().empty());
+  ASSERT_EQ(server.get_blocked_hosts().size(), 1);
+}
+
+TEST(ban, parse_subnet)
+{
+  uint32_t ip;
+  uint8_t bits;
+  ASSERT_TRUE(nodetool::ban_list::parse_subnet("10.0.0.0/8", ip, bits));
+  ASSERT_EQ(ip, MAKE_IP(10,0,0,0));
+  ASSERT_EQ(bits, 8);
+  ASSERT_TRUE(nodetool::ban_list::parse_subnet("10.1.2.3/32", ip, bits));
+  ASSERT_EQ(bits, 32);
+  ASSERT_FALSE(nodetool::ban_list::parse_subnet("10.0.0.0", ip, bits));
+  ASSERT_FALSE(nodetool::ban_list::parse_subnet("10.0.0.0/", ip, bits));
+  ASSERT_FALSE(nodetool::ban_list::parse_subnet("10.0.0.0/0", ip, bits));
+  ASSERT_FALSE(nodetool::ban_list::parse_subnet("10.0.0.0/33", ip, bits));
+  ASSERT_FALSE(nodetool::ban_list::parse_subnet("10.0.0.0/8x", ip, bits));
+}
+
 namespace nodetool { template class node_server<cryptonote::t_cryptonote_protocol_handler<test_core>>; }
 namespace cryptonote { template class t_cryptonote_protocol_handler<test_core>; }
@@ -85,3 +85,57 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, span_size_follows_throughput)
+{
+  cryptonote::block_queue bq;
+  const boost::uuids::uuid uuid3 = crypto::rand<boost::uuids::uuid>();
+
+  // unmeasured peers get full spans
+  ASSERT_EQ(bq.get_span_size(uuid1(), 5, 40, 3.0f), 40);
+  ASSERT_EQ(bq.get_expected_download_time(uuid1(), 10), 0);
+
+  // 1000 byte blocks, a fast and a slow peer
+  bq.add_blocks(0, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 100000.0f, 10000);
+  bq.add_blocks(10, std::vector<cryptonote::block_complete_entry>(10), uuid2(), 1000.0f, 10000);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 5, 40, 3.0f), 40);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 5, 40, 3.0f), 5);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 1, 40, 3.0f), 3);
+  ASSERT_EQ(bq.get_span_size(uuid3, 5, 40, 3.0f), 40);
+  ASSERT_EQ(bq.get_expected_download_time(uuid2(), 10), 10000000);
+
+  // requested but not yet received blocks are estimated at the average size
+  ASSERT_EQ(bq.get_inflight_size(), 0);
+  bq.add_blocks(20, 20, uuid1());
+  ASSERT_EQ(bq.get_inflight_size(), 20000);
+
+  // measurements go away with the peer
+  std::set<boost::uuids::uuid> live;
+  live.insert(uuid1());
+  bq.flush_stale_spans(live);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 5, 40, 3.0f), 40);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 5, 40, 3.0f), 40);
+}
+
+TEST(block_queue, data_size_tracks_spans)
+{
+  cryptonote::block_queue bq;
+  ASSERT_EQ(bq.get_data_size(), 0);
+
+  // scheduled spans hold no data until filled
+  bq.add_blocks(0, 10, uuid1());
+  ASSERT_EQ(bq.get_data_size(), 0);
+  bq.add_blocks(0, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 1000.0f, 10000);
+  ASSERT_EQ(bq.get_data_size(), 10000);
+  bq.add_blocks(10, std::vector<cryptonote::block_complete_entry>(5), uuid2(), 1000.0f, 2500);
+  ASSERT_EQ(bq.get_data_size(), 12500);
+
+  // spans are reinserted when their hashes are set
+  bq.set_span_hashes(10, uuid2(), std::vector<crypto::hash>(5, crypto::null_hash));
+  ASSERT_EQ(bq.get_data_size(), 12500);
+
+  ASSERT_TRUE(bq.remove_span(0));
+  ASSERT_EQ(bq.get_data_size(), 2500);
+  bq.flush_spans(uuid2(), true);
+  ASSERT_EQ(bq.get_data_size(), 0);
+}
@@ -0,0 +1,149 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/block_tracer.h"
+
+using cryptonote::block_trace;
+using cryptonote::block_trace_scope;
+using cryptonote::block_tracer;
+
+namespace
+{
+  crypto::hash make_hash(uint64_t n)
+  {
+    crypto::hash h = crypto::null_hash;
+    memcpy(&h, &n, sizeof(n));
+    return h;
+  }
+
+  block_trace make_trace(uint64_t height, const std::vector<uint64_t> &tx_durations)
+  {
+    block_trace trace;
+    trace.height = height;
+    trace.id = make_hash(height);
+    trace.timestamp_us = 1000000 * height;
+    trace.duration_us = 100;
+    trace.added = true;
+    trace.phases.push_back({"pow", 0, 60});
+    trace.phases.push_back({"txs", 60, 40});
+    for (uint64_t d: tx_durations)
+      trace.txs.push_back({make_hash(d), 60, d, 1, 2});
+    return trace;
+  }
+}
+
+TEST(block_tracer, off_by_default)
+{
+  block_tracer tracer;
+  ASSERT_FALSE(tracer.enabled());
+  tracer.add(make_trace(1, {}));
+  ASSERT_TRUE(tracer.get_traces().empty());
+
+  {
+    block_trace_scope trace(tracer, 2, make_hash(2));
+    ASSERT_EQ(0, block_trace_scope::now_us());
+    trace.lap("pow");
+  }
+  ASSERT_TRUE(tracer.get_traces().empty());
+}
+
+TEST(block_tracer, keeps_last_blocks_and_slowest_txs)
+{
+  block_tracer tracer;
+  tracer.set_max_blocks(2);
+  tracer.set_max_txs(2);
+  tracer.add(make_trace(1, {5}));
+  tracer.add(make_trace(2, {3, 9, 1, 7}));
+  tracer.add(make_trace(3, {}));
+
+  std::vector<block_trace> traces = tracer.get_traces();
+  ASSERT_EQ(2, traces.size());
+  ASSERT_EQ(2, traces[0].height);
+  ASSERT_EQ(3, traces[1].height);
+  ASSERT_EQ(2, traces[0].txs.size());
+  ASSERT_EQ(9, traces[0].txs[0].duration_us);
+  ASSERT_EQ(7, traces[0].txs[1].duration_us);
+
+  tracer.set_max_blocks(1);
+  traces = tracer.get_traces();
+  ASSERT_EQ(1, traces.size());
+  ASSERT_EQ(3, traces[0].height);
+
+  tracer.set_max_blocks(0);
+  ASSERT_TRUE(tracer.get_traces().empty());
+}
+
+TEST(block_tracer, scope)
+{
+  block_tracer tracer;
+  tracer.set_max_blocks(10);
+  {
+    block_trace_scope trace(tracer, 5, make_hash(5));
+    trace.lap("pow");
+    trace.begin_tx(make_hash(50));
+    trace.tx_taken_from_pool();
+    const uint64_t start = block_trace_scope::now_us();
+    ASSERT_NE(0, start);
+    block_trace_scope::add_ring_members_time(start);
+    trace.end_tx();
+    trace.lap("txs");
+    trace.set_added();
+
+    // a block handled inside another is not traced on its own
+    block_trace_scope nested(tracer, 6, make_hash(6));
+    nested.lap("pow");
+  }
+  ASSERT_EQ(0, block_trace_scope::now_us());
+
+  const std::vector<block_trace> traces = tracer.get_traces();
+  ASSERT_EQ(1, traces.size());
+  const block_trace &b = traces[0];
+  ASSERT_EQ(5, b.height);
+  ASSERT_TRUE(b.id == make_hash(5));
+  ASSERT_TRUE(b.added);
+  ASSERT_EQ(2, b.phases.size());
+  ASSERT_EQ("pow", b.phases[0].name);
+  ASSERT_EQ("txs", b.phases[1].name);
+  ASSERT_EQ(b.phases[0].start_us + b.phases[0].duration_us, b.phases[1].start_us);
+  ASSERT_LE(b.phases[1].start_us + b.phases[1].duration_us, b.duration_us);
+  ASSERT_EQ(1, b.txs.size());
+  ASSERT_TRUE(b.txs[0].id == make_hash(50));
+  ASSERT_LE(b.txs[0].pool_us + b.txs[0].ring_members_us, b.txs[0].duration_us);
+}
+
+TEST(block_tracer, chrome_trace)
+{
+  const std::string json = block_tracer::to_chrome_trace({make_trace(7, {4})});
+  ASSERT_EQ(0, json.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+  ASSERT_NE(std::string::npos, json.find("{\"name\":\"block 7\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":7000000,\"dur\":100,"));
+  ASSERT_NE(std::string::npos, json.find("{\"name\":\"txs\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":7000060,\"dur\":40,"));
+  ASSERT_NE(std::string::npos, json.find("\"tid\":2,\"ts\":7000060,\"dur\":4,\"args\":{\"height\":7,\"pool_us\":1,\"ring_members_us\":2}"));
+  ASSERT_EQ("\n]}\n", json.substr(json.size() - 4));
+}
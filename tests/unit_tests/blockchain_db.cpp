@@ -26,6 +26,7 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <cstdio>
@@ -38,10 +39,12 @@
 #include "string_tools.h"
 #include "blockchain_db/blockchain_db.h"
 #include "blockchain_db/lmdb/db_lmdb.h"
+#include "blockchain_db/memory/db_memory.h"
 #ifdef BERKELEY_DB
 #include "blockchain_db/berkeleydb/db_bdb.h"
 #endif
 #include "cryptonote_basic/cryptonote_format_utils.h"
+#include "ringct/rctOps.h"
 
 using namespace cryptonote;
 using epee::string_tools::pod_to_hex;
@@ -344,4 +347,624 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, CumulativeEmissionAndFees)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  uint64_t expected_emission = 0, expected_fees = 0;
+  for (size_t i = 0; i < 2; ++i)
+  {
+    uint64_t fees = 0;
+    for (const auto &tx: this->m_txs[i])
+      fees += get_tx_fee(tx);
+    expected_emission += get_outs_money_amount(this->m_blocks[i].miner_tx) - fees;
+    expected_fees += fees;
+
+    uint64_t emission, cum_fees;
+    ASSERT_NO_THROW(this->m_db->get_block_cumulative_emission_and_fees(i, emission, cum_fees));
+    ASSERT_EQ(expected_emission, emission);
+    ASSERT_EQ(expected_fees, cum_fees);
+  }
+
+  uint64_t emission, fees;
+  ASSERT_THROW(this->m_db->get_block_cumulative_emission_and_fees(2, emission, fees), BLOCK_DNE);
+
+  // popping the top block leaves the totals up to the new top
+  block popped;
+  std::vector<transaction> popped_txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(popped, popped_txs));
+  ASSERT_NO_THROW(this->m_db->get_block_cumulative_emission_and_fees(0, emission, fees));
+  ASSERT_THROW(this->m_db->get_block_cumulative_emission_and_fees(1, emission, fees), BLOCK_DNE);
+}
+
+TYPED_TEST(BlockchainDBTest, BlockHeaderEntries)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // the range read matches the single block getters, from either height
+  for (uint64_t h1 = 0; h1 < 2; ++h1)
+  {
+    std::vector<block_header_entry_t> entries;
+    ASSERT_NO_THROW(this->m_db->get_block_header_entries(h1, 1, entries));
+    ASSERT_EQ(2 - h1, entries.size());
+    for (uint64_t h = h1; h < 2; ++h)
+    {
+      const block_header_entry_t &e = entries[h - h1];
+      ASSERT_HASH_EQ(get_block_hash(this->m_blocks[h]), get_block_hash(e.blk));
+      ASSERT_HASH_EQ(this->m_db->get_block_hash_from_height(h), e.hash);
+      ASSERT_EQ(t_sizes[h], e.weight);
+      ASSERT_EQ(t_diffs[h], e.cumulative_difficulty);
+      ASSERT_EQ(this->m_db->get_block_difficulty(h), e.difficulty);
+    }
+  }
+
+  std::vector<block_header_entry_t> entries;
+  ASSERT_THROW(this->m_db->get_block_header_entries(1, 2, entries), BLOCK_DNE);
+}
+
+TYPED_TEST(BlockchainDBTest, PrefetchAndScan)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // advisory only: empty, partial, past the end and out of range are all fine
+  ASSERT_NO_THROW(this->m_db->prefetch_blocks(0, 0));
+  ASSERT_NO_THROW(this->m_db->prefetch_blocks(0, 1));
+  ASSERT_NO_THROW(this->m_db->prefetch_blocks(1, 1000));
+  ASSERT_NO_THROW(this->m_db->prefetch_blocks(2, 1));
+  {
+    db_rtxn_guard rtxn_guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->prefetch_blocks(0, 2));
+  }
+
+  size_t blocks = 0;
+  ASSERT_TRUE(this->m_db->for_blocks_range(0, 1, [&](uint64_t height, const crypto::hash &hash, const cryptonote::block &b) {
+    EXPECT_EQ(pod_to_hex(get_block_hash(this->m_blocks[height])), pod_to_hex(hash));
+    ++blocks;
+    return true;
+  }));
+  ASSERT_EQ(2, blocks);
+
+  size_t txs = 0;
+  ASSERT_TRUE(this->m_db->for_all_transactions([&](const crypto::hash&, const cryptonote::transaction&) { ++txs; return true; }, true));
+  ASSERT_EQ(this->m_db->get_tx_count(), txs);
+}
+
+TYPED_TEST(BlockchainDBTest, GetTxBlobs)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // out of db order, with a missing tx and a duplicate
+  std::vector<crypto::hash> hashes(this->m_blocks[1].tx_hashes.rbegin(), this->m_blocks[1].tx_hashes.rend());
+  hashes.push_back(crypto::null_hash);
+  hashes.insert(hashes.end(), this->m_blocks[0].tx_hashes.begin(), this->m_blocks[0].tx_hashes.end());
+  hashes.push_back(this->m_blocks[0].tx_hashes.front());
+
+  for (bool pruned: {false, true})
+  {
+    std::vector<cryptonote::blobdata> bds;
+    std::vector<bool> found;
+    ASSERT_EQ(hashes.size() - 1, this->m_db->get_tx_blobs(hashes, bds, found, pruned));
+    ASSERT_EQ(hashes.size(), bds.size());
+    ASSERT_EQ(hashes.size(), found.size());
+    for (size_t i = 0; i < hashes.size(); ++i)
+    {
+      if (hashes[i] == crypto::null_hash)
+      {
+        ASSERT_FALSE(found[i]);
+        continue;
+      }
+      ASSERT_TRUE(found[i]);
+      cryptonote::blobdata bd;
+      ASSERT_TRUE(pruned ? this->m_db->get_pruned_tx_blob(hashes[i], bd) : this->m_db->get_tx_blob(hashes[i], bd));
+      ASSERT_EQ(bd, bds[i]);
+    }
+  }
+}
+
+TYPED_TEST(BlockchainDBTest, GetBlockTxBlobs)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // the range read matches the lookups by hash, for a block in the middle
+  // and for the top block
+  for (uint64_t height = 0; height < 2; ++height)
+  {
+    for (bool pruned: {false, true})
+    {
+      std::vector<cryptonote::blobdata> by_range, by_hash;
+      std::vector<bool> found;
+      ASSERT_TRUE(this->m_db->get_block_tx_blobs(height, by_range, pruned));
+      ASSERT_EQ(this->m_blocks[height].tx_hashes.size(), this->m_db->get_tx_blobs(this->m_blocks[height].tx_hashes, by_hash, found, pruned));
+      ASSERT_EQ(by_hash, by_range);
+    }
+  }
+  ASSERT_FALSE(this->m_blocks[0].tx_hashes.empty());
+
+  std::vector<cryptonote::blobdata> blobs;
+  ASSERT_THROW(this->m_db->get_block_tx_blobs(2, blobs), BLOCK_DNE);
+
+  // popping the top block leaves block 0's range intact
+  block blk;
+  std::vector<transaction> txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(blk, txs));
+  ASSERT_TRUE(this->m_db->get_block_tx_blobs(0, blobs));
+  ASSERT_EQ(this->m_blocks[0].tx_hashes.size(), blobs.size());
+}
+
+TYPED_TEST(BlockchainDBTest, GetBlocksOutputIndices)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // the range read matches the lookups by hash, miner tx first
+  std::vector<std::vector<std::vector<uint64_t>>> indices;
+  ASSERT_NO_THROW(this->m_db->get_blocks_amount_output_indices(0, 2, indices));
+  ASSERT_EQ(2, indices.size());
+  for (uint64_t height = 0; height < 2; ++height)
+  {
+    const block &b = this->m_blocks[height];
+    ASSERT_EQ(1 + b.tx_hashes.size(), indices[height].size());
+    uint64_t tx_id;
+    ASSERT_TRUE(this->m_db->tx_exists(get_transaction_hash(b.miner_tx), tx_id));
+    ASSERT_EQ(this->m_db->get_tx_amount_output_indices(tx_id), indices[height][0]);
+    for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+    {
+      ASSERT_TRUE(this->m_db->tx_exists(b.tx_hashes[i], tx_id));
+      ASSERT_EQ(this->m_db->get_tx_amount_output_indices(tx_id), indices[height][1 + i]);
+    }
+  }
+
+  std::vector<std::vector<std::vector<uint64_t>>> top;
+  ASSERT_NO_THROW(this->m_db->get_blocks_amount_output_indices(1, 1, top));
+  ASSERT_EQ(1, top.size());
+  ASSERT_EQ(indices[1], top[0]);
+
+  ASSERT_THROW(this->m_db->get_blocks_amount_output_indices(1, 2, top), BLOCK_DNE);
+}
+
+TYPED_TEST(BlockchainDBTest, ReadTxnGuard)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+
+  {
+    db_rtxn_guard outer(this->m_db);
+    // a txn is active, so none is started
+    ASSERT_FALSE(this->m_db->block_rtxn_start());
+    {
+      db_rtxn_guard inner(this->m_db);
+      ASSERT_EQ(1, this->m_db->height());
+    }
+    // the inner guard did not end the outer guard's txn
+    ASSERT_FALSE(this->m_db->block_rtxn_start());
+    ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0]), this->m_db->get_block_hash_from_height(0));
+  }
+
+  ASSERT_TRUE(this->m_db->block_rtxn_start());
+  this->m_db->block_rtxn_stop();
+}
+
+TYPED_TEST(BlockchainDBTest, KeyImageFilter)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<crypto::key_image> spent;
+  for (size_t i = 0; i < 2; ++i)
+    for (const auto &tx : this->m_txs[i])
+      for (const auto &in : tx.vin)
+        if (in.type() == typeid(txin_to_key))
+          spent.push_back(boost::get<txin_to_key>(in).k_image);
+
+  for (const auto &ki : spent)
+    ASSERT_TRUE(this->m_db->has_key_image(ki));
+
+  // the filter has no false negatives, and misses are still answered correctly
+  size_t unspent = 0;
+  for (size_t i = 0; i < 1000; ++i)
+  {
+    const crypto::key_image ki = rct::rct2ki(rct::skGen());
+    if (std::find(spent.begin(), spent.end(), ki) == spent.end())
+    {
+      ASSERT_FALSE(this->m_db->has_key_image(ki));
+      ++unspent;
+    }
+  }
+
+  key_image_filter_stats stats;
+  if (this->m_db->get_key_image_filter_stats(stats))
+  {
+    ASSERT_TRUE(stats.enabled);
+    ASSERT_EQ(spent.size() + unspent, stats.lookups);
+    ASSERT_EQ(unspent, stats.filtered + stats.false_positives);
+    ASSERT_GT(stats.filtered, unspent / 2);
+  }
+
+  // the filter is rebuilt from the db on open
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  for (const auto &ki : spent)
+    ASSERT_TRUE(this->m_db->has_key_image(ki));
+
+  // but not for a read only db, which another process may add to
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_RDONLY));
+  if (this->m_db->get_key_image_filter_stats(stats))
+    ASSERT_FALSE(stats.enabled);
+  for (const auto &ki : spent)
+    ASSERT_TRUE(this->m_db->has_key_image(ki));
+}
+
+TYPED_TEST(BlockchainDBTest, HasKeyImages)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  // spent and unspent key images, some repeated, answered in request order
+  std::vector<crypto::key_image> key_images;
+  std::vector<bool> expected;
+  for (size_t i = 0; i < 2; ++i)
+    for (const auto &tx : this->m_txs[i])
+      for (const auto &in : tx.vin)
+        if (in.type() == typeid(txin_to_key))
+        {
+          key_images.push_back(boost::get<txin_to_key>(in).k_image);
+          expected.push_back(true);
+          key_images.push_back(rct::rct2ki(rct::skGen()));
+          expected.push_back(false);
+        }
+  ASSERT_FALSE(key_images.empty());
+  const size_t n_unique = key_images.size();
+  for (size_t i = 0; i < n_unique; i += 3)
+  {
+    key_images.push_back(key_images[i]);
+    expected.push_back(expected[i]);
+  }
+
+  std::vector<bool> spent;
+  ASSERT_NO_THROW(this->m_db->has_key_images(key_images, spent));
+  ASSERT_EQ(expected, spent);
+  for (size_t i = 0; i < key_images.size(); ++i)
+    ASSERT_EQ(this->m_db->has_key_image(key_images[i]), spent[i]);
+
+  ASSERT_NO_THROW(this->m_db->has_key_images({}, spent));
+  ASSERT_TRUE(spent.empty());
+}
+
+TYPED_TEST(BlockchainDBTest, AltBlocks)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  const crypto::hash id0 = get_block_hash(this->m_blocks[0]);
+  const crypto::hash id1 = get_block_hash(this->m_blocks[1]);
+  cryptonote::alt_block_data_t data = {};
+  data.prev_id = this->m_blocks[0].prev_id;
+  data.timestamp = this->m_blocks[0].timestamp;
+  data.height = 7;
+  data.cumulative_difficulty = 1234;
+  const cryptonote::blobdata blob = block_to_blob(this->m_blocks[0]);
+
+  ASSERT_EQ(0, this->m_db->get_alt_block_count());
+  ASSERT_FALSE(this->m_db->get_alt_block(id0, NULL, NULL));
+
+  ASSERT_TRUE(this->m_db->batch_start());
+  ASSERT_NO_THROW(this->m_db->add_alt_block(id0, data, blob));
+  ASSERT_THROW(this->m_db->add_alt_block(id0, data, blob), DB_ERROR);
+  data.prev_id = id0;
+  data.height = 8;
+  ASSERT_NO_THROW(this->m_db->add_alt_block(id1, data, block_to_blob(this->m_blocks[1])));
+  this->m_db->batch_stop();
+
+  ASSERT_EQ(2, this->m_db->get_alt_block_count());
+  cryptonote::alt_block_data_t read_data;
+  cryptonote::blobdata read_blob;
+  ASSERT_TRUE(this->m_db->get_alt_block(id0, &read_data, &read_blob));
+  ASSERT_EQ(this->m_blocks[0].prev_id, read_data.prev_id);
+  ASSERT_EQ(this->m_blocks[0].timestamp, read_data.timestamp);
+  ASSERT_EQ(7, read_data.height);
+  ASSERT_EQ(1234, read_data.cumulative_difficulty);
+  ASSERT_EQ(blob, read_blob);
+  ASSERT_TRUE(this->m_db->get_alt_block(id1, &read_data, NULL));
+  ASSERT_EQ(id0, read_data.prev_id);
+
+  size_t n_blobs = 0;
+  ASSERT_TRUE(this->m_db->for_all_alt_blocks([&](const crypto::hash &blkid, const cryptonote::alt_block_data_t &d, const cryptonote::blobdata *b) {
+    if (b && blkid == id0 && *b == blob)
+      ++n_blobs;
+    return blkid == id0 || blkid == id1;
+  }, true));
+  ASSERT_EQ(1, n_blobs);
+
+  ASSERT_TRUE(this->m_db->batch_start());
+  ASSERT_NO_THROW(this->m_db->remove_alt_block(id0));
+  ASSERT_NO_THROW(this->m_db->remove_alt_block(id0));
+  this->m_db->batch_stop();
+  ASSERT_EQ(1, this->m_db->get_alt_block_count());
+  ASSERT_FALSE(this->m_db->get_alt_block(id0, NULL, NULL));
+  ASSERT_TRUE(this->m_db->get_alt_block(id1, NULL, NULL));
+
+  ASSERT_NO_THROW(this->m_db->drop_alt_blocks());
+  ASSERT_EQ(0, this->m_db->get_alt_block_count());
+}
+
+TYPED_TEST(BlockchainDBTest, TxpoolInMemory)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+
+  transaction tx0, tx1;
+  tx0.version = tx1.version = 1;
+  tx0.unlock_time = 0;
+  tx1.unlock_time = 1;
+  const crypto::hash txid0 = get_transaction_hash(tx0);
+  const crypto::hash txid1 = get_transaction_hash(tx1);
+  txpool_tx_meta_t meta = {};
+  meta.weight = 100;
+
+  // a pool in the db to start from
+  ASSERT_FALSE(this->m_db->snapshot_txpool());
+  ASSERT_TRUE(this->m_db->batch_start());
+  ASSERT_NO_THROW(this->m_db->add_txpool_tx(tx0, meta));
+  this->m_db->batch_stop();
+  this->m_db->close();
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_TXPOOL_MEMORY));
+  ASSERT_TRUE(this->m_db->txpool_has_tx(txid0));
+  ASSERT_EQ(tx_to_blob(tx0), this->m_db->get_txpool_tx_blob(txid0));
+
+  meta.do_not_relay = 1;
+  ASSERT_NO_THROW(this->m_db->add_txpool_tx(tx1, meta));
+  ASSERT_THROW(this->m_db->add_txpool_tx(tx1, meta), DB_ERROR);
+  ASSERT_EQ(2, this->m_db->get_txpool_tx_count());
+  ASSERT_EQ(1, this->m_db->get_txpool_tx_count(false));
+  meta.weight = 200;
+  ASSERT_NO_THROW(this->m_db->update_txpool_tx(txid1, meta));
+  ASSERT_NO_THROW(this->m_db->remove_txpool_tx(txid0));
+  ASSERT_NO_THROW(this->m_db->remove_txpool_tx(txid0));
+  ASSERT_FALSE(this->m_db->txpool_has_tx(txid0));
+  size_t n = 0;
+  ASSERT_TRUE(this->m_db->for_all_txpool_txes([&](const crypto::hash &txid, const txpool_tx_meta_t &m, const cryptonote::blobdata *bd) {
+    ++n;
+    return txid == txid1 && m.weight == 200 && bd && *bd == tx_to_blob(tx1);
+  }, true));
+  ASSERT_EQ(1, n);
+
+  // closing writes the pool to the db
+  this->m_db->close();
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_RDONLY));
+  ASSERT_FALSE(this->m_db->txpool_has_tx(txid0));
+  ASSERT_TRUE(this->m_db->txpool_has_tx(txid1));
+  ASSERT_TRUE(this->m_db->get_txpool_tx_meta(txid1, meta));
+  ASSERT_EQ(200, meta.weight);
+  this->m_db->close();
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath, DBF_TXPOOL_MEMORY));
+  ASSERT_NO_THROW(this->m_db->add_txpool_tx(tx0, meta));
+  ASSERT_TRUE(this->m_db->batch_start());
+  ASSERT_TRUE(this->m_db->snapshot_txpool());
+  this->m_db->batch_stop();
+  ASSERT_NO_THROW(this->m_db->remove_txpool_tx(txid0));
+  ASSERT_NO_THROW(this->m_db->remove_txpool_tx(txid1));
+  ASSERT_EQ(0, this->m_db->get_txpool_tx_count());
+}
+
+TYPED_TEST(BlockchainDBTest, RctOutputs)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // v2 coinbase outputs are stored as rct outputs, with amount 0
+  std::vector<block> blocks(this->m_blocks);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    blocks[i].miner_tx.version = 2;
+    blocks[i].miner_tx.rct_signatures.type = rct::RCTTypeNull;
+    blocks[i].miner_tx.invalidate_hashes();
+    if (i > 0)
+      blocks[i].prev_id = get_block_hash(blocks[i - 1]);
+    blocks[i].invalidate_hashes();
+  }
+  ASSERT_NO_THROW(this->m_db->add_block(blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+
+  std::vector<tx_out> rct_outs;
+  std::vector<uint64_t> rct_heights;
+  std::vector<crypto::hash> rct_txs;
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    for (const auto &out : blocks[i].miner_tx.vout)
+    {
+      rct_outs.push_back(out);
+      rct_heights.push_back(i);
+      rct_txs.push_back(get_transaction_hash(blocks[i].miner_tx));
+    }
+  }
+  ASSERT_EQ(rct_outs.size(), this->m_db->get_num_outputs(0));
+
+  std::vector<uint64_t> offsets;
+  for (size_t i = 0; i < rct_outs.size(); ++i)
+  {
+    const output_data_t od = this->m_db->get_output_key(0, i);
+    ASSERT_HASH_EQ(boost::get<txout_to_key>(rct_outs[i].target).key, od.pubkey);
+    ASSERT_HASH_EQ(rct::zeroCommit(rct_outs[i].amount), od.commitment);
+    ASSERT_EQ(rct_heights[i], od.height);
+    const tx_out_index toi = this->m_db->get_output_tx_and_index(0, i);
+    ASSERT_HASH_EQ(rct_txs[i], toi.first);
+    offsets.push_back(i);
+  }
+  std::reverse(offsets.begin(), offsets.end());
+  std::vector<output_data_t> outputs;
+  ASSERT_NO_THROW(this->m_db->get_output_key(0, offsets, outputs));
+  ASSERT_EQ(offsets.size(), outputs.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+    ASSERT_HASH_EQ(boost::get<txout_to_key>(rct_outs[offsets[i]].target).key, outputs[i].pubkey);
+  offsets.push_back(rct_outs.size());
+  ASSERT_THROW(this->m_db->get_output_key(0, offsets, outputs), OUTPUT_DNE);
+
+  const auto histogram = this->m_db->get_output_histogram({}, false, 0, 0);
+  ASSERT_EQ(1, histogram.count(0));
+  ASSERT_EQ(rct_outs.size(), std::get<0>(histogram.at(0)));
+  size_t enumerated = 0;
+  ASSERT_TRUE(this->m_db->for_all_outputs([&](uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx) {
+    if (amount == 0)
+      ++enumerated;
+    return true;
+  }));
+  ASSERT_EQ(rct_outs.size(), enumerated);
+  std::vector<uint64_t> distribution;
+  uint64_t base;
+  ASSERT_TRUE(this->m_db->get_output_distribution(0, 0, 0, distribution, base));
+  ASSERT_EQ(2, distribution.size());
+  ASSERT_EQ(blocks[0].miner_tx.vout.size(), distribution[0]);
+  ASSERT_EQ(rct_outs.size(), distribution[1]);
+
+  // popping a block removes its rct outputs
+  block popped;
+  std::vector<transaction> popped_txs;
+  ASSERT_NO_THROW(this->m_db->pop_block(popped, popped_txs));
+  ASSERT_EQ(blocks[0].miner_tx.vout.size(), this->m_db->get_num_outputs(0));
+  ASSERT_THROW(this->m_db->get_output_key(0, blocks[0].miner_tx.vout.size()), OUTPUT_DNE);
+}
+
+typedef BlockchainDBTest<BlockchainMemory> BlockchainMemoryTest;
+
+TEST_F(BlockchainMemoryTest, Ephemeral)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  set_prefix(dirPath);
+
+  ASSERT_THROW(m_db->open(dirPath, DBF_RDONLY), DB_OPEN_FAILURE);
+  ASSERT_NO_THROW(m_db->open(dirPath));
+  ASSERT_EQ("memory", m_db->get_db_name());
+  init_hard_fork();
+
+  // the db lives elsewhere, the folder is only there for other files
+  const std::vector<std::string> filenames = m_db->get_filenames();
+  ASSERT_FALSE(filenames.empty());
+  ASSERT_FALSE(boost::starts_with(filenames[0], dirPath));
+  ASSERT_TRUE(boost::filesystem::exists(filenames[0]));
+  ASSERT_TRUE(boost::filesystem::is_directory(dirPath));
+
+  ASSERT_NO_THROW(m_db->batch_start());
+  ASSERT_NO_THROW(m_db->add_block(m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], m_txs[0]));
+  ASSERT_NO_THROW(m_db->add_block(m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], m_txs[1]));
+  ASSERT_NO_THROW(m_db->batch_stop());
+  ASSERT_EQ(2, m_db->height());
+  ASSERT_TRUE(m_db->block_exists(get_block_hash(m_blocks[1])));
+
+  // closing deletes it, and the next open starts afresh
+  ASSERT_NO_THROW(m_db->close());
+  ASSERT_FALSE(boost::filesystem::exists(filenames[0]));
+  ASSERT_NO_THROW(m_db->open(dirPath));
+  ASSERT_EQ(0, m_db->height());
+  ASSERT_NO_THROW(m_db->close());
+
+  boost::filesystem::remove_all(dirPath);
+}
+
 }  // anonymous namespace
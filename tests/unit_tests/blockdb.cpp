@@ -0,0 +1,124 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "wallet/blockdb.h"
+
+namespace
+{
+  class BlockDB
+  {
+  public:
+    BlockDB(): path(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("electroneum-blockdb-test-%%%%-%%%%"))
+    {
+      db = tools::blockdb::open(path.string(), "genesis");
+    }
+    ~BlockDB() { db.reset(); boost::filesystem::remove_all(path); }
+
+    boost::filesystem::path path;
+    std::shared_ptr<tools::blockdb> db;
+  };
+
+  std::vector<tools::blockdb::entry> make_chain(const crypto::hash &prev_id, size_t count)
+  {
+    std::vector<tools::blockdb::entry> entries(count);
+    for (size_t n = 0; n < count; ++n)
+    {
+      entries[n].hash = crypto::rand<crypto::hash>();
+      entries[n].prev_id = n ? entries[n - 1].hash : prev_id;
+      entries[n].block.block = "block " + std::to_string(n);
+      entries[n].block.txs.push_back("tx " + std::to_string(n));
+      entries[n].o_indices.indices.resize(2);
+      entries[n].o_indices.indices[1].indices.push_back(n);
+    }
+    return entries;
+  }
+}
+
+TEST(blockdb, not_found)
+{
+  BlockDB blockdb;
+  uint64_t start_height;
+  std::vector<tools::blockdb::entry> entries;
+  ASSERT_FALSE(blockdb.db->get_blocks(crypto::rand<crypto::hash>(), 100, start_height, entries));
+  ASSERT_TRUE(entries.empty());
+}
+
+TEST(blockdb, shared_per_path)
+{
+  BlockDB blockdb;
+  ASSERT_EQ(blockdb.db, tools::blockdb::open(blockdb.path.string(), "genesis"));
+  ASSERT_THROW(tools::blockdb::open(blockdb.path.string(), "other"), std::exception);
+}
+
+TEST(blockdb, chain)
+{
+  BlockDB blockdb;
+  const std::vector<tools::blockdb::entry> chain = make_chain(crypto::null_hash, 10);
+  ASSERT_TRUE(blockdb.db->add_blocks(100, chain));
+
+  uint64_t start_height;
+  std::vector<tools::blockdb::entry> entries;
+  ASSERT_TRUE(blockdb.db->get_blocks(chain[3].hash, 100, start_height, entries));
+  ASSERT_EQ(103, start_height);
+  ASSERT_EQ(7, entries.size());
+  for (size_t n = 0; n < entries.size(); ++n)
+  {
+    ASSERT_EQ(chain[3 + n].hash, entries[n].hash);
+    ASSERT_EQ(chain[3 + n].block.block, entries[n].block.block);
+    ASSERT_EQ(chain[3 + n].block.txs, entries[n].block.txs);
+    ASSERT_EQ(chain[3 + n].o_indices.indices[1].indices, entries[n].o_indices.indices[1].indices);
+  }
+
+  ASSERT_TRUE(blockdb.db->get_blocks(chain[3].hash, 2, start_height, entries));
+  ASSERT_EQ(2, entries.size());
+}
+
+TEST(blockdb, reorg)
+{
+  BlockDB blockdb;
+  const std::vector<tools::blockdb::entry> chain = make_chain(crypto::null_hash, 10);
+  ASSERT_TRUE(blockdb.db->add_blocks(0, chain));
+
+  // replace from height 5: the old blocks there are gone, and the stored chain
+  // stops where the old blocks above do not build on the new ones
+  const std::vector<tools::blockdb::entry> fork = make_chain(chain[4].hash, 2);
+  ASSERT_TRUE(blockdb.db->add_blocks(5, fork));
+
+  uint64_t start_height;
+  std::vector<tools::blockdb::entry> entries;
+  ASSERT_FALSE(blockdb.db->get_blocks(chain[5].hash, 100, start_height, entries));
+  ASSERT_TRUE(blockdb.db->get_blocks(chain[0].hash, 100, start_height, entries));
+  ASSERT_EQ(0, start_height);
+  ASSERT_EQ(7, entries.size());
+  ASSERT_EQ(fork[1].hash, entries.back().hash);
+}
@@ -0,0 +1,197 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+#include <atomic>
+#include <list>
+#include "gtest/gtest.h"
+#include "rpc/bootstrap_daemon.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+
+namespace
+{
+  // answers every request with the same getheight reply, over keep-alive connections
+  class test_daemon
+  {
+  public:
+    test_daemon(unsigned delay_ms = 0):
+      m_acceptor(m_io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), 0)),
+      m_delay_ms(delay_ms), m_stop(false), m_requests(0), m_connections(0)
+    {
+      m_thread = boost::thread([this]() { accept(); });
+    }
+
+    // the clients must be gone, so the connection threads see them close
+    ~test_daemon()
+    {
+      // closing the acceptor does not wake a blocking accept, a connection does
+      m_stop = true;
+      boost::system::error_code ec;
+      boost::asio::ip::tcp::socket socket(m_io_service);
+      socket.connect(m_acceptor.local_endpoint(), ec);
+      m_thread.join();
+      for (boost::thread &t: m_connection_threads)
+        t.join();
+    }
+
+    std::string address() const { return "127.0.0.1:" + std::to_string(m_acceptor.local_endpoint().port()); }
+    unsigned requests() const { return m_requests; }
+    unsigned connections() const { return m_connections; }
+
+  private:
+    void accept()
+    {
+      while (true)
+      {
+        std::shared_ptr<boost::asio::ip::tcp::socket> socket = std::make_shared<boost::asio::ip::tcp::socket>(m_io_service);
+        boost::system::error_code ec;
+        m_acceptor.accept(*socket, ec);
+        if (ec || m_stop)
+          return;
+        ++m_connections;
+        m_connection_threads.push_back(boost::thread([this, socket]() { serve(*socket); }));
+      }
+    }
+
+    void serve(boost::asio::ip::tcp::socket &socket)
+    {
+      static const std::string body = "{\"height\": 100, \"status\": \"OK\", \"untrusted\": false}";
+      boost::asio::streambuf buf;
+      boost::system::error_code ec;
+      while (true)
+      {
+        const size_t head_size = boost::asio::read_until(socket, buf, "\r\n\r\n", ec);
+        if (ec)
+          return;
+        std::string head(boost::asio::buffers_begin(buf.data()), boost::asio::buffers_begin(buf.data()) + head_size);
+        buf.consume(head_size);
+        size_t content_length = 0;
+        const size_t pos = head.find("Content-Length: ");
+        if (pos != std::string::npos)
+          content_length = std::stoul(head.substr(pos + 16));
+        if (buf.size() < content_length)
+          boost::asio::read(socket, buf, boost::asio::transfer_exactly(content_length - buf.size()), ec);
+        if (ec)
+          return;
+        buf.consume(content_length);
+
+        ++m_requests;
+        if (m_delay_ms)
+          boost::this_thread::sleep_for(boost::chrono::milliseconds(m_delay_ms));
+        const std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: keep-alive\r\nContent-Length: "
+          + std::to_string(body.size()) + "\r\n\r\n" + body;
+        boost::asio::write(socket, boost::asio::buffer(response), ec);
+        if (ec)
+          return;
+      }
+    }
+
+    boost::asio::io_service m_io_service;
+    boost::asio::ip::tcp::acceptor m_acceptor;
+    const unsigned m_delay_ms;
+    std::atomic<bool> m_stop;
+    std::atomic<unsigned> m_requests;
+    std::atomic<unsigned> m_connections;
+    boost::thread m_thread;
+    std::list<boost::thread> m_connection_threads;
+  };
+}
+
+TEST(bootstrap_daemon, cacheable_calls)
+{
+  ASSERT_TRUE(cryptonote::bootstrap_daemon::is_cacheable("/getheight"));
+  ASSERT_TRUE(cryptonote::bootstrap_daemon::is_cacheable("getblockheaderbyhash"));
+  ASSERT_FALSE(cryptonote::bootstrap_daemon::is_cacheable("/sendrawtransaction"));
+  ASSERT_FALSE(cryptonote::bootstrap_daemon::is_cacheable("/is_key_image_spent"));
+  ASSERT_FALSE(cryptonote::bootstrap_daemon::is_cacheable("getblocktemplate"));
+}
+
+TEST(bootstrap_daemon, caches_read_only_calls)
+{
+  test_daemon server;
+  {
+    cryptonote::bootstrap_daemon daemon(server.address(), boost::none);
+    cryptonote::COMMAND_RPC_GET_HEIGHT::request req;
+    cryptonote::COMMAND_RPC_GET_HEIGHT::response res;
+
+    ASSERT_TRUE(daemon.invoke_http_json("/getheight", req, res));
+    ASSERT_EQ(100, res.height);
+    ASSERT_TRUE(daemon.invoke_http_json("/getheight", req, res));
+    ASSERT_EQ(1, server.requests());
+
+    // the height check always asks
+    uint64_t height = 0;
+    ASSERT_TRUE(daemon.get_height(height));
+    ASSERT_EQ(100, height);
+    ASSERT_EQ(2, server.requests());
+
+    ASSERT_TRUE(daemon.invoke_http_json("/is_key_image_spent", req, res));
+    ASSERT_TRUE(daemon.invoke_http_json("/is_key_image_spent", req, res));
+    ASSERT_EQ(4, server.requests());
+
+    uint64_t requests, forwarded;
+    size_t connections;
+    daemon.get_stats(requests, forwarded, connections);
+    ASSERT_EQ(5, requests);
+    ASSERT_EQ(4, forwarded);
+    ASSERT_EQ(1, connections);
+  }
+  ASSERT_EQ(1, server.connections());
+}
+
+TEST(bootstrap_daemon, forwards_concurrently_over_a_bounded_pool)
+{
+  static const size_t max_connections = 2;
+  static const size_t calls = 8;
+  test_daemon server(50);
+  {
+    cryptonote::bootstrap_daemon daemon(server.address(), boost::none, max_connections);
+    std::atomic<unsigned> succeeded(0);
+    std::vector<boost::thread> threads;
+    for (size_t i = 0; i < calls; ++i)
+    {
+      threads.push_back(boost::thread([&daemon, &succeeded]() {
+        cryptonote::COMMAND_RPC_GET_HEIGHT::request req;
+        cryptonote::COMMAND_RPC_GET_HEIGHT::response res;
+        if (daemon.invoke_http_json("/is_key_image_spent", req, res) && res.height == 100)
+          ++succeeded;
+      }));
+    }
+    for (boost::thread &t: threads)
+      t.join();
+    ASSERT_EQ(calls, succeeded);
+
+    uint64_t requests, forwarded;
+    size_t connections;
+    daemon.get_stats(requests, forwarded, connections);
+    ASSERT_EQ(max_connections, connections);
+  }
+  ASSERT_EQ(calls, server.requests());
+  ASSERT_EQ(max_connections, server.connections());
+}
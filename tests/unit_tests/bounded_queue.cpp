@@ -0,0 +1,73 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <boost/thread/thread.hpp>
+#include "gtest/gtest.h"
+#include "common/bounded_queue.h"
+
+TEST(bounded_queue, fifo)
+{
+  tools::bounded_queue<int> q(4);
+  for (int i = 0; i < 4; ++i)
+    ASSERT_TRUE(q.push(int(i)));
+  for (int i = 0; i < 4; ++i)
+  {
+    int v;
+    ASSERT_TRUE(q.pop(v));
+    ASSERT_EQ(v, i);
+  }
+}
+
+TEST(bounded_queue, producer_consumer)
+{
+  tools::bounded_queue<int> q(2);
+  boost::thread producer([&q](){
+    for (int i = 0; i < 1000; ++i)
+      q.push(int(i));
+    q.close();
+  });
+  int expected = 0, v;
+  while (q.pop(v))
+    ASSERT_EQ(v, expected++);
+  producer.join();
+  ASSERT_EQ(expected, 1000);
+}
+
+TEST(bounded_queue, close_wakes_blocked_push)
+{
+  tools::bounded_queue<int> q(1);
+  ASSERT_TRUE(q.push(0));
+  bool pushed = true;
+  boost::thread producer([&q, &pushed](){ pushed = q.push(1); });
+  q.close();
+  producer.join();
+  ASSERT_FALSE(pushed);
+  int v;
+  ASSERT_TRUE(q.pop(v));
+  ASSERT_EQ(v, 0);
+  ASSERT_FALSE(q.pop(v));
+}
@@ -26,13 +26,22 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
 #include <cstdint>
 #include <gtest/gtest.h>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
 
 namespace
 {
@@ -96,3 +105,144 @@ TEST(Crypto, verify_32)
     }
   }
 }
+
+TEST(Crypto, generate_key_derivations_batch)
+{
+  // enough keys for a full chunk plus a remainder that is not a multiple of 4
+  static const size_t count = 64 + 7;
+  crypto::public_key pub;
+  crypto::secret_key sec;
+  crypto::generate_keys(pub, sec);
+
+  std::vector<crypto::public_key> keys(count);
+  for (size_t i = 0; i < count; ++i)
+  {
+    crypto::secret_key tx_sec;
+    crypto::generate_keys(keys[i], tx_sec);
+  }
+  // not a point
+  memset(&keys[3], 0xff, sizeof(keys[3]));
+
+  std::vector<crypto::key_derivation> derivations(count);
+  bool valid[count];
+  ASSERT_FALSE(crypto::generate_key_derivations_batch(keys.data(), count, sec, derivations.data(), valid));
+  for (size_t i = 0; i < count; ++i)
+  {
+    crypto::key_derivation derivation;
+    const bool r = crypto::generate_key_derivation(keys[i], sec, derivation);
+    ASSERT_EQ(valid[i], r);
+    if (r)
+      ASSERT_EQ(memcmp(&derivation, &derivations[i], sizeof(derivation)), 0);
+  }
+}
+
+TEST(Crypto, derive_public_keys_batch)
+{
+  static const size_t count = 10;
+  crypto::public_key pub, tx_pub;
+  crypto::secret_key sec, tx_sec;
+  crypto::generate_keys(pub, sec);
+  crypto::generate_keys(tx_pub, tx_sec);
+
+  crypto::key_derivation derivation;
+  ASSERT_TRUE(crypto::generate_key_derivation(tx_pub, sec, derivation));
+  std::vector<crypto::key_derivation> derivations(count, derivation);
+  std::vector<size_t> indices(count);
+  for (size_t i = 0; i < count; ++i)
+    indices[i] = i * 3;
+
+  std::vector<crypto::public_key> derived(count);
+  ASSERT_TRUE(crypto::derive_public_keys_batch(derivations.data(), indices.data(), count, pub, derived.data()));
+  for (size_t i = 0; i < count; ++i)
+  {
+    crypto::public_key expected_key;
+    ASSERT_TRUE(crypto::derive_public_key(derivation, indices[i], pub, expected_key));
+    ASSERT_EQ(expected_key, derived[i]);
+  }
+}
+
+TEST(Crypto, random_bytes_threads)
+{
+  static const size_t threads = 4, draws = 1000;
+  std::vector<std::vector<crypto::hash>> out(threads, std::vector<crypto::hash>(draws));
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t)
+    workers.emplace_back([&out, t]() {
+      for (crypto::hash &h: out[t])
+        crypto::generate_random_bytes_thread_safe(sizeof(h), (uint8_t*)h.data);
+    });
+  for (std::thread &w: workers)
+    w.join();
+
+  std::unordered_set<crypto::hash> seen;
+  for (const auto &v: out)
+    for (const crypto::hash &h: v)
+      ASSERT_TRUE(seen.insert(h).second);
+
+  // more than one block at once
+  std::vector<uint8_t> large(5000, 0);
+  crypto::generate_random_bytes_thread_safe(large.size(), large.data());
+  ASSERT_NE(std::count(large.begin(), large.end(), 0), (ptrdiff_t)large.size());
+}
+
+#ifndef _WIN32
+TEST(Crypto, random_bytes_fork)
+{
+  // prime the thread's buffer so the child inherits it
+  crypto::hash h;
+  crypto::generate_random_bytes_thread_safe(sizeof(h), (uint8_t*)h.data);
+
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  const pid_t pid = fork();
+  ASSERT_NE(pid, -1);
+  if (pid == 0)
+  {
+    crypto::generate_random_bytes_thread_safe(sizeof(h), (uint8_t*)h.data);
+    _exit(write(fds[1], h.data, sizeof(h)) == sizeof(h) ? 0 : 1);
+  }
+  crypto::hash child_h;
+  ASSERT_EQ(read(fds[0], child_h.data, sizeof(child_h)), (ssize_t)sizeof(child_h));
+  close(fds[0]);
+  close(fds[1]);
+  int status;
+  ASSERT_EQ(waitpid(pid, &status, 0), pid);
+  crypto::generate_random_bytes_thread_safe(sizeof(h), (uint8_t*)h.data);
+  ASSERT_NE(h, child_h);
+}
+#endif
+
+TEST(Crypto, tree_branch)
+{
+  std::vector<crypto::hash> hashes(600);
+  for (auto &h: hashes)
+    h = crypto::rand<crypto::hash>();
+  for (size_t count = 1; count <= hashes.size(); ++count)
+  {
+    crypto::hash root, branch_root;
+    crypto::tree_hash(hashes.data(), count, root);
+    std::vector<crypto::hash> branch(crypto::tree_depth(count));
+    crypto::tree_branch(hashes.data(), count, branch.data());
+    crypto::tree_hash_from_branch(branch.data(), branch.size(), hashes[0], branch_root);
+    ASSERT_EQ(root, branch_root) << "count " << count;
+  }
+}
+
+TEST(Crypto, block_hashing_blob_from_tx_tree_branch)
+{
+  cryptonote::block b;
+  b.miner_tx.version = 1;
+  for (size_t i = 0; i < 1000; ++i)
+    b.tx_hashes.push_back(crypto::rand<crypto::hash>());
+  std::vector<crypto::hash> branch;
+  cryptonote::get_tx_tree_branch(b, branch);
+  ASSERT_EQ(branch.size(), 9);
+
+  // a new extra nonce only changes the miner tx, the branch stays valid
+  for (uint8_t extra = 0; extra < 4; ++extra)
+  {
+    b.miner_tx.extra.push_back(extra);
+    b.miner_tx.invalidate_hashes();
+    ASSERT_EQ(cryptonote::get_block_hashing_blob(b), cryptonote::get_block_hashing_blob(b, branch));
+  }
+}
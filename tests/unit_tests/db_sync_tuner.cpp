@@ -0,0 +1,120 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/db_sync_tuner.h"
+
+using cryptonote::db_sync_tuner;
+
+TEST(db_sync_tuner, not_adapted_by_default)
+{
+  db_sync_tuner tuner;
+  tuner.on_commit(20, 20000, 100);
+  tuner.on_sync(100, 1000000);
+  tuner.on_sync(100, 2000000);
+  ASSERT_EQ(0, tuner.get_batch_blocks());
+  ASSERT_EQ(0, tuner.get_sync_blocks());
+  ASSERT_EQ(100, tuner.get_state().avg_commit_us);
+}
+
+TEST(db_sync_tuner, batch_follows_commit_time)
+{
+  db_sync_tuner tuner;
+  tuner.set_batch_bounds(20, 100);
+  ASSERT_EQ(20, tuner.get_batch_blocks());
+
+  // cheap commits grow batches, at most doubling each time, up to the max
+  tuner.on_commit(20, 20000, 1000);
+  ASSERT_EQ(40, tuner.get_batch_blocks());
+  tuner.on_commit(40, 40000, 2000);
+  ASSERT_EQ(80, tuner.get_batch_blocks());
+  tuner.on_commit(80, 80000, 4000);
+  ASSERT_EQ(100, tuner.get_batch_blocks());
+
+  // commits well over the target shrink them, down to the min
+  for (int i = 0; i < 20; ++i)
+    tuner.on_commit(100, 100000, 20 * db_sync_tuner::TARGET_COMMIT_US);
+  ASSERT_EQ(20, tuner.get_batch_blocks());
+}
+
+TEST(db_sync_tuner, batch_settles_on_target)
+{
+  db_sync_tuner tuner;
+  tuner.set_batch_bounds(1, 1000);
+  // 20 ms per block, so 50 blocks per target commit
+  for (int i = 0; i < 50; ++i)
+  {
+    const uint64_t blocks = tuner.get_batch_blocks();
+    tuner.on_commit(blocks, blocks * 1000, blocks * 20000);
+  }
+  ASSERT_EQ(50, tuner.get_batch_blocks());
+
+  // a rotating drive allows longer commits
+  tuner.set_rotating_drive(true);
+  for (int i = 0; i < 50; ++i)
+  {
+    const uint64_t blocks = tuner.get_batch_blocks();
+    tuner.on_commit(blocks, blocks * 1000, blocks * 20000);
+  }
+  ASSERT_EQ(150, tuner.get_batch_blocks());
+}
+
+TEST(db_sync_tuner, sync_interval_follows_sync_share)
+{
+  db_sync_tuner tuner;
+  tuner.set_sync_bounds(1, 16);
+  ASSERT_EQ(1, tuner.get_sync_blocks());
+
+  // syncs taking half the time are spaced out
+  uint64_t now = 1000000;
+  tuner.on_sync(500000, now);
+  ASSERT_EQ(1, tuner.get_sync_blocks());
+  for (int i = 0; i < 10; ++i)
+    tuner.on_sync(500000, now += 1000000);
+  ASSERT_EQ(16, tuner.get_sync_blocks());
+
+  // in between shares keep the interval
+  tuner.on_sync(50000, now += 1000000);
+  ASSERT_EQ(16, tuner.get_sync_blocks());
+
+  // cheap syncs are brought closer again, down to the min
+  for (int i = 0; i < 10; ++i)
+    tuner.on_sync(1000, now += 1000000);
+  ASSERT_EQ(1, tuner.get_sync_blocks());
+}
+
+TEST(db_sync_tuner, rotating_drive_starts_spaced_out)
+{
+  db_sync_tuner tuner;
+  tuner.set_rotating_drive(true);
+  tuner.set_sync_bounds(2, 100);
+  ASSERT_EQ(16, tuner.get_sync_blocks());
+  tuner.set_sync_bounds(2, 10);
+  ASSERT_EQ(10, tuner.get_sync_blocks());
+}
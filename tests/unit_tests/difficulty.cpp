@@ -0,0 +1,116 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <deque>
+#include "gtest/gtest.h"
+#include "cryptonote_config.h"
+#include "cryptonote_basic/difficulty.h"
+
+namespace
+{
+  void check_window(const cryptonote::difficulty_window &w, const std::deque<uint64_t> &ts, const std::deque<uint64_t> &cd)
+  {
+    ASSERT_EQ(w.size(), ts.size());
+    for (size_t i = 0; i < ts.size(); ++i)
+    {
+      ASSERT_EQ(w.timestamps()[i], ts[i]);
+      ASSERT_EQ(w.cumulative_difficulties()[i], cd[i]);
+    }
+  }
+}
+
+TEST(difficulty_window, slides)
+{
+  cryptonote::difficulty_window w;
+  std::deque<uint64_t> ts, cd;
+  w.reserve(10);
+  for (uint64_t i = 0; i < 1000; ++i)
+  {
+    w.push_back(i * 120, i * 1000);
+    ts.push_back(i * 120);
+    cd.push_back(i * 1000);
+    if (ts.size() > 10)
+    {
+      w.pop_front();
+      ts.pop_front();
+      cd.pop_front();
+    }
+    check_window(w, ts, cd);
+  }
+}
+
+TEST(difficulty_window, steps_back)
+{
+  cryptonote::difficulty_window w;
+  std::deque<uint64_t> ts, cd;
+  for (uint64_t i = 0; i < 30; ++i)
+  {
+    w.push_back(i, i * 7);
+    ts.push_back(i);
+    cd.push_back(i * 7);
+    if (ts.size() > 10)
+    {
+      w.pop_front();
+      ts.pop_front();
+      cd.pop_front();
+    }
+  }
+  // as when popping blocks: drop the top, read back the one below the window
+  for (int n = 0; n < 15; ++n)
+  {
+    w.pop_back();
+    ts.pop_back();
+    cd.pop_back();
+    const uint64_t below = ts.front() - 1;
+    w.push_front(below, below * 7);
+    ts.push_front(below);
+    cd.push_front(below * 7);
+    check_window(w, ts, cd);
+  }
+}
+
+TEST(difficulty, pointer_and_vector_versions_agree)
+{
+  std::vector<uint64_t> timestamps, cumulative_difficulties;
+  cryptonote::difficulty_window w;
+  uint64_t cd = 0;
+  for (uint64_t i = 0; i < DIFFICULTY_BLOCKS_COUNT_V9; ++i)
+  {
+    const uint64_t ts = 1000000 + i * DIFFICULTY_TARGET + (i * 37) % 50;
+    cd += 5000 + (i * 13) % 700;
+    timestamps.push_back(ts);
+    cumulative_difficulties.push_back(cd);
+    w.push_back(ts, cd);
+  }
+  const cryptonote::difficulty_type v9 = cryptonote::next_difficulty_v9(timestamps, cumulative_difficulties, DIFFICULTY_TARGET);
+  ASSERT_EQ(v9, cryptonote::next_difficulty_v9(w.timestamps(), w.cumulative_difficulties(), w.size(), DIFFICULTY_TARGET));
+  ASSERT_EQ(cryptonote::next_difficulty(timestamps, cumulative_difficulties, DIFFICULTY_TARGET),
+      cryptonote::next_difficulty(w.timestamps(), w.cumulative_difficulties(), w.size(), DIFFICULTY_TARGET));
+  // the vector versions no longer take copies, make sure nothing is sorted in place
+  ASSERT_EQ(timestamps[0], 1000000u);
+  ASSERT_EQ(w.timestamps()[0], 1000000u);
+}
@@ -158,6 +158,40 @@ TEST(DNSResolver, GetTXTRecord)
   EXPECT_STREQ("donate.getmonero.org", addr.c_str());
 }
 
+TEST(DNSResolver, IPv4Multi)
+{
+  const std::vector<std::string> urls = { "example.com", "example.invalid", "notaurl", "example.com" };
+  std::vector<std::vector<std::string>> results(urls.size());
+  std::vector<int> calls(urls.size(), 0);
+
+  size_t answered = tools::DNSResolver::instance().get_ipv4(urls, [&](size_t i, const std::vector<std::string> &ips, bool avail, bool valid) {
+    ++calls[i];
+    results[i] = ips;
+    return true;
+  }, 20000);
+
+  ASSERT_EQ(3, answered);
+  for (int c: calls)
+    ASSERT_EQ(1, c);
+  ASSERT_EQ(1, results[0].size());
+  ASSERT_EQ(0, results[1].size());
+  ASSERT_EQ(0, results[2].size());
+  ASSERT_EQ(results[0], results[3]);
+}
+
+TEST(DNSResolver, IPv4MultiStop)
+{
+  const std::vector<std::string> urls = { "example.com", "example.com", "example.com" };
+  size_t calls = 0;
+
+  tools::DNSResolver::instance().get_ipv4(urls, [&](size_t i, const std::vector<std::string> &ips, bool avail, bool valid) {
+    ++calls;
+    return false;
+  }, 20000);
+
+  ASSERT_EQ(1, calls);
+}
+
 bool is_equal(const char *s, const std::vector<std::string> &v) { return v.size() == 1 && v[0] == s; }
 
 TEST(DNS_PUBLIC, empty) { EXPECT_TRUE(tools::dns_utils::parse_dns_public("").empty()); }
@@ -425,6 +425,124 @@ TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_process
   ASSERT_EQ(3, m_commands_handler.callback_counter());
 }
 
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, shared_notify_buffer_matches_notify)
+{
+  const int expected_command = 2246153;
+  const std::string in_data(1000, 'n');
+
+  test_connection_ptr conn = create_connection();
+
+  ASSERT_EQ(1, conn->m_protocol_handler.notify(expected_command, in_data));
+  const std::string notify_data = conn->last_send_data();
+  conn->reset_last_send_data();
+
+  std::shared_ptr<const std::string> message = m_handler_config.make_notify_buffer(expected_command, in_data);
+  ASSERT_EQ(sizeof(epee::levin::bucket_head2) + in_data.size(), message->size());
+  ASSERT_EQ(1, m_handler_config.send_notify(message, conn->m_protocol_handler.get_connection_id()));
+  ASSERT_EQ(notify_data, conn->last_send_data());
+
+  epee::levin::bucket_head2 head = *reinterpret_cast<const epee::levin::bucket_head2*>(message->data());
+  ASSERT_EQ(LEVIN_SIGNATURE, head.m_signature);
+  ASSERT_EQ(expected_command, head.m_command);
+  ASSERT_EQ(in_data.size(), head.m_cb);
+  ASSERT_FALSE(head.m_have_to_return_data);
+  ASSERT_EQ(in_data, message->substr(sizeof(head)));
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, command_stats_are_kept_per_connection)
+{
+  const int invoked_command = 3318420;
+  const int notified_command = 3318421;
+  const std::string in_data(100, 's');
+
+  test_connection_ptr conn = create_connection();
+
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = in_data.size();
+  req_head.m_have_to_return_data = true;
+  req_head.m_command = invoked_command;
+  req_head.m_flags = LEVIN_PACKET_REQUEST;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+  std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += in_data;
+  m_commands_handler.invoke_out_buf(std::string(50, 'r'));
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+
+  req_head.m_have_to_return_data = false;
+  req_head.m_command = notified_command;
+  buf.assign(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += in_data;
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+
+  const std::vector<epee::levin::command_stats_snapshot> stats = conn->m_protocol_handler.get_command_stats_snapshot();
+  ASSERT_EQ(2, stats.size());
+  ASSERT_EQ(invoked_command, stats[0].command);
+  ASSERT_EQ(1, stats[0].packets_in);
+  ASSERT_EQ(sizeof(req_head) + in_data.size(), stats[0].bytes_in);
+  ASSERT_EQ(1, stats[0].packets_out);
+  ASSERT_EQ(sizeof(req_head) + 50, stats[0].bytes_out);
+  ASSERT_EQ(1, stats[0].handled);
+  ASSERT_EQ(notified_command, stats[1].command);
+  ASSERT_EQ(2, stats[1].packets_in);
+  ASSERT_EQ(0, stats[1].packets_out);
+  ASSERT_EQ(2, stats[1].handled);
+
+  // the process wide table has them too
+  bool found = false;
+  for (const auto &s: epee::levin::snapshot_command_stats(epee::levin::get_command_stats(), LEVIN_COMMAND_STATS_SLOTS))
+    if (s.command == notified_command)
+      found = s.handled == 2;
+  ASSERT_TRUE(found);
+
+  size_t connections = 0, commands = 0;
+  m_handler_config.foreach_connection_command_stats([&](test_levin_connection_context&, const std::vector<epee::levin::command_stats_snapshot> &s) {
+    ++connections;
+    commands += s.size();
+    return true;
+  });
+  ASSERT_EQ(1, connections);
+  ASSERT_EQ(2, commands);
+
+  test_connection_ptr idle_conn = create_connection();
+  ASSERT_TRUE(idle_conn->m_protocol_handler.get_command_stats_snapshot().empty());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, command_stats_time_answered_invokes)
+{
+  const int expected_command = 3318422;
+
+  test_connection_ptr conn = create_connection();
+
+  bool answered = false;
+  ASSERT_TRUE(m_handler_config.invoke_async(expected_command, std::string(10, 'i'), conn->m_protocol_handler.get_connection_id(), [&answered](int code, const std::string&, test_levin_connection_context&) {
+    answered = code == LEVIN_OK;
+  }));
+  std::vector<epee::levin::command_stats_snapshot> stats = conn->m_protocol_handler.get_command_stats_snapshot();
+  ASSERT_EQ(1, stats.size());
+  ASSERT_EQ(1, stats[0].packets_out);
+  ASSERT_EQ(0, stats[0].invokes);
+
+  epee::levin::bucket_head2 resp_head;
+  resp_head.m_signature = LEVIN_SIGNATURE;
+  resp_head.m_cb = 0;
+  resp_head.m_have_to_return_data = false;
+  resp_head.m_command = expected_command;
+  resp_head.m_return_code = LEVIN_OK;
+  resp_head.m_flags = LEVIN_PACKET_RESPONSE;
+  resp_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(&resp_head, sizeof(resp_head)));
+  ASSERT_TRUE(answered);
+
+  stats = conn->m_protocol_handler.get_command_stats_snapshot();
+  ASSERT_EQ(1, stats.size());
+  ASSERT_EQ(1, stats[0].packets_in);
+  ASSERT_EQ(1, stats[0].invokes);
+  ASSERT_EQ(0, stats[0].invoke_timeouts);
+  ASSERT_EQ(0, stats[0].handled);
+}
+
 TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_big_packet_1)
 {
   std::string buf("yyyyyy");
@@ -27,10 +27,13 @@
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <array>
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/endian/conversion.hpp>
 #include <boost/range/algorithm/equal.hpp>
 #include <boost/range/algorithm_ext/iota.hpp>
+#include <cctype>
 #include <cstdint>
+#include <cstring>
 #include <gtest/gtest.h>
 #include <iterator>
 #include <string>
@@ -44,8 +47,11 @@
 #include "boost/archive/portable_binary_iarchive.hpp"
 #include "boost/archive/portable_binary_oarchive.hpp"
 #include "hex.h"
+#include "misc_os_dependent.h"
 #include "net/net_utils_base.h"
 #include "net/local_ip.h"
+#include "net/timer_wheel.h"
+#include "net/http_server_handlers_map2.h"
 #include "p2p/net_peerlist_boost_serialization.h"
 #include "span.h"
 #include "string_tools.h"
@@ -435,6 +441,79 @@ TEST(ToHex, Formatted)
   EXPECT_EQ(expected, out.str());
 }
 
+TEST(FromHex, Buffer)
+{
+  const std::vector<unsigned char> all_bytes = get_all_bytes();
+  const std::string hex = std_to_hex(all_bytes);
+
+  std::vector<std::uint8_t> out(all_bytes.size());
+  EXPECT_TRUE(epee::from_hex::buffer(epee::to_mut_span(out), epee::to_span(hex)));
+  EXPECT_EQ(all_bytes, out);
+
+  std::string upper = hex;
+  boost::algorithm::to_upper(upper);
+  std::fill(out.begin(), out.end(), 0);
+  EXPECT_TRUE(epee::from_hex::buffer(epee::to_mut_span(out), epee::to_span(upper)));
+  EXPECT_EQ(all_bytes, out);
+
+  EXPECT_TRUE(epee::from_hex::buffer(nullptr, nullptr));
+  EXPECT_FALSE(epee::from_hex::buffer({out.data(), 3}, {hex.data(), 5}));
+  EXPECT_FALSE(epee::from_hex::buffer({out.data(), 3}, {hex.data(), 8}));
+}
+
+TEST(FromHex, Invalid)
+{
+  // every position of both the vectorized and the tail part of the input
+  std::string hex(2 * 37, '0');
+  std::vector<std::uint8_t> out(37);
+  for (const char c : {'g', 'G', '/', ':', '@', '`', ' ', '+', '-', 'x', '\0', '\x80', '\xc6', '\xff'})
+  {
+    for (std::size_t i = 0; i < hex.size(); ++i)
+    {
+      hex[i] = c;
+      EXPECT_FALSE(epee::from_hex::buffer(epee::to_mut_span(out), epee::to_span(hex))) << "char " << int(c) << " at " << i;
+      hex[i] = '0';
+    }
+  }
+  EXPECT_TRUE(epee::from_hex::buffer(epee::to_mut_span(out), epee::to_span(hex)));
+
+  for (int c = 0; c < 256; ++c)
+  {
+    const bool valid = std::isxdigit(c);
+    EXPECT_EQ(valid, epee::from_hex::nibble(char(c)) >= 0);
+  }
+}
+
+TEST(StringTools, ParseHex)
+{
+  std::string res;
+  EXPECT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(std::string("ffAB0100"), res));
+  EXPECT_EQ(std::string("\xff\xab\x01\x00", 4), res);
+  EXPECT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string("ffa"), res));
+  EXPECT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(std::string("ffa"), res, true));
+  EXPECT_EQ(std::string("\xff\x0a", 2), res);
+  EXPECT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string("ffx"), res, true));
+  EXPECT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string(" fab"), res));
+  EXPECT_FALSE(epee::string_tools::parse_hexstr_to_binbuff(std::string("+fab"), res));
+  EXPECT_TRUE(res.empty());
+
+  const std::vector<unsigned char> all_bytes = get_all_bytes();
+  EXPECT_TRUE(epee::string_tools::parse_hexstr_to_binbuff(std_to_hex(all_bytes), res));
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(all_bytes.data()), all_bytes.size()), res);
+}
+
+TEST(StringTools, HexToPod)
+{
+  struct some_pod { unsigned char data[4]; };
+  some_pod pod{{1, 2, 3, 4}};
+  EXPECT_TRUE(epee::string_tools::hex_to_pod("ffab0100", pod));
+  EXPECT_EQ(0, memcmp(pod.data, "\xff\xab\x01\x00", 4));
+  EXPECT_FALSE(epee::string_tools::hex_to_pod("ffab01", pod));
+  EXPECT_FALSE(epee::string_tools::hex_to_pod("ffab0100ff", pod));
+  EXPECT_FALSE(epee::string_tools::hex_to_pod("01020z04", pod));
+  EXPECT_EQ(0, memcmp(pod.data, "\xff\xab\x01\x00", 4));
+}
+
 TEST(StringTools, BuffToHex)
 {
   const std::vector<unsigned char> all_bytes = get_all_bytes();
@@ -735,3 +814,271 @@ TEST(NetUtils, PrivateRanges)
   ASSERT_EQ(is_local("0.0.30.172"), false);
   ASSERT_EQ(is_local("0.0.30.127"), false);
 }
+
+namespace
+{
+  struct COMMAND_TEST_DOUBLE
+  {
+    struct request
+    {
+      uint64_t value;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+      END_KV_SERIALIZE_MAP()
+    };
+    struct response
+    {
+      uint64_t value;
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct json_rpc_test_server
+  {
+    bool on_double(const COMMAND_TEST_DOUBLE::request& req, COMMAND_TEST_DOUBLE::response& res, epee::json_rpc::error& error_resp)
+    {
+      res.value = req.value * 2;
+      return true;
+    }
+
+    BEGIN_URI_MAP2()
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC_WE("double", on_double, COMMAND_TEST_DOUBLE)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    std::string call(const std::string& body)
+    {
+      epee::net_utils::http::http_request_info query;
+      query.m_URI = "/json_rpc";
+      query.m_body = body;
+      epee::net_utils::http::http_response_info response;
+      int context = 0;
+      EXPECT_TRUE(handle_http_request_map(query, response, context));
+      return response.m_body;
+    }
+  };
+}
+
+TEST(JsonRpc, SplitBatch)
+{
+  std::vector<std::string> items;
+  EXPECT_FALSE(epee::json_rpc::is_batch("{\"id\":0}"));
+  EXPECT_TRUE(epee::json_rpc::is_batch(" \n[]"));
+  ASSERT_TRUE(epee::json_rpc::split_batch("[]", items));
+  EXPECT_TRUE(items.empty());
+  ASSERT_TRUE(epee::json_rpc::split_batch(" [ {\"a\":[1,2]} , {\"b\":\"],\\\"}\"} ] ", items));
+  ASSERT_EQ(items.size(), 2);
+  EXPECT_EQ(items[0], " {\"a\":[1,2]} ");
+  EXPECT_EQ(items[1], " {\"b\":\"],\\\"}\"} ");
+  EXPECT_FALSE(epee::json_rpc::split_batch("[{}", items));
+  EXPECT_FALSE(epee::json_rpc::split_batch("[{}] x", items));
+  EXPECT_FALSE(epee::json_rpc::split_batch("[{]}", items));
+}
+
+TEST(JsonRpc, Batch)
+{
+  json_rpc_test_server server;
+  const std::string single = server.call("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"double\",\"params\":{\"value\":4}}");
+  EXPECT_EQ(single.find('['), std::string::npos);
+  EXPECT_NE(single.find("\"value\": 8"), std::string::npos);
+
+  const std::string batch = server.call("[{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"double\",\"params\":{\"value\":4}},"
+    "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"triple\"},[],"
+    "{\"jsonrpc\":\"2.0\",\"id\":3,\"method\":\"double\",\"params\":{\"value\":21}}]");
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_json("{\"batch\":" + batch + "}"));
+  epee::serialization::hsection reply = nullptr;
+  epee::serialization::harray replies = ps.get_first_section("batch", reply, nullptr);
+  ASSERT_TRUE(replies != nullptr);
+  uint64_t value = 0;
+  ASSERT_TRUE(ps.get_value("id", value, reply));
+  EXPECT_EQ(value, 1);
+  epee::serialization::hsection result = ps.open_section("result", reply, false);
+  ASSERT_TRUE(result != nullptr);
+  ASSERT_TRUE(ps.get_value("value", value, result));
+  EXPECT_EQ(value, 8);
+
+  int64_t code = 0;
+  ASSERT_TRUE(ps.get_next_section(replies, reply));
+  epee::serialization::hsection error = ps.open_section("error", reply, false);
+  ASSERT_TRUE(error != nullptr);
+  ASSERT_TRUE(ps.get_value("code", code, error));
+  EXPECT_EQ(code, -32601);
+
+  ASSERT_TRUE(ps.get_next_section(replies, reply));
+  error = ps.open_section("error", reply, false);
+  ASSERT_TRUE(error != nullptr);
+  ASSERT_TRUE(ps.get_value("code", code, error));
+  EXPECT_EQ(code, -32600);
+
+  ASSERT_TRUE(ps.get_next_section(replies, reply));
+  result = ps.open_section("result", reply, false);
+  ASSERT_TRUE(result != nullptr);
+  ASSERT_TRUE(ps.get_value("value", value, result));
+  EXPECT_EQ(value, 42);
+  EXPECT_FALSE(ps.get_next_section(replies, reply));
+
+  EXPECT_NE(server.call("[]").find("-32600"), std::string::npos);
+}
+
+TEST(PortableStorage, LoadFromJson)
+{
+  epee::serialization::portable_storage ps;
+  ASSERT_TRUE(ps.load_from_json("{\"u\": 18446744073709551615, \"i\": -5, \"d\": 1.5e1, \"s\": \"a\\\"b\", \"b\": true, \"n\": null,"
+    " \"sec\": {\"x\": 1}, \"nums\": [1, -2], \"strs\": [\"p\", \"q\"], \"secs\": [{\"y\": 2}, {\"y\": 3}], \"empty\": []}"));
+
+  uint64_t u = 0;
+  ASSERT_TRUE(ps.get_value("u", u, nullptr));
+  EXPECT_EQ(u, std::numeric_limits<uint64_t>::max());
+  int64_t i = 0;
+  ASSERT_TRUE(ps.get_value("i", i, nullptr));
+  EXPECT_EQ(i, -5);
+  double d = 0;
+  ASSERT_TRUE(ps.get_value("d", d, nullptr));
+  EXPECT_EQ(d, 15.0);
+  std::string s;
+  ASSERT_TRUE(ps.get_value("s", s, nullptr));
+  EXPECT_EQ(s, "a\"b");
+  bool b = false;
+  ASSERT_TRUE(ps.get_value("b", b, nullptr));
+  EXPECT_TRUE(b);
+  epee::serialization::storage_entry n;
+  EXPECT_FALSE(ps.get_value("n", n, nullptr));
+
+  epee::serialization::hsection sec = ps.open_section("sec", nullptr, false);
+  ASSERT_TRUE(sec != nullptr);
+  ASSERT_TRUE(ps.get_value("x", u, sec));
+  EXPECT_EQ(u, 1);
+
+  epee::serialization::harray nums = ps.get_first_value("nums", i, nullptr);
+  ASSERT_TRUE(nums != nullptr);
+  EXPECT_EQ(i, 1);
+  ASSERT_TRUE(ps.get_next_value(nums, i));
+  EXPECT_EQ(i, -2);
+  EXPECT_FALSE(ps.get_next_value(nums, i));
+
+  epee::serialization::harray strs = ps.get_first_value("strs", s, nullptr);
+  ASSERT_TRUE(strs != nullptr);
+  EXPECT_EQ(s, "p");
+  ASSERT_TRUE(ps.get_next_value(strs, s));
+  EXPECT_EQ(s, "q");
+
+  epee::serialization::hsection item = nullptr;
+  epee::serialization::harray secs = ps.get_first_section("secs", item, nullptr);
+  ASSERT_TRUE(secs != nullptr);
+  ASSERT_TRUE(ps.get_value("y", u, item));
+  EXPECT_EQ(u, 2);
+  ASSERT_TRUE(ps.get_next_section(secs, item));
+  ASSERT_TRUE(ps.get_value("y", u, item));
+  EXPECT_EQ(u, 3);
+  EXPECT_FALSE(ps.get_next_section(secs, item));
+
+  // control characters are stored with escapes the parser accepts back
+  epee::serialization::portable_storage out;
+  ASSERT_TRUE(out.set_value("c", std::string("\v\x01/\n"), nullptr));
+  std::string json;
+  ASSERT_TRUE(out.dump_as_json(json));
+  ASSERT_TRUE(ps.load_from_json(json));
+  ASSERT_TRUE(ps.get_value("c", s, nullptr));
+  EXPECT_EQ(s, "\v\x01/\n");
+}
+
+TEST(PortableStorage, LoadFromJsonRejects)
+{
+  epee::serialization::portable_storage ps;
+  EXPECT_TRUE(ps.load_from_json(" \r\n"));
+  EXPECT_FALSE(ps.load_from_json("x"));
+  EXPECT_FALSE(ps.load_from_json("[{}]"));
+  EXPECT_FALSE(ps.load_from_json("5"));
+  EXPECT_FALSE(ps.load_from_json("{\"a\": 1"));
+  EXPECT_FALSE(ps.load_from_json("{\"a\": 18446744073709551616}"));
+  EXPECT_FALSE(ps.load_from_json("{\"a\": [[1]]}"));
+  EXPECT_FALSE(ps.load_from_json("{\"a\": [1, \"b\"]}"));
+  EXPECT_FALSE(ps.load_from_json("{\"a\": [1, null]}"));
+
+  std::string deep;
+  for (int n = 0; n < 200; ++n)
+    deep += "{\"a\": ";
+  deep += "1" + std::string(200, '}');
+  EXPECT_FALSE(ps.load_from_json(deep));
+}
+
+TEST(TimerWheel, FiresInOrder)
+{
+  boost::asio::io_service io_service;
+  epee::net_utils::timer_wheel &wheel = epee::net_utils::timer_wheel::get(io_service);
+  ASSERT_EQ(&wheel, &epee::net_utils::timer_wheel::get(io_service));
+
+  std::vector<int> fired;
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::chrono::milliseconds> at(4);
+  auto add = [&](int n, unsigned ms) {
+    return wheel.add(std::chrono::milliseconds(ms), [&, n]() {
+      fired.push_back(n);
+      at[n] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    });
+  };
+  add(2, 300);
+  add(0, 1);
+  const auto cancelled = add(3, 100);
+  add(1, 120);
+  ASSERT_EQ(wheel.size(), 4);
+  ASSERT_TRUE(wheel.cancel(cancelled));
+  ASSERT_FALSE(wheel.cancel(cancelled));
+  io_service.run();
+
+  ASSERT_EQ(fired, std::vector<int>({0, 1, 2}));
+  ASSERT_EQ(wheel.size(), 0);
+  ASSERT_GE(at[1].count(), 120);
+  ASSERT_GE(at[2].count(), 300);
+}
+
+TEST(TimerWheel, Reset)
+{
+  boost::asio::io_service io_service;
+  epee::net_utils::timer_wheel &wheel = epee::net_utils::timer_wheel::get(io_service);
+  bool fired = false;
+  const auto start = std::chrono::steady_clock::now();
+  const auto id = wheel.add(std::chrono::milliseconds(50), [&]() { fired = true; });
+  ASSERT_TRUE(wheel.reset(id, std::chrono::milliseconds(200)));
+  ASSERT_GT(wheel.remaining(id).count(), 100);
+  io_service.run();
+  ASSERT_TRUE(fired);
+  ASSERT_GE(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), 200);
+  ASSERT_FALSE(wheel.reset(id, std::chrono::milliseconds(50)));
+  ASSERT_FALSE(wheel.cancel(id));
+  ASSERT_EQ(wheel.remaining(id).count(), 0);
+}
+
+TEST(TimerWheel, Cascades)
+{
+  // deadlines on every level, placed without running the wheel
+  boost::asio::io_service io_service;
+  epee::net_utils::timer_wheel &wheel = epee::net_utils::timer_wheel::get(io_service);
+  std::vector<epee::net_utils::timer_wheel::timer_id> ids;
+  for (unsigned ticks: {1u, 63u, 64u, 65u, 4095u, 4096u, 262144u, 20000000u})
+    ids.push_back(wheel.add(std::chrono::milliseconds(ticks * epee::net_utils::timer_wheel::TICK_MS), [](){}));
+  for (size_t i = 1; i < ids.size(); ++i)
+    ASSERT_GE(wheel.remaining(ids[i]).count(), wheel.remaining(ids[i - 1]).count());
+  for (auto id: ids)
+    ASSERT_TRUE(wheel.cancel(id));
+  ASSERT_EQ(wheel.size(), 0);
+}
+
+TEST(TimerWheel, CrossesLevels)
+{
+  boost::asio::io_service io_service;
+  epee::net_utils::timer_wheel &wheel = epee::net_utils::timer_wheel::get(io_service);
+  const unsigned ms = 66 * epee::net_utils::timer_wheel::TICK_MS;
+  std::chrono::milliseconds elapsed(0);
+  const auto start = std::chrono::steady_clock::now();
+  wheel.add(std::chrono::milliseconds(ms), [&]() {
+    elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  });
+  io_service.run();
+  ASSERT_GE(elapsed.count(), ms);
+  ASSERT_LT(elapsed.count(), ms + 1000);
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include "gtest/gtest.h"
+
+#include "common/flat_hash_map.h"
+
+namespace
+{
+  // all keys collide, to exercise probing and backward shifts
+  struct bad_hash
+  {
+    size_t operator()(uint64_t k) const { return k & 3; }
+  };
+}
+
+TEST(flat_hash_map, empty)
+{
+  tools::flat_hash_map<uint64_t, int> m;
+  ASSERT_TRUE(m.empty());
+  ASSERT_TRUE(m.find(0) == m.end());
+  ASSERT_EQ(m.erase(0), 0);
+  ASSERT_TRUE(m.begin() == m.end());
+}
+
+TEST(flat_hash_map, insert_find_erase)
+{
+  tools::flat_hash_map<uint64_t, uint64_t> m;
+  for (uint64_t i = 0; i < 1000; ++i)
+    ASSERT_TRUE(m.emplace(i * 7919, i).second);
+  ASSERT_FALSE(m.emplace(0, 42).second);
+  ASSERT_EQ(m.size(), 1000);
+  for (uint64_t i = 0; i < 1000; ++i)
+  {
+    auto it = m.find(i * 7919);
+    ASSERT_TRUE(it != m.end());
+    ASSERT_EQ(it->second, i);
+  }
+  for (uint64_t i = 0; i < 1000; i += 2)
+    ASSERT_EQ(m.erase(i * 7919), 1);
+  ASSERT_EQ(m.size(), 500);
+  for (uint64_t i = 0; i < 1000; ++i)
+    ASSERT_EQ(m.count(i * 7919), i & 1);
+}
+
+TEST(flat_hash_map, collisions)
+{
+  // random inserts and erases, checked against std::map
+  tools::flat_hash_map<uint64_t, uint64_t, bad_hash> m;
+  std::map<uint64_t, uint64_t> ref;
+  uint64_t seed = 1;
+  for (int n = 0; n < 20000; ++n)
+  {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    const uint64_t k = (seed >> 33) % 64;
+    if ((seed >> 20) & 1)
+    {
+      m[k] = seed;
+      ref[k] = seed;
+    }
+    else
+    {
+      ASSERT_EQ(m.erase(k), ref.erase(k));
+    }
+    ASSERT_EQ(m.size(), ref.size());
+  }
+  for (const auto &e: ref)
+  {
+    auto it = m.find(e.first);
+    ASSERT_TRUE(it != m.end());
+    ASSERT_EQ(it->second, e.second);
+  }
+  size_t n = 0;
+  for (const auto &e: m)
+  {
+    ASSERT_EQ(ref[e.first], e.second);
+    ++n;
+  }
+  ASSERT_EQ(n, ref.size());
+}
+
+TEST(flat_hash_map, erase_iterator)
+{
+  tools::flat_hash_map<uint64_t, std::vector<int>> m;
+  m[1].push_back(1);
+  m[2].push_back(2);
+  m.erase(m.find(1));
+  ASSERT_EQ(m.size(), 1);
+  ASSERT_TRUE(m.find(1) == m.end());
+  ASSERT_EQ(m.find(2)->second.size(), 1);
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "cryptonote_protocol/get_objects_serialization.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  block_complete_entry make_entry(size_t n, size_t txes)
+  {
+    block_complete_entry e;
+    e.block = std::string(80 + n, 'b' + n % 16);
+    for (size_t i = 0; i < txes; ++i)
+      e.txs.push_back(std::string(100 + i * 7, 't' + i % 4));
+    return e;
+  }
+
+  void check(const NOTIFY_RESPONSE_GET_OBJECTS::request &full)
+  {
+    std::string expected;
+    ASSERT_TRUE(epee::serialization::store_t_to_binary(full, expected));
+
+    NOTIFY_RESPONSE_GET_OBJECTS::request rsp = full;
+    rsp.blocks.clear();
+    std::vector<std::shared_ptr<const std::string>> blocks;
+    for (const auto &e: full.blocks)
+      blocks.push_back(std::make_shared<const std::string>(get_objects_serialization::serialize_block_entry(e)));
+    std::string blob;
+    ASSERT_TRUE(get_objects_serialization::serialize_response(rsp, blocks, blob));
+    EXPECT_EQ(blob, expected);
+
+    NOTIFY_RESPONSE_GET_OBJECTS::request loaded;
+    ASSERT_TRUE(epee::serialization::load_t_from_binary(loaded, blob));
+    ASSERT_EQ(loaded.blocks.size(), full.blocks.size());
+    for (size_t i = 0; i < full.blocks.size(); ++i)
+    {
+      EXPECT_EQ(loaded.blocks[i].block, full.blocks[i].block);
+      EXPECT_EQ(loaded.blocks[i].txs, full.blocks[i].txs);
+    }
+    EXPECT_EQ(loaded.txs, full.txs);
+    EXPECT_EQ(loaded.missed_ids, full.missed_ids);
+    EXPECT_EQ(loaded.current_blockchain_height, full.current_blockchain_height);
+  }
+}
+
+TEST(get_objects_serialization, empty)
+{
+  NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
+  rsp.current_blockchain_height = 1234;
+  check(rsp);
+}
+
+TEST(get_objects_serialization, blocks_only)
+{
+  NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
+  rsp.current_blockchain_height = 5000000;
+  for (size_t n = 0; n < 3; ++n)
+    rsp.blocks.push_back(make_entry(n, n));
+  check(rsp);
+}
+
+TEST(get_objects_serialization, all_fields)
+{
+  NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
+  rsp.current_blockchain_height = 77;
+  // enough blocks for a two byte count
+  for (size_t n = 0; n < 70; ++n)
+    rsp.blocks.push_back(make_entry(n, n % 5));
+  for (size_t n = 0; n < 70; ++n)
+    rsp.txs.push_back(std::string(n, 'x'));
+  rsp.missed_ids.push_back(crypto::null_hash);
+  check(rsp);
+}
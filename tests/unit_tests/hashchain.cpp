@@ -127,3 +127,39 @@ TEST(hashchain, trim)
   ASSERT_FALSE(hashchain.empty());
   ASSERT_EQ(hashchain.genesis(), make_hash(1));
 }
+
+TEST(hashchain, trim_sparse)
+{
+  tools::hashchain hashchain;
+  for (uint64_t n = 1; n <= 10; ++n)
+    hashchain.push_back(make_hash(n));
+  hashchain.trim(8, 3);
+  ASSERT_EQ(hashchain.offset(), 8);
+  ASSERT_EQ(hashchain.size(), 10);
+  ASSERT_EQ(hashchain.sparse().size(), 2);
+  ASSERT_EQ(hashchain.sparse().at(3), make_hash(4));
+  ASSERT_EQ(hashchain.sparse().at(6), make_hash(7));
+  hashchain.trim(9);
+  ASSERT_EQ(hashchain.sparse().size(), 2);
+  hashchain.clear();
+  ASSERT_TRUE(hashchain.sparse().empty());
+}
+
+TEST(hashchain, rebase)
+{
+  tools::hashchain hashchain;
+  for (uint64_t n = 1; n <= 10; ++n)
+    hashchain.push_back(make_hash(n));
+  hashchain.trim(8, 3);
+  ASSERT_FALSE(hashchain.rebase(5));
+  ASSERT_FALSE(hashchain.rebase(8));
+  ASSERT_TRUE(hashchain.rebase(6));
+  ASSERT_EQ(hashchain.offset(), 6);
+  ASSERT_EQ(hashchain.size(), 7);
+  ASSERT_EQ(hashchain[6], make_hash(7));
+  ASSERT_EQ(hashchain.sparse().size(), 1);
+  ASSERT_EQ(hashchain.genesis(), make_hash(1));
+  hashchain.push_back(make_hash(100));
+  ASSERT_EQ(hashchain.size(), 8);
+  ASSERT_EQ(hashchain[7], make_hash(100));
+}
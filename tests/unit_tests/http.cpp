@@ -28,6 +28,9 @@
 
 #include "gtest/gtest.h"
 #include "net/http_auth.h"
+#ifdef HTTP_ENABLE_GZIP
+#include "gzip_encoding.h"
+#endif
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -743,3 +746,34 @@ TEST(HTTP, Add_Field)
 
   EXPECT_STREQ("leading textfoo: bar\r\nbar: foo\r\nmoarbars: moarfoo\r\n", str.c_str());
 }
+
+#ifdef HTTP_ENABLE_GZIP
+namespace
+{
+  struct collect_target: epee::net_utils::i_target_handler
+  {
+    std::string data;
+    virtual bool handle_target_data(std::string& piece) { data += piece; piece.clear(); return true; }
+  };
+}
+
+TEST(HTTP_Gzip, RoundTrip)
+{
+  std::string body;
+  for (int i = 0; i < 20000; ++i)
+    body += std::to_string(i * 7919 % 1000) + ",";
+  std::string packed;
+  ASSERT_TRUE(epee::net_utils::gzip_pack(body, packed));
+  EXPECT_LT(packed.size(), body.size());
+
+  // the client gets the body in pieces as they come off the socket
+  collect_target target;
+  epee::net_utils::content_encoding_gzip decoder(&target);
+  for (size_t offset = 0; offset < packed.size(); offset += 100)
+  {
+    std::string piece = packed.substr(offset, 100);
+    ASSERT_TRUE(decoder.update_in(piece));
+  }
+  EXPECT_EQ(body, target.data);
+}
+#endif
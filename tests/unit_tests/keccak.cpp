@@ -26,6 +26,9 @@
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <string>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 extern "C" {
@@ -148,3 +151,37 @@ TEST(keccak, 137_and_1_136)
   TEST_KECCAK(137, chunks);
 }
 
+
+TEST(keccak, multi)
+{
+  // mixed lengths around the rate so some groups of four share a block
+  // count and some do not
+  static const size_t lengths[] = {0, 32, 64, 64, 64, 64, 135, 136, 137, 271, 272, 300, 64, 64, 64, 64, 1};
+  static const size_t n = sizeof(lengths) / sizeof(lengths[0]);
+  std::vector<std::string> data(n);
+  const uint8_t *in[n];
+  for (size_t i = 0; i < n; ++i)
+  {
+    data[i].resize(lengths[i]);
+    for (size_t j = 0; j < lengths[i]; ++j)
+      data[i][j] = i * 31 + j * 17;
+    in[i] = (const uint8_t*)data[i].data();
+  }
+  for (int mdlen: {32, 200})
+  {
+    std::vector<uint8_t> expected(n * mdlen), md(n * mdlen);
+    for (size_t i = 0; i < n; ++i)
+      keccak(in[i], lengths[i], expected.data() + i * mdlen, mdlen);
+    for (int backend: {KECCAK_BACKEND_PORTABLE, KECCAK_BACKEND_AVX2})
+    {
+      if (!keccak_backend_supported(backend))
+        continue;
+      memset(md.data(), 0, md.size());
+      keccak_multi_backend(backend, in, lengths, n, md.data(), mdlen);
+      ASSERT_EQ(memcmp(md.data(), expected.data(), md.size()), 0);
+    }
+    memset(md.data(), 0, md.size());
+    keccak_multi(in, lengths, n, md.data(), mdlen);
+    ASSERT_EQ(memcmp(md.data(), expected.data(), md.size()), 0);
+  }
+}
@@ -0,0 +1,363 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <map>
+#include <unordered_map>
+#include "gtest/gtest.h"
+
+#include "blockchain_db/blockchain_db.h"
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "cryptonote_core/light_wallet_scanner.h"
+
+using namespace cryptonote;
+
+namespace
+{
+  class TestDB: public BlockchainDB {
+  public:
+    TestDB() {};
+    virtual void open(const std::string& filename, const int db_flags = 0) { }
+    virtual void close() {}
+    virtual void sync() {}
+    virtual void safesyncmode(const bool onoff) {}
+    virtual void reset() {}
+    virtual std::vector<std::string> get_filenames() const { return std::vector<std::string>(); }
+    virtual bool remove_data_file(const std::string& folder) const { return true; }
+    virtual std::string get_db_name() const { return std::string(); }
+    virtual bool lock() { return true; }
+    virtual void unlock() { }
+    virtual bool batch_start(uint64_t batch_num_blocks=0, uint64_t batch_bytes=0) { return true; }
+    virtual void batch_stop() {}
+    virtual void set_batch_transactions(bool) {}
+    virtual void block_txn_start(bool readonly=false) {}
+    virtual void block_txn_stop() {}
+    virtual void block_txn_abort() {}
+    virtual void drop_hard_fork_info() {}
+    virtual bool block_exists(const crypto::hash& h, uint64_t *height) const { return false; }
+    virtual blobdata get_block_blob_from_height(const uint64_t& height) const { return cryptonote::t_serializable_object_to_blob(get_block_from_height(height)); }
+    virtual blobdata get_block_blob(const crypto::hash& h) const { return blobdata(); }
+    virtual bool get_block_filter(uint64_t height, cryptonote::blobdata& filter) const { return false; }
+    virtual bool get_pow_hash(const crypto::hash& blk_hash, crypto::hash& pow_hash) const { return false; }
+    virtual bool has_explorer_index() const { return false; }
+    virtual bool get_key_image_spender(const crypto::key_image& k_image, crypto::hash& tx_hash) const { return false; }
+    virtual bool get_output_locations(const crypto::public_key& key, std::vector<output_location_t>& locations) const { return false; }
+    virtual uint32_t get_blockchain_pruning_seed() const { return 0; }
+    virtual bool prune_blockchain(uint32_t pruning_seed = 0) { return true; }
+    virtual bool update_pruning() { return true; }
+    virtual void add_pow_hash(const crypto::hash& blk_hash, const crypto::hash& pow_hash) {}
+    virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const { return false; }
+    virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const { return false; }
+    virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const { return false; }
+    virtual uint64_t get_block_height(const crypto::hash& h) const { return 0; }
+    virtual block_header get_block_header(const crypto::hash& h) const { return block_header(); }
+    virtual uint64_t get_block_timestamp(const uint64_t& height) const { return 0; }
+    virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const { return {}; }
+    virtual uint64_t get_top_block_timestamp() const { return 0; }
+    virtual size_t get_block_weight(const uint64_t& height) const { return 128; }
+    virtual difficulty_type get_block_cumulative_difficulty(const uint64_t& height) const { return 10; }
+    virtual difficulty_type get_block_difficulty(const uint64_t& height) const { return 0; }
+    virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const { return 10000000000; }
+    virtual void get_block_cumulative_emission_and_fees(const uint64_t& height, uint64_t &emission, uint64_t &fees) const { emission = fees = 0; }
+    virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const { return crypto::hash(); }
+    virtual std::vector<block> get_blocks_range(const uint64_t& h1, const uint64_t& h2) const { return std::vector<block>(); }
+    virtual std::vector<crypto::hash> get_hashes_range(const uint64_t& h1, const uint64_t& h2) const { return std::vector<crypto::hash>(); }
+    virtual crypto::hash top_block_hash() const { return crypto::hash(); }
+    virtual block get_top_block() const { return block(); }
+    virtual uint64_t height() const { return blocks.size(); }
+    virtual bool tx_exists(const crypto::hash& h) const { return false; }
+    virtual bool tx_exists(const crypto::hash& h, uint64_t& tx_index) const {
+      const auto i = tx_indices.find(h);
+      if (i == tx_indices.end())
+        return false;
+      tx_index = i->second;
+      return true;
+    }
+    virtual uint64_t get_tx_unlock_time(const crypto::hash& h) const { return 0; }
+    virtual transaction get_tx(const crypto::hash& h) const { return txs.at(h); }
+    virtual bool get_tx(const crypto::hash& h, transaction &tx) const { return false; }
+    virtual uint64_t get_tx_count() const { return 0; }
+    virtual std::vector<transaction> get_tx_list(const std::vector<crypto::hash>& hlist) const { return std::vector<transaction>(); }
+    virtual uint64_t get_tx_block_height(const crypto::hash& h) const { return 0; }
+    virtual uint64_t get_num_outputs(const uint64_t& amount) const { return 1; }
+    virtual uint64_t get_indexing_base() const { return 0; }
+    virtual output_data_t get_output_key(const uint64_t& amount, const uint64_t& index) { return output_data_t(); }
+    virtual tx_out_index get_output_tx_and_index_from_global(const uint64_t& index) const { return tx_out_index(); }
+    virtual tx_out_index get_output_tx_and_index(const uint64_t& amount, const uint64_t& index) const { return tx_out_index(); }
+    virtual void get_output_tx_and_index(const uint64_t& amount, const std::vector<uint64_t> &offsets, std::vector<tx_out_index> &indices) const {}
+    virtual void get_output_key(const uint64_t &amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial = false) {}
+    virtual bool can_thread_bulk_indices() const { return false; }
+    virtual std::vector<uint64_t> get_tx_output_indices(const crypto::hash& h) const { return std::vector<uint64_t>(); }
+    virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_index) const { return output_indices.at(tx_index); }
+    virtual bool has_key_image(const crypto::key_image& img) const { return false; }
+    virtual void remove_block() { blocks.pop_back(); }
+    virtual void add_block_filter(uint64_t height, const cryptonote::blobdata& filter) {}
+    virtual uint64_t add_transaction_data(const crypto::hash& blk_hash, const transaction& tx, const crypto::hash& tx_hash, const crypto::hash& tx_prunable_hash) {return 0;}
+    virtual void remove_transaction_data(const crypto::hash& tx_hash, const transaction& tx) {}
+    virtual uint64_t add_output(const crypto::hash& tx_hash, const tx_out& tx_output, const uint64_t& local_index, const uint64_t unlock_time, const rct::key *commitment) {return 0;}
+    virtual void add_tx_amount_output_indices(const uint64_t tx_index, const std::vector<uint64_t>& amount_output_indices) {}
+    virtual void add_spent_key(const crypto::key_image& k_image) {}
+    virtual void remove_spent_key(const crypto::key_image& k_image) {}
+
+    virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const { return true; }
+    virtual bool for_blocks_range(const uint64_t&, const uint64_t&, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const { return true; }
+    virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>, bool pruned) const { return true; }
+    virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const { return true; }
+    virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const { return true; }
+    virtual bool is_read_only() const { return false; }
+    virtual std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>> get_output_histogram(const std::vector<uint64_t> &amounts, bool unlocked, uint64_t recent_cutoff, uint64_t min_count) const { return std::map<uint64_t, std::tuple<uint64_t, uint64_t, uint64_t>>(); }
+    virtual bool get_output_distribution(uint64_t amount, uint64_t from_height, uint64_t to_height, std::vector<uint64_t> &distribution, uint64_t &base) const { return false; }
+
+    virtual void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t& details) {}
+    virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& details) {}
+    virtual uint64_t get_txpool_tx_count(bool include_unrelayed_txes = true) const { return 0; }
+    virtual bool txpool_has_tx(const crypto::hash &txid) const { return false; }
+    virtual void remove_txpool_tx(const crypto::hash& txid) {}
+    virtual bool get_txpool_tx_meta(const crypto::hash& txid, txpool_tx_meta_t &meta) const { return false; }
+    virtual bool get_txpool_tx_blob(const crypto::hash& txid, cryptonote::blobdata &bd) const { return false; }
+    virtual uint64_t get_database_size() const { return 0; }
+    virtual cryptonote::blobdata get_txpool_tx_blob(const crypto::hash& txid) const { return ""; }
+    virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)>, bool include_blob = false, bool include_unrelayed_txes = false) const { return false; }
+    virtual void add_alt_block(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata &blob) {}
+    virtual bool get_alt_block(const crypto::hash &blkid, cryptonote::alt_block_data_t *data, cryptonote::blobdata *blob) const { return false; }
+    virtual void remove_alt_block(const crypto::hash &blkid) {}
+    virtual uint64_t get_alt_block_count() { return 0; }
+    virtual void drop_alt_blocks() {}
+    virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const cryptonote::alt_block_data_t &data, const cryptonote::blobdata *blob)> f, bool include_blob = false) const { return true; }
+
+    virtual void add_block( const block& blk
+                          , size_t block_weight
+                          , const difficulty_type& cumulative_difficulty
+                          , const uint64_t& coins_generated
+                          , uint64_t num_rct_outs
+                          , uint64_t emission
+                          , uint64_t fees
+                          , const crypto::hash& blk_hash
+                          ) {
+      blocks.push_back(blk);
+    }
+    virtual block get_block_from_height(const uint64_t& height) const {
+      return blocks.at(height);
+    }
+    virtual void set_hard_fork_version(uint64_t height, uint8_t version) {}
+    virtual uint8_t get_hard_fork_version(uint64_t height) const { return 1; }
+    virtual void check_hard_fork_info() {}
+
+    // adds a block and its txs, numbering the outputs of each amount in turn
+    void add(const block &b, const std::vector<transaction> &block_txs)
+    {
+      blocks.push_back(b);
+      add_tx(b.miner_tx);
+      for (const transaction &tx: block_txs)
+        add_tx(tx);
+    }
+    void pop() { blocks.pop_back(); }
+
+  private:
+    void add_tx(const transaction &tx)
+    {
+      const crypto::hash h = get_transaction_hash(tx);
+      tx_indices[h] = output_indices.size();
+      txs[h] = tx;
+      std::vector<uint64_t> indices;
+      for (const tx_out &out: tx.vout)
+        indices.push_back(num_outputs[out.amount]++);
+      output_indices.push_back(indices);
+    }
+
+    std::vector<block> blocks;
+    std::unordered_map<crypto::hash, uint64_t> tx_indices;
+    std::unordered_map<crypto::hash, transaction> txs;
+    std::vector<std::vector<uint64_t>> output_indices;
+    std::map<uint64_t, uint64_t> num_outputs;
+  };
+
+  block make_block(const account_public_address &miner, uint64_t height)
+  {
+    block b;
+    b.major_version = 1;
+    b.minor_version = 1;
+    b.timestamp = 1000000 + height;
+    b.prev_id = crypto::null_hash;
+    b.nonce = 0;
+    construct_miner_tx(height, 0, 0, 0, 0, miner, b.miner_tx);
+    return b;
+  }
+
+  uint64_t total_received(const light_wallet_scanner::account_state &state)
+  {
+    uint64_t total = 0;
+    for (const auto &out: state.outputs)
+      total += out.amount;
+    return total;
+  }
+
+  // a tx spending through a ring made of the given outputs of the amount
+  transaction make_spend(uint64_t amount, const std::vector<uint64_t> &ring)
+  {
+    transaction tx;
+    tx.version = 1;
+    tx.unlock_time = 0;
+    txin_to_key in;
+    in.amount = amount;
+    in.key_offsets = absolute_output_offsets_to_relative(ring);
+    in.k_image = crypto::key_image();
+    in.k_image.data[0] = 1;
+    tx.vin.push_back(in);
+    return tx;
+  }
+}
+
+TEST(light_wallet_scanner, login)
+{
+  TestDB db;
+  light_wallet_scanner scanner(db, 1);
+  account_base alice, bob;
+  alice.generate();
+  bob.generate();
+  const account_keys &keys = alice.get_keys();
+
+  ASSERT_EQ(light_wallet_scanner::login_wrong_key, scanner.login(keys.m_account_address, bob.get_keys().m_view_secret_key, true));
+  ASSERT_EQ(light_wallet_scanner::login_not_found, scanner.login(keys.m_account_address, keys.m_view_secret_key, false));
+  ASSERT_EQ(light_wallet_scanner::login_created, scanner.login(keys.m_account_address, keys.m_view_secret_key, true));
+  ASSERT_EQ(light_wallet_scanner::login_existing, scanner.login(keys.m_account_address, keys.m_view_secret_key, false));
+  ASSERT_EQ(light_wallet_scanner::login_too_many_accounts, scanner.login(bob.get_keys().m_account_address, bob.get_keys().m_view_secret_key, true));
+
+  // the view key alone is not enough to read another address
+  account_public_address other = keys.m_account_address;
+  other.m_spend_public_key = bob.get_keys().m_account_address.m_spend_public_key;
+  light_wallet_scanner::account_state state;
+  ASSERT_FALSE(scanner.get_account(other, keys.m_view_secret_key, state));
+  ASSERT_TRUE(scanner.get_account(keys.m_account_address, keys.m_view_secret_key, state));
+  ASSERT_EQ(0, state.start_height);
+}
+
+TEST(light_wallet_scanner, scans_new_blocks_for_all_accounts)
+{
+  TestDB db;
+  light_wallet_scanner scanner(db, 100);
+  std::vector<account_base> accounts(20);
+  for (auto &acc: accounts)
+  {
+    acc.generate();
+    ASSERT_EQ(light_wallet_scanner::login_created, scanner.login(acc.get_keys().m_account_address, acc.get_keys().m_view_secret_key, true));
+  }
+
+  // one block paying each account, each seen by that account only
+  for (size_t i = 0; i < accounts.size(); ++i)
+  {
+    const block b = make_block(accounts[i].get_keys().m_account_address, i);
+    db.add(b, {});
+    scanner.on_block_added(i, b, {});
+  }
+  for (size_t i = 0; i < accounts.size(); ++i)
+  {
+    light_wallet_scanner::account_state state;
+    ASSERT_TRUE(scanner.get_account(accounts[i].get_keys().m_account_address, accounts[i].get_keys().m_view_secret_key, state));
+    ASSERT_EQ(accounts.size(), state.scanned_height);
+    ASSERT_FALSE(state.outputs.empty());
+    ASSERT_EQ(get_outs_money_amount(db.get_block_from_height(i).miner_tx), total_received(state));
+    for (const auto &out: state.outputs)
+    {
+      ASSERT_EQ(i, out.height);
+      ASSERT_TRUE(out.coinbase);
+    }
+  }
+}
+
+TEST(light_wallet_scanner, possible_spends)
+{
+  TestDB db;
+  light_wallet_scanner scanner(db, 10);
+  account_base alice;
+  alice.generate();
+  const account_keys &keys = alice.get_keys();
+  ASSERT_EQ(light_wallet_scanner::login_created, scanner.login(keys.m_account_address, keys.m_view_secret_key, true));
+
+  const block b0 = make_block(keys.m_account_address, 0);
+  db.add(b0, {});
+  scanner.on_block_added(0, b0, {});
+  light_wallet_scanner::account_state state;
+  ASSERT_TRUE(scanner.get_account(keys.m_account_address, keys.m_view_secret_key, state));
+  ASSERT_FALSE(state.outputs.empty());
+  const auto &owned = state.outputs.front();
+  const uint64_t amount = db.get_block_from_height(0).miner_tx.vout[owned.out_index].amount;
+
+  // a ring using the output as a decoy or not, and one which does not
+  account_base bob;
+  bob.generate();
+  block b1 = make_block(bob.get_keys().m_account_address, 1);
+  const std::vector<transaction> txs{make_spend(amount, {owned.global_index, owned.global_index + 5}), make_spend(amount + 1, {owned.global_index})};
+  for (const transaction &tx: txs)
+    b1.tx_hashes.push_back(get_transaction_hash(tx));
+  db.add(b1, txs);
+  scanner.on_block_added(1, b1, txs);
+
+  ASSERT_TRUE(scanner.get_account(keys.m_account_address, keys.m_view_secret_key, state));
+  ASSERT_EQ(1, state.spends.size());
+  ASSERT_EQ(b1.tx_hashes[0], state.spends[0].tx_hash);
+  ASSERT_EQ(0, state.spends[0].output);
+  ASSERT_EQ(1, state.spends[0].mixin);
+}
+
+TEST(light_wallet_scanner, pop_and_catch_up)
+{
+  TestDB db;
+  light_wallet_scanner scanner(db, 10);
+  account_base alice, bob;
+  alice.generate();
+  bob.generate();
+  for (uint64_t h = 0; h < 5; ++h)
+    db.add(make_block((h % 2 ? bob : alice).get_keys().m_account_address, h), {});
+
+  // registered at the top, then asked to import from the start
+  const account_keys &keys = alice.get_keys();
+  ASSERT_EQ(light_wallet_scanner::login_created, scanner.login(keys.m_account_address, keys.m_view_secret_key, true));
+  light_wallet_scanner::account_state state;
+  ASSERT_TRUE(scanner.get_account(keys.m_account_address, keys.m_view_secret_key, state));
+  ASSERT_EQ(5, state.start_height);
+  ASSERT_EQ(0, scanner.catch_up());
+  ASSERT_TRUE(scanner.import_from_genesis(keys.m_account_address, keys.m_view_secret_key));
+  ASSERT_EQ(2, scanner.catch_up(2));
+  ASSERT_EQ(3, scanner.catch_up());
+  ASSERT_TRUE(scanner.get_account(keys.m_account_address, keys.m_view_secret_key, state));
+  ASSERT_EQ(5, state.scanned_height);
+  uint64_t expected = 0;
+  for (uint64_t h = 0; h < 5; h += 2)
+    expected += get_outs_money_amount(db.get_block_from_height(h).miner_tx);
+  ASSERT_EQ(expected, total_received(state));
+
+  // what was found in popped blocks is forgotten
+  const uint64_t popped = get_outs_money_amount(db.get_block_from_height(4).miner_tx);
+  db.pop();
+  scanner.on_blocks_popped(4);
+  ASSERT_TRUE(scanner.get_account(keys.m_account_address, keys.m_view_secret_key, state));
+  ASSERT_EQ(4, state.scanned_height);
+  ASSERT_EQ(expected - popped, total_received(state));
+}
@@ -0,0 +1,141 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include "gtest/gtest.h"
+
+#include "misc_log_ex.h"
+
+namespace
+{
+  class logging: public ::testing::Test
+  {
+  protected:
+    void SetUp()
+    {
+      m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      boost::filesystem::create_directory(m_dir);
+      m_log = (m_dir / "test.log").string();
+      m_categories = mlog_get_categories();
+    }
+
+    void TearDown()
+    {
+      mlog_set_async(false);
+      mlog_configure(mlog_get_default_log_path("unit_tests.log"), true);
+      mlog_set_categories(m_categories.c_str());
+      boost::filesystem::remove_all(m_dir);
+    }
+
+    std::vector<std::string> read_lines(const std::string &marker)
+    {
+      std::vector<std::string> lines;
+      std::ifstream f(m_log);
+      std::string line;
+      while (std::getline(f, line))
+        if (line.find(marker) != std::string::npos)
+          lines.push_back(line);
+      return lines;
+    }
+
+    boost::filesystem::path m_dir;
+    std::string m_log;
+    std::string m_categories;
+  };
+
+  int count(int &n)
+  {
+    return ++n;
+  }
+}
+
+TEST_F(logging, disabled_lines_are_not_built)
+{
+  mlog_configure(m_log, false);
+  mlog_set_categories("logging_test:WARNING");
+  int n = 0;
+  MCDEBUG("logging_test", "debug " << count(n));
+  ASSERT_EQ(0, n);
+  MCWARNING("logging_test", "warning " << count(n));
+  ASSERT_EQ(1, n);
+
+  // changing the categories is seen at once
+  mlog_set_categories("logging_test:DEBUG");
+  MCDEBUG("logging_test", "debug " << count(n));
+  ASSERT_EQ(2, n);
+  MCTRACE("logging_test", "trace " << count(n));
+  ASSERT_EQ(2, n);
+
+  // the name, not the pointer, picks the category
+  std::string category = "logging_test";
+  MCDEBUG(category.c_str(), "debug " << count(n));
+  ASSERT_EQ(3, n);
+  category = "logging_other";
+  MCDEBUG(category.c_str(), "debug " << count(n));
+  ASSERT_EQ(3, n);
+}
+
+TEST_F(logging, async_keeps_lines_in_order)
+{
+  mlog_configure(m_log, false);
+  mlog_set_categories("logging_test:WARNING");
+  ASSERT_TRUE(mlog_set_async(true, 64));
+  ASSERT_TRUE(mlog_is_async());
+  // warnings are never dropped, even from a small queue
+  for (int i = 0; i < 1000; ++i)
+    MCWARNING("logging_test", "async line " << i);
+  ASSERT_TRUE(mlog_set_async(false));
+  ASSERT_FALSE(mlog_is_async());
+  MCWARNING("logging_test", "async line 1000");
+
+  const std::vector<std::string> lines = read_lines("async line ");
+  ASSERT_EQ(1001, lines.size());
+  for (size_t i = 0; i < lines.size(); ++i)
+  {
+    const std::string expected = "async line " + std::to_string(i);
+    ASSERT_EQ(expected, lines[i].substr(lines[i].size() - expected.size()));
+  }
+}
+
+TEST_F(logging, async_rolls_files)
+{
+  mlog_configure(m_log, false, 4096, 3);
+  mlog_set_categories("logging_test:WARNING");
+  ASSERT_TRUE(mlog_set_async(true));
+  for (int i = 0; i < 1000; ++i)
+    MCWARNING("logging_test", "rolled line " << i);
+  ASSERT_TRUE(mlog_set_async(false));
+
+  size_t files = 0;
+  for (boost::filesystem::directory_iterator i(m_dir), end; i != end; ++i)
+    ++files;
+  ASSERT_LE(2, files);
+  ASSERT_GE(3, files);
+  ASSERT_GE(4096 + 256, boost::filesystem::file_size(m_log));
+}
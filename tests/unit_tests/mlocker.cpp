@@ -192,4 +192,53 @@ TEST(mlocker, mlocked)
   ASSERT_EQ(epee::mlocker::get_num_locked_objects(), base_objects + 0);
 }
 
+TEST(mlocker, arena)
+{
+  const size_t base_pages = epee::mlocker::get_num_locked_pages();
+  const size_t base_objects = epee::mlocker::get_num_locked_objects();
+  const size_t base_blocks = epee::mlocked_arena::get_num_allocated_blocks();
+  void *p0 = epee::mlocked_arena::allocate(32);
+  ASSERT_TRUE(p0 != NULL);
+  void *p1 = epee::mlocked_arena::allocate(20);
+  ASSERT_TRUE(p1 != NULL);
+  ASSERT_NE(p0, p1);
+  ASSERT_TRUE(epee::mlocked_arena::contains(p0, 32));
+  ASSERT_EQ(epee::mlocked_arena::get_num_allocated_blocks(), base_blocks + 2);
+  ASSERT_TRUE(epee::mlocked_arena::allocate(epee::mlocked_arena::max_block_size + 1) == NULL);
+
+  // objects placed in the arena need no page locking of their own
+  struct Foo { uint64_t u; };
+  epee::mlocked<Foo> *l = new (p0) epee::mlocked<Foo>();
+  ASSERT_EQ(epee::mlocker::get_num_locked_pages(), base_pages);
+  ASSERT_EQ(epee::mlocker::get_num_locked_objects(), base_objects + 1);
+  l->~mlocked<Foo>();
+  ASSERT_EQ(epee::mlocker::get_num_locked_objects(), base_objects);
+
+  // freed blocks are wiped and reused
+  memset(p1, 0x55, 20);
+  ASSERT_TRUE(epee::mlocked_arena::deallocate(p1, 20));
+  void *p2 = epee::mlocked_arena::allocate(24);
+  ASSERT_EQ(p1, p2);
+  ASSERT_EQ(((const char*)p2)[16], 0);
+  ASSERT_TRUE(epee::mlocked_arena::deallocate(p0, 32));
+  ASSERT_TRUE(epee::mlocked_arena::deallocate(p2, 24));
+  ASSERT_EQ(epee::mlocked_arena::get_num_allocated_blocks(), base_blocks);
+
+  char c;
+  ASSERT_FALSE(epee::mlocked_arena::contains(&c, 1));
+  ASSERT_FALSE(epee::mlocked_arena::deallocate(&c, 1));
+}
+
+TEST(mlocker, allocator_fallback)
+{
+  const size_t page_size = epee::mlocker::get_page_size();
+  const size_t base_pages = epee::mlocker::get_num_locked_pages();
+  epee::mlocked_allocator<char> allocator;
+  char *p = allocator.allocate(page_size * 2);
+  ASSERT_FALSE(epee::mlocked_arena::contains(p, page_size * 2));
+  ASSERT_TRUE(epee::mlocker::get_num_locked_pages() >= base_pages + 2);
+  allocator.deallocate(p, page_size * 2);
+  ASSERT_EQ(epee::mlocker::get_num_locked_pages(), base_pages);
+}
+
 #endif
@@ -0,0 +1,69 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "net/network_throttle-detail.hpp"
+
+using epee::net_utils::network_token_bucket;
+
+TEST(network_token_bucket, no_limit)
+{
+  network_token_bucket bucket("test");
+  bucket.set_target_speed(0);
+  for (int i = 0; i < 100; ++i)
+    ASSERT_EQ(bucket.reserve(1024 * 1024), 0);
+  ASSERT_EQ(bucket.get_target_speed(), 0);
+}
+
+TEST(network_token_bucket, burst_then_wait)
+{
+  network_token_bucket bucket("test", 1.0);
+  bucket.set_target_speed(1);
+  ASSERT_EQ(bucket.get_target_speed(), 1);
+
+  // one second worth fits in the burst allowance
+  ASSERT_EQ(bucket.reserve(1024), 0);
+  ASSERT_NEAR(bucket.get_sleep_time(1024), 1.0, 0.1);
+  // peeking does not take anything
+  ASSERT_NEAR(bucket.get_sleep_time(1024), 1.0, 0.1);
+
+  // each further reservation queues behind the previous ones
+  ASSERT_NEAR(bucket.reserve(1024), 1.0, 0.1);
+  ASSERT_NEAR(bucket.reserve(512), 1.5, 0.1);
+  ASSERT_NEAR(bucket.reserve(512), 2.0, 0.1);
+}
+
+TEST(network_token_bucket, speed_change)
+{
+  network_token_bucket bucket("test", 1.0);
+  bucket.set_target_speed(1);
+  ASSERT_EQ(bucket.reserve(1024), 0);
+  ASSERT_GT(bucket.reserve(1024), 0.9);
+  bucket.set_target_speed(0);
+  ASSERT_EQ(bucket.reserve(1024 * 1024), 0);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "cryptonote_config.h"
+#include "common/pruning.h"
+
+#define ASSERT_EX(x) do { bool ex = false; try { x; } catch(...) { ex = true; } ASSERT_TRUE(ex); } while(0)
+
+TEST(pruning, seeds)
+{
+  ASSERT_EX(tools::make_pruning_seed(0, 3));
+  ASSERT_EX(tools::make_pruning_seed(9, 3));
+  ASSERT_EX(tools::make_pruning_seed(1, 8));
+  for (uint32_t log_stripes = 1; log_stripes <= tools::PRUNING_SEED_LOG_STRIPES_MASK; ++log_stripes)
+  {
+    for (uint32_t stripe = 1; stripe <= (1u << log_stripes); ++stripe)
+    {
+      const uint32_t seed = tools::make_pruning_seed(stripe, log_stripes);
+      ASSERT_NE(seed, 0);
+      ASSERT_EQ(tools::get_pruning_log_stripes(seed), log_stripes);
+      ASSERT_EQ(tools::get_pruning_stripe(seed), stripe);
+    }
+  }
+  ASSERT_EQ(tools::get_pruning_stripe(0), 0);
+}
+
+TEST(pruning, stripes)
+{
+  const uint64_t blockchain_height = 20 * CRYPTONOTE_PRUNING_STRIPE_SIZE + CRYPTONOTE_PRUNING_TIP_BLOCKS;
+  ASSERT_EQ(tools::get_pruning_stripe(0, blockchain_height, 3), 1);
+  ASSERT_EQ(tools::get_pruning_stripe(CRYPTONOTE_PRUNING_STRIPE_SIZE - 1, blockchain_height, 3), 1);
+  ASSERT_EQ(tools::get_pruning_stripe(CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, 3), 2);
+  ASSERT_EQ(tools::get_pruning_stripe(8 * CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, 3), 1);
+  ASSERT_EQ(tools::get_pruning_stripe(blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS - 1, blockchain_height, 3), 4);
+  ASSERT_EQ(tools::get_pruning_stripe(blockchain_height - CRYPTONOTE_PRUNING_TIP_BLOCKS, blockchain_height, 3), 0);
+  ASSERT_EQ(tools::get_pruning_seed(blockchain_height - 1, blockchain_height, 3), 0);
+  ASSERT_EQ(tools::get_pruning_seed(CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, 3), tools::make_pruning_seed(2, 3));
+
+  for (uint32_t stripe = 1; stripe <= 8; ++stripe)
+  {
+    const uint32_t seed = tools::make_pruning_seed(stripe, 3);
+    uint64_t kept = 0;
+    for (uint64_t h = 0; h < blockchain_height; h += CRYPTONOTE_PRUNING_STRIPE_SIZE / 4)
+      kept += tools::has_unpruned_block(h, blockchain_height, seed);
+    // a stripe in eight, and the whole tip
+    const uint64_t tip = (CRYPTONOTE_PRUNING_TIP_BLOCKS + CRYPTONOTE_PRUNING_STRIPE_SIZE / 4 - 1) / (CRYPTONOTE_PRUNING_STRIPE_SIZE / 4);
+    ASSERT_EQ(kept, (stripe <= 4 ? 3 : 2) * 4 + tip);
+  }
+  ASSERT_TRUE(tools::has_unpruned_block(CRYPTONOTE_PRUNING_STRIPE_SIZE, blockchain_height, 0));
+}
+
+TEST(pruning, next_heights)
+{
+  const uint64_t blockchain_height = 20 * CRYPTONOTE_PRUNING_STRIPE_SIZE + 123 + CRYPTONOTE_PRUNING_TIP_BLOCKS;
+  for (uint32_t stripe = 1; stripe <= 8; ++stripe)
+  {
+    const uint32_t seed = tools::make_pruning_seed(stripe, 3);
+    for (uint64_t h = 0; h < blockchain_height; h += 97)
+    {
+      uint64_t next_unpruned = h;
+      while (next_unpruned < blockchain_height && !tools::has_unpruned_block(next_unpruned, blockchain_height, seed))
+        ++next_unpruned;
+      ASSERT_EQ(tools::get_next_unpruned_block_height(h, blockchain_height, seed), next_unpruned);
+
+      uint64_t next_pruned = h;
+      while (next_pruned < blockchain_height && tools::has_unpruned_block(next_pruned, blockchain_height, seed))
+        ++next_pruned;
+      ASSERT_EQ(tools::get_next_pruned_block_height(h, blockchain_height, seed), next_pruned);
+    }
+  }
+  ASSERT_EQ(tools::get_next_pruned_block_height(0, blockchain_height, 0), blockchain_height);
+  ASSERT_EQ(tools::get_next_unpruned_block_height(5, blockchain_height, 0), 5);
+}
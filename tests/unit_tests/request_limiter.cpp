@@ -0,0 +1,88 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <atomic>
+#include "gtest/gtest.h"
+#include "common/request_limiter.h"
+
+TEST(request_limiter, unknown_kinds_not_limited)
+{
+  tools::request_limiter limiter;
+  limiter.set_total_limit(1);
+  limiter.set_limit("heavy", 0);
+  tools::request_limiter::slot heavy(limiter, "heavy");
+  ASSERT_TRUE(!!heavy);
+  for (int i = 0; i < 10; ++i)
+    ASSERT_TRUE(limiter.try_acquire("cheap"));
+  ASSERT_EQ(limiter.running(), 1u);
+  ASSERT_EQ(limiter.running("cheap"), 0u);
+}
+
+TEST(request_limiter, per_kind_limit)
+{
+  tools::request_limiter limiter;
+  limiter.set_limit("a", 1);
+  limiter.set_limit("b", 0);
+  ASSERT_TRUE(limiter.try_acquire("a"));
+  ASSERT_FALSE(limiter.try_acquire("a"));
+  ASSERT_TRUE(limiter.try_acquire("b"));
+  ASSERT_TRUE(limiter.try_acquire("b"));
+  limiter.release("a");
+  ASSERT_TRUE(limiter.try_acquire("a"));
+  ASSERT_EQ(limiter.running("a"), 1u);
+  ASSERT_EQ(limiter.running("b"), 2u);
+}
+
+TEST(request_limiter, total_limit)
+{
+  tools::request_limiter limiter;
+  limiter.set_total_limit(2);
+  limiter.set_limit("a", 0);
+  limiter.set_limit("b", 0);
+  {
+    tools::request_limiter::slot s0(limiter, "a");
+    tools::request_limiter::slot s1(limiter, "b");
+    tools::request_limiter::slot s2(limiter, "a");
+    ASSERT_TRUE(!!s0);
+    ASSERT_TRUE(!!s1);
+    ASSERT_FALSE(!!s2);
+    ASSERT_EQ(limiter.running(), 2u);
+  }
+  ASSERT_EQ(limiter.running(), 0u);
+  ASSERT_EQ(limiter.running("a"), 0u);
+}
+
+TEST(request_limiter, aliases_share_a_kind)
+{
+  tools::request_limiter limiter;
+  limiter.set_limit("/get_blocks.bin", 1);
+  limiter.add_alias("/getblocks.bin", "/get_blocks.bin");
+  tools::request_limiter::slot s0(limiter, "/getblocks.bin");
+  ASSERT_TRUE(!!s0);
+  ASSERT_FALSE(limiter.try_acquire("/get_blocks.bin"));
+  ASSERT_EQ(limiter.running("/get_blocks.bin"), 1u);
+}
@@ -1116,3 +1116,86 @@ TEST(ringct, aggregated)
 
   ASSERT_TRUE(verRctSemanticsSimple(sp));
 }
+
+TEST(ringct, hashToPoint_p3)
+{
+  for (size_t n = 0; n < 16; ++n)
+  {
+    const key k = skGen();
+    ge_p3 p;
+    key compressed;
+    hashToPoint(p, k);
+    ge_p3_tobytes(compressed.bytes, &p);
+    ASSERT_EQ(compressed, hashToPoint(k));
+    ASSERT_FALSE(ge_p3_is_identity_vartime(&p));
+
+    // p - p is the identity, but not with the limbs of ge_p3_identity
+    ge_cached cached;
+    ge_p1p1 diff;
+    ge_p3 zero;
+    ge_p3_to_cached(&cached, &p);
+    ge_sub(&diff, &p, &cached);
+    ge_p1p1_to_p3(&zero, &diff);
+    ASSERT_TRUE(ge_p3_is_identity_vartime(&zero));
+  }
+  ASSERT_TRUE(ge_p3_is_identity_vartime(&ge_p3_identity));
+}
+
+TEST(ringct, base_table)
+{
+  // a table built for G matches ref10's static one
+  ge_p3 G_p3;
+  ASSERT_EQ(ge_frombytes_vartime(&G_p3, rct::G.bytes), 0);
+  std::vector<ge_precomp> table(32 * 8);
+  ge_precomp (*rows)[8] = reinterpret_cast<ge_precomp(*)[8]>(table.data());
+  ge_base_table_init(rows, &G_p3);
+  for (size_t i = 0; i < 32; ++i)
+  {
+    for (size_t j = 0; j < 8; ++j)
+    {
+      unsigned char a[32], b[32];
+      fe_tobytes(a, rows[i][j].yplusx); fe_tobytes(b, ge_base[i][j].yplusx);
+      ASSERT_EQ(memcmp(a, b, 32), 0);
+      fe_tobytes(a, rows[i][j].yminusx); fe_tobytes(b, ge_base[i][j].yminusx);
+      ASSERT_EQ(memcmp(a, b, 32), 0);
+      fe_tobytes(a, rows[i][j].xy2d); fe_tobytes(b, ge_base[i][j].xy2d);
+      ASSERT_EQ(memcmp(a, b, 32), 0);
+    }
+  }
+}
+
+TEST(ringct, scalarmultH)
+{
+  std::vector<rct::key> scalars = { rct::zero(), rct::identity(), rct::d2h(crypto::rand<uint64_t>()), rct::curveOrder() };
+  for (size_t n = 0; n < 16; ++n)
+    scalars.push_back(rct::skGen());
+  rct::key unreduced;
+  memset(unreduced.bytes, 0xff, 32);
+  scalars.push_back(unreduced);
+
+  for (const rct::key &a: scalars)
+  {
+    rct::key reduced;
+    sc_reduce32copy(reduced.bytes, a.bytes);
+    ge_p2 R;
+    ge_scalarmult(&R, reduced.bytes, &ge_p3_H);
+    rct::key expected;
+    ge_tobytes(expected.bytes, &R);
+    ASSERT_EQ(rct::scalarmultH(a), expected);
+    ASSERT_EQ(rct::scalarmultKey(rct::H, reduced), expected);
+  }
+}
+
+TEST(ringct, addKeysGH)
+{
+  for (size_t n = 0; n < 16; ++n)
+  {
+    const rct::key a = rct::skGen(), b = rct::skGen();
+    const uint64_t amount = crypto::rand<uint64_t>();
+    rct::key aGbH, aGbB;
+    rct::addKeysGH(aGbH, a, b);
+    rct::addKeys2(aGbB, a, b, rct::H);
+    ASSERT_EQ(aGbH, aGbB);
+    ASSERT_EQ(rct::commit(amount, a), rct::addKeys(rct::scalarmultBase(a), rct::scalarmultKey(rct::H, rct::d2h(amount))));
+  }
+}
@@ -136,6 +136,23 @@ TEST(ringdb, different_genesis)
   ASSERT_FALSE(ringdb.get_ring(KEY_2, KEY_IMAGE_1, outs2));
 }
 
+TEST(ringdb, add_rings)
+{
+  RingDB ringdb;
+  const crypto::key_image key_image_2 = generate_key_image(), key_image_3 = generate_key_image();
+  std::vector<std::pair<crypto::key_image, std::vector<uint64_t>>> rings;
+  rings.push_back(std::make_pair(KEY_IMAGE_1, std::vector<uint64_t>{43, 7320, 8429}));
+  rings.push_back(std::make_pair(key_image_2, std::vector<uint64_t>{1, 2}));
+  rings.push_back(std::make_pair(key_image_3, std::vector<uint64_t>{5}));
+  ASSERT_TRUE(ringdb.add_rings(KEY_1, rings));
+  std::vector<uint64_t> outs;
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, KEY_IMAGE_1, outs));
+  ASSERT_EQ(outs, std::vector<uint64_t>({43, 43+7320, 43+7320+8429}));
+  ASSERT_TRUE(ringdb.get_ring(KEY_1, key_image_2, outs));
+  ASSERT_EQ(outs, std::vector<uint64_t>({1, 3}));
+  ASSERT_FALSE(ringdb.get_ring(KEY_1, key_image_3, outs));
+}
+
 TEST(spent_outputs, not_found)
 {
   RingDB ringdb;
@@ -190,3 +207,23 @@ TEST(spent_outputs, clear)
   ASSERT_FALSE(ringdb.blackballed(OUTPUT_1));
 }
 
+TEST(spent_outputs, lookups_follow_changes)
+{
+  RingDB ringdb;
+  ASSERT_FALSE(ringdb.blackballed(OUTPUT_1));
+  ASSERT_TRUE(ringdb.blackball(OUTPUT_1));
+  ASSERT_TRUE(ringdb.blackballed(OUTPUT_1));
+  ASSERT_TRUE(ringdb.set_ring(KEY_1, KEY_IMAGE_1, std::vector<uint64_t>{1, 2}, true));
+  ASSERT_TRUE(ringdb.blackball(OUTPUT_1));
+  ASSERT_TRUE(ringdb.blackball(OUTPUT_2));
+  ASSERT_TRUE(ringdb.blackballed(OUTPUT_1));
+  ASSERT_TRUE(ringdb.blackballed(OUTPUT_2));
+  ASSERT_TRUE(ringdb.unblackball(OUTPUT_1));
+  ASSERT_FALSE(ringdb.blackballed(OUTPUT_1));
+  ASSERT_TRUE(ringdb.blackballed(OUTPUT_2));
+  ASSERT_TRUE(ringdb.clear_blackballs());
+  ASSERT_FALSE(ringdb.blackballed(OUTPUT_2));
+  ASSERT_TRUE(ringdb.blackball(OUTPUT_1));
+  ASSERT_TRUE(ringdb.blackballed(OUTPUT_1));
+  ASSERT_FALSE(ringdb.blackballed(OUTPUT_2));
+}
@@ -0,0 +1,81 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <deque>
+#include <random>
+#include "gtest/gtest.h"
+#include "misc_language.h"
+#include "common/rolling_median.h"
+
+namespace
+{
+  uint64_t reference_median(const std::deque<uint64_t> &values)
+  {
+    std::vector<uint64_t> v(values.begin(), values.end());
+    return epee::misc_utils::median(v);
+  }
+}
+
+TEST(rolling_median, empty)
+{
+  tools::rolling_median<uint64_t> m;
+  ASSERT_TRUE(m.empty());
+  ASSERT_EQ(m.median(), 0u);
+  m.push_back(5);
+  m.pop_front();
+  ASSERT_EQ(m.median(), 0u);
+}
+
+TEST(rolling_median, matches_full_median)
+{
+  std::mt19937_64 rng(42);
+  tools::rolling_median<uint64_t> m;
+  std::deque<uint64_t> ref;
+  for (int i = 0; i < 20000; ++i)
+  {
+    // mostly add blocks at the top and drop the oldest, sometimes pop the top
+    // and bring back an older one, with plenty of duplicate weights
+    const uint64_t v = rng() % 50;
+    switch (rng() % 8)
+    {
+      case 0:
+        if (!ref.empty()) { m.pop_back(); ref.pop_back(); }
+        break;
+      case 1:
+        m.push_front(v); ref.push_front(v);
+        break;
+      default:
+        m.push_back(v); ref.push_back(v);
+        if (ref.size() > 100) { m.pop_front(); ref.pop_front(); }
+        break;
+    }
+    ASSERT_EQ(m.size(), ref.size());
+    ASSERT_EQ(m.median(), reference_median(ref));
+    ASSERT_TRUE(std::equal(ref.begin(), ref.end(), m.get_values().begin()));
+  }
+}
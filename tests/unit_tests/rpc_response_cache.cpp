@@ -0,0 +1,138 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#pragma once
+#include "gtest/gtest.h"
+#include "rpc/rpc_response_cache.h"
+
+namespace
+{
+  const char GET_INFO_BODY[] = "{\r\n  \"height\": 5,\r\n  \"status\": \"OK\"\r\n}";
+
+  crypto::hash make_hash(char c)
+  {
+    crypto::hash h;
+    memset(&h, c, sizeof(h));
+    return h;
+  }
+
+  std::string json_rpc_body(const std::string &id)
+  {
+    return "{\r\n  \"id\": " + id + ",\r\n  \"jsonrpc\": \"2.0\",\r\n  \"result\": {\r\n    \"id\": 7,\r\n    \"status\": \"OK\"\r\n  }\r\n}";
+  }
+}
+
+TEST(rpc_response_cache, uncached_calls)
+{
+  cryptonote::rpc_response_cache cache;
+  cryptonote::rpc_response_cache::request_key key;
+  ASSERT_FALSE(cache.get_key("/get_transactions", "{}", key));
+  ASSERT_FALSE(cache.get_key("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":\"0\",\"method\":\"get_block\"}", key));
+  ASSERT_FALSE(cache.get_key("/json_rpc", "not json", key));
+  ASSERT_TRUE(cache.get_key("/get_info", "", key));
+  cache.set_max_size(0);
+  ASSERT_FALSE(cache.get_key("/get_info", "", key));
+}
+
+TEST(rpc_response_cache, invalidated_by_chain_and_pool)
+{
+  cryptonote::rpc_response_cache cache;
+  cryptonote::rpc_response_cache::request_key key;
+  std::string body, mime_type;
+  ASSERT_TRUE(cache.get_key("/get_info", "", key));
+  ASSERT_FALSE(cache.find(key, make_hash(1), 1, body, mime_type));
+  cache.add(key, make_hash(1), 1, GET_INFO_BODY, "application/json");
+  ASSERT_TRUE(cache.find(key, make_hash(1), 1, body, mime_type));
+  ASSERT_EQ(body, GET_INFO_BODY);
+  ASSERT_EQ(mime_type, "application/json");
+  ASSERT_FALSE(cache.find(key, make_hash(1), 2, body, mime_type));
+
+  // header calls only follow the chain
+  ASSERT_TRUE(cache.get_key("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"get_last_block_header\"}", key));
+  cache.add(key, make_hash(1), 1, json_rpc_body("1"), "application/json");
+  ASSERT_TRUE(cache.find(key, make_hash(1), 2, body, mime_type));
+  ASSERT_FALSE(cache.find(key, make_hash(2), 2, body, mime_type));
+
+  uint64_t hits, misses;
+  size_t size, entries;
+  cache.get_stats(hits, misses, size, entries);
+  ASSERT_EQ(hits, 2);
+  ASSERT_EQ(misses, 3);
+  ASSERT_EQ(entries, 0);
+  ASSERT_EQ(size, 0);
+}
+
+TEST(rpc_response_cache, json_rpc_id_and_params)
+{
+  cryptonote::rpc_response_cache cache;
+  cryptonote::rpc_response_cache::request_key key, other_id, reordered, other_params;
+  ASSERT_TRUE(cache.get_key("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"get_block_headers_range\",\"params\":{\"start_height\":1,\"end_height\":2}}", key));
+  ASSERT_TRUE(cache.get_key("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":\"abc\",\"method\":\"get_block_headers_range\",\"params\":{\"start_height\":1,\"end_height\":2}}", other_id));
+  ASSERT_TRUE(cache.get_key("/json_rpc", "{\"params\":{\"end_height\":2,\"start_height\":1},\"method\":\"get_block_headers_range\",\"id\":1}", reordered));
+  ASSERT_TRUE(cache.get_key("/json_rpc", "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"get_block_headers_range\",\"params\":{\"start_height\":1,\"end_height\":3}}", other_params));
+  ASSERT_EQ(key.key, other_id.key);
+  ASSERT_EQ(key.key, reordered.key);
+  ASSERT_NE(key.key, other_params.key);
+
+  std::string body, mime_type;
+  cache.add(key, make_hash(1), 1, json_rpc_body("1"), "application/json");
+  ASSERT_TRUE(cache.find(other_id, make_hash(1), 1, body, mime_type));
+  ASSERT_EQ(body, json_rpc_body("\"abc\""));
+  ASSERT_FALSE(cache.find(other_params, make_hash(1), 1, body, mime_type));
+}
+
+TEST(rpc_response_cache, errors_not_cached)
+{
+  cryptonote::rpc_response_cache cache;
+  cryptonote::rpc_response_cache::request_key key;
+  std::string body, mime_type;
+  ASSERT_TRUE(cache.get_key("/get_info", "", key));
+  cache.add(key, make_hash(1), 1, "{\r\n  \"status\": \"BUSY\"\r\n}", "application/json");
+  ASSERT_FALSE(cache.find(key, make_hash(1), 1, body, mime_type));
+}
+
+TEST(rpc_response_cache, size_bound)
+{
+  const std::string body = GET_INFO_BODY;
+  cryptonote::rpc_response_cache cache(2 * (body.size() + 32));
+  cryptonote::rpc_response_cache::request_key keys[3];
+  for (int i = 0; i < 3; ++i)
+  {
+    ASSERT_TRUE(cache.get_key("/get_info", std::string(i, ' '), keys[i]));
+    cache.add(keys[i], make_hash(1), 1, body, "application/json");
+  }
+  std::string found, mime_type;
+  ASSERT_FALSE(cache.find(keys[0], make_hash(1), 1, found, mime_type));
+  ASSERT_TRUE(cache.find(keys[1], make_hash(1), 1, found, mime_type));
+  ASSERT_TRUE(cache.find(keys[2], make_hash(1), 1, found, mime_type));
+
+  uint64_t hits, misses;
+  size_t size, entries;
+  cache.get_stats(hits, misses, size, entries);
+  ASSERT_EQ(entries, 2);
+  ASSERT_LE(size, 2 * (body.size() + 32));
+}
@@ -35,8 +35,10 @@
 #include <vector>
 #include <boost/foreach.hpp>
 #include <boost/archive/portable_binary_iarchive.hpp>
+#include <boost/archive/portable_binary_oarchive.hpp>
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
 #include "ringct/rctSigs.h"
 #include "serialization/binary_archive.h"
 #include "serialization/json_archive.h"
@@ -132,11 +134,11 @@ TEST(Serialization, BinaryArchiveInts) {
   ASSERT_EQ(8, oss.str().size());
   ASSERT_EQ(string("\0\0\0\0\xff\0\0\0", 8), oss.str());
 
-  istringstream iss(oss.str());
-  binary_archive<false> iar(iss);
+  const std::string blob = oss.str();
+  binary_archive<false> iar{epee::strspan<std::uint8_t>(blob)};
   iar.serialize_int(x1);
-  ASSERT_EQ(8, iss.tellg());
-  ASSERT_TRUE(iss.good());
+  ASSERT_EQ(0, iar.remaining_bytes());
+  ASSERT_TRUE(iar.good());
 
   ASSERT_EQ(x, x1);
 }
@@ -151,13 +153,51 @@ TEST(Serialization, BinaryArchiveVarInts) {
   ASSERT_EQ(6, oss.str().size());
   ASSERT_EQ(string("\x80\x80\x80\x80\xF0\x1F", 6), oss.str());
 
-  istringstream iss(oss.str());
-  binary_archive<false> iar(iss);
+  const std::string blob = oss.str();
+  binary_archive<false> iar{epee::strspan<std::uint8_t>(blob)};
   iar.serialize_varint(x1);
-  ASSERT_TRUE(iss.good());
+  ASSERT_TRUE(iar.good());
   ASSERT_EQ(x, x1);
 }
 
+TEST(Serialization, BinaryArchiveTruncated) {
+  uint64_t x = 0xff00000000, x1;
+
+  string blob;
+  ASSERT_TRUE(serialization::dump_binary(x, blob));
+  ASSERT_EQ(8, blob.size());
+  ASSERT_FALSE(serialization::parse_binary(blob.substr(0, 7), x1));
+
+  ostringstream oss;
+  binary_archive<true> oar(oss);
+  oar.serialize_varint(x);
+  blob = oss.str();
+  blob.resize(blob.size() - 1);
+  binary_archive<false> iar{epee::strspan<std::uint8_t>(blob)};
+  iar.serialize_varint(x1);
+  ASSERT_FALSE(iar.good());
+  ASSERT_EQ(0, iar.remaining_bytes());
+}
+
+TEST(Serialization, BinaryArchiveBlobVector) {
+  std::vector<crypto::hash> hashes(3), hashes1;
+  for (size_t n = 0; n < hashes.size(); ++n)
+    hashes[n].data[n] = n + 1;
+
+  string blob;
+  ASSERT_TRUE(serialization::dump_binary(hashes, blob));
+  ASSERT_EQ(1 + 3 * sizeof(crypto::hash), blob.size());
+  ASSERT_EQ(3, blob[0]);
+  ASSERT_EQ(0, memcmp(blob.data() + 1, hashes.data(), 3 * sizeof(crypto::hash)));
+
+  ASSERT_TRUE(serialization::parse_binary(blob, hashes1));
+  ASSERT_EQ(hashes, hashes1);
+
+  ASSERT_FALSE(serialization::parse_binary(blob.substr(0, blob.size() - 1), hashes1));
+  blob[0] = 4;
+  ASSERT_FALSE(serialization::parse_binary(blob, hashes1));
+}
+
 TEST(Serialization, Test1) {
   ostringstream str;
   binary_archive<true> ar(str);
@@ -1177,3 +1217,266 @@ TEST(Serialization, portability_signed_tx)
   ASSERT_TRUE(epee::string_tools::pod_to_hex(ki1) == "d54cbd435a8d636ad9b01b8d4f3eb13bd0cf1ce98eddf53ab1617f9b763e66c0");
   ASSERT_TRUE(epee::string_tools::pod_to_hex(ki2) == "6c3cd6af97c4070a7aef9b1344e7463e29c7cd245076fdb65da447a34da3ca76");
 }
+
+TEST(Serialization, block_filter_round_trip)
+{
+  using namespace cryptonote;
+
+  const crypto::public_key tx_pub_key = crypto::rand<crypto::public_key>();
+  const crypto::public_key out_key0 = crypto::rand<crypto::public_key>();
+  const crypto::public_key out_key1 = crypto::rand<crypto::public_key>();
+  const crypto::key_image key_image = crypto::rand<crypto::key_image>();
+
+  block b = AUTO_VAL_INIT(b);
+  b.miner_tx.vin.push_back(txin_gen{});
+  b.miner_tx.vout.push_back(tx_out{10, txout_to_key(out_key0)});
+  ASSERT_TRUE(add_tx_pub_key_to_extra(b.miner_tx, tx_pub_key));
+
+  transaction tx;
+  tx.set_null();
+  txin_to_key in;
+  in.k_image = key_image;
+  tx.vin.push_back(in);
+  tx.vout.push_back(tx_out{0, txout_to_key(out_key1)});
+  b.tx_hashes.push_back(crypto::rand<crypto::hash>());
+
+  // one tx hash per transaction is required
+  block_filter filter;
+  ASSERT_FALSE(make_block_filter(b, {}, filter));
+
+  const blobdata blob = make_block_filter_blob(b, {tx});
+  ASSERT_FALSE(blob.empty());
+  ASSERT_TRUE(serialization::parse_binary(blob, filter));
+
+  ASSERT_EQ(1, filter.version);
+  ASSERT_EQ(get_block_hash(b), filter.block_hash);
+  ASSERT_EQ(2, filter.txs.size());
+
+  ASSERT_EQ(get_transaction_hash(b.miner_tx), filter.txs[0].tx_hash);
+  ASSERT_EQ(tx_pub_key, filter.txs[0].tx_pub_key);
+  ASSERT_TRUE(filter.txs[0].additional_tx_pub_keys.empty());
+  ASSERT_EQ(std::vector<crypto::public_key>{out_key0}, filter.txs[0].output_keys);
+  ASSERT_TRUE(filter.txs[0].key_images.empty());
+
+  ASSERT_EQ(b.tx_hashes[0], filter.txs[1].tx_hash);
+  ASSERT_EQ(crypto::null_pkey, filter.txs[1].tx_pub_key);
+  ASSERT_EQ(std::vector<crypto::public_key>{out_key1}, filter.txs[1].output_keys);
+  ASSERT_EQ(std::vector<crypto::key_image>{key_image}, filter.txs[1].key_images);
+}
+
+TEST(Serialization, tx_hash_cache_survives_copy_and_move)
+{
+  using namespace cryptonote;
+
+  transaction tx;
+  txin_gen txin_gen1;
+  txin_gen1.height = 0;
+  tx.vin.push_back(txin_gen1);
+  tx.vout.push_back(tx_out{1, txout_to_key(crypto::rand<crypto::public_key>())});
+
+  blobdata blob;
+  ASSERT_TRUE(tx_to_blob(tx, blob));
+  transaction parsed;
+  ASSERT_TRUE(parse_and_validate_tx_from_blob(blob, parsed));
+  ASSERT_FALSE(parsed.is_hash_valid());
+  ASSERT_TRUE(parsed.is_blob_size_valid());
+  ASSERT_EQ(blob.size(), parsed.blob_size);
+
+  const crypto::hash txid = get_transaction_hash(parsed);
+  ASSERT_TRUE(parsed.is_hash_valid());
+
+  transaction copied(parsed);
+  ASSERT_TRUE(copied.is_hash_valid());
+  ASSERT_EQ(txid, copied.hash);
+  ASSERT_TRUE(copied.is_blob_size_valid());
+
+  transaction moved(std::move(copied));
+  ASSERT_TRUE(moved.is_hash_valid());
+  ASSERT_EQ(txid, moved.hash);
+  ASSERT_FALSE(copied.is_hash_valid());
+
+  transaction assigned;
+  assigned = std::move(moved);
+  ASSERT_TRUE(assigned.is_hash_valid());
+  ASSERT_EQ(txid, get_transaction_hash(assigned));
+
+  assigned.invalidate_hashes();
+  ASSERT_FALSE(assigned.is_hash_valid());
+  ASSERT_FALSE(assigned.is_prunable_hash_valid());
+  ASSERT_FALSE(assigned.is_blob_size_valid());
+  ASSERT_FALSE(assigned.is_weight_valid());
+}
+
+TEST(Serialization, tx_weight_cache)
+{
+  using namespace cryptonote;
+
+  transaction tx;
+  txin_gen txin_gen1;
+  txin_gen1.height = 0;
+  tx.vin.push_back(txin_gen1);
+  tx.vout.push_back(tx_out{1, txout_to_key(crypto::rand<crypto::public_key>())});
+
+  blobdata blob;
+  ASSERT_TRUE(tx_to_blob(tx, blob));
+
+  // weight without a blob size serializes once and keeps both
+  ASSERT_FALSE(tx.is_weight_valid());
+  ASSERT_EQ(blob.size(), get_transaction_weight(tx));
+  ASSERT_TRUE(tx.is_weight_valid());
+  ASSERT_TRUE(tx.is_blob_size_valid());
+  ASSERT_EQ(blob.size(), get_transaction_blob_size(tx));
+
+  transaction copied(tx);
+  ASSERT_TRUE(copied.is_weight_valid());
+  ASSERT_EQ(tx.weight, copied.weight);
+
+  // a size other than the cached blob size is not cached
+  transaction parsed;
+  ASSERT_TRUE(parse_and_validate_tx_from_blob(blob, parsed));
+  ASSERT_EQ(blob.size() + 10, get_transaction_weight(parsed, blob.size() + 10));
+  ASSERT_FALSE(parsed.is_weight_valid());
+  ASSERT_EQ(blob.size(), get_transaction_weight(parsed, blob.size()));
+  ASSERT_TRUE(parsed.is_weight_valid());
+
+  tx.extra.resize(10, 0);
+  tx.invalidate_hashes();
+  ASSERT_FALSE(tx.is_weight_valid());
+  ASSERT_EQ(blob.size() + 10, get_transaction_weight(tx));
+}
+
+TEST(Serialization, wallet_lazy_history)
+{
+  tools::wallet2 w(cryptonote::TESTNET);
+  w.generate("", "test", crypto::secret_key(), true, false);
+  crypto::hash txid;
+  epee::string_tools::hex_to_pod("b9aac8c020ab33859e0c0b6331f46a8780d349e7ac17b067116e2d87bf48daad", txid);
+  w.set_tx_note(txid, "a note");
+  ASSERT_TRUE(w.add_address_book_row(w.get_account().get_keys().m_account_address, crypto::null_hash, "me", false));
+
+  std::stringstream ss;
+  {
+    boost::archive::portable_binary_oarchive ar(ss);
+    ar << w;
+  }
+  tools::wallet2 w2(cryptonote::TESTNET);
+  {
+    boost::archive::portable_binary_iarchive ar(ss);
+    ar >> w2;
+  }
+  ASSERT_FALSE(w2.m_history_loaded);
+
+  // stored again before use, the history is passed through as is
+  std::stringstream ss2;
+  {
+    boost::archive::portable_binary_oarchive ar(ss2);
+    ar << w2;
+  }
+  ASSERT_FALSE(w2.m_history_loaded);
+  tools::wallet2 w3(cryptonote::TESTNET);
+  {
+    boost::archive::portable_binary_iarchive ar(ss2);
+    ar >> w3;
+  }
+
+  for (tools::wallet2 *wallet: {&w2, &w3})
+  {
+    ASSERT_EQ("a note", wallet->get_tx_note(txid));
+    ASSERT_TRUE(wallet->m_history_loaded);
+    const std::vector<tools::wallet2::address_book_row> address_book = wallet->get_address_book();
+    ASSERT_EQ(1, address_book.size());
+    ASSERT_EQ("me", address_book[0].m_description);
+  }
+}
+
+TEST(Serialization, keys_file_data_kdf_lanes)
+{
+  tools::wallet2::keys_file_data data = boost::value_initialized<tools::wallet2::keys_file_data>();
+  data.iv = crypto::rand<crypto::chacha_iv>();
+  data.account_data = "encrypted";
+
+  // without lanes, the layout is the one older wallets wrote and read
+  std::string single_chain;
+  ASSERT_TRUE(serialization::dump_binary(data, single_chain));
+  ASSERT_EQ(sizeof(data.iv) + 1 + data.account_data.size(), single_chain.size());
+  tools::wallet2::keys_file_data loaded;
+  ASSERT_TRUE(serialization::parse_binary(single_chain, loaded));
+  ASSERT_EQ(0, loaded.kdf_lanes);
+  ASSERT_EQ(data.account_data, loaded.account_data);
+
+  data.kdf_lanes = 4;
+  std::string lanes;
+  ASSERT_TRUE(serialization::dump_binary(data, lanes));
+  ASSERT_EQ(0, lanes.compare(0, single_chain.size(), single_chain));
+  ASSERT_TRUE(serialization::parse_binary(lanes, loaded));
+  ASSERT_EQ(4, loaded.kdf_lanes);
+  ASSERT_EQ(data.account_data, loaded.account_data);
+}
+
+TEST(Serialization, parallel_kdf)
+{
+  const epee::wipeable_string password("password");
+  crypto::chacha_key key0, key1, key2, key2_again;
+  crypto::generate_chacha_key(password.data(), password.size(), key0, 1);
+  tools::wallet2::generate_chacha_key_from_password(password, key1, 1, 0);
+  tools::wallet2::generate_chacha_key_from_password(password, key2, 1, 2);
+  tools::wallet2::generate_chacha_key_from_password(password, key2_again, 1, 2);
+  ASSERT_EQ(0, memcmp(&key0, &key1, sizeof(key0)));
+  ASSERT_NE(0, memcmp(&key0, &key2, sizeof(key0)));
+  ASSERT_EQ(0, memcmp(&key2, &key2_again, sizeof(key2)));
+}
+
+TEST(Serialization, exported_outputs_compact)
+{
+  tools::wallet2::exported_outputs outs;
+  outs.m_offset = 3;
+  outs.m_total = 5;
+  outs.m_outputs.resize(2);
+  for (size_t n = 0; n < outs.m_outputs.size(); ++n)
+  {
+    tools::wallet2::exported_transfer_details &etd = outs.m_outputs[n];
+    etd.m_pubkey = crypto::rand<crypto::public_key>();
+    etd.m_internal_output_index = n + 1;
+    etd.m_global_output_index = 1000000 + n;
+    etd.m_tx_pubkey = crypto::rand<crypto::public_key>();
+    etd.m_txid = crypto::rand<crypto::hash>();
+    etd.m_block_height = 200000;
+    etd.m_unlock_time = 0;
+    etd.m_spent_height = 0;
+    etd.m_amount = 1000;
+    etd.m_mask = rct::skGen();
+    etd.m_subaddr_index = {0, (uint32_t)n};
+  }
+  outs.m_outputs[0].m_flags = tools::wallet2::exported_transfer_details::flag_rct;
+  outs.m_outputs[1].m_flags = tools::wallet2::exported_transfer_details::flag_spent;
+  outs.m_outputs[1].m_additional_tx_keys.push_back(crypto::rand<crypto::public_key>());
+
+  std::string blob;
+  ASSERT_TRUE(serialization::dump_binary(outs, blob));
+  tools::wallet2::exported_outputs loaded;
+  ASSERT_TRUE(serialization::parse_binary(blob, loaded));
+  ASSERT_EQ(3, loaded.m_offset);
+  ASSERT_EQ(5, loaded.m_total);
+  ASSERT_EQ(2, loaded.m_outputs.size());
+  for (size_t n = 0; n < loaded.m_outputs.size(); ++n)
+  {
+    const tools::wallet2::exported_transfer_details &a = outs.m_outputs[n], &b = loaded.m_outputs[n];
+    ASSERT_EQ(a.m_flags, b.m_flags);
+    ASSERT_EQ(a.m_pubkey, b.m_pubkey);
+    ASSERT_EQ(a.m_internal_output_index, b.m_internal_output_index);
+    ASSERT_EQ(a.m_global_output_index, b.m_global_output_index);
+    ASSERT_EQ(a.m_tx_pubkey, b.m_tx_pubkey);
+    ASSERT_EQ(a.m_additional_tx_keys, b.m_additional_tx_keys);
+    ASSERT_EQ(a.m_txid, b.m_txid);
+    ASSERT_EQ(a.m_amount, b.m_amount);
+    ASSERT_EQ(a.m_subaddr_index, b.m_subaddr_index);
+  }
+  ASSERT_EQ(outs.m_outputs[0].m_mask, loaded.m_outputs[0].m_mask);
+
+  // the mask is only sent for rct outputs
+  tools::wallet2::exported_outputs non_rct = outs;
+  non_rct.m_outputs[0].m_flags = 0;
+  std::string non_rct_blob;
+  ASSERT_TRUE(serialization::dump_binary(non_rct, non_rct_blob));
+  ASSERT_EQ(blob.size() - sizeof(rct::key), non_rct_blob.size());
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include "gtest/gtest.h"
+#include "common/single_flight_cache.h"
+
+typedef tools::single_flight_cache<int> cache_t;
+
+TEST(single_flight_cache, caches)
+{
+  cache_t cache(4, std::chrono::seconds(60));
+  int calls = 0;
+  auto f = [&calls](){ ++calls; return std::make_shared<const int>(42); };
+  ASSERT_EQ(*cache.get("a", f), 42);
+  ASSERT_EQ(*cache.get("a", f), 42);
+  ASSERT_EQ(calls, 1);
+  ASSERT_EQ(*cache.get("b", f), 42);
+  ASSERT_EQ(calls, 2);
+}
+
+TEST(single_flight_cache, null_not_cached)
+{
+  cache_t cache(4, std::chrono::seconds(60));
+  int calls = 0;
+  auto f = [&calls](){ ++calls; return cache_t::value_ptr(); };
+  ASSERT_FALSE(cache.get("a", f));
+  ASSERT_FALSE(cache.get("a", f));
+  ASSERT_EQ(calls, 2);
+  ASSERT_EQ(cache.size(), 0);
+}
+
+TEST(single_flight_cache, evicts_oldest)
+{
+  cache_t cache(2, std::chrono::seconds(60));
+  int calls = 0;
+  auto f = [&calls](){ ++calls; return std::make_shared<const int>(calls); };
+  cache.get("a", f);
+  cache.get("b", f);
+  cache.get("c", f);
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(*cache.get("c", f), 3);
+  ASSERT_EQ(*cache.get("a", f), 4);
+}
+
+TEST(single_flight_cache, expires)
+{
+  cache_t cache(4, std::chrono::milliseconds(0));
+  int calls = 0;
+  auto f = [&calls](){ ++calls; return std::make_shared<const int>(calls); };
+  cache.get("a", f);
+  ASSERT_EQ(*cache.get("a", f), 2);
+}
+
+TEST(single_flight_cache, concurrent_callers_share)
+{
+  cache_t cache(4, std::chrono::seconds(60));
+  std::atomic<int> calls(0);
+  auto f = [&calls](){
+    ++calls;
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+    return std::make_shared<const int>(7);
+  };
+  std::atomic<int> sum(0);
+  std::vector<boost::thread> threads;
+  for (int i = 0; i < 8; ++i)
+    threads.emplace_back([&](){ sum += *cache.get("a", f); });
+  for (auto &t: threads)
+    t.join();
+  ASSERT_EQ(calls.load(), 1);
+  ASSERT_EQ(sum.load(), 56);
+}
+
+TEST(single_flight_cache, exception_releases_waiters)
+{
+  cache_t cache(4, std::chrono::seconds(60));
+  ASSERT_THROW(cache.get("a", []() -> cache_t::value_ptr { throw std::runtime_error("failed"); }), std::runtime_error);
+  ASSERT_EQ(*cache.get("a", [](){ return std::make_shared<const int>(1); }), 1);
+}
@@ -101,3 +101,21 @@ TEST_F(WalletSubaddress, OutOfBoundsIndexes)
     EXPECT_STREQ("index.minor is out of bound", e.what());  
   }   
 }
+
+TEST_F(WalletSubaddress, LookaheadKeysMatchIndexes)
+{
+  // large enough to be derived in parallel chunks, then grown one address at a time
+  w1.set_subaddress_lookahead(2, 1000);
+  w1.add_subaddress_account("big account");
+  for (int i = 0; i < 5; ++i)
+    w1.add_subaddress(2, "");
+  for (uint32_t minor: {0u, 1u, 5u, 255u, 256u, 257u, 999u, 1004u})
+  {
+    const cryptonote::subaddress_index index = {2, minor};
+    const boost::optional<cryptonote::subaddress_index> found = w1.get_subaddress_index(w1.get_subaddress(index));
+    ASSERT_TRUE(!!found);
+    EXPECT_EQ(index.major, found->major);
+    EXPECT_EQ(index.minor, found->minor);
+  }
+  EXPECT_TRUE(!w1.get_subaddress_index(w1.get_subaddress({2, 1005})));
+}
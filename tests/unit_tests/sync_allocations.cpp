@@ -0,0 +1,137 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "gtest/gtest.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// counts every heap allocation made by this binary, so the sync path
+// tests below can put a budget on what a getblocks.bin response costs
+static std::atomic<uint64_t> heap_allocations(0);
+
+void *operator new(std::size_t size)
+{
+  ++heap_allocations;
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { free(ptr); }
+
+namespace
+{
+  static const size_t N_BLOCKS = 1000;
+  static const size_t N_TXES = 4;
+
+  typedef std::vector<std::pair<std::pair<cryptonote::blobdata, crypto::hash>, std::vector<std::pair<crypto::hash, cryptonote::blobdata>>>> supplement_t;
+
+  supplement_t make_supplement()
+  {
+    supplement_t bs(N_BLOCKS);
+    for (auto &bd: bs)
+    {
+      bd.first.first = cryptonote::blobdata(300, 'b');
+      bd.second.resize(N_TXES);
+      for (auto &tx: bd.second)
+        tx.second = cryptonote::blobdata(2000, 't');
+    }
+    return bs;
+  }
+
+  // same shape as core_rpc_server::on_get_blocks
+  void fill_response(supplement_t &bs, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response &res)
+  {
+    res.blocks.reserve(bs.size());
+    res.output_indices.reserve(bs.size());
+    for (auto &bd: bs)
+    {
+      res.blocks.resize(res.blocks.size() + 1);
+      res.blocks.back().block = std::move(bd.first.first);
+      res.output_indices.push_back(cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
+      res.output_indices.back().indices.reserve(1 + bd.second.size());
+      res.output_indices.back().indices.push_back(cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+      res.output_indices.back().indices.back().indices = {0, 1};
+      res.blocks.back().txs.reserve(bd.second.size());
+      for (auto &tx: bd.second)
+      {
+        res.blocks.back().txs.push_back(std::move(tx.second));
+        res.output_indices.back().indices.push_back(cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
+        res.output_indices.back().indices.back().indices = {2, 3};
+      }
+    }
+    res.status = CORE_RPC_STATUS_OK;
+  }
+}
+
+TEST(sync_allocations, get_blocks_response_moves_blobs)
+{
+  supplement_t bs = make_supplement();
+  cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res;
+
+  const uint64_t start = heap_allocations;
+  fill_response(bs, res);
+  const uint64_t allocations = heap_allocations - start;
+
+  // one txs vector, one indices vector and one small vector per output index list,
+  // none of the block or tx blobs may be copied
+  ASSERT_LE(allocations, N_BLOCKS * (3 + N_TXES) + 2);
+  ASSERT_EQ(res.blocks.size(), N_BLOCKS);
+  ASSERT_EQ(res.blocks.back().txs.size(), N_TXES);
+  ASSERT_EQ(res.blocks.back().txs.back().size(), 2000);
+}
+
+TEST(sync_allocations, get_blocks_bin_budget)
+{
+  supplement_t bs = make_supplement();
+  cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res;
+  fill_response(bs, res);
+
+  uint64_t start = heap_allocations;
+  std::string blob;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(res, blob));
+  const uint64_t store_allocations = heap_allocations - start;
+  ASSERT_LE(store_allocations, N_BLOCKS);
+
+  start = heap_allocations;
+  cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res2;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(res2, blob));
+  const uint64_t load_allocations = heap_allocations - start;
+  ASSERT_LE(load_allocations, N_BLOCKS * (40 + 32 * N_TXES));
+
+  ASSERT_EQ(res2.blocks.size(), N_BLOCKS);
+  ASSERT_EQ(res2.output_indices.size(), N_BLOCKS);
+  ASSERT_EQ(res2.blocks.back().txs.size(), N_TXES);
+  ASSERT_EQ(res2.output_indices.back().indices.size(), N_TXES + 1);
+}
@@ -83,3 +83,90 @@ TEST(peer_list, merge_peer_lists)
 
 
 }
+
+TEST(peer_list, peer_stats)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  const epee::net_utils::network_address fast = MAKE_IPV4_ADDRESS(123,43,12,1, 8080);
+  const epee::net_utils::network_address slow = MAKE_IPV4_ADDRESS(123,43,12,2, 8080);
+  const epee::net_utils::network_address unlisted = MAKE_IPV4_ADDRESS(123,43,12,3, 8080);
+  ADD_WHITE_NODE(fast, 1, 34345);
+  ADD_WHITE_NODE(slow, 2, 34345);
+
+  nodetool::peer_stats stats;
+  ASSERT_FALSE(plm.get_peer_stats(fast, stats));
+  ASSERT_EQ(plm.get_peer_score(fast), plm.get_peer_score(slow));
+
+  plm.add_peer_connect_result(fast, true, 20);
+  plm.add_peer_sync_rate(fast, 2 * 1024 * 1024);
+  plm.add_peer_connect_result(slow, true, 400);
+  plm.add_peer_connect_result(slow, false, 0);
+  ASSERT_GT(plm.get_peer_score(fast), plm.get_peer_score(slow));
+
+  ASSERT_TRUE(plm.get_peer_stats(slow, stats));
+  ASSERT_EQ(stats.rtt_ms, 400);
+  ASSERT_EQ(stats.successes, 1);
+  ASSERT_EQ(stats.failures, 1);
+
+  // only peers in the lists get stats
+  plm.add_peer_connect_result(unlisted, true, 20);
+  ASSERT_FALSE(plm.get_peer_stats(unlisted, stats));
+
+  // and lose them when dropped from the lists
+  ADD_GRAY_NODE(unlisted, 3, 34345);
+  plm.add_peer_connect_result(unlisted, false, 0);
+  ASSERT_TRUE(plm.get_peer_stats(unlisted, stats));
+  nodetool::peerlist_entry ple;
+  ple.adr = unlisted;
+  plm.remove_from_peer_gray(ple);
+  ASSERT_FALSE(plm.get_peer_stats(unlisted, stats));
+}
+
+TEST(peer_list, peerlist_head_since)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 1, 1000);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,2, 8080), 2, 2000);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,3, 8080), 3, 3000);
+
+  std::list<nodetool::peerlist_entry> bs_head;
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 0));
+  ASSERT_EQ(bs_head.size(), 3);
+
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 2000));
+  ASSERT_EQ(bs_head.size(), 2);
+  ASSERT_EQ(bs_head.front().id, 3);
+  ASSERT_EQ(bs_head.back().id, 2);
+
+  // seeing a peer again makes it part of the next increment
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 1, 4000);
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 3001));
+  ASSERT_EQ(bs_head.size(), 1);
+  ASSERT_EQ(bs_head.front().id, 1);
+
+  bs_head.clear();
+  ASSERT_TRUE(plm.get_peerlist_head(bs_head, 100, 4001));
+  ASSERT_TRUE(bs_head.empty());
+}
+
+TEST(peer_list, merge_is_bounded)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  std::list<nodetool::peerlist_entry> outer_bs;
+  for (uint32_t i = 0; i < 2 * P2P_DEFAULT_PEERS_IN_HANDSHAKE; ++i)
+  {
+    nodetool::peerlist_entry ple;
+    const uint32_t c = i >> 8, d = i & 0xff;
+    ple.adr = MAKE_IPV4_ADDRESS(123,43,c,d, 8080);
+    ple.id = i + 1;
+    ple.last_seen = 34345;
+    outer_bs.push_back(ple);
+  }
+  ASSERT_TRUE(plm.merge_peerlist(outer_bs));
+  ASSERT_EQ(plm.get_gray_peers_count(), P2P_DEFAULT_PEERS_IN_HANDSHAKE);
+}
@@ -53,3 +53,47 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+TEST(protocol_pack, stream_writer_matches_portable_storage)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+  r.current_blockchain_height = 123456;
+  r.missed_ids.resize(3, boost::value_initialized<crypto::hash>());
+  r.txs.push_back(std::string(70, 'x'));
+  for(size_t i = 0; i < 100; ++i)
+  {
+    cryptonote::block_complete_entry bce;
+    bce.block = std::string(80 + i * 10, (char)i);
+    bce.txs.resize(i % 5, std::string(2000 + i, 't'));
+    r.blocks.push_back(bce);
+  }
+
+  epee::serialization::portable_storage ps;
+  r.store(ps);
+  std::string dom_buff;
+  ASSERT_TRUE(ps.store_to_binary(dom_buff));
+
+  std::string stream_buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, stream_buff));
+  // same entries and minimal varints, only the entry order may differ
+  ASSERT_EQ(dom_buff.size(), stream_buff.size());
+
+  epee::serialization::portable_storage loaded;
+  ASSERT_TRUE(loaded.load_from_binary(stream_buff));
+  std::string dom_json, stream_json;
+  ASSERT_TRUE(ps.dump_as_json(dom_json));
+  ASSERT_TRUE(loaded.dump_as_json(stream_json));
+  ASSERT_EQ(dom_json, stream_json);
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r2;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(r2, stream_buff));
+  ASSERT_EQ(r.txs, r2.txs);
+  ASSERT_EQ(r.blocks.size(), r2.blocks.size());
+  for(size_t i = 0; i < r.blocks.size(); ++i)
+  {
+    ASSERT_EQ(r.blocks[i].block, r2.blocks[i].block);
+    ASSERT_EQ(r.blocks[i].txs, r2.blocks[i].txs);
+  }
+  ASSERT_EQ(r.missed_ids, r2.missed_ids);
+  ASSERT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+}
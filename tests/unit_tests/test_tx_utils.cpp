@@ -133,6 +133,66 @@ TEST(parse_tx_extra, handles_pub_key_and_padding)
   ASSERT_EQ(typeid(cryptonote::tx_extra_padding), tx_extra_fields[1].type());
 }
 
+TEST(parse_tx_extra, handles_pub_key_nonce_and_additional_pub_keys)
+{
+  crypto::public_key keys[3];
+  for (size_t n = 0; n < 3; ++n)
+    memset(&keys[n], n + 1, sizeof(keys[n]));
+  std::vector<uint8_t> extra;
+  ASSERT_TRUE(cryptonote::add_tx_pub_key_to_extra(extra, keys[0]));
+  ASSERT_TRUE(cryptonote::add_extra_nonce_to_tx_extra(extra, std::string(9, 7)));
+  ASSERT_TRUE(cryptonote::add_additional_tx_pub_keys_to_extra(extra, {keys[1], keys[2]}));
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  ASSERT_TRUE(cryptonote::parse_tx_extra(extra, tx_extra_fields));
+  ASSERT_EQ(3, tx_extra_fields.size());
+  ASSERT_EQ(keys[0], boost::get<cryptonote::tx_extra_pub_key>(tx_extra_fields[0]).pub_key);
+  ASSERT_EQ(std::string(9, 7), boost::get<cryptonote::tx_extra_nonce>(tx_extra_fields[1]).nonce);
+  ASSERT_EQ((std::vector<crypto::public_key>{keys[1], keys[2]}), boost::get<cryptonote::tx_extra_additional_pub_keys>(tx_extra_fields[2]).data);
+
+  // truncated anywhere
+  for (size_t size = 1; size < extra.size(); ++size)
+  {
+    const std::vector<uint8_t> truncated(extra.begin(), extra.begin() + size);
+    const bool field_boundary = size == 1 + sizeof(crypto::public_key) || size == 1 + sizeof(crypto::public_key) + 2 + 9;
+    ASSERT_EQ(field_boundary, cryptonote::parse_tx_extra(truncated, tx_extra_fields)) << size;
+  }
+}
+
+TEST(parse_tx_extra, handles_extra_nonce_with_long_size)
+{
+  // 200 does not fit a one byte varint
+  std::vector<uint8_t> extra = {TX_EXTRA_NONCE, 0xc8, 0x01};
+  extra.resize(extra.size() + 200, 42);
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  ASSERT_TRUE(cryptonote::parse_tx_extra(extra, tx_extra_fields));
+  ASSERT_EQ(1, tx_extra_fields.size());
+  ASSERT_EQ(std::string(200, 42), boost::get<cryptonote::tx_extra_nonce>(tx_extra_fields[0]).nonce);
+}
+
+TEST(parse_tx_extra, cached_fields_follow_extra)
+{
+  crypto::public_key key0, key1;
+  memset(&key0, 1, sizeof(key0));
+  memset(&key1, 2, sizeof(key1));
+  cryptonote::transaction tx;
+  ASSERT_TRUE(cryptonote::add_tx_pub_key_to_extra(tx, key0));
+  ASSERT_EQ(key0, cryptonote::get_tx_pub_key_from_extra(tx));
+  ASSERT_TRUE(cryptonote::get_additional_tx_pub_keys_from_extra(tx).empty());
+
+  const cryptonote::transaction copy = tx;
+  tx.extra.clear();
+  ASSERT_TRUE(cryptonote::add_tx_pub_key_to_extra(tx, key1));
+  ASSERT_TRUE(cryptonote::add_additional_tx_pub_keys_to_extra(tx.extra, {key0}));
+  ASSERT_EQ(key1, cryptonote::get_tx_pub_key_from_extra(tx));
+  ASSERT_EQ(std::vector<crypto::public_key>{key0}, cryptonote::get_additional_tx_pub_keys_from_extra(tx));
+  ASSERT_EQ(key0, cryptonote::get_tx_pub_key_from_extra(copy));
+
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  tx.extra.push_back(TX_EXTRA_TAG_PUBKEY);
+  ASSERT_FALSE(cryptonote::parse_tx_extra(tx, tx_extra_fields));
+  ASSERT_EQ(2, tx_extra_fields.size());
+}
+
 TEST(parse_and_validate_tx_extra, is_valid_tx_extra_parsed)
 {
   cryptonote::transaction tx = AUTO_VAL_INIT(tx);
@@ -160,6 +220,68 @@ TEST(parse_and_validate_tx_extra, fails_on_wrong_size_in_extra_nonce)
   std::vector<cryptonote::tx_extra_field> tx_extra_fields;
   ASSERT_FALSE(cryptonote::parse_tx_extra(tx.extra, tx_extra_fields));
 }
+TEST(miner_tx_weight, matches_constructed_tx)
+{
+  cryptonote::account_base acc;
+  acc.generate();
+  for (uint8_t hf_version: {1, 2, 4})
+  {
+    for (const cryptonote::blobdata &nonce: {cryptonote::blobdata(), cryptonote::blobdata(8, 'x'), cryptonote::blobdata(200, 'x')})
+    {
+      const size_t max_outs = hf_version >= 4 ? 1 : 999;
+      cryptonote::transaction tx;
+      ASSERT_TRUE(cryptonote::construct_miner_tx(100000, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, nonce, max_outs, hf_version));
+      size_t weight;
+      ASSERT_TRUE(cryptonote::get_miner_tx_weight(100000, cryptonote::get_outs_money_amount(tx), nonce, max_outs, hf_version, weight));
+      ASSERT_EQ(weight, cryptonote::get_transaction_weight(tx));
+    }
+  }
+}
+TEST(miner_tx_weight, padding_is_varint_aware)
+{
+  cryptonote::account_base acc;
+  acc.generate();
+  cryptonote::transaction tx;
+  ASSERT_TRUE(cryptonote::construct_miner_tx(100000, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(), 1, 4));
+  const size_t weight = cryptonote::get_transaction_weight(tx);
+  ASSERT_FALSE(cryptonote::pad_miner_tx_to_weight(tx, weight - 1));
+
+  // the extra length needs a second byte once extra reaches 128 bytes, which skips one weight
+  const size_t skipped = weight + 128 - tx.extra.size();
+  for (size_t target = weight; target < weight + 140; ++target)
+  {
+    cryptonote::transaction padded = tx;
+    const bool r = cryptonote::pad_miner_tx_to_weight(padded, target);
+    ASSERT_EQ(r, target != skipped);
+    if (r)
+      ASSERT_EQ(cryptonote::get_transaction_weight(padded), target);
+  }
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  ASSERT_TRUE(cryptonote::pad_miner_tx_to_weight(tx, weight + 40));
+  ASSERT_TRUE(cryptonote::parse_tx_extra(tx.extra, tx_extra_fields));
+}
+TEST(miner_tx_weight, replace_extra_nonce_keeps_weight)
+{
+  cryptonote::account_base acc;
+  acc.generate();
+  cryptonote::transaction tx;
+  ASSERT_TRUE(cryptonote::construct_miner_tx(100000, 0, 10000000000000, 1000, TEST_FEE, acc.get_keys().m_account_address, tx, cryptonote::blobdata(8, 'a'), 1, 4));
+  const size_t weight = cryptonote::get_transaction_weight(tx);
+  const crypto::public_key tx_pub_key = cryptonote::get_tx_pub_key_from_extra(tx);
+
+  ASSERT_TRUE(cryptonote::replace_miner_tx_extra_nonce(tx, cryptonote::blobdata(8, 'b')));
+  ASSERT_EQ(cryptonote::get_transaction_weight(tx), weight);
+  ASSERT_EQ(cryptonote::get_tx_pub_key_from_extra(tx), tx_pub_key);
+  std::vector<cryptonote::tx_extra_field> tx_extra_fields;
+  ASSERT_TRUE(cryptonote::parse_tx_extra(tx.extra, tx_extra_fields));
+  cryptonote::tx_extra_nonce extra_nonce;
+  ASSERT_TRUE(cryptonote::find_tx_extra_field_by_type(tx_extra_fields, extra_nonce));
+  ASSERT_EQ(extra_nonce.nonce, cryptonote::blobdata(8, 'b'));
+
+  ASSERT_TRUE(cryptonote::replace_miner_tx_extra_nonce(tx, cryptonote::blobdata(4, 'c')));
+  ASSERT_EQ(cryptonote::get_transaction_weight(tx), weight);
+  ASSERT_FALSE(cryptonote::replace_miner_tx_extra_nonce(tx, cryptonote::blobdata(9, 'd')));
+}
 TEST(validate_parse_amount_case, validate_parse_amount)
 {
   uint64_t res = 0;
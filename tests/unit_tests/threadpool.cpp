@@ -77,6 +77,33 @@ TEST(threadpool, many_threads)
   ASSERT_EQ(counter, 4096);
 }
 
+TEST(threadpool, bulk)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(8));
+  tools::threadpool::waiter waiter;
+
+  std::atomic<unsigned int> counter(0);
+  std::vector<std::function<void()>> jobs;
+  for (size_t n = 0; n < 4097; ++n)
+    jobs.push_back([&counter](){++counter;});
+  tpool->submit_bulk(&waiter, std::move(jobs));
+  waiter.wait(tpool.get());
+  ASSERT_EQ(counter, 4097);
+}
+
+TEST(threadpool, bulk_leaf_one_thread)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(1));
+  tools::threadpool::waiter waiter;
+
+  std::atomic<unsigned int> counter(0);
+  std::vector<std::function<void()>> jobs(100, [&counter](){++counter;});
+  tpool->submit_bulk(&waiter, jobs, true);
+  tpool->submit_bulk(&waiter, {});
+  waiter.wait(tpool.get());
+  ASSERT_EQ(counter, 100);
+}
+
 static uint64_t fibonacci(std::shared_ptr<tools::threadpool> tpool, uint64_t n)
 {
   if (n <= 1)
@@ -144,3 +171,53 @@ TEST(threadpool, leaf_reentrancy)
   waiter.wait(tpool.get());
   ASSERT_EQ(counter, 500000);
 }
+
+TEST(threadpool, scoped_purpose)
+{
+  tools::threadpool &block = tools::threadpool::getInstance(tools::threadpool::block);
+  tools::threadpool &relay = tools::threadpool::getInstance(tools::threadpool::relay);
+  ASSERT_NE(&block, &relay);
+  ASSERT_EQ(&tools::threadpool::getInstance(), &block);
+  {
+    tools::threadpool::scoped_purpose purpose(tools::threadpool::relay);
+    ASSERT_EQ(&tools::threadpool::getInstance(), &relay);
+    {
+      tools::threadpool::scoped_purpose purpose(tools::threadpool::background);
+      ASSERT_EQ(&tools::threadpool::getInstance(), &tools::threadpool::getInstance(tools::threadpool::background));
+    }
+    ASSERT_EQ(&tools::threadpool::getInstance(), &relay);
+  }
+  ASSERT_EQ(&tools::threadpool::getInstance(), &block);
+}
+
+TEST(threadpool, nested_tasks_stay_in_pool)
+{
+  std::shared_ptr<tools::threadpool> tpool(tools::threadpool::getNewForUnitTests(4));
+  tools::threadpool::waiter waiter;
+  std::atomic<int> elsewhere(0);
+  for (int i = 0; i < 100; ++i)
+  {
+    tpool->submit(&waiter, [&](){
+      epee::misc_utils::sleep_no_w(1);
+      if (&tools::threadpool::getInstance() != tpool.get())
+        ++elsewhere;
+    });
+  }
+  waiter.wait(tpool.get());
+  // tasks run by the submitting thread itself are not on a worker
+  ASSERT_LT(elsewhere, 100);
+}
+
+TEST(threadpool, configure_rejects_malformed)
+{
+  ASSERT_TRUE(tools::threadpool::configure_from_args({}, {}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({"relay"}, {}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({"relay:"}, {}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({"relay:x"}, {}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({"foo:2"}, {}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({"relay:-1"}, {}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({}, {"block:3-1"}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({}, {"block:0,,1"}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({}, {"block:0-"}));
+  ASSERT_FALSE(tools::threadpool::configure_from_args({"relay:2"}, {"background:a"}));
+}
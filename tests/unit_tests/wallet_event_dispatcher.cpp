@@ -0,0 +1,87 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+#include <atomic>
+#include <boost/thread/thread.hpp>
+#include "gtest/gtest.h"
+#include "wallet/event_dispatcher.h"
+
+namespace
+{
+  tools::wallet_event make_event(uint64_t height)
+  {
+    return {tools::wallet_event::new_block, height, crypto::null_hash, 0, {}};
+  }
+}
+
+TEST(wallet_event_dispatcher, delivers_in_order)
+{
+  std::vector<uint64_t> heights;
+  tools::event_dispatcher dispatcher([&heights](const std::vector<tools::wallet_event> &events) {
+    for (const auto &e: events)
+      heights.push_back(e.height);
+  });
+  for (uint64_t batch = 0; batch < 10; ++batch)
+  {
+    std::vector<tools::wallet_event> events;
+    for (uint64_t i = 0; i < 10; ++i)
+      events.push_back(make_event(batch * 10 + i));
+    dispatcher.post(std::move(events));
+  }
+  dispatcher.wait_idle();
+  ASSERT_EQ(heights.size(), 100);
+  for (size_t i = 0; i < heights.size(); ++i)
+    ASSERT_EQ(heights[i], i);
+}
+
+TEST(wallet_event_dispatcher, slow_listener_does_not_block_post)
+{
+  std::atomic<bool> release(false);
+  std::atomic<size_t> calls(0), delivered(0);
+  tools::event_dispatcher dispatcher([&](const std::vector<tools::wallet_event> &events) {
+    while (!release)
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    ++calls;
+    delivered += events.size();
+  });
+  // the first batch holds the listener, the others pile up and get merged
+  for (uint64_t i = 0; i < 50; ++i)
+    dispatcher.post({make_event(i)});
+  release = true;
+  dispatcher.wait_idle();
+  ASSERT_EQ(delivered, 50);
+  ASSERT_LE(calls, 2);
+}
+
+TEST(wallet_event_dispatcher, stop_delivers_queued)
+{
+  size_t delivered = 0;
+  {
+    tools::event_dispatcher dispatcher([&delivered](const std::vector<tools::wallet_event> &events) { delivered += events.size(); });
+    dispatcher.post({make_event(0), make_event(1)});
+  }
+  ASSERT_EQ(delivered, 2);
+}
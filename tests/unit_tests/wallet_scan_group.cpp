@@ -0,0 +1,111 @@
+// Copyright (c) 2018-2019, The Electroneum Classic Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "ringct/rctOps.h"
+#include "wallet/scan_group.h"
+
+namespace
+{
+  std::vector<crypto::public_key> make_tx_pubkeys(size_t count)
+  {
+    std::vector<crypto::public_key> pkeys(count);
+    crypto::secret_key sec;
+    for (auto &pkey: pkeys)
+      crypto::generate_keys(pkey, sec);
+    return pkeys;
+  }
+}
+
+TEST(wallet_scan_group, derives_for_each_member)
+{
+  tools::scan_group group;
+  std::vector<crypto::public_key> view_pubs(3);
+  std::vector<crypto::secret_key> view_secs(3);
+  for (size_t m = 0; m < view_pubs.size(); ++m)
+  {
+    crypto::generate_keys(view_pubs[m], view_secs[m]);
+    group.add(view_pubs[m], view_secs[m]);
+  }
+  ASSERT_EQ(group.size(), 3);
+
+  // more than a batch, with a partial last one
+  const std::vector<crypto::public_key> pkeys = make_tx_pubkeys(tools::scan_group::derivation_batch_size + 17);
+  const tools::scan_group::derivations_t derivations = group.derive(pkeys);
+  ASSERT_EQ(derivations.size(), 3);
+  for (size_t m = 0; m < view_pubs.size(); ++m)
+  {
+    const auto i = derivations.find(view_pubs[m]);
+    ASSERT_TRUE(i != derivations.end());
+    ASSERT_EQ(i->second->size(), pkeys.size());
+    for (size_t k = 0; k < pkeys.size(); ++k)
+    {
+      crypto::key_derivation expected;
+      ASSERT_TRUE(crypto::generate_key_derivation(pkeys[k], view_secs[m], expected));
+      ASSERT_EQ(memcmp(&(*i->second)[k], &expected, sizeof(expected)), 0);
+    }
+  }
+}
+
+TEST(wallet_scan_group, shared_keys_are_counted)
+{
+  tools::scan_group group;
+  crypto::public_key view_pub;
+  crypto::secret_key view_sec;
+  crypto::generate_keys(view_pub, view_sec);
+
+  group.add(view_pub, view_sec);
+  group.add(view_pub, view_sec);
+  ASSERT_EQ(group.size(), 1);
+  group.remove(view_pub);
+  ASSERT_TRUE(group.has(view_pub));
+  group.remove(view_pub);
+  ASSERT_FALSE(group.has(view_pub));
+  ASSERT_TRUE(group.derive(make_tx_pubkeys(4)).empty());
+}
+
+TEST(wallet_scan_group, invalid_key_derives_identity)
+{
+  tools::scan_group group;
+  crypto::public_key view_pub;
+  crypto::secret_key view_sec;
+  crypto::generate_keys(view_pub, view_sec);
+  group.add(view_pub, view_sec);
+
+  std::vector<crypto::public_key> pkeys = make_tx_pubkeys(3);
+  // not a point
+  memset(&pkeys[1], 0xff, sizeof(pkeys[1]));
+  const tools::scan_group::derivations_t derivations = group.derive(pkeys);
+  const std::vector<crypto::key_derivation> &d = *derivations.at(view_pub);
+  ASSERT_EQ(d.size(), 3);
+  ASSERT_EQ(memcmp(&d[1], rct::identity().bytes, sizeof(d[1])), 0);
+  crypto::key_derivation expected;
+  ASSERT_TRUE(crypto::generate_key_derivation(pkeys[2], view_sec, expected));
+  ASSERT_EQ(memcmp(&d[2], &expected, sizeof(expected)), 0);
+}